@@ -0,0 +1,475 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * Bench.cpp
+ *
+ * Benchmark runner and entry point of the benchmark suite. Build it with the
+ * 'bench' target of the usual Makefile, e.g.:
+ *
+ *  make -f Makefiles/Makefile.UNIX bench
+ *
+ * and run bin/supermodel-bench. The command line follows Google Benchmark's:
+ *
+ *  --benchmark_filter=<regex>        Run only the benchmarks whose names match
+ *  --benchmark_list_tests            List the benchmarks and exit
+ *  --benchmark_min_time=<seconds>    Time each for at least this long [0.5]
+ *  --benchmark_repetitions=<n>       Time each n times and add mean, median
+ *                                    and standard deviation [1]
+ *  --benchmark_format=<fmt>          console, json or csv on stdout [console]
+ *  --benchmark_out=<file>            Also write the results to a file
+ *  --benchmark_out_format=<fmt>      Format of that file [json]
+ *
+ * and the JSON is laid out as Google Benchmark writes it, so its compare.py
+ * can diff two runs, e.g. of consecutive releases. Benchmarks that need data
+ * not in the tree take it from:
+ *
+ *  --vram=<file>       Raw tile generator RAM captured from a game
+ *  --rom=<file>        ROM set zip to time GameLoader with, and of the game
+ *                      a GPU frame was captured from
+ *  --gfx-state=<file>  GPU frame captured in Supermodel (Alt+G) to render
+ *  --game-xml=<file>   Game definitions [Config/Games.xml]
+ */
+
+#include "Bench/Bench.h"
+#include "Supermodel.h"
+#include "OSD/Video.h"
+#include "SDLIncludes.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <regex>
+#include <thread>
+#include <vector>
+
+// The emulator's objects call back into the front end for these
+bool BeginFrameVideo() { return true; }
+void EndFrameVideo() {}
+void SetVideoDiscard(bool discard) {}
+
+namespace Bench
+{
+  static std::vector<Case> &Cases()
+  {
+    static std::vector<Case> cases;
+    return cases;
+  }
+
+  void Register(Case benchmark)
+  {
+    Cases().push_back(std::move(benchmark));
+  }
+
+  static volatile UINT64 s_sink;
+
+  void DoNotOptimize(UINT64 value)
+  {
+    s_sink = value;
+  }
+}
+
+using namespace Bench;
+
+struct Run
+{
+  std::string name;
+  std::string runName;
+  std::string aggregate;    // empty for a single timing
+  std::string error;
+  unsigned    repetitions = 1;
+  unsigned    repetitionIndex = 0;
+  UINT64      iterations = 0;
+  double      realTime = 0;   // ns per iteration
+  double      cpuTime = 0;
+  double      itemsPerSecond = 0;
+  double      bytesPerSecond = 0;
+};
+
+enum class Format
+{
+  Console,
+  JSON,
+  CSV
+};
+
+static bool ParseFormat(const std::string &name, Format *format)
+{
+  if (name == "console")
+    *format = Format::Console;
+  else if (name == "json")
+    *format = Format::JSON;
+  else if (name == "csv")
+    *format = Format::CSV;
+  else
+    return FAIL;
+  return OKAY;
+}
+
+// Times n iterations, growing n until they take at least minTime
+static Run Measure(const Case &c, double minTime)
+{
+  Run run;
+  run.name = run.runName = c.name;
+  UINT64 iterations = 1;
+  while (true)
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::clock_t cpuStart = std::clock();
+    c.Run(iterations);
+    std::clock_t cpuEnd = std::clock();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = double(cpuEnd - cpuStart) / CLOCKS_PER_SEC;
+    if (elapsed >= minTime || iterations >= 1000000000)
+    {
+      run.iterations = iterations;
+      run.realTime = elapsed * 1e9 / iterations;
+      run.cpuTime = cpu * 1e9 / iterations;
+      if (elapsed > 0)
+      {
+        run.itemsPerSecond = c.itemsPerRun * iterations / elapsed;
+        run.bytesPerSecond = c.bytesPerRun * iterations / elapsed;
+      }
+      return run;
+    }
+    double multiplier = elapsed > minTime / 100 ? 1.4 * minTime / elapsed : 10;
+    iterations = std::max(iterations + 1, UINT64(iterations * std::min(multiplier, 10.0)));
+  }
+}
+
+static Run Aggregate(const std::vector<Run> &runs, const char *name, double (*Reduce)(std::vector<double>))
+{
+  Run result = runs[0];
+  result.name = runs[0].runName + "_" + name;
+  result.aggregate = name;
+  result.repetitions = unsigned(runs.size());
+  std::vector<double> values;
+  for (auto &r: runs) values.push_back(r.realTime);
+  result.realTime = Reduce(values);
+  values.clear();
+  for (auto &r: runs) values.push_back(r.cpuTime);
+  result.cpuTime = Reduce(values);
+  values.clear();
+  for (auto &r: runs) values.push_back(r.itemsPerSecond);
+  result.itemsPerSecond = Reduce(values);
+  values.clear();
+  for (auto &r: runs) values.push_back(r.bytesPerSecond);
+  result.bytesPerSecond = Reduce(values);
+  return result;
+}
+
+static double Mean(std::vector<double> v)
+{
+  double sum = 0;
+  for (double x: v) sum += x;
+  return sum / v.size();
+}
+
+static double Median(std::vector<double> v)
+{
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static double StdDev(std::vector<double> v)
+{
+  if (v.size() < 2)
+    return 0;
+  double mean = Mean(v), sum = 0;
+  for (double x: v) sum += (x - mean) * (x - mean);
+  return std::sqrt(sum / (v.size() - 1));
+}
+
+/******************************************************************************
+ Output
+******************************************************************************/
+
+static std::string Rate(double perSecond)
+{
+  static const char *suffix[] = { "", "k", "M", "G", "T" };
+  int i = 0;
+  while (perSecond >= 1000 && i < 4)
+  {
+    perSecond /= 1000;
+    i++;
+  }
+  char buf[32];
+  sprintf(buf, "%.4g%s/s", perSecond, suffix[i]);
+  return buf;
+}
+
+static std::string JSONString(const std::string &s)
+{
+  std::string out = "\"";
+  for (char c: s)
+  {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out + "\"";
+}
+
+static void WriteHeader(FILE *fp, Format format, const char *executable)
+{
+  if (format == Format::Console)
+  {
+    fprintf(fp, "%-44s %15s %15s %12s %12s\n", "Benchmark", "Time", "CPU", "Iterations", "Items/s");
+    fprintf(fp, "%s\n", std::string(102, '-').c_str());
+  }
+  else if (format == Format::CSV)
+    fprintf(fp, "name,iterations,real_time,cpu_time,time_unit,bytes_per_second,items_per_second,label,error_occurred,error_message\n");
+  else
+  {
+    char date[64];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    fprintf(fp, "{\n  \"context\": {\n");
+    fprintf(fp, "    \"date\": \"%s\",\n", date);
+    fprintf(fp, "    \"executable\": %s,\n", JSONString(executable).c_str());
+    fprintf(fp, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(fp, "    \"supermodel_version\": %s,\n", JSONString(SUPERMODEL_VERSION).c_str());
+#ifdef DEBUG
+    fprintf(fp, "    \"library_build_type\": \"debug\"\n");
+#else
+    fprintf(fp, "    \"library_build_type\": \"release\"\n");
+#endif
+    fprintf(fp, "  },\n  \"benchmarks\": [");
+  }
+}
+
+static void WriteRun(FILE *fp, Format format, const Run &run, bool first)
+{
+  if (format == Format::Console)
+  {
+    if (!run.error.empty())
+      fprintf(fp, "%-44s ERROR OCCURRED: '%s'\n", run.name.c_str(), run.error.c_str());
+    else
+      fprintf(fp, "%-44s %12.0f ns %12.0f ns %12llu %12s\n", run.name.c_str(), run.realTime, run.cpuTime,
+        (unsigned long long) run.iterations, run.itemsPerSecond > 0 ? Rate(run.itemsPerSecond).c_str() : "");
+  }
+  else if (format == Format::CSV)
+  {
+    fprintf(fp, "\"%s\",%llu,%g,%g,ns,", run.name.c_str(), (unsigned long long) run.iterations, run.realTime, run.cpuTime);
+    if (run.bytesPerSecond > 0) fprintf(fp, "%g", run.bytesPerSecond);
+    fprintf(fp, ",");
+    if (run.itemsPerSecond > 0) fprintf(fp, "%g", run.itemsPerSecond);
+    fprintf(fp, ",,%s,\"%s\"\n", run.error.empty() ? "" : "true", run.error.c_str());
+  }
+  else
+  {
+    fprintf(fp, "%s\n    {\n", first ? "" : ",");
+    fprintf(fp, "      \"name\": %s,\n", JSONString(run.name).c_str());
+    fprintf(fp, "      \"run_name\": %s,\n", JSONString(run.runName).c_str());
+    fprintf(fp, "      \"run_type\": \"%s\",\n", run.aggregate.empty() ? "iteration" : "aggregate");
+    fprintf(fp, "      \"repetitions\": %u,\n", run.repetitions);
+    if (run.aggregate.empty())
+      fprintf(fp, "      \"repetition_index\": %u,\n", run.repetitionIndex);
+    else
+      fprintf(fp, "      \"aggregate_name\": \"%s\",\n", run.aggregate.c_str());
+    fprintf(fp, "      \"threads\": 1,\n");
+    if (!run.error.empty())
+    {
+      fprintf(fp, "      \"error_occurred\": true,\n");
+      fprintf(fp, "      \"error_message\": %s\n    }", JSONString(run.error).c_str());
+      return;
+    }
+    fprintf(fp, "      \"iterations\": %llu,\n", (unsigned long long) run.iterations);
+    fprintf(fp, "      \"real_time\": %.6e,\n", run.realTime);
+    fprintf(fp, "      \"cpu_time\": %.6e,\n", run.cpuTime);
+    fprintf(fp, "      \"time_unit\": \"ns\"");
+    if (run.bytesPerSecond > 0)
+      fprintf(fp, ",\n      \"bytes_per_second\": %.6e", run.bytesPerSecond);
+    if (run.itemsPerSecond > 0)
+      fprintf(fp, ",\n      \"items_per_second\": %.6e", run.itemsPerSecond);
+    fprintf(fp, "\n    }");
+  }
+  fflush(fp);
+}
+
+static void WriteFooter(FILE *fp, Format format)
+{
+  if (format == Format::JSON)
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+/******************************************************************************
+ Entry Point
+******************************************************************************/
+
+static void Help(const char *name)
+{
+  printf("Usage: %s [options]\n", name);
+  puts("  --benchmark_filter=<regex>      Run only benchmarks whose names match");
+  puts("  --benchmark_list_tests          List the benchmarks and exit");
+  puts("  --benchmark_min_time=<seconds>  Minimum time to run each for [Default: 0.5]");
+  puts("  --benchmark_repetitions=<n>     Number of times to run each [Default: 1]");
+  puts("  --benchmark_format=<format>     console, json or csv [Default: console]");
+  puts("  --benchmark_out=<file>          Also write results to a file");
+  puts("  --benchmark_out_format=<format> Format of that file [Default: json]");
+  puts("  --vram=<file>                   Tile generator RAM to draw (0x120000 bytes)");
+  puts("  --rom=<file>                    ROM set to time loading, and of --gfx-state");
+  puts("  --gfx-state=<file>              GPU frame capture to render with the 3D engines");
+  puts("  --game-xml=<file>               Game definitions [Default: Config/Games.xml]");
+}
+
+int main(int argc, char **argv)
+{
+  std::string filter = ".";
+  bool list = false;
+  double minTime = 0.5;
+  unsigned repetitions = 1;
+  Format format = Format::Console;
+  Format outFormat = Format::JSON;
+  std::string outFile;
+  Inputs inputs;
+  inputs.gameXML = "Config/Games.xml";
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    std::string option = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    bool ok = true;
+    if (option == "--benchmark_filter")
+      filter = value;
+    else if (option == "--benchmark_list_tests")
+      list = value.empty() || value == "true";
+    else if (option == "--benchmark_min_time")
+      ok = (minTime = atof(value.c_str())) > 0;
+    else if (option == "--benchmark_repetitions")
+      ok = (repetitions = unsigned(atoi(value.c_str()))) > 0;
+    else if (option == "--benchmark_format")
+      ok = ParseFormat(value, &format) == OKAY;
+    else if (option == "--benchmark_out")
+      outFile = value;
+    else if (option == "--benchmark_out_format")
+      ok = ParseFormat(value, &outFormat) == OKAY;
+    else if (option == "--vram")
+      inputs.vramFile = value;
+    else if (option == "--rom")
+      inputs.romFile = value;
+    else if (option == "--gfx-state")
+      inputs.gfxState = value;
+    else if (option == "--game-xml")
+      inputs.gameXML = value;
+    else if (option == "-h" || option == "--help")
+    {
+      Help(argv[0]);
+      return 0;
+    }
+    else
+      ok = false;
+    if (!ok)
+    {
+      fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+      Help(argv[0]);
+      return 1;
+    }
+  }
+
+  RegisterCPUBenchmarks(inputs);
+  RegisterSoundBenchmarks(inputs);
+  RegisterModel3Benchmarks(inputs);
+  RegisterGraphicsBenchmarks(inputs);
+
+  std::regex pattern;
+  try
+  {
+    pattern = std::regex(filter);
+  }
+  catch (const std::regex_error &)
+  {
+    fprintf(stderr, "Invalid filter: %s\n", filter.c_str());
+    return 1;
+  }
+  std::vector<const Case *> selected;
+  for (const Case &c: Cases())
+  {
+    if (std::regex_search(c.name, pattern))
+      selected.push_back(&c);
+  }
+  if (list)
+  {
+    for (const Case *c: selected)
+      printf("%s\n", c->name.c_str());
+    return 0;
+  }
+
+  FILE *out = NULL;
+  if (!outFile.empty() && (out = fopen(outFile.c_str(), "w")) == NULL)
+  {
+    fprintf(stderr, "Unable to write %s\n", outFile.c_str());
+    return 1;
+  }
+  WriteHeader(stdout, format, argv[0]);
+  if (out)
+    WriteHeader(out, outFormat, argv[0]);
+
+  bool first = true;
+  auto Report = [&](const Run &run)
+  {
+    WriteRun(stdout, format, run, first);
+    if (out)
+      WriteRun(out, outFormat, run, first);
+    first = false;
+  };
+
+  for (const Case *c: selected)
+  {
+    std::string error = c->Setup ? c->Setup() : "";
+    if (!error.empty())
+    {
+      Run run;
+      run.name = run.runName = c->name;
+      run.error = error;
+      Report(run);
+      continue;
+    }
+    std::vector<Run> runs;
+    for (unsigned i = 0; i < repetitions; i++)
+    {
+      runs.push_back(Measure(*c, minTime));
+      runs.back().repetitions = repetitions;
+      runs.back().repetitionIndex = i;
+      Report(runs.back());
+    }
+    if (repetitions > 1)
+    {
+      Report(Aggregate(runs, "mean", Mean));
+      Report(Aggregate(runs, "median", Median));
+      Report(Aggregate(runs, "stddev", StdDev));
+    }
+    if (c->Teardown)
+      c->Teardown();
+  }
+
+  WriteFooter(stdout, format);
+  if (out)
+  {
+    WriteFooter(out, outFormat);
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * Bench.h
+ *
+ * Header file for the micro-benchmark suite built by the 'bench' make target.
+ * It links the emulator's own objects (everything but the SDL front end's
+ * entry point) and times the CPU cores and device kernels in isolation.
+ */
+
+#ifndef INCLUDED_BENCH_H
+#define INCLUDED_BENCH_H
+
+#include "Types.h"
+#include <functional>
+#include <string>
+
+namespace Bench
+{
+  /*
+   * Captured data that some benchmarks run on. Empty if not given, in which
+   * case they use generated data or are skipped.
+   */
+  struct Inputs
+  {
+    std::string vramFile;   // raw tile generator RAM (VRAM and palette, 0x120000 bytes)
+    std::string romFile;    // ROM set zip file, for GameLoader and the 3D renderers
+    std::string gfxState;   // GPU frame captured with Alt+G, to render again
+    std::string gameXML;    // game definitions for the ROM set
+  };
+
+  /*
+   * A benchmark. Setup() is called once before the case is timed and returns
+   * an empty string, or the reason the case cannot run (reported as an error
+   * and skipped). Run(n) then repeats the work measured n times, as often as
+   * needed, and Teardown() releases what Setup() made. One repetition
+   * processes the given number of items (cycles emulated, samples, words,
+   * ...) and bytes, from which the rates are worked out; either may be 0.
+   */
+  struct Case
+  {
+    std::string                         name;
+    std::function<std::string(void)>    Setup;
+    std::function<void(UINT64)>         Run;
+    std::function<void(void)>           Teardown;
+    double                              itemsPerRun = 0;
+    double                              bytesPerRun = 0;
+  };
+
+  /*
+   * Adds a benchmark to the suite. Names are of the form
+   * "component/kernel/variant" so that --benchmark_filter can pick groups.
+   */
+  void Register(Case benchmark);
+
+  // Each group of benchmarks registers its cases
+  void RegisterCPUBenchmarks(const Inputs &inputs);
+  void RegisterSoundBenchmarks(const Inputs &inputs);
+  void RegisterModel3Benchmarks(const Inputs &inputs);
+  void RegisterGraphicsBenchmarks(const Inputs &inputs);
+
+  /*
+   * Keeps the compiler from optimizing away a result that is otherwise
+   * unused.
+   */
+  void DoNotOptimize(UINT64 value);
+}
+
+#endif  // INCLUDED_BENCH_H
@@ -0,0 +1,344 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * BenchCPU.cpp
+ *
+ * CPU core throughput: the PowerPC under each execution engine, the 68K under
+ * each engine and the Z80. Each runs a loop of code in the style of game code
+ * (integer arithmetic, loads and stores, and calls and branches for the
+ * PowerPC) out of RAM; items are emulated cycles.
+ */
+
+#include "Bench/Bench.h"
+#include "Supermodel.h"
+#include <vector>
+
+using namespace Bench;
+
+static const int SLICE = 100000;  // cycles per call into a core, as in a frame
+
+/******************************************************************************
+ PowerPC
+******************************************************************************/
+
+static const UINT32 PPC_DATA = 0x10000;
+
+static UINT8 s_ppcRAM[0x800000];  // stored as byte-reversed words, like CModel3
+static UINT8 s_ppcROM[0x100000];  // reset vector at 0xFFF00100
+static PPC_CONTEXT *s_ppcCtx = NULL;
+
+static UINT32 D(int opcd, int rt, int ra, int d)      { return (opcd << 26) | (rt << 21) | (ra << 16) | (d & 0xFFFF); }
+static UINT32 X(int xo, int rt, int ra, int rb)       { return (31u << 26) | (rt << 21) | (ra << 16) | (rb << 11) | (xo << 1); }
+static UINT32 RLWINM(int ra, int rs, int sh, int mb, int me) { return (21u << 26) | (rs << 21) | (ra << 16) | (sh << 11) | (mb << 6) | (me << 1); }
+static UINT32 B(int offset, bool link)                { return (18u << 26) | (offset & 0x3FFFFFC) | (link ? 1 : 0); }
+static UINT32 BC(int bo, int bi, int offset)          { return (16u << 26) | (bo << 21) | (bi << 16) | (offset & 0xFFFC); }
+
+static void Store(UINT8 *mem, UINT32 offset, UINT32 word)
+{
+  *(UINT32 *) &mem[offset] = word;
+}
+
+// Loop bodies, each followed by a branch back to its start
+static std::vector<UINT32> PPCALUSnippet()
+{
+  std::vector<UINT32> code;
+  for (int i = 0; i < 16; i++)
+  {
+    int r = 5 + (i & 7);
+    code.push_back(X(266, r, 5 + ((i + 1) & 7), 5 + ((i + 2) & 7)));   // add
+    code.push_back(RLWINM(r, r, 3, 0, 28));                           // rlwinm
+    code.push_back(X(316, 5 + ((i + 3) & 7), r, 4));                  // xor (rS in rt position)
+    code.push_back(X(235, 13 + (i & 3), r, 5 + ((i + 5) & 7)));       // mullw
+    code.push_back(D(14, r, r, i + 1));                               // addi
+    code.push_back(X(0, 0, r, 4));                                    // cmpw cr0
+  }
+  return code;
+}
+
+static std::vector<UINT32> PPCLoadStoreSnippet()
+{
+  std::vector<UINT32> code;
+  for (int i = 0; i < 16; i++)
+  {
+    int r = 5 + (i & 7);
+    code.push_back(D(32, r, 3, 4 * i));            // lwz
+    code.push_back(D(36, r, 3, 0x100 + 4 * i));    // stw
+    code.push_back(D(40, r + 8, 3, 2 * i));        // lhz
+    code.push_back(D(44, r + 8, 3, 0x200 + 2 * i));// sth
+    code.push_back(D(34, 4, 3, i));                // lbz
+    code.push_back(D(38, 4, 3, 0x300 + i));        // stb
+  }
+  return code;
+}
+
+// Tests, taken and untaken conditional branches and calls to a leaf
+// function placed after the loop
+static std::vector<UINT32> PPCBranchSnippet(size_t *functionOffset)
+{
+  std::vector<UINT32> code;
+  std::vector<size_t> calls;
+  for (int i = 0; i < 16; i++)
+  {
+    code.push_back(D(14, 5, 5, 1));                // addi r5,r5,1
+    code.push_back(D(28, 5, 0, 1));                // andi. r0,r5,1
+    code.push_back(BC(4, 2, 8));                   // bne +8 (taken every other time)
+    code.push_back(D(14, 6, 6, 1));                // addi r6,r6,1
+    calls.push_back(code.size());
+    code.push_back(0);                             // bl function
+  }
+  *functionOffset = code.size() + 1;               // after the loop branch
+  for (size_t call: calls)
+    code[call] = B(int(4 * (*functionOffset - call)), true);
+  return code;
+}
+
+static std::string SetupPPC(PPC_ENGINE engine, const char *snippet)
+{
+  memset(s_ppcRAM, 0, sizeof(s_ppcRAM));
+  memset(s_ppcROM, 0, sizeof(s_ppcROM));
+  Store(s_ppcROM, 0x100, 0x48000102);           // ba 0x100
+  for (UINT32 i = 0; i < 0x400; i += 4)
+    Store(s_ppcRAM, PPC_DATA + i, i * 0x9E3779B9);
+
+  std::vector<UINT32> code;
+  code.push_back(D(15, 3, 0, PPC_DATA >> 16));  // lis r3,PPC_DATA>>16
+  code.push_back(D(14, 4, 0, 0x1234));          // li r4,0x1234
+  size_t loop = code.size();
+  size_t function = 0;
+  std::vector<UINT32> body = !strcmp(snippet, "alu") ? PPCALUSnippet() : !strcmp(snippet, "loadstore") ? PPCLoadStoreSnippet() : PPCBranchSnippet(&function);
+  code.insert(code.end(), body.begin(), body.end());
+  code.push_back(B(-4 * int(code.size() - loop), false));
+  if (function)
+  {
+    code.push_back(D(14, 7, 7, 3));             // function: addi r7,r7,3
+    code.push_back(0x4E800020);                 //           blr
+  }
+  for (size_t i = 0; i < code.size(); i++)
+    Store(s_ppcRAM, 0x100 + 4 * i, code[i]);
+
+  static IBus bus;
+  static PPC_FETCH_REGION fetch[3];
+  PPC_CONFIG config;
+  config.pvr = PPC_MODEL_603R;
+  config.bus_frequency = BUS_FREQUENCY_66MHZ;
+  config.bus_frequency_multiplier = 0x25;
+  if (s_ppcCtx == NULL)
+    s_ppcCtx = ppc_create_context();
+  ppc_set_context(s_ppcCtx);
+  ppc_attach_bus(&bus);
+  ppc_init(&config);
+  fetch[0] = { 0x00000000, 0x007FFFFF, (UINT32 *) s_ppcRAM };
+  fetch[1] = { 0xFFF00000, 0xFFFFFFFF, (UINT32 *) s_ppcROM };
+  fetch[2] = { 0, 0, NULL };
+  ppc_set_fetch(fetch);
+  ppc_map_memory(0x00000000, 0x007FFFFF, s_ppcRAM, true);
+  if (!ppc_set_engine(engine))
+  {
+    ppc_shutdown();
+    return "engine not available on this host";
+  }
+  ppc_reset();
+  return "";
+}
+
+/******************************************************************************
+ 68K
+******************************************************************************/
+
+// 1 MB of RAM in 16-bit host-order words, as M68KMapRAM() expects, which the
+// bus also reads for the reference engine
+class CBench68KBus: public IBus
+{
+public:
+  UINT8 ram[0x100000];
+
+  UINT16 Read16(UINT32 addr)
+  {
+    return *(UINT16 *) &ram[addr & 0xFFFFE];
+  }
+
+  UINT8 Read8(UINT32 addr)
+  {
+    return UINT8(Read16(addr) >> ((addr & 1) ? 0 : 8));
+  }
+
+  UINT32 Read32(UINT32 addr)
+  {
+    return (UINT32(Read16(addr)) << 16) | Read16(addr + 2);
+  }
+
+  void Write16(UINT32 addr, UINT16 data)
+  {
+    *(UINT16 *) &ram[addr & 0xFFFFE] = data;
+  }
+
+  void Write8(UINT32 addr, UINT8 data)
+  {
+    UINT16 word = Read16(addr);
+    Write16(addr, (addr & 1) ? ((word & 0xFF00) | data) : ((word & 0x00FF) | (data << 8)));
+  }
+
+  void Write32(UINT32 addr, UINT32 data)
+  {
+    Write16(addr, UINT16(data >> 16));
+    Write16(addr + 2, UINT16(data));
+  }
+};
+
+static CBench68KBus s_68kBus;
+static M68KCtx s_68kCtx;
+
+// Sums a table into a checksum, writing out each step
+static std::string Setup68K(const char *engine)
+{
+  static const UINT16 program[] =
+  {
+    0x41F8, 0x1000,   // start: lea     $1000.w,a0
+    0x43F8, 0x4000,   //        lea     $4000.w,a1
+    0x363C, 0x00FF,   //        move.w  #255,d3
+    0xD058,           // loop:  add.w   (a0)+,d0
+    0xB141,           //        eor.w   d0,d1
+    0xE349,           //        lsl.w   #1,d1
+    0x5242,           //        addq.w  #1,d2
+    0x32C1,           //        move.w  d1,(a1)+
+    0x51CB, 0xFFF4,   //        dbra    d3,loop
+    0x6000, 0xFFE4    //        bra     start
+  };
+  memset(s_68kBus.ram, 0, sizeof(s_68kBus.ram));
+  s_68kBus.Write32(0, 0x00080000);    // initial SSP
+  s_68kBus.Write32(4, 0x00000400);    // initial PC
+  for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); i++)
+    s_68kBus.Write16(0x400 + 2 * UINT32(i), program[i]);
+  for (UINT32 i = 0; i < 0x200; i += 2)
+    s_68kBus.Write16(0x1000 + i, UINT16(i * 0x9E37));
+
+  M68KSetContext(&s_68kCtx);
+  M68KInit();
+  M68KAttachBus(&s_68kBus);
+  M68KMapRAM(0x000000, 0x0FFFFF, s_68kBus.ram, 0x0FFFFF);
+  if (OKAY != M68KSetEngine(engine))
+    return "engine not available";
+  M68KReset();
+  return "";
+}
+
+/******************************************************************************
+ Z80
+******************************************************************************/
+
+class CBenchZ80Bus: public IBus
+{
+public:
+  UINT8 mem[0x10000];
+
+  UINT8 Read8(UINT32 addr)
+  {
+    return mem[addr & 0xFFFF];
+  }
+
+  void Write8(UINT32 addr, UINT8 data)
+  {
+    mem[addr & 0xFFFF] = data;
+  }
+};
+
+static CBenchZ80Bus s_z80Bus;
+static CZ80 s_z80;
+
+// Sums and rotates a table, over and over
+static std::string SetupZ80(void)
+{
+  static const UINT8 loop[] =
+  {
+    0x21, 0x00, 0x40,             // loop: LD HL,4000h
+    0x06, 0x00,                   //       LD B,0
+    0xAF,                         //       XOR A
+    0x86,                         // next: ADD A,(HL)
+    0x8E,                         //       ADC A,(HL)
+    0xAE,                         //       XOR (HL)
+    0x96,                         //       SUB (HL)
+    0xBE,                         //       CP (HL)
+    0xE6, 0x7F,                   //       AND 7Fh
+    0xB1,                         //       OR C
+    0x4F,                         //       LD C,A
+    0x0C,                         //       INC C
+    0x15,                         //       DEC D
+    0xCB, 0x11,                   //       RL C
+    0xCB, 0x3A,                   //       SRL D
+    0x23,                         //       INC HL
+    0x10, 0xEE,                   //       DJNZ next
+    0x18, 0xE6                    //       JR loop
+  };
+  for (int i = 0; i < 0x10000; i++)
+    s_z80Bus.mem[i] = UINT8(i * 0x9E3779B9 >> 24);
+  memcpy(s_z80Bus.mem, loop, sizeof(loop));
+  s_z80.Init(&s_z80Bus, NULL);
+  s_z80.Reset();
+  return "";
+}
+
+/******************************************************************************
+ Registration
+******************************************************************************/
+
+void Bench::RegisterCPUBenchmarks(const Inputs &inputs)
+{
+  static const struct { PPC_ENGINE engine; const char *name; } ppcEngines[] =
+  {
+    { PPC_ENGINE_INTERPRETER, "interpreter" },
+    { PPC_ENGINE_THREADED,    "threaded" },
+    { PPC_ENGINE_JIT,         "jit" }
+  };
+  static const char *ppcSnippets[] = { "alu", "loadstore", "branch" };
+  for (const char *snippet: ppcSnippets)
+  {
+    for (auto &e: ppcEngines)
+    {
+      Case c;
+      c.name = std::string("ppc/") + snippet + "/" + e.name;
+      PPC_ENGINE engine = e.engine;
+      c.Setup = [engine, snippet]() { return SetupPPC(engine, snippet); };
+      c.Run = [](UINT64 n) { for (UINT64 i = 0; i < n; i++) ppc_execute(SLICE); };
+      c.Teardown = []() { ppc_shutdown(); };
+      c.itemsPerRun = SLICE;
+      Register(c);
+    }
+  }
+
+  static const char *m68kEngines[] = { "musashi", "fast" };
+  for (const char *engine: m68kEngines)
+  {
+    Case c;
+    c.name = std::string("68k/alu/") + engine;
+    c.Setup = [engine]() { return Setup68K(engine); };
+    c.Run = [](UINT64 n) { M68KSetContext(&s_68kCtx); for (UINT64 i = 0; i < n; i++) M68KRun(SLICE); };
+    c.itemsPerRun = SLICE;
+    Register(c);
+  }
+
+  Case z80;
+  z80.name = "z80/alu";
+  z80.Setup = SetupZ80;
+  z80.Run = [](UINT64 n) { for (UINT64 i = 0; i < n; i++) s_z80.Run(SLICE); };
+  z80.itemsPerRun = SLICE;
+  Register(z80);
+}
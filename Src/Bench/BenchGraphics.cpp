@@ -0,0 +1,513 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * BenchGraphics.cpp
+ *
+ * Renderer benchmarks. Those that draw run in a hidden OpenGL window and are
+ * skipped if no OpenGL context can be had; their items are frames.
+ *
+ *  render2d/pre_render_frame/...   Drawing all four tilemap layers for a
+ *                                  frame, on the CPU and with the tilemap
+ *                                  shader. The tile generator RAM is the
+ *                                  capture given with --vram (a raw dump of
+ *                                  VRAM and palette RAM, 0x120000 bytes) or
+ *                                  else random tiles. Every line is redrawn
+ *                                  each frame.
+ *  render3d/frame/...              Rendering a whole frame captured in
+ *                                  Supermodel with Alt+G (--gfx-state) again,
+ *                                  tilemaps included, with the new and legacy
+ *                                  3D engines. Needs the game's ROM set
+ *                                  (--rom) for its VROM. The new engine's
+ *                                  memory allocations after the first frame
+ *                                  are reported, and should be none.
+ *  new3d/decode_vertices/...       Decoding models of random polygon
+ *                                  vertices one field at a time, as
+ *                                  CNew3D::CacheModel() used to ("one"), and
+ *                                  a model at a time with each version of
+ *                                  SIMDMath::DecodeVertices() the CPU
+ *                                  supports. Each version must give the
+ *                                  same results as the first bit for bit.
+ *                                  Items are vertices.
+ */
+
+#include "Bench/Bench.h"
+#include "Supermodel.h"
+#include "Graphics/Render2D.h"
+#include "Graphics/New3D/New3D.h"
+#include "Graphics/Legacy3D/Legacy3D.h"
+#include "Graphics/New3D/SIMDMath.h"
+#include "Model3/Model3GraphicsState.h"
+#include "GameLoader.h"
+#include "BlockFile.h"
+#include "SDLIncludes.h"
+#include <GL/glew.h>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace Bench;
+
+static const unsigned VRAM_SIZE = 0x120000;
+
+static SDL_Window *s_window = NULL;
+static SDL_GLContext s_context = NULL;
+static Util::Config::Node s_render2DConfig("Global");
+static std::unique_ptr<CRender2D> s_render2D;
+static std::unique_ptr<UINT8[]> s_vram;
+static std::unique_ptr<UINT32[]> s_palette[2];
+static UINT32 s_regs[64];
+
+static std::string CreateContext(void)
+{
+  if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    return std::string("unable to initialize SDL video: ") + SDL_GetError();
+  SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
+  SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
+  SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
+  SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+  SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+  SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+  s_window = SDL_CreateWindow("Supermodel Benchmark", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 496, 384, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+  if (!s_window)
+    return std::string("unable to create an OpenGL window: ") + SDL_GetError();
+  s_context = SDL_GL_CreateContext(s_window);
+  if (!s_context)
+    return std::string("unable to create an OpenGL context: ") + SDL_GetError();
+  SDL_GL_MakeCurrent(s_window, s_context);
+  glewExperimental = GL_TRUE;
+  GLenum err = glewInit();
+  if (GLEW_OK != err)
+    return std::string("unable to initialize GLEW: ") + (const char *) glewGetErrorString(err);
+  return "";
+}
+
+static void DestroyContext(void)
+{
+  if (s_context)
+    SDL_GL_DeleteContext(s_context);
+  if (s_window)
+    SDL_DestroyWindow(s_window);
+  s_context = NULL;
+  s_window = NULL;
+  SDL_QuitSubSystem(SDL_INIT_VIDEO);
+}
+
+// As CTileGen::WritePalette(), with no color offsets
+static UINT32 ConvertColor(UINT32 data)
+{
+  if ((data & 0x8000))
+    return 0;
+  UINT32 b = (((data >> 10) & 0x1F) * 255) / 31;
+  UINT32 g = (((data >> 5) & 0x1F) * 255) / 31;
+  UINT32 r = ((data & 0x1F) * 255) / 31;
+  return 0xFF000000 | (b << 16) | (g << 8) | r;
+}
+
+static std::string LoadVRAM(const std::string &file)
+{
+  s_vram.reset(new UINT8[VRAM_SIZE]());
+  if (!file.empty())
+  {
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (!fp)
+      return "unable to open " + file;
+    size_t n = fread(s_vram.get(), 1, VRAM_SIZE, fp);
+    fclose(fp);
+    if (n != VRAM_SIZE)
+      return file + " is not a tile generator RAM capture (0x120000 bytes)";
+  }
+  else
+  {
+    // Random tiles, name tables and colors, with the scroll tables cleared
+    // so that the layers are drawn unscrolled
+    unsigned seed = 12345;
+    UINT32 *vram = (UINT32 *) s_vram.get();
+    for (unsigned i = 0; i < VRAM_SIZE / 4; i++)
+    {
+      seed = seed * 1664525 + 1013904223;
+      vram[i] = seed & 0x7FFF7FFF;
+    }
+    memset(&s_vram[0xF6000], 0, 0x1000);  // horizontal scroll tables
+    memset(&s_vram[0xF7000], 0xFF, 0x1000); // layer mask: primary layers
+  }
+
+  for (int i = 0; i < 2; i++)
+    s_palette[i].reset(new UINT32[0x8000]);
+  const UINT32 *palRAM = (const UINT32 *) &s_vram[0x100000];
+  for (unsigned i = 0; i < 0x8000; i++)
+    s_palette[0][i] = s_palette[1][i] = ConvertColor(palRAM[i]);
+  return "";
+}
+
+static void TeardownRender2D(void);
+
+static std::string SetupRender2D(const Inputs &inputs, bool gpuTilemaps)
+{
+  std::string error = CreateContext();
+  if (error.empty())
+    error = LoadVRAM(inputs.vramFile);
+  if (!error.empty())
+  {
+    TeardownRender2D();
+    return error;
+  }
+
+  // All layers enabled, 8-bit color
+  memset(s_regs, 0, sizeof(s_regs));
+  for (int i = 0; i < 4; i++)
+    s_regs[0x60/4 + i] = 0x80000000;
+
+  s_render2DConfig.Set("VertexShader2D", "");
+  s_render2DConfig.Set("FragmentShader2D", "");
+  s_render2DConfig.Set("GPUTilemaps", gpuTilemaps);
+  s_render2DConfig.Set("WideBackground", false);
+  s_render2D.reset(new CRender2D(s_render2DConfig));
+  if (OKAY != s_render2D->Init(0, 0, 496, 384, 496, 384))
+  {
+    TeardownRender2D();
+    return "CRender2D::Init failed";
+  }
+  const UINT32 *palettes[2] = { s_palette[0].get(), s_palette[1].get() };
+  s_render2D->AttachRegisters(s_regs);
+  s_render2D->AttachPalette(palettes);
+  s_render2D->AttachVRAM(s_vram.get());
+  return "";
+}
+
+static void RunRender2D(UINT64 n)
+{
+  for (UINT64 i = 0; i < n; i++)
+  {
+    s_render2D->BeginFrame();
+    s_render2D->PreRenderFrame();
+    s_render2D->EndFrame();
+  }
+  glFinish();
+}
+
+static void TeardownRender2D(void)
+{
+  s_render2D.reset();
+  s_vram.reset();
+  s_palette[0].reset();
+  s_palette[1].reset();
+  DestroyContext();
+}
+
+/******************************************************************************
+ 3D Frame Replay
+******************************************************************************/
+
+static Util::Config::Node s_render3DConfig("Global");
+static std::unique_ptr<CModel3GraphicsState> s_gfxState;
+static std::unique_ptr<IRender3D> s_render3D;
+static New3D::CNew3D *s_new3D = NULL;
+static UINT64 s_new3DAllocations;
+
+static void TeardownRender3D(void);
+
+// Returns the name of the game a GPU frame capture was made from, or an empty
+// string if the file is not one
+static std::string CapturedGame(const std::string &file)
+{
+  CBlockFile capture;
+  if (OKAY != capture.Load(file) || OKAY != capture.FindBlock("Supermodel Graphics State"))
+    return "";
+  int32_t version;
+  capture.Read(&version, sizeof(version));
+  std::string name;
+  char c;
+  while (capture.Read(&c, 1) == 1 && c != '\0')
+    name += c;
+  capture.Close();
+  return name;
+}
+
+static std::string SetupRender3D(const Inputs &inputs, bool new3D)
+{
+  if (inputs.gfxState.empty() || inputs.romFile.empty())
+    return "no GPU frame capture and ROM set given (--gfx-state, --rom)";
+  std::string captured = CapturedGame(inputs.gfxState);
+  if (captured.empty())
+    return inputs.gfxState + " is not a GPU frame capture";
+
+  Game game;
+  ROMSet roms;
+  GameLoader loader(inputs.gameXML);
+  if (OKAY != loader.Load(&game, &roms, inputs.romFile))
+    return "unable to load " + inputs.romFile;
+  if (game.name != captured)
+    return inputs.gfxState + " was captured from " + captured + ", not " + game.name;
+
+  std::string error = CreateContext();
+  if (!error.empty())
+  {
+    TeardownRender3D();
+    return error;
+  }
+
+  s_render3DConfig.Set("GPUMultiThreaded", false);
+  s_render3DConfig.Set("GPUDoubleBuffered", false);
+  s_render3DConfig.Set("MultiTexture", false);
+  s_render3DConfig.Set("QuadRendering", false);
+  s_render3DConfig.Set("WideScreen", false);
+  s_render3DConfig.Set("WideBackground", false);
+  s_render3DConfig.Set("VertexShader", "");
+  s_render3DConfig.Set("FragmentShader", "");
+  s_render3DConfig.Set("VertexShaderFog", "");
+  s_render3DConfig.Set("FragmentShaderFog", "");
+  s_render3DConfig.Set("VertexShader2D", "");
+  s_render3DConfig.Set("FragmentShader2D", "");
+
+  s_render2D.reset(new CRender2D(s_render3DConfig));
+  if (new3D)
+    s_render3D.reset(s_new3D = new New3D::CNew3D(s_render3DConfig, game.name));
+  else
+    s_render3D.reset(new Legacy3D::CLegacy3D(s_render3DConfig));
+  s_gfxState.reset(new CModel3GraphicsState(s_render3DConfig, inputs.gfxState));
+  if (OKAY != s_render2D->Init(0, 0, 496, 384, 496, 384) || OKAY != s_render3D->Init(0, 0, 496, 384, 496, 384) ||
+      OKAY != s_gfxState->Init() || OKAY != s_gfxState->LoadGame(game, roms))
+  {
+    TeardownRender3D();
+    return "unable to initialize the renderers";
+  }
+  s_gfxState->AttachRenderers(s_render2D.get(), s_render3D.get());
+  s_gfxState->Reset();  // loads the capture
+
+  // The first frame sizes New3D's per-frame structures, after which replaying
+  // the same frame should not allocate any more
+  if (s_new3D)
+  {
+    s_gfxState->RenderFrame(true);
+    s_new3DAllocations = s_new3D->GetFrameAllocations();
+  }
+  return "";
+}
+
+static void RunRender3D(UINT64 n)
+{
+  for (UINT64 i = 0; i < n; i++)
+    s_gfxState->RenderFrame(true);
+  glFinish();
+}
+
+static void TeardownRender3D(void)
+{
+  if (s_new3D && s_gfxState)
+    fprintf(stderr, "render3d/frame/new3d: %llu frame allocations after the first frame\n", (unsigned long long) (s_new3D->GetFrameAllocations() - s_new3DAllocations));
+  s_new3D = NULL;
+  s_gfxState.reset();
+  s_render3D.reset();
+  s_render2D.reset();
+  DestroyContext();
+}
+
+/******************************************************************************
+ New3D Vertex Decoding
+******************************************************************************/
+
+static const int VERTS_PER_MODEL = 256;
+static const int NUM_MODELS = 1000;
+static const float VERTEX_FACTOR = 1.0f / 128.0f;
+
+struct DecodeModel
+{
+  New3D::SIMDMath::VertexBatch  batch;
+  std::vector<int>              width, height;
+  std::vector<bool>             textured;
+};
+
+static std::vector<UINT32> s_vertexWords;
+static std::vector<DecodeModel> s_decodeModels;
+static std::string s_decodeImplementation;  // to restore afterwards
+
+// As CNew3D::CacheModel() decoded each vertex
+static void DecodeVertex(const UINT32 *in, float uvScale, int width, int height, bool textured, bool signedShade, float out[9])
+{
+  out[0] = (((INT32) in[0]) >> 8) * VERTEX_FACTOR;
+  out[1] = (((INT32) in[1]) >> 8) * VERTEX_FACTOR;
+  out[2] = (((INT32) in[2]) >> 8) * VERTEX_FACTOR;
+  out[3] = ((2.0f * (INT8) (in[0] & 0xFF) + 1.0f) * (1.0F/255.0f));
+  out[4] = ((2.0f * (INT8) (in[1] & 0xFF) + 1.0f) * (1.0F/255.0f));
+  out[5] = ((2.0f * (INT8) (in[2] & 0xFF) + 1.0f) * (1.0F/255.0f));
+  out[6] = signedShade ? out[3] : (in[0] & 0xFF) / 255.f;
+  out[7] = textured ? ((UINT16) (in[3] >> 16) * uvScale) / width : 0;
+  out[8] = textured ? ((UINT16) (in[3] & 0xFFFF) * uvScale) / height : 0;
+}
+
+// Random vertices with random texture sizes and scales, one in eight of
+// them untextured
+static void BuildDecodeModels(void)
+{
+  static const float uvScales[] = { 1.0f, 0.125f };
+  unsigned seed = 12345;
+  auto Random = [&seed]() { seed = seed * 1664525 + 1013904223; return seed >> 8; };
+
+  s_vertexWords.resize(VERTS_PER_MODEL * NUM_MODELS * 4);
+  for (auto &word: s_vertexWords)
+    word = Random() ^ (Random() << 16);
+  s_decodeModels.assign(NUM_MODELS, DecodeModel());
+  for (size_t i = 0; i < s_vertexWords.size() / 4; i++)
+  {
+    DecodeModel &model = s_decodeModels[i / VERTS_PER_MODEL];
+    int width = 32 << (Random() % 6);
+    int height = 32 << (Random() % 6);
+    bool textured = (Random() % 8) != 0;
+    if (textured)
+      model.batch.Add(&s_vertexWords[i * 4], uvScales[Random() % 2], (float) width, (float) height);
+    else
+      model.batch.Add(&s_vertexWords[i * 4], 0, 1, 1);
+    model.width.push_back(width);
+    model.height.push_back(height);
+    model.textured.push_back(textured);
+  }
+}
+
+static bool DecodedVerticesMatch(bool signedShade)
+{
+  for (auto &model: s_decodeModels)
+  {
+    const New3D::SIMDMath::VertexBatch &b = model.batch;
+    New3D::SIMDMath::DecodeVertices(model.batch, VERTEX_FACTOR, signedShade);
+    for (int i = 0; i < b.Size(); i++)
+    {
+      float expected[9];
+      float decoded[9] = { b.x[i], b.y[i], b.z[i], b.nx[i], b.ny[i], b.nz[i], b.shade[i], b.u[i], b.v[i] };
+      DecodeVertex(b.data[i], b.uvScale[i], model.width[i], model.height[i], model.textured[i], signedShade, expected);
+      if (memcmp(expected, decoded, sizeof(expected)))
+        return false;
+    }
+  }
+  return true;
+}
+
+static void TeardownDecode(void);
+
+// A NULL implementation decodes one field at a time
+static std::string SetupDecode(const char *implementation)
+{
+  s_decodeImplementation = New3D::SIMDMath::GetImplementation();
+  BuildDecodeModels();
+  if (implementation)
+  {
+    if (!New3D::SIMDMath::SetImplementation(implementation))
+    {
+      TeardownDecode();
+      return "not supported by this CPU";
+    }
+    if (!DecodedVerticesMatch(false) || !DecodedVerticesMatch(true))
+    {
+      TeardownDecode();
+      return "decoded vertices differ from decoding one field at a time";
+    }
+  }
+  return "";
+}
+
+static void RunDecodeOne(UINT64 n)
+{
+  float out[9];
+  float sum = 0;
+  for (UINT64 i = 0; i < n; i++)
+  {
+    for (auto &model: s_decodeModels)
+    {
+      for (int j = 0; j < model.batch.Size(); j++)
+      {
+        DecodeVertex(model.batch.data[j], model.batch.uvScale[j], model.width[j], model.height[j], model.textured[j], false, out);
+        sum += out[0] + out[7];
+      }
+    }
+  }
+  DoNotOptimize(UINT64(sum));
+}
+
+static void RunDecodeBatch(UINT64 n)
+{
+  for (UINT64 i = 0; i < n; i++)
+  {
+    for (auto &model: s_decodeModels)
+      New3D::SIMDMath::DecodeVertices(model.batch, VERTEX_FACTOR, false);
+  }
+}
+
+static void TeardownDecode(void)
+{
+  New3D::SIMDMath::SetImplementation(s_decodeImplementation.c_str());
+  s_decodeModels.clear();
+  s_vertexWords.clear();
+}
+
+/******************************************************************************
+ Registration
+******************************************************************************/
+
+void Bench::RegisterGraphicsBenchmarks(const Inputs &inputs)
+{
+  static const struct { const char *name; bool gpu; } variants[] =
+  {
+    { "cpu", false },
+    { "gpu", true }
+  };
+  for (auto &variant: variants)
+  {
+    bool gpu = variant.gpu;
+    Case c;
+    c.name = std::string("render2d/pre_render_frame/") + variant.name;
+    c.Setup = [inputs, gpu]() { return SetupRender2D(inputs, gpu); };
+    c.Run = RunRender2D;
+    c.Teardown = TeardownRender2D;
+    c.itemsPerRun = 1;
+    Register(c);
+  }
+
+  static const struct { const char *name; bool new3D; } engines[] =
+  {
+    { "new3d", true },
+    { "legacy3d", false }
+  };
+  for (auto &engine: engines)
+  {
+    bool new3D = engine.new3D;
+    Case c;
+    c.name = std::string("render3d/frame/") + engine.name;
+    c.Setup = [inputs, new3D]() { return SetupRender3D(inputs, new3D); };
+    c.Run = RunRender3D;
+    c.Teardown = TeardownRender3D;
+    c.itemsPerRun = 1;
+    Register(c);
+  }
+
+  static const char *decoders[] = { "one", "scalar", "sse", "avx", "neon" };
+  for (const char *decoder: decoders)
+  {
+    const char *implementation = strcmp(decoder, "one") ? decoder : NULL;
+    Case c;
+    c.name = std::string("new3d/decode_vertices/") + decoder;
+    c.Setup = [implementation]() { return SetupDecode(implementation); };
+    c.Run = implementation ? RunDecodeBatch : RunDecodeOne;
+    c.Teardown = TeardownDecode;
+    c.itemsPerRun = VERTS_PER_MODEL * NUM_MODELS;
+    Register(c);
+  }
+}
@@ -0,0 +1,217 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * BenchModel3.cpp
+ *
+ * Board device benchmarks:
+ *
+ *  crypto/decrypt      Security board stream decryption, per 16-bit word.
+ *  real3d/snapshot/... Copying the Real3D memory written in a frame to the
+ *                      render thread's snapshots (SyncSnapshots() and the
+ *                      snapshot copier), for a few patterns of dirty pages.
+ *                      Bytes are those copied.
+ *  gameloader/load     Loading and assembling the ROM set given with --rom,
+ *                      uncached. Items are ROM sets loaded.
+ */
+
+#include "Bench/Bench.h"
+#include "Supermodel.h"
+#include "Model3/Crypto.h"
+#include "Model3/Real3D.h"
+#include "Model3/SnapshotCopier.h"
+#include "GameLoader.h"
+#include <memory>
+#include <vector>
+
+using namespace Bench;
+
+/******************************************************************************
+ Security Board Decryption
+******************************************************************************/
+
+static const UINT32 CRYPTO_KEY = 0x29290F17;
+static const int CRYPTO_WORDS = 4096;
+
+static std::vector<UINT16> s_securityRAM;
+static std::unique_ptr<CCrypto> s_crypto;
+
+static std::string SetupCrypto(void)
+{
+  s_securityRAM.resize(0x10000);
+  for (size_t i = 0; i < s_securityRAM.size(); i++)
+    s_securityRAM[i] = UINT16((i * 0x9E3779B9) >> 16);
+  s_crypto.reset(new CCrypto());
+  s_crypto->Init(CRYPTO_KEY, [](UINT32 addr) { return s_securityRAM[addr & 0xFFFF]; });
+  s_crypto->Reset();
+  return "";
+}
+
+static void RunCrypto(UINT64 n)
+{
+  UINT64 sum = 0;
+  for (UINT64 i = 0; i < n; i++)
+  {
+    // A stream starts with a subkey and address, as written by the game
+    s_crypto->SetSubKey(UINT16(i));
+    s_crypto->SetAddressLow(0);
+    s_crypto->SetAddressHigh(0);
+    UINT8 *base;
+    for (int j = 0; j < CRYPTO_WORDS; j++)
+      sum += s_crypto->Decrypt(&base);
+  }
+  DoNotOptimize(sum);
+}
+
+/******************************************************************************
+ Real3D Snapshots
+******************************************************************************/
+
+static const unsigned REAL3D_PAGE = 0x1000;
+
+static Util::Config::Node s_real3DConfig("Global");
+static std::unique_ptr<CReal3D> s_real3D;
+static std::unique_ptr<CSnapshotCopier> s_copier;
+static std::unique_ptr<UINT8[]> s_vrom;
+static CIRQ s_irq;
+static IBus s_real3DBus;
+
+// Pages of polygon and culling RAM written in a frame
+struct DirtyPattern
+{
+  const char  *name;
+  unsigned    polyStride;   // every n-th page of polygon RAM (0 for none)
+  unsigned    cullStride;   // every n-th page of low culling RAM
+};
+
+static const DirtyPattern s_patterns[] =
+{
+  { "sparse",   64, 64 },   // a few models and nodes updated
+  { "strided",  4,  8 },    // typical of a busy scene
+  { "dense",    1,  1 }     // everything rewritten
+};
+
+// Bytes of the pages a pattern dirties, all of which are copied
+static double DirtyBytes(const DirtyPattern &pattern)
+{
+  double bytes = 0;
+  if (pattern.polyStride)
+    bytes += double(0x400000 / REAL3D_PAGE / pattern.polyStride) * REAL3D_PAGE;
+  if (pattern.cullStride)
+    bytes += double(0x400000 / REAL3D_PAGE / pattern.cullStride) * REAL3D_PAGE;
+  return bytes;
+}
+
+static std::string SetupReal3D(void)
+{
+  s_real3DConfig.Set("GPUMultiThreaded", true);
+  s_real3DConfig.Set("GPUDoubleBuffered", false);
+  s_vrom.reset(new UINT8[0x4000000]());
+  s_real3D.reset(new CReal3D(s_real3DConfig));
+  if (OKAY != s_real3D->Init(s_vrom.get(), NULL, &s_real3DBus, &s_irq, 0x02))
+    return "CReal3D::Init failed";
+  s_copier.reset(new CSnapshotCopier());
+  return "";
+}
+
+static void RunReal3D(const DirtyPattern &pattern, UINT64 n)
+{
+  for (UINT64 i = 0; i < n; i++)
+  {
+    // One word on each page is enough to dirty it
+    UINT32 offset = UINT32(i * 4) & (REAL3D_PAGE - 1);
+    if (pattern.polyStride)
+    {
+      for (UINT32 addr = 0; addr < 0x400000; addr += REAL3D_PAGE * pattern.polyStride)
+        s_real3D->WritePolygonRAM(addr + offset, UINT32(i));
+    }
+    if (pattern.cullStride)
+    {
+      for (UINT32 addr = 0; addr < 0x400000; addr += REAL3D_PAGE * pattern.cullStride)
+        s_real3D->WriteLowCullingRAM(addr + offset, UINT32(i));
+    }
+    s_real3D->SyncSnapshots(*s_copier);
+    DoNotOptimize(s_copier->Run());
+  }
+}
+
+/******************************************************************************
+ Game Loader
+******************************************************************************/
+
+static std::unique_ptr<GameLoader> s_loader;
+
+static std::string SetupGameLoader(const Inputs &inputs)
+{
+  if (inputs.romFile.empty())
+    return "no ROM set given (--rom)";
+  s_loader.reset(new GameLoader(inputs.gameXML));
+  Game game;
+  ROMSet roms;
+  if (OKAY != s_loader->Load(&game, &roms, inputs.romFile))
+    return "unable to load " + inputs.romFile;
+  return "";
+}
+
+static void RunGameLoader(const Inputs &inputs, UINT64 n)
+{
+  for (UINT64 i = 0; i < n; i++)
+  {
+    Game game;
+    ROMSet roms;
+    s_loader->Load(&game, &roms, inputs.romFile);
+  }
+}
+
+/******************************************************************************
+ Registration
+******************************************************************************/
+
+void Bench::RegisterModel3Benchmarks(const Inputs &inputs)
+{
+  Case crypto;
+  crypto.name = "crypto/decrypt";
+  crypto.Setup = SetupCrypto;
+  crypto.Run = RunCrypto;
+  crypto.Teardown = []() { s_crypto.reset(); };
+  crypto.itemsPerRun = CRYPTO_WORDS;
+  crypto.bytesPerRun = CRYPTO_WORDS * 2;
+  Register(crypto);
+
+  for (const DirtyPattern &pattern: s_patterns)
+  {
+    Case c;
+    c.name = std::string("real3d/snapshot/") + pattern.name;
+    c.Setup = SetupReal3D;
+    c.Run = [&pattern](UINT64 n) { RunReal3D(pattern, n); };
+    c.Teardown = []() { s_copier.reset(); s_real3D.reset(); s_vrom.reset(); };
+    c.bytesPerRun = DirtyBytes(pattern);
+    Register(c);
+  }
+
+  Case loader;
+  loader.name = "gameloader/load";
+  loader.Setup = [inputs]() { return SetupGameLoader(inputs); };
+  loader.Run = [inputs](UINT64 n) { RunGameLoader(inputs, n); };
+  loader.Teardown = []() { s_loader.reset(); };
+  loader.itemsPerRun = 1;
+  Register(loader);
+}
@@ -0,0 +1,166 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * BenchSound.cpp
+ *
+ * SCSP benchmarks: a frame of samples (735 at 60 Hz) from the master SCSP
+ * with a number of looping slots keyed on, and a step of the DSP running a
+ * full 128-step program. Items are output samples.
+ */
+
+#include "Bench/Bench.h"
+#include "Supermodel.h"
+#include "Sound/SCSP.h"
+#include "Sound/SCSPDSP.h"
+#include <memory>
+
+using namespace Bench;
+
+static const int SAMPLES_PER_FRAME = 44100 / 60;
+
+static unsigned s_seed;
+
+static unsigned Random(unsigned range)
+{
+  s_seed = s_seed * 1664525 + 1013904223;
+  return (s_seed >> 8) % range;
+}
+
+/******************************************************************************
+ SCSP
+******************************************************************************/
+
+static Util::Config::Node s_scspConfig("Global");
+static std::unique_ptr<UINT8[]> s_scspRAM;
+static INT16 s_left[SAMPLES_PER_FRAME];
+static INT16 s_right[SAMPLES_PER_FRAME];
+static SCSP_CONTEXT *s_scspCtx = NULL;
+
+// No 68K: the callbacks report it as having run exactly what was asked
+static int Run68K(int cycles) { return 0; }
+static void Int68K(int irq) {}
+
+static void WriteSlot(int slot, int reg, UINT16 value)
+{
+  SCSP_Master_w16(slot * 0x20 + reg * 2, value);
+}
+
+static std::string SetupSCSP(int numSlots)
+{
+  s_scspConfig.Set("MultiThreaded", false);
+  s_scspConfig.Set("MultiThreadedSCSP", false);
+  s_scspConfig.Set("LegacySoundDSP", false);
+  s_scspConfig.Set("SoundBlockSamples", int(1));
+  s_scspConfig.Set("Balance", "0");
+
+  // 16-bit samples: a different noisy tone for each slot
+  s_seed = 12345;
+  s_scspRAM.reset(new UINT8[0x100000]());
+  for (int i = 0; i < 0x80000; i += 2)
+    *(UINT16 *) &s_scspRAM[i] = UINT16(Random(0x10000));
+
+  if (s_scspCtx == NULL)
+    s_scspCtx = SCSP_CreateContext();
+  SCSP_SetContext(s_scspCtx);
+  SCSP_SetBuffers(s_left, s_right, SAMPLES_PER_FRAME);
+  SCSP_SetCB(Run68K, Int68K);
+  if (OKAY != SCSP_Init(s_scspConfig, 1))
+    return "SCSP_Init failed";
+  SCSP_SetRAM(0, s_scspRAM.get());
+
+  for (int slot = 0; slot < numSlots; slot++)
+  {
+    WriteSlot(slot, 0x1, UINT16(slot * 0x2000));              // SA (low)
+    WriteSlot(slot, 0x2, 0);                                  // LSA
+    WriteSlot(slot, 0x3, 0x0FFF);                             // LEA
+    WriteSlot(slot, 0x4, 0x001F);                             // AR fastest, no decay
+    WriteSlot(slot, 0x5, 0x001F);                             // RR
+    WriteSlot(slot, 0x6, UINT16(Random(32)));                 // TL
+    WriteSlot(slot, 0x8, UINT16((Random(4) << 11) | Random(0x400)));  // OCT, FNS
+    WriteSlot(slot, 0xB, UINT16(0xE000 | (Random(32) << 8))); // DISDL, DIPAN
+    WriteSlot(slot, 0x0, UINT16(0x0800 | 0x0020 | (slot == numSlots - 1 ? 0x1000 : 0)));  // KYONB, forward loop, KYONEX on the last
+  }
+  return "";
+}
+
+/******************************************************************************
+ SCSP DSP
+******************************************************************************/
+
+static std::unique_ptr<_SCSPDSP> s_dsp;
+static std::unique_ptr<UINT16[]> s_dspRAM;
+
+static std::string SetupDSP(void)
+{
+  s_seed = 54321;
+  s_dsp.reset(new _SCSPDSP);
+  s_dspRAM.reset(new UINT16[0x80000]());
+  SCSPDSP_Init(s_dsp.get());
+  s_dsp->SCSPRAM = s_dspRAM.get();
+  s_dsp->SCSPRAM_LENGTH = 0x80000;
+  s_dsp->RBL = 0x8000;
+  for (int i = 0; i < 64; i++)
+    s_dsp->COEF[i] = INT16(Random(0x10000));
+  for (int i = 0; i < 32; i++)
+    s_dsp->MADRS[i] = UINT16(Random(0x8000));
+  for (int i = 0; i < 128 * 4; i++)
+    s_dsp->MPRO[i] = UINT16(Random(0x10000));
+  SCSPDSP_Start(s_dsp.get());
+  return "";
+}
+
+static void StepDSP(UINT64 n)
+{
+  for (UINT64 i = 0; i < n; i++)
+  {
+    SCSPDSP_SetSample(s_dsp.get(), INT32(i * 0x9E3779B9) >> 8, int(i & 15), 0);
+    SCSPDSP_Step(s_dsp.get());
+  }
+  DoNotOptimize(UINT64(s_dsp->EFREG[0]));
+}
+
+/******************************************************************************
+ Registration
+******************************************************************************/
+
+void Bench::RegisterSoundBenchmarks(const Inputs &inputs)
+{
+  static const int slotCounts[] = { 8, 32 };
+  for (int slots: slotCounts)
+  {
+    Case c;
+    c.name = "scsp/master_samples/" + std::to_string(slots) + "_slots";
+    c.Setup = [slots]() { return SetupSCSP(slots); };
+    c.Run = [](UINT64 n) { for (UINT64 i = 0; i < n; i++) SCSP_Update(); };
+    c.Teardown = []() { SCSP_Deinit(); s_scspRAM.reset(); };
+    c.itemsPerRun = SAMPLES_PER_FRAME;
+    Register(c);
+  }
+
+  Case dsp;
+  dsp.name = "scsp/dsp_step";
+  dsp.Setup = SetupDSP;
+  dsp.Run = StepDSP;
+  dsp.Teardown = []() { s_dsp.reset(); s_dspRAM.reset(); };
+  dsp.itemsPerRun = 1;
+  Register(dsp);
+}
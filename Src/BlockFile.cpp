@@ -29,24 +29,101 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdint>
+#include <algorithm>
+#include <zlib.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "Supermodel.h"
 
 
+/*
+ * A compressed file is COMPRESSED_MAGIC, the uncompressed size as a 64-bit
+ * little endian integer, and the zlib stream. As the first 4 bytes of an
+ * uncompressed file, the marker would be the size of a header block of 800 MB.
+ */
+static const uint8_t COMPRESSED_MAGIC[4] = { 'S', 'M', 'Z', '1' };
+static const uint64_t MAX_UNCOMPRESSED_SIZE = uint64_t(1) << 30;
+static const size_t COMPRESSION_CHUNK = 0x40000;
+
+
+static uint32_t HashName(const char *name, size_t length)
+{
+  uint32_t hash = 2166136261u;  // FNV-1a
+  for (size_t i = 0; i < length && name[i]; i++)
+    hash = (hash ^ uint8_t(name[i])) * 16777619u;
+  return hash;
+}
+
+
 /******************************************************************************
  Output Functions
 ******************************************************************************/
 
+bool CBlockFile::IsOpen(void) const
+{
+  return fp != NULL || memWrite != NULL || memRead != NULL;
+}
+
+long int CBlockFile::Tell(void) const
+{
+  if (fp != NULL)
+    return ftell(fp);
+  return memPos;
+}
+
+void CBlockFile::Seek(long int pos)
+{
+  if (fp != NULL)
+    fseek(fp, pos, SEEK_SET);
+  else
+    memPos = pos;
+}
+
+size_t CBlockFile::RawRead(void *data, size_t numBytes)
+{
+  if (fp != NULL)
+    return fread(data, sizeof(uint8_t), numBytes, fp);
+  if (memRead == NULL || memPos >= fileSize)
+    return 0;
+  if (numBytes > size_t(fileSize - memPos))
+    numBytes = size_t(fileSize - memPos);
+  memcpy(data, memRead + memPos, numBytes);
+  memPos += numBytes;
+  return numBytes;
+}
+
+void CBlockFile::RawWrite(const void *data, size_t numBytes)
+{
+  if (fp != NULL)
+  {
+    fwrite(data, sizeof(uint8_t), numBytes, fp);
+    return;
+  }
+  if (memWrite == NULL)
+    return;
+
+  // Overwrite what is already there (block sizes) and append the rest
+  const uint8_t *bytes = (const uint8_t *) data;
+  size_t overlap = memPos < long(memWrite->size()) ? std::min(numBytes, memWrite->size() - memPos) : 0;
+  memcpy(memWrite->data() + memPos, bytes, overlap);
+  memWrite->insert(memWrite->end(), bytes + overlap, bytes + numBytes);
+  memPos += numBytes;
+}
+
 void CBlockFile::ReadString(std::string *str, uint32_t length)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
   str->clear();
   //TODO: use fstream to get rid of this ugly hack
   bool keep_loading = true;
   for (size_t i = 0; i < length; i++)
   {
-    char c;
-    fread(&c, sizeof(char), 1, fp);
+    char c = 0;
+    RawRead(&c, sizeof(char));
     if (keep_loading)
     {
       if (!c)
@@ -59,16 +136,16 @@ void CBlockFile::ReadString(std::string *str, uint32_t length)
 
 unsigned CBlockFile::ReadBytes(void *data, uint32_t numBytes)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return 0;
-  return fread(data, sizeof(uint8_t), numBytes, fp);
+  return RawRead(data, numBytes);
 }
 
 unsigned CBlockFile::ReadDWord(uint32_t *data)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return 0;
-  fread(data, sizeof(uint32_t), 1, fp);
+  RawRead(data, sizeof(uint32_t));
   return 4;
 }
   
@@ -77,49 +154,52 @@ void CBlockFile::UpdateBlockSize(void)
   long int  curPos;
   unsigned  newBlockSize;
   
-  if (NULL == fp)
+  if (!IsOpen())
     return;
-  curPos = ftell(fp);       // save current file position
-  fseek(fp, blockStartPos, SEEK_SET);
+  curPos = Tell();          // save current file position
+  Seek(blockStartPos);
   newBlockSize = curPos - blockStartPos;
-  fwrite(&newBlockSize, sizeof(uint32_t), 1, fp);
-  fseek(fp, curPos, SEEK_SET);  // go back
+  RawWrite(&newBlockSize, sizeof(uint32_t));
+  Seek(curPos);             // go back
 }
 
+// The size of the block being written is filled in once it is finished, by
+// the next NewBlock() or Close(), rather than on every write
 void CBlockFile::WriteByte(uint8_t data)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
-  fwrite(&data, sizeof(uint8_t), 1, fp);
-  UpdateBlockSize();
+  RawWrite(&data, sizeof(uint8_t));
 }
 
 void CBlockFile::WriteDWord(uint32_t data)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
-  fwrite(&data, sizeof(uint32_t), 1, fp);
-  UpdateBlockSize();
+  RawWrite(&data, sizeof(uint32_t));
 }
 
 void CBlockFile::WriteBytes(const void *data, uint32_t numBytes)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
-  fwrite(data, sizeof(uint8_t), numBytes, fp);
-  UpdateBlockSize();
+  RawWrite(data, numBytes);
 }
 
 void CBlockFile::WriteBlockHeader(const std::string &name, const std::string &comment)
 {
-  if (NULL == fp)
+  if (!IsOpen())
     return;
+
+  // Finish the previous block
+  if (blockStartPos >= 0)
+    UpdateBlockSize();
   
   // Record current block starting position
-  blockStartPos = ftell(fp);
+  blockStartPos = Tell();
 
   // Write the total block length field
-  WriteDWord(0);  // will be automatically updated as we write the file
+  WriteDWord(0);  // updated when the block is finished
   
   // Write name and comment lengths
   WriteDWord(name.size() + 1);
@@ -128,7 +208,7 @@ void CBlockFile::WriteBlockHeader(const std::string &name, const std::string &co
   Write(comment);
   
   // Record the start of the current data section
-  dataStartPos = ftell(fp);
+  dataStartPos = Tell();
 } 
 
 
@@ -188,41 +268,112 @@ void CBlockFile::NewBlock(const std::string &name, const std::string &comment)
     WriteBlockHeader(name, comment);
 }
 
-bool CBlockFile::FindBlock(const std::string &name)
+/*
+ * The blocks are indexed when the file is loaded, by a hash of their names in
+ * an open addressed table that is only ever grown, so that FindBlock() doesn't
+ * have to scan the file and a CBlockFile reused for loading images with the
+ * same blocks doesn't allocate. Entries with the same hash are probed in file
+ * order, so the first of any blocks with the same name is found, as before.
+ */
+void CBlockFile::IndexBlocks(void)
 {
-  if (mode != 'r')
-    return FAIL;
-    
-  fseek(fp, 0, SEEK_SET);
-  
+  blockIndexCount = 0;
+  std::fill(blockIndex.begin(), blockIndex.end(), IndexEntry{ 0, -1 });
+
   long int  curPos = 0;
-  while (curPos < fileSize)
+  while (curPos + 12 <= fileSize)
   {
-    blockStartPos = curPos;
-    
     // Read header
     uint32_t block_length;
     uint32_t name_length;
     uint32_t comment_length;
-    curPos += ReadDWord(&block_length);
-    curPos += ReadDWord(&name_length);
-    curPos += ReadDWord(&comment_length);
-    std::string block_name;
-    ReadString(&block_name, name_length);
-    
-    // Is this the block we want?
-    if (block_name == name)
+    Seek(curPos);
+    ReadDWord(&block_length);
+    ReadDWord(&name_length);
+    ReadDWord(&comment_length);
+    uint32_t hash;
+    if (memRead != NULL)
+      hash = HashName((const char *) memRead + curPos + 12, std::min<size_t>(name_length, fileSize - curPos - 12));
+    else
     {
-      fseek(fp, blockStartPos + 12 + name_length + comment_length, SEEK_SET); // move to beginning of data
-      dataStartPos = ftell(fp);
-      return OKAY;
+      ReadString(&nameBuffer, name_length);
+      hash = HashName(nameBuffer.c_str(), nameBuffer.size());
     }
-    
+
+    // Keep the table at most half full
+    if (2 * (blockIndexCount + 1) > blockIndex.size())
+      GrowIndex();
+    size_t mask = blockIndex.size() - 1;
+    size_t i = hash & mask;
+    while (blockIndex[i].pos >= 0)
+      i = (i + 1) & mask;
+    blockIndex[i] = IndexEntry{ hash, curPos };
+    blockIndexCount++;
+
     // Move to next block
-    fseek(fp, blockStartPos + block_length, SEEK_SET);
-    curPos = blockStartPos + block_length;
     if (block_length == 0)  // this would never advance
       break;
+    curPos += block_length;
+  }
+}
+
+void CBlockFile::GrowIndex(void)
+{
+  std::vector<IndexEntry> old(std::max<size_t>(64, 2 * blockIndex.size()), IndexEntry{ 0, -1 });
+  old.swap(blockIndex);
+
+  // Re-inserting in slot order would reorder entries that probe past the end,
+  // so start from an empty slot, where no probe sequence is interrupted
+  size_t start = 0;
+  while (start < old.size() && old[start].pos >= 0)
+    start++;
+  size_t mask = blockIndex.size() - 1;
+  for (size_t n = 0; n < old.size(); n++)
+  {
+    const IndexEntry &entry = old[(start + n) % old.size()];
+    if (entry.pos < 0)
+      continue;
+    size_t i = entry.hash & mask;
+    while (blockIndex[i].pos >= 0)
+      i = (i + 1) & mask;
+    blockIndex[i] = entry;
+  }
+}
+
+bool CBlockFile::BlockNameIs(long int pos, const std::string &name, uint32_t *nameLength, uint32_t *commentLength)
+{
+  Seek(pos + 4);
+  ReadDWord(nameLength);
+  ReadDWord(commentLength);
+  if (memRead != NULL)
+  {
+    size_t available = std::min<size_t>(*nameLength, fileSize - pos - 12);
+    const char *blockName = (const char *) memRead + pos + 12;
+    size_t length = strnlen(blockName, available);
+    return length == name.size() && !memcmp(blockName, name.c_str(), length);
+  }
+  ReadString(&nameBuffer, *nameLength);
+  return nameBuffer == name;
+}
+
+bool CBlockFile::FindBlock(const std::string &name)
+{
+  if (mode != 'r' || blockIndex.empty())
+    return FAIL;
+
+  uint32_t hash = HashName(name.c_str(), name.size());
+  size_t mask = blockIndex.size() - 1;
+  for (size_t i = hash & mask; blockIndex[i].pos >= 0; i = (i + 1) & mask)
+  {
+    uint32_t name_length;
+    uint32_t comment_length;
+    if (blockIndex[i].hash == hash && BlockNameIs(blockIndex[i].pos, name, &name_length, &comment_length))
+    {
+      blockStartPos = blockIndex[i].pos;
+      Seek(blockStartPos + 12 + name_length + comment_length); // move to beginning of data
+      dataStartPos = Tell();
+      return OKAY;
+    }
   }
   
   return FAIL;
@@ -234,16 +385,52 @@ bool CBlockFile::Create(const std::string &file, const std::string &headerName,
   if (NULL == fp)
     return FAIL;
   mode = 'w';
+  blockStartPos = -1;
+  WriteBlockHeader(headerName, comment);
+  return OKAY;
+}
+
+bool CBlockFile::Create(std::vector<uint8_t> *buffer, const std::string &headerName, const std::string &comment)
+{
+  memWrite = buffer;
+  memWrite->clear();
+  memPos = 0;
+  mode = 'w';
+  blockStartPos = -1;
   WriteBlockHeader(headerName, comment);
   return OKAY;
 }
   
+void CBlockFile::CreateBlocks(std::vector<uint8_t> *buffer)
+{
+  memWrite = buffer;
+  memWrite->clear();
+  memPos = 0;
+  mode = 'w';
+  blockStartPos = -1;
+}
+
+void CBlockFile::AppendBlocks(const std::vector<uint8_t> &blocks)
+{
+  if (mode != 'w' || !IsOpen())
+    return;
+  if (blockStartPos >= 0)
+    UpdateBlockSize();
+  RawWrite(blocks.data(), blocks.size());
+  blockStartPos = -1;
+}
+
 bool CBlockFile::Load(const std::string &file)
 {
   fp = fopen(file.c_str(), "rb");
   if (NULL == fp)
     return FAIL;
   mode = 'r';
+
+  // Compressed files are read into memory
+  uint8_t magic[sizeof(COMPRESSED_MAGIC)];
+  if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && !memcmp(magic, COMPRESSED_MAGIC, sizeof(magic)))
+    return LoadCompressed();
   
   // TODO: is this a valid block file?
   
@@ -251,28 +438,235 @@ bool CBlockFile::Load(const std::string &file)
   fseek(fp, 0, SEEK_END);
   fileSize = ftell(fp);
   fseek(fp, 0, SEEK_SET);
-  
+
+  IndexBlocks();
+  Seek(0);
+  return OKAY;
+}
+
+bool CBlockFile::LoadCompressed(void)
+{
+  uint8_t sizeBytes[8];
+  uint64_t size = 0;
+  if (fread(sizeBytes, 1, sizeof(sizeBytes), fp) == sizeof(sizeBytes))
+  {
+    for (int i = 7; i >= 0; i--)
+      size = (size << 8) | sizeBytes[i];
+  }
+
+  bool result = FAIL;
+  z_stream stream = {};
+  if (size > 0 && size <= MAX_UNCOMPRESSED_SIZE && inflateInit(&stream) == Z_OK)
+  {
+    memLoaded.resize(size_t(size));
+    std::vector<uint8_t> chunk(COMPRESSION_CHUNK);
+    stream.next_out = memLoaded.data();
+    stream.avail_out = uInt(memLoaded.size());
+    int status = Z_OK;
+    while (status == Z_OK)
+    {
+      if (stream.avail_in == 0)
+      {
+        stream.avail_in = uInt(fread(chunk.data(), 1, chunk.size(), fp));
+        stream.next_in = chunk.data();
+        if (stream.avail_in == 0)
+          break;
+      }
+      status = inflate(&stream, Z_NO_FLUSH);
+    }
+    result = (status == Z_STREAM_END && stream.avail_out == 0) ? OKAY : FAIL;
+    inflateEnd(&stream);
+  }
+
+  fclose(fp);
+  fp = NULL;
+  if (result != OKAY)
+  {
+    memLoaded.clear();
+    mode = 0;
+    return FAIL;
+  }
+  return Load(memLoaded.data(), memLoaded.size());
+}
+
+bool CBlockFile::Load(const uint8_t *data, size_t size)
+{
+  memRead = data;
+  memPos = 0;
+  fileSize = long(size);
+  mode = 'r';
+  IndexBlocks();
+  Seek(0);
   return OKAY;
 }
   
+const uint8_t *CBlockFile::Image(size_t *size) const
+{
+  if (mode != 'r' || memRead == NULL)
+    return NULL;
+  *size = size_t(fileSize);
+  return memRead;
+}
+
 void CBlockFile::Close(void)
 {
+  if (mode == 'w' && blockStartPos >= 0)
+    UpdateBlockSize();
   if (fp != NULL)
     fclose(fp);
   fp = NULL;
+  memWrite = NULL;
+  memRead = NULL;
+  memLoaded.clear();
+  blockStartPos = -1;
   mode = 0;
 }
 
 CBlockFile::CBlockFile(void)
 {
   fp = NULL;
+  memWrite = NULL;
+  memRead = NULL;
+  memPos = 0;
+  blockStartPos = -1;
+  blockIndexCount = 0;
   mode = 0;   // neither reading nor writing (do nothing)
 }
 
 CBlockFile::~CBlockFile(void)
 {
-  if (fp != NULL) // in case user forgot
-    fclose(fp);
-  fp = NULL;
-  mode = 0;
+  Close();  // in case user forgot
+}
+
+
+/******************************************************************************
+ Background Writer
+******************************************************************************/
+
+bool CBlockFileWriter::WriteFile(const std::string &file, const std::vector<uint8_t> &image, bool compress)
+{
+  std::string temp_file = file + ".tmp";
+  FILE *fp = fopen(temp_file.c_str(), "wb");
+  if (fp == NULL)
+    return FAIL;
+
+  bool result = OKAY;
+  if (!compress)
+    result = fwrite(image.data(), sizeof(uint8_t), image.size(), fp) == image.size() ? OKAY : FAIL;
+  else
+  {
+    // Header, then the stream a chunk at a time
+    uint8_t header[sizeof(COMPRESSED_MAGIC) + 8];
+    memcpy(header, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC));
+    for (int i = 0; i < 8; i++)
+      header[sizeof(COMPRESSED_MAGIC) + i] = uint8_t(uint64_t(image.size()) >> (8 * i));
+    result = fwrite(header, 1, sizeof(header), fp) == sizeof(header) ? OKAY : FAIL;
+
+    z_stream stream = {};
+    if (result == OKAY && deflateInit(&stream, Z_BEST_SPEED) == Z_OK)
+    {
+      std::vector<uint8_t> chunk(COMPRESSION_CHUNK);
+      stream.next_in = const_cast<uint8_t *>(image.data());
+      stream.avail_in = uInt(image.size());
+      int status;
+      do
+      {
+        stream.next_out = chunk.data();
+        stream.avail_out = uInt(chunk.size());
+        status = deflate(&stream, Z_FINISH);
+        size_t have = chunk.size() - stream.avail_out;
+        if (fwrite(chunk.data(), 1, have, fp) != have)
+          result = FAIL;
+      } while (status == Z_OK && result == OKAY);
+      if (status != Z_STREAM_END)
+        result = FAIL;
+      deflateEnd(&stream);
+    }
+    else
+      result = FAIL;
+  }
+
+  // On the disk before it replaces the old file, so that a crash or power cut
+  // leaves one or the other whole
+  if (fflush(fp) != 0)
+    result = FAIL;
+#ifdef _WIN32
+  else if (_commit(_fileno(fp)) != 0)
+    result = FAIL;
+#else
+  else if (fsync(fileno(fp)) != 0)
+    result = FAIL;
+#endif
+  if (fclose(fp) != 0)
+    result = FAIL;
+#ifdef _WIN32
+  if (result == OKAY)
+    remove(file.c_str());   // rename() does not replace files on Windows
+#endif
+  if (result != OKAY || rename(temp_file.c_str(), file.c_str()) != 0)
+  {
+    remove(temp_file.c_str());
+    return FAIL;
+  }
+  return OKAY;
+}
+
+void CBlockFileWriter::Write(const std::string &file, std::vector<uint8_t> *image, bool compress, std::function<void(bool)> done)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(Job{ file, std::vector<uint8_t>(), compress, done });
+    m_jobs.back().image.swap(*image);
+    if (!m_spare.empty())
+    {
+      image->swap(m_spare.back());
+      m_spare.pop_back();
+    }
+    if (!m_thread.joinable())
+      m_thread = std::thread(&CBlockFileWriter::WriterThread, this);
+  }
+  m_cv.notify_all();
+}
+
+void CBlockFileWriter::Wait(void)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_cv.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+}
+
+void CBlockFileWriter::WriterThread(void)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;)
+  {
+    m_cv.wait(lock, [this] { return m_exit || !m_jobs.empty(); });
+    if (m_jobs.empty())
+      return;
+
+    Job job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    m_busy = true;
+    lock.unlock();
+
+    bool result = WriteFile(job.file, job.image, job.compress);
+    if (job.done)
+      job.done(result);
+
+    lock.lock();
+    m_busy = false;
+    job.image.clear();
+    m_spare.push_back(std::move(job.image));
+    m_cv.notify_all();
+  }
+}
+
+CBlockFileWriter::~CBlockFileWriter(void)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_exit = true;
+  }
+  m_cv.notify_all();
+  if (m_thread.joinable())
+    m_thread.join();
 }
@@ -28,8 +28,15 @@
 #ifndef INCLUDED_BLOCKFILE_H
 #define INCLUDED_BLOCKFILE_H
 
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 /*
  * CBlockFile:
@@ -40,6 +47,14 @@
  * All strings (comments and names) will be truncated to 1024 bytes, not
  * including the null terminator.
  *
+ * A block file may also be held in memory rather than on disk, which is used
+ * for snapshots that must be taken quickly and often. Blocks are indexed when
+ * loaded, so finding one doesn't scan the file.
+ *
+ * Files written from memory by CBlockFileWriter may be compressed as a whole
+ * with zlib. They begin with a marker that no uncompressed block file can,
+ * and Load() reads either kind.
+ *
  * Members do not generate any output messages.
  */
 class CBlockFile
@@ -76,8 +91,9 @@ public:
   /*
    * FindBlock(name):
    *
-   * Scans the file for a block with the given name string. When it is found,
-   * the file pointer is set to the beginning of the data region.
+   * Looks up the block with the given name string. When it is found, the file
+   * pointer is set to the beginning of the data region. If there are several,
+   * the first is found.
    *
    * Parameters:
    *    name  Name of block to locate.
@@ -151,6 +167,46 @@ public:
    */
   bool Create(const std::string &file, const std::string &headerName, const std::string &comment);
 
+  /*
+   * Create(buffer, headerName, comment):
+   *
+   * As above but writes to a buffer in memory, which is emptied first. Its
+   * capacity is kept, so a buffer that is reused for images of about the
+   * same size is only allocated once.
+   *
+   * Parameters:
+   *    buffer      Buffer to write to. Must remain valid until closed.
+   *    headerName  Block name for header. Must be unique and not NULL.
+   *    comment     Comment string that will be embedded into file header.
+   *
+   * Returns:
+   *    OKAY.
+   */
+  bool Create(std::vector<uint8_t> *buffer, const std::string &headerName, const std::string &comment);
+
+  /*
+   * CreateBlocks(buffer):
+   *
+   * As above but without a header block, for blocks that are written
+   * separately (on another thread, say) and then added to a block file with
+   * AppendBlocks().
+   *
+   * Parameters:
+   *    buffer      Buffer to write to. Must remain valid until closed.
+   */
+  void CreateBlocks(std::vector<uint8_t> *buffer);
+
+  /*
+   * AppendBlocks(blocks):
+   *
+   * Finishes the current block and adds blocks written by CreateBlocks() and
+   * closed. A new block must be begun before writing anything else.
+   *
+   * Parameters:
+   *    blocks      Blocks to add.
+   */
+  void AppendBlocks(const std::vector<uint8_t> &blocks);
+
   /*
    * Load(file):
    *
@@ -163,10 +219,41 @@ public:
    *    OKAY if successfully opened and confirmed to be a valid Supermodel
    *    block file, otherwise FAIL. If the file could not be opened, all 
    *    subsequent operations will be silently ignored (reads will return
-   *    0's). Write commands will be ignored.
+   *    0's). Write commands will be ignored. A compressed file is
+   *    decompressed into memory, and FAIL is returned if it is corrupt.
    */
   bool Load(const std::string &file);
 
+  /*
+   * Load(data, size):
+   *
+   * As above but reads a block file held in memory, such as one written by
+   * Create(buffer, ...).
+   *
+   * Parameters:
+   *    data  Block file image. Must remain valid until closed.
+   *    size  Size of image in bytes.
+   *
+   * Returns:
+   *    OKAY.
+   */
+  bool Load(const uint8_t *data, size_t size);
+
+  /*
+   * Image(size):
+   *
+   * Returns the image being read if it is held in memory (loaded from memory
+   * or decompressed), so that other CBlockFiles can load it too and read
+   * different blocks of it at once.
+   *
+   * Parameters:
+   *    size  Set to the size of the image in bytes.
+   *
+   * Returns:
+   *    The image, or NULL if the file is read from disk.
+   */
+  const uint8_t *Image(size_t *size) const;
+
   /*
    * Close(void):
    *
@@ -193,13 +280,111 @@ private:
   void      WriteDWord(uint32_t data);
   void      WriteBytes(const void *data, uint32_t numBytes);
   void      WriteBlockHeader(const std::string &name, const std::string &comment);
+  void      IndexBlocks(void);
+  void      GrowIndex(void);
+  bool      BlockNameIs(long int pos, const std::string &name, uint32_t *nameLength, uint32_t *commentLength);
+  bool      LoadCompressed(void);
+
+  // Positioning and raw access, to whichever of the file or memory is open
+  bool      IsOpen(void) const;
+  long int  Tell(void) const;
+  void      Seek(long int pos);
+  size_t    RawRead(void *data, size_t numBytes);
+  void      RawWrite(const void *data, size_t numBytes);
 
   // File state data
   FILE      *fp;
+  std::vector<uint8_t> *memWrite; // buffer being written, if in memory
+  const uint8_t *memRead;         // image being read, if in memory
+  std::vector<uint8_t> memLoaded; // decompressed image of a compressed file
+  long int  memPos;               // position in memory image
   int       mode;           // 'r' for read, 'w' for write
   long int  fileSize;       // size of file in bytes
   long int  blockStartPos;  // points to beginning of current block (or file) header
   long int  dataStartPos;   // points to beginning of current block's data section 
+
+  // Index of blocks by name hash, for reading
+  struct IndexEntry
+  {
+    uint32_t  hash;
+    long int  pos;          // block header position, or -1 if slot is empty
+  };
+  std::vector<IndexEntry> blockIndex;
+  size_t    blockIndexCount;
+  std::string nameBuffer;
+};
+
+/*
+ * CBlockFileWriter:
+ *
+ * Writes block files held in memory out to disk on a thread of its own, so
+ * that saving one only takes as long as serializing it. Images are written in
+ * the order given.
+ */
+class CBlockFileWriter
+{
+public:
+  /*
+   * Write(file, image, compress, done):
+   *
+   * Queues an image to be written to a file. The image is taken by swapping
+   * it with a buffer from an earlier write, so the caller's buffer can be
+   * reused without allocating again.
+   *
+   * Parameters:
+   *    file      File path.
+   *    image     Block file image, such as one written by
+   *              CBlockFile::Create(buffer, ...).
+   *    compress  Whether to compress it.
+   *    done      Called from the writer thread once written, with OKAY or
+   *              FAIL. May be empty.
+   */
+  void Write(const std::string &file, std::vector<uint8_t> *image, bool compress, std::function<void(bool)> done);
+
+  /*
+   * WriteFile(file, image, compress):
+   *
+   * Writes an image to a file straight away, on the calling thread. It is
+   * written under a temporary name, flushed to the disk and then renamed
+   * over any old file, which is kept if writing fails part way.
+   *
+   * Returns:
+   *    OKAY if written, otherwise FAIL.
+   */
+  static bool WriteFile(const std::string &file, const std::vector<uint8_t> &image, bool compress);
+
+  /*
+   * Wait(void):
+   *
+   * Waits for all queued images to be written.
+   */
+  void Wait(void);
+
+  /*
+   * ~CBlockFileWriter(void):
+   *
+   * Waits for queued images to be written and stops the thread.
+   */
+  ~CBlockFileWriter(void);
+
+private:
+  struct Job
+  {
+    std::string file;
+    std::vector<uint8_t> image;
+    bool compress;
+    std::function<void(bool)> done;
+  };
+
+  void WriterThread(void);
+
+  std::thread             m_thread;
+  std::mutex              m_mutex;
+  std::condition_variable m_cv;
+  std::deque<Job>         m_jobs;
+  std::vector<std::vector<uint8_t>> m_spare;  // buffers of images already written
+  bool                    m_busy = false;
+  bool                    m_exit = false;
 };
 
 
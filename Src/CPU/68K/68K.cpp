@@ -22,9 +22,10 @@
 /*
  * 68K.cpp
  * 
- * 68K CPU interface. This is presently just a wrapper for the Musashi 68K core
- * and therefore, only a single CPU is supported. In the future, we may want to
- * add in another 68K core (eg., Turbo68K, A68K, or a recompiler). 
+ * 68K CPU interface. This is presently just a wrapper for the Musashi 68K core.
+ * Each thread has its own active context, so different threads may run
+ * different 68Ks at the same time. In the future, we may want to add in another
+ * 68K core (eg., Turbo68K, A68K, or a recompiler). 
  *
  * To-Do List
  * ----------
@@ -40,24 +41,20 @@
 /******************************************************************************
  Internal Context
  
- An active context must be mapped before calling M68K interface functions. Only
- the bus and IRQ handlers are copied here; the CPU context is passed directly
+ An active context must be mapped before calling M68K interface functions.
+ Nothing is copied: the context (including its bus and IRQ handlers) is used
+ in place by the thread that mapped it, and its CPU state is passed directly
  to Musashi.
 ******************************************************************************/
 
-// Bus
-static IBus	*s_Bus = NULL;
-
-#ifdef SUPERMODEL_DEBUGGER
-// Debugger
-static Debugger::CMusashi68KDebug *s_Debug = NULL;
-#endif
-
-// IRQ callback
-static int	(*IRQAck)(int nIRQ) = NULL;
+// Active context of this thread
+static thread_local M68KCtx *s_ctx = NULL;
 
 // Cycles remaining in timeslice
-static int s_lastCycles;
+static thread_local int s_lastCycles;
+
+// Map used by the "musashi" engine: nothing is accessed directly
+static const M68KMemoryMap s_busOnlyMap = { { NULL }, { NULL } };
 
 
 /******************************************************************************
@@ -125,10 +122,8 @@ void M68KSaveState(CBlockFile *StateFile, const char *name)
 	 * version has to be changed, so don't do it!
 	 */
 	 
-	UINT32			data[34];
-	m68ki_cpu_core	Ctx;
-	
-	m68k_get_context(&Ctx);
+	UINT32					data[34];
+	const m68ki_cpu_core	&Ctx = s_ctx->musashiCtx;
 	
 	data[0] = Ctx.int_level;
 	data[1] = Ctx.int_cycles;
@@ -177,16 +172,14 @@ void M68KLoadState(CBlockFile *StateFile, const char *name)
 	}
 
 	UINT32			data[34];
-	m68ki_cpu_core	Ctx;
+	m68ki_cpu_core	&Ctx = s_ctx->musashiCtx;
 		
 	StateFile->Read(data, sizeof(data));
 	
 	// These must be set first, to ensure another contexts' IRQs aren't active when PC is changed 
-	m68k_get_context(&Ctx);
 	Ctx.int_level = data[0];
 	Ctx.int_cycles = data[1];
 	Ctx.stopped = data[2];
-	m68k_set_context(&Ctx);	// write them back to context
 	m68k_set_reg(M68K_REG_D0, data[3]);
 	m68k_set_reg(M68K_REG_D1, data[4]);
 	m68k_set_reg(M68K_REG_D2, data[5]);
@@ -224,24 +217,48 @@ void M68KLoadState(CBlockFile *StateFile, const char *name)
 
 void M68KSetIRQ(int irqLevel)
 {
+	s_ctx->IRQLevel = irqLevel;
 	m68k_set_irq(irqLevel);
 }
 
+int M68KGetIRQ(void)
+{
+	return s_ctx->IRQLevel;
+}
+
 int M68KRun(int numCycles)
 {
+	// Only pay for the instruction hook (and the debugger's bus wrapper) while
+	// the debugger or the trace needs them
+	bool hooked = s_ctx->Trace != NULL;
 #ifdef SUPERMODEL_DEBUGGER
-	if (s_Debug != NULL)
+	if (s_ctx->Debug != NULL)
 	{
-		s_Debug->CPUActive();
-		s_lastCycles += numCycles;
+		s_ctx->Debug->CPUActive();
+		s_ctx->DebugHooked = s_ctx->Debug->IsHooked();
+		s_ctx->Bus = s_ctx->DebugHooked ? s_ctx->Debug : s_ctx->DirectBus;
+		hooked = hooked || s_ctx->DebugHooked;
+		if (s_ctx->DebugHooked)
+			s_lastCycles += numCycles;
 	}
 #endif // SUPERMODEL_DEBUGGER
-	int doneCycles = m68k_execute(numCycles);
+	int doneCycles;
+	if (hooked)
+	{
+		s_ctx->TraceCycles += numCycles;
+		doneCycles = m68k_execute_hooked(numCycles);
+		s_ctx->TraceCycles -= m68k_cycles_remaining();
+	}
+	else
+		doneCycles = m68k_execute(numCycles);
 #ifdef SUPERMODEL_DEBUGGER
-	if (s_Debug != NULL)
+	if (s_ctx->Debug != NULL)
 	{
-		s_Debug->CPUInactive();
-		s_lastCycles -= m68k_cycles_remaining();
+		if (s_ctx->DebugHooked)
+			s_lastCycles -= m68k_cycles_remaining();
+		else
+			s_ctx->Debug->CPURan(doneCycles);
+		s_ctx->Debug->CPUInactive();
 	}
 #endif // SUPERMODEL_DEBUGGER
 	return doneCycles;
@@ -253,42 +270,33 @@ void M68KReset(void)
 #ifdef SUPERMODEL_DEBUGGER
 	s_lastCycles = 0;
 #endif
-	DebugLog("68K reset\n");
+	DEBUG_LOG(Sound, "68K reset\n");
 }
 
 // Callback setup
 
 void M68KSetIRQCallback(int (*F)(int nIRQ))
 {
-	IRQAck = F;
+	s_ctx->IRQAck = F;
 }
 
 void M68KAttachBus(IBus *BusPtr)
 {
-	s_Bus = BusPtr;
-	DebugLog("Attached bus to 68K\n");
+	s_ctx->Bus = BusPtr;
+	DEBUG_LOG(Sound, "Attached bus to 68K\n");
 }
 
 // Context switching
 
-void M68KGetContext(M68KCtx *Dest)
+M68KCtx *M68KGetContext(void)
 {
-	Dest->IRQAck = IRQAck;
-	Dest->Bus = s_Bus;
-#ifdef SUPERMODEL_DEBUGGER
-	Dest->Debug = s_Debug;
-#endif // SUPERMODEL_DEBUGGER
-	m68k_get_context(&(Dest->musashiCtx));
+	return s_ctx;
 }
 
 void M68KSetContext(M68KCtx *Src)
 {
-	IRQAck = Src->IRQAck;
-	s_Bus = Src->Bus;
-#ifdef SUPERMODEL_DEBUGGER
-	s_Debug = Src->Debug;
-#endif // SUPERMODEL_DEBUGGER
-	m68k_set_context(&(Src->musashiCtx));
+	s_ctx = Src;
+	m68k_set_context(Src != NULL ? &(Src->musashiCtx) : NULL);
 }
 
 // One-time initialization
@@ -298,14 +306,49 @@ bool M68KInit(void)
 	m68k_init();
 	m68k_set_cpu_type(M68K_CPU_TYPE_68000);
 	m68k_set_int_ack_callback(M68KIRQCallback);
-	s_Bus = NULL;
+	s_ctx->Bus = NULL;
+	memset(&s_ctx->Map, 0, sizeof(s_ctx->Map));
+	s_ctx->ActiveMap = &s_ctx->Map;
 #ifdef SUPERMODEL_DEBUGGER
-	s_Debug = NULL;
+	s_ctx->Debug = NULL;
+	s_ctx->DirectBus = NULL;
+	s_ctx->DebugHooked = false;
 #endif // SUPERMODEL_DEBUGGER
-	DebugLog("Initialized 68K\n");
+	DEBUG_LOG(Sound, "Initialized 68K\n");
 	return OKAY;
 }
 
+// Direct memory access
+
+void M68KMapROM(UINT32 start, UINT32 end, const UINT8 *ptr, UINT32 mask)
+{
+	for (UINT32 page = (start >> 16) & 0xFF; page <= ((end >> 16) & 0xFF); page++)
+	{
+		s_ctx->Map.Read[page] = &ptr[(page << 16) & mask];
+		s_ctx->Map.Write[page] = NULL;
+	}
+}
+
+void M68KMapRAM(UINT32 start, UINT32 end, UINT8 *ptr, UINT32 mask)
+{
+	for (UINT32 page = (start >> 16) & 0xFF; page <= ((end >> 16) & 0xFF); page++)
+	{
+		s_ctx->Map.Read[page] = &ptr[(page << 16) & mask];
+		s_ctx->Map.Write[page] = &ptr[(page << 16) & mask];
+	}
+}
+
+bool M68KSetEngine(const char *name)
+{
+	if (!stricmp(name, "fast"))
+	{
+		s_ctx->ActiveMap = &s_ctx->Map;
+		return OKAY;
+	}
+	s_ctx->ActiveMap = &s_busOnlyMap;
+	return stricmp(name, "musashi") ? FAIL : OKAY;
+}
+
 #ifdef SUPERMODEL_DEBUGGER
 UINT32 M68KGetRegister(M68KCtx *Src, unsigned reg)
 {
@@ -370,80 +413,139 @@ UINT32 M68KSetRegister(M68KCtx *Src, unsigned reg, UINT32 val)
 
 extern "C" {
 
-#ifdef SUPERMODEL_DEBUGGER
-void M68KDebugCallback()
+void M68KInstructionCallback(void)
 {
-	if (s_Debug != NULL)
+#ifdef SUPERMODEL_DEBUGGER
+	if (s_ctx->DebugHooked)
 	{
 		UINT32 pc = m68k_get_reg(NULL, M68K_REG_PC);
-		UINT32 opcode = s_Bus->Read16(pc);
-		s_Debug->CPUExecute(pc, opcode, s_lastCycles - m68k_cycles_remaining());
+		UINT32 opcode = s_ctx->Bus->Read16(pc);
+		s_ctx->Debug->CPUExecute(pc, opcode, s_lastCycles - m68k_cycles_remaining());
 		s_lastCycles = m68k_cycles_remaining();
 	}
-}
 #endif // SUPERMODEL_DEBUGGER
+	if (s_ctx->Trace != NULL)
+	{
+		// Debugger may have moved the PC
+		UINT32 pc = m68k_get_reg(NULL, M68K_REG_PC);
+		s_ctx->Trace->Record(pc, M68KFetch16(pc), s_ctx->TraceCycles - m68k_cycles_remaining());
+		s_ctx->TraceCycles = m68k_cycles_remaining();
+	}
+}
 
 int M68KIRQCallback(int nIRQ)
 {
 #ifdef SUPERMODEL_DEBUGGER
-	if (s_Debug != NULL)
+	if (s_ctx->Debug != NULL)
 	{
-		s_Debug->CPUException(25);
-		s_Debug->CPUInterrupt(nIRQ - 1);
+		s_ctx->Debug->CPUException(25);
+		s_ctx->Debug->CPUInterrupt(nIRQ - 1);
 	}
 #endif // SUPERMODEL_DEBUGGER
-	if (NULL == IRQAck)	// no handler, use default behavior
+	if (NULL == s_ctx->IRQAck)	// no handler, use default behavior
 	{
 		m68k_set_irq(0);	// clear line
 		return M68K_IRQ_AUTOVECTOR;
 	}
 	else
-		return IRQAck(nIRQ);
+		return s_ctx->IRQAck(nIRQ);
+}
+
+/*
+ * Pages mapped for direct access are used in place of the bus. 32-bit accesses
+ * that would cross into the next page, and all accesses while a debugger is
+ * watching, go through the bus.
+ */
+
+static inline const UINT8 *ReadPage(unsigned int a)
+{
+#ifdef SUPERMODEL_DEBUGGER
+	if (s_ctx->DebugHooked)
+		return NULL;
+#endif // SUPERMODEL_DEBUGGER
+	return s_ctx->ActiveMap->Read[(a >> 16) & 0xFF];
+}
+
+static inline UINT8 *WritePage(unsigned int a)
+{
+#ifdef SUPERMODEL_DEBUGGER
+	if (s_ctx->DebugHooked)
+		return NULL;
+#endif // SUPERMODEL_DEBUGGER
+	return s_ctx->ActiveMap->Write[(a >> 16) & 0xFF];
 }
 
 unsigned int FASTCALL M68KFetch8(unsigned int a)
 {
-	return s_Bus->Read8(a);
+	return M68KRead8(a);
 }
 
 unsigned int FASTCALL M68KFetch16(unsigned int a)
 {
-	return s_Bus->Read16(a);
+	return M68KRead16(a);
 }
 
 unsigned int FASTCALL M68KFetch32(unsigned int a)
 {
-	return s_Bus->Read32(a);
+	return M68KRead32(a);
 }
 
 unsigned int FASTCALL M68KRead8(unsigned int a)
 {
-	return s_Bus->Read8(a);
+	const UINT8 *p = ReadPage(a);
+	if (p != NULL)
+		return p[(a & 0xFFFF) ^ 1];
+	return s_ctx->Bus->Read8(a);
 }
 
 unsigned int FASTCALL M68KRead16(unsigned int a)
 {
-	return s_Bus->Read16(a);
+	const UINT8 *p = ReadPage(a);
+	if (p != NULL)
+		return *(const UINT16 *) &p[a & 0xFFFF];
+	return s_ctx->Bus->Read16(a);
 }
 
 unsigned int FASTCALL M68KRead32(unsigned int a)
 {
-	return s_Bus->Read32(a);
+	const UINT8 *p = ReadPage(a);
+	if (p != NULL && (a & 0xFFFF) <= 0xFFFC)
+	{
+		UINT32 hi = *(const UINT16 *) &p[a & 0xFFFF];
+		UINT32 lo = *(const UINT16 *) &p[(a & 0xFFFF) + 2];
+		return (hi << 16) | lo;
+	}
+	return s_ctx->Bus->Read32(a);
 }
 
 void FASTCALL M68KWrite8(unsigned int a, unsigned int d)
 {
-	s_Bus->Write8(a, d);
+	UINT8 *p = WritePage(a);
+	if (p != NULL)
+		p[(a & 0xFFFF) ^ 1] = d;
+	else
+		s_ctx->Bus->Write8(a, d);
 }
 
 void FASTCALL M68KWrite16(unsigned int a, unsigned int d)
 {
-	s_Bus->Write16(a, d);
+	UINT8 *p = WritePage(a);
+	if (p != NULL)
+		*(UINT16 *) &p[a & 0xFFFF] = d;
+	else
+		s_ctx->Bus->Write16(a, d);
 }
 
 void FASTCALL M68KWrite32(unsigned int a, unsigned int d)
 {
-	s_Bus->Write32(a, d);
+	UINT8 *p = WritePage(a);
+	if (p != NULL && (a & 0xFFFF) <= 0xFFFC)
+	{
+		*(UINT16 *) &p[a & 0xFFFF] = d >> 16;
+		*(UINT16 *) &p[(a & 0xFFFF) + 2] = d & 0xFFFF;
+	}
+	else
+		s_ctx->Bus->Write32(a, d);
 }
 
 }	// extern "C"
@@ -50,6 +50,8 @@ namespace Debugger {
 }
 #endif // SUPERMODEL_DEBUGGER
 
+class CExecTrace;
+
 /******************************************************************************
  Definitions 
 ******************************************************************************/
@@ -68,25 +70,55 @@ namespace Debugger {
  *
  * Complete state of a single 68K. Do NOT manipulate these directly. Set the
  * context and then use the M68K* functions below to attach a bus and IRQ
- * callback to the active context.
+ * callback to the active context. Each board owns its context, which is run in
+ * place while it is active, so it must not be active on two threads at once.
  */
+
+/*
+ * M68KMemoryMap:
+ *
+ * Memory that the 68K may access directly instead of through the bus, one
+ * host pointer per 64 KB page of the 24-bit address space (NULL for pages that
+ * must go through the bus). Pages hold 16-bit words in host order, as board
+ * memory always does. See M68KMapROM() and M68KMapRAM().
+ */
+struct M68KMemoryMap
+{
+	const UINT8		*Read[256];		// pages fetched and read directly
+	UINT8			*Write[256];	// pages written directly
+};
+
 typedef struct SM68KCtx
 {
 public:
 	m68ki_cpu_core	musashiCtx;		// CPU context
 	IBus			*Bus;			// memory handlers
 	int				(*IRQAck)(int);	// IRQ acknowledge callback
+	int				IRQLevel;		// interrupt level last set with M68KSetIRQ()
+	M68KMemoryMap	Map;			// memory mapped by the board
+	const M68KMemoryMap	*ActiveMap;	// Map for the "fast" engine, an empty map for "musashi"
+	CExecTrace		*Trace;			// instruction trace (NULL when not tracing)
+	int				TraceCycles;	// cycles remaining at the last recorded instruction
 #ifdef SUPERMODEL_DEBUGGER
 	Debugger::CMusashi68KDebug *Debug;        // holds debugger (if attached)
+	IBus			*DirectBus;		// bus wrapped by the debugger, used while it has nothing to check
+	bool			DebugHooked;	// running with the debugger's hooks
 #endif // SUPERMODEL_DEBUGGER
 
 	SM68KCtx(void)
 	{
 		Bus = NULL;
 		IRQAck = NULL;
+		IRQLevel = 0;
+		memset(&Map, 0, sizeof(Map));
+		ActiveMap = &Map;
+		Trace = NULL;
+		TraceCycles = 0;
 		memset(&musashiCtx, 0, sizeof(musashiCtx));	// very important! garbage in context at reset can cause very strange bugs
 #ifdef SUPERMODEL_DEBUGGER
 		Debug = NULL;
+		DirectBus = NULL;
+		DebugHooked = false;
 #endif // SUPERMODEL_DEBUGGER
 	}
 	
@@ -101,7 +133,8 @@ public:
 /******************************************************************************
  68K Interface
  
- Unless otherwise noted, all functions operate on the active context.
+ Unless otherwise noted, all functions operate on the active context of the
+ calling thread.
 ******************************************************************************/
 	
 /*
@@ -185,6 +218,15 @@ extern void M68KLoadState(CBlockFile *StateFile, const char *name);
  */
 extern void M68KSetIRQ(int irqLevel);
 
+/*
+ * M68KGetIRQ():
+ *
+ * Returns:
+ *		The interrupt level last set with M68KSetIRQ() on the currently active
+ *		CPU, for boards that arbitrate between interrupt sources.
+ */
+extern int M68KGetIRQ(void);
+
 /*
  * M68KRun(numCycles):
  *
@@ -242,22 +284,58 @@ extern void M68KAttachBus(IBus *BusPtr);
 extern bool M68KInit(void);
 
 /*
- * M68KGetContext(M68KCtx *Dest):
+ * M68KMapROM(start, end, ptr, mask):
+ * M68KMapRAM(start, end, ptr, mask):
  *
- * Copies the internal (active) 68K context back to the destination.
+ * Maps plain memory of the board so that the "fast" engine can access it
+ * without calling the bus. Address a in start-end (which must cover whole 64 KB
+ * pages) is taken to be ptr[a & mask], exactly as the bus handlers would do it.
+ * ROM is fetched and read directly; RAM is also written directly. Only memory
+ * whose accesses have no side effects may be mapped. Call after M68KInit();
+ * pages may be mapped again at any time, e.g. when a bank is switched.
  *
  * Parameters:
- *		Dest	Location to which to copy 68K context.
+ *		start	First address (multiple of 0x10000).
+ *		end		Last address (0xFFFF modulo 0x10000).
+ *		ptr		Board memory, in 16-bit host-order words.
+ *		mask	Address mask giving the offset into ptr.
  */
-extern void M68KGetContext(M68KCtx *Dest);
+extern void M68KMapROM(UINT32 start, UINT32 end, const UINT8 *ptr, UINT32 mask);
+extern void M68KMapRAM(UINT32 start, UINT32 end, UINT8 *ptr, UINT32 mask);
+
+/*
+ * M68KSetEngine(name):
+ *
+ * Selects how the 68K runs. "musashi" performs every memory access through the
+ * attached bus and is the reference. "fast", the default, accesses the memory
+ * mapped with M68KMapROM() and M68KMapRAM() directly, which gives identical
+ * results. All accesses go through the bus while a debugger is attached.
+ *
+ * Parameters:
+ *		name	Engine name.
+ *
+ * Returns:
+ *		OKAY if the engine was selected, FAIL if the name is not recognized
+ *		(in which case "musashi" is used).
+ */
+extern bool M68KSetEngine(const char *name);
+
+/*
+ * M68KGetContext():
+ *
+ * Returns:
+ *		The active 68K context of the calling thread (NULL if none).
+ */
+extern M68KCtx *M68KGetContext(void);
 
 /*
  * M68KSetContext(M68KCtx *Src):
  *
- * Sets the specified 68K context by copying it to the internal context.
+ * Makes the specified 68K context the active one for the calling thread. It is
+ * not copied; all changes are made to it directly until another is set.
  *
  * Parameters:
- *		Src		Location from which to copy 68K context.
+ *		Src		68K context to make active (may be NULL).
  */
 extern void M68KSetContext(M68KCtx *Src);
 
@@ -317,9 +395,7 @@ UINT32 M68KSetRegister(SM68KCtx *ctx, unsigned reg, UINT32 val);
 
 extern "C" {
 
-#ifdef SUPERMODEL_DEBUGGER
-extern void M68KDebugCallback();
-#endif // SUPERMODEL_DEBUGGER
+extern void M68KInstructionCallback(void);
 	
 /*
  * M68KIRQCallback(nIRQ):
@@ -322,6 +322,12 @@ void m68k_pulse_reset(void);
 /* execute num_cycles worth of instructions.  returns number of cycles used */
 int m68k_execute(int num_cycles);
 
+/* as m68k_execute(), but calls the instruction hook before every instruction.
+ * m68k_execute() never calls it, so that it runs at full speed.
+ * Only available if M68K_INSTRUCTION_HOOK is enabled in m68kconf.h.
+ */
+int m68k_execute_hooked(int num_cycles);
+
 /* These functions let you read/write/modify the number of cycles left to run
  * while m68k_execute() is running.
  * These are useful if the 68k accesses a memory-mapped port on another device
@@ -348,10 +354,12 @@ void m68k_pulse_halt(void);
 /* Get the size of the cpu context in bytes */
 unsigned int m68k_context_size(void);
 
-/* Get a cpu context */
+/* Get a copy of the current cpu context */
 unsigned int m68k_get_context(void* dst);
 
-/* set the current cpu context */
+/* set the current cpu context of the calling thread. The context is run in
+ * place, so it must stay valid for as long as it is the current one.
+ */
 void m68k_set_context(void* dst);
 
 /* Register the CPU state information */
@@ -152,14 +152,12 @@
 
 /* If ON, CPU will call the instruction hook callback before every
  * instruction.
+ *
+ * Supermodel: only m68k_execute_hooked() calls it (for the debugger and the
+ * instruction trace), so m68k_execute() does not pay for it.
  */
-#ifdef SUPERMODEL_DEBUGGER
 #define M68K_INSTRUCTION_HOOK       OPT_SPECIFY_HANDLER
-#define M68K_INSTRUCTION_CALLBACK() M68KDebugCallback()
-#else
-#define M68K_INSTRUCTION_HOOK       OPT_OFF
-#define M68K_INSTRUCTION_CALLBACK() your_instruction_hook_function()
-#endif // SUPERMODEL_DEBUGGER
+#define M68K_INSTRUCTION_CALLBACK() M68KInstructionCallback()
 
 /* If ON, the CPU will emulate the 4-byte prefetch queue of a real 68000 */
 #define M68K_EMULATE_PREFETCH       OPT_OFF
@@ -203,6 +201,19 @@
 #define INLINE static __inline__	// defined for GCC; if using MSVC, pass INLINE as "static __inline" from Makefile
 #endif /* INLINE */
 
+
+/* Set to your compiler's thread-local storage keyword. The active context
+ * and the state of the timeslice being run are kept per thread, so that
+ * different threads can run different CPUs at the same time.
+ */
+#ifndef M68K_THREAD_LOCAL
+#ifdef _MSC_VER
+#define M68K_THREAD_LOCAL __declspec(thread)
+#else
+#define M68K_THREAD_LOCAL __thread
+#endif
+#endif /* M68K_THREAD_LOCAL */
+
 /******************************************************************************
  Supermodel Interface
 ******************************************************************************/
@@ -221,6 +232,7 @@ unsigned int FASTCALL M68KRead32(unsigned int a);
 void FASTCALL M68KWrite8(unsigned int a, unsigned int d);
 void FASTCALL M68KWrite16(unsigned int a, unsigned int d);
 void FASTCALL M68KWrite32(unsigned int a, unsigned int d);
+void M68KInstructionCallback(void);
 
 /* Read data relative to the PC */
 #define m68k_read_pcrelative_8(address) M68KFetch8(address)
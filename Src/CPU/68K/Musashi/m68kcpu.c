@@ -27,8 +27,9 @@
  * Permission was obtained from Karl Stenerud to apply the GPL license to this
  * code.
  *
- * NOTE: The internal CPU context is initialized to all zeros here. If setting
- * an external context for the first time, make sure it is cleared first, 
+ * NOTE: There is no internal CPU context. Each thread runs whichever context
+ * it last passed to m68k_set_context(), which must be done before using any
+ * other function. Make sure a context is cleared before it is first set,
  * otherwise interrupts may appear pending and other nasty problems.
  */
 
@@ -73,10 +74,10 @@ static const char* copyright_notice =
 /* ================================= DATA ================================= */
 /* ======================================================================== */
 
-int  m68ki_initial_cycles;
-int  m68ki_remaining_cycles = 0;                     /* Number of clocks remaining */
-uint m68ki_tracing = 0;
-uint m68ki_address_space;
+M68K_THREAD_LOCAL int  m68ki_initial_cycles;
+M68K_THREAD_LOCAL int  m68ki_remaining_cycles = 0;   /* Number of clocks remaining */
+M68K_THREAD_LOCAL uint m68ki_tracing = 0;
+M68K_THREAD_LOCAL uint m68ki_address_space;
 
 #ifdef M68K_LOG_ENABLE
 const char* m68ki_cpu_names[] =
@@ -101,16 +102,16 @@ const char* m68ki_cpu_names[] =
 };
 #endif /* M68K_LOG_ENABLE */
 
-/* The CPU core */
-m68ki_cpu_core m68ki_cpu = {0};
+/* The CPU core (active context of this thread) */
+M68K_THREAD_LOCAL m68ki_cpu_core *m68ki_cpu_p = NULL;
 
 #if M68K_EMULATE_ADDRESS_ERROR
-jmp_buf m68ki_aerr_trap;
+M68K_THREAD_LOCAL jmp_buf m68ki_aerr_trap;
 #endif /* M68K_EMULATE_ADDRESS_ERROR */
 
-uint    m68ki_aerr_address;
-uint    m68ki_aerr_write_mode;
-uint    m68ki_aerr_fc;
+M68K_THREAD_LOCAL uint m68ki_aerr_address;
+M68K_THREAD_LOCAL uint m68ki_aerr_write_mode;
+M68K_THREAD_LOCAL uint m68ki_aerr_fc;
 
 /* Used by shift & rotate instructions */
 uint8 m68ki_shift_8_table[65] =
@@ -458,7 +459,6 @@ static void default_instr_hook_callback(void)
 
 #if M68K_EMULATE_ADDRESS_ERROR
 	#include <setjmp.h>
-	jmp_buf m68ki_aerr_trap;
 #endif /* M68K_EMULATE_ADDRESS_ERROR */
 
 
@@ -711,7 +711,8 @@ void m68k_set_cpu_type(unsigned int cpu_type)
 
 /* Execute some instructions until we use up num_cycles clock cycles */
 /* ASG: removed per-instruction interrupt checks */
-int m68k_execute(int num_cycles)
+/* The loop is compiled with and without the instruction hook (see below) */
+static inline int m68ki_execute(int num_cycles, int hooked)
 {
 	/* Make sure we're not stopped */
 	if(!CPU_STOPPED)
@@ -737,7 +738,10 @@ int m68k_execute(int num_cycles)
 			m68ki_use_data_space(); /* auto-disable (see m68kcpu.h) */
 
 			/* Call external hook to peek at CPU */
-			m68ki_instr_hook(); /* auto-disable (see m68kcpu.h) */
+#if M68K_INSTRUCTION_HOOK
+			if(hooked)
+				m68ki_instr_hook();
+#endif /* M68K_INSTRUCTION_HOOK */
 
 			/* Record previous program counter */
 			REG_PPC = REG_PC;
@@ -769,6 +773,18 @@ int m68k_execute(int num_cycles)
 	return num_cycles;
 }
 
+int m68k_execute(int num_cycles)
+{
+	return m68ki_execute(num_cycles, 0);
+}
+
+#if M68K_INSTRUCTION_HOOK
+int m68k_execute_hooked(int num_cycles)
+{
+	return m68ki_execute(num_cycles, 1);
+}
+#endif /* M68K_INSTRUCTION_HOOK */
+
 
 int m68k_cycles_run(void)
 {
@@ -887,9 +903,10 @@ unsigned int m68k_get_context(void* dst)
 	return sizeof(m68ki_cpu_core);
 }
 
+/* The context is used in place (not copied) until another is set */
 void m68k_set_context(void* src)
 {
-	if(src) m68ki_cpu = *(m68ki_cpu_core*)src;
+	m68ki_cpu_p = (m68ki_cpu_core*)src;
 }
 
 
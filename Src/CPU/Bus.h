@@ -79,6 +79,24 @@ public:
 	virtual void	Write32(UINT32 addr, UINT32 data)	{}
 	virtual void	Write64(UINT32 addr, UINT64 data)	{}
 	
+	/*
+	 * CopyBlock(dest, src, numBytes):
+	 *
+	 * Copies a block of memory in one go, with the same result as calling
+	 * Write32(dest, Read32(src)) for each word in ascending order. For devices
+	 * that perform bus to bus transfers.
+	 *
+	 * Parameters:
+	 *		dest		Destination address (word aligned).
+	 *		src			Source address (word aligned).
+	 *		numBytes	Number of bytes, a multiple of 4.
+	 *
+	 * Returns:
+	 *		True if the block was copied, false if the caller must copy it word
+	 *		by word (the default).
+	 */
+	virtual bool	CopyBlock(UINT32 dest, UINT32 src, UINT32 numBytes)	{ return false; }
+	
 	/*
 	 * IORead8(addr):
 	 *
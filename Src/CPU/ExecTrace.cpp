@@ -0,0 +1,125 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ExecTrace.cpp
+ *
+ * Instruction flight recorder. See ExecTrace.h for the format.
+ */
+
+#include "Supermodel.h"
+#include "CPU/ExecTrace.h"
+
+static const char s_magic[8] = { 'S', 'M', 'T', 'R', 'A', 'C', 'E', '1' };
+
+CExecTrace::CExecTrace(const std::string &name, CPUType cpu, size_t instructions)
+	: m_name(name), m_cpu(cpu)
+{
+	switch (cpu)
+	{
+	case PowerPC:	m_opcodeBytes = 4; break;
+	case M68K:		m_opcodeBytes = 2; break;
+	default:		m_opcodeBytes = 1; break;
+	}
+
+	// Typical record is a byte each for the address change and cycles
+	size_t numBlocks = (instructions * (m_opcodeBytes + 2) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	if (numBlocks < 2)
+		numBlocks = 2;
+	m_data.resize(numBlocks * BLOCK_SIZE);
+	m_blocks.resize(numBlocks);
+	Clear();
+}
+
+const std::string &CExecTrace::Name() const
+{
+	return m_name;
+}
+
+void CExecTrace::Clear()
+{
+	m_block = 0;
+	m_filled = 1;
+	m_lastPC = 0;
+	m_cycle = 0;
+	m_blocks[0].pc = 0;
+	m_blocks[0].used = 0;
+	m_blocks[0].cycle = 0;
+	m_pos = &m_data[0];
+	m_limit = m_pos + BLOCK_SIZE - MAX_RECORD;
+}
+
+UINT8 *CExecTrace::NextBlock()
+{
+	m_blocks[m_block].used = UINT32(m_pos - &m_data[m_block * BLOCK_SIZE]);
+
+	// Oldest block is overwritten once the ring is full
+	m_block = (m_block + 1) % m_blocks.size();
+	if (m_filled < m_blocks.size())
+		m_filled++;
+	m_blocks[m_block].pc = m_lastPC;
+	m_blocks[m_block].used = 0;
+	m_blocks[m_block].cycle = m_cycle;
+
+	m_pos = &m_data[m_block * BLOCK_SIZE];
+	m_limit = m_pos + BLOCK_SIZE - MAX_RECORD;
+	return m_pos;
+}
+
+bool CExecTrace::Write(FILE *file) const
+{
+	UINT8 nameLength = UINT8(m_name.length() < 255 ? m_name.length() : 255);
+	UINT8 cpu = UINT8(m_cpu);
+	UINT8 opcodeBytes = UINT8(m_opcodeBytes);
+	UINT32 numBlocks = UINT32(m_filled);
+	bool ok = fwrite(&nameLength, sizeof(nameLength), 1, file) == 1
+		&& (nameLength == 0 || fwrite(m_name.data(), nameLength, 1, file) == 1)
+		&& fwrite(&cpu, sizeof(cpu), 1, file) == 1
+		&& fwrite(&opcodeBytes, sizeof(opcodeBytes), 1, file) == 1
+		&& fwrite(&numBlocks, sizeof(numBlocks), 1, file) == 1;
+
+	size_t first = (m_block + m_blocks.size() + 1 - m_filled) % m_blocks.size();
+	for (size_t i = 0; ok && i < m_filled; i++)
+	{
+		size_t index = (first + i) % m_blocks.size();
+		const Block &block = m_blocks[index];
+		const UINT8 *data = &m_data[index * BLOCK_SIZE];
+		UINT32 used = index == m_block ? UINT32(m_pos - data) : block.used;
+		ok = fwrite(&block.pc, sizeof(block.pc), 1, file) == 1
+			&& fwrite(&block.cycle, sizeof(block.cycle), 1, file) == 1
+			&& fwrite(&used, sizeof(used), 1, file) == 1
+			&& (used == 0 || fwrite(data, used, 1, file) == 1);
+	}
+	return ok ? OKAY : FAIL;
+}
+
+bool CExecTrace::WriteFile(const char *file, const std::vector<const CExecTrace *> &traces)
+{
+	FILE *fp = fopen(file, "wb");
+	if (fp == NULL)
+		return FAIL;
+	UINT32 count = UINT32(traces.size());
+	bool ok = fwrite(s_magic, sizeof(s_magic), 1, fp) == 1 && fwrite(&count, sizeof(count), 1, fp) == 1;
+	for (size_t i = 0; ok && i < traces.size(); i++)
+		ok = traces[i]->Write(fp) == OKAY;
+	ok = fclose(fp) == 0 && ok;
+	return ok ? OKAY : FAIL;
+}
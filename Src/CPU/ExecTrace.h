@@ -0,0 +1,166 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ExecTrace.h
+ *
+ * Header file for CExecTrace, a flight recorder of the instructions a CPU has
+ * executed most recently.
+ */
+
+#ifndef INCLUDED_EXECTRACE_H
+#define INCLUDED_EXECTRACE_H
+
+#include "Types.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Keeps the most recent instructions executed by one CPU: the address, the
+ * opcode and the cycles run since the previous one.  CPU cores call Record()
+ * before each instruction from the thread that runs them, which is the only
+ * writer, so no locking is needed.  Traces are written out while the CPU is
+ * stopped (or, after a crash, as they stand).
+ *
+ * Instructions are delta-encoded into a ring of fixed-size blocks.  Each block
+ * starts from the address and cycle count the previous one ended at, so that
+ * the oldest block can be overwritten whole and every block decodes on its
+ * own.  A record is the address change as a zigzag varint, the opcode as
+ * stored (4 bytes for the PowerPC, the first 16-bit word for the 68K, the
+ * first byte for the Z80, low byte first) and the cycles as a varint: about 6
+ * bytes for a PowerPC instruction.
+ *
+ * Trace files start with the magic "SMTRACE1" and a 32-bit number of traces.
+ * Each trace then has its name (length byte and characters), CPU type and
+ * opcode size (one byte each), its number of blocks (32 bits) and the blocks,
+ * oldest first: start address (32 bits), start cycle (64 bits), number of
+ * bytes (32 bits) and the encoded records.  Values are in host byte order.
+ * Src/CPU/TraceDecoder.cpp lists them.
+ */
+class CExecTrace
+{
+public:
+	enum CPUType
+	{
+		PowerPC = 0,
+		M68K = 1,
+		Z80 = 2
+	};
+
+	/*
+	 * Records an instruction about to be executed.  Cycles are those run since
+	 * the previous one was recorded.
+	 */
+	void Record(UINT32 pc, UINT32 opcode, UINT32 cycles);
+
+	/*
+	 * Forgets all recorded instructions, as after a reset or state load.
+	 */
+	void Clear();
+
+	/*
+	 * Writes the trace, oldest instruction first.  Returns FAIL on a write
+	 * error.
+	 */
+	bool Write(FILE *file) const;
+
+	/*
+	 * Writes a trace file holding the given traces.  Returns FAIL if it
+	 * could not be written.
+	 */
+	static bool WriteFile(const char *file, const std::vector<const CExecTrace *> &traces);
+
+	const std::string &Name() const;
+
+	/*
+	 * Keeps at least roughly the given number of instructions.
+	 */
+	CExecTrace(const std::string &name, CPUType cpu, size_t instructions);
+
+private:
+	static const size_t BLOCK_SIZE = 4096;
+	static const size_t MAX_RECORD = 5 + 4 + 5;  // two varints and the largest opcode
+
+	struct Block
+	{
+		UINT32 pc;      // address the block's first record is relative to
+		UINT32 used;    // bytes of records, when no longer the current block
+		UINT64 cycle;   // cycles run before the block's first record
+	};
+
+	std::string m_name;
+	CPUType m_cpu;
+	unsigned m_opcodeBytes;
+	std::vector<UINT8> m_data;
+	std::vector<Block> m_blocks;
+	size_t m_block;   // current block
+	size_t m_filled;  // blocks holding records
+	UINT8 *m_pos;     // next record
+	UINT8 *m_limit;   // last position a whole record fits at
+	UINT32 m_lastPC;
+	UINT64 m_cycle;
+
+	UINT8 *NextBlock();
+};
+
+inline void CExecTrace::Record(UINT32 pc, UINT32 opcode, UINT32 cycles)
+{
+	UINT8 *p = m_pos;
+	if (p > m_limit)
+		p = NextBlock();
+
+	UINT32 delta = pc - m_lastPC;
+	UINT32 value = (delta << 1) ^ (UINT32) ((INT32) delta >> 31);
+	while (value >= 0x80)
+	{
+		*p++ = UINT8(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = UINT8(value);
+
+	p[0] = UINT8(opcode);
+	if (m_opcodeBytes > 1)
+	{
+		p[1] = UINT8(opcode >> 8);
+		if (m_opcodeBytes > 2)
+		{
+			p[2] = UINT8(opcode >> 16);
+			p[3] = UINT8(opcode >> 24);
+		}
+	}
+	p += m_opcodeBytes;
+
+	value = cycles;
+	while (value >= 0x80)
+	{
+		*p++ = UINT8(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = UINT8(value);
+
+	m_pos = p;
+	m_lastPC = pc;
+	m_cycle += cycles;
+}
+
+#endif	// INCLUDED_EXECTRACE_H
@@ -28,9 +28,31 @@
 
 /* IBM/Motorola PowerPC 4xx/6xx Emulator */
 
-#include <cstring>	// memset()
+#include <cstring>	// memset(), memcpy()
+#include <cstddef>	// offsetof()
+#include <cstdlib>	// qsort()
+#include <climits>	// INT_MIN
+#include <algorithm>
+#include <vector>
+#include <mutex>		// std::call_once()
 #include "Supermodel.h"
 #include "ppc.h"
+#ifdef SUPERMODEL_DEBUGGER
+#include "Debugger/Label.h"	// profiler symbolization
+#endif // SUPERMODEL_DEBUGGER
+
+// Dynamic recompiler is available on x86-64 hosts only
+#if defined(__x86_64__) || defined(_M_X64)
+#define PPC_JIT_X64	1
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>	// VirtualAlloc()
+#else
+#include <sys/mman.h>	// mmap()
+#endif
+#else
+#define PPC_JIT_X64	0
+#endif
 
 // Typedefs that Supermodel no longer provides
 typedef unsigned int	UINT;
@@ -38,17 +60,28 @@ typedef unsigned int	UINT;
 // C++ should allow this...
 #define INLINE	inline
 
-// Model 3 context provides read/write handlers
-static class IBus	*Bus = NULL;	// pointer to Model 3 bus object (for access handlers)
+// Direct memory map pages (4 KB)
+#define PPC_MAP_SHIFT	12
+#define PPC_MAP_MASK	((1 << PPC_MAP_SHIFT) - 1)
 
-#ifdef SUPERMODEL_DEBUGGER
-// Pointer to current PPC debugger (if any)
-static class Debugger::CPPCDebug *PPCDebug = NULL;
-#endif
+// Fetch region index granules (1 MB)
+#define PPC_FETCH_SHIFT	20
+#define PPC_FETCH_SPLIT	0xFF	// granule not covered by exactly one region
 
 void ppc603_exception(int exception);
 static void ppc603_check_interrupts(void);
 
+// Translation cache and block engines (ppc_jit.c)
+static void ppc_jit_flush(void);
+static void ppc_jit_set_fetch(PPC_FETCH_REGION *fetch);
+static void ppc_jit_write(UINT32 address, UINT32 size);
+static bool ppc_jit_alloc(PPC_ENGINE engine);
+static void ppc_jit_shutdown(void);
+static bool ppc_jit_execute_block(void);
+
+// Idle loop detection (ppc_idle.c)
+static void ppc_idle_flush(void);
+
 #define RD				((op >> 21) & 0x1F)
 #define RT				((op >> 21) & 0x1f)
 #define RS				((op >> 21) & 0x1f)
@@ -176,6 +209,7 @@ typedef struct {
 
 typedef struct {
 	bool	fatalError;	// if true, halt PowerPC until hard reset
+	bool	jit_exit;	// if true, translated code returns to the dispatcher (must follow fatalError)
 	
 	UINT32 r[32];
 	UINT32 pc;
@@ -255,6 +289,7 @@ typedef struct {
 
 	// Timing related
 	int timer_ratio;
+	UINT64 timer_recip;		// floor(2^32 / timer_ratio) + 1, see ppc_timer_ticks()
 	UINT32 timer_frac;
 	int tb_base_icount;
 	int dec_base_icount;
@@ -285,12 +320,163 @@ typedef struct {
 
 
 
-static PPC_REGS ppc;
+/*
+ * PPC_CONTEXT:
+ *
+ * Everything that belongs to one PowerPC: its registers, memory map,
+ * translation cache and whatever is attached to it. Each thread runs the
+ * context last passed to ppc_set_context() on it, which the names defined
+ * below refer to, so the code reads as though there were a single PowerPC.
+ * Tables built from constants by ppc_init() are shared by all contexts.
+ */
+struct PPC_JIT_STATE;		// ppc_jit.c
+struct PPC_IDLE_STATE;		// ppc_idle.c
+struct PPC_PROFILE_STATE;	// ppc_profile.c
+
+struct PPC_CONTEXT
+{
+	PPC_REGS	ppc;
+
+	// Model 3 context provides read/write handlers
+	class IBus	*Bus = NULL;	// pointer to Model 3 bus object (for access handlers)
+
+	// Translation cache and block engines (ppc_jit.c)
+	PPC_ENGINE	ppc_engine = PPC_ENGINE_INTERPRETER;
+	PPC_JIT_STATE		*jit = NULL;
+
+	// Floating point flag tracking (ppc_ops.c)
+	PPC_FPU_MODE	ppc_fpu_mode = PPC_FPU_ACCURATE;
+	bool		ppc_fpscr_stale = false;	// arithmetic changed flags since FPSCR was last read
+	UINT64		ppc_stale_fpscr_reads = 0;
+
+	// Idle loop detection (ppc_idle.c) and profiler (ppc_profile.c)
+	PPC_IDLE_STATE		*idle = NULL;
+	PPC_PROFILE_STATE	*profile = NULL;
+
+	// Instruction trace (NULL when not tracing)
+	class CExecTrace	*ppc_trace = NULL;
+	int			ppc_trace_icount = 0;	// icount at the last recorded instruction
+
+	// Address watch, stopped once hit
+	bool		ppc_watch_enabled = false;
+	bool		ppc_watch_hit = false;
+	UINT32		ppc_watch_pc = 0;
+
+	// Direct memory map: host pointer to each 4 KB page, or NULL to use the bus
+	UINT8		*ppc_read_map[1 << (32 - PPC_MAP_SHIFT)];
+	UINT8		*ppc_write_map[1 << (32 - PPC_MAP_SHIFT)];
+
+	// Pages holding translated code (one bit per page) are left out of the write
+	// map, so that stores to them take the slow path and invalidate the code
+	UINT8		ppc_code_pages[1 << (32 - PPC_MAP_SHIFT - 3)];
+	UINT8		ppc_writeable_pages[1 << (32 - PPC_MAP_SHIFT - 3)];
+
+	// Fetch region covering each 1 MB of the address space: index into ppc.fetch
+	// plus one, 0 if none, or PPC_FETCH_SPLIT if the regions must be searched
+	UINT8		ppc_fetch_index[1 << (32 - PPC_FETCH_SHIFT)];
+
+#ifdef SUPERMODEL_DEBUGGER
+	// Pointer to current PPC debugger (if any)
+	class Debugger::CPPCDebug *PPCDebug = NULL;
+
+	// Debugger's bus and the one it wraps; Bus is set to one or the other for each
+	// time slice, depending on whether the debugger needs to see accesses
+	class IBus	*DebugBus = NULL;
+	class IBus	*DirectBus = NULL;
+	bool		ppc_debug_hooked = false;	// running the debug variant of the loop
+#endif
+};
+
+// Active context of this thread
+static thread_local PPC_CONTEXT *ppc_ctx = NULL;
+
+#define ppc					(ppc_ctx->ppc)
+#define Bus					(ppc_ctx->Bus)
+#define ppc_engine			(ppc_ctx->ppc_engine)
+#define ppc_fpu_mode		(ppc_ctx->ppc_fpu_mode)
+#define ppc_fpscr_stale		(ppc_ctx->ppc_fpscr_stale)
+#define ppc_stale_fpscr_reads	(ppc_ctx->ppc_stale_fpscr_reads)
+#define ppc_trace			(ppc_ctx->ppc_trace)
+#define ppc_trace_icount	(ppc_ctx->ppc_trace_icount)
+#define ppc_watch_enabled	(ppc_ctx->ppc_watch_enabled)
+#define ppc_watch_hit		(ppc_ctx->ppc_watch_hit)
+#define ppc_watch_pc		(ppc_ctx->ppc_watch_pc)
+#define ppc_read_map		(ppc_ctx->ppc_read_map)
+#define ppc_write_map		(ppc_ctx->ppc_write_map)
+#define ppc_code_pages		(ppc_ctx->ppc_code_pages)
+#define ppc_writeable_pages	(ppc_ctx->ppc_writeable_pages)
+#define ppc_fetch_index		(ppc_ctx->ppc_fetch_index)
+#ifdef SUPERMODEL_DEBUGGER
+#define PPCDebug			(ppc_ctx->PPCDebug)
+#define DebugBus			(ppc_ctx->DebugBus)
+#define DirectBus			(ppc_ctx->DirectBus)
+#define ppc_debug_hooked	(ppc_ctx->ppc_debug_hooked)
+#endif
+
 static UINT32 ppc_rotate_mask[32][32];
 
+static void ppc_set_code_page(UINT32 address, bool code)
+{
+	UINT32 page = address >> PPC_MAP_SHIFT;
+	UINT8 bit = 1 << (page & 7);
+
+	if (code)
+	{
+		ppc_code_pages[page >> 3] |= bit;
+		ppc_write_map[page] = NULL;
+	}
+	else
+	{
+		ppc_code_pages[page >> 3] &= ~bit;
+		if (ppc_writeable_pages[page >> 3] & bit)
+			ppc_write_map[page] = ppc_read_map[page];
+	}
+}
+
+/*
+ * Returns the index into ppc.fetch of the region containing pc, or -1. Almost
+ * every lookup is settled by the index; only granules holding the edge of a
+ * region fall back to searching.
+ */
+static int ppc_fetch_region(UINT32 pc)
+{
+	int index = ppc_fetch_index[pc >> PPC_FETCH_SHIFT];
+	if (index != PPC_FETCH_SPLIT)
+		return index - 1;
+
+	for (int i = 0; ppc.fetch[i].ptr != NULL; i++)
+	{
+		if (ppc.fetch[i].start <= pc && pc <= ppc.fetch[i].end)
+			return i;
+	}
+	return -1;
+}
+
+static void ppc_build_fetch_index(void)
+{
+	memset(ppc_fetch_index, 0, sizeof(ppc_fetch_index));
+	for (int i = 0; ppc.fetch != NULL && ppc.fetch[i].ptr != NULL; i++)
+	{
+		UINT32 first = ppc.fetch[i].start >> PPC_FETCH_SHIFT;
+		UINT32 last = ppc.fetch[i].end >> PPC_FETCH_SHIFT;
+		for (UINT32 g = first; g <= last; g++)
+		{
+			UINT32 start = g << PPC_FETCH_SHIFT;
+			UINT32 end = start + ((1 << PPC_FETCH_SHIFT) - 1);
+			bool whole = ppc.fetch[i].start <= start && end <= ppc.fetch[i].end;
+
+			// Earlier regions take precedence, as they did when searching
+			if (whole && ppc_fetch_index[g] == 0 && i + 1 < PPC_FETCH_SPLIT)
+				ppc_fetch_index[g] = i + 1;
+			else
+				ppc_fetch_index[g] = PPC_FETCH_SPLIT;
+		}
+	}
+}
+
 static void ppc_change_pc(UINT32 newpc)
 {
-	UINT i;
+	int i;
 
 	if (ppc.cur_fetch.start <= newpc && newpc <= ppc.cur_fetch.end)
 	{
@@ -299,63 +485,147 @@ static void ppc_change_pc(UINT32 newpc)
 		return;
 	}
 
-	for(i = 0; ppc.fetch[i].ptr != NULL; i++)
+	i = ppc_fetch_region(newpc);
+	if (i >= 0)
 	{
-		if (ppc.fetch[i].start <= newpc && newpc <= ppc.fetch[i].end)
-		{
-			ppc.cur_fetch.start = ppc.fetch[i].start;
-			ppc.cur_fetch.end = ppc.fetch[i].end;
-			ppc.cur_fetch.ptr = ppc.fetch[i].ptr;
+		ppc.cur_fetch.start = ppc.fetch[i].start;
+		ppc.cur_fetch.end = ppc.fetch[i].end;
+		ppc.cur_fetch.ptr = ppc.fetch[i].ptr;
 
-//			ppc.op = (UINT32 *)((UINT32)ppc.cur_fetch.ptr + (UINT32)(newpc - ppc.cur_fetch.start));
-			ppc.op = &ppc.cur_fetch.ptr[(newpc-ppc.cur_fetch.start)/4];			
-			return;
-		}
+//		ppc.op = (UINT32 *)((UINT32)ppc.cur_fetch.ptr + (UINT32)(newpc - ppc.cur_fetch.start));
+		ppc.op = &ppc.cur_fetch.ptr[(newpc-ppc.cur_fetch.start)/4];
+		return;
 	}
 
-	DebugLog("Invalid PC %08X, previous PC %08X\n", newpc, ppc.pc);
+	DEBUG_LOG(PPC, "Invalid PC %08X, previous PC %08X\n", newpc, ppc.pc);
 	ErrorLog("PowerPC is out of bounds. Halting emulation until reset.");
 	ppc.fatalError = true;
 }
 
+/*
+ * Memory is stored as byte-reversed 32-bit words (see PPC_FETCH_REGION), so
+ * smaller accesses are adjusted the same way the Model 3 handlers do. Only
+ * aligned accesses that do not cross a page take the direct path. A 64-bit
+ * value is a pair of words, high word first, so it is a single host access
+ * with its halves swapped.
+ */
+INLINE UINT8 *ppc_map_page(UINT8 * const *map, UINT32 address)
+{
+#ifdef SUPERMODEL_DEBUGGER
+	if (ppc_debug_hooked)	// debugger must see every access
+		return NULL;
+#endif // SUPERMODEL_DEBUGGER
+	return map[address >> PPC_MAP_SHIFT];
+}
+
+INLINE bool ppc_map_aligned64(UINT32 address)
+{
+	return (address & 3) == 0 && (address & PPC_MAP_MASK) != (PPC_MAP_MASK & ~3);
+}
+
+INLINE UINT64 ppc_swap_words(UINT64 data)
+{
+	return (data << 32) | (data >> 32);
+}
+
+// Page holding all of [address, address + size), or NULL if the range is not
+// directly mapped or crosses into the next page
+INLINE UINT8 *ppc_map_range(UINT8 * const *map, UINT32 address, UINT32 size)
+{
+	if ((address & PPC_MAP_MASK) + size > PPC_MAP_MASK + 1)
+		return NULL;
+	return ppc_map_page(map, address);
+}
+
 INLINE UINT8 READ8(UINT32 address)
 {
+	UINT8 *page = ppc_map_page(ppc_read_map, address);
+	if (page != NULL)
+		return page[(address & PPC_MAP_MASK) ^ 3];
 	return Bus->Read8(address);
 }
 
 INLINE UINT16 READ16(UINT32 address)
 {
+	UINT8 *page = ppc_map_page(ppc_read_map, address);
+	if (page != NULL && (address & 1) == 0)
+		return *(UINT16 *) &page[(address & PPC_MAP_MASK) ^ 2];
 	return Bus->Read16(address);
 }
 
 INLINE UINT32 READ32(UINT32 address)
 {
+	UINT8 *page = ppc_map_page(ppc_read_map, address);
+	if (page != NULL && (address & 3) == 0)
+		return *(UINT32 *) &page[address & PPC_MAP_MASK];
 	return Bus->Read32(address);
 }
 
 INLINE UINT64 READ64(UINT32 address)
 {
+	UINT8 *page = ppc_map_page(ppc_read_map, address);
+	if (page != NULL && ppc_map_aligned64(address))
+	{
+		UINT64 data;
+		memcpy(&data, &page[address & PPC_MAP_MASK], sizeof(data));
+		return ppc_swap_words(data);
+	}
 	return Bus->Read64(address);
 }
 
 INLINE void WRITE8(UINT32 address, UINT8 data)
 {
-	Bus->Write8(address,data);
+	UINT8 *page = ppc_map_page(ppc_write_map, address);
+	if (page != NULL)
+		page[(address & PPC_MAP_MASK) ^ 3] = data;
+	else
+	{
+		Bus->Write8(address,data);
+		if (ppc_engine != PPC_ENGINE_INTERPRETER)
+			ppc_jit_write(address, 1);
+	}
 }
 
 INLINE void WRITE16(UINT32 address, UINT16 data)
 {
-	Bus->Write16(address,data);
+	UINT8 *page = ppc_map_page(ppc_write_map, address);
+	if (page != NULL && (address & 1) == 0)
+		*(UINT16 *) &page[(address & PPC_MAP_MASK) ^ 2] = data;
+	else
+	{
+		Bus->Write16(address,data);
+		if (ppc_engine != PPC_ENGINE_INTERPRETER)
+			ppc_jit_write(address, 2);
+	}
 }
 
 INLINE void WRITE32(UINT32 address, UINT32 data)
 {
-	Bus->Write32(address,data);
+	UINT8 *page = ppc_map_page(ppc_write_map, address);
+	if (page != NULL && (address & 3) == 0)
+		*(UINT32 *) &page[address & PPC_MAP_MASK] = data;
+	else
+	{
+		Bus->Write32(address,data);
+		if (ppc_engine != PPC_ENGINE_INTERPRETER)
+			ppc_jit_write(address, 4);
+	}
 }
 
 INLINE void WRITE64(UINT32 address, UINT64 data)
 {
-	Bus->Write64(address,data);
+	UINT8 *page = ppc_map_page(ppc_write_map, address);
+	if (page != NULL && ppc_map_aligned64(address))
+	{
+		data = ppc_swap_words(data);
+		memcpy(&page[address & PPC_MAP_MASK], &data, sizeof(data));
+	}
+	else
+	{
+		Bus->Write64(address,data);
+		if (ppc_engine != PPC_ENGINE_INTERPRETER)
+			ppc_jit_write(address, 8);
+	}
 }
 
 
@@ -376,8 +646,11 @@ INLINE void SET_CR0(INT32 rd)
 		CR(0) |= 0x1;
 }
 
+static void ppc_check_fpscr_read(void);
+
 INLINE void SET_CR1(void)
 {
+	ppc_check_fpscr_read();
 	CR(1) = (ppc.fpscr >> 28) & 0xf;
 }
 
@@ -431,19 +704,51 @@ INLINE UINT32 check_condition_code(UINT32 bo, UINT32 bi)
 	return ctr_ok && condition_ok;
 }
 
+/*
+ * The timebase and decrementer are not updated per instruction. Their values
+ * are kept as of a base icount and derived from the cycles elapsed since, which
+ * must be converted to timer ticks on every mftb or DEC read. The divide by
+ * timer_ratio is done as a multiply by its reciprocal, which is exact for any
+ * cycle count below 2^32 / timer_ratio (far longer than any time slice).
+ */
+INLINE UINT32 ppc_timer_ticks(UINT32 cycles)
+{
+	return (UINT32)((cycles * ppc.timer_recip) >> 32);
+}
+
+INLINE UINT32 ppc_timer_remainder(UINT32 cycles)
+{
+	return cycles - ppc_timer_ticks(cycles) * ppc.timer_ratio;
+}
+
+static void ppc_update_timer_ratio(int ratio)
+{
+	ppc.timer_ratio = ratio;
+	ppc.timer_recip = ((UINT64)1 << 32) / (UINT32)ratio + 1;
+}
+
+// Finds the icount at which the decrementer passes through zero, if within the time slice
+INLINE void ppc_update_dec_trigger(void)
+{
+	if (ppc_timer_ticks(ppc.dec_base_icount) > DEC)
+		ppc.dec_trigger_cycle = ppc.dec_base_icount - ((1 + DEC) * ppc.timer_ratio);
+	else
+		ppc.dec_trigger_cycle = 0x7fffffff;
+}
+
 INLINE UINT64 ppc_read_timebase(void)
 {
 	int cycles = ppc.tb_base_icount - ppc.icount;
 
 	// Timebase is incremented according to timer ratio, so adjust value accordingly
-	return ppc.tb + (cycles / ppc.timer_ratio);
+	return ppc.tb + ppc_timer_ticks(cycles);
 }
 
 INLINE void ppc_write_timebase_l(UINT32 tbl)
 {
 	UINT64 tb = ppc_read_timebase();
 
-	ppc.tb_base_icount = ppc.icount + ((ppc.tb_base_icount - ppc.icount) % ppc.timer_ratio);
+	ppc.tb_base_icount = ppc.icount + ppc_timer_remainder(ppc.tb_base_icount - ppc.icount);
 
 	ppc.tb = (tb&~0xffffffff)|tbl;
 }
@@ -452,7 +757,7 @@ INLINE void ppc_write_timebase_h(UINT32 tbh)
 {
 	UINT64 tb = ppc_read_timebase();
 
-	ppc.tb_base_icount = ppc.icount + ((ppc.tb_base_icount - ppc.icount) % ppc.timer_ratio);
+	ppc.tb_base_icount = ppc.icount + ppc_timer_remainder(ppc.tb_base_icount - ppc.icount);
 	
 	ppc.tb = (tb&0xffffffff)|((UINT64)(tbh) << 32);
 }
@@ -462,7 +767,7 @@ INLINE UINT32 read_decrementer(void)
 	int cycles = ppc.dec_base_icount - ppc.icount;
 
 	// Decrementer is decremented at same rate as timebase, so adjust value accordingly
-	return DEC - (cycles / ppc.timer_ratio);
+	return DEC - ppc_timer_ticks(cycles);
 }
 
 INLINE void write_decrementer(UINT32 value)
@@ -474,20 +779,41 @@ INLINE void write_decrementer(UINT32 value)
 		ppc603_check_interrupts();
 	}
 
-	ppc.dec_base_icount = ppc.icount + ((ppc.dec_base_icount - ppc.icount) % ppc.timer_ratio);
+	ppc.dec_base_icount = ppc.icount + ppc_timer_remainder(ppc.dec_base_icount - ppc.icount);
 	
 	DEC = value;
 
 	// Check if decrementer exception occurs during execution (exception occurs after decrementer
 	// has passed through zero)
-	if ((UINT32)(ppc.dec_base_icount / ppc.timer_ratio) > DEC)
-		ppc.dec_trigger_cycle = ppc.dec_base_icount - ((1 + DEC) * ppc.timer_ratio);
-	else
-		ppc.dec_trigger_cycle = 0x7fffffff;
+	ppc_update_dec_trigger();
 }
 
 /*********************************************************************/
 
+/*
+ * Address translation is not emulated. Effective addresses are used as
+ * physical ones and the direct memory map already holds the host pointer of
+ * each page, which is all a TLB would cache. That is only right while the
+ * BATs map addresses onto themselves, so a valid BAT that doesn't is
+ * reported. It is checked when the upper half is written, which is done last
+ * when a BAT is set up.
+ */
+static void ppc_check_bat(const char *type, int n, const BATENT &bat)
+{
+	static bool reported = false;
+	UINT32 mask = ~(((bat.u >> 2) & 0x7FF) << 17) & 0xFFFE0000;		// BEPI/BRPN bits above the block length
+
+	if ((bat.u & 3) == 0 || (bat.u & mask) == (bat.l & mask))
+		return;
+
+	DEBUG_LOG(PPC, "ppc: %sBAT%d maps %08X to %08X\n", type, n, bat.u & mask, bat.l & mask);
+	if (!reported)
+	{
+		InfoLog("PowerPC %sBAT%d maps %08X to %08X but address translation is not emulated.", type, n, bat.u & mask, bat.l & mask);
+		reported = true;
+	}
+}
+
 INLINE void ppc_set_spr(int spr, UINT32 value)
 {
 	switch (spr)
@@ -533,21 +859,21 @@ INLINE void ppc_set_spr(int spr, UINT32 value)
 		case SPR603E_RPA:			ppc.rpa = value; return;
 
 		case SPR603E_IBAT0L:		ppc.ibat[0].l = value; return;
-		case SPR603E_IBAT0U:		ppc.ibat[0].u = value; return;
+		case SPR603E_IBAT0U:		ppc.ibat[0].u = value; ppc_check_bat("I", 0, ppc.ibat[0]); return;
 		case SPR603E_IBAT1L:		ppc.ibat[1].l = value; return;
-		case SPR603E_IBAT1U:		ppc.ibat[1].u = value; return;
+		case SPR603E_IBAT1U:		ppc.ibat[1].u = value; ppc_check_bat("I", 1, ppc.ibat[1]); return;
 		case SPR603E_IBAT2L:		ppc.ibat[2].l = value; return;
-		case SPR603E_IBAT2U:		ppc.ibat[2].u = value; return;
+		case SPR603E_IBAT2U:		ppc.ibat[2].u = value; ppc_check_bat("I", 2, ppc.ibat[2]); return;
 		case SPR603E_IBAT3L:		ppc.ibat[3].l = value; return;
-		case SPR603E_IBAT3U:		ppc.ibat[3].u = value; return;
+		case SPR603E_IBAT3U:		ppc.ibat[3].u = value; ppc_check_bat("I", 3, ppc.ibat[3]); return;
 		case SPR603E_DBAT0L:		ppc.dbat[0].l = value; return;
-		case SPR603E_DBAT0U:		ppc.dbat[0].u = value; return;
+		case SPR603E_DBAT0U:		ppc.dbat[0].u = value; ppc_check_bat("D", 0, ppc.dbat[0]); return;
 		case SPR603E_DBAT1L:		ppc.dbat[1].l = value; return;
-		case SPR603E_DBAT1U:		ppc.dbat[1].u = value; return;
+		case SPR603E_DBAT1U:		ppc.dbat[1].u = value; ppc_check_bat("D", 1, ppc.dbat[1]); return;
 		case SPR603E_DBAT2L:		ppc.dbat[2].l = value; return;
-		case SPR603E_DBAT2U:		ppc.dbat[2].u = value; return;
+		case SPR603E_DBAT2U:		ppc.dbat[2].u = value; ppc_check_bat("D", 2, ppc.dbat[2]); return;
 		case SPR603E_DBAT3L:		ppc.dbat[3].l = value; return;
-		case SPR603E_DBAT3U:		ppc.dbat[3].u = value; return;
+		case SPR603E_DBAT3U:		ppc.dbat[3].u = value; ppc_check_bat("D", 3, ppc.dbat[3]); return;
 
 		case SPR603E_SDR1:
 			ppc.sdr1 = value;
@@ -557,7 +883,7 @@ INLINE void ppc_set_spr(int spr, UINT32 value)
 	}
 
 	ErrorLog("PowerPC wrote to an invalid register. Halting emulation until reset.");
-	DebugLog("ppc: set_spr: unknown spr %d (%03X) !\n", spr, spr);
+	DEBUG_LOG(PPC, "ppc: set_spr: unknown spr %d (%03X) !\n", spr, spr);
 	ppc.fatalError = true;
 }
 
@@ -576,11 +902,11 @@ INLINE UINT32 ppc_get_spr(int spr)
 		case SPR_SPRG3:		return ppc.sprg[3];
 		case SPR_PVR:		return ppc.pvr;
 		case SPR603E_TBL_R:
-			DebugLog("ppc: get_spr: TBL_R\n");
+			DEBUG_LOG(PPC, "ppc: get_spr: TBL_R\n");
 			break;
 
 		case SPR603E_TBU_R:
-			DebugLog("ppc: get_spr: TBU_R\n");
+			DEBUG_LOG(PPC, "ppc: get_spr: TBU_R\n");
 			break;
 
 		case SPR603E_TBL_W:		return (UINT32)(ppc_read_timebase());
@@ -619,7 +945,7 @@ INLINE UINT32 ppc_get_spr(int spr)
 	}
 	
 	ErrorLog("PowerPC read from an invalid register. Halting emulation until reset.");
-	DebugLog("ppc: get_spr: unknown spr %d (%03X) !\n", spr, spr);
+	DEBUG_LOG(PPC, "ppc: get_spr: unknown spr %d (%03X) !\n", spr, spr);
 	ppc.fatalError = true;
 	return 0;
 }
@@ -629,13 +955,17 @@ INLINE void ppc_set_msr(UINT32 value)
 	if( value & (MSR_ILE | MSR_LE) )
 	{
 		ErrorLog("PowerPC entered an unemulated mode. Halting emulation until reset.");
-		DebugLog("ppc: set_msr: little_endian mode not supported !\n");
+		DEBUG_LOG(PPC, "ppc: set_msr: little_endian mode not supported !\n");
 		ppc.fatalError = true;
 	}
 
+	// Interrupts pending while EE is set are taken as soon as they occur, so
+	// there can only be one to take now if EE has just been set
+	UINT32 enabled = value & ~MSR & MSR_EE;
 	MSR = value;
 
-	ppc603_check_interrupts();
+	if (enabled)
+		ppc603_check_interrupts();
 }
 
 INLINE UINT32 ppc_get_msr(void)
@@ -662,30 +992,58 @@ INLINE UINT32 ppc_get_cr(void)
 
 /***********************************************************************/
 
-static void (* optable19[1024])(UINT32);
-static void (* optable31[1024])(UINT32);
-static void (* optable59[1024])(UINT32);
-static void (* optable63[1024])(UINT32);
-static void (* optable[64])(UINT32);
+/*
+ * All handlers live in a single table so that the interpreter dispatches with
+ * one indexed call and no second-level lookup: primary opcodes first, then the
+ * extended opcodes of groups 19, 31, 59 and 63.
+ */
+static void (* optable_all[64 + 4 * 1024])(UINT32);
+static void (** const optable)(UINT32)   = &optable_all[0];
+static void (** const optable19)(UINT32) = &optable_all[64 + 0 * 1024];
+static void (** const optable31)(UINT32) = &optable_all[64 + 1 * 1024];
+static void (** const optable59)(UINT32) = &optable_all[64 + 2 * 1024];
+static void (** const optable63)(UINT32) = &optable_all[64 + 3 * 1024];
+static UINT16 optable_base[64];	// start of each primary opcode's handlers in optable_all
+static UINT16 optable_mask[64];	// extended opcode mask (0 for primary-only opcodes)
+
+INLINE UINT32 ppc_optable_index(UINT32 op)
+{
+	return optable_base[op >> 26] + ((op >> 1) & optable_mask[op >> 26]);
+}
 
+#include "ppc_profile.c"
 #include "ppc603.c"
 
 /********************************************************************/
 
+#include "ppc_idle.c"
+
+/********************************************************************/
+
 #include "ppc_ops.c"
 #include "ppc_ops.h"
 
+/********************************************************************/
+
+#include "ppc_jit.c"
+#include "ppc_threaded.c"
+
 /* Initialization and shutdown */
 
-void ppc_base_init(void)
+static void ppc_build_tables(void)
 {
 	int i,j;
 
-	memset(&ppc, 0, sizeof(ppc));
-
 	for( i=0; i < 64; i++ ) {
 		optable[i] = ppc_invalid;
+		optable_base[i] = i;
+		optable_mask[i] = 0;
 	}
+	optable_base[19] = 64 + 0 * 1024;
+	optable_base[31] = 64 + 1 * 1024;
+	optable_base[59] = 64 + 2 * 1024;
+	optable_base[63] = 64 + 3 * 1024;
+	optable_mask[19] = optable_mask[31] = optable_mask[59] = optable_mask[63] = 0x3ff;
 	for( i=0; i < 1024; i++ ) {
 		optable19[i] = ppc_invalid;
 		optable31[i] = ppc_invalid;
@@ -729,15 +1087,6 @@ void ppc_base_init(void)
 			ppc_rotate_mask[i][j] = mask;
 		}
 	}
-}
-
-void ppc_init(const PPC_CONFIG *config)
-{
-	int pll_config = 0;
-	float multiplier;
-	int i ;
-
-	ppc_base_init() ;
 
 	optable[48] = ppc_lfs;
 	optable[49] = ppc_lfsu;
@@ -823,6 +1172,17 @@ void ppc_init(const PPC_CONFIG *config)
 			((i & 0x02) ? 0x000000F0 : 0) |
 			((i & 0x01) ? 0x0000000F : 0);
 	}
+}
+
+void ppc_init(const PPC_CONFIG *config)
+{
+	int pll_config = 0;
+	float multiplier;
+
+	static std::once_flag tables_built;
+	std::call_once(tables_built, ppc_build_tables);
+
+	memset(&ppc, 0, sizeof(ppc));
 
 	ppc.pvr = config->pvr;
 
@@ -831,7 +1191,7 @@ void ppc_init(const PPC_CONFIG *config)
 	ppc.bus_freq_multiplier = (int)(multiplier * 2);
 
 	// tb and dec are incremented every four bus cycles, so calculate default timer ratio
-	ppc.timer_ratio = 2 * ppc.bus_freq_multiplier;  
+	ppc_update_timer_ratio(2 * ppc.bus_freq_multiplier);
 	
 	switch (config->bus_frequency)
 	{
@@ -864,11 +1224,15 @@ void ppc_init(const PPC_CONFIG *config)
 
 void ppc_shutdown(void)
 {
-
+	ppc_jit_shutdown();
+	ppc_engine = PPC_ENGINE_INTERPRETER;
 }
 
 void ppc_set_irq_line(int irqline)
 {
+	// Nothing changes if the interrupt is already waiting for EE to be set
+	if (ppc.interrupt_pending & 0x1)
+		return;
 	ppc.interrupt_pending |= 0x1;
 	
 	ppc603_check_interrupts();
@@ -882,6 +1246,119 @@ UINT32 ppc_get_pc(void)
 void ppc_set_fetch(PPC_FETCH_REGION * fetch)
 {
 	ppc.fetch = fetch;
+	ppc_build_fetch_index();
+	ppc_jit_set_fetch(fetch);
+}
+
+bool ppc_set_engine(PPC_ENGINE engine)
+{
+	if (engine != PPC_ENGINE_INTERPRETER && !ppc_jit_alloc(engine))
+	{
+		ppc_engine = PPC_ENGINE_INTERPRETER;
+		return false;
+	}
+
+	ppc_jit_flush();
+	ppc_engine = engine;
+	return true;
+}
+
+PPC_ENGINE ppc_get_engine(void)
+{
+	return ppc_engine;
+}
+
+void ppc_set_fpu_mode(PPC_FPU_MODE mode)
+{
+	ppc_fpu_mode = mode;
+	ppc_fpscr_stale = false;
+	ppc_stale_fpscr_reads = 0;
+}
+
+UINT64 ppc_get_stale_fpscr_reads(void)
+{
+	return ppc_stale_fpscr_reads;
+}
+
+void ppc_map_memory(UINT32 start, UINT32 end, UINT8 *ptr, bool writeable)
+{
+	for (UINT32 page = start >> PPC_MAP_SHIFT; page <= (end >> PPC_MAP_SHIFT); page++)
+	{
+		UINT8 *host = (ptr == NULL) ? NULL : &ptr[(page << PPC_MAP_SHIFT) - start];
+		UINT8 bit = 1 << (page & 7);
+		ppc_read_map[page] = host;
+		if (writeable && host != NULL)
+			ppc_writeable_pages[page >> 3] |= bit;
+		else
+			ppc_writeable_pages[page >> 3] &= ~bit;
+		ppc_write_map[page] = (writeable && !(ppc_code_pages[page >> 3] & bit)) ? host : NULL;
+	}
+}
+
+const UINT8 *ppc_get_code_page_map(void)
+{
+	return ppc_code_pages;
+}
+
+void ppc_invalidate_code(UINT32 address, UINT32 size)
+{
+	ppc_jit_write(address, size);
+}
+
+unsigned ppc_get_code_blocks(UINT32 start, UINT32 end, UINT32 *pcs, unsigned max_pcs)
+{
+	return ppc_jit_get_blocks(start, end, pcs, max_pcs);
+}
+
+unsigned ppc_translate_code_blocks(const UINT32 *pcs, unsigned num_pcs)
+{
+	return ppc_jit_warm_up(pcs, num_pcs);
+}
+
+void ppc_set_idle_loop_detection(bool enable)
+{
+	ppc_idle.enabled = enable;
+	ppc_idle_flush();
+}
+
+UINT64 ppc_get_idle_cycles_skipped(void)
+{
+	return ppc_idle.skipped;
+}
+
+void ppc_set_profiling(bool enable)
+{
+	if (enable && !ppc_profile.enabled)
+		ppc_profile_reset();
+	ppc_profile.enabled = enable;
+}
+
+void ppc_set_trace(CExecTrace *trace)
+{
+	ppc_trace = trace;
+	ppc_trace_icount = 0;
+}
+
+void ppc_set_pc_watch(bool enable, UINT32 pc)
+{
+	ppc_watch_enabled = enable;
+	ppc_watch_hit = false;
+	ppc_watch_pc = pc;
+}
+
+bool ppc_pc_watch_hit(void)
+{
+	return ppc_watch_hit;
+}
+
+bool ppc_dump_profile(const char *file, unsigned top_n)
+{
+	FILE *fp = fopen(file, "w");
+	if (NULL == fp)
+		return FAIL;
+	ppc_profile_write(fp, top_n);
+	fclose(fp);
+	return OKAY;
 }
 
 UINT64 ppc_total_cycles(void)
@@ -901,7 +1378,7 @@ int ppc_get_bus_freq_multipler()
 
 void ppc_set_timer_ratio(int ratio)
 {
-	ppc.timer_ratio = ratio;
+	ppc_update_timer_ratio(ratio);
 }
 
 int ppc_get_timer_ratio()
@@ -913,6 +1390,42 @@ int ppc_get_timer_ratio()
  Supermodel Interface
 ******************************************************************************/
 
+PPC_CONTEXT *ppc_create_context(void)
+{
+	PPC_CONTEXT *ctx = new PPC_CONTEXT();
+	ctx->jit = new PPC_JIT_STATE();
+	ctx->idle = new PPC_IDLE_STATE();
+	ctx->profile = new PPC_PROFILE_STATE();
+	return ctx;
+}
+
+void ppc_destroy_context(PPC_CONTEXT *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	// Free the translation cache as the context's own thread would
+	PPC_CONTEXT *active = ppc_ctx;
+	ppc_ctx = ctx;
+	ppc_shutdown();
+	ppc_ctx = (active == ctx) ? NULL : active;
+
+	delete ctx->profile;
+	delete ctx->idle;
+	delete ctx->jit;
+	delete ctx;
+}
+
+void ppc_set_context(PPC_CONTEXT *ctx)
+{
+	ppc_ctx = ctx;
+}
+
+PPC_CONTEXT *ppc_get_context(void)
+{
+	return ppc_ctx;
+}
+
 void ppc_attach_bus(IBus *BusPtr)
 {
 	Bus = BusPtr;
@@ -1011,6 +1524,8 @@ void ppc_load_state(CBlockFile *SaveState)
 	SaveState->Read(&ppc.pc, sizeof(ppc.pc));
 	SaveState->Read(&ppc.npc, sizeof(ppc.npc));
 	ppc_change_pc(ppc.npc);
+	ppc_jit_flush();
+	ppc_idle_flush();
 	SaveState->Read(&ppc.lr, sizeof(ppc.lr));
 	SaveState->Read(&ppc.ctr, sizeof(ppc.ctr));
 	SaveState->Read(&ppc.xer, sizeof(ppc.xer));
@@ -1107,7 +1622,10 @@ void ppc_attach_debugger(Debugger::CPPCDebug *PPCDebugPtr)
 	if (PPCDebug != NULL)
 		ppc_detach_debugger();
 	PPCDebug = PPCDebugPtr;
-	Bus = PPCDebug->AttachBus(Bus);
+	DirectBus = Bus;
+	DebugBus = PPCDebug->AttachBus(Bus);
+	Bus = DebugBus;
+	ppc_debug_hooked = true;
 }
 
 void ppc_detach_debugger()
@@ -1116,6 +1634,9 @@ void ppc_detach_debugger()
 		return;
 	Bus = PPCDebug->DetachBus(); 
 	PPCDebug = NULL;
+	DebugBus = NULL;
+	DirectBus = NULL;
+	ppc_debug_hooked = false;
 }
 
 void ppc_break()
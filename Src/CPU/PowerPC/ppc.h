@@ -340,11 +340,41 @@ typedef struct
 
 } PPC_FETCH_REGION;
 
+typedef enum
+{
+	PPC_ENGINE_INTERPRETER,	// ppc603.c interpreter
+	PPC_ENGINE_THREADED,	// threaded interpreter over pre-decoded blocks
+	PPC_ENGINE_JIT			// block-translating recompiler (x86-64 hosts only)
+} PPC_ENGINE;
+
+typedef enum
+{
+	PPC_FPU_ACCURATE,	// FPSCR result and exception flags kept by every operation
+	PPC_FPU_FAST,		// flags left alone by arithmetic (compares and FPSCR instructions still set them)
+	PPC_FPU_VALIDATE	// accurate, and reports reads of flags that fast mode would have left stale
+} PPC_FPU_MODE;
+
+
+/*
+ * PPC_CONTEXT:
+ *
+ * Complete state of a single PowerPC. Each board owns one, created with
+ * ppc_create_context(), and passes it to ppc_set_context() on every thread
+ * before calling the functions below there, all of which act on the context
+ * active on the calling thread. A context must not be active on two threads
+ * at once, but contexts on different threads run independently.
+ */
+struct PPC_CONTEXT;
+
 
 /******************************************************************************
  Functions
 ******************************************************************************/
 
+extern PPC_CONTEXT *ppc_create_context(void);
+extern void ppc_destroy_context(PPC_CONTEXT *ctx);	// also shuts it down
+extern void ppc_set_context(PPC_CONTEXT *ctx);	// makes ctx active on the calling thread
+extern PPC_CONTEXT *ppc_get_context(void);
 extern UINT32 ppc_get_pc(void);
 extern void ppc_set_irq_line(int irqline);
 extern int ppc_execute(int cycles);
@@ -352,11 +382,27 @@ extern void ppc_reset(void);
 extern void ppc_shutdown(void);
 extern void ppc_init(const PPC_CONFIG *config);		// must be called second!
 extern void ppc_set_fetch(PPC_FETCH_REGION * fetch);
+extern void ppc_map_memory(UINT32 start, UINT32 end, UINT8 *ptr, bool writeable);	// 4 KB aligned; ptr=NULL unmaps (accesses go to bus)
+extern const UINT8 *ppc_get_code_page_map(void);	// one bit per 4 KB page holding translated code; stores to these reach the bus
+extern void ppc_invalidate_code(UINT32 address, UINT32 size);	// call when the bus modifies a code page
+extern unsigned ppc_get_code_blocks(UINT32 start, UINT32 end, UINT32 *pcs, unsigned max_pcs);	// entry points of translated blocks in [start,end]; returns number found (may exceed max_pcs)
+extern unsigned ppc_translate_code_blocks(const UINT32 *pcs, unsigned num_pcs);	// translates ahead of time (block engines only); returns number translated
 extern UINT64 ppc_total_cycles(void);
 extern int ppc_get_cycles_per_sec(void);
 extern int ppc_get_bus_freq_multipler(void);
 extern int ppc_get_timer_ratio(void);
 extern void ppc_set_timer_ratio(int ratio);
+extern bool ppc_set_engine(PPC_ENGINE engine);	// returns false if engine unavailable on this host
+extern PPC_ENGINE ppc_get_engine(void);
+extern void ppc_set_fpu_mode(PPC_FPU_MODE mode);
+extern UINT64 ppc_get_stale_fpscr_reads(void);	// FPSCR reads that fast mode would have changed (validate mode)
+extern void ppc_set_idle_loop_detection(bool enable);
+extern UINT64 ppc_get_idle_cycles_skipped(void);
+extern void ppc_set_profiling(bool enable);		// sampling profiler; enabling clears collected samples
+extern bool ppc_dump_profile(const char *file, unsigned top_n);	// writes hottest blocks and instruction classes
+extern void ppc_set_trace(class CExecTrace *trace);	// records executed instructions (forces the interpreter); NULL stops
+extern void ppc_set_pc_watch(bool enable, UINT32 pc);	// watches for one execution of an address (forces the interpreter until then)
+extern bool ppc_pc_watch_hit(void);				// true once the watched address has executed
 
 // These have been added to support the new Supermodel
 extern void ppc_attach_bus(class IBus *BusPtr);		// must be called first!
@@ -254,43 +254,38 @@ void ppc_reset(void)
 	ppc.total_cycles = 0;
 	ppc.cur_cycles = 0;
 	ppc.icount = 0;
+
+	ppc_jit_flush();
+	ppc_idle_flush();
 }
 
-int ppc_execute(int cycles)
+/*
+ * The instruction loop is compiled twice. The hooked variant calls the debugger
+ * and the trace recorder and checks the address watch before every instruction
+ * and always interprets, so that it can be stepped. The other runs at full
+ * speed whenever none of them is in use.
+ */
+template <bool Hooked>
+static void ppc_execute_loop(bool use_jit)
 {
 	UINT32 opcode;
 
-	ppc.cur_cycles = cycles;
-	ppc.icount = cycles;
-	ppc.tb_base_icount = cycles + ppc.timer_frac;
-	ppc.dec_base_icount = cycles + ppc.timer_frac;
-
-	// Check if decrementer exception occurs during execution (exception occurs after decrementer
-	// has passed through zero)
-	if ((UINT32)(ppc.dec_base_icount / ppc.timer_ratio) > DEC)
-		ppc.dec_trigger_cycle = ppc.dec_base_icount - ((1 + DEC) * ppc.timer_ratio);
-	else
-		ppc.dec_trigger_cycle = 0x7fffffff;
-
-	ppc_change_pc(ppc.npc);
-
-	/*{
-		char string1[200];
-		char string2[200];
-		opcode = BSWAP32(*ppc.op);
-		DisassemblePowerPC(opcode, ppc.npc, string1, string2, true);
-		printf("%08X: %s %s\n", ppc.npc, string1, string2);
-	}*/
+	while( ppc.icount > 0 && !ppc.fatalError)
+	{
+		if (ppc.icount <= ppc_profile.next_sample)
+			ppc_profile_sample();
 
-	ppc603_check_interrupts();
+		if (use_jit)
+		{
+			if (ppc_jit_execute_block())
+				continue;
 
-#ifdef SUPERMODEL_DEBUGGER
-	if (PPCDebug != NULL)
-		PPCDebug->CPUActive();
-#endif // SUPERMODEL_DEBUGGER
+			// Interpreter steps this instruction; resynchronize fetch pointer
+			ppc_change_pc(ppc.npc);
+			if (ppc.fatalError)
+				break;
+		}
 
-	while( ppc.icount > 0 && !ppc.fatalError)
-	{
 		ppc.pc = ppc.npc;
 		
 		// Debug breakpoints
@@ -305,23 +300,29 @@ int ppc_execute(int cycles)
 		opcode = *ppc.op++;	// Supermodel byte reverses each aligned word (converting them to little endian) so they can be fetched directly
 		ppc.npc = ppc.pc + 4;
 
-#ifdef SUPERMODEL_DEBUGGER
-		if (PPCDebug != NULL)
+		if (Hooked)
 		{
-			while (PPCDebug->CPUExecute(ppc.pc, opcode, (PPCDebug->instrCount > 0 ? 1 : 0)))
-				opcode = *ppc.op++;
-		}
+#ifdef SUPERMODEL_DEBUGGER
+			if (ppc_debug_hooked)
+			{
+				while (PPCDebug->CPUExecute(ppc.pc, opcode, (PPCDebug->instrCount > 0 ? 1 : 0)))
+					opcode = *ppc.op++;
+			}
 #endif // SUPERMODEL_DEBUGGER
-
-		switch(opcode >> 26)
-		{
-			case 19:	optable19[(opcode >> 1) & 0x3ff](opcode); break;
-			case 31:	optable31[(opcode >> 1) & 0x3ff](opcode); break;
-			case 59:	optable59[(opcode >> 1) & 0x3ff](opcode); break;
-			case 63:	optable63[(opcode >> 1) & 0x3ff](opcode); break;
-			default:	optable[opcode >> 26](opcode); break;
+			if (ppc_trace != NULL)
+			{
+				ppc_trace->Record(ppc.pc, opcode, ppc_trace_icount - ppc.icount);
+				ppc_trace_icount = ppc.icount;
+			}
+			if (ppc_watch_enabled && ppc.pc == ppc_watch_pc)
+			{
+				ppc_watch_enabled = false;
+				ppc_watch_hit = true;
+			}
 		}
 
+		optable_all[ppc_optable_index(opcode)](opcode);
+
 		ppc.icount--;
 		
 		if (ppc.icount == ppc.dec_trigger_cycle)
@@ -332,16 +333,67 @@ int ppc_execute(int cycles)
 
 		//ppc603_check_interrupts();
 	}
+}
+
+int ppc_execute(int cycles)
+{
+	ppc.cur_cycles = cycles;
+	ppc.icount = cycles;
+	ppc.tb_base_icount = cycles + ppc.timer_frac;
+	ppc.dec_base_icount = cycles + ppc.timer_frac;
+
+	// Check if decrementer exception occurs during execution (exception occurs after decrementer
+	// has passed through zero)
+	ppc_update_dec_trigger();
+
+	ppc_profile_begin(cycles);
+	ppc_change_pc(ppc.npc);
+
+	/*{
+		char string1[200];
+		char string2[200];
+		opcode = BSWAP32(*ppc.op);
+		DisassemblePowerPC(opcode, ppc.npc, string1, string2, true);
+		printf("%08X: %s %s\n", ppc.npc, string1, string2);
+	}*/
+
+	ppc603_check_interrupts();
 
+	// Translated blocks cannot be single-stepped or traced, so the debugger, the
+	// trace recorder and the address watch force the interpreter
+	bool use_jit = ppc_engine != PPC_ENGINE_INTERPRETER;
+	bool hooked = ppc_trace != NULL || ppc_watch_enabled;
+#ifdef SUPERMODEL_DEBUGGER
+	if (PPCDebug != NULL)
+	{
+		PPCDebug->CPUActive();
+		ppc_debug_hooked = PPCDebug->IsHooked();
+		Bus = ppc_debug_hooked ? DebugBus : DirectBus;
+	}
+	hooked = hooked || ppc_debug_hooked;
+#endif // SUPERMODEL_DEBUGGER
+	if (hooked)
+	{
+		// Cycles of the last instruction of the previous slice carry over
+		ppc_trace_icount += cycles;
+		ppc_execute_loop<true>(false);
+		ppc_trace_icount -= ppc.icount;
+	}
+	else
+		ppc_execute_loop<false>(use_jit);
 #ifdef SUPERMODEL_DEBUGGER
 	if (PPCDebug != NULL)
+	{
+		if (!ppc_debug_hooked)
+			PPCDebug->CPURan(cycles - ppc.icount);
 		PPCDebug->CPUInactive();
+	}
 #endif // SUPERMODEL_DEBUGGER
 
 	// Update timebase and decrementer.  Both are updated at same rate as specified by timer_ratio.
-	ppc.timer_frac = ((ppc.tb_base_icount - ppc.icount) % ppc.timer_ratio);
-	ppc.tb += ((ppc.tb_base_icount - ppc.icount) / ppc.timer_ratio);
-	DEC -= ((ppc.dec_base_icount - ppc.icount) / ppc.timer_ratio);
+	ppc.timer_frac = ppc_timer_remainder(ppc.tb_base_icount - ppc.icount);
+	ppc.tb += ppc_timer_ticks(ppc.tb_base_icount - ppc.icount);
+	DEC -= ppc_timer_ticks(ppc.dec_base_icount - ppc.icount);
 	
 	/*
 	{
@@ -353,6 +405,8 @@ int ppc_execute(int cycles)
 	}
 	*/
 
+	ppc_profile_end();
+
 	int executed = cycles - ppc.icount;
 	ppc.total_cycles += executed;
 	ppc.cur_cycles = 0;
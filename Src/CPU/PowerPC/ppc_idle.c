@@ -0,0 +1,262 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ppc_idle.c
+ *
+ * Idle loop detection. Included from ppc.cpp; do not compile separately.
+ *
+ * Games spend much of each frame spinning on a status register or waiting for
+ * an interrupt in a tight loop. When a short backward branch is taken, the
+ * loop body is analyzed once: if it contains only loads, compares and simple
+ * register operations, makes no stores, and carries no register value from one
+ * iteration to the next, every iteration produces the same result until some
+ * external state changes. Such loops are fast-forwarded to the next point at
+ * which that can happen: the decrementer trigger or the end of the time slice
+ * (slices end at each scheduled board event).
+ */
+
+#define PPC_IDLE_MAX_BODY	16		// maximum loop length in instructions
+#define PPC_IDLE_CACHE_SIZE	256		// analyzed loops (must be a power of 2)
+
+typedef struct
+{
+	UINT32	target;		// loop start (branch target)
+	UINT32	branch;		// address of the backward branch
+	UINT32	hash;		// hash of loop body, to detect modified code
+	bool	idle;
+} PPC_IDLE_LOOP;
+
+struct PPC_IDLE_STATE
+{
+	bool			enabled;
+	UINT64			skipped;		// total cycles skipped
+	UINT32			armed_branch;	// idle loop branch last taken, and when
+	UINT64			armed_cycle;
+	PPC_IDLE_LOOP	cache[PPC_IDLE_CACHE_SIZE];
+};
+
+// Held by the active context
+#define ppc_idle	(*ppc_ctx->idle)
+
+static void ppc_idle_flush(void)
+{
+	memset(ppc_idle.cache, 0, sizeof(ppc_idle.cache));
+	ppc_idle.armed_branch = 0xffffffff;
+}
+
+/*
+ * ppc_idle_decode(op, pc, loop_start, last, uses, defs):
+ *
+ * Determines which GPRs (bits 0-31) and CR fields (bits 32-39) an instruction
+ * reads and writes. Returns false if the instruction may not appear in an idle
+ * loop: stores, anything that writes XER, SPRs or memory, and branches other
+ * than the final backward branch and forward exits from the loop.
+ */
+static bool ppc_idle_decode(UINT32 op, UINT32 pc, UINT32 loop_start, bool last, UINT64 *uses, UINT64 *defs)
+{
+	#define GPR_BIT(n)	((UINT64)1 << (n))
+	#define CRF_BIT(n)	((UINT64)1 << (32 + (n)))
+	#define RA_USE		(RA ? GPR_BIT(RA) : 0)
+
+	*uses = 0;
+	*defs = 0;
+
+	switch (op >> 26)
+	{
+	case 32:	// lwz
+	case 34:	// lbz
+	case 40:	// lhz
+	case 42:	// lha
+	case 14:	// addi
+	case 15:	// addis
+		*uses = RA_USE;
+		*defs = GPR_BIT(RT);
+		return true;
+	case 10:	// cmpli
+	case 11:	// cmpi
+		*uses = GPR_BIT(RA);
+		*defs = CRF_BIT(CRFD);
+		return true;
+	case 24:	// ori
+	case 25:	// oris
+	case 26:	// xori
+	case 27:	// xoris
+		*uses = GPR_BIT(RS);
+		*defs = GPR_BIT(RA);
+		return true;
+	case 28:	// andi.
+	case 29:	// andis.
+		*uses = GPR_BIT(RS);
+		*defs = GPR_BIT(RA) | CRF_BIT(0);
+		return true;
+	case 21:	// rlwinm
+		*uses = GPR_BIT(RS);
+		*defs = GPR_BIT(RA) | (RCBIT ? CRF_BIT(0) : 0);
+		return true;
+	case 31:
+		switch ((op >> 1) & 0x3ff)
+		{
+		case 23:	// lwzx
+		case 87:	// lbzx
+		case 279:	// lhzx
+		case 343:	// lhax
+		case 534:	// lwbrx
+		case 790:	// lhbrx
+			*uses = RA_USE | GPR_BIT(RB);
+			*defs = GPR_BIT(RT);
+			return true;
+		case 0:		// cmp
+		case 32:	// cmpl
+			*uses = GPR_BIT(RA) | GPR_BIT(RB);
+			*defs = CRF_BIT(CRFD);
+			return true;
+		case 28:	// and
+		case 60:	// andc
+		case 124:	// nor
+		case 316:	// xor
+		case 444:	// or
+			*uses = GPR_BIT(RS) | GPR_BIT(RB);
+			*defs = GPR_BIT(RA) | (RCBIT ? CRF_BIT(0) : 0);
+			return true;
+		case 26:	// cntlzw
+		case 922:	// extsh
+		case 954:	// extsb
+			*uses = GPR_BIT(RS);
+			*defs = GPR_BIT(RA) | (RCBIT ? CRF_BIT(0) : 0);
+			return true;
+		}
+		return false;
+	case 16:	// bc
+		{
+			UINT32 target = (AABIT ? 0 : pc) + (SIMM16 & ~0x3);
+			if (LKBIT || (BO & 0x04) == 0)	// must not link or decrement CTR
+				return false;
+			if (!last && target >= loop_start && target <= pc)
+				return false;
+			if ((BO & 0x10) == 0)
+				*uses = CRF_BIT(BI / 4);
+		}
+		return true;
+	case 18:	// b
+		return last && !LKBIT;
+	}
+	return false;
+
+	#undef GPR_BIT
+	#undef CRF_BIT
+	#undef RA_USE
+}
+
+static bool ppc_idle_analyze(const UINT32 *body, UINT32 target, UINT32 n)
+{
+	UINT64 uses[PPC_IDLE_MAX_BODY], defs[PPC_IDLE_MAX_BODY];
+	UINT64 loop_defs = 0, iter_defs = 0;
+	UINT32 i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (!ppc_idle_decode(body[i], target + 4 * i, target, i == n - 1, &uses[i], &defs[i]))
+			return false;
+		loop_defs |= defs[i];
+	}
+
+	// Any value written in the loop must be written before it is read
+	for (i = 0; i < n; i++)
+	{
+		if ((uses[i] & loop_defs & ~iter_defs) != 0)
+			return false;
+		iter_defs |= defs[i];
+	}
+	return true;
+}
+
+/*
+ * ppc_idle_check(target):
+ *
+ * Called by branch handlers after a taken branch has updated ppc.npc and the
+ * fetch pointer. If this is the backward branch of an idle loop, consumes the
+ * cycles up to the next point at which the loop could exit.
+ */
+static void ppc_idle_check(UINT32 target)
+{
+	UINT32 branch = ppc.pc;
+	UINT32 n = (branch - target) / 4 + 1;
+	const UINT32 *body;
+	UINT32 hash = 2166136261u;
+	UINT32 i;
+
+#ifdef SUPERMODEL_DEBUGGER
+	if (ppc_debug_hooked)	// keep stepping through loops under the debugger
+		return;
+#endif // SUPERMODEL_DEBUGGER
+
+	if (ppc.fatalError || target < ppc.cur_fetch.start || branch > ppc.cur_fetch.end)
+		return;
+	body = &ppc.cur_fetch.ptr[(target - ppc.cur_fetch.start) / 4];
+
+	PPC_IDLE_LOOP *loop = &ppc_idle.cache[(target >> 2) & (PPC_IDLE_CACHE_SIZE - 1)];
+	if (loop->target == target && loop->branch == branch && !loop->idle)
+		return;
+	for (i = 0; i < n; i++)
+		hash = (hash ^ body[i]) * 16777619u;
+	if (loop->target != target || loop->branch != branch || loop->hash != hash)
+	{
+		loop->target = target;
+		loop->branch = branch;
+		loop->hash = hash;
+		loop->idle = ppc_idle_analyze(body, target, n);
+	}
+	if (!loop->idle)
+		return;
+
+	// Only skip once a whole iteration has run undisturbed: no exception taken
+	// and no time slice boundary crossed since the last time this branch was
+	// taken
+	UINT64 now = ppc.total_cycles + (UINT64)(ppc.cur_cycles - ppc.icount);
+	bool clean = ppc_idle.armed_branch == branch && ppc_idle.armed_cycle >= ppc.total_cycles && now - ppc_idle.armed_cycle == n;
+	ppc_idle.armed_branch = branch;
+	ppc_idle.armed_cycle = now;
+	if (!clean)
+		return;
+
+	// Stop at decrementer trigger or end of slice
+	int stop = 0;
+	if (ppc.dec_trigger_cycle > stop && ppc.dec_trigger_cycle < ppc.icount)
+		stop = ppc.dec_trigger_cycle;
+
+	// Skip whole iterations so execution resumes exactly where it would have
+	// been; the branch instruction itself is still charged by the caller
+	int skip = ppc.icount - 1 - stop;
+	skip -= skip % n;
+	if (skip > 0)
+	{
+		ppc.icount -= skip;
+		ppc_idle.skipped += skip;
+		ppc_idle.armed_cycle += skip;
+	}
+}
+
+INLINE void ppc_idle_branch(UINT32 target)
+{
+	if (ppc_idle.enabled && target <= ppc.pc && ppc.pc - target < PPC_IDLE_MAX_BODY * 4)
+		ppc_idle_check(target);
+}
@@ -0,0 +1,749 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ppc_jit.c
+ *
+ * PowerPC translation cache and block-translating dynamic recompiler.
+ * Included from ppc.cpp; do not compile separately.
+ *
+ * Both block engines (the x86-64 recompiler here and the threaded interpreter
+ * in ppc_threaded.c) translate straight-line runs of PowerPC code once and
+ * share this cache. A block ends at a branch, at any instruction that can
+ * alter the machine state the block was entered under (MSR, SPRs, segment
+ * registers), at the end of a 4 KB page, or after PPC_JIT_MAX_BLOCK
+ * instructions. Instructions without a fast path call their ppc_ops.c
+ * handler, so the interpreter remains the reference for semantics.
+ *
+ * Cycle accounting is identical to the interpreter: ppc.icount is decremented
+ * once per instruction and is exact whenever a handler that may observe it
+ * (timebase/decrementer reads, bus accesses) is called. A block is only run
+ * if it cannot reach the end of the time slice or the decrementer trigger
+ * before its final instruction; otherwise the interpreter steps instead.
+ *
+ * Blocks are direct-mapped by PC. Each fetch region is divided into 4 KB
+ * pages with a generation counter; a store to a page holding translated code
+ * bumps the counter, which invalidates every block from that page. Code pages
+ * are removed from the direct write map, so only stores to them (and stores
+ * that go to the bus anyway) are checked. The bus must report its own writes
+ * to code pages, such as DMA, with ppc_invalidate_code(). Nothing stores to
+ * CROM, so its blocks stay valid until the cache is flushed.
+ */
+
+
+/******************************************************************************
+ Translation Cache
+******************************************************************************/
+
+#define PPC_JIT_NUM_BLOCKS	16384				// block table entries (must be a power of 2)
+#define PPC_JIT_CODE_SIZE	(8*1024*1024)		// executable code buffer size
+#define PPC_JIT_NUM_DECODED	(256*1024)			// pre-decoded instruction pool size
+#define PPC_JIT_MAX_BLOCK	64					// maximum instructions per block
+#define PPC_JIT_MAX_INSN	128					// worst case host code bytes per instruction
+#define PPC_JIT_MAX_REGIONS	8
+#define PPC_JIT_PAGE_SHIFT	12
+
+// Pre-decoded instruction (threaded interpreter)
+typedef struct PPC_DECODED
+{
+	void	(*fn)(const struct PPC_DECODED *d);	// fast path or generic handler call
+	void	(*handler)(UINT32);	// ppc_ops.c handler
+	UINT32	op;
+	UINT32	imm;			// sign/zero extended immediate, shifted immediate or rotate mask
+	UINT8	rd;				// rD/rS (or crfD)
+	UINT8	ra;
+	UINT8	rb;				// rB (or shift amount)
+	UINT8	checked;		// may redirect, halt or modify code
+} PPC_DECODED;
+
+typedef struct
+{
+	UINT32		pc;				// address of first instruction
+	UINT32		length;			// number of PowerPC instructions
+	UINT32		gen;			// page generation at time of translation
+	UINT32		*page_gen;		// page generation counter
+	void		(*code)(void);	// host code (recompiler)
+	PPC_DECODED	*decoded;		// pre-decoded instructions (threaded interpreter)
+} PPC_JIT_BLOCK;
+
+typedef struct
+{
+	UINT32	start;
+	UINT32	end;
+	UINT32	*ptr;
+	UINT32	num_pages;
+	UINT32	*page_gen;		// invalidation counter for each page
+} PPC_JIT_REGION;
+
+struct PPC_JIT_STATE
+{
+	UINT8			*code;		// executable buffer
+	UINT32			code_used;
+	UINT8			*emit;		// current emit position
+	PPC_DECODED		*decoded;	// pre-decoded instruction pool
+	UINT32			decoded_used;
+	PPC_JIT_BLOCK	blocks[PPC_JIT_NUM_BLOCKS];
+	PPC_JIT_REGION	region[PPC_JIT_MAX_REGIONS];
+	int				num_regions;
+};
+
+// Held by the active context
+#define ppc_jit	(*ppc_ctx->jit)
+
+// Code pages are tracked in the direct memory map (ppc.cpp)
+static_assert(PPC_JIT_PAGE_SHIFT == PPC_MAP_SHIFT, "translation and memory map pages must match");
+
+// Handler exit flags share a single 16-bit test with fatalError
+static_assert(offsetof(PPC_REGS, jit_exit) == offsetof(PPC_REGS, fatalError) + 1, "jit_exit must follow fatalError");
+
+static void ppc_jit_flush(void)
+{
+	int i;
+
+	for (i = 0; i < PPC_JIT_NUM_BLOCKS; i++)
+		ppc_jit.blocks[i].length = 0;
+	for (i = 0; i < (int) sizeof(ppc_code_pages); i++)
+	{
+		for (int bit = 0; ppc_code_pages[i] != 0; bit++)
+		{
+			if (ppc_code_pages[i] & (1 << bit))
+				ppc_set_code_page(UINT32(i * 8 + bit) << PPC_MAP_SHIFT, false);
+		}
+	}
+	ppc_jit.code_used = 0;
+	ppc_jit.decoded_used = 0;
+}
+
+static void ppc_jit_free_regions(void)
+{
+	for (int i = 0; i < ppc_jit.num_regions; i++)
+	{
+		delete [] ppc_jit.region[i].page_gen;
+	}
+	ppc_jit.num_regions = 0;
+}
+
+// Mirrors ppc.fetch so that code pages can be tracked per region
+static void ppc_jit_set_fetch(PPC_FETCH_REGION *fetch)
+{
+	ppc_jit_free_regions();
+	for (int i = 0; fetch != NULL && i < PPC_JIT_MAX_REGIONS && fetch[i].ptr != NULL; i++)
+	{
+		PPC_JIT_REGION *r = &ppc_jit.region[i];
+		r->start = fetch[i].start;
+		r->end = fetch[i].end;
+		r->ptr = fetch[i].ptr;
+		r->num_pages = ((r->end - r->start) >> PPC_JIT_PAGE_SHIFT) + 1;
+		r->page_gen = new UINT32[r->num_pages];
+		memset(r->page_gen, 0, r->num_pages * sizeof(UINT32));
+		ppc_jit.num_regions = i + 1;
+	}
+	ppc_jit_flush();
+}
+
+static void ppc_jit_invalidate(UINT32 address)
+{
+	UINT32 page = address >> PPC_JIT_PAGE_SHIFT;
+	if ((ppc_code_pages[page >> 3] & (1 << (page & 7))) == 0)
+		return;
+
+	ppc_set_code_page(address, false);
+	ppc.jit_exit = true;	// current block may have been modified
+	int i = ppc_fetch_region(address);
+	if (i >= 0 && i < ppc_jit.num_regions)
+	{
+		PPC_JIT_REGION *r = &ppc_jit.region[i];
+		r->page_gen[(address - r->start) >> PPC_JIT_PAGE_SHIFT]++;
+	}
+}
+
+static void ppc_jit_write(UINT32 address, UINT32 size)
+{
+	ppc_jit_invalidate(address);
+	if (((address ^ (address + size - 1)) >> PPC_JIT_PAGE_SHIFT) != 0)
+		ppc_jit_invalidate(address + size - 1);
+}
+
+/*
+ * ppc_jit_alloc(engine):
+ *
+ * Allocates the storage used by the given block engine. Returns false if the
+ * engine is not available on this host.
+ */
+static bool ppc_jit_alloc(PPC_ENGINE engine)
+{
+	if (engine == PPC_ENGINE_THREADED)
+	{
+		if (ppc_jit.decoded == NULL)
+			ppc_jit.decoded = new PPC_DECODED[PPC_JIT_NUM_DECODED];
+		return true;
+	}
+
+#if PPC_JIT_X64
+	if (ppc_jit.code != NULL)
+		return true;
+#ifdef _WIN32
+	ppc_jit.code = (UINT8 *) VirtualAlloc(NULL, PPC_JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void *p = mmap(NULL, PPC_JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ppc_jit.code = (p == MAP_FAILED) ? NULL : (UINT8 *) p;
+#endif
+	return ppc_jit.code != NULL;
+#else
+	return false;	// no recompiler backend for this host
+#endif	// PPC_JIT_X64
+}
+
+static void ppc_jit_shutdown(void)
+{
+#if PPC_JIT_X64
+	if (ppc_jit.code != NULL)
+	{
+#ifdef _WIN32
+		VirtualFree(ppc_jit.code, 0, MEM_RELEASE);
+#else
+		munmap(ppc_jit.code, PPC_JIT_CODE_SIZE);
+#endif
+		ppc_jit.code = NULL;
+	}
+#endif	// PPC_JIT_X64
+	delete [] ppc_jit.decoded;
+	ppc_jit.decoded = NULL;
+	ppc_jit_free_regions();
+}
+
+
+/******************************************************************************
+ Instruction Classification
+******************************************************************************/
+
+enum
+{
+	PPC_JIT_PURE,		// register-only; cannot redirect, fault or touch the bus
+	PPC_JIT_CHECKED,	// may redirect (exception), halt or modify code
+	PPC_JIT_END			// ends the block
+};
+
+static void (*ppc_jit_lookup_handler(UINT32 op))(UINT32)
+{
+	return optable_all[ppc_optable_index(op)];
+}
+
+static int ppc_jit_classify(void (*handler)(UINT32))
+{
+	static void (* const end_ops[])(UINT32) =
+	{
+		ppc_bx, ppc_bcx, ppc_bclrx, ppc_bcctrx, ppc_rfi, ppc_sc, ppc_tw, ppc_twi,
+		ppc_mtmsr, ppc_mtspr, ppc_mtsr, ppc_mtsrin, ppc_isync, ppc_invalid
+	};
+	static void (* const pure_ops[])(UINT32) =
+	{
+		ppc_addx, ppc_addcx, ppc_addex, ppc_addi, ppc_addic, ppc_addic_rc, ppc_addis, ppc_addmex,
+		ppc_addzex, ppc_andx, ppc_andcx, ppc_andi_rc, ppc_andis_rc, ppc_cmp, ppc_cmpi, ppc_cmpl,
+		ppc_cmpli, ppc_cntlzw, ppc_crand, ppc_crandc, ppc_creqv, ppc_crnand, ppc_crnor, ppc_cror,
+		ppc_crorc, ppc_crxor, ppc_divwux, ppc_divwx, ppc_eqvx, ppc_extsbx, ppc_extshx, ppc_mcrf,
+		ppc_mcrxr, ppc_mfcr, ppc_mfmsr, ppc_mtcrf, ppc_mulhwux, ppc_mulhwx, ppc_mulli, ppc_mullwx,
+		ppc_nandx, ppc_negx, ppc_norx, ppc_orcx, ppc_ori, ppc_oris, ppc_orx, ppc_rlwimix,
+		ppc_rlwinmx, ppc_rlwnmx, ppc_slwx, ppc_srawix, ppc_srawx, ppc_srwx, ppc_subfcx, ppc_subfex,
+		ppc_subfic, ppc_subfmex, ppc_subfx, ppc_subfzex, ppc_xori, ppc_xoris, ppc_xorx,
+		ppc_fabsx, ppc_faddsx, ppc_faddx, ppc_fcmpo, ppc_fcmpu, ppc_fctiwx, ppc_fctiwzx, ppc_fdivsx,
+		ppc_fdivx, ppc_fmaddsx, ppc_fmaddx, ppc_fmrx, ppc_fmsubsx, ppc_fmsubx, ppc_fmulsx, ppc_fmulx,
+		ppc_fnabsx, ppc_fnegx, ppc_fnmaddsx, ppc_fnmaddx, ppc_fnmsubsx, ppc_fnmsubx, ppc_fresx,
+		ppc_frspx, ppc_frsqrtex, ppc_fselx, ppc_fsqrtsx, ppc_fsqrtx, ppc_fsubsx, ppc_fsubx,
+		ppc_mcrfs, ppc_mffsx, ppc_mtfsb0x, ppc_mtfsb1x, ppc_mtfsfix, ppc_mtfsfx
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(end_ops) / sizeof(end_ops[0]); i++)
+	{
+		if (handler == end_ops[i])
+			return PPC_JIT_END;
+	}
+	for (i = 0; i < sizeof(pure_ops) / sizeof(pure_ops[0]); i++)
+	{
+		if (handler == pure_ops[i])
+			return PPC_JIT_PURE;
+	}
+	return PPC_JIT_CHECKED;
+}
+
+
+#if PPC_JIT_X64
+
+/******************************************************************************
+ x86-64 Code Emission
+
+ RBX holds &ppc throughout a block, so every register access is a single
+ [rbx+disp32] operand. Only RAX, RCX and RDX are used by native code and none
+ of them is live across a handler call.
+******************************************************************************/
+
+#define PPC_OFFS(field)	((INT32) offsetof(PPC_REGS, field))
+#define PPC_OFFS_R(n)	(PPC_OFFS(r) + 4 * (n))
+#define PPC_OFFS_CR(n)	(PPC_OFFS(cr) + (n))
+
+// ModRM for [rbx+disp32] with the given reg field
+#define MODRM_RBX32(reg)	(0x83 | ((reg) << 3))
+
+enum
+{
+	X64_EAX = 0,
+	X64_ECX = 1,
+	X64_EDX = 2
+};
+
+INLINE void emit8(UINT8 b)
+{
+	*ppc_jit.emit++ = b;
+}
+
+INLINE void emit32(UINT32 d)
+{
+	memcpy(ppc_jit.emit, &d, 4);
+	ppc_jit.emit += 4;
+}
+
+INLINE void emit64(UINT64 q)
+{
+	memcpy(ppc_jit.emit, &q, 8);
+	ppc_jit.emit += 8;
+}
+
+// mov r32, [rbx+offs]
+static void emit_load(int reg, INT32 offs)
+{
+	emit8(0x8B); emit8(MODRM_RBX32(reg)); emit32(offs);
+}
+
+// mov [rbx+offs], r32
+static void emit_store(int reg, INT32 offs)
+{
+	emit8(0x89); emit8(MODRM_RBX32(reg)); emit32(offs);
+}
+
+// mov dword [rbx+offs], imm32
+static void emit_store_imm(INT32 offs, UINT32 imm)
+{
+	emit8(0xC7); emit8(MODRM_RBX32(0)); emit32(offs); emit32(imm);
+}
+
+// <alu> eax, [rbx+offs] (opcode is the r32, r/m32 form)
+static void emit_alu_mem(UINT8 opcode, INT32 offs)
+{
+	emit8(opcode); emit8(MODRM_RBX32(X64_EAX)); emit32(offs);
+}
+
+// sub dword [rbx+icount], n
+static void emit_sub_icount(int n)
+{
+	if (n == 0)
+		return;
+	if (n == 1)
+	{
+		emit8(0xFF); emit8(MODRM_RBX32(1)); emit32(PPC_OFFS(icount));	// dec
+	}
+	else
+	{
+		emit8(0x81); emit8(MODRM_RBX32(5)); emit32(PPC_OFFS(icount)); emit32(n);
+	}
+}
+
+// jne rel32 to be patched later; returns location of displacement
+static UINT8 *emit_jne(void)
+{
+	UINT8 *fixup;
+	emit8(0x0F); emit8(0x85);
+	fixup = ppc_jit.emit;
+	emit32(0);
+	return fixup;
+}
+
+static void emit_call_handler(void (*handler)(UINT32), UINT32 op)
+{
+#ifdef _WIN32
+	emit8(0xB9); emit32(op);	// mov ecx, op
+#else
+	emit8(0xBF); emit32(op);	// mov edi, op
+#endif
+	emit8(0x48); emit8(0xB8); emit64((UINT64)(uintptr_t) handler);	// mov rax, handler
+	emit8(0xFF); emit8(0xD0);	// call rax
+}
+
+// Compare rA with rB or an immediate and set CR field (cmp/cmpl/cmpi/cmpli)
+static void emit_compare(UINT32 op, bool is_signed, bool immediate, UINT32 imm)
+{
+	emit_load(X64_EAX, PPC_OFFS_R(RA));
+	if (immediate)
+	{
+		emit8(0x3D); emit32(imm);				// cmp eax, imm32
+	}
+	else
+		emit_alu_mem(0x3B, PPC_OFFS_R(RB));		// cmp eax, [rB]
+	emit8(0xB9); emit32(0x2);					// mov ecx, 2 (EQ)
+	emit8(0xBA); emit32(0x4);					// mov edx, 4 (GT)
+	emit8(0x0F); emit8(is_signed ? 0x4F : 0x47); emit8(0xCA);	// cmovg/cmova ecx, edx
+	emit8(0xBA); emit32(0x8);					// mov edx, 8 (LT)
+	emit8(0x0F); emit8(is_signed ? 0x4C : 0x42); emit8(0xCA);	// cmovl/cmovb ecx, edx
+	emit_load(X64_EAX, PPC_OFFS(xer));
+	emit8(0xC1); emit8(0xE8); emit8(31);		// shr eax, 31 (SO)
+	emit8(0x09); emit8(0xC1);					// or ecx, eax
+	emit8(0x88); emit8(MODRM_RBX32(X64_ECX)); emit32(PPC_OFFS_CR(CRFD));	// mov [cr], cl
+}
+
+/*
+ * ppc_jit_emit_native(op):
+ *
+ * Emits host code for the most common side-effect free integer instructions.
+ * Returns false if the instruction must go through its handler instead.
+ */
+static bool ppc_jit_emit_native(UINT32 op)
+{
+	switch (op >> 26)
+	{
+	case 14:	// addi
+	case 15:	// addis
+		{
+			UINT32 imm = ((op >> 26) == 14) ? (UINT32) SIMM16 : (UINT32) (UIMM16 << 16);
+			if (RA == 0)
+				emit_store_imm(PPC_OFFS_R(RT), imm);
+			else
+			{
+				emit_load(X64_EAX, PPC_OFFS_R(RA));
+				emit8(0x05); emit32(imm);			// add eax, imm32
+				emit_store(X64_EAX, PPC_OFFS_R(RT));
+			}
+		}
+		return true;
+	case 24:	// ori
+	case 25:	// oris
+	case 26:	// xori
+	case 27:	// xoris
+		{
+			UINT32 imm = (op & 0x04000000) ? (UIMM16 << 16) : UIMM16;
+			emit_load(X64_EAX, PPC_OFFS_R(RS));
+			emit8((op >> 26) <= 25 ? 0x0D : 0x35); emit32(imm);	// or/xor eax, imm32
+			emit_store(X64_EAX, PPC_OFFS_R(RA));
+		}
+		return true;
+	case 21:	// rlwinm
+		if (RCBIT)
+			return false;
+		emit_load(X64_EAX, PPC_OFFS_R(RS));
+		if (SH != 0)
+		{
+			emit8(0xC1); emit8(0xC0); emit8(SH);	// rol eax, sh
+		}
+		emit8(0x25); emit32(GET_ROTATE_MASK(MB, ME));	// and eax, mask
+		emit_store(X64_EAX, PPC_OFFS_R(RA));
+		return true;
+	case 10:	// cmpli
+		emit_compare(op, false, true, UIMM16);
+		return true;
+	case 11:	// cmpi
+		emit_compare(op, true, true, (UINT32) SIMM16);
+		return true;
+	case 31:
+		switch ((op >> 1) & 0x3ff)
+		{
+		case 0:		// cmp
+			emit_compare(op, true, false, 0);
+			return true;
+		case 32:	// cmpl
+			emit_compare(op, false, false, 0);
+			return true;
+		case 28:	// and
+		case 316:	// xor
+		case 444:	// or
+			if (RCBIT)
+				return false;
+			if (RS == RB && ((op >> 1) & 0x3ff) == 316)
+			{
+				emit8(0x31); emit8(0xC0);	// xor eax, eax: xor rA,rS,rS clears rA
+			}
+			else
+			{
+				emit_load(X64_EAX, PPC_OFFS_R(RS));
+				if (RS != RB)	// and/or rA,rS,rS (mr) just copy rS
+					emit_alu_mem(((op >> 1) & 0x3ff) == 28 ? 0x23 : (((op >> 1) & 0x3ff) == 316 ? 0x33 : 0x0B), PPC_OFFS_R(RB));
+			}
+			emit_store(X64_EAX, PPC_OFFS_R(RA));
+			return true;
+		case 266:	// add
+			if (RCBIT || OEBIT)
+				return false;
+			emit_load(X64_EAX, PPC_OFFS_R(RA));
+			emit_alu_mem(0x03, PPC_OFFS_R(RB));		// add eax, [rB]
+			emit_store(X64_EAX, PPC_OFFS_R(RT));
+			return true;
+		case 40:	// subf
+			if (RCBIT || OEBIT)
+				return false;
+			emit_load(X64_EAX, PPC_OFFS_R(RB));
+			emit_alu_mem(0x2B, PPC_OFFS_R(RA));		// sub eax, [rA]
+			emit_store(X64_EAX, PPC_OFFS_R(RT));
+			return true;
+		}
+		return false;
+	}
+	return false;
+}
+
+
+/*
+ * ppc_jit_emit_block(pc, max_length, r, block):
+ *
+ * Emits host code for up to max_length instructions starting at pc. Returns
+ * the number of instructions translated.
+ */
+static UINT32 ppc_jit_emit_block(UINT32 pc, UINT32 max_length, const PPC_JIT_REGION *r, PPC_JIT_BLOCK *block)
+{
+	UINT8	*fixups[2 * PPC_JIT_MAX_BLOCK];
+	int		num_fixups = 0;
+	int		pending = 0;	// native instructions not yet subtracted from icount
+	bool	pc_valid = false;
+	UINT32	addr = pc;
+	UINT32	n;
+
+	ppc_jit.emit = ppc_jit.code + ppc_jit.code_used;
+	UINT8 *start = ppc_jit.emit;
+
+	// Prologue: push rbx / [sub rsp, 32] / mov rbx, &ppc
+	emit8(0x53);
+#ifdef _WIN32
+	emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x20);
+#endif
+	emit8(0x48); emit8(0xBB); emit64((UINT64)(uintptr_t) &ppc);
+
+	for (n = 0; n < max_length; n++, addr += 4)
+	{
+		UINT32 op = r->ptr[(addr - r->start) / 4];
+		void (*handler)(UINT32) = ppc_jit_lookup_handler(op);
+		int kind = ppc_jit_classify(handler);
+
+		if (kind == PPC_JIT_PURE)
+		{
+			if (!ppc_jit_emit_native(op))
+				emit_call_handler(handler, op);
+			pending++;
+			pc_valid = false;
+			continue;
+		}
+
+		// Handler may observe pc, npc and icount
+		emit_sub_icount(pending);
+		pending = 0;
+		emit_store_imm(PPC_OFFS(pc), addr);
+		emit_store_imm(PPC_OFFS(npc), addr + 4);
+		emit_call_handler(handler, op);
+		emit_sub_icount(1);
+		pc_valid = true;
+
+		if (kind == PPC_JIT_END)
+		{
+			n++;
+			break;
+		}
+
+		// Leave if the handler redirected execution, halted, or hit translated code
+		emit8(0x81); emit8(MODRM_RBX32(7)); emit32(PPC_OFFS(npc)); emit32(addr + 4);	// cmp [npc], addr+4
+		fixups[num_fixups++] = emit_jne();
+		emit8(0x66); emit8(0x83); emit8(MODRM_RBX32(7)); emit32(PPC_OFFS(fatalError)); emit8(0);	// cmp word [fatalError/jit_exit], 0
+		fixups[num_fixups++] = emit_jne();
+	}
+
+	// Fell through the end of the block
+	if (!pc_valid)
+	{
+		emit_sub_icount(pending);
+		emit_store_imm(PPC_OFFS(pc), addr - 4);
+		emit_store_imm(PPC_OFFS(npc), addr);
+	}
+
+	// Epilogue
+	for (int i = 0; i < num_fixups; i++)
+	{
+		INT32 rel = (INT32) (ppc_jit.emit - (fixups[i] + 4));
+		memcpy(fixups[i], &rel, 4);
+	}
+#ifdef _WIN32
+	emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x20);
+#endif
+	emit8(0x5B);
+	emit8(0xC3);
+
+	ppc_jit.code_used += (UINT32) (ppc_jit.emit - start);
+	block->code = (void (*)(void)) start;
+	return n;
+}
+
+#endif	// PPC_JIT_X64
+
+
+/******************************************************************************
+ Dispatch
+******************************************************************************/
+
+// Threaded interpreter (ppc_threaded.c)
+static UINT32 ppc_threaded_decode_block(UINT32 pc, UINT32 max_length, const PPC_JIT_REGION *r, PPC_JIT_BLOCK *block);
+static void ppc_threaded_run(const PPC_JIT_BLOCK *block);
+
+/*
+ * ppc_jit_translate(pc, block):
+ *
+ * Translates the block starting at pc into the given cache entry using the
+ * current engine. Returns false if pc is not in any fetch region.
+ */
+static bool ppc_jit_translate(UINT32 pc, PPC_JIT_BLOCK *block)
+{
+	PPC_JIT_REGION	*r = NULL;
+	UINT32			page, max_length, length;
+
+	int i = ppc_fetch_region(pc);	// regions mirror ppc.fetch
+	if (i < 0 || i >= ppc_jit.num_regions)
+		return false;
+	r = &ppc_jit.region[i];
+
+	// Blocks stay within one page of their region
+	page = (pc - r->start) >> PPC_JIT_PAGE_SHIFT;
+	max_length = (((page + 1) << PPC_JIT_PAGE_SHIFT) - (pc - r->start)) / 4;
+	if ((r->end - pc) / 4 + 1 < max_length)
+		max_length = (r->end - pc) / 4 + 1;
+	if (max_length > PPC_JIT_MAX_BLOCK)
+		max_length = PPC_JIT_MAX_BLOCK;
+
+	if (ppc_engine == PPC_ENGINE_THREADED)
+	{
+		if (ppc_jit.decoded_used + PPC_JIT_MAX_BLOCK > PPC_JIT_NUM_DECODED)
+			ppc_jit_flush();
+		length = ppc_threaded_decode_block(pc, max_length, r, block);
+	}
+	else
+	{
+#if PPC_JIT_X64
+		if (ppc_jit.code_used + PPC_JIT_MAX_BLOCK * PPC_JIT_MAX_INSN + 64 > PPC_JIT_CODE_SIZE)
+			ppc_jit_flush();
+		length = ppc_jit_emit_block(pc, max_length, r, block);
+#else
+		return false;
+#endif
+	}
+
+	ppc_set_code_page(pc, true);
+	block->pc = pc;
+	block->length = length;
+	block->page_gen = &r->page_gen[page];
+	block->gen = r->page_gen[page];
+	return true;
+}
+
+/*
+ * ppc_jit_execute_block():
+ *
+ * Runs the translated block at ppc.npc, translating it first if needed.
+ * Returns false if the interpreter must execute the next instruction instead:
+ * either the address cannot be translated or the block could run past the end
+ * of the time slice or the decrementer trigger point.
+ */
+static bool ppc_jit_execute_block(void)
+{
+	UINT32 pc = ppc.npc;
+	PPC_JIT_BLOCK *block = &ppc_jit.blocks[(pc >> 2) & (PPC_JIT_NUM_BLOCKS - 1)];
+
+	if (block->length == 0 || block->pc != pc || *block->page_gen != block->gen)
+	{
+		if (!ppc_jit_translate(pc, block))
+			return false;
+	}
+
+	int icount = ppc.icount;
+	int length = (int) block->length;
+	if (icount < length)
+		return false;
+	if (ppc.dec_trigger_cycle > icount - length && ppc.dec_trigger_cycle < icount)
+		return false;
+
+	ppc.jit_exit = false;
+	if (ppc_engine == PPC_ENGINE_THREADED)
+		ppc_threaded_run(block);
+	else
+		block->code();
+
+	if (ppc.icount == ppc.dec_trigger_cycle)
+	{
+		ppc.interrupt_pending |= 0x2;
+		ppc603_check_interrupts();
+	}
+	return true;
+}
+
+
+/******************************************************************************
+ Ahead-of-Time Translation
+
+ Translated code holds host addresses (handlers, &ppc) and is cheap to make
+ again, so what is kept between runs is where blocks start. Translating those
+ again up front, before the game runs, takes the translation cost off the
+ first frames that reach them.
+******************************************************************************/
+
+// Entry points of valid blocks between start and end, as many as fit in pcs;
+// returns the number found
+static unsigned ppc_jit_get_blocks(UINT32 start, UINT32 end, UINT32 *pcs, unsigned max_pcs)
+{
+	unsigned n = 0;
+
+	if (ppc_engine == PPC_ENGINE_INTERPRETER)
+		return 0;
+	for (int i = 0; i < PPC_JIT_NUM_BLOCKS; i++)
+	{
+		const PPC_JIT_BLOCK *block = &ppc_jit.blocks[i];
+		if (block->length == 0 || *block->page_gen != block->gen || block->pc < start || block->pc > end)
+			continue;
+		if (n < max_pcs)
+			pcs[n] = block->pc;
+		n++;
+	}
+	return n;
+}
+
+// Translates blocks at the given addresses, leaving at least half of the code
+// buffer for the game so that warming up never causes a flush; returns the
+// number translated
+static unsigned ppc_jit_warm_up(const UINT32 *pcs, unsigned num_pcs)
+{
+	unsigned n = 0;
+
+	if (ppc_engine == PPC_ENGINE_INTERPRETER)
+		return 0;
+	for (unsigned i = 0; i < num_pcs; i++)
+	{
+		if (ppc_engine == PPC_ENGINE_THREADED ? ppc_jit.decoded_used > PPC_JIT_NUM_DECODED / 2 : ppc_jit.code_used > PPC_JIT_CODE_SIZE / 2)
+			break;
+
+		UINT32 pc = pcs[i];
+		PPC_JIT_BLOCK *block = &ppc_jit.blocks[(pc >> 2) & (PPC_JIT_NUM_BLOCKS - 1)];
+		if ((pc & 3) != 0 || (block->length != 0 && block->pc == pc && *block->page_gen == block->gen))
+			continue;
+		if (ppc_jit_translate(pc, block))
+			n++;
+	}
+	return n;
+}
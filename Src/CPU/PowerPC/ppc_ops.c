@@ -241,6 +241,7 @@ static void ppc_bx(UINT32 op)
 	}
 	
 	ppc_change_pc(ppc.npc);
+	ppc_idle_branch(ppc.npc);
 }
 
 static void ppc_bcx(UINT32 op)
@@ -255,6 +256,7 @@ static void ppc_bcx(UINT32 op)
 		}
 
 		ppc_change_pc(ppc.npc);
+		ppc_idle_branch(ppc.npc);
 	}
 
 	if( LKBIT ) {
@@ -726,6 +728,14 @@ static void ppc_lmw(UINT32 op)
 	else
 		ea = REG(RA) + SIMM16;
 
+	// Words are held in host order, so a block in RAM is a single copy
+	UINT8 *page = ppc_map_range(ppc_read_map, ea, 4 * (32 - r));
+	if( page != NULL && (ea & 3) == 0 )
+	{
+		memcpy(&REG(r), &page[ea & PPC_MAP_MASK], 4 * (32 - r));
+		return;
+	}
+
 	while( r <= 31 )
 	{
 		REG(r) = READ32(ea);
@@ -749,13 +759,15 @@ static void ppc_lswi(UINT32 op)
 	r = RT - 1;
 	i = 0;
 
+	UINT8 *page = ppc_map_range(ppc_read_map, ea, n);
 	while(n > 0)
 	{
 		if (i == 0) {
 			r = (r + 1) % 32;
 			REG(r) = 0;
 		}
-		REG(r) |= ((READ8(ea) & 0xff) << (24 - i));
+		UINT8 b = (page != NULL) ? page[(ea & PPC_MAP_MASK) ^ 3] : READ8(ea);
+		REG(r) |= (b << (24 - i));
 		i += 8;
 		if (i == 32) {
 			i = 0;
@@ -1243,6 +1255,13 @@ static void ppc_stmw(UINT32 op)
 	else
 		ea = REG(RA) + SIMM16;
 
+	UINT8 *page = ppc_map_range(ppc_write_map, ea, 4 * (32 - r));
+	if( page != NULL && (ea & 3) == 0 )
+	{
+		memcpy(&page[ea & PPC_MAP_MASK], &REG(r), 4 * (32 - r));
+		return;
+	}
+
 	while( r <= 31 )
 	{
 		WRITE32(ea, REG(r));
@@ -1266,12 +1285,16 @@ static void ppc_stswi(UINT32 op)
 	r = RT - 1;
 	i = 0;
 
+	UINT8 *page = ppc_map_range(ppc_write_map, ea, n);
 	while(n > 0)
 	{
 		if (i == 0) {
 			r = (r + 1) % 32;
 		}
-		WRITE8(ea, (REG(r) >> (24-i)) & 0xff);
+		if (page != NULL)
+			page[(ea & PPC_MAP_MASK) ^ 3] = (REG(r) >> (24-i)) & 0xff;
+		else
+			WRITE8(ea, (REG(r) >> (24-i)) & 0xff);
 		i += 8;
 		if (i == 32) {
 			i = 0;
@@ -1722,13 +1745,42 @@ INLINE INT64 round_toward_negative_infinity(FPR f)
 	return (INT64)(r);
 }
 
-#define SET_VXSNAN(a, b)    if (is_snan_double(a) || is_snan_double(b)) ppc.fpscr |= 0x80000000
-#define SET_VXSNAN_1(c)     if (is_snan_double(c)) ppc.fpscr |= 0x80000000
+/*
+ * Result and exception flags are only kept in PPC_FPU_ACCURATE and
+ * PPC_FPU_VALIDATE modes. Games hardly ever look at them, so PPC_FPU_FAST
+ * skips classifying every result. Arithmetic is the host's either way.
+ * Validation notes when arithmetic changes a flag and reports the next read
+ * of FPSCR (mffs, mcrfs or a record form), which fast mode would have got
+ * differently.
+ */
+INLINE void set_fpscr_flags(UINT32 mask, UINT32 flags)
+{
+	UINT32 fpscr = (ppc.fpscr & ~mask) | flags;
+	if (ppc_fpu_mode == PPC_FPU_VALIDATE && fpscr != ppc.fpscr)
+		ppc_fpscr_stale = true;
+	ppc.fpscr = fpscr;
+}
+
+static void ppc_check_fpscr_read(void)
+{
+	if (!ppc_fpscr_stale)
+		return;
+	ppc_fpscr_stale = false;
+	if (ppc_stale_fpscr_reads++ == 0)
+		InfoLog("PowerPC read FPSCR flags set by arithmetic at %08X; the fast FPU mode may not suit this game.", ppc.pc);
+	DEBUG_LOG(PPC, "FPSCR read at %08X after arithmetic changed its flags\n", ppc.pc);
+}
+
+#define SET_VXSNAN(a, b)    if (ppc_fpu_mode != PPC_FPU_FAST && (is_snan_double(a) || is_snan_double(b))) set_fpscr_flags(0x80000000, 0x80000000)
+#define SET_VXSNAN_1(c)     if (ppc_fpu_mode != PPC_FPU_FAST && is_snan_double(c)) set_fpscr_flags(0x80000000, 0x80000000)
 
 INLINE void set_fprf(FPR f)
 {
 	UINT32 fprf;
 
+	if (ppc_fpu_mode == PPC_FPU_FAST)
+		return;
+
 	// see page 3-30, 3-31
 
 	if (is_qnan_double(f))
@@ -1764,8 +1816,7 @@ INLINE void set_fprf(FPR f)
 			fprf = 0x02;
 	}
 
-	ppc.fpscr &= ~0x0001f000;
-	ppc.fpscr |= (fprf << 12);
+	set_fpscr_flags(0x0001f000, fprf << 12);
 }
 
 
@@ -2063,12 +2114,12 @@ static void ppc_stfsx(UINT32 op)
 
 static void ppc_tlbia(UINT32 op)
 {
-	/* TODO: TLB not emulated so this opcode doesn't need to implemented */
+	/* Address translation is not emulated (see ppc_check_bat()), so there are no entries to invalidate */
 }
 
 static void ppc_tlbie(UINT32 op)
 {
-	/* TODO: TLB not emulated so this opcode doesn't need to implemented */
+	/* Address translation is not emulated (see ppc_check_bat()), so there are no entries to invalidate */
 }
 
 static void ppc_tlbsync(UINT32 op)
@@ -2414,6 +2465,7 @@ static void ppc_fsubx(UINT32 op)
 
 static void ppc_mffsx(UINT32 op)
 {
+	ppc_check_fpscr_read();
 	FPR(RT).id = (UINT32)ppc.fpscr;
 
 	if( RCBIT ) {
@@ -2503,6 +2555,7 @@ static void ppc_mcrfs(UINT32 op)
 	UINT32 crfs, f;
 	crfs = CRFA;
 
+	ppc_check_fpscr_read();
 	f = ppc.fpscr >> ((7 - crfs) * 4);	// get crfS field from FPSCR
 	f &= 0xf;
 
@@ -0,0 +1,251 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ppc_profile.c
+ *
+ * Sampling profiler for emulated code. Included from ppc.cpp; do not compile
+ * separately.
+ *
+ * Every PPC_PROFILE_INTERVAL cycles, the address of the next instruction to
+ * execute is recorded in a histogram of 64-byte code blocks, and its opcode in
+ * a histogram of instruction classes (primary opcode plus extended opcode where
+ * there is one). Translated blocks run to completion, so under the threaded
+ * and JIT engines samples land on block entry points. When disabled, the only
+ * cost is one compare per step in ppc_execute().
+ */
+
+#define PPC_PROFILE_INTERVAL	1024	// cycles between samples
+#define PPC_PROFILE_BLOCK_SHIFT	6		// 64-byte blocks
+#define PPC_PROFILE_NUM_BLOCKS	65536	// block hash table size (must be a power of 2)
+#define PPC_PROFILE_NUM_CLASSES	65536	// 6-bit primary and 10-bit extended opcode
+
+typedef struct
+{
+	UINT32	addr;	// block address + 1 (0 marks an empty entry)
+	UINT32	count;
+} PPC_PROFILE_BLOCK;
+
+struct PPC_PROFILE_STATE
+{
+	bool				enabled;
+	int					next_sample;	// icount at which to take the next sample
+	int					remaining;		// cycles to next sample carried between slices
+	UINT64				samples;
+	UINT64				dropped;		// samples lost to a full block table
+	PPC_PROFILE_BLOCK	blocks[PPC_PROFILE_NUM_BLOCKS];
+	UINT32				classes[PPC_PROFILE_NUM_CLASSES];
+};
+
+// Held by the active context
+#define ppc_profile	(*ppc_ctx->profile)
+
+static void ppc_profile_reset(void)
+{
+	memset(ppc_profile.blocks, 0, sizeof(ppc_profile.blocks));
+	memset(ppc_profile.classes, 0, sizeof(ppc_profile.classes));
+	ppc_profile.samples = 0;
+	ppc_profile.dropped = 0;
+	ppc_profile.remaining = PPC_PROFILE_INTERVAL;
+}
+
+static UINT32 ppc_profile_class(UINT32 op)
+{
+	UINT32 primary = op >> 26;
+	UINT32 xo = (op >> 1) & 0x3ff;
+
+	switch (primary)
+	{
+	case 19:
+	case 31:
+		return (primary << 10) | xo;
+	case 59:	// A-form: frC occupies the upper bits
+		return (primary << 10) | (xo & 0x1f);
+	case 63:
+		return (primary << 10) | ((xo & 0x1f) >= 18 ? (xo & 0x1f) : xo);
+	}
+	return primary << 10;
+}
+
+static bool ppc_profile_fetch(UINT32 pc, UINT32 *op)
+{
+	if (ppc.fetch == NULL)
+		return false;
+	int i = ppc_fetch_region(pc);
+	if (i < 0)
+		return false;
+	*op = ppc.fetch[i].ptr[(pc - ppc.fetch[i].start) / 4];
+	return true;
+}
+
+/*
+ * ppc_profile_sample():
+ *
+ * Called from ppc_execute() once ppc.icount reaches the sample point. A single
+ * step may span several intervals (a translated block or a skipped idle loop),
+ * in which case the sample is weighted accordingly.
+ */
+static void ppc_profile_sample(void)
+{
+	UINT32 weight = 1 + (UINT32)(ppc_profile.next_sample - ppc.icount) / PPC_PROFILE_INTERVAL;
+	UINT32 pc = ppc.npc;
+	UINT32 op;
+
+	ppc_profile.next_sample -= weight * PPC_PROFILE_INTERVAL;
+	ppc_profile.samples += weight;
+
+	UINT32 addr = (pc >> PPC_PROFILE_BLOCK_SHIFT) + 1;
+	UINT32 i = (addr * 2654435761u) & (PPC_PROFILE_NUM_BLOCKS - 1);
+	UINT32 probes;
+	for (probes = 0; probes < 16; probes++, i = (i + 1) & (PPC_PROFILE_NUM_BLOCKS - 1))
+	{
+		PPC_PROFILE_BLOCK *block = &ppc_profile.blocks[i];
+		if (block->addr == addr || block->addr == 0)
+		{
+			block->addr = addr;
+			block->count += weight;
+			break;
+		}
+	}
+	if (probes == 16)
+		ppc_profile.dropped += weight;
+
+	if (ppc_profile_fetch(pc, &op))
+		ppc_profile.classes[ppc_profile_class(op)] += weight;
+}
+
+INLINE void ppc_profile_begin(int cycles)
+{
+	ppc_profile.next_sample = ppc_profile.enabled ? cycles - ppc_profile.remaining : INT_MIN;
+}
+
+INLINE void ppc_profile_end(void)
+{
+	if (ppc_profile.enabled)
+		ppc_profile.remaining = ppc.icount - ppc_profile.next_sample;
+}
+
+#ifdef SUPERMODEL_DEBUGGER
+// Finds the nearest label at or before addr, from the debugger's custom labels or code analysis
+static bool ppc_profile_symbol(UINT32 addr, char *str, size_t len)
+{
+	const char *best = NULL;
+	UINT32 bestAddr = 0;
+	char autoStr[256];
+
+	if (PPCDebug == NULL)
+		return false;
+
+	for (Debugger::CLabel *label: PPCDebug->labels)
+	{
+		if (label->addr <= addr && (best == NULL || label->addr > bestAddr))
+		{
+			best = label->name;
+			bestAddr = label->addr;
+		}
+	}
+
+	Debugger::CCodeAnalyser *analyser = PPCDebug->GetCodeAnalyser();
+	Debugger::CAutoLabel *bestAuto = NULL;
+	if (analyser != NULL && analyser->analysis != NULL)
+	{
+		for (Debugger::CAutoLabel *autoLabel: analyser->analysis->autoLabels)
+		{
+			if (autoLabel->addr <= addr && (best == NULL || autoLabel->addr > bestAddr))
+			{
+				bestAuto = autoLabel;
+				best = NULL;
+				bestAddr = autoLabel->addr;
+			}
+		}
+	}
+	if (bestAuto != NULL && bestAuto->GetLabel(autoStr))
+		best = autoStr;
+
+	if (best == NULL)
+		return false;
+	if (addr == bestAddr)
+		snprintf(str, len, "%s", best);
+	else
+		snprintf(str, len, "%s+0x%X", best, addr - bestAddr);
+	return true;
+}
+#endif // SUPERMODEL_DEBUGGER
+
+static int ppc_profile_compare_blocks(const void *a, const void *b)
+{
+	const PPC_PROFILE_BLOCK *x = (const PPC_PROFILE_BLOCK *) a;
+	const PPC_PROFILE_BLOCK *y = (const PPC_PROFILE_BLOCK *) b;
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return x->addr < y->addr ? -1 : (x->addr > y->addr);
+}
+
+static void ppc_profile_write(FILE *fp, unsigned top_n)
+{
+	std::vector<PPC_PROFILE_BLOCK> sorted;
+	UINT64 total = ppc_profile.samples > 0 ? ppc_profile.samples : 1;
+
+	fprintf(fp, "PowerPC profile: %llu samples, one per %u cycles", (unsigned long long) ppc_profile.samples, PPC_PROFILE_INTERVAL);
+	if (ppc_profile.dropped > 0)
+		fprintf(fp, " (%llu not attributed to a block)", (unsigned long long) ppc_profile.dropped);
+	fprintf(fp, "\n\n");
+
+	// Hottest code blocks
+	for (UINT32 i = 0; i < PPC_PROFILE_NUM_BLOCKS; i++)
+	{
+		if (ppc_profile.blocks[i].addr != 0)
+			sorted.push_back(ppc_profile.blocks[i]);
+	}
+	if (!sorted.empty())
+		qsort(&sorted[0], sorted.size(), sizeof(sorted[0]), ppc_profile_compare_blocks);
+	fprintf(fp, "Top %u of %u blocks (%u bytes):\n", std::min<unsigned>(top_n, sorted.size()), (unsigned) sorted.size(), 1u << PPC_PROFILE_BLOCK_SHIFT);
+	for (size_t i = 0; i < sorted.size() && i < top_n; i++)
+	{
+		UINT32 addr = (sorted[i].addr - 1) << PPC_PROFILE_BLOCK_SHIFT;
+		fprintf(fp, "  %08X-%08X %10u %6.2f%%", addr, addr + (1u << PPC_PROFILE_BLOCK_SHIFT) - 1, sorted[i].count, 100.0 * sorted[i].count / total);
+#ifdef SUPERMODEL_DEBUGGER
+		char symbol[300];
+		if (ppc_profile_symbol(addr, symbol, sizeof(symbol)))
+			fprintf(fp, "  %s", symbol);
+#endif // SUPERMODEL_DEBUGGER
+		fprintf(fp, "\n");
+	}
+
+	// Instruction classes, reusing the block entry type (addr holds the class)
+	sorted.clear();
+	for (UINT32 i = 0; i < PPC_PROFILE_NUM_CLASSES; i++)
+	{
+		if (ppc_profile.classes[i] != 0)
+			sorted.push_back({ i, ppc_profile.classes[i] });
+	}
+	if (!sorted.empty())
+		qsort(&sorted[0], sorted.size(), sizeof(sorted[0]), ppc_profile_compare_blocks);
+	fprintf(fp, "\nTop %u of %u instruction classes:\n", std::min<unsigned>(top_n, sorted.size()), (unsigned) sorted.size());
+	for (size_t i = 0; i < sorted.size() && i < top_n; i++)
+	{
+		UINT32 op = ((sorted[i].addr >> 10) << 26) | ((sorted[i].addr & 0x3ff) << 1);
+		char mnem[32], oprs[100];
+		if (DisassemblePowerPC(op, 0, mnem, oprs, false) != OKAY && mnem[0] == '\0')
+			snprintf(mnem, sizeof(mnem), "op %u/%u", sorted[i].addr >> 10, sorted[i].addr & 0x3ff);
+		fprintf(fp, "  %-12s %10u %6.2f%%\n", mnem, sorted[i].count, 100.0 * sorted[i].count / total);
+	}
+}
@@ -0,0 +1,348 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * ppc_threaded.c
+ *
+ * Threaded interpreter. Included from ppc.cpp; do not compile separately.
+ *
+ * Each block from the translation cache (ppc_jit.c) is decoded once into an
+ * array of PPC_DECODED entries holding the handler and pre-extracted operand
+ * fields. Common instructions get a fast path that works from those fields;
+ * the rest call their ppc_ops.c handler with the original opcode. Unlike the
+ * recompiler, this engine is portable to any host.
+ */
+
+
+/******************************************************************************
+ Fast Paths
+******************************************************************************/
+
+static void ppct_generic(const PPC_DECODED *d)
+{
+	d->handler(d->op);
+}
+
+static void ppct_li(const PPC_DECODED *d)		// addi/addis rD,0,imm
+{
+	REG(d->rd) = d->imm;
+}
+
+static void ppct_addi(const PPC_DECODED *d)		// addi/addis
+{
+	REG(d->rd) = REG(d->ra) + d->imm;
+}
+
+static void ppct_ori(const PPC_DECODED *d)		// ori/oris
+{
+	REG(d->ra) = REG(d->rd) | d->imm;
+}
+
+static void ppct_xori(const PPC_DECODED *d)		// xori/xoris
+{
+	REG(d->ra) = REG(d->rd) ^ d->imm;
+}
+
+static void ppct_rlwinm(const PPC_DECODED *d)
+{
+	UINT32 rs = REG(d->rd);
+	REG(d->ra) = ((rs << d->rb) | (rs >> ((32 - d->rb) & 31))) & d->imm;
+}
+
+static void ppct_and(const PPC_DECODED *d)
+{
+	REG(d->ra) = REG(d->rd) & REG(d->rb);
+}
+
+static void ppct_or(const PPC_DECODED *d)
+{
+	REG(d->ra) = REG(d->rd) | REG(d->rb);
+}
+
+static void ppct_xor(const PPC_DECODED *d)
+{
+	REG(d->ra) = REG(d->rd) ^ REG(d->rb);
+}
+
+static void ppct_add(const PPC_DECODED *d)
+{
+	REG(d->rd) = REG(d->ra) + REG(d->rb);
+}
+
+static void ppct_subf(const PPC_DECODED *d)
+{
+	REG(d->rd) = REG(d->rb) - REG(d->ra);
+}
+
+INLINE void ppct_set_cr(int crf, bool lt, bool gt)
+{
+	CR(crf) = (lt ? 0x8 : (gt ? 0x4 : 0x2)) | ((XER & XER_SO) ? 0x1 : 0);
+}
+
+static void ppct_cmpi(const PPC_DECODED *d)
+{
+	INT32 ra = REG(d->ra);
+	ppct_set_cr(d->rd, ra < (INT32) d->imm, ra > (INT32) d->imm);
+}
+
+static void ppct_cmpli(const PPC_DECODED *d)
+{
+	UINT32 ra = REG(d->ra);
+	ppct_set_cr(d->rd, ra < d->imm, ra > d->imm);
+}
+
+static void ppct_cmp(const PPC_DECODED *d)
+{
+	INT32 ra = REG(d->ra);
+	INT32 rb = REG(d->rb);
+	ppct_set_cr(d->rd, ra < rb, ra > rb);
+}
+
+static void ppct_cmpl(const PPC_DECODED *d)
+{
+	UINT32 ra = REG(d->ra);
+	UINT32 rb = REG(d->rb);
+	ppct_set_cr(d->rd, ra < rb, ra > rb);
+}
+
+#define PPCT_EA(d)	((d->ra ? REG(d->ra) : 0) + d->imm)
+
+static void ppct_lwz(const PPC_DECODED *d)
+{
+	REG(d->rd) = READ32(PPCT_EA(d));
+}
+
+static void ppct_lhz(const PPC_DECODED *d)
+{
+	REG(d->rd) = (UINT32) READ16(PPCT_EA(d));
+}
+
+static void ppct_lbz(const PPC_DECODED *d)
+{
+	REG(d->rd) = (UINT32) READ8(PPCT_EA(d));
+}
+
+static void ppct_stw(const PPC_DECODED *d)
+{
+	WRITE32(PPCT_EA(d), REG(d->rd));
+}
+
+static void ppct_sth(const PPC_DECODED *d)
+{
+	WRITE16(PPCT_EA(d), (UINT16) REG(d->rd));
+}
+
+static void ppct_stb(const PPC_DECODED *d)
+{
+	WRITE8(PPCT_EA(d), (UINT8) REG(d->rd));
+}
+
+// Floating point loads and stores (x-forms keep rB in place of the offset)
+#define PPCT_EA_X(d)	((d->ra ? REG(d->ra) : 0) + REG(d->rb))
+
+INLINE void ppct_load_single(UINT32 t, UINT32 ea)
+{
+	FPR32 f;
+	f.i = READ32(ea);
+	FPR(t).fd = (double)(f.f);
+}
+
+INLINE void ppct_store_single(UINT32 t, UINT32 ea)
+{
+	FPR32 f;
+	f.f = (float)(FPR(t).fd);
+	WRITE32(ea, f.i);
+}
+
+static void ppct_lfs(const PPC_DECODED *d)
+{
+	ppct_load_single(d->rd, PPCT_EA(d));
+}
+
+static void ppct_lfsx(const PPC_DECODED *d)
+{
+	ppct_load_single(d->rd, PPCT_EA_X(d));
+}
+
+static void ppct_lfd(const PPC_DECODED *d)
+{
+	FPR(d->rd).id = READ64(PPCT_EA(d));
+}
+
+static void ppct_lfdx(const PPC_DECODED *d)
+{
+	FPR(d->rd).id = READ64(PPCT_EA_X(d));
+}
+
+static void ppct_lfdu(const PPC_DECODED *d)
+{
+	UINT32 ea = REG(d->ra) + d->imm;
+	FPR(d->rd).id = READ64(ea);
+	REG(d->ra) = ea;
+}
+
+static void ppct_stfs(const PPC_DECODED *d)
+{
+	ppct_store_single(d->rd, PPCT_EA(d));
+}
+
+static void ppct_stfsx(const PPC_DECODED *d)
+{
+	ppct_store_single(d->rd, PPCT_EA_X(d));
+}
+
+static void ppct_stfd(const PPC_DECODED *d)
+{
+	WRITE64(PPCT_EA(d), FPR(d->rd).id);
+}
+
+static void ppct_stfdx(const PPC_DECODED *d)
+{
+	WRITE64(PPCT_EA_X(d), FPR(d->rd).id);
+}
+
+static void ppct_stfdu(const PPC_DECODED *d)
+{
+	UINT32 ea = REG(d->ra) + d->imm;
+	WRITE64(ea, FPR(d->rd).id);
+	REG(d->ra) = ea;
+}
+
+
+/******************************************************************************
+ Decoding and Execution
+******************************************************************************/
+
+// Selects a fast path for the instruction, or NULL if it must use its handler
+static void (*ppc_threaded_fast_path(UINT32 op))(const PPC_DECODED *)
+{
+	switch (op >> 26)
+	{
+	case 10:	return ppct_cmpli;
+	case 11:	return ppct_cmpi;
+	case 14:
+	case 15:	return RA == 0 ? ppct_li : ppct_addi;
+	case 21:	return RCBIT ? NULL : ppct_rlwinm;
+	case 24:
+	case 25:	return ppct_ori;
+	case 26:
+	case 27:	return ppct_xori;
+	case 32:	return ppct_lwz;
+	case 34:	return ppct_lbz;
+	case 36:	return ppct_stw;
+	case 38:	return ppct_stb;
+	case 40:	return ppct_lhz;
+	case 44:	return ppct_sth;
+	case 48:	return ppct_lfs;
+	case 50:	return ppct_lfd;
+	case 51:	return RA == 0 ? NULL : ppct_lfdu;
+	case 52:	return ppct_stfs;
+	case 54:	return ppct_stfd;
+	case 55:	return RA == 0 ? NULL : ppct_stfdu;
+	case 31:
+		if (RCBIT)
+			return NULL;
+		switch ((op >> 1) & 0x3ff)
+		{
+		case 535:	return ppct_lfsx;
+		case 599:	return ppct_lfdx;
+		case 663:	return ppct_stfsx;
+		case 727:	return ppct_stfdx;
+		case 0:		return ppct_cmp;
+		case 32:	return ppct_cmpl;
+		case 28:	return ppct_and;
+		case 316:	return ppct_xor;
+		case 444:	return ppct_or;
+		case 266:	return OEBIT ? NULL : ppct_add;
+		case 40:	return OEBIT ? NULL : ppct_subf;
+		}
+		return NULL;
+	}
+	return NULL;
+}
+
+static UINT32 ppc_threaded_decode_block(UINT32 pc, UINT32 max_length, const PPC_JIT_REGION *r, PPC_JIT_BLOCK *block)
+{
+	PPC_DECODED *d = &ppc_jit.decoded[ppc_jit.decoded_used];
+	UINT32 n;
+
+	block->decoded = d;
+	for (n = 0; n < max_length; n++, d++)
+	{
+		UINT32 op = r->ptr[(pc + 4 * n - r->start) / 4];
+		int kind;
+
+		d->op = op;
+		d->handler = ppc_jit_lookup_handler(op);
+		d->rd = RD;
+		d->ra = RA;
+		d->rb = RB;
+		switch (op >> 26)
+		{
+		case 15:
+		case 25:
+		case 27:	d->imm = UIMM16 << 16; break;
+		case 10:
+		case 24:
+		case 26:	d->imm = UIMM16; break;
+		case 21:	d->imm = GET_ROTATE_MASK(MB, ME); d->rb = SH; break;
+		default:	d->imm = (UINT32) SIMM16; break;
+		}
+
+		d->fn = ppc_threaded_fast_path(op);
+		if (d->fn == NULL)
+			d->fn = ppct_generic;
+
+		// Compares take crfD in place of rD
+		if (d->fn == ppct_cmpi || d->fn == ppct_cmpli || d->fn == ppct_cmp || d->fn == ppct_cmpl)
+			d->rd = CRFD;
+
+		kind = ppc_jit_classify(d->handler);
+		d->checked = kind != PPC_JIT_PURE;
+		if (kind == PPC_JIT_END)
+		{
+			n++;
+			break;
+		}
+	}
+
+	ppc_jit.decoded_used += n;
+	return n;
+}
+
+static void ppc_threaded_run(const PPC_JIT_BLOCK *block)
+{
+	const PPC_DECODED *d = block->decoded;
+	const PPC_DECODED *end = d + block->length;
+	UINT32 pc = block->pc;
+
+	for (; d != end; d++, pc += 4)
+	{
+		ppc.pc = pc;
+		ppc.npc = pc + 4;
+		d->fn(d);
+		ppc.icount--;
+
+		// Leave if the handler redirected execution, halted, or hit translated code
+		if (d->checked && (ppc.npc != pc + 4 || ppc.fatalError || ppc.jit_exit))
+			return;
+	}
+}
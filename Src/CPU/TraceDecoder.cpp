@@ -0,0 +1,218 @@
+/*
+ * TraceDecoder.cpp
+ *
+ * Lists the instructions in a CPU trace file written by Supermodel's CPUTrace
+ * option (see CPU/ExecTrace.h for the format), oldest first, one per line:
+ * the CPU's cycle count, the address, the opcode and its disassembly. PowerPC
+ * instructions are disassembled in full. Only the first word of each 68K
+ * instruction is recorded, so operands held in extension words read as 0, and
+ * Z80 instructions are shown as their first byte. Not part of the regular
+ * build; compile with, e.g.:
+ *
+ *  gcc -c -ISrc/CPU/68K/Musashi -DINLINE="static inline" \
+ *    Src/CPU/68K/Musashi/m68kdasm.c -o m68kdasm.o
+ *  g++ -O2 -std=c++17 -ISrc -ISrc/OSD/SDL -ISrc/Pkgs -ISrc/CPU/68K/Musashi \
+ *    $(sdl2-config --cflags) Src/CPU/TraceDecoder.cpp \
+ *    Src/CPU/PowerPC/PPCDisasm.cpp m68kdasm.o -o trace_decoder
+ *
+ * Usage: trace_decoder <file> [cpu name] [number of instructions]
+ */
+
+#include "Supermodel.h"
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "m68k.h"
+}
+
+// Logging stubs (the full emulator is not linked in)
+uint32_t g_debugLogChannels = 0;
+void DebugLog(const char *fmt, ...) {}
+void InfoLog(const char *fmt, ...) {}
+bool ErrorLog(const char *fmt, ...)
+{
+  va_list vl;
+  va_start(vl, fmt);
+  vfprintf(stderr, fmt, vl);
+  va_end(vl);
+  fprintf(stderr, "\n");
+  return FAIL;
+}
+
+// The 68K disassembler reads memory, of which only the instruction's first
+// word is known
+static UINT32 s_m68kPC;
+static UINT32 s_m68kOpcode;
+
+extern "C" {
+unsigned int M68KRead8(unsigned int a)
+{
+  return a == s_m68kPC ? s_m68kOpcode >> 8 : a == s_m68kPC + 1 ? s_m68kOpcode & 0xFF : 0;
+}
+
+unsigned int M68KRead16(unsigned int a)
+{
+  return a == s_m68kPC ? s_m68kOpcode : 0;
+}
+
+unsigned int M68KRead32(unsigned int a)
+{
+  return a == s_m68kPC ? s_m68kOpcode << 16 : 0;
+}
+}
+
+struct Instruction
+{
+  UINT64  cycle;
+  UINT32  pc;
+  UINT32  opcode;
+};
+
+struct Trace
+{
+  std::string name;
+  unsigned    cpu;
+  unsigned    opcodeBytes;
+  std::vector<Instruction> instructions;
+};
+
+static bool Read(FILE *fp, void *data, size_t size)
+{
+  return size == 0 || fread(data, size, 1, fp) == 1;
+}
+
+static bool ReadVarint(const UINT8 *&p, const UINT8 *end, UINT32 &value)
+{
+  value = 0;
+  for (unsigned shift = 0; shift < 35 && p < end; shift += 7)
+  {
+    UINT8 b = *p++;
+    value |= UINT32(b & 0x7F) << shift;
+    if ((b & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+static bool DecodeBlock(Trace &trace, UINT32 pc, UINT64 cycle, const std::vector<UINT8> &data)
+{
+  const UINT8 *p = data.data();
+  const UINT8 *end = p + data.size();
+  while (p < end)
+  {
+    UINT32 delta, cycles;
+    if (!ReadVarint(p, end, delta))
+      return false;
+    pc += (delta >> 1) ^ (0 - (delta & 1));
+    if (end - p < ptrdiff_t(trace.opcodeBytes))
+      return false;
+    UINT32 opcode = 0;
+    for (unsigned i = 0; i < trace.opcodeBytes; i++)
+      opcode |= UINT32(*p++) << (8 * i);
+    if (!ReadVarint(p, end, cycles))
+      return false;
+    cycle += cycles;
+    trace.instructions.push_back({ cycle, pc, opcode });
+  }
+  return true;
+}
+
+static bool ReadTrace(FILE *fp, Trace &trace)
+{
+  UINT8 nameLength, cpu, opcodeBytes;
+  UINT32 numBlocks;
+  char name[256];
+  if (!Read(fp, &nameLength, sizeof(nameLength)) || !Read(fp, name, nameLength)
+      || !Read(fp, &cpu, sizeof(cpu)) || !Read(fp, &opcodeBytes, sizeof(opcodeBytes))
+      || !Read(fp, &numBlocks, sizeof(numBlocks)) || opcodeBytes > 4)
+    return false;
+  trace.name.assign(name, nameLength);
+  trace.cpu = cpu;
+  trace.opcodeBytes = opcodeBytes;
+
+  std::vector<UINT8> data;
+  for (UINT32 i = 0; i < numBlocks; i++)
+  {
+    UINT32 pc, used;
+    UINT64 cycle;
+    if (!Read(fp, &pc, sizeof(pc)) || !Read(fp, &cycle, sizeof(cycle)) || !Read(fp, &used, sizeof(used)))
+      return false;
+    data.resize(used);
+    if (!Read(fp, data.data(), used) || !DecodeBlock(trace, pc, cycle, data))
+      return false;
+  }
+  return true;
+}
+
+static void PrintInstruction(const Trace &trace, const Instruction &in)
+{
+  char mnem[64] = "";
+  char oprs[128] = "";
+  switch (trace.cpu)
+  {
+  case CExecTrace::PowerPC:
+    if (DisassemblePowerPC(in.opcode, in.pc, mnem, oprs, true))
+      strcpy(mnem, "?");
+    printf("%12llu  %08X  %08X  %-8s %s\n", (unsigned long long) in.cycle, in.pc, in.opcode, mnem, oprs);
+    break;
+  case CExecTrace::M68K:
+    s_m68kPC = in.pc;
+    s_m68kOpcode = in.opcode;
+    m68k_disassemble(oprs, in.pc, M68K_CPU_TYPE_68000);
+    printf("%12llu  %06X  %04X  %s\n", (unsigned long long) in.cycle, in.pc, in.opcode, oprs);
+    break;
+  default:
+    printf("%12llu  %04X  %02X\n", (unsigned long long) in.cycle, in.pc, in.opcode);
+    break;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <file> [cpu name] [number of instructions]\n", argv[0]);
+    return 1;
+  }
+  const char *only = argc > 2 ? argv[2] : NULL;
+  size_t last = argc > 3 ? strtoul(argv[3], NULL, 0) : 0;
+
+  FILE *fp = fopen(argv[1], "rb");
+  if (fp == NULL)
+  {
+    fprintf(stderr, "Unable to open '%s'.\n", argv[1]);
+    return 1;
+  }
+  char magic[8];
+  UINT32 count;
+  if (!Read(fp, magic, sizeof(magic)) || memcmp(magic, "SMTRACE1", sizeof(magic)) != 0 || !Read(fp, &count, sizeof(count)))
+  {
+    fprintf(stderr, "'%s' is not a CPU trace file.\n", argv[1]);
+    fclose(fp);
+    return 1;
+  }
+
+  for (UINT32 i = 0; i < count; i++)
+  {
+    Trace trace;
+    if (!ReadTrace(fp, trace))
+    {
+      fprintf(stderr, "'%s' is truncated or corrupt.\n", argv[1]);
+      fclose(fp);
+      return 1;
+    }
+    if (only != NULL && trace.name != only)
+      continue;
+    size_t first = last > 0 && last < trace.instructions.size() ? trace.instructions.size() - last : 0;
+    printf("%s: %zu instructions\n", trace.name.c_str(), trace.instructions.size());
+    for (size_t j = first; j < trace.instructions.size(); j++)
+      PrintInstruction(trace, trace.instructions[j]);
+    printf("\n");
+  }
+  fclose(fp);
+  return 0;
+}
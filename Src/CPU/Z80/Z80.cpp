@@ -27,6 +27,10 @@
  * Adapted for use in Supermodel by Bart Trzynadlowski (July 15, 2011).
  *
  * Please see Z80.h for a discussion of known inaccuracies.
+ *
+ * Flags of the 8-bit arithmetic and logical instructions are looked up in
+ * tables built at start up. Building with Z80_FLAG_TABLES defined as 0
+ * computes them from the results instead, as the original simulator did.
  */
 
 #include <cstdio> // for NULL
@@ -39,7 +43,7 @@
 ******************************************************************************/
 
 // Address space access
-#define GetBYTE(a)    ( Bus->Read8(a&0xFFFF) )
+#define GetBYTE(a)    ( Bus->Read8((a)&0xFFFF) )
 #define GetBYTE_pp(a) ( Bus->Read8(((a)++)&0xFFFF) )
 #define GetBYTE_mm(a) ( Bus->Read8(((a)--)&0xFFFF) )
 #define mm_GetBYTE(a) ( Bus->Read8((--(a))&0xFFFF) )
@@ -198,6 +202,56 @@ static const unsigned char cycleTables[5][256] = {
 
 #define parity(x) partab[(x)&0xff]
 
+// Flags of 8-bit results
+#ifndef Z80_FLAG_TABLES
+#define Z80_FLAG_TABLES 1
+#endif
+
+#define SZ_FLAGS_OF(v)    (((v) & 0xa8) | ((((v) & 0xff) == 0) << 6))
+#define INC_FLAGS_OF(v)   (SZ_FLAGS_OF(v) | ((((v) & 0xf) == 0) << 4) | ((((v) & 0xff) == 0x80) << 2))
+#define DEC_FLAGS_OF(v)   (SZ_FLAGS_OF(v) | ((((v) & 0xf) == 0xf) << 4) | ((((v) & 0xff) == 0x7f) << 2) | 2)
+#define CBITS_FLAGS_OF(c) (((c) & 0x10) | ((((c) >> 6) ^ ((c) >> 5)) & 4) | (((c) >> 8) & 1))
+
+#if Z80_FLAG_TABLES
+
+static const struct FlagTables
+{
+  UINT8 sz[256];      // S, Z and undocumented bits 5 and 3 of a result
+  UINT8 szp[256];     // as above, with P/V set to the parity of the result
+  UINT8 inc[256];     // S, Z, H, P/V (overflow) and bits 5 and 3 after INC, by result
+  UINT8 dec[256];     // the same after DEC, with N set
+  UINT8 cbits[512];   // H, P/V (overflow) and C of an add or subtract, by carry bits (a ^ b ^ result)
+
+  FlagTables(void)
+  {
+    for (unsigned v = 0; v < 256; v++)
+    {
+      sz[v] = SZ_FLAGS_OF(v);
+      szp[v] = SZ_FLAGS_OF(v) | partab[v];
+      inc[v] = INC_FLAGS_OF(v);
+      dec[v] = DEC_FLAGS_OF(v);
+    }
+    for (unsigned c = 0; c < 512; c++)
+      cbits[c] = CBITS_FLAGS_OF(c);
+  }
+} flagTables;
+
+#define SZ_FLAGS(v)     flagTables.sz[(v) & 0xff]
+#define SZP_FLAGS(v)    flagTables.szp[(v) & 0xff]
+#define INC_FLAGS(v)    flagTables.inc[(v) & 0xff]
+#define DEC_FLAGS(v)    flagTables.dec[(v) & 0xff]
+#define CBITS_FLAGS(c)  flagTables.cbits[(c) & 0x1ff]
+
+#else
+
+#define SZ_FLAGS(v)     SZ_FLAGS_OF(v)
+#define SZP_FLAGS(v)    (SZ_FLAGS_OF(v) | parity(v))
+#define INC_FLAGS(v)    INC_FLAGS_OF(v)
+#define DEC_FLAGS(v)    DEC_FLAGS_OF(v)
+#define CBITS_FLAGS(c)  CBITS_FLAGS_OF(c)
+
+#endif  // Z80_FLAG_TABLES
+
 // Stack
 #define POP(x)                        \
   do                                  \
@@ -216,6 +270,19 @@ static const unsigned char cycleTables[5][256] = {
 // Branching
 #define Jpc(cond) pc = cond ? GetWORD(pc) : pc+2
 
+// Relative jump, checking whether it goes back to the start of an idle loop
+#define JRC(cond)                               \
+  {                                             \
+    if (cond)                                   \
+    {                                           \
+      UINT16 branch = pc - 1;                   \
+      pc += (signed char) GetBYTE(pc) + 1;      \
+      SkipIdleLoop(branch, cycles);             \
+    }                                           \
+    else                                        \
+      ++pc;                                     \
+  }
+
 #define CALLC(cond)                     \
   {                                     \
     if (cond)                           \
@@ -229,11 +296,161 @@ static const unsigned char cycleTables[5][256] = {
   }
   
 
+/*******************************************************************************
+ Idle Loop Detection
+
+ Firmware often waits for an interrupt in a short loop that only reads memory
+ and tests what it read, e.g.:
+
+    wait: ld    a,(flag)
+          or    a
+          jr    z,wait
+
+ Nothing can change while no interrupt is taken (memory is only changed by
+ the Z80 itself and, between calls to Run(), by the rest of the system), so
+ once one iteration has run, every one after it is the same and the loop
+ spins until Run() returns. Such a loop is recognized when it jumps back to
+ its start, and whole iterations are then skipped. The last one is left to
+ run, so that registers, flags and the cycle count end up exactly as if the
+ loop had been executed.
+*******************************************************************************/
+
+// Registers read or written by instructions of an idle loop
+#define IDLE_A  0x01
+#define IDLE_F  0x02
+#define IDLE_B  0x04
+#define IDLE_C  0x08
+#define IDLE_D  0x10
+#define IDLE_E  0x20
+#define IDLE_H  0x40
+#define IDLE_L  0x80
+
+// Registers B, C, D, E, H, L, (HL), A as encoded in the low 3 opcode bits
+static const unsigned char idleRegTable[8] = { IDLE_B, IDLE_C, IDLE_D, IDLE_E, IDLE_H, IDLE_L, IDLE_H|IDLE_L, IDLE_A };
+
+int CZ80::IdleLoopCycles(UINT16 start, UINT16 branch)
+{
+  static const int MAX_LOOP_BYTES = 16;
+  struct Op { unsigned reads, writes; } ops[MAX_LOOP_BYTES + 1];
+  int numOps = 0;
+  int loopCycles = 0;
+  unsigned written = 0;
+
+  if (((branch - start) & 0xFFFF) > MAX_LOOP_BYTES)
+    return 0;
+
+  // Decode the loop body, which may only read memory and registers
+  UINT16 addr = start;
+  while (addr != branch)
+  {
+    unsigned op = GetBYTE(addr);
+    unsigned reads = 0, writes = 0;
+    int len = 1;
+    int opCycles = cycleTables[0][op];
+    if (op >= 0x78 && op <= 0x7F)       // LD A,r / LD A,(HL)
+    { reads = idleRegTable[op & 7]; writes = IDLE_A; }
+    else switch (op)
+    {
+    case 0x00:                          // NOP
+      break;
+    case 0x0A: reads = IDLE_B|IDLE_C; writes = IDLE_A; break;   // LD A,(BC)
+    case 0x1A: reads = IDLE_D|IDLE_E; writes = IDLE_A; break;   // LD A,(DE)
+    case 0x3A: writes = IDLE_A; len = 3; break;                 // LD A,(nnnn)
+    case 0x01: writes = IDLE_B|IDLE_C; len = 3; break;          // LD BC,nnnn
+    case 0x11: writes = IDLE_D|IDLE_E; len = 3; break;          // LD DE,nnnn
+    case 0x21: writes = IDLE_H|IDLE_L; len = 3; break;          // LD HL,nnnn
+    case 0xA7:                                                  // AND A
+    case 0xB7: reads = IDLE_A; writes = IDLE_F; break;          // OR A
+    case 0xBE: reads = IDLE_A|IDLE_H|IDLE_L; writes = IDLE_F; break;  // CP (HL)
+    case 0xE6:                                                  // AND nn
+    case 0xEE:                                                  // XOR nn
+    case 0xF6: reads = IDLE_A; writes = IDLE_A|IDLE_F; len = 2; break;  // OR nn
+    case 0xFE: reads = IDLE_A; writes = IDLE_F; len = 2; break; // CP nn
+    case 0xCB:                          // BIT b,r / BIT b,(HL)
+      op = GetBYTE(addr + 1);
+      if ((op & 0xC0) != 0x40)
+        return 0;
+      reads = idleRegTable[op & 7];
+      writes = IDLE_F;
+      opCycles = cycleTables[1][op];
+      len = 2;
+      break;
+    default:
+      return 0;
+    }
+    if (((branch - addr) & 0xFFFF) < (unsigned) len)  // instruction overlaps the branch
+      return 0;
+    loopCycles += opCycles;
+    ops[numOps].reads = reads;
+    ops[numOps].writes = writes;
+    numOps++;
+    written |= writes;
+    addr += len;
+  }
+
+  // The branch itself (only conditional relative jumps read anything)
+  unsigned op = GetBYTE(branch);
+  loopCycles += cycleTables[0][op];
+  ops[numOps].reads = (op == 0x20 || op == 0x28 || op == 0x30 || op == 0x38) ? IDLE_F : 0;
+  ops[numOps].writes = 0;
+  numOps++;
+
+  // No register may carry a value from one iteration to the next
+  unsigned defined = 0;
+  for (int i = 0; i < numOps; i++)
+  {
+    if ((ops[i].reads & written & ~defined) != 0)
+      return 0;
+    defined |= ops[i].writes;
+  }
+
+  return loopCycles;
+}
+
+void CZ80::SkipIdleLoop(UINT16 branch, int &cycles)
+{
+  // Only backward jumps to a loop that cannot be left by an interrupt
+  if (((branch - pc) & 0xFFFF) > 0x7FFF || nmiTrigger || (intLine && (iff&1)) || branch == lastNonIdleBranch)
+    return;
+#ifdef SUPERMODEL_DEBUGGER
+  if (debugHooked)
+    return;
+#endif // SUPERMODEL_DEBUGGER
+
+  int loopCycles = IdleLoopCycles(pc, branch);
+  if (loopCycles == 0)
+  {
+    lastNonIdleBranch = branch; // don't decode it again
+    return;
+  }
+
+  // Memory read before an interrupt or the start of Run() may since have
+  // changed, so one whole iteration must first run without either
+  if (idleLoopBranch != branch)
+  {
+    idleLoopBranch = branch;
+    return;
+  }
+
+  if (cycles > loopCycles)
+  {
+    int skipped = ((cycles - 1) / loopCycles) * loopCycles;
+    cycles -= skipped;
+    idleCycles += skipped;
+  }
+}
+
+
 /*******************************************************************************
  Functions
 *******************************************************************************/
 
-int CZ80::Run(int numCycles)
+/*
+ * The instruction loop is compiled twice: with the debugger called before every
+ * instruction, and without for when the debugger has nothing to check.
+ */
+template <bool Hooked>
+int CZ80::RunLoop(int numCycles)
 {
 #ifdef SUPERMODEL_DEBUGGER
   // If debugging enabled, don't optimize access to registers as they need to be accesible to debugger during execution
@@ -262,25 +479,39 @@ int CZ80::Run(int numCycles)
   unsigned int adr = 0;
 
   int cycles = numCycles;
-#ifdef SUPERMODEL_DEBUGGER
-  if (Debug != NULL)
-  {
-    Debug->CPUActive();
-    lastCycles += numCycles;
-  }
-#endif // SUPERMODEL_DEBUGGER
+  idleLoopBranch = -1;
 
   while (cycles > 0)
   {
-  op = GetBYTE_pp(pc);
-#ifdef SUPERMODEL_DEBUGGER
-  if (Debug != NULL)
+  // While halted, NOPs are executed until an interrupt is taken. None can be
+  // this time unless one is already pending, so the rest of the time is idle.
+  if (halted)
   {
-    while (Debug->CPUExecute(pc - 1, op, lastCycles - cycles))
-      op = GetBYTE_pp(pc);
-    lastCycles = cycles;
+    if (nmiTrigger || (intLine && (iff&1)))
+      goto Interrupts;
+    int skipped = ((cycles + cycleTables[0][0x00] - 1) / cycleTables[0][0x00]) * cycleTables[0][0x00];
+    idleCycles += skipped;
+    cycles -= skipped;
+    break;
   }
+
+  op = GetBYTE_pp(pc);
+  if (Hooked)
+  {
+#ifdef SUPERMODEL_DEBUGGER
+    if (debugHooked)
+    {
+      while (Debug->CPUExecute(pc - 1, op, lastCycles - cycles))
+        op = GetBYTE_pp(pc);
+      lastCycles = cycles;
+    }
 #endif // SUPERMODEL_DEBUGGER
+    if (Trace != NULL)
+    {
+      Trace->Record(pc - 1, op, traceCycles - cycles);
+      traceCycles = cycles;
+    }
+  }
   switch(op) {
   case 0x00:      /* NOP */
     cycles -= cycleTables[0][0x00];
@@ -302,19 +533,13 @@ int CZ80::Run(int numCycles)
     cycles -= cycleTables[0][0x04];
     BC += 0x100;
     temp = hreg(BC);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
+    AF = (AF & ~0xfe) | INC_FLAGS(temp);
     break;
   case 0x05:      /* DEC B */
     cycles -= cycleTables[0][0x05];
     BC -= 0x100;
     temp = hreg(BC);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
+    AF = (AF & ~0xfe) | DEC_FLAGS(temp);
     break;
   case 0x06:      /* LD B,nn */
     cycles -= cycleTables[0][0x06];
@@ -353,19 +578,13 @@ int CZ80::Run(int numCycles)
     cycles -= cycleTables[0][0x0C];
     temp = lreg(BC)+1;
     Setlreg(BC, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
+    AF = (AF & ~0xfe) | INC_FLAGS(temp);
     break;
   case 0x0D:      /* DEC C */
     cycles -= cycleTables[0][0x0D];
     temp = lreg(BC)-1;
     Setlreg(BC, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
+    AF = (AF & ~0xfe) | DEC_FLAGS(temp);
     break;
   case 0x0E:      /* LD C,nn */
     cycles -= cycleTables[0][0x0E];
@@ -399,19 +618,13 @@ int CZ80::Run(int numCycles)
     cycles -= cycleTables[0][0x14];
     DE += 0x100;
     temp = hreg(DE);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
+    AF = (AF & ~0xfe) | INC_FLAGS(temp);
     break;
   case 0x15:      /* DEC D */
     cycles -= cycleTables[0][0x15];
     DE -= 0x100;
     temp = hreg(DE);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
+    AF = (AF & ~0xfe) | DEC_FLAGS(temp);
     break;
   case 0x16:      /* LD D,nn */
     cycles -= cycleTables[0][0x16];
@@ -424,7 +637,7 @@ int CZ80::Run(int numCycles)
     break;
   case 0x18:      /* JR dd */
     cycles -= cycleTables[0][0x18];
-    pc += (1) ? (signed char) GetBYTE(pc) + 1 : 1;
+    JRC(1);
     break;
   case 0x19:      /* ADD HL,DE */
     cycles -= cycleTables[0][0x19];
@@ -448,19 +661,13 @@ int CZ80::Run(int numCycles)
     cycles -= cycleTables[0][0x1C];
     temp = lreg(DE)+1;
     Setlreg(DE, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
+    AF = (AF & ~0xfe) | INC_FLAGS(temp);
     break;
   case 0x1D:      /* DEC E */
     cycles -= cycleTables[0][0x1D];
     temp = lreg(DE)-1;
     Setlreg(DE, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
+    AF = (AF & ~0xfe) | DEC_FLAGS(temp);
     break;
   case 0x1E:      /* LD E,nn */
     cycles -= cycleTables[0][0x1E];
@@ -475,7 +682,7 @@ int CZ80::Run(int numCycles)
     break;
   case 0x20:      /* JR NZ,dd */
     cycles -= cycleTables[0][0x20];
-    pc += (!TSTFLAG(Z)) ? (signed char) GetBYTE(pc) + 1 : 1;
+    JRC(!TSTFLAG(Z));
     break;
   case 0x21:      /* LD HL,nnnn */
     cycles -= cycleTables[0][0x21];
@@ -496,19 +703,13 @@ int CZ80::Run(int numCycles)
     cycles -= cycleTables[0][0x24];
     HL += 0x100;
     temp = hreg(HL);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
+    AF = (AF & ~0xfe) | INC_FLAGS(temp);
     break;
   case 0x25:      /* DEC H */
     cycles -= cycleTables[0][0x25];
     HL -= 0x100;
     temp = hreg(HL);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
+    AF = (AF & ~0xfe) | DEC_FLAGS(temp);
     break;
   case 0x26:      /* LD H,nn */
     cycles -= cycleTables[0][0x26];
@@ -545,7 +746,7 @@ int CZ80::Run(int numCycles)
     break;
   case 0x28:      /* JR Z,dd */
     cycles -= cycleTables[0][0x28];
-    pc += (TSTFLAG(Z)) ? (signed char) GetBYTE(pc) + 1 : 1;
+    JRC(TSTFLAG(Z));
     break;
   case 0x29:      /* ADD HL,HL */
     cycles -= cycleTables[0][0x29];
@@ -570,19 +771,13 @@ int CZ80::Run(int numCycles)
     cycles -= cycleTables[0][0x2C];
     temp = lreg(HL)+1;
     Setlreg(HL, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
+    AF = (AF & ~0xfe) | INC_FLAGS(temp);
     break;
   case 0x2D:      /* DEC L */
     cycles -= cycleTables[0][0x2D];
     temp = lreg(HL)-1;
     Setlreg(HL, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
+    AF = (AF & ~0xfe) | DEC_FLAGS(temp);
     break;
   case 0x2E:      /* LD L,nn */
     cycles -= cycleTables[0][0x2E];
@@ -594,7 +789,7 @@ int CZ80::Run(int numCycles)
     break;
   case 0x30:      /* JR NC,dd */
     cycles -= cycleTables[0][0x30];
-    pc += (!TSTFLAG(C)) ? (signed char) GetBYTE(pc) + 1 : 1;
+    JRC(!TSTFLAG(C));
     break;
   case 0x31:      /* LD SP,nnnn */
     cycles -= cycleTables[0][0x31];
@@ -615,19 +810,13 @@ int CZ80::Run(int numCycles)
     cycles -= cycleTables[0][0x34];
     temp = GetBYTE(HL)+1;
     PutBYTE(HL, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
+    AF = (AF & ~0xfe) | INC_FLAGS(temp);
     break;
   case 0x35:      /* DEC (HL) */
     cycles -= cycleTables[0][0x35];
     temp = GetBYTE(HL)-1;
     PutBYTE(HL, temp);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
+    AF = (AF & ~0xfe) | DEC_FLAGS(temp);
     break;
   case 0x36:      /* LD (HL),nn */
     cycles -= cycleTables[0][0x36];
@@ -639,7 +828,7 @@ int CZ80::Run(int numCycles)
     break;
   case 0x38:      /* JR C,dd */
     cycles -= cycleTables[0][0x38];
-    pc += (TSTFLAG(C)) ? (signed char) GetBYTE(pc) + 1 : 1;
+    JRC(TSTFLAG(C));
     break;
   case 0x39:      /* ADD HL,SP */
     cycles -= cycleTables[0][0x39];
@@ -665,19 +854,13 @@ int CZ80::Run(int numCycles)
     cycles -= cycleTables[0][0x3C];
     AF += 0x100;
     temp = hreg(AF);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0) << 4) |
-      ((temp == 0x80) << 2);
+    AF = (AF & ~0xfe) | INC_FLAGS(temp);
     break;
   case 0x3D:      /* DEC A */
     cycles -= cycleTables[0][0x3D];
     AF -= 0x100;
     temp = hreg(AF);
-    AF = (AF & ~0xfe) | (temp & 0xa8) |
-      (((temp & 0xff) == 0) << 6) |
-      (((temp & 0xf) == 0xf) << 4) |
-      ((temp == 0x7f) << 2) | 2;
+    AF = (AF & ~0xfe) | DEC_FLAGS(temp);
     break;
   case 0x3E:      /* LD A,nn */
     cycles -= cycleTables[0][0x3E];
@@ -905,8 +1088,8 @@ int CZ80::Run(int numCycles)
     break;
   case 0x76:      /* HALT */
     cycles -= cycleTables[0][0x76];
-//    ErrorLog("Z80 encountered an unemulated instruction at 0x%04X", (pc-1)&0xFFFF);
-    goto HALTExit;
+    halted = true;
+    break;
   case 0x77:      /* LD (HL),A */
     cycles -= cycleTables[0][0x77];
     PutBYTE(HL, hreg(AF));
@@ -949,10 +1132,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x81:      /* ADD A,C */
     cycles -= cycleTables[0][0x81];
@@ -960,10 +1140,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x82:      /* ADD A,D */
     cycles -= cycleTables[0][0x82];
@@ -971,10 +1148,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x83:      /* ADD A,E */
     cycles -= cycleTables[0][0x83];
@@ -982,10 +1156,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x84:      /* ADD A,H */
     cycles -= cycleTables[0][0x84];
@@ -993,10 +1164,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x85:      /* ADD A,L */
     cycles -= cycleTables[0][0x85];
@@ -1004,10 +1172,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x86:      /* ADD A,(HL) */
     cycles -= cycleTables[0][0x86];
@@ -1015,10 +1180,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x87:      /* ADD A,A */
     cycles -= cycleTables[0][0x87];
@@ -1026,10 +1188,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x88:      /* ADC A,B */
     cycles -= cycleTables[0][0x88];
@@ -1037,10 +1196,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x89:      /* ADC A,C */
     cycles -= cycleTables[0][0x89];
@@ -1048,10 +1204,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x8A:      /* ADC A,D */
     cycles -= cycleTables[0][0x8A];
@@ -1059,10 +1212,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x8B:      /* ADC A,E */
     cycles -= cycleTables[0][0x8B];
@@ -1070,10 +1220,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x8C:      /* ADC A,H */
     cycles -= cycleTables[0][0x8C];
@@ -1081,10 +1228,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x8D:      /* ADC A,L */
     cycles -= cycleTables[0][0x8D];
@@ -1092,10 +1236,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x8E:      /* ADC A,(HL) */
     cycles -= cycleTables[0][0x8E];
@@ -1103,10 +1244,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x8F:      /* ADC A,A */
     cycles -= cycleTables[0][0x8F];
@@ -1114,10 +1252,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0x90:      /* SUB B */
     cycles -= cycleTables[0][0x90];
@@ -1125,10 +1260,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x91:      /* SUB C */
     cycles -= cycleTables[0][0x91];
@@ -1136,10 +1268,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x92:      /* SUB D */
     cycles -= cycleTables[0][0x92];
@@ -1147,10 +1276,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x93:      /* SUB E */
     cycles -= cycleTables[0][0x93];
@@ -1158,10 +1284,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x94:      /* SUB H */
     cycles -= cycleTables[0][0x94];
@@ -1169,10 +1292,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x95:      /* SUB L */
     cycles -= cycleTables[0][0x95];
@@ -1180,10 +1300,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x96:      /* SUB (HL) */
     cycles -= cycleTables[0][0x96];
@@ -1191,10 +1308,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x97:      /* SUB A */
     cycles -= cycleTables[0][0x97];
@@ -1202,10 +1316,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x98:      /* SBC A,B */
     cycles -= cycleTables[0][0x98];
@@ -1213,10 +1324,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x99:      /* SBC A,C */
     cycles -= cycleTables[0][0x99];
@@ -1224,10 +1332,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x9A:      /* SBC A,D */
     cycles -= cycleTables[0][0x9A];
@@ -1235,10 +1340,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x9B:      /* SBC A,E */
     cycles -= cycleTables[0][0x9B];
@@ -1246,10 +1348,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x9C:      /* SBC A,H */
     cycles -= cycleTables[0][0x9C];
@@ -1257,10 +1356,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x9D:      /* SBC A,L */
     cycles -= cycleTables[0][0x9D];
@@ -1268,10 +1364,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x9E:      /* SBC A,(HL) */
     cycles -= cycleTables[0][0x9E];
@@ -1279,10 +1372,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0x9F:      /* SBC A,A */
     cycles -= cycleTables[0][0x9F];
@@ -1290,138 +1380,127 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xA0:      /* AND B */
     cycles -= cycleTables[0][0xA0];
     sum = ((AF & (BC)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) |
-      ((sum == 0) << 6) | 0x10 | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xA1:      /* AND C */
     cycles -= cycleTables[0][0xA1];
     sum = ((AF >> 8) & BC) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xA2:      /* AND D */
     cycles -= cycleTables[0][0xA2];
     sum = ((AF & (DE)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) |
-      ((sum == 0) << 6) | 0x10 | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xA3:      /* AND E */
     cycles -= cycleTables[0][0xA3];
     sum = ((AF >> 8) & DE) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xA4:      /* AND H */
     cycles -= cycleTables[0][0xA4];
     sum = ((AF & (HL)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) |
-      ((sum == 0) << 6) | 0x10 | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xA5:      /* AND L */
     cycles -= cycleTables[0][0xA5];
     sum = ((AF >> 8) & HL) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xA6:      /* AND (HL) */
     cycles -= cycleTables[0][0xA6];
     sum = ((AF >> 8) & GetBYTE(HL)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xA7:      /* AND A */
     cycles -= cycleTables[0][0xA7];
     sum = ((AF & (AF)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) |
-      ((sum == 0) << 6) | 0x10 | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xA8:      /* XOR B */
     cycles -= cycleTables[0][0xA8];
     sum = ((AF ^ (BC)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xA9:      /* XOR C */
     cycles -= cycleTables[0][0xA9];
     sum = ((AF >> 8) ^ BC) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xAA:      /* XOR D */
     cycles -= cycleTables[0][0xAA];
     sum = ((AF ^ (DE)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xAB:      /* XOR E */
     cycles -= cycleTables[0][0xAB];
     sum = ((AF >> 8) ^ DE) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xAC:      /* XOR H */
     cycles -= cycleTables[0][0xAC];
     sum = ((AF ^ (HL)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xAD:      /* XOR L */
     cycles -= cycleTables[0][0xAD];
     sum = ((AF >> 8) ^ HL) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xAE:      /* XOR (HL) */
     cycles -= cycleTables[0][0xAE];
     sum = ((AF >> 8) ^ GetBYTE(HL)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xAF:      /* XOR A */
     cycles -= cycleTables[0][0xAF];
     sum = ((AF ^ (AF)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB0:      /* OR B */
     cycles -= cycleTables[0][0xB0];
     sum = ((AF | (BC)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB1:      /* OR C */
     cycles -= cycleTables[0][0xB1];
     sum = ((AF >> 8) | BC) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB2:      /* OR D */
     cycles -= cycleTables[0][0xB2];
     sum = ((AF | (DE)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB3:      /* OR E */
     cycles -= cycleTables[0][0xB3];
     sum = ((AF >> 8) | DE) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB4:      /* OR H */
     cycles -= cycleTables[0][0xB4];
     sum = ((AF | (HL)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB5:      /* OR L */
     cycles -= cycleTables[0][0xB5];
     sum = ((AF >> 8) | HL) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB6:      /* OR (HL) */
     cycles -= cycleTables[0][0xB6];
     sum = ((AF >> 8) | GetBYTE(HL)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB7:      /* OR A */
     cycles -= cycleTables[0][0xB7];
     sum = ((AF | (AF)) >> 8) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xB8:      /* CP B */
     cycles -= cycleTables[0][0xB8];
@@ -1430,10 +1509,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xB9:      /* CP C */
     cycles -= cycleTables[0][0xB9];
@@ -1442,10 +1518,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xBA:      /* CP D */
     cycles -= cycleTables[0][0xBA];
@@ -1454,10 +1527,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xBB:      /* CP E */
     cycles -= cycleTables[0][0xBB];
@@ -1466,10 +1536,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xBC:      /* CP H */
     cycles -= cycleTables[0][0xBC];
@@ -1478,10 +1545,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xBD:      /* CP L */
     cycles -= cycleTables[0][0xBD];
@@ -1490,10 +1554,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xBE:      /* CP (HL) */
     cycles -= cycleTables[0][0xBE];
@@ -1502,10 +1563,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xBF:      /* CP A */
     cycles -= cycleTables[0][0xBF];
@@ -1514,10 +1572,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xC0:      /* RET NZ */
     cycles -= cycleTables[0][0xC0];
@@ -1533,7 +1588,9 @@ int CZ80::Run(int numCycles)
     break;
   case 0xC3:      /* JP nnnn */
     cycles -= cycleTables[0][0xC3];
+    adr = pc - 1;
     Jpc(1);
+    SkipIdleLoop(adr, cycles);
     break;
   case 0xC4:      /* CALL NZ,nnnn */
     cycles -= cycleTables[0][0xC4];
@@ -1549,10 +1606,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0xC7:      /* RST 0 */
     cycles -= cycleTables[0][0xC7];
@@ -1666,10 +1720,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu + temp + TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
     break;
   case 0xCF:      /* RST 8 */
     cycles -= cycleTables[0][0xCF];
@@ -1705,10 +1756,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xD7:      /* RST 10H */
     cycles -= cycleTables[0][0xD7];
@@ -1782,19 +1830,13 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[3][0x24];
       IX += 0x100;
       temp = hreg(IX);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | INC_FLAGS(temp);
       break;
     case 0x25:      /* DEC IXH */
       cycles -= cycleTables[3][0x25];
       IX -= 0x100;
       temp = hreg(IX);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | DEC_FLAGS(temp);
       break;
     case 0x26:      /* LD IXH,nn */
       cycles -= cycleTables[3][0x26];
@@ -1823,19 +1865,13 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[3][0x2C];
       temp = lreg(IX)+1;
       Setlreg(IX, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | INC_FLAGS(temp);
       break;
     case 0x2D:      /* DEC IXL */
       cycles -= cycleTables[3][0x2D];
       temp = lreg(IX)-1;
       Setlreg(IX, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | DEC_FLAGS(temp);
       break;
     case 0x2E:      /* LD IXL,nn */
       cycles -= cycleTables[3][0x2E];
@@ -1846,20 +1882,14 @@ int CZ80::Run(int numCycles)
       adr = IX + (signed char) GetBYTE_pp(pc);
       temp = GetBYTE(adr)+1;
       PutBYTE(adr, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | INC_FLAGS(temp);
       break;
     case 0x35:      /* DEC (IX+dd) */
       cycles -= cycleTables[3][0x35];
       adr = IX + (signed char) GetBYTE_pp(pc);
       temp = GetBYTE(adr)-1;
       PutBYTE(adr, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | DEC_FLAGS(temp);
       break;
     case 0x36:      /* LD (IX+dd),nn */
       cycles -= cycleTables[3][0x36];
@@ -2048,10 +2078,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x85:      /* ADD A,IXL */
       cycles -= cycleTables[3][0x85];
@@ -2059,10 +2086,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x86:      /* ADD A,(IX+dd) */
       cycles -= cycleTables[3][0x86];
@@ -2071,10 +2095,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x8C:      /* ADC A,IXH */
       cycles -= cycleTables[3][0x8C];
@@ -2082,10 +2103,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x8D:      /* ADC A,IXL */
       cycles -= cycleTables[3][0x8D];
@@ -2093,10 +2111,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x8E:      /* ADC A,(IX+dd) */
       cycles -= cycleTables[3][0x8E];
@@ -2105,10 +2120,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x94:      /* SUB IXH */
       cycles -= cycleTables[3][0x94];
@@ -2116,10 +2128,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x95:      /* SUB IXL */
       cycles -= cycleTables[3][0x95];
@@ -2127,10 +2136,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x96:      /* SUB (IX+dd) */
       cycles -= cycleTables[3][0x96];
@@ -2139,10 +2145,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x9C:      /* SBC A,IXH */
       cycles -= cycleTables[3][0x9C];
@@ -2150,10 +2153,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x9D:      /* SBC A,IXL */
       cycles -= cycleTables[3][0x9D];
@@ -2161,10 +2161,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x9E:      /* SBC A,(IX+dd) */
       cycles -= cycleTables[3][0x9E];
@@ -2173,61 +2170,55 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0xA4:      /* AND IXH */
       cycles -= cycleTables[3][0xA4];
       sum = ((AF & (IX)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) |
-        ((sum == 0) << 6) | 0x10 | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
       break;
     case 0xA5:      /* AND IXL */
       cycles -= cycleTables[3][0xA5];
       sum = ((AF >> 8) & IX) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-        ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
       break;
     case 0xA6:      /* AND (IX+dd) */
       cycles -= cycleTables[3][0xA6];
       adr = IX + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) & GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-        ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
       break;
     case 0xAC:      /* XOR IXH */
       cycles -= cycleTables[3][0xAC];
       sum = ((AF ^ (IX)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xAD:      /* XOR IXL */
       cycles -= cycleTables[3][0xAD];
       sum = ((AF >> 8) ^ IX) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xAE:      /* XOR (IX+dd) */
       cycles -= cycleTables[3][0xAE];
       adr = IX + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) ^ GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xB4:      /* OR IXH */
       cycles -= cycleTables[3][0xB4];
       sum = ((AF | (IX)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xB5:      /* OR IXL */
       cycles -= cycleTables[3][0xB5];
       sum = ((AF >> 8) | IX) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xB6:      /* OR (IX+dd) */
       cycles -= cycleTables[3][0xB6];
       adr = IX + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) | GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xBC:      /* CP IXH */
       cycles -= cycleTables[3][0xBC];
@@ -2236,10 +2227,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = (AF & ~0xff) | (sum & 0x80) |
-        (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        (cbits & 0x10) | ((cbits >> 8) & 1);
+      AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0xBD:      /* CP IXL */
       cycles -= cycleTables[3][0xBD];
@@ -2248,10 +2236,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = (AF & ~0xff) | (sum & 0x80) |
-        (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        (cbits & 0x10) | ((cbits >> 8) & 1);
+      AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0xBE:      /* CP (IX+dd) */
       cycles -= cycleTables[3][0xBE];
@@ -2261,10 +2246,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = (AF & ~0xff) | (sum & 0x80) |
-        (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        (cbits & 0x10) | ((cbits >> 8) & 1);
+      AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0xCB:      /* CB prefix */
       adr = IX + (signed char) GetBYTE_pp(pc);
@@ -2378,10 +2360,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp - TSTFLAG(C);
     cbits = acu ^ temp ^ sum;
-    AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-      (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      ((cbits >> 8) & 1);
+    AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xDF:      /* RST 18H */
     cycles -= cycleTables[0][0xDF];
@@ -2414,8 +2393,7 @@ int CZ80::Run(int numCycles)
   case 0xE6:      /* AND nn */
     cycles -= cycleTables[0][0xE6];
     sum = ((AF >> 8) & GetBYTE_pp(pc)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-      ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
     break;
   case 0xE7:      /* RST 20H */
     cycles -= cycleTables[0][0xE7];
@@ -2448,9 +2426,7 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[2][0x40];
       temp = INPUT(lreg(BC));
       Sethreg(BC, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        parity(temp);
+      AF = (AF & ~0xfe) | SZP_FLAGS(temp);
       break;
     case 0x41:      /* OUT (C),B */
       cycles -= cycleTables[2][0x41];
@@ -2499,9 +2475,7 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[2][0x48];
       temp = INPUT(lreg(BC));
       Setlreg(BC, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        parity(temp);
+      AF = (AF & ~0xfe) | SZP_FLAGS(temp);
       break;
     case 0x49:      /* OUT (C),C */
       cycles -= cycleTables[2][0x49];
@@ -2538,9 +2512,7 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[2][0x50];
       temp = INPUT(lreg(BC));
       Sethreg(DE, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        parity(temp);
+      AF = (AF & ~0xfe) | SZP_FLAGS(temp);
       break;
     case 0x51:      /* OUT (C),D */
       cycles -= cycleTables[2][0x51];
@@ -2576,9 +2548,7 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[2][0x58];
       temp = INPUT(lreg(BC));
       Setlreg(DE, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        parity(temp);
+      AF = (AF & ~0xfe) | SZP_FLAGS(temp);
       break;
     case 0x59:      /* OUT (C),E */
       cycles -= cycleTables[2][0x59];
@@ -2614,9 +2584,7 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[2][0x60];
       temp = INPUT(lreg(BC));
       Sethreg(HL, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        parity(temp);
+      AF = (AF & ~0xfe) | SZP_FLAGS(temp);
       break;
     case 0x61:      /* OUT (C),H */
       cycles -= cycleTables[2][0x61];
@@ -2645,16 +2613,13 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       PutBYTE(HL, hdig(temp) | (ldig(acu) << 4));
       acu = (acu & 0xf0) | ldig(temp);
-      AF = (acu << 8) | (acu & 0xa8) | (((acu & 0xff) == 0) << 6) |
-        partab[acu] | (AF & 1);
+      AF = (acu << 8) | SZP_FLAGS(acu) | (AF & 1);
       break;
     case 0x68:      /* IN L,(C) */
       cycles -= cycleTables[2][0x68];
       temp = INPUT(lreg(BC));
       Setlreg(HL, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        parity(temp);
+      AF = (AF & ~0xfe) | SZP_FLAGS(temp);
       break;
     case 0x69:      /* OUT (C),L */
       cycles -= cycleTables[2][0x69];
@@ -2683,16 +2648,13 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       PutBYTE(HL, (ldig(temp) << 4) | ldig(acu));
       acu = (acu & 0xf0) | hdig(temp);
-      AF = (acu << 8) | (acu & 0xa8) | (((acu & 0xff) == 0) << 6) |
-        partab[acu] | (AF & 1);
+      AF = (acu << 8) | SZP_FLAGS(acu) | (AF & 1);
       break;
     case 0x70:      /* IN (C) */
       cycles -= cycleTables[2][0x70];
       temp = INPUT(lreg(BC));
       Setlreg(temp, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        parity(temp);
+      AF = (AF & ~0xfe) | SZP_FLAGS(temp);
       break;
     case 0x71:      /* OUT (C),0 */
       cycles -= cycleTables[2][0x71];
@@ -2720,9 +2682,7 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[2][0x78];
       temp = INPUT(lreg(BC));
       Sethreg(AF, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        parity(temp);
+      AF = (AF & ~0xfe) | SZP_FLAGS(temp);
       break;
     case 0x79:      /* OUT (C),A */
       cycles -= cycleTables[2][0x79];
@@ -2916,7 +2876,7 @@ int CZ80::Run(int numCycles)
   case 0xEE:      /* XOR nn */
     cycles -= cycleTables[0][0xEE];
     sum = ((AF >> 8) ^ GetBYTE_pp(pc)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xEF:      /* RST 28H */
     cycles -= cycleTables[0][0xEF];
@@ -2949,7 +2909,7 @@ int CZ80::Run(int numCycles)
   case 0xF6:      /* OR nn */
     cycles -= cycleTables[0][0xF6];
     sum = ((AF >> 8) | GetBYTE_pp(pc)) & 0xff;
-    AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+    AF = (sum << 8) | SZP_FLAGS(sum);
     break;
   case 0xF7:      /* RST 30H */
     cycles -= cycleTables[0][0xF7];
@@ -3017,19 +2977,13 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[3][0x24];
       IY += 0x100;
       temp = hreg(IY);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | INC_FLAGS(temp);
       break;
     case 0x25:      /* DEC IYH */
       cycles -= cycleTables[3][0x25];
       IY -= 0x100;
       temp = hreg(IY);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | DEC_FLAGS(temp);
       break;
     case 0x26:      /* LD IYH,nn */
       cycles -= cycleTables[3][0x26];
@@ -3058,19 +3012,13 @@ int CZ80::Run(int numCycles)
       cycles -= cycleTables[3][0x2C];
       temp = lreg(IY)+1;
       Setlreg(IY, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | INC_FLAGS(temp);
       break;
     case 0x2D:      /* DEC IYL */
       cycles -= cycleTables[3][0x2D];
       temp = lreg(IY)-1;
       Setlreg(IY, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | DEC_FLAGS(temp);
       break;
     case 0x2E:      /* LD IYL,nn */
       cycles -= cycleTables[3][0x2E];
@@ -3081,20 +3029,14 @@ int CZ80::Run(int numCycles)
       adr = IY + (signed char) GetBYTE_pp(pc);
       temp = GetBYTE(adr)+1;
       PutBYTE(adr, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0) << 4) |
-        ((temp == 0x80) << 2);
+      AF = (AF & ~0xfe) | INC_FLAGS(temp);
       break;
     case 0x35:      /* DEC (IY+dd) */
       cycles -= cycleTables[3][0x35];
       adr = IY + (signed char) GetBYTE_pp(pc);
       temp = GetBYTE(adr)-1;
       PutBYTE(adr, temp);
-      AF = (AF & ~0xfe) | (temp & 0xa8) |
-        (((temp & 0xff) == 0) << 6) |
-        (((temp & 0xf) == 0xf) << 4) |
-        ((temp == 0x7f) << 2) | 2;
+      AF = (AF & ~0xfe) | DEC_FLAGS(temp);
       break;
     case 0x36:      /* LD (IY+dd),nn */
       cycles -= cycleTables[3][0x36];
@@ -3283,10 +3225,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x85:      /* ADD A,IYL */
       cycles -= cycleTables[3][0x85];
@@ -3294,10 +3233,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x86:      /* ADD A,(IY+dd) */
       cycles -= cycleTables[3][0x86];
@@ -3306,10 +3242,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x8C:      /* ADC A,IYH */
       cycles -= cycleTables[3][0x8C];
@@ -3317,10 +3250,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x8D:      /* ADC A,IYL */
       cycles -= cycleTables[3][0x8D];
@@ -3328,10 +3258,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x8E:      /* ADC A,(IY+dd) */
       cycles -= cycleTables[3][0x8E];
@@ -3340,10 +3267,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu + temp + TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits);
       break;
     case 0x94:      /* SUB IYH */
       cycles -= cycleTables[3][0x94];
@@ -3351,10 +3275,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x95:      /* SUB IYL */
       cycles -= cycleTables[3][0x95];
@@ -3362,10 +3283,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x96:      /* SUB (IY+dd) */
       cycles -= cycleTables[3][0x96];
@@ -3374,10 +3292,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x9C:      /* SBC A,IYH */
       cycles -= cycleTables[3][0x9C];
@@ -3385,10 +3300,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x9D:      /* SBC A,IYL */
       cycles -= cycleTables[3][0x9D];
@@ -3396,10 +3308,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0x9E:      /* SBC A,(IY+dd) */
       cycles -= cycleTables[3][0x9E];
@@ -3408,61 +3317,55 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp - TSTFLAG(C);
       cbits = acu ^ temp ^ sum;
-      AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-        (((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        ((cbits >> 8) & 1);
+      AF = ((sum & 0xff) << 8) | SZ_FLAGS(sum) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0xA4:      /* AND IYH */
       cycles -= cycleTables[3][0xA4];
       sum = ((AF & (IY)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) |
-        ((sum == 0) << 6) | 0x10 | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
       break;
     case 0xA5:      /* AND IYL */
       cycles -= cycleTables[3][0xA5];
       sum = ((AF >> 8) & IY) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-        ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
       break;
     case 0xA6:      /* AND (IY+dd) */
       cycles -= cycleTables[3][0xA6];
       adr = IY + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) & GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-        ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum) | 0x10;
       break;
     case 0xAC:      /* XOR IYH */
       cycles -= cycleTables[3][0xAC];
       sum = ((AF ^ (IY)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xAD:      /* XOR IYL */
       cycles -= cycleTables[3][0xAD];
       sum = ((AF >> 8) ^ IY) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xAE:      /* XOR (IY+dd) */
       cycles -= cycleTables[3][0xAE];
       adr = IY + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) ^ GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xB4:      /* OR IYH */
       cycles -= cycleTables[3][0xB4];
       sum = ((AF | (IY)) >> 8) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xB5:      /* OR IYL */
       cycles -= cycleTables[3][0xB5];
       sum = ((AF >> 8) | IY) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xB6:      /* OR (IY+dd) */
       cycles -= cycleTables[3][0xB6];
       adr = IY + (signed char) GetBYTE_pp(pc);
       sum = ((AF >> 8) | GetBYTE(adr)) & 0xff;
-      AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+      AF = (sum << 8) | SZP_FLAGS(sum);
       break;
     case 0xBC:      /* CP IYH */
       cycles -= cycleTables[3][0xBC];
@@ -3471,10 +3374,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = (AF & ~0xff) | (sum & 0x80) |
-        (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        (cbits & 0x10) | ((cbits >> 8) & 1);
+      AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0xBD:      /* CP IYL */
       cycles -= cycleTables[3][0xBD];
@@ -3483,10 +3383,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = (AF & ~0xff) | (sum & 0x80) |
-        (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        (cbits & 0x10) | ((cbits >> 8) & 1);
+      AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0xBE:      /* CP (IY+dd) */
       cycles -= cycleTables[3][0xBE];
@@ -3496,10 +3393,7 @@ int CZ80::Run(int numCycles)
       acu = hreg(AF);
       sum = acu - temp;
       cbits = acu ^ temp ^ sum;
-      AF = (AF & ~0xff) | (sum & 0x80) |
-        (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-        (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-        (cbits & 0x10) | ((cbits >> 8) & 1);
+      AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
       break;
     case 0xCB:      /* CB prefix */
       adr = IY + (signed char) GetBYTE_pp(pc);
@@ -3614,10 +3508,7 @@ int CZ80::Run(int numCycles)
     acu = hreg(AF);
     sum = acu - temp;
     cbits = acu ^ temp ^ sum;
-    AF = (AF & ~0xff) | (sum & 0x80) |
-      (((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-      (((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-      (cbits & 0x10) | ((cbits >> 8) & 1);
+    AF = (AF & ~0xff) | (SZ_FLAGS(sum) & 0xc0) | (temp & 0x28) | CBITS_FLAGS(cbits) | 2;
     break;
   case 0xFF:      /* RST 38H */
     cycles -= cycleTables[0][0xFF];
@@ -3626,7 +3517,7 @@ int CZ80::Run(int numCycles)
     }
     
   // Interrupts
-    
+Interrupts:
     if (nmiTrigger)   // NMI triggered (higher priority than INT)
     {     
       /*
@@ -3649,7 +3540,8 @@ int CZ80::Run(int numCycles)
       iff = (iff&~2) | ((iff&1)<<1);
       iff &= ~1;
       nmiTrigger = false; // clear NMI
-      // TODO: if in HALTed state, un-halt
+      halted = false;
+      idleLoopBranch = -1;
     }
     else if (intLine) // INT asserted
     {
@@ -3670,7 +3562,8 @@ int CZ80::Run(int numCycles)
          * the interrupt line is cleared. Otherwise, callbacks are
          * responsible for clearing the lines themselves.
          */
-        // TODO: if in HALTed state, un-halt
+        halted = false;
+        idleLoopBranch = -1;
         switch (im) // interrupt mode (0, 1, or 2 only!)
         {
         case 0:
@@ -3769,14 +3662,7 @@ int CZ80::Run(int numCycles)
   } // end while
 
   // write registers back to context
-HALTExit: 
-#ifdef SUPERMODEL_DEBUGGER
-  if (Debug != NULL)
-  {
-    Debug->CPUInactive();
-    lastCycles -= cycles;
-  }
-#else
+#ifndef SUPERMODEL_DEBUGGER
   // Save local copies of Z80 registers back to context
   af[af_sel] = AF;
     regs[regs_sel].bc = BC;
@@ -3791,6 +3677,58 @@ HALTExit:
     return numCycles - cycles;
 }
 
+int CZ80::Run(int numCycles)
+{
+  bool hooked = Trace != NULL;
+#ifdef SUPERMODEL_DEBUGGER
+  if (Debug != NULL)
+  {
+    Debug->CPUActive();
+    debugHooked = Debug->IsHooked();
+    Bus = debugHooked ? DebugBus : DirectBus;
+    hooked = hooked || debugHooked;
+  }
+#endif // SUPERMODEL_DEBUGGER
+  if (!hooked)
+  {
+    int doneCycles = RunLoop<false>(numCycles);
+#ifdef SUPERMODEL_DEBUGGER
+    if (Debug != NULL)
+    {
+      Debug->CPURan(doneCycles);
+      Debug->CPUInactive();
+    }
+#endif // SUPERMODEL_DEBUGGER
+    return doneCycles;
+  }
+
+  // Cycles since the last hooked instruction carry over between time slices
+#ifdef SUPERMODEL_DEBUGGER
+  if (debugHooked)
+    lastCycles += numCycles;
+#endif // SUPERMODEL_DEBUGGER
+  traceCycles += numCycles;
+  int doneCycles = RunLoop<true>(numCycles);
+  traceCycles -= numCycles - doneCycles;
+#ifdef SUPERMODEL_DEBUGGER
+  if (debugHooked)
+    lastCycles -= numCycles - doneCycles;
+  if (Debug != NULL)
+  {
+    if (!debugHooked)
+      Debug->CPURan(doneCycles);
+    Debug->CPUInactive();
+  }
+#endif // SUPERMODEL_DEBUGGER
+  return doneCycles;
+}
+
+void CZ80::SetTrace(CExecTrace *TracePtr)
+{
+  Trace = TracePtr;
+  traceCycles = 0;
+}
+
 void CZ80::TriggerNMI(void)
 {
   nmiTrigger = true;
@@ -3913,6 +3851,8 @@ void CZ80::Reset(void)
   
   intLine     = false;
   nmiTrigger  = false;
+  halted      = false;
+  lastNonIdleBranch = 0xFFFF;
 #ifdef SUPERMODEL_DEBUGGER
   lastCycles  = 0;
 #endif // SUPERMODEL_DEBUGGER
@@ -3941,6 +3881,7 @@ void CZ80::SaveState(CBlockFile *StateFile, const char *name)
   StateFile->Write(&af_sel, sizeof(af_sel));
   StateFile->Write(&nmiTrigger, sizeof(nmiTrigger));
   StateFile->Write(&intLine, sizeof(intLine));
+  StateFile->Write(&halted, sizeof(halted));
 }
 
 void CZ80::LoadState(CBlockFile *StateFile, const char *name)
@@ -3970,6 +3911,7 @@ void CZ80::LoadState(CBlockFile *StateFile, const char *name)
   StateFile->Read(&af_sel, sizeof(af_sel));
   StateFile->Read(&nmiTrigger, sizeof(nmiTrigger));
   StateFile->Read(&intLine, sizeof(intLine));
+  StateFile->Read(&halted, sizeof(halted));
 }
 
 void CZ80::Init(IBus *BusPtr, int (*INTF)(CZ80 *Z80))
@@ -3984,7 +3926,9 @@ void CZ80::AttachDebugger(Debugger::CZ80Debug *DebugPtr)
   if (Debug != NULL)
     DetachDebugger();
   Debug = DebugPtr;
-  Bus = Debug->AttachBus(Bus);
+  DirectBus = Bus;
+  DebugBus = Debug->AttachBus(Bus);
+  Bus = DebugBus;
 }
 
 void CZ80::DetachDebugger()
@@ -3993,15 +3937,31 @@ void CZ80::DetachDebugger()
     return;
   Bus = Debug->DetachBus();
   Debug = NULL;
+  DebugBus = NULL;
+  DirectBus = NULL;
+  debugHooked = false;
 }
 #endif //SUPERMODEL_DEBUGGER
 
+UINT64 CZ80::GetIdleCycles(void)
+{
+  return idleCycles;
+}
+
 CZ80::CZ80(void)
 {
   INTCallback = NULL; // so we can later check to see if one has been installed
   Bus = NULL;
+  halted = false;
+  lastNonIdleBranch = 0xFFFF;
+  idleCycles = 0;
+  Trace = NULL;
+  traceCycles = 0;
 #ifdef SUPERMODEL_DEBUGGER
   Debug = NULL;
+  DebugBus = NULL;
+  DirectBus = NULL;
+  debugHooked = false;
 #endif //SUPERMODEL_DEBUGGER
 }
 
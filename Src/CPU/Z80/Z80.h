@@ -35,7 +35,8 @@
  *    should take care to immediately clear the interrupt line, otherwise,
  *    an improperly timed interrupt may occur right after an EI instruction
  *    but before the service routine has a chance to return.
- *  - HALT instruction is not implemented (it just exits).
+ *  - The halted state is not saved. A state saved while halted resumes at
+ *    the instruction following HALT.
  *  - 16-bit words are read as two bytes but these reads may not occur in
  *    the exact same order as the real device. Needs to be checked.
  */
@@ -104,6 +105,8 @@ namespace Debugger {
 }
 #endif // SUPERMODEL_DEBUGGER
 
+class CExecTrace;
+
 /*
  * CZ80:
  *
@@ -122,8 +125,21 @@ public:
    *
    * Returns:
    *    Number of instruction cycles actually executed.
+   *
+   * Time spent halted, or spinning in a loop that can only be left by an
+   * interrupt, is skipped rather than executed instruction by instruction
+   * (see GetIdleCycles()). Results are the same either way.
    */
   int Run(int numCycles);
+
+  /*
+   * GetIdleCycles(void):
+   *
+   * Returns:
+   *    Total number of cycles skipped by Run() while halted or waiting in an
+   *    idle loop, since the CPU was created.
+   */
+  UINT64 GetIdleCycles(void);
   
   /*
    * TriggerNMI(void):
@@ -279,6 +295,14 @@ public:
    */
   void Init(IBus *BusPtr, int (*INTF)(CZ80 *Z80));
 
+  /*
+   * SetTrace(TracePtr):
+   *
+   * Records each instruction executed from now on in the given trace, or
+   * stops recording if it is NULL.
+   */
+  void SetTrace(CExecTrace *TracePtr);
+
 #ifdef SUPERMODEL_DEBUGGER
   /*
    * AttachDebugger(DebugPtr):
@@ -328,11 +352,30 @@ private:
   // Interrupts
   bool  nmiTrigger;
   bool  intLine;
+  bool  halted;     // HALT executed, waiting for an interrupt
   int   (*INTCallback)(CZ80 *Z80);
 
+  // Idle loop detection
+  UINT64  idleCycles;         // cycles skipped since creation
+  UINT16  lastNonIdleBranch;  // last backward jump found not to make an idle loop
+  int     idleLoopBranch;     // idle loop whose last iteration ran uninterrupted (-1 if none)
+  int   IdleLoopCycles(UINT16 start, UINT16 branch);
+  void  SkipIdleLoop(UINT16 branch, int &cycles);
+
+  // Instruction loop, with or without the debugger and trace hooks
+  template <bool Hooked>
+  int   RunLoop(int numCycles);
+
+  // Instruction trace
+  CExecTrace  *Trace;
+  int         traceCycles;  // cycles at the last recorded instruction
+
 #ifdef SUPERMODEL_DEBUGGER
   int   lastCycles;
+  bool  debugHooked;  // debugger checks each instruction in this time slice
   Debugger::CZ80Debug *Debug;
+  IBus  *DebugBus;  // debugger's bus, used by the hooked loop
+  IBus  *DirectBus; // bus it wraps, used otherwise
 #endif // SUPERMODEL_DEBUGGER
 };
 
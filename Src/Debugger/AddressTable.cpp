@@ -38,9 +38,9 @@ namespace Debugger
 		//
 	}
 		
-	CAddressTable::CAddressTable() : m_count(0)
+	CAddressTable::CAddressTable()
 	{
-		memset(m_tables, NULL, sizeof(m_tables));
+		memset(m_pageBits, 0, sizeof(m_pageBits));
 	}
 
 	CAddressTable::~CAddressTable()
@@ -48,99 +48,58 @@ namespace Debugger
 		Clear();
 	}
 
-	CAddressRef **CAddressTable::GetTableCreate(UINT32 addr, int &tableIndex, unsigned &indexInTable)
-	{
-		// Convert address to table index
-		tableIndex = addr >> INDEX_SHIFT;
-		// See if have a table at index
-		if (m_tables[tableIndex] == NULL)
-		{
-			// If not, create one now and increase count
-			m_tables[tableIndex] = new CAddressRef*[TABLE_SIZE];
-			memset(m_tables[tableIndex], NULL, sizeof(CAddressRef*) * TABLE_SIZE);
-			m_count++;
-		}
-		// Calculate index within table
-		indexInTable = addr & TABLE_MASK;
-		return m_tables[tableIndex];
-	}
-		
-	void CAddressTable::CheckAndReleaseTable(int tableIndex)
-	{
-		// See if have table at give index
-		CAddressRef **table = m_tables[tableIndex];
-		if (table == NULL)
-			return;
-		// If so, check if it is empty
-		for (int i = 0; i < TABLE_SIZE; i++)
-		{
-			if (table[i] != NULL)
-				return;
-		}
-		// If so, delete it and decrease count
-		delete[] table;
-		m_tables[tableIndex] = NULL;
-		m_count--;
-	}
-
 	bool CAddressTable::IsEmpty()
 	{
-		return m_count == 0;
+		return m_refs.empty();
 	} 
 
 	void CAddressTable::Clear()
 	{
-		if (m_count == 0)
+		if (m_refs.empty())
 			return;
-		// Delete all tables and reset count
-		for (int i = 0; i < NUM_TABLES; i++)
-		{
-			if (m_tables[i] != NULL)
-			{
-				delete[] m_tables[i];
-				m_tables[i] = NULL;
-			}
-		}
-		m_count = 0;
+		// Unmark only the pages that were in use
+		for (std::unordered_map<UINT32, unsigned>::iterator it = m_pageCounts.begin(); it != m_pageCounts.end(); it++)
+			m_pageBits[it->first >> 5] &= ~(1U << (it->first & 31));
+		m_pageCounts.clear();
+		m_refs.clear();
 	}
 
 	void CAddressTable::Add(CAddressRef *value)
 	{
-		int tableIndex;
-		unsigned indexInTable;
-		CAddressRef **table = GetTableCreate(value->addr, tableIndex, indexInTable);
-		for (UINT32 i = 0; i < value->size; i++)
+		UINT32 addr = value->addr;
+		for (UINT32 i = 0; i < value->size; i++, addr++)
 		{
-			table[indexInTable] = value;
-			if (indexInTable >= TABLE_SIZE - 1)
-				table = GetTableCreate(value->addr + i, tableIndex, indexInTable);
-			else
-				indexInTable++;
+			// Count address against its page if not already referenced and mark the page
+			std::pair<std::unordered_map<UINT32, CAddressRef*>::iterator, bool> res = m_refs.insert(std::make_pair(addr, value));
+			if (!res.second)
+			{
+				res.first->second = value;
+				continue;
+			}
+			UINT32 page = addr >> ADDR_PAGE_WIDTH;
+			m_pageCounts[page]++;
+			m_pageBits[page >> 5] |= 1U << (page & 31);
 		}
 	}
 
 	bool CAddressTable::Remove(CAddressRef *value)
 	{
-		int tableIndex;
-		unsigned indexInTable;
-		CAddressRef **table = GetTableNoCreate(value->addr, tableIndex, indexInTable);
+		UINT32 addr = value->addr;
 		bool removed = false;
-		for (UINT32 i = 0; i < value->size; i++)
+		for (UINT32 i = 0; i < value->size; i++, addr++)
 		{
-			if (table != NULL)
-			{
-				removed |= table[indexInTable] != NULL;
-				table[indexInTable] = NULL;
-			}
-			if (indexInTable >= TABLE_SIZE - 1)
+			if (m_refs.erase(addr) == 0)
+				continue;
+			removed = true;
+			// Unmark page once it holds no more references
+			UINT32 page = addr >> ADDR_PAGE_WIDTH;
+			std::unordered_map<UINT32, unsigned>::iterator it = m_pageCounts.find(page);
+			if (--it->second == 0)
 			{
-				CheckAndReleaseTable(tableIndex);
-				table = GetTableNoCreate(value->addr + i, tableIndex, indexInTable);
+				m_pageCounts.erase(it);
+				m_pageBits[page >> 5] &= ~(1U << (page & 31));
 			}
-			else
-				indexInTable++;
 		}
-		CheckAndReleaseTable(tableIndex);
 		return removed;
 	}
 }
@@ -31,12 +31,12 @@
 
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
 
-#define TABLE_WIDTH 16
-#define TABLE_SIZE (1 << TABLE_WIDTH)
-#define TABLE_MASK (TABLE_SIZE - 1)
-#define INDEX_SHIFT TABLE_WIDTH
-#define NUM_TABLES (0x100000000ULL / TABLE_SIZE)
+#define ADDR_PAGE_WIDTH 12
+#define ADDR_PAGE_SIZE (1 << ADDR_PAGE_WIDTH)
+#define ADDR_PAGE_MASK (ADDR_PAGE_SIZE - 1)
+#define NUM_ADDR_PAGES (0x100000000ULL / ADDR_PAGE_SIZE)
 
 namespace Debugger
 {
@@ -62,20 +62,19 @@ namespace Debugger
 	};
 
 	/*
-	 * Class that holds a table of address references.  It does so in an a memory-expensive manner but with the result that it 
-	 * performs better (hopefully!) as lookups are constant-time.
+	 * Class that holds a table of address references.  A bitmap marks the pages that hold any reference, so that looking up an
+	 * address in any other page costs a single bit test.  Addresses in marked pages are then looked up in a hash map.
 	 */
 	class CAddressTable
 	{
 	private:
-		int m_count;
-		CAddressRef **m_tables[NUM_TABLES];
+		UINT32 m_pageBits[NUM_ADDR_PAGES / 32];
+		std::unordered_map<UINT32, unsigned> m_pageCounts;
+		std::unordered_map<UINT32, CAddressRef*> m_refs;
 
-		CAddressRef **GetTableNoCreate(UINT32 addr, int &tableIndex, unsigned &indexInTable);
+		bool IsPageMarked(UINT32 addr);
 
-		CAddressRef **GetTableCreate(UINT32 addr, int &tableIndex, unsigned &indexInTable);
-		
-		void CheckAndReleaseTable(int tableIndex);
+		CAddressRef *GetMarked(UINT32 addr);
 
 	public:
 		CAddressTable();
@@ -104,48 +103,45 @@ namespace Debugger
 		return addr <= loc && loc <= addrEnd;
 	}
 
-	inline CAddressRef **CAddressTable::GetTableNoCreate(UINT32 addr, int &tableIndex, unsigned &indexInTable)
+	inline bool CAddressTable::IsPageMarked(UINT32 addr)
 	{
-		tableIndex = addr >> INDEX_SHIFT;
-		if (m_tables[tableIndex] == NULL)
-			return NULL;
-		indexInTable = addr & TABLE_MASK;
-		return m_tables[tableIndex];
+		UINT32 page = addr >> ADDR_PAGE_WIDTH;
+		return (m_pageBits[page >> 5] & (1U << (page & 31))) != 0;
+	}
+
+	inline CAddressRef *CAddressTable::GetMarked(UINT32 addr)
+	{
+		std::unordered_map<UINT32, CAddressRef*>::const_iterator it = m_refs.find(addr);
+		return it != m_refs.end() ? it->second : NULL;
 	}
 
 	inline CAddressRef *CAddressTable::Get(UINT32 addr)
 	{
-		int tableIndex;
-		unsigned indexInTable;
-		CAddressRef **table = GetTableNoCreate(addr, tableIndex, indexInTable);
-		if (table == NULL)
+		if (!IsPageMarked(addr))
 			return NULL;
-		return table[indexInTable];
+		return GetMarked(addr);
 	}
 
 	inline CAddressRef *CAddressTable::Get(UINT32 addr, UINT32 size)
 	{
-		int tableIndex;
-		unsigned indexInTable;
-		CAddressRef **table = GetTableNoCreate(addr, tableIndex, indexInTable);
-		for (UINT32 i = 0; i < size; i++)
+		UINT32 i = 0;
+		while (i < size)
 		{
-			if (table != NULL)
-			{
-				CAddressRef *ref = table[indexInTable];
-				if (ref != NULL)
-					return ref;
-				addr++;
-				if (indexInTable >= TABLE_SIZE - 1)
-					table = GetTableNoCreate(addr, tableIndex, indexInTable);
-				else
-					indexInTable++;
-			}
-			else
+			if (!IsPageMarked(addr))
 			{
-				addr++;
-				table = GetTableNoCreate(addr, tableIndex, indexInTable);
+				// Skip rest of page
+				UINT32 left = ADDR_PAGE_SIZE - (addr & ADDR_PAGE_MASK);
+				if (left >= size - i)
+					return NULL;
+				i += left;
+				addr += left;
+				continue;
 			}
+			CAddressRef *ref = GetMarked(addr);
+			if (ref != NULL)
+				return ref;
+			i++;
+			addr++;
 		}
 		return NULL;
 	}
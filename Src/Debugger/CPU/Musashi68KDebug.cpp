@@ -51,7 +51,7 @@ namespace Debugger
 	static const char *drGroup = "Data Registers";
 	static const char *arGroup = "Address Regsters";
 
-	CMusashi68KDebug::CMusashi68KDebug(const char *name, M68KCtx *ctx) : C68KDebug(name), m_ctx(ctx), m_resetAddr(0)
+	CMusashi68KDebug::CMusashi68KDebug(const char *name, M68KCtx *ctx) : C68KDebug(name), m_ctx(ctx), m_resetAddr(0), m_savedCtx(NULL)
 	{
 		// Special registers
 		AddPCRegister      ("PC", srGroup);
@@ -96,6 +96,8 @@ namespace Debugger
 		m_ctx->Debug = this;
 		m_bus = m_ctx->Bus;
 		m_ctx->Bus = this;
+		m_ctx->DirectBus = m_bus;
+		m_ctx->DebugHooked = true;
 
 		// Reset address is held at 0x000004
 		m_resetAddr = m_bus->Read32(0x000004);
@@ -108,6 +110,8 @@ namespace Debugger
 		m_ctx->Bus = m_bus;
 		m_bus = NULL;
 		m_ctx->Debug = NULL;
+		m_ctx->DirectBus = NULL;
+		m_ctx->DebugHooked = false;
 	}
 
 	UINT32 CMusashi68KDebug::GetResetAddr()
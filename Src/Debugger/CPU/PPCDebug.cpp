@@ -112,7 +112,7 @@ namespace Debugger
 	static const char *grGroup = "GPR Registers";
 	static const char *frGroup = "FPR Registers";
 
-	CPPCDebug::CPPCDebug(const char *name) : CCPUDebug("PPC", name, 4, 4, true, 32, 7), m_irqState(0)
+	CPPCDebug::CPPCDebug(const char *name) : CCPUDebug("PPC", name, 4, 4, true, 32, 7), m_ppc(::ppc_get_context()), m_irqState(0)
 	{
 		// PC & Link registers
 		AddPCRegister  ("pc", srGroup);
@@ -172,6 +172,7 @@ namespace Debugger
 
 	void CPPCDebug::AttachToCPU()
 	{
+		::ppc_set_context(m_ppc);
 		::ppc_attach_debugger(this);
 	}
 
@@ -183,6 +184,7 @@ namespace Debugger
 
 	void CPPCDebug::DetachFromCPU()
 	{
+		::ppc_set_context(m_ppc);
 		::ppc_detach_debugger();
 	}
 
@@ -322,6 +324,20 @@ namespace Debugger
 			return -4;
 	}
 
+	int CPPCDebug::GetOpLength(UINT32 addr)
+	{
+		// Only need to know whether instruction is valid, not format its operands
+		char mnemonic[255];
+		char operands[255];
+		return (::DisassemblePowerPC(m_bus->Read32(addr), addr, mnemonic, operands, true) ? -4 : 4);
+	}
+
+	bool CPPCDebug::IsDecodeReentrant()
+	{
+		// Disassembler is stateless and code regions are plain memory
+		return true;
+	}
+
 	EOpFlags CPPCDebug::GetOpFlags(UINT32 addr, UINT32 opcode)
 	{
 		EOpFlags opFlags;
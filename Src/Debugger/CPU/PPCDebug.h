@@ -35,6 +35,8 @@
 #define PPCSPECIAL_FPSCR 1
 #define PPCSPECIAL_MSR 2
 
+struct PPC_CONTEXT;
+
 namespace Debugger
 {
 	/*
@@ -48,6 +50,7 @@ namespace Debugger
 		char m_fprNames[32][4];
 
 		::IBus *m_bus;
+		::PPC_CONTEXT *m_ppc;	// context active when the debugger was created
 
 		UINT8 m_irqState;
 
@@ -81,6 +84,10 @@ namespace Debugger
 		bool WriteMem(UINT32 addr, unsigned dataSize, UINT64 data);
 
 		int Disassemble(UINT32 addr, char *mnemonic, char *operands);
+
+		int GetOpLength(UINT32 addr);
+
+		bool IsDecodeReentrant();
 		
 		EOpFlags GetOpFlags(UINT32 addr, UINT32 opcode);
 
@@ -1641,6 +1641,12 @@ namespace Debugger
 		return Disassemble(addr, mnemonic, operands);
 	}
 
+	bool CCPUDebug::IsDecodeReentrant()
+	{
+		// Disassemblers generally keep state of their own, so by default analyse code on one thread
+		return false;
+	}
+
 	UINT32 CCPUDebug::GetOpcode(UINT32 addr)
 	{
 		return (UINT32)ReadMem(addr, min<int>(4, minInstrLen));
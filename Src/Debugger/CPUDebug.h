@@ -365,6 +365,18 @@ namespace Debugger
 		 */
 		bool CPUExecute(UINT32 newPC, UINT32 newOpcode, UINT32 lastCycles);
 
+		/*
+		 * Returns true if the CPU must run with its debugging hooks, ie call CPUExecute before every instruction and send
+		 * memory and I/O accesses through the debugger.  Otherwise, no breakpoint, watch, monitor or step can trigger and 
+		 * the CPU may run its fast variant.  Should be checked by the CPU each time it enters its instruction loop.
+		 */
+		bool IsHooked();
+
+		/*
+		 * Should be called by CPU after executing without its debugging hooks, so that the total cycle count stays current.
+		 */
+		void CPURan(UINT32 cycles);
+
 		/*
 		 * Should be called by CPU whenever a CPU exception is raised (and before the exception handler is executed).
 		 */
@@ -593,6 +605,9 @@ namespace Debugger
 
 		virtual int GetOpLength(UINT32 addr);
 
+		// Returns true if GetOpLength, GetOpcode, GetOpFlags and GetJumpAddr may be called from several threads at once (for code analysis)
+		virtual bool IsDecodeReentrant();
+
 		// Returns head (no more than 32-bits or min instr length) of full opcode for use with following methods
 		virtual UINT32 GetOpcode(UINT32 addr);
 
@@ -874,6 +889,17 @@ namespace Debugger
 		}
 	}
 	
+	inline bool CCPUDebug::IsHooked()
+	{
+		// Execution masks only let every address through untested when there is nothing to check
+		return m_execAndMask != 0xFFFFFFFF || m_execOrMask != 0xFFFFFFFF || memWatches.size() > 0 || ioWatches.size() > 0;
+	}
+
+	inline void CCPUDebug::CPURan(UINT32 cycles)
+	{
+		totalCycles += cycles;
+	}
+
 	inline bool CCPUDebug::CheckExecute(UINT32 newPC, UINT32 newOpcode, UINT32 lastCycles)
 	{
 		// Check not just updating state
@@ -32,6 +32,16 @@
 #include <cctype>
 #include <string>
 
+#ifdef DEBUGGER_HASBLOCKFILE
+#include <zlib.h>
+#endif // DEBUGGER_HASBLOCKFILE
+
+#ifdef DEBUGGER_HASTHREAD
+#include "Util/JobSystem.h"
+#endif // DEBUGGER_HASTHREAD
+
+#define CODEANALYSIS_CACHE_VERSION 0
+
 using namespace std;
 
 namespace Debugger
@@ -550,17 +560,27 @@ namespace Debugger
 			return false;
 
 		CCodeAnalysis *newAnalysis;
-		if (reanalyse || oldAnalysis == &emptyAnalysis)
+		bool fullAnalysis = reanalyse || oldAnalysis == &emptyAnalysis;
+		if (fullAnalysis)
 			newAnalysis = new CCodeAnalysis(this, totalIndices, entryPoints, unseenEntryAddrs);
 		else
 			newAnalysis = new CCodeAnalysis(oldAnalysis, entryPoints, unseenEntryAddrs);
 		newAnalysis->Acquire();
 
-		for (vector<CEntryPoint>::iterator it = newAnalysis->m_entryPoints.begin(); it != newAnalysis->m_entryPoints.end(); it++)
+#ifdef DEBUGGER_HASBLOCKFILE
+		// Full analysis of code that has been analysed before (eg after attaching or reloading state) is read back from disk
+		UINT32 crc = 0;
+		bool cached = false;
+		if (fullAnalysis)
 		{
-			AddFlagToAddr(newAnalysis->m_autoLabelsMap, it->addr, it->autoFlag, it->autoLabel);
-			AnalyseCode(newAnalysis->m_seenIndices, newAnalysis->m_validIndices, newAnalysis->validIndexSet, newAnalysis->m_autoLabelsMap, it->addr);
+			crc = GetCodeCRC();
+			cached = LoadCachedAnalysis(newAnalysis, crc);
 		}
+		if (!cached)
+			AnalyseCode(newAnalysis);
+#else
+		AnalyseCode(newAnalysis);
+#endif // DEBUGGER_HASBLOCKFILE
 		newAnalysis->FinishAnalysis();
 
 		if (m_abortAnalysis)
@@ -569,6 +589,11 @@ namespace Debugger
 			return false;
 		}
 
+#ifdef DEBUGGER_HASBLOCKFILE
+		if (fullAnalysis && !cached)
+			SaveCachedAnalysis(newAnalysis, crc);
+#endif // DEBUGGER_HASBLOCKFILE
+
 		analysis = newAnalysis;
 		if (oldAnalysis != &emptyAnalysis)
 			oldAnalysis->Release();
@@ -577,41 +602,97 @@ namespace Debugger
 		return true;
 	}
 
-	void CCodeAnalyser::AnalyseCode(vector<bool> &seenIndices, vector<bool> &validIndices, set<unsigned> &validIndexSet,
-		map<UINT32,CAutoLabel*> &autoLabelsMap, UINT32 addr)
+	void CCodeAnalyser::AnalyseCode(CCodeAnalysis *newAnalysis)
 	{
-		if (m_abortAnalysis)
-			return;
+		// Each address index is claimed by the first walk to reach it, so that it is only decoded once
+		vector<atomic<UINT32> > claimed((totalIndices + 31) / 32);
+		for (unsigned index = 0; index < totalIndices; index++)
+		{
+			if (newAnalysis->m_seenIndices[index])
+				claimed[index / 32].fetch_or(1u << (index % 32));
+		}
+
+		vector<UINT32> pending;
+		for (vector<CEntryPoint>::iterator it = newAnalysis->m_entryPoints.begin(); it != newAnalysis->m_entryPoints.end(); it++)
+		{
+			AddFlagToAddr(newAnalysis->m_autoLabelsMap, it->addr, it->autoFlag, it->autoLabel);
+			pending.push_back(it->addr);
+		}
+
+		// Code is followed in rounds: the walks from all addresses found so far (in parallel if the CPU's disassembler allows it),
+		// then the jump destinations they found.  The result does not depend on the order the walks run in.
+		while (!pending.empty() && !m_abortAnalysis)
+		{
+			const size_t walksPerJob = 16;
+			size_t numJobs = 1;
+#ifdef DEBUGGER_HASTHREAD
+			if (cpu->IsDecodeReentrant() && Util::JobSystem::Shared().NumWorkers() > 0)
+				numJobs = (pending.size() + walksPerJob - 1) / walksPerJob;
+#endif // DEBUGGER_HASTHREAD
+			vector<SCodeWalk> walks(numJobs);
+			auto runJob = [&](size_t job)
+			{
+				size_t first = (numJobs == 1 ? 0 : job * walksPerJob);
+				size_t last = (numJobs == 1 ? pending.size() : min(pending.size(), first + walksPerJob));
+				for (size_t i = first; i < last && !m_abortAnalysis; i++)
+					WalkCode(pending[i], claimed.data(), walks[job]);
+			};
+#ifdef DEBUGGER_HASTHREAD
+			if (numJobs > 1)
+				Util::JobSystem::Shared().ParallelFor(numJobs, runJob);
+			else
+				runJob(0);
+#else
+			runJob(0);
+#endif // DEBUGGER_HASTHREAD
+
+			// Merge results and carry on from jump destinations not yet seen
+			pending.clear();
+			for (vector<SCodeWalk>::iterator it = walks.begin(); it != walks.end(); it++)
+			{
+				for (vector<unsigned>::iterator idxIt = it->seenIndices.begin(); idxIt != it->seenIndices.end(); idxIt++)
+					newAnalysis->m_seenIndices[*idxIt] = true;
+				for (vector<unsigned>::iterator idxIt = it->validIndices.begin(); idxIt != it->validIndices.end(); idxIt++)
+				{
+					newAnalysis->m_validIndices[*idxIt] = true;
+					newAnalysis->validIndexSet.insert(*idxIt);
+				}
+				for (vector<pair<UINT32,ELabelFlags> >::iterator jumpIt = it->jumps.begin(); jumpIt != it->jumps.end(); jumpIt++)
+				{
+					AddFlagToAddr(newAnalysis->m_autoLabelsMap, jumpIt->first, jumpIt->second, NULL);
+					unsigned index;
+					if (GetIndexOfAddr(jumpIt->first, index) && !(claimed[index / 32].load() & (1u << (index % 32))))
+						pending.push_back(jumpIt->first);
+				}
+			}
+		}
+	}
 
+	void CCodeAnalyser::WalkCode(UINT32 addr, atomic<UINT32> *claimed, SCodeWalk &walk)
+	{
 		unsigned index;
-		if (!GetIndexOfAddr(addr, index) || seenIndices[index])
+		if (!GetIndexOfAddr(addr, index))
 			return;
 		
 		CRegion *region = cpu->GetRegion(addr);
 		if (region == NULL || !region->isCode)
 			return;
 
-		set<unsigned>::iterator setIt = validIndexSet.end();
-
-		unsigned startIndex = index;
-		do
+		// Stop on reaching an address index that has already been seen
+		while (!(claimed[index / 32].fetch_or(1u << (index % 32)) & (1u << (index % 32))))
 		{
 			if (m_abortAnalysis)
 				return;
 
 			// Flag that have seen this address index
-			seenIndices[index] = true;
+			walk.seenIndices.push_back(index);
 
 			// If unit is not valid (ie doesn't disassemble) then code block must be invalid (TODO - invalidate whole code block?)
 			int codesLen = cpu->GetOpLength(addr);
 			if (codesLen <= 0)
 				return;
 
-			validIndices[index] = true;
-			if (setIt != validIndexSet.end())
-				setIt = validIndexSet.insert(setIt, index);
-			else
-				setIt = validIndexSet.insert(index).first;
+			walk.validIndices.push_back(index);
 			
 			UINT32 opcode = cpu->GetOpcode(addr);
 			EOpFlags opFlags = cpu->GetOpFlags(addr, opcode);
@@ -619,15 +700,14 @@ namespace Debugger
 			// See if instruction is jump
 			if (opFlags & (JumpSimple|JumpLoop|JumpSub))
 			{
-				// If so, see if address is valid (ie known at disassemble time)
+				// If so, see if address is valid (ie known at disassemble time) and if so, record it so that destination code block is
+				// analysed too
 				UINT32 jumpAddr;
 				if (cpu->GetJumpAddr(addr, opcode, jumpAddr))
 				{
-					// If so, add flags to jump address and analyse destination code block too
-					if      (opFlags & JumpSub)  AddFlagToAddr(autoLabelsMap, jumpAddr, LFSubroutine, NULL);
-					else if (opFlags & JumpLoop) AddFlagToAddr(autoLabelsMap, jumpAddr, LFLoopPoint, NULL);
-					else                         AddFlagToAddr(autoLabelsMap, jumpAddr, LFJumpTarget, NULL);
-					AnalyseCode(seenIndices, validIndices, validIndexSet, autoLabelsMap, jumpAddr);
+					if      (opFlags & JumpSub)  walk.jumps.push_back(make_pair(jumpAddr, LFSubroutine));
+					else if (opFlags & JumpLoop) walk.jumps.push_back(make_pair(jumpAddr, LFLoopPoint));
+					else                         walk.jumps.push_back(make_pair(jumpAddr, LFJumpTarget));
 				}
 			}
 
@@ -654,7 +734,6 @@ namespace Debugger
 					return;
 			}
 		}
-		while (!seenIndices[index]);
 	}
 
 	void CCodeAnalyser::AddFlagToAddr(map<UINT32,CAutoLabel*> &autoLabelsMap, UINT32 addr, ELabelFlags flag, const char *subLabel)
@@ -700,6 +779,150 @@ namespace Debugger
 	}
 
 #ifdef DEBUGGER_HASBLOCKFILE
+	UINT32 CCodeAnalyser::GetCodeCRC()
+	{
+		// Analysis depends only on the entry points and the contents of the code regions
+		UINT8 buffer[4096];
+		uLong crc = crc32(0L, Z_NULL, 0);
+		for (vector<CRegion*>::iterator it = m_codeRegions.begin(); it != m_codeRegions.end(); it++)
+		{
+			UINT32 addr = (*it)->addr;
+			unsigned numUnits = (*it)->size / instrAlign;
+			size_t len = 0;
+			for (unsigned i = 0; i < numUnits; i++, addr += instrAlign)
+			{
+				UINT64 data = cpu->ReadMem(addr, instrAlign);
+				for (unsigned j = 0; j < instrAlign; j++)
+					buffer[len++] = (UINT8)(data >> (8 * j));
+				if (len + instrAlign > sizeof(buffer))
+				{
+					crc = crc32(crc, buffer, (uInt)len);
+					len = 0;
+				}
+			}
+			crc = crc32(crc, buffer, (uInt)len);
+		}
+		return (UINT32)crc;
+	}
+
+	void CCodeAnalyser::GetCacheFileName(char *fileName, UINT32 crc)
+	{
+		sprintf(fileName, "Debug/%s-%08X.ca", cpu->name, crc);
+	}
+
+	bool CCodeAnalyser::LoadCachedAnalysis(CCodeAnalysis *newAnalysis, UINT32 crc)
+	{
+		char fileName[255];
+		GetCacheFileName(fileName, crc);
+		CBlockFile cache;
+		if (cache.Load(fileName) != OKAY)
+			return false;
+		if (cache.FindBlock("Code Analysis") != OKAY)
+		{
+			cache.Close();
+			return false;
+		}
+
+		// Check cache was made by same version for same code and entry points
+		UINT32 version, cacheCRC, numIndices, numEntries;
+		bool ok = cache.Read(&version, sizeof(version)) == sizeof(version) && version == CODEANALYSIS_CACHE_VERSION &&
+			cache.Read(&cacheCRC, sizeof(cacheCRC)) == sizeof(cacheCRC) && cacheCRC == crc &&
+			cache.Read(&numIndices, sizeof(numIndices)) == sizeof(numIndices) && numIndices == totalIndices &&
+			cache.Read(&numEntries, sizeof(numEntries)) == sizeof(numEntries) && numEntries == newAnalysis->m_entryPoints.size();
+		for (UINT32 i = 0; ok && i < numEntries; i++)
+		{
+			UINT32 addr, flag;
+			ok = cache.Read(&addr, sizeof(addr)) == sizeof(addr) && cache.Read(&flag, sizeof(flag)) == sizeof(flag) &&
+				addr == newAnalysis->m_entryPoints[i].addr && flag == (UINT32)newAnalysis->m_entryPoints[i].autoFlag;
+		}
+
+		// Read seen and valid address indices as bitmaps, followed by flags of labels found from jumps
+		vector<UINT8> seenBits((totalIndices + 7) / 8);
+		vector<UINT8> validBits((totalIndices + 7) / 8);
+		UINT32 numLabels = 0;
+		ok = ok && cache.Read(seenBits.data(), (UINT32)seenBits.size()) == seenBits.size() &&
+			cache.Read(validBits.data(), (UINT32)validBits.size()) == validBits.size() &&
+			cache.Read(&numLabels, sizeof(numLabels)) == sizeof(numLabels);
+		vector<pair<UINT32,UINT32> > labelFlags(ok ? numLabels : 0);
+		for (UINT32 i = 0; ok && i < numLabels; i++)
+			ok = cache.Read(&labelFlags[i].first, sizeof(UINT32)) == sizeof(UINT32) && cache.Read(&labelFlags[i].second, sizeof(UINT32)) == sizeof(UINT32);
+		cache.Close();
+		if (!ok)
+			return false;
+
+		for (unsigned index = 0; index < totalIndices; index++)
+		{
+			if (seenBits[index / 8] & (1 << (index % 8)))
+				newAnalysis->m_seenIndices[index] = true;
+			if (validBits[index / 8] & (1 << (index % 8)))
+			{
+				newAnalysis->m_validIndices[index] = true;
+				newAnalysis->validIndexSet.insert(newAnalysis->validIndexSet.end(), index);
+			}
+		}
+		for (vector<CEntryPoint>::iterator it = newAnalysis->m_entryPoints.begin(); it != newAnalysis->m_entryPoints.end(); it++)
+			AddFlagToAddr(newAnalysis->m_autoLabelsMap, it->addr, it->autoFlag, it->autoLabel);
+		for (vector<pair<UINT32,UINT32> >::iterator it = labelFlags.begin(); it != labelFlags.end(); it++)
+		{
+			if (it->second & LFJumpTarget) AddFlagToAddr(newAnalysis->m_autoLabelsMap, it->first, LFJumpTarget, NULL);
+			if (it->second & LFLoopPoint)  AddFlagToAddr(newAnalysis->m_autoLabelsMap, it->first, LFLoopPoint, NULL);
+			if (it->second & LFSubroutine) AddFlagToAddr(newAnalysis->m_autoLabelsMap, it->first, LFSubroutine, NULL);
+		}
+		return true;
+	}
+
+	void CCodeAnalyser::SaveCachedAnalysis(CCodeAnalysis *newAnalysis, UINT32 crc)
+	{
+		char fileName[255];
+		GetCacheFileName(fileName, crc);
+		CBlockFile cache;
+		if (cache.Create(fileName, "Code Analysis", __FILE__) != OKAY)
+			return;
+
+		UINT32 version = CODEANALYSIS_CACHE_VERSION;
+		UINT32 numIndices = totalIndices;
+		UINT32 numEntries = (UINT32)newAnalysis->m_entryPoints.size();
+		cache.Write(&version, sizeof(version));
+		cache.Write(&crc, sizeof(crc));
+		cache.Write(&numIndices, sizeof(numIndices));
+		cache.Write(&numEntries, sizeof(numEntries));
+		for (vector<CEntryPoint>::iterator it = newAnalysis->m_entryPoints.begin(); it != newAnalysis->m_entryPoints.end(); it++)
+		{
+			UINT32 flag = (UINT32)it->autoFlag;
+			cache.Write(&it->addr, sizeof(it->addr));
+			cache.Write(&flag, sizeof(flag));
+		}
+
+		vector<UINT8> seenBits((totalIndices + 7) / 8);
+		vector<UINT8> validBits((totalIndices + 7) / 8);
+		for (unsigned index = 0; index < totalIndices; index++)
+		{
+			if (newAnalysis->m_seenIndices[index])
+				seenBits[index / 8] |= 1 << (index % 8);
+			if (newAnalysis->m_validIndices[index])
+				validBits[index / 8] |= 1 << (index % 8);
+		}
+		cache.Write(seenBits.data(), (UINT32)seenBits.size());
+		cache.Write(validBits.data(), (UINT32)validBits.size());
+
+		// Labels from entry points are recreated from those, so only flags found from jumps are needed
+		vector<pair<UINT32,UINT32> > labelFlags;
+		for (map<UINT32,CAutoLabel*>::iterator it = newAnalysis->m_autoLabelsMap.begin(); it != newAnalysis->m_autoLabelsMap.end(); it++)
+		{
+			UINT32 flags = (UINT32)it->second->flags & (LFJumpTarget | LFLoopPoint | LFSubroutine);
+			if (flags != 0)
+				labelFlags.push_back(make_pair(it->first, flags));
+		}
+		UINT32 numLabels = (UINT32)labelFlags.size();
+		cache.Write(&numLabels, sizeof(numLabels));
+		for (vector<pair<UINT32,UINT32> >::iterator it = labelFlags.begin(); it != labelFlags.end(); it++)
+		{
+			cache.Write(&it->first, sizeof(UINT32));
+			cache.Write(&it->second, sizeof(UINT32));
+		}
+		cache.Close();
+	}
+
 	bool CCodeAnalyser::LoadState(CBlockFile *state)
 	{
 		// Load custom entry addresses
@@ -32,6 +32,7 @@
 #include <map>
 #include <set>
 #include <algorithm>
+#include <atomic>
 
 #include "Types.h"
 #include "Debugger.h"
@@ -192,6 +193,14 @@ namespace Debugger
 	class CCodeAnalyser
 	{	
 	private:
+		// Instructions and jumps found by following code from a set of addresses
+		struct SCodeWalk
+		{
+			std::vector<unsigned> seenIndices;
+			std::vector<unsigned> validIndices;
+			std::vector<std::pair<UINT32,ELabelFlags> > jumps;
+		};
+
 		std::vector<CRegion*> m_codeRegions;
 		std::vector<unsigned> m_indexBounds;
 
@@ -206,10 +215,22 @@ namespace Debugger
 
 		void AddEntryPoint(std::vector<CEntryPoint> &entryPoints, UINT32 addr, ELabelFlags autoFlag, const char *autoLabel);
 
-		void AnalyseCode(std::vector<bool> &seenIndices, std::vector<bool> &validIndices, std::set<unsigned> &validIndexSet, std::map<UINT32, CAutoLabel*> &autoLabelsMap, UINT32 addr);
+		void AnalyseCode(CCodeAnalysis *newAnalysis);
+
+		void WalkCode(UINT32 addr, std::atomic<UINT32> *claimed, SCodeWalk &walk);
 
 		void AddFlagToAddr(std::map<UINT32, CAutoLabel*> &autoLabelsMap, UINT32 addr, ELabelFlags autoFlag, const char *autoLabel);
 
+#ifdef DEBUGGER_HASBLOCKFILE
+		UINT32 GetCodeCRC();
+
+		void GetCacheFileName(char *fileName, UINT32 crc);
+
+		bool LoadCachedAnalysis(CCodeAnalysis *newAnalysis, UINT32 crc);
+
+		void SaveCachedAnalysis(CCodeAnalysis *newAnalysis, UINT32 crc);
+#endif // DEBUGGER_HASBLOCKFILE
+
 	public:
 		CCPUDebug *cpu;
 
@@ -17,6 +17,7 @@ struct Game
   std::string pci_bridge;               // overrides default PCI bridge type for stepping (empty string for default)
   uint32_t real3d_pci_id = 0;           // overrides default Real3D PCI ID for stepping (0 for default)
   float real3d_status_bit_set_percent_of_frame = 0; // overrides default status bit timing (0 for default)
+  bool idle_loop_detection = true;      // allows PowerPC idle loops to be skipped (disable for games that misbehave)
   uint32_t encryption_key = 0;
   bool netboard_present;
 
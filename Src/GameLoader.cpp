@@ -1,12 +1,16 @@
 #include "GameLoader.h"
+#include "ROMCache.h"
 #include "OSD/Logger.h"
 #include "Util/NewConfig.h"
 #include "Util/ConfigBuilders.h"
 #include "Util/ByteSwap.h"
 #include "Util/Format.h"
+#include "Util/JobSystem.h"
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <iostream>
+#include <sys/stat.h>
 
 bool GameLoader::LoadZipArchive(ZipArchive *zip, const std::string &zipfilename) const
 {
@@ -28,10 +32,11 @@ bool GameLoader::LoadZipArchive(ZipArchive *zip, const std::string &zipfilename)
     if (UNZ_OK != unzGetCurrentFileInfo(zf, &file_info, filename_buffer, sizeof(filename_buffer), NULL, 0, NULL, 0))
       continue;
     zip->files_by_crc[file_info.crc].zf = zf;
-    zip->files_by_crc[file_info.crc].zipfilename = filename_buffer;
+    zip->files_by_crc[file_info.crc].zipfilename = zipfilename;
     zip->files_by_crc[file_info.crc].filename = filename_buffer;
     zip->files_by_crc[file_info.crc].uncompressed_size = file_info.uncompressed_size;
     zip->files_by_crc[file_info.crc].crc32 = file_info.crc;
+    unzGetFilePos(zf, &zip->files_by_crc[file_info.crc].file_pos);
   }
 
   if (err != UNZ_END_OF_LIST_OF_FILE)
@@ -89,37 +94,87 @@ const GameLoader::ZippedFile *GameLoader::LookupFile(const File::ptr_t &file, co
   return nullptr;
 }
 
-bool GameLoader::LoadZippedFile(std::shared_ptr<uint8_t> *buffer, size_t *file_size, const GameLoader::File::ptr_t &file, const ZipArchive &zip) const
+// We need to preserve the absolute offsets in order for byte swapping to work
+// properly when chunk size is 1
+static inline void CopyBytes(uint8_t *dest_base, uint32_t dest_offset, const uint8_t *src_base, uint32_t src_offset, uint32_t size, uint32_t byte_swap)
+{
+  for (uint32_t i = 0; i < size; i++)
+  {
+    dest_base[(dest_offset + i) ^ byte_swap] = src_base[src_offset + i];
+  }
+}
+
+// Files are inflated a piece at a time straight into the region, interleaved
+// and byte swapped as they go. Each is read through a handle of its own, so
+// that several can be read at once.
+bool GameLoader::LoadZippedFile(uint8_t *dest, const GameLoader::File::ptr_t &file, const GameLoader::Region::ptr_t &region, const ZipArchive &zip) const
 {
+  static const uint32_t PIECE_SIZE = 0x10000;
+
   // Locate file
   const ZippedFile *zipped_file = LookupFile(file, zip);
   if (!zipped_file)
     return true;
-  if (UNZ_OK != unzLocateFile(zipped_file->zf, zipped_file->filename.c_str(), 2))
+  unzFile zf = unzOpen(zipped_file->zipfilename.c_str());
+  unz_file_pos file_pos = zipped_file->file_pos;
+  if (NULL == zf || UNZ_OK != unzGoToFilePos(zf, &file_pos))
   {
     ErrorLog("Unable to locate '%s' in '%s'. Is zip file corrupt?", zipped_file->filename.c_str(), zipped_file->zipfilename.c_str());
+    if (zf != NULL)
+      unzClose(zf);
     return true;
   }
 
   // Read it in
-  if (UNZ_OK != unzOpenCurrentFile(zipped_file->zf))
+  if (UNZ_OK != unzOpenCurrentFile(zf))
   {
     ErrorLog("Unable to read '%s' from '%s'. Is zip file corrupt?", zipped_file->filename.c_str(), zipped_file->zipfilename.c_str());
+    unzClose(zf);
     return true;
   }
-  *file_size = zipped_file->uncompressed_size;
-  buffer->reset(new uint8_t[*file_size], std::default_delete<uint8_t[]>());
-  size_t bytes_read = (size_t) unzReadCurrentFile(zipped_file->zf, buffer->get(), *file_size);
-  if (bytes_read != *file_size)
+  uint32_t file_size = (uint32_t)zipped_file->uncompressed_size;
+  uint32_t chunk_size = (uint32_t)region->chunk_size;  // cache these as pointer dereferencing cripples performance in a tight loop
+  uint32_t stride = (uint32_t)region->stride;
+  uint32_t byte_swap = region->byte_swap;
+  bool contiguous = chunk_size == stride;
+  std::vector<uint8_t> piece(contiguous ? 0 : PIECE_SIZE);
+  bool error = false;
+  for (uint32_t pos = 0; pos < file_size && !error; pos += PIECE_SIZE)
+  {
+    uint32_t size = std::min(PIECE_SIZE, file_size - pos);
+    if (contiguous)
+    {
+      // Straight to its place, then swapped there (PIECE_SIZE is even)
+      uint8_t *piece_dest = dest + file->offset + pos;
+      error = (uint32_t)unzReadCurrentFile(zf, piece_dest, size) != size;
+      if (!error && byte_swap)
+        Util::FlipEndian16(piece_dest, size);
+    }
+    else
+    {
+      error = (uint32_t)unzReadCurrentFile(zf, piece.data(), size) != size;
+      for (uint32_t i = 0; i < size && !error; )
+      {
+        uint32_t chunk = (pos + i) / chunk_size;
+        uint32_t within = (pos + i) % chunk_size;
+        uint32_t n = std::min(chunk_size - within, size - i);
+        CopyBytes(dest, file->offset + chunk * stride + within, piece.data(), i, n, byte_swap);
+        i += n;
+      }
+    }
+  }
+  if (error)
   {
     ErrorLog("Unable to read '%s' from '%s'. Is zip file corrupt?", zipped_file->filename.c_str(), zipped_file->zipfilename.c_str());
-    unzCloseCurrentFile(zipped_file->zf);
+    unzCloseCurrentFile(zf);
+    unzClose(zf);
     return true;
   }
 
   // And close it
-  if (UNZ_CRCERROR == unzCloseCurrentFile(zipped_file->zf))
+  if (UNZ_CRCERROR == unzCloseCurrentFile(zf))
     ErrorLog("CRC error reading '%s' from '%s'. File may be corrupt.", zipped_file->filename.c_str(), zipped_file->zipfilename.c_str());
+  unzClose(zf);
   return false;
 }
 
@@ -201,6 +256,7 @@ static void PopulateGameInfo(Game *game, const Util::Config::Node &game_node)
   game->pci_bridge = game_node["hardware/pci_bridge"].ValueAsDefault<std::string>("");
   game->real3d_pci_id = game_node["hardware/real3d_pci_id"].ValueAsDefault<uint32_t>(0);
   game->real3d_status_bit_set_percent_of_frame = game_node["hardware/real3d_status_bit_set_percent_of_frame"].ValueAsDefault<float>(0);
+  game->idle_loop_detection = game_node["hardware/idle_loop_detection"].ValueAsDefault<bool>(true);
   game->encryption_key = game_node["hardware/encryption_key"].ValueAsDefault<uint32_t>(0);
   game->netboard_present = game_node["hardware/netboard"].ValueAsDefault<bool>(false);
 
@@ -475,16 +531,328 @@ bool GameLoader::ParseXML(const Util::Config::Node &xml)
   return error;
 }
 
+std::string StripFilename(const std::string &filepath)
+{
+  // Search for last '/' or '\', if any
+  size_t last_slash = std::string::npos;
+  for (size_t i = filepath.length() - 1; i < filepath.length(); i--)
+  {
+    if (filepath[i] == '/' || filepath[i] =='\\')
+    {
+      last_slash = i;
+      break;
+    }
+  }
+
+  // If none found, there is directory component here
+  if (last_slash == std::string::npos)
+    return "";
+
+  // Otherwise, strip everything after the slash
+  return std::string(filepath, 0, last_slash + 1);
+}
+
+/*
+ * Definition cache: the games, regions, files, and patches as parsed from the
+ * XML, so that it need not be parsed again until it changes. In host byte
+ * order:
+ *
+ *    magic         "SMGDBC01"
+ *    xml_size      uint64
+ *    xml_mtime     int64
+ *    num_games     uint32
+ *      game        Game fields, strings as uint32 length and characters
+ *      num_regions uint32
+ *        region    name, stride, chunk size, byte swap, required
+ *        num_files uint32
+ *          file    offset, filename, crc32, has_crc32
+ *      num_patched uint32
+ *        region    name
+ *        num       uint32
+ *          patch   offset, value, bits
+ *
+ * Child sets are merged with their parents after loading, as after parsing.
+ */
+
+static const char DEFINITION_CACHE_MAGIC[8] = { 'S', 'M', 'G', 'D', 'B', 'C', '0', '1' };
+
+namespace
+{
+  struct DefinitionReader
+  {
+    const uint8_t *pos;
+    const uint8_t *end;
+    bool error = false;
+
+    template <typename T>
+    T Get()
+    {
+      T value = T();
+      if (size_t(end - pos) < sizeof(T))
+        error = true;
+      else
+      {
+        memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+      }
+      return value;
+    }
+
+    std::string GetString()
+    {
+      uint32_t length = Get<uint32_t>();
+      if (error || size_t(end - pos) < length)
+      {
+        error = true;
+        return std::string();
+      }
+      std::string s((const char *) pos, length);
+      pos += length;
+      return s;
+    }
+  };
+
+  struct DefinitionWriter
+  {
+    std::vector<uint8_t> data;
+
+    template <typename T>
+    void Put(T value)
+    {
+      const uint8_t *p = (const uint8_t *) &value;
+      data.insert(data.end(), p, p + sizeof(T));
+    }
+
+    void PutString(const std::string &s)
+    {
+      Put<uint32_t>(uint32_t(s.length()));
+      data.insert(data.end(), s.begin(), s.end());
+    }
+  };
+}
+
+static bool StatXML(uint64_t *size, int64_t *mtime, const std::string &filename)
+{
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    return true;
+  *size = uint64_t(st.st_size);
+  *mtime = int64_t(st.st_mtime);
+  return false;
+}
+
+bool GameLoader::LoadDefinitionCache(const std::string &cache_file)
+{
+  FILE *fp = fopen(cache_file.c_str(), "rb");
+  if (!fp)
+    return true;
+  std::vector<uint8_t> data;
+  uint8_t buf[0x10000];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    data.insert(data.end(), buf, buf + n);
+  fclose(fp);
+
+  uint64_t xml_size;
+  int64_t xml_mtime;
+  if (data.size() < sizeof(DEFINITION_CACHE_MAGIC) || memcmp(data.data(), DEFINITION_CACHE_MAGIC, sizeof(DEFINITION_CACHE_MAGIC)) ||
+      StatXML(&xml_size, &xml_mtime, m_xml_filename))
+    return true;
+  DefinitionReader in = { data.data() + sizeof(DEFINITION_CACHE_MAGIC), data.data() + data.size() };
+  if (in.Get<uint64_t>() != xml_size || in.Get<int64_t>() != xml_mtime)
+  {
+    InfoLog("Game definition cache '%s' is out of date.", cache_file.c_str());
+    return true;
+  }
+
+  std::map<std::string, Game> game_info_by_game;
+  std::map<std::string, PatchesByRegion_t> patches_by_game;
+  std::map<std::string, RegionsByName_t> regions_by_game;
+  uint32_t num_games = in.Get<uint32_t>();
+  for (uint32_t i = 0; i < num_games && !in.error; i++)
+  {
+    Game game;
+    game.name = in.GetString();
+    game.parent = in.GetString();
+    game.title = in.GetString();
+    game.version = in.GetString();
+    game.manufacturer = in.GetString();
+    game.year = in.Get<uint32_t>();
+    game.stepping = in.GetString();
+    game.mpeg_board = in.GetString();
+    game.pci_bridge = in.GetString();
+    game.real3d_pci_id = in.Get<uint32_t>();
+    game.real3d_status_bit_set_percent_of_frame = in.Get<float>();
+    game.idle_loop_detection = in.Get<uint8_t>() != 0;
+    game.encryption_key = in.Get<uint32_t>();
+    game.netboard_present = in.Get<uint8_t>() != 0;
+    game.inputs = in.Get<uint32_t>();
+    game.driveboard_type = Game::DriveBoardType(in.Get<uint32_t>());
+
+    RegionsByName_t &regions_by_name = regions_by_game[game.name];
+    uint32_t num_regions = in.Get<uint32_t>();
+    for (uint32_t j = 0; j < num_regions && !in.error; j++)
+    {
+      Region::ptr_t region = std::make_shared<Region>();
+      region->region_name = in.GetString();
+      region->stride = size_t(in.Get<uint64_t>());
+      region->chunk_size = size_t(in.Get<uint64_t>());
+      region->byte_swap = in.Get<uint8_t>() != 0;
+      region->required = in.Get<uint8_t>() != 0;
+      uint32_t num_files = in.Get<uint32_t>();
+      for (uint32_t k = 0; k < num_files && !in.error; k++)
+      {
+        File::ptr_t file = std::make_shared<File>();
+        file->offset = in.Get<uint32_t>();
+        file->filename = in.GetString();
+        file->crc32 = in.Get<uint32_t>();
+        file->has_crc32 = in.Get<uint8_t>() != 0;
+        region->files.push_back(file);
+      }
+      regions_by_name[region->region_name] = region;
+    }
+
+    PatchesByRegion_t &patches_by_region = patches_by_game[game.name];
+    uint32_t num_patched = in.Get<uint32_t>();
+    for (uint32_t j = 0; j < num_patched && !in.error; j++)
+    {
+      auto &patches = patches_by_region[in.GetString()];
+      uint32_t num_patches = in.Get<uint32_t>();
+      for (uint32_t k = 0; k < num_patches && !in.error; k++)
+      {
+        uint32_t offset = in.Get<uint32_t>();
+        uint64_t value = in.Get<uint64_t>();
+        unsigned bits = in.Get<uint32_t>();
+        patches.push_back(ROM::BigEndianPatch(offset, value, bits));
+      }
+    }
+
+    game_info_by_game[game.name] = game;
+  }
+  if (in.error || in.pos != in.end || game_info_by_game.empty())
+  {
+    InfoLog("Game definition cache '%s' is corrupt.", cache_file.c_str());
+    return true;
+  }
+
+  m_game_info_by_game = std::move(game_info_by_game);
+  m_patches_by_game = std::move(patches_by_game);
+  m_regions_by_game = std::move(regions_by_game);
+  m_regions_by_merged_game.clear();
+  return MergeChildrenWithParents();
+}
+
+void GameLoader::SaveDefinitionCache(const std::string &cache_file) const
+{
+  uint64_t xml_size;
+  int64_t xml_mtime;
+  if (StatXML(&xml_size, &xml_mtime, m_xml_filename))
+    return;
+
+  DefinitionWriter out;
+  out.data.assign(DEFINITION_CACHE_MAGIC, DEFINITION_CACHE_MAGIC + sizeof(DEFINITION_CACHE_MAGIC));
+  out.Put<uint64_t>(xml_size);
+  out.Put<int64_t>(xml_mtime);
+  out.Put<uint32_t>(uint32_t(m_game_info_by_game.size()));
+  for (auto &v: m_game_info_by_game)
+  {
+    const Game &game = v.second;
+    out.PutString(game.name);
+    out.PutString(game.parent);
+    out.PutString(game.title);
+    out.PutString(game.version);
+    out.PutString(game.manufacturer);
+    out.Put<uint32_t>(game.year);
+    out.PutString(game.stepping);
+    out.PutString(game.mpeg_board);
+    out.PutString(game.pci_bridge);
+    out.Put<uint32_t>(game.real3d_pci_id);
+    out.Put<float>(game.real3d_status_bit_set_percent_of_frame);
+    out.Put<uint8_t>(game.idle_loop_detection);
+    out.Put<uint32_t>(game.encryption_key);
+    out.Put<uint8_t>(game.netboard_present);
+    out.Put<uint32_t>(game.inputs);
+    out.Put<uint32_t>(uint32_t(game.driveboard_type));
+
+    auto &regions_by_name = m_regions_by_game.find(v.first)->second;
+    out.Put<uint32_t>(uint32_t(regions_by_name.size()));
+    for (auto &v2: regions_by_name)
+    {
+      const Region &region = *v2.second;
+      out.PutString(region.region_name);
+      out.Put<uint64_t>(region.stride);
+      out.Put<uint64_t>(region.chunk_size);
+      out.Put<uint8_t>(region.byte_swap);
+      out.Put<uint8_t>(region.required);
+      out.Put<uint32_t>(uint32_t(region.files.size()));
+      for (auto &file: region.files)
+      {
+        out.Put<uint32_t>(file->offset);
+        out.PutString(file->filename);
+        out.Put<uint32_t>(file->crc32);
+        out.Put<uint8_t>(file->has_crc32);
+      }
+    }
+
+    auto &patches_by_region = m_patches_by_game.find(v.first)->second;
+    out.Put<uint32_t>(uint32_t(patches_by_region.size()));
+    for (auto &v2: patches_by_region)
+    {
+      out.PutString(v2.first);
+      out.Put<uint32_t>(uint32_t(v2.second.size()));
+      for (auto &patch: v2.second)
+      {
+        out.Put<uint32_t>(patch.offset);
+        out.Put<uint64_t>(patch.value);
+        out.Put<uint32_t>(patch.bits);
+      }
+    }
+  }
+
+  // Written under another name first, so the cache is never seen half written
+  std::string temp_file = cache_file + ".tmp";
+  FILE *fp = fopen(temp_file.c_str(), "wb");
+  if (!fp)
+    return;
+  bool error = fwrite(out.data.data(), out.data.size(), 1, fp) != 1;
+  error |= fclose(fp) != 0;
+  remove(cache_file.c_str());
+  if (error || rename(temp_file.c_str(), cache_file.c_str()) != 0)
+  {
+    remove(temp_file.c_str());
+    ErrorLog("Unable to write game definition cache '%s'.", cache_file.c_str());
+  }
+}
+
 bool GameLoader::LoadDefinitionXML(const std::string &filename)
 {
   m_xml_filename = filename;
+
+  // The parsed definitions are kept in the cache directory alongside the ROMs
+  // and used for as long as the XML file is unchanged
+  std::string cache_file;
+  if (!m_cache_directory.empty())
+  {
+    char last = m_cache_directory.back();
+    cache_file = m_cache_directory + (last == '/' || last == '\\' ? "" : "/") + filename.substr(StripFilename(filename).length()) + ".cache";
+    if (!LoadDefinitionCache(cache_file))
+      return false;
+    m_game_info_by_game.clear();
+    m_patches_by_game.clear();
+    m_regions_by_game.clear();
+    m_regions_by_merged_game.clear();
+  }
+
   Util::Config::Node xml("xml");
   if (Util::Config::FromXMLFile(&xml, filename))
   {
     ErrorLog("Game and ROM set definitions could not be loaded! ROMs will not be detected.");
     return true;
   }
-  return ParseXML(xml);
+  bool error = ParseXML(xml);
+  if (!error && !cache_file.empty())
+    SaveDefinitionCache(cache_file);
+  return error;
 }
 
 void GameLoader::FindEquivalentFiles(std::set<File::ptr_t> *equivalent_files, const std::set<File::ptr_t> &a, const std::set<File::ptr_t> &b)
@@ -713,54 +1081,6 @@ bool GameLoader::ComputeRegionSize(uint32_t *region_size, const GameLoader::Regi
   return error;
 }
 
-// We need to preserve the absolute offsets in order for byte swapping to work
-// properly when chunk size is 1
-static inline void CopyBytes(uint8_t *dest_base, uint32_t dest_offset, const uint8_t *src_base, uint32_t src_offset, uint32_t size, uint32_t byte_swap)
-{
-  for (uint32_t i = 0; i < size; i++)
-  {
-    dest_base[(dest_offset + i) ^ byte_swap] = src_base[src_offset + i];
-  }
-}
-
-bool GameLoader::LoadRegion(ROM *rom, const GameLoader::Region::ptr_t &region, const ZipArchive &zip) const
-{
-  bool error = false;
-  for (auto &file: region->files)
-  {
-    std::shared_ptr<uint8_t> tmp;
-    size_t file_size;
-    error |= LoadZippedFile(&tmp, &file_size, file, zip);
-    if (!error)
-    {
-      uint8_t *dest = rom->data.get();
-      uint8_t *src = tmp.get();
-      if (region->chunk_size == region->stride)
-      {
-        memcpy(dest + file->offset, src, file_size);
-        if (region->byte_swap)
-          Util::FlipEndian16(dest + file->offset, file_size);
-      }
-      else
-      {
-        uint32_t num_chunks = (uint32_t)file_size / region->chunk_size;
-        uint32_t dest_offset = file->offset;
-        uint32_t src_offset = 0;
-        uint32_t chunk_size = (uint32_t)region->chunk_size;		// cache these as pointer dereferencing cripples performance in a tight loop
-        uint32_t stride = (uint32_t)region->stride;
-        uint32_t byte_swap = region->byte_swap;
-        for (uint32_t i = 0; i < num_chunks; i++)
-        {
-          CopyBytes(dest, dest_offset, src, src_offset, chunk_size, byte_swap);
-          dest_offset += stride;
-          src_offset += chunk_size;
-        }
-      }
-    }
-  }
-  return error;
-}
-
 bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const ZipArchive &zip) const
 {
   auto it = m_game_info_by_game.find(game_name);
@@ -773,12 +1093,23 @@ bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const Z
   // Load up the ROMs
   auto &regions_by_name = IsChildSet(it->second) ? m_regions_by_merged_game.find(game_name)->second : m_regions_by_game.find(game_name)->second;
   LogROMDefinition(game_name, regions_by_name);
-  bool error = false;
+  auto start = std::chrono::steady_clock::now();
+
+  // Allocate the regions, then load all their files at once
+  struct FileToLoad
+  {
+    uint8_t *dest;
+    const Region::ptr_t *region;
+    const File::ptr_t *file;
+    bool *error;
+  };
+  std::map<std::string, bool> error_by_region;
+  std::vector<FileToLoad> files_to_load;
   for (auto &v: regions_by_name)
   {
     auto &region = v.second;
     uint32_t region_size = 0;
-    bool error_loading_region = false;
+    bool &error_loading_region = error_by_region[region->region_name];
 
     // Attempt to load the region
     if (ComputeRegionSize(&region_size, region, zip))
@@ -789,8 +1120,30 @@ bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const Z
       auto &rom = rom_set->rom_by_region[region->region_name];
       rom.data.reset(new uint8_t[region_size], std::default_delete<uint8_t[]>());
       rom.size = region_size;
-      error_loading_region = LoadRegion(&rom, region, zip);
+      for (auto &file: region->files)
+        files_to_load.push_back({ rom.data.get(), &region, &file, &error_loading_region });
     }
+  }
+
+  // Different files of a region never write the same bytes. Each one's result
+  // is kept apart and merged after, as several may fail at once.
+  std::vector<char> file_errors(files_to_load.size(), 0);
+  Util::JobSystem::Shared().ParallelFor(files_to_load.size(), [&](size_t i)
+  {
+    const FileToLoad &f = files_to_load[i];
+    file_errors[i] = LoadZippedFile(f.dest, *f.file, *f.region, zip);
+  });
+  for (size_t i = 0; i < files_to_load.size(); i++)
+    *files_to_load[i].error |= file_errors[i] != 0;
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  InfoLog("Loaded %zu ROM files in %1.3f seconds.", files_to_load.size(), elapsed.count());
+
+  bool error = false;
+  for (auto &v: regions_by_name)
+  {
+    auto &region = v.second;
+    bool error_loading_region = error_by_region[region->region_name];
 
     if (error_loading_region && !region->required)
     {
@@ -806,6 +1159,12 @@ bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const Z
     }
   }
 
+  AttachPatches(rom_set, game_name, regions_by_name);
+  return error;
+}
+
+void GameLoader::AttachPatches(ROMSet *rom_set, const std::string &game_name, const RegionsByName_t &regions_by_name) const
+{
   // Attach the patches and do some more error checking here
   auto &patches_by_region = m_patches_by_game.find(game_name)->second;
   for (auto &v: patches_by_region)
@@ -817,33 +1176,43 @@ bool GameLoader::LoadROMs(ROMSet *rom_set, const std::string &game_name, const Z
     else if (rom_set->rom_by_region.find(region_name) != rom_set->rom_by_region.end())
       rom_set->rom_by_region[region_name].patches = patches;
   }
-  return error;
 }
 
-std::string StripFilename(const std::string &filepath)
+// The cache holds the regions as they were assembled. Patches are not applied
+// to them but come from the XML, like everything else about the game.
+bool GameLoader::LoadCachedROMs(Game *game, ROMSet *rom_set, const std::string &cache_file, const std::string &zipfilename) const
 {
-  // Search for last '/' or '\', if any
-  size_t last_slash = std::string::npos;
-  for (size_t i = filepath.length() - 1; i < filepath.length(); i--)
-  {
-    if (filepath[i] == '/' || filepath[i] =='\\')
-    {
-      last_slash = i;
-      break;
-    }
-  }
-
-  // If none found, there is directory component here
-  if (last_slash == std::string::npos)
-    return "";
+  std::string game_name;
+  ROMSet cached_rom_set;
+  if (ROMCache::Load(&game_name, &cached_rom_set, cache_file, { zipfilename, m_xml_filename }))
+    return true;
+  auto it = m_game_info_by_game.find(game_name);
+  if (it == m_game_info_by_game.end())
+    return true;
 
-  // Otherwise, strip everything after the slash
-  return std::string(filepath, 0, last_slash + 1);
+  *game = it->second;
+  *rom_set = std::move(cached_rom_set);
+  auto &regions_by_name = IsChildSet(it->second) ? m_regions_by_merged_game.find(game_name)->second : m_regions_by_game.find(game_name)->second;
+  AttachPatches(rom_set, game_name, regions_by_name);
+  InfoLog("Loaded '%s' from ROM cache '%s'.", game_name.c_str(), cache_file.c_str());
+  return false;
 }
 
 bool GameLoader::Load(Game *game, ROMSet *rom_set, const std::string &zipfilename) const
 {
   *game = Game();
+  Choice choice;
+  if (Choose(&choice, zipfilename) || Load(rom_set, choice))
+    return true;
+  *game = choice.game;
+  return false;
+}
+
+// Picks the game to load, from the zip directory alone, so that its
+// configuration can be worked out while its ROMs are being read
+bool GameLoader::Choose(Choice *choice, const std::string &zipfilename) const
+{
+  *choice = Choice();
 
   // Read the zip contents
   ZipArchive zip;
@@ -858,10 +1227,42 @@ bool GameLoader::Load(Game *game, ROMSet *rom_set, const std::string &zipfilenam
     return true;
 
   // Return game information to caller
-  *game = m_game_info_by_game.find(chosen_game)->second;
+  choice->game = m_game_info_by_game.find(chosen_game)->second;
+  choice->zipfilename = zipfilename;
+  choice->missing_parent_roms = missing_parent_roms;
+  return false;
+}
+
+bool GameLoader::Load(ROMSet *rom_set, const Choice &choice) const
+{
+  const Game *game = &choice.game;
+  const std::string &zipfilename = choice.zipfilename;
+
+  // A cached copy of the ROMs, if still good, saves decompressing the zip
+  // archives at all
+  std::string cache_file;
+  if (!m_cache_directory.empty())
+  {
+    std::string name = zipfilename.substr(StripFilename(zipfilename).length());
+    name = name.substr(0, name.find_last_of('.'));
+    char last = m_cache_directory.back();
+    cache_file = m_cache_directory + (last == '/' || last == '\\' ? "" : "/") + name + ".bin";
+    Game cached_game;
+    if (!LoadCachedROMs(&cached_game, rom_set, cache_file, zipfilename))
+    {
+      if (cached_game.name == game->name)
+        return false;
+      *rom_set = ROMSet();
+    }
+  }
+
+  // Read the zip contents
+  ZipArchive zip;
+  if (LoadZipArchive(&zip, zipfilename))
+    return true;
 
   // Bring in additional parent ROM set if needed
-  if (missing_parent_roms)
+  if (choice.missing_parent_roms)
   {
     std::string parent_zipfilename = StripFilename(zipfilename) + game->parent + ".zip";
     if (LoadZipArchive(&zip, parent_zipfilename))
@@ -873,12 +1274,37 @@ bool GameLoader::Load(Game *game, ROMSet *rom_set, const std::string &zipfilenam
 
   // Load
   bool error = LoadROMs(rom_set, game->name, zip);
-  if (error)
-    *game = Game();
+  if (!error && !cache_file.empty())
+  {
+    std::vector<std::string> sources(zip.zipfilenames);
+    sources.push_back(m_xml_filename);
+    ROMCache::Save(cache_file, sources, game->name, *rom_set);
+  }
   return error;
 }
 
-GameLoader::GameLoader(const std::string &xml_file)
+// Games are identified only by the file names and CRCs in the zip directories,
+// without decompressing anything, so a whole folder of ROM sets can be gone
+// through at once. Archives with no game yield an empty Game.
+std::vector<Game> GameLoader::Identify(const std::vector<std::string> &zipfilenames) const
+{
+  std::vector<Game> games(zipfilenames.size());
+  Util::JobSystem::Shared().ParallelFor(zipfilenames.size(), [&](size_t i)
+  {
+    ZipArchive zip;
+    if (LoadZipArchive(&zip, zipfilenames[i]))
+      return;
+    std::string chosen_game;
+    bool missing_parent_roms = false;
+    ChooseGameInZipArchive(&chosen_game, &missing_parent_roms, zip, zipfilenames[i]);
+    if (!chosen_game.empty())
+      games[i] = m_game_info_by_game.find(chosen_game)->second;
+  });
+  return games;
+}
+
+GameLoader::GameLoader(const std::string &xml_file, const std::string &cache_directory)
+  : m_cache_directory(cache_directory)
 {
   LoadDefinitionXML(xml_file);
 }
@@ -52,6 +52,7 @@ private:
   std::map<std::string, RegionsByName_t> m_regions_by_game;         // all games as defined in XML
   std::map<std::string, RegionsByName_t> m_regions_by_merged_game;  // only child sets merged w/ parents
   std::string m_xml_filename;
+  std::string m_cache_directory;  // empty if ROMs and definitions aren't cached
 
   // Single compressed file inside of a zip archive
   struct ZippedFile
@@ -61,6 +62,7 @@ private:
     std::string filename;     // file inside the zip archive
     size_t uncompressed_size = 0;
     uint32_t crc32 = 0;
+    unz_file_pos file_pos = {}; // where it is in the archive's directory
   };
 
   // Multiple zip archives
@@ -82,12 +84,14 @@ private:
   bool LoadZipArchive(ZipArchive *zip, const std::string &zipfilename) const;
   const ZippedFile *LookupFile(const File::ptr_t &file, const ZipArchive &zip) const;
   bool FileExistsInZipArchive(const File::ptr_t &file, const ZipArchive &zip) const;
-  bool LoadZippedFile(std::shared_ptr<uint8_t> *buffer, size_t *file_size, const GameLoader::File::ptr_t &file, const ZipArchive &zip) const;
+  bool LoadZippedFile(uint8_t *dest, const GameLoader::File::ptr_t &file, const GameLoader::Region::ptr_t &region, const ZipArchive &zip) const;
   static bool MissingAttrib(const GameLoader &loader, const Util::Config::Node &node, const std::string &attribute);
   bool LoadGamesFromXML(const Util::Config::Node &xml);
   bool MergeChildrenWithParents();
   void LogROMDefinition(const std::string &game_name, const RegionsByName_t &regions_by_name) const;
   bool ParseXML(const Util::Config::Node &xml);
+  bool LoadDefinitionCache(const std::string &cache_file);
+  void SaveDefinitionCache(const std::string &cache_file) const;
   bool LoadDefinitionXML(const std::string &filename);
   static void FindEquivalentFiles(std::set<File::ptr_t> *equivalent_files, const std::set<File::ptr_t> &a, const std::set<File::ptr_t> &b);
   void IdentifyGamesInZipArchive(
@@ -97,14 +101,27 @@ private:
     const std::map<std::string, RegionsByName_t> &regions_by_game) const;
   bool ComputeRegionSize(uint32_t *region_size, const Region::ptr_t &region, const ZipArchive &zip) const;
   void ChooseGameInZipArchive(std::string *chosen_game, bool *missing_parent_roms, const ZipArchive &zip, const std::string &zipfilename) const;
-  bool LoadRegion(ROM *buffer, const GameLoader::Region::ptr_t &region, const ZipArchive &zip) const;
   bool LoadROMs(ROMSet *rom_set, const std::string &game_name, const ZipArchive &zip) const;
+  void AttachPatches(ROMSet *rom_set, const std::string &game_name, const RegionsByName_t &regions_by_name) const;
+  bool LoadCachedROMs(Game *game, ROMSet *rom_set, const std::string &cache_file, const std::string &zipfilename) const;
   std::string ChooseGame(const std::set<std::string> &games_found, const std::string &zipfilename) const;
   static bool CompareFilesByName(const File::ptr_t &a,const File::ptr_t &b);
 
 public:
-  GameLoader(const std::string &xml_file);
+  // A game picked from a zip archive by Choose(), whose ROMs can be loaded
+  // later on
+  struct Choice
+  {
+    Game game;
+    std::string zipfilename;
+    bool missing_parent_roms = false;
+  };
+
+  GameLoader(const std::string &xml_file, const std::string &cache_directory = "");
   bool Load(Game *game, ROMSet *rom_set, const std::string &zipfilename) const;
+  bool Choose(Choice *choice, const std::string &zipfilename) const;
+  bool Load(ROMSet *rom_set, const Choice &choice) const;
+  std::vector<Game> Identify(const std::vector<std::string> &zipfilenames) const;
   const std::map<std::string, Game> &GetGames() const
   {
     return m_game_info_by_game;
@@ -0,0 +1,111 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson 
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free 
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+ 
+/*
+ * GPUTimer.cpp
+ * 
+ * Implementation of the CGPUTimer class: pass timing with GL timer queries.
+ */
+
+#include "GPUTimer.h"
+
+
+CGPUTimer &CGPUTimer::Shared()
+{
+  static CGPUTimer s_timer;
+  return s_timer;
+}
+
+const char *CGPUTimer::PassName(int pass)
+{
+  static const char *s_names[NumPasses] = { "opaque", "trans", "composite", "fog", "2d" };
+  return s_names[pass];
+}
+
+void CGPUTimer::SetEnabled(bool enable)
+{
+  m_wantEnabled = enable;
+}
+
+void CGPUTimer::Begin(Pass pass)
+{
+  if (!m_enabled || m_inPass)
+    return;
+
+  Frame &frame = m_frames[m_current];
+  if (frame.used == frame.queries.size())
+  {
+    Query query;
+    glGenQueries(1, &query.id);
+    frame.queries.push_back(query);
+  }
+
+  Query &query = frame.queries[frame.used++];
+  query.pass = pass;
+  glBeginQuery(GL_TIME_ELAPSED, query.id);
+  m_inPass = true;
+}
+
+void CGPUTimer::End()
+{
+  if (!m_inPass)
+    return;
+  glEndQuery(GL_TIME_ELAPSED);
+  m_inPass = false;
+}
+
+void CGPUTimer::EndFrame()
+{
+  End();
+
+  // Collect the frame before this one, which is the set to be reused next
+  m_current ^= 1;
+  Frame &previous = m_frames[m_current];
+
+  if (previous.used)
+  {
+    // Queries complete in order, so the last one being ready means they all are
+    GLint available = 0;
+    glGetQueryObjectiv(previous.queries[previous.used - 1].id, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+    {
+      GLuint64 nanos[NumPasses] = {};
+      for (size_t i = 0; i < previous.used; i++)
+      {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(previous.queries[i].id, GL_QUERY_RESULT, &elapsed);
+        nanos[previous.queries[i].pass] += elapsed;
+      }
+      for (int i = 0; i < NumPasses; i++)
+        m_micros[i] = UINT32(nanos[i] / 1000);
+    }
+  }
+  previous.used = 0;
+
+  bool enable = m_wantEnabled && GLEW_ARB_timer_query;
+  if (!enable)
+  {
+    for (int i = 0; i < NumPasses; i++)
+      m_micros[i] = 0;
+    m_frames[m_current ^ 1].used = 0;   // results of the frame just issued aren't wanted either
+  }
+  m_enabled = enable;
+}
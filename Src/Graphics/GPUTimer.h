@@ -0,0 +1,108 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson 
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free 
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+ 
+/*
+ * GPUTimer.h
+ * 
+ * GL_TIME_ELAPSED queries around each rendering pass, for the frame timings.
+ */
+
+#ifndef INCLUDED_GPUTIMER_H
+#define INCLUDED_GPUTIMER_H
+
+#include <GL/glew.h>
+#include "Types.h"
+#include <vector>
+
+
+/*
+ * CGPUTimer:
+ *
+ * Measures how long the GPU spends on each pass of a frame. A pass may be
+ * timed several times in a frame and the times are added up. Timer queries
+ * can't nest, so one pass must end before the next begins.
+ *
+ * Queries are double buffered: each frame's results are read back at the end
+ * of the next one, when they are normally ready, so reading them never stalls.
+ * The timings are therefore a frame old. If the results still aren't ready the
+ * previous timings are kept.
+ *
+ * Does nothing until enabled, or if the GL lacks timer queries. All members
+ * must be called from the thread that owns the GL context.
+ */
+class CGPUTimer
+{
+public:
+  enum Pass
+  {
+    Opaque3D,       // New3D opaque layer, including the line of sight read
+    Trans3D,        // New3D translucent layers
+    Composite3D,    // R3DFrameBuffers composition of the layers onto the back buffer
+    ScrollFog3D,
+    Tilegen2D,      // tile generator layer upload and composition
+    NumPasses
+  };
+
+  static CGPUTimer &Shared();
+  static const char *PassName(int pass);
+
+  // Takes effect from the next frame
+  void SetEnabled(bool enable);
+
+  void Begin(Pass pass);
+  void End();
+
+  // Call once all passes of a frame have been issued
+  void EndFrame();
+
+  // Microseconds spent on each pass by the last frame read back
+  const UINT32 *Micros() const
+  {
+    return m_micros;
+  }
+
+private:
+  struct Query
+  {
+    Pass pass;
+    GLuint id;
+  };
+
+  struct Frame
+  {
+    std::vector<Query> queries;
+    size_t used = 0;
+  };
+
+  CGPUTimer() = default;
+
+  bool m_wantEnabled = false;
+  bool m_enabled = false;
+  bool m_inPass = false;
+  Frame m_frames[2];
+  int m_current = 0;
+  UINT32 m_micros[NumPasses] = {};
+
+  // Queries are freed with the GL context
+};
+
+
+#endif  // INCLUDED_GPUTIMER_H
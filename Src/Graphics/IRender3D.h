@@ -14,13 +14,17 @@ public:
   virtual void RenderFrame(void) = 0;
   virtual void BeginFrame(void) = 0;
   virtual void EndFrame(void) = 0;
+  virtual bool CanRepeatFrame(void) const = 0;  // the last frame's 3D was kept and can be drawn again, in place of BeginFrame() and RenderFrame()
+  virtual void RepeatFrame(void) = 0;
   virtual void UploadTextures(unsigned level, unsigned x, unsigned y, unsigned width, unsigned height) = 0;
   virtual void AttachMemory(const uint32_t *cullingRAMLoPtr, const uint32_t *cullingRAMHiPtr, const uint32_t *polyRAMPtr, const uint32_t *vromPtr, const uint16_t *textureRAMPtr) = 0;
   virtual void SetStepping(int stepping) = 0;
   virtual bool Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes) = 0;
+  virtual bool Resize(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes) = 0; // keeps caches, reallocates only what depends on size
   virtual void SetSunClamp(bool enable) = 0;
   virtual void SetSignedShade(bool enable) = 0;
   virtual float GetLosValue(int layer) = 0;
+  virtual void GetTextureCacheStats(uint64_t *hits, uint64_t *misses) = 0;  // textures reused and uploaded so far
 
   virtual ~IRender3D()
   {
@@ -158,6 +158,7 @@
 
 #include "Supermodel.h"
 #include "Graphics/Legacy3D/Shaders3D.h"  // fragment and vertex shaders
+#include "Util/JobSystem.h"
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
@@ -209,17 +210,56 @@ int CLegacy3D::defaultFmtToTexSheetNum[] = {
   7  //     7  -> 7
 };
 
-void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
+// Hash of the 32x32 texel tile of texture RAM at (x,y), decoded in the given format
+static UINT64 HashTile(const UINT16 *textureRAM, int format, int x, int y)
+{
+  UINT64 hash = 0xCBF29CE484222325ULL ^ (UINT64)(format + 1);  // never 0, which marks a tile not yet decoded
+  for (int yi = y; yi < (y+32); yi++)
+  {
+    const UINT64 *row = (const UINT64 *) &textureRAM[yi*2048+x];
+    for (int xi = 0; xi < 32/4; xi++)
+    {
+      hash = (hash ^ row[xi]) * 0x100000001B3ULL;
+      hash ^= hash >> 29;
+    }
+  }
+  return hash | 1;
+}
+
+// True if every tile of the texture holds what texture RAM would decode to
+static bool TilesMatch(const TexSheet *texSheet, const UINT16 *textureRAM, int format, int x, int y, int width, int height)
+{
+  for (int yi = y; yi < (y+height); yi += 32)
+  {
+    for (int xi = x; xi < (x+width); xi += 32)
+    {
+      if (texSheet->texHash[yi/32][xi/32] != HashTile(textureRAM, format, xi, yi))
+        return false;
+    }
+  }
+  return true;
+}
+
+// Bytes of decoded texels DecodeTexels() writes for a texture
+static size_t DecodedTextureSize(int format, int width, int height)
+{
+  if (format == 7)
+    return 0;
+  return size_t(width) * height * (format == 0 ? 2 : 4);
+}
+
+// Clips the texture to the sheet and returns the sheet it must be decoded onto, or NULL if there is nothing to do
+TexSheet *CLegacy3D::TextureToDecode(int format, int &x, int &y, int width, int height)
 { 
   x &= 2047;
   y &= 2047;
   
   if ((x+width)>2048 || (y+height)>2048)
-    return;
+    return NULL;
   if (width > 1024 || height > 1024)
   {
     //ErrorLog("Encountered a texture that is too large (%d,%d,%d,%d)", x, y, width, height);
-    return;
+    return NULL;
   }
   
   // Map Model3 format to texture sheet
@@ -227,11 +267,26 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
   
   // Check to see if ALL texture tiles have been properly decoded on texture sheet
   if ((texSheet->texFormat[y/32][x/32] == format) && (texSheet->texWidth[y/32][x/32] >= width) && (texSheet->texHeight[y/32][x/32] >= height))
-    return;
+    return NULL;
 
+  // Games often upload the same textures again. If texture RAM holds what was last decoded here, the sheet already has it.
+  if (TilesMatch(texSheet, textureRAM, format, x, y, width, height))
+  {
+    texSheet->texFormat[y/32][x/32] = format;
+    texSheet->texWidth[y/32][x/32] = width;
+    texSheet->texHeight[y/32][x/32] = height;
+    return NULL;
+  }
+
+  return texSheet;
+}
+
+// Copies and decodes texels from texture RAM. T1RGB5 is written as packed 16-bit texels, RGBA4 is uploaded straight from
+// texture RAM and the rest are expanded to RGBA8. Touches no GL or renderer state, so may run on any thread.
+void CLegacy3D::DecodeTexels(int format, int x, int y, int width, int height, UINT8 *texels) const
+{
   //printf("Decoding texture format %u: %u x %u @ (%u, %u) sheet %u\n", format, width, height, x, y, texNum);
 
-  // Copy and decode
   int i = 0;
   switch (format)
   {
@@ -240,36 +295,26 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
     {
       for (int xi = x; xi < (x+width); xi++)
       {
-        textureBuffer[i++] = 0.0; // R
-        textureBuffer[i++] = 0.0; // G
-        textureBuffer[i++] = 1.0f;  // B
-        textureBuffer[i++] = 1.0f;  // A
+        texels[i++] = 0;     // R
+        texels[i++] = 0;     // G
+        texels[i++] = 0xFF;  // B
+        texels[i++] = 0xFF;  // A
       }
     }
     break;    
   case 0: // T1RGB5
-    for (int yi = y; yi < (y+height); yi++)
     {
-      for (int xi = x; xi < (x+width); xi++)
+      // Same layout as GL's 1_5_5_5_REV, but T is set for transparent texels so must be inverted
+      UINT16 *texels16 = (UINT16 *) texels;
+      for (int yi = y; yi < (y+height); yi++)
       {
-        textureBuffer[i++] = (GLfloat) ((textureRAM[yi*2048+xi]>>10)&0x1F) * (1.0f/31.0f);  // R
-        textureBuffer[i++] = (GLfloat) ((textureRAM[yi*2048+xi]>>5)&0x1F) * (1.0f/31.0f); // G
-        textureBuffer[i++] = (GLfloat) ((textureRAM[yi*2048+xi]>>0)&0x1F) * (1.0f/31.0f); // B
-        textureBuffer[i++] = ((textureRAM[yi*2048+xi]&0x8000)?0.0f:1.0f);         // T
+        for (int xi = x; xi < (x+width); xi++)
+          texels16[i++] = textureRAM[yi*2048+xi] ^ 0x8000;
       }
     }
     break;
   case 7: // RGBA4
-    for (int yi = y; yi < (y+height); yi++)
-    {
-      for (int xi = x; xi < (x+width); xi++)
-      {
-        textureBuffer[i++] = (GLfloat) ((textureRAM[yi*2048+xi]>>12)&0xF) * (1.0f/15.0f); // R
-        textureBuffer[i++] = (GLfloat) ((textureRAM[yi*2048+xi]>>8)&0xF) * (1.0f/15.0f);  // G
-        textureBuffer[i++] = (GLfloat) ((textureRAM[yi*2048+xi]>>4)&0xF) * (1.0f/15.0f);  // B
-        textureBuffer[i++] = (GLfloat) ((textureRAM[yi*2048+xi]>>0)&0xF) * (1.0f/15.0f);  // A
-      }
-    }
+    // Exactly GL's 4_4_4_4, uploaded straight from texture RAM
     break;
   case 5: // 8-bit grayscale
     for (int yi = y; yi < (y+height); yi++)
@@ -277,12 +322,11 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
       for (int xi = x; xi < (x+width); xi++)
       {
         // Interpret as 8-bit grayscale
-        uint16_t texel = textureRAM[yi*2048+xi] & 0xFF;
-        GLfloat c = texel * (1.0f/255.0f);
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = (texel == 0xFF) ? 0.f : 1.f;
+        UINT8 texel = textureRAM[yi*2048+xi] & 0xFF;
+        texels[i++] = texel;
+        texels[i++] = texel;
+        texels[i++] = texel;
+        texels[i++] = (texel == 0xFF) ? 0 : 0xFF;
       }
     }
     break;
@@ -291,13 +335,13 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
     {
       for (int xi = x; xi < (x+width); xi++)
       {
-        uint16_t texel = textureRAM[yi*2048+xi] >> 8;
-        GLfloat c = (texel >> 4) * (1.0f/15.0f);
-        GLfloat a = (texel & 0xF) * (1.0f/15.0f);
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = a;
+        UINT8 texel = textureRAM[yi*2048+xi] >> 8;
+        UINT8 c = (texel >> 4) * 17;  // 4 bits to 8
+        UINT8 a = (texel & 0xF) * 17;
+        texels[i++] = c;
+        texels[i++] = c;
+        texels[i++] = c;
+        texels[i++] = a;
       }
     }
     break;
@@ -306,12 +350,11 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
     {
       for (int xi = x; xi < (x+width); xi++)
       {
-        uint16_t texel = textureRAM[yi*2048+xi] >> 8;
-        GLfloat c = texel * (1.0f/255.0f);
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = (texel == 0xFF) ? 0.f : 1.f;
+        UINT8 texel = textureRAM[yi*2048+xi] >> 8;
+        texels[i++] = texel;
+        texels[i++] = texel;
+        texels[i++] = texel;
+        texels[i++] = (texel == 0xFF) ? 0 : 0xFF;
       }
     }
     break;
@@ -320,13 +363,13 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
     {
       for (int xi = x; xi < (x+width); xi++)
       {
-        uint16_t texel = textureRAM[yi*2048+xi] & 0xFF;
-        GLfloat c = (texel >> 4) * (1.0f/15.0f);
-        GLfloat a = (texel & 0xF) * (1.0f/15.0f);
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = a;
+        UINT8 texel = textureRAM[yi*2048+xi] & 0xFF;
+        UINT8 c = (texel >> 4) * 17;
+        UINT8 a = (texel & 0xF) * 17;
+        texels[i++] = c;
+        texels[i++] = c;
+        texels[i++] = c;
+        texels[i++] = a;
       }
     }
     break;
@@ -335,13 +378,13 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
     {
       for (int xi = x; xi < (x+width); xi++)
       {
-        uint16_t texel = textureRAM[yi*2048+xi] >> 8;
-        GLfloat c = (texel & 0xF) * (1.0f/15.0f);
-        GLfloat a = (texel >> 4) * (1.0f/15.0f);
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = a;
+        UINT8 texel = textureRAM[yi*2048+xi] >> 8;
+        UINT8 c = (texel & 0xF) * 17;
+        UINT8 a = (texel >> 4) * 17;
+        texels[i++] = c;
+        texels[i++] = c;
+        texels[i++] = c;
+        texels[i++] = a;
       }
     }
     break;
@@ -350,23 +393,59 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
     {
       for (int xi = x; xi < (x+width); xi++)
       {
-        uint16_t texel = textureRAM[yi*2048+xi] & 0xFF;
-        GLfloat c = (texel & 0xF) * (1.0f/15.0f);
-        GLfloat a = (texel >> 4) * (1.0f/15.0f);
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = c;
-        textureBuffer[i++] = a;
+        UINT8 texel = textureRAM[yi*2048+xi] & 0xFF;
+        UINT8 c = (texel & 0xF) * 17;
+        UINT8 a = (texel >> 4) * 17;
+        texels[i++] = c;
+        texels[i++] = c;
+        texels[i++] = c;
+        texels[i++] = a;
       }
     }
     break;
   }
-    
-  // Upload texture to correct position within texture map
+  
+}
+
+// Uploads decoded texels to the texture's position within its texture map and marks it decoded. Tile hashes are
+// computed here unless already given.
+void CLegacy3D::UploadTexture(TexSheet *texSheet, int format, int x, int y, int width, int height, const UINT8 *texels, const UINT64 *hashes)
+{
+  GLenum uploadFormat = GL_RGBA;
+  GLenum uploadType = GL_UNSIGNED_BYTE;
+  const GLvoid *pixels = texels;
+  if (format == 0)
+  {
+    uploadFormat = GL_BGRA;
+    uploadType = GL_UNSIGNED_SHORT_1_5_5_5_REV;
+  }
+  else if (format == 7)
+  {
+    pixels = &textureRAM[y*2048+x];
+    uploadType = GL_UNSIGNED_SHORT_4_4_4_4;
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 2048);
+  }
+
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  glActiveTexture(GL_TEXTURE0 + texSheet->mapNum);           // activate correct texture unit
-  glBindTexture(GL_TEXTURE_2D, texMapIDs[texSheet->mapNum]); // bind correct texture map
-  glTexSubImage2D(GL_TEXTURE_2D, 0, texSheet->xOffset + x, texSheet->yOffset + y, width, height, GL_RGBA, GL_FLOAT, textureBuffer);
+  if (textureArray)
+  {
+    // Texture maps are layers of the one array, so there is no unit to switch to
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texMapIDs[0]);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, texSheet->xOffset + x, texSheet->yOffset + y, texSheet->mapNum, width, height, 1, uploadFormat, uploadType, pixels);
+  }
+  else
+  {
+    glActiveTexture(GL_TEXTURE0 + texSheet->mapNum);           // activate correct texture unit
+    glBindTexture(GL_TEXTURE_2D, texMapIDs[texSheet->mapNum]); // bind correct texture map
+    glTexSubImage2D(GL_TEXTURE_2D, 0, texSheet->xOffset + x, texSheet->yOffset + y, width, height, uploadFormat, uploadType, pixels);
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  for (int yi = y; yi < (y+height); yi += 32)
+  {
+    for (int xi = x; xi < (x+width); xi += 32)
+      texSheet->texHash[yi/32][xi/32] = (NULL != hashes) ? *hashes++ : HashTile(textureRAM, format, xi, yi);
+  }
   
   // Mark texture as decoded
   texSheet->texFormat[y/32][x/32] = format;
@@ -374,6 +453,92 @@ void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
   texSheet->texHeight[y/32][x/32] = height;
 }
 
+void CLegacy3D::DecodeTexture(int format, int x, int y, int width, int height)
+{ 
+  TexSheet *texSheet = TextureToDecode(format, x, y, width, height);
+  if (NULL == texSheet)
+    return;
+  DecodeTexels(format, x, y, width, height, textureBuffer);
+  UploadTexture(texSheet, format, x, y, width, height, textureBuffer, NULL);
+}
+
+void CLegacy3D::QueueTexture(int format, int x, int y, int width, int height)
+{
+  QueuedTexture texture = { format, x, y, width, height, NULL, 0, 0 };
+  textureQueue.push_back(texture);
+}
+
+// Decodes the queued textures. Texels and tile hashes are worked out in parallel, as many textures at a time as fit
+// in the staging buffer, and GL uploads stay on this thread.
+void CLegacy3D::DecodeQueuedTextures(void)
+{
+  static const size_t MAX_STAGING_BYTES = 16 * 1024 * 1024;
+
+  Util::JobSystem &jobs = Util::JobSystem::Shared();
+  if (jobs.NumWorkers() == 0 || textureQueue.size() < 2)
+  {
+    for (const QueuedTexture &texture : textureQueue)
+      DecodeTexture(texture.format, texture.x, texture.y, texture.width, texture.height);
+    textureQueue.clear();
+    return;
+  }
+
+  // Leave out textures already on their sheets
+  size_t numToDecode = 0;
+  for (QueuedTexture &texture : textureQueue)
+  {
+    texture.texSheet = TextureToDecode(texture.format, texture.x, texture.y, texture.width, texture.height);
+    if (NULL != texture.texSheet)
+      textureQueue[numToDecode++] = texture;
+  }
+  textureQueue.resize(numToDecode);
+
+  size_t first = 0;
+  while (first < textureQueue.size())
+  {
+    // Lay out as many textures as fit in the staging buffer
+    size_t end = first;
+    size_t size = 0;
+    size_t numHashes = 0;
+    while (end < textureQueue.size())
+    {
+      QueuedTexture &texture = textureQueue[end];
+      size_t textureSize = DecodedTextureSize(texture.format, texture.width, texture.height);
+      if (end > first && size + textureSize > MAX_STAGING_BYTES)
+        break;
+      texture.offset = size;
+      texture.hashOffset = numHashes;
+      size += textureSize;
+      numHashes += size_t((texture.width + 31) / 32) * ((texture.height + 31) / 32);
+      ++end;
+    }
+    if (textureStaging.size() < size)
+      textureStaging.resize(size);
+    if (textureHashes.size() < numHashes)
+      textureHashes.resize(numHashes);
+
+    jobs.ParallelFor(end - first, [this, first](size_t i)
+    {
+      const QueuedTexture &texture = textureQueue[first + i];
+      DecodeTexels(texture.format, texture.x, texture.y, texture.width, texture.height, textureStaging.data() + texture.offset);
+      UINT64 *hash = &textureHashes[texture.hashOffset];
+      for (int yi = texture.y; yi < (texture.y+texture.height); yi += 32)
+      {
+        for (int xi = texture.x; xi < (texture.x+texture.width); xi += 32)
+          *hash++ = HashTile(textureRAM, texture.format, xi, yi);
+      }
+    });
+
+    for (size_t i = first; i < end; i++)
+    {
+      const QueuedTexture &texture = textureQueue[i];
+      UploadTexture(texture.texSheet, texture.format, texture.x, texture.y, texture.width, texture.height, textureStaging.data() + texture.offset, &textureHashes[texture.hashOffset]);
+    }
+    first = end;
+  }
+  textureQueue.clear();
+}
+
 // Signals that new textures have been uploaded. Flushes model caches. Be careful not to exceed bounds!
 void CLegacy3D::UploadTextures(unsigned level, unsigned x, unsigned y, unsigned width, unsigned height)
 {
@@ -381,10 +546,10 @@ void CLegacy3D::UploadTextures(unsigned level, unsigned x, unsigned y, unsigned
   // Make everything red
   for (int i = 0; i < 512*512; )
   {
-    textureBuffer[i++] = 1.0f;
-    textureBuffer[i++] = 0.0f;
-    textureBuffer[i++] = 0.0f;
-    textureBuffer[i++] = 1.0f;
+    textureBuffer[i++] = 0xFF;
+    textureBuffer[i++] = 0;
+    textureBuffer[i++] = 0;
+    textureBuffer[i++] = 0xFF;
   }
 #endif
 
@@ -960,7 +1125,7 @@ void CLegacy3D::RenderViewport(UINT32 addr, int pri, bool wideScreen)
 
 void CLegacy3D::RenderFrame(void)
 {
-  bool wideScreen = m_config["WideScreen"].ValueAs<bool>();
+  bool wideScreen = m_wideScreen;
 
   // Begin frame
   ClearErrors();  // must be cleared each frame
@@ -977,7 +1142,12 @@ void CLegacy3D::RenderFrame(void)
 
   // Bind Real3D shader program and texture maps
   glUseProgram(shaderProgram);
-  for (unsigned mapNum = 0; mapNum < numTexMaps; mapNum++)
+  if (textureArray)
+  {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texMapIDs[0]);
+  }
+  else for (unsigned mapNum = 0; mapNum < numTexMaps; mapNum++)
   {
     // Map Model3 format to texture unit and texture unit to texture sheet number
     glActiveTexture(GL_TEXTURE0 + mapNum);           // activate correct texture unit
@@ -986,20 +1156,10 @@ void CLegacy3D::RenderFrame(void)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   }
   
-  // Enable VBO client states
-  glEnableClientState(GL_VERTEX_ARRAY);
-  glEnableClientState(GL_NORMAL_ARRAY);
-  glEnableClientState(GL_COLOR_ARRAY);
-  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-  if (subTextureLoc != -1)   glEnableVertexAttribArray(subTextureLoc);
-  if (texParamsLoc != -1)    glEnableVertexAttribArray(texParamsLoc);
-  if (texFormatLoc != -1)    glEnableVertexAttribArray(texFormatLoc);
-  if (texMapLoc != -1)       glEnableVertexAttribArray(texMapLoc);
-  if (transLevelLoc != -1)   glEnableVertexAttribArray(transLevelLoc);
-  if (lightEnableLoc != -1)  glEnableVertexAttribArray(lightEnableLoc);
-  if (specularLoc != -1)     glEnableVertexAttribArray(specularLoc);
-  if (shininessLoc != -1)    glEnableVertexAttribArray(shininessLoc);
-  if (fogIntensityLoc != -1) glEnableVertexAttribArray(fogIntensityLoc);
+  // Enable VBO client states (vertex array objects have their own)
+  bool vertexArrays = VROMCache.vaoID != 0;
+  if (!vertexArrays)
+    EnableVertexArrays();
   
   // Draw
 #ifdef DEBUG
@@ -1027,25 +1187,40 @@ void CLegacy3D::RenderFrame(void)
   glDisable(GL_STENCIL_TEST); // make sure this is turned off
   
   // Disable VBO client states
-  if (fogIntensityLoc != -1)  glDisableVertexAttribArray(fogIntensityLoc);
-  if (shininessLoc != -1)     glDisableVertexAttribArray(shininessLoc);
-  if (specularLoc != -1)      glDisableVertexAttribArray(specularLoc);
-  if (lightEnableLoc != -1)   glDisableVertexAttribArray(lightEnableLoc);
-  if (transLevelLoc != -1)    glDisableVertexAttribArray(transLevelLoc);
-  if (texMapLoc != -1)        glDisableVertexAttribArray(texMapLoc);
-  if (texFormatLoc != -1)     glDisableVertexAttribArray(texFormatLoc);
-  if (texParamsLoc != -1)     glDisableVertexAttribArray(texParamsLoc);
-  if (subTextureLoc != -1)    glDisableVertexAttribArray(subTextureLoc);
-  glDisableClientState(GL_COLOR_ARRAY);
-  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-  glDisableClientState(GL_NORMAL_ARRAY);
-  glDisableClientState(GL_VERTEX_ARRAY);
+  if (vertexArrays)
+    glBindVertexArray(0);
+  else
+  {
+    if (fogIntensityLoc != -1)  glDisableVertexAttribArray(fogIntensityLoc);
+    if (shininessLoc != -1)     glDisableVertexAttribArray(shininessLoc);
+    if (specularLoc != -1)      glDisableVertexAttribArray(specularLoc);
+    if (lightEnableLoc != -1)   glDisableVertexAttribArray(lightEnableLoc);
+    if (transLevelLoc != -1)    glDisableVertexAttribArray(transLevelLoc);
+    if (texMapLoc != -1)        glDisableVertexAttribArray(texMapLoc);
+    if (texFormatLoc != -1)     glDisableVertexAttribArray(texFormatLoc);
+    if (texParamsLoc != -1)     glDisableVertexAttribArray(texParamsLoc);
+    if (subTextureLoc != -1)    glDisableVertexAttribArray(subTextureLoc);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
 }
 
 void CLegacy3D::EndFrame(void)
 {
 }
 
+bool CLegacy3D::CanRepeatFrame(void) const
+{
+  return false;
+}
+
+void CLegacy3D::RepeatFrame(void)
+{
+  RenderFrame();
+}
+
 void CLegacy3D::BeginFrame(void)
 {
   //printf("--- BEGIN FRAME ---\n");
@@ -1063,7 +1238,7 @@ void CLegacy3D::AttachMemory(const UINT32 *cullingRAMLoPtr, const UINT32 *cullin
   polyRAM = polyRAMPtr;
   vrom = vromPtr;
   textureRAM = textureRAMPtr;
-  DebugLog("Legacy3D attached Real3D memory regions\n");
+  DEBUG_LOG(Graphics, "Legacy3D attached Real3D memory regions\n");
 }
 
 void CLegacy3D::SetStepping(int stepping)
@@ -1072,7 +1247,7 @@ void CLegacy3D::SetStepping(int stepping)
   
   if ((step!=0x10) && (step!=0x15) && (step!=0x20) && (step!=0x21))
   {
-    DebugLog("Legacy3D: Unrecognized stepping: %d.%d\n", (step>>4)&0xF, step&0xF);
+    DEBUG_LOG(Graphics, "Legacy3D: Unrecognized stepping: %d.%d\n", (step>>4)&0xF, step&0xF);
     step = 0x10;
   }
   
@@ -1087,13 +1262,25 @@ void CLegacy3D::SetStepping(int stepping)
     vertexFactor = (1.0f/128.0f); // 17.7
   }
   
-  DebugLog("Legacy3D set to Step %d.%d\n", (step>>4)&0xF, step&0xF);
+  DEBUG_LOG(Graphics, "Legacy3D set to Step %d.%d\n", (step>>4)&0xF, step&0xF);
 }
   
+bool CLegacy3D::Resize(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXResParam, unsigned totalYResParam)
+{
+  // Nothing is allocated by size, viewports are worked out from these each frame
+  xRatio = (GLfloat) xRes / 496.0f;
+  yRatio = (GLfloat) yRes / 384.0f;
+  xOffs = xOffset;
+  yOffs = yOffset;
+  totalXRes = totalXResParam;
+  totalYRes = totalYResParam;
+  return OKAY;
+}
+
 bool CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXResParam, unsigned totalYResParam)
 {
   // Allocate memory for texture buffer
-  textureBuffer = new(std::nothrow) GLfloat[1024*1024*4];
+  textureBuffer = new(std::nothrow) UINT8[1024*1024*4];
   if (NULL == textureBuffer)
     return ErrorLog("Insufficient memory for texture decode buffer.");
     
@@ -1114,12 +1301,7 @@ bool CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
   lightingParams[5] = 0.0;
 
   // Resolution and offset within physical display area
-  xRatio = (GLfloat) xRes / 496.0f;
-  yRatio = (GLfloat) yRes / 384.0f;
-  xOffs = xOffset;
-  yOffs = yOffset;
-  totalXRes = totalXResParam;
-  totalYRes = totalYResParam;
+  Resize(xOffset, yOffset, xRes, yRes, totalXResParam, totalYResParam);
 
   // Get ideal number of texture sheets required by default mapping from Model3 texture format to texture sheet
   int idealTexSheets = 0;
@@ -1154,35 +1336,60 @@ bool CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
     mapSize -= 2048;
   }
 
-  // Load shaders, using multi-sheet shader if requested.
-  const char *fragmentShaderSource = (m_config["MultiTexture"].ValueAs<bool>() ? fragmentShaderMultiSheetSource : fragmentShaderSingleSheetSource); // single texture shader
+  // Load shaders, using multi-sheet shader if requested. It samples a texture array, so needs them supported.
+  bool multiTexture = m_config["MultiTexture"].ValueAs<bool>();
+  if (multiTexture && !GLEW_VERSION_3_0 && !GLEW_EXT_texture_array)
+  {
+    InfoLog("Texture arrays are not supported by OpenGL. Using a single texture sheet.");
+    multiTexture = false;
+  }
+  const char *fragmentShaderSource = (multiTexture ? fragmentShaderMultiSheetSource : fragmentShaderSingleSheetSource); // single texture shader
   if (OKAY != LoadShaderProgram(&shaderProgram,&vertexShader,&fragmentShader,m_config["VertexShader"].ValueAs<std::string>(),m_config["FragmentShader"].ValueAs<std::string>(),vertexShaderSource,fragmentShaderSource))
     return FAIL;
   
-  // Try locating default "textureMap" uniform in shader program
+  // Try locating "textureMaps" texture array uniform in shader program. If it exists, each texture map is a layer of
+  // a single array on the first texture unit, selected with the texMap vertex attribute, and holds one sheet.
   glUseProgram(shaderProgram); // bind program
-  textureMapLoc = glGetUniformLocation(shaderProgram, "textureMap");
-  
-  // If exists, bind to first texture unit
+  GLint textureMapsLoc = glGetUniformLocation(shaderProgram, "textureMaps");
+  textureArray = textureMapsLoc != -1;
   int mapCount = 0;
-  if (textureMapLoc != -1)
-    glUniform1i(textureMapLoc, mapCount++);
-  
-  // Try locating "textureMap[0-7]" uniforms in shader program
-  for (int mapNum = 0; mapNum < 8 && mapCount < maxTexMaps; mapNum++)
+  if (textureArray)
+  {
+    glUniform1i(textureMapsLoc, 0);
+    GLint maxLayers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    mapCount = std::max<int>(1, std::min<int>(std::min<int>(m_config["MaxTexMaps"].ValueAsDefault<int>(9), maxLayers), idealTexSheets));
+    mapExtent = 1;
+    mapSize = 2048;
+  }
+  else
   {
-    char uniformName[12];
-    sprintf(uniformName, "textureMap%u", mapNum);
-    textureMapLocs[mapNum] = glGetUniformLocation(shaderProgram, uniformName);  
-    // If exist, bind to remaining texture units
-    if (textureMapLocs[mapNum] != -1)
-      glUniform1i(textureMapLocs[mapNum], mapCount++);
+    // Try locating default "textureMap" uniform in shader program
+    textureMapLoc = glGetUniformLocation(shaderProgram, "textureMap");
+    
+    // If exists, bind to first texture unit
+    if (textureMapLoc != -1)
+      glUniform1i(textureMapLoc, mapCount++);
+    
+    // Try locating "textureMap[0-7]" uniforms in shader program
+    for (int mapNum = 0; mapNum < 8 && mapCount < maxTexMaps; mapNum++)
+    {
+      char uniformName[12];
+      sprintf(uniformName, "textureMap%u", mapNum);
+      textureMapLocs[mapNum] = glGetUniformLocation(shaderProgram, uniformName);  
+      // If exist, bind to remaining texture units
+      if (textureMapLocs[mapNum] != -1)
+        glUniform1i(textureMapLocs[mapNum], mapCount++);
+    }
   }
   
   // Check sucessully located at least one "textureMap" uniform in shader program
   if (mapCount == 0)
     return ErrorLog("Fragment shader must contain at least one 'textureMap' uniform.");
-  InfoLog("Located and bound %u 'textureMap' uniform(s) in fragment shader.", mapCount);
+  if (textureArray)
+    InfoLog("Located and bound 'textureMaps' texture array uniform in fragment shader.");
+  else
+    InfoLog("Located and bound %u 'textureMap' uniform(s) in fragment shader.", mapCount);
 
   // Readjust map extent so as to utilise as many texture maps found in shader program as possible
   while (mapExtent > 1 && mapCount * (mapExtent - 1) * (mapExtent - 1) >= idealTexSheets)
@@ -1198,6 +1405,29 @@ bool CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
     numTexMaps = std::min<unsigned>(mapCount, 1 + (idealTexSheets - 1) / sheetsPerMap);
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (textureArray)
+    {
+      glGenTextures(1, texMapIDs);
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texMapIDs[0]);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);  // fragment shader performs its own interpolation
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, mapSize, mapSize, numTexMaps, 0, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, 0);
+      if (glGetError() == GL_NO_ERROR)
+        break;
+
+      // Ran out of video memory. Try again with fewer layers, sharing them between formats.
+      glDeleteTextures(1, texMapIDs);
+      if (numTexMaps == 1)
+      {
+        numTexMaps = 0;
+        break;
+      }
+      mapCount = numTexMaps - 1;
+      continue;
+    }
     glGenTextures(numTexMaps, texMapIDs);
     bool okay = true;
     for (unsigned mapNum = 0; mapNum < numTexMaps; mapNum++)
@@ -1230,7 +1460,10 @@ bool CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
   // Check successfully created at least one texture map
   if (numTexMaps == 0)
     return ErrorLog("OpenGL was unable to provide any 2048x2048-texel texture maps.");
-  InfoLog("Created %u %ux%u-texel GL texture map(s).", numTexMaps, mapSize, mapSize);
+  if (textureArray)
+    InfoLog("Created a %u-layer %ux%u-texel GL texture array.", numTexMaps, mapSize, mapSize);
+  else
+    InfoLog("Created %u %ux%u-texel GL texture map(s).", numTexMaps, mapSize, mapSize);
 
   // Create texture sheet objects and assign them to texture maps
   numTexSheets = std::min<unsigned>(numTexMaps * sheetsPerMap, idealTexSheets);
@@ -1245,6 +1478,7 @@ bool CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
     texSheets[sheetNum].mapNum = mapNum;
     texSheets[sheetNum].xOffset = 2048 * (posInMap % mapExtent);
     texSheets[sheetNum].yOffset = 2048 * (posInMap / mapExtent);
+    memset(texSheets[sheetNum].texHash, 0, sizeof(texSheets[sheetNum].texHash));
   }
 
   // Assign Model3 texture formats to texture sheets (cannot just use default mapping as may have ended up with fewer
@@ -1281,6 +1515,14 @@ bool CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
   if (mapSizeLoc != -1)
     glUniform1f(mapSizeLoc, (GLfloat)mapSize);
 
+  // Vertex array objects, so drawing needn't set up every pointer each time, and mapped VBO uploads
+  if (GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object)
+  {
+    CreateVertexArray(&VROMCache);
+    CreateVertexArray(&PolyCache);
+  }
+  mapBufferRange = GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range;
+
   // Additional OpenGL stuff
   glFrontFace(GL_CW);   // polygons are uploaded w/ clockwise winding
   glCullFace(GL_BACK);
@@ -1293,7 +1535,7 @@ bool CLegacy3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
   // Mark all textures as dirty
   UploadTextures(0, 0, 0, 2048, 2048);
 
-  DebugLog("Legacy3D initialized\n");
+  DEBUG_LOG(Graphics, "Legacy3D initialized\n");
   return OKAY;
 }
 
@@ -1310,8 +1552,15 @@ float CLegacy3D::GetLosValue(int layer)
 	return 0.0f;
 }
 
+void CLegacy3D::GetTextureCacheStats(uint64_t *hits, uint64_t *misses)
+{
+	*hits = 0;
+	*misses = 0;
+}
+
 CLegacy3D::CLegacy3D(const Util::Config::Node &config)
-  : m_config(config)
+  : m_config(config),
+    m_wideScreen(config, "WideScreen")
 { 
   cullingRAMLo = NULL;
   cullingRAMHi = NULL;
@@ -1320,6 +1569,8 @@ CLegacy3D::CLegacy3D(const Util::Config::Node &config)
   textureRAM = NULL;
   textureBuffer = NULL;
   texSheets = NULL;
+  textureArray = false;
+  mapBufferRange = false;
   
   // Clear model cache pointers so we can safely destroy them if init fails
   for (int i = 0; i < 2; i++)
@@ -1332,13 +1583,15 @@ CLegacy3D::CLegacy3D(const Util::Config::Node &config)
     PolyCache.lut = NULL;
     VROMCache.List = NULL;
     PolyCache.List = NULL;
+    VROMCache.vaoID = 0;
+    PolyCache.vaoID = 0;
     VROMCache.ListHead[i] = NULL;
     PolyCache.ListHead[i] = NULL;
     VROMCache.ListTail[i] = NULL;
     PolyCache.ListTail[i] = NULL;
   }
   
-  DebugLog("Built Legacy3D\n");
+  DEBUG_LOG(Graphics, "Built Legacy3D\n");
 }
 
 CLegacy3D::~CLegacy3D(void)
@@ -1346,7 +1599,7 @@ CLegacy3D::~CLegacy3D(void)
   DestroyShaderProgram(shaderProgram,vertexShader,fragmentShader);
   if (glBindBuffer != NULL) // we may have failed earlier due to lack of OpenGL 2.0 functions 
     glBindBuffer(GL_ARRAY_BUFFER, 0); // disable VBOs by binding to 0
-  glDeleteTextures(numTexMaps, texMapIDs);
+  glDeleteTextures(textureArray ? 1 : numTexMaps, texMapIDs);
   
   DestroyModelCache(&VROMCache);
   DestroyModelCache(&PolyCache);
@@ -1364,7 +1617,7 @@ CLegacy3D::~CLegacy3D(void)
     delete [] textureBuffer;
   textureBuffer = NULL;
 
-  DebugLog("Destroyed Legacy3D\n");
+  DEBUG_LOG(Graphics, "Destroyed Legacy3D\n");
 }
 
 } // Legacy3D
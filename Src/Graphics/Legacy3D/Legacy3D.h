@@ -32,6 +32,7 @@
 #include "Graphics/IRender3D.h"
 #include <GL/glew.h>
 #include "Util/NewConfig.h"
+#include <vector>
 
 namespace Legacy3D {
 
@@ -169,6 +170,7 @@ struct ModelCache
 	unsigned	vboMaxOffset;	// size of VBO (in bytes)
 	unsigned	vboCurOffset;	// current offset in VBO (in bytes)
 	GLuint		vboID;			// OpenGL VBO handle
+	GLuint		vaoID;			// vertex array object with the VBO's attribute pointers (0 if unsupported)
 	
 	// Local vertex buffers (enough for a single model)
 	unsigned	maxVertIdx;		// size of each local vertex buffer (in vertices)
@@ -218,6 +220,13 @@ struct TexSheet
 	int	 texWidth[2048/32][2048/32];
 	int	 texHeight[2048/32][2048/32];
 	INT8 texFormat[2048/32][2048/32];
+
+	/*
+	 * Hash of the texture RAM and format each 32x32 tile of the sheet was last
+	 * decoded from (0 if never). When a texture is uploaded again unchanged,
+	 * its tiles match and the sheet still holds it, so it isn't decoded again.
+	 */
+	UINT64 texHash[2048/32][2048/32];
 };
 
 /******************************************************************************
@@ -258,6 +267,16 @@ public:
 	 * the frame.
 	 */
 	void EndFrame(void);
+
+	/*
+	 * CanRepeatFrame(void):
+	 * RepeatFrame(void):
+	 *
+	 * Nothing is kept between frames, so frames can't be repeated and are
+	 * always rendered again.
+	 */
+	bool CanRepeatFrame(void) const;
+	void RepeatFrame(void);
 	
 	/*
 	 * UploadTextures(x, y, width, height):
@@ -328,6 +347,17 @@ public:
 	 */
 	bool Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes);
 
+	/*
+	 * Resize(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes):
+	 *
+	 * Changes the display area after Init(), e.g. on a fullscreen toggle,
+	 * keeping the model and texture caches. Parameters are as for Init().
+	 *
+	 * Returns:
+	 *		Always OKAY.
+	 */
+	bool Resize(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes);
+
 	/*
 	* SetSunClamp(bool enable);
 	*
@@ -358,6 +388,13 @@ public:
 	*/
 	float GetLosValue(int layer);
 
+	/*
+	* GetTextureCacheStats(hits, misses);
+	*
+	* The legacy engine has no texture cache, so both are always 0.
+	*/
+	void GetTextureCacheStats(uint64_t *hits, uint64_t *misses);
+
 	/*
 	 * CLegacy3D(void):
 	 * ~CLegacy3D(void):
@@ -394,9 +431,17 @@ private:
 	void 			ClearModelCache(ModelCache *cache);
 	bool 			CreateModelCache(ModelCache *cache, unsigned vboMaxVerts, unsigned localMaxVerts, unsigned maxNumModels, unsigned numLUTEntries, unsigned displayListSize, bool isDynamic);
 	void 			DestroyModelCache(ModelCache *cache);
+	void			EnableVertexArrays(void);
+	void			SetVertexPointers(void);
+	void			CreateVertexArray(ModelCache *cache);
 	
 	// Texture management
 	void DecodeTexture(int format, int x, int y, int width, int height);
+	TexSheet *TextureToDecode(int format, int &x, int &y, int width, int height);
+	void DecodeTexels(int format, int x, int y, int width, int height, UINT8 *texels) const;
+	void UploadTexture(TexSheet *texSheet, int format, int x, int y, int width, int height, const UINT8 *texels, const UINT64 *hashes);
+	void QueueTexture(int format, int x, int y, int width, int height);
+	void DecodeQueuedTextures(void);
 	
 	// Matrix stack
 	void	MultMatrix(UINT32 matrixOffset);
@@ -419,6 +464,7 @@ private:
 	 */
   
   const Util::Config::Node &m_config;
+  Util::Config::Binding<bool> m_wideScreen;
 	
 #ifdef DEBUG
 	// Debug
@@ -488,7 +534,8 @@ private:
 	// Texture details
 	static int	defaultFmtToTexSheetNum[8];  // default mapping from Model3 texture format to texture sheet	
 	unsigned    numTexMaps;                  // total number of texture maps
-	GLuint		texMapIDs[9];                // GL texture IDs of texture maps
+	GLuint		texMapIDs[9];                // GL texture IDs of texture maps (just the first, if a texture array)
+	bool        textureArray;                // texture maps are layers of a GL_TEXTURE_2D_ARRAY
 	unsigned    numTexSheets;                // total number of texture sheets
 	TexSheet   *texSheets;                   // texture sheet objects
 	TexSheet   *fmtToTexSheet[8];            // final mapping from Model3 texture format to texture sheet
@@ -519,14 +566,32 @@ private:
 	// Model caching
 	ModelCache	VROMCache;	// VROM (static) models
 	ModelCache	PolyCache;	// polygon RAM (dynamic) models
+	bool		mapBufferRange;	// upload models through glMapBufferRange() rather than glBufferSubData()
 	
 	/*
  	 * Texture Decode Buffer
  	 *
  	 * Textures are decoded and copied from texture RAM into this temporary buffer
- 	 * before being uploaded. Dimensions are 512x512.
+ 	 * before being uploaded. Dimensions are 1024x1024.
  	 */
-	GLfloat	*textureBuffer;	// RGBA8 format
+	UINT8	*textureBuffer;	// RGBA8 format, or 16-bit texels for T1RGB5
+	
+	/*
+	 * Queued Textures
+	 *
+	 * Textures of a cached model are decoded together: in parallel on the job
+	 * system into the staging buffer, then uploaded one after another here.
+	 */
+	struct QueuedTexture
+	{
+		int       format, x, y, width, height;
+		TexSheet  *texSheet;    // sheet to upload to
+		size_t    offset;       // of the texels in textureStaging
+		size_t    hashOffset;   // of the tile hashes in textureHashes
+	};
+	std::vector<QueuedTexture>  textureQueue;
+	std::vector<UINT8>          textureStaging;
+	std::vector<UINT64>         textureHashes;
 };
 
 } // Legacy3D
@@ -225,11 +225,9 @@ static void PrintMatrix(GLfloat m[4*4])
  alpha polygons. Therefore, it may be necessary in the future to decouple them.
 ******************************************************************************/   
     
-// Draws the display list
-void CLegacy3D::DrawDisplayList(ModelCache *Cache, POLY_STATE state)
+// Points the vertex attributes at the currently bound VBO
+void CLegacy3D::SetVertexPointers(void)
 {
-  // Bind and activate VBO (pointers activate currently bound VBO)
-  glBindBuffer(GL_ARRAY_BUFFER, Cache->vboID);
   glVertexPointer(3, GL_FLOAT, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_X*sizeof(GLfloat))); 
   glNormalPointer(GL_FLOAT, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_NX*sizeof(GLfloat))); 
   glTexCoordPointer(2, GL_FLOAT, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_U*sizeof(GLfloat)));
@@ -243,6 +241,19 @@ void CLegacy3D::DrawDisplayList(ModelCache *Cache, POLY_STATE state)
   if (shininessLoc != -1)    glVertexAttribPointer(shininessLoc, 1, GL_FLOAT, GL_FALSE, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_SHININESS*sizeof(GLfloat)));
   if (specularLoc != -1)     glVertexAttribPointer(specularLoc, 1, GL_FLOAT, GL_FALSE, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_SPECULAR*sizeof(GLfloat)));
   if (fogIntensityLoc != -1) glVertexAttribPointer(fogIntensityLoc, 1, GL_FLOAT, GL_FALSE, VBO_VERTEX_SIZE*sizeof(GLfloat), (GLvoid *) (VBO_VERTEX_OFFSET_FOGINTENSITY*sizeof(GLfloat)));
+}
+
+// Draws the display list
+void CLegacy3D::DrawDisplayList(ModelCache *Cache, POLY_STATE state)
+{
+  // Bind and activate VBO (pointers activate currently bound VBO), or the vertex array object that already has them
+  if (Cache->vaoID)
+    glBindVertexArray(Cache->vaoID);
+  else
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, Cache->vboID);
+    SetVertexPointers();
+  }
   
   // Set up state
   if (state == POLY_STATE_ALPHA)
@@ -953,12 +964,27 @@ void CLegacy3D::EndModel(ModelCache *Cache, struct VBORef *Model, int lutIdx, UI
   // First alpha polygon immediately follows the normal polygons
   Model->index[POLY_STATE_ALPHA] = Model->index[POLY_STATE_NORMAL] + Model->numVerts[POLY_STATE_NORMAL];
 
-  // Upload from local vertex buffer to real VBO
+  // Upload from local vertex buffer to real VBO. Nothing drawn since the VBO was last cleared uses this part of it, so
+  // it can be written without waiting for the GPU.
   glBindBuffer(GL_ARRAY_BUFFER, Cache->vboID);
-  if (Model->numVerts[POLY_STATE_NORMAL] > 0)
-    glBufferSubData(GL_ARRAY_BUFFER, Model->index[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->curVertIdx[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->verts[POLY_STATE_NORMAL]);
-  if (Model->numVerts[POLY_STATE_ALPHA] > 0)
-    glBufferSubData(GL_ARRAY_BUFFER, Model->index[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->curVertIdx[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->verts[POLY_STATE_ALPHA]);
+  size_t normalBytes = Model->numVerts[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat);
+  size_t alphaBytes = Model->numVerts[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat);
+  GLubyte *dest = NULL;
+  if (mapBufferRange && (normalBytes + alphaBytes) > 0)
+    dest = (GLubyte *) glMapBufferRange(GL_ARRAY_BUFFER, Model->index[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), normalBytes + alphaBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  if (dest != NULL)
+  {
+    memcpy(dest, Cache->verts[POLY_STATE_NORMAL], normalBytes);
+    memcpy(dest + normalBytes, Cache->verts[POLY_STATE_ALPHA], alphaBytes);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
+  else
+  {
+    if (Model->numVerts[POLY_STATE_NORMAL] > 0)
+      glBufferSubData(GL_ARRAY_BUFFER, Model->index[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->curVertIdx[POLY_STATE_NORMAL]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->verts[POLY_STATE_NORMAL]);
+    if (Model->numVerts[POLY_STATE_ALPHA] > 0)
+      glBufferSubData(GL_ARRAY_BUFFER, Model->index[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->curVertIdx[POLY_STATE_ALPHA]*VBO_VERTEX_SIZE*sizeof(GLfloat), Cache->verts[POLY_STATE_ALPHA]);
+  }
     
   // Record LUT index in the model VBORef
   Model->lutIdx = lutIdx;
@@ -1174,6 +1200,12 @@ struct VBORef *CLegacy3D::LookUpModel(ModelCache *Cache, int lutIdx, UINT16 text
 // Discard all models in the cache and the display list
 void CLegacy3D::ClearModelCache(ModelCache *Cache)
 {
+  // Give the VBO new storage, so models cached next never overwrite vertices the GPU may still be drawing
+  if (Cache->vboCurOffset > 0)
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, Cache->vboID);
+    glBufferData(GL_ARRAY_BUFFER, Cache->vboMaxOffset, 0, Cache->dynamic?GL_STREAM_DRAW:GL_STATIC_DRAW);
+  }
   Cache->vboCurOffset = 0;
   for (size_t i = 0; i < 2; i++)
     Cache->curVertIdx[i] = 0;
@@ -1189,6 +1221,7 @@ bool CLegacy3D::CreateModelCache(ModelCache *Cache, unsigned vboMaxVerts,
                  unsigned displayListSize, bool isDynamic)
 {
   Cache->dynamic = isDynamic;
+  Cache->vaoID = 0;
   
   /*
    * VBO allocation:
@@ -1228,7 +1261,7 @@ bool CLegacy3D::CreateModelCache(ModelCache *Cache, unsigned vboMaxVerts,
       return ErrorLog("OpenGL was unable to provide a %s vertex buffer.", isDynamic?"dynamic":"static");
   }
   
-  DebugLog("%s vertex buffer size: %1.2f MB", isDynamic?"Dynamic":"Static", (float)vboBytes/(float)0x100000);
+  DEBUG_LOG(Graphics, "%s vertex buffer size: %1.2f MB", isDynamic?"Dynamic":"Static", (float)vboBytes/(float)0x100000);
   InfoLog("%s vertex buffer size: %1.2f MB", isDynamic?"Dynamic":"Static", (float)vboBytes/(float)0x100000);
   
   // Set the VBO to the size we obtained
@@ -1275,6 +1308,8 @@ bool CLegacy3D::CreateModelCache(ModelCache *Cache, unsigned vboMaxVerts,
 void CLegacy3D::DestroyModelCache(ModelCache *Cache)
 {
   glDeleteBuffers(1, &(Cache->vboID));
+  if (Cache->vaoID)
+    glDeleteVertexArrays(1, &(Cache->vaoID));
 
   for (size_t i = 0; i < 2; i++)
   {
@@ -1291,4 +1326,33 @@ void CLegacy3D::DestroyModelCache(ModelCache *Cache)
   memset(Cache, 0, sizeof(ModelCache));
 }
 
+// Enables all vertex attributes the shader uses
+void CLegacy3D::EnableVertexArrays(void)
+{
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  if (subTextureLoc != -1)   glEnableVertexAttribArray(subTextureLoc);
+  if (texParamsLoc != -1)    glEnableVertexAttribArray(texParamsLoc);
+  if (texFormatLoc != -1)    glEnableVertexAttribArray(texFormatLoc);
+  if (texMapLoc != -1)       glEnableVertexAttribArray(texMapLoc);
+  if (transLevelLoc != -1)   glEnableVertexAttribArray(transLevelLoc);
+  if (lightEnableLoc != -1)  glEnableVertexAttribArray(lightEnableLoc);
+  if (specularLoc != -1)     glEnableVertexAttribArray(specularLoc);
+  if (shininessLoc != -1)    glEnableVertexAttribArray(shininessLoc);
+  if (fogIntensityLoc != -1) glEnableVertexAttribArray(fogIntensityLoc);
+}
+
+// Records the model cache's VBO and attribute pointers in a vertex array object, so drawing just binds it
+void CLegacy3D::CreateVertexArray(ModelCache *Cache)
+{
+  glGenVertexArrays(1, &(Cache->vaoID));
+  glBindVertexArray(Cache->vaoID);
+  glBindBuffer(GL_ARRAY_BUFFER, Cache->vboID);
+  EnableVertexArrays();
+  SetVertexPointers();
+  glBindVertexArray(0);
+}
+
 } // Legacy3D
@@ -22,21 +22,15 @@
 /*
  * Fragment_MultiSheet.glsl
  *
- * Fragment shader for 3D rendering. Uses 8 texture sheets to decode the 
- * different possible formats.
+ * Fragment shader for 3D rendering. Uses a texture sheet for each of the
+ * different possible formats, held as the layers of a texture array.
  */
 
 #version 120
+#extension GL_EXT_texture_array : require
 
 // Global uniforms
-uniform sampler2D	textureMap0;		// complete texture map (fmt 0), 2048x2048 texels
-uniform sampler2D	textureMap1;		// complete texture map (fmt 1), 2048x2048 texels
-uniform sampler2D	textureMap2;		// complete texture map (fmt 2), 2048x2048 texels
-uniform sampler2D	textureMap3;		// complete texture map (fmt 3), 2048x2048 texels
-uniform sampler2D	textureMap4;		// complete texture map (fmt 4), 2048x2048 texels
-uniform sampler2D	textureMap5;		// complete texture map (fmt 5), 2048x2048 texels
-uniform sampler2D	textureMap6;		// complete texture map (fmt 6), 2048x2048 texels
-uniform sampler2D	textureMap7;		// complete texture map (fmt 7), 2048x2048 texels
+uniform sampler2DArray	textureMaps;	// texture maps (one per layer, selected by fsTexMap), 2048x2048 texels each
 uniform vec4		spotEllipse;		// spotlight ellipse position: .x=X position (screen coordinates), .y=Y position, .z=half-width, .w=half-height)
 uniform vec2		spotRange;			// spotlight Z range: .x=start (viewspace coordinates), .y=limit
 uniform vec3		spotColor;			// spotlight RGB color
@@ -47,7 +41,7 @@ uniform float		mapSize;			// texture map size (2048,4096,6144 etc)
 varying vec4		fsSubTexture;	// .x=texture X, .y=texture Y, .z=texture width, .w=texture height (all in texels)
 varying vec4		fsTexParams;	// .x=texture enable (if 1, else 0), .y=use transparency (if > 0), .z=U wrap mode (1=mirror, 0=repeat), .w=V wrap mode
 varying float		fsTexFormat;	// T1RGB5 contour texture (if > 0)
-varying float		fsTexMap;		// texture map number
+varying float		fsTexMap;		// texture map number (layer of textureMaps)
 varying float		fsTransLevel;	// translucence level, 0.0 (transparent) to 1.0 (opaque)
 varying vec3		fsLightIntensity;	// lighting intensity 
 varying float		fsSpecularTerm;	// specular highlight
@@ -143,47 +137,10 @@ void main(void)
 		uv_bot = WrapTexelCoords(uv_bot,vec4(fsSubTexture.xy,fsSubTexture.xy),vec4(fsSubTexture.zw,fsSubTexture.zw), vec4(fsTexParams.zw,fsTexParams.zw));
 
 		// Fetch the texels from the given texture map
-		if (fsTexMap < 0.5f)	{
-			c[0]=texture2D(textureMap0, uv_bot.xy);       // bottom-left (base texel)
-			c[1]=texture2D(textureMap0, uv_bot.zw);       // bottom-right
-			c[2]=texture2D(textureMap0, uv_top.xy);       // top-left
-			c[3]=texture2D(textureMap0, uv_top.zw);       // top-right
-		} else if (fsTexMap < 1.5f) {
-            c[0]=texture2D(textureMap1, uv_bot.xy);       // bottom-left (base texel)
-			c[1]=texture2D(textureMap1, uv_bot.zw);       // bottom-right
-			c[2]=texture2D(textureMap1, uv_top.xy);       // top-left
-			c[3]=texture2D(textureMap1, uv_top.zw);       // top-right
-		} else if (fsTexMap < 2.5f) {
-            c[0]=texture2D(textureMap2, uv_bot.xy);       // bottom-left (base texel)
-			c[1]=texture2D(textureMap2, uv_bot.zw);       // bottom-right
-			c[2]=texture2D(textureMap2, uv_top.xy);       // top-left
-			c[3]=texture2D(textureMap2, uv_top.zw);       // top-right
-		} else if (fsTexMap < 3.5f) {
-            c[0]=texture2D(textureMap3, uv_bot.xy);       // bottom-left (base texel)
-			c[1]=texture2D(textureMap3, uv_bot.zw);       // bottom-right
-			c[2]=texture2D(textureMap3, uv_top.xy);       // top-left
-			c[3]=texture2D(textureMap3, uv_top.zw);       // top-right
-		} else if (fsTexMap < 4.5f) {
-            c[0]=texture2D(textureMap4, uv_bot.xy);       // bottom-left (base texel)
-			c[1]=texture2D(textureMap4, uv_bot.zw);       // bottom-right
-			c[2]=texture2D(textureMap4, uv_top.xy);       // top-left
-			c[3]=texture2D(textureMap4, uv_top.zw);       // top-right
-		} else if (fsTexMap < 5.5f) {
-            c[0]=texture2D(textureMap5, uv_bot.xy);       // bottom-left (base texel)
-			c[1]=texture2D(textureMap5, uv_bot.zw);       // bottom-right
-			c[2]=texture2D(textureMap5, uv_top.xy);       // top-left
-			c[3]=texture2D(textureMap5, uv_top.zw);       // top-right
-		} else if (fsTexMap < 6.5f) {
-			c[0]=texture2D(textureMap6, uv_bot.xy);       // bottom-left (base texel)
-			c[1]=texture2D(textureMap6, uv_bot.zw);       // bottom-right
-			c[2]=texture2D(textureMap6, uv_top.xy);       // top-left
-			c[3]=texture2D(textureMap6, uv_top.zw);       // top-right
-		} else {
-            c[0]=texture2D(textureMap7, uv_bot.xy);       // bottom-left (base texel)
-			c[1]=texture2D(textureMap7, uv_bot.zw);       // bottom-right
-			c[2]=texture2D(textureMap7, uv_top.xy);       // top-left
-			c[3]=texture2D(textureMap7, uv_top.zw);       // top-right
-		}                      
+		c[0]=texture2DArray(textureMaps, vec3(uv_bot.xy, fsTexMap));  // bottom-left (base texel)
+		c[1]=texture2DArray(textureMaps, vec3(uv_bot.zw, fsTexMap));  // bottom-right
+		c[2]=texture2DArray(textureMaps, vec3(uv_top.xy, fsTexMap));  // top-left
+		c[3]=texture2DArray(textureMaps, vec3(uv_top.zw, fsTexMap));  // top-right
 
 		// Interpolate texels and blend result with material color to determine final (unlit) fragment color
 		// fragColor = (c[0]*(1.0-r.s)*(1.0-r.t) + c[1]*r.s*(1.0-r.t) + c[2]*(1.0-r.s)*r.t + c[3]*r.s*r.t);
@@ -27,21 +27,25 @@
  * Texture references are stored internally as a 27-bit field (3 bits for format, 6 bits each for x, y, width & height) to save space.
  * 
  * A pre-allocated array is used for storing up to TEXREFS_ARRAY_SIZE texture references.  When that limit is exceeded, it switches
- * to using a hashset to store the texture references, but this requires extra memory allocation.
+ * to a sorted vector, searched in binary, and a bitmap of the sheet's 32x32 texel tiles that the references start on.  Most lookups
+ * are for textures the model doesn't use yet, and the bitmap answers those with a single bit test.
  */
 
 #include "Supermodel.h"
+#include <algorithm>
+#include <new>
 
 namespace Legacy3D {
 
-CTextureRefs::CTextureRefs() : m_size(0), m_hashCapacity(0), m_hashEntries(NULL)
+// Pack texture reference into bitfield
+static inline unsigned PackTexRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height)
 {
-	//
+	return (fmt&7)<<24|(x&0x7E0)<<13|(y&0x7E0)<<7|(width&0x7E0)<<1|(height&0x7E0)>>5;
 }
 
-CTextureRefs::~CTextureRefs()
+CTextureRefs::CTextureRefs() : m_size(0)
 {
-	DeleteAllHashEntries();
+	//
 }
 
 unsigned CTextureRefs::GetSize() const
@@ -51,19 +55,17 @@ unsigned CTextureRefs::GetSize() const
 
 void CTextureRefs::Clear()
 {
-	// Delete all hash entries
-	DeleteAllHashEntries();
+	// Release the vector and bitmap, so that models with few references don't keep them
+	std::vector<unsigned>().swap(m_refs);
+	std::vector<uint64_t>().swap(m_tiles);
 	m_size = 0;
-	m_hashCapacity = 0;
-	m_hashEntries = NULL;
 }
 
-bool CTextureRefs::ContainsRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height)
+bool CTextureRefs::ContainsRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height) const
 {
-	// Pack texture reference into bitfield
-	unsigned texRef = (fmt&7)<<24|(x&0x7E0)<<13|(y&0x7E0)<<7|(width&0x7E0)<<1|(height&0x7E0)>>5;
+	unsigned texRef = PackTexRef(fmt, x, y, width, height);
 	
-	// Check if using array or hashset
+	// Check if using array or vector
 	if (m_size <= TEXREFS_ARRAY_SIZE)
 	{
 		// See if texture reference held in array
@@ -75,16 +77,14 @@ bool CTextureRefs::ContainsRef(unsigned fmt, unsigned x, unsigned y, unsigned wi
 		return false;
 	}
 	else
-		// See if texture reference held in hashset
-		return HashContains(texRef);
+		return TileHeld(texRef) && std::binary_search(m_refs.begin(), m_refs.end(), texRef);
 }
 
 bool CTextureRefs::AddRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height)
 {
-	// Pack texture reference into bitfield
-	unsigned texRef = (fmt&7)<<24|(x&0x7E0)<<13|(y&0x7E0)<<7|(width&0x7E0)<<1|(height&0x7E0)>>5;
+	unsigned texRef = PackTexRef(fmt, x, y, width, height);
 
-	// Check if using array or hashset
+	// Check if using array or vector
 	if (m_size <= TEXREFS_ARRAY_SIZE)
 	{
 		// See if already held in array, if so nothing to do
@@ -93,36 +93,58 @@ bool CTextureRefs::AddRef(unsigned fmt, unsigned x, unsigned y, unsigned width,
 			if (texRef == m_array[i])
 				return true;
 		}
-		// If not, check if array is full
-		if (m_size == TEXREFS_ARRAY_SIZE)
-		{
-			// If so, set initial hashset capacity to 47 to initialize it
-			UpdateHashCapacity(47);
-			// Copy array into hashset
-			for (unsigned i = 0; i < TEXREFS_ARRAY_SIZE; i++)
-				AddToHash(m_array[i]);
-			// Add texture reference to hashset
-			AddToHash(texRef);
-		}
-		else
+		// If not, add texture reference to array if there is room
+		if (m_size < TEXREFS_ARRAY_SIZE)
 		{
-			// Add texture reference to array
 			m_array[m_size] = texRef;
 			m_size++;
+			return true;
+		}
+		// Otherwise, move array into vector
+		try
+		{
+			m_refs.assign(m_array, m_array + TEXREFS_ARRAY_SIZE);
+			m_refs.push_back(texRef);
+			m_tiles.assign(64, 0);
 		}
+		catch (const std::bad_alloc &)
+		{
+			// If couldn't allocate (ie out of memory), let caller know
+			std::vector<unsigned>().swap(m_refs);
+			std::vector<uint64_t>().swap(m_tiles);
+			return false;
+		}
+		std::sort(m_refs.begin(), m_refs.end());
+		BuildTiles();
+		m_size++;
 		return true;
 	}
 	else
-		// Add texture reference to hashset
-		return AddToHash(texRef);
+	{
+		// See if already held in vector, if so nothing to do
+		auto it = std::lower_bound(m_refs.begin(), m_refs.end(), texRef);
+		if (it != m_refs.end() && *it == texRef)
+			return true;
+		// Insert texture reference into vector, keeping it sorted
+		try
+		{
+			m_refs.insert(it, texRef);
+		}
+		catch (const std::bad_alloc &)
+		{
+			return false;
+		}
+		m_tiles[(texRef>>12)&63] |= uint64_t(1) << ((texRef>>18)&63);
+		m_size++;
+		return true;
+	}
 }
 
 bool CTextureRefs::RemoveRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height)
 {
-	// Pack texture reference into bitfield
-	unsigned texRef = (fmt&7)<<24|(x&0x7E0)<<13|(y&0x7E0)<<7|(width&0x7E0)<<1|(height&0x7E0)>>5;
+	unsigned texRef = PackTexRef(fmt, x, y, width, height);
 
-	// Check if using array or hashset
+	// Check if using array or vector
 	if (m_size <= TEXREFS_ARRAY_SIZE)
 	{
 		for (unsigned i = 0; i < m_size; i++)
@@ -139,195 +161,55 @@ bool CTextureRefs::RemoveRef(unsigned fmt, unsigned x, unsigned y, unsigned widt
 	}
 	else 
 	{
-		// Remove texture reference from hashset
-		bool removed = RemoveFromHash(texRef);
+		// Remove texture reference from vector
+		auto it = std::lower_bound(m_refs.begin(), m_refs.end(), texRef);
+		if (it == m_refs.end() || *it != texRef)
+			return false;
+		m_refs.erase(it);
+		m_size--;
 
 		// See if should switch back to array
 		if (m_size == TEXREFS_ARRAY_SIZE)
 		{
-			// Loop through all hash entries and copy texture references into array
-			unsigned j = 0;
-			for (unsigned i = 0; i < m_hashCapacity; i++)
-			{
-				for (HashEntry *entry = m_hashEntries[i]; entry; entry = entry->nextEntry)
-					m_array[j++] = entry->texRef;
-			}
-			// Delete all hash entries
-			DeleteAllHashEntries();
-		}
-		return removed;
-	}
-}
-
-void CTextureRefs::DecodeAllTextures(CLegacy3D *Render3D)
-{
-	// Check if using array or hashset
-	if (m_size <= TEXREFS_ARRAY_SIZE)
-	{
-		// Loop through elements in array and call CLegacy3D::DecodeTexture
-		for (unsigned i = 0; i < m_size; i++)
-		{
-			// Unpack texture reference from bitfield 
-			unsigned texRef = m_array[i];
-			unsigned fmt = texRef>>24;
-			unsigned x = (texRef>>13)&0x7E0;
-			unsigned y = (texRef>>7)&0x7E0;
-			unsigned width = (texRef>>1)&0x7E0;
-			unsigned height = (texRef<<5)&0x7E0;
-			Render3D->DecodeTexture(fmt, x, y, width, height);
-		}
-	}
-	else
-	{
-		// Loop through all hash entriesa and call CLegacy3D::DecodeTexture
-		for (unsigned i = 0; i < m_hashCapacity; i++)
-		{
-			for (HashEntry *entry = m_hashEntries[i]; entry; entry = entry->nextEntry)
-			{
-				// Unpack texture reference from bitfield 
-				unsigned texRef = entry->texRef;
-				unsigned fmt = texRef>>24;
-				unsigned x = (texRef>>13)&0x7E0;
-				unsigned y = (texRef>>7)&0x7E0;
-				unsigned width = (texRef>>1)&0x7E0;
-				unsigned height = (texRef<<5)&0x7E0;
-				Render3D->DecodeTexture(fmt, x, y, width, height);
-			}
-		}
-	}
-}
-
-bool CTextureRefs::UpdateHashCapacity(unsigned capacity)
-{
-	unsigned oldCapacity = m_hashCapacity;
-	HashEntry **oldEntries = m_hashEntries;
-	// Update capacity and create new empty entries array
-	m_hashCapacity = capacity;
-	m_hashEntries = new(std::nothrow) HashEntry*[capacity];
-	if (!m_hashEntries)
-		return false;
-	memset(m_hashEntries, 0, capacity * sizeof(HashEntry*));
-	if (oldEntries)
-	{
-		// Redistribute entries into new entries array
-		for (unsigned i = 0; i < oldCapacity; i++)
-		{
-			HashEntry *entry = oldEntries[i];
-			while (entry)
-			{
-				HashEntry *nextEntry = entry->nextEntry;
-				unsigned hash = entry->texRef % capacity;
-				entry->nextEntry = m_hashEntries[hash];
-				m_hashEntries[hash] = entry;
-				entry = nextEntry;
-			}
+			std::copy(m_refs.begin(), m_refs.end(), m_array);
+			std::vector<unsigned>().swap(m_refs);
+			std::vector<uint64_t>().swap(m_tiles);
 		}
-		// Delete old entries array
-		delete[] oldEntries;
-	}
-	return true;
-}
-
-HashEntry *CTextureRefs::CreateHashEntry(unsigned texRef, bool &hashCapacityUpdated)
-{
-	// Update size and increase hash capacity if required
-	m_size++;
-	hashCapacityUpdated = m_size >= m_hashCapacity;
-	if (hashCapacityUpdated)
-	{
-		if (m_hashCapacity < 89)
-			UpdateHashCapacity(89); // Capacity of 89 gives good sequence of mostly prime capacities (89, 179, 359, 719, 1439, 2879 etc)
 		else
-			UpdateHashCapacity(2 * m_hashCapacity + 1);
-	}
-	return new(std::nothrow) HashEntry(texRef);
-}
-
-void CTextureRefs::DeleteHashEntry(HashEntry *entry)
-{
-	// Update size and delete hash entry
-	m_size--;
-	delete entry;
-}
-
-void CTextureRefs::DeleteAllHashEntries()
-{
-	if (!m_hashEntries)
-		return;
-	// Delete all hash entries and their storage
-	for (unsigned i = 0; i < m_hashCapacity; i++)
-	{
-		HashEntry *entry = m_hashEntries[i];
-		if (entry)
-			delete entry;
+			// Other references may start on the same tile
+			BuildTiles();
+		return true;
 	}
-	delete[] m_hashEntries;
 }
 
-bool CTextureRefs::AddToHash(unsigned texRef)
+void CTextureRefs::DecodeAllTextures(CLegacy3D *Render3D) const
 {
-	// Convert texture reference to hash value
-	unsigned hash = texRef % m_hashCapacity;
-	// Loop through linked list for hash value and see if have texture reference already
-	HashEntry *headEntry = m_hashEntries[hash];
-	HashEntry *entry = headEntry;
-	while (entry && texRef != entry->texRef)
-		entry = entry->nextEntry;
-	// If found, nothing to do
-	if (entry)
-		return true;
-	// Otherwise, create new hash entry for texture reference
-	bool hashCapacityUpdated;
-	entry = CreateHashEntry(texRef, hashCapacityUpdated);
-	// If couldn't create entry (ie out of memory), let caller know
-	if (!entry)
-		return false;
-	if (hashCapacityUpdated)
+	const unsigned *texRefs = m_size <= TEXREFS_ARRAY_SIZE ? m_array : m_refs.data();
+	for (unsigned i = 0; i < m_size; i++)
 	{
-		// If hash capacity was increased recalculate hash value
-		hash = texRef % m_hashCapacity;
-		headEntry = m_hashEntries[hash];
+		// Unpack texture reference from bitfield 
+		unsigned texRef = texRefs[i];
+		unsigned fmt = texRef>>24;
+		unsigned x = (texRef>>13)&0x7E0;
+		unsigned y = (texRef>>7)&0x7E0;
+		unsigned width = (texRef>>1)&0x7E0;
+		unsigned height = (texRef<<5)&0x7E0;
+		Render3D->QueueTexture(fmt, x, y, width, height);
 	}
-	// Store hash entry in linked list for hash value
-	entry->nextEntry = headEntry;
-	m_hashEntries[hash] = entry;
-	return true;
+	Render3D->DecodeQueuedTextures();
 }
 
-bool CTextureRefs::RemoveFromHash(unsigned texRef)
+bool CTextureRefs::TileHeld(unsigned texRef) const
 {
-	// Convert texture reference to hash value
-	unsigned hash = texRef % m_hashCapacity;
-	// Loop through linked list for hash value and see if have texture reference
-	HashEntry *entry = m_hashEntries[hash];
-	HashEntry *prevEntry = NULL;
-	while (entry && texRef != entry->texRef)
-	{
-		prevEntry = entry;
-		entry = entry->nextEntry;
-    }
-	// If not found, nothing to do
-	if (!entry)
-		return false;
-	// Otherwise, remove entry from linked list for hash value
-	if (prevEntry)	
-		prevEntry->nextEntry = entry->nextEntry;
-	else
-		m_hashEntries[hash] = entry->nextEntry;
-	// Delete hash entry storage
-	DeleteHashEntry(entry);
-	return true;
+	// Row is the tile's y, bit is its x
+	return (m_tiles[(texRef>>12)&63] >> ((texRef>>18)&63)) & 1;
 }
 
-bool CTextureRefs::HashContains(unsigned texRef) const
+void CTextureRefs::BuildTiles()
 {
-	// Convert texture reference to hash value
-	unsigned hash = texRef % m_hashCapacity;
-	// Loop through linked list for hash value and see if have texture reference
-	HashEntry *entry = m_hashEntries[hash];
-	while (entry && texRef != entry->texRef)
-		entry = entry->nextEntry;
-	return !!entry;
+	std::fill(m_tiles.begin(), m_tiles.end(), 0);
+	for (unsigned texRef : m_refs)
+		m_tiles[(texRef>>12)&63] |= uint64_t(1) << ((texRef>>18)&63);
 }
 
 } // Legacy3D
@@ -28,19 +28,13 @@
 #ifndef INCLUDED_TEXTUREREFS_H
 #define INCLUDED_TEXTUREREFS_H
 
+#include <cstdint>
+#include <vector>
+
 namespace Legacy3D {
 
 #define TEXREFS_ARRAY_SIZE 12
 
-// Hash entry that holds a texture reference in the hashset
-struct HashEntry
-{
-	const unsigned texRef;	// Texture reference as a bitfield
-	HashEntry *nextEntry;   // Next entry with the same hash
-  
-	HashEntry(unsigned theTexRef) : texRef(theTexRef), nextEntry(NULL) { }
-};
-
 class CLegacy3D;
 
 class CTextureRefs
@@ -53,13 +47,6 @@ public:
 	 */
     CTextureRefs();
     
-	/*
-	 * ~CTextureRefs():
-	 *
-	 * Destructor.
-	 */
-    ~CTextureRefs();
-
 	/*
 	 * GetSize():
 	 *
@@ -79,7 +66,7 @@ public:
 	 *
 	 * Returns true if holds the given texture reference.
 	 */
-	bool ContainsRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height);
+	bool ContainsRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height) const;
 
 	/*
 	 * AddRef(fmt, x, y, width, height):
@@ -96,11 +83,12 @@ public:
 	bool RemoveRef(unsigned fmt, unsigned x, unsigned y, unsigned width, unsigned height);
 
 	/*
-	 * RemoveRef(fmt, x, y, width, height):
+	 * DecodeAllTextures(Render3D):
 	 *
-	 * Decodes all texture references held, calling CLegacy3D::DecodeTexture for each one.
+	 * Decodes all texture references held, queuing them with CLegacy3D::QueueTexture and then decoding them together with
+	 * CLegacy3D::DecodeQueuedTextures.
 	 */
-	void DecodeAllTextures(CLegacy3D *Render3D);
+	void DecodeAllTextures(CLegacy3D *Render3D) const;
 
 private:
 	// Number of texture references held.
@@ -109,58 +97,26 @@ private:
 	// Pre-allocated array used to hold first TEXREFS_ARRAY_SIZE texture references.
 	unsigned m_array[TEXREFS_ARRAY_SIZE];
 
-	// Dynamically allocated hashset used to hold texture references when there are more than TEXREFS_ARRAY_SIZE.
-	unsigned m_hashCapacity;
-	HashEntry **m_hashEntries;
-    
-	/*
-	 * UpdateHashCapacity(hashCapacity)
-	 *
-	 * Increases capacity of the hashset to given size.
-	 */
-	bool UpdateHashCapacity(unsigned hashCapacity);
-
-	/*
-	 * CreateHashEntry(texRef, hashCapacityUpdated)
-	 *
-	 * Creates and returns a new hash entry, updating the capacity if required (hashCapacityUpdated is set to true).
-	 */
-	HashEntry *CreateHashEntry(unsigned texRef, bool &hashCapacityUpdated);
+	// Sorted texture references, used when there are more than TEXREFS_ARRAY_SIZE.
+	std::vector<unsigned> m_refs;
 
-	/*
-	 * DeleteHashEntry(entry)
-	 *
-	 * Deletes the given hash entry and its storage.
-	 */
-	void DeleteHashEntry(HashEntry *entry);
-	
-	/*
-	 * DeleteAllHashEntries()
-	 *
-	 * Deletes all hash entries and their storage.
-	 */
-    void DeleteAllHashEntries();
-	
-	/*
-	 * AddToHash(texRef)
-	 *
-	 * Adds the given texture reference (as a bitfield) to the hashset.
-	 */
-	bool AddToHash(unsigned texRef);
+	// Bitmap of the 32x32 texel tiles of the sheet (64 rows of 64) that the references in m_refs start on, so that
+	// references anywhere else are turned away without searching.
+	std::vector<uint64_t> m_tiles;
 
 	/*
-	 * RemoveFromHash(texRef)
+	 * TileHeld(texRef)
 	 *
-	 * Removes the given texture reference (as a bitfield) from the hashset.
+	 * Returns true if a reference held in m_refs starts on the same tile as the given one (as a bitfield).
 	 */
-	bool RemoveFromHash(unsigned texRef);
+	bool TileHeld(unsigned texRef) const;
 
 	/*
-	 * HashContains(texRef)
+	 * BuildTiles()
 	 *
-	 * Returns true if given texture reference (as a bitfield) is held in the hashset.
+	 * Rebuilds m_tiles from m_refs.
 	 */
-    bool HashContains(unsigned texRef) const;
+	void BuildTiles();
 };
 
 } // Legacy3D
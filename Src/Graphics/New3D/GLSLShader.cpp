@@ -1,4 +1,5 @@
 #include "GLSLShader.h"
+#include "Graphics/ShaderCache.h"
 #include <stdio.h>
 
 GLSLShader::GLSLShader() {
@@ -24,6 +25,14 @@ GLSLShader::~GLSLShader() {
 bool GLSLShader::LoadShaders(const char *vertexShader, const char *fragmentShader) {
 
 	m_program = glCreateProgram();
+
+	const char* sources[2] = { vertexShader, fragmentShader };
+	UINT64 key = CShaderCache::Shared().Key(sources, 2);
+
+	if (CShaderCache::Shared().Load(m_program, key)) {
+		return true;		// no shader objects, deleting 0 is ignored
+	}
+
 	m_vShader = glCreateShader(GL_VERTEX_SHADER);
 	m_fShader = glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -36,12 +45,20 @@ bool GLSLShader::LoadShaders(const char *vertexShader, const char *fragmentShade
 	glAttachShader(m_program, m_vShader);
 	glAttachShader(m_program, m_fShader);
 
+	CShaderCache::Shared().PrepareLink(m_program);
 	glLinkProgram(m_program);
 
 	PrintShaderInfoLog(m_vShader);
 	PrintShaderInfoLog(m_fShader);
 	PrintProgramInfoLog(m_program);
 
+	GLint linked = GL_FALSE;
+	glGetProgramiv(m_program, GL_LINK_STATUS, &linked);
+
+	if (linked) {
+		CShaderCache::Shared().Store(m_program, key);
+	}
+
 	return true;
 }
 
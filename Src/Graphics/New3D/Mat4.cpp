@@ -1,4 +1,5 @@
 #include "Mat4.h"
+#include "SIMDMath.h"
 #include <cmath>
 #include <utility>
 
@@ -25,22 +26,7 @@ void Mat4::LoadIdentity()
 
 void Mat4::MultiMatrices(const float a[16], const float b[16], float r[16]) 
 {
-#define A(row,col)  a[(col<<2)+row]
-#define B(row,col)  b[(col<<2)+row]
-#define P(row,col)  r[(col<<2)+row]
-
-	int i;
-	for (i = 0; i < 4; i++) {
-		const float ai0 = A(i, 0), ai1 = A(i, 1), ai2 = A(i, 2), ai3 = A(i, 3);
-		P(i, 0) = ai0 * B(0, 0) + ai1 * B(1, 0) + ai2 * B(2, 0) + ai3 * B(3, 0);
-		P(i, 1) = ai0 * B(0, 1) + ai1 * B(1, 1) + ai2 * B(2, 1) + ai3 * B(3, 1);
-		P(i, 2) = ai0 * B(0, 2) + ai1 * B(1, 2) + ai2 * B(2, 2) + ai3 * B(3, 2);
-		P(i, 3) = ai0 * B(0, 3) + ai1 * B(1, 3) + ai2 * B(2, 3) + ai3 * B(3, 3);
-	}
-
-#undef A
-#undef B
-#undef p
+	SIMDMath::MultMatrices(a, b, r);
 }
 
 void Mat4::Copy(const float in[16], float out[16])
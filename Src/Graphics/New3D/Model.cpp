@@ -1,7 +1,76 @@
 #include "Model.h"
+#include <algorithm>
 
 namespace New3D {
 
+static INT32 RoundClamped(float f, float scale)
+{
+	f = std::min(std::max(f, -1.0f), 1.0f);
+
+	return (INT32)(f * scale + scale + 1.5f) - (INT32)scale - 1;		// rounds without branching on the sign, which is unpredictable
+}
+
+static UINT32 PackSigned10(float f)
+{
+	return (UINT32)RoundClamped(f, 511.0f) & 0x3FF;
+}
+
+static UINT32 PackNormal(const float n[3])
+{
+	return PackSigned10(n[0]) | (PackSigned10(n[1]) << 10) | (PackSigned10(n[2]) << 20);
+}
+
+static UINT16 FloatToHalf(float f)
+{
+	UINT32 bits;
+	memcpy(&bits, &f, sizeof(bits));
+
+	UINT32 sign		= (bits >> 16) & 0x8000;
+	INT32  exponent	= (INT32)((bits >> 23) & 0xFF) - 127 + 15;
+	UINT32 mantissa	= bits & 0x7FFFFF;
+
+	if (exponent >= 31) {
+		return (UINT16)(sign | 0x7C00);						// too big, or inf/nan, becomes inf
+	}
+
+	if (exponent <= 0) {
+		if (exponent < -10) {
+			return (UINT16)sign;							// too small even for a denormal
+		}
+
+		mantissa |= 0x800000;								// denormal, make the implicit 1 explicit
+		UINT32 shift	= 14 - exponent;
+		UINT32 half		= mantissa >> shift;
+		UINT32 rest		= mantissa & ((1u << shift) - 1);
+
+		half += (rest > (1u << (shift - 1))) | ((rest == (1u << (shift - 1))) & (half & 1));		// round to nearest even
+
+		return (UINT16)(sign | half);
+	}
+
+	UINT32 half = sign | (exponent << 10) | (mantissa >> 13);
+	UINT32 rest = mantissa & 0x1FFF;
+
+	half += (rest > 0x1000) | ((rest == 0x1000) & (half & 1));	// round to nearest even, without a branch as it's unpredictable, may carry into the exponent which is what we want
+
+	return (UINT16)half;
+}
+
+PackedVertex::PackedVertex(const FVertex& v)
+{
+	pos[0]			= v.pos[0];
+	pos[1]			= v.pos[1];
+	pos[2]			= v.pos[2];
+	normal			= PackNormal(v.normal);
+	texcoords[0]	= FloatToHalf(v.texcoords[0]);
+	texcoords[1]	= FloatToHalf(v.texcoords[1]);
+	fixedShade		= (INT16)RoundClamped(v.fixedShade, 32767.0f);
+	pad				= 0;
+	faceNormal		= PackNormal(v.faceNormal);
+
+	for (int i = 0; i < 4; i++) { faceColour[i] = v.faceColour[i]; }
+}
+
 NodeAttributes::NodeAttributes()
 {
 	currentTexOffsetX	= 0;
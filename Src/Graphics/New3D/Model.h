@@ -98,6 +98,20 @@ struct FVertex : Vertex			// full vertex including face attributes
 	}
 };
 
+struct PackedVertex				// optional compact gpu copy of an FVertex, 32 bytes instead of 56
+{
+	float	pos[3];				// w is always 1
+	UINT32	normal;				// 2_10_10_10 signed normalised
+	UINT16	texcoords[2];		// half floats
+	INT16	fixedShade;			// signed normalised
+	INT16	pad;
+	UINT8	faceColour[4];
+	UINT32	faceNormal;			// 2_10_10_10 signed normalised, the same for every vertex of a polygon
+
+	PackedVertex() {}
+	PackedVertex(const FVertex& v);
+};
+
 enum class Layer { colour, trans1, trans2, trans12 /*both 1&2*/, all, none };
 
 struct Mesh
@@ -164,17 +178,20 @@ struct Mesh
 
 	// opengl resources
 	int vboOffset		= 0;			// this will be calculated later
-	int vertexCount		= 0;			// /3 for triangles /4 for quads
+	int vertexCount		= 0;			// vertices are shared between the polygons that use them
+	int iboOffset		= 0;
+	int indexCount		= 0;			// /3 for triangles /4 for quads
 };
 
 struct SortingMesh : public Mesh		// This struct temporarily holds the model data, before it gets copied to the main buffer
 {
 	std::vector<FVertex> verts;
+	std::vector<UINT32> indices;		// into verts
 };
 
 struct Model
 {
-	std::shared_ptr<std::vector<Mesh>> meshes;	// this reason why this is a shared ptr to an array, is that multiple models might use the same meshes
+	int meshes = -1;	// index of the mesh list in the renderer's pool, rather than the meshes themselves, as multiple models might use the same meshes
 
 	//which memory are we in
 	bool dynamic = true;
@@ -1,16 +1,30 @@
-﻿#include "New3D.h"
+﻿#include "Supermodel.h"
+#include "New3D.h"
 #include "Texture.h"
 #include "Vec.h"
 #include <cmath>
 #include <algorithm>
 #include <limits>
+#include <atomic>
+#include <tuple>
 #include <string.h>
 #include "R3DFloat.h"
+#include "SIMDMath.h"
+#include "Util/JobSystem.h"
+#include "Graphics/GPUTimer.h"
+#include "Util/Trace.h"
 
 #define MAX_RAM_VERTS 300000	
 #define MAX_ROM_VERTS 1500000
+#define ROM_VERTS_STEP 65536	// growth of the rom polys in low memory mode
+#define MAX_WARM_UP_VERTS (MAX_ROM_VERTS*3/4)	// leave room for models not seen before
+#define MAX_RAM_INDICES (MAX_RAM_VERTS*2)	// a little over 1.5 per vertex for quads sharing vertices, 3 if none are shared
+#define MAX_ROM_INDICES (MAX_ROM_VERTS*2)
+#define SHARED_VERTEX_WINDOW 8				// vertices looked back over for one to share, enough for the last two polygons
+#define MAX_INSTANCES 16384					// model matrices of instanced draws per frame, models past this are drawn one at a time
 
-#define BYTE_TO_FLOAT(B)	((2.0f * (B) + 1.0f) * (1.0F/255.0f))
+#define MODEL_CACHE_FILE_VERSION 1
+#define MAX_CULLING_FORK_DEPTH 2			// pointer lists nested deeper than this are walked on the thread that found them
 
 namespace New3D {
 
@@ -33,11 +47,62 @@ CNew3D::CNew3D(const Util::Config::Node &config, std::string gameName)
 		m_numPolyVerts	= 4;
 		m_primType		= GL_LINES_ADJACENCY;
 	}
+
+	m_parallelCulling = config["New3DParallelCulling"].ValueAsDefault<bool>(true) && Util::JobSystem::Shared().NumWorkers() > 0;
+
+	m_textureSheetEnabled = config["New3DTextureSheet"].ValueAsDefault<bool>(false);
+
+	m_compressTextures = config["New3DCompressTextures"].ValueAsDefault<bool>(false) && !m_textureSheetEnabled;
+
+	m_packedVertices = config["New3DPackedVertices"].ValueAsDefault<bool>(false);
+
+	m_asyncLos = config["New3DAsyncLos"].ValueAsDefault<bool>(false);
+
+	m_boxClipping = config["New3DBoxClipping"].ValueAsDefault<bool>(false);
+
+	m_scaleTarget	= UINT32(std::max(config["New3DDynamicScale"].ValueAsDefault<int>(0), 0)) * 1000;
+	m_minScale		= std::max(10, std::min(100, config["New3DMinScale"].ValueAsDefault<int>(50))) / 100.0f;
+	m_maxScale		= std::max(10, std::min(100, config["New3DMaxScale"].ValueAsDefault<int>(100))) / 100.0f;
+	m_minScale		= std::min(m_minScale, m_maxScale);
+	m_renderScale	= m_scaleTarget ? m_maxScale : 1.0f;
+	m_scaleFrames	= 0;
+
+	m_instancing = config["New3DInstancing"].ValueAsDefault<bool>(false);
+
+	m_frontToBack = config["New3DFrontToBack"].ValueAsDefault<bool>(false);
+
+	m_multisample = config["New3DMultisample"].ValueAsDefault<int>(0);
+
+	m_overlapBuild		= config["New3DOverlapBuild"].ValueAsDefault<bool>(false) && Util::JobSystem::Shared().NumWorkers() > 0;
+	m_buildPending		= false;
+	m_repeatFrames		= config["New3DRepeatFrames"].ValueAsDefault<bool>(true);
+	m_frameKept			= false;
+	m_vboSyncPending	= false;
+
+	m_lowMemory = config["LowMemory"].ValueAsDefault<bool>(false);
+	m_texSheet.SetLowMemory(m_lowMemory);
+	m_texSheet.SetCacheBudget(m_lowMemory ? 0 : size_t(std::max(config["New3DTextureCacheMB"].ValueAsDefault<int>(64), 0)) << 20);
+
+	m_modelCacheEnabled = config["New3DModelCache"].ValueAsDefault<bool>(false) && !m_gameName.empty();
+	m_modelCacheFile	= "NVRAM/" + m_gameName + ".models";
+
+	if (m_modelCacheEnabled) {
+		LoadModelCache();
+	}
 }
 
 CNew3D::~CNew3D()
 {
+	if (m_modelCacheEnabled) {
+		SaveModelCache();
+	}
+
+	m_texSheet.SaveCompressed();
+
+	ReleaseLosReadbacks();
 	m_vbo.Destroy();
+	m_ibo.Destroy();
+	m_instanceVbo.Destroy();
 }
 
 void CNew3D::AttachMemory(const UINT32 *cullingRAMLoPtr, const UINT32 *cullingRAMHiPtr, const UINT32 *polyRAMPtr, const UINT32 *vromPtr, const UINT16 *textureRAMPtr)
@@ -66,32 +131,120 @@ void CNew3D::SetStepping(int stepping)
 		m_vertexFactor = (1.0f / 128.0f);		// 17.7
 	}
 
-	m_vbo.Create(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, sizeof(FVertex) * (MAX_RAM_VERTS + MAX_ROM_VERTS));
+	if (m_packedVertices && !(GLEW_ARB_vertex_type_2_10_10_10_rev && GLEW_ARB_half_float_vertex)) {
+		m_packedVertices = false;
+	}
+
+	m_vertexSize = m_packedVertices ? sizeof(PackedVertex) : sizeof(FVertex);
+
+	m_vbo.Create(GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW, m_vertexSize * (MAX_RAM_VERTS + MAX_ROM_VERTS), nullptr, true);
+	m_ibo.Create(GL_ELEMENT_ARRAY_BUFFER, GL_DYNAMIC_DRAW, sizeof(UINT32) * (MAX_RAM_INDICES + MAX_ROM_INDICES), nullptr, true);
+
+	ClearDynamicModels();		// the vertex format has changed, and they are no longer in the vbo
 }
 
 bool CNew3D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXResParam, unsigned totalYResParam)
 {
-	// Resolution and offset within physical display area
-	m_xRatio	= xRes / 496.0f;
-	m_yRatio	= yRes / 384.0f;
-	m_xOffs		= xOffset;
-	m_yOffs		= yOffset;
-	m_xRes    = xRes;
-	m_yRes    = yRes;
-	m_totalXRes	= totalXResParam;
-	m_totalYRes = totalYResParam;
-
 	m_r3dShader.LoadShader();
 
-	m_r3dFrameBuffers.CreateFBO(totalXResParam, totalYResParam);
+	Resize(xOffset, yOffset, xRes, yRes, totalXResParam, totalYResParam);
+
+	if (m_asyncLos && !(GLEW_ARB_pixel_buffer_object && GLEW_ARB_sync)) {
+		m_asyncLos = false;
+	}
+
+	if (m_instancing && !GLEW_VERSION_3_3) {		// instanced arrays
+		m_instancing = false;
+	}
+
+	if (m_compressTextures && !GLEW_EXT_texture_compression_s3tc) {
+		m_compressTextures = false;
+	}
+
+	m_texSheet.SetCompression(m_compressTextures, m_gameName.empty() ? "" : "NVRAM/" + m_gameName + ".textures");
+
+	if (m_instancing) {
+		m_instanceVbo.Create(GL_ARRAY_BUFFER, GL_STREAM_DRAW, sizeof(Model::modelMat) * MAX_INSTANCES);
+	}
 
 	glUseProgram(0);
 
 	return OKAY;	// OKAY ? wtf ..
 }
 
+bool CNew3D::Resize(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXResParam, unsigned totalYResParam)
+{
+	// Resolution and offset within physical display area
+	m_display[0] = xOffset;
+	m_display[1] = yOffset;
+	m_display[2] = xRes;
+	m_display[3] = yRes;
+	m_display[4] = totalXResParam;
+	m_display[5] = totalYResParam;
+
+	// the frame buffers are all that depend on size
+	m_r3dFrameBuffers.DestroyFBO();
+	m_r3dFrameBuffers.CreateFBO(totalXResParam, totalYResParam, m_multisample);
+	m_frameKept = false;
+
+	SetRenderScale(m_renderScale);
+
+	return OKAY;
+}
+
+void CNew3D::SetRenderScale(float scale)
+{
+	m_renderScale = scale;
+
+	m_xOffs		= (unsigned)(m_display[0] * scale + 0.5f);
+	m_yOffs		= (unsigned)(m_display[1] * scale + 0.5f);
+	m_xRes		= (unsigned)(m_display[2] * scale + 0.5f);
+	m_yRes		= (unsigned)(m_display[3] * scale + 0.5f);
+	m_totalXRes	= (unsigned)(m_display[4] * scale + 0.5f);
+	m_totalYRes	= (unsigned)(m_display[5] * scale + 0.5f);
+	m_xRatio	= m_xRes / 496.0f;
+	m_yRatio	= m_yRes / 384.0f;
+
+	m_r3dFrameBuffers.SetDrawSize(m_totalXRes, m_totalYRes);
+}
+
+void CNew3D::UpdateRenderScale()
+{
+	if (!m_scaleTarget) {
+		return;
+	}
+
+	// timings are a frame or two old, so give the last change time to show up in them
+	if (++m_scaleFrames < 4) {
+		return;
+	}
+
+	const UINT32* micros = CGPUTimer::Shared().Micros();
+
+	if (!micros[CGPUTimer::Opaque3D]) {
+		return;											// no timer queries, or the frame timed was repeated rather than drawn
+	}
+
+	m_scaleFrames = 0;
+
+	UINT32 gpuTime = micros[CGPUTimer::Opaque3D] + micros[CGPUTimer::Trans3D] + micros[CGPUTimer::Composite3D] + micros[CGPUTimer::ScrollFog3D];
+
+	// time goes with the number of pixels, the square of the scale. Go half way there, in 1/32 steps, so that it settles
+	// rather than chasing every change in the timings
+	float scale = m_renderScale * std::sqrt((float)m_scaleTarget / gpuTime);
+	scale = m_renderScale + (scale - m_renderScale) * 0.5f;
+	scale = std::round(scale * 32) / 32;
+	scale = std::max(m_minScale, std::min(m_maxScale, scale));
+
+	if (scale != m_renderScale) {
+		SetRenderScale(scale);
+	}
+}
+
 void CNew3D::UploadTextures(unsigned level, unsigned x, unsigned y, unsigned width, unsigned height)
 {
+	m_texSheet.InvalidateSheets(x, y, width, height);	// mipmaps sit in the sheet too, so every level counts
+
 	if (level == 0) {
 		m_texSheet.Invalidate(x, y, width, height);		// base textures only
 	} 
@@ -155,8 +308,12 @@ CheckScroll:
 						rgba[1] == n.viewport.fogParams[1] &&
 						rgba[2] == n.viewport.fogParams[2]) {
 
-						glViewport(n.viewport.x, n.viewport.y, n.viewport.width, n.viewport.height);
-						m_r3dScrollFog.DrawScrollFog(rgba, n.viewport.scrollAtt, n.viewport.fogParams[6], n.viewport.spotFogColor, n.viewport.spotEllipse);
+						// drawn on the back buffer, so back to full scale
+						float s = 1.0f / m_renderScale;
+						float spotEllipse[4] = { n.viewport.spotEllipse[0] * s, n.viewport.spotEllipse[1] * s, n.viewport.spotEllipse[2] * s, n.viewport.spotEllipse[3] * s };
+
+						glViewport((GLint)(n.viewport.x * s), (GLint)(n.viewport.y * s), (GLsizei)(n.viewport.width * s + 0.5f), (GLsizei)(n.viewport.height * s + 0.5f));
+						m_r3dScrollFog.DrawScrollFog(rgba, n.viewport.scrollAtt, n.viewport.fogParams[6], n.viewport.spotFogColor, spotEllipse);
 						return;
 					}
 				}
@@ -168,30 +325,68 @@ CheckScroll:
 
 bool CNew3D::RenderScene(int priority, bool renderOverlay, Layer layer)
 {
+	TRACE_ZONE("CNew3D::RenderScene");
+
 	bool hasOverlay = false;		// (high priority polys)
 
+	// Meshes are drawn in scene order, but consecutive ones that need no state change in between (same model
+	// matrix, textures and mesh uniforms) are queued up and submitted together with glMultiDrawElements
+	DrawStates states;
+
+	// With instancing, opaque ROM models repeated within a viewport are all drawn where the first of them is, one
+	// instanced draw per mesh. Their order doesn't matter to the depth test, but it does to the transparent layers
+	bool instanced = m_instancing && layer == Layer::colour;
+
+	// Sorting the opaque models nearest first lets the depth test reject what is behind them before it is shaded,
+	// at the cost of fewer draws sharing states. Fill rate matters more than that at high resolutions
+	bool sorted = m_frontToBack && layer == Layer::colour;
+
 	for (auto &n : m_nodes) {
 
 		if (n.viewport.priority != priority || n.models.empty()) {
 			continue;
 		}
 
-		std::shared_ptr<Texture> tex1;
+		FlushDraws();
 
 		CalcViewport(&n.viewport, std::abs(m_nfPairs[priority].zNear*0.96f), std::abs(m_nfPairs[priority].zFar*1.05f));	// make planes 5% bigger
 		glViewport(n.viewport.x, n.viewport.y, n.viewport.width, n.viewport.height);
 
 		m_r3dShader.SetViewportUniforms(&n.viewport);
 
-		for (auto &m : n.models) {
+		if (instanced) {
+			GroupInstances(n);
+		}
+
+		if (sorted) {
+			SortModels(n);
+		}
+
+		for (size_t k = 0; k < n.models.size(); k++) {
 
+			size_t i = sorted ? m_drawOrder[k].second : k;
+			const Model& m = n.models[i];
+			const InstanceGroup* group = nullptr;
 			bool matrixLoaded = false;
 
-			if (m.meshes->empty()) {
+			if (MeshList(m.meshes).empty()) {
 				continue;
 			}
 
-			for (auto &mesh : *m.meshes) {
+			if (instanced && m_instanceGroupOf[i] >= 0) {
+				group = &m_instanceGroups[m_instanceGroupOf[i]];
+				if (group->leader != (int)i) {
+					continue;		// drawn along with the group's first model, which has the same meshes
+				}
+				SetInstanceArrays(group->offset);
+			}
+
+			for (auto &mesh : MeshList(m.meshes)) {
+
+				// overflowed the buffers, so not uploaded, until they are cleared
+				if (mesh.vboOffset + mesh.vertexCount > MAX_ROM_VERTS + MAX_RAM_VERTS || mesh.iboOffset + mesh.indexCount > MAX_ROM_INDICES + MAX_RAM_INDICES) {
+					continue;
+				}
 
 				if (mesh.highPriority) {
 					hasOverlay = true;
@@ -201,45 +396,300 @@ bool CNew3D::RenderScene(int priority, bool renderOverlay, Layer layer)
 				if (mesh.highPriority != renderOverlay) continue;
 
 				if (!matrixLoaded) {
-					m_r3dShader.SetModelStates(&m);
+					if (!m_r3dShader.ModelStatesMatch(&m)) {	// models are often drawn one after another with the same matrix
+						FlushDraws();
+						m_r3dShader.SetModelStates(&m);
+					}
 					matrixLoaded = true;		// do this here to stop loading matrices we don't need. Ie when rendering non transparent etc
 				}
-				
-				if (mesh.textured) {
 
-					int x, y;
-					CalcTexOffset(m.textureOffsetX, m.textureOffsetY, m.page, mesh.x, mesh.y, x, y);
+				SetMeshStates(m, mesh, states);
 
-					if (tex1 && tex1->Compare(x, y, mesh.width, mesh.height, mesh.format)) {
-						// texture already bound
-					}
-					else {
-						tex1 = m_texSheet.BindTexture(m_textureRAM, mesh.format, x, y, mesh.width, mesh.height);
-						if (tex1) {
-							tex1->BindTexture();
-						}
-					}
+				if (group) {
+					glDrawElementsInstanced(m_primType, mesh.indexCount, GL_UNSIGNED_INT, (const GLvoid*)(mesh.iboOffset * sizeof(UINT32)), group->count);
+				}
+				else {
+					QueueDraw(mesh.iboOffset, mesh.indexCount);
+				}
+			}
 
-					if (mesh.microTexture) {
+			if (group) {
+				SetInstanceArrays(-1);
+			}
+		}
+	}
 
-						int mX, mY;
-						glActiveTexture(GL_TEXTURE1);
-						m_texSheet.GetMicrotexPos(y / 1024, mesh.microTextureID, mX, mY);
-						auto tex2 = m_texSheet.BindTexture(m_textureRAM, 0, mX, mY, 128, 128);
-						if (tex2) {
-							tex2->BindTexture();
-						}
-						glActiveTexture(GL_TEXTURE0);
-					}
+	FlushDraws();
+
+	return hasOverlay;
+}
+
+void CNew3D::SetMeshStates(const Model& m, const Mesh& mesh, DrawStates& states)
+{
+	if (mesh.textured) {
+
+		int x, y;
+		CalcTexOffset(m.textureOffsetX, m.textureOffsetY, m.page, mesh.x, mesh.y, x, y);
+
+		if (m_textureSheetEnabled) {
+			BindTextureSheets(mesh, x, y, states.sheetFormat, states.microSheetBound);
+		}
+		else if (states.tex1 && states.tex1->Compare(x, y, mesh.width, mesh.height, mesh.format)) {
+			// texture already bound
+		}
+		else {
+			FlushDraws();
+			states.tex1 = m_texSheet.BindTexture(m_textureRAM, mesh.format, x, y, mesh.width, mesh.height);
+			if (states.tex1) {
+				states.tex1->BindTexture();
+			}
+		}
+
+		if (mesh.microTexture && !m_textureSheetEnabled) {
+
+			int mX, mY;
+			m_texSheet.GetMicrotexPos(y / 1024, mesh.microTextureID, mX, mY);
+
+			if (states.tex2 && states.tex2->Compare(mX, mY, 128, 128, 0)) {
+				// microtexture already bound
+			}
+			else {
+				FlushDraws();
+				glActiveTexture(GL_TEXTURE1);
+				states.tex2 = m_texSheet.BindTexture(m_textureRAM, 0, mX, mY, 128, 128);
+				if (states.tex2) {
+					states.tex2->BindTexture();
 				}
-				
-				m_r3dShader.SetMeshUniforms(&mesh);
-				glDrawArrays(m_primType, mesh.vboOffset, mesh.vertexCount);
+				glActiveTexture(GL_TEXTURE0);
 			}
 		}
 	}
+	
+	if (!m_r3dShader.MeshUniformsMatch(&mesh)) {
+		FlushDraws();
+		m_r3dShader.SetMeshUniforms(&mesh);
+	}
+}
 
-	return hasOverlay;
+void CNew3D::GroupInstances(const Node& n)
+{
+	m_instanceGroups.clear();
+	m_instanceGroupOf.assign(n.models.size(), -1);
+	m_instanceOrder.clear();
+	m_instanceMatrices.clear();
+
+	// stencilled meshes depend on the order polys are drawn in, and instances would draw them mesh by mesh
+	for (int i = 0; i < (int)n.models.size(); i++) {
+
+		const Model& m = n.models[i];
+
+		if (m.dynamic || MeshList(m.meshes).empty()) {
+			continue;
+		}
+
+		if (!HasLayeredMeshes(m)) {
+			m_instanceOrder.push_back(i);
+		}
+	}
+
+	// everything but the matrix must match, the stable sort keeps each run in scene order
+	auto key = [&n](int i) {
+		const Model& m = n.models[i];
+		return std::make_tuple(m.meshes, m.scale, m.textureOffsetX, m.textureOffsetY, m.page);
+	};
+
+	std::stable_sort(m_instanceOrder.begin(), m_instanceOrder.end(), [&key](int a, int b) { return key(a) < key(b); });
+
+	size_t last;
+
+	for (size_t first = 0; first < m_instanceOrder.size(); first = last) {
+
+		for (last = first + 1; last < m_instanceOrder.size() && key(m_instanceOrder[last]) == key(m_instanceOrder[first]); last++) {}
+
+		if (last - first < 2) {
+			continue;
+		}
+
+		InstanceGroup group;
+		group.leader	= m_instanceOrder[first];
+		group.count		= (int)(last - first);
+		group.offset	= m_instanceVbo.GetSize() + m_instanceMatrices.size() * sizeof(float);
+
+		for (size_t j = first; j < last; j++) {
+			const Model& m = n.models[m_instanceOrder[j]];
+			m_instanceMatrices.insert(m_instanceMatrices.end(), m.modelMat, m.modelMat + 16);
+			m_instanceGroupOf[m_instanceOrder[j]] = (int)m_instanceGroups.size();
+		}
+
+		m_instanceGroups.push_back(group);
+	}
+
+	if (m_instanceGroups.empty()) {
+		return;
+	}
+
+	m_instanceVbo.Bind(true);
+	bool uploaded = m_instanceVbo.AppendData(m_instanceMatrices.size() * sizeof(float), m_instanceMatrices.data());
+	m_vbo.Bind(true);
+
+	if (!uploaded) {
+		m_instanceGroups.clear();							// out of room this frame, they are drawn one at a time
+		m_instanceGroupOf.assign(n.models.size(), -1);
+	}
+}
+
+void CNew3D::SortModels(const Node& n)
+{
+	m_drawOrder.clear();
+
+	// by the distance to their origin, and a stable sort keeps the scene order of models at the same depth. Stencilled
+	// meshes depend on the order they are drawn in, so models with them come last, in scene order
+	for (int i = 0; i < (int)n.models.size(); i++) {
+
+		const Model& m = n.models[i];
+		float distance = -m.modelMat[14];		// the camera looks down -z
+
+		if (HasLayeredMeshes(m)) {
+			distance = std::numeric_limits<float>::infinity();
+		}
+
+		m_drawOrder.emplace_back(distance, i);
+	}
+
+	std::stable_sort(m_drawOrder.begin(), m_drawOrder.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first < b.first; });
+}
+
+bool CNew3D::HasLayeredMeshes(const Model& m)
+{
+	for (const auto& mesh : MeshList(m.meshes)) {
+		if (mesh.layered) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CNew3D::SetInstanceArrays(GLintptr offset)
+{
+	FlushDraws();
+
+	if (offset >= 0) {
+
+		// a column of the model matrix per attribute location, stepping once per instance
+		m_instanceVbo.Bind(true);
+
+		for (int i = 0; i < 4; i++) {
+			glEnableVertexAttribArray(6 + i);
+			glVertexAttribPointer(6 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Model::modelMat), (const GLvoid*)(offset + i * 4 * sizeof(float)));
+			glVertexAttribDivisor(6 + i, 1);
+		}
+
+		m_vbo.Bind(true);
+	}
+	else {
+
+		for (int i = 0; i < 4; i++) {
+			glDisableVertexAttribArray(6 + i);
+		}
+
+		m_r3dShader.InvalidateModelStates();		// the constant matrix is undefined after drawing from an array
+	}
+}
+
+void CNew3D::BindTextureSheets(const Mesh& mesh, int x, int y, int& sheetFormat, bool& microSheetBound)
+{
+	// no binds at all unless the format changes, the shader just needs to know where the texture is
+
+	if (mesh.format != sheetFormat) {
+		FlushDraws();
+		m_texSheet.BindSheet(m_textureRAM, mesh.format);
+		sheetFormat = mesh.format;
+	}
+
+	int mX = 0, mY = 0;
+
+	if (mesh.microTexture) {
+
+		m_texSheet.GetMicrotexPos(y / 1024, mesh.microTextureID, mX, mY);
+
+		if (!microSheetBound) {
+			FlushDraws();
+			glActiveTexture(GL_TEXTURE1);
+			m_texSheet.BindSheet(m_textureRAM, 0);
+			glActiveTexture(GL_TEXTURE0);
+			microSheetBound = true;
+		}
+	}
+
+	if (!m_r3dShader.TexturePositionsMatch(x & 2047, y & 2047, mX, mY)) {
+		FlushDraws();
+		m_r3dShader.SetTexturePositions(x & 2047, y & 2047, mX, mY);
+	}
+}
+
+void CNew3D::QueueDraw(int first, int count)
+{
+	if (m_drawFirst.size() && m_drawFirst.back() + m_drawCount.back() == first) {
+		m_drawCount.back() += count;		// meshes next to each other in the IBO become one range
+		return;
+	}
+
+	m_drawFirst.push_back(first);
+	m_drawCount.push_back(count);
+}
+
+void CNew3D::FlushDraws()
+{
+	if (m_drawFirst.size() == 1) {
+		glDrawElements(m_primType, m_drawCount[0], GL_UNSIGNED_INT, (const GLvoid*)(m_drawFirst[0] * sizeof(UINT32)));
+	}
+	else if (m_drawFirst.size() > 1) {
+
+		m_drawOffsets.clear();
+
+		for (GLint first : m_drawFirst) {
+			m_drawOffsets.push_back((const GLvoid*)(first * sizeof(UINT32)));
+		}
+
+		glMultiDrawElements(m_primType, m_drawCount.data(), GL_UNSIGNED_INT, m_drawOffsets.data(), (GLsizei)m_drawFirst.size());
+	}
+
+	m_drawFirst.clear();
+	m_drawCount.clear();
+}
+
+void CNew3D::PrefetchTextures()
+{
+	if (m_textureSheetEnabled) {
+		return;		// whole sheets are decoded when they are first bound
+	}
+
+	for (const auto &n : m_nodes) {
+
+		for (const auto &m : n.models) {
+
+			for (const auto &mesh : MeshList(m.meshes)) {
+
+				if (!mesh.textured) {
+					continue;
+				}
+
+				int x, y;
+				CalcTexOffset(m.textureOffsetX, m.textureOffsetY, m.page, mesh.x, mesh.y, x, y);
+				m_texSheet.Prefetch(m_textureRAM, mesh.format, x, y, mesh.width, mesh.height);
+
+				if (mesh.microTexture) {
+					int mX, mY;
+					m_texSheet.GetMicrotexPos(y / 1024, mesh.microTextureID, mX, mY);
+					m_texSheet.Prefetch(m_textureRAM, 0, mX, mY, 128, 128);
+				}
+			}
+		}
+	}
+
+	m_texSheet.DecodePending();
+	m_texSheet.CompressStable(m_textureRAM);		// textures drawn for a while are likely to be from VROM, and to stay
 }
 
 bool CNew3D::SkipLayer(int layer)
@@ -258,6 +708,7 @@ bool CNew3D::SkipLayer(int layer)
 void CNew3D::SetRenderStates()
 {
 	m_vbo.Bind(true);
+	m_ibo.Bind(true);
 	m_r3dShader.SetShader(true);
 
 	glEnableVertexAttribArray(0);
@@ -268,12 +719,22 @@ void CNew3D::SetRenderStates()
 	glEnableVertexAttribArray(5);
 
 	// before draw, specify vertex and index arrays with their offsets, offsetof is maybe evil ..
-	glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inVertex"), 4, GL_FLOAT, GL_FALSE, sizeof(FVertex), 0);
-	glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inNormal"), 3, GL_FLOAT, GL_FALSE, sizeof(FVertex), (void*)offsetof(FVertex, normal));
-	glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inTexCoord"), 2, GL_FLOAT, GL_FALSE, sizeof(FVertex), (void*)offsetof(FVertex, texcoords));
-	glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inColour"), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FVertex), (void*)offsetof(FVertex, faceColour));
-	glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inFaceNormal"), 3, GL_FLOAT, GL_FALSE, sizeof(FVertex), (void*)offsetof(FVertex, faceNormal));
-	glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inFixedShade"), 1, GL_FLOAT, GL_FALSE, sizeof(FVertex), (void*)offsetof(FVertex, fixedShade));
+	if (m_packedVertices) {
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inVertex"), 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), 0);
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inNormal"), 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inTexCoord"), 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texcoords));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inColour"), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, faceColour));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inFaceNormal"), 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, faceNormal));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inFixedShade"), 1, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, fixedShade));
+	}
+	else {
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inVertex"), 4, GL_FLOAT, GL_FALSE, sizeof(FVertex), 0);
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inNormal"), 3, GL_FLOAT, GL_FALSE, sizeof(FVertex), (void*)offsetof(FVertex, normal));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inTexCoord"), 2, GL_FLOAT, GL_FALSE, sizeof(FVertex), (void*)offsetof(FVertex, texcoords));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inColour"), 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FVertex), (void*)offsetof(FVertex, faceColour));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inFaceNormal"), 3, GL_FLOAT, GL_FALSE, sizeof(FVertex), (void*)offsetof(FVertex, faceNormal));
+		glVertexAttribPointer(m_r3dShader.GetVertexAttribPos("inFixedShade"), 1, GL_FLOAT, GL_FALSE, sizeof(FVertex), (void*)offsetof(FVertex, fixedShade));
+	}
 
 	glDepthFunc		(GL_LEQUAL);
 	glEnable		(GL_DEPTH_TEST);
@@ -290,6 +751,7 @@ void CNew3D::SetRenderStates()
 void CNew3D::DisableRenderStates()
 {
 	m_vbo.Bind(false);
+	m_ibo.Bind(false);
 	m_r3dShader.SetShader(false);
 
 	glDisable(GL_STENCIL_TEST);
@@ -303,52 +765,135 @@ void CNew3D::DisableRenderStates()
 }
 
 void CNew3D::RenderFrame(void)
+{
+	if (m_buildPending) {
+		WaitForBuild();
+	}
+	else {
+		BuildFrame();
+	}
+
+	SubmitFrame();
+}
+
+void CNew3D::BuildFrame()
 {
 	for (int i = 0; i < 4; i++) {
 		m_nfPairs[i].zNear = -std::numeric_limits<float>::max();
 		m_nfPairs[i].zFar  =  std::numeric_limits<float>::max();
 	}
 
-	for (int i = 0; i < 4; i++) {
-		m_lineOfSight[i] = 0;
+	// release any resources from last frame, keeping the memory for this one
+	for (auto &n : m_nodes) {
+		n.models.clear();
+		if (m_spareNodes.size() == m_spareNodes.capacity()) {
+			m_frameAllocations++;
+		}
+		m_spareNodes.emplace_back(std::move(n));
 	}
 
-	// release any resources from last frame
-	m_polyBufferRam.clear();		// clear dyanmic model memory buffer
 	m_nodes.clear();				// memory will grow during the object life time, that's fine, no need to shrink to fit
-	m_modelMat.Release();			// would hope we wouldn't need this but no harm in checking
-	m_nodeAttribs.Reset();
+	RecycleMeshLists();
+	CompactDynamicModels();			// ram models drawn last frame stay in the buffer to be reused
+	m_walk.modelMat.Release();		// would hope we wouldn't need this but no harm in checking
+	m_walk.attribs.Reset();
+
+	if (m_warmUpModels.size()) {
+		WarmUpModelCache();							// ROM models drawn last time go into the VBO with this frame's
+	}
 
 	RenderViewport(0x800000);						// build model structure
+}
+
+void CNew3D::WaitForBuild()
+{
+	Util::JobSystem::Shared().Wait(m_buildGroup);
+	m_buildPending = false;
+}
+
+void CNew3D::SubmitFrame()
+{
+	if (m_asyncLos) {
+		ResolveLosReadbacks();			// values from earlier frames, for as long as the game keeps asking
+	}
+	else {
+		for (int i = 0; i < 4; i++) {
+			m_lineOfSight[i] = 0;
+		}
+	}
+
+	if (m_vboSyncPending) {
+		m_vbo.Sync();					// recent frames may still be drawing from where the models are about to be uploaded to
+		m_ibo.Sync();
+		m_vboSyncPending = false;
+	}
+
+	PrefetchTextures();								// so drawing only has to bind them
+	CGPUTimer::Shared().Begin(CGPUTimer::ScrollFog3D);
 	DrawScrollFog();								// fog layer if applicable must be drawn here
+	CGPUTimer::Shared().End();
 	
 	m_vbo.Bind(true);
-	m_vbo.BufferSubData(MAX_ROM_VERTS*sizeof(FVertex), m_polyBufferRam.size()*sizeof(FVertex), m_polyBufferRam.data());	// upload all the dynamic data to GPU in one go
+	m_ibo.Bind(true);
+
+	// upload the dynamic data converted this frame to GPU in one go, if we have overflowed the ram part of the vbo the models past the end aren't drawn, until compaction makes room
+	size_t ramVerts = std::min(m_polyBufferRam.size(), (size_t)MAX_RAM_VERTS);
+
+	if (ramVerts > m_ramUploadStart) {
+		m_vbo.BufferSubData((MAX_ROM_VERTS + m_ramUploadStart) * m_vertexSize, (ramVerts - m_ramUploadStart) * m_vertexSize, VertexData(&m_polyBufferRam[m_ramUploadStart], ramVerts - m_ramUploadStart));
+	}
+
+	m_ramUploadStart = m_polyBufferRam.size();
+
+	size_t ramIndices = std::min(m_polyIndicesRam.size(), (size_t)MAX_RAM_INDICES);
+
+	if (ramIndices > m_ramIndexUploadStart) {
+		m_ibo.BufferSubData((MAX_ROM_INDICES + m_ramIndexUploadStart) * sizeof(UINT32), (ramIndices - m_ramIndexUploadStart) * sizeof(UINT32), IndexData(&m_polyIndicesRam[m_ramIndexUploadStart], ramIndices - m_ramIndexUploadStart, MAX_ROM_VERTS));
+	}
+
+	m_ramIndexUploadStart = m_polyIndicesRam.size();
 
 	if (m_polyBufferRom.size()) {
 
 		// sync rom memory with vbo
-		int romBytes	= (int)m_polyBufferRom.size() * sizeof(FVertex);
-		int vboBytes	= m_vbo.GetSize();
-		int size		= romBytes - vboBytes;
-
-		if (size) {
+		int romVerts	= (int)m_polyBufferRom.size();
+		int vboVerts	= m_vbo.GetSize() / m_vertexSize;
+		int size		= romVerts - vboVerts;
+		int romIndices	= (int)m_polyIndicesRom.size();
+		int iboIndices	= m_ibo.GetSize() / sizeof(UINT32);
+		int indexSize	= romIndices - iboIndices;
+
+		if (size || indexSize) {
 			//check we haven't blown up the memory buffers
 			//we will lose rom models for 1 frame is this happens, not the end of the world, as probably won't ever happen anyway
-			if (m_polyBufferRom.size() >= MAX_ROM_VERTS) {
+			if (m_polyBufferRom.size() >= MAX_ROM_VERTS || m_polyIndicesRom.size() >= MAX_ROM_INDICES) {
 				m_polyBufferRom.clear();
+				m_polyIndicesRom.clear();
+				for (auto &it : m_romMap) {
+					ReleaseMeshList(it.second);
+				}
 				m_romMap.clear();
 				m_vbo.Reset();
+				m_ibo.Reset();
 			}
 			else {
-				m_vbo.AppendData(size, &m_polyBufferRom[vboBytes / sizeof(FVertex)]);
+				m_vbo.AppendData(size * m_vertexSize, VertexData(&m_polyBufferRom[vboVerts], size));
+				m_ibo.AppendData(indexSize * sizeof(UINT32), IndexData(&m_polyIndicesRom[iboIndices], indexSize, 0));
 			}
 		}
 	}
 
+	if (m_instancing) {
+		m_instanceVbo.Reset();						// matrices of instanced draws are uploaded as each viewport is drawn
+	}
+
 	m_r3dFrameBuffers.SetFBO(Layer::trans12);
 	glClear(GL_COLOR_BUFFER_BIT);					// wipe both trans layers
 
+	bool transDrawn		= false;					// nothing to mask in the trans layers until a trans pass has run
+	bool baseDeferred	= false;					// the last opaque pass is composited along with the trans layers
+	bool baseDrawn		= false;					// an opaque pass has been composited on its own, so isn't kept in the layers
+
 	for (int pri = 0; pri <= 3; pri++) {
 
 		//==============
@@ -361,6 +906,8 @@ void CNew3D::RenderFrame(void)
 
 			bool renderOverlay = (i == 1);
 
+			CGPUTimer::Shared().Begin(CGPUTimer::Opaque3D);
+
 			m_r3dFrameBuffers.SetFBO(Layer::colour);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 			
@@ -376,8 +923,27 @@ void CNew3D::RenderFrame(void)
 
 			DisableRenderStates();
 
-			m_r3dFrameBuffers.DrawOverTransLayers();			// mask trans layer with opaque pixels
-			m_r3dFrameBuffers.CompositeBaseLayer();				// copy opaque pixels to back buffer
+			CGPUTimer::Shared().End();
+			CGPUTimer::Shared().Begin(CGPUTimer::Composite3D);
+
+			if (transDrawn) {
+				m_r3dFrameBuffers.DrawOverTransLayers();		// mask trans layer with opaque pixels
+			}
+
+			// the colour layer isn't drawn on again after the last opaque pass, so it can wait for the final composite
+			baseDeferred = renderOverlay || !hasOverlay;
+
+			for (int next = pri + 1; next <= 3 && baseDeferred; next++) {
+				baseDeferred = SkipLayer(next);
+			}
+
+			if (!baseDeferred) {
+				m_r3dFrameBuffers.CompositeBaseLayer();			// copy opaque pixels to back buffer
+				baseDrawn = true;
+			}
+
+			CGPUTimer::Shared().End();
+			CGPUTimer::Shared().Begin(CGPUTimer::Trans3D);
 
 			SetRenderStates();
 			
@@ -394,19 +960,66 @@ void CNew3D::RenderFrame(void)
 
 			DisableRenderStates();
 
+			transDrawn = true;
+
+			CGPUTimer::Shared().End();
+
 			if (!hasOverlay) break;								// no high priority polys						
 		}
 	}
 
-	m_r3dFrameBuffers.CompositeAlphaLayer();
+	CGPUTimer::Shared().Begin(CGPUTimer::Composite3D);
+
+	if (baseDeferred) {
+		m_r3dFrameBuffers.Draw();						// opaque and trans layers in one pass
+	}
+	else {
+		m_r3dFrameBuffers.CompositeAlphaLayer();
+	}
+
+	CGPUTimer::Shared().End();
+
+	m_frameKept = baseDeferred && !baseDrawn;
+}
+
+bool CNew3D::CanRepeatFrame(void) const
+{
+	return m_repeatFrames && m_frameKept;
+}
+
+void CNew3D::RepeatFrame(void)
+{
+	if (m_asyncLos) {
+		ResolveLosReadbacks();			// what was read back from the frame being repeated, the values drawn are the same
+	}
+
+	CGPUTimer::Shared().Begin(CGPUTimer::ScrollFog3D);
+	DrawScrollFog();					// the nodes of the last frame are still there
+	CGPUTimer::Shared().End();
+
+	CGPUTimer::Shared().Begin(CGPUTimer::Composite3D);
+	m_r3dFrameBuffers.Draw();
+	CGPUTimer::Shared().End();
 }
 
 void CNew3D::BeginFrame(void)
 {
+	UpdateRenderScale();							// before the frame is built at that scale
+
+	if (m_overlapBuild && !m_buildPending) {
+		m_buildPending = true;
+		Util::JobSystem::Shared().Submit(m_buildGroup, [this]() { BuildFrame(); });
+	}
 }
 
 void CNew3D::EndFrame(void)
 {
+	if (m_buildPending) {
+		WaitForBuild();					// begun but never rendered
+	}
+
+	m_vbo.EndFrame();
+	m_ibo.EndFrame();
 }
 
 /******************************************************************************
@@ -443,15 +1056,40 @@ const UINT32* CNew3D::TranslateModelAddress(UINT32 modelAddr)
 	}
 }
 
-bool CNew3D::DrawModel(UINT32 modelAddr)
+void CNew3D::QueueModel(CullingWalk& walk, UINT32 modelAddr)
+{
+	walk.commands.emplace_back();
+
+	CullingCommand& cmd = walk.commands.back();
+
+	cmd.colorTable	= false;
+	cmd.addr		= modelAddr;
+	cmd.clipStatus	= walk.attribs.currentClipStatus;
+	cmd.texOffsetX	= walk.attribs.currentTexOffsetX;
+	cmd.texOffsetY	= walk.attribs.currentTexOffsetY;
+	cmd.page		= walk.attribs.currentPage;
+	cmd.scale		= walk.attribs.currentModelScale;
+
+	for (int i = 0; i < 16; i++) {
+		cmd.modelMat[i] = walk.modelMat.currentMatrix[i];
+	}
+}
+
+bool CNew3D::DrawModel(const CullingCommand& cmd)
 {
 	const UINT32*	modelAddress;
 	bool			cached = false;
 	Model*			m;
+	UINT32			modelAddr = cmd.addr;
+	DynamicModel*	dynamicModel = nullptr;
 
 	modelAddress = TranslateModelAddress(modelAddr);
 
 	// create a new model to push onto the vector
+	if (m_nodes.back().models.size() == m_nodes.back().models.capacity()) {
+		m_frameAllocations++;
+	}
+
 	m_nodes.back().models.emplace_back();
 
 	// get the last model in the array
@@ -461,38 +1099,78 @@ bool CNew3D::DrawModel(UINT32 modelAddr)
 
 		// try to find meshes in the rom cache
 
-		m->meshes = m_romMap[modelAddr];	// will create an entry with a null pointer if empty
+		auto it = m_romMap.find(modelAddr);
 
-		if (m->meshes) {
+		if (it != m_romMap.end()) {
+			m->meshes = it->second;
 			cached = true;
 		}
 		else {
-			m->meshes = std::make_shared<std::vector<Mesh>>();
+			m->meshes = NewMeshList();
 			m_romMap[modelAddr] = m->meshes;		// store meshes in our rom map here
 		}
 
 		m->dynamic = false;
 	}
 	else {
-		m->meshes = std::make_shared<std::vector<Mesh>>();
+
+		// reuse the last conversion of this model if nothing it was built from has changed
+
+		UINT64 hash = HashDynamicModel(modelAddress);
+
+		dynamicModel = &m_dynamicMap[((UINT64)m_colorTableAddr << 32) | modelAddr];
+
+		if (dynamicModel->meshes >= 0 && dynamicModel->hash == hash) {
+
+			m->meshes = dynamicModel->meshes;
+			cached = true;
+
+			memcpy(m_prev, dynamicModel->prev, sizeof(m_prev));
+			memcpy(m_prevTexCoords, dynamicModel->prevTexCoords, sizeof(m_prevTexCoords));
+		}
+		else {
+			if (dynamicModel->meshes >= 0) {
+				ReleaseMeshList(dynamicModel->meshes);
+			}
+
+			m->meshes = NewMeshList();
+
+			dynamicModel->hash		= hash;
+			dynamicModel->meshes	= m->meshes;
+			dynamicModel->first		= (int)m_polyBufferRam.size();	// any previous vertices are left as a gap until the next compaction
+			dynamicModel->indexFirst	= (int)m_polyIndicesRam.size();
+		}
+
+		dynamicModel->used = true;
 	}
 
-	// copy current model matrix
+	// copy model matrix at the time the model was found
 	for (int i = 0; i < 16; i++) {
-		m->modelMat[i] = m_modelMat.currentMatrix[i];
+		m->modelMat[i] = cmd.modelMat[i];
 	}
 
 	// update texture offsets
-	m->textureOffsetX = m_nodeAttribs.currentTexOffsetX;
-	m->textureOffsetY = m_nodeAttribs.currentTexOffsetY;
-	m->page = m_nodeAttribs.currentPage;
-	m->scale = m_nodeAttribs.currentModelScale;
+	m->textureOffsetX = cmd.texOffsetX;
+	m->textureOffsetY = cmd.texOffsetY;
+	m->page = cmd.page;
+	m->scale = cmd.scale;
 
 	if (!cached) {
 		CacheModel(m, modelAddress);
+
+		if (dynamicModel) {
+			dynamicModel->count = (int)m_polyBufferRam.size() - dynamicModel->first;
+			dynamicModel->indexCount = (int)m_polyIndicesRam.size() - dynamicModel->indexFirst;
+
+			memcpy(dynamicModel->prev, m_prev, sizeof(m_prev));
+			memcpy(dynamicModel->prevTexCoords, m_prevTexCoords, sizeof(m_prevTexCoords));
+		}
 	}
 
-	if (m_nodeAttribs.currentClipStatus != Clip::INSIDE) {
+	if (cmd.clipStatus == Clip::INTERCEPT && m_boxClipping) {
+		// already covered by the culling box
+	}
+	else if (cmd.clipStatus != Clip::INSIDE) {
 		ClipModel(m);	// not storing clipped values, only working out the Z range
 	}
 
@@ -500,7 +1178,7 @@ bool CNew3D::DrawModel(UINT32 modelAddr)
 }
 
 // Descends into a 10-word culling node
-void CNew3D::DescendCullingNode(UINT32 addr)
+void CNew3D::DescendCullingNode(CullingWalk& walk, UINT32 addr)
 {
 	enum class NodeType { undefined = -1, viewport = 0, rootNode = 1, cullingNode = 2 };
 
@@ -514,7 +1192,7 @@ void CNew3D::DescendCullingNode(UINT32 addr)
 	UINT8			lodTablePointer;
 	NodeType		nodeType;
 
-	if (m_nodeAttribs.StackLimit()) {
+	if (walk.attribs.StackLimit()) {
 		return;
 	}
 
@@ -539,47 +1217,51 @@ void CNew3D::DescendCullingNode(UINT32 addr)
 	// parse siblings 
 	if ((node[0x00] & 0x07) != 0x06) {						// colour table seems to indicate no siblings
 		if (!(sibling2Ptr & 0x1000000) && sibling2Ptr) {
-			DescendCullingNode(sibling2Ptr);				// no need to mask bit, would already be zero
+			DescendCullingNode(walk, sibling2Ptr);			// no need to mask bit, would already be zero
 		}
 	}
 
 	if ((node[0x00] & 0x04)) {
-		m_colorTableAddr = ((node[0x03 - m_offset] >> 19) << 0) | ((node[0x07 - m_offset] >> 28) << 13) | ((node[0x08 - m_offset] >> 25) << 17);
-		m_colorTableAddr &= 0x000FFFFF; // clamp to 4MB (in words) range
+		UINT32 colorTableAddr = ((node[0x03 - m_offset] >> 19) << 0) | ((node[0x07 - m_offset] >> 28) << 13) | ((node[0x08 - m_offset] >> 25) << 17);
+		walk.commands.emplace_back();
+		walk.commands.back().colorTable	= true;
+		walk.commands.back().addr		= colorTableAddr & 0x000FFFFF; // clamp to 4MB (in words) range
 	}
 
-	m_nodeAttribs.Push();	// save current attribs
+	walk.attribs.Push();	// save current attribs
 
 	if (!m_offset) {		// Step 1.5+
 		
 		float modelScale = *(float *)&node[1];
 		if (modelScale > std::numeric_limits<float>::min()) {
-			m_nodeAttribs.currentModelScale = modelScale;
+			walk.attribs.currentModelScale = modelScale;
 		}
 
 		// apply texture offsets, else retain current ones
 		if ((node[0x02] & 0x8000))	{
 			int tx = 32 * ((node[0x02] >> 7) & 0x3F);
 			int ty = 32 * (node[0x02] & 0x1F);
-			m_nodeAttribs.currentTexOffsetX	= tx;
-			m_nodeAttribs.currentTexOffsetY = ty;
-			m_nodeAttribs.currentPage = (node[0x02] & 0x4000) >> 14;
+			walk.attribs.currentTexOffsetX	= tx;
+			walk.attribs.currentTexOffsetY = ty;
+			walk.attribs.currentPage = (node[0x02] & 0x4000) >> 14;
 		}
 	}
 
 	// Apply matrix and translation
-	m_modelMat.PushMatrix();
+	walk.modelMat.PushMatrix();
+	UINT64 parentMatrixState = walk.matrixState;
 
 	// apply translation vector
 	if (node[0x00] & 0x10) {
 		float x = *(float *)&node[0x04 - m_offset];
 		float y = *(float *)&node[0x05 - m_offset];
 		float z = *(float *)&node[0x06 - m_offset];
-		m_modelMat.Translate(x, y, z);
+		walk.modelMat.Translate(x, y, z);
+		walk.matrixState = walk.nextMatrixState++;
 	}
 	// multiply matrix, if specified
 	else if (matrixOffset) {
-		MultMatrix(matrixOffset,m_modelMat);
+		ApplyMatrix(walk, matrixOffset);
 	}
 
 	uCullRadius = node[9 - m_offset] & 0xFFFF;
@@ -588,25 +1270,22 @@ void CNew3D::DescendCullingNode(UINT32 addr)
 	uBlendRadius = node[9 - m_offset] >> 16;
 	fBlendRadius = R3DFloat::GetFloat16(uBlendRadius);
 
-	if (m_nodeAttribs.currentClipStatus != Clip::INSIDE) {
+	if (walk.attribs.currentClipStatus != Clip::INSIDE) {
 
 		if (uCullRadius != R3DFloat::Pro16BitMax) {
 
-			CalcBox(fCullRadius, bbox);
-			TransformBox(m_modelMat, bbox);
-
-			m_nodeAttribs.currentClipStatus = ClipBox(bbox, m_planes);
+			walk.attribs.currentClipStatus = SIMDMath::TransformClipBox(walk.modelMat, fCullRadius, m_planes, bbox.points);
 
-			if (m_nodeAttribs.currentClipStatus == Clip::INSIDE) {
-				CalcBoxExtents(bbox);
+			if (walk.attribs.currentClipStatus == Clip::INSIDE || (walk.attribs.currentClipStatus == Clip::INTERCEPT && m_boxClipping)) {
+				CalcBoxExtents(walk.nfPair, bbox);
 			}
 		}
 		else {
-			m_nodeAttribs.currentClipStatus = Clip::NOT_SET;
+			walk.attribs.currentClipStatus = Clip::NOT_SET;
 		}
 	}
 
-	if (m_nodeAttribs.currentClipStatus != Clip::OUTSIDE && fCullRadius > R3DFloat::Pro16BitFltMin) {
+	if (walk.attribs.currentClipStatus != Clip::OUTSIDE && fCullRadius > R3DFloat::Pro16BitFltMin) {
 
 		// Descend down first link
 		if ((node[0x00] & 0x08))	// 4-element LOD table
@@ -615,26 +1294,27 @@ void CNew3D::DescendCullingNode(UINT32 addr)
 
 			if (NULL != lodTable) {
 				if ((node[0x03 - m_offset] & 0x20000000)) {
-					DescendCullingNode(lodTable[0] & 0xFFFFFF);
+					DescendCullingNode(walk, lodTable[0] & 0xFFFFFF);
 				}
 				else {
-					DrawModel(lodTable[0] & 0xFFFFFF);	//TODO
+					QueueModel(walk, lodTable[0] & 0xFFFFFF);	//TODO
 				}
 			}
 		}
 		else {
-			DescendNodePtr(child1Ptr);
+			DescendNodePtr(walk, child1Ptr);
 		}
 
 	}
 
-	m_modelMat.PopMatrix();
+	walk.modelMat.PopMatrix();
+	walk.matrixState = parentMatrixState;
 
 	// Restore old texture offsets
-	m_nodeAttribs.Pop();
+	walk.attribs.Pop();
 }
 
-void CNew3D::DescendNodePtr(UINT32 nodeAddr)
+void CNew3D::DescendNodePtr(CullingWalk& walk, UINT32 nodeAddr)
 {
 	// Ignore null links
 	if ((nodeAddr & 0x00FFFFFF) == 0) {
@@ -644,20 +1324,20 @@ void CNew3D::DescendNodePtr(UINT32 nodeAddr)
 	switch ((nodeAddr >> 24) & 0x5)		// pointer type encoded in upper 8 bits
 	{
 	case 0x00:
-		DescendCullingNode(nodeAddr & 0xFFFFFF);
+		DescendCullingNode(walk, nodeAddr & 0xFFFFFF);
 		break;
 	case 0x01:
-		DrawModel(nodeAddr & 0xFFFFFF);
+		QueueModel(walk, nodeAddr & 0xFFFFFF);
 		break;
 	case 0x04:
-		DescendPointerList(nodeAddr & 0xFFFFFF);
+		DescendPointerList(walk, nodeAddr & 0xFFFFFF);
 		break;
 	default:
 		break;
 	}
 }
 
-void CNew3D::DescendPointerList(UINT32 addr)
+void CNew3D::DescendPointerList(CullingWalk& walk, UINT32 addr)
 {
 	const UINT32*	list;
 	UINT32			nodeAddr;
@@ -671,6 +1351,46 @@ void CNew3D::DescendPointerList(UINT32 addr)
 
 	index = 0;
 
+	if (m_parallelCulling && walk.forkDepth < MAX_CULLING_FORK_DEPTH) {
+
+		// each entry gets its own walk, starting from this one's state, and the commands are joined up again in list order
+
+		std::vector<UINT32> entries;
+
+		while (!(list[index] & 0x01000000)) {		// empty list
+			entries.push_back(list[index] & 0x00FFFFFF);
+			if (list[index] & 0x02000000) {
+				break;	// list end
+			}
+			index++;
+		}
+
+		if (entries.size() > 1) {
+
+			std::vector<CullingWalk> walks(entries.size());
+
+			Util::JobSystem::Shared().ParallelFor(entries.size(), [&](size_t i) {
+				walks[i].attribs	= walk.attribs;
+				walks[i].modelMat	= walk.modelMat;
+				walks[i].matrixState		= walk.matrixState;
+				walks[i].nextMatrixState	= NewMatrixStates();
+				walks[i].nfPair		= walk.nfPair;
+				walks[i].forkDepth	= walk.forkDepth + 1;
+				DescendCullingNode(walks[i], entries[i]);
+			});
+
+			for (const auto& w : walks) {
+				walk.commands.insert(walk.commands.end(), w.commands.begin(), w.commands.end());
+				walk.nfPair.zNear	= std::max(walk.nfPair.zNear, w.nfPair.zNear);
+				walk.nfPair.zFar	= std::min(walk.nfPair.zFar, w.nfPair.zFar);
+			}
+
+			return;
+		}
+
+		index = 0;
+	}
+
 	while (true) {
 
 		if (list[index] & 0x01000000) {
@@ -679,7 +1399,7 @@ void CNew3D::DescendPointerList(UINT32 addr)
 
 		nodeAddr = list[index] & 0x00FFFFFF;	// clear upper 8 bits to ensure this is processed as a culling node
 
-		DescendCullingNode(nodeAddr);
+		DescendCullingNode(walk, nodeAddr);
 
 		if (list[index] & 0x02000000) {
 			break;	// list end
@@ -732,6 +1452,58 @@ void CNew3D::MultMatrix(UINT32 matrixOffset, Mat4& mat)
 	mat.MultMatrix(m);
 }
 
+/*
+* ApplyMatrix():
+*
+* Multiplies the walk's matrix by a matrix from the matrix base, as MultMatrix(), remembering the product. When the
+* same matrix is applied to the same state again, by siblings sharing a matrix or by a subtree drawn more than once,
+* the product is copied instead of worked out again, along with its state, so the rest of the subtree finds its
+* products too.
+*
+* Every state of every walk has its own number, never reused, so products from earlier frames can't be found again
+* and the products need no clearing. They are kept per thread, as forked walks run on the job system's threads.
+*/
+
+struct MatrixProduct
+{
+	UINT64	parent	= 0;	// state multiplied
+	UINT32	offset	= 0;	// by this matrix
+	UINT64	state	= 0;	// giving this state
+	float	matrix[16];
+};
+
+static const int MATRIX_PRODUCTS = 1024;						// per thread, a power of 2
+static std::atomic<UINT64> s_matrixStateBlocks(1);				// 0 is no state
+static thread_local std::vector<MatrixProduct> t_matrixProducts;
+
+UINT64 CNew3D::NewMatrixStates()
+{
+	return s_matrixStateBlocks++ << 32;		// enough for any walk
+}
+
+void CNew3D::ApplyMatrix(CullingWalk& walk, UINT32 matrixOffset)
+{
+	if (t_matrixProducts.empty()) {
+		t_matrixProducts.resize(MATRIX_PRODUCTS);
+	}
+
+	UINT64 key = (walk.matrixState ^ (UINT64(matrixOffset) << 20)) * 0x9E3779B97F4A7C15ULL;
+	MatrixProduct& product = t_matrixProducts[key >> 54];
+
+	if (product.parent == walk.matrixState && product.offset == matrixOffset) {
+		memcpy(walk.modelMat.currentMatrix, product.matrix, sizeof(product.matrix));
+		walk.matrixState = product.state;
+		return;
+	}
+
+	MultMatrix(matrixOffset, walk.modelMat);
+
+	product.parent	= walk.matrixState;
+	product.offset	= matrixOffset;
+	product.state	= walk.matrixState = walk.nextMatrixState++;
+	memcpy(product.matrix, walk.modelMat.currentMatrix, sizeof(product.matrix));
+}
+
 /*
 * InitMatrixStack():
 *
@@ -782,6 +1554,8 @@ void CNew3D::InitMatrixStack(UINT32 matrixBaseAddr, Mat4& mat)
 // Draws viewports of the given priority
 void CNew3D::RenderViewport(UINT32 addr)
 {
+	TRACE_ZONE("CNew3D::RenderViewport");
+
 	static const GLfloat	color[8][3] =
 	{											// RGB1 color translation
 		{ 0.0, 0.0, 0.0 },	// off
@@ -807,9 +1581,21 @@ void CNew3D::RenderViewport(UINT32 addr)
 
 	if (!(vpnode[0] & 0x20)) {	// only if viewport enabled
 
-		// create node object 
-		m_nodes.emplace_back(Node());
-		m_nodes.back().models.reserve(2048);				// create space for models
+		// create node object, reusing one from an earlier frame if there is one
+		if (m_nodes.size() == m_nodes.capacity()) {
+			m_frameAllocations++;
+		}
+
+		if (m_spareNodes.size()) {
+			m_nodes.emplace_back(std::move(m_spareNodes.back()));
+			m_nodes.back().viewport = Viewport();
+			m_spareNodes.pop_back();
+		}
+		else {
+			m_nodes.emplace_back(Node());
+			m_nodes.back().models.reserve(2048);			// create space for models
+			m_frameAllocations++;
+		}
 
 		// get pointer to its viewport
 		Viewport *vp = &m_nodes.back().viewport;
@@ -922,15 +1708,33 @@ void CNew3D::RenderViewport(UINT32 addr)
 		vp->scrollAtt = (float)(vpnode[0x24] & 0xFF) * (1.0f / 255.0f);				// scroll attenuation
 
 		// Clear texture offsets before proceeding
-		m_nodeAttribs.Reset();
+		m_walk.attribs.Reset();
+		m_walk.commands.clear();
+		m_walk.nfPair		= m_nfPairs[m_currentPriority];
+		m_walk.forkDepth	= 0;
 
 		// Set up coordinate system and base matrix
-		InitMatrixStack(matrixBase, m_modelMat);
+		InitMatrixStack(matrixBase, m_walk.modelMat);
+		m_walk.nextMatrixState	= NewMatrixStates();
+		m_walk.matrixState		= m_walk.nextMatrixState++;
 
 		// Descend down the node link. Need to start with a culling node because that defines our culling radius.
 		auto childptr = vpnode[0x02];
 		if (((childptr >> 24) & 0x5) == 0) {
-			DescendNodePtr(vpnode[0x02]);
+			DescendNodePtr(m_walk, vpnode[0x02]);
+		}
+
+		m_nfPairs[m_currentPriority] = m_walk.nfPair;
+
+		// now build the models, in the order they were found
+
+		for (const auto& cmd : m_walk.commands) {
+			if (cmd.colorTable) {
+				m_colorTableAddr = cmd.addr;
+			}
+			else {
+				DrawModel(cmd);
+			}
 		}
 	}
 
@@ -940,8 +1744,58 @@ void CNew3D::RenderViewport(UINT32 addr)
 	}
 }
 
-void CNew3D::CopyVertexData(const R3DPoly& r3dPoly, std::vector<FVertex>& vertexArray)
+const void* CNew3D::VertexData(const FVertex* vertices, size_t count)
 {
+	if (!m_packedVertices) {
+		return vertices;
+	}
+
+	m_packedBuffer.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		m_packedBuffer[i] = PackedVertex(vertices[i]);
+	}
+
+	return m_packedBuffer.data();
+}
+
+const void* CNew3D::IndexData(const UINT32* indices, size_t count, UINT32 base)
+{
+	if (!base) {
+		return indices;
+	}
+
+	m_indexBuffer.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		m_indexBuffer[i] = indices[i] + base;
+	}
+
+	return m_indexBuffer.data();
+}
+
+UINT32 CNew3D::AddVertex(const FVertex& vertex, std::vector<FVertex>& verts)
+{
+	// consecutive polygons with the same face attributes share vertices, so look for this one amongst the last added
+	size_t window = std::min(verts.size(), (size_t)SHARED_VERTEX_WINDOW);
+
+	for (size_t i = verts.size(); i > verts.size() - window; i--) {
+		if (!memcmp(&verts[i - 1], &vertex, sizeof(FVertex))) {
+			return UINT32(i - 1);
+		}
+	}
+
+	verts.push_back(vertex);
+
+	return UINT32(verts.size() - 1);
+}
+
+void CNew3D::CopyVertexData(const R3DPoly& r3dPoly, SortingMesh& mesh)
+{
+	//==========
+	FVertex v[4];
+	//==========
+
 	// both lemans 24 and dirt devils are rendering some totally transparent polys as the first object in each viewport
 	// in dirt devils it's parallel to the camera so is completel invisible, but breaks our depth calculation
 	// in lemans 24 its a sort of diamond shape, but never leaves a hole in the transparent geometry so must be being skipped by the h/w
@@ -951,15 +1805,13 @@ void CNew3D::CopyVertexData(const R3DPoly& r3dPoly, std::vector<FVertex>& vertex
 
 	if (m_numPolyVerts==4) {
 		if (r3dPoly.number == 4) {
-			vertexArray.emplace_back(r3dPoly, 0);		// construct directly inside container without copy
-			vertexArray.emplace_back(r3dPoly, 1);
-			vertexArray.emplace_back(r3dPoly, 2);
-			vertexArray.emplace_back(r3dPoly, 3);
+			v[0] = FVertex(r3dPoly, 0);
+			v[1] = FVertex(r3dPoly, 1);
+			v[2] = FVertex(r3dPoly, 2);
+			v[3] = FVertex(r3dPoly, 3);
 
 			// check for identical points (ie forced triangle) and replace with average point
 			// if we don't do this our quad code falls apart
-			FVertex* v = (&vertexArray.back()) - 3;
-
 			for (int i = 0; i < 4; i++) {
 
 				int next1 = (i + 1) % 4;
@@ -972,21 +1824,31 @@ void CNew3D::CopyVertexData(const R3DPoly& r3dPoly, std::vector<FVertex>& vertex
 			}
 		}
 		else {
-			vertexArray.emplace_back(r3dPoly, 0);	
-			vertexArray.emplace_back(r3dPoly, 1);
-			vertexArray.emplace_back(r3dPoly, 2);
-			vertexArray.emplace_back(r3dPoly, 0, 2);	// last point is an average of 0 and 2
+			v[0] = FVertex(r3dPoly, 0);
+			v[1] = FVertex(r3dPoly, 1);
+			v[2] = FVertex(r3dPoly, 2);
+			v[3] = FVertex(r3dPoly, 0, 2);	// last point is an average of 0 and 2
+		}
+
+		for (int i = 0; i < 4; i++) {
+			mesh.indices.push_back(AddVertex(v[i], mesh.verts));
 		}
 	}
 	else {
-		vertexArray.emplace_back(r3dPoly, 0);
-		vertexArray.emplace_back(r3dPoly, 1);
-		vertexArray.emplace_back(r3dPoly, 2);
+		UINT32 index[4];
+
+		for (int i = 0; i < r3dPoly.number; i++) {
+			index[i] = AddVertex(FVertex(r3dPoly, i), mesh.verts);
+		}
+
+		mesh.indices.push_back(index[0]);
+		mesh.indices.push_back(index[1]);
+		mesh.indices.push_back(index[2]);
 
 		if (r3dPoly.number == 4) {
-			vertexArray.emplace_back(r3dPoly, 0);
-			vertexArray.emplace_back(r3dPoly, 2);
-			vertexArray.emplace_back(r3dPoly, 3);
+			mesh.indices.push_back(index[0]);
+			mesh.indices.push_back(index[2]);
+			mesh.indices.push_back(index[3]);
 		}
 	}
 }
@@ -1077,12 +1939,12 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 	ph = data; 
 	int numTriangles = ph.NumTrianglesTotal();
 
-	// Cache all polygons
-	do {
+	// First pass over the headers sorts the polygons into meshes and gathers their new vertices, which are then
+	// decoded all together rather than one field at a time
+	m_vertexBatch.Clear();
+	m_polyHashes.clear();
 
-		R3DPoly		p;					// current polygon
-		float		uvScale;
-		int			i, j;
+	do {
 
 		if (ph.header[6] == 0) {
 			break;
@@ -1109,6 +1971,41 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 			currentMesh = &sMap[hash];
 		}
 
+		lastHash = hash;
+		m_polyHashes.push_back(hash);
+
+		int newVerts = ph.NumVerts() - ph.NumSharedVerts();
+		const UINT32* vData = ph.StartOfData();
+
+		for (int i = 0; i < newVerts; i++) {
+			if (currentMesh->textured) {
+				m_vertexBatch.Add(vData + i * 4, ph.UVScale(), (float)currentMesh->width, (float)currentMesh->height);
+			}
+			else {
+				m_vertexBatch.Add(vData + i * 4, 0, 1, 1);		// decodes to 0, as untextured polys have always had
+			}
+		}
+
+	} while (ph.NextPoly());
+
+	SIMDMath::DecodeVertices(m_vertexBatch, m_vertexFactor, m_shadeIsSigned);
+
+	// Cache all polygons
+	ph = data;
+	lastHash = -1;
+	currentMesh = nullptr;
+	int vertex = 0;					// next in the batch
+
+	for (UINT64 hash : m_polyHashes) {
+
+		R3DPoly		p;					// current polygon
+		float		uvScale;
+		int			i, j;
+
+		if (hash != lastHash) {
+			currentMesh = &sMap[hash];
+		}
+
 		// Obtain basic polygon parameters
 		p.number	= ph.NumVerts();
 		uvScale		= ph.UVScale();
@@ -1169,54 +2066,29 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 
 		UINT32* vData = ph.StartOfData();	// vertex data starts here
 
-		// remaining vertices are new and defined here
-		for (; j < p.number; j++)	
+		// remaining vertices are new and defined here, already decoded
+		for (; j < p.number; j++, vertex++)	
 		{
-			// Fetch vertices
-			UINT32 ix = vData[0];
-			UINT32 iy = vData[1];
-			UINT32 iz = vData[2];
 			UINT32 it = vData[3];
 
-			// Decode vertices
-			p.v[j].pos[0] = (((INT32)ix) >> 8) * m_vertexFactor;
-			p.v[j].pos[1] = (((INT32)iy) >> 8) * m_vertexFactor;
-			p.v[j].pos[2] = (((INT32)iz) >> 8) * m_vertexFactor;
-			p.v[j].pos[3] = 1.0f;
-
-			// Per vertex normals
-			if (ph.SmoothShading()) {
-				p.v[j].normal[0] = BYTE_TO_FLOAT((INT8)(ix & 0xFF));
-				p.v[j].normal[1] = BYTE_TO_FLOAT((INT8)(iy & 0xFF));
-				p.v[j].normal[2] = BYTE_TO_FLOAT((INT8)(iz & 0xFF));
-			}
-
-			if (ph.FixedShading() && !ph.SmoothShading()) {			// fixed shading seems to be disabled if actual normals are set
-
-				//==========
-				float shade;
-				//==========
-
-				if (!m_shadeIsSigned) {
-					shade = (ix & 0xFF) / 255.f;
-				}
-				else {
-					shade = BYTE_TO_FLOAT((INT8)(ix & 0xFF));
-				}
-				
-				p.v[j].fixedShade = shade;
-			}
-
-			float texU = 0;
-			float texV = 0;
+			p.v[j].pos[0] = m_vertexBatch.x[vertex];
+			p.v[j].pos[1] = m_vertexBatch.y[vertex];
+			p.v[j].pos[2] = m_vertexBatch.z[vertex];
+			p.v[j].pos[3] = 1.0f;
 
-			// tex coords
-			if (currentMesh->textured) {
-				Texture::GetCoordinates(currentMesh->width, currentMesh->height, (UINT16)(it >> 16), (UINT16)(it & 0xFFFF), uvScale, texU, texV);
+			// Per vertex normals
+			if (ph.SmoothShading()) {
+				p.v[j].normal[0] = m_vertexBatch.nx[vertex];
+				p.v[j].normal[1] = m_vertexBatch.ny[vertex];
+				p.v[j].normal[2] = m_vertexBatch.nz[vertex];
 			}
 
-			p.v[j].texcoords[0] = texU;
-			p.v[j].texcoords[1] = texV;
+			if (ph.FixedShading() && !ph.SmoothShading()) {			// fixed shading seems to be disabled if actual normals are set
+				p.v[j].fixedShade = m_vertexBatch.shade[vertex];
+			}
+
+			p.v[j].texcoords[0] = m_vertexBatch.u[vertex];
+			p.v[j].texcoords[1] = m_vertexBatch.v[vertex];
 
 			//cache un-normalised tex coordinates
 			texCoords[j][0] = (UINT16)(it >> 16);
@@ -1237,12 +2109,12 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 				V3::inverse(tempP.v[i].normal);
 			}
 
-			CopyVertexData(tempP, currentMesh->verts);
+			CopyVertexData(tempP, *currentMesh);
 		}
 
 		// Copy this polygon into the model buffer
 		if (!ph.Discard()) {
-			CopyVertexData(p, currentMesh->verts);
+			CopyVertexData(p, *currentMesh);
 		}
 		
 		// Copy current vertices into previous vertex array
@@ -1252,12 +2124,19 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 			m_prevTexCoords[i][1] = texCoords[i][1];
 		}
 
-	} while (ph.NextPoly());
+		ph.NextPoly();
+	}
 
 	//sorted the data, now copy to main data structures
 
 	// we know how many meshes we have so reserve appropriate space
-	m->meshes->reserve(sMap.size());
+	std::vector<Mesh>& meshes = MeshList(m->meshes);
+
+	if (meshes.capacity() < sMap.size()) {
+		m_frameAllocations++;
+	}
+
+	meshes.reserve(sMap.size());
 
 	for (auto& it : sMap) {
 
@@ -1266,22 +2145,44 @@ void CNew3D::CacheModel(Model *m, const UINT32 *data)
 			// calculate VBO values for current mesh
 			it.second.vboOffset		= (int)m_polyBufferRam.size() + MAX_ROM_VERTS;
 			it.second.vertexCount	= (int)it.second.verts.size();
+			it.second.iboOffset		= (int)m_polyIndicesRam.size() + MAX_ROM_INDICES;
+			it.second.indexCount	= (int)it.second.indices.size();
+
+			// copy poly data to main buffer, with indices to where the vertices are in it
+			UINT32 first = (UINT32)m_polyBufferRam.size();
+
+			for (UINT32 index : it.second.indices) {
+				m_polyIndicesRam.push_back(first + index);
+			}
 
-			// copy poly data to main buffer
 			m_polyBufferRam.insert(m_polyBufferRam.end(), it.second.verts.begin(), it.second.verts.end());
 		}
 		else {
 			// calculate VBO values for current mesh
 			it.second.vboOffset		= (int)m_polyBufferRom.size();
 			it.second.vertexCount	= (int)it.second.verts.size();
+			it.second.iboOffset		= (int)m_polyIndicesRom.size();
+			it.second.indexCount	= (int)it.second.indices.size();
+
+			UINT32 first = (UINT32)m_polyBufferRom.size();
+
+			for (UINT32 index : it.second.indices) {
+				m_polyIndicesRom.push_back(first + index);
+			}
+
+			// copy poly data to main buffer, which when short of memory grows in steps rather than doubling
+			size_t romVerts = m_polyBufferRom.size() + it.second.verts.size();
+
+			if (m_lowMemory && romVerts > m_polyBufferRom.capacity()) {
+				m_polyBufferRom.reserve(std::max(romVerts, std::min(romVerts + ROM_VERTS_STEP, (size_t)MAX_ROM_VERTS)));
+			}
 
-			// copy poly data to main buffer
 			m_polyBufferRom.insert(m_polyBufferRom.end(), it.second.verts.begin(), it.second.verts.end());
 		}
 
 		//copy the temp mesh into the model structure
 		//this will lose the associated vertex data, which is now copied to the main buffer anyway
-		m->meshes->push_back(it.second);
+		meshes.push_back(it.second);
 	}
 }
 
@@ -1308,11 +2209,282 @@ bool CNew3D::IsDynamicModel(UINT32 *data)
 	return false;
 }
 
+static inline UINT64 HashWord(UINT64 hash, UINT32 word)
+{
+	return (hash ^ word) * 0x100000001B3ull;		// FNV-1a, a word at a time
+}
+
+static UINT64 HashWords(UINT64 hash, const void *data, size_t bytes)
+{
+	const UINT32* words = (const UINT32*)data;
+
+	for (size_t i = 0; i < bytes / sizeof(UINT32); i++) {
+		hash = HashWord(hash, words[i]);
+	}
+
+	return hash;
+}
+
+UINT64 CNew3D::HashDynamicModel(const UINT32 *data)
+{
+	if (data == NULL) {
+		return 0;
+	}
+
+	PolyHeader	ph((UINT32*)data);
+	UINT64		hash = 0xCBF29CE484222325ull;
+
+	// a model can start with vertices shared from the previous one, so those are part of what it is made from
+	for (int i = 0; i < 4; i++) {
+		if (ph.SharedVertex(i)) {
+			hash = HashWords(hash, m_prev, sizeof(m_prev));
+			hash = HashWords(hash, m_prevTexCoords, sizeof(m_prevTexCoords));
+			break;
+		}
+	}
+
+	do {
+
+		if (ph.header[6] == 0) {
+			hash = HashWords(hash, ph.header, 7 * sizeof(UINT32));
+			break;
+		}
+
+		hash = HashWords(hash, ph.header, (7 + (ph.NumVerts() - ph.NumSharedVerts()) * 4) * sizeof(UINT32));
+
+		if (!ph.PolyColor()) {
+			hash = HashWord(hash, m_polyRAM[m_colorTableAddr + ph.ColorIndex()]);
+		}
+
+	} while (ph.NextPoly());
+
+	return hash;
+}
+
+void CNew3D::CompactDynamicModels()
+{
+	size_t liveVerts = 0;
+	size_t liveIndices = 0;
+
+	for (auto it = m_dynamicMap.begin(); it != m_dynamicMap.end(); ) {
+		if (!it->second.used) {
+			ReleaseMeshList(it->second.meshes);
+			it = m_dynamicMap.erase(it);
+		}
+		else {
+			it->second.used = false;
+			liveVerts += it->second.count;
+			liveIndices += it->second.indexCount;
+			++it;
+		}
+	}
+
+	if (liveVerts > MAX_RAM_VERTS || liveIndices > MAX_RAM_INDICES) {
+		ClearDynamicModels();			// wouldn't fit even without gaps, so start again
+		return;
+	}
+
+	// only move vertices about once the gaps outweigh the models, or the vbo is full
+	size_t gapVerts = m_polyBufferRam.size() - liveVerts;
+
+	if (gapVerts <= liveVerts && m_polyBufferRam.size() <= MAX_RAM_VERTS && m_polyIndicesRam.size() <= MAX_RAM_INDICES) {
+		return;
+	}
+
+	m_vboSyncPending = true;			// recent frames may still be drawing from where the models are about to move to
+
+	std::vector<FVertex> compacted;
+	std::vector<UINT32> compactedIndices;
+	compacted.reserve(liveVerts);
+	compactedIndices.reserve(liveIndices);
+
+	for (auto& it : m_dynamicMap) {
+
+		DynamicModel& dm = it.second;
+		int shift = (int)compacted.size() - dm.first;
+		int indexShift = (int)compactedIndices.size() - dm.indexFirst;
+
+		compacted.insert(compacted.end(), m_polyBufferRam.begin() + dm.first, m_polyBufferRam.begin() + dm.first + dm.count);
+
+		for (int i = dm.indexFirst; i < dm.indexFirst + dm.indexCount; i++) {
+			compactedIndices.push_back(m_polyIndicesRam[i] + shift);
+		}
+
+		for (auto& mesh : MeshList(dm.meshes)) {
+			mesh.vboOffset += shift;
+			mesh.iboOffset += indexShift;
+		}
+
+		dm.first += shift;
+		dm.indexFirst += indexShift;
+	}
+
+	m_polyBufferRam.swap(compacted);
+	m_polyIndicesRam.swap(compactedIndices);
+	m_ramUploadStart = 0;				// everything has moved
+	m_ramIndexUploadStart = 0;
+}
+
+void CNew3D::ClearDynamicModels()
+{
+	m_vboSyncPending = true;
+
+	for (auto& it : m_dynamicMap) {
+		ReleaseMeshList(it.second.meshes);
+	}
+
+	m_dynamicMap.clear();
+	m_polyBufferRam.clear();
+	m_polyIndicesRam.clear();
+	m_ramUploadStart = 0;
+	m_ramIndexUploadStart = 0;
+}
+
 bool CNew3D::IsVROMModel(UINT32 modelAddr)
 {
 	return modelAddr >= 0x100000;
 }
 
+void CNew3D::LoadModelCache()
+{
+	CBlockFile	file;
+	INT32		fileVersion;
+	UINT32		count;
+
+	if (OKAY != file.Load(m_modelCacheFile)) {
+		return;										// nothing cached yet
+	}
+
+	if (OKAY != file.FindBlock("Supermodel New3D Model Cache")) {
+		ErrorLog("'%s' is not a valid model cache file.", m_modelCacheFile.c_str());
+		return;
+	}
+
+	file.Read(&fileVersion, sizeof(fileVersion));
+
+	if (fileVersion != MODEL_CACHE_FILE_VERSION || OKAY != file.FindBlock("Models")) {
+		return;										// stale, will be rewritten on exit
+	}
+
+	if (file.Read(&count, sizeof(count)) != sizeof(count)) {
+		return;
+	}
+
+	m_warmUpModels.resize(count);
+	unsigned bytes = file.Read(m_warmUpModels.data(), count * sizeof(CachedModel));
+	m_warmUpModels.resize(bytes / sizeof(CachedModel));
+}
+
+void CNew3D::SaveModelCache()
+{
+	CBlockFile	file;
+	INT32		fileVersion = MODEL_CACHE_FILE_VERSION;
+
+	// models warmed up are in the map too, so only those still waiting need adding
+	std::vector<CachedModel> models = m_warmUpModels;
+
+	for (auto& it : m_romMap) {
+
+		if (MeshList(it.second).empty() || m_vrom == nullptr) {
+			continue;
+		}
+
+		CachedModel m;
+		m.addr = it.first;
+		memcpy(m.header, &m_vrom[it.first], sizeof(m.header));
+		models.push_back(m);
+	}
+
+	if (models.empty()) {
+		return;
+	}
+
+	std::sort(models.begin(), models.end(), [](const CachedModel& a, const CachedModel& b) { return a.addr < b.addr; });
+
+	if (OKAY != file.Create(m_modelCacheFile, "Supermodel New3D Model Cache", "Supermodel Version " SUPERMODEL_VERSION)) {
+		ErrorLog("Unable to save model cache to '%s'. Make sure directory exists!", m_modelCacheFile.c_str());
+		return;
+	}
+
+	file.Write(&fileVersion, sizeof(fileVersion));
+
+	UINT32 count = (UINT32)models.size();
+	file.NewBlock("Models", "VROM model addresses and first polygon headers");
+	file.Write(&count, sizeof(count));
+	file.Write(models.data(), count * sizeof(CachedModel));
+	file.Close();
+}
+
+int CNew3D::NewMeshList()
+{
+	if (m_freeMeshLists.size()) {
+		int list = m_freeMeshLists.back();
+		m_freeMeshLists.pop_back();
+		return list;
+	}
+
+	m_frameAllocations++;
+	m_meshLists.emplace_back();
+
+	return (int)m_meshLists.size() - 1;
+}
+
+void CNew3D::ReleaseMeshList(int list)
+{
+	m_releasedMeshLists.push_back(list);
+}
+
+void CNew3D::RecycleMeshLists()
+{
+	for (int list : m_releasedMeshLists) {
+		m_meshLists[list].clear();
+		m_freeMeshLists.push_back(list);
+	}
+
+	m_releasedMeshLists.clear();
+}
+
+void CNew3D::WarmUpModelCache()
+{
+	if (m_vrom == nullptr) {
+		return;
+	}
+
+	size_t built = 0;
+
+	for (const auto& cached : m_warmUpModels) {
+
+		UINT32 addr = cached.addr & 0x00FFFFFF;
+
+		if (m_polyBufferRom.size() >= MAX_WARM_UP_VERTS) {
+			break;
+		}
+
+		// skip anything that is not where it was, in case the ROM set changed
+		if (!IsVROMModel(addr) || m_romMap.count(addr) || memcmp(&m_vrom[addr], cached.header, sizeof(cached.header))) {
+			continue;
+		}
+
+		UINT32* data = (UINT32*)TranslateModelAddress(addr);
+
+		if (IsDynamicModel(data)) {
+			continue;
+		}
+
+		Model m;
+		m.meshes	= NewMeshList();
+		m.dynamic	= false;
+		CacheModel(&m, data);
+
+		m_romMap[addr] = m.meshes;
+		built++;
+	}
+
+	InfoLog("Built %u of %u cached ROM models (%u vertices).", (unsigned)built, (unsigned)m_warmUpModels.size(), (unsigned)m_polyBufferRom.size());
+
+	m_warmUpModels.clear();
+}
+
 void CNew3D::CalcTexOffset(int offX, int offY, int page, int x, int y, int& newX, int& newY)
 {
 	newX = (x + offX) & 2047;	// wrap around 2048, shouldn't be required
@@ -1367,57 +2539,6 @@ void CNew3D::CalcFrustumPlanes(Plane p[5], const float* matrix)
 	p[4].d =0;
 }
 
-void CNew3D::CalcBox(float distance, BBox& box)
-{
-	//bottom left front
-	box.points[0][0] = -distance;
-	box.points[0][1] = -distance;
-	box.points[0][2] = distance;
-	box.points[0][3] = 1;
-
-	//bottom left back
-	box.points[1][0] = -distance;
-	box.points[1][1] = -distance;
-	box.points[1][2] = -distance;
-	box.points[1][3] = 1;
-
-	//bottom right back
-	box.points[2][0] = distance;
-	box.points[2][1] = -distance;
-	box.points[2][2] = -distance;
-	box.points[2][3] = 1;
-
-	//bottom right front
-	box.points[3][0] = distance;
-	box.points[3][1] = -distance;
-	box.points[3][2] = distance;
-	box.points[3][3] = 1;
-
-	//top left front
-	box.points[4][0] = -distance;
-	box.points[4][1] = distance;
-	box.points[4][2] = distance;
-	box.points[4][3] = 1;
-
-	//top left back
-	box.points[5][0] = -distance;
-	box.points[5][1] = distance;
-	box.points[5][2] = -distance;
-	box.points[5][3] = 1;
-
-	//top right back
-	box.points[6][0] = distance;
-	box.points[6][1] = distance;
-	box.points[6][2] = -distance;
-	box.points[6][3] = 1;
-
-	//top right front
-	box.points[7][0] = distance;
-	box.points[7][1] = distance;
-	box.points[7][2] = distance;
-	box.points[7][3] = 1;
-}
-
 void CNew3D::MultVec(const float matrix[16], const float in[4], float out[4]) 
 {
 	for (int i = 0; i < 4; i++) {
@@ -1429,66 +2550,12 @@ void CNew3D::MultVec(const float matrix[16], const float in[4], float out[4])
 	}
 }
 
-void CNew3D::TransformBox(const float *m, BBox& box)
-{
-	for (int i = 0; i < 8; i++) {
-		float v[4];
-		MultVec(m, box.points[i], v);
-		box.points[i][0] = v[0];
-		box.points[i][1] = v[1];
-		box.points[i][2] = v[2];
-	}
-}
-
-Clip CNew3D::ClipBox(BBox& box, Plane planes[5])
-{
-	int count = 0;
-
-	for (int i = 0; i < 8; i++) {
-
-		int temp = 0;
-
-		for (int j = 0; j < 5; j++) {
-			if (planes[j].DistanceToPoint(box.points[i]) >= 0) {
-				temp++;
-			}
-		}
-
-		if (temp == 5) count++;		// point is inside all 4 frustum planes
-	}
-
-	if (count == 8)	return Clip::INSIDE;
-	if (count > 0)	return Clip::INTERCEPT;
-	
-	//if we got here all points are outside of the view frustum
-	//check for all points being side same of any plane, means box outside of view
-
-	for (int i = 0; i < 5; i++) {
-
-		int temp = 0;
-
-		for (int j = 0; j < 8; j++) {
-			if (planes[i].DistanceToPoint(box.points[j]) >= 0) {
-				temp++;
-			}
-		}
-
-		if (temp == 0) {
-			return Clip::OUTSIDE;
-		}
-	}
-
-	//if we got here, box is traversing view frustum
-
-	return Clip::INTERCEPT;
-}
-
-void CNew3D::CalcBoxExtents(const BBox& box)
+void CNew3D::CalcBoxExtents(NFPair& nfPair, const BBox& box)
 {
 	for (int i = 0; i < 8; i++) {
 		if (box.points[i][2] < 0) {
-			m_nfPairs[m_currentPriority].zNear = std::max(box.points[i][2], m_nfPairs[m_currentPriority].zNear);
-			m_nfPairs[m_currentPriority].zFar  = std::min(box.points[i][2], m_nfPairs[m_currentPriority].zFar);
+			nfPair.zNear = std::max(box.points[i][2], nfPair.zNear);
+			nfPair.zFar  = std::min(box.points[i][2], nfPair.zFar);
 		}
 	}
 }
@@ -1559,26 +2626,40 @@ void CNew3D::ClipModel(const Model *m)
 	//===============================
 	ClipPoly				clipPoly;
 	std::vector<FVertex>*	vertices;
+	std::vector<UINT32>*	indices;
 	int						offset;
 	//===============================
 
 	if (m->dynamic) {
 		vertices = &m_polyBufferRam;
-		offset = MAX_ROM_VERTS;
+		indices = &m_polyIndicesRam;
+		offset = MAX_ROM_INDICES;
 	}
 	else {
 		vertices = &m_polyBufferRom;
+		indices = &m_polyIndicesRom;
 		offset = 0;
 	}
 
-	for (const auto &mesh : *m->meshes) {
+	NFPair& nfPair = m_nfPairs[m_currentPriority];
 
-		int start = mesh.vboOffset - offset;
-		
-		for (int i = 0; i < mesh.vertexCount; i += m_numPolyVerts) {							// inc to next poly
+	for (const auto &mesh : MeshList(m->meshes)) {
+
+		const UINT32* polyIndices = indices->data() + mesh.iboOffset - offset;
+		int polys = mesh.indexCount / m_numPolyVerts;
+
+		// polys entirely inside or outside are dealt with in batches, only those crossing a plane need clipping
+
+		m_straddlingPolys.resize(std::max(m_straddlingPolys.size(), (size_t)polys));
+
+		int straddling = SIMDMath::ClipPolysZRange(m->modelMat, vertices->data(), polyIndices, polys, m_numPolyVerts, m_planes, nfPair.zNear, nfPair.zFar, m_straddlingPolys.data());
+
+		for (int k = 0; k < straddling; k++) {
+
+			int i = m_straddlingPolys[k] * m_numPolyVerts;
 
 			for (int j = 0; j < m_numPolyVerts; j++) {
-				MultVec(m->modelMat, (*vertices)[start + i + j].pos, clipPoly.list[j].pos);		// copy all 3 of 4  our transformed vertices into our clip poly struct
+				MultVec(m->modelMat, (*vertices)[polyIndices[i + j]].pos, clipPoly.list[j].pos);		// copy all 3 of 4  our transformed vertices into our clip poly struct
 			}
 
 			clipPoly.count = m_numPolyVerts;
@@ -1587,8 +2668,8 @@ void CNew3D::ClipModel(const Model *m)
 
 			for (int j = 0; j < clipPoly.count; j++) {
 				if (clipPoly.list[j].pos[2] < 0) {
-					m_nfPairs[m_currentPriority].zNear = std::max(clipPoly.list[j].pos[2], m_nfPairs[m_currentPriority].zNear);
-					m_nfPairs[m_currentPriority].zFar  = std::min(clipPoly.list[j].pos[2], m_nfPairs[m_currentPriority].zFar);
+					nfPair.zNear = std::max(clipPoly.list[j].pos[2], nfPair.zNear);
+					nfPair.zFar  = std::min(clipPoly.list[j].pos[2], nfPair.zFar);
 				}
 			}
 		}
@@ -1666,6 +2747,10 @@ void CNew3D::SetSunClamp(bool enable)
 
 void CNew3D::SetSignedShade(bool enable)
 {
+	if (enable != m_shadeIsSigned) {
+		ClearDynamicModels();
+	}
+
 	m_shadeIsSigned = enable;
 }
 
@@ -1674,6 +2759,19 @@ float CNew3D::GetLosValue(int layer)
 	return m_lineOfSight[layer];
 }
 
+UINT64 CNew3D::GetFrameAllocations(void) const
+{
+	return m_frameAllocations;
+}
+
+void CNew3D::GetTextureCacheStats(uint64_t *hits, uint64_t *misses)
+{
+	UINT64 h, m;
+	m_texSheet.GetCacheStats(h, m);
+	*hits	= h;
+	*misses	= m;
+}
+
 void CNew3D::TranslateLosPosition(int inX, int inY, int& outX, int& outY)
 {
 	// remap real3d 496x384 to our new viewport
@@ -1683,6 +2781,18 @@ void CNew3D::TranslateLosPosition(int inX, int inY, int& outX, int& outY)
 	outY = m_yOffs + int(inY * m_yRatio);
 }
 
+static bool LosDistance(float depth, float zNear, float zFar, float& distance)
+{
+	if (depth < 0.99f || depth == 1.0f) {		// kinda guess work but when depth = 1, haven't drawn anything, when 0.99~ drawing sky somewhere far
+		return false;
+	}
+
+	depth = 2.0f * depth - 1.0f;
+
+	distance = 2.0f * zNear * zFar / (zFar + zNear - depth * (zFar - zNear));
+	return true;
+}
+
 bool CNew3D::ProcessLos(int priority)
 {
 	for (const auto &n : m_nodes) {
@@ -1692,21 +2802,39 @@ bool CNew3D::ProcessLos(int priority)
 				int losX, losY;
 				TranslateLosPosition(n.viewport.losPosX, n.viewport.losPosY, losX, losY);
 
-				float depth;
-				glReadPixels(losX, losY, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
+				if (m_asyncLos) {
 
-				if (depth < 0.99f || depth == 1.0f) {		// kinda guess work but when depth = 1, haven't drawn anything, when 0.99~ drawing sky somewhere far
-					return false;
-				}
+					// read into a pixel buffer so we don't wait for the gpu here, the value is picked up by a later frame
+					LosReadback& rb = m_losReadbacks[priority][m_losNext[priority]];
+					m_losNext[priority] = (m_losNext[priority] + 1) % NUM_LOS_READBACKS;
+
+					if (!rb.pbo) {
+						glGenBuffers(1, &rb.pbo);
+						glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+						glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float), nullptr, GL_STREAM_READ);
+					}
+					else {
+						glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+					}
+
+					if (rb.fence) {
+						glDeleteSync(rb.fence);		// never collected, a newer one will be
+					}
+
+					m_r3dFrameBuffers.ReadDepth(losX, losY, nullptr);
+					glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-				depth = 2.0f * depth - 1.0f;
+					rb.fence	= glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+					rb.zNear	= m_nfPairs[priority].zNear;
+					rb.zFar		= m_nfPairs[priority].zFar;
 
-				float zNear = m_nfPairs[priority].zNear;
-				float zFar	= m_nfPairs[priority].zFar;
-				float zVal	= 2.0f * zNear * zFar / (zFar + zNear - depth * (zFar - zNear));
+					return false;					// nothing known yet
+				}
+
+				float depth;
+				m_r3dFrameBuffers.ReadDepth(losX, losY, &depth);
 
-				m_lineOfSight[priority] = zVal;
-				return true;
+				return LosDistance(depth, m_nfPairs[priority].zNear, m_nfPairs[priority].zFar, m_lineOfSight[priority]);
 			}
 		}
 	}
@@ -1714,4 +2842,67 @@ bool CNew3D::ProcessLos(int priority)
 	return false;
 }
 
+void CNew3D::ResolveLosReadbacks()
+{
+	for (int pri = 0; pri < 4; pri++) {
+
+		bool pending = false;
+
+		// oldest first, so the newest finished read wins
+		for (int i = 0; i < NUM_LOS_READBACKS; i++) {
+
+			LosReadback& rb = m_losReadbacks[pri][(m_losNext[pri] + i) % NUM_LOS_READBACKS];
+
+			if (!rb.fence) {
+				continue;
+			}
+
+			pending = true;
+
+			if (glClientWaitSync(rb.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+				continue;
+			}
+
+			glDeleteSync(rb.fence);
+			rb.fence = nullptr;
+
+			float depth = 1.0f;
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+
+			if (const float* mapped = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(float), GL_MAP_READ_BIT)) {
+				depth = *mapped;
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+			if (!LosDistance(depth, rb.zNear, rb.zFar, m_lineOfSight[pri])) {
+				m_lineOfSight[pri] = 0;
+			}
+		}
+
+		if (!pending) {
+			m_lineOfSight[pri] = 0;			// game has stopped asking
+		}
+	}
+}
+
+void CNew3D::ReleaseLosReadbacks()
+{
+	for (auto& readbacks : m_losReadbacks) {
+		for (auto& rb : readbacks) {
+			if (rb.fence) {
+				glDeleteSync(rb.fence);
+				rb.fence = nullptr;
+			}
+
+			if (rb.pbo) {
+				glDeleteBuffers(1, &rb.pbo);
+				rb.pbo = 0;
+			}
+		}
+	}
+}
+
 } // New3D
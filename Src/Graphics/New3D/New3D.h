@@ -43,6 +43,9 @@
 #include "R3DScrollFog.h"
 #include "PolyHeader.h"
 #include "R3DFrameBuffers.h"
+#include "SIMDMath.h"
+#include "Util/JobSystem.h"
+#include <deque>
 
 namespace New3D {
 
@@ -74,6 +77,25 @@ public:
 	*/
 	void EndFrame(void);
 
+	/*
+	* CanRepeatFrame(void):
+	*
+	* Returns true if the frame buffers still hold the whole of the last
+	* frame's 3D, which is the case when it was composited in a single pass.
+	* Scenes drawn over several priority layers composite the earlier ones
+	* as they go and have to be rendered again.
+	*/
+	bool CanRepeatFrame(void) const;
+
+	/*
+	* RepeatFrame(void):
+	*
+	* Draws the last frame's 3D again from the frame buffers, without walking
+	* the scene database, in place of BeginFrame() and RenderFrame(). The
+	* caller decides that nothing has changed.
+	*/
+	void RepeatFrame(void);
+
 	/*
 	* UploadTextures(x, y, width, height):
 	*
@@ -143,6 +165,18 @@ public:
 	*/
 	bool Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes);
 
+	/*
+	* Resize(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes):
+	*
+	* Changes the display area after Init(), e.g. on a fullscreen toggle. Only
+	* the frame buffers are created again; models, textures and shaders are
+	* kept. Parameters are as for Init().
+	*
+	* Returns:
+	*		OKAY is successful, otherwise FAIL.
+	*/
+	bool Resize(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes);
+
 	/*
 	* SetSunClamp(bool enable);
 	*
@@ -173,6 +207,25 @@ public:
 	*/
 	float GetLosValue(int layer);
 
+	/*
+	* GetFrameAllocations(void);
+	*
+	* Returns how many times building frames has had to allocate memory for
+	* its nodes, model lists and mesh lists, which are otherwise reused from
+	* one frame to the next. Once the scenes a game draws have all been seen
+	* this should stop going up.
+	*/
+	UINT64 GetFrameAllocations(void) const;
+
+	/*
+	* GetTextureCacheStats(hits, misses);
+	*
+	* Counts textures created so far that were found in the texture cache,
+	* having been invalidated earlier and then uploaded again with the same
+	* data, and those that had to be uploaded.
+	*/
+	void GetTextureCacheStats(uint64_t *hits, uint64_t *misses);
+
 	/*
 	* CRender3D(config):
 	* ~CRender3D(void):
@@ -196,29 +249,74 @@ private:
 
 	// Matrix stack
 	void MultMatrix(UINT32 matrixOffset, Mat4& mat);
+	UINT64 NewMatrixStates();						// first of a block of state numbers for a walk
 	void InitMatrixStack(UINT32 matrixBaseAddr, Mat4& mat);
 
 	// Scene database traversal
-	bool DrawModel(UINT32 modelAddr);
-	void DescendCullingNode(UINT32 addr);
-	void DescendPointerList(UINT32 addr);
-	void DescendNodePtr(UINT32 nodeAddr);
+	struct CullingCommand;
+	struct CullingWalk;
+	void QueueModel(CullingWalk& walk, UINT32 modelAddr);
+	void ApplyMatrix(CullingWalk& walk, UINT32 matrixOffset);
+	bool DrawModel(const CullingCommand& cmd);
+	void DescendCullingNode(CullingWalk& walk, UINT32 addr);
+	void DescendPointerList(CullingWalk& walk, UINT32 addr);
+	void DescendNodePtr(CullingWalk& walk, UINT32 nodeAddr);
 	void RenderViewport(UINT32 addr);
 
+	// A frame is built (scene traversal into m_nodes and the vertex buffers, no GL calls) and then submitted (uploads and
+	// drawing). With New3DOverlapBuild the build runs on the job system from BeginFrame(), alongside the 2D layers.
+	void BuildFrame();
+	void SubmitFrame();
+	void WaitForBuild();
+	void SetRenderScale(float scale);
+	void UpdateRenderScale();
+
 	// building the scene
 	void SetMeshValues(SortingMesh *currentMesh, PolyHeader &ph);
 	void CacheModel(Model *m, const UINT32 *data);
-	void CopyVertexData(const R3DPoly& r3dPoly, std::vector<FVertex>& vertexArray);
+	void CopyVertexData(const R3DPoly& r3dPoly, SortingMesh& mesh);
+	UINT32 AddVertex(const FVertex& vertex, std::vector<FVertex>& verts);	// index of an identical vertex of the last polygons if there is one, else of it once added
+	const void* VertexData(const FVertex* vertices, size_t count);		// in the vbo's format, valid until the next call
+	const void* IndexData(const UINT32* indices, size_t count, UINT32 base);	// offset to the vbo's vertices, valid until the next call
+
+	struct DrawStates					// what RenderScene() has bound so far
+	{
+		std::shared_ptr<Texture> tex1;
+		std::shared_ptr<Texture> tex2;
+		int sheetFormat = -1;			// format of sheet bound to unit 0 in texture sheet mode
+		bool microSheetBound = false;
+	};
 
 	bool RenderScene(int priority, bool renderOverlay, Layer layer);		// returns if has overlay plane
+	void SetMeshStates(const Model& m, const Mesh& mesh, DrawStates& states);	// textures and mesh uniforms
+	void BindTextureSheets(const Mesh& mesh, int x, int y, int& sheetFormat, bool& microSheetBound);
+	void GroupInstances(const Node& n);				// its repeated rom models, with their matrices uploaded to m_instanceVbo
+	void SetInstanceArrays(GLintptr offset);		// model matrices from m_instanceVbo, or back to the constant one if < 0
+	void SortModels(const Node& n);					// into m_drawOrder, nearest first
+	bool HasLayeredMeshes(const Model& m);
+	void QueueDraw(int first, int count);			// batches meshes drawn with the same state, by their index ranges
+	void FlushDraws();
 	bool IsDynamicModel(UINT32 *data);				// check if the model has a colour palette
+	UINT64 HashDynamicModel(const UINT32 *data);	// hash of everything CacheModel() reads to convert a ram model
+	void CompactDynamicModels();					// drop ram models not drawn last frame, and close up the gaps they leave
+	void ClearDynamicModels();
 	bool IsVROMModel(UINT32 modelAddr);
 	void DrawScrollFog();
 	bool SkipLayer(int layer);
+	void PrefetchTextures();	// decode all textures missing from the texture sheet up front, in parallel
+	void LoadModelCache();		// read VROM model addresses drawn by earlier sessions
+	void SaveModelCache();
+	void WarmUpModelCache();	// build meshes for all of them before the first frame is drawn
+	int NewMeshList();							// index of an empty list in m_meshLists
+	void ReleaseMeshList(int list);				// recycled from the next frame, as models drawn in this one may still use it
+	void RecycleMeshLists();
+	std::vector<Mesh>& MeshList(int list) { return m_meshLists[list]; }
 	void SetRenderStates();
 	void DisableRenderStates();
 	void TranslateLosPosition(int inX, int inY, int& outX, int& outY);
 	bool ProcessLos(int priority);
+	void ResolveLosReadbacks();		// pick up the results of earlier asynchronous line of sight reads that the gpu has finished
+	void ReleaseLosReadbacks();
 
 	void CalcTexOffset(int offX, int offY, int page, int x, int y, int& newX, int& newY);	
 
@@ -231,6 +329,32 @@ private:
 	int m_numPolyVerts;
 	GLenum m_primType;
 
+	// Persistent ROM model cache
+	struct CachedModel
+	{
+		UINT32 addr;
+		UINT32 header[7];	// first polygon header, to check the model is still there
+	};
+	bool m_parallelCulling;			// fork culling sub-trees onto the job system
+	bool m_textureSheetEnabled;		// sample textures from whole decoded sheets instead of individual texture objects
+	bool m_compressTextures;		// swap textures that stay in texture RAM for S3TC ones
+	bool m_packedVertices;			// vbo holds PackedVertex rather than FVertex
+	bool m_boxClipping;				// Z range of models crossing the frustum from their culling box rather than their polygons
+	bool m_instancing;				// draw opaque rom models repeated within a viewport with instanced draws
+	bool m_frontToBack;				// draw opaque models nearest first, for the depth test to save fill rate
+	int  m_multisample;				// samples per pixel in the frame buffers, 0 for none
+	bool m_overlapBuild;			// build the frame on the job system while the caller does other work
+	bool m_buildPending;
+	bool m_repeatFrames;			// allow unchanged frames to be drawn again from the frame buffers
+	bool m_frameKept;				// the frame buffers hold the whole of the last frame, composited in one pass
+	bool m_vboSyncPending;			// ram models moved, so the gpu must be done with the vbo before they are uploaded again
+	Util::JobSystem::Group m_buildGroup;
+	int  m_vertexSize;				// bytes per vertex in the vbo
+	bool m_lowMemory;				// free staging memory as soon as it's used, and don't over-allocate
+	bool m_modelCacheEnabled;
+	std::string m_modelCacheFile;
+	std::vector<CachedModel> m_warmUpModels;	// waiting to be built on the first frame
+
 	// GPU configuration
 	bool m_sunClamp;
 	bool m_shadeIsSigned;
@@ -253,26 +377,95 @@ private:
 	unsigned	m_xRes, m_yRes;           // resolution of Model 3's 496x384 display area within the window
 	unsigned 	m_totalXRes, m_totalYRes; // total OpenGL window resolution
 
+	// Dynamic render scale. The values above are for the part of the frame buffers drawn on, the window scaled by
+	// m_renderScale, which follows the GPU time of the 3D passes. The composite scales it back up to the window.
+	unsigned	m_display[6];			// Resize() parameters, at full scale
+	float		m_renderScale;
+	float		m_minScale, m_maxScale;
+	UINT32		m_scaleTarget;			// microseconds of GPU time to aim for, 0 for a fixed scale of 1
+	int			m_scaleFrames;			// frames since the scale was last looked at
+
 	// Real3D Base Matrix Pointer
 	const float	*m_matrixBasePtr;
 	UINT32 m_colorTableAddr = 0x400;		// address of color table in polygon RAM
 	LODBlendTable* m_LODBlendTable;
 
 	TextureSheet	m_texSheet;
-	NodeAttributes	m_nodeAttribs;
-	Mat4			m_modelMat;				// current modelview matrix
 
 	float			m_lineOfSight[4];
 
+	// Asynchronous line of sight reads, a small ring per priority so collecting one never waits on the gpu
+	static const int NUM_LOS_READBACKS = 3;
+
+	struct LosReadback
+	{
+		GLuint	pbo		= 0;
+		GLsync	fence	= nullptr;
+		float	zNear, zFar;		// of the frame it was read in
+	};
+
+	bool			m_asyncLos;
+	LosReadback		m_losReadbacks[4][NUM_LOS_READBACKS];
+	int				m_losNext[4] = {};
+
 	Vertex			m_prev[4];				// these are class variables because sega bass fishing starts meshes with shared vertices from the previous one
 	UINT16			m_prevTexCoords[4][2];	// basically relying on undefined behavour
 
+	SIMDMath::VertexBatch	m_vertexBatch;	// CacheModel() scratch, the new vertices of the model
+	std::vector<UINT64>		m_polyHashes;	// and the mesh of each polygon
+
 	std::vector<Node>	 m_nodes;				// this represents the entire render frame
+	std::vector<Node>	 m_spareNodes;			// nodes of earlier frames, emptied but keeping the memory of their model lists
 	std::vector<FVertex> m_polyBufferRam;		// dynamic polys
 	std::vector<FVertex> m_polyBufferRom;		// rom polys
-	std::unordered_map<UINT32, std::shared_ptr<std::vector<Mesh>>> m_romMap;	// a hash table for all the ROM models. The meshes don't have model matrices or tex offsets yet
+	std::vector<UINT32>	 m_polyIndicesRam;		// indices of the polys' vertices in m_polyBufferRam
+	std::vector<UINT32>	 m_polyIndicesRom;		// and in m_polyBufferRom
+	std::vector<PackedVertex> m_packedBuffer;	// staging for uploads when m_packedVertices is set
+	std::vector<UINT32>	 m_indexBuffer;			// staging for uploads of ram indices
+	std::vector<GLint>	 m_drawFirst;			// index ranges queued for the next glMultiDrawElements
+	std::vector<GLsizei> m_drawCount;
+	std::vector<const GLvoid*> m_drawOffsets;
+
+	// Instanced and sorted drawing, rebuilt for each viewport node in the opaque pass
+	struct InstanceGroup
+	{
+		int			leader;				// first of the models in the scene, the whole group is drawn in its place
+		int			count;
+		GLintptr	offset;				// of their matrices in m_instanceVbo
+	};
+	std::vector<InstanceGroup>	m_instanceGroups;
+	std::vector<int>			m_instanceGroupOf;		// group of each model of the node, -1 if drawn on its own
+	std::vector<int>			m_instanceOrder;		// models of the node sorted by what they draw
+	std::vector<float>			m_instanceMatrices;		// staging for uploads
+	std::vector<std::pair<float, int>> m_drawOrder;		// distance and index of the models of the node, in the order the opaque pass draws them
+	std::unordered_map<UINT32, int> m_romMap;	// a hash table for all the ROM models, to their mesh lists. The meshes don't have model matrices or tex offsets yet
+
+	// Mesh lists are kept in a pool that never moves them, models refer to them by index. Released lists are emptied and reused but keep their memory
+	std::deque<std::vector<Mesh>> m_meshLists;
+	std::vector<int>	m_freeMeshLists;
+	std::vector<int>	m_releasedMeshLists;		// until the next frame
+	UINT64				m_frameAllocations = 0;
+
+	// Converted ram models are kept in m_polyBufferRam and the VBO from one frame to the next, and reused while their source data is unchanged
+	struct DynamicModel
+	{
+		UINT64	hash;
+		int		meshes = -1;			// in m_meshLists
+		int		first;					// vertex range in m_polyBufferRam
+		int		count;
+		int		indexFirst;				// index range in m_polyIndicesRam
+		int		indexCount;
+		Vertex	prev[4];				// m_prev and m_prevTexCoords after conversion, for a following model that shares them
+		UINT16	prevTexCoords[4][2];
+		bool	used;					// drawn this frame
+	};
+	std::unordered_map<UINT64, DynamicModel> m_dynamicMap;	// keyed on colour table and model address
+	size_t	m_ramUploadStart = 0;		// vertices of m_polyBufferRam before this are already in the VBO
+	size_t	m_ramIndexUploadStart = 0;	// and indices of m_polyIndicesRam in the IBO
 
 	VBO m_vbo;								// large VBO to hold our poly data, start of VBO is ROM data, ram polys follow
+	VBO m_ibo;								// indices of the polys' vertices in m_vbo, laid out the same way
+	VBO m_instanceVbo;						// model matrices of instanced draws, refilled every frame
 	R3DShader m_r3dShader;
 	R3DScrollFog m_r3dScrollFog;
 	R3DFrameBuffers m_r3dFrameBuffers;
@@ -293,14 +486,41 @@ private:
 	NFPair m_nfPairs[4];
 	int m_currentPriority;
 
+	// The culling tree of a viewport is walked without touching anything but the walk itself, so that
+	// pointer lists can be split between threads. Models found and colour table changes are recorded
+	// as commands and carried out afterwards in the original order.
+	struct CullingCommand
+	{
+		bool	colorTable;			// sets colour table to addr, otherwise draws model at addr
+		UINT32	addr;
+		Clip	clipStatus;
+		int		texOffsetX;
+		int		texOffsetY;
+		int		page;
+		float	scale;
+		float	modelMat[16];
+	};
+
+	struct CullingWalk
+	{
+		NodeAttributes				attribs;
+		Mat4						modelMat;		// current modelview matrix
+		UINT64						matrixState;	// number for the value of modelMat, see ApplyMatrix()
+		UINT64						nextMatrixState;
+		NFPair						nfPair;			// z range of culling boxes found inside the frustum
+		std::vector<CullingCommand>	commands;
+		int							forkDepth;		// how many pointer lists above this one were split up
+	};
+
+	CullingWalk m_walk;
+
+	std::vector<int> m_straddlingPolys;		// ClipModel() scratch
+
 	void CalcFrustumPlanes	(Plane p[5], const float* matrix);
-	void CalcBox			(float distance, BBox& box);
-	void TransformBox		(const float *m, BBox& box);
 	void MultVec			(const float matrix[16], const float in[4], float out[4]);
-	Clip ClipBox			(BBox& box, Plane planes[5]);
 	void ClipModel			(const Model *m);
 	void ClipPolygon		(ClipPoly& clipPoly, Plane planes[5]);
-	void CalcBoxExtents		(const BBox& box);
+	void CalcBoxExtents		(NFPair& nfPair, const BBox& box);
 	void CalcViewport		(Viewport* vp, float near, float far);
 };
 
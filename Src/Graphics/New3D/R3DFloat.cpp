@@ -1,9 +1,24 @@
 #include "Types.h"
 #include "R3DFloat.h"
+#include <vector>
+
+// every 16 bit value converted up front, as culling nodes look up two each
+static std::vector<float> BuildFloat16Table()
+{
+	std::vector<float> table(0x10000);
+
+	for (UINT32 i = 0; i < 0x10000; i++) {
+		table[i] = R3DFloat::ToFloat(R3DFloat::Convert16BitProFloat(i));
+	}
+
+	return table;
+}
+
+static const std::vector<float> s_float16Table = BuildFloat16Table();
 
 float R3DFloat::GetFloat16(UINT16 f)
 {
-	return ToFloat(Convert16BitProFloat(f));
+	return s_float16Table[f];
 }
 
 float R3DFloat::GetFloat32(UINT32 f)
@@ -13,17 +28,12 @@ float R3DFloat::GetFloat32(UINT32 f)
 
 UINT32 R3DFloat::ConvertProFloat(UINT32 a1)
 {
-	int exponent = (a1 & 0x7E000000) >> 25;
+	UINT32 exponent = (a1 & 0x7E000000) >> 25;
 
-	if (exponent <= 31) {	// positive
-		exponent += 127;
-	}
-	else {					// negative exponent
-		exponent -= 64;
-		exponent += 127;
-	}
+	// exponents above 31 are negative, take 64 off them without a branch
+	exponent = exponent + 127 - ((exponent & 32) << 1);
 
-	int mantissa = (a1 & 0x1FFFFFF) >> 2;
+	UINT32 mantissa = (a1 & 0x1FFFFFF) >> 2;
 
 	return (a1 & 0x80000000) | (exponent << 23) | mantissa;
 }
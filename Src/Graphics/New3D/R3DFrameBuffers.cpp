@@ -1,5 +1,6 @@
 #include "R3DFrameBuffers.h"
 #include "Mat4.h"
+#include <algorithm>
 
 #define countof(a) (sizeof(a)/sizeof(*(a)))
 
@@ -13,16 +14,27 @@ R3DFrameBuffers::R3DFrameBuffers()
 	m_renderBufferIDCopy = 0;
 	m_width = 0;
 	m_height = 0;
+	m_drawWidth = 0;
+	m_drawHeight = 0;
+	m_samples = 0;
+	m_frameBufferIDResolve = 0;
+	m_renderBufferIDResolve = 0;
+	m_unresolved = 0;
 
 	for (auto &i : m_texIDs) {
 		i = 0;
 	}
 
+	for (auto &i : m_msColourIDs) {
+		i = 0;
+	}
+
 	m_lastLayer = Layer::none;
 
 	AllocShaderTrans();
 	AllocShaderBase();
 	AllocShaderWipe();
+	AllocShaderComposite();
 
 	FBVertex vertices[4];
 	vertices[0].Set(-1,-1, 0, 0);
@@ -39,13 +51,29 @@ R3DFrameBuffers::~R3DFrameBuffers()
 	m_shaderTrans.UnloadShaders();
 	m_shaderBase.UnloadShaders();
 	m_shaderWipe.UnloadShaders();
+	m_shaderComposite.UnloadShaders();
 	m_vbo.Destroy();
 }
 
-bool R3DFrameBuffers::CreateFBO(int width, int height)
+bool R3DFrameBuffers::CreateFBO(int width, int height, int samples)
 {
 	m_width = width;
 	m_height = height;
+	m_drawWidth = 0;
+	m_drawHeight = 0;
+	SetDrawSize(width, height);						// all of it until told otherwise
+
+	glGetIntegerv(GL_SCISSOR_BOX, m_scissor);		// set up by the OSD layer before the renderers
+
+	if (samples > 1) {
+		GLint maxSamples = 0;
+		glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+		m_samples = std::min(samples, (int)maxSamples);
+	}
+
+	if (m_samples < 2) {
+		m_samples = 0;
+	}
 
 	m_texIDs[0] = CreateTexture(width, height);		// colour buffer
 	m_texIDs[1] = CreateTexture(width, height);		// trans layer1
@@ -55,14 +83,20 @@ bool R3DFrameBuffers::CreateFBO(int width, int height)
 	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBufferID);
 
 	// colour attachments
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texIDs[0], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_texIDs[1], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_texIDs[2], 0);
+	if (m_samples) {
+		for (unsigned i = 0; i < countof(m_msColourIDs); i++) {
+			m_msColourIDs[i] = CreateRenderBuffer(GL_RGBA8, width, height, m_samples);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_RENDERBUFFER, m_msColourIDs[i]);
+		}
+	}
+	else {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texIDs[0], 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_texIDs[1], 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_texIDs[2], 0);
+	}
 
 	// depth/stencil attachment
-	glGenRenderbuffers(1, &m_renderBufferID);
-	glBindRenderbuffer(GL_RENDERBUFFER, m_renderBufferID);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	m_renderBufferID = CreateRenderBuffer(GL_DEPTH24_STENCIL8, width, height, m_samples);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferID);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferID);
 
@@ -73,6 +107,10 @@ bool R3DFrameBuffers::CreateFBO(int width, int height)
 
 	CreateFBODepthCopy(width, height);
 
+	if (m_samples && !CreateFBOResolve(width, height)) {
+		return false;
+	}
+
 	return (fboStatus == GL_FRAMEBUFFER_COMPLETE);
 }
 
@@ -81,9 +119,7 @@ bool R3DFrameBuffers::CreateFBODepthCopy(int width, int height)
 	glGenFramebuffers(1, &m_frameBufferIDCopy);
 	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBufferIDCopy);
 
-	glGenRenderbuffers(1, &m_renderBufferIDCopy);
-	glBindRenderbuffer(GL_RENDERBUFFER, m_renderBufferIDCopy);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	m_renderBufferIDCopy = CreateRenderBuffer(GL_DEPTH24_STENCIL8, width, height, m_samples);	// blits between them need the same samples
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferIDCopy);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferIDCopy);
 
@@ -95,18 +131,97 @@ bool R3DFrameBuffers::CreateFBODepthCopy(int width, int height)
 	return (fboStatus == GL_FRAMEBUFFER_COMPLETE);
 }
 
+bool R3DFrameBuffers::CreateFBOResolve(int width, int height)
+{
+	glGenFramebuffers(1, &m_frameBufferIDResolve);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBufferIDResolve);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texIDs[0], 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_texIDs[1], 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_texIDs[2], 0);
+
+	// depth only for reading back line of sight, multisampled buffers can't be read directly
+	m_renderBufferIDResolve = CreateRenderBuffer(GL_DEPTH24_STENCIL8, width, height, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferIDResolve);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_renderBufferIDResolve);
+
+	auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return (fboStatus == GL_FRAMEBUFFER_COMPLETE);
+}
+
+GLuint R3DFrameBuffers::CreateRenderBuffer(GLenum format, int width, int height, int samples)
+{
+	GLuint id;
+	glGenRenderbuffers(1, &id);
+	glBindRenderbuffer(GL_RENDERBUFFER, id);
+
+	if (samples) {
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, format, width, height);
+	}
+	else {
+		glRenderbufferStorage(GL_RENDERBUFFER, format, width, height);
+	}
+
+	return id;
+}
+
+void R3DFrameBuffers::Resolve(unsigned layers)
+{
+	layers &= m_unresolved;
+
+	if (!m_samples || !layers) {
+		return;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBufferID);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_frameBufferIDResolve);
+
+	for (unsigned i = 0; i < countof(m_texIDs); i++) {
+		if (layers & (1 << i)) {
+			glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0 + i);
+			glBlitFramebuffer(0, 0, m_drawWidth, m_drawHeight, 0, 0, m_drawWidth, m_drawHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
+	}
+
+	m_unresolved &= ~layers;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_lastLayer == Layer::none ? 0 : m_frameBufferID);		// back to what SetFBO() bound
+}
+
+void R3DFrameBuffers::ReadDepth(int x, int y, void* depth)
+{
+	if (!m_samples) {
+		glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, depth);
+		return;
+	}
+
+	// resolve just the pixel we want, the rectangles have to match when blitting from a multisampled buffer
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBufferID);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_frameBufferIDResolve);
+	glBlitFramebuffer(x, y, x + 1, y + 1, x, y, x + 1, y + 1, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBufferIDResolve);
+	glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, depth);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_lastLayer == Layer::none ? 0 : m_frameBufferID);
+}
+
 void R3DFrameBuffers::StoreDepth()
 {
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBufferID);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_frameBufferIDCopy);
-	glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+	glBlitFramebuffer(0, 0, m_drawWidth, m_drawHeight, 0, 0, m_drawWidth, m_drawHeight, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
 }
 
 void R3DFrameBuffers::RestoreDepth()
 {
 	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frameBufferIDCopy);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_frameBufferID);
-	glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+	glBlitFramebuffer(0, 0, m_drawWidth, m_drawHeight, 0, 0, m_drawWidth, m_drawHeight, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
 }
 
 void R3DFrameBuffers::DestroyFBO()
@@ -122,6 +237,18 @@ void R3DFrameBuffers::DestroyFBO()
 		glDeleteFramebuffers(1, &m_frameBufferIDCopy);
 	}
 
+	if (m_frameBufferIDResolve) {
+		glDeleteRenderbuffers(1, &m_renderBufferIDResolve);
+		glDeleteFramebuffers(1, &m_frameBufferIDResolve);
+	}
+
+	for (auto &i : m_msColourIDs) {
+		if (i) {
+			glDeleteRenderbuffers(1, &i);
+			i = 0;
+		}
+	}
+
 	for (auto &i : m_texIDs) {
 		if (i) {
 			glDeleteTextures(1, &i);
@@ -133,8 +260,57 @@ void R3DFrameBuffers::DestroyFBO()
 	m_renderBufferID = 0;
 	m_frameBufferIDCopy = 0;
 	m_renderBufferIDCopy = 0;
+	m_frameBufferIDResolve = 0;
+	m_renderBufferIDResolve = 0;
+	m_samples = 0;
+	m_unresolved = 0;
 	m_width = 0;
 	m_height = 0;
+	m_drawWidth = 0;
+	m_drawHeight = 0;
+}
+
+void R3DFrameBuffers::SetDrawSize(int width, int height)
+{
+	width	= std::max(1, std::min(width, m_width));
+	height	= std::max(1, std::min(height, m_height));
+
+	if (width == m_drawWidth && height == m_drawHeight) {
+		return;
+	}
+
+	m_drawWidth		= width;
+	m_drawHeight	= height;
+
+	// the quad samples just the draw area, whether it's drawn there or over the whole back buffer
+	float s = (float)m_drawWidth / m_width;
+	float t = (float)m_drawHeight / m_height;
+
+	FBVertex vertices[4];
+	vertices[0].Set(-1,-1, 0, 0);
+	vertices[1].Set(-1, 1, 0, t);
+	vertices[2].Set( 1,-1, s, 0);
+	vertices[3].Set( 1, 1, s, t);
+
+	m_vbo.Bind(true);
+	m_vbo.BufferSubData(0, sizeof(vertices), vertices);
+	m_vbo.Bind(false);
+}
+
+void R3DFrameBuffers::SetScissor(bool drawArea)
+{
+	if (m_drawWidth == m_width && m_drawHeight == m_height) {
+		return;											// full size, the back buffer's box applies as it is
+	}
+
+	if (drawArea) {
+		float s = (float)m_drawWidth / m_width;
+		float t = (float)m_drawHeight / m_height;
+		glScissor((GLint)(m_scissor[0] * s), (GLint)(m_scissor[1] * t), (GLsizei)(m_scissor[2] * s + 0.5f), (GLsizei)(m_scissor[3] * t + 0.5f));
+	}
+	else {
+		glScissor(m_scissor[0], m_scissor[1], m_scissor[2], m_scissor[3]);
+	}
 }
 
 GLuint R3DFrameBuffers::CreateTexture(int width, int height)
@@ -157,10 +333,18 @@ void R3DFrameBuffers::BindTexture(Layer layer)
 
 void R3DFrameBuffers::SetFBO(Layer layer)
 {
+	static const unsigned layerBits[] = { 1, 2, 4, 6, 7, 0 };		// colour, trans1, trans2, trans12, all, none
+
+	m_unresolved |= layerBits[(int)layer];		// assume whatever is bound gets drawn on
+
 	if (m_lastLayer == layer) {
 		return;
 	}
 
+	if ((layer == Layer::none) != (m_lastLayer == Layer::none)) {
+		SetScissor(layer != Layer::none);				// moving between the layers and the back buffer
+	}
+
 	switch (layer)
 	{
 	case Layer::colour:
@@ -219,13 +403,14 @@ void R3DFrameBuffers::AllocShaderBase()
 	const char *fragmentShader = R"glsl(
 
 	uniform sampler2D tex1;			// base tex
+	uniform float minAlpha;			// 1 unless multisampled, when edges are resolved to partial alpha
 
 	varying vec2 fsTexCoord;
 
 	void main()
 	{
 		vec4 colBase = texture2D( tex1, fsTexCoord);
-		if(colBase.a < 1.0) discard;
+		if(colBase.a < minAlpha) discard;
 		gl_FragColor = colBase;
 	}
 
@@ -233,6 +418,7 @@ void R3DFrameBuffers::AllocShaderBase()
 
 	m_shaderBase.LoadShaders(vertexShader, fragmentShader);
 	m_shaderBase.uniformLoc[0] = m_shaderTrans.GetUniformLocation("tex1");
+	m_shaderBase.uniformLoc[1] = m_shaderBase.GetUniformLocation("minAlpha");
 	m_shaderBase.attribLoc[0] = m_shaderTrans.GetAttributeLocation("inVertex");
 	m_shaderBase.attribLoc[1] = m_shaderTrans.GetAttributeLocation("inTexCoord");
 }
@@ -335,13 +521,77 @@ void R3DFrameBuffers::AllocShaderWipe()
 	m_shaderWipe.attribLoc[1] = m_shaderTrans.GetAttributeLocation("inTexCoord");
 }
 
+void R3DFrameBuffers::AllocShaderComposite()
+{
+	const char *vertexShader = R"glsl(
+
+	// inputs
+	attribute vec3 inVertex; 
+	attribute vec2 inTexCoord;
+
+	// outputs
+	varying vec2 fsTexCoord;
+
+	void main(void)
+	{
+		fsTexCoord = inTexCoord;
+		gl_Position = vec4(inVertex,1.0);
+	}
+
+	)glsl";
+
+	const char *fragmentShader = R"glsl(
+
+	uniform sampler2D texColor;		// base colour layer
+	uniform sampler2D tex1;			// trans layer 1
+	uniform sampler2D tex2;			// trans layer 2
+	uniform float minAlpha;			// 1 unless multisampled, when edges are resolved to partial alpha
+
+	varying vec2 fsTexCoord;
+
+	void main()
+	{
+		vec4 colBase	= texture2D( texColor, fsTexCoord);
+		vec4 colTrans1	= texture2D( tex1, fsTexCoord);
+		vec4 colTrans2	= texture2D( tex2, fsTexCoord);
+
+		if(colBase.a < minAlpha) {
+			colBase = vec4(0.0);			// nothing drawn, the back buffer shows through
+		}
+
+		if(colTrans1.a+colTrans2.a > 0.0) {
+			vec3 col1 = (colTrans1.rgb * colTrans1.a) / ( colTrans1.a + colTrans2.a);		// blended as the trans layer shader does
+			vec3 col2 = (colTrans2.rgb * colTrans2.a) / ( colTrans1.a + colTrans2.a);
+
+			colTrans1 = vec4(col1+col2,colTrans1.a+colTrans2.a);
+		}
+
+		colTrans1 = clamp(colTrans1, 0.0, 1.0);	// as blending a fixed point back buffer would
+
+		// trans over base, premultiplied, so what's left to blend with the back buffer is where neither covers
+		gl_FragColor = vec4(colTrans1.rgb * colTrans1.a, colTrans1.a) + colBase * (1.0 - colTrans1.a);
+	}
+
+	)glsl";
+
+	m_shaderComposite.LoadShaders(vertexShader, fragmentShader);
+
+	m_shaderComposite.uniformLoc[0] = m_shaderComposite.GetUniformLocation("texColor");
+	m_shaderComposite.uniformLoc[1] = m_shaderComposite.GetUniformLocation("tex1");
+	m_shaderComposite.uniformLoc[2] = m_shaderComposite.GetUniformLocation("tex2");
+	m_shaderComposite.uniformLoc[3] = m_shaderComposite.GetUniformLocation("minAlpha");
+
+	m_shaderComposite.attribLoc[0] = m_shaderComposite.GetAttributeLocation("inVertex");
+	m_shaderComposite.attribLoc[1] = m_shaderComposite.GetAttributeLocation("inTexCoord");
+}
+
 void R3DFrameBuffers::Draw()
 {
+	Resolve		(7);								// all layers
 	SetFBO		(Layer::none);						// make sure to draw on the back buffer
 	glViewport	(0, 0, m_width, m_height);			// cover the entire screen
 	glDisable	(GL_DEPTH_TEST);					// disable depth testing / writing
 	glDisable	(GL_CULL_FACE);
-	glDisable	(GL_BLEND);
 
 	for (int i = 0; i < countof(m_texIDs); i++) {	// bind our textures to correct texture units
 		glActiveTexture(GL_TEXTURE0 + i);
@@ -351,12 +601,30 @@ void R3DFrameBuffers::Draw()
 	glActiveTexture	(GL_TEXTURE0);
 	m_vbo.Bind		(true);
 
-	DrawBaseLayer	();
+	// one read of each layer and one write of the back buffer, rather than a pass for the base layer then one for the
+	// trans layers. The shader output is premultiplied, which covers both the base layer replacing what's below or,
+	// multisampled, being blended over it by its coverage
+	m_shaderComposite.EnableShader();
+	glUniform1i(m_shaderComposite.uniformLoc[0], 0);
+	glUniform1i(m_shaderComposite.uniformLoc[1], 1);
+	glUniform1i(m_shaderComposite.uniformLoc[2], 2);
+	glUniform1f(m_shaderComposite.uniformLoc[3], m_samples ? 1.0f / 512 : 1.0f);
 
-	glBlendFunc		(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBlendFunc		(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 	glEnable		(GL_BLEND);
 
-	DrawAlphaLayer	();
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribPointer(m_shaderComposite.attribLoc[0], 3, GL_FLOAT, GL_FALSE, sizeof(FBVertex), (void*)offsetof(FBVertex, verts));
+	glVertexAttribPointer(m_shaderComposite.attribLoc[1], 2, GL_FLOAT, GL_FALSE, sizeof(FBVertex), (void*)offsetof(FBVertex, texCoords));
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(1);
+
+	m_shaderComposite.DisableShader();
 
 	glDisable		(GL_BLEND);
 	m_vbo.Bind		(false);
@@ -364,6 +632,7 @@ void R3DFrameBuffers::Draw()
 
 void R3DFrameBuffers::CompositeBaseLayer()
 {
+	Resolve(1);										// colour layer
 	SetFBO(Layer::none);							// make sure to draw on the back buffer
 	glViewport(0, 0, m_width, m_height);			// cover the entire screen
 	glDisable(GL_DEPTH_TEST);						// disable depth testing / writing
@@ -385,6 +654,7 @@ void R3DFrameBuffers::CompositeBaseLayer()
 
 void R3DFrameBuffers::CompositeAlphaLayer()
 {
+	Resolve(6);										// both trans layers
 	SetFBO(Layer::none);							// make sure to draw on the back buffer
 	glViewport(0, 0, m_width, m_height);			// cover the entire screen
 	glDisable(GL_DEPTH_TEST);						// disable depth testing / writing
@@ -409,9 +679,10 @@ void R3DFrameBuffers::CompositeAlphaLayer()
 
 void R3DFrameBuffers::DrawOverTransLayers()
 {
+	Resolve(1);										// reads the colour layer
 	SetFBO(Layer::trans12);							// need to write to both layers
 
-	glViewport	(0, 0, m_width, m_height);			// cover the entire screen
+	glViewport	(0, 0, m_drawWidth, m_drawHeight);	// cover the draw area
 	glDisable	(GL_DEPTH_TEST);					// disable depth testing / writing
 	glDisable	(GL_CULL_FACE);
 	glDisable	(GL_BLEND);
@@ -445,6 +716,15 @@ void R3DFrameBuffers::DrawBaseLayer()
 	m_shaderBase.EnableShader();
 	glUniform1i(m_shaderTrans.uniformLoc[0], 0);
 
+	if (m_samples) {
+		glUniform1f(m_shaderBase.uniformLoc[1], 1.0f / 512);		// anything drawn, over what's below by its coverage
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);				// resolved colour is premultiplied, empty samples are cleared to 0
+		glEnable(GL_BLEND);
+	}
+	else {
+		glUniform1f(m_shaderBase.uniformLoc[1], 1.0f);
+	}
+
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 
@@ -456,6 +736,10 @@ void R3DFrameBuffers::DrawBaseLayer()
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
 
+	if (m_samples) {
+		glDisable(GL_BLEND);
+	}
+
 	m_shaderBase.DisableShader();
 }
 
@@ -14,18 +14,20 @@ public:
 	R3DFrameBuffers();
 	~R3DFrameBuffers();
 
-	void	Draw();					// draw and composite the transparent layers
+	void	Draw();					// composite the colour and transparent layers in one pass, for the last priority layer
 	void	CompositeBaseLayer();
 	void	CompositeAlphaLayer();
 	void	DrawOverTransLayers();	// opaque pixels in next priority layer need to wipe trans pixels
 	
-	bool	CreateFBO(int width, int height);
+	bool	CreateFBO(int width, int height, int samples = 0);	// samples > 1 renders multisampled, resolved before compositing
 	void	DestroyFBO();
+	void	SetDrawSize(int width, int height);		// draw to the bottom left of the layers only, scaled up to their full size when composited
 
 	void	BindTexture(Layer layer);
 	void	SetFBO(Layer layer);
 	void	StoreDepth();
 	void	RestoreDepth();
+	void	ReadDepth(int x, int y, void* depth);	// one float from the bound layers, or into a bound pixel pack buffer at offset depth
 
 private:
 
@@ -45,10 +47,15 @@ private:
 	};
 
 	bool	CreateFBODepthCopy(int width, int height);
+	bool	CreateFBOResolve(int width, int height);
 	GLuint	CreateTexture(int width, int height);
+	GLuint	CreateRenderBuffer(GLenum format, int width, int height, int samples);
+	void	Resolve(unsigned layers);		// copy multisampled layers (bit n for m_texIDs[n]) to their textures if drawn on since
+	void	SetScissor(bool drawArea);		// the back buffer's scissor box, or scaled down to the draw area
 	void	AllocShaderTrans();
 	void	AllocShaderBase();
 	void	AllocShaderWipe();
+	void	AllocShaderComposite();
 
 	void	DrawBaseLayer();
 	void	DrawAlphaLayer();
@@ -61,11 +68,22 @@ private:
 	Layer m_lastLayer;
 	int m_width;
 	int m_height;
+	int m_drawWidth;				// part of the layers drawn on, m_width x m_height unless rendering at a lower scale
+	int m_drawHeight;
+	GLint m_scissor[4];				// back buffer scissor box when the buffers were created
+
+	// multisampling
+	int m_samples;					// 0 if not multisampled
+	GLuint m_msColourIDs[3];		// drawn to in place of m_texIDs
+	GLuint m_frameBufferIDResolve;	// m_texIDs and a depth buffer
+	GLuint m_renderBufferIDResolve;
+	unsigned m_unresolved;			// layers drawn since they were last resolved
 
 	// shaders
 	GLSLShader m_shaderBase;
 	GLSLShader m_shaderTrans;
 	GLSLShader m_shaderWipe;
+	GLSLShader m_shaderComposite;
 
 	// vertices for fbo
 	VBO m_vbo;
@@ -1,23 +1,50 @@
+#include "Supermodel.h"
 #include "R3DShader.h"
 #include "R3DShaderQuads.h"
 #include "R3DShaderTriangles.h"
+#include "Graphics/ShaderCache.h"
+#include <string.h>
 
 // having 2 sets of shaders to maintain is really less than ideal
 // but hopefully not too many breaking changes at this point
 
+// With New3DShaderPermutations the mesh bools in PermutationBits are compiled into the shaders as constants,
+// one program for each combination the game actually draws, so the driver can strip out the branches that
+// aren't taken. The uber program (everything a uniform) is always built as a fallback. Program binaries are
+// kept in a cache file so later runs don't pay for compiling them again.
+
 namespace New3D {
 
+static const char*	PROGRAM_CACHE_FILE			= "NVRAM/New3DShaders.bin";
+static const INT32	PROGRAM_CACHE_FILE_VERSION	= 1;
+
 R3DShader::R3DShader(const Util::Config::Node &config)
 	: m_config(config)
 {
-	m_shaderProgram		= 0;
-	m_vertexShader		= 0;
-	m_geoShader			= 0;
-	m_fragmentShader	= 0;
+	m_quads				= false;
+	m_permutations		= false;
+	m_current			= nullptr;
+	m_programCacheDirty	= false;
+	m_textureSheet		= false;
+
+	memset(&m_loc, -1, sizeof(m_loc));
 
 	Start();	// reset attributes
 }
 
+R3DShader::~R3DShader()
+{
+	if (m_programCacheDirty) {
+		SaveProgramCache();
+	}
+
+	for (auto& it : m_programs) {
+		if (it.second.id) {
+			glDeleteProgram(it.second.id);
+		}
+	}
+}
+
 void R3DShader::Start()
 {
 	m_textured1			= false;
@@ -41,98 +68,390 @@ void R3DShader::Start()
 	m_texWrapMode[0]	= 0;
 	m_texWrapMode[1]	= 0;
 
+	m_baseTexPos[0]		= 0;
+	m_baseTexPos[1]		= 0;
+	m_microTexPos[0]	= 0;
+	m_microTexPos[1]	= 0;
+
+	m_viewport			= nullptr;
+	m_discardAlpha		= false;
+
 	m_dirtyMesh			= true;			// dirty means all the above are dirty, ie first run
 	m_dirtyModel		= true;
+	m_dirtyTexPos		= true;
 }
 
 bool R3DShader::LoadShader(const char* vertexShader, const char* fragmentShader)
 {
-	bool quads = m_config["QuadRendering"].ValueAs<bool>();
-
-	const char* vShader = vertexShaderR3D;
-	const char* gShader = "";
-	const char* fShader = fragmentShaderR3D;
-
-	if (quads) {
-		vShader = vertexShaderR3DQuads;
-		gShader = geometryShaderR3DQuads;
-		fShader = fragmentShaderR3DQuads;
-	}
-
-	m_shaderProgram		= glCreateProgram();
-	m_vertexShader		= glCreateShader(GL_VERTEX_SHADER);
-	m_fragmentShader	= glCreateShader(GL_FRAGMENT_SHADER);
-
-	glShaderSource(m_vertexShader,		1, (const GLchar **)&vShader, NULL);
-	glShaderSource(m_fragmentShader,	1, (const GLchar **)&fShader, NULL);
-
-	glCompileShader(m_vertexShader);
-	glCompileShader(m_fragmentShader);
-
-	if (quads) {
-		m_geoShader = glCreateShader(GL_GEOMETRY_SHADER);
-		glShaderSource(m_geoShader, 1, (const GLchar **)&gShader, NULL);
-		glCompileShader(m_geoShader);
-		glAttachShader(m_shaderProgram, m_geoShader);
-		PrintShaderResult(m_geoShader);
-	}
-
-	PrintShaderResult(m_vertexShader);
-	PrintShaderResult(m_fragmentShader);
-
-	glAttachShader(m_shaderProgram, m_vertexShader);
-	glAttachShader(m_shaderProgram, m_fragmentShader);
-	glLinkProgram(m_shaderProgram);
-
-	PrintProgramResult(m_shaderProgram);
-
-	m_locTexture1			= glGetUniformLocation(m_shaderProgram, "tex1");
-	m_locTexture2			= glGetUniformLocation(m_shaderProgram, "tex2");
-	m_locTexture1Enabled	= glGetUniformLocation(m_shaderProgram, "textureEnabled");
-	m_locTexture2Enabled	= glGetUniformLocation(m_shaderProgram, "microTexture");
-	m_locTextureAlpha		= glGetUniformLocation(m_shaderProgram, "textureAlpha");
-	m_locAlphaTest			= glGetUniformLocation(m_shaderProgram, "alphaTest");
-	m_locMicroTexScale		= glGetUniformLocation(m_shaderProgram, "microTextureScale");
-	m_locBaseTexSize		= glGetUniformLocation(m_shaderProgram, "baseTexSize");
-	m_locTextureInverted	= glGetUniformLocation(m_shaderProgram, "textureInverted");
-	m_locTexWrapMode		= glGetUniformLocation(m_shaderProgram, "textureWrapMode");
-
-	m_locFogIntensity		= glGetUniformLocation(m_shaderProgram, "fogIntensity");
-	m_locFogDensity			= glGetUniformLocation(m_shaderProgram, "fogDensity");
-	m_locFogStart			= glGetUniformLocation(m_shaderProgram, "fogStart");
-	m_locFogColour			= glGetUniformLocation(m_shaderProgram, "fogColour");
-	m_locFogAttenuation		= glGetUniformLocation(m_shaderProgram, "fogAttenuation");
-	m_locFogAmbient			= glGetUniformLocation(m_shaderProgram, "fogAmbient");
-
-	m_locLighting			= glGetUniformLocation(m_shaderProgram, "lighting");
-	m_locLightEnabled		= glGetUniformLocation(m_shaderProgram, "lightEnabled");
-	m_locSunClamp			= glGetUniformLocation(m_shaderProgram, "sunClamp");
-	m_locIntensityClamp		= glGetUniformLocation(m_shaderProgram, "intensityClamp");
-	m_locShininess			= glGetUniformLocation(m_shaderProgram, "shininess");
-	m_locSpecularValue		= glGetUniformLocation(m_shaderProgram, "specularValue");
-	m_locSpecularEnabled	= glGetUniformLocation(m_shaderProgram, "specularEnabled");
-	m_locFixedShading		= glGetUniformLocation(m_shaderProgram, "fixedShading");
-	m_locTranslatorMap		= glGetUniformLocation(m_shaderProgram, "translatorMap");
-
-	m_locSpotEllipse		= glGetUniformLocation(m_shaderProgram, "spotEllipse");
-	m_locSpotRange			= glGetUniformLocation(m_shaderProgram, "spotRange");
-	m_locSpotColor			= glGetUniformLocation(m_shaderProgram, "spotColor");
-	m_locSpotFogColor		= glGetUniformLocation(m_shaderProgram, "spotFogColor");
-	m_locModelScale			= glGetUniformLocation(m_shaderProgram, "modelScale");
-
-	m_locProjMat			= glGetUniformLocation(m_shaderProgram, "projMat");
-	m_locModelMat			= glGetUniformLocation(m_shaderProgram, "modelMat");
-
-	m_locHardwareStep		= glGetUniformLocation(m_shaderProgram, "hardwareStep");
-	m_locDiscardAlpha		= glGetUniformLocation(m_shaderProgram, "discardAlpha");
+	m_quads = m_config["QuadRendering"].ValueAs<bool>();
+
+	m_textureSheet = m_config["New3DTextureSheet"].ValueAsDefault<bool>(false);
+	m_permutations = m_config["New3DShaderPermutations"].ValueAsDefault<bool>(false);
+
+	if (m_permutations) {
+		LoadProgramCache();
+	}
+
+	Program& uber = m_programs[PERM_UBER];
+
+	if (!uber.id && !BuildProgram(PERM_UBER, uber)) {
+		return false;
+	}
+
+	m_current	= &uber;
+	m_loc		= uber.loc;
 
 	return true;
 }
 
+unsigned R3DShader::PermutationKey(const Mesh* m) const
+{
+	if (!m_permutations) {
+		return PERM_UBER;
+	}
+
+	unsigned key = 0;
+
+	if (m->textured)		key |= PERM_TEXTURED;
+	if (m->microTexture)	key |= PERM_MICRO_TEXTURE;
+	if (m->lighting)		key |= PERM_LIGHTING;
+	if (m->specular)		key |= PERM_SPECULAR;
+	if (m->fixedShading)	key |= PERM_FIXED_SHADING;
+	if (m->translatorMap)	key |= PERM_TRANSLATOR_MAP;
+
+	return key;
+}
+
+R3DShader::Program* R3DShader::GetProgram(unsigned key)
+{
+	auto it = m_programs.find(key);
+
+	if (it == m_programs.end()) {
+		it = m_programs.emplace(key, Program()).first;
+
+		if (BuildProgram(key, it->second)) {
+			m_programCacheDirty = true;
+		}
+	}
+
+	if (!it->second.id) {
+		return &m_programs[PERM_UBER];		// failed to build, an id of 0 is kept so we only try once
+	}
+
+	return &it->second;
+}
+
+bool R3DShader::BuildProgram(unsigned key, Program& program, const std::vector<char>* binary, GLenum binaryFormat)
+{
+	bool	cacheShared	= false;
+	bool	compiled	= false;
+	UINT64	cacheKey	= 0;
+
+	program.id = glCreateProgram();
+
+	if (binary) {
+		glProgramBinary(program.id, binaryFormat, binary->data(), (GLsizei)binary->size());
+	}
+	else {
+		const char* sources[3]	= { vertexShaderR3D, fragmentShaderR3D, nullptr };
+		GLenum types[3]			= { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+
+		if (m_quads) {
+			sources[0] = vertexShaderR3DQuads;
+			sources[1] = fragmentShaderR3DQuads;
+			sources[2] = geometryShaderR3DQuads;
+		}
+
+		// the specialised values go straight after the #version line, the uber program has none
+		std::string prelude;
+
+		if (key != PERM_UBER) {
+			prelude =	"#define SPECIALISED\n";
+			prelude +=	std::string("const bool textureEnabled = ")		+ ((key & PERM_TEXTURED)		? "true" : "false") + ";\n";
+			prelude +=	std::string("const bool microTexture = ")		+ ((key & PERM_MICRO_TEXTURE)	? "true" : "false") + ";\n";
+			prelude +=	std::string("const bool lightEnabled = ")		+ ((key & PERM_LIGHTING)		? "true" : "false") + ";\n";
+			prelude +=	std::string("const bool specularEnabled = ")	+ ((key & PERM_SPECULAR)		? "true" : "false") + ";\n";
+			prelude +=	std::string("const bool fixedShading = ")		+ ((key & PERM_FIXED_SHADING)	? "true" : "false") + ";\n";
+			prelude +=	std::string("const bool translatorMap = ")		+ ((key & PERM_TRANSLATOR_MAP)	? "true" : "false") + ";\n";
+			prelude +=	std::string("const bool textureSheet = ")		+ (m_textureSheet				? "true" : "false") + ";\n";
+		}
+
+		// without permutations there is no New3DShaders.bin, so the uber program is kept in the shared cache
+		cacheShared	= !m_permutations;
+		cacheKey	= cacheShared ? CShaderCache::Shared().Key(sources, 3) : 0;
+
+		if (!cacheShared || !CShaderCache::Shared().Load(program.id, cacheKey)) {
+
+			compiled = true;
+
+			GLuint shaders[3] = { 0, 0, 0 };
+
+			for (int i = 0; i < 3 && sources[i]; i++) {
+
+				std::string source = sources[i];
+				size_t pos = source.find('\n', source.find("#version"));
+				source.insert(pos + 1, prelude);
+
+				const GLchar* str = source.c_str();
+
+				shaders[i] = glCreateShader(types[i]);
+				glShaderSource(shaders[i], 1, &str, NULL);
+				glCompileShader(shaders[i]);
+				PrintShaderResult(shaders[i]);
+				glAttachShader(program.id, shaders[i]);
+			}
+
+			// same attribute locations in every program, so the vertex layout doesn't depend on which is bound
+			glBindAttribLocation(program.id, 0, "inVertex");
+			glBindAttribLocation(program.id, 1, "inNormal");
+			glBindAttribLocation(program.id, 2, "inTexCoord");
+			glBindAttribLocation(program.id, 3, "inColour");
+			glBindAttribLocation(program.id, 4, "inFaceNormal");
+			glBindAttribLocation(program.id, 5, "inFixedShade");
+			glBindAttribLocation(program.id, 6, "inModelMat");		// and 7-9, a location for each column
+
+			if (m_permutations && GLEW_ARB_get_program_binary) {
+				glProgramParameteri(program.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			}
+			else if (cacheShared) {
+				CShaderCache::Shared().PrepareLink(program.id);
+			}
+
+			glLinkProgram(program.id);
+
+			PrintProgramResult(program.id);
+
+			for (int i = 0; i < 3 && shaders[i]; i++) {
+				glDetachShader(program.id, shaders[i]);
+				glDeleteShader(shaders[i]);
+			}
+		}
+	}
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program.id, GL_LINK_STATUS, &linked);
+
+	if (linked == GL_FALSE) {
+		glDeleteProgram(program.id);
+		program.id = 0;
+		return false;
+	}
+
+	if (cacheShared && compiled) {
+		CShaderCache::Shared().Store(program.id, cacheKey);
+	}
+
+	GLuint id		= program.id;
+	Locations& loc	= program.loc;
+
+	loc.texture1			= glGetUniformLocation(id, "tex1");
+	loc.texture2			= glGetUniformLocation(id, "tex2");
+	loc.texture1Enabled		= glGetUniformLocation(id, "textureEnabled");
+	loc.texture2Enabled		= glGetUniformLocation(id, "microTexture");
+	loc.textureAlpha		= glGetUniformLocation(id, "textureAlpha");
+	loc.alphaTest			= glGetUniformLocation(id, "alphaTest");
+	loc.microTexScale		= glGetUniformLocation(id, "microTextureScale");
+	loc.baseTexSize			= glGetUniformLocation(id, "baseTexSize");
+	loc.textureInverted		= glGetUniformLocation(id, "textureInverted");
+	loc.texWrapMode			= glGetUniformLocation(id, "textureWrapMode");
+	loc.textureSheet		= glGetUniformLocation(id, "textureSheet");
+	loc.baseTexPos			= glGetUniformLocation(id, "baseTexPos");
+	loc.microTexPos			= glGetUniformLocation(id, "microTexPos");
+
+	loc.fogIntensity		= glGetUniformLocation(id, "fogIntensity");
+	loc.fogDensity			= glGetUniformLocation(id, "fogDensity");
+	loc.fogStart			= glGetUniformLocation(id, "fogStart");
+	loc.fogColour			= glGetUniformLocation(id, "fogColour");
+	loc.fogAttenuation		= glGetUniformLocation(id, "fogAttenuation");
+	loc.fogAmbient			= glGetUniformLocation(id, "fogAmbient");
+
+	loc.lighting			= glGetUniformLocation(id, "lighting");
+	loc.lightEnabled		= glGetUniformLocation(id, "lightEnabled");
+	loc.sunClamp			= glGetUniformLocation(id, "sunClamp");
+	loc.intensityClamp		= glGetUniformLocation(id, "intensityClamp");
+	loc.shininess			= glGetUniformLocation(id, "shininess");
+	loc.specularValue		= glGetUniformLocation(id, "specularValue");
+	loc.specularEnabled		= glGetUniformLocation(id, "specularEnabled");
+	loc.fixedShading		= glGetUniformLocation(id, "fixedShading");
+	loc.translatorMap		= glGetUniformLocation(id, "translatorMap");
+
+	loc.spotEllipse			= glGetUniformLocation(id, "spotEllipse");
+	loc.spotRange			= glGetUniformLocation(id, "spotRange");
+	loc.spotColor			= glGetUniformLocation(id, "spotColor");
+	loc.spotFogColor		= glGetUniformLocation(id, "spotFogColor");
+	loc.modelScale			= glGetUniformLocation(id, "modelScale");
+
+	loc.projMat				= glGetUniformLocation(id, "projMat");
+
+	loc.hardwareStep		= glGetUniformLocation(id, "hardwareStep");
+	loc.discardAlpha		= glGetUniformLocation(id, "discardAlpha");
+
+	return true;
+}
+
+void R3DShader::UseProgram(Program* program)
+{
+	glUseProgram(program->id);
+
+	m_current	= program;
+	m_loc		= program->loc;
+
+	// uniforms are per program, so everything set so far has to be sent again
+	glUniform1i(m_loc.textureSheet, m_textureSheet);
+	glUniform1i(m_loc.discardAlpha, m_discardAlpha);
+
+	if (m_viewport) {
+		SetViewportUniforms(m_viewport);
+	}
+
+	if (!m_dirtyModel) {
+		glUniform1f(m_loc.modelScale, m_modelScale);		// the matrix is an attribute, which isn't per program
+	}
+
+	if (!m_dirtyTexPos) {
+		glUniform2fv(m_loc.baseTexPos, 1, m_baseTexPos);
+		glUniform2fv(m_loc.microTexPos, 1, m_microTexPos);
+	}
+
+	m_dirtyMesh = true;
+}
+
+UINT64 R3DShader::ProgramCacheHash() const
+{
+	// anything that would make a cached binary wrong, or unloadable
+	std::string ids[] = {
+		(const char*)glGetString(GL_VENDOR),
+		(const char*)glGetString(GL_RENDERER),
+		(const char*)glGetString(GL_VERSION),
+		m_quads ? vertexShaderR3DQuads : vertexShaderR3D,
+		m_quads ? fragmentShaderR3DQuads : fragmentShaderR3D,
+		m_quads ? geometryShaderR3DQuads : "",
+		m_textureSheet ? "sheet" : "",
+	};
+
+	UINT64 hash = 0xCBF29CE484222325ULL;	// FNV-1a
+
+	for (const auto& id : ids) {
+		for (unsigned char c : id) {
+			hash = (hash ^ c) * 0x100000001B3ULL;
+		}
+		hash = (hash ^ 0xFF) * 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+void R3DShader::LoadProgramCache()
+{
+	CBlockFile	file;
+	INT32		fileVersion;
+	UINT64		hash;
+	UINT32		count;
+
+	if (!GLEW_ARB_get_program_binary || OKAY != file.Load(PROGRAM_CACHE_FILE)) {
+		return;
+	}
+
+	if (OKAY != file.FindBlock("Supermodel New3D Shader Cache")) {
+		ErrorLog("'%s' is not a valid shader cache file.", PROGRAM_CACHE_FILE);
+		return;
+	}
+
+	file.Read(&fileVersion, sizeof(fileVersion));
+	file.Read(&hash, sizeof(hash));
+
+	if (fileVersion != PROGRAM_CACHE_FILE_VERSION || hash != ProgramCacheHash() || OKAY != file.FindBlock("Programs")) {
+		m_programCacheDirty = true;			// stale (new driver, shader or settings), rewritten on exit
+		return;
+	}
+
+	if (file.Read(&count, sizeof(count)) != sizeof(count)) {
+		return;
+	}
+
+	for (UINT32 i = 0; i < count; i++) {
+
+		UINT32 entry[3];	// key, binary format, length
+
+		if (file.Read(entry, sizeof(entry)) != sizeof(entry)) {
+			break;
+		}
+
+		std::vector<char> binary(entry[2]);
+
+		if (file.Read(binary.data(), entry[2]) != entry[2]) {
+			break;
+		}
+
+		Program program;
+
+		if (BuildProgram(entry[0], program, &binary, entry[1])) {
+			m_programs[entry[0]] = program;
+		}
+		else {
+			m_programCacheDirty = true;		// driver refused it, compiled again when needed
+		}
+	}
+}
+
+void R3DShader::SaveProgramCache()
+{
+	CBlockFile	file;
+	INT32		fileVersion	= PROGRAM_CACHE_FILE_VERSION;
+	UINT64		hash		= ProgramCacheHash();
+	UINT32		count		= 0;
+
+	if (!GLEW_ARB_get_program_binary) {
+		return;
+	}
+
+	for (const auto& it : m_programs) {
+		if (it.second.id) {
+			count++;
+		}
+	}
+
+	if (OKAY != file.Create(PROGRAM_CACHE_FILE, "Supermodel New3D Shader Cache", "Supermodel Version " SUPERMODEL_VERSION)) {
+		ErrorLog("Unable to save shader cache to '%s'. Make sure directory exists!", PROGRAM_CACHE_FILE);
+		return;
+	}
+
+	file.Write(&fileVersion, sizeof(fileVersion));
+	file.Write(&hash, sizeof(hash));
+
+	file.NewBlock("Programs", "Program binaries for each permutation");
+	file.Write(&count, sizeof(count));
+
+	for (const auto& it : m_programs) {
+
+		if (!it.second.id) {
+			continue;
+		}
+
+		GLint length = 0;
+		GLenum format = 0;
+
+		glGetProgramiv(it.second.id, GL_PROGRAM_BINARY_LENGTH, &length);
+
+		std::vector<char> binary(length);
+
+		if (length > 0) {
+			glGetProgramBinary(it.second.id, length, &length, &format, binary.data());
+		}
+
+		UINT32 entry[3] = { it.first, format, (UINT32)length };
+
+		file.Write(entry, sizeof(entry));
+		file.Write(binary.data(), entry[2]);
+	}
+
+	file.Close();
+}
+
 GLint R3DShader::GetVertexAttribPos(const std::string& attrib)
 {
 	if (m_vertexLocCache.count(attrib)==0) {
-		auto pos = glGetAttribLocation(m_shaderProgram, attrib.c_str());
+		auto pos = glGetAttribLocation(m_programs[PERM_UBER].id, attrib.c_str());
 		m_vertexLocCache[attrib] = pos;
 	}
 
@@ -142,9 +461,10 @@ GLint R3DShader::GetVertexAttribPos(const std::string& attrib)
 void R3DShader::SetShader(bool enable)
 {
 	if (enable) {
-		glUseProgram(m_shaderProgram);
+		glUseProgram(m_current->id);
 		Start();
 		DiscardAlpha(false);	// need some default
+		glUniform1i(m_loc.textureSheet, m_textureSheet);
 	}
 	else {
 		glUseProgram(0);
@@ -157,86 +477,94 @@ void R3DShader::SetMeshUniforms(const Mesh* m)
 		return;			// sanity check
 	}
 
+	if (m_permutations) {
+		Program* program = GetProgram(PermutationKey(m));
+
+		if (program != m_current) {
+			UseProgram(program);
+		}
+	}
+
 	if (m_dirtyMesh) {
-		glUniform1i(m_locTexture1, 0);
-		glUniform1i(m_locTexture2, 1);
+		glUniform1i(m_loc.texture1, 0);
+		glUniform1i(m_loc.texture2, 1);
 	}
 
 	if (m_dirtyMesh || m->textured != m_textured1) {
-		glUniform1i(m_locTexture1Enabled, m->textured);
+		glUniform1i(m_loc.texture1Enabled, m->textured);
 		m_textured1 = m->textured;
 	}
 
 	if (m_dirtyMesh || m->microTexture != m_textured2) {
-		glUniform1i(m_locTexture2Enabled, m->microTexture);
+		glUniform1i(m_loc.texture2Enabled, m->microTexture);
 		m_textured2 = m->microTexture;
 	}
 
 	if (m_dirtyMesh || m->microTextureScale != m_microTexScale) {
-		glUniform1f(m_locMicroTexScale, m->microTextureScale);
+		glUniform1f(m_loc.microTexScale, m->microTextureScale);
 		m_microTexScale = m->microTextureScale;
 	}
 
 	if (m_dirtyMesh || (m_baseTexSize[0] != m->width || m_baseTexSize[1] != m->height)) {
 		m_baseTexSize[0] = (float)m->width;
 		m_baseTexSize[1] = (float)m->height;
-		glUniform2fv(m_locBaseTexSize, 1, m_baseTexSize);
+		glUniform2fv(m_loc.baseTexSize, 1, m_baseTexSize);
 	}
 
 	if (m_dirtyMesh || m->inverted != m_textureInverted) {
-		glUniform1i(m_locTextureInverted, m->inverted);
+		glUniform1i(m_loc.textureInverted, m->inverted);
 		m_textureInverted = m->inverted;
 	}
 
 	if (m_dirtyMesh || m->alphaTest != m_alphaTest) {
-		glUniform1i(m_locAlphaTest, m->alphaTest);
+		glUniform1i(m_loc.alphaTest, m->alphaTest);
 		m_alphaTest = m->alphaTest;
 	}
 
 	if (m_dirtyMesh || m->textureAlpha != m_textureAlpha) {
-		glUniform1i(m_locTextureAlpha, m->textureAlpha);
+		glUniform1i(m_loc.textureAlpha, m->textureAlpha);
 		m_textureAlpha = m->textureAlpha;
 	}
 
 	if (m_dirtyMesh || m->fogIntensity != m_fogIntensity) {
-		glUniform1f(m_locFogIntensity, m->fogIntensity);
+		glUniform1f(m_loc.fogIntensity, m->fogIntensity);
 		m_fogIntensity = m->fogIntensity;
 	}
 
 	if (m_dirtyMesh || m->lighting != m_lightEnabled) {
-		glUniform1i(m_locLightEnabled, m->lighting);
+		glUniform1i(m_loc.lightEnabled, m->lighting);
 		m_lightEnabled = m->lighting;
 	}
 
 	if (m_dirtyMesh || m->shininess != m_shininess) {
-		glUniform1f(m_locShininess, m->shininess);
+		glUniform1f(m_loc.shininess, m->shininess);
 		m_shininess = m->shininess;
 	}
 
 	if (m_dirtyMesh || m->specular != m_specularEnabled) {
-		glUniform1i(m_locSpecularEnabled, m->specular);
+		glUniform1i(m_loc.specularEnabled, m->specular);
 		m_specularEnabled = m->specular;
 	}
 
 	if (m_dirtyMesh || m->specularValue != m_specularValue) {
-		glUniform1f(m_locSpecularValue, m->specularValue);
+		glUniform1f(m_loc.specularValue, m->specularValue);
 		m_specularValue = m->specularValue;
 	}
 
 	if (m_dirtyMesh || m->fixedShading != m_fixedShading) {
-		glUniform1i(m_locFixedShading, m->fixedShading);
+		glUniform1i(m_loc.fixedShading, m->fixedShading);
 		m_fixedShading = m->fixedShading;
 	}
 
 	if (m_dirtyMesh || m->translatorMap != m_translatorMap) {
-		glUniform1i(m_locTranslatorMap, m->translatorMap);
+		glUniform1i(m_loc.translatorMap, m->translatorMap);
 		m_translatorMap = m->translatorMap;
 	}
 
 	if (m_dirtyMesh || m->wrapModeU != m_texWrapMode[0] || m->wrapModeV != m_texWrapMode[1]) {
 		m_texWrapMode[0] = m->wrapModeU;
 		m_texWrapMode[1] = m->wrapModeV;
-		glUniform2iv(m_locTexWrapMode, 1, m_texWrapMode);
+		glUniform2iv(m_loc.texWrapMode, 1, m_texWrapMode);
 	}
 
 	if (m_dirtyMesh || m->layered != m_layered) {
@@ -255,40 +583,101 @@ void R3DShader::SetMeshUniforms(const Mesh* m)
 void R3DShader::SetViewportUniforms(const Viewport *vp)
 {
 	//didn't bother caching these, they don't get frequently called anyway
-	glUniform1f(m_locFogDensity, vp->fogParams[3]);
-	glUniform1f(m_locFogStart, vp->fogParams[4]);
-	glUniform3fv(m_locFogColour, 1, vp->fogParams);
-	glUniform1f(m_locFogAttenuation, vp->fogParams[5]);
-	glUniform1f(m_locFogAmbient, vp->fogParams[6]);
-
-	glUniform3fv(m_locLighting, 2, vp->lightingParams);
-	glUniform1i(m_locSunClamp, vp->sunClamp);
-	glUniform1i(m_locIntensityClamp, vp->intensityClamp);
-	glUniform4fv(m_locSpotEllipse, 1, vp->spotEllipse);
-	glUniform2fv(m_locSpotRange, 1, vp->spotRange);
-	glUniform3fv(m_locSpotColor, 1, vp->spotColor);
-	glUniform3fv(m_locSpotFogColor, 1, vp->spotFogColor);
-
-	glUniformMatrix4fv(m_locProjMat, 1, GL_FALSE, vp->projectionMatrix);
-
-	glUniform1i(m_locHardwareStep, vp->hardwareStep);
+	m_viewport = vp;
+
+	glUniform1f(m_loc.fogDensity, vp->fogParams[3]);
+	glUniform1f(m_loc.fogStart, vp->fogParams[4]);
+	glUniform3fv(m_loc.fogColour, 1, vp->fogParams);
+	glUniform1f(m_loc.fogAttenuation, vp->fogParams[5]);
+	glUniform1f(m_loc.fogAmbient, vp->fogParams[6]);
+
+	glUniform3fv(m_loc.lighting, 2, vp->lightingParams);
+	glUniform1i(m_loc.sunClamp, vp->sunClamp);
+	glUniform1i(m_loc.intensityClamp, vp->intensityClamp);
+	glUniform4fv(m_loc.spotEllipse, 1, vp->spotEllipse);
+	glUniform2fv(m_loc.spotRange, 1, vp->spotRange);
+	glUniform3fv(m_loc.spotColor, 1, vp->spotColor);
+	glUniform3fv(m_loc.spotFogColor, 1, vp->spotFogColor);
+
+	glUniformMatrix4fv(m_loc.projMat, 1, GL_FALSE, vp->projectionMatrix);
+
+	glUniform1i(m_loc.hardwareStep, vp->hardwareStep);
 }
 
 void R3DShader::SetModelStates(const Model* model)
 {
 	if (m_dirtyModel || model->scale != m_modelScale) {
-		glUniform1f(m_locModelScale, model->scale);
+		glUniform1f(m_loc.modelScale, model->scale);
 		m_modelScale = model->scale;
 	}
 
-	glUniformMatrix4fv(m_locModelMat, 1, GL_FALSE, model->modelMat);
+	// the matrix is a vertex attribute, so instances can have their own, here constant for the whole draw
+	for (int i = 0; i < 4; i++) {
+		glVertexAttrib4fv(6 + i, &model->modelMat[i * 4]);
+	}
+
+	memcpy(m_modelMat, model->modelMat, sizeof(m_modelMat));
 
 	m_dirtyModel = false;
 }
 
+void R3DShader::InvalidateModelStates()
+{
+	m_dirtyModel = true;
+}
+
+bool R3DShader::MeshUniformsMatch(const Mesh* m) const
+{
+	return !m_dirtyMesh &&
+		m->textured == m_textured1 &&
+		m->microTexture == m_textured2 &&
+		m->microTextureScale == m_microTexScale &&
+		m_baseTexSize[0] == m->width && m_baseTexSize[1] == m->height &&
+		m->inverted == m_textureInverted &&
+		m->alphaTest == m_alphaTest &&
+		m->textureAlpha == m_textureAlpha &&
+		m->fogIntensity == m_fogIntensity &&
+		m->lighting == m_lightEnabled &&
+		m->shininess == m_shininess &&
+		m->specular == m_specularEnabled &&
+		m->specularValue == m_specularValue &&
+		m->fixedShading == m_fixedShading &&
+		m->translatorMap == m_translatorMap &&
+		m->wrapModeU == m_texWrapMode[0] && m->wrapModeV == m_texWrapMode[1] &&
+		m->layered == m_layered;
+}
+
+bool R3DShader::ModelStatesMatch(const Model* model) const
+{
+	return !m_dirtyModel &&
+		model->scale == m_modelScale &&
+		memcmp(model->modelMat, m_modelMat, sizeof(m_modelMat)) == 0;
+}
+
+void R3DShader::SetTexturePositions(int baseX, int baseY, int microX, int microY)
+{
+	m_baseTexPos[0]		= (float)baseX;
+	m_baseTexPos[1]		= (float)baseY;
+	m_microTexPos[0]	= (float)microX;
+	m_microTexPos[1]	= (float)microY;
+
+	glUniform2fv(m_loc.baseTexPos, 1, m_baseTexPos);
+	glUniform2fv(m_loc.microTexPos, 1, m_microTexPos);
+
+	m_dirtyTexPos = false;
+}
+
+bool R3DShader::TexturePositionsMatch(int baseX, int baseY, int microX, int microY) const
+{
+	return !m_dirtyTexPos &&
+		m_baseTexPos[0] == baseX && m_baseTexPos[1] == baseY &&
+		m_microTexPos[0] == microX && m_microTexPos[1] == microY;
+}
+
 void R3DShader::DiscardAlpha(bool discard)
 {
-	glUniform1i(m_locDiscardAlpha, discard);
+	glUniform1i(m_loc.discardAlpha, discard);
+	m_discardAlpha = discard;
 }
 
 void R3DShader::PrintShaderResult(GLuint shader)
@@ -6,6 +6,7 @@
 #include "Model.h"
 #include <map>
 #include <string>
+#include <vector>
 
 namespace New3D {
 
@@ -13,10 +14,16 @@ class R3DShader
 {
 public:
 	R3DShader(const Util::Config::Node &config);
+	~R3DShader();
 
 	bool	LoadShader			(const char* vertexShader = nullptr, const char* fragmentShader = nullptr);
 	void	SetMeshUniforms		(const Mesh* m);
 	void	SetModelStates		(const Model* model);
+	bool	MeshUniformsMatch	(const Mesh* m) const;		// true if SetMeshUniforms() would change nothing
+	bool	ModelStatesMatch	(const Model* model) const;	// true if SetModelStates() would change nothing
+	void	InvalidateModelStates();						// after drawing instances, which leave the constant matrix undefined
+	void	SetTexturePositions	(int baseX, int baseY, int microX, int microY);		// position of textures in the sheet, when sampling from it
+	bool	TexturePositionsMatch(int baseX, int baseY, int microX, int microY) const;
 	void	SetViewportUniforms	(const Viewport *vp);
 	void	Start				();
 	void	SetShader			(bool enable = true);
@@ -25,30 +32,98 @@ public:
 
 private:
 
+	// Mesh values that can be compiled into a program permutation as constants rather than uniforms
+	enum PermutationBits {
+		PERM_TEXTURED		= 1 << 0,
+		PERM_MICRO_TEXTURE	= 1 << 1,
+		PERM_LIGHTING		= 1 << 2,
+		PERM_SPECULAR		= 1 << 3,
+		PERM_FIXED_SHADING	= 1 << 4,
+		PERM_TRANSLATOR_MAP	= 1 << 5,
+		PERM_UBER			= 1 << 6,		// the unspecialised program, everything is a uniform
+	};
+
+	struct Locations
+	{
+		// mesh uniform locations
+		GLint texture1;
+		GLint texture2;
+		GLint texture1Enabled;
+		GLint texture2Enabled;
+		GLint textureAlpha;
+		GLint alphaTest;
+		GLint microTexScale;
+		GLint baseTexSize;
+		GLint textureInverted;
+		GLint texWrapMode;
+		GLint translatorMap;
+		GLint textureSheet;
+		GLint baseTexPos;
+		GLint microTexPos;
+
+		// viewport uniform locations
+		GLint fogIntensity;
+		GLint fogDensity;
+		GLint fogStart;
+		GLint fogColour;
+		GLint fogAttenuation;
+		GLint fogAmbient;
+		GLint projMat;
+
+		// lighting / other
+		GLint lighting;
+		GLint lightEnabled;
+		GLint sunClamp;
+		GLint intensityClamp;
+		GLint shininess;
+		GLint specularValue;
+		GLint specularEnabled;
+		GLint fixedShading;
+
+		GLint spotEllipse;
+		GLint spotRange;
+		GLint spotColor;
+		GLint spotFogColor;
+
+		// model uniforms
+		GLint modelScale;
+
+		// global uniforms
+		GLint hardwareStep;
+		GLint discardAlpha;
+	};
+
+	struct Program
+	{
+		GLuint		id = 0;
+		Locations	loc;
+	};
+
+	unsigned	PermutationKey		(const Mesh* m) const;
+	Program*	GetProgram			(unsigned key);
+	bool		BuildProgram		(unsigned key, Program& program, const std::vector<char>* binary = nullptr, GLenum binaryFormat = 0);
+	void		UseProgram			(Program* program);		// makes it current and gives it all the state set so far
+	void		LoadProgramCache	();
+	void		SaveProgramCache	();
+	UINT64		ProgramCacheHash	() const;
+
 	void PrintShaderResult(GLuint shader);
 	void PrintProgramResult(GLuint program);
 
 	// run-time config
 	const Util::Config::Node &m_config;
 
-	// shader IDs
-	GLuint m_shaderProgram;
-	GLuint m_vertexShader;
-	GLuint m_geoShader;
-	GLuint m_fragmentShader;
-
-	// mesh uniform locations
-	GLint m_locTexture1;
-	GLint m_locTexture2;
-	GLint m_locTexture1Enabled;
-	GLint m_locTexture2Enabled;
-	GLint m_locTextureAlpha;
-	GLint m_locAlphaTest;
-	GLint m_locMicroTexScale;
-	GLint m_locBaseTexSize;
-	GLint m_locTextureInverted;
-	GLint m_locTexWrapMode;
-	GLint m_locTranslatorMap;
+	// programs
+	bool							m_quads;
+	bool							m_permutations;		// build a program specialised on PermutationBits for each combination meshes use
+	std::map<unsigned, Program>		m_programs;
+	Program*						m_current;
+	Locations						m_loc;				// of m_current
+	bool							m_programCacheDirty;	// programs were compiled that aren't in the cache file
+
+	// state set since Start(), to pass on when switching program
+	const Viewport*	m_viewport;
+	bool			m_discardAlpha;
 
 	// cached mesh values
 	bool	m_textured1;
@@ -68,45 +143,19 @@ private:
 	float	m_baseTexSize[2];
 	int		m_texWrapMode[2];
 	bool	m_textureInverted;
+	float	m_baseTexPos[2];
+	float	m_microTexPos[2];
 
 	// cached model values
 	float	m_modelScale;
+	float	m_modelMat[16];
 
 	// are our cache values dirty
 	bool	m_dirtyMesh;
 	bool	m_dirtyModel;
+	bool	m_dirtyTexPos;
 
-	// viewport uniform locations
-	GLint m_locFogIntensity;
-	GLint m_locFogDensity;
-	GLint m_locFogStart;
-	GLint m_locFogColour;
-	GLint m_locFogAttenuation;
-	GLint m_locFogAmbient;
-	GLint m_locProjMat;
-
-	// lighting / other
-	GLint m_locLighting;
-	GLint m_locLightEnabled;
-	GLint m_locSunClamp;
-	GLint m_locIntensityClamp;
-	GLint m_locShininess;
-	GLint m_locSpecularValue;
-	GLint m_locSpecularEnabled;
-	GLint m_locFixedShading;
-
-	GLint m_locSpotEllipse;
-	GLint m_locSpotRange;
-	GLint m_locSpotColor;
-	GLint m_locSpotFogColor;
-
-	// model uniforms
-	GLint m_locModelScale;
-	GLint m_locModelMat;
-
-	// global uniforms
-	GLint m_locHardwareStep;
-	GLint m_locDiscardAlpha;
+	bool	m_textureSheet;		// textures are sampled from the whole texture sheet
 
 	// vertex attribute position cache
 	std::map<std::string, GLint> m_vertexLocCache;
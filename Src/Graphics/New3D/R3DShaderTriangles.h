@@ -7,9 +7,10 @@ static const char *vertexShaderR3D = R"glsl(
 
 // uniforms
 uniform float	modelScale;
-uniform mat4	modelMat;
 uniform mat4	projMat;
+#ifndef SPECIALISED
 uniform bool	translatorMap;
+#endif
 
 // attributes
 attribute vec4	inVertex;
@@ -18,6 +19,7 @@ attribute vec2	inTexCoord;
 attribute vec4	inColour;
 attribute vec3	inFaceNormal;		// used to emulate r3d culling 
 attribute float	inFixedShade;
+attribute mat4	inModelMat;		// per instance when drawn instanced
 
 // outputs to fragment shader
 varying vec3	fsViewVertex;
@@ -41,7 +43,7 @@ vec4 GetColour(vec4 colour)
 float CalcBackFace(in vec3 viewVertex)
 {
 	vec3 vt = viewVertex - vec3(0.0);
-	vec3 vn = (mat3(modelMat) * inFaceNormal);
+	vec3 vn = (mat3(inModelMat) * inFaceNormal);
 
 	// dot product of face normal with view direction
 	return dot(vt, vn);
@@ -49,13 +51,13 @@ float CalcBackFace(in vec3 viewVertex)
 
 void main(void)
 {
-	fsViewVertex	= vec3(modelMat * inVertex);
-	fsViewNormal	= (mat3(modelMat) * inNormal) / modelScale;
+	fsViewVertex	= vec3(inModelMat * inVertex);
+	fsViewNormal	= (mat3(inModelMat) * inNormal) / modelScale;
 	fsDiscard		= CalcBackFace(fsViewVertex);
 	fsColor    		= GetColour(inColour);
 	fsTexCoord		= inTexCoord;
 	fsFixedShade	= inFixedShade;
-	gl_Position		= projMat * modelMat * inVertex;
+	gl_Position		= projMat * inModelMat * inVertex;
 }
 )glsl";
 
@@ -67,8 +69,10 @@ uniform sampler2D tex1;			// base tex
 uniform sampler2D tex2;			// micro tex (optional)
 
 // texturing
+#ifndef SPECIALISED
 uniform bool	textureEnabled;
 uniform bool	microTexture;
+#endif
 uniform float	microTextureScale;
 uniform vec2	baseTexSize;
 uniform bool	textureInverted;
@@ -76,6 +80,11 @@ uniform bool	textureAlpha;
 uniform bool	alphaTest;
 uniform bool	discardAlpha;
 uniform ivec2	textureWrapMode;
+#ifndef SPECIALISED
+uniform bool	textureSheet;		// tex1/tex2 hold the whole texture sheet, with textures at baseTexPos/microTexPos
+#endif
+uniform vec2	baseTexPos;
+uniform vec2	microTexPos;
 
 // general
 uniform vec3	fogColour;
@@ -84,10 +93,14 @@ uniform vec2	spotRange;			// spotlight Z range: .x=start (viewspace coordinates)
 uniform vec3	spotColor;			// spotlight RGB color
 uniform vec3	spotFogColor;		// spotlight RGB color on fog
 uniform vec3	lighting[2];		// lighting state (lighting[0] = sun direction, lighting[1].x,y = diffuse, ambient intensities from 0-1.0)
+#ifndef SPECIALISED
 uniform bool	lightEnabled;		// lighting enabled (1.0) or luminous (0.0), drawn at full intensity
+#endif
 uniform bool	sunClamp;			// not used by daytona and la machine guns
 uniform bool	intensityClamp;		// some games such as daytona and 
+#ifndef SPECIALISED
 uniform bool	specularEnabled;	// specular enabled
+#endif
 uniform float	specularValue;		// specular coefficient
 uniform float	shininess;			// specular shininess
 uniform float	fogIntensity;
@@ -95,7 +108,9 @@ uniform float	fogDensity;
 uniform float	fogStart;
 uniform float	fogAttenuation;
 uniform float	fogAmbient;
+#ifndef SPECIALISED
 uniform bool	fixedShading;
+#endif
 uniform int		hardwareStep;
 
 //interpolated inputs from vertex shader
@@ -162,16 +177,35 @@ float LinearTexLocations(int wrapMode, float size, float u, out float u0, out fl
 	}
 }
 
-vec4 texBiLinear(sampler2D texSampler, float level, ivec2 wrapMode, vec2 texSize, vec2 texCoord)
+vec2 SheetCoords(vec2 texPos, float level, vec2 texSize, vec2 texCoord)
+{
+	// the r3d keeps mipmaps in the sheet itself, level n of each 1024 line page starting at 2048-2048/2^n across and 1024-1024/2^n down
+	float d		= pow(2.0, level);
+	float page	= floor(texPos.y / 1024.0) * 1024.0;
+	vec2 origin	= vec2(2048.0, 1024.0) * (1.0 - 1.0 / d) + floor((texPos - vec2(0.0, page)) / d) + vec2(0.0, page);
+
+	return (origin + texCoord * texSize) / 2048.0;
+}
+
+vec4 texSample(sampler2D texSampler, float level, vec2 texPos, vec2 texSize, vec2 texCoord)
+{
+	if(textureSheet) {
+		return texture2DLod(texSampler, SheetCoords(texPos, level, texSize, texCoord), 0.0);
+	}
+
+	return texture2DLod(texSampler, texCoord, level);
+}
+
+vec4 texBiLinear(sampler2D texSampler, float level, ivec2 wrapMode, vec2 texPos, vec2 texSize, vec2 texCoord)
 {
 	float tx[2], ty[2];
 	float a = LinearTexLocations(wrapMode.s, texSize.x, texCoord.x, tx[0], tx[1]);
 	float b = LinearTexLocations(wrapMode.t, texSize.y, texCoord.y, ty[0], ty[1]);
 	
-	vec4 p0q0 = texture2DLod(texSampler, vec2(tx[0],ty[0]), level);
-    vec4 p1q0 = texture2DLod(texSampler, vec2(tx[1],ty[0]), level);
-    vec4 p0q1 = texture2DLod(texSampler, vec2(tx[0],ty[1]), level);
-    vec4 p1q1 = texture2DLod(texSampler, vec2(tx[1],ty[1]), level);
+	vec4 p0q0 = texSample(texSampler, level, texPos, texSize, vec2(tx[0],ty[0]));
+    vec4 p1q0 = texSample(texSampler, level, texPos, texSize, vec2(tx[1],ty[0]));
+    vec4 p0q1 = texSample(texSampler, level, texPos, texSize, vec2(tx[0],ty[1]));
+    vec4 p1q1 = texSample(texSampler, level, texPos, texSize, vec2(tx[1],ty[1]));
 
 	if(alphaTest) {
 		if(p0q0.a > p1q0.a)		{ p1q0.rgb = p0q0.rgb; }
@@ -194,7 +228,7 @@ vec4 texBiLinear(sampler2D texSampler, float level, ivec2 wrapMode, vec2 texSize
     return mix( pInterp_q0, pInterp_q1, b ); // Interpolate in Y direction.
 }
 
-vec4 textureR3D(sampler2D texSampler, ivec2 wrapMode, vec2 texSize, vec2 texCoord)
+vec4 textureR3D(sampler2D texSampler, ivec2 wrapMode, vec2 texPos, vec2 texSize, vec2 texCoord)
 {
 	float numLevels = floor(log2(min(texSize.x, texSize.y)));				// r3d only generates down to 1:1 for square textures, otherwise its the min dimension
 	float fLevel	= min(mip_map_level(texCoord * texSize), numLevels);
@@ -207,15 +241,15 @@ vec4 textureR3D(sampler2D texSampler, ivec2 wrapMode, vec2 texSize, vec2 texCoor
 	vec2 texSize0 = texSize / pow(2, iLevel);
 	vec2 texSize1 = texSize / pow(2, iLevel+1.0);
 
-	vec4 texLevel0 = texBiLinear(texSampler, iLevel, wrapMode, texSize0, texCoord);
-	vec4 texLevel1 = texBiLinear(texSampler, iLevel+1.0, wrapMode, texSize1, texCoord);
+	vec4 texLevel0 = texBiLinear(texSampler, iLevel, wrapMode, texPos, texSize0, texCoord);
+	vec4 texLevel1 = texBiLinear(texSampler, iLevel+1.0, wrapMode, texPos, texSize1, texCoord);
 
 	return mix(texLevel0, texLevel1, fract(fLevel));	// linear blend between our mipmap levels
 }
 
 vec4 GetTextureValue()
 {
-	vec4 tex1Data = textureR3D(tex1, textureWrapMode, baseTexSize, fsTexCoord);
+	vec4 tex1Data = textureR3D(tex1, textureWrapMode, baseTexPos, baseTexSize, fsTexCoord);
 
 	if(textureInverted) {
 		tex1Data.rgb = vec3(1.0) - vec3(tex1Data.rgb);
@@ -223,7 +257,7 @@ vec4 GetTextureValue()
 
 	if (microTexture) {
 		vec2 scale			= (baseTexSize / 128.0) * microTextureScale;
-		vec4 tex2Data		= textureR3D( tex2, ivec2(0), vec2(128.0), fsTexCoord * scale);
+		vec4 tex2Data		= textureR3D( tex2, ivec2(0), microTexPos, vec2(128.0), fsTexCoord * scale);
 
 		float lod			= mip_map_level(fsTexCoord * scale * vec2(128.0));
 
@@ -0,0 +1,918 @@
+#include "SIMDMath.h"
+#include "Util/CPUFeatures.h"
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SIMDMATH_SSE
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define SIMDMATH_AVX
+#endif
+#elif defined(__ARM_NEON)
+#define SIMDMATH_NEON
+#endif
+
+#if defined(SIMDMATH_AVX)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define AVX_TARGET
+#else
+#define AVX_TARGET __attribute__((target("avx")))
+#endif
+#elif defined(SIMDMATH_SSE)
+#include <xmmintrin.h>
+#elif defined(SIMDMATH_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(SIMDMATH_SSE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SIMDMATH_SSE2			// the integer conversions of the vertex decoding need sse2
+#include <emmintrin.h>
+#endif
+
+namespace New3D {
+namespace SIMDMath {
+
+// corners of the culling box, in the order CNew3D has always used
+static const float s_cornerX[8] = { -1, -1,  1,  1, -1, -1,  1,  1 };
+static const float s_cornerY[8] = { -1, -1, -1, -1,  1,  1,  1,  1 };
+static const float s_cornerZ[8] = {  1, -1, -1,  1,  1, -1, -1,  1 };
+
+// each mask has bit n set if corner n is on the inside of the plane
+static Clip ClassifyBox(const unsigned masks[5])
+{
+	unsigned inside = masks[0] & masks[1] & masks[2] & masks[3] & masks[4];
+
+	if (inside == 0xFF)	return Clip::INSIDE;
+	if (inside != 0)	return Clip::INTERCEPT;
+
+	// all points are outside of the view frustum, check for all points being on the same side of any plane
+
+	for (int i = 0; i < 5; i++) {
+		if (masks[i] == 0) {
+			return Clip::OUTSIDE;
+		}
+	}
+
+	return Clip::INTERCEPT;		// box is traversing view frustum
+}
+
+// position of vertex n of the polygons, through the indices if there are any
+static inline const float* Pos(const FVertex* vertices, const UINT32* indices, int n)
+{
+	return vertices[indices ? indices[n] : n].pos;
+}
+
+//
+// scalar
+//
+
+static void MultMatricesScalar(const float a[16], const float b[16], float r[16])
+{
+#define A(row,col)  a[(col<<2)+row]
+#define B(row,col)  b[(col<<2)+row]
+#define P(row,col)  r[(col<<2)+row]
+
+	float t[16];
+
+	for (int i = 0; i < 4; i++) {
+		const float ai0 = A(i, 0), ai1 = A(i, 1), ai2 = A(i, 2), ai3 = A(i, 3);
+		t[(0<<2)+i] = ai0 * B(0, 0) + ai1 * B(1, 0) + ai2 * B(2, 0) + ai3 * B(3, 0);
+		t[(1<<2)+i] = ai0 * B(0, 1) + ai1 * B(1, 1) + ai2 * B(2, 1) + ai3 * B(3, 1);
+		t[(2<<2)+i] = ai0 * B(0, 2) + ai1 * B(1, 2) + ai2 * B(2, 2) + ai3 * B(3, 2);
+		t[(3<<2)+i] = ai0 * B(0, 3) + ai1 * B(1, 3) + ai2 * B(2, 3) + ai3 * B(3, 3);
+	}
+
+	memcpy(r, t, sizeof(t));	// b can be r too
+
+#undef A
+#undef B
+#undef P
+}
+
+// Whether the box is entirely outside the plane, from the signed distance of its centre and how far its corners
+// reach along the plane's normal. That is exactly what testing the corners would find, but only boxes clear of the
+// plane by more than rounding could make up are counted, so the result never differs from the corners'.
+static inline bool BoxOutsidePlane(const float m[16], float distance, const Plane& p)
+{
+	float reach = std::abs(distance) * (std::abs(p.a * m[0] + p.b * m[1] + p.c * m[2]) +
+										std::abs(p.a * m[4] + p.b * m[5] + p.c * m[6]) +
+										std::abs(p.a * m[8] + p.b * m[9] + p.c * m[10]));
+	float centre = p.a * m[12] + p.b * m[13] + p.c * m[14] + p.d;
+	float scale = std::abs(p.a * m[12]) + std::abs(p.b * m[13]) + std::abs(p.c * m[14]) + std::abs(p.d) + reach;
+
+	return centre + reach < -scale * 1e-4f;
+}
+
+static bool BoxOutside(const float m[16], float distance, const Plane planes[5])
+{
+	for (int j = 0; j < 5; j++) {
+		if (BoxOutsidePlane(m, distance, planes[j])) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static Clip TransformClipBoxScalar(const float m[16], float distance, const Plane planes[5], V4::Vec4 points[8])
+{
+	unsigned masks[5] = { 0, 0, 0, 0, 0 };
+
+	// much of what gets tested is off screen, and its corners aren't needed
+	if (BoxOutside(m, distance, planes)) {
+		return Clip::OUTSIDE;
+	}
+
+	for (int i = 0; i < 8; i++) {
+
+		float x = s_cornerX[i] * distance;
+		float y = s_cornerY[i] * distance;
+		float z = s_cornerZ[i] * distance;
+
+		for (int j = 0; j < 3; j++) {
+			points[i][j] = x * m[0 * 4 + j] + y * m[1 * 4 + j] + z * m[2 * 4 + j] + m[3 * 4 + j];
+		}
+
+		points[i][3] = 1;
+
+		for (int j = 0; j < 5; j++) {
+			if (planes[j].a * points[i][0] + planes[j].b * points[i][1] + planes[j].c * points[i][2] + planes[j].d >= 0) {
+				masks[j] |= 1 << i;
+			}
+		}
+	}
+
+	return ClassifyBox(masks);
+}
+
+// polygons first to polyCount-1, which the vector versions use for what's left over
+static int ClipPolysZRangeFrom(int first, const float m[16], const FVertex* vertices, const UINT32* indices, int polyCount, int polyVerts, const Plane planes[4], float& zNear, float& zFar, int* straddling)
+{
+	int		count	= 0;
+	float	nearZ	= zNear;		// locals, as writes through the references could alias the inputs
+	float	farZ	= zFar;
+
+	for (int i = first; i < polyCount; i++) {
+
+		unsigned	allInside = 0xF, anyInside = 0;
+		float		z[4];
+
+		for (int j = 0; j < polyVerts; j++) {
+
+			const float* in = Pos(vertices, indices, i * polyVerts + j);
+			float p[3];
+
+			for (int k = 0; k < 3; k++) {		// as CNew3D::MultVec()
+				p[k] = in[0] * m[0 * 4 + k] + in[1] * m[1 * 4 + k] + in[2] * m[2 * 4 + k] + in[3] * m[3 * 4 + k];
+			}
+
+			unsigned inside = 0;
+
+			for (int k = 0; k < 4; k++) {		// as CNew3D::ClipPolygon()
+				if ((planes[k].a * p[0] + planes[k].b * p[1] + planes[k].c * p[2]) + planes[k].d >= 0) {
+					inside |= 1 << k;
+				}
+			}
+
+			allInside &= inside;
+			anyInside |= inside;
+			z[j] = p[2];
+		}
+
+		if (anyInside != 0xF) {
+			continue;							// clipped away by a plane
+		}
+
+		if (allInside != 0xF) {
+			straddling[count++] = i;
+			continue;
+		}
+
+		for (int j = 0; j < polyVerts; j++) {
+			if (z[j] < 0) {
+				nearZ	= std::max(z[j], nearZ);
+				farZ	= std::min(z[j], farZ);
+			}
+		}
+	}
+
+	zNear	= nearZ;
+	zFar	= farZ;
+
+	return count;
+}
+
+static int ClipPolysZRangeScalar(const float m[16], const FVertex* vertices, const UINT32* indices, int polyCount, int polyVerts, const Plane planes[4], float& zNear, float& zFar, int* straddling)
+{
+	return ClipPolysZRangeFrom(0, m, vertices, indices, polyCount, polyVerts, planes, zNear, zFar, straddling);
+}
+
+// normals and signed shades, as CNew3D has always converted them
+static float ByteToFloat(INT8 b)
+{
+	return (2.0f * b + 1.0f) * (1.0f / 255.0f);
+}
+
+// vertices first to the end of the batch, which the vector versions use for what's left over
+static void DecodeVerticesFrom(int first, VertexBatch& batch, float vertexFactor, bool signedShade)
+{
+	for (int i = first; i < batch.Size(); i++) {
+
+		const UINT32* in = batch.data[i];
+
+		batch.x[i]	= (((INT32)in[0]) >> 8) * vertexFactor;
+		batch.y[i]	= (((INT32)in[1]) >> 8) * vertexFactor;
+		batch.z[i]	= (((INT32)in[2]) >> 8) * vertexFactor;
+
+		batch.nx[i]	= ByteToFloat((INT8)(in[0] & 0xFF));
+		batch.ny[i]	= ByteToFloat((INT8)(in[1] & 0xFF));
+		batch.nz[i]	= ByteToFloat((INT8)(in[2] & 0xFF));
+
+		batch.shade[i] = signedShade ? batch.nx[i] : (in[0] & 0xFF) / 255.f;
+
+		// as Texture::GetCoordinates()
+		batch.u[i]	= ((UINT16)(in[3] >> 16) * batch.uvScale[i]) / batch.texWidth[i];
+		batch.v[i]	= ((UINT16)(in[3] & 0xFFFF) * batch.uvScale[i]) / batch.texHeight[i];
+	}
+}
+
+static void DecodeVerticesScalar(VertexBatch& batch, float vertexFactor, bool signedShade)
+{
+	DecodeVerticesFrom(0, batch, vertexFactor, signedShade);
+}
+
+//
+// sse, 4 corners at a time
+//
+
+#if defined(SIMDMATH_SSE)
+
+static void MultMatricesSSE(const float a[16], const float b[16], float r[16])
+{
+	__m128 a0 = _mm_loadu_ps(a + 0);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+	__m128 col[4];
+
+	for (int j = 0; j < 4; j++) {
+		__m128 p  = _mm_mul_ps(a0, _mm_set1_ps(b[j * 4 + 0]));
+		p = _mm_add_ps(p, _mm_mul_ps(a1, _mm_set1_ps(b[j * 4 + 1])));
+		p = _mm_add_ps(p, _mm_mul_ps(a2, _mm_set1_ps(b[j * 4 + 2])));
+		col[j] = _mm_add_ps(p, _mm_mul_ps(a3, _mm_set1_ps(b[j * 4 + 3])));
+	}
+
+	for (int j = 0; j < 4; j++) {
+		_mm_storeu_ps(r + j * 4, col[j]);
+	}
+}
+
+// BoxOutsidePlane() for all five planes, the four side ones a lane each
+static inline bool BoxOutsideSSE(const float m[16], float distance, const Plane planes[5])
+{
+	__m128 a = _mm_loadu_ps(&planes[0].a);
+	__m128 b = _mm_loadu_ps(&planes[1].a);
+	__m128 c = _mm_loadu_ps(&planes[2].a);
+	__m128 d = _mm_loadu_ps(&planes[3].a);
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 reach = _mm_setzero_ps();
+
+	for (int k = 0; k < 3; k++) {
+		__m128 v = _mm_mul_ps(a, _mm_set1_ps(m[k * 4 + 0]));
+		v = _mm_add_ps(v, _mm_mul_ps(b, _mm_set1_ps(m[k * 4 + 1])));
+		v = _mm_add_ps(v, _mm_mul_ps(c, _mm_set1_ps(m[k * 4 + 2])));
+		reach = _mm_add_ps(reach, _mm_andnot_ps(sign, v));
+	}
+
+	reach = _mm_mul_ps(reach, _mm_set1_ps(std::abs(distance)));
+
+	__m128 tx = _mm_mul_ps(a, _mm_set1_ps(m[12]));
+	__m128 ty = _mm_mul_ps(b, _mm_set1_ps(m[13]));
+	__m128 tz = _mm_mul_ps(c, _mm_set1_ps(m[14]));
+	__m128 centre = _mm_add_ps(_mm_add_ps(_mm_add_ps(tx, ty), tz), d);
+	__m128 scale = _mm_add_ps(_mm_andnot_ps(sign, tx), _mm_andnot_ps(sign, ty));
+	scale = _mm_add_ps(scale, _mm_add_ps(_mm_andnot_ps(sign, tz), _mm_andnot_ps(sign, d)));
+	scale = _mm_add_ps(scale, reach);
+
+	__m128 outside = _mm_cmplt_ps(_mm_add_ps(centre, reach), _mm_mul_ps(scale, _mm_set1_ps(-1e-4f)));
+	if (_mm_movemask_ps(outside)) {
+		return true;
+	}
+
+	return BoxOutsidePlane(m, distance, planes[4]);
+}
+
+// transforms corners first to first+3, returning their inside masks for each plane
+static inline void TransformClip4SSE(const float m[16], __m128 dist, const Plane planes[5], int first, V4::Vec4 points[8], unsigned masks[5])
+{
+	__m128 x = _mm_mul_ps(_mm_loadu_ps(s_cornerX + first), dist);
+	__m128 y = _mm_mul_ps(_mm_loadu_ps(s_cornerY + first), dist);
+	__m128 z = _mm_mul_ps(_mm_loadu_ps(s_cornerZ + first), dist);
+	__m128 p[4];
+
+	for (int j = 0; j < 3; j++) {
+		__m128 v = _mm_mul_ps(x, _mm_set1_ps(m[0 * 4 + j]));
+		v = _mm_add_ps(v, _mm_mul_ps(y, _mm_set1_ps(m[1 * 4 + j])));
+		v = _mm_add_ps(v, _mm_mul_ps(z, _mm_set1_ps(m[2 * 4 + j])));
+		p[j] = _mm_add_ps(v, _mm_set1_ps(m[3 * 4 + j]));
+	}
+
+	for (int j = 0; j < 5; j++) {
+		__m128 d = _mm_mul_ps(p[0], _mm_set1_ps(planes[j].a));
+		d = _mm_add_ps(d, _mm_mul_ps(p[1], _mm_set1_ps(planes[j].b)));
+		d = _mm_add_ps(d, _mm_mul_ps(p[2], _mm_set1_ps(planes[j].c)));
+		d = _mm_add_ps(d, _mm_set1_ps(planes[j].d));
+		masks[j] |= _mm_movemask_ps(_mm_cmpge_ps(d, _mm_setzero_ps())) << first;
+	}
+
+	p[3] = _mm_set1_ps(1.0f);
+	_MM_TRANSPOSE4_PS(p[0], p[1], p[2], p[3]);
+
+	for (int i = 0; i < 4; i++) {
+		_mm_storeu_ps(points[first + i], p[i]);
+	}
+}
+
+static Clip TransformClipBoxSSE(const float m[16], float distance, const Plane planes[5], V4::Vec4 points[8])
+{
+	unsigned masks[5] = { 0, 0, 0, 0, 0 };
+
+	if (BoxOutsideSSE(m, distance, planes)) {
+		return Clip::OUTSIDE;
+	}
+
+	__m128 dist = _mm_set1_ps(distance);
+
+	TransformClip4SSE(m, dist, planes, 0, points, masks);
+	TransformClip4SSE(m, dist, planes, 4, points, masks);
+
+	return ClassifyBox(masks);
+}
+
+// 4 polygons at a time, vertex j of each in a lane
+static int ClipPolysZRangeSSE(const float m[16], const FVertex* vertices, const UINT32* indices, int polyCount, int polyVerts, const Plane planes[4], float& zNear, float& zFar, int* straddling)
+{
+	const __m128 lowest		= _mm_set1_ps(-std::numeric_limits<float>::max());
+	const __m128 highest	= _mm_set1_ps(std::numeric_limits<float>::max());
+	const __m128 zero		= _mm_setzero_ps();
+
+	__m128	nearZ	= lowest;
+	__m128	farZ	= highest;
+	int		count	= 0;
+	int		i		= 0;
+
+	for (; i + 4 <= polyCount; i += 4) {
+
+		__m128 allInside = _mm_cmpeq_ps(zero, zero);
+		__m128 anyInside[4] = { zero, zero, zero, zero };
+		__m128 z[4];
+
+		for (int j = 0; j < polyVerts; j++) {
+
+			__m128 vx = _mm_loadu_ps(Pos(vertices, indices, (i + 0) * polyVerts + j));
+			__m128 vy = _mm_loadu_ps(Pos(vertices, indices, (i + 1) * polyVerts + j));
+			__m128 vz = _mm_loadu_ps(Pos(vertices, indices, (i + 2) * polyVerts + j));
+			__m128 vw = _mm_loadu_ps(Pos(vertices, indices, (i + 3) * polyVerts + j));
+			_MM_TRANSPOSE4_PS(vx, vy, vz, vw);
+
+			__m128 p[3];
+
+			for (int k = 0; k < 3; k++) {
+				__m128 t = _mm_mul_ps(vx, _mm_set1_ps(m[0 * 4 + k]));
+				t = _mm_add_ps(t, _mm_mul_ps(vy, _mm_set1_ps(m[1 * 4 + k])));
+				t = _mm_add_ps(t, _mm_mul_ps(vz, _mm_set1_ps(m[2 * 4 + k])));
+				p[k] = _mm_add_ps(t, _mm_mul_ps(vw, _mm_set1_ps(m[3 * 4 + k])));
+			}
+
+			for (int k = 0; k < 4; k++) {
+				__m128 d = _mm_mul_ps(p[0], _mm_set1_ps(planes[k].a));
+				d = _mm_add_ps(d, _mm_mul_ps(p[1], _mm_set1_ps(planes[k].b)));
+				d = _mm_add_ps(d, _mm_mul_ps(p[2], _mm_set1_ps(planes[k].c)));
+				d = _mm_cmpge_ps(_mm_add_ps(d, _mm_set1_ps(planes[k].d)), zero);
+				allInside		= _mm_and_ps(allInside, d);
+				anyInside[k]	= _mm_or_ps(anyInside[k], d);
+			}
+
+			z[j] = p[2];
+		}
+
+		__m128 visible = _mm_and_ps(_mm_and_ps(anyInside[0], anyInside[1]), _mm_and_ps(anyInside[2], anyInside[3]));
+
+		int straddles = _mm_movemask_ps(_mm_andnot_ps(allInside, visible));
+
+		while (straddles) {
+			int lane = 0;
+			while (!(straddles & (1 << lane))) {
+				lane++;
+			}
+			straddling[count++] = i + lane;
+			straddles &= ~(1 << lane);
+		}
+
+		for (int j = 0; j < polyVerts; j++) {
+			__m128 use = _mm_and_ps(allInside, _mm_cmplt_ps(z[j], zero));
+			nearZ	= _mm_max_ps(nearZ, _mm_or_ps(_mm_and_ps(use, z[j]), _mm_andnot_ps(use, lowest)));
+			farZ	= _mm_min_ps(farZ, _mm_or_ps(_mm_and_ps(use, z[j]), _mm_andnot_ps(use, highest)));
+		}
+	}
+
+	float nearLanes[4], farLanes[4];
+	_mm_storeu_ps(nearLanes, nearZ);
+	_mm_storeu_ps(farLanes, farZ);
+
+	for (int j = 0; j < 4; j++) {		// lanes that saw nothing hold the starting values, which change nothing
+		zNear	= std::max(nearLanes[j], zNear);
+		zFar	= std::min(farLanes[j], zFar);
+	}
+
+	return count + ClipPolysZRangeFrom(i, m, vertices, indices, polyCount, polyVerts, planes, zNear, zFar, straddling + count);
+}
+
+// 4 vertices at a time, one in each lane
+#if defined(SIMDMATH_SSE2)
+static void DecodeVerticesSSE(VertexBatch& batch, float vertexFactor, bool signedShade)
+{
+	const __m128	factor		= _mm_set1_ps(vertexFactor);
+	const __m128	one			= _mm_set1_ps(1.0f);
+	const __m128	two			= _mm_set1_ps(2.0f);
+	const __m128	byteScale	= _mm_set1_ps(1.0f / 255.0f);
+	const __m128	byteMax		= _mm_set1_ps(255.f);
+	const __m128i	byteMask	= _mm_set1_epi32(0xFF);
+	const __m128i	wordMask	= _mm_set1_epi32(0xFFFF);
+
+	int i = 0;
+
+	for (; i + 4 <= batch.Size(); i += 4) {
+
+		// the words are only moved about as floats, which leaves their bits alone
+		__m128 w0 = _mm_loadu_ps((const float*)batch.data[i + 0]);
+		__m128 w1 = _mm_loadu_ps((const float*)batch.data[i + 1]);
+		__m128 w2 = _mm_loadu_ps((const float*)batch.data[i + 2]);
+		__m128 w3 = _mm_loadu_ps((const float*)batch.data[i + 3]);
+		_MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+
+		__m128i ix = _mm_castps_si128(w0);
+		__m128i iy = _mm_castps_si128(w1);
+		__m128i iz = _mm_castps_si128(w2);
+		__m128i it = _mm_castps_si128(w3);
+
+		_mm_storeu_ps(&batch.x[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(ix, 8)), factor));
+		_mm_storeu_ps(&batch.y[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(iy, 8)), factor));
+		_mm_storeu_ps(&batch.z[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(iz, 8)), factor));
+
+		// sign extend the low bytes
+		__m128 nx = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(ix, 24), 24))), one), byteScale);
+		__m128 ny = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(iy, 24), 24))), one), byteScale);
+		__m128 nz = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(iz, 24), 24))), one), byteScale);
+
+		_mm_storeu_ps(&batch.nx[i], nx);
+		_mm_storeu_ps(&batch.ny[i], ny);
+		_mm_storeu_ps(&batch.nz[i], nz);
+		_mm_storeu_ps(&batch.shade[i], signedShade ? nx : _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(ix, byteMask)), byteMax));
+
+		__m128 uvScale = _mm_loadu_ps(&batch.uvScale[i]);
+		_mm_storeu_ps(&batch.u[i], _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(it, 16)), uvScale), _mm_loadu_ps(&batch.texWidth[i])));
+		_mm_storeu_ps(&batch.v[i], _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(it, wordMask)), uvScale), _mm_loadu_ps(&batch.texHeight[i])));
+	}
+
+	DecodeVerticesFrom(i, batch, vertexFactor, signedShade);
+}
+#else
+static void DecodeVerticesSSE(VertexBatch& batch, float vertexFactor, bool signedShade)
+{
+	DecodeVerticesFrom(0, batch, vertexFactor, signedShade);
+}
+#endif
+
+#endif
+
+//
+// avx, all 8 corners at once
+//
+
+#if defined(SIMDMATH_AVX)
+
+AVX_TARGET static Clip TransformClipBoxAVX(const float m[16], float distance, const Plane planes[5], V4::Vec4 points[8])
+{
+	unsigned masks[5];
+
+	if (BoxOutsideSSE(m, distance, planes)) {
+		return Clip::OUTSIDE;
+	}
+
+	__m256 dist = _mm256_set1_ps(distance);
+	__m256 x = _mm256_mul_ps(_mm256_loadu_ps(s_cornerX), dist);
+	__m256 y = _mm256_mul_ps(_mm256_loadu_ps(s_cornerY), dist);
+	__m256 z = _mm256_mul_ps(_mm256_loadu_ps(s_cornerZ), dist);
+	__m256 p[3];
+
+	for (int j = 0; j < 3; j++) {
+		__m256 v = _mm256_mul_ps(x, _mm256_set1_ps(m[0 * 4 + j]));
+		v = _mm256_add_ps(v, _mm256_mul_ps(y, _mm256_set1_ps(m[1 * 4 + j])));
+		v = _mm256_add_ps(v, _mm256_mul_ps(z, _mm256_set1_ps(m[2 * 4 + j])));
+		p[j] = _mm256_add_ps(v, _mm256_set1_ps(m[3 * 4 + j]));
+	}
+
+	for (int j = 0; j < 5; j++) {
+		__m256 d = _mm256_mul_ps(p[0], _mm256_set1_ps(planes[j].a));
+		d = _mm256_add_ps(d, _mm256_mul_ps(p[1], _mm256_set1_ps(planes[j].b)));
+		d = _mm256_add_ps(d, _mm256_mul_ps(p[2], _mm256_set1_ps(planes[j].c)));
+		d = _mm256_add_ps(d, _mm256_set1_ps(planes[j].d));
+		masks[j] = _mm256_movemask_ps(_mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+	}
+
+	// back to one point per row, a half at a time
+
+	for (int half = 0; half < 2; half++) {
+
+		__m128 q0 = half ? _mm256_extractf128_ps(p[0], 1) : _mm256_castps256_ps128(p[0]);
+		__m128 q1 = half ? _mm256_extractf128_ps(p[1], 1) : _mm256_castps256_ps128(p[1]);
+		__m128 q2 = half ? _mm256_extractf128_ps(p[2], 1) : _mm256_castps256_ps128(p[2]);
+		__m128 q3 = _mm_set1_ps(1.0f);
+		_MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+
+		_mm_storeu_ps(points[half * 4 + 0], q0);
+		_mm_storeu_ps(points[half * 4 + 1], q1);
+		_mm_storeu_ps(points[half * 4 + 2], q2);
+		_mm_storeu_ps(points[half * 4 + 3], q3);
+	}
+
+	_mm256_zeroupper();		// the rest of the emulator is sse code, which stalls on dirty upper halves
+
+	return ClassifyBox(masks);
+}
+
+// 8 polygons at a time, vertex j of each in a lane
+AVX_TARGET static int ClipPolysZRangeAVX(const float m[16], const FVertex* vertices, const UINT32* indices, int polyCount, int polyVerts, const Plane planes[4], float& zNear, float& zFar, int* straddling)
+{
+	const __m256 lowest		= _mm256_set1_ps(-std::numeric_limits<float>::max());
+	const __m256 highest	= _mm256_set1_ps(std::numeric_limits<float>::max());
+	const __m256 zero		= _mm256_setzero_ps();
+
+	__m256	nearZ	= lowest;
+	__m256	farZ	= highest;
+	int		count	= 0;
+	int		i		= 0;
+
+	for (; i + 8 <= polyCount; i += 8) {
+
+		__m256 allInside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+		__m256 anyInside[4] = { zero, zero, zero, zero };
+		__m256 z[4];
+
+		for (int j = 0; j < polyVerts; j++) {
+
+			__m128 r[8];
+
+			for (int n = 0; n < 8; n++) {
+				r[n] = _mm_loadu_ps(Pos(vertices, indices, (i + n) * polyVerts + j));
+			}
+
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			_MM_TRANSPOSE4_PS(r[4], r[5], r[6], r[7]);
+
+			__m256 vx = _mm256_insertf128_ps(_mm256_castps128_ps256(r[0]), r[4], 1);
+			__m256 vy = _mm256_insertf128_ps(_mm256_castps128_ps256(r[1]), r[5], 1);
+			__m256 vz = _mm256_insertf128_ps(_mm256_castps128_ps256(r[2]), r[6], 1);
+			__m256 vw = _mm256_insertf128_ps(_mm256_castps128_ps256(r[3]), r[7], 1);
+
+			__m256 p[3];
+
+			for (int k = 0; k < 3; k++) {
+				__m256 t = _mm256_mul_ps(vx, _mm256_set1_ps(m[0 * 4 + k]));
+				t = _mm256_add_ps(t, _mm256_mul_ps(vy, _mm256_set1_ps(m[1 * 4 + k])));
+				t = _mm256_add_ps(t, _mm256_mul_ps(vz, _mm256_set1_ps(m[2 * 4 + k])));
+				p[k] = _mm256_add_ps(t, _mm256_mul_ps(vw, _mm256_set1_ps(m[3 * 4 + k])));
+			}
+
+			for (int k = 0; k < 4; k++) {
+				__m256 d = _mm256_mul_ps(p[0], _mm256_set1_ps(planes[k].a));
+				d = _mm256_add_ps(d, _mm256_mul_ps(p[1], _mm256_set1_ps(planes[k].b)));
+				d = _mm256_add_ps(d, _mm256_mul_ps(p[2], _mm256_set1_ps(planes[k].c)));
+				d = _mm256_cmp_ps(_mm256_add_ps(d, _mm256_set1_ps(planes[k].d)), zero, _CMP_GE_OQ);
+				allInside		= _mm256_and_ps(allInside, d);
+				anyInside[k]	= _mm256_or_ps(anyInside[k], d);
+			}
+
+			z[j] = p[2];
+		}
+
+		__m256 visible = _mm256_and_ps(_mm256_and_ps(anyInside[0], anyInside[1]), _mm256_and_ps(anyInside[2], anyInside[3]));
+
+		int straddles = _mm256_movemask_ps(_mm256_andnot_ps(allInside, visible));
+
+		while (straddles) {
+			int lane = 0;
+			while (!(straddles & (1 << lane))) {
+				lane++;
+			}
+			straddling[count++] = i + lane;
+			straddles &= ~(1 << lane);
+		}
+
+		for (int j = 0; j < polyVerts; j++) {
+			__m256 use = _mm256_and_ps(allInside, _mm256_cmp_ps(z[j], zero, _CMP_LT_OQ));
+			nearZ	= _mm256_max_ps(nearZ, _mm256_blendv_ps(lowest, z[j], use));
+			farZ	= _mm256_min_ps(farZ, _mm256_blendv_ps(highest, z[j], use));
+		}
+	}
+
+	float nearLanes[8], farLanes[8];
+	_mm256_storeu_ps(nearLanes, nearZ);
+	_mm256_storeu_ps(farLanes, farZ);
+
+	_mm256_zeroupper();
+
+	for (int j = 0; j < 8; j++) {
+		zNear	= std::max(nearLanes[j], zNear);
+		zFar	= std::min(farLanes[j], zFar);
+	}
+
+	return count + ClipPolysZRangeFrom(i, m, vertices, indices, polyCount, polyVerts, planes, zNear, zFar, straddling + count);
+}
+
+#endif
+
+//
+// neon, 4 corners at a time
+//
+
+#if defined(SIMDMATH_NEON)
+
+static void MultMatricesNEON(const float a[16], const float b[16], float r[16])
+{
+	float32x4_t a0 = vld1q_f32(a + 0);
+	float32x4_t a1 = vld1q_f32(a + 4);
+	float32x4_t a2 = vld1q_f32(a + 8);
+	float32x4_t a3 = vld1q_f32(a + 12);
+	float32x4_t col[4];
+
+	for (int j = 0; j < 4; j++) {		// separate multiply and add, a fused multiply-add would round differently
+		float32x4_t p = vmulq_n_f32(a0, b[j * 4 + 0]);
+		p = vaddq_f32(p, vmulq_n_f32(a1, b[j * 4 + 1]));
+		p = vaddq_f32(p, vmulq_n_f32(a2, b[j * 4 + 2]));
+		col[j] = vaddq_f32(p, vmulq_n_f32(a3, b[j * 4 + 3]));
+	}
+
+	for (int j = 0; j < 4; j++) {
+		vst1q_f32(r + j * 4, col[j]);
+	}
+}
+
+static inline void TransformClip4NEON(const float m[16], float distance, const Plane planes[5], int first, V4::Vec4 points[8], unsigned masks[5])
+{
+	static const uint32_t bits[4] = { 1, 2, 4, 8 };
+
+	float32x4_t x = vmulq_n_f32(vld1q_f32(s_cornerX + first), distance);
+	float32x4_t y = vmulq_n_f32(vld1q_f32(s_cornerY + first), distance);
+	float32x4_t z = vmulq_n_f32(vld1q_f32(s_cornerZ + first), distance);
+	float32x4x4_t p;
+
+	for (int j = 0; j < 3; j++) {
+		float32x4_t v = vmulq_n_f32(x, m[0 * 4 + j]);
+		v = vaddq_f32(v, vmulq_n_f32(y, m[1 * 4 + j]));
+		v = vaddq_f32(v, vmulq_n_f32(z, m[2 * 4 + j]));
+		p.val[j] = vaddq_f32(v, vdupq_n_f32(m[3 * 4 + j]));
+	}
+
+	for (int j = 0; j < 5; j++) {
+		float32x4_t d = vmulq_n_f32(p.val[0], planes[j].a);
+		d = vaddq_f32(d, vmulq_n_f32(p.val[1], planes[j].b));
+		d = vaddq_f32(d, vmulq_n_f32(p.val[2], planes[j].c));
+		d = vaddq_f32(d, vdupq_n_f32(planes[j].d));
+
+		uint32x4_t inside = vandq_u32(vcgeq_f32(d, vdupq_n_f32(0)), vld1q_u32(bits));
+		uint32x2_t sum = vadd_u32(vget_low_u32(inside), vget_high_u32(inside));
+		masks[j] |= (vget_lane_u32(sum, 0) + vget_lane_u32(sum, 1)) << first;
+	}
+
+	p.val[3] = vdupq_n_f32(1.0f);
+	vst4q_f32(points[first], p);		// interleaves back to one point per row
+}
+
+static Clip TransformClipBoxNEON(const float m[16], float distance, const Plane planes[5], V4::Vec4 points[8])
+{
+	unsigned masks[5] = { 0, 0, 0, 0, 0 };
+
+	if (BoxOutside(m, distance, planes)) {
+		return Clip::OUTSIDE;
+	}
+
+	TransformClip4NEON(m, distance, planes, 0, points, masks);
+	TransformClip4NEON(m, distance, planes, 4, points, masks);
+
+	return ClassifyBox(masks);
+}
+
+// 4 polygons at a time, vertex j of each in a lane
+static int ClipPolysZRangeNEON(const float m[16], const FVertex* vertices, const UINT32* indices, int polyCount, int polyVerts, const Plane planes[4], float& zNear, float& zFar, int* straddling)
+{
+	static const uint32_t bits[4] = { 1, 2, 4, 8 };
+
+	const float32x4_t lowest	= vdupq_n_f32(-std::numeric_limits<float>::max());
+	const float32x4_t highest	= vdupq_n_f32(std::numeric_limits<float>::max());
+	const float32x4_t zero		= vdupq_n_f32(0);
+
+	float32x4_t	nearZ	= lowest;
+	float32x4_t	farZ	= highest;
+	int			count	= 0;
+	int			i		= 0;
+
+	for (; i + 4 <= polyCount; i += 4) {
+
+		uint32x4_t	allInside = vdupq_n_u32(0xFFFFFFFF);
+		uint32x4_t	anyInside[4] = { vdupq_n_u32(0), vdupq_n_u32(0), vdupq_n_u32(0), vdupq_n_u32(0) };
+		float32x4_t	z[4];
+
+		for (int j = 0; j < polyVerts; j++) {
+
+			float32x4x2_t t01 = vtrnq_f32(vld1q_f32(Pos(vertices, indices, (i + 0) * polyVerts + j)), vld1q_f32(Pos(vertices, indices, (i + 1) * polyVerts + j)));
+			float32x4x2_t t23 = vtrnq_f32(vld1q_f32(Pos(vertices, indices, (i + 2) * polyVerts + j)), vld1q_f32(Pos(vertices, indices, (i + 3) * polyVerts + j)));
+
+			float32x4_t vx = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+			float32x4_t vy = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+			float32x4_t vz = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+			float32x4_t vw = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+
+			float32x4_t p[3];
+
+			for (int k = 0; k < 3; k++) {
+				float32x4_t t = vmulq_n_f32(vx, m[0 * 4 + k]);
+				t = vaddq_f32(t, vmulq_n_f32(vy, m[1 * 4 + k]));
+				t = vaddq_f32(t, vmulq_n_f32(vz, m[2 * 4 + k]));
+				p[k] = vaddq_f32(t, vmulq_n_f32(vw, m[3 * 4 + k]));
+			}
+
+			for (int k = 0; k < 4; k++) {
+				float32x4_t d = vmulq_n_f32(p[0], planes[k].a);
+				d = vaddq_f32(d, vmulq_n_f32(p[1], planes[k].b));
+				d = vaddq_f32(d, vmulq_n_f32(p[2], planes[k].c));
+				uint32x4_t inside = vcgeq_f32(vaddq_f32(d, vdupq_n_f32(planes[k].d)), zero);
+				allInside		= vandq_u32(allInside, inside);
+				anyInside[k]	= vorrq_u32(anyInside[k], inside);
+			}
+
+			z[j] = p[2];
+		}
+
+		uint32x4_t visible		= vandq_u32(vandq_u32(anyInside[0], anyInside[1]), vandq_u32(anyInside[2], anyInside[3]));
+		uint32x4_t straddle		= vandq_u32(vbicq_u32(visible, allInside), vld1q_u32(bits));
+		uint32x2_t sum			= vadd_u32(vget_low_u32(straddle), vget_high_u32(straddle));
+		unsigned straddles		= vget_lane_u32(sum, 0) + vget_lane_u32(sum, 1);
+
+		while (straddles) {
+			int lane = 0;
+			while (!(straddles & (1 << lane))) {
+				lane++;
+			}
+			straddling[count++] = i + lane;
+			straddles &= ~(1 << lane);
+		}
+
+		for (int j = 0; j < polyVerts; j++) {
+			uint32x4_t use = vandq_u32(allInside, vcltq_f32(z[j], zero));
+			nearZ	= vmaxq_f32(nearZ, vbslq_f32(use, z[j], lowest));
+			farZ	= vminq_f32(farZ, vbslq_f32(use, z[j], highest));
+		}
+	}
+
+	float nearLanes[4], farLanes[4];
+	vst1q_f32(nearLanes, nearZ);
+	vst1q_f32(farLanes, farZ);
+
+	for (int j = 0; j < 4; j++) {
+		zNear	= std::max(nearLanes[j], zNear);
+		zFar	= std::min(farLanes[j], zFar);
+	}
+
+	return count + ClipPolysZRangeFrom(i, m, vertices, indices, polyCount, polyVerts, planes, zNear, zFar, straddling + count);
+}
+
+// 4 vertices at a time, one in each lane. Dividing needs aarch64, 32 bit arm only has reciprocal estimates.
+#if defined(__aarch64__) || defined(_M_ARM64)
+static void DecodeVerticesNEON(VertexBatch& batch, float vertexFactor, bool signedShade)
+{
+	const float32x4_t	factor		= vdupq_n_f32(vertexFactor);
+	const float32x4_t	one			= vdupq_n_f32(1.0f);
+	const float32x4_t	two			= vdupq_n_f32(2.0f);
+	const float32x4_t	byteScale	= vdupq_n_f32(1.0f / 255.0f);
+	const float32x4_t	byteMax		= vdupq_n_f32(255.f);
+
+	int i = 0;
+
+	for (; i + 4 <= batch.Size(); i += 4) {
+
+		uint32x4x2_t t01 = vtrnq_u32(vld1q_u32(batch.data[i + 0]), vld1q_u32(batch.data[i + 1]));
+		uint32x4x2_t t23 = vtrnq_u32(vld1q_u32(batch.data[i + 2]), vld1q_u32(batch.data[i + 3]));
+
+		int32x4_t	ix = vreinterpretq_s32_u32(vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0])));
+		int32x4_t	iy = vreinterpretq_s32_u32(vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1])));
+		int32x4_t	iz = vreinterpretq_s32_u32(vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0])));
+		uint32x4_t	it = vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]));
+
+		vst1q_f32(&batch.x[i], vmulq_f32(vcvtq_f32_s32(vshrq_n_s32(ix, 8)), factor));
+		vst1q_f32(&batch.y[i], vmulq_f32(vcvtq_f32_s32(vshrq_n_s32(iy, 8)), factor));
+		vst1q_f32(&batch.z[i], vmulq_f32(vcvtq_f32_s32(vshrq_n_s32(iz, 8)), factor));
+
+		// sign extend the low bytes
+		float32x4_t nx = vmulq_f32(vaddq_f32(vmulq_f32(two, vcvtq_f32_s32(vshrq_n_s32(vshlq_n_s32(ix, 24), 24))), one), byteScale);
+		float32x4_t ny = vmulq_f32(vaddq_f32(vmulq_f32(two, vcvtq_f32_s32(vshrq_n_s32(vshlq_n_s32(iy, 24), 24))), one), byteScale);
+		float32x4_t nz = vmulq_f32(vaddq_f32(vmulq_f32(two, vcvtq_f32_s32(vshrq_n_s32(vshlq_n_s32(iz, 24), 24))), one), byteScale);
+
+		vst1q_f32(&batch.nx[i], nx);
+		vst1q_f32(&batch.ny[i], ny);
+		vst1q_f32(&batch.nz[i], nz);
+		vst1q_f32(&batch.shade[i], signedShade ? nx : vdivq_f32(vcvtq_f32_u32(vandq_u32(vreinterpretq_u32_s32(ix), vdupq_n_u32(0xFF))), byteMax));
+
+		float32x4_t uvScale = vld1q_f32(&batch.uvScale[i]);
+		vst1q_f32(&batch.u[i], vdivq_f32(vmulq_f32(vcvtq_f32_u32(vshrq_n_u32(it, 16)), uvScale), vld1q_f32(&batch.texWidth[i])));
+		vst1q_f32(&batch.v[i], vdivq_f32(vmulq_f32(vcvtq_f32_u32(vandq_u32(it, vdupq_n_u32(0xFFFF))), uvScale), vld1q_f32(&batch.texHeight[i])));
+	}
+
+	DecodeVerticesFrom(i, batch, vertexFactor, signedShade);
+}
+#else
+static void DecodeVerticesNEON(VertexBatch& batch, float vertexFactor, bool signedShade)
+{
+	DecodeVerticesFrom(0, batch, vertexFactor, signedShade);
+}
+#endif
+
+#endif
+
+//
+// dispatch
+//
+
+struct Implementation
+{
+	const char* name;
+	uint32_t features;		// needed by the cpu
+	void (*multMatrices)(const float a[16], const float b[16], float r[16]);
+	Clip (*transformClipBox)(const float m[16], float distance, const Plane planes[5], V4::Vec4 points[8]);
+	int  (*clipPolysZRange)(const float m[16], const FVertex* vertices, const UINT32* indices, int polyCount, int polyVerts, const Plane planes[4], float& zNear, float& zFar, int* straddling);
+	void (*decodeVertices)(VertexBatch& batch, float vertexFactor, bool signedShade);
+};
+
+static const Implementation s_implementations[] =		// best first
+{
+#if defined(SIMDMATH_AVX)
+	{ "avx",	Util::CPUFeatures::AVX,	MultMatricesSSE,	TransformClipBoxAVX,	ClipPolysZRangeAVX,	DecodeVerticesSSE },		// no real gain from avx for a single matrix, or without avx2 for integers
+#endif
+#if defined(SIMDMATH_SSE)
+	{ "sse",	0,						MultMatricesSSE,	TransformClipBoxSSE,	ClipPolysZRangeSSE,	DecodeVerticesSSE },
+#endif
+#if defined(SIMDMATH_NEON)
+	{ "neon",	Util::CPUFeatures::NEON,	MultMatricesNEON,	TransformClipBoxNEON,	ClipPolysZRangeNEON,	DecodeVerticesNEON },
+#endif
+	{ "scalar",	0,						MultMatricesScalar,	TransformClipBoxScalar,	ClipPolysZRangeScalar,	DecodeVerticesScalar }
+};
+
+static const Implementation* s_current = Util::CPUFeatures::FindBest(s_implementations);
+
+void MultMatrices(const float a[16], const float b[16], float r[16])
+{
+	s_current->multMatrices(a, b, r);
+}
+
+Clip TransformClipBox(const float m[16], float distance, const Plane planes[5], V4::Vec4 points[8])
+{
+	return s_current->transformClipBox(m, distance, planes, points);
+}
+
+int ClipPolysZRange(const float m[16], const FVertex* vertices, const UINT32* indices, int polyCount, int polyVerts, const Plane planes[4], float& zNear, float& zFar, int* straddling)
+{
+	return s_current->clipPolysZRange(m, vertices, indices, polyCount, polyVerts, planes, zNear, zFar, straddling);
+}
+
+void DecodeVertices(VertexBatch& batch, float vertexFactor, bool signedShade)
+{
+	for (auto out : { &batch.x, &batch.y, &batch.z, &batch.nx, &batch.ny, &batch.nz, &batch.shade, &batch.u, &batch.v }) {
+		out->resize(batch.data.size());
+	}
+
+	s_current->decodeVertices(batch, vertexFactor, signedShade);
+}
+
+const char* GetImplementation()
+{
+	return s_current->name;
+}
+
+bool SetImplementation(const char* name)
+{
+	const Implementation* impl = Util::CPUFeatures::Find(s_implementations, name);
+	if (impl == nullptr) {
+		return false;
+	}
+
+	s_current = impl;
+	return true;
+}
+
+} // SIMDMath
+} // New3D
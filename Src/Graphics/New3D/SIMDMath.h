@@ -0,0 +1,75 @@
+#ifndef _SIMDMATH_H_
+#define _SIMDMATH_H_
+
+#include "Model.h"
+#include "Plane.h"
+#include "Vec.h"
+#include <vector>
+
+// Vectorised versions of the maths done for every culling node. The best implementation the cpu supports
+// is picked the first time any of these is called, and every implementation gives bit identical results.
+
+namespace New3D {
+namespace SIMDMath {
+
+	// Vertices of polygon data to be decoded together. Each is 4 words: x, y and z in their top 24 bits, with the normal
+	// (or the fixed shade, in x) in their low bytes, then the texture coordinates in the top and bottom halves.
+	struct VertexBatch
+	{
+		// one of each per vertex, added with Add()
+		std::vector<const UINT32*>	data;
+		std::vector<float>			uvScale;		// of its polygon, 0 if untextured
+		std::vector<float>			texWidth;		// of its polygon's texture, 1 if untextured
+		std::vector<float>			texHeight;
+
+		// one of each per vertex, written by DecodeVertices()
+		std::vector<float>			x, y, z;		// scaled by the vertex factor
+		std::vector<float>			nx, ny, nz;
+		std::vector<float>			shade;			// fixed shading
+		std::vector<float>			u, v;
+
+		void Clear()
+		{
+			data.clear();
+			uvScale.clear();
+			texWidth.clear();
+			texHeight.clear();
+		}
+
+		void Add(const UINT32* vertex, float scale, float width, float height)
+		{
+			data.push_back(vertex);
+			uvScale.push_back(scale);
+			texWidth.push_back(width);
+			texHeight.push_back(height);
+		}
+
+		int Size() const { return (int)data.size(); }
+	};
+
+	// r = a * b, column major like Mat4. r may be the same as a or b
+	void	MultMatrices		(const float a[16], const float b[16], float r[16]);
+
+	// Transforms the corners of the cube of half width distance around the origin by m, storing them in points,
+	// and classifies the cube against the frustum planes. Cubes plainly outside a plane are rejected without their
+	// corners, which leaves points undefined when the result is Clip::OUTSIDE
+	Clip	TransformClipBox	(const float m[16], float distance, const Plane planes[5], V4::Vec4 points[8]);
+
+	// Transforms polyCount polygons of polyVerts vertices each by m, and classifies them against the four side planes
+	// of the frustum. Polygons entirely inside widen the Z range with their vertices in front of the camera, those
+	// entirely outside a plane are dropped, and the index of each polygon crossing a plane is stored in straddling for
+	// the caller to clip properly. Returns the number of indexes stored. Vertex n of the polygons is vertices[indices[n]],
+	// or vertices[n] with no indices.
+	int		ClipPolysZRange		(const float m[16], const FVertex* vertices, const UINT32* indices, int polyCount, int polyVerts, const Plane planes[4], float& zNear, float& zFar, int* straddling);
+
+	// Decodes every vertex of the batch the way CNew3D::CacheModel() always did one at a time, with the shade signed
+	// or not as the game has it
+	void	DecodeVertices		(VertexBatch& batch, float vertexFactor, bool signedShade);
+
+	const char*	GetImplementation	();					// "avx", "sse", "neon" or "scalar"
+	bool		SetImplementation	(const char* name);	// returns false if not supported by this cpu
+
+} // SIMDMath
+} // New3D
+
+#endif
@@ -1,4 +1,6 @@
 #include "Texture.h"
+#include "TextureCompress.h"
+#include "Util/Hash.h"
 #include <stdio.h>
 #include <math.h>
 #include <algorithm>
@@ -31,6 +33,7 @@ void Texture::Reset()
 	m_height = 0;
 	m_format = 0;
 	m_textureID = 0;
+	m_compressed = false;
 }
 
 void Texture::BindTexture()
@@ -50,15 +53,29 @@ void Texture::GetCoordinates(int width, int height, UINT16 uIn, UINT16 vIn, floa
 	vOut = (vIn*uvScale) / height;
 }
 
-void Texture::UploadTextureMip(int level, const UINT16* src, UINT8* scratch, int format, int x, int y, int width, int height)
+UINT64 Texture::HashDecodedTexture(const UINT8* decoded, int x, int y, int width, int height)
 {
-	int		xi, yi, i;
-	int		subWidth, subHeight;
-	GLubyte	texel;
-	GLubyte	c, a;
-	
-	i = 0;
+	UINT64 hash = 0;
+
+	for (int i = 0; width > 0 && height > 0; i++) {
 
+		int xPos, yPos, subWidth, subHeight;
+		GetMipPosition(i, x, y, xPos, yPos);
+		ClipMip(xPos, yPos, width, height, subWidth, subHeight);
+
+		// only the part of each level that was decoded, the rest of it is whatever the buffer held before
+		hash = (hash * 0x100000001B3ULL) ^ Util::Hash64(decoded, size_t(subWidth) * subHeight * 4);
+
+		decoded += size_t(width) * height * 4;
+		width /= 2;
+		height /= 2;
+	}
+
+	return hash;
+}
+
+void Texture::ClipMip(int x, int y, int width, int height, int& subWidth, int& subHeight)
+{
 	subWidth = width;
 	subHeight = height;
 
@@ -69,6 +86,29 @@ void Texture::UploadTextureMip(int level, const UINT16* src, UINT8* scratch, int
 	if (subHeight + y > 2048) {
 		subHeight = 2048 - y;
 	}
+}
+
+void Texture::GetMipPosition(int level, int x, int y, int& xPos, int& yPos)
+{
+	const int mipXBase[] = { 0, 1024, 1536, 1792, 1920, 1984, 2016, 2032, 2040, 2044, 2046, 2047 };
+	const int mipYBase[] = { 0, 512, 768, 896, 960, 992, 1008, 1016, 1020, 1022, 1023 };
+	const int mipDivisor[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024 };
+
+	int page = y / 1024;
+
+	y -= (page * 1024);	// remove page from tex y
+
+	xPos = mipXBase[level] + (x / mipDivisor[level]);
+	yPos = mipYBase[level] + (y / mipDivisor[level]) + (page * 1024);
+}
+
+void Texture::DecodeTextureMip(const UINT16* src, UINT8* scratch, int format, int x, int y, int subWidth, int subHeight)
+{
+	int		xi, yi, i;
+	GLubyte	texel;
+	GLubyte	c, a;
+	
+	i = 0;
 
 	switch (format)
 	{
@@ -270,6 +310,14 @@ void Texture::UploadTextureMip(int level, const UINT16* src, UINT8* scratch, int
 		}
 		break;
 	}
+}
+
+void Texture::UploadTextureMip(int level, const UINT16* src, UINT8* scratch, int format, int x, int y, int width, int height)
+{
+	int subWidth, subHeight;
+
+	ClipMip(x, y, width, height, subWidth, subHeight);
+	DecodeTextureMip(src, scratch, format, x, y, subWidth, subHeight);
 
 	glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 	glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, subWidth, subHeight, GL_RGBA, GL_UNSIGNED_BYTE, scratch);
@@ -277,10 +325,6 @@ void Texture::UploadTextureMip(int level, const UINT16* src, UINT8* scratch, int
 
 UINT32 Texture::UploadTexture(const UINT16* src, UINT8* scratch, int format, int x, int y, int width, int height)
 {
-	const int mipXBase[] = { 0, 1024, 1536, 1792, 1920, 1984, 2016, 2032, 2040, 2044, 2046, 2047 };
-	const int mipYBase[] = { 0, 512, 768, 896, 960, 992, 1008, 1016, 1020, 1022, 1023 };
-	const int mipDivisor[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024 };
-
 	if (!src || !scratch) {
 		return 0;		// sanity checking
 	}
@@ -288,17 +332,65 @@ UINT32 Texture::UploadTexture(const UINT16* src, UINT8* scratch, int format, int
 	DeleteTexture();	// free any existing texture
 	CreateTextureObject(format, x, y, width, height);
 
-	int page = y / 1024;
+	for (int i = 0; width > 0 && height > 0; i++) {
 
-	y -= (page * 1024);	// remove page from tex y
+		int xPos, yPos;
+		GetMipPosition(i, x, y, xPos, yPos);
+
+		UploadTextureMip(i, src, scratch, format, xPos, yPos, width, height);
+
+		width /= 2;
+		height /= 2;
+	}
+
+	return m_textureID;
+}
+
+size_t Texture::GetDecodedSize(int width, int height)
+{
+	size_t size = 0;
 
+	for (; width > 0 && height > 0; width /= 2, height /= 2) {
+		size += size_t(width) * height * 4;
+	}
+
+	return size;
+}
+
+void Texture::DecodeTexture(const UINT16* src, UINT8* dst, int format, int x, int y, int width, int height)
+{
 	for (int i = 0; width > 0 && height > 0; i++) {
 
-		int xPos = mipXBase[i] + (x / mipDivisor[i]);
-		int yPos = mipYBase[i] + (y / mipDivisor[i]);
+		int xPos, yPos, subWidth, subHeight;
+		GetMipPosition(i, x, y, xPos, yPos);
+		ClipMip(xPos, yPos, width, height, subWidth, subHeight);
+		DecodeTextureMip(src, dst, format, xPos, yPos, subWidth, subHeight);
 
-		UploadTextureMip(i, src, scratch, format, xPos, yPos + (page * 1024), width, height);
+		dst += size_t(width) * height * 4;
+		width /= 2;
+		height /= 2;
+	}
+}
 
+UINT32 Texture::UploadDecodedTexture(const UINT8* decoded, int format, int x, int y, int width, int height)
+{
+	if (!decoded) {
+		return 0;		// sanity checking
+	}
+
+	DeleteTexture();	// free any existing texture
+	CreateTextureObject(format, x, y, width, height);
+
+	for (int i = 0; width > 0 && height > 0; i++) {
+
+		int xPos, yPos, subWidth, subHeight;
+		GetMipPosition(i, x, y, xPos, yPos);
+		ClipMip(xPos, yPos, width, height, subWidth, subHeight);
+
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, subWidth, subHeight, GL_RGBA, GL_UNSIGNED_BYTE, decoded);
+
+		decoded += size_t(width) * height * 4;
 		width /= 2;
 		height /= 2;
 	}
@@ -306,6 +398,70 @@ UINT32 Texture::UploadTexture(const UINT16* src, UINT8* scratch, int format, int
 	return m_textureID;
 }
 
+bool Texture::CompressTexture(const UINT8* decoded, std::vector<UINT8>& compressed, int x, int y, int width, int height)
+{
+	bool alpha = false;
+	size_t size = 0;
+
+	// one format for every level, so look at all of them first
+
+	const UINT8* level = decoded;
+
+	for (int i = 0, w = width, h = height; w > 0 && h > 0; i++, w /= 2, h /= 2) {
+
+		int xPos, yPos, subWidth, subHeight;
+		GetMipPosition(i, x, y, xPos, yPos);
+		ClipMip(xPos, yPos, w, h, subWidth, subHeight);
+
+		alpha = alpha || !TextureCompress::IsOpaque(level, w, subWidth, subHeight);
+		level += size_t(w) * h * 4;
+	}
+
+	for (int w = width, h = height; w > 0 && h > 0; w /= 2, h /= 2) {
+		size += TextureCompress::GetLevelSize(w, h, alpha);
+	}
+
+	compressed.resize(size);
+
+	UINT8* dst = compressed.data();
+
+	for (int i = 0; width > 0 && height > 0; i++) {
+
+		int xPos, yPos, subWidth, subHeight;
+		GetMipPosition(i, x, y, xPos, yPos);
+		ClipMip(xPos, yPos, width, height, subWidth, subHeight);
+		TextureCompress::CompressLevel(decoded, dst, alpha, width, height, subWidth, subHeight);
+
+		decoded += size_t(width) * height * 4;
+		dst += TextureCompress::GetLevelSize(width, height, alpha);
+		width /= 2;
+		height /= 2;
+	}
+
+	return alpha;
+}
+
+void Texture::UploadCompressedTexture(const UINT8* compressed, bool alpha)
+{
+	if (!m_textureID || !compressed) {
+		return;		// sanity checking
+	}
+
+	GLenum internalFormat = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+	glBindTexture(GL_TEXTURE_2D, m_textureID);
+
+	for (int i = 0, width = m_width, height = m_height; width > 0 && height > 0; i++, width /= 2, height /= 2) {
+
+		GLsizei size = GLsizei(TextureCompress::GetLevelSize(width, height, alpha));
+
+		glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, width, height, 0, size, compressed);
+		compressed += size;
+	}
+
+	m_compressed = true;
+}
+
 void Texture::GetDetails(int& x, int&y, int& width, int& height, int& format)
 {
 	x = m_x;
@@ -339,6 +495,12 @@ bool Texture::CheckMapPos(int ax1, int ax2, int ay1, int ay2)
 	return false;
 }
 
+void Texture::Move(int x, int y)
+{
+	m_x = x;
+	m_y = y;
+}
+
 void Texture::CreateTextureObject(int format, int x, int y, int width, int height)
 {
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);	// rgba is always 4 byte aligned
@@ -3,6 +3,7 @@
 
 #include "Types.h"
 #include <GL/glew.h>
+#include <vector>
 
 namespace New3D {
   
@@ -14,19 +15,34 @@ public:
 	~Texture();
 
 	UINT32	UploadTexture	(const UINT16* src, UINT8* scratch, int format, int x, int y, int width, int height);
+	UINT32	UploadDecodedTexture(const UINT8* decoded, int format, int x, int y, int width, int height);	// from buffer filled by DecodeTexture()
+	void	UploadCompressedTexture(const UINT8* compressed, bool alpha);	// replaces the levels of this texture, keeping its GL name
+	bool	IsCompressed	() const { return m_compressed; }
 	void	DeleteTexture	();
 	void	BindTexture		();
 	void	GetCoordinates	(UINT16 uIn, UINT16 vIn, float uvScale, float& uOut, float& vOut);
 	void	GetDetails		(int& x, int&y, int& width, int& height, int& format);
 	bool	Compare			(int x, int y, int width, int height, int format);
 	bool	CheckMapPos		(int ax1, int ax2, int ay1, int ay2);				//check to see if textures overlap
+	void	Move			(int x, int y);		// for the same data found elsewhere in texture RAM, keeping the GL texture
+	void	SetHash			(UINT64 hash) { m_hash = hash; }	// of the decoded data, from HashDecodedTexture()
+	UINT64	GetHash			() const { return m_hash; }
 
 	static void GetCoordinates(int width, int height, UINT16 uIn, UINT16 vIn, float uvScale, float& uOut, float& vOut);
 
+	// convert a texture and its mipmaps to RGBA without touching GL, so this can run on any thread
+	static size_t	GetDecodedSize	(int width, int height);
+	static void		DecodeTexture	(const UINT16* src, UINT8* dst, int format, int x, int y, int width, int height);
+	static void		DecodeTextureMip(const UINT16* src, UINT8* scratch, int format, int x, int y, int subWidth, int subHeight);	// a single rectangle of texture RAM
+	static UINT64	HashDecodedTexture(const UINT8* decoded, int x, int y, int width, int height);	// of what DecodeTexture() wrote
+	static bool		CompressTexture	(const UINT8* decoded, std::vector<UINT8>& compressed, int x, int y, int width, int height);	// S3TC of what DecodeTexture() wrote, returns true if it needed alpha (BC3)
+
 private:
 
 	void CreateTextureObject(int format, int x, int y, int width, int height);
 	void UploadTextureMip(int level, const UINT16* src, UINT8* scratch, int format, int x, int y, int width, int height);
+	static void GetMipPosition(int level, int x, int y, int& xPos, int& yPos);
+	static void ClipMip(int x, int y, int width, int height, int& subWidth, int& subHeight);
 	void Reset();
 
 	int m_x;
@@ -35,6 +51,8 @@ private:
 	int m_height;
 	int m_format;
 	GLuint m_textureID;
+	UINT64 m_hash = 0;
+	bool m_compressed;
 };
 
 } // New3D
@@ -0,0 +1,331 @@
+#include "TextureCompress.h"
+#include "Supermodel.h"
+#include <algorithm>
+
+#define TEXTURE_CACHE_FILE_VERSION 1
+
+namespace New3D {
+namespace TextureCompress {
+
+static UINT16 To565(int r, int g, int b)
+{
+	return UINT16(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+static void From565(UINT16 c, int* rgb)
+{
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+static void Write16(UINT8* dst, UINT16 value)
+{
+	dst[0] = UINT8(value);
+	dst[1] = UINT8(value >> 8);
+}
+
+// colour part of a block, always in the 4 colour mode (c0 > c1) which BC3 also uses
+static void CompressColourBlock(const UINT8 block[16][4], UINT8* dst)
+{
+	int minC[3] = { 255, 255, 255 };
+	int maxC[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			minC[c] = std::min(minC[c], int(block[i][c]));
+			maxC[c] = std::max(maxC[c], int(block[i][c]));
+		}
+	}
+
+	// pull the corners of the bounding box in a little, the palette then spans the colours better than with the extremes
+	for (int c = 0; c < 3; c++) {
+		int inset = (maxC[c] - minC[c]) / 16;
+		minC[c] += inset;
+		maxC[c] -= inset;
+	}
+
+	UINT16 c0 = To565(maxC[0], maxC[1], maxC[2]);
+	UINT16 c1 = To565(minC[0], minC[1], minC[2]);
+
+	if (c0 < c1) {
+		std::swap(c0, c1);
+	}
+
+	Write16(dst + 0, c0);
+	Write16(dst + 2, c1);
+
+	UINT32 indices = 0;
+
+	if (c0 != c1) {
+
+		int palette[4][3];
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+
+			int best = 0;
+			int bestError = INT32_MAX;
+
+			for (int p = 0; p < 4; p++) {
+
+				int dr = block[i][0] - palette[p][0];
+				int dg = block[i][1] - palette[p][1];
+				int db = block[i][2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+
+			indices |= UINT32(best) << (i * 2);
+		}
+	}
+
+	dst[4] = UINT8(indices);
+	dst[5] = UINT8(indices >> 8);
+	dst[6] = UINT8(indices >> 16);
+	dst[7] = UINT8(indices >> 24);
+}
+
+// BC3 alpha part of a block, in the 8 value mode so fully transparent and opaque texels stay exact
+static void CompressAlphaBlock(const UINT8 block[16][4], UINT8* dst)
+{
+	int a0 = 0;
+	int a1 = 255;
+
+	for (int i = 0; i < 16; i++) {
+		a0 = std::max(a0, int(block[i][3]));
+		a1 = std::min(a1, int(block[i][3]));
+	}
+
+	dst[0] = UINT8(a0);
+	dst[1] = UINT8(a1);
+
+	UINT64 indices = 0;
+
+	if (a0 != a1) {
+
+		int palette[8] = { a0, a1 };
+
+		for (int p = 1; p < 7; p++) {
+			palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+		}
+
+		for (int i = 0; i < 16; i++) {
+
+			int best = 0;
+			int bestError = INT32_MAX;
+
+			for (int p = 0; p < 8; p++) {
+
+				int error = std::abs(block[i][3] - palette[p]);
+
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+
+			indices |= UINT64(best) << (i * 3);
+		}
+	}
+
+	for (int i = 0; i < 6; i++) {
+		dst[2 + i] = UINT8(indices >> (i * 8));
+	}
+}
+
+bool IsOpaque(const UINT8* rgba, int width, int validWidth, int validHeight)
+{
+	for (int y = 0; y < validHeight; y++) {
+
+		const UINT8* row = rgba + size_t(y) * width * 4;
+
+		for (int x = 0; x < validWidth; x++) {
+			if (row[x * 4 + 3] != 255) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+size_t GetLevelSize(int width, int height, bool alpha)
+{
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * (alpha ? 16 : 8);
+}
+
+void CompressLevel(const UINT8* rgba, UINT8* dst, bool alpha, int width, int height, int validWidth, int validHeight)
+{
+	UINT8 block[16][4];
+
+	validWidth	= std::max(1, std::min(validWidth, width));
+	validHeight	= std::max(1, std::min(validHeight, height));
+
+	for (int by = 0; by < height; by += 4) {
+
+		for (int bx = 0; bx < width; bx += 4) {
+
+			// levels smaller than a block, and the part past the end of texture RAM, repeat the texels that are there
+			for (int i = 0; i < 16; i++) {
+
+				int x = std::min(bx + (i & 3), validWidth - 1);
+				int y = std::min(by + (i >> 2), validHeight - 1);
+				const UINT8* texel = rgba + (size_t(y) * width + x) * 4;
+
+				block[i][0] = texel[0];
+				block[i][1] = texel[1];
+				block[i][2] = texel[2];
+				block[i][3] = texel[3];
+			}
+
+			if (alpha) {
+				CompressAlphaBlock(block, dst);
+				dst += 8;
+			}
+
+			CompressColourBlock(block, dst);
+			dst += 8;
+		}
+	}
+}
+
+File::File()
+{
+	m_dirty = false;
+}
+
+void File::Load(const std::string& path)
+{
+	CBlockFile	file;
+	INT32		fileVersion;
+	UINT32		count;
+
+	m_path = path;
+	m_entries.clear();
+
+	if (OKAY != file.Load(m_path)) {
+		return;										// nothing cached yet
+	}
+
+	if (OKAY != file.FindBlock("Supermodel New3D Texture Cache")) {
+		ErrorLog("'%s' is not a valid texture cache file.", m_path.c_str());
+		return;
+	}
+
+	file.Read(&fileVersion, sizeof(fileVersion));
+
+	if (fileVersion != TEXTURE_CACHE_FILE_VERSION || OKAY != file.FindBlock("Textures") || file.Read(&count, sizeof(count)) != sizeof(count)) {
+		m_dirty = true;								// stale, will be rewritten on exit
+		return;
+	}
+
+	for (UINT32 i = 0; i < count; i++) {
+
+		UINT64 key;
+		UINT32 entry[2];		// alpha, size
+
+		if (file.Read(&key, sizeof(key)) != sizeof(key) || file.Read(entry, sizeof(entry)) != sizeof(entry)) {
+			break;
+		}
+
+		Entry& e = m_entries[key];
+		e.alpha	= entry[0] != 0;
+		e.used	= false;
+		e.data.resize(entry[1]);
+
+		if (file.Read(e.data.data(), entry[1]) != entry[1]) {
+			m_entries.erase(key);
+			break;
+		}
+	}
+}
+
+void File::Save()
+{
+	if (m_path.empty()) {
+		return;
+	}
+
+	// entries not used this session are dropped, so their absence is also a change
+	UINT32 count = 0;
+
+	for (const auto& it : m_entries) {
+		count += it.second.used ? 1 : 0;
+	}
+
+	if (!m_dirty && count == m_entries.size()) {
+		return;
+	}
+
+	CBlockFile file;
+
+	if (OKAY != file.Create(m_path, "Supermodel New3D Texture Cache", "Supermodel Version " SUPERMODEL_VERSION)) {
+		ErrorLog("Unable to save texture cache to '%s'. Make sure directory exists!", m_path.c_str());
+		return;
+	}
+
+	INT32 fileVersion = TEXTURE_CACHE_FILE_VERSION;
+	file.Write(&fileVersion, sizeof(fileVersion));
+	file.NewBlock("Textures", "S3TC textures by hash of their decoded data");
+	file.Write(&count, sizeof(count));
+
+	for (const auto& it : m_entries) {
+
+		if (!it.second.used) {
+			continue;
+		}
+
+		UINT64 key = it.first;
+		UINT32 entry[2] = { it.second.alpha ? 1u : 0u, UINT32(it.second.data.size()) };
+		file.Write(&key, sizeof(key));
+		file.Write(entry, sizeof(entry));
+		file.Write(it.second.data.data(), entry[1]);
+	}
+
+	file.Close();
+	m_dirty = false;
+}
+
+const std::vector<UINT8>* File::Find(UINT64 key, bool& alpha)
+{
+	auto it = m_entries.find(key);
+
+	if (it == m_entries.end()) {
+		return nullptr;
+	}
+
+	it->second.used = true;
+	alpha = it->second.alpha;
+	return &it->second.data;
+}
+
+void File::Store(UINT64 key, bool alpha, std::vector<UINT8>&& data)
+{
+	if (m_path.empty()) {
+		return;			// nowhere to keep it
+	}
+
+	Entry& e = m_entries[key];
+	e.alpha	= alpha;
+	e.used	= true;
+	e.data	= std::move(data);
+	m_dirty	= true;
+}
+
+} // TextureCompress
+} // New3D
@@ -0,0 +1,56 @@
+#ifndef _TEXTURECOMPRESS_H_
+#define _TEXTURECOMPRESS_H_
+
+#include "Types.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// S3TC encoding of textures that have been decoded to RGBA, so textures which stay in texture RAM take a quarter
+// (BC3) or an eighth (BC1) of the GL memory. The encoder aims to be fast rather than exact, since it runs while
+// the game does; the results are kept in a file so each texture is only encoded once.
+
+namespace New3D {
+namespace TextureCompress {
+
+	// BC1 if every texel the game can see is opaque, BC3 otherwise
+	bool	IsOpaque	(const UINT8* rgba, int width, int validWidth, int validHeight);
+
+	// bytes of one mipmap level, in 4x4 blocks of 8 (BC1) or 16 (BC3) bytes
+	size_t	GetLevelSize(int width, int height, bool alpha);
+
+	// encode one width x height level of RGBA, of which only the top left validWidth x validHeight texels were
+	// decoded (the rest of the texture is past the end of texture RAM) and are repeated into the remainder
+	void	CompressLevel(const UINT8* rgba, UINT8* dst, bool alpha, int width, int height, int validWidth, int validHeight);
+
+	// Compressed textures kept between sessions, keyed on a hash of their decoded data. Only those used in a
+	// session are written back to the file.
+	class File
+	{
+	public:
+		File();
+
+		void	Load	(const std::string& path);		// does nothing if the file doesn't exist yet
+		void	Save	();								// if anything was added, or some entries went unused
+
+		const std::vector<UINT8>*	Find	(UINT64 key, bool& alpha);	// null if not found
+		void						Store	(UINT64 key, bool alpha, std::vector<UINT8>&& data);
+
+	private:
+
+		struct Entry
+		{
+			bool				alpha;
+			bool				used;
+			std::vector<UINT8>	data;
+		};
+
+		std::string							m_path;
+		std::unordered_map<UINT64, Entry>	m_entries;
+		bool								m_dirty;
+	};
+
+} // TextureCompress
+} // New3D
+
+#endif
@@ -1,10 +1,32 @@
 #include "TextureSheet.h"
+#include "Util/JobSystem.h"
+#include <algorithm>
 
 namespace New3D {
 
+static const size_t MAX_DECODE_BATCH_BYTES = 16 * 1024 * 1024;	// bounds size of m_decoded
+static const int SHEET_DECODE_ROWS = 64;		// rows of texture RAM decoded by each job in UploadSheetRect()
+static const UINT64 COMPRESS_STABLE_FRAMES = 120;		// frames a texture must go unchanged before it is compressed
+static const size_t MAX_COMPRESS_BATCH_BYTES = 4 * 1024 * 1024;	// of decoded textures compressed per frame, so it never stalls a frame for long
+
 TextureSheet::TextureSheet()
 {
-	m_temp.resize(1024 * 1024 * 4);	// temporay buffer for textures
+	m_lowMemory		= false;
+	m_cacheBytes	= 0;
+	m_cacheBudget	= 0;
+	m_cacheHits		= 0;
+	m_cacheMisses	= 0;
+	m_compress		= false;
+	m_frame			= 0;
+
+	for (auto& tex : m_sheetTex) {
+		tex = 0;
+	}
+}
+
+TextureSheet::~TextureSheet()
+{
+	ReleaseSheets();		// make sure to have valid context before destroying
 }
 
 int TextureSheet::ToIndex(int x, int y)
@@ -27,44 +49,418 @@ std::shared_ptr<Texture> TextureSheet::BindTexture(const UINT16* src, int format
 
 	index = ToIndex(x, y);
 
-	auto range = m_texMap.equal_range(index);
+	auto t = Find(index, format, width, height);
 
-	if (range.first == range.second) {	
+	if (t) {
+		return t;
+	}
+
+	if (!src) {
+		return nullptr;
+	}
 
-		// nothing found so create a new texture 
+	// nothing found so decode it and create a new texture, or take one with the same data from the cache
 
-		std::shared_ptr<Texture> t(new Texture());
-		m_texMap.insert(std::pair<int, std::shared_ptr<Texture>>(index, t));
-		t->UploadTexture(src, m_temp.data(), format, x, y, width, height);
-		return t;
+	size_t size = Texture::GetDecodedSize(width, height);
+
+	if (m_temp.size() < size) {
+		m_temp.resize(size);	// temporay buffer for textures
+	}
+
+	Texture::DecodeTexture(src, m_temp.data(), format, x, y, width, height);
+
+	UINT64 hash = m_cacheBudget ? Texture::HashDecodedTexture(m_temp.data(), x, y, width, height) : 0;
+
+	return CreateTexture(m_temp.data(), hash, format, x, y, width, height);
+}
+
+std::shared_ptr<Texture> TextureSheet::CreateTexture(const UINT8* decoded, UINT64 hash, int format, int x, int y, int width, int height)
+{
+	std::shared_ptr<Texture> t;
+
+	auto range = m_cacheMap.equal_range(hash);
+
+	for (auto it = range.first; it != range.second; ++it) {
+
+		int x2, y2, width2, height2, format2;
+
+		it->second->texture->GetDetails(x2, y2, width2, height2, format2);
+
+		if (width == width2 && height == height2 && format == format2) {
+			t = it->second->texture;
+			m_cacheBytes -= it->second->bytes;
+			m_cache.erase(it->second);
+			m_cacheMap.erase(it);
+			break;
+		}
+	}
+
+	if (t) {
+		t->Move(x, y);
+		m_cacheHits++;
 	}
 	else {
+		t = std::make_shared<Texture>();
+		t->UploadDecodedTexture(decoded, format, x, y, width, height);
+		m_cacheMisses++;
+	}
+
+	if (m_compress && !t->IsCompressed()) {
+		m_compressQueue.push_back({ t, m_frame });
+	}
 
-		// iterate to try and find a match
+	t->SetHash(hash);
+	m_texMap.insert(std::pair<int, std::shared_ptr<Texture>>(ToIndex(x, y), t));
+	return t;
+}
+
+void TextureSheet::Erase(int index)
+{
+	auto range = m_texMap.equal_range(index);
+
+	if (m_cacheBudget) {
 
 		for (auto it = range.first; it != range.second; ++it) {
 
-			int x2, y2, width2, height2, format2;
+			int x, y, width, height, format;
+
+			it->second->GetDetails(x, y, width, height, format);
 
-			it->second->GetDetails(x2, y2, width2, height2, format2);
+			size_t bytes = Texture::GetDecodedSize(width, height);
 
-			if (width == width2 && height == height2 && format == format2) {
-				return it->second;
+			if (bytes <= m_cacheBudget) {
+				m_cache.push_front({ it->second->GetHash(), bytes, it->second });
+				m_cacheMap.insert(std::make_pair(it->second->GetHash(), m_cache.begin()));
+				m_cacheBytes += bytes;
 			}
 		}
 
-		// nothing found so create a new entry
+		Evict();
+	}
 
-		std::shared_ptr<Texture> t(new Texture());
-		m_texMap.insert(std::pair<int, std::shared_ptr<Texture>>(index, t));
-		t->UploadTexture(src, m_temp.data(), format, x, y, width, height);
-		return t;
+	m_texMap.erase(range.first, range.second);
+}
+
+void TextureSheet::Evict()
+{
+	while (m_cacheBytes > m_cacheBudget) {
+
+		auto last = std::prev(m_cache.end());
+		auto range = m_cacheMap.equal_range(last->hash);
+
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == last) {
+				m_cacheMap.erase(it);
+				break;
+			}
+		}
+
+		m_cacheBytes -= last->bytes;
+		m_cache.erase(last);
+	}
+}
+
+std::shared_ptr<Texture> TextureSheet::Find(int index, int format, int width, int height)
+{
+	auto range = m_texMap.equal_range(index);
+
+	// iterate to try and find a match
+
+	for (auto it = range.first; it != range.second; ++it) {
+
+		int x2, y2, width2, height2, format2;
+
+		it->second->GetDetails(x2, y2, width2, height2, format2);
+
+		if (width == width2 && height == height2 && format == format2) {
+			return it->second;
+		}
+	}
+
+	return nullptr;
+}
+
+void TextureSheet::Prefetch(const UINT16* src, int format, int x, int y, int width, int height)
+{
+	x &= 2047;
+	y &= 2047;
+
+	if (!src || width > 1024 || height > 1024) {	// sanity checking, as for BindTexture
+		return;
+	}
+
+	int index = ToIndex(x, y);
+
+	if (Find(index, format, width, height)) {
+		return;
+	}
+
+	UINT64 key = UINT64(index) | (UINT64(width) << 22) | (UINT64(height) << 33) | (UINT64(format) << 44);
+
+	if (m_pendingKeys.insert(key).second) {
+		m_pending.push_back({ src, format, x, y, width, height, 0, 0 });
+	}
+}
+
+void TextureSheet::DecodePending()
+{
+	size_t first = 0;
+
+	while (first < m_pending.size()) {
+
+		// lay out as many textures as fit in the buffer
+
+		size_t end = first;
+		size_t size = 0;
+
+		while (end < m_pending.size()) {
+
+			size_t texSize = Texture::GetDecodedSize(m_pending[end].width, m_pending[end].height);
+
+			if (end > first && size + texSize > MAX_DECODE_BATCH_BYTES) {
+				break;
+			}
+
+			m_pending[end++].offset = size;
+			size += texSize;
+		}
+
+		if (m_decoded.size() < size) {
+			m_decoded.resize(size);
+		}
+
+		Util::JobSystem::Shared().ParallelFor(end - first, [this, first](size_t i) {
+			auto& job = m_pending[first + i];
+			Texture::DecodeTexture(job.src, m_decoded.data() + job.offset, job.format, job.x, job.y, job.width, job.height);
+			job.hash = m_cacheBudget ? Texture::HashDecodedTexture(m_decoded.data() + job.offset, job.x, job.y, job.width, job.height) : 0;
+		});
+
+		// GL work stays on this thread
+
+		for (size_t i = first; i < end; i++) {
+			const auto& job = m_pending[i];
+			CreateTexture(m_decoded.data() + job.offset, job.hash, job.format, job.x, job.y, job.width, job.height);
+		}
+
+		first = end;
+	}
+
+	m_pending.clear();
+	m_pendingKeys.clear();
+
+	// everything decoded since the last call has been uploaded by now
+
+	if (m_lowMemory) {
+		std::vector<UINT8>().swap(m_temp);
+		std::vector<UINT8>().swap(m_decoded);
+	}
+}
+
+void TextureSheet::SetLowMemory(bool lowMemory)
+{
+	m_lowMemory = lowMemory;
+}
+
+void TextureSheet::SetCacheBudget(size_t bytes)
+{
+	m_cacheBudget = bytes;
+	Evict();
+}
+
+void TextureSheet::GetCacheStats(UINT64& hits, UINT64& misses) const
+{
+	hits	= m_cacheHits;
+	misses	= m_cacheMisses;
+}
+
+void TextureSheet::SetCompression(bool enable, const std::string& cacheFile)
+{
+	m_compress = enable;
+	m_compressQueue.clear();
+
+	if (m_compress && !cacheFile.empty()) {
+		m_compressFile.Load(cacheFile);
+	}
+}
+
+void TextureSheet::CompressStable(const UINT16* src)
+{
+	if (!m_compress || !src) {
+		return;
+	}
+
+	m_frame++;
+	m_compressJobs.clear();
+
+	// take the textures old enough, as long as they haven't been invalidated since they were created
+
+	size_t size = 0;
+
+	while (m_compressQueue.size() && m_frame - m_compressQueue.front().frame >= COMPRESS_STABLE_FRAMES) {
+
+		auto t = m_compressQueue.front().texture.lock();
+
+		if (t && !t->IsCompressed()) {
+
+			int x, y, width, height, format;
+			t->GetDetails(x, y, width, height, format);
+
+			size_t texSize = Texture::GetDecodedSize(width, height);
+
+			if (m_compressJobs.size() && size + texSize > MAX_COMPRESS_BATCH_BYTES) {
+				break;		// the rest wait for the next frame
+			}
+
+			if (Find(ToIndex(x, y), format, width, height) == t) {
+				m_compressJobs.push_back({ t, format, x, y, width, height, size, 0, false, nullptr, {} });
+				size += texSize;
+			}
+		}
+
+		m_compressQueue.pop_front();
+	}
+
+	if (m_compressJobs.empty()) {
+		return;
+	}
+
+	if (m_decoded.size() < size) {
+		m_decoded.resize(size);
+	}
+
+	Util::JobSystem::Shared().ParallelFor(m_compressJobs.size(), [this, src](size_t i) {
+		auto& job = m_compressJobs[i];
+		Texture::DecodeTexture(src, m_decoded.data() + job.offset, job.format, job.x, job.y, job.width, job.height);
+		job.key = Texture::HashDecodedTexture(m_decoded.data() + job.offset, job.x, job.y, job.width, job.height) ^ (UINT64(job.width) << 48) ^ (UINT64(job.height) << 32);
+	});
+
+	// encode the ones not in the file, from earlier sessions or from other parts of texture RAM with the same data
+
+	std::vector<size_t> misses;
+
+	for (size_t i = 0; i < m_compressJobs.size(); i++) {
+
+		auto& job = m_compressJobs[i];
+		job.cached = m_compressFile.Find(job.key, job.alpha);
+
+		if (!job.cached) {
+			misses.push_back(i);
+		}
+	}
+
+	Util::JobSystem::Shared().ParallelFor(misses.size(), [this, &misses](size_t i) {
+		auto& job = m_compressJobs[misses[i]];
+		job.alpha = Texture::CompressTexture(m_decoded.data() + job.offset, job.compressed, job.x, job.y, job.width, job.height);
+	});
+
+	// GL work stays on this thread
+
+	for (auto& job : m_compressJobs) {
+
+		if (job.cached) {
+			job.texture->UploadCompressedTexture(job.cached->data(), job.alpha);
+		}
+		else {
+			job.texture->UploadCompressedTexture(job.compressed.data(), job.alpha);
+			m_compressFile.Store(job.key, job.alpha, std::move(job.compressed));
+		}
+	}
+
+	m_compressJobs.clear();
+
+	if (m_lowMemory) {
+		std::vector<UINT8>().swap(m_decoded);
+	}
+}
+
+void TextureSheet::SaveCompressed()
+{
+	if (m_compress) {
+		m_compressFile.Save();
 	}
 }
 
 void TextureSheet::Release()
 {
 	m_texMap.clear();
+	m_compressQueue.clear();
+	m_cache.clear();
+	m_cacheMap.clear();
+	m_cacheBytes = 0;
+	m_pending.clear();
+	m_pendingKeys.clear();
+	ReleaseSheets();
+}
+
+void TextureSheet::ReleaseSheets()
+{
+	for (int i = 0; i < NUM_FORMATS; i++) {
+		if (m_sheetTex[i]) {
+			glDeleteTextures(1, &m_sheetTex[i]);
+			m_sheetTex[i] = 0;
+		}
+		m_sheetDirty[i].clear();
+	}
+}
+
+void TextureSheet::BindSheet(const UINT16* src, int format)
+{
+	if (format < 0 || format >= NUM_FORMATS) {
+		return;		// sanity checking
+	}
+
+	GLuint& tex = m_sheetTex[format];
+
+	if (!tex) {
+
+		// mipmaps live in the sheet along with everything else, so the shader works out where to sample from and no GL mipmaps are needed
+
+		glGenTextures(1, &tex);
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+		m_sheetDirty[format].clear();
+		UploadSheetRect(src, format, 0, 0, 2048, 2048);
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	for (const auto& r : m_sheetDirty[format]) {
+		UploadSheetRect(src, format, r.x, r.y, r.width, r.height);
+	}
+
+	m_sheetDirty[format].clear();
+}
+
+void TextureSheet::UploadSheetRect(const UINT16* src, int format, int x, int y, int width, int height)
+{
+	if (!src || width <= 0 || height <= 0) {
+		return;
+	}
+
+	size_t rowBytes = size_t(width) * 4;
+
+	if (m_decoded.size() < rowBytes * height) {
+		m_decoded.resize(rowBytes * height);
+	}
+
+	size_t numJobs = (height + SHEET_DECODE_ROWS - 1) / SHEET_DECODE_ROWS;
+
+	Util::JobSystem::Shared().ParallelFor(numJobs, [&](size_t i) {
+		int row		= int(i) * SHEET_DECODE_ROWS;
+		int rows	= std::min(SHEET_DECODE_ROWS, height - row);
+		Texture::DecodeTextureMip(src, m_decoded.data() + row * rowBytes, format, x, y + row, width, rows);
+	});
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);	// rgba is always 4 byte aligned
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, m_decoded.data());
 }
 
 void TextureSheet::Invalidate(int x, int y, int width, int height)
@@ -110,7 +506,7 @@ void TextureSheet::Invalidate(int x, int y, int width, int height)
 		int index	= ToIndex(posX, posY);
 
 		if (posX >= x && posY >= y) {				// invalidate this area of memory
-			m_texMap.erase(index);
+			Erase(index);
 		}
 		else {										// check for overlapping data tiles and invalidate as necessary
 
@@ -119,7 +515,7 @@ void TextureSheet::Invalidate(int x, int y, int width, int height)
 			for (auto it = range.first; it != range.second; ++it) {
 
 				if (it->second->CheckMapPos(x, x + width, y, y + height)) {
-					m_texMap.erase(index);
+					Erase(index);
 					break;
 				}
 			}
@@ -127,6 +523,22 @@ void TextureSheet::Invalidate(int x, int y, int width, int height)
 	}
 }
 
+void TextureSheet::InvalidateSheets(int x, int y, int width, int height)
+{
+	width	= std::min(x + width, 2048) - x;
+	height	= std::min(y + height, 2048) - y;
+
+	if (x < 0 || y < 0 || width <= 0 || height <= 0) {
+		return;
+	}
+
+	for (int i = 0; i < NUM_FORMATS; i++) {
+		if (m_sheetTex[i]) {
+			m_sheetDirty[i].push_back({ x, y, width, height });	// redecoded next time the sheet is bound
+		}
+	}
+}
+
 void TextureSheet::CropTile(int oldX, int oldY, int &newX, int &newY, int &newWidth, int &newHeight)
 {
 	if (newX < 0) {
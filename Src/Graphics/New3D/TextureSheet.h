@@ -5,7 +5,12 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <list>
+#include <deque>
+#include <string>
 #include "Texture.h"
+#include "TextureCompress.h"
+#include <unordered_set>
 
 namespace New3D {
 
@@ -13,17 +18,34 @@ class TextureSheet
 {
 public:
 	TextureSheet();
+	~TextureSheet();
 
 	std::shared_ptr<Texture>	BindTexture		(const UINT16* src, int format, int x, int y, int width, int height);
+	void						Prefetch		(const UINT16* src, int format, int x, int y, int width, int height);	// queue texture for DecodePending() if not already created
+	void						DecodePending	();		// decode queued textures with the job system, then upload them
+	void						SetLowMemory	(bool lowMemory);	// free the decoding buffers in DecodePending() rather than keeping them
+	void						SetCacheBudget	(size_t bytes);		// GL memory to keep invalidated textures in, for reuse if the same data is uploaded again
+	void						GetCacheStats	(UINT64& hits, UINT64& misses) const;	// textures taken from the cache, and uploaded, so far
+	void						SetCompression	(bool enable, const std::string& cacheFile);	// S3TC for textures that stay in texture RAM, kept in cacheFile (if not empty) between sessions
+	void						CompressStable	(const UINT16* src);	// once a frame, compress some of the textures unchanged for long enough
+	void						SaveCompressed	();		// write the compressed textures used this session to the cache file
 	void						Invalidate		(int x, int y, int width, int height); // release parts of the memory
+	void						InvalidateSheets(int x, int y, int width, int height); // mark area of texture RAM as changed for BindSheet()
 	void						Release			();		// release all texture objects and memory
+	void						BindSheet		(const UINT16* src, int format);	// bind the whole sheet decoded in one format, updating invalidated parts first
 	int							GetTexFormat	(int originalFormat, bool contour);
 	void						GetMicrotexPos	(int basePage, int id, int& x, int& y);
 
 private:
 
 	int ToIndex(int x, int y);
+	std::shared_ptr<Texture> Find(int index, int format, int width, int height);
+	std::shared_ptr<Texture> CreateTexture(const UINT8* decoded, UINT64 hash, int format, int x, int y, int width, int height);	// reusing a cached texture with the same hash if there is one
+	void Erase(int index);		// remove the textures at an index from m_texMap, into the cache
+	void Evict();				// least recently invalidated textures, until the cache is within budget
 	void CropTile(int oldX, int oldY, int &newX, int &newY, int &newWidth, int &newHeight);
+	void UploadSheetRect(const UINT16* src, int format, int x, int y, int width, int height);
+	void ReleaseSheets();
 
 	std::unordered_multimap<int, std::shared_ptr<Texture>> m_texMap;
 
@@ -31,6 +53,85 @@ private:
 	// array of 8 planes for each texture type
 
 	std::vector<UINT8> m_temp;
+
+	struct PendingTexture
+	{
+		const UINT16*	src;
+		int				format;
+		int				x;
+		int				y;
+		int				width;
+		int				height;
+		size_t			offset;		// where the decoded texture goes in m_decoded
+		UINT64			hash;
+	};
+
+	std::vector<PendingTexture>	m_pending;
+	std::unordered_set<UINT64>	m_pendingKeys;	// index, size and format of textures in m_pending
+	std::vector<UINT8>			m_decoded;		// RGBA output of Texture::DecodeTexture()
+	bool						m_lowMemory;
+
+	// Invalidated textures, most recently invalidated first. Games that stream the same textures back into texture RAM get them
+	// back from here without uploading them again.
+
+	struct CachedTexture
+	{
+		UINT64						hash;
+		size_t						bytes;
+		std::shared_ptr<Texture>	texture;
+	};
+
+	std::list<CachedTexture>	m_cache;
+	std::unordered_multimap<UINT64, std::list<CachedTexture>::iterator>	m_cacheMap;	// keyed on hash
+	size_t						m_cacheBytes;
+	size_t						m_cacheBudget;
+	UINT64						m_cacheHits;
+	UINT64						m_cacheMisses;
+
+	// whole sheet textures for BindSheet(), one per format and only created when first used
+
+	static const int NUM_FORMATS = 12;
+
+	struct SheetRect
+	{
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	GLuint						m_sheetTex[NUM_FORMATS];
+	std::vector<SheetRect>		m_sheetDirty[NUM_FORMATS];	// areas invalidated since the sheet was last bound
+
+	// Textures created since compression was enabled, oldest first. Those still in m_texMap after a while are
+	// decoded again (texture RAM still holds what they were made from) and swapped for S3TC in CompressStable().
+
+	struct CompressCandidate
+	{
+		std::weak_ptr<Texture>	texture;
+		UINT64					frame;		// when it was created
+	};
+
+	struct CompressJob
+	{
+		std::shared_ptr<Texture>	texture;
+		int							format;
+		int							x;
+		int							y;
+		int							width;
+		int							height;
+		size_t						offset;		// where the decoded texture goes in m_decoded
+		UINT64						key;		// for m_compressFile
+		bool						alpha;
+		const std::vector<UINT8>*	cached;		// from m_compressFile, or null if it was compressed this frame
+		std::vector<UINT8>			compressed;
+	};
+
+	bool							m_compress;
+	UINT64							m_frame;
+	std::deque<CompressCandidate>	m_compressQueue;
+	std::vector<CompressJob>		m_compressJobs;
+	TextureCompress::File			m_compressFile;
 };
 
 } // New3D
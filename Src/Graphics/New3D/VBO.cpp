@@ -1,4 +1,5 @@
 #include "VBO.h"
+#include <cstring>
 
 namespace New3D {
 
@@ -8,13 +9,29 @@ VBO::VBO()
 	m_target	= 0;
 	m_capacity	= 0;
 	m_size		= 0;
+	m_mapped	= nullptr;
 }
 
-void VBO::Create(GLenum target, GLenum usage, GLsizeiptr size, const void* data)
+void VBO::Create(GLenum target, GLenum usage, GLsizeiptr size, const void* data, bool persistent)
 {
+	Destroy();
+
 	glGenBuffers(1, &m_id);							// create a vbo
 	glBindBuffer(target, m_id);						// activate vbo id to use
-	glBufferData(target, size, data, usage);		// upload data to video card
+
+	if (persistent && GLEW_ARB_buffer_storage) {
+
+		// keep the buffer mapped for its whole life, so data is written straight into memory the gpu reads
+		// rather than going through the driver's copy, which can stall on a buffer still being drawn from
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(target, size, data, flags);
+		m_mapped = (GLubyte*)glMapBufferRange(target, 0, size, flags);
+	}
+
+	if (!m_mapped) {
+		glBufferData(target, size, data, usage);	// upload data to video card
+	}
 
 	m_target	= target;
 	m_capacity	= size;
@@ -25,7 +42,12 @@ void VBO::Create(GLenum target, GLenum usage, GLsizeiptr size, const void* data)
 
 void VBO::BufferSubData(GLintptr offset, GLsizeiptr size, const GLvoid* data)
 {
-	glBufferSubData(m_target, offset, size, data);
+	if (m_mapped) {
+		memcpy(m_mapped + offset, data, size);		// caller must Sync() first if this overwrites data recent frames drew
+	}
+	else {
+		glBufferSubData(m_target, offset, size, data);
+	}
 }
 
 bool VBO::AppendData(GLsizeiptr size, const GLvoid* data)
@@ -47,12 +69,26 @@ bool VBO::AppendData(GLsizeiptr size, const GLvoid* data)
 
 void VBO::Reset()
 {
+	Sync();			// appends will now overwrite old data
 	m_size = 0;
 }
 
 void VBO::Destroy()
 {
+	for (auto fence : m_fences) {
+		glDeleteSync(fence);
+	}
+
+	m_fences.clear();
+
 	if (m_id) {
+		if (m_mapped) {
+			glBindBuffer(m_target, m_id);
+			glUnmapBuffer(m_target);
+			glBindBuffer(m_target, 0);
+			m_mapped = nullptr;
+		}
+
 		glDeleteBuffers(1, &m_id);
 		m_id		= 0;
 		m_target	= 0;
@@ -61,6 +97,42 @@ void VBO::Destroy()
 	}
 }
 
+void VBO::EndFrame()
+{
+	if (!m_mapped) {
+		return;		// the driver keeps track of normal buffers itself
+	}
+
+	// retire the fences the gpu has passed, and don't get more than MAX_FRAMES_IN_FLIGHT frames ahead of it
+	while (m_fences.size() && glClientWaitSync(m_fences.front(), 0, 0) != GL_TIMEOUT_EXPIRED) {
+		glDeleteSync(m_fences.front());
+		m_fences.pop_front();
+	}
+
+	if (m_fences.size() >= MAX_FRAMES_IN_FLIGHT) {
+		glClientWaitSync(m_fences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(m_fences.front());
+		m_fences.pop_front();
+	}
+
+	m_fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+void VBO::Sync()
+{
+	for (auto fence : m_fences) {
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+	}
+
+	m_fences.clear();
+}
+
+bool VBO::IsPersistent()
+{
+	return m_mapped != nullptr;
+}
+
 void VBO::Bind(bool enable)
 {
 	if (enable) {
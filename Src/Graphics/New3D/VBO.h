@@ -2,6 +2,7 @@
 #define _VBO_H_
 
 #include <GL/glew.h>
+#include <deque>
 
 namespace New3D {
 
@@ -10,20 +11,27 @@ class VBO
 public:
 	VBO();
 
-	void Create			(GLenum target, GLenum usage, GLsizeiptr size, const void* data=nullptr);
+	void Create			(GLenum target, GLenum usage, GLsizeiptr size, const void* data=nullptr, bool persistent=false);	// persistent falls back to a normal buffer without ARB_buffer_storage
 	void BufferSubData	(GLintptr offset, GLsizeiptr size, const GLvoid* data);
 	bool AppendData		(GLsizeiptr size, const GLvoid* data);
 	void Reset			();		// don't delete data, just go back to start
 	void Destroy		();
 	void Bind			(bool enable);
+	void EndFrame		();		// fence the frame's draws
+	void Sync			();		// wait for the gpu to finish with all fenced frames, before overwriting data they may have drawn
+	bool IsPersistent	();
 	int  GetSize		();
 	int  GetCapacity	();
 
 private:
+	static const int MAX_FRAMES_IN_FLIGHT = 3;
+
 	GLuint	m_id;
 	GLenum	m_target;
 	int		m_capacity;
 	int		m_size;
+	GLubyte*			m_mapped;	// persistent coherent mapping of the whole buffer, or null
+	std::deque<GLsync>	m_fences;	// oldest first
 };
 
 } // New3D
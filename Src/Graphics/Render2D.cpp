@@ -274,10 +274,13 @@
  * -- one for A/A' and another for B/B'. These are passed to the renderer.
  */
 
+#include <algorithm>
 #include <cstring>
 #include <GL/glew.h>
 #include "Supermodel.h"
 #include "Graphics/Shaders2D.h" // fragment and vertex shaders
+#include "Graphics/TileLine.h"
+#include "Util/Trace.h"
 
 
 /******************************************************************************
@@ -292,97 +295,13 @@
 /******************************************************************************
  Layer Rendering
 
- This code is quite slow and badly needs to be optimized. Dirty rectangles
- should be implemented first and tile pre-decoding second.
+ Whole tiles are drawn by TileLine::DrawTiles(), vectorised where the CPU
+ allows, and only the clipped tiles at either end use DrawTileLine() directly.
 ******************************************************************************/
 
-template <int bits, bool alphaTest, bool clip>
-static inline void DrawTileLine(uint32_t *line, int pixelOffset, uint16_t tile, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask)
-{
-  static_assert(bits == 4 || bits == 8, "Tiles are either 4- or 8-bit");
-
-  // For 8-bit pixels, each line of tile pattern is two words
-  if (bits == 8)
-    patternLine *= 2;
-
-  // Compute offset of pattern for this line
-  int patternOffset;
-  if (bits == 4)
-  {
-    patternOffset = ((tile & 0x3FFF) << 1) | ((tile >> 15) & 1);
-    patternOffset *= 32;
-    patternOffset /= 4;
-  }
-  else
-  {
-    patternOffset = tile & 0x3FFF;
-    patternOffset *= 64;
-    patternOffset /= 4;
-  }
-
-  // Name table entry provides high color bits
-  uint32_t colorHi = tile & ((bits == 4) ? 0x7FF0 : 0x7F00);
-
-  // Draw
-  if (bits == 4)
-  {
-    uint32_t pattern = vram[patternOffset + patternLine];
-    for (int p = 7; p >= 0; p--)
-    {
-      if (!clip || (clip && pixelOffset >= 0 && pixelOffset < 496))
-      {
-        uint16_t maskTest = 1 << (15-((pixelOffset+0)/32));
-        bool visible = (mask & maskTest) != 0;
-        uint32_t pixel = palette[((pattern >> (p*4)) & 0xF) | colorHi];
-        if (alphaTest)
-        {
-          if (visible && (pixel >> 24) != 0)  // only draw opaque pixels
-            line[pixelOffset] = pixel;
-        }
-        else
-        {
-          if (visible)
-            line[pixelOffset] = pixel;
-          else
-            line[pixelOffset] = 0;
-        }
-      }
-      ++pixelOffset;
-    }
-  }
-  else
-  {
-    for (int i = 0; i < 2; i++) // 4 pixels per word
-    {
-      uint32_t pattern = vram[patternOffset + patternLine + i];
-      for (int p = 3; p >= 0; p--)
-      {
-        if (!clip || (clip && pixelOffset >= 0 && pixelOffset < 496))
-        {
-          uint16_t maskTest = 1 << (15-((pixelOffset+0)/32));
-          bool visible = (mask & maskTest) != 0;
-          uint32_t pixel = palette[((pattern >> (p*8)) & 0xFF) | colorHi];
-          if (alphaTest)
-          {
-            if (visible && (pixel >> 24) != 0)
-              line[pixelOffset] = pixel;
-          }
-          else
-          {
-            if (visible)
-              line[pixelOffset] = pixel;
-            else
-              line[pixelOffset] = 0;  // transparent
-          }
-        }
-        ++pixelOffset;
-      }
-    }
-  }
-}
-
+// Draws the whole layer, or only the lines flagged in lines if given
 template <int bits, bool alphaTest>
-static void DrawLayer(uint32_t *pixels, int layerNum, const uint32_t *vram, const uint32_t *regs, const uint32_t *palette)
+static void DrawLayer(uint32_t *pixels, int layerNum, const uint32_t *vram, const uint32_t *regs, const uint32_t *palette, const bool *lines)
 {
   const uint16_t *nameTableBase = (const uint16_t *) &vram[(0xF8000 + layerNum * 0x2000) / 4];
   const uint16_t *hScrollTable = (const uint16_t *) &vram[(0xF6000 + layerNum * 0x400) / 4];
@@ -402,6 +321,13 @@ static void DrawLayer(uint32_t *pixels, int layerNum, const uint32_t *vram, cons
 
   for (int y = 0; y < 384; y++)
   {
+    if (lines && !lines[y])
+    {
+      maskTable += 2;
+      line += 496;
+      continue;
+    }
+
     int hScroll = (lineScrollMode ? hScrollTable[y] : hFullScroll) & 0x1FF;
     int hTile = hScroll / 8;
     int hFine = hScroll & 7;        // horizontal pixel offset within tile line
@@ -413,17 +339,14 @@ static void DrawLayer(uint32_t *pixels, int layerNum, const uint32_t *vram, cons
     int extraTile = (hFine != 0) ? 1 : 0; // h-scrolling requires part of 63rd tile
 
     // First tile may be clipped
-    int tx = 0;
     DrawTileLine<bits, alphaTest, true>(line, pixelOffset, nameTable[(hTile ^ 1) & 63], vFine, vram, palette, mask);
     ++hTile;
     pixelOffset += 8;
     // Middle tiles will not be clipped
-    for (tx = 1; tx < (62 - 1 + extraTile); tx++)
-    {
-      DrawTileLine<bits, alphaTest, false>(line, pixelOffset, nameTable[(hTile ^ 1) & 63], vFine, vram, palette, mask);
-      ++hTile;
-      pixelOffset += 8;
-    }
+    int middleTiles = 62 - 2 + extraTile;
+    TileLine::DrawTiles(bits, alphaTest, line, pixelOffset, nameTable, hTile, middleTiles, vFine, vram, palette, mask);
+    hTile += middleTiles;
+    pixelOffset += 8 * middleTiles;
     // Last tile may be clipped
     DrawTileLine<bits, alphaTest, true>(line, pixelOffset, nameTable[(hTile ^ 1) & 63], vFine, vram, palette, mask);
     ++hTile;
@@ -435,8 +358,9 @@ static void DrawLayer(uint32_t *pixels, int layerNum, const uint32_t *vram, cons
   }
 }
 
-std::pair<bool, bool> CRender2D::DrawTilemaps(uint32_t *pixelsBottom, uint32_t *pixelsTop)
+std::pair<bool, bool> CRender2D::DrawTilemaps(uint32_t *pixelsBottom, uint32_t *pixelsTop, const bool *bottomLines, const bool *topLines)
 {
+  TRACE_ZONE("CRender2D::DrawTilemaps");
   unsigned priority = (m_regs[0x20/4] >> 8) & 0xF;
 
   // Render bottom layers
@@ -453,16 +377,16 @@ std::pair<bool, bool> CRender2D::DrawTilemaps(uint32_t *pixelsBottom, uint32_t *
       if (noBottomSurface)
       {
         if (is4Bit)
-          DrawLayer<4, false>(pixelsBottom, layerNum, m_vram, m_regs, m_palette[layerNum / 2]);
+          DrawLayer<4, false>(pixelsBottom, layerNum, m_vram, m_regs, m_palette[layerNum / 2], bottomLines);
         else
-          DrawLayer<8, false>(pixelsBottom, layerNum, m_vram, m_regs, m_palette[layerNum / 2]);
+          DrawLayer<8, false>(pixelsBottom, layerNum, m_vram, m_regs, m_palette[layerNum / 2], bottomLines);
       }
       else
       {
         if (is4Bit)
-          DrawLayer<4, true>(pixelsBottom, layerNum, m_vram, m_regs, m_palette[layerNum / 2]);
+          DrawLayer<4, true>(pixelsBottom, layerNum, m_vram, m_regs, m_palette[layerNum / 2], bottomLines);
         else
-          DrawLayer<8, true>(pixelsBottom, layerNum, m_vram, m_regs, m_palette[layerNum / 2]);
+          DrawLayer<8, true>(pixelsBottom, layerNum, m_vram, m_regs, m_palette[layerNum / 2], bottomLines);
       }
       noBottomSurface = false;
     }
@@ -485,16 +409,16 @@ std::pair<bool, bool> CRender2D::DrawTilemaps(uint32_t *pixelsBottom, uint32_t *
       if (noTopSurface)
       {
         if (is4Bit)
-          DrawLayer<4, false>(pixelsTop, layerNum, m_vram, m_regs, m_palette[layerNum / 2]);
+          DrawLayer<4, false>(pixelsTop, layerNum, m_vram, m_regs, m_palette[layerNum / 2], topLines);
         else
-          DrawLayer<8, false>(pixelsTop, layerNum, m_vram, m_regs, m_palette[layerNum / 2]);
+          DrawLayer<8, false>(pixelsTop, layerNum, m_vram, m_regs, m_palette[layerNum / 2], topLines);
       }
       else
       {
         if (is4Bit)
-          DrawLayer<4, true>(pixelsTop, layerNum, m_vram, m_regs, m_palette[layerNum / 2]);
+          DrawLayer<4, true>(pixelsTop, layerNum, m_vram, m_regs, m_palette[layerNum / 2], topLines);
         else
-          DrawLayer<8, true>(pixelsTop, layerNum, m_vram, m_regs, m_palette[layerNum / 2]);
+          DrawLayer<8, true>(pixelsTop, layerNum, m_vram, m_regs, m_palette[layerNum / 2], topLines);
       }
       noTopSurface = false;
     }
@@ -504,23 +428,236 @@ std::pair<bool, bool> CRender2D::DrawTilemaps(uint32_t *pixelsBottom, uint32_t *
   return std::pair<bool, bool>(!noTopSurface, !noBottomSurface);
 }
 
+static inline bool PageChanged(const uint8_t *pages, unsigned addr)
+{
+  unsigned page = addr >> 10;
+  return (pages[page / 8] & (1 << (page & 7))) != 0;
+}
+
+// Whether anything a line of a layer is drawn from has changed: its scroll and mask table entries, its row of the
+// name table, and the pattern lines and palette pages of every tile in that row (even those scrolled out of view)
+bool CRender2D::LineChanged(int layerNum, int y) const
+{
+  if (PageChanged(m_vramChanged, 0xF6000 + layerNum * 0x400 + y * 2) || PageChanged(m_vramChanged, 0xF7000 + y * 4))
+    return true;
+
+  bool is4Bit = (m_regs[0x20/4] & (1 << (12 + layerNum))) != 0;
+  int vScroll = (m_regs[0x60/4 + layerNum] >> 16) & 0x1FF;
+  int vFine = (y + vScroll) & 7;
+  unsigned nameTableAddr = 0xF8000 + layerNum * 0x2000 + ((64 * ((y + vScroll) / 8)) & 0xFFF) * 2;
+  if (PageChanged(m_vramChanged, nameTableAddr))
+    return true;
+
+  const uint16_t *nameTable = (const uint16_t *) &m_vram[nameTableAddr / 4];
+  for (int i = 0; i < 64; i++)
+  {
+    uint16_t tile = nameTable[i];
+    unsigned patternAddr, color;
+    if (is4Bit)
+    {
+      patternAddr = ((((tile & 0x3FFF) << 1) | ((tile >> 15) & 1)) * 32) + vFine * 4;
+      color = tile & 0x7FF0;
+    }
+    else
+    {
+      patternAddr = (tile & 0x3FFF) * 64 + vFine * 8;
+      color = tile & 0x7F00;
+    }
+    if (PageChanged(m_vramChanged, patternAddr) || PageChanged(m_paletteChanged, color * 4))
+      return true;
+  }
+
+  return false;
+}
+
+// Flags the lines of each surface (0 is top and 1 is bottom) that must be redrawn. Returns true if there are any.
+bool CRender2D::FindChangedLines(bool lines[2][384]) const
+{
+  unsigned priority = (m_regs[0x20/4] >> 8) & 0xF;
+  bool any = false;
+
+  memset(lines, 0, 2 * 384 * sizeof(bool));
+  for (int layerNum = 0; layerNum < 4; layerNum++)
+  {
+    if ((m_regs[0x60/4 + layerNum] & 0x80000000) == 0)
+      continue;
+    int surface = (priority & (1 << layerNum)) ? 0 : 1;
+    for (int y = 0; y < 384; y++)
+    {
+      if (!lines[surface][y] && LineChanged(layerNum, y))
+      {
+        lines[surface][y] = true;
+        any = true;
+      }
+    }
+  }
+
+  return any;
+}
+
+
+/******************************************************************************
+ GPU Layer Rendering
+
+ With GPUTilemaps, the layer surfaces are drawn by the tilemap fragment shader
+ instead of DrawTilemaps(). Only the rows of VRAM that changed since the last
+ frame are uploaded, rather than both finished surfaces. The shader decodes
+ palette RAM itself and adds the color offsets, so fades upload nothing.
+******************************************************************************/
+
+// Uploads rows of a texture that differ from the shadow copy, as few calls as possible
+void CRender2D::UploadChangedRows(GLuint texID, int firstRow, const uint32_t *src, uint32_t *shadow, int rows, int rowWords, GLenum format, GLenum type)
+{
+  glBindTexture(GL_TEXTURE_2D, texID);
+  int y = 0;
+  while (y < rows)
+  {
+    if (m_tilemapDataValid && 0 == memcmp(&src[y * rowWords], &shadow[y * rowWords], rowWords * 4))
+    {
+      ++y;
+      continue;
+    }
+    int start = y;
+    while (y < rows && (!m_tilemapDataValid || 0 != memcmp(&src[y * rowWords], &shadow[y * rowWords], rowWords * 4)))
+      ++y;
+    memcpy(&shadow[start * rowWords], &src[start * rowWords], (y - start) * rowWords * 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow + start, rowWords, y - start, format, type, &src[start * rowWords]);
+  }
+}
+
+void CRender2D::UploadTilemapData(void)
+{
+  UploadChangedRows(m_vramTexID, 0, m_vram, m_vramShadow, 576, 512, GL_RED_INTEGER, GL_UNSIGNED_INT);
+  m_tilemapDataValid = true;
+}
+
+std::pair<bool, bool> CRender2D::DrawTilemapsGPU(void)
+{
+  TRACE_ZONE("CRender2D::DrawTilemapsGPU");
+
+  // Same layer selection as DrawTilemaps()
+  unsigned priority = (m_regs[0x20/4] >> 8) & 0xF;
+  unsigned enabled = 0;
+  GLint scroll[4];
+  for (int i = 0; i < 4; i++)
+  {
+    if ((m_regs[0x60/4 + i] & 0x80000000) != 0)
+      enabled |= 1 << i;
+    scroll[i] = GLint(m_regs[0x60/4 + i]);
+  }
+  unsigned layers[2] = { enabled & priority, enabled & ~priority };  // top, bottom
+
+  // Signed RGB color offsets of A/A' and B/B', doubled as CTileGen applies them
+  GLint colorOffset[6];
+  for (int i = 0; i < 2; i++)
+  {
+    uint32_t offsetReg = m_regs[0x40/4 + i];
+    colorOffset[i * 3 + 0] = 2 * int8_t(offsetReg & 0xFF);
+    colorOffset[i * 3 + 1] = 2 * int8_t((offsetReg >> 8) & 0xFF);
+    colorOffset[i * 3 + 2] = 2 * int8_t((offsetReg >> 16) & 0xFF);
+  }
+
+  glActiveTexture(GL_TEXTURE0);
+  UploadTilemapData();
+
+  if (layers[0] || layers[1])
+  {
+    GLint prevFBO, prevViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFBO);
+    glGetIntegerv(GL_VIEWPORT, prevViewport);
+    GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+
+    glUseProgram(m_tilemapProgram);
+    glUniform1iv(m_layerScrollLoc, 4, scroll);
+    glUniform1i(m_layer4BitLoc, (m_regs[0x20/4] >> 12) & 0xF);
+    glUniform3iv(m_colorOffsetLoc, 2, colorOffset);
+    glBindTexture(GL_TEXTURE_2D, m_vramTexID);
+    glViewport(0, 0, 496, 384);
+
+    for (int surface = 0; surface < 2; surface++)
+    {
+      if (!layers[surface])
+        continue;
+      glBindFramebuffer(GL_FRAMEBUFFER, m_surfaceFBO[surface]);
+      glUniform1i(m_layerEnabledLoc, layers[surface]);
+      DrawQuad(m_tilemapVertexLoc);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+    glViewport(prevViewport[0], prevViewport[1], prevViewport[2], prevViewport[3]);
+    if (scissor)
+      glEnable(GL_SCISSOR_TEST);
+  }
+
+  return std::pair<bool, bool>(layers[0] != 0, layers[1] != 0);
+}
+
+bool CRender2D::InitTilemapShader(void)
+{
+  if (!GLEW_VERSION_3_0)
+    return FAIL;
+  if (OKAY != LoadShaderProgram(&m_tilemapProgram, &m_tilemapVertexShader, &m_tilemapFragmentShader, "", "", s_tilemapVertexShaderSource, s_tilemapFragmentShaderSource))
+    return FAIL;
+
+  glUseProgram(m_tilemapProgram);
+  glUniform1i(glGetUniformLocation(m_tilemapProgram, "vram"), 0);
+  m_layerScrollLoc = glGetUniformLocation(m_tilemapProgram, "layerScroll");
+  m_layerEnabledLoc = glGetUniformLocation(m_tilemapProgram, "layerEnabled");
+  m_layer4BitLoc = glGetUniformLocation(m_tilemapProgram, "layer4Bit");
+  m_colorOffsetLoc = glGetUniformLocation(m_tilemapProgram, "colorOffset");
+  m_tilemapVertexLoc = glGetAttribLocation(m_tilemapProgram, "inVertex");
+
+  glActiveTexture(GL_TEXTURE0);
+  glGenTextures(1, &m_vramTexID);
+  glBindTexture(GL_TEXTURE_2D, m_vramTexID);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, 512, 576, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+  // Layer textures must already exist
+  GLint prevFBO;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevFBO);
+  glGenFramebuffers(2, m_surfaceFBO);
+  bool complete = true;
+  for (int i = 0; i < 2; i++)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, m_surfaceFBO[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texID[i], 0);
+    complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, prevFBO);
+
+  glUseProgram(m_shaderProgram);
+  return complete ? OKAY : FAIL;
+}
+
 
 /******************************************************************************
  Frame Display Functions
 ******************************************************************************/
 
+// Draws the quad covering a surface, (0,0) to (1,1), with the current program
+void CRender2D::DrawQuad(GLint vertexLoc)
+{
+  glBindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
+  glEnableVertexAttribArray(vertexLoc);
+  glVertexAttribPointer(vertexLoc, 2, GL_FLOAT, GL_FALSE, 0, 0);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  glDisableVertexAttribArray(vertexLoc);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 // Draws a surface to the screen (0 is top and 1 is bottom)
 void CRender2D::DisplaySurface(int surface)
 {
   // Draw the surface
   glActiveTexture(GL_TEXTURE0); // texture unit 0
   glBindTexture(GL_TEXTURE_2D, m_texID[surface]);
-  glBegin(GL_QUADS);
-  glTexCoord2f(0.0f, 0.0f);  glVertex2f(0.0f, 0.0f);
-  glTexCoord2f(1.0f, 0.0f);  glVertex2f(1.0f, 0.0f);
-  glTexCoord2f(1.0f, 1.0f);  glVertex2f(1.0f, 1.0f);
-  glTexCoord2f(0.0f, 1.0f);  glVertex2f(0.0f, 1.0f);
-  glEnd();
+  DrawQuad(m_vertexLoc);
 }
 
 // Set up viewport and OpenGL state for 2D rendering (sets up blending function but disables blending)
@@ -546,16 +683,21 @@ void CRender2D::Setup2D(bool isBottom)
   }
 
   // Set up the viewport and orthogonal projection
-  bool stretchBottom = m_config["WideBackground"].ValueAs<bool>() && isBottom;
+  bool stretchBottom = m_wideBackground && isBottom;
   if (!stretchBottom)
   {
     glViewport(m_xOffset - m_correction, m_yOffset + m_correction, m_xPixels, m_yPixels); //Preserve aspect ratio of tile layer by constraining and centering viewport
   }
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(0.0, 1.0, 1.0, 0.0, 1.0, -1.0);
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
+
+  // Sharp filtering blends across the seams of texels a screen pixel wide, however many pixels they cover
+  GLfloat xScale = 1.0f;
+  GLfloat yScale = 1.0f;
+  if (m_sharpFilter)
+  {
+    xScale = std::max(1.0f, float(stretchBottom ? m_totalXPixels : m_xPixels) / 496.0f);
+    yScale = std::max(1.0f, float(stretchBottom ? m_totalYPixels : m_yPixels) / 384.0f);
+  }
+  glUniform2f(m_pixelScaleLoc, xScale, yScale);
 }
 
 void CRender2D::BeginFrame(void)
@@ -564,27 +706,89 @@ void CRender2D::BeginFrame(void)
 
 void CRender2D::PreRenderFrame(void)
 {
-  // Update all layers
-  m_surfaces_present = DrawTilemaps(m_bottomSurface, m_topSurface);
+  if (m_gpuTilemaps)
+  {
+    CGPUTimer::Shared().Begin(CGPUTimer::Tilegen2D);
+    m_surfaces_present = DrawTilemapsGPU();
+    CGPUTimer::Shared().End();
+    return;
+  }
+
+  // Update all layers, or if they are set up as they were last frame and we know what changed, just the lines affected
+  uint32_t layerRegs[5] = { m_regs[0x20/4], m_regs[0x60/4], m_regs[0x64/4], m_regs[0x68/4], m_regs[0x6C/4] };
+  bool sameLayers = m_surfacesValid && 0 == memcmp(layerRegs, m_drawnLayerRegs, sizeof(layerRegs));
+  if (sameLayers && m_vramChanged && m_paletteChanged)
+  {
+    FindChangedLines(m_changedLines);
+    m_surfaces_present = DrawTilemaps(m_bottomSurface, m_topSurface, m_changedLines[1], m_changedLines[0]);
+  }
+  else
+  {
+    m_surfaces_present = DrawTilemaps(m_bottomSurface, m_topSurface);
+    memcpy(m_drawnLayerRegs, layerRegs, sizeof(layerRegs));
+    memset(m_changedLines, true, sizeof(m_changedLines));
+    m_surfacesValid = true;
+  }
+
+  // Upload the rows redrawn, if any
+  CGPUTimer::Shared().Begin(CGPUTimer::Tilegen2D);
   glActiveTexture(GL_TEXTURE0); // texture unit 0
-  if (m_surfaces_present.first)
+  bool present[2] = { m_surfaces_present.first, m_surfaces_present.second };
+  const uint32_t *pixels[2] = { m_topSurface, m_bottomSurface };
+  bool orphaned = false;
+  for (int surface = 0; surface < 2; surface++)
   {
-    glBindTexture(GL_TEXTURE_2D, m_texID[0]);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 496, 384, GL_RGBA, GL_UNSIGNED_BYTE, m_topSurface);
+    if (!present[surface])
+      continue;
+    int y = 0;
+    while (y < 384)
+    {
+      if (!m_changedLines[surface][y])
+      {
+        ++y;
+        continue;
+      }
+      int start = y;
+      while (y < 384 && m_changedLines[surface][y])
+        ++y;
+      if (m_pbo && !orphaned)
+      {
+        // Orphan last frame's storage, so the copy never waits on the GPU still reading from it
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, 2 * 496 * 384 * 4, NULL, GL_STREAM_DRAW);
+        orphaned = true;
+      }
+      UploadSurface(surface, pixels[surface], start, y - start);
+    }
   }
-  if (m_surfaces_present.second)
+  if (orphaned)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  CGPUTimer::Shared().End();
+}
+
+void CRender2D::UploadSurface(int surface, const uint32_t *pixels, int firstRow, int rows)
+{
+  glBindTexture(GL_TEXTURE_2D, m_texID[surface]);
+  pixels += firstRow * 496;
+  if (m_pbo)
   {
-    glBindTexture(GL_TEXTURE_2D, m_texID[1]);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 496, 384, GL_RGBA, GL_UNSIGNED_BYTE, m_bottomSurface);
+    // The texture is filled from the buffer by the GPU later on, rather than the driver copying or stalling here
+    GLintptr offset = (surface * 384 + firstRow) * 496 * 4;
+    glBufferSubData(GL_PIXEL_UNPACK_BUFFER, offset, rows * 496 * 4, pixels);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, 496, rows, GL_RGBA, GL_UNSIGNED_BYTE, (const GLvoid *) offset);
   }
+  else
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, 496, rows, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 }
 
 void CRender2D::RenderFrameBottom(void)
 {
   // Display bottom surface if anything was drawn there, else clear everything
+  CGPUTimer::Shared().Begin(CGPUTimer::Tilegen2D);
   Setup2D(true);
   if (m_surfaces_present.second)
     DisplaySurface(1);
+  CGPUTimer::Shared().End();
 }
 
 void CRender2D::RenderFrameTop(void)
@@ -592,14 +796,19 @@ void CRender2D::RenderFrameTop(void)
   // Display top surface only if it exists
   if (m_surfaces_present.first)
   {
+    CGPUTimer::Shared().Begin(CGPUTimer::Tilegen2D);
     Setup2D(false);
     glEnable(GL_BLEND);
     DisplaySurface(0);
+    CGPUTimer::Shared().End();
   }
 }
 
 void CRender2D::EndFrame(void)
 {
+  // Only good for the frame they were given for
+  m_vramChanged = NULL;
+  m_paletteChanged = NULL;
 }
 
 
@@ -612,6 +821,12 @@ void CRender2D::WriteVRAM(unsigned addr, uint32_t data)
 {
 }
 
+void CRender2D::SetChangedPages(const uint8_t *vramPages, const uint8_t *palettePages)
+{
+  m_vramChanged = vramPages;
+  m_paletteChanged = palettePages;
+}
+
 
 /******************************************************************************
  Configuration, Initialization, and Shutdown
@@ -620,26 +835,28 @@ void CRender2D::WriteVRAM(unsigned addr, uint32_t data)
 void CRender2D::AttachRegisters(const uint32_t *regPtr)
 {
   m_regs = regPtr;
-  DebugLog("Render2D attached registers\n");
+  DEBUG_LOG(Graphics, "Render2D attached registers\n");
 }
 
 void CRender2D::AttachPalette(const uint32_t *palPtr[2])
 {
   m_palette[0] = palPtr[0];
   m_palette[1] = palPtr[1];
-  DebugLog("Render2D attached palette\n");
+  DEBUG_LOG(Graphics, "Render2D attached palette\n");
 }
 
 void CRender2D::AttachVRAM(const uint8_t *vramPtr)
 {
   m_vram = (uint32_t *) vramPtr;
-  DebugLog("Render2D attached VRAM\n");
+  DEBUG_LOG(Graphics, "Render2D attached VRAM\n");
 }
 
 // Memory pool and offsets within it
 #define MEMORY_POOL_SIZE      (2*512*384*4)
 #define OFFSET_TOP_SURFACE    0             // 512*384*4 bytes
 #define OFFSET_BOTTOM_SURFACE (512*384*4)   // 512*384*4
+#define OFFSET_VRAM_SHADOW    (2*512*384*4) // 0x120000, GPUTilemaps only
+#define TILEMAP_SHADOW_SIZE   0x120000
 
 bool CRender2D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes)
 {
@@ -651,25 +868,45 @@ bool CRender2D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
   glUseProgram(m_shaderProgram);    // bind program
   m_textureMapLoc = glGetUniformLocation(m_shaderProgram, "textureMap");
   glUniform1i(m_textureMapLoc, 0);  // attach it to texture unit 0
+  m_textureSizeLoc = glGetUniformLocation(m_shaderProgram, "textureSize");
+  m_pixelScaleLoc = glGetUniformLocation(m_shaderProgram, "pixelScale");
+  glUniform2f(m_textureSizeLoc, 496.0f, 384.0f);
+  glUniform2f(m_pixelScaleLoc, 1.0f, 1.0f);
+  m_vertexLoc = glGetAttribLocation(m_shaderProgram, "inVertex");
+
+  // Surfaces are drawn as a strip of two triangles
+  static const GLfloat quad[] = { 0.0f, 0.0f,   1.0f, 0.0f,   0.0f, 1.0f,   1.0f, 1.0f };
+  glGenBuffers(1, &m_quadVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // How the surfaces are scaled to the viewport
+  std::string filter = m_config["Filter2D"].ValueAsDefault<std::string>("bilinear");
+  GLint texFilter = GL_LINEAR;
+  if (filter == "nearest")
+    texFilter = GL_NEAREST;
+  else if (filter == "sharp")
+    m_sharpFilter = true;
+  else if (filter != "bilinear")
+    ErrorLog("Unknown 2D filter '%s'. Using bilinear.", filter.c_str());
 
   // Allocate memory for layer surfaces
-  m_memoryPool = new(std::nothrow) uint8_t[MEMORY_POOL_SIZE];
+  m_gpuTilemaps = m_config["GPUTilemaps"].ValueAsDefault<bool>(false);
+  size_t memoryPoolSize = MEMORY_POOL_SIZE + (m_gpuTilemaps ? TILEMAP_SHADOW_SIZE : 0);
+  m_memoryPool = new(std::nothrow) uint8_t[memoryPoolSize];
   if (NULL == m_memoryPool)
-    return ErrorLog("Insufficient memory for tilemap surfaces (need %1.1f MB).", float(MEMORY_POOL_SIZE) / 0x100000);
-  memset(m_memoryPool, 0, MEMORY_POOL_SIZE);  // clear textures
+    return ErrorLog("Insufficient memory for tilemap surfaces (need %1.1f MB).", float(memoryPoolSize) / 0x100000);
+  memset(m_memoryPool, 0, memoryPoolSize);  // clear textures
 
   // Set up pointers to memory regions
   m_topSurface    = (uint32_t *) &m_memoryPool[OFFSET_TOP_SURFACE];
   m_bottomSurface = (uint32_t *) &m_memoryPool[OFFSET_BOTTOM_SURFACE];
+  if (m_gpuTilemaps)
+    m_vramShadow    = (uint32_t *) &m_memoryPool[OFFSET_VRAM_SHADOW];
 
   // Resolution
-  m_xPixels = xRes;
-  m_yPixels = yRes;
-  m_xOffset = xOffset;
-  m_yOffset = yOffset;
-  m_totalXPixels = totalXRes;
-  m_totalYPixels = totalYRes;
-  m_correction = (UINT32)(((yRes / 384.f) * 2) + 0.5f);		// for some reason the 2d layer is 2 pixels off the 3D
+  Resize(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes);
 
   // Create textures
   glActiveTexture(GL_TEXTURE0); // texture unit 0
@@ -680,25 +917,56 @@ bool CRender2D::Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned
     glBindTexture(GL_TEXTURE_2D, m_texID[i]);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texFilter);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 496, 384, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
   }
 
-  DebugLog("Render2D initialized (allocated %1.1f MB)\n", float(MEMORY_POOL_SIZE) / 0x100000);
+  if (GLEW_ARB_pixel_buffer_object)
+    glGenBuffers(1, &m_pbo);
+
+  if (m_gpuTilemaps && OKAY != InitTilemapShader())
+  {
+    InfoLog("Unable to draw tilemaps on the GPU (requires OpenGL 3.0). Drawing them on the CPU instead.");
+    m_gpuTilemaps = false;
+  }
+
+  DEBUG_LOG(Graphics, "Render2D initialized (allocated %1.1f MB)\n", float(memoryPoolSize) / 0x100000);
   return OKAY;
 }
 
+void CRender2D::Resize(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes)
+{
+  m_xPixels = xRes;
+  m_yPixels = yRes;
+  m_xOffset = xOffset;
+  m_yOffset = yOffset;
+  m_totalXPixels = totalXRes;
+  m_totalYPixels = totalYRes;
+  m_correction = (UINT32)(((yRes / 384.f) * 2) + 0.5f);		// for some reason the 2d layer is 2 pixels off the 3D
+}
+
 CRender2D::CRender2D(const Util::Config::Node &config)
-  : m_config(config)
+  : m_config(config),
+    m_wideBackground(config, "WideBackground")
 {
-  DebugLog("Built Render2D\n");
+  DEBUG_LOG(Graphics, "Built Render2D\n");
 }
 
 CRender2D::~CRender2D(void)
 {
   DestroyShaderProgram(m_shaderProgram, m_vertexShader, m_fragmentShader);
   glDeleteTextures(2, m_texID);
+  if (m_quadVBO)
+    glDeleteBuffers(1, &m_quadVBO);
+  if (m_pbo)
+    glDeleteBuffers(1, &m_pbo);
+  if (m_tilemapProgram)
+    DestroyShaderProgram(m_tilemapProgram, m_tilemapVertexShader, m_tilemapFragmentShader);
+  if (m_vramTexID)
+    glDeleteTextures(1, &m_vramTexID);
+  if (m_surfaceFBO[0])
+    glDeleteFramebuffers(2, m_surfaceFBO);
 
   if (m_memoryPool)
   {
@@ -709,6 +977,7 @@ CRender2D::~CRender2D(void)
   m_vram = 0;
   m_topSurface = 0;
   m_bottomSurface = 0;
+  m_vramShadow = 0;
 
-  DebugLog("Destroyed Render2D\n");
+  DEBUG_LOG(Graphics, "Destroyed Render2D\n");
 }
@@ -100,6 +100,23 @@ public:
    *    data  The data to write.
    */
   void WriteVRAM(unsigned addr, uint32_t data);
+
+  /*
+   * SetChangedPages(vramPages, palettePages):
+   *
+   * Indicates which parts of tile generator RAM changed since the last frame
+   * was drawn, so that the next PreRenderFrame() need only redraw the lines
+   * they affect. Applies to the next frame only; if not called, everything is
+   * redrawn.
+   *
+   * Parameters:
+   *    vramPages     Bitmap of the 1 KB pages of VRAM changed (bit n of byte
+   *                  n/8 for page n), or NULL if all of it may have changed.
+   *    palettePages  Bitmap of the 1 KB pages of the palettes changed (A/A'
+   *                  and B/B' together), or NULL. Must remain valid until
+   *                  EndFrame().
+   */
+  void SetChangedPages(const uint8_t *vramPages, const uint8_t *palettePages);
   
   /*
    * AttachRegisters(regPtr):
@@ -158,6 +175,15 @@ public:
    *    occurred. Prints own error messages.
    */
   bool Init(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes);
+
+  /*
+   * Resize(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes);
+   *
+   * Changes the display area after Init(), e.g. on a fullscreen toggle. The
+   * layer surfaces are native size, so they and the shaders are all kept.
+   * Parameters are as for Init().
+   */
+  void Resize(unsigned xOffset, unsigned yOffset, unsigned xRes, unsigned yRes, unsigned totalXRes, unsigned totalYRes);
    
   /*
    * CRender2D(config):
@@ -173,12 +199,21 @@ public:
   
 private:
   // Private member functions
-  std::pair<bool, bool> DrawTilemaps(uint32_t *destBottom, uint32_t *destTop);
+  std::pair<bool, bool> DrawTilemaps(uint32_t *destBottom, uint32_t *destTop, const bool *bottomLines = NULL, const bool *topLines = NULL);
+  bool LineChanged(int layerNum, int y) const;
+  bool FindChangedLines(bool lines[2][384]) const;
+  std::pair<bool, bool> DrawTilemapsGPU(void);
+  bool InitTilemapShader(void);
+  void UploadTilemapData(void);
+  void UploadChangedRows(GLuint texID, int firstRow, const uint32_t *src, uint32_t *shadow, int rows, int rowWords, GLenum format, GLenum type);
+  void DrawQuad(GLint vertexLoc);
   void DisplaySurface(int surface);
   void Setup2D(bool isBottom);
+  void UploadSurface(int surface, const uint32_t *pixels, int firstRow, int rows);
       
   // Run-time configuration
   const Util::Config::Node &m_config;
+  Util::Config::Binding<bool> m_wideBackground;
 
   // Data received from tile generator device object
   const uint32_t *m_vram;
@@ -187,6 +222,7 @@ private:
   
   // OpenGL data
   GLuint    m_texID[2];       // IDs for the 2 layer textures (top and bottom)
+  GLuint    m_pbo = 0;        // pixel unpack buffer both surfaces are streamed through, if supported
   unsigned  m_xPixels = 496;  // display surface resolution
   unsigned  m_yPixels = 384;  // ...
   unsigned  m_xOffset = 0;    // offset
@@ -200,14 +236,41 @@ private:
   GLuint m_vertexShader;    // vertex shader handle
   GLuint m_fragmentShader;  // fragment shader
   GLuint m_textureMapLoc;   // location of "textureMap" uniform
+  GLint  m_textureSizeLoc;  // "textureSize"
+  GLint  m_pixelScaleLoc;   // "pixelScale"
+  GLint  m_vertexLoc;       // location of "inVertex" attribute
+  GLuint m_quadVBO = 0;     // corners of the quad surfaces are drawn with
+  bool   m_sharpFilter = false; // Filter2D is "sharp": scale by whole texels, blending only their seams
+
+  // Tilemaps drawn by a shader (GPUTilemaps), from VRAM copied to a texture
+  bool      m_gpuTilemaps = false;
+  GLuint    m_tilemapProgram = 0;
+  GLuint    m_tilemapVertexShader = 0;
+  GLuint    m_tilemapFragmentShader = 0;
+  GLint     m_tilemapVertexLoc;     // location of "inVertex" attribute
+  GLint     m_layerScrollLoc;       // location of "layerScroll" uniform
+  GLint     m_layerEnabledLoc;      // "layerEnabled"
+  GLint     m_layer4BitLoc;         // "layer4Bit"
+  GLint     m_colorOffsetLoc;       // "colorOffset"
+  GLuint    m_vramTexID = 0;        // 512x576 R32UI copy of VRAM, palette RAM included
+  GLuint    m_surfaceFBO[2] = { 0, 0 };   // render to the top and bottom layer textures
+  bool      m_tilemapDataValid = false;  // textures hold the shadow copies below
 
   // PreRenderFrame() tracks which surfaces exist in current frame
   std::pair<bool, bool> m_surfaces_present = std::pair<bool, bool>(false, false);
 
+  // What changed since the surfaces were last drawn on the CPU, to redraw only the lines affected
+  const uint8_t *m_vramChanged = NULL;    // NULL if unknown
+  const uint8_t *m_paletteChanged = NULL;
+  uint32_t  m_drawnLayerRegs[5];          // layer configuration and scroll registers the surfaces were drawn with
+  bool      m_surfacesValid = false;
+  bool      m_changedLines[2][384];       // lines of the top and bottom surfaces redrawn this frame
+
   // Buffers
   uint8_t   *m_memoryPool = 0;    // all memory is allocated here
   uint32_t  *m_topSurface = 0;    // 512x384x32bpp pixel surface for top layers
   uint32_t  *m_bottomSurface = 0; // bottom layers
+  uint32_t  *m_vramShadow = 0;    // VRAM as last uploaded, so only changed rows are sent again
 };
 
 
@@ -46,6 +46,7 @@
 #include <cstdio>
 #include <GL/glew.h>
 #include "Supermodel.h"
+#include "Graphics/ShaderCache.h"
 
 
 // Load a source file. Pointer returned must be freed by caller. Returns NULL if failed.
@@ -89,6 +90,8 @@ bool LoadShaderProgram(GLuint *shaderProgramPtr, GLuint *vertexShaderPtr, GLuint
 	GLuint		shaderProgram, vertexShader, fragmentShader;
 	GLint		result, len;
 	bool		ret = OKAY;
+	const char	*sources[2];
+	UINT64		cacheKey;
 	
 	// Load shaders from files if specified
 	if (!vsFile.empty())
@@ -113,11 +116,23 @@ bool LoadShaderProgram(GLuint *shaderProgramPtr, GLuint *vertexShaderPtr, GLuint
 		goto Quit;
 	}
 	
-	// Create the shaders and shader program
+	// Create the shader program, from a cached binary if there is one
 	shaderProgram	= glCreateProgram();
+	*shaderProgramPtr	= shaderProgram;
+	sources[0] = vsSource;
+	sources[1] = fsSource;
+	cacheKey = CShaderCache::Shared().Key(sources, 2);
+	if (CShaderCache::Shared().Load(shaderProgram, cacheKey))
+	{
+		*vertexShaderPtr	= 0;	// nothing compiled, DestroyShaderProgram() ignores them
+		*fragmentShaderPtr	= 0;
+		glUseProgram(shaderProgram);
+		goto Quit;
+	}
+
+	// Create the shaders
 	vertexShader	= glCreateShader(GL_VERTEX_SHADER);
 	fragmentShader 	= glCreateShader(GL_FRAGMENT_SHADER);
-	*shaderProgramPtr	= shaderProgram;
 	*vertexShaderPtr 	= vertexShader;
 	*fragmentShaderPtr 	= fragmentShader;
 	
@@ -146,6 +161,7 @@ bool LoadShaderProgram(GLuint *shaderProgramPtr, GLuint *vertexShaderPtr, GLuint
 	// Link
 	glAttachShader(shaderProgram, vertexShader);
 	glAttachShader(shaderProgram, fragmentShader);
+	CShaderCache::Shared().PrepareLink(shaderProgram);
 	glLinkProgram(shaderProgram);
 	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &result);
 	if (result == GL_FALSE)
@@ -154,6 +170,8 @@ bool LoadShaderProgram(GLuint *shaderProgramPtr, GLuint *vertexShaderPtr, GLuint
 		ErrorLog("Failed to link shader objects. Your OpenGL driver said:\n%s\n", infoLog);
 		ret = FAIL;	// error
 	}
+	else if (ret == OKAY)
+		CShaderCache::Shared().Store(shaderProgram, cacheKey);
 
 	// Enable the shader (if no errors)
 	if (ret == OKAY)
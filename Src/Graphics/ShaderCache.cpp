@@ -0,0 +1,193 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson 
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free 
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+ 
+/*
+ * ShaderCache.cpp
+ * 
+ * Implementation of the CShaderCache class: program binaries kept on disk.
+ */
+
+#include "ShaderCache.h"
+#include "Supermodel.h"
+#include <string>
+
+
+static const char   SHADER_CACHE_FILE[]       = "NVRAM/Shaders.bin";
+static const INT32  SHADER_CACHE_FILE_VERSION = 1;
+
+// FNV-1a, with each string terminated so that the boundaries between them count
+static UINT64 HashString(UINT64 hash, const char *str)
+{
+  for (const unsigned char *c = (const unsigned char *) str; *c; c++)
+    hash = (hash ^ *c) * 0x100000001B3ULL;
+  return (hash ^ 0xFF) * 0x100000001B3ULL;
+}
+
+CShaderCache &CShaderCache::Shared()
+{
+  static CShaderCache s_cache;
+  return s_cache;
+}
+
+void CShaderCache::SetEnabled(bool enable)
+{
+  m_enabled = enable;
+}
+
+bool CShaderCache::Enabled() const
+{
+  return m_enabled && GLEW_ARB_get_program_binary;
+}
+
+UINT64 CShaderCache::Key(const char *const *sources, int numSources) const
+{
+  // Anything that would make a binary wrong or unloadable
+  UINT64 hash = 0xCBF29CE484222325ULL;
+  hash = HashString(hash, (const char *) glGetString(GL_VENDOR));
+  hash = HashString(hash, (const char *) glGetString(GL_RENDERER));
+  hash = HashString(hash, (const char *) glGetString(GL_VERSION));
+  for (int i = 0; i < numSources; i++)
+    hash = HashString(hash, sources[i] ? sources[i] : "");
+  return hash;
+}
+
+bool CShaderCache::Load(GLuint program, UINT64 key)
+{
+  if (!Enabled())
+    return false;
+  if (!m_fileLoaded)
+    LoadFile();
+
+  auto it = m_binaries.find(key);
+  if (it == m_binaries.end())
+    return false;
+
+  glProgramBinary(program, it->second.format, it->second.data.data(), GLsizei(it->second.data.size()));
+  GLint linked = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked);
+  if (linked == GL_FALSE)
+  {
+    // Compiled again by the caller and stored in its place
+    m_binaries.erase(it);
+    m_dirty = true;
+    return false;
+  }
+
+  it->second.used = true;
+  return true;
+}
+
+void CShaderCache::PrepareLink(GLuint program)
+{
+  if (Enabled())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void CShaderCache::Store(GLuint program, UINT64 key)
+{
+  if (!Enabled())
+    return;
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  Binary &binary = m_binaries[key];
+  binary.data.resize(length);
+  glGetProgramBinary(program, length, &length, &binary.format, binary.data.data());
+  binary.data.resize(length);
+  binary.used = true;
+  m_dirty = true;
+}
+
+void CShaderCache::LoadFile()
+{
+  m_fileLoaded = true;
+
+  CBlockFile file;
+  if (OKAY != file.Load(SHADER_CACHE_FILE))
+    return;
+  if (OKAY != file.FindBlock("Supermodel Shader Cache"))
+  {
+    ErrorLog("'%s' is not a valid shader cache file.", SHADER_CACHE_FILE);
+    return;
+  }
+
+  INT32 fileVersion = 0;
+  UINT32 count = 0;
+  file.Read(&fileVersion, sizeof(fileVersion));
+  if (fileVersion != SHADER_CACHE_FILE_VERSION || OKAY != file.FindBlock("Programs") || file.Read(&count, sizeof(count)) != sizeof(count))
+  {
+    m_dirty = true;   // rewritten on exit
+    return;
+  }
+
+  for (UINT32 i = 0; i < count; i++)
+  {
+    UINT64 key;
+    UINT32 entry[2];  // binary format, length
+    if (file.Read(&key, sizeof(key)) != sizeof(key) || file.Read(entry, sizeof(entry)) != sizeof(entry))
+      break;
+    Binary &binary = m_binaries[key];
+    binary.format = entry[0];
+    binary.data.resize(entry[1]);
+    if (file.Read(binary.data.data(), entry[1]) != entry[1])
+    {
+      m_binaries.erase(key);
+      break;
+    }
+  }
+}
+
+void CShaderCache::Save()
+{
+  // Binaries not used this session would only be stale, so their absence is also a change
+  UINT32 count = 0;
+  for (auto &it: m_binaries)
+    count += it.second.used ? 1 : 0;
+  if (!m_dirty && count == m_binaries.size())
+    return;
+
+  CBlockFile file;
+  if (OKAY != file.Create(SHADER_CACHE_FILE, "Supermodel Shader Cache", "Supermodel Version " SUPERMODEL_VERSION))
+  {
+    ErrorLog("Unable to save shader cache to '%s'. Make sure directory exists!", SHADER_CACHE_FILE);
+    return;
+  }
+
+  INT32 fileVersion = SHADER_CACHE_FILE_VERSION;
+  file.Write(&fileVersion, sizeof(fileVersion));
+  file.NewBlock("Programs", "Program binaries by hash of driver and sources");
+  file.Write(&count, sizeof(count));
+  for (auto &it: m_binaries)
+  {
+    if (!it.second.used)
+      continue;
+    UINT64 key = it.first;
+    UINT32 entry[2] = { it.second.format, UINT32(it.second.data.size()) };
+    file.Write(&key, sizeof(key));
+    file.Write(entry, sizeof(entry));
+    file.Write(it.second.data.data(), entry[1]);
+  }
+  file.Close();
+  m_dirty = false;
+}
@@ -0,0 +1,94 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson 
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free 
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+ 
+/*
+ * ShaderCache.h
+ * 
+ * Program binaries kept on disk, so shaders are compiled once per driver.
+ */
+
+#ifndef INCLUDED_SHADERCACHE_H
+#define INCLUDED_SHADERCACHE_H
+
+#include <GL/glew.h>
+#include "Types.h"
+#include <map>
+#include <vector>
+
+
+/*
+ * CShaderCache:
+ *
+ * Holds the binaries of linked shader programs, keyed by a hash of their
+ * sources and of the driver, and keeps them in a file between runs. A program
+ * whose key is found is loaded from its binary instead of being compiled.
+ *
+ * The file is read the first time a binary is looked for. Only binaries used
+ * in a session are written back, so ones for old shaders or drivers are
+ * dropped. The driver may reject a binary (after an update, for instance),
+ * in which case the program is compiled as normal and the binary replaced.
+ *
+ * Does nothing unless enabled and the GL supports program binaries. All
+ * members but Save() must be called from the thread that owns the GL context.
+ */
+class CShaderCache
+{
+public:
+  static CShaderCache &Shared();
+
+  void SetEnabled(bool enable);
+
+  // Key of a program linked from the given sources (NULL ones are skipped) on this driver
+  UINT64 Key(const char *const *sources, int numSources) const;
+
+  // Links a new program from the binary held for key. Returns true if it linked.
+  bool Load(GLuint program, UINT64 key);
+
+  // Call before linking a program that will be stored, so the driver keeps its binary
+  void PrepareLink(GLuint program);
+
+  // Keeps the binary of a program that was just linked successfully
+  void Store(GLuint program, UINT64 key);
+
+  // Writes the cache file if any binaries were added
+  void Save();
+
+private:
+  struct Binary
+  {
+    GLenum format = 0;
+    std::vector<char> data;
+    bool used = false;
+  };
+
+  CShaderCache() = default;
+
+  bool Enabled() const;
+  void LoadFile();
+
+  bool m_enabled = false;
+  bool m_fileLoaded = false;
+  bool m_dirty = false;
+  std::map<UINT64, Binary> m_binaries;
+};
+
+
+#endif  // INCLUDED_SHADERCACHE_H
@@ -60,10 +60,16 @@ static const char s_vertexShaderSource[] =
 " \n"
 "#version 120\n"
 "\n"
+"// Inputs\n"
+"attribute vec2\tinVertex;\t\t// corner of the layer surface, (0,0) top left to (1,1) bottom right\n"
+"\n"
+"// Outputs\n"
+"varying vec2\tfsTexCoord;\n"
+"\n"
 "void main(void)\n"
 "{\n"
-"\tgl_TexCoord[0] = gl_MultiTexCoord0;\n"
-"\tgl_Position = gl_ModelViewProjectionMatrix*gl_Vertex;\n"
+"\tfsTexCoord = inVertex;\n"
+"\tgl_Position = vec4(inVertex.x * 2.0 - 1.0, 1.0 - inVertex.y * 2.0, 0.0, 1.0);\n"
 "}\n"
 };
 
@@ -100,7 +106,12 @@ static const char s_fragmentShaderSource[] =
 "#version 120\n"
 "\n"
 "// Global uniforms\n"
-"uniform sampler2D\ttextureMap;\t\t// 512x512 layer surface\n"
+"uniform sampler2D\ttextureMap;\t\t// 496x384 layer surface\n"
+"uniform vec2\t\ttextureSize;\t// its size in texels\n"
+"uniform vec2\t\tpixelScale;\t\t// screen pixels per texel for sharp bilinear filtering, else 1\n"
+"\n"
+"// Inputs\n"
+"varying vec2\t\tfsTexCoord;\n"
 "\n"
 "/*\n"
 " * main():\n"
@@ -110,7 +121,132 @@ static const char s_fragmentShaderSource[] =
 "\n"
 "void main(void)\n"
 "{\t\n"
-"\tgl_FragColor = texture2D(textureMap, gl_TexCoord[0].st);\n"
+"\t// Sample texel centers except within half a screen pixel of their edges, which\n"
+"\t// keeps each texel sharp but blends the seams. A scale of 1 leaves the coordinate as is.\n"
+"\tvec2 texel\t= fsTexCoord * textureSize;\n"
+"\tvec2 offset\t= fract(texel) - 0.5;\n"
+"\tvec2 region\t= 0.5 - 0.5 / pixelScale;\n"
+"\toffset = (offset - clamp(offset, -region, region)) * pixelScale + 0.5;\n"
+"\tgl_FragColor = texture2D(textureMap, (floor(texel) + offset) / textureSize);\n"
+"}\n"
+};
+
+// Vertex shader for drawing tilemaps on the GPU
+static const char s_tilemapVertexShaderSource[] =
+{
+"/*\n"
+" * Tilemap2D vertex shader\n"
+" *\n"
+" * Covers a 496x384 layer surface with the quad CRender2D displays surfaces with.\n"
+" */\n"
+"\n"
+"#version 130\n"
+"\n"
+"in vec2 inVertex;\t\t// corner of the surface, (0,0) to (1,1)\n"
+"\n"
+"void main(void)\n"
+"{\n"
+"\tgl_Position = vec4(inVertex * 2.0 - 1.0, 0.0, 1.0);\n"
+"}\n"
+};
+
+// Fragment shader for drawing tilemaps on the GPU
+static const char s_tilemapFragmentShaderSource[] =
+{
+"/*\n"
+" * Tilemap2D fragment shader\n"
+" *\n"
+" * Draws the tilemap layers selected for one surface, one pixel per fragment,\n"
+" * exactly as CRender2D::DrawLayer() does on the CPU.\n"
+" */\n"
+"\n"
+"#version 130\n"
+"\n"
+"// Global uniforms\n"
+"uniform usampler2D\tvram;\t\t\t// VRAM and palette RAM as 512x576 32-bit words\n"
+"uniform ivec3\t\tcolorOffset[2];\t// signed RGB offsets added to A/A' and B/B' colors\n"
+"uniform int\t\t\tlayerScroll[4];\t// scroll registers of each layer\n"
+"uniform int\t\t\tlayerEnabled;\t// bit n set if layer n is drawn on this surface\n"
+"uniform int\t\t\tlayer4Bit;\t\t// bit n set if layer n has 4-bit pixels\n"
+"\n"
+"uint ReadWord(int offset)\n"
+"{\n"
+"\treturn texelFetch(vram, ivec2(offset & 511, offset >> 9), 0).r;\n"
+"}\n"
+"\n"
+"// little endian 16-bit word at VRAM byte offset 2*index\n"
+"int ReadHalfWord(int index)\n"
+"{\n"
+"\tuint data = ReadWord(index >> 1);\n"
+"\treturn int(((index & 1) != 0) ? (data >> 16) : (data & 0xFFFFu));\n"
+"}\n"
+"\n"
+"// Decodes a palette RAM color as CTileGen::WritePalette() does\n"
+"vec4 PaletteColor(int layer, int index)\n"
+"{\n"
+"\tint\t\tdata\t\t= int(ReadWord(0x100000 / 4 + index) & 0xFFFFu);\n"
+"\tbool\ttransparent\t= (data & 0x8000) != 0;\n"
+"\tivec3\trgb\t\t\t= transparent ? ivec3(0) : ((ivec3(data, data >> 5, data >> 10) & 0x1F) * 255) / 31;\n"
+"\n"
+"\trgb = clamp(rgb + colorOffset[layer / 2], 0, 255);\n"
+"\treturn vec4(vec3(rgb) / 255.0, transparent ? 0.0 : 1.0);\n"
+"}\n"
+"\n"
+"// Returns whether the mask shows this layer at (x,y), and its color there\n"
+"bool LayerPixel(int layer, int x, int y, out vec4 color)\n"
+"{\n"
+"\tint scroll\t= layerScroll[layer];\n"
+"\tint hScroll\t= ((scroll & 0x8000) != 0) ? ReadHalfWord((0xF6000 + layer * 0x400) / 2 + y) : scroll;\n"
+"\tint vScroll\t= (scroll >> 16) & 0x1FF;\n"
+"\tint tileX\t= x + (hScroll & 0x1FF);\n"
+"\tint tileY\t= y + vScroll;\n"
+"\tint tile\t= ReadHalfWord((0xF8000 + layer * 0x2000) / 2 + ((64 * (tileY / 8)) & 0xFFF) + (((tileX / 8) ^ 1) & 63));\n"
+"\tint index;\n"
+"\n"
+"\tif (((layer4Bit >> layer) & 1) != 0)\n"
+"\t{\n"
+"\t\tuint pattern = ReadWord((((tile & 0x3FFF) << 1) | ((tile >> 15) & 1)) * 8 + (tileY & 7));\n"
+"\t\tindex = int((pattern >> uint((7 - (tileX & 7)) * 4)) & 0xFu) | (tile & 0x7FF0);\n"
+"\t}\n"
+"\telse\n"
+"\t{\n"
+"\t\tuint pattern = ReadWord((tile & 0x3FFF) * 16 + (tileY & 7) * 2 + (tileX & 7) / 4);\n"
+"\t\tindex = int((pattern >> uint((3 - (tileX & 3)) * 8)) & 0xFFu) | (tile & 0x7F00);\n"
+"\t}\n"
+"\n"
+"\tcolor = PaletteColor(layer, index);\n"
+"\n"
+"\t// A/A' use the high half of each mask word, and alternate layers are shown where the mask is clear\n"
+"\tuint maskWord\t= ReadWord(0xF7000 / 4 + y);\n"
+"\tint mask\t\t= int((layer < 2) ? (maskWord >> 16) : (maskWord & 0xFFFFu));\n"
+"\tif ((layer & 1) != 0)\n"
+"\t\tmask ^= 0xFFFF;\n"
+"\treturn (mask & (1 << (15 - x / 32))) != 0;\n"
+"}\n"
+"\n"
+"void main(void)\n"
+"{\n"
+"\tint\t\tx\t\t= int(gl_FragCoord.x);\n"
+"\tint\t\ty\t\t= int(gl_FragCoord.y);\n"
+"\tvec4\tresult\t= vec4(0.0);\n"
+"\tbool\tfirst\t= true;\n"
+"\n"
+"\t// Bottom-most layer is drawn whole, those above only where opaque\n"
+"\tfor (int layer = 3; layer >= 0; layer--)\n"
+"\t{\n"
+"\t\tif (((layerEnabled >> layer) & 1) == 0)\n"
+"\t\t\tcontinue;\n"
+"\n"
+"\t\tvec4 color;\n"
+"\t\tbool visible = LayerPixel(layer, x, y, color);\n"
+"\t\tif (first)\n"
+"\t\t\tresult = visible ? color : vec4(0.0);\n"
+"\t\telse if (visible && color.a > 0.0)\n"
+"\t\t\tresult = color;\n"
+"\t\tfirst = false;\n"
+"\t}\n"
+"\n"
+"\tgl_FragColor = result;\n"
 "}\n"
 };
 
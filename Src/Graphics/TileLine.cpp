@@ -0,0 +1,326 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2012 Bart Trzynadlowski, Nik Henson 
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free 
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+ 
+
+/*
+ * TileLine.cpp
+ *
+ * Vectorised tile line drawing for CRender2D's CPU path. Each implementation
+ * draws a whole tile line (8 pixels) at a time: the pattern is split into
+ * palette indices with shifts or byte shuffles, the colors are gathered (AVX2)
+ * or loaded one by one, and the mask and alpha test are applied with vector
+ * compares and blends. They all draw the same pixels as DrawTileLine().
+ */
+
+#include "TileLine.h"
+#include "Util/CPUFeatures.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TILELINE_X86
+#elif defined(__ARM_NEON)
+#define TILELINE_NEON
+#endif
+
+#if defined(TILELINE_X86)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define SSE41_TARGET
+#define AVX2_TARGET
+#else
+#define SSE41_TARGET __attribute__((target("sse4.1")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#elif defined(TILELINE_NEON)
+#include <arm_neon.h>
+#endif
+
+
+namespace TileLine
+{
+  // Offset of the tile's pattern line in VRAM (in words) and the high palette index bits from its name table entry
+  template <int bits>
+  static inline void DecodeTile(uint16_t tile, int patternLine, int &patternOffset, uint32_t &colorHi)
+  {
+    if (bits == 4)
+    {
+      patternOffset = (((tile & 0x3FFF) << 1) | ((tile >> 15) & 1)) * 8 + patternLine;
+      colorHi = tile & 0x7FF0;
+    }
+    else
+    {
+      patternOffset = (tile & 0x3FFF) * 16 + patternLine * 2;
+      colorHi = tile & 0x7F00;
+    }
+  }
+
+
+/******************************************************************************
+ Scalar
+******************************************************************************/
+
+  template <int bits, bool alphaTest>
+  static void DrawTilesScalar(uint32_t *line, int pixelOffset, const uint16_t *nameTable, int hTile, int count, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      DrawTileLine<bits, alphaTest, false>(line, pixelOffset, nameTable[(hTile ^ 1) & 63], patternLine, vram, palette, mask);
+      ++hTile;
+      pixelOffset += 8;
+    }
+  }
+
+
+/******************************************************************************
+ AVX2: a tile line per vector, colors gathered
+******************************************************************************/
+
+#if defined(TILELINE_X86)
+
+  template <int bits, bool alphaTest>
+  AVX2_TARGET static void DrawTilesAVX2(uint32_t *line, int pixelOffset, const uint16_t *nameTable, int hTile, int count, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask)
+  {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i fifteen = _mm256_set1_epi32(15);
+    const __m256i maskBits = _mm256_set1_epi32(mask);
+    const __m256i shifts = (bits == 4) ? _mm256_setr_epi32(28, 24, 20, 16, 12, 8, 4, 0) : _mm256_setr_epi32(24, 16, 8, 0, 24, 16, 8, 0);
+    const __m256i indexMask = _mm256_set1_epi32((bits == 4) ? 0xF : 0xFF);
+    const __m256i alphaMask = _mm256_set1_epi32(int(0xFF000000));
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (int i = 0; i < count; i++)
+    {
+      int patternOffset;
+      uint32_t colorHi;
+      DecodeTile<bits>(nameTable[(hTile ^ 1) & 63], patternLine, patternOffset, colorHi);
+
+      __m256i pattern;
+      if (bits == 4)
+        pattern = _mm256_set1_epi32(int(vram[patternOffset]));
+      else
+      {
+        int p0 = int(vram[patternOffset]);
+        int p1 = int(vram[patternOffset + 1]);
+        pattern = _mm256_setr_epi32(p0, p0, p0, p0, p1, p1, p1, p1);
+      }
+      __m256i index = _mm256_or_si256(_mm256_and_si256(_mm256_srlv_epi32(pattern, shifts), indexMask), _mm256_set1_epi32(int(colorHi)));
+      __m256i pixel = _mm256_i32gather_epi32((const int *) palette, index, 4);
+
+      // Each mask bit covers 32 pixels, from the most significant
+      __m256i x = _mm256_add_epi32(_mm256_set1_epi32(pixelOffset), lane);
+      __m256i maskShift = _mm256_sub_epi32(fifteen, _mm256_srli_epi32(x, 5));
+      __m256i visible = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_srlv_epi32(maskBits, maskShift), one), one);
+
+      __m256i *dest = (__m256i *) &line[pixelOffset];
+      if (alphaTest)
+      {
+        __m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(pixel, alphaMask), zero);
+        __m256i draw = _mm256_andnot_si256(transparent, visible);
+        _mm256_storeu_si256(dest, _mm256_blendv_epi8(_mm256_loadu_si256(dest), pixel, draw));
+      }
+      else
+        _mm256_storeu_si256(dest, _mm256_and_si256(pixel, visible));
+
+      ++hTile;
+      pixelOffset += 8;
+    }
+  }
+
+
+/******************************************************************************
+ SSE4.1: half a tile line per vector, indices from byte shuffles
+******************************************************************************/
+
+  template <int bits, bool alphaTest>
+  SSE41_TARGET static void DrawTilesSSE41(uint32_t *line, int pixelOffset, const uint16_t *nameTable, int hTile, int count, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask)
+  {
+    // Moves the byte holding each pixel of a pattern word to the bottom of its lane. 4-bit pixels come in pairs
+    // from each byte, high nibble first, so the first half of the tile is in the upper two bytes.
+    const __m128i spread4[2] =
+    {
+      _mm_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 2, -1, -1, -1, 2, -1, -1, -1),
+      _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1)
+    };
+    const __m128i spread8 = _mm_setr_epi8(3, -1, -1, -1, 2, -1, -1, -1, 1, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i nibble = _mm_set1_epi32(0xF);
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000));
+    const __m128i zero = _mm_setzero_si128();
+
+    for (int i = 0; i < count; i++)
+    {
+      int patternOffset;
+      uint32_t colorHi;
+      DecodeTile<bits>(nameTable[(hTile ^ 1) & 63], patternLine, patternOffset, colorHi);
+
+      alignas(16) uint32_t index[8];
+      for (int h = 0; h < 2; h++)
+      {
+        __m128i pixelIndex;
+        if (bits == 4)
+        {
+          __m128i bytes = _mm_shuffle_epi8(_mm_cvtsi32_si128(int(vram[patternOffset])), spread4[h]);
+          pixelIndex = _mm_blend_epi16(_mm_srli_epi32(bytes, 4), _mm_and_si128(bytes, nibble), 0xCC);  // odd pixels are the low nibbles
+        }
+        else
+          pixelIndex = _mm_shuffle_epi8(_mm_cvtsi32_si128(int(vram[patternOffset + h])), spread8);
+        _mm_store_si128((__m128i *) &index[h * 4], _mm_or_si128(pixelIndex, _mm_set1_epi32(int(colorHi))));
+      }
+
+      // The 8 pixels are covered by at most two mask bits
+      int block = pixelOffset >> 5;
+      int firstBlockPixels = 32 - (pixelOffset & 31);
+      __m128i visibleFirst = _mm_set1_epi32(-int((mask >> (15 - block)) & 1));
+      __m128i visibleSecond = (block < 15) ? _mm_set1_epi32(-int((mask >> (14 - block)) & 1)) : visibleFirst;
+
+      for (int h = 0; h < 2; h++)
+      {
+        const uint32_t *idx = &index[h * 4];
+        __m128i pixel = _mm_setr_epi32(int(palette[idx[0]]), int(palette[idx[1]]), int(palette[idx[2]]), int(palette[idx[3]]));
+        __m128i inFirst = _mm_cmplt_epi32(_mm_add_epi32(lane, _mm_set1_epi32(h * 4)), _mm_set1_epi32(firstBlockPixels));
+        __m128i visible = _mm_blendv_epi8(visibleSecond, visibleFirst, inFirst);
+
+        __m128i *dest = (__m128i *) &line[pixelOffset + h * 4];
+        if (alphaTest)
+        {
+          __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(pixel, alphaMask), zero);
+          __m128i draw = _mm_andnot_si128(transparent, visible);
+          _mm_storeu_si128(dest, _mm_blendv_epi8(_mm_loadu_si128(dest), pixel, draw));
+        }
+        else
+          _mm_storeu_si128(dest, _mm_and_si128(pixel, visible));
+      }
+
+      ++hTile;
+      pixelOffset += 8;
+    }
+  }
+
+#endif  // TILELINE_X86
+
+
+/******************************************************************************
+ NEON: half a tile line per vector, indices from variable shifts
+******************************************************************************/
+
+#if defined(TILELINE_NEON)
+
+  template <int bits, bool alphaTest>
+  static void DrawTilesNEON(uint32_t *line, int pixelOffset, const uint16_t *nameTable, int hTile, int count, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask)
+  {
+    static const int32_t shifts4[8] = { -28, -24, -20, -16, -12, -8, -4, 0 };  // negative shifts are to the right
+    static const int32_t shifts8[4] = { -24, -16, -8, 0 };
+    static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+    const uint32x4_t lane = vld1q_u32(lanes);
+    const uint32x4_t one = vdupq_n_u32(1);
+    const uint32x4_t fifteen = vdupq_n_u32(15);
+    const uint32x4_t maskBits = vdupq_n_u32(mask);
+    const uint32x4_t indexMask = vdupq_n_u32((bits == 4) ? 0xF : 0xFF);
+    const uint32x4_t alphaMask = vdupq_n_u32(0xFF000000);
+
+    for (int i = 0; i < count; i++)
+    {
+      int patternOffset;
+      uint32_t colorHi;
+      DecodeTile<bits>(nameTable[(hTile ^ 1) & 63], patternLine, patternOffset, colorHi);
+
+      for (int h = 0; h < 2; h++)
+      {
+        uint32x4_t pattern = vdupq_n_u32((bits == 4) ? vram[patternOffset] : vram[patternOffset + h]);
+        int32x4_t shift = vld1q_s32((bits == 4) ? &shifts4[h * 4] : shifts8);
+        uint32x4_t pixelIndex = vorrq_u32(vandq_u32(vshlq_u32(pattern, shift), indexMask), vdupq_n_u32(colorHi));
+
+        uint32_t index[4];
+        vst1q_u32(index, pixelIndex);
+        const uint32_t colors[4] = { palette[index[0]], palette[index[1]], palette[index[2]], palette[index[3]] };
+        uint32x4_t pixel = vld1q_u32(colors);
+
+        // Each mask bit covers 32 pixels, from the most significant
+        uint32x4_t x = vaddq_u32(vdupq_n_u32(pixelOffset + h * 4), lane);
+        int32x4_t maskShift = vnegq_s32(vreinterpretq_s32_u32(vsubq_u32(fifteen, vshrq_n_u32(x, 5))));
+        uint32x4_t visible = vceqq_u32(vandq_u32(vshlq_u32(maskBits, maskShift), one), one);
+
+        uint32_t *dest = &line[pixelOffset + h * 4];
+        if (alphaTest)
+        {
+          uint32x4_t draw = vandq_u32(visible, vtstq_u32(pixel, alphaMask));
+          vst1q_u32(dest, vbslq_u32(draw, pixel, vld1q_u32(dest)));
+        }
+        else
+          vst1q_u32(dest, vandq_u32(pixel, visible));
+      }
+
+      ++hTile;
+      pixelOffset += 8;
+    }
+  }
+
+#endif  // TILELINE_NEON
+
+
+/******************************************************************************
+ Dispatch
+******************************************************************************/
+
+  typedef void (*DrawTilesFunction)(uint32_t *line, int pixelOffset, const uint16_t *nameTable, int hTile, int count, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask);
+
+  struct Implementation
+  {
+    const char *name;
+    uint32_t features;  // needed by the CPU
+    DrawTilesFunction drawTiles[2][2];  // [8-bit][alphaTest]
+  };
+
+#define TILELINE_FUNCTIONS(fn) { { fn<4, false>, fn<4, true> }, { fn<8, false>, fn<8, true> } }
+
+  static const Implementation s_implementations[] = // best first
+  {
+#if defined(TILELINE_X86)
+    { "avx2",   Util::CPUFeatures::AVX2,  TILELINE_FUNCTIONS(DrawTilesAVX2) },
+    { "sse4.1", Util::CPUFeatures::SSE41, TILELINE_FUNCTIONS(DrawTilesSSE41) },
+#endif
+#if defined(TILELINE_NEON)
+    { "neon",   Util::CPUFeatures::NEON,  TILELINE_FUNCTIONS(DrawTilesNEON) },
+#endif
+    { "scalar", 0,                        TILELINE_FUNCTIONS(DrawTilesScalar) }
+  };
+
+  static const Implementation *s_current = Util::CPUFeatures::FindBest(s_implementations);
+
+  void DrawTiles(int bits, bool alphaTest, uint32_t *line, int pixelOffset, const uint16_t *nameTable, int hTile, int count, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask)
+  {
+    s_current->drawTiles[bits == 8][alphaTest](line, pixelOffset, nameTable, hTile, count, patternLine, vram, palette, mask);
+  }
+
+  const char *GetImplementation(void)
+  {
+    return s_current->name;
+  }
+
+  bool SetImplementation(const char *name)
+  {
+    const Implementation *impl = Util::CPUFeatures::Find(s_implementations, name);
+    if (impl == nullptr)
+      return false;
+    s_current = impl;
+    return true;
+  }
+}
@@ -0,0 +1,165 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2012 Bart Trzynadlowski, Nik Henson 
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free 
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+ 
+/*
+ * TileLine.h
+ * 
+ * Header file for drawing lines of tilemap layers on the CPU, with vectorised
+ * versions chosen at run time.
+ */
+
+#ifndef INCLUDED_TILELINE_H
+#define INCLUDED_TILELINE_H
+
+#include <cstdint>
+
+
+/*
+ * DrawTileLine<bits, alphaTest, clip>(line, pixelOffset, tile, patternLine,
+ *                                      vram, palette, mask):
+ *
+ * Draws one line of the 8 pixels of a tile. With alphaTest, only opaque
+ * pixels are drawn, otherwise pixels the mask hides are cleared. With clip,
+ * pixels outside the 496 pixel line are skipped.
+ */
+template <int bits, bool alphaTest, bool clip>
+inline void DrawTileLine(uint32_t *line, int pixelOffset, uint16_t tile, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask)
+{
+  static_assert(bits == 4 || bits == 8, "Tiles are either 4- or 8-bit");
+
+  // For 8-bit pixels, each line of tile pattern is two words
+  if (bits == 8)
+    patternLine *= 2;
+
+  // Compute offset of pattern for this line
+  int patternOffset;
+  if (bits == 4)
+  {
+    patternOffset = ((tile & 0x3FFF) << 1) | ((tile >> 15) & 1);
+    patternOffset *= 32;
+    patternOffset /= 4;
+  }
+  else
+  {
+    patternOffset = tile & 0x3FFF;
+    patternOffset *= 64;
+    patternOffset /= 4;
+  }
+
+  // Name table entry provides high color bits
+  uint32_t colorHi = tile & ((bits == 4) ? 0x7FF0 : 0x7F00);
+
+  // Draw
+  if (bits == 4)
+  {
+    uint32_t pattern = vram[patternOffset + patternLine];
+    for (int p = 7; p >= 0; p--)
+    {
+      if (!clip || (clip && pixelOffset >= 0 && pixelOffset < 496))
+      {
+        uint16_t maskTest = 1 << (15-((pixelOffset+0)/32));
+        bool visible = (mask & maskTest) != 0;
+        uint32_t pixel = palette[((pattern >> (p*4)) & 0xF) | colorHi];
+        if (alphaTest)
+        {
+          if (visible && (pixel >> 24) != 0)  // only draw opaque pixels
+            line[pixelOffset] = pixel;
+        }
+        else
+        {
+          if (visible)
+            line[pixelOffset] = pixel;
+          else
+            line[pixelOffset] = 0;
+        }
+      }
+      ++pixelOffset;
+    }
+  }
+  else
+  {
+    for (int i = 0; i < 2; i++) // 4 pixels per word
+    {
+      uint32_t pattern = vram[patternOffset + patternLine + i];
+      for (int p = 3; p >= 0; p--)
+      {
+        if (!clip || (clip && pixelOffset >= 0 && pixelOffset < 496))
+        {
+          uint16_t maskTest = 1 << (15-((pixelOffset+0)/32));
+          bool visible = (mask & maskTest) != 0;
+          uint32_t pixel = palette[((pattern >> (p*8)) & 0xFF) | colorHi];
+          if (alphaTest)
+          {
+            if (visible && (pixel >> 24) != 0)
+              line[pixelOffset] = pixel;
+          }
+          else
+          {
+            if (visible)
+              line[pixelOffset] = pixel;
+            else
+              line[pixelOffset] = 0;  // transparent
+          }
+        }
+        ++pixelOffset;
+      }
+    }
+  }
+}
+
+namespace TileLine
+{
+  /*
+   * DrawTiles(bits, alphaTest, line, pixelOffset, nameTable, hTile, count,
+   *           patternLine, vram, palette, mask):
+   *
+   * Draws count consecutive tiles of a layer line, none of them clipped. The
+   * result is the same as DrawTileLine<bits, alphaTest, false>() for each.
+   *
+   * Parameters:
+   *    bits        4 or 8 bits per pixel.
+   *    alphaTest   Only draw opaque pixels.
+   *    line        First pixel of the line.
+   *    pixelOffset Offset of the first tile's left pixel within the line.
+   *    nameTable   Name table row of the line.
+   *    hTile       Column of the first tile in the name table.
+   *    count       Number of tiles.
+   *    patternLine Line within the tiles (0-7).
+   *    vram        Tile generator RAM.
+   *    palette     Palette of the layer.
+   *    mask        Stencil mask of the line, flipped for alternate layers.
+   */
+  void DrawTiles(int bits, bool alphaTest, uint32_t *line, int pixelOffset, const uint16_t *nameTable, int hTile, int count, int patternLine, const uint32_t *vram, const uint32_t *palette, uint16_t mask);
+
+  /*
+   * GetImplementation():
+   * SetImplementation(name):
+   *
+   * The implementation in use: "avx2", "sse4.1", "neon" or "scalar". The best
+   * one the CPU supports is used unless another is set. SetImplementation()
+   * returns false if the CPU doesn't support the one named.
+   */
+  const char *GetImplementation(void);
+  bool SetImplementation(const char *name);
+}
+
+
+#endif  // INCLUDED_TILELINE_H
@@ -70,6 +70,14 @@ void CInput::CreateSource()
 			}
 		}
 	}
+
+	if (flags & INPUT_FLAGS_SWITCH)
+		m_switchProgram.Compile(m_source);
+}
+
+bool CInput::IsSourceOn()
+{
+	return m_system != NULL && m_switchProgram.Evaluate(m_system->GetPollNumber());
 }
 
 void CInput::Initialize(CInputSystem *system)
@@ -32,8 +32,8 @@
 #include "Types.h"
 #include "Game.h"
 #include "Util/NewConfig.h"
+#include "InputSource.h"
 
-class CInputSource;
 class CInputSystem;
 
 // Flags for inputs
@@ -76,6 +76,9 @@ private:
 	// Assigned input system
 	CInputSystem *m_system;
 
+	// Current input source compiled for reading as a switch (switch inputs only)
+	CSwitchProgram m_switchProgram;
+
 	/*
 	 * Creates an input source using the current input system and assigns it to this input.
 	 */
@@ -84,6 +87,11 @@ private:
 protected:
 	// Current input source
 	CInputSource *m_source;
+
+	/*
+	 * Returns whether the current input source is on, for switch inputs.
+	 */
+	bool IsSourceOn();
 	
 	/*
 	 * Constructs an input with the given identifier, label, flags, game flags, default mapping and initial value.
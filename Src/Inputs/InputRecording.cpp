@@ -0,0 +1,206 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * InputRecording.cpp
+ *
+ * Implementation of CInputRecording.
+ */
+
+#include "Supermodel.h"
+#include "Inputs/InputRecording.h"
+
+#include <cstring>
+
+static const char s_magic[8] = { 'S', 'M', 'I', 'N', 'P', 'U', 'T', '1' };
+
+static bool WriteString(FILE *file, const std::string &str)
+{
+	UINT8 length = UINT8(str.length() < 255 ? str.length() : 255);
+	return fwrite(&length, sizeof(length), 1, file) == 1 && (length == 0 || fwrite(str.data(), length, 1, file) == 1);
+}
+
+static bool ReadString(FILE *file, std::string *str)
+{
+	UINT8 length;
+	char buffer[256];
+	if (fread(&length, sizeof(length), 1, file) != 1 || (length > 0 && fread(buffer, length, 1, file) != 1))
+		return false;
+	str->assign(buffer, length);
+	return true;
+}
+
+CInputRecording::CInputRecording() : m_file(NULL), m_recording(false), m_frames(0)
+{
+	//
+}
+
+CInputRecording::~CInputRecording()
+{
+	Close();
+}
+
+void CInputRecording::Close()
+{
+	if (m_file != NULL)
+	{
+		if (m_recording)
+			InfoLog("Recorded %llu frames of inputs.", (unsigned long long) m_frames);
+		fclose(m_file);
+		m_file = NULL;
+	}
+	m_inputs.clear();
+}
+
+bool CInputRecording::Record(const std::string &file, CInputs *inputs, const Game &game)
+{
+	Close();
+	m_file = fopen(file.c_str(), "wb");
+	if (m_file == NULL)
+	{
+		ErrorLog("Unable to record inputs to '%s'.", file.c_str());
+		return FAIL;
+	}
+	m_recording = true;
+	m_frames = 0;
+
+	for (unsigned i = 0; i < inputs->Count(); i++)
+	{
+		CInput *input = (*inputs)[i];
+		if (!input->IsUIInput() && (input->gameFlags & game.inputs))
+			m_inputs.push_back(input);
+	}
+	m_values.resize(m_inputs.size());
+
+	UINT32 count = UINT32(m_inputs.size());
+	bool ok = fwrite(s_magic, sizeof(s_magic), 1, m_file) == 1 && WriteString(m_file, game.name) && fwrite(&count, sizeof(count), 1, m_file) == 1;
+	for (size_t i = 0; ok && i < m_inputs.size(); i++)
+		ok = WriteString(m_file, m_inputs[i]->id);
+	if (!ok)
+	{
+		ErrorLog("Unable to record inputs to '%s'.", file.c_str());
+		Close();
+		return FAIL;
+	}
+	InfoLog("Recording inputs to '%s'.", file.c_str());
+	return OKAY;
+}
+
+bool CInputRecording::Replay(const std::string &file, CInputs *inputs, const Game &game)
+{
+	Close();
+	m_file = fopen(file.c_str(), "rb");
+	if (m_file == NULL)
+	{
+		ErrorLog("Unable to read inputs from '%s'.", file.c_str());
+		return FAIL;
+	}
+	m_recording = false;
+	m_frames = 0;
+
+	char magic[sizeof(s_magic)];
+	std::string name;
+	UINT32 count;
+	if (fread(magic, sizeof(magic), 1, m_file) != 1 || memcmp(magic, s_magic, sizeof(magic)) != 0 ||
+		!ReadString(m_file, &name) || fread(&count, sizeof(count), 1, m_file) != 1)
+	{
+		ErrorLog("'%s' is not an input recording.", file.c_str());
+		Close();
+		return FAIL;
+	}
+	if (name != game.name)
+	{
+		ErrorLog("'%s' is a recording of %s, not %s.", file.c_str(), name.c_str(), game.name.c_str());
+		Close();
+		return FAIL;
+	}
+	for (UINT32 i = 0; i < count; i++)
+	{
+		std::string id;
+		if (!ReadString(m_file, &id))
+		{
+			ErrorLog("'%s' is not an input recording.", file.c_str());
+			Close();
+			return FAIL;
+		}
+		CInput *input = (*inputs)[id.c_str()];
+		if (input == NULL)
+			ErrorLog("Input %s in '%s' is unknown and will be ignored.", id.c_str(), file.c_str());
+		m_inputs.push_back(input);
+	}
+	m_values.resize(m_inputs.size());
+	m_lastValues.resize(m_inputs.size());
+	InfoLog("Replaying inputs from '%s'.", file.c_str());
+	return OKAY;
+}
+
+bool CInputRecording::Frame()
+{
+	if (m_file == NULL)
+		return false;
+
+	if (m_recording)
+	{
+		for (size_t i = 0; i < m_inputs.size(); i++)
+			m_values[i] = m_inputs[i]->value;
+		if (!m_values.empty() && fwrite(m_values.data(), sizeof(UINT16), m_values.size(), m_file) != m_values.size())
+		{
+			ErrorLog("Unable to write input recording; stopped after %llu frames.", (unsigned long long) m_frames);
+			Close();
+			return false;
+		}
+		m_frames++;
+		return true;
+	}
+
+	// Previous values are those played back the frame before, as they would have been when polled
+	if (!m_values.empty() && fread(m_values.data(), sizeof(UINT16), m_values.size(), m_file) != m_values.size())
+	{
+		InfoLog("Input replay ended after %llu frames.", (unsigned long long) m_frames);
+		Close();
+		return false;
+	}
+	for (size_t i = 0; i < m_inputs.size(); i++)
+	{
+		if (m_inputs[i] == NULL)
+			continue;
+		m_inputs[i]->prevValue = m_frames > 0 ? m_lastValues[i] : m_values[i];
+		m_inputs[i]->value = m_values[i];
+	}
+	m_lastValues.swap(m_values);
+	m_frames++;
+	return true;
+}
+
+bool CInputRecording::Recording() const
+{
+	return m_file != NULL && m_recording;
+}
+
+bool CInputRecording::Replaying() const
+{
+	return m_file != NULL && !m_recording;
+}
+
+UINT64 CInputRecording::Frames() const
+{
+	return m_frames;
+}
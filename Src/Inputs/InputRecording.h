@@ -0,0 +1,98 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * InputRecording.h
+ *
+ * Header file for CInputRecording, which records the game's inputs frame by
+ * frame and plays them back.
+ */
+
+#ifndef INCLUDED_INPUTRECORDING_H
+#define INCLUDED_INPUTRECORDING_H
+
+#include "Types.h"
+#include "Game.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class CInputs;
+class CInput;
+
+/*
+ * Records the values of the inputs a game uses (UI inputs are left out) once
+ * a frame, or overwrites them with values recorded earlier, so that a run can
+ * be repeated exactly.  Inputs are stored by id, so recordings still play back
+ * when inputs are added or reordered.
+ *
+ * The file holds a header (magic "SMINPUT1", game name, number of inputs and
+ * their ids) followed by one 16-bit value per input per frame, in host byte
+ * order.
+ */
+class CInputRecording
+{
+public:
+	CInputRecording();
+
+	~CInputRecording();
+
+	/*
+	 * Starts recording the inputs used by the game to the given file.
+	 * Returns FAIL if it could not be created.
+	 */
+	bool Record(const std::string &file, CInputs *inputs, const Game &game);
+
+	/*
+	 * Starts playing back the given file, which must have been recorded with
+	 * the same game.  Returns FAIL if it could not be read.
+	 */
+	bool Replay(const std::string &file, CInputs *inputs, const Game &game);
+
+	/*
+	 * To be called once a frame, after the inputs have been polled.  Records
+	 * their values, or sets them to the recorded ones.  Returns false once a
+	 * replay has run out of frames, after which the inputs are left as polled.
+	 */
+	bool Frame();
+
+	bool Recording() const;
+
+	bool Replaying() const;
+
+	/*
+	 * Number of frames recorded or played back so far.
+	 */
+	UINT64 Frames() const;
+
+private:
+	FILE *m_file;
+	bool m_recording;
+	std::vector<CInput *> m_inputs;  // in the order stored, NULL for those no longer known
+	std::vector<UINT16> m_values;
+	std::vector<UINT16> m_lastValues;  // played back the frame before
+	UINT64 m_frames;
+
+	void Close();
+};
+
+#endif	// INCLUDED_INPUTRECORDING_H
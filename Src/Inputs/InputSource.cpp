@@ -32,7 +32,7 @@
 #include <vector>
 using namespace std;
 
-CInputSource::CInputSource(ESourceType sourceType) : type(sourceType), m_acquired(0)
+CInputSource::CInputSource(ESourceType sourceType) : type(sourceType), m_switchPollNum(0), m_switchState(false), m_acquired(0)
 {
 	//
 }
@@ -131,7 +131,102 @@ bool CInputSource::IsActive()
 	return GetValueAsSwitch(boolVal);
 }
 
+void CInputSource::CompileSwitch(CSwitchProgram &program)
+{
+	program.AddSource(this);
+}
+
 bool CInputSource::SendForceFeedbackCmd(ForceFeedbackCmd ffCmd)
 {
 	return false;
+}
+
+/*
+ * CSwitchProgram
+ */
+CSwitchProgram::CSwitchProgram() : m_depth(0)
+{
+	//
+}
+
+void CSwitchProgram::Push()
+{
+	if (++m_depth > m_stack.size())
+		m_stack.resize(m_depth);
+}
+
+void CSwitchProgram::Compile(CInputSource *source)
+{
+	m_instrs.clear();
+	m_depth = 0;
+	if (source != NULL)
+		source->CompileSwitch(*this);
+	else
+		AddCombine(true, 0);
+}
+
+void CSwitchProgram::AddSource(CInputSource *source)
+{
+	Instr instr = { OpSource, 0, source };
+	m_instrs.push_back(instr);
+	Push();
+}
+
+void CSwitchProgram::AddNot()
+{
+	Instr instr = { OpNot, 0, NULL };
+	m_instrs.push_back(instr);
+}
+
+void CSwitchProgram::AddCombine(bool isOr, unsigned numArgs)
+{
+	Instr instr = { isOr ? OpOr : OpAnd, numArgs, NULL };
+	m_instrs.push_back(instr);
+	m_depth -= numArgs;
+	Push();
+}
+
+bool CSwitchProgram::Evaluate(unsigned pollNum)
+{
+	unsigned char *stack = m_stack.data();
+	unsigned top = 0;
+	for (vector<Instr>::const_iterator it = m_instrs.begin(); it != m_instrs.end(); it++)
+	{
+		switch (it->op)
+		{
+		case OpSource:
+			{
+				CInputSource *source = it->source;
+				if (source->m_switchPollNum != pollNum)
+				{
+					source->m_switchState = source->IsActive();
+					source->m_switchPollNum = pollNum;
+				}
+				stack[top++] = source->m_switchState;
+			}
+			break;
+		case OpNot:
+			stack[top - 1] = !stack[top - 1];
+			break;
+		case OpAnd:
+			{
+				top -= it->numArgs;
+				unsigned char on = it->numArgs > 0;
+				for (unsigned i = 0; i < it->numArgs; i++)
+					on &= stack[top + i];
+				stack[top++] = on;
+			}
+			break;
+		case OpOr:
+			{
+				top -= it->numArgs;
+				unsigned char on = 0;
+				for (unsigned i = 0; i < it->numArgs; i++)
+					on |= stack[top + i];
+				stack[top++] = on;
+			}
+			break;
+		}
+	}
+	return top > 0 && stack[top - 1];
 }
\ No newline at end of file
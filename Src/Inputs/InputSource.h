@@ -29,8 +29,10 @@
 #define INCLUDED_INPUTSOURCE_H
 
 #include <string>
+#include <vector>
 
 class CInputSystem;
+class CSwitchProgram;
 struct ForceFeedbackCmd;
 
 /*
@@ -50,6 +52,13 @@ enum ESourceType
  */
 class CInputSource
 {
+private:
+	friend class CSwitchProgram;
+
+	// Switch value as last read by a compiled switch mapping, and the poll it was read in
+	unsigned m_switchPollNum;
+	bool m_switchState;
+
 protected:
 	unsigned m_acquired;
 
@@ -102,10 +111,71 @@ public:
 	 */
 	virtual bool GetValueAsAnalog(int &val, int minVal, int offVal, int maxVal) = 0;
 
+	/*
+	 * Appends the instructions for reading this source as a switch to the given program.  By default the source is read
+	 * directly; sources that combine others override this to compile the sources they are made of instead.
+	 */
+	virtual void CompileSwitch(CSwitchProgram &program);
+
 	/*
 	 * Sends a force feedback command to the input source.
 	 */
 	virtual bool SendForceFeedbackCmd(ForceFeedbackCmd ffCmd);
 };
 
+/*
+ * A switch mapping (such as KEY_A,JOY1_BUTTON1+JOY1_BUTTON2) compiled to a flat list of instructions in postfix order, so that
+ * evaluating it does not walk the tree of combined sources through virtual calls.  The sources at its leaves are the ones the
+ * input system shares between all mappings (see CInputSystem::GetKeySource etc.) and each of them is read at most once per poll,
+ * however many mappings use it.
+ */
+class CSwitchProgram
+{
+private:
+	enum EOp
+	{
+		OpSource,
+		OpNot,
+		OpAnd,
+		OpOr
+	};
+
+	struct Instr
+	{
+		EOp op;
+		unsigned numArgs;       // for OpAnd and OpOr
+		CInputSource *source;   // for OpSource
+	};
+
+	std::vector<Instr> m_instrs;
+	std::vector<unsigned char> m_stack;
+	unsigned m_depth;
+
+	void Push();
+
+public:
+	CSwitchProgram();
+
+	/*
+	 * Compiles the given source, replacing the current program.  A NULL source compiles to a program that is always off.
+	 */
+	void Compile(CInputSource *source);
+
+	/*
+	 * Used by CInputSource::CompileSwitch to append instructions.  AddNot negates the last value and AddCombine replaces the last
+	 * numArgs values with whether any (isOr) or all of them are on, an empty combination being off.
+	 */
+	void AddSource(CInputSource *source);
+
+	void AddNot();
+
+	void AddCombine(bool isOr, unsigned numArgs);
+
+	/*
+	 * Returns whether the switch is on.  Sources are re-read only if they have not been read already during the given poll (see
+	 * CInputSystem::BeginInputPoll).
+	 */
+	bool Evaluate(unsigned pollNum);
+};
+
 #endif // INCLUDED_INPUTSOURCE_H
\ No newline at end of file
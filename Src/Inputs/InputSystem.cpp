@@ -413,11 +413,15 @@ const char *CInputSystem::GetDefaultAxisName(int axisNum)
 }
 
 CInputSystem::CInputSystem(const char *systemName)
-  : m_dispX(0),
+  : m_ffRate(0),
+    m_ffExit(false),
+    m_ffStats(),
+    m_dispX(0),
     m_dispY(0),
     m_dispW(0),
     m_dispH(0),
     m_grabMouse(false),
+    m_pollNum(0),
     name(systemName)
 {
   m_emptySource = new CMultiInputSource();
@@ -426,6 +430,8 @@ CInputSystem::CInputSystem(const char *systemName)
 
 CInputSystem::~CInputSystem()
 {
+  StopForceFeedback();
+
   m_emptySource->Release();
 
   ClearSettings();
@@ -1811,6 +1817,18 @@ Finish:
   return !cancelled;
 }
 
+void CInputSystem::BeginInputPoll()
+{
+  // Sources start out read in poll zero, which is skipped when wrapping around
+  if (++m_pollNum == 0)
+    m_pollNum = 1;
+}
+
+unsigned CInputSystem::GetPollNumber() const
+{
+  return m_pollNum;
+}
+
 void CInputSystem::GrabMouse()
 {
   m_grabMouse = true;
@@ -1829,7 +1847,99 @@ bool CInputSystem::SendForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCm
   const JoyDetails *joyDetails = GetJoyDetails(joyNum);
   if (!joyDetails->hasFFeedback || !joyDetails->axisHasFF[axisNum])
     return false;
-  return ProcessForceFeedbackCmd(joyNum, axisNum, ffCmd);
+
+  PendingForceFeedbackCmd pending = { joyNum, axisNum, ffCmd, std::chrono::steady_clock::now() };
+
+  std::unique_lock<std::mutex> lock(m_ffMutex);
+  if (m_ffRate == 0 || m_ffExit)
+  {
+    lock.unlock();
+    ProcessQueuedForceFeedbackCmd(pending);
+    return true;
+  }
+
+  // Replace any command not yet sent for the same effect, or for any effect if stopping them all. The replacement
+  // goes to the back of the queue, keeping commands for different effects in the order they were made.
+  for (auto it = m_ffPending.begin(); it != m_ffPending.end(); )
+  {
+    if (it->joyNum == joyNum && it->axisNum == axisNum && (it->ffCmd.id == ffCmd.id || ffCmd.id == FFStop))
+    {
+      if (it->queued < pending.queued)
+        pending.queued = it->queued;
+      it = m_ffPending.erase(it);
+      m_ffStats.replaced++;
+    }
+    else
+      ++it;
+  }
+  m_ffPending.push_back(pending);
+
+  if (!m_ffThread.joinable())
+    m_ffThread = std::thread(&CInputSystem::RunForceFeedbackThread, this);
+  lock.unlock();
+  m_ffCond.notify_one();
+  return true;
+}
+
+void CInputSystem::ProcessQueuedForceFeedbackCmd(const PendingForceFeedbackCmd &pending)
+{
+  auto start = std::chrono::steady_clock::now();
+  ProcessForceFeedbackCmd(pending.joyNum, pending.axisNum, pending.ffCmd);
+  auto end = std::chrono::steady_clock::now();
+
+  double latency = std::chrono::duration<double>(end - pending.queued).count();
+  double callTime = std::chrono::duration<double>(end - start).count();
+
+  std::lock_guard<std::mutex> lock(m_ffMutex);
+  m_ffStats.sent++;
+  m_ffStats.totalLatency += latency;
+  m_ffStats.maxLatency = std::max(m_ffStats.maxLatency, latency);
+  m_ffStats.maxCallTime = std::max(m_ffStats.maxCallTime, callTime);
+}
+
+void CInputSystem::RunForceFeedbackThread()
+{
+  std::vector<PendingForceFeedbackCmd> sending;
+  std::unique_lock<std::mutex> lock(m_ffMutex);
+  for (;;)
+  {
+    m_ffCond.wait(lock, [this] { return m_ffExit || !m_ffPending.empty(); });
+    if (m_ffPending.empty())
+      return;
+
+    // Send everything queued, then leave commands to gather until the next period
+    sending.swap(m_ffPending);
+    auto next = std::chrono::steady_clock::now() + std::chrono::microseconds(1000000 / std::max(m_ffRate, 1u));
+    lock.unlock();
+    for (const PendingForceFeedbackCmd &pending : sending)
+      ProcessQueuedForceFeedbackCmd(pending);
+    sending.clear();
+    lock.lock();
+    m_ffCond.wait_until(lock, next, [this] { return m_ffExit; });
+  }
+}
+
+void CInputSystem::SetForceFeedbackRate(unsigned rate)
+{
+  std::lock_guard<std::mutex> lock(m_ffMutex);
+  m_ffRate = rate;
+}
+
+void CInputSystem::StopForceFeedback()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_ffMutex);
+    m_ffExit = true;
+  }
+  m_ffCond.notify_one();
+  if (m_ffThread.joinable())
+    m_ffThread.join();
+}
+
+ForceFeedbackStats CInputSystem::GetForceFeedbackStats()
+{
+  std::lock_guard<std::mutex> lock(m_ffMutex);
+  return m_ffStats;
 }
 
 bool CInputSystem::DetectJoystickAxis(unsigned joyNum, unsigned &axisNum, const char *escapeMapping, const char *confirmMapping)
@@ -29,9 +29,14 @@
 #ifndef INCLUDED_INPUTSYSTEM_H
 #define INCLUDED_INPUTSYSTEM_H
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
+#include "Input.h"
 #include "MultiInputSource.h"
 #include "Util/NewConfig.h"
 
@@ -314,6 +319,15 @@ struct JoyDetails
   bool axisHasFF[NUM_JOY_AXES];                     // Flags to indicate which axes are force feedback enabled
 };
 
+struct ForceFeedbackStats
+{
+  UINT64 sent;          // Commands sent to devices
+  UINT64 replaced;      // Commands replaced by later ones before being sent
+  double totalLatency;  // Sum over commands sent of seconds from being queued to the device accepting them
+  double maxLatency;    // Longest of those, in seconds
+  double maxCallTime;   // Longest time taken by the device to accept a command, in seconds
+};
+
 /*
  * Abstract base class that represents an input system.  An input system encapsulates all the O/S dependent code to read keyboards, 
  * mice and joysticks.
@@ -360,6 +374,23 @@ private:
   // Empty input source
   CMultiInputSource *m_emptySource;
 
+  // Force feedback commands waiting to be sent, at most one per joystick, axis and effect (the latest), and the thread
+  // that sends them
+  struct PendingForceFeedbackCmd
+  {
+    int joyNum;
+    int axisNum;
+    ForceFeedbackCmd ffCmd;
+    std::chrono::steady_clock::time_point queued;   // when first queued since last sent
+  };
+  std::vector<PendingForceFeedbackCmd> m_ffPending;
+  unsigned m_ffRate;
+  bool m_ffExit;
+  std::thread m_ffThread;
+  std::mutex m_ffMutex;
+  std::condition_variable m_ffCond;
+  ForceFeedbackStats m_ffStats;
+
   //
   // Helper methods
   //
@@ -369,6 +400,16 @@ private:
    */
   void CreateSourceCache();
 
+  /*
+   * Sends queued force feedback commands to the devices at most m_ffRate times a second.
+   */
+  void RunForceFeedbackThread();
+
+  /*
+   * Calls ProcessForceFeedbackCmd for a command and updates the force feedback statistics.
+   */
+  void ProcessQueuedForceFeedbackCmd(const PendingForceFeedbackCmd &pending);
+
   /*
    * Clears cache of all sources and optionally deletes cache itself.
    */
@@ -525,6 +566,9 @@ protected:
   // Flag to indicate if system has grabbed mouse
   bool m_grabMouse;
 
+  // Current poll number (see BeginInputPoll), zero until the inputs are first polled
+  unsigned m_pollNum;
+
   /*
    * Constructs an input system with the given name.
    */
@@ -841,6 +885,14 @@ public:
    */
   virtual bool Poll() = 0;
 
+  /*
+   * Starts a new poll number once the system has been polled, before the inputs are (called by CInputs.Poll).  Compiled switch
+   * mappings read each source once per poll number.
+   */
+  void BeginInputPoll();
+
+  unsigned GetPollNumber() const;
+
   virtual void GrabMouse();
 
   virtual void UngrabMouse();
@@ -850,8 +902,30 @@ public:
    */
   virtual void SetMouseVisibility(bool visible) = 0;
 
+  /*
+   * Sends a force feedback command to the given joystick and axis. Unless the rate set by SetForceFeedbackRate is 0,
+   * commands are queued and sent from a thread of their own, since some devices take milliseconds to accept them, and
+   * a command replaces any not yet sent for the same joystick, axis and effect (a stop replacing all for that axis).
+   */
   virtual bool SendForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCmd ffCmd);
 
+  /*
+   * Sets how many times a second queued force feedback commands are sent, 0 to send each one straight away instead.
+   */
+  void SetForceFeedbackRate(unsigned rate);
+
+  /*
+   * Sends any force feedback commands still queued and stops the thread sending them. Subclasses must call this in their
+   * destructor before closing their devices.
+   */
+  void StopForceFeedback();
+
+  /*
+   * Returns the number of force feedback commands sent and replaced so far, and the time taken from the emulated
+   * board's command to the device accepting it.
+   */
+  ForceFeedbackStats GetForceFeedbackStats();
+
   bool DetectJoystickAxis(unsigned joyNum, unsigned &axisNum, const char *escapeMapping = "KEY_ESCAPE", const char *confirmMapping = "KEY_RETURN");
 
   bool CalibrateJoystickAxis(unsigned joyNum, unsigned axisNum, const char *escapeMapping = "KEY_ESCAPE", const char *confirmMapping = "KEY_RETURN");
@@ -41,11 +41,7 @@ void CSwitchInput::Poll()
 {
 	prevValue = value;
 
-	bool boolValue = !!value;
-	if (m_source != NULL && m_source->GetValueAsSwitch(boolValue))
-		value = (boolValue ? m_onVal : m_offVal);
-	else
-		value = m_offVal;
+	value = (IsSourceOn() ? m_onVal : m_offVal);
 }
 
 bool CSwitchInput::Pressed()
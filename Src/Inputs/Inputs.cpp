@@ -56,9 +56,16 @@ CInputs::CInputs(CInputSystem *system)
 	uiClearNVRAM       = AddSwitchInput("UIClearNVRAM",       "Clear NVRAM",           Game::INPUT_UI, "KEY_ALT+KEY_N");
 	uiSelectCrosshairs = AddSwitchInput("UISelectCrosshairs", "Select Crosshairs",     Game::INPUT_UI, "KEY_ALT+KEY_I");
 	uiToggleFrLimit    = AddSwitchInput("UIToggleFrameLimit", "Toggle Frame Limiting", Game::INPUT_UI, "KEY_ALT+KEY_T");
+	uiToggleTimings    = AddSwitchInput("UIToggleTimings",    "Toggle Timing Overlay", Game::INPUT_UI, "KEY_ALT+KEY_Y");
 	uiDumpInpState     = AddSwitchInput("UIDumpInputState",   "Dump Input State",      Game::INPUT_UI, "KEY_ALT+KEY_U");
 	uiDumpTimings      = AddSwitchInput("UIDumpTimings",      "Dump Frame Timings",    Game::INPUT_UI, "KEY_ALT+KEY_O");
+	uiDumpPPCProfile   = AddSwitchInput("UIDumpPPCProfile",   "Dump PowerPC Profile",  Game::INPUT_UI, "KEY_ALT+KEY_H");
+	uiDumpCPUTrace     = AddSwitchInput("UIDumpCPUTrace",     "Dump CPU Trace",        Game::INPUT_UI, "KEY_ALT+KEY_K");
 	uiScreenshot       = AddSwitchInput("UIScreenShot",	      "Screenshot",            Game::INPUT_UI, "KEY_ALT+KEY_S");
+	uiRecordVideo      = AddSwitchInput("UIRecordVideo",      "Toggle Video Recording", Game::INPUT_UI, "KEY_ALT+KEY_V");
+	uiCaptureGPUFrame  = AddSwitchInput("UICaptureGPUFrame",  "Capture GPU Frame",     Game::INPUT_UI, "KEY_ALT+KEY_G");
+	uiRewind           = AddSwitchInput("UIRewind",           "Rewind (Hold)",         Game::INPUT_UI, "KEY_BACKSPACE");
+	uiFastForward      = AddSwitchInput("UIFastForward",      "Fast Forward (Hold)",   Game::INPUT_UI, "KEY_TAB");
 #ifdef SUPERMODEL_DEBUGGER
 	uiEnterDebugger    = AddSwitchInput("UIEnterDebugger",    "Enter Debugger",        Game::INPUT_UI, "KEY_ALT+KEY_B");
 #endif
@@ -742,6 +749,7 @@ bool CInputs::Poll(const Game *game, unsigned dispX, unsigned dispY, unsigned di
 	// Poll the input system
 	if (!m_system->Poll())
 		return false;
+	m_system->BeginInputPoll();
 
 	// Poll all UI inputs and all the inputs used by the current game, or all inputs if game is NULL
 	uint32_t gameFlags = game ? game->inputs : Game::INPUT_ALL;
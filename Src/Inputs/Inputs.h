@@ -103,9 +103,16 @@ public:
   CSwitchInput  *uiClearNVRAM;
   CSwitchInput  *uiSelectCrosshairs;
   CSwitchInput  *uiToggleFrLimit;
+  CSwitchInput  *uiToggleTimings;
   CSwitchInput  *uiDumpInpState;
   CSwitchInput  *uiDumpTimings;
+  CSwitchInput  *uiDumpPPCProfile;
+  CSwitchInput  *uiDumpCPUTrace;
   CSwitchInput  *uiScreenshot;
+  CSwitchInput  *uiRecordVideo;
+  CSwitchInput  *uiCaptureGPUFrame;
+  CSwitchInput  *uiRewind;
+  CSwitchInput  *uiFastForward;
 #ifdef SUPERMODEL_DEBUGGER
   CSwitchInput  *uiEnterDebugger;
 #endif
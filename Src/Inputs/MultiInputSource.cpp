@@ -163,6 +163,13 @@ bool CMultiInputSource::GetValueAsAnalog(int &val, int minVal, int offVal, int m
 	}
 }
 
+void CMultiInputSource::CompileSwitch(CSwitchProgram &program)
+{
+	for (int i = 0; i < m_numSrcs; i++)
+		m_srcArray[i]->CompileSwitch(program);
+	program.AddCombine(m_isOr, m_numSrcs);
+}
+
 bool CMultiInputSource::SendForceFeedbackCmd(ForceFeedbackCmd ffCmd)
 {
 	bool result = false;
@@ -217,4 +224,10 @@ bool CNegInputSource::GetValueAsAnalog(int &val, int minVal, int offVal, int max
 	}
 	val = maxVal;
 	return true;
+}
+
+void CNegInputSource::CompileSwitch(CSwitchProgram &program)
+{
+	m_source->CompileSwitch(program);
+	program.AddNot();
 }
\ No newline at end of file
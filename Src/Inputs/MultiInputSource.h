@@ -80,6 +80,8 @@ public:
 
 	bool GetValueAsAnalog(int &val, int minVal, int offVal, int maxVal);	
 
+	void CompileSwitch(CSwitchProgram &program);
+
 	bool SendForceFeedbackCmd(ForceFeedbackCmd ffCmd);
 };
 
@@ -104,6 +106,8 @@ public:
 	bool GetValueAsSwitch(bool &val);
 
 	bool GetValueAsAnalog(int &val, int minVal, int offVal, int maxVal);
+
+	void CompileSwitch(CSwitchProgram &program);
 };
 
 #endif	// INCLUDED_MULTIINPUTSOURCE_H
\ No newline at end of file
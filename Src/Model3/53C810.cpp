@@ -121,15 +121,23 @@ static bool SCRIPTS_MoveMemory(struct NCR53C810Context *Ctx)
   numBytes = Ctx->regDBC;
   // Not implemented: illegal instruction interrupt when src and dest are not aligned the same way
 
-  DebugLog("53C810: Move Memory %08X -> %08X, %X\n", src, dest, numBytes);
+  DEBUG_LOG(Model3, "53C810: Move Memory %08X -> %08X, %X\n", src, dest, numBytes);
   //if (dest==0x94000000)printf("53C810: Move Memory %08X -> %08X, %X\n", src, dest, numBytes);    
 
-  // Perform a 32-bit copy if possible
-  for (i = 0; i < (numBytes/4); i++)
+  // Perform a 32-bit copy if possible, in one go if the bus can
+  if (!(src&3) && !(dest&3) && Ctx->Bus->CopyBlock(dest, src, numBytes & ~3))
   {
-    Ctx->Bus->Write32(dest, Ctx->Bus->Read32(src));
-    dest += 4;
-    src += 4;
+    dest += numBytes & ~3;
+    src += numBytes & ~3;
+  }
+  else
+  {
+    for (i = 0; i < (numBytes/4); i++)
+    {
+      Ctx->Bus->Write32(dest, Ctx->Bus->Read32(src));
+      dest += 4;
+      src += 4;
+    }
   }
 
   // Finish off the last few odd bytes
@@ -152,14 +160,13 @@ static bool SCRIPTS_MoveMemory(struct NCR53C810Context *Ctx)
 // Invalid instruction handler
 static bool SCRIPTS_Invalid(struct NCR53C810Context *Ctx)
 {
-  DebugLog("53C810 encountered an unrecognized instruction (%02X%06X, DSP=%08X)\n!", Ctx->regDCMD, Ctx->regDBC, Ctx->regDSP);
+  DEBUG_LOG(Model3, "53C810 encountered an unrecognized instruction (%02X%06X, DSP=%08X)\n!", Ctx->regDCMD, Ctx->regDBC, Ctx->regDSP);
   return FAIL;
 }
 
 void C53C810::Run(bool singleStep)
 {
   UINT32  op;
-  int   i;
   
   if (singleStep)// && !Ctx.halt)
   {
@@ -176,12 +183,13 @@ void C53C810::Run(bool singleStep)
     Ctx.regISTAT |= 1;            // DMA interrupt pending
     Ctx.regDSTAT |= 8;            // single step interrupt
     Ctx.IRQ->Assert(Ctx.scsiIRQ); // generate an interrupt
-    DebugLog("53C810: Asserted IRQ\n");
+    DEBUG_LOG(Model3, "53C810: Asserted IRQ\n");
   }
   else
   {
-    // Automatic mode: run (as long as the processor is not halted)
-    for (i = 0; (i < 100) && !Ctx.halt; i++)
+    // Automatic mode: run until the processor halts or hits an instruction it
+    // cannot execute
+    while (!Ctx.halt)
     {
       // Fetch instruction (first two words are always fetched)
       op = Fetch(&Ctx, 0);          // word 1
@@ -228,7 +236,7 @@ void C53C810::WriteRegister(unsigned reg, UINT8 data)
     return;
   }
   
-  DebugLog("53C810 write: %02X=%02X (PC=%08X, LR=%08X)\n", reg, data, ppc_get_pc(), ppc_get_lr());
+  DEBUG_LOG(Model3, "53C810 write: %02X=%02X (PC=%08X, LR=%08X)\n", reg, data, ppc_get_pc(), ppc_get_lr());
   
   // Dump everything into the register file
   Ctx.regs[reg&0xFF] = data;
@@ -239,7 +247,7 @@ void C53C810::WriteRegister(unsigned reg, UINT8 data)
   {
   case 0x14:    // ISTAT
     Ctx.regISTAT = data;
-    DebugLog("ISTAT=%02X\n", data);
+    DEBUG_LOG(Model3, "ISTAT=%02X\n", data);
     break;
   case 0x1C:    // TEMP 7-0
     Ctx.regTEMP &= 0xFFFFFF00;
@@ -292,7 +300,7 @@ void C53C810::WriteRegister(unsigned reg, UINT8 data)
     // To-Do: is this correct? Should single step really be tested first?
     //if (!(Ctx.regDCNTL&0x10) && !(Ctx.regDMODE&1))  // if MAN=0 and not single stepping, start SCRIPTS automatically
     {
-      DebugLog("53C810: Automatically starting (PC=%08X, LR=%08X, single step=%d)\n", ppc_get_pc(), ppc_get_lr(), !!(Ctx.regDCNTL&0x10));
+      DEBUG_LOG(Model3, "53C810: Automatically starting (PC=%08X, LR=%08X, single step=%d)\n", ppc_get_pc(), ppc_get_lr(), !!(Ctx.regDCNTL&0x10));
       Run(false);       // automatic
     }
     break;  
@@ -319,12 +327,12 @@ void C53C810::WriteRegister(unsigned reg, UINT8 data)
     Ctx.regDCNTL = data;
     if ((Ctx.regDCNTL&0x14) == 0x14)    // single step
     {
-      DebugLog("53C810: single step: %08X, (halt=%d)\n", Ctx.regDSP, Ctx.halt);
+      DEBUG_LOG(Model3, "53C810: single step: %08X, (halt=%d)\n", Ctx.regDSP, Ctx.halt);
       Run(true);
     }
     else if ((Ctx.regDCNTL&0x04))     // start DMA bit
     {
-      DebugLog("53C810: Manually starting\n");
+      DEBUG_LOG(Model3, "53C810: Manually starting\n");
       Run(false);
     }
     break;
@@ -343,7 +351,7 @@ UINT8 C53C810::ReadRegister(unsigned reg)
     return 0;
   }
   
-  DebugLog("53C810 read: %02X (PC=%08X, LR=%08X)\n", reg, ppc_get_pc(), ppc_get_lr());
+  DEBUG_LOG(Model3, "53C810 read: %02X (PC=%08X, LR=%08X)\n", reg, ppc_get_pc(), ppc_get_lr());
   
   // Some registers require special handling
   switch(reg)
@@ -412,7 +420,7 @@ UINT32 C53C810::ReadPCIConfigSpace(unsigned device, unsigned reg, unsigned bits,
   
   if ((bits==8))
   {
-    DebugLog("53C810 %d-bit PCI read request for reg=%02X\n", bits, reg);
+    DEBUG_LOG(Model3, "53C810 %d-bit PCI read request for reg=%02X\n", bits, reg);
     return 0;
   }
   
@@ -435,7 +443,7 @@ UINT32 C53C810::ReadPCIConfigSpace(unsigned device, unsigned reg, unsigned bits,
     }
     return d;
   default:
-    DebugLog("53C810 PCI read request for reg=%02X (%d-bit)\n", reg, bits);
+    DEBUG_LOG(Model3, "53C810 PCI read request for reg=%02X (%d-bit)\n", reg, bits);
     break;
   }
 
@@ -444,7 +452,7 @@ UINT32 C53C810::ReadPCIConfigSpace(unsigned device, unsigned reg, unsigned bits,
   
 void C53C810::WritePCIConfigSpace(unsigned device, unsigned reg, unsigned bits, unsigned offset, UINT32 data)
 {
-  DebugLog("53C810 PCI %d-bit write request for reg=%02X, data=%08X\n", bits, reg, data);
+  DEBUG_LOG(Model3, "53C810 PCI %d-bit write request for reg=%02X, data=%08X\n", bits, reg, data);
 }
 
 void C53C810::Reset(void)
@@ -470,7 +478,7 @@ void C53C810::Reset(void)
   Ctx.regISTAT = 0;
   Ctx.halt = false;
   
-  DebugLog("53C810 reset\n");
+  DEBUG_LOG(Model3, "53C810 reset\n");
 }
 
 
@@ -491,12 +499,12 @@ C53C810::C53C810(void)
   Ctx.Bus = NULL;
   Ctx.IRQ = NULL;
   scsiIRQ = 0;
-  DebugLog("Built 53C810\n");
+  DEBUG_LOG(Model3, "Built 53C810\n");
 }
 
 C53C810::~C53C810(void)
 { 
   Ctx.Bus = NULL;
   Ctx.IRQ = NULL;
-  DebugLog("Destroyed 53C810\n");
+  DEBUG_LOG(Model3, "Destroyed 53C810\n");
 }
@@ -140,24 +140,24 @@ void C93C46::Write(unsigned pinCS, unsigned pinCLK, unsigned pinDI)
 				//bitBufferOut <<= 1;	// a leading 0 precedes the first word read (causes problems)
 				bitsOut = 0;		// how many bits read out
 				receiving = false;	// transmitting data now
-				DebugLog("93C46: READ %X\n", addr);
+				DEBUG_LOG(Model3, "93C46: READ %X\n", addr);
 			}
 			else if (bitBufferIn == 0x13)						// WEN (write enable)
 			{
 				locked = false;
-				DebugLog("93C46: WEN\n");
+				DEBUG_LOG(Model3, "93C46: WEN\n");
 			}
 			else if (bitBufferIn == 0x10)						// WDS (write disable)
 			{
 				locked = true;
-				DebugLog("93C46: WDS\n");
+				DEBUG_LOG(Model3, "93C46: WDS\n");
 			}
 			else if ((bitBufferIn&0xFFC00000) == 0x01400000)	// WRITE
 			{
 				if (!locked)
 					regs[(bitBufferIn>>16)&0x3F] = bitBufferIn&0xFFFF;
 				DO = 1;	// ready (write completed)
-				DebugLog("93C46: WRITE %X=%04X (lock=%d)\n", (bitBufferIn>>16)&0x3F, bitBufferIn&0xFFFF, locked);
+				DEBUG_LOG(Model3, "93C46: WRITE %X=%04X (lock=%d)\n", (bitBufferIn>>16)&0x3F, bitBufferIn&0xFFFF, locked);
 			}
 			else if ((bitBufferIn&0xFFF00000) == 0x01100000)	// WRALL (write all)
 			{
@@ -167,14 +167,14 @@ void C93C46::Write(unsigned pinCS, unsigned pinCLK, unsigned pinDI)
 						regs[i] = bitBufferIn&0xFFFF;
 				}
 				DO = 1;
-				DebugLog("93C46: WRALL %04X (lock=%d)\n", bitBufferIn&0xFFFF, locked);
+				DEBUG_LOG(Model3, "93C46: WRALL %04X (lock=%d)\n", bitBufferIn&0xFFFF, locked);
 			}
 			else if ((bitBufferIn&0xFFFFFFC0) == 0x1C0)			// ERASE
 			{
 				if (!locked)
 					regs[bitBufferIn&0x3F] = 0xFFFF;
 				DO = 1;
-				DebugLog("93C46: ERASE %X (lock=%d)\n", bitBufferIn&0x3F, locked);
+				DEBUG_LOG(Model3, "93C46: ERASE %X (lock=%d)\n", bitBufferIn&0x3F, locked);
 			}
 			else if ((bitBufferIn&0xFFFFFFF0) == 0x120)			// ERALL (erase all)
 			{
@@ -182,7 +182,7 @@ void C93C46::Write(unsigned pinCS, unsigned pinCLK, unsigned pinDI)
 				{
 					for (int i = 0; i < 64; i++)
 						regs[i] = 0xFFFF;
-					DebugLog("93C46: ERALL (lock=%d)\n", locked);
+					DEBUG_LOG(Model3, "93C46: ERALL (lock=%d)\n", locked);
 				}
 				DO = 1;
 			}
@@ -201,7 +201,7 @@ void C93C46::Write(unsigned pinCS, unsigned pinCLK, unsigned pinDI)
 				bitBufferOut = ReverseBits16(regs[addr]);
 				bitsOut = 0;
 				
-				DebugLog("93C46: Next word loaded: %X\n", addr);
+				DEBUG_LOG(Model3, "93C46: Next word loaded: %X\n", addr);
 			}
 		}
 	} 
@@ -254,10 +254,10 @@ void C93C46::Init(void)
 C93C46::C93C46(void)
 {	
 	memset(regs, 0xFF, sizeof(regs));	
-	DebugLog("Built 93C46 EEPROM\n");
+	DEBUG_LOG(Model3, "Built 93C46 EEPROM\n");
 }
 
 C93C46::~C93C46(void)
 {	
-	DebugLog("Destroyed 93C46 EEPROM\n");
+	DEBUG_LOG(Model3, "Destroyed 93C46 EEPROM\n");
 }
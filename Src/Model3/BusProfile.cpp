@@ -0,0 +1,252 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2017 Bart Trzynadlowski, Nik Henson, Ian Curtis
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * BusProfile.cpp
+ *
+ * Counts of main board bus accesses by region, see BusProfile.h. The address
+ * decoding must follow CModel3::Read8() through Write64().
+ */
+
+#include "Supermodel.h"
+#include "Model3/BusProfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BUSPROFILE_RDTSC
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BUSPROFILE_RDTSC
+#endif
+
+static const char *s_regionNames[CBusProfile::NumRegions] =
+{
+  "RAM",
+  "CROM",
+  "CROM bank",
+  "Real3D registers",
+  "Real3D culling RAM",
+  "Real3D polygon RAM",
+  "Real3D textures",
+  "Real3D DMA",
+  "Inputs",
+  "Sound",
+  "Backup RAM",
+  "System registers",
+  "RTC",
+  "Security",
+  "Tile generator",
+  "PCI (MPC10x)",
+  "53C810 SCSI",
+  "Net board",
+  "Unmapped"
+};
+
+static int64_t NowNanos(void)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char *CBusProfile::RegionName(Region region)
+{
+  return s_regionNames[region];
+}
+
+CBusProfile::Region CBusProfile::Classify(uint32_t addr, bool netBoard)
+{
+  if (addr < 0x00800000)
+    return RAM;
+
+  switch (addr >> 24)
+  {
+  case 0xFF:
+    return addr < 0xFF800000 ? CROMBank : CROM;
+  case 0x84:
+  case 0x88:
+  case 0x9C:
+    return Real3DRegisters;
+  case 0x8C:
+  case 0x8E:
+    return Real3DCullingRAM;
+  case 0x90:
+  case 0x94:
+    return Real3DTexture;
+  case 0x98:
+    return Real3DPolygonRAM;
+  case 0xC2:
+    return Real3DDMA;
+  case 0xC0:
+    return netBoard ? NetBoard : SCSI;
+  case 0xC1:
+  case 0xF9:
+    return SCSI;
+  case 0xF1:
+    return TileGen;
+  case 0xF8:
+    return PCI;
+  case 0xF0:
+  case 0xFE:  // mirror
+    switch ((addr >> 16) & 0xFF)
+    {
+    case 0x04:
+      return Inputs;
+    case 0x08:
+      return Sound;
+    case 0x0C:
+    case 0x0D:
+      return BackupRAM;
+    case 0x10:
+      return SystemRegisters;
+    case 0x14:
+      return RTC;
+    case 0x18:
+    case 0x19:
+    case 0x1A:
+      return Security;
+    default:
+      if (((addr >> 16) & 0xFF) == 0x80 || ((addr >> 16) & 0xFF) >= 0xC0)
+        return PCI;
+      return Unmapped;
+    }
+  default:
+    return Unmapped;
+  }
+}
+
+void CBusProfile::SetNetBoard(bool netBoard)
+{
+  m_netBoard = netBoard;
+}
+
+void CBusProfile::Count(Region region, bool write, uint64_t ticks)
+{
+  Counts &counts = m_frame[region];
+  if (write)
+    counts.writes++;
+  else
+    counts.reads++;
+  counts.ticks += ticks;
+}
+
+void CBusProfile::EndFrame(void)
+{
+  for (int i = 0; i < NumRegions; i++)
+  {
+    m_total[i].reads += m_frame[i].reads;
+    m_total[i].writes += m_frame[i].writes;
+    m_total[i].ticks += m_frame[i].ticks;
+  }
+  memcpy(m_lastFrame, m_frame, sizeof(m_frame));
+  memset(m_frame, 0, sizeof(m_frame));
+  m_frames++;
+}
+
+uint64_t CBusProfile::Ticks(void)
+{
+#ifdef BUSPROFILE_RDTSC
+  return __rdtsc();
+#else
+  return uint64_t(NowNanos());
+#endif
+}
+
+double CBusProfile::NanosPerTick(void) const
+{
+#ifdef BUSPROFILE_RDTSC
+  // Calibrated against the steady clock over the whole run
+  uint64_t ticks = Ticks() - m_startTicks;
+  int64_t nanos = NowNanos() - m_startNanos;
+  return ticks > 0 ? double(nanos) / double(ticks) : 0.0;
+#else
+  return 1.0;
+#endif
+}
+
+unsigned CBusProfile::SortRegions(const Counts counts[NumRegions], int order[NumRegions])
+{
+  // Busiest first by host time, leaving out regions never accessed
+  unsigned n = 0;
+  for (int i = 0; i < NumRegions; i++)
+  {
+    if (counts[i].reads + counts[i].writes > 0)
+      order[n++] = i;
+  }
+  std::stable_sort(order, order + n, [counts](int a, int b) { return counts[a].ticks > counts[b].ticks; });
+  return n;
+}
+
+std::string CBusProfile::FrameSummary(unsigned top) const
+{
+  int order[NumRegions];
+  unsigned n = std::min(top, SortRegions(m_lastFrame, order));
+  double nanosPerTick = NanosPerTick();
+  std::string summary;
+  for (unsigned i = 0; i < n; i++)
+  {
+    const Counts &counts = m_lastFrame[order[i]];
+    char buf[128];
+    sprintf(buf, " %s:%llu/%llu %1.2fms", s_regionNames[order[i]], (unsigned long long) counts.reads, (unsigned long long) counts.writes, counts.ticks * nanosPerTick / 1e6);
+    summary += buf;
+  }
+  return summary;
+}
+
+void CBusProfile::Report(unsigned top) const
+{
+  if (m_frames == 0)
+    return;
+
+  int order[NumRegions];
+  unsigned n = std::min(top, SortRegions(m_total, order));
+  double nanosPerTick = NanosPerTick();
+  uint64_t allTicks = 0;
+  for (int i = 0; i < NumRegions; i++)
+    allTicks += m_total[i].ticks;
+
+  printf("Bus accesses over %llu frames (per frame):\n", (unsigned long long) m_frames);
+  printf("  %-20s %10s %10s %10s %6s\n", "Region", "Reads", "Writes", "Host us", "Time");
+  InfoLog("Bus accesses over %llu frames (per frame):", (unsigned long long) m_frames);
+  for (unsigned i = 0; i < n; i++)
+  {
+    const Counts &counts = m_total[order[i]];
+    double reads = double(counts.reads) / m_frames;
+    double writes = double(counts.writes) / m_frames;
+    double micros = counts.ticks * nanosPerTick / 1e3 / m_frames;
+    double share = allTicks ? 100.0 * counts.ticks / allTicks : 0.0;
+    printf("  %-20s %10.0f %10.0f %10.1f %5.1f%%\n", s_regionNames[order[i]], reads, writes, micros, share);
+    InfoLog("  %s: %.0f reads, %.0f writes, %.1f us (%.1f%%).", s_regionNames[order[i]], reads, writes, micros, share);
+  }
+}
+
+CBusProfile::CBusProfile(void)
+  : m_depth(0),
+    m_netBoard(false),
+    m_frames(0),
+    m_startTicks(Ticks()),
+    m_startNanos(NowNanos())
+{
+  memset(m_frame, 0, sizeof(m_frame));
+  memset(m_lastFrame, 0, sizeof(m_lastFrame));
+  memset(m_total, 0, sizeof(m_total));
+}
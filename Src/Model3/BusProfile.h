@@ -0,0 +1,207 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2017 Bart Trzynadlowski, Nik Henson, Ian Curtis
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * BusProfile.h
+ *
+ * Header file defining the CBusProfile class: counts of the main board bus
+ * accesses to each memory mapped region, and the host time they took.
+ */
+
+#ifndef INCLUDED_BUSPROFILE_H
+#define INCLUDED_BUSPROFILE_H
+
+#include <cstdint>
+#include <string>
+
+/*
+ * CBusProfile:
+ *
+ * Counts the accesses made through CModel3's Read and Write handlers to each
+ * region they decode, along with an estimate of the host time spent in them,
+ * to show which device paths are worth a fast path. Counts are kept per frame
+ * and for the whole run.
+ *
+ * CModel3 only counts accesses in builds with SUPERMODEL_BUS_PROFILE defined
+ * (ENABLE_BUS_PROFILE=1 in Makefiles/Options.inc); otherwise none of this is
+ * compiled into its handlers. The handlers all run on the main board thread.
+ */
+class CBusProfile
+{
+public:
+  enum Region
+  {
+    RAM,
+    CROM,
+    CROMBank,
+    Real3DRegisters,    // status, command port and configuration
+    Real3DCullingRAM,
+    Real3DPolygonRAM,
+    Real3DTexture,      // texture port and FIFO
+    Real3DDMA,
+    Inputs,
+    Sound,
+    BackupRAM,
+    SystemRegisters,
+    RTC,
+    Security,
+    TileGen,
+    PCI,                // MPC105/106
+    SCSI,               // 53C810
+    NetBoard,
+    Unmapped,
+    NumRegions
+  };
+
+  /*
+   * RegionName(region):
+   *
+   * Returns:
+   *    Name of a region, for reports.
+   */
+  static const char *RegionName(Region region);
+
+  /*
+   * Classify(addr, netBoard):
+   *
+   * Decodes an address the way the CModel3 handlers do.
+   *
+   * Parameters:
+   *    addr      Address on the PowerPC bus.
+   *    netBoard  True if the net board is mapped at 0xC0000000 rather than
+   *              the Step 1.0 53C810.
+   *
+   * Returns:
+   *    Region the address belongs to.
+   */
+  static Region Classify(uint32_t addr, bool netBoard);
+
+  /*
+   * Scope:
+   *
+   * Counts the access made by the handler it is declared in, timed until it
+   * goes out of scope. Accesses a handler makes through the others (a 64-bit
+   * read as two 32-bit ones, for instance) are part of the outer access.
+   */
+  class Scope
+  {
+  public:
+    Scope(CBusProfile &profile, uint32_t addr, bool write)
+      : m_profile(profile),
+        m_outer(profile.m_depth++ == 0),
+        m_addr(addr),
+        m_write(write),
+        m_start(m_outer ? Ticks() : 0)
+    {
+    }
+
+    ~Scope()
+    {
+      if (m_outer)
+        m_profile.Count(Classify(m_addr, m_profile.m_netBoard), m_write, Ticks() - m_start);
+      m_profile.m_depth--;
+    }
+
+  private:
+    CBusProfile &m_profile;
+    bool        m_outer;
+    uint32_t    m_addr;
+    bool        m_write;
+    uint64_t    m_start;
+  };
+
+  /*
+   * SetNetBoard(netBoard):
+   *
+   * Sets whether 0xC0000000 is the net board, see Classify().
+   */
+  void SetNetBoard(bool netBoard);
+
+  /*
+   * Count(region, write, ticks):
+   *
+   * Adds an access to the current frame's counts.
+   *
+   * Parameters:
+   *    region  Region accessed.
+   *    write   True for a write, false for a read.
+   *    ticks   Host time it took, in Ticks() units.
+   */
+  void Count(Region region, bool write, uint64_t ticks);
+
+  /*
+   * EndFrame(void):
+   *
+   * Adds the current frame's counts to the run's and starts a new frame.
+   */
+  void EndFrame(void);
+
+  /*
+   * FrameSummary(top):
+   *
+   * Returns:
+   *    One line listing the regions most accessed in the last completed
+   *    frame, at most top of them.
+   */
+  std::string FrameSummary(unsigned top) const;
+
+  /*
+   * Report(top):
+   *
+   * Prints the regions that took the most host time over the run, at most
+   * top of them, with their counts and time per frame, and logs them.
+   */
+  void Report(unsigned top) const;
+
+  /*
+   * Ticks(void):
+   *
+   * Returns:
+   *    Host time stamp. The time stamp counter where there is one, as the
+   *    handlers are too short for the system clocks, and nanoseconds
+   *    otherwise.
+   */
+  static uint64_t Ticks(void);
+
+  CBusProfile(void);
+
+private:
+  struct Counts
+  {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t ticks;
+  };
+
+  static unsigned SortRegions(const Counts counts[NumRegions], int order[NumRegions]);
+  double NanosPerTick(void) const;
+
+  unsigned  m_depth;
+  bool      m_netBoard;
+  Counts    m_frame[NumRegions];
+  Counts    m_lastFrame[NumRegions];
+  Counts    m_total[NumRegions];
+  uint64_t  m_frames;
+  uint64_t  m_startTicks;
+  int64_t   m_startNanos;
+};
+
+#endif  // INCLUDED_BUSPROFILE_H
@@ -134,6 +134,7 @@ void CCrypto::LoadState(CBlockFile *SaveState)
 	SaveState->Read(&buffer_pos, sizeof(buffer_pos));
 	SaveState->Read(&line_buffer_pos, sizeof(line_buffer_pos));
 	SaveState->Read(&line_buffer_size, sizeof(line_buffer_size));
+	schedule_subkey();
 }
 
 void CCrypto::Init(uint32_t encryptionKey, std::function<uint16_t(uint32_t)> ReadRAMCallback)
@@ -165,6 +166,8 @@ void CCrypto::Init(uint32_t encryptionKey, std::function<uint16_t(uint32_t)> Rea
 */
 
   key = encryptionKey;
+  init_tables();
+  schedule_subkey();
 }
 
 void CCrypto::Reset()
@@ -175,6 +178,7 @@ void CCrypto::Reset()
 
 	prot_cur_address = 0;
 	subkey = 0;
+	schedule_subkey();
 	dec_hist = 0;
 	dec_header = 0;
 	enc_ready = false;
@@ -231,6 +235,7 @@ void CCrypto::SetAddressHigh(UINT16 data)
 void CCrypto::SetSubKey(UINT16 data)
 {
 	subkey = data;
+	schedule_subkey();
 	enc_ready = false;
 }
 
@@ -671,91 +676,122 @@ int CCrypto::feistel_function(int input, const struct sbox *sboxes, UINT32 subke
 }
 
 /**************************
-This implementation is an "educational" version. It must be noted that it can be speed-optimized in a number of ways.
-The most evident one is to factor out the parts of the key-scheduling that must only be done once (like the game-key &
-sequence-key parts) as noted in the comments inlined in the function. More sophisticated speed-ups can be gained by
-noticing that the weak key-scheduling would allow to create some pregenerated look-up tables for doing most of the work
-of the function. Even so, it would still be pretty slow, so caching techniques could be a wiser option here.
+The key-scheduling is factored out of block_decrypt(), which runs for every word of a stream: the game-key part is
+done once in Init(), the sequence-key part whenever the subkey changes. With both known, every round of the first
+Feistel network is a fixed function of 8 bits and is looked up in a 256-entry table. The rounds of the second network
+depend on the middle result, so there only the bit gathering and scattering around each sbox are tabled, along with
+the subkey bits every byte of the middle result toggles.
 **************************/
 
-UINT16 CCrypto::block_decrypt(UINT32 game_key, UINT16 sequence_key, UINT16 counter, UINT16 data)
+void CCrypto::init_tables()
 {
-	int j;
-	int aux, aux2;
-	int A, B;
-	int middle_result;
-	UINT32 fn1_subkeys[4];
-	UINT32 fn2_subkeys[4];
+	for (int r = 0; r < 4; ++r) {
+		for (int m = 0; m < 4; ++m) {
+			const sbox &s = fn2_sboxes[r][m];
+			for (int input = 0; input < 256; ++input) {
+				int aux = 0;
+				for (int k = 0; k < 6; ++k)
+					if (s.inputs[k] != -1)
+						aux |= BIT(input, s.inputs[k]) << k;
+				fn2_sbox_inputs[r][m][input] = aux;
+			}
+			for (int x = 0; x < 64; ++x) {
+				int result = 0;
+				for (int k = 0; k < 2; ++k)
+					result |= BIT(s.table[x], k) << s.outputs[k];
+				fn2_sbox_outputs[r][m][x] = result;
+			}
+		}
+	}
+
+	memset(fn2_middle_subkeys, 0, sizeof(fn2_middle_subkeys));
+	for (int half = 0; half < 2; ++half) {
+		for (int value = 0; value < 256; ++value) {
+			for (int j = 0; j < 8; ++j) {
+				if (BIT(value, j) != 0) {
+					int bit = fn2_middle_result_scheduling[half * 8 + j];
+					fn2_middle_subkeys[half][value][bit / 24] ^= (1 << (bit % 24));
+				}
+			}
+		}
+	}
 
-	/* Game-key scheduling; this could be done just once per game at initialization time */
-	memset(fn1_subkeys, 0, sizeof(UINT32) * 4);
-	memset(fn2_subkeys, 0, sizeof(UINT32) * 4);
+	memset(fn1_game_subkeys, 0, sizeof(fn1_game_subkeys));
+	memset(fn2_game_subkeys, 0, sizeof(fn2_game_subkeys));
 
-	for (j = 0; j < FN1GK; ++j) {
-		if (BIT(game_key, fn1_game_key_scheduling[j][0]) != 0) {
-			aux = fn1_game_key_scheduling[j][1] % 24;
-			aux2 = fn1_game_key_scheduling[j][1] / 24;
-			fn1_subkeys[aux2] ^= (1 << aux);
+	for (int j = 0; j < FN1GK; ++j) {
+		if (BIT(key, fn1_game_key_scheduling[j][0]) != 0) {
+			int aux = fn1_game_key_scheduling[j][1] % 24;
+			int aux2 = fn1_game_key_scheduling[j][1] / 24;
+			fn1_game_subkeys[aux2] ^= (1 << aux);
 		}
 	}
 
-	for (j = 0; j < FN2GK; ++j) {
-		if (BIT(game_key, fn2_game_key_scheduling[j][0]) != 0) {
-			aux = fn2_game_key_scheduling[j][1] % 24;
-			aux2 = fn2_game_key_scheduling[j][1] / 24;
-			fn2_subkeys[aux2] ^= (1 << aux);
+	for (int j = 0; j < FN2GK; ++j) {
+		if (BIT(key, fn2_game_key_scheduling[j][0]) != 0) {
+			int aux = fn2_game_key_scheduling[j][1] % 24;
+			int aux2 = fn2_game_key_scheduling[j][1] / 24;
+			fn2_game_subkeys[aux2] ^= (1 << aux);
 		}
 	}
-	/********************************************************/
+}
 
-	/* Sequence-key scheduling; this could be done just once per decryption run */
-	for (j = 0; j < 20; ++j) {
-		if (BIT(sequence_key, fn1_sequence_key_scheduling[j][0]) != 0) {
-			aux = fn1_sequence_key_scheduling[j][1] % 24;
-			aux2 = fn1_sequence_key_scheduling[j][1] / 24;
+void CCrypto::schedule_subkey()
+{
+	UINT32 fn1_subkeys[4];
+
+	memcpy(fn1_subkeys, fn1_game_subkeys, sizeof(fn1_subkeys));
+	memcpy(fn2_subkeys, fn2_game_subkeys, sizeof(fn2_subkeys));
+
+	for (int j = 0; j < 20; ++j) {
+		if (BIT(subkey, fn1_sequence_key_scheduling[j][0]) != 0) {
+			int aux = fn1_sequence_key_scheduling[j][1] % 24;
+			int aux2 = fn1_sequence_key_scheduling[j][1] / 24;
 			fn1_subkeys[aux2] ^= (1 << aux);
 		}
 	}
 
-	for (j = 0; j < 16; ++j) {
-		if (BIT(sequence_key, j) != 0) {
-			aux = fn2_sequence_key_scheduling[j] % 24;
-			aux2 = fn2_sequence_key_scheduling[j] / 24;
+	for (int j = 0; j < 16; ++j) {
+		if (BIT(subkey, j) != 0) {
+			int aux = fn2_sequence_key_scheduling[j] % 24;
+			int aux2 = fn2_sequence_key_scheduling[j] / 24;
 			fn2_subkeys[aux2] ^= (1 << aux);
 		}
 	}
 
-	/**************************************************************/
+	for (int r = 0; r < 4; ++r)
+		for (int input = 0; input < 256; ++input)
+			fn1_rounds[r][input] = feistel_function(input, fn1_sboxes[r], fn1_subkeys[r]);
+}
+
+inline int CCrypto::fn2_feistel_function(int round, int input, UINT32 subkeys) const
+{
+	return fn2_sbox_outputs[round][0][(fn2_sbox_inputs[round][0][input] ^ subkeys) & 0x3f] |
+	       fn2_sbox_outputs[round][1][(fn2_sbox_inputs[round][1][input] ^ (subkeys >> 6)) & 0x3f] |
+	       fn2_sbox_outputs[round][2][(fn2_sbox_inputs[round][2][input] ^ (subkeys >> 12)) & 0x3f] |
+	       fn2_sbox_outputs[round][3][(fn2_sbox_inputs[round][3][input] ^ (subkeys >> 18)) & 0x3f];
+}
+
+UINT16 CCrypto::block_decrypt(UINT16 counter, UINT16 data)
+{
+	int j;
+	int aux;
+	int A, B;
+	UINT32 subkeys[4];
 
 	// First Feistel Network
 
 	aux = BITSWAP16(counter, 5, 12, 14, 13, 9, 3, 6, 4, 8, 1, 15, 11, 0, 7, 10, 2);
 
-	// 1st round
 	B = aux >> 8;
-	A = (aux & 0xff) ^ feistel_function(B, fn1_sboxes[0], fn1_subkeys[0]);
-
-	// 2nd round
-	B ^= feistel_function(A, fn1_sboxes[1], fn1_subkeys[1]);
-
-	// 3rd round
-	A ^= feistel_function(B, fn1_sboxes[2], fn1_subkeys[2]);
-
-	// 4th round
-	B ^= feistel_function(A, fn1_sboxes[3], fn1_subkeys[3]);
+	A = (aux & 0xff) ^ fn1_rounds[0][B];
+	B ^= fn1_rounds[1][A];
+	A ^= fn1_rounds[2][B];
+	B ^= fn1_rounds[3][A];
 
-	middle_result = (B << 8) | A;
-
-
-	/* Middle-result-key sheduling */
-	for (j = 0; j < 16; ++j) {
-		if (BIT(middle_result, j) != 0) {
-			aux = fn2_middle_result_scheduling[j] % 24;
-			aux2 = fn2_middle_result_scheduling[j] / 24;
-			fn2_subkeys[aux2] ^= (1 << aux);
-		}
-	}
-	/*********************/
+	/* Middle-result-key sheduling (the middle result is (B << 8) | A) */
+	for (j = 0; j < 4; ++j)
+		subkeys[j] = fn2_subkeys[j] ^ fn2_middle_subkeys[0][A][j] ^ fn2_middle_subkeys[1][B][j];
 
 	// Second Feistel Network
 
@@ -763,16 +799,16 @@ UINT16 CCrypto::block_decrypt(UINT32 game_key, UINT16 sequence_key, UINT16 count
 
 	// 1st round
 	B = aux >> 8;
-	A = (aux & 0xff) ^ feistel_function(B, fn2_sboxes[0], fn2_subkeys[0]);
+	A = (aux & 0xff) ^ fn2_feistel_function(0, B, subkeys[0]);
 
 	// 2nd round
-	B ^= feistel_function(A, fn2_sboxes[1], fn2_subkeys[1]);
+	B ^= fn2_feistel_function(1, A, subkeys[1]);
 
 	// 3rd round
-	A ^= feistel_function(B, fn2_sboxes[2], fn2_subkeys[2]);
+	A ^= fn2_feistel_function(2, B, subkeys[2]);
 
 	// 4th round
-	B ^= feistel_function(A, fn2_sboxes[3], fn2_subkeys[3]);
+	B ^= fn2_feistel_function(3, A, subkeys[3]);
 
 	aux = (B << 8) | A;
 
@@ -788,7 +824,7 @@ UINT16 CCrypto::get_decrypted_16()
 
 	enc = m_read(prot_cur_address);
 
-	UINT16 dec = block_decrypt(key, subkey, prot_cur_address, enc);
+	UINT16 dec = block_decrypt(prot_cur_address, enc);
 	UINT16 res = (dec & 3) | (dec_hist & 0xfffc);
 	dec_hist = dec;
 
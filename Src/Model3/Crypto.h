@@ -108,8 +108,20 @@ private:
 
 	static const uint8_t trees[9][2][32];
 
+	// Key-scheduling done ahead of block_decrypt()
+	uint32_t fn1_game_subkeys[4];              // game-key part, set by Init()
+	uint32_t fn2_game_subkeys[4];
+	uint32_t fn2_subkeys[4];                   // game and sequence-key parts, set with the subkey
+	uint8_t fn1_rounds[4][256];                // first network's rounds for the current key and subkey
+	uint8_t fn2_sbox_inputs[4][4][256];        // sbox inputs gathered from a round's input byte
+	uint8_t fn2_sbox_outputs[4][4][64];        // sbox outputs scattered to their bits in the round's result
+	uint32_t fn2_middle_subkeys[2][256][4];    // subkey bits toggled by each byte of the middle result
+
+	void init_tables();
+	void schedule_subkey();
 	int feistel_function(int input, const struct sbox *sboxes, uint32_t subkeys);
-	uint16_t block_decrypt(uint32_t game_key, uint16_t sequence_key, uint16_t counter, uint16_t data);
+	int fn2_feistel_function(int round, int input, uint32_t subkeys) const;
+	uint16_t block_decrypt(uint16_t counter, uint16_t data);
 
 	uint16_t get_decrypted_16();
 	int get_compressed_bit();
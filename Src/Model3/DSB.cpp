@@ -39,7 +39,10 @@
 
 #include "Supermodel.h"
 #include "Sound/MPEG/MpegAudio.h"
+#include "Sound/DSBMix.h"
+#include "Util/Trace.h"
 #include <algorithm>
+#include <thread>
 
 /******************************************************************************
  Resampler
@@ -114,6 +117,18 @@
  Fixed point arithmetic is used to track fractions. For such numbers, the low
  8 bits represent a fraction (0x100 would be 1.0, 0x080 would be 0.5, etc.)
  and the upper bits are the integral portion.
+
+ 5. Windowed Sinc
+
+ Optionally (DSBSincResampler), each output sample is instead made from 16
+ input samples with a Kaiser windowed sinc filter, which passes more of the
+ treble and aliases far less than linear interpolation. The filter lags by 7
+ input samples and needs 14 samples from before the start of the buffer, so
+ those are kept from the previous frame. They are kept in either mode, so the
+ setting can be changed at any time.
+
+ The work is done in Sound/DSBMix.cpp, which interpolates and mixes 8 samples
+ at a time with SSE2 or NEON.
 ******************************************************************************/
 
 void CDSBResampler::Reset(void)
@@ -121,31 +136,21 @@ void CDSBResampler::Reset(void)
 	// Initial state of fractions (24.8 fixed point)
 	nFrac = 0<<8;	// fraction of next sample to use (0->1.0 as x moves p->n)
  	pFrac = 1<<8;	// previous sample (1.0->0 as x moves p->n)
-}
 
-// Mixes 16-bit samples (sign extended in a and b)
-static inline INT16 MixAndClip(INT32 a, INT32 b)
-{
-	a += b;
-	if (a > 32767)
-		a = 32767;
-	else if (a < -32768)
-		a = -32768;
-	return (INT16) a;
+	memset(historyL, 0, sizeof(historyL));
+	memset(historyR, 0, sizeof(historyR));
 }
 
 // Mixes audio and returns number of samples copied back to start of buffer (ie. offset at which new samples should be written)
 int CDSBResampler::UpSampleAndMix(INT16 *outL, INT16 *outR, INT16 *inL, INT16 *inR, UINT8 volumeL, UINT8 volumeR, int sizeOut, int sizeIn, int outRate, int inRate)
 {
 	int 	delta = (inRate<<8)/outRate;	// (1/fout)/(1/fin)=fin/fout, 24.8 fixed point
-	int		outIdx = 0;
 	int		inIdx = 0;
-	INT32	leftSample, rightSample, leftSoundSample, rightSoundSample;
 	INT32	v[2], musicVol, soundVol;
 
 	// Obtain program volume settings and convert to 24.8 fixed point (0-200 -> 0x00-0x200)
-	musicVol = m_config["MusicVolume"].ValueAs<int>();
-	soundVol = m_config["SoundVolume"].ValueAs<int>();
+	musicVol = m_musicVolume;
+	soundVol = m_soundVolume;
 	musicVol = (INT32) ((float) 0x100 * (float) musicVol / 100.0f);
 	soundVol = (INT32) ((float) 0x100 * (float) soundVol / 100.0f);
 
@@ -153,38 +158,30 @@ int CDSBResampler::UpSampleAndMix(INT16 *outL, INT16 *outR, INT16 *inL, INT16 *i
 	v[0] = (INT16) ((float) 0x100 * (float) volumeL / 255.0f);
 	v[1] = (INT16) ((float) 0x100 * (float) volumeR / 255.0f);
 
+	// DSB volume and then overall music volume setting (multiplied by two 24.8 numbers, so 16.16)
+	INT32	musicVolume = v[0]*musicVol;
+
 	// Up-sample and mix!
-	while (outIdx < sizeOut)
+	if (m_sinc)
 	{
-		// nFrac, pFrac will never exceed 1.0 (0x100) (only true if delta does not exceed 1)
-		leftSample	= ((int)inL[inIdx]*pFrac+(int)inL[inIdx+1]*nFrac) >> 8;	// left channel
-		rightSample	= ((int)inR[inIdx]*pFrac+(int)inR[inIdx+1]*nFrac) >> 8;	// right channel
-
-		// Apply DSB volume and then overall music volume setting
-		leftSample = (leftSample*v[0]*musicVol) >> 16;		// multiplied by two 24.8 numbers, shift back by 16
-		rightSample = (rightSample*v[0]*musicVol) >> 16;
-
-		// Apply sound volume setting
-		leftSoundSample = (outL[outIdx]*soundVol) >> 8;
-		rightSoundSample = (outR[outIdx]*soundVol) >> 8;
-
-		// Mix and output
-		outL[outIdx] = MixAndClip(leftSoundSample, leftSample);
-		outR[outIdx] = MixAndClip(rightSoundSample, rightSample);
-		outIdx++;
-
-		// Time step
-		pFrac -= delta;
-		nFrac += delta;
-
-		// Time to move to next samples?
-		if (pFrac <= 0)	// when pFrac becomes 0, advance samples, reset pFrac to 1
-		{
-			pFrac += (1<<8);
-			nFrac -= (1<<8);
-			inIdx++;	// advance samples (for upsampling only; downsampling may advance by more than one -- add delta every loop iteration)
+		// Input preceded by the end of the previous frame, for the filter
+		INT16	extL[HISTORY_SAMPLES + MAX_INPUT_SAMPLES], extR[HISTORY_SAMPLES + MAX_INPUT_SAMPLES];
+		int		size = std::min(sizeIn, MAX_INPUT_SAMPLES);
+		memcpy(extL, historyL, sizeof(historyL));
+		memcpy(extR, historyR, sizeof(historyR));
+		memcpy(&extL[HISTORY_SAMPLES], inL, size*sizeof(INT16));
+		memcpy(&extR[HISTORY_SAMPLES], inR, size*sizeof(INT16));
+		inIdx = DSBMix_Sinc(outL, outR, extL, extR, sizeOut, delta, pFrac, nFrac, musicVolume, soundVol);
+	}
+	else
+		inIdx = DSBMix_Linear(outL, outR, inL, inR, sizeOut, delta, pFrac, nFrac, musicVolume, soundVol);
 
-		}
+	// Keep the samples before the first unprocessed one for the sinc filter (some may still be in the history)
+	for (int k = 0; k < HISTORY_SAMPLES; k++)
+	{
+		int src = inIdx - HISTORY_SAMPLES + k;
+		historyL[k] = src >= 0 ? inL[src] : historyL[HISTORY_SAMPLES + src];
+		historyR[k] = src >= 0 ? inR[src] : historyR[HISTORY_SAMPLES + src];
 	}
 
 	// Copy remaining "active" input samples to start of buffer
@@ -423,12 +420,19 @@ void CDSB1::SendCommand(UINT8 data)
 #endif
 }
 
+void CDSB1::StartFrame(void)
+{
+	// The Z80 is run by RunFrame() on the sound board thread
+}
+
 void CDSB1::RunFrame(INT16 *audioL, INT16 *audioR)
 {
+	TRACE_ZONE("CDSB1::RunFrame");
+
 	int		cycles;
 	UINT8	v;
 
-	if (!m_config["EmulateDSB"].ValueAs<bool>())
+	if (!m_emulateDSB)
 	{
 		// DSB code applies SCSP volume, too, so we must still mix
 		memset(mpegL, 0, (32000/60+2)*sizeof(INT16));
@@ -437,6 +441,8 @@ void CDSB1::RunFrame(INT16 *audioL, INT16 *audioR)
 		return;
 	}
 
+	MpegDec::SetContext(m_mpeg);
+
 	// While FIFO not empty, fire interrupts, run for up to one frame
 	for (cycles = (4000000/60); (cycles > 0) && (fifoIdxR != fifoIdxW);  )
 	{
@@ -460,6 +466,7 @@ void CDSB1::RunFrame(INT16 *audioL, INT16 *audioR)
 
 void CDSB1::Reset(void)
 {
+	MpegDec::SetContext(m_mpeg);
 	MpegDec::Stop();
 	Resampler.Reset();
 	retainedSamples = 0;
@@ -474,7 +481,7 @@ void CDSB1::Reset(void)
 
 	// Even if DSB emulation is disabled, must reset to establish valid Z80 state
 	Z80.Reset();
-	DebugLog("DSB1 Reset\n");
+	DEBUG_LOG(DSB, "DSB1 Reset\n");
 }
 
 void CDSB1::SaveState(CBlockFile *StateFile)
@@ -485,6 +492,7 @@ void CDSB1::SaveState(CBlockFile *StateFile)
 	StateFile->NewBlock("DSB1", __FILE__);
 
 	// MPEG playback state
+	MpegDec::SetContext(m_mpeg);
 	isPlaying	= (UINT8)MpegDec::IsLoaded();
 	playOffset	= (UINT32)MpegDec::GetPosition();
 	endOffset	= 0;
@@ -551,6 +559,7 @@ void CDSB1::LoadState(CBlockFile *StateFile)
 	Z80.LoadState(StateFile, "DSB1 Z80");
 
 	// Restart MPEG audio at the appropriate position
+	MpegDec::SetContext(m_mpeg);
 	if (isPlaying)
 	{
 		MpegDec::SetMemory(&mpegROM[usingMPEGStart], usingMPEGEnd - usingMPEGStart, false);
@@ -591,6 +600,10 @@ bool CDSB1::Init(const UINT8 *progROMPtr, const UINT8 *mpegROMPtr)
 	mpegL = (INT16 *) &memoryPool[DSB1_OFFSET_MPEG_LEFT];
 	mpegR = (INT16 *) &memoryPool[DSB1_OFFSET_MPEG_RIGHT];
 
+	// Decoded frames are only good for this ROM
+	MpegDec::SetContext(m_mpeg);
+	MpegDec::SetCacheSize(size_t(m_config["MpegCacheMB"].ValueAsDefault<unsigned>(0)) << 20);
+
 	// Initialize Z80 CPU
 	Z80.Init(this, Z80IRQCallback);
 
@@ -606,6 +619,7 @@ CZ80 *CDSB1::GetZ80(void)
 
 CDSB1::CDSB1(const Util::Config::Node &config)
   : m_config(config),
+    m_emulateDSB(config, "EmulateDSB"),
     Resampler(config)
 {
 	progROM		= NULL;
@@ -614,6 +628,7 @@ CDSB1::CDSB1(const Util::Config::Node &config)
 	ram			= NULL;
 	mpegL		= NULL;
 	mpegR		= NULL;
+	m_mpeg		= MpegDec::CreateContext();
 
 	// must init these otherwise we end up trying to read illegal addresses
 	mpegStart	= 0;
@@ -622,11 +637,14 @@ CDSB1::CDSB1(const Util::Config::Node &config)
 	loopStart	= 0;
 	loopEnd		= 0;
 
-	DebugLog("Built DSB1 Board\n");
+	DEBUG_LOG(DSB, "Built DSB1 Board\n");
 }
 
 CDSB1::~CDSB1(void)
 {
+	MpegDec::DestroyContext(m_mpeg);	// make sure the decoder is no longer reading the MPEG ROM
+	m_mpeg = NULL;
+
 	if (memoryPool != NULL)
 	{
 		delete [] memoryPool;
@@ -639,7 +657,7 @@ CDSB1::~CDSB1(void)
 	mpegL	= NULL;
 	mpegR	= NULL;
 
-	DebugLog("Destroyed DSB1 Board\n");
+	DEBUG_LOG(DSB, "Destroyed DSB1 Board\n");
 }
 
 
@@ -992,18 +1010,86 @@ void CDSB2::SendCommand(UINT8 data)
 }
 
 
-void CDSB2::RunFrame(INT16 *audioL, INT16 *audioR)
+/*
+ * The 68K frame and MPEG decode do not depend on the SCSP audio, only the mix
+ * does, so the DSB thread runs them while the sound board renders the SCSPs.
+ * The frame is always finished within CSoundBoard::RunFrame(), so nothing else
+ * touches the board between StartFrame() and RunFrame(), and the output is the
+ * same as running the whole frame in RunFrame().
+ */
+
+int CDSB2::StartThread(void *data)
+{
+  return ((CDSB2 *) data)->RunThread();
+}
+
+int CDSB2::RunThread(void)
 {
-  if (!m_config["EmulateDSB"].ValueAs<bool>())
+  for (;;)
   {
-    // DSB code applies SCSP volume, too, so we must still mix
-    memset(mpegL, 0, (32000 / 60 + 2) * sizeof(INT16));
-    memset(mpegR, 0, (32000 / 60 + 2) * sizeof(INT16));
-    retainedSamples = Resampler.UpSampleAndMix(audioL, audioR, mpegL, mpegR, volume[0], volume[1], 44100 / 60, 32000 / 60 + 2, 44100, 32000);
+    if (!m_threadSync->Wait())
+    {
+      ErrorLog("Threading error in DSB2 thread: %s", CThread::GetLastError());
+      return 1;
+    }
+    if (m_threadExit)
+      return 0;
+    RunCPU();
+    m_frameDone.Arrive();
+  }
+}
+
+void CDSB2::StopThread(void)
+{
+  if (m_thread != NULL)
+  {
+    m_threadExit = true;
+    if (m_threadSync->Post())
+      m_thread->Wait();
+    delete m_thread;
+    m_thread = NULL;
+  }
+  if (m_threadSync != NULL)
+  {
+    delete m_threadSync;
+    m_threadSync = NULL;
+  }
+  m_threadExit = false;
+}
+
+void CDSB2::StartFrame(void)
+{
+  if (!m_emulateDSB || !m_threaded)
     return;
+
+  if (NULL == m_thread)
+  {
+    m_threadSync = CThread::CreateSemaphore(0);
+    if (m_threadSync != NULL)
+      m_thread = CThread::CreateThread("DSB2", StartThread, this);
+    if (NULL == m_thread)
+    {
+      ErrorLog("Unable to create DSB2 thread: %s", CThread::GetLastError());
+      StopThread();
+      m_threaded = false;
+      return;
+    }
   }
 
+  m_frameDone.Add(1);
+  if (!m_threadSync->Post())
+  {
+    ErrorLog("Threading error in CDSB2::StartFrame: %s", CThread::GetLastError());
+    m_frameDone.Arm(0);
+    return;
+  }
+  m_frameStarted = true;
+}
+
+void CDSB2::RunCPU(void)
+{
   M68KSetContext(&M68K);
+  MpegDec::SetContext(m_mpeg);
   //printf("DSB2 run frame PC=%06X\n", M68KGetPC());
 
   // While FIFO not empty...
@@ -1038,10 +1124,31 @@ void CDSB2::RunFrame(INT16 *audioL, INT16 *audioR)
   m_cyclesElapsedThisFrame -= k_framePeriod;
   m_nextTimerInterruptCycles -= k_framePeriod;
 
-  M68KGetContext(&M68K);
-
   // Decode MPEG for this frame
   MpegDec::DecodeAudio(&mpegL[retainedSamples], &mpegR[retainedSamples], 32000 / 60 - retainedSamples + 2);
+}
+
+void CDSB2::RunFrame(INT16 *audioL, INT16 *audioR)
+{
+  TRACE_ZONE("CDSB2::RunFrame");
+
+  if (!m_emulateDSB)
+  {
+    // DSB code applies SCSP volume, too, so we must still mix
+    memset(mpegL, 0, (32000 / 60 + 2) * sizeof(INT16));
+    memset(mpegR, 0, (32000 / 60 + 2) * sizeof(INT16));
+    retainedSamples = Resampler.UpSampleAndMix(audioL, audioR, mpegL, mpegR, volume[0], volume[1], 44100 / 60, 32000 / 60 + 2, 44100, 32000);
+    return;
+  }
+
+  // Finish the frame started on the DSB thread, or run it now
+  if (m_frameStarted)
+  {
+    m_frameDone.Wait();
+    m_frameStarted = false;
+  }
+  else
+    RunCPU();
 
   INT16 *leftChannelSource = nullptr;
   INT16 *rightChannelSource = nullptr;
@@ -1075,6 +1182,7 @@ void CDSB2::RunFrame(INT16 *audioL, INT16 *audioR)
 
 void CDSB2::Reset(void)
 {
+	MpegDec::SetContext(m_mpeg);
 	MpegDec::Stop();
 	Resampler.Reset();
 	retainedSamples = 0;
@@ -1094,12 +1202,11 @@ void CDSB2::Reset(void)
 	M68KSetContext(&M68K);
 	M68KReset();
 	//printf("DSB2 PC=%06X\n", M68KGetPC());
-	M68KGetContext(&M68K);
 
 	m_cyclesElapsedThisFrame = 0;
 	m_nextTimerInterruptCycles = k_timerPeriod;
 
-	DebugLog("DSB2 Reset\n");
+	DEBUG_LOG(DSB, "DSB2 Reset\n");
 }
 
 void CDSB2::SaveState(CBlockFile *StateFile)
@@ -1110,6 +1217,7 @@ void CDSB2::SaveState(CBlockFile *StateFile)
 	StateFile->NewBlock("DSB2", __FILE__);
 
 	// MPEG playback state
+	MpegDec::SetContext(m_mpeg);
 	isPlaying	= (UINT8)MpegDec::IsLoaded();
 	playOffset	= (UINT32)MpegDec::GetPosition();
 	endOffset	= 0;
@@ -1179,7 +1287,6 @@ void CDSB2::LoadState(CBlockFile *StateFile)
 
 	M68KSetContext(&M68K);
 	M68KLoadState(StateFile, "DSB2 68K");
-	M68KGetContext(&M68K);
 
 	// Technically these should be saved/restored rather than being reset but that would mean
 	// the save state format has to be modified and the difference would be imperceptible anyway
@@ -1187,6 +1294,7 @@ void CDSB2::LoadState(CBlockFile *StateFile)
 	m_nextTimerInterruptCycles = k_timerPeriod;
 
 	// Restart MPEG audio at the appropriate position
+	MpegDec::SetContext(m_mpeg);
 	if (isPlaying)
 	{
 		MpegDec::SetMemory(&mpegROM[usingMPEGStart], usingMPEGEnd - usingMPEGStart, false);
@@ -1234,12 +1342,20 @@ bool CDSB2::Init(const UINT8 *progROMPtr, const UINT8 *mpegROMPtr)
 	mpegL = (INT16 *) &memoryPool[DSB2_OFFSET_MPEG_LEFT];
 	mpegR = (INT16 *) &memoryPool[DSB2_OFFSET_MPEG_RIGHT];
 
+	// Decoded frames are only good for this ROM
+	MpegDec::SetContext(m_mpeg);
+	MpegDec::SetCacheSize(size_t(m_config["MpegCacheMB"].ValueAsDefault<unsigned>(0)) << 20);
+
 	// Initialize 68K CPU
 	M68KSetContext(&M68K);
 	M68KInit();
 	M68KAttachBus(this);
 	M68KSetIRQCallback(NULL);	// use default behavior (autovector, clear interrupt)
-	M68KGetContext(&M68K);
+	M68KMapROM(0x000000, 0x01FFFF, progROM, 0x01FFFF);
+	M68KMapRAM(0xF00000, 0xF1FFFF, ram, 0x01FFFF);
+	std::string engine = m_config["DSBM68KEngine"].ValueAsDefault<std::string>(m_config["M68KEngine"].ValueAs<std::string>());
+	if (OKAY != M68KSetEngine(engine.c_str()))
+		ErrorLog("Unknown 68K engine '%s' for DSB; using 'musashi'.", engine.c_str());
 
 	retainedSamples = 0;
 
@@ -1253,6 +1369,7 @@ M68KCtx *CDSB2::GetM68K(void)
 
 CDSB2::CDSB2(const Util::Config::Node &config)
   : m_config(config),
+    m_emulateDSB(config, "EmulateDSB"),
     Resampler(config)
 {
 	progROM		= NULL;
@@ -1261,6 +1378,7 @@ CDSB2::CDSB2(const Util::Config::Node &config)
 	ram			= NULL;
 	mpegL		= NULL;
 	mpegR		= NULL;
+	m_mpeg		= MpegDec::CreateContext();
 
 	cmdLatch	= 0;
 	mpegState	= 0;
@@ -1268,11 +1386,21 @@ CDSB2::CDSB2(const Util::Config::Node &config)
 	mpegEnd		= 0;
 	playing		= 0;
 
-	DebugLog("Built DSB2 Board\n");
+	m_threaded		= config["MultiThreadedDSB"].ValueAs<bool>() && std::thread::hardware_concurrency() > 1;
+	m_frameStarted	= false;
+	m_threadExit	= false;
+	m_thread		= NULL;
+	m_threadSync	= NULL;
+
+	DEBUG_LOG(DSB, "Built DSB2 Board\n");
 }
 
 CDSB2::~CDSB2(void)
 {
+	StopThread();
+	MpegDec::DestroyContext(m_mpeg);	// make sure the decoder is no longer reading the MPEG ROM
+	m_mpeg = NULL;
+
 	if (memoryPool != NULL)
 	{
 		delete [] memoryPool;
@@ -1285,5 +1413,5 @@ CDSB2::~CDSB2(void)
 	mpegL	= NULL;
 	mpegR	= NULL;
 
-	DebugLog("Destroyed DSB2 Board\n");
+	DEBUG_LOG(DSB, "Destroyed DSB2 Board\n");
 }
\ No newline at end of file
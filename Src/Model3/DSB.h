@@ -35,6 +35,7 @@
 #include "Types.h"
 #include "CPU/Bus.h"
 #include "Util/NewConfig.h"
+#include "Sound/MPEG/MpegAudio.h"
 
 
 /******************************************************************************
@@ -68,13 +69,24 @@ public:
 	int		UpSampleAndMix(INT16 *outL, INT16 *outR, INT16 *inL, INT16 *inR, UINT8 volumeL, UINT8 volumeR, int sizeOut, int sizeIn, int outRate, int inRate);
 	void	Reset(void);
 	CDSBResampler(const Util::Config::Node &config)
-	  : m_config(config)
+	  : m_config(config),
+	    m_musicVolume(config, "MusicVolume"),
+	    m_soundVolume(config, "SoundVolume"),
+	    m_sinc(config, "DSBSincResampler")
   {
   }
 private:
+	static const int MAX_INPUT_SAMPLES = 2048;	// input samples per frame
+	static const int HISTORY_SAMPLES = 14;		// input samples kept for the sinc filter (DSBMIX_SINC_HISTORY)
+
 	const Util::Config::Node &m_config;
+	Util::Config::Binding<int> m_musicVolume;
+	Util::Config::Binding<int> m_soundVolume;
+	Util::Config::Binding<bool> m_sinc;
 	int	nFrac;
 	int	pFrac;
+	INT16	historyL[HISTORY_SAMPLES];
+	INT16	historyR[HISTORY_SAMPLES];
 };
 
 
@@ -98,11 +110,21 @@ public:
 	 */
 	virtual void SendCommand(UINT8 data) = 0;
 
+	/*
+	 * StartFrame(void):
+	 *
+	 * Starts running the next frame on the board's own thread, if it has one,
+	 * so that it runs while the sound board renders the SCSP audio. Optional;
+	 * RunFrame() must follow.
+	 */
+	virtual void StartFrame(void) = 0;
+
 	/*
 	 * RunFrame(audioL, audioR):
 	 *
-	 * Runs one frame and updates the MPEG audio. Audio is mixed into the
-	 * supplied buffers (they are assumed to already contain audio data).
+	 * Runs one frame (or finishes the one StartFrame() began) and updates the
+	 * MPEG audio. Audio is mixed into the supplied buffers (they are assumed to
+	 * already contain audio data).
 	 *
 	 * Parameters:
 	 *		audioL	Left audio channel, one frame (44 KHz, 1/60th second).
@@ -181,6 +203,7 @@ public:
 
 	// DSB interface (see CDSB definition)
 	void 	SendCommand(UINT8 data);
+	void 	StartFrame(void);
 	void 	RunFrame(INT16 *audioL, INT16 *audioR);
 	void 	Reset(void);
 	void	SaveState(CBlockFile *StateFile);
@@ -196,6 +219,7 @@ public:
 
 private:
   const Util::Config::Node &m_config;
+  Util::Config::Binding<bool> m_emulateDSB;
 
 	// Resampler
 	CDSBResampler	Resampler;
@@ -204,6 +228,9 @@ private:
   // MPEG decode buffers (48KHz, 1/60th second + 2 extra padding samples)
 	INT16	*mpegL, *mpegR;
 
+	// MPEG decoder, made active at each entry point
+	MpegDec::Context	*m_mpeg;
+
 	// DSB memory
 	const UINT8	*progROM;		// Z80 program ROM (passed in from parent object)
 	const UINT8	*mpegROM;		// MPEG music ROM
@@ -258,6 +285,7 @@ public:
 
 	// DSB interface (see definition of CDSB)
 	void 	SendCommand(UINT8 data);
+	void 	StartFrame(void);
 	void 	RunFrame(INT16 *audioL, INT16 *audioR);
 	void 	Reset(void);
 	void	SaveState(CBlockFile *StateFile);
@@ -273,9 +301,22 @@ public:
 
 private:
 	const Util::Config::Node &m_config;
+	Util::Config::Binding<bool> m_emulateDSB;
 
 	// Private helper functions
 	void	WriteMPEGFIFO(UINT8 byte);
+	void	RunCPU(void);	// runs the 68K for a frame and decodes its MPEG audio
+
+	// DSB thread (runs RunCPU() while the sound board renders the SCSPs)
+	static int	StartThread(void *data);
+	int			RunThread(void);
+	void		StopThread(void);
+	bool			m_threaded;		// run frames on the DSB thread
+	bool			m_frameStarted;	// StartFrame() handed a frame to the thread
+	bool			m_threadExit;
+	CThread			*m_thread;
+	CSemaphore		*m_threadSync;
+	CFrameBarrier	m_frameDone;
 
 	// Resampler
 	CDSBResampler	Resampler;
@@ -284,6 +325,9 @@ private:
 	// MPEG decode buffers (48KHz, 1/60th second + 2 extra padding samples)
 	INT16	*mpegL, *mpegR;
 
+	// MPEG decoder, made active at each entry point
+	MpegDec::Context	*m_mpeg;
+
 	// Stereo mode (do not change values because they are used in save states!)
 	enum class StereoMode: uint8_t
 	{
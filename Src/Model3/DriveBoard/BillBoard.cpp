@@ -118,7 +118,7 @@ UINT8 CBillBoard::IORead8(UINT32 portNum)
     // 0xf0 or 0x0f = no more test lamp
     return 0xff;
   default:
-    DebugLog("Unhandled Z80 input on port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
+    DEBUG_LOG(Drive, "Unhandled Z80 input on port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
     return 0xff;
   }
 }
@@ -168,7 +168,7 @@ void CBillBoard::IOWrite8(UINT32 portNum, UINT8 data)
       m_initialized = true;
     return;
   default:
-    DebugLog("Unhandled Z80 output on port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
+    DEBUG_LOG(Drive, "Unhandled Z80 output on port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
     break;
   }
 }
@@ -183,7 +183,7 @@ CBillBoard::CBillBoard(const Util::Config::Node& config)
   m_z80Clock = 8.0;
   m_z80NMI = false;
 
-  DebugLog("Built Drive Board (billboard)\n");
+  DEBUG_LOG(Drive, "Built Drive Board (billboard)\n");
 }
 
 CBillBoard::~CBillBoard(void)
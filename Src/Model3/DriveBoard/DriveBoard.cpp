@@ -53,6 +53,7 @@
  */
 
 #include "Supermodel.h"
+#include "Util/Trace.h"
 
 #include <cstdio>
 #include <cmath>
@@ -84,10 +85,13 @@ void CDriveBoard::SaveState(CBlockFile* SaveState)
             SaveState->Write(m_ram, RAM_SIZE);
 
             // Save interrupt and input/output state
-            SaveState->Write(&m_initialized, sizeof(m_initialized));
+            bool initialized = m_initialized;
+            UINT8 dataSent = m_dataSent;
+            UINT8 dataReceived = m_dataReceived;
+            SaveState->Write(&initialized, sizeof(initialized));
             SaveState->Write(&m_allowInterrupts, sizeof(m_allowInterrupts));
-            SaveState->Write(&m_dataSent, sizeof(m_dataSent));
-            SaveState->Write(&m_dataReceived, sizeof(m_dataReceived));
+            SaveState->Write(&dataSent, sizeof(dataSent));
+            SaveState->Write(&dataReceived, sizeof(dataReceived));
 
             // Save CPU state
             m_z80.SaveState(SaveState, "DriveBoard Z80");
@@ -123,10 +127,16 @@ void CDriveBoard::LoadState(CBlockFile* SaveState)
             SaveState->Read(m_ram, RAM_SIZE);
 
             // Load interrupt and input/output state
-            SaveState->Read(&m_initialized, sizeof(m_initialized));
+            bool initialized = false;
+            UINT8 dataSent = 0;
+            UINT8 dataReceived = 0;
+            SaveState->Read(&initialized, sizeof(initialized));
             SaveState->Read(&m_allowInterrupts, sizeof(m_allowInterrupts));
-            SaveState->Read(&m_dataSent, sizeof(m_dataSent));
-            SaveState->Read(&m_dataReceived, sizeof(m_dataReceived));
+            SaveState->Read(&dataSent, sizeof(dataSent));
+            SaveState->Read(&dataReceived, sizeof(dataReceived));
+            m_initialized = initialized;
+            m_dataSent = dataSent;
+            m_dataReceived = dataReceived;
 
             // Load CPU state
             // TODO: we should have a way to check whether this succeeds... make CZ80::LoadState() return a bool
@@ -147,7 +157,7 @@ void CDriveBoard::LoadLegacyState(const LegacyDriveBoardState &state, CBlockFile
 {
   static_assert(RAM_SIZE == sizeof(state.ram),"Ram sizes must match");
   memcpy(m_ram, state.ram, RAM_SIZE);
-  m_initialized = state.initialized;
+  m_initialized = state.initialized != 0;
   m_allowInterrupts = state.allowInterrupts;
   m_dataSent = state.dataSent;
   m_dataReceived = state.dataReceived;
@@ -222,14 +232,14 @@ void CDriveBoard::AttachInputs(CInputs* inputs, unsigned gameInputFlags)
   m_inputs = inputs;
   m_inputFlags = gameInputFlags;
 
-  DebugLog("DriveBoard attached inputs\n");
+  DEBUG_LOG(Drive, "DriveBoard attached inputs\n");
 }
 
 void CDriveBoard::AttachOutputs(COutputs* outputs)
 {
   m_outputs = outputs;
 
-  DebugLog("DriveBoard attached outputs\n");
+  DEBUG_LOG(Drive, "DriveBoard attached outputs\n");
 }
 
 
@@ -247,6 +257,31 @@ void CDriveBoard::Write(UINT8 data)
   m_dataSent = data;
 }
 
+void CDriveBoard::QueueForceFeedbackCmd(CInput *input, const ForceFeedbackCmd &ffCmd)
+{
+  unsigned tail = m_ffTail.load(std::memory_order_relaxed);
+  if (tail - m_ffHead.load(std::memory_order_acquire) >= FF_QUEUE_SIZE)
+  {
+    DEBUG_LOG(Drive, "DriveBoard force feedback queue full, command dropped\n");
+    return;
+  }
+  m_ffQueue[tail % FF_QUEUE_SIZE].input = input;
+  m_ffQueue[tail % FF_QUEUE_SIZE].ffCmd = ffCmd;
+  m_ffTail.store(tail + 1, std::memory_order_release);
+}
+
+void CDriveBoard::FlushForceFeedback(void)
+{
+  unsigned head = m_ffHead.load(std::memory_order_relaxed);
+  unsigned tail = m_ffTail.load(std::memory_order_acquire);
+  for (; head != tail; head++)
+  {
+    QueuedForceFeedbackCmd &queued = m_ffQueue[head % FF_QUEUE_SIZE];
+    queued.input->SendForceFeedbackCmd(queued.ffCmd);
+  }
+  m_ffHead.store(head, std::memory_order_release);
+}
+
 UINT8 CDriveBoard::Read8(UINT32 addr)
 {
   // TODO - shouldn't end of ROM be 0x7FFF not 0x8FFF?
@@ -267,7 +302,7 @@ void CDriveBoard::Write8(UINT32 addr, UINT8 data)
     m_ram[(addr - 0xE000) & 0x1FFF] = data;
 #ifdef DEBUG
   else
-    DebugLog("Unhandled Z80 write to %08X (at PC = %04X)\n", addr, m_z80.GetPC());
+    DEBUG_LOG(Drive, "Unhandled Z80 write to %08X (at PC = %04X)\n", addr, m_z80.GetPC());
 #endif
 }
 
@@ -282,6 +317,8 @@ void CDriveBoard::IOWrite8(UINT32 portNum, UINT8 data)
 
 void CDriveBoard::RunFrame(void)
 {
+  TRACE_ZONE("CDriveBoard::RunFrame");
+
   if (IsDisabled())
   {
     return;
@@ -401,9 +438,11 @@ CDriveBoard::CDriveBoard(const Util::Config::Node& config)
     m_z80NMI(true),
     m_inputs(NULL),
     m_inputFlags(0),
-    m_outputs(NULL)
+    m_outputs(NULL),
+    m_ffHead(0),
+    m_ffTail(0)
 {
-  DebugLog("Built Drive Board\n");
+  DEBUG_LOG(Drive, "Built Drive Board\n");
 }
 
 CDriveBoard::~CDriveBoard(void)
@@ -422,5 +461,5 @@ CDriveBoard::~CDriveBoard(void)
   m_inputs = NULL;
   m_outputs = NULL;
 
-  DebugLog("Destroyed Drive Board\n");
+  DEBUG_LOG(Drive, "Destroyed Drive Board\n");
 }
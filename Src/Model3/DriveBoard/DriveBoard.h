@@ -32,6 +32,7 @@
 
 #include "Util/NewConfig.h"
 #include "Game.h"
+#include <atomic>
 
 /*
  * CDriveBoard
@@ -208,6 +209,16 @@ public:
    */
   virtual void RunFrame(void);
 
+  /*
+   * FlushForceFeedback(void):
+   *
+   * Sends the force feedback commands queued since the last call to the
+   * input system. Called after each frame by whichever thread runs the drive
+   * board, so that commands made on the main board's thread (by simulated
+   * boards) are issued from there too.
+   */
+  void FlushForceFeedback(void);
+
   /*
      * CDriveBoard(config):
      * ~CDriveBoard():
@@ -278,6 +289,9 @@ protected:
   // Attempt to load drive board data from old save states (prior to drive board refactor)
   void LoadLegacyState(const LegacyDriveBoardState &state, CBlockFile *SaveState);
 
+  // Queue a force feedback command for FlushForceFeedback() to send to an input
+  void QueueForceFeedbackCmd(CInput *input, const ForceFeedbackCmd &ffCmd);
+
 
     const Util::Config::Node& m_config;
 
@@ -286,11 +300,12 @@ protected:
     bool m_simulated;   // True if drive board should be simulated rather than emulated
 
     // Emulation state
-    bool m_initialized;     // True if drive board has finished initialization
+    std::atomic<bool> m_initialized;  // True if drive board has finished initialization
     bool m_allowInterrupts; // True if drive board has enabled NMI interrupts
 
-    UINT8 m_dataSent;       // Last command sent by main board
-    UINT8 m_dataReceived;   // Data to send back to main board
+    // Mailbox between main board and drive board threads
+    std::atomic<UINT8> m_dataSent;      // Last command sent by main board
+    std::atomic<UINT8> m_dataReceived;  // Data to send back to main board
 
     UINT8 m_dip1;           // Value of DIP switch 1
     UINT8 m_dip2;           // Value of DIP switch 2
@@ -317,6 +332,19 @@ protected:
     unsigned m_inputFlags;
 
     COutputs* m_outputs;
+
+private:
+    // Force feedback commands from the main board's thread or the drive board's own, in a single reader ring
+    struct QueuedForceFeedbackCmd
+    {
+      CInput *input;
+      ForceFeedbackCmd ffCmd;
+    };
+    static const unsigned FF_QUEUE_SIZE = 64;
+
+    QueuedForceFeedbackCmd m_ffQueue[FF_QUEUE_SIZE];
+    std::atomic<unsigned> m_ffHead;   // next to send, advanced by FlushForceFeedback()
+    std::atomic<unsigned> m_ffTail;   // next free, advanced by QueueForceFeedbackCmd()
 };
 
 #endif  // INCLUDED_DRIVEBOARD_H
@@ -364,14 +364,14 @@ UINT8 CJoyBoard::IORead8(UINT32 portNum)
         adcVal = ReadADCChannel4();
         break;
       default:
-        DebugLog("Unhandled Z80 input on ADC port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
+        DEBUG_LOG(Drive, "Unhandled Z80 input on ADC port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
         return 0xFF;
       }
       return (adcVal >> m_adcPortBit) & 0x01;
       }
       else
       {
-        DebugLog("Unhandled Z80 input on ADC port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
+        DEBUG_LOG(Drive, "Unhandled Z80 input on ADC port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
         return 0xFF;
       }
   case 0x28: // PPC command
@@ -384,7 +384,7 @@ UINT8 CJoyBoard::IORead8(UINT32 portNum)
     //     1 1 = encoder error 3 - encoder error, reinitializes board
     return 0x00;
   default:
-    DebugLog("Unhandled Z80 input on port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
+    DEBUG_LOG(Drive, "Unhandled Z80 input on port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
     return 0xFF;
   }
 }
@@ -446,7 +446,7 @@ void CJoyBoard::IOWrite8(UINT32 portNum, UINT8 data)
   case 0xf1: // Unsure? - single byte 0x4E sent regularly - some sort of watchdog?
     return;
   default:
-    DebugLog("Unhandled Z80 output on port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
+    DEBUG_LOG(Drive, "Unhandled Z80 output on port %u (at PC = %04X)\n", portNum, m_z80.GetPC());
     return;
   }
 }
@@ -576,8 +576,8 @@ void CJoyBoard::SendStopAll(void)
   ForceFeedbackCmd ffCmd;
   ffCmd.id = FFStop;
 
-  m_inputs->analogJoyX->SendForceFeedbackCmd(ffCmd);
-  m_inputs->analogJoyY->SendForceFeedbackCmd(ffCmd);
+  QueueForceFeedbackCmd(m_inputs->analogJoyX, ffCmd);
+  QueueForceFeedbackCmd(m_inputs->analogJoyY, ffCmd);
 
   m_lastConstForce = 0;
   m_lastSelfCenter = 0;
@@ -593,27 +593,27 @@ void CJoyBoard::SendConstantForce(INT8 val)
   /*
   if (val > 0)
   {
-    DebugLog(">> Force Right %02X [%8s", val, "");
+    DEBUG_LOG(Drive, ">> Force Right %02X [%8s", val, "");
     for (unsigned i = 0; i < 8; i++)
-      DebugLog(i == 0 || i <= (val + 1) / 16 ? ">" : " ");
-    DebugLog("]\n");
+      DEBUG_LOG(Drive, i == 0 || i <= (val + 1) / 16 ? ">" : " ");
+    DEBUG_LOG(Drive, "]\n");
   }
   else if (val < 0)
   {
-    DebugLog(">> Force Left  %02X [", -val);
+    DEBUG_LOG(Drive, ">> Force Left  %02X [", -val);
     for (unsigned i = 0; i < 8; i++)
-      DebugLog(i == 7 || i >= (val + 128) / 16 ? "<" : " ");
-    DebugLog("%8s]\n", "");
+      DEBUG_LOG(Drive, i == 7 || i >= (val + 128) / 16 ? "<" : " ");
+    DEBUG_LOG(Drive, "%8s]\n", "");
   }
   else
-    DebugLog(">> Stop Force     [%16s]\n", "");
+    DEBUG_LOG(Drive, ">> Stop Force     [%16s]\n", "");
   */
 
   ForceFeedbackCmd ffCmd;
   ffCmd.id = FFConstantForce;
   ffCmd.force = (float)val / (val >= 0 ? 127.0f : 128.0f);
 
-  m_inputs->analogJoyX->SendForceFeedbackCmd(ffCmd);
+  QueueForceFeedbackCmd(m_inputs->analogJoyX, ffCmd);
 
   m_lastConstForce = val;
 }
@@ -626,7 +626,7 @@ void CJoyBoard::SendConstantForceY(INT8 val)
   ForceFeedbackCmd ffCmd;
   ffCmd.id = FFConstantForce;
   ffCmd.force = (float)val / (val >= 0 ? 127.0f : 128.0f);
-  m_inputs->analogJoyY->SendForceFeedbackCmd(ffCmd);
+  QueueForceFeedbackCmd(m_inputs->analogJoyY, ffCmd);
   m_lastConstForceY = val;
 }
 
@@ -636,17 +636,17 @@ void CJoyBoard::SendSelfCenter(UINT8 val)
     return;
   /*
   if (val == 0)
-    DebugLog(">> Stop Self-Center\n");
+    DEBUG_LOG(Drive, ">> Stop Self-Center\n");
   else
-    DebugLog(">> Self-Center %02X\n", val);
+    DEBUG_LOG(Drive, ">> Self-Center %02X\n", val);
   */
 
   ForceFeedbackCmd ffCmd;
   ffCmd.id = FFSelfCenter;
   ffCmd.force = (float)val / 255.0f;
 
-  m_inputs->analogJoyX->SendForceFeedbackCmd(ffCmd);
-  m_inputs->analogJoyY->SendForceFeedbackCmd(ffCmd);
+  QueueForceFeedbackCmd(m_inputs->analogJoyX, ffCmd);
+  QueueForceFeedbackCmd(m_inputs->analogJoyY, ffCmd);
 
   m_lastSelfCenter = val;
 }
@@ -658,15 +658,15 @@ void CJoyBoard::SendFriction(UINT8 val)
     return;
   /*
   if (val == 0)
-    DebugLog(">> Stop Friction\n");
+    DEBUG_LOG(Drive, ">> Stop Friction\n");
   else
-    DebugLog(">> Friction %02X\n", val);
+    DEBUG_LOG(Drive, ">> Friction %02X\n", val);
   */
 
   ForceFeedbackCmd ffCmd;
   ffCmd.id = FFFriction;
   ffCmd.force = (float)val / 255.0f;
-  m_inputs->analogJoyX->SendForceFeedbackCmd(ffCmd);
+  QueueForceFeedbackCmd(m_inputs->analogJoyX, ffCmd);
 
   m_lastFriction = val;
 }
@@ -677,15 +677,15 @@ void CJoyBoard::SendVibrate(UINT8 val)
     return;
   /*
   if (val == 0)
-    DebugLog(">> Stop Vibrate\n");
+    DEBUG_LOG(Drive, ">> Stop Vibrate\n");
   else
-    DebugLog(">> Vibrate %02X\n", val);
+    DEBUG_LOG(Drive, ">> Vibrate %02X\n", val);
   */
 
   ForceFeedbackCmd ffCmd;
   ffCmd.id = FFVibrate;
   ffCmd.force = (float)val / 255.0f;
-  m_inputs->analogJoyX->SendForceFeedbackCmd(ffCmd);
+  QueueForceFeedbackCmd(m_inputs->analogJoyX, ffCmd);
 
   m_lastVibrate = val;
 }
@@ -722,7 +722,7 @@ CJoyBoard::CJoyBoard(const Util::Config::Node &config)
   m_dip1 = 0xCF;
   m_dip2 = 0xFF;
 
-  DebugLog("Built Drive Board (Joystick)\n");
+  DEBUG_LOG(Drive, "Built Drive Board (Joystick)\n");
 }
 
 CJoyBoard::~CJoyBoard(void)
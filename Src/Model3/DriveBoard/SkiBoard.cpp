@@ -233,15 +233,15 @@ void CSkiBoard::SendVibrate(UINT8 val)
     return;
   /*
   if (val == 0)
-    DebugLog(">> Stop Vibrate\n");
+    DEBUG_LOG(Drive, ">> Stop Vibrate\n");
   else
-    DebugLog(">> Vibrate %02X\n", val);
+    DEBUG_LOG(Drive, ">> Vibrate %02X\n", val);
   */
 
   ForceFeedbackCmd ffCmd;
   ffCmd.id = FFVibrate;
   ffCmd.force = (float)val / 255.0f;
-  m_inputs->skiX->SendForceFeedbackCmd(ffCmd);
+  QueueForceFeedbackCmd(m_inputs->skiX, ffCmd);
 
   m_lastVibrate = val;
 }
@@ -256,7 +256,7 @@ CSkiBoard::CSkiBoard(const Util::Config::Node& config)
   m_initialized = false;
   m_dip1 = 0xCF;
 
-  DebugLog("Built Drive Board (ski pad)\n");
+  DEBUG_LOG(Drive, "Built Drive Board (ski pad)\n");
 }
 
 CSkiBoard::~CSkiBoard(void)
@@ -55,6 +55,7 @@ void CIRQ::LoadState(CBlockFile *SaveState)
 	
 	SaveState->Read(&irqEnable, sizeof(irqEnable));
 	SaveState->Read(&irqState, sizeof(irqState));
+	UpdatePending();
 }
 
 
@@ -62,14 +63,17 @@ void CIRQ::LoadState(CBlockFile *SaveState)
  Emulation Functions
 ******************************************************************************/
 
+// Low 8 bits are maskable interrupts, any above are non-maskable
+inline void CIRQ::UpdatePending(void)
+{
+	irqPending = irqState & (irqEnable | ~0xFF);
+}
+
 void CIRQ::Assert(unsigned irqBits)
 {
 	irqState |= irqBits;
-	if ((irqState&irqEnable))	// low 8 bits are maskable interrupts
-		//ppc_set_irq_line(0);
-		ppc_set_irq_line(1);
-	if ((irqState&(~0xFF)))		// any non-maskable interrupts pending?
-		//ppc_set_irq_line(0);
+	UpdatePending();
+	if (irqPending)
 		ppc_set_irq_line(1);
 }
 
@@ -77,11 +81,13 @@ void CIRQ::Assert(unsigned irqBits)
 void CIRQ::Deassert(unsigned irqBits)
 {
 	irqState &= ~irqBits;
+	UpdatePending();
 }
 
 void CIRQ::WriteIRQEnable(UINT8 data)
 {
 	irqEnable = (unsigned) data;
+	UpdatePending();
 }
 
 UINT8 CIRQ::ReadIRQEnable(void)
@@ -98,6 +104,7 @@ void CIRQ::Reset(void)
 {
 	irqEnable = 0;	// disable all
 	irqState = 0;	// no IRQs pending
+	irqPending = 0;
 }
 
 
@@ -112,7 +119,7 @@ void CIRQ::Init(void)
 
 CIRQ::CIRQ(void)
 {	
-	DebugLog("Built IRQ controller\n");
+	DEBUG_LOG(Model3, "Built IRQ controller\n");
 }
 
 /*
@@ -122,5 +129,5 @@ CIRQ::CIRQ(void)
  */
 CIRQ::~CIRQ(void)
 {	
-	DebugLog("Destroyed IRQ controller\n");
+	DEBUG_LOG(Model3, "Destroyed IRQ controller\n");
 }
@@ -142,6 +142,9 @@ public:
 private:
 	unsigned	irqEnable;	// 8 bits, 1=enabled, 0=disabled
 	unsigned	irqState;	// bits correspond to irqEnable, 1=pending, 0=not pending
+	unsigned	irqPending;	// irqState bits that are enabled or non-maskable
+
+	void	UpdatePending(void);
 };
 
 
@@ -205,7 +205,7 @@ void CJTAG::Write(uint8_t tck, uint8_t tms, uint8_t tdi, uint8_t trst)
 void CJTAG::Reset()
 {
   m_state = State::TestLogicReset;
-  DebugLog("JTAG reset\n");
+  DEBUG_LOG(Model3, "JTAG reset\n");
 }
 
 CJTAG::CJTAG(CReal3D &real3D)
@@ -213,5 +213,5 @@ CJTAG::CJTAG(CReal3D &real3D)
     m_instructionShiftReg(46, 0),
     m_dataShiftReg(197, 0)
 {
-  DebugLog("Built JTAG logic\n");
+  DEBUG_LOG(Model3, "Built JTAG logic\n");
 }
\ No newline at end of file
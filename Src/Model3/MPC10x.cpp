@@ -97,6 +97,7 @@ void CMPC10x::LoadState(CBlockFile *SaveState)
 	SaveState->Read(&pciDevice, sizeof(pciDevice));
 	SaveState->Read(&pciFunction, sizeof(pciFunction));
 	SaveState->Read(&pciReg, sizeof(pciReg));
+	DecodePCIConfigAddress();
 }
 
 
@@ -123,7 +124,7 @@ void CMPC10x::WritePCIConfigAddress(UINT32 data)
 #ifdef DEBUG
 	if (pciDevice == 0)
 	{
-		DebugLog("MPC10x: Device 0 configuration access: %08X\n", d);
+		DEBUG_LOG(Model3, "MPC10x: Device 0 configuration access: %08X\n", d);
 		if ((d&3))
 			ErrorLog("MPC10x: Device 0 configuration address with low bits set: %08X\n", d);
 	}
@@ -133,8 +134,26 @@ void CMPC10x::WritePCIConfigAddress(UINT32 data)
 	if (pciBus != 0)
 	{
 		//printf("Multiple PCI buses detected!\n");
-		DebugLog("Multiple PCI buses detected!\n");
+		DEBUG_LOG(Model3, "Multiple PCI buses detected!\n");
 	}
+	
+	DecodePCIConfigAddress();
+}
+
+/*
+ * CMPC10x::DecodePCIConfigAddress(void):
+ *
+ * Looks up the device and register selected by the configuration address, so
+ * that the configuration data register, which some games poll, can go straight
+ * to the device.
+ */
+void CMPC10x::DecodePCIConfigAddress(void)
+{
+	pciTargetReg = (pciReg>>2)&0x3C;
+	if ((pciDevice == 0) || (PCIBus == NULL))
+		pciTarget = NULL;
+	else
+		pciTarget = PCIBus->FindDevice(pciDevice);
 }
 
 /*
@@ -171,8 +190,10 @@ UINT32 CMPC10x::ReadPCIConfigData(unsigned bits, unsigned offset)
 		}
 	}
 	
-	// All other PCI devices passed to PCI bus
-	return PCIBus->ReadConfigSpace(pciDevice, (pciReg>>2)&0x3C, bits, offset);
+	// All other PCI devices passed to PCI bus, unless already found
+	if (pciTarget != NULL)
+		return pciTarget->ReadPCIConfigSpace(pciDevice, pciTargetReg, bits, offset);
+	return PCIBus->ReadConfigSpace(pciDevice, pciTargetReg, bits, offset);
 }
 
 /*
@@ -215,7 +236,10 @@ void CMPC10x::WritePCIConfigData(unsigned bits, unsigned offset, UINT32 data)
 		return;
 	}
 	
-	PCIBus->WriteConfigSpace(pciDevice, (pciReg>>2)&0x3C, bits, offset, data);
+	if (pciTarget != NULL)
+		pciTarget->WritePCIConfigSpace(pciDevice, pciTargetReg, bits, offset, data);
+	else
+		PCIBus->WriteConfigSpace(pciDevice, pciTargetReg, bits, offset, data);
 }
 
 /*
@@ -281,8 +305,9 @@ void CMPC10x::Reset(void)
 	pciDevice = 0;
 	pciFunction = 0;
 	pciReg = 0;
+	DecodePCIConfigAddress();
 	
-	DebugLog("MPC%X reset\n", model);
+	DEBUG_LOG(Model3, "MPC%X reset\n", model);
 }
 
 
@@ -298,7 +323,7 @@ void CMPC10x::Reset(void)
 void CMPC10x::AttachPCIBus(CPCIBus *BusObjectPtr)
 {
 	PCIBus = BusObjectPtr;
-	DebugLog("MPC10x connected to a PCI bus\n");
+	DEBUG_LOG(Model3, "MPC10x connected to a PCI bus\n");
 }
 
 /*
@@ -316,7 +341,7 @@ void CMPC10x::SetModel(int modelNum)
 		model = 0x105;
 	}
 	
-	DebugLog("MPC10x set to MPC%X\n", model);
+	DEBUG_LOG(Model3, "MPC10x set to MPC%X\n", model);
 }
 
 /*
@@ -352,7 +377,9 @@ CMPC10x::CMPC10x(void)
 	pciDevice = 0;
 	pciFunction = 0;
 	pciReg = 0;
-	DebugLog("Built MPC10x\n");
+	pciTarget = NULL;
+	pciTargetReg = 0;
+	DEBUG_LOG(Model3, "Built MPC10x\n");
 }
 
 /*
@@ -363,5 +390,5 @@ CMPC10x::CMPC10x(void)
 CMPC10x::~CMPC10x(void)
 {
 	PCIBus = NULL;
-	DebugLog("Destroyed MPC10x\n");
+	DEBUG_LOG(Model3, "Destroyed MPC10x\n");
 }
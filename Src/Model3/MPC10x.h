@@ -180,6 +180,12 @@ private:
 	unsigned	pciDevice;		// PCI device component (5 bits)
 	unsigned	pciFunction;	// PCI function component (3 bits)
 	unsigned	pciReg;			// PCI register component (7 bits)
+	
+	// Decoded from the above by DecodePCIConfigAddress()
+	IPCIDevice	*pciTarget;		// selected PCI device (NULL for self-access or unknown devices)
+	unsigned	pciTargetReg;	// register number passed to it
+	
+	void DecodePCIConfigAddress(void);
 };
 
 
@@ -211,6 +211,7 @@
  */
 
 #include <new>
+#include <sys/stat.h>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -223,10 +224,16 @@
 #endif // NET_BOARD
 #include "Util/Format.h"
 #include "Util/ByteSwap.h"
+#include "Util/Hash.h"
+#include "Util/MappedMemory.h"
+#include "Util/Trace.h"
+#include "Util/AllocTracker.h"
 #include <functional>
 #include <set>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 /******************************************************************************
  Model 3 Inputs
@@ -234,312 +241,404 @@
  Game controls. The EEPROM is mapped here as well.
 ******************************************************************************/
 
-UINT8 CModel3::ReadInputs(unsigned reg)
+/*
+ * Builds the values of the input registers from the polled inputs once a
+ * frame, just before the main board runs it, so that the many reads the game
+ * makes of them are table lookups. Only the EEPROM bit and the drive board's
+ * bits are read live.
+ */
+void CModel3::LatchInputs(void)
 {
-  UINT8 adc[8];
   UINT8 data;
-  reg &= 0x3F;
-  switch (reg)
+  UINT8 *adc = m_inputImage.adc;
+
+  if (NULL == Inputs)
+    return;
+
+  // Offset 0x04, bank 0
+  data = 0xFF;
+  data &= ~(Inputs->coin[0]->value);        // Coin 1
+  data &= ~(Inputs->coin[1]->value<<1);     // Coin 2
+  data &= ~(Inputs->test[0]->value<<2);     // Test A
+  data &= ~(Inputs->service[0]->value<<3);  // Service A
+  data &= ~(Inputs->start[0]->value<<4);    // Start 1
+  data &= ~(Inputs->start[1]->value<<5);    // Start 2
+  if ((m_game.inputs & Game::INPUT_SKI))
   {
-  case 0x00:  // input bank
-    return inputBank;
+    data &= ~(Inputs->skiPollLeft->value<<5);
+    data &= ~(Inputs->skiSelect1->value<<6);
+    data &= ~(Inputs->skiSelect2->value<<7);
+    data &= ~(Inputs->skiSelect3->value<<4);
+  }
 
-  case 0x04:  // current input bank
+  m_inputImage.bank[0] = data;
 
-    data = 0xFF;
+  // Offset 0x04, bank 1 (EEPROM bit is merged in when read)
+  data = 0xFF;
+  data &= ~(Inputs->service[1]->value<<6);  // Service B
+  data &= ~(Inputs->test[1]->value<<7);     // Test B
+  m_inputImage.bank[1] = data;
 
-    if ((inputBank&1) == 0)
-    {
-      data &= ~(Inputs->coin[0]->value);        // Coin 1
-      data &= ~(Inputs->coin[1]->value<<1);     // Coin 2
-      data &= ~(Inputs->test[0]->value<<2);     // Test A
-      data &= ~(Inputs->service[0]->value<<3);  // Service A
-      data &= ~(Inputs->start[0]->value<<4);    // Start 1
-      data &= ~(Inputs->start[1]->value<<5);    // Start 2
-    }
-    else
-    {
-      data &= ~(Inputs->service[1]->value<<6);  // Service B
-      data &= ~(Inputs->test[1]->value<<7);     // Test B
-      data = (data&0xDF)|(EEPROM.Read()<<5);    // bank 1 contains EEPROM data bit
-    }
+  // Offset 0x08
+  data = 0xFF;
 
-    if ((m_game.inputs & Game::INPUT_SKI))
-    {
-      if ((inputBank&1) == 0)
-      {
-        data &= ~(Inputs->skiPollLeft->value<<5);
-        data &= ~(Inputs->skiSelect1->value<<6);
-        data &= ~(Inputs->skiSelect2->value<<7);
-        data &= ~(Inputs->skiSelect3->value<<4);
-      }
-    }
+  if ((m_game.inputs & Game::INPUT_SKI))
+  {
+    data &= ~(Inputs->skiPollRight->value<<0);
+  }
 
-    return data;
+  if ((m_game.inputs & Game::INPUT_JOYSTICK1))
+  {
+    data &= ~(Inputs->up[0]->value<<5);     // P1 Up
+    data &= ~(Inputs->down[0]->value<<4);   // P1 Down
+    data &= ~(Inputs->left[0]->value<<7);   // P1 Left
+    data &= ~(Inputs->right[0]->value<<6);  // P1 Right
+  }
 
-  case 0x08:  // game-specific inputs
+  if ((m_game.inputs & Game::INPUT_FIGHTING))
+  {
+    data &= ~(Inputs->escape[0]->value<<3); // P1 Escape
+    data &= ~(Inputs->guard[0]->value<<2);  // P1 Guard
+    data &= ~(Inputs->kick[0]->value<<1);   // P1 Kick
+    data &= ~(Inputs->punch[0]->value<<0);  // P1 Punch
+  }
 
-    data = 0xFF;
+  if ((m_game.inputs & Game::INPUT_SPIKEOUT))
+  {
+    data &= ~(Inputs->shift->value<<2);     // Shift
+    data &= ~(Inputs->beat->value<<0);      // Beat
+    data &= ~(Inputs->charge->value<<1);    // Charge
+    data &= ~(Inputs->jump->value<<3);      // Jump
+  }
 
-    if ((m_game.inputs & Game::INPUT_SKI))
-    {
-      data &= ~(Inputs->skiPollRight->value<<0);
-    }
+  if ((m_game.inputs & Game::INPUT_SOCCER))
+  {
+    data &= ~(Inputs->shortPass[0]->value<<2);  // P1 Short Pass
+    data &= ~(Inputs->longPass[0]->value<<0);   // P1 Long Pass
+    data &= ~(Inputs->shoot[0]->value<<1);      // P1 Shoot
+  }
 
-    if ((m_game.inputs & Game::INPUT_JOYSTICK1))
-    {
-      data &= ~(Inputs->up[0]->value<<5);     // P1 Up
-      data &= ~(Inputs->down[0]->value<<4);   // P1 Down
-      data &= ~(Inputs->left[0]->value<<7);   // P1 Left
-      data &= ~(Inputs->right[0]->value<<6);  // P1 Right
-    }
+  if ((m_game.inputs & Game::INPUT_VR4))
+  {
+    data &= ~(Inputs->vr[0]->value<<0); // VR1 Red
+    data &= ~(Inputs->vr[1]->value<<1); // VR2 Blue
+    data &= ~(Inputs->vr[2]->value<<2); // VR3 Yellow
+    data &= ~(Inputs->vr[3]->value<<3); // VR4 Green
+  }
 
-    if ((m_game.inputs & Game::INPUT_FIGHTING))
-    {
-      data &= ~(Inputs->escape[0]->value<<3); // P1 Escape
-      data &= ~(Inputs->guard[0]->value<<2);  // P1 Guard
-      data &= ~(Inputs->kick[0]->value<<1);   // P1 Kick
-      data &= ~(Inputs->punch[0]->value<<0);  // P1 Punch
-    }
+  if ((m_game.inputs & Game::INPUT_VIEWCHANGE))
+  {
+    // Harley is wired slightly differently
+    if ((m_game.inputs & Game::INPUT_HARLEY))
+      data &= ~(Inputs->viewChange->value<<1);  // View change
+    else
+      data &= ~(Inputs->viewChange->value<<0);  // View change
+  }
 
-    if ((m_game.inputs & Game::INPUT_SPIKEOUT))
-    {
-      data &= ~(Inputs->shift->value<<2);     // Shift
-      data &= ~(Inputs->beat->value<<0);      // Beat
-      data &= ~(Inputs->charge->value<<1);    // Charge
-      data &= ~(Inputs->jump->value<<3);      // Jump
-    }
+  if ((m_game.inputs & Game::INPUT_SHIFT4))
+  {
+    if (Inputs->gearShift4->value == 2)       // Shift 2
+      data &= ~0x60;
+    else if (Inputs->gearShift4->value == 4)  // Shift 4
+      data &= ~0x20;
+    if (Inputs->gearShift4->value == 1)       // Shift 1
+      data &= ~0x50;
+    else if (Inputs->gearShift4->value == 3)  // Shift 3
+      data &= ~0x10;
+  }
 
-    if ((m_game.inputs & Game::INPUT_SOCCER))
+  if ((m_game.inputs & Game::INPUT_SHIFTUPDOWN))
+  {
+    // Harley is wired slightly differently
+    if ((m_game.inputs & Game::INPUT_HARLEY))
     {
-      data &= ~(Inputs->shortPass[0]->value<<2);  // P1 Short Pass
-      data &= ~(Inputs->longPass[0]->value<<0);   // P1 Long Pass
-      data &= ~(Inputs->shoot[0]->value<<1);      // P1 Shoot
+      if (Inputs->gearShiftUp->value)         // Shift up
+        data &= ~0x20;
+      else if (Inputs->gearShiftDown->value)  // Shift down
+        data &= ~0x10;
     }
-
-    if ((m_game.inputs & Game::INPUT_VR4))
+    else
     {
-      data &= ~(Inputs->vr[0]->value<<0); // VR1 Red
-      data &= ~(Inputs->vr[1]->value<<1); // VR2 Blue
-      data &= ~(Inputs->vr[2]->value<<2); // VR3 Yellow
-      data &= ~(Inputs->vr[3]->value<<3); // VR4 Green
+      if (Inputs->gearShiftUp->value)         // Shift up
+        data &= ~0x50;
+      else if (Inputs->gearShiftDown->value)  // Shift down
+        data &= ~0x60;
     }
+  }
 
-    if ((m_game.inputs & Game::INPUT_VIEWCHANGE))
-    {
-      // Harley is wired slightly differently
-      if ((m_game.inputs & Game::INPUT_HARLEY))
-        data &= ~(Inputs->viewChange->value<<1);  // View change
-      else
-        data &= ~(Inputs->viewChange->value<<0);  // View change
-    }
+  if ((m_game.inputs & Game::INPUT_HANDBRAKE))
+    data &= ~(Inputs->handBrake->value<<1);   // Hand brake
+
+  if ((m_game.inputs & Game::INPUT_HARLEY))
+    data &= ~(Inputs->musicSelect->value<<0); // Music select
 
-    if ((m_game.inputs & Game::INPUT_SHIFT4))
+  if ((m_game.inputs & Game::INPUT_GUN1))
+    data &= ~(Inputs->trigger[0]->value<<0);  // P1 Trigger
+
+  if ((m_game.inputs & Game::INPUT_ANALOG_JOYSTICK))
+  {
+    data &= ~(Inputs->analogJoyTrigger1->value<<5); // Trigger 1
+    data &= ~(Inputs->analogJoyTrigger2->value<<4); // Trigger 2
+    data &= ~(Inputs->analogJoyEvent1->value<<0);   // Event Button 1
+    data &= ~(Inputs->analogJoyEvent2->value<<1);   // Event Button 2
+  }
+
+  if ((m_game.inputs & Game::INPUT_TWIN_JOYSTICKS)) // First twin joystick
+  {
+    /*
+     * Process left joystick inputs first
+     */
+
+    // Shot trigger and Turbo
+    data &= ~(Inputs->twinJoyShot1->value<<0);
+    data &= ~(Inputs->twinJoyTurbo1->value<<1);
+
+    // Stick
+    data &= ~(Inputs->twinJoyLeft1->value<<7);
+    data &= ~(Inputs->twinJoyRight1->value<<6);
+    data &= ~(Inputs->twinJoyUp1->value<<5);
+    data &= ~(Inputs->twinJoyDown1->value<<4);
+
+    /*
+     * Next, process twin joystick macro inputs (higher level inputs
+     * that map to actions on both joysticks simultaneously).
+     */
+
+    /*
+     * Forward/reverse/turn are mutually exclusive.
+     *
+     * Turn Left:   1D 2U
+     * Turn Right:  1U 2D
+     * Forward:     1U 2U
+     * Reverse:     1D 2D
+     */
+    if (Inputs->twinJoyTurnLeft->value)
+      data &= ~0x10;
+    else if (Inputs->twinJoyTurnRight->value)
+      data &= ~0x20;
+    else if (Inputs->twinJoyForward->value)
+      data &= ~0x20;
+    else if (Inputs->twinJoyReverse->value)
+      data &= ~0x10;
+
+    /*
+     * Strafe/crouch/jump are mutually exclusive.
+     *
+     * Strafe Left:   1L 2L
+     * Strafe Right:  1R 2R
+     * Jump:          1L 2R
+     * Crouch:        1R 2L
+     */
+    if (Inputs->twinJoyStrafeLeft->value)
+      data &= ~0x80;
+    else if (Inputs->twinJoyStrafeRight->value)
+      data &= ~0x40;
+    else if (Inputs->twinJoyJump->value)
+      data &= ~0x80;
+    else if (Inputs->twinJoyCrouch->value)
+      data &= ~0x40;
+  }
+
+  if ((m_game.inputs & Game::INPUT_ANALOG_GUN1))
+  {
+    data &= ~(Inputs->analogTriggerLeft[0]->value<<0);
+    data &= ~(Inputs->analogTriggerRight[0]->value<<1);
+  }
+
+  if ((m_game.inputs & Game::INPUT_MAGTRUCK))
+    data &= ~(Inputs->magicalPedal1->value << 0);
+
+  if ((m_game.inputs & Game::INPUT_FISHING))
+  {
+    if (m_game.name == "getbassur")
     {
-      if (Inputs->gearShift4->value == 2)       // Shift 2
-        data &= ~0x60;
-      else if (Inputs->gearShift4->value == 4)  // Shift 4
-        data &= ~0x20;
-      if (Inputs->gearShift4->value == 1)       // Shift 1
-        data &= ~0x50;
-      else if (Inputs->gearShift4->value == 3)  // Shift 3
-        data &= ~0x10;
+      // bass fishing
+      data &= ~(Inputs->fishingCast->value << 0);
+      data &= ~(Inputs->fishingSelect->value << 1);
     }
-
-    if ((m_game.inputs & Game::INPUT_SHIFTUPDOWN))
+    else
     {
-      // Harley is wired slightly differently
-      if ((m_game.inputs & Game::INPUT_HARLEY))
-      {
-        if (Inputs->gearShiftUp->value)         // Shift up
-          data &= ~0x20;
-        else if (Inputs->gearShiftDown->value)  // Shift down
-          data &= ~0x10;
-      }
-      else
-      {
-        if (Inputs->gearShiftUp->value)         // Shift up
-          data &= ~0x50;
-        else if (Inputs->gearShiftDown->value)  // Shift down
-          data &= ~0x60;
-      }
+      // get bass fishing
+      data &= ~(!Inputs->fishingCast->value << 4);
+      data &= ~(!Inputs->fishingSelect->value << 5);
     }
+  }
+  m_inputImage.gameInputs[0] = data;
 
-    if ((m_game.inputs & Game::INPUT_HANDBRAKE))
-      data &= ~(Inputs->handBrake->value<<1);   // Hand brake
+  // Offset 0x0C (drive board bits are combined with these when read)
+  data = 0xFF;
 
-    if ((m_game.inputs & Game::INPUT_HARLEY))
-      data &= ~(Inputs->musicSelect->value<<0); // Music select
+  if ((m_game.inputs & Game::INPUT_JOYSTICK2))
+  {
+    data &= ~(Inputs->up[1]->value<<5);     // P2 Up
+    data &= ~(Inputs->down[1]->value<<4);   // P2 Down
+    data &= ~(Inputs->left[1]->value<<7);   // P2 Left
+    data &= ~(Inputs->right[1]->value<<6);  // P2 Right
+  }
 
-    if ((m_game.inputs & Game::INPUT_GUN1))
-      data &= ~(Inputs->trigger[0]->value<<0);  // P1 Trigger
+  if ((m_game.inputs & Game::INPUT_FIGHTING))
+  {
+    data &= ~(Inputs->escape[1]->value<<3); // P2 Escape
+    data &= ~(Inputs->guard[1]->value<<2);  // P2 Guard
+    data &= ~(Inputs->kick[1]->value<<1);   // P2 Kick
+    data &= ~(Inputs->punch[1]->value<<0);  // P2 Punch
+  }
 
-    if ((m_game.inputs & Game::INPUT_ANALOG_JOYSTICK))
-    {
-      data &= ~(Inputs->analogJoyTrigger1->value<<5); // Trigger 1
-      data &= ~(Inputs->analogJoyTrigger2->value<<4); // Trigger 2
-      data &= ~(Inputs->analogJoyEvent1->value<<0);   // Event Button 1
-      data &= ~(Inputs->analogJoyEvent2->value<<1);   // Event Button 2
-    }
+  if ((m_game.inputs & Game::INPUT_SOCCER))
+  {
+    data &= ~(Inputs->shortPass[1]->value<<2);  // P2 Short Pass
+    data &= ~(Inputs->longPass[1]->value<<0);   // P2 Long Pass
+    data &= ~(Inputs->shoot[1]->value<<1);      // P2 Shoot
+  }
 
-    if ((m_game.inputs & Game::INPUT_TWIN_JOYSTICKS)) // First twin joystick
-    {
-      /*
-       * Process left joystick inputs first
-       */
-
-      // Shot trigger and Turbo
-      data &= ~(Inputs->twinJoyShot1->value<<0);
-      data &= ~(Inputs->twinJoyTurbo1->value<<1);
-
-      // Stick
-      data &= ~(Inputs->twinJoyLeft1->value<<7);
-      data &= ~(Inputs->twinJoyRight1->value<<6);
-      data &= ~(Inputs->twinJoyUp1->value<<5);
-      data &= ~(Inputs->twinJoyDown1->value<<4);
-
-      /*
-       * Next, process twin joystick macro inputs (higher level inputs
-       * that map to actions on both joysticks simultaneously).
-       */
-
-      /*
-       * Forward/reverse/turn are mutually exclusive.
-       *
-       * Turn Left:   1D 2U
-       * Turn Right:  1U 2D
-       * Forward:     1U 2U
-       * Reverse:     1D 2D
-       */
-      if (Inputs->twinJoyTurnLeft->value)
-        data &= ~0x10;
-      else if (Inputs->twinJoyTurnRight->value)
-        data &= ~0x20;
-      else if (Inputs->twinJoyForward->value)
-        data &= ~0x20;
-      else if (Inputs->twinJoyReverse->value)
-        data &= ~0x10;
+  if ((m_game.inputs & Game::INPUT_TWIN_JOYSTICKS)) // Second twin joystick (see register 0x08 for comments)
+  {
 
-      /*
-       * Strafe/crouch/jump are mutually exclusive.
-       *
-       * Strafe Left:   1L 2L
-       * Strafe Right:  1R 2R
-       * Jump:          1L 2R
-       * Crouch:        1R 2L
-       */
-      if (Inputs->twinJoyStrafeLeft->value)
-        data &= ~0x80;
-      else if (Inputs->twinJoyStrafeRight->value)
-        data &= ~0x40;
-      else if (Inputs->twinJoyJump->value)
-        data &= ~0x80;
-      else if (Inputs->twinJoyCrouch->value)
-        data &= ~0x40;
-    }
+    data &= ~(Inputs->twinJoyShot2->value<<0);
+    data &= ~(Inputs->twinJoyTurbo2->value<<1);
+
+    data &= ~(Inputs->twinJoyLeft2->value<<7);
+    data &= ~(Inputs->twinJoyRight2->value<<6);
+    data &= ~(Inputs->twinJoyUp2->value<<5);
+    data &= ~(Inputs->twinJoyDown2->value<<4);
+
+    if (Inputs->twinJoyTurnLeft->value)
+      data &= ~0x20;
+    else if (Inputs->twinJoyTurnRight->value)
+      data &= ~0x10;
+    else if (Inputs->twinJoyForward->value)
+      data &= ~0x20;
+    else if (Inputs->twinJoyReverse->value)
+      data &= ~0x10;
+
+    if (Inputs->twinJoyStrafeLeft->value)
+      data &= ~0x80;
+    else if (Inputs->twinJoyStrafeRight->value)
+      data &= ~0x40;
+    else if (Inputs->twinJoyJump->value)
+      data &= ~0x40;
+    else if (Inputs->twinJoyCrouch->value)
+      data &= ~0x80;
+  }
 
-    if ((m_game.inputs & Game::INPUT_ANALOG_GUN1))
-    {
-      data &= ~(Inputs->analogTriggerLeft[0]->value<<0);
-      data &= ~(Inputs->analogTriggerRight[0]->value<<1);
-    }
+  if ((m_game.inputs & Game::INPUT_GUN2))
+    data &= ~(Inputs->trigger[1]->value<<0);  // P2 Trigger
 
-    if ((m_game.inputs & Game::INPUT_MAGTRUCK))
-      data &= ~(Inputs->magicalPedal1->value << 0);
+  if ((m_game.inputs & Game::INPUT_ANALOG_GUN2))
+  {
+    data &= ~(Inputs->analogTriggerLeft[1]->value<<0);
+    data &= ~(Inputs->analogTriggerRight[1]->value<<1);
+  }
 
-    if ((m_game.inputs & Game::INPUT_FISHING))
-    {
-      if (m_game.name == "getbassur")
-      {
-        // bass fishing
-        data &= ~(Inputs->fishingCast->value << 0);
-        data &= ~(Inputs->fishingSelect->value << 1);
-      }
-      else
-      {
-        // get bass fishing
-        data &= ~(!Inputs->fishingCast->value << 4);
-        data &= ~(!Inputs->fishingSelect->value << 5);
-      }
-    }
-    return data;
+  if ((m_game.inputs & Game::INPUT_MAGTRUCK))
+    data &= ~(Inputs->magicalPedal2->value << 0);
 
-  case 0x0C:  // game-specific inputs
+  m_inputImage.gameInputs[1] = data;
 
-    data = 0xFF;
+  // ADC channels
+  memset(adc, 0, sizeof(m_inputImage.adc));
+  if ((m_game.inputs & Game::INPUT_VEHICLE))
+  {
+    adc[0] = (UINT8)Inputs->steering->value;
+    adc[1] = (UINT8)Inputs->accelerator->value;
+    adc[2] = (UINT8)Inputs->brake->value;
+    if ((m_game.inputs & Game::INPUT_HARLEY))
+      adc[3] = (UINT8)Inputs->rearBrake->value;
+  }
 
-    if (DriveBoard->IsAttached() && DriveBoard->GetType() != Game::DRIVE_BOARD_BILLBOARD)
-    {
-      // If driveboard is set as billboard, don't read BillBoard reg (no inputs)
-      data = DriveBoard->Read();
-    }
+  if ((m_game.inputs & Game::INPUT_ANALOG_JOYSTICK))
+  {
+    adc[0] = (UINT8)Inputs->analogJoyY->value;
+    adc[1] = (UINT8)Inputs->analogJoyX->value;
+  }
 
-    if ((m_game.inputs & Game::INPUT_JOYSTICK2))
-    {
-      data &= ~(Inputs->up[1]->value<<5);     // P2 Up
-      data &= ~(Inputs->down[1]->value<<4);   // P2 Down
-      data &= ~(Inputs->left[1]->value<<7);   // P2 Left
-      data &= ~(Inputs->right[1]->value<<6);  // P2 Right
+  if (m_game.inputs & (Game::INPUT_ANALOG_GUN1 | Game::INPUT_ANALOG_GUN2))
+  {
+    adc[0] = (UINT8)Inputs->analogGunX[0]->value;
+    adc[2] = (UINT8)Inputs->analogGunY[0]->value;
+    adc[1] = (UINT8)Inputs->analogGunX[1]->value;
+    adc[3] = (UINT8)Inputs->analogGunY[1]->value;
+
+	  // Unclear why this is necessary or how to cleanly fix it, so I'm
+	  // disabling it but leaving it here for future reference. The proper fix is
+	  // probably to allow users to define inverted controls for this game only,
+	  // which means the input system must support loading per-game config (not
+	  // all analog_gun games require axis inversion to be playable).
+	  if (m_game.name == "lostwsga" || m_game.name == "lostwsgo")
+	  { // to do, not a string compare
+      adc[0] =       (UINT8)Inputs->analogGunX[0]->value; // order is different for some reason in lost world
+      adc[1] = 255 - (UINT8)Inputs->analogGunY[0]->value; // why are values inverted? is this the wrong place to fix this
+      adc[2] =       (UINT8)Inputs->analogGunX[1]->value;
+      adc[3] = 255 - (UINT8)Inputs->analogGunY[1]->value;
     }
+  }
 
-    if ((m_game.inputs & Game::INPUT_FIGHTING))
-    {
-      data &= ~(Inputs->escape[1]->value<<3); // P2 Escape
-      data &= ~(Inputs->guard[1]->value<<2);  // P2 Guard
-      data &= ~(Inputs->kick[1]->value<<1);   // P2 Kick
-      data &= ~(Inputs->punch[1]->value<<0);  // P2 Punch
-    }
+  if ((m_game.inputs & Game::INPUT_SKI))
+  {
+    adc[0] = (UINT8)Inputs->skiY->value;
+    adc[1] = (UINT8)Inputs->skiX->value;
+  }
 
-    if ((m_game.inputs & Game::INPUT_SOCCER))
-    {
-      data &= ~(Inputs->shortPass[1]->value<<2);  // P2 Short Pass
-      data &= ~(Inputs->longPass[1]->value<<0);   // P2 Long Pass
-      data &= ~(Inputs->shoot[1]->value<<1);      // P2 Shoot
-    }
+  if ((m_game.inputs & Game::INPUT_MAGTRUCK))
+  {
+    adc[0] = uint8_t(Inputs->magicalLever1->value);
+    adc[1] = uint8_t(Inputs->magicalLever2->value);
+  }
 
-    if ((m_game.inputs & Game::INPUT_TWIN_JOYSTICKS)) // Second twin joystick (see register 0x08 for comments)
-    {
+  if ((m_game.inputs & Game::INPUT_FISHING))
+  {
+    adc[0] = uint8_t(Inputs->fishingRodY->value);
+    adc[1] = uint8_t(Inputs->fishingRodX->value);
+    adc[2] = uint8_t(Inputs->fishingTension->value); // get bass fishing only : Tension Sensor ?
+    adc[3] = uint8_t(Inputs->fishingReel->value);
+    adc[5] = uint8_t(Inputs->fishingStickX->value);
+    adc[4] = uint8_t(Inputs->fishingStickY->value);
+  }
 
-      data &= ~(Inputs->twinJoyShot2->value<<0);
-      data &= ~(Inputs->twinJoyTurbo2->value<<1);
+  // Light gun registers
+  if ((m_game.inputs & Game::INPUT_GUN1||m_game.inputs & Game::INPUT_GUN2))
+  {
+    m_inputImage.gun[0] = Inputs->gunY[0]->value&0xFF;        // Player 1 gun Y (low 8 bits)
+    m_inputImage.gun[1] = (Inputs->gunY[0]->value>>8)&3;      // Player 1 gun Y (high 2 bits)
+    m_inputImage.gun[2] = Inputs->gunX[0]->value&0xFF;        // Player 1 gun X (low 8 bits)
+    m_inputImage.gun[3] = (Inputs->gunX[0]->value>>8)&3;      // Player 1 gun X (high 2 bits)
+    m_inputImage.gun[4] = Inputs->gunY[1]->value&0xFF;        // Player 2 gun Y (low 8 bits)
+    m_inputImage.gun[5] = (Inputs->gunY[1]->value>>8)&3;      // Player 2 gun Y (high 2 bits)
+    m_inputImage.gun[6] = Inputs->gunX[1]->value&0xFF;        // Player 2 gun X (low 8 bits)
+    m_inputImage.gun[7] = (Inputs->gunX[1]->value>>8)&3;      // Player 2 gun X (high 2 bits)
+    m_inputImage.gun[8] = (Inputs->trigger[1]->offscreenValue<<1)|Inputs->trigger[0]->offscreenValue; // Off-screen indicator (bit 0 = player 1, bit 1 = player 2, set indicates off screen)
+  }
+}
 
-      data &= ~(Inputs->twinJoyLeft2->value<<7);
-      data &= ~(Inputs->twinJoyRight2->value<<6);
-      data &= ~(Inputs->twinJoyUp2->value<<5);
-      data &= ~(Inputs->twinJoyDown2->value<<4);
+UINT8 CModel3::ReadInputs(unsigned reg)
+{
+  UINT8 data;
+  reg &= 0x3F;
+  switch (reg)
+  {
+  case 0x00:  // input bank
+    return inputBank;
 
-      if (Inputs->twinJoyTurnLeft->value)
-        data &= ~0x20;
-      else if (Inputs->twinJoyTurnRight->value)
-        data &= ~0x10;
-      else if (Inputs->twinJoyForward->value)
-        data &= ~0x20;
-      else if (Inputs->twinJoyReverse->value)
-        data &= ~0x10;
+  case 0x04:  // current input bank
+    data = m_inputImage.bank[inputBank&1];
+    if ((inputBank&1) != 0)
+      data = (data&0xDF)|(EEPROM.Read()<<5);    // bank 1 contains EEPROM data bit
+    return data;
 
-      if (Inputs->twinJoyStrafeLeft->value)
-        data &= ~0x80;
-      else if (Inputs->twinJoyStrafeRight->value)
-        data &= ~0x40;
-      else if (Inputs->twinJoyJump->value)
-        data &= ~0x40;
-      else if (Inputs->twinJoyCrouch->value)
-        data &= ~0x80;
-    }
+  case 0x08:  // game-specific inputs
+    return m_inputImage.gameInputs[0];
+
+  case 0x0C:  // game-specific inputs
 
-    if ((m_game.inputs & Game::INPUT_GUN2))
-      data &= ~(Inputs->trigger[1]->value<<0);  // P2 Trigger
+    data = 0xFF;
 
-    if ((m_game.inputs & Game::INPUT_ANALOG_GUN2))
+    if (DriveBoard->IsAttached() && DriveBoard->GetType() != Game::DRIVE_BOARD_BILLBOARD)
     {
-      data &= ~(Inputs->analogTriggerLeft[1]->value<<0);
-      data &= ~(Inputs->analogTriggerRight[1]->value<<1);
+      // If driveboard is set as billboard, don't read BillBoard reg (no inputs)
+      data = DriveBoard->Read();
     }
 
-    if ((m_game.inputs & Game::INPUT_MAGTRUCK))
-      data &= ~(Inputs->magicalPedal2->value << 0);
-
-    return data;
+    return data & m_inputImage.gameInputs[1];
 
   case 0x18:         // swtrilgy and getbass. Remove IO board error on getbass. Not sure, but may be related to device feedback ?
       data = 0x7f;   // Note : when this returned value is wrong, there is a side effect on Ocean Hunter game, a sort of 3d interlaced effect
@@ -560,69 +659,7 @@ UINT8 CModel3::ReadInputs(unsigned reg)
     }
 
   case 0x3C:  // ADC
-
-    // Load ADC channels with input data
-    memset(adc, 0, sizeof(adc));
-    if ((m_game.inputs & Game::INPUT_VEHICLE))
-    {
-      adc[0] = (UINT8)Inputs->steering->value;
-      adc[1] = (UINT8)Inputs->accelerator->value;
-      adc[2] = (UINT8)Inputs->brake->value;
-      if ((m_game.inputs & Game::INPUT_HARLEY))
-        adc[3] = (UINT8)Inputs->rearBrake->value;
-    }
-
-    if ((m_game.inputs & Game::INPUT_ANALOG_JOYSTICK))
-    {
-      adc[0] = (UINT8)Inputs->analogJoyY->value;
-      adc[1] = (UINT8)Inputs->analogJoyX->value;
-    }
-
-    if (m_game.inputs & (Game::INPUT_ANALOG_GUN1 | Game::INPUT_ANALOG_GUN2))
-    {
-      adc[0] = (UINT8)Inputs->analogGunX[0]->value;
-      adc[2] = (UINT8)Inputs->analogGunY[0]->value;
-      adc[1] = (UINT8)Inputs->analogGunX[1]->value;
-      adc[3] = (UINT8)Inputs->analogGunY[1]->value;
-
-  	  // Unclear why this is necessary or how to cleanly fix it, so I'm
-  	  // disabling it but leaving it here for future reference. The proper fix is
-  	  // probably to allow users to define inverted controls for this game only,
-  	  // which means the input system must support loading per-game config (not
-  	  // all analog_gun games require axis inversion to be playable).
-	  if (m_game.name == "lostwsga" || m_game.name == "lostwsgo")
-	  { // to do, not a string compare
-        adc[0] =       (UINT8)Inputs->analogGunX[0]->value; // order is different for some reason in lost world
-        adc[1] = 255 - (UINT8)Inputs->analogGunY[0]->value; // why are values inverted? is this the wrong place to fix this
-        adc[2] =       (UINT8)Inputs->analogGunX[1]->value;
-        adc[3] = 255 - (UINT8)Inputs->analogGunY[1]->value;
-      }
-    }
-
-    if ((m_game.inputs & Game::INPUT_SKI))
-    {
-      adc[0] = (UINT8)Inputs->skiY->value;
-      adc[1] = (UINT8)Inputs->skiX->value;
-    }
-
-    if ((m_game.inputs & Game::INPUT_MAGTRUCK))
-    {
-      adc[0] = uint8_t(Inputs->magicalLever1->value);
-      adc[1] = uint8_t(Inputs->magicalLever2->value);
-    }
-
-    if ((m_game.inputs & Game::INPUT_FISHING))
-    {
-      adc[0] = uint8_t(Inputs->fishingRodY->value);
-      adc[1] = uint8_t(Inputs->fishingRodX->value);
-      adc[2] = uint8_t(Inputs->fishingTension->value); // get bass fishing only : Tension Sensor ?
-      adc[3] = uint8_t(Inputs->fishingReel->value);
-      adc[5] = uint8_t(Inputs->fishingStickX->value);
-      adc[4] = uint8_t(Inputs->fishingStickY->value);
-    }
-
-    // Read out appropriate channel
-    data = adc[adcChannel&7];
+    data = m_inputImage.adc[adcChannel&7];
     ++adcChannel;
     return data;
 
@@ -672,43 +709,14 @@ void CModel3::WriteInputs(unsigned reg, UINT8 data)
       serialFIFO2 = 0;
       if ((m_game.inputs & Game::INPUT_GUN1||m_game.inputs & Game::INPUT_GUN2))
       {
-        switch (gunReg)
-        {
-        case 0: // Player 1 gun Y (low 8 bits)
-          serialFIFO2 = Inputs->gunY[0]->value&0xFF;
-          break;
-        case 1: // Player 1 gun Y (high 2 bits)
-          serialFIFO2 = (Inputs->gunY[0]->value>>8)&3;
-          break;
-        case 2: // Player 1 gun X (low 8 bits)
-          serialFIFO2 = Inputs->gunX[0]->value&0xFF;
-          break;
-        case 3: // Player 1 gun X (high 2 bits)
-          serialFIFO2 = (Inputs->gunX[0]->value>>8)&3;
-          break;
-        case 4: // Player 2 gun Y (low 8 bits)
-          serialFIFO2 = Inputs->gunY[1]->value&0xFF;
-          break;
-        case 5: // Player 2 gun Y (high 2 bits)
-          serialFIFO2 = (Inputs->gunY[1]->value>>8)&3;
-          break;
-        case 6: // Player 2 gun X (low 8 bits)
-          serialFIFO2 = Inputs->gunX[1]->value&0xFF;
-          break;
-        case 7: // Player 2 gun X (high 2 bits)
-          serialFIFO2 = (Inputs->gunX[1]->value>>8)&3;
-          break;
-        case 8: // Off-screen indicator (bit 0 = player 1, bit 1 = player 2, set indicates off screen)
-          serialFIFO2 = (Inputs->trigger[1]->offscreenValue<<1)|Inputs->trigger[0]->offscreenValue;
-          break;
-        default:
-          DebugLog("Unknown gun register: %X\n", gunReg);
-          break;
-        }
+        if (gunReg < sizeof(m_inputImage.gun))
+          serialFIFO2 = m_inputImage.gun[gunReg];
+        else
+          DEBUG_LOG(Model3, "Unknown gun register: %X\n", gunReg);
       }
       break;
     default:
-      DebugLog("Uknown command to serial FIFO: %02X\n", data);
+      DEBUG_LOG(Model3, "Uknown command to serial FIFO: %02X\n", data);
       break;
     }
     break;
@@ -760,7 +768,7 @@ UINT32 CModel3::ReadSecurity(unsigned reg)
       return m_cryptoDevice.Decrypt(&base_ptr) << 16;
     }
   default:
-    DebugLog("Security read: reg=%X\n", reg);
+    DEBUG_LOG(Model3, "Security read: reg=%X\n", reg);
     break;
   }
 
@@ -785,7 +793,7 @@ void CModel3::WriteSecurity(unsigned reg, UINT32 data)
     break;
   }
   default:
-    DebugLog("Security write: reg=%X, data=%08X (PC=%08X, LR=%08X)\n", reg, data, ppc_get_pc(), ppc_get_lr());
+    DEBUG_LOG(Model3, "Security write: reg=%X, data=%08X (PC=%08X, LR=%08X)\n", reg, data, ppc_get_pc(), ppc_get_lr());
     break;
   }
 }
@@ -801,7 +809,7 @@ UINT32 CModel3::ReadPCIConfigSpace(unsigned device, unsigned reg, unsigned bits,
 {
   if ((bits==8) || (bits==16))
   {
-    DebugLog("Model 3: %d-bit PCI read request for reg=%02X\n", bits, reg);
+    DEBUG_LOG(Model3, "Model 3: %d-bit PCI read request for reg=%02X\n", bits, reg);
     return 0;
   }
 
@@ -819,13 +827,13 @@ UINT32 CModel3::ReadPCIConfigSpace(unsigned device, unsigned reg, unsigned bits,
     break;
   }
 
-  DebugLog("Model 3: PCI %d-bit write request for device=%d, reg=%02X\n", bits, device, reg);
+  DEBUG_LOG(Model3, "Model 3: PCI %d-bit write request for device=%d, reg=%02X\n", bits, device, reg);
   return 0;
 }
 
 void CModel3::WritePCIConfigSpace(unsigned device, unsigned reg, unsigned bits, unsigned offset, UINT32 data)
 {
-  DebugLog("Model 3: PCI %d-bit write request for device=%d, reg=%02X, data=%08X\n", bits, device, reg, data);
+  DEBUG_LOG(Model3, "Model 3: PCI %d-bit write request for device=%d, reg=%02X, data=%08X\n", bits, device, reg, data);
 }
 
 
@@ -847,7 +855,8 @@ void CModel3::SetCROMBank(unsigned idx)
   cromBankReg = idx;
   idx = (~idx) & 0xF;
   cromBank = &crom[0x800000 + (idx*0x800000)];
-  DebugLog("CROM bank setting: %d (%02X), PC=%08X, LR=%08X\n", idx, cromBankReg, ppc_get_pc(), ppc_get_lr());
+  ppc_map_memory(0xFF000000, 0xFF7FFFFF, cromBank, false);
+  DEBUG_LOG(Model3, "CROM bank setting: %d (%02X), PC=%08X, LR=%08X\n", idx, cromBankReg, ppc_get_pc(), ppc_get_lr());
 }
 
 UINT8 CModel3::ReadSystemRegister(unsigned reg)
@@ -882,11 +891,11 @@ void CModel3::WriteSystemRegister(unsigned reg, UINT8 data)
     break;
   case 0x14:  // IRQ enable
     IRQ.WriteIRQEnable(data);
-    DebugLog("IRQ ENABLE=%02X\n", data);
+    DEBUG_LOG(Model3, "IRQ ENABLE=%02X\n", data);
     break;
   case 0x18:  // IRQ acknowledge
     IRQ.Deassert(data);
-    DebugLog("IRQ ACK? %02X=%02X\n", reg, data);
+    DEBUG_LOG(Model3, "IRQ ACK? %02X=%02X\n", reg, data);
     break;
   case 0x0C:  // JTAG Test Access Port
   {
@@ -916,6 +925,13 @@ void CModel3::WriteSystemRegister(unsigned reg, UINT8 data)
  for the MPC10x. Write32() handles the MPC10x most correctly.
 ******************************************************************************/
 
+// Counts each access by region in bus profiling builds (see BusProfile.h)
+#ifdef SUPERMODEL_BUS_PROFILE
+#define BUS_PROFILE(addr, write)  CBusProfile::Scope busProfileScope(m_busProfile, addr, write)
+#else
+#define BUS_PROFILE(addr, write)
+#endif
+
 /*
  * CModel3::Read8(addr):
  * CModel3::Read16(addr):
@@ -926,6 +942,8 @@ void CModel3::WriteSystemRegister(unsigned reg, UINT8 data)
  */
 UINT8 CModel3::Read8(UINT32 addr)
 {
+  BUS_PROFILE(addr, false);
+
   // RAM (most frequently accessed)
   if (addr<0x00800000)
     return ram[addr^3];
@@ -1056,12 +1074,14 @@ UINT8 CModel3::Read8(UINT32 addr)
     break;
   }
 
-  DebugLog("PC=%08X\tread8 : %08X\n", ppc_get_pc(), addr);
+  DEBUG_LOG(Model3, "PC=%08X\tread8 : %08X\n", ppc_get_pc(), addr);
   return 0xFF;
 }
 
 UINT16 CModel3::Read16(UINT32 addr)
 {
+  BUS_PROFILE(addr, false);
+
   UINT16  data;
 
   if ((addr&1))
@@ -1169,12 +1189,14 @@ UINT16 CModel3::Read16(UINT32 addr)
     break;
   }
 
-  DebugLog("PC=%08X\tread16: %08X\n", ppc_get_pc(), addr);
+  DEBUG_LOG(Model3, "PC=%08X\tread16: %08X\n", ppc_get_pc(), addr);
   return 0xFFFF;
 }
 
 UINT32 CModel3::Read32(UINT32 addr)
 {
+  BUS_PROFILE(addr, false);
+
   UINT32  data;
 
   if ((addr&3))
@@ -1378,12 +1400,14 @@ UINT32 CModel3::Read32(UINT32 addr)
     break;
   }
 
-  DebugLog("PC=%08X\tread32: %08X\n", ppc_get_pc(), addr);
+  DEBUG_LOG(Model3, "PC=%08X\tread32: %08X\n", ppc_get_pc(), addr);
   return 0xFFFFFFFF;
 }
 
 UINT64 CModel3::Read64(UINT32 addr)
 {
+  BUS_PROFILE(addr, false);
+
   UINT64  data;
 
   data = Read32(addr+0);
@@ -1401,12 +1425,27 @@ UINT64 CModel3::Read64(UINT32 addr)
  *
  * Write handlers.
  */
+/*
+ * PowerPC stores to RAM pages holding translated code are routed here rather
+ * than written directly, as are all 53C810 DMA transfers. Writes to those pages
+ * invalidate the translations; other RAM writes only test a bit.
+ */
+inline void CModel3::CheckCodeWrite(UINT32 addr, unsigned size)
+{
+  UINT32 page = addr >> 12;
+  if (ppcCodePages[page >> 3] & (1 << (page & 7)))
+    ppc_invalidate_code(addr, size);
+}
+
 void CModel3::Write8(UINT32 addr, UINT8 data)
 {
+  BUS_PROFILE(addr, true);
+
   // RAM (most frequently accessed)
   if (addr < 0x00800000)
   {
     ram[addr^3] = data;
+    CheckCodeWrite(addr, 1);
     return;
   }
 
@@ -1461,7 +1500,7 @@ void CModel3::Write8(UINT32 addr, UINT8 data)
       break;
     }
 
-    DebugLog("PC=%08X\twrite8 : %08X=%02X\n", ppc_get_pc(), addr, data);
+    DEBUG_LOG(Model3, "PC=%08X\twrite8 : %08X=%02X\n", ppc_get_pc(), addr, data);
     break;
 
   // Tile generator
@@ -1544,13 +1583,15 @@ void CModel3::Write8(UINT32 addr, UINT8 data)
 #ifdef NET_BOARD
     //printf("CMODEL3 : unknown W8 : %x\n", addr >> 24); // harleyb unknown 0xF1
 #endif
-    DebugLog("PC=%08X\twrite8 : %08X=%02X\n", ppc_get_pc(), addr, data);
+    DEBUG_LOG(Model3, "PC=%08X\twrite8 : %08X=%02X\n", ppc_get_pc(), addr, data);
     break;
   }
 }
 
 void CModel3::Write16(UINT32 addr, UINT16 data)
 {
+  BUS_PROFILE(addr, true);
+
   if ((addr&1))
   {
     Write8(addr+0,data>>8);
@@ -1562,6 +1603,7 @@ void CModel3::Write16(UINT32 addr, UINT16 data)
   if (addr < 0x00800000)
   {
     *(UINT16 *) &ram[addr^2] = data;
+    CheckCodeWrite(addr, 2);
     return;
   }
 
@@ -1596,7 +1638,7 @@ void CModel3::Write16(UINT32 addr, UINT16 data)
       break;
     }
 
-    DebugLog("PC=%08X\twrite16 : %08X=%04X\n", ppc_get_pc(), addr, data);
+    DEBUG_LOG(Model3, "PC=%08X\twrite16 : %08X=%04X\n", ppc_get_pc(), addr, data);
     break;
 
   // Tile generator
@@ -1638,13 +1680,15 @@ void CModel3::Write16(UINT32 addr, UINT16 data)
   // Unknown
   default:
   Unknown16:
-    DebugLog("PC=%08X\twrite16: %08X=%04X\n", ppc_get_pc(), addr, data);
+    DEBUG_LOG(Model3, "PC=%08X\twrite16: %08X=%04X\n", ppc_get_pc(), addr, data);
     break;
   }
 }
 
 void CModel3::Write32(UINT32 addr, UINT32 data)
 {
+  BUS_PROFILE(addr, true);
+
   if ((addr&3))
   {
     Write16(addr+0,data>>16);
@@ -1656,6 +1700,7 @@ void CModel3::Write32(UINT32 addr, UINT32 data)
   if (addr<0x00800000)
   {
     *(UINT32 *) &ram[addr] = data;
+    CheckCodeWrite(addr, 4);
     return;
   }
 
@@ -1787,7 +1832,7 @@ void CModel3::Write32(UINT32 addr, UINT32 data)
       break;
     }
 
-    DebugLog("PC=%08X\twrite32: %08X=%08X\n", ppc_get_pc(), addr, data);
+    DEBUG_LOG(Model3, "PC=%08X\twrite32: %08X=%08X\n", ppc_get_pc(), addr, data);
     break;
 
   // Tile generator
@@ -1885,18 +1930,44 @@ void CModel3::Write32(UINT32 addr, UINT32 data)
       if (m_runNetBoard) printf("CMODEL3 : unknown W32 : %x (%x) data=%d\n", addr,addr >> 24,data);
 #endif
     //printf("PC=%08X\twrite32: %08X=%08X\n", ppc_get_pc(), addr, data);
-    DebugLog("PC=%08X\twrite32: %08X=%08X\n", ppc_get_pc(), addr, data);
+    DEBUG_LOG(Model3, "PC=%08X\twrite32: %08X=%08X\n", ppc_get_pc(), addr, data);
     break;
   }
 }
 
 void CModel3::Write64(UINT32 addr, UINT64 data)
 {
+  BUS_PROFILE(addr, true);
     //printf("write64 %x <- %x\n", addr, data);
     Write32(addr+0, (UINT32) (data>>32));
     Write32(addr+4, (UINT32) data);
 }
 
+// Copies from RAM to RAM or to the Real3D memory regions, which is what the
+// SCSI controller's memory moves are used for
+bool CModel3::CopyBlock(UINT32 dest, UINT32 src, UINT32 numBytes)
+{
+  if (((dest | src | numBytes) & 3) || numBytes > 0x00800000 || src > 0x00800000 - numBytes)
+    return false;
+
+  if (dest < 0x00800000)
+  {
+    // A forward copy onto the end of its own source repeats it, unlike memmove()
+    if (dest > 0x00800000 - numBytes || (dest > src && dest < src + numBytes))
+      return false;
+    memmove(&ram[dest], &ram[src], numBytes);
+    for (UINT32 addr = dest & ~0xFFF; addr < dest + numBytes; addr += 0x1000)
+      CheckCodeWrite(addr, 0x1000);
+    return true;
+  }
+
+  // Tile generator RAM (stored byte reversed, like Write32() does)
+  if (dest >= 0xF1000000 && dest < 0xF1120000)
+    return TileGen.WriteRAMBlock(dest & 0x1FFFFF, &ram[src], numBytes, false);
+
+  return GPU.CopyFromRAM(dest, src, numBytes, false);
+}
+
 
 /******************************************************************************
  Emulation and Interface Functions
@@ -1904,6 +1975,21 @@ void CModel3::Write64(UINT32 addr, UINT64 data)
 
 void CModel3::SaveState(CBlockFile *SaveState)
 {
+  ppc_set_context(m_ppc);
+
+  // The tile generator, Real3D and sound board, which hold most of the state,
+  // are captured into blocks of their own on the job system while the rest is
+  // written here, and then added in the usual order
+  Util::JobSystem &jobs = Util::JobSystem::Shared();
+  Util::JobSystem::Group boardsSaved;
+  bool parallel = m_parallelState && jobs.NumWorkers() > 0;
+  if (parallel)
+  {
+    jobs.Submit(boardsSaved, [this]() { SaveBoardState(0); });
+    jobs.Submit(boardsSaved, [this]() { SaveBoardState(1); });
+    jobs.Submit(boardsSaved, [this]() { SaveBoardState(2); });
+  }
+
   // Write Model 3 state
   SaveState->NewBlock("Model 3", __FILE__);
   SaveState->Write(&inputBank, sizeof(inputBank));
@@ -1926,20 +2012,70 @@ void CModel3::SaveState(CBlockFile *SaveState)
   PCIBridge.SaveState(SaveState);
   SCSI.SaveState(SaveState);
   EEPROM.SaveState(SaveState);
-  TileGen.SaveState(SaveState);
-  GPU.SaveState(SaveState);
-  SoundBoard.SaveState(SaveState);  // also saves DSB state
+  if (parallel)
+  {
+    jobs.Wait(boardsSaved);
+    for (auto &blocks: m_boardStates)
+      SaveState->AppendBlocks(blocks);
+  }
+  else
+  {
+    TileGen.SaveState(SaveState);
+    GPU.SaveState(SaveState);
+    SoundBoard.SaveState(SaveState);  // also saves DSB state
+  }
   DriveBoard->SaveState(SaveState);
   m_cryptoDevice.SaveState(SaveState);
   m_jtag.SaveState(SaveState);
 }
 
+void CModel3::SaveBoardState(int board)
+{
+  CBlockFile blocks;
+  blocks.CreateBlocks(&m_boardStates[board]);
+  if (board == 0)
+    TileGen.SaveState(&blocks);
+  else if (board == 1)
+    GPU.SaveState(&blocks);
+  else
+    SoundBoard.SaveState(&blocks);  // also saves DSB state
+  blocks.Close();
+}
+
 void CModel3::LoadState(CBlockFile *SaveState)
 {
+  ppc_set_context(m_ppc);
+
+  // The tile generator and sound board are restored on the job system from
+  // their own readers of the image, if it is in memory, while Real3D (which
+  // uploads textures to the renderer, so must stay on this thread) and the
+  // rest are restored here
+  Util::JobSystem &jobs = Util::JobSystem::Shared();
+  Util::JobSystem::Group boardsLoaded;
+  size_t imageSize = 0;
+  const uint8_t *image = SaveState->Image(&imageSize);
+  bool parallel = m_parallelState && jobs.NumWorkers() > 0 && image != NULL;
+  if (parallel)
+  {
+    jobs.Submit(boardsLoaded, [this, image, imageSize]()
+    {
+      CBlockFile state;
+      state.Load(image, imageSize);
+      TileGen.LoadState(&state);
+    });
+    jobs.Submit(boardsLoaded, [this, image, imageSize]()
+    {
+      CBlockFile state;
+      state.Load(image, imageSize);
+      SoundBoard.LoadState(&state);
+    });
+  }
+
   // Load Model 3 state
   if (OKAY != SaveState->FindBlock("Model 3"))
   {
     ErrorLog("Unable to load Model 3 core state. Save state file is corrupt.");
+    jobs.Wait(boardsLoaded);
     return;
   }
 
@@ -1961,13 +2097,18 @@ void CModel3::LoadState(CBlockFile *SaveState)
 
   // All devices...
   GPU.LoadState(SaveState);
-  TileGen.LoadState(SaveState);
+  if (!parallel)
+    TileGen.LoadState(SaveState);
   EEPROM.LoadState(SaveState);
   SCSI.LoadState(SaveState);
   PCIBridge.LoadState(SaveState);
   IRQ.LoadState(SaveState);
   ppc_load_state(SaveState);
-  SoundBoard.LoadState(SaveState);
+  WarmUpPPCCode();
+  if (parallel)
+    jobs.Wait(boardsLoaded);
+  else
+    SoundBoard.LoadState(SaveState);
   DriveBoard->LoadState(SaveState);
   m_cryptoDevice.LoadState(SaveState);
   m_jtag.LoadState(SaveState);
@@ -2003,9 +2144,17 @@ void CModel3::ClearNVRAM(void)
   EEPROM.Clear();
 }
 
+// Returns microseconds elapsed since start, for frame timings
+static inline UINT32 MicrosSince(std::chrono::steady_clock::time_point start)
+{
+  return UINT32(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
 void CModel3::RunFrame(bool displayFrame)
 {
-  UINT32 start = CThread::GetTicks();
+  TRACE_ZONE("CModel3::RunFrame");
+  ppc_set_context(m_ppc);
+  auto start = std::chrono::steady_clock::now();
 
   // See if currently running multi-threaded
   if (m_multiThreaded)
@@ -2014,10 +2163,16 @@ void CModel3::RunFrame(bool displayFrame)
     if (!StartThreads())
       goto ThreadError;
 
-    // Wake threads for PPC main board (if multi-threading GPU), sound board (if sync'd) and drive board (if attached) so they can process a frame
+    // Wake threads for PPC main board (if multi-threading GPU), sound board (if sync'd) and drive board (if attached) so they can process a frame.
+    // Sound board frames are counted on top of any it has not finished yet, since it may be running behind. The drive board is never
+    // waited for: it is given this frame only if it is no further behind than the latency budget, and otherwise skips it.
+    bool runDrvBrd = DriveBoard->IsAttached() && drvFrameDone.Pending() <= m_boardLatency;
+    frameDone.Arm(unsigned(m_gpuMultiThreaded));
+    sndFrameDone.Add(unsigned(syncSndBrdThread));
+    drvFrameDone.Add(unsigned(runDrvBrd));
     if ((m_gpuMultiThreaded       && !ppcBrdThreadSync->Post()) ||
         (syncSndBrdThread         && !sndBrdThreadSync->Post()) ||
-        (DriveBoard->IsAttached()  && !drvBrdThreadSync->Post()))
+        (runDrvBrd                && !drvBrdThreadSync->Post()))
       goto ThreadError;
 
     // If not multi-threading GPU, then run PPC main board for a frame and sync GPUs now in this thread
@@ -2030,46 +2185,54 @@ void CModel3::RunFrame(bool displayFrame)
     // Render frame
     RenderFrame(displayFrame);
 
-    // Enter notify wait critical section
-    if (!notifyLock->Lock())
-      goto ThreadError;
-
-    // Wait for PPC main board, sound board and drive board threads to finish their work (if they are running and haven't finished already)
-    while ((m_gpuMultiThreaded      && !ppcBrdThreadDone) ||
-           (syncSndBrdThread        && !sndBrdThreadDone) ||
-           (DriveBoard->IsAttached() && !drvBrdThreadDone))
+    // Wait for PPC main board thread to finish its frame (if it is running and hasn't finished already). The sound board
+    // thread need only get within the latency budget, keeping the frames it is behind by queued on its semaphore, and the
+    // drive board thread is not waited for at all. Their exchanges with the main board (MIDI FIFO, drive board command and
+    // status bytes) are safe to make from any frame, the drive board issuing its force feedback commands from its own
+    // thread, and inputs are still polled after this returns, just before the PPC consumes them.
+    auto waitStart = std::chrono::steady_clock::now();
+    bool ppcParked, sndParked;
     {
-      if (!notifySync->Wait(notifyLock))
-        goto ThreadError;
+      TRACE_ZONE("CModel3::RunFrame wait");
+      ppcParked = frameDone.Wait();
+      sndParked = sndFrameDone.Wait(m_boardLatency);
     }
-    ppcBrdThreadDone = false;
-    sndBrdThreadDone = false;
-    drvBrdThreadDone = false;
-
-    // Leave notify wait critical section
-    if (!notifyLock->Unlock())
-      goto ThreadError;
+    timings.waitParked = ppcParked || sndParked;
+    timings.waitMicros = MicrosSince(waitStart);
 
     // If multi-threading GPU, then sync GPUs last while PPC main board thread is waiting
     if (m_gpuMultiThreaded)
       SyncGPUs();
 
 #ifdef NET_BOARD
-    if (NetBoard->IsRunning() && m_config["SimulateNet"].ValueAs<bool>())
+    if (netBrdThread != NULL && NetBoard->IsRunning())
     {
+        // Net board thread must have finished last frame before the PowerPC is interrupted for this one
+        netFrameDone.Wait();
+
+        RefreshGPUWriteBuffers();
+
         // ppc irq network needed ? no effect, is it really active/needed ?
         IRQ.Assert(0x10);
         ppc_execute(200); // give PowerPC time to acknowledge IRQ
         IRQ.Deassert(0x10);
         ppc_execute(200); // acknowledge that IRQ was deasserted (TODO: is this really needed?)
-        RunNetBoardFrame();
         // Hum hum, if runnetboardframe is called at 1st place or between ppc irq assert/deassert, spikout freezes just after the gate with net error
         // if runnetboardframe is called after ppc irq assert/deassert, spikout works
+
+        // Net board frame then runs on its own thread, alongside the next main board frame (its 68K has a context
+        // of its own, so it can run at the same time as the sound board 68K)
+        netFrameDone.Add(1);
+        if (!netBrdThreadSync->Post())
+          goto ThreadError;
     }
 #endif
   }
   else
   {
+    timings.waitParked = false;
+    timings.waitMicros = 0;
+
     // If not multi-threaded, then just process and render a single frame for PPC main board, sound board and drive board in turn in this thread
     RunMainBoardFrame();
     SyncGPUs();
@@ -2092,7 +2255,17 @@ void CModel3::RunFrame(bool displayFrame)
 #endif
   }
 
-  timings.frameTicks = CThread::GetTicks() - start;
+  timings.frameMicros = MicrosSince(start);
+
+  // Allocations since the last frame, from whichever threads made them
+  if (Util::AllocTracker::Enabled())
+  {
+    Util::AllocTracker::Counts counts;
+    Util::AllocTracker::Read(&counts);
+    for (int i = 0; i < Util::AllocTracker::NumSubsystems; i++)
+      timings.allocations[i] = (UINT32) (counts.allocations[i] - allocCounts.allocations[i]);
+    allocCounts = counts;
+  }
 
   return;
 
@@ -2101,12 +2274,28 @@ ThreadError:
   m_multiThreaded = false;
 }
 
-void CModel3::RunMainBoardFrame(void)
+void CModel3::RefreshGPUWriteBuffers(void)
 {
-	UINT32 start = CThread::GetTicks();
+  GPU.RefreshWriteBuffers(snapshotCopier);
+  TileGen.RefreshWriteBuffers(snapshotCopier);
+  snapshotCopier.Run();
+}
+
+void CModel3::RunMainBoardFrame(void)
+{
+	TRACE_ZONE("CModel3::RunMainBoardFrame");
+	ALLOC_SCOPE(MainBoard);
+	auto start = std::chrono::steady_clock::now();
+	UINT64 idleStart = ppc_get_idle_cycles_skipped();
+
+	// If GPU memory is double-buffered, catch up on last frame's writes (in parallel with rendering, if multi-threading GPU)
+	RefreshGPUWriteBuffers();
+
+	// Inputs were polled just before this frame was started
+	LatchInputs();
 
 	// Compute display and VBlank timings
-	unsigned ppcCycles		= m_config["PowerPCFrequency"].ValueAs<unsigned>() * 1000000;
+	unsigned ppcCycles		= m_ppcFrequency * 1000000;
 	unsigned frameCycles	= ppcCycles / 60;
 	unsigned gapCycles		= (unsigned)((float)frameCycles * 2.5f / 100.0f);	// we need a gap between asserting irq2 & irq 0x40
 	unsigned offsetCycles = (unsigned)((float)frameCycles * 33.f / 100.0f);
@@ -2128,75 +2317,80 @@ void CModel3::RunMainBoardFrame(void)
 	// the Real3D status bit below.
 	ppc_set_timer_ratio(ppc_get_bus_freq_multipler() * 2 * ppcCycles / ppc_get_cycles_per_sec());
 
-	// VBlank
+	// Post this frame's events and run the PowerPC through them in a single timeline
+	UINT64 frameStart = ppc_total_cycles();
 	if (gpusReady)
 	{
+		// VBlank
 		TileGen.BeginVBlank();
 		GPU.BeginVBlank(statusCycles);	// Games poll the ping_pong at startup. Values aren't 100% accurate so we stretch the frame a bit to ensure writes happen in the correct frame
+		m_scheduler.Schedule(frameStart + statusCycles, nullptr);	// Real3D status bit flips (computed from cycle count, so only the slice has to end there)
+		m_scheduler.Schedule(frameStart + offsetCycles, [this]() { IRQ.Assert(0x02); });	// start at 33% of the frame
+		m_scheduler.Schedule(frameStart + offsetCycles + gapCycles, [this]() { MIDIInterruptEvent(0); });	// need a gap between asserting irqs
+		m_scheduler.Run(frameStart + frameCycles);
+	}
+	else
+		m_scheduler.Run(frameStart + dispCycles);
+
+	timings.ppcMicros = MicrosSince(start);
+	timings.ppcIdleCycles = (UINT32) (ppc_get_idle_cycles_skipped() - idleStart);
+#ifdef SUPERMODEL_BUS_PROFILE
+	m_busProfile.EndFrame();
+#endif
+}
 
-		ppc_execute(offsetCycles);
-		IRQ.Assert(0x02);								// start at 33% of the frame
-		ppc_execute(gapCycles);					// need a gap between asserting irqs
-
-		/*
-		* Sound:
-		*
-		* Bit 0x20 of the MIDI control port appears to enable periodic interrupts,
-		* which are used to send MIDI commands. Often games will write 0x27, send
-		* a series of commands, and write 0x06 to stop. Other games, like Star
-		* Wars Trilogy and Sega Rally 2, will enable interrupts at the beginning
-		* by writing 0x37 and will disable/enable interrupts to control command
-		* output.
-		*/
-		//printf("\t-- BEGIN (Ctrl=%02X, IRQEn=%02X, IRQPend=%02X) --\n", midiCtrlPort, IRQ.ReadIRQEnable()&0x40, IRQ.ReadIRQState());
-		int irqCount = 0;
-		while ((midiCtrlPort & 0x20))
-			//while (midiCtrlPort == 0x27)  // 27 triggers IRQ sequence, 06 stops it
-		{
-			// Don't waste time firing MIDI interrupts if game has disabled them
-			if ((IRQ.ReadIRQEnable() & 0x40) == 0)
-				break;
-
-			// Process MIDI interrupt
-			IRQ.Assert(0x40);
-			ppc_execute(200); // give PowerPC time to acknowledge IR
-			IRQ.Deassert(0x40);
-			ppc_execute(200); // acknowledge that IRQ was deasserted (TODO: is this really needed?)
-			dispCycles -= 400;
-
-			++irqCount;
-			if (irqCount > 128)
-			{
-				break;
-			}
-		}
-
-		IRQ.Assert(0x0D);
-
-		// End VBlank
-		GPU.EndVBlank();
-		TileGen.EndVBlank();
+/*
+ * Sound:
+ *
+ * Bit 0x20 of the MIDI control port appears to enable periodic interrupts,
+ * which are used to send MIDI commands. Often games will write 0x27, send
+ * a series of commands, and write 0x06 to stop. Other games, like Star
+ * Wars Trilogy and Sega Rally 2, will enable interrupts at the beginning
+ * by writing 0x37 and will disable/enable interrupts to control command
+ * output.
+ *
+ * Each MIDI interrupt is held for 200 cycles and followed by another 200
+ * before the next one, up to 129 per frame. Once the game stops requesting
+ * them, VBlank ends.
+ */
+void CModel3::MIDIInterruptEvent(unsigned irqCount)
+{
+	//printf("\t-- MIDI IRQ %u (Ctrl=%02X, IRQEn=%02X, IRQPend=%02X) --\n", irqCount, midiCtrlPort, IRQ.ReadIRQEnable()&0x40, IRQ.ReadIRQState());
+	// Don't waste time firing MIDI interrupts if game has disabled them
+	if ((midiCtrlPort & 0x20) && (IRQ.ReadIRQEnable() & 0x40) && irqCount <= 128)
+	{
+		// Process MIDI interrupt
+		IRQ.Assert(0x40);
+		m_scheduler.ScheduleIn(200, [this]() { IRQ.Deassert(0x40); });	// give PowerPC time to acknowledge IRQ
+		m_scheduler.ScheduleIn(400, [this, irqCount]() { MIDIInterruptEvent(irqCount + 1); });	// acknowledge that IRQ was deasserted (TODO: is this really needed?)
+		return;
 	}
 
-	// Run the PowerPC for the active display part of the frame
-	ppc_execute(dispCycles);
+	IRQ.Assert(0x0D);
 
-	timings.ppcTicks = CThread::GetTicks() - start;
+	// End VBlank
+	GPU.EndVBlank();
+	TileGen.EndVBlank();
 }
 
 void CModel3::SyncGPUs(void)
 {
-  UINT32 start = CThread::GetTicks();
+  TRACE_ZONE("CModel3::SyncGPUs");
+  ALLOC_SCOPE(Sync);
+  auto start = std::chrono::steady_clock::now();
 
-  timings.syncSize = GPU.SyncSnapshots() + TileGen.SyncSnapshots();
+  timings.syncSize = GPU.SyncSnapshots(snapshotCopier) + TileGen.SyncSnapshots(snapshotCopier);
+  timings.syncSize += snapshotCopier.Run();
   gpusReady = true;
 
-  timings.syncTicks = CThread::GetTicks() - start;
+  timings.syncMicros = MicrosSince(start);
 }
 
 void CModel3::RenderFrame(bool displayFrame)
 {
-  UINT32 start = CThread::GetTicks();
+  TRACE_ZONE("CModel3::RenderFrame");
+  ALLOC_SCOPE(Render);
+  auto start = std::chrono::steady_clock::now();
 
   // Call OSD video callbacks
   if (BeginFrameVideo() && gpusReady && displayFrame)
@@ -2210,32 +2404,60 @@ void CModel3::RenderFrame(bool displayFrame)
     TileGen.RenderFrameTop();
     GPU.EndFrame();
     TileGen.EndFrame();
+    CGPUTimer::Shared().EndFrame();
   }
 
   EndFrameVideo();
 
-  timings.renderTicks = CThread::GetTicks() - start;
+  const UINT32 *gpuMicros = CGPUTimer::Shared().Micros();
+  for (int i = 0; i < CGPUTimer::NumPasses; i++)
+    timings.gpuMicros[i] = gpuMicros[i];
+
+  timings.texCacheHits = 0;
+  timings.texCacheMisses = 0;
+  if (render3D != NULL)
+  {
+    uint64_t hits, misses;
+    render3D->GetTextureCacheStats(&hits, &misses);
+    timings.texCacheHits = (UINT32) (hits - texCacheHits);
+    timings.texCacheMisses = (UINT32) (misses - texCacheMisses);
+    texCacheHits = hits;
+    texCacheMisses = misses;
+  }
+
+  timings.renderMicros = MicrosSince(start);
 }
 
 bool CModel3::RunSoundBoardFrame(void)
 {
-  UINT32 start = CThread::GetTicks();
+  ALLOC_SCOPE(SoundBoard);
+  CDSB1 *dsb1 = dynamic_cast<CDSB1 *>(DSB);
+  UINT64 idleStart = dsb1 != NULL ? dsb1->GetZ80()->GetIdleCycles() : 0;
+  auto start = std::chrono::steady_clock::now();
   bool bufferFull = SoundBoard.RunFrame();
-  timings.sndTicks = CThread::GetTicks() - start;
+  timings.sndMicros = MicrosSince(start);
+  timings.dsbIdleCycles = dsb1 != NULL ? (UINT32) (dsb1->GetZ80()->GetIdleCycles() - idleStart) : 0;
   return bufferFull;
 }
 
 void CModel3::RunDriveBoardFrame(void)
 {
-  UINT32 start = CThread::GetTicks();
+  ALLOC_SCOPE(DriveBoard);
+  UINT64 idleStart = DriveBoard->GetZ80()->GetIdleCycles();
+  auto start = std::chrono::steady_clock::now();
   DriveBoard->RunFrame();
-  timings.drvTicks = CThread::GetTicks() - start;
+  DriveBoard->FlushForceFeedback();
+  timings.drvMicros = MicrosSince(start);
+  timings.drvIdleCycles = (UINT32) (DriveBoard->GetZ80()->GetIdleCycles() - idleStart);
 }
 
 #ifdef NET_BOARD
 void CModel3::RunNetBoardFrame(void)
 {
+  ALLOC_SCOPE(NetBoard);
+  auto start = std::chrono::steady_clock::now();
   NetBoard->RunFrame();
+  timings.netMicros = MicrosSince(start);
 }
 #endif
 
@@ -2244,6 +2466,12 @@ bool CModel3::StartThreads(void)
   if (startedThreads)
     return true;
 
+#ifdef NET_BOARD
+  bool netBrdAttached = NetBoard->IsAttached();
+#else
+  bool netBrdAttached = false;
+#endif
+
   // Create synchronization objects
   if (m_gpuMultiThreaded)
   {
@@ -2266,6 +2494,12 @@ bool CModel3::StartThreads(void)
     if (drvBrdThreadSync == NULL)
       goto ThreadError;
   }
+  if (netBrdAttached)
+  {
+    netBrdThreadSync = CThread::CreateSemaphore(0);
+    if (netBrdThreadSync == NULL)
+      goto ThreadError;
+  }
   notifyLock = CThread::CreateMutex();
   if (notifyLock == NULL)
     goto ThreadError;
@@ -2277,6 +2511,15 @@ bool CModel3::StartThreads(void)
   pauseThreads = false;
   stopThreads = false;
 
+  // Log thread topology (each board thread logs its own affinity and priority as it starts)
+  InfoLog("Starting threads on %u logical CPU(s): render%s, sound board (%s)%s%s.", std::thread::hardware_concurrency(),
+    m_gpuMultiThreaded ? ", main board" : " and main board", syncSndBrdThread ? "sync'd" : "unsync'd", DriveBoard->IsAttached() ? ", drive board" : "",
+    netBrdAttached ? ", net board" : "");
+
+  // Let snapshot copier use the shared job system, if multi-threading GPU (copies then run while PPC main board thread waits)
+  if (m_gpuMultiThreaded)
+    snapshotCopier.SetJobSystem(&Util::JobSystem::Shared());
+
   // Create PPC main board thread, if multi-threading GPU
   if (m_gpuMultiThreaded)
   {
@@ -2301,6 +2544,16 @@ bool CModel3::StartThreads(void)
       goto ThreadError;
   }
 
+#ifdef NET_BOARD
+  // Create net board thread, if net board is attached
+  if (netBrdAttached)
+  {
+    netBrdThread = CThread::CreateThread("NetBoard", StartNetBoardThread, this);
+    if (netBrdThread == NULL)
+      goto ThreadError;
+  }
+#endif
+
   // Set audio callback if sound board thread is unsync'd
   if (!syncSndBrdThread)
   {
@@ -2322,13 +2575,18 @@ bool CModel3::PauseThreads(void)
   if (!startedThreads)
     return true;
 
+  // Let sound board, drive board and net board threads finish any frames they are behind by, otherwise they would be dropped
+  sndFrameDone.Wait();
+  drvFrameDone.Wait();
+  netFrameDone.Wait();
+
   // Enter notify critical section
   if (!notifyLock->Lock())
     goto ThreadError;
 
   // Let threads know that they should pause and wait for all of them to do so
   pauseThreads = true;
-  while (ppcBrdThreadRunning || sndBrdThreadRunning || drvBrdThreadRunning)
+  while (ppcBrdThreadRunning || sndBrdThreadRunning || drvBrdThreadRunning || netBrdThreadRunning)
   {
     if (!notifySync->Wait(notifyLock))
       goto ThreadError;
@@ -2377,13 +2635,18 @@ bool CModel3::StopThreads(void)
   if (!syncSndBrdThread)
     SetAudioCallback(NULL, NULL);
 
+  // Let sound board, drive board and net board threads finish any frames they are behind by
+  sndFrameDone.Wait();
+  drvFrameDone.Wait();
+  netFrameDone.Wait();
+
   // Enter notify critical section
   if (!notifyLock->Lock())
     goto ThreadError;
 
   // Let threads know that they should pause and wait for all of them to do so
   pauseThreads = true;
-  while (ppcBrdThreadRunning || sndBrdThreadRunning || drvBrdThreadRunning)
+  while (ppcBrdThreadRunning || sndBrdThreadRunning || drvBrdThreadRunning || netBrdThreadRunning)
   {
     if (!notifySync->Wait(notifyLock))
       goto ThreadError;
@@ -2420,6 +2683,11 @@ bool CModel3::StopThreads(void)
     if (drvBrdThreadSync->Post())
       drvBrdThread->Wait();
   }
+  if (netBrdThread != NULL)
+  {
+    if (netBrdThreadSync->Post())
+      netBrdThread->Wait();
+  }
 
   // Delete all thread and synchronization objects
   DeleteThreadObjects();
@@ -2434,7 +2702,7 @@ ThreadError:
 
 void CModel3::DeleteThreadObjects(void)
 {
-  // Delete PPC main board, sound board and drive board threads
+  // Delete PPC main board, sound board, drive board and net board threads
   if (ppcBrdThread != NULL)
   {
     delete ppcBrdThread;
@@ -2450,6 +2718,12 @@ void CModel3::DeleteThreadObjects(void)
     delete drvBrdThread;
     drvBrdThread = NULL;
   }
+  if (netBrdThread != NULL)
+  {
+    delete netBrdThread;
+    netBrdThread = NULL;
+  }
+  snapshotCopier.SetJobSystem(NULL);
 
 
   // Delete synchronization objects
@@ -2468,6 +2742,11 @@ void CModel3::DeleteThreadObjects(void)
     delete drvBrdThreadSync;
     drvBrdThreadSync = NULL;
   }
+  if (netBrdThreadSync != NULL)
+  {
+    delete netBrdThreadSync;
+    netBrdThreadSync = NULL;
+  }
 
 
   if (sndBrdNotifyLock != NULL)
@@ -2494,14 +2773,122 @@ void CModel3::DeleteThreadObjects(void)
 
 void CModel3::DumpTimings(void)
 {
-  printf("PPC:%3ums%c render:%3ums%c sync:%4uK%c%3ums%c snd:%3ums%c drv:%3ums%c frame:%3ums%c\n",
-    timings.ppcTicks, (timings.ppcTicks > timings.renderTicks ? '!' : ','),
-    timings.renderTicks, (timings.renderTicks > timings.ppcTicks ? '!' : ','),
+  printf("PPC:%5.1fms%c idle:%5uK, render:%5.1fms%c sync:%4uK%c%5.1fms%c snd:%5.1fms%c idle:%4uK, drv:%5.1fms%c idle:%4uK, wait:%5uus%c frame:%5.1fms%c\n",
+    timings.ppcMicros / 1000.0, (timings.ppcMicros > timings.renderMicros ? '!' : ','),
+    timings.ppcIdleCycles / 1000,
+    timings.renderMicros / 1000.0, (timings.renderMicros > timings.ppcMicros ? '!' : ','),
     timings.syncSize / 1024, (timings.syncSize / 1024 > 128 ? '!' : ','),
-    timings.syncTicks, (timings.syncTicks > 1 ? '!' : ','),
-    timings.sndTicks, (timings.sndTicks > 10 ? '!' : ','),
-    timings.drvTicks, (timings.drvTicks > 10 ? '!' : ','),
-    timings.frameTicks, (timings.frameTicks > 16 ? '!' : ' '));
+    timings.syncMicros / 1000.0, (timings.syncMicros > 1000 ? '!' : ','),
+    timings.sndMicros / 1000.0, (timings.sndMicros > 10000 ? '!' : ','),
+    timings.dsbIdleCycles / 1000,
+    timings.drvMicros / 1000.0, (timings.drvMicros > 10000 ? '!' : ','),
+    timings.drvIdleCycles / 1000,
+    timings.waitMicros, (timings.waitParked ? '!' : ','),
+    timings.frameMicros / 1000.0, (timings.frameMicros > 16667 ? '!' : ' '));
+
+  // Pages of each GPU memory region dirtied since the previous sync
+  const std::vector<CSnapshotCopier::RegionStats> &stats = snapshotCopier.GetStats();
+  if (!stats.empty())
+  {
+    printf("  dirty pages -");
+    for (const CSnapshotCopier::RegionStats &region: stats)
+      printf(" %s:%u/%u", region.name, region.dirtyPages, region.numPages);
+    printf("\n");
+  }
+
+#ifdef SUPERMODEL_BUS_PROFILE
+  // Regions the PowerPC spent the most host time accessing (reads/writes)
+  printf("  bus -%s\n", m_busProfile.FrameSummary(6).c_str());
+#endif
+
+  // Heap allocations made during the frame by each subsystem
+  if (Util::AllocTracker::Enabled())
+  {
+    printf("  allocs -");
+    for (int i = 0; i < Util::AllocTracker::NumSubsystems; i++)
+      printf(" %s:%u", Util::AllocTracker::SubsystemName(i), timings.allocations[i]);
+    printf("\n");
+  }
+}
+
+#ifdef SUPERMODEL_BUS_PROFILE
+void CModel3::DumpBusProfile(void)
+{
+  m_busProfile.Report(CBusProfile::NumRegions);
+}
+#endif
+
+void CModel3::DumpPPCProfile(const char *file)
+{
+  ppc_set_context(m_ppc);
+  if (ppc_dump_profile(file, 50) != OKAY)
+    ErrorLog("Unable to write PowerPC profile to '%s'.", file);
+  else
+    printf("PowerPC profile written to '%s'.\n", file);
+}
+
+void CModel3::DumpCPUTrace(const char *file)
+{
+  if (m_cpuTraces.empty())
+    return;
+  std::vector<const CExecTrace *> traces;
+  for (auto &trace: m_cpuTraces)
+    traces.push_back(trace.get());
+  if (CExecTrace::WriteFile(file, traces) != OKAY)
+    ErrorLog("Unable to write CPU trace to '%s'.", file);
+  else
+    printf("CPU trace written to '%s'.\n", file);
+}
+
+void CModel3::WatchPPCAddress(bool enable, UINT32 addr)
+{
+  ppc_set_context(m_ppc);
+  ppc_set_pc_watch(enable, addr);
+}
+
+bool CModel3::PPCAddressReached(void) const
+{
+  ppc_set_context(m_ppc);
+  return ppc_pc_watch_hit();
+}
+
+void CModel3::StartCPUTraces(void)
+{
+  ppc_set_context(m_ppc);
+
+  // Size is given in millions of instructions per CPU
+  size_t instructions = size_t(m_config["CPUTrace"].ValueAsDefault<unsigned>(0)) * 1000000;
+  if (instructions == 0)
+    return;
+
+  m_cpuTraces.emplace_back(new CExecTrace("PPC", CExecTrace::PowerPC, instructions));
+  ppc_set_trace(m_cpuTraces.back().get());
+  m_cpuTraces.emplace_back(new CExecTrace("Snd68K", CExecTrace::M68K, instructions));
+  SoundBoard.GetM68K()->Trace = m_cpuTraces.back().get();
+  if (CDSB1 *dsb1 = dynamic_cast<CDSB1 *>(DSB))
+  {
+    m_cpuTraces.emplace_back(new CExecTrace("DSBZ80", CExecTrace::Z80, instructions));
+    dsb1->GetZ80()->SetTrace(m_cpuTraces.back().get());
+  }
+  else if (CDSB2 *dsb2 = dynamic_cast<CDSB2 *>(DSB))
+  {
+    m_cpuTraces.emplace_back(new CExecTrace("DSB68K", CExecTrace::M68K, instructions));
+    dsb2->GetM68K()->Trace = m_cpuTraces.back().get();
+  }
+  if (DriveBoard->IsAttached() && DriveBoard->GetZ80() != NULL)
+  {
+    m_cpuTraces.emplace_back(new CExecTrace("DrvZ80", CExecTrace::Z80, instructions));
+    DriveBoard->GetZ80()->SetTrace(m_cpuTraces.back().get());
+  }
+#ifdef NET_BOARD
+  CNetBoard *netBoard = dynamic_cast<CNetBoard *>(NetBoard);
+  if (netBoard != NULL && netBoard->IsAttached())
+  {
+    m_cpuTraces.emplace_back(new CExecTrace("Net68K", CExecTrace::M68K, instructions));
+    netBoard->GetM68K()->Trace = m_cpuTraces.back().get();
+  }
+#endif // NET_BOARD
+  printf("Tracing the last %u million instructions of %u CPUs.\n", unsigned(instructions / 1000000), unsigned(m_cpuTraces.size()));
 }
 
 FrameTimings CModel3::GetTimings(void)
@@ -2509,6 +2896,56 @@ FrameTimings CModel3::GetTimings(void)
   return timings;
 }
 
+FrameHashes CModel3::GetFrameHashes(void)
+{
+  FrameHashes hashes;
+  hashes.ram = Util::Hash64(ram, 0x800000);
+  hashes.real3D = GPU.HashSnapshots();
+  hashes.audio = SoundBoard.HashAudio();
+  return hashes;
+}
+
+void CModel3::SaveFrameState(CBlockFile *SaveState)
+{
+  GPU.SaveFrameState(SaveState);
+  TileGen.SaveFrameState(SaveState);
+}
+
+void CModel3::ConfigureBoardThread(const std::string &name)
+{
+  std::string cpus = m_config[name + "ThreadCPUs"].ValueAsDefault<std::string>("");
+  std::string priority = Util::ToLower(m_config[name + "ThreadPriority"].ValueAsDefault<std::string>("normal"));
+
+  if (!cpus.empty())
+  {
+    std::vector<unsigned> cpuList;
+    for (auto &cpu: Util::Format(cpus).Split(','))
+      cpuList.push_back(unsigned(atoi(cpu.c_str())));
+    if (!CThread::SetAffinity(cpuList))
+    {
+      ErrorLog("Unable to set affinity of %s thread to CPU(s) %s: %s\n", name.c_str(), cpus.c_str(), CThread::GetLastError());
+      cpus.clear();
+    }
+  }
+
+  if (priority == "high" || priority == "realtime")
+  {
+    if (!CThread::SetPriority(priority == "high" ? CThread::PRIORITY_HIGH : CThread::PRIORITY_REALTIME))
+    {
+      ErrorLog("Unable to set priority of %s thread to %s: %s\n", name.c_str(), priority.c_str(), CThread::GetLastError());
+      priority = "normal";
+    }
+  }
+  else if (priority != "normal")
+  {
+    ErrorLog("Invalid %sThreadPriority '%s'. Use normal, high or realtime.\n", name.c_str(), priority.c_str());
+    priority = "normal";
+  }
+
+  InfoLog("%s thread running on CPU(s) %s with %s priority.", name.c_str(), cpus.empty() ? "any" : cpus.c_str(), priority.c_str());
+  TRACE_THREAD_NAME(name);
+}
+
 int CModel3::StartMainBoardThread(void *data)
 {
   // Call method on CModel3 to run PPC main board thread
@@ -2537,8 +2974,20 @@ int CModel3::StartDriveBoardThread(void *data)
   return model3->RunDriveBoardThread();
 }
 
+#ifdef NET_BOARD
+int CModel3::StartNetBoardThread(void *data)
+{
+  // Call method on CModel3 to run net board thread
+  CModel3 *model3 = (CModel3*)data;
+  return model3->RunNetBoardThread();
+}
+#endif
+
 int CModel3::RunMainBoardThread(void)
 {
+  ConfigureBoardThread("MainBoard");
+  ppc_set_context(m_ppc);
+
   for (;;)
   {
     bool wait = true;
@@ -2576,15 +3025,17 @@ int CModel3::RunMainBoardThread(void)
     if (!notifyLock->Lock())
       goto ThreadError;
 
-    // Let other threads know processing has finished
+    // Let other threads know processing has finished (only PauseThreads and StopThreads wait on this)
     ppcBrdThreadRunning = false;
-    ppcBrdThreadDone = true;
-    if (!notifySync->SignalAll())
+    if (pauseThreads && !notifySync->SignalAll())
       goto ThreadError;
 
     // Leave notify critical section
     if (!notifyLock->Unlock())
       goto ThreadError;
+
+    // Hand frame back to render thread
+    frameDone.Arrive();
   }
 
 ThreadError:
@@ -2640,6 +3091,8 @@ ThreadError:
 
 int CModel3::RunSoundBoardThread(void)
 {
+  ConfigureBoardThread("SoundBoard");
+
   for (;;)
   {
     bool wait = true;
@@ -2705,10 +3158,9 @@ int CModel3::RunSoundBoardThread(void)
     if (!notifyLock->Lock())
       goto ThreadError;
 
-    // Let other threads know processing has finished
+    // Let other threads know processing has finished (only PauseThreads and StopThreads wait on this)
     sndBrdThreadRunning = false;
-    sndBrdThreadDone = true;
-    if (!notifySync->SignalAll())
+    if (pauseThreads && !notifySync->SignalAll())
       goto ThreadError;
 
     // Leave main notify critical section
@@ -2724,6 +3176,8 @@ ThreadError:
 
 int CModel3::RunSoundBoardThreadSyncd(void)
 {
+  ConfigureBoardThread("SoundBoard");
+
   for (;;)
   {
     bool wait = true;
@@ -2761,15 +3215,17 @@ int CModel3::RunSoundBoardThreadSyncd(void)
     if (!notifyLock->Lock())
       goto ThreadError;
 
-    // Let other threads know processing has finished
+    // Let other threads know processing has finished (only PauseThreads and StopThreads wait on this)
     sndBrdThreadRunning = false;
-    sndBrdThreadDone = true;
-    if (!notifySync->SignalAll())
+    if (pauseThreads && !notifySync->SignalAll())
       goto ThreadError;
 
     // Leave notify critical section
     if (!notifyLock->Unlock())
       goto ThreadError;
+
+    // Hand frame back to render thread
+    sndFrameDone.Arrive();
   }
 
 ThreadError:
@@ -2780,6 +3236,8 @@ ThreadError:
 
 int CModel3::RunDriveBoardThread(void)
 {
+  ConfigureBoardThread("DriveBoard");
+
   for (;;)
   {
     bool wait = true;
@@ -2817,15 +3275,17 @@ int CModel3::RunDriveBoardThread(void)
     if (!notifyLock->Lock())
       goto ThreadError;
 
-    // Let other threads know processing has finished
+    // Let other threads know processing has finished (only PauseThreads and StopThreads wait on this)
     drvBrdThreadRunning = false;
-    drvBrdThreadDone = true;
-    if (!notifySync->SignalAll())
+    if (pauseThreads && !notifySync->SignalAll())
       goto ThreadError;
 
     // Leave notify critical section
     if (!notifyLock->Unlock())
       goto ThreadError;
+
+    // Hand frame back to render thread
+    drvFrameDone.Arrive();
   }
 
 ThreadError:
@@ -2834,14 +3294,81 @@ ThreadError:
   return 1;
 }
 
+#ifdef NET_BOARD
+int CModel3::RunNetBoardThread(void)
+{
+  ConfigureBoardThread("NetBoard");
+
+  for (;;)
+  {
+    bool wait = true;
+    bool exit = false;
+    while (wait && !exit)
+    {
+      // Wait on net board thread semaphore
+      if (!netBrdThreadSync->Wait())
+        goto ThreadError;
+
+      // Enter notify critical section
+      if (!notifyLock->Lock())
+        goto ThreadError;
+
+      // Check threads are not being stopped or paused
+      if (stopThreads)
+        exit = true;
+      else if (!pauseThreads)
+      {
+        wait = false;
+        netBrdThreadRunning = true;
+      }
+
+      // Leave notify critical section
+      if (!notifyLock->Unlock())
+        goto ThreadError;
+    }
+    if (exit)
+      return 0;
+
+    // Process a single frame for net board
+    RunNetBoardFrame();
+
+    // Enter notify critical section
+    if (!notifyLock->Lock())
+      goto ThreadError;
+
+    // Let other threads know processing has finished (only PauseThreads and StopThreads wait on this)
+    netBrdThreadRunning = false;
+    if (pauseThreads && !notifySync->SignalAll())
+      goto ThreadError;
+
+    // Leave notify critical section
+    if (!notifyLock->Unlock())
+      goto ThreadError;
+
+    // Hand frame back to render thread
+    netFrameDone.Arrive();
+  }
+
+ThreadError:
+  ErrorLog("Threading error in RunNetBoardThread: %s\nSwitching back to single-threaded mode.\n", CThread::GetLastError());
+  m_multiThreaded = false;
+  return 1;
+}
+#endif
+
 void CModel3::Reset(void)
 {
+  ppc_set_context(m_ppc);
+
   // Clear memory (but do not modify backup RAM!)
   memset(ram, 0, 0x800000);
 
   // Initial bank is bank 0
   SetCROMBank(0xFF);
 
+  // Drop any events left over from before the reset
+  m_scheduler.Clear();
+
   // Reset security device
   securityPtr = 0;
   m_securityFirstRead = true;
@@ -2857,6 +3384,7 @@ void CModel3::Reset(void)
 
   // Reset all devices
   ppc_reset();
+  WarmUpPPCCode();
   IRQ.Reset();
   PCIBridge.Reset();
   PCIBus.Reset();
@@ -2875,19 +3403,24 @@ void CModel3::Reset(void)
 
   gpusReady = false;
 
-  timings.ppcTicks = 0;
+  timings.ppcMicros = 0;
+  timings.ppcIdleCycles = 0;
   timings.syncSize = 0;
-  timings.syncTicks = 0;
-  timings.renderTicks = 0;
-  timings.sndTicks = 0;
-  timings.drvTicks = 0;
+  timings.syncMicros = 0;
+  timings.renderMicros = 0;
+  timings.sndMicros = 0;
+  timings.dsbIdleCycles = 0;
+  timings.drvMicros = 0;
+  timings.drvIdleCycles = 0;
 #ifdef NET_BOARD
-  timings.netTicks = 0;
+  timings.netMicros = 0;
   NetBoard->Reset();
 #endif
-  timings.frameTicks = 0;
+  timings.frameMicros = 0;
+  memset(timings.allocations, 0, sizeof(timings.allocations));
+  Util::AllocTracker::Read(&allocCounts);
 
-  DebugLog("Model 3 reset\n");
+  DEBUG_LOG(Model3, "Model 3 reset\n");
 }
 
 
@@ -2900,11 +3433,153 @@ const Game &CModel3::GetGame() const
   return m_game;
 }
 
+/*
+ * PowerPC code cache: where translated blocks in fixed CROM start, so that a
+ * block engine can translate them all on reset instead of the first time each
+ * one runs. The file is keyed by a hash of fixed CROM and the Supermodel
+ * version and is ignored if either differs. Only the addresses are kept;
+ * translations contain host pointers and are quick to make again.
+ */
+static const int32_t PPC_CODE_CACHE_FILE_VERSION = 0;
+
+void CModel3::LoadPPCCodeCache(const std::string &gameName)
+{
+  m_ppcCodeCacheFile = "NVRAM/" + gameName + ".ppc";
+  m_ppcCodeCacheKey = Util::Hash64(crom, 8*0x100000) ^ Util::Hash64((const UINT8 *) SUPERMODEL_VERSION, sizeof(SUPERMODEL_VERSION) - 1);
+  m_ppcCodeCache.clear();
+
+  CBlockFile file;
+  if (OKAY != file.Load(m_ppcCodeCacheFile))
+    return; // nothing cached yet
+  if (OKAY != file.FindBlock("Supermodel PowerPC Code Cache"))
+  {
+    ErrorLog("'%s' is not a valid PowerPC code cache file.", m_ppcCodeCacheFile.c_str());
+    return;
+  }
+
+  int32_t fileVersion = -1;
+  UINT64 key = 0;
+  UINT32 count = 0;
+  file.Read(&fileVersion, sizeof(fileVersion));
+  file.Read(&key, sizeof(key));
+  if (fileVersion != PPC_CODE_CACHE_FILE_VERSION || key != m_ppcCodeCacheKey)
+    return; // stale, will be rewritten on exit
+  if (OKAY != file.FindBlock("Blocks") || file.Read(&count, sizeof(count)) != sizeof(count))
+    return;
+
+  m_ppcCodeCache.resize(count);
+  unsigned bytes = file.Read(m_ppcCodeCache.data(), count * sizeof(UINT32));
+  m_ppcCodeCache.resize(bytes / sizeof(UINT32));
+  DebugLog("Loaded %u PowerPC code blocks from '%s'.\n", (unsigned) m_ppcCodeCache.size(), m_ppcCodeCacheFile.c_str());
+}
+
+void CModel3::SavePPCCodeCache(void)
+{
+  if (m_ppcCodeCacheFile.empty())
+    return;
+
+  // Blocks from earlier runs may have been evicted this time, so keep those too
+  std::vector<UINT32> pcs(ppc_get_code_blocks(0xFF800000, 0xFFFFFFFF, NULL, 0));
+  pcs.resize(ppc_get_code_blocks(0xFF800000, 0xFFFFFFFF, pcs.data(), (unsigned) pcs.size()));
+  pcs.insert(pcs.end(), m_ppcCodeCache.begin(), m_ppcCodeCache.end());
+  std::sort(pcs.begin(), pcs.end());
+  pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+  if (pcs.empty())
+    return;
+
+  CBlockFile file;
+  if (OKAY != file.Create(m_ppcCodeCacheFile, "Supermodel PowerPC Code Cache", "Supermodel Version " SUPERMODEL_VERSION))
+  {
+    ErrorLog("Unable to save PowerPC code cache to '%s'. Make sure directory exists!", m_ppcCodeCacheFile.c_str());
+    return;
+  }
+  int32_t fileVersion = PPC_CODE_CACHE_FILE_VERSION;
+  UINT32 count = (UINT32) pcs.size();
+  file.Write(&fileVersion, sizeof(fileVersion));
+  file.Write(&m_ppcCodeCacheKey, sizeof(m_ppcCodeCacheKey));
+  file.NewBlock("Blocks", "Fixed CROM block entry points");
+  file.Write(&count, sizeof(count));
+  file.Write(pcs.data(), count * sizeof(UINT32));
+  file.Close();
+}
+
+void CModel3::WarmUpPPCCode(void)
+{
+  if (m_ppcCodeCache.empty())
+    return;
+  unsigned translated = ppc_translate_code_blocks(m_ppcCodeCache.data(), (unsigned) m_ppcCodeCache.size());
+  DebugLog("Translated %u of %u cached PowerPC code blocks.\n", translated, (unsigned) m_ppcCodeCache.size());
+}
+
+// VROM is only read by the GPU, a little at a time, so if it came from the ROM
+// cache it is mapped in from there instead, and only the pages the GPU reads
+// are ever loaded. Anything short of a whole page at the end is copied.
+void CModel3::LoadVROM(UINT8 *dest, size_t dest_size, const ROM &rom)
+{
+  size_t size = std::min(rom.size, dest_size);
+  size_t mapped = size / Util::MappedMemory::PageSize() * Util::MappedMemory::PageSize();
+  if (!m_config["MapVROM"].ValueAs<bool>() || rom.file.empty() || !rom.patches.empty() || !mapped ||
+      Util::MappedMemory::MapFile(dest, mapped, rom.file, rom.file_offset))
+  {
+    rom.CopyTo(dest, dest_size);
+    return;
+  }
+  memcpy(&dest[mapped], rom.data.get() + mapped, size - mapped);
+  InfoLog("Mapped %1.1f MB of VROM from '%s'.", (float)mapped / (float)0x100000, rom.file.c_str());
+}
+
+/*
+ * Shared ROM image: with ShareROMs, CROM, sample ROM and MPEG ROM are kept
+ * fully assembled (mirrored, patched and in host byte order) in a file beside
+ * the ROM cache file and mapped from there read-only, so that every process
+ * running the game uses the same pages of the OS file cache instead of a copy
+ * of its own. The image is keyed by the cache file, the patches and the
+ * Supermodel version, and is made again whenever one of them differs.
+ */
+static UINT64 ROMImageKey(const ROMSet &rom_set, std::string *imageFile)
+{
+  ROM crom = rom_set.get_rom("crom");
+  struct stat st;
+  if (crom.file.empty() || stat(crom.file.c_str(), &st) != 0)
+    return 0; // not loaded from the ROM cache
+  std::vector<UINT8> id((const UINT8 *) SUPERMODEL_VERSION, (const UINT8 *) SUPERMODEL_VERSION + sizeof(SUPERMODEL_VERSION) - 1);
+  auto put = [&id](UINT64 value) { id.insert(id.end(), (const UINT8 *) &value, (const UINT8 *) &value + sizeof(value)); };
+  put(UINT64(st.st_size));
+  put(UINT64(st.st_mtime));
+  for (const char *region: { "crom", "banked_crom", "sound_samples", "mpeg_music" })
+  {
+    ROM rom = rom_set.get_rom(region);
+    put(rom.size);
+    put(rom.file_offset);
+    for (auto &patch: rom.patches)
+    {
+      put(patch.offset);
+      put(patch.value);
+      put(patch.bits);
+    }
+  }
+  *imageFile = crom.file.substr(0, crom.file.find_last_of('.')) + ".image";
+  return Util::Hash64(id.data(), id.size());
+}
+
 // Stepping-dependent parameters (MPC10x type, etc.) are initialized here
 bool CModel3::LoadGame(const Game &game, const ROMSet &rom_set)
 {
+  ppc_set_context(m_ppc);
   m_game = Game();
 
+  // Views can't be placed over part of an allocation on Windows, so there is
+  // nothing to share there
+  std::string imageFile;
+  UINT64 imageKey = 0;
+  bool imageMapped = false;
+#ifndef _WIN32
+  if (m_config["ShareROMs"].ValueAsDefault<bool>(false))
+    imageKey = ROMImageKey(rom_set, &imageFile);
+#endif
+  if (!imageFile.empty() && OKAY != MapROMImage(imageFile, imageKey, &imageMapped))
+    return FAIL;
+
   /*
    * Copy in ROM data with mirroring as necessary for the following cases:
    *
@@ -2917,37 +3592,49 @@ bool CModel3::LoadGame(const Game &game, const ROMSet &rom_set)
   if (rom_set.get_rom("vrom").size <= 32*0x100000)
   {
     rom_set.get_rom("vrom").CopyTo(&vrom[0], 32*100000);
-    rom_set.get_rom("vrom").CopyTo(&vrom[32*0x100000], 32*0x100000);
+    LoadVROM(&vrom[32*0x100000], 32*0x100000, rom_set.get_rom("vrom"));
   }
   else
-    rom_set.get_rom("vrom").CopyTo(vrom, 64*0x100000);
-  if (rom_set.get_rom("banked_crom").size <= 64*0x100000)
+    LoadVROM(vrom, 64*0x100000, rom_set.get_rom("vrom"));
+  if (!imageMapped)
   {
-    rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 0], 64*0x100000);
-    rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 64*0x100000], 64*0x100000);
-  }
-  else
-    rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 0], 128*0x100000);
-  size_t crom_size = rom_set.get_rom("crom").size;
-  rom_set.get_rom("crom").CopyTo(&crom[8*0x100000 - crom_size], crom_size);
-  if (crom_size < 8*0x100000)
-    rom_set.get_rom("banked_crom").CopyTo(&crom[0], 8*0x100000 - crom_size);
-  if (rom_set.get_rom("sound_samples").size <= 8*0x100000)
-  {
-    rom_set.get_rom("sound_samples").CopyTo(&sampleROM[0], 8*0x100000);
-    rom_set.get_rom("sound_samples").CopyTo(&sampleROM[8*0x100000], 8*0x100000);
+    if (rom_set.get_rom("banked_crom").size <= 64*0x100000)
+    {
+      rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 0], 64*0x100000);
+      rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 64*0x100000], 64*0x100000);
+    }
+    else
+      rom_set.get_rom("banked_crom").CopyTo(&crom[8*0x100000 + 0], 128*0x100000);
+    size_t crom_size = rom_set.get_rom("crom").size;
+    rom_set.get_rom("crom").CopyTo(&crom[8*0x100000 - crom_size], crom_size);
+    if (crom_size < 8*0x100000)
+      rom_set.get_rom("banked_crom").CopyTo(&crom[0], 8*0x100000 - crom_size);
+    if (rom_set.get_rom("sound_samples").size <= 8*0x100000)
+    {
+      rom_set.get_rom("sound_samples").CopyTo(&sampleROM[0], 8*0x100000);
+      rom_set.get_rom("sound_samples").CopyTo(&sampleROM[8*0x100000], 8*0x100000);
+    }
+    else
+      rom_set.get_rom("sound_samples").CopyTo(sampleROM, 16*0x100000);
+    rom_set.get_rom("mpeg_music").CopyTo(mpegROM, 16*0x100000);
   }
-  else
-    rom_set.get_rom("sound_samples").CopyTo(sampleROM, 16*0x100000);
   rom_set.get_rom("sound_program").CopyTo(soundROM, 512*1024);
   rom_set.get_rom("mpeg_program").CopyTo(dsbROM, 128*1024);
-  rom_set.get_rom("mpeg_music").CopyTo(mpegROM, 16*0x100000);
   rom_set.get_rom("driveboard_program").CopyTo(driveROM, 64*1024);
 
   // Convert PowerPC and 68K ROMs to little endian words
-  Util::FlipEndian32(crom, 8*0x100000 + 128*0x100000);
+  if (!imageMapped)
+  {
+    Util::FlipEndian32(crom, 8*0x100000 + 128*0x100000);
+    Util::FlipEndian16(sampleROM, 16*0x100000);
+  }
   Util::FlipEndian16(soundROM, 512*1024);
-  Util::FlipEndian16(sampleROM, 16*0x100000);
+
+  // The first process to run the game makes the image, then maps it like the
+  // rest, giving up its own copy
+  if (!imageFile.empty() && !imageMapped && OKAY == SaveROMImage(imageFile, imageKey) &&
+      OKAY != MapROMImage(imageFile, imageKey, &imageMapped))
+    return FAIL;
 
   // Configure CPU and PCI bridge
   PPC_CONFIG  ppc_config;
@@ -3002,6 +3689,45 @@ bool CModel3::LoadGame(const Game &game, const ROMSet &rom_set)
   PPCFetchRegions[2].ptr = NULL;
   ppc_set_fetch(PPCFetchRegions);
 
+  // Map memory for direct PowerPC access (banked CROM is mapped by SetCROMBank())
+  ppc_map_memory(0x00000000, 0x007FFFFF, ram, true);
+  ppc_map_memory(0xFF800000, 0xFFFFFFFF, crom, false);
+
+  // Select PowerPC execution engine
+  std::string ppcEngine = m_config["PowerPCEngine"].ValueAs<std::string>();
+  if (ppcEngine == "jit")
+  {
+    if (!ppc_set_engine(PPC_ENGINE_JIT))
+      ErrorLog("PowerPC recompiler is not supported on this platform. Using interpreter.");
+  }
+  else if (ppcEngine == "threaded")
+    ppc_set_engine(PPC_ENGINE_THREADED);
+  else
+  {
+    if (ppcEngine != "interpreter")
+      ErrorLog("Unknown PowerPC engine '%s'. Using interpreter.", ppcEngine.c_str());
+    ppc_set_engine(PPC_ENGINE_INTERPRETER);
+  }
+
+  // Idle loop skipping can be disabled per game in the ROM set definition file
+  ppc_set_idle_loop_detection(game.idle_loop_detection);
+  ppc_set_profiling(m_config["ProfilePPC"].ValueAsDefault<bool>(false));
+  if (m_config["PowerPCCodeCache"].ValueAsDefault<bool>(false) && ppc_get_engine() != PPC_ENGINE_INTERPRETER)
+    LoadPPCCodeCache(game.name);
+
+  // FPSCR flag tracking (fast mode is usually set in a game's own section)
+  std::string ppcFPU = m_config["PowerPCFPU"].ValueAsDefault<std::string>("accurate");
+  if (ppcFPU == "fast")
+    ppc_set_fpu_mode(PPC_FPU_FAST);
+  else if (ppcFPU == "validate")
+    ppc_set_fpu_mode(PPC_FPU_VALIDATE);
+  else
+  {
+    if (ppcFPU != "accurate")
+      ErrorLog("Unknown PowerPC FPU mode '%s'. Using accurate.", ppcFPU.c_str());
+    ppc_set_fpu_mode(PPC_FPU_ACCURATE);
+  }
+
   // Initialize Real3D
   int stepping = ((game.stepping[0] - '0') << 4) | (game.stepping[2] - '0');
   uint32_t real3DPCIID = game.real3d_pci_id;
@@ -3109,7 +3835,12 @@ bool CModel3::LoadGame(const Game &game, const ROMSet &rom_set)
   }
 
   m_runNetBoard = m_game.stepping != "1.0" && NetBoard->IsAttached();
+#ifdef SUPERMODEL_BUS_PROFILE
+  m_busProfile.SetNetBoard(m_runNetBoard);
 #endif
+#endif
+
+  StartCPUTraces();
   return OKAY;
 }
 
@@ -3117,6 +3848,9 @@ void CModel3::AttachRenderers(CRender2D *Render2DPtr, IRender3D *Render3DPtr)
 {
   TileGen.AttachRenderer(Render2DPtr);
   GPU.AttachRenderer(Render3DPtr);
+  render3D = Render3DPtr;
+  texCacheHits = 0;
+  texCacheMisses = 0;
 }
 
 void CModel3::AttachInputs(CInputs *InputsPtr)
@@ -3126,7 +3860,7 @@ void CModel3::AttachInputs(CInputs *InputsPtr)
   if (DriveBoard->IsAttached())
     DriveBoard->AttachInputs(Inputs, m_game.inputs);
 
-  DebugLog("Model 3 attached inputs\n");
+  DEBUG_LOG(Model3, "Model 3 attached inputs\n");
 }
 
 void CModel3::AttachOutputs(COutputs *OutputsPtr)
@@ -3138,7 +3872,7 @@ void CModel3::AttachOutputs(COutputs *OutputsPtr)
   if (DriveBoard->IsAttached())
     DriveBoard->AttachOutputs(Outputs);
 
-  DebugLog("Model 3 attached outputs\n");
+  DEBUG_LOG(Model3, "Model 3 attached outputs\n");
 }
 
 const static int RAM_SIZE			= 0x800000;		//8MB
@@ -3155,8 +3889,9 @@ const static int DRIVEROM_SIZE		= 0x10000;		//64KB
 const static int NETBUFFER_SIZE		= 0x20000;		//128KB
 const static int NETRAM_SIZE		= 0x20000;		//128KB
 
+// VROM is allocated on its own, so that it can be mapped from the ROM cache
 const static int MEM_POOL_SIZE		= RAM_SIZE + CROM_SIZE +
-                                        CROMxx_SIZE + VROM_SIZE +
+                                        CROMxx_SIZE +
                                         BACKUPRAM_SIZE + SECURITYRAM_SIZE +
                                         SOUNDROM_SIZE + SAMPLEROM_SIZE +
                                         DSBPROGROM_SIZE + DSBMPEGROM_SIZE +
@@ -3166,8 +3901,7 @@ const static int MEM_POOL_SIZE		= RAM_SIZE + CROM_SIZE +
 const static int RAM_OFFSET			= 0;
 const static int CROM_OFFSET		= RAM_OFFSET + RAM_SIZE;
 const static int CROMxx_OFFSET		= CROM_OFFSET + CROM_SIZE;
-const static int VROM_OFFSET		= CROMxx_OFFSET + CROMxx_SIZE;
-const static int BACKUPRAM_OFFSET	= VROM_OFFSET + VROM_SIZE;
+const static int BACKUPRAM_OFFSET	= CROMxx_OFFSET + CROMxx_SIZE;
 const static int SECURITYRAM_OFFSET	= BACKUPRAM_OFFSET + BACKUPRAM_SIZE;
 const static int SOUNDROM_OFFSET	= SECURITYRAM_OFFSET + SECURITYRAM_SIZE;
 const static int SAMPLEROM_OFFSET	= SOUNDROM_OFFSET + SOUNDROM_SIZE;
@@ -3177,21 +3911,89 @@ const static int DRIVEROM_OFFSET	= DSBMPEGROM_OFFSET + DSBMPEGROM_SIZE;
 const static int NETBUFFER_OFFSET	= DRIVEROM_OFFSET + DRIVEROM_SIZE;
 const static int NETRAM_OFFSET		= NETBUFFER_OFFSET + NETBUFFER_SIZE;
 
+// Parts of the pool kept in the shared ROM image, after a header padded to a
+// whole number of pages on any host
+static const struct { size_t offset, size; } s_romImageSegments[] =
+{
+  { CROM_OFFSET,        CROM_SIZE + CROMxx_SIZE },
+  { SAMPLEROM_OFFSET,   SAMPLEROM_SIZE },
+  { DSBMPEGROM_OFFSET,  DSBMPEGROM_SIZE }
+};
+static const char ROM_IMAGE_MAGIC[8] = { 'S', 'M', 'R', 'O', 'M', 'I', '0', '1' };
+static const size_t ROM_IMAGE_HEADER_SIZE = 0x10000;
+static const size_t ROM_IMAGE_SIZE = ROM_IMAGE_HEADER_SIZE + CROM_SIZE + CROMxx_SIZE + SAMPLEROM_SIZE + DSBMPEGROM_SIZE;
+
+bool CModel3::MapROMImage(const std::string &imageFile, UINT64 key, bool *mapped)
+{
+  *mapped = false;
+  FILE *fp = fopen(imageFile.c_str(), "rb");
+  if (!fp)
+    return OKAY;  // not made yet
+  char magic[sizeof(ROM_IMAGE_MAGIC)];
+  UINT64 imageKey = 0;
+  bool current = fread(magic, sizeof(magic), 1, fp) == 1 && !memcmp(magic, ROM_IMAGE_MAGIC, sizeof(magic)) &&
+                 fread(&imageKey, sizeof(imageKey), 1, fp) == 1 && imageKey == key &&
+                 fseek(fp, 0, SEEK_END) == 0 && ftell(fp) == long(ROM_IMAGE_SIZE);
+  fclose(fp);
+  if (!current)
+    return OKAY;  // made again over the old one
+
+  // Mapping only fails when out of address space, and by then the segments
+  // before are read-only, so the ROMs can't be copied in instead
+  UINT64 offset = ROM_IMAGE_HEADER_SIZE;
+  for (auto &segment: s_romImageSegments)
+  {
+    if (Util::MappedMemory::MapFile(&memoryPool[segment.offset], segment.size, imageFile, offset))
+      return ErrorLog("Unable to map shared ROM image '%s'.", imageFile.c_str());
+    offset += segment.size;
+  }
+  *mapped = true;
+  InfoLog("Mapped %1.1f MB of ROM from shared image '%s'.", (float)(ROM_IMAGE_SIZE - ROM_IMAGE_HEADER_SIZE) / (float)0x100000, imageFile.c_str());
+  return OKAY;
+}
+
+bool CModel3::SaveROMImage(const std::string &imageFile, UINT64 key) const
+{
+  // Written under another name first and renamed over any old image, so that
+  // no process ever maps one half written
+  std::string tempFile = imageFile + ".tmp";
+  FILE *fp = fopen(tempFile.c_str(), "wb");
+  if (!fp)
+    return ErrorLog("Unable to write shared ROM image '%s'.", imageFile.c_str());
+  std::vector<UINT8> header(ROM_IMAGE_HEADER_SIZE, 0);
+  memcpy(header.data(), ROM_IMAGE_MAGIC, sizeof(ROM_IMAGE_MAGIC));
+  memcpy(&header[sizeof(ROM_IMAGE_MAGIC)], &key, sizeof(key));
+  bool error = fwrite(header.data(), header.size(), 1, fp) != 1;
+  for (auto &segment: s_romImageSegments)
+    error |= fwrite(&memoryPool[segment.offset], segment.size, 1, fp) != 1;
+  error |= fclose(fp) != 0;
+  if (error || rename(tempFile.c_str(), imageFile.c_str()) != 0)
+  {
+    remove(tempFile.c_str());
+    return ErrorLog("Unable to write shared ROM image '%s'.", imageFile.c_str());
+  }
+  InfoLog("Wrote shared ROM image '%s'.", imageFile.c_str());
+  return OKAY;
+}
+
 // Model 3 initialization. Some initialization is deferred until ROMs are loaded in LoadROMSet()
 bool CModel3::Init(void)
 {
   float memSizeMB = (float)MEM_POOL_SIZE / (float)0x100000;
 
-  // Allocate all memory for ROMs and PPC RAM
-  memoryPool = new(std::nothrow) UINT8[MEM_POOL_SIZE];
+  // Allocate all memory for ROMs and PPC RAM. The pool starts on a huge page
+  // and RAM, CROM and banked CROM are multiples of 2 MB, so each of them
+  // begins on a huge page of its own. It comes from the OS zeroed.
+  memoryPool = Util::MappedMemory::AllocateLarge(MEM_POOL_SIZE);
   if (NULL == memoryPool)
     return ErrorLog("Insufficient memory for Model 3 object (needs %1.1f MB).", memSizeMB);
-  memset(memoryPool, 0, MEM_POOL_SIZE);
+  vrom = Util::MappedMemory::Allocate(VROM_SIZE);
+  if (NULL == vrom)
+    return ErrorLog("Insufficient memory for Model 3 object (needs %1.1f MB).", memSizeMB + (float)VROM_SIZE / (float)0x100000);
 
   // Set up pointers
   ram = &memoryPool[RAM_OFFSET];
   crom = &memoryPool[CROM_OFFSET];
-  vrom = &memoryPool[VROM_OFFSET];
   soundROM = &memoryPool[SOUNDROM_OFFSET];
   sampleROM = &memoryPool[SAMPLEROM_OFFSET];
   dsbROM = &memoryPool[DSBPROGROM_OFFSET];
@@ -3210,10 +4012,12 @@ bool CModel3::Init(void)
   PCIBus.Init();
   SCSI.Init(this,&IRQ,0x100); // SCSI is actually a non-maskable interrupt, so we give it a bit number outside of 8-bit range
   RTC.Init();
+  if (m_config["Benchmark"].ValueAsDefault<unsigned>(0) > 0 || !m_config["FrameHashLog"].ValueAsDefault<std::string>("").empty() || !m_config["VerifyFrameHashes"].ValueAsDefault<std::string>("").empty())
+    RTC.SetFixedTime(946684800);  // 2000-01-01, so that benchmark and regression runs are repeatable
   EEPROM.Init();
   if (OKAY != TileGen.Init(&IRQ))
     return FAIL;
-  if (OKAY != GPU.Init(vrom,this,&IRQ,0x100)) // same for Real3D DMA interrupt
+  if (OKAY != GPU.Init(vrom,ram,this,&IRQ,0x100)) // same for Real3D DMA interrupt
     return FAIL;
   if (OKAY != SoundBoard.Init(soundROM,sampleROM))
     return FAIL;
@@ -3230,7 +4034,7 @@ bool CModel3::Init(void)
       NetBoard = new CNetBoard(m_config);
 #endif // NET_BOARD
 
-  DebugLog("Initialized Model 3 (allocated %1.1f MB)\n", memSizeMB);
+  DEBUG_LOG(Model3, "Initialized Model 3 (allocated %1.1f MB)\n", memSizeMB);
 
   return OKAY;
 }
@@ -3256,11 +4060,18 @@ CModel3::CModel3(const Util::Config::Node &config)
   : m_config(config),
     m_multiThreaded(config["MultiThreaded"].ValueAs<bool>()),
     m_gpuMultiThreaded(config["GPUMultiThreaded"].ValueAs<bool>()),
+    m_boardLatency(std::min(config["BoardLatencyFrames"].ValueAsDefault<unsigned>(0), 4u)),
+    m_parallelState(config["ParallelSaveState"].ValueAsDefault<bool>(true) && !config["LowMemory"].ValueAsDefault<bool>(false)),
+    m_ppcFrequency(config, "PowerPCFrequency"),
     TileGen(config),
     GPU(config),
     SoundBoard(config),
     m_jtag(GPU)
 {
+  // PowerPC state is this object's own, made active on each thread that runs it
+  m_ppc = ppc_create_context();
+  ppc_set_context(m_ppc);
+
   // Initialize pointers so dtor can know whether to free them
   memoryPool = NULL;
 
@@ -3268,6 +4079,7 @@ CModel3::CModel3(const Util::Config::Node &config)
   Inputs = NULL;
   Outputs = NULL;
   ram = NULL;
+  ppcCodePages = ppc_get_code_page_map();
   crom = NULL;
   vrom = NULL;
   soundROM = NULL;
@@ -3291,23 +4103,28 @@ CModel3::CModel3(const Util::Config::Node &config)
   ppcBrdThread = NULL;
   sndBrdThread = NULL;
   drvBrdThread = NULL;
+  netBrdThread = NULL;
 
   ppcBrdThreadRunning = false;
-  ppcBrdThreadDone = false;
   sndBrdThreadRunning = false;
-  sndBrdThreadDone = false;
   drvBrdThreadRunning = false;
-  drvBrdThreadDone = false;
+  netBrdThreadRunning = false;
 
   syncSndBrdThread = false;
   ppcBrdThreadSync = NULL;
   sndBrdThreadSync = NULL;
   drvBrdThreadSync = NULL;
+  netBrdThreadSync = NULL;
 
   notifyLock = NULL;
   notifySync = NULL;
 
-  DebugLog("Built Model 3\n");
+  render3D = NULL;
+  texCacheHits = 0;
+  texCacheMisses = 0;
+  Util::AllocTracker::Read(&allocCounts);
+
+  DEBUG_LOG(Model3, "Built Model 3\n");
 }
 
 // Dumps a memory region to a file for debugging purposes
@@ -3343,19 +4160,26 @@ CModel3::~CModel3(void)
   // Stop all threads
   StopThreads();
 
-  // Free memory
-  if (memoryPool != NULL)
-  {
-    delete [] memoryPool;
-    memoryPool = NULL;
-  }
+  // Traces are freed with this object
+  ppc_set_context(m_ppc);
+  ppc_set_trace(NULL);
+  SavePPCCodeCache();
+  if (m_config["PowerPCFPU"].ValueAsDefault<std::string>("accurate") == "validate")
+    InfoLog("PowerPC FPU validation: %llu FPSCR reads would have differed in fast mode.", (unsigned long long) ppc_get_stale_fpscr_reads());
 
+  // Delete DSB first, which stops MPEG decoding from reading its ROM
   if (DSB != NULL)
   {
     delete DSB;
     DSB = NULL;
   }
 
+  // Free memory
+  ppc_map_memory(0x00000000, 0xFFFFFFFF, NULL, false);
+  Util::MappedMemory::Free(memoryPool, MEM_POOL_SIZE);
+  memoryPool = NULL;
+  Util::MappedMemory::Free(vrom, VROM_SIZE);
+
   if (DriveBoard != NULL)
   {
       delete DriveBoard;
@@ -3377,5 +4201,8 @@ CModel3::~CModel3(void)
   netRAM = NULL;
   netBuffer = NULL;
 
-  DebugLog("Destroyed Model 3\n");
+  ppc_destroy_context(m_ppc);
+  m_ppc = NULL;
+
+  DEBUG_LOG(Model3, "Destroyed Model 3\n");
 }
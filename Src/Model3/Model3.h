@@ -31,29 +31,61 @@
 
 #include "Model3/IEmulator.h"
 #include "Model3/JTAG.h"
+#include "Model3/Scheduler.h"
 #include "Model3/Crypto.h"
+#ifdef SUPERMODEL_BUS_PROFILE
+#include "Model3/BusProfile.h"
+#endif
 #ifdef NET_BOARD
 #include "Network/INetBoard.h"
 #endif // NET_BOARD
 #include "Util/NewConfig.h"
+#include "Util/AllocTracker.h"
+#include "Graphics/GPUTimer.h"
+#include <memory>
+#include <vector>
+
+struct ROM;
 
 /*
  * FrameTimings
  *
- * Timings within a frame, for debugging purposes
+ * Timings within a frame, for debugging purposes. All times are in
+ * microseconds.
  */
 struct FrameTimings
 {
-  UINT32 ppcTicks;
+  UINT32 ppcMicros;
+  UINT32 ppcIdleCycles;   // PowerPC cycles skipped by idle loop detection
   UINT32 syncSize;
-  UINT32 syncTicks;
-  UINT32 renderTicks;
-  UINT32 sndTicks;
-  UINT32 drvTicks;
+  UINT32 syncMicros;
+  UINT32 renderMicros;
+  UINT32 sndMicros;
+  UINT32 dsbIdleCycles;   // DSB1 Z80 cycles skipped while halted or in idle loops
+  UINT32 drvMicros;
+  UINT32 drvIdleCycles;   // drive board Z80 cycles skipped while halted or in idle loops
 #ifdef NET_BOARD
-  UINT32 netTicks;
+  UINT32 netMicros;
 #endif
-  UINT32 frameTicks;
+  UINT32 frameMicros;
+  UINT32 waitMicros;      // time render thread spent waiting for board threads at end of frame
+  bool waitParked;        // true if that wait outlasted the spin and had to sleep
+  UINT32 gpuMicros[CGPUTimer::NumPasses];  // GPU time of each rendering pass, a frame behind, 0 unless enabled
+  UINT32 texCacheHits;    // textures the 3D renderer found in its texture cache rather than uploading
+  UINT32 texCacheMisses;  // and those it uploaded
+  UINT32 allocations[Util::AllocTracker::NumSubsystems];  // heap allocations made during the frame, 0 unless built with allocation tracking
+};
+
+/*
+ * FrameHashes:
+ *
+ * Hashes of a frame's results, as compared between runs by regression tests.
+ */
+struct FrameHashes
+{
+  UINT64 ram;     // PowerPC RAM
+  UINT64 real3D;  // Real3D memory the frame was rendered from
+  UINT64 audio;   // sound board output
 };
 
 /*
@@ -100,6 +132,7 @@ public:
   void Write16(UINT32 addr, UINT16 data);
   void Write32(UINT32 addr, UINT32 data);
   void Write64(UINT32 addr, UINT64 data);
+  bool CopyBlock(UINT32 dest, UINT32 src, UINT32 numBytes);
 
   /*
    * LoadGame(game, rom_set):
@@ -151,10 +184,64 @@ public:
   /*
    * DumpTimings(void):
    *
-   * Prints all timings for the most recent frame to the console, for debugging purposes.
+   * Prints all timings for the most recent frame to the console, along with
+   * the number of pages of each GPU memory region that had to be copied to
+   * its snapshot and, in bus profiling builds, the regions the PowerPC spent
+   * the most time accessing, for debugging purposes.
    */
   void DumpTimings(void);
 
+#ifdef SUPERMODEL_BUS_PROFILE
+  /*
+   * DumpBusProfile(void):
+   *
+   * Prints how many accesses the PowerPC made to each memory mapped region
+   * per frame over the run, and the host time they took, busiest first.
+   * Only in builds with SUPERMODEL_BUS_PROFILE defined.
+   */
+  void DumpBusProfile(void);
+#endif
+
+  /*
+   * DumpPPCProfile(file):
+   *
+   * Writes the hottest PowerPC code blocks and instruction classes sampled so
+   * far to a text file. Only has data if the ProfilePPC option is enabled.
+   *
+   * Parameters:
+   *    file    File name.
+   */
+  void DumpPPCProfile(const char *file);
+
+  /*
+   * DumpCPUTrace(file):
+   *
+   * Writes the instructions most recently executed by each CPU to a binary
+   * trace file, which Src/CPU/TraceDecoder.cpp lists. Only has data if the
+   * CPUTrace option is set. The CPUs should be stopped, except when dumping
+   * after a crash.
+   *
+   * Parameters:
+   *    file    File name.
+   */
+  void DumpCPUTrace(const char *file);
+
+  /*
+   * WatchPPCAddress(enable, addr):
+   * PPCAddressReached(void):
+   *
+   * Watches for the PowerPC executing the instruction at an address, as fast
+   * start does to tell when the game has finished booting, and reports
+   * whether it has. The PowerPC uses the interpreter until it is reached or
+   * the watch is turned off.
+   *
+   * Parameters:
+   *    enable  True to start watching, false to stop.
+   *    addr    Address of the instruction.
+   */
+  void WatchPPCAddress(bool enable, UINT32 addr);
+  bool PPCAddressReached(void) const;
+
   /*
    * GetTimings(void):
    *
@@ -162,6 +249,27 @@ public:
    */
   FrameTimings GetTimings(void);
 
+  /*
+   * GetFrameHashes(void):
+   *
+   * Returns hashes of the state the most recent frame left behind, which
+   * match between runs only if they emulated exactly the same thing. Must be
+   * called between frames, with the board threads not running.
+   */
+  FrameHashes GetFrameHashes(void);
+
+  /*
+   * SaveFrameState(SaveState):
+   *
+   * Saves the Real3D and tile generator state the most recent frame was
+   * rendered from, which CModel3GraphicsState can load to render the frame
+   * again without the rest of the system. Threads must be paused.
+   *
+   * Parameters:
+   *    SaveState   Block file to save state information to.
+   */
+  void SaveFrameState(CBlockFile *SaveState);
+
   /*
    * CModel3(config):
    * ~CModel3(void):
@@ -184,6 +292,7 @@ public:
    */
 private:
   // Private member functions
+  void      LatchInputs(void);
   UINT8     ReadInputs(unsigned reg);
   void      WriteInputs(unsigned reg, UINT8 data);
   uint16_t  ReadSecurityRAM(uint32_t addr);
@@ -194,6 +303,9 @@ private:
   void      WriteSystemRegister(unsigned reg, UINT8 data);
 
   void RunMainBoardFrame(void);                       // Runs PPC main board for a frame
+  void RefreshGPUWriteBuffers(void);                  // Brings double-buffered GPU memory up to date - must be called before PPC runs after SyncGPUs
+  void CheckCodeWrite(UINT32 addr, unsigned size);    // Invalidates translated PowerPC code in modified RAM
+  void MIDIInterruptEvent(unsigned irqCount);         // Fires next VBlank MIDI IRQ or ends VBlank
   void SyncGPUs(void);                                // Sync's up GPUs in preparation for rendering - must be called when PPC is not running
   bool RunSoundBoardFrame(void);                      // Runs sound board for a frame
   void RunDriveBoardFrame(void);                      // Runs drive board for a frame
@@ -209,6 +321,9 @@ private:
   static int StartSoundBoardThread(void *data);       // Callback to start sound board thread (unsync'd)
   static int StartSoundBoardThreadSyncd(void *data);  // Callback to start sound board thread (sync'd)
   static int StartDriveBoardThread(void *data);       // Callback to start drive board thread
+#ifdef NET_BOARD
+  static int StartNetBoardThread(void *data);         // Callback to start net board thread
+#endif
 
   static void AudioCallback(void *data);              // Audio buffer callback
 
@@ -216,12 +331,27 @@ private:
   int     RunMainBoardThread(void);                   // Runs PPC main board thread (sync'd in step with render thread)
   int     RunSoundBoardThread(void);                  // Runs sound board thread (not sync'd in step with render thread, ie running at full speed)
   int     RunSoundBoardThreadSyncd(void);             // Runs sound board thread (sync'd in step with render thread)
-  int     RunDriveBoardThread(void);                  // Runs drive board thread (sync'd in step with render thread)
+  int     RunDriveBoardThread(void);                  // Runs drive board thread (given frames by render thread, which never waits on it)
+#ifdef NET_BOARD
+  int     RunNetBoardThread(void);                    // Runs net board thread (each frame alongside the next main board frame)
+#endif
+  void    ConfigureBoardThread(const std::string &name);  // Applies CPU affinity and priority settings to calling board thread
+  void    LoadVROM(UINT8 *dest, size_t dest_size, const ROM &rom); // Copies VROM in, or maps it from the ROM cache
+  bool    MapROMImage(const std::string &imageFile, UINT64 key, bool *mapped); // Maps CROM, sample and MPEG ROM from a shared image, if it is up to date
+  bool    SaveROMImage(const std::string &imageFile, UINT64 key) const;        // Writes the assembled CROM, sample and MPEG ROM as a shared image
+  void    StartCPUTraces(void);                       // Attaches instruction traces to every CPU, if enabled
+  void    LoadPPCCodeCache(const std::string &gameName);  // Reads CROM block entry points translated in earlier runs, if enabled
+  void    SavePPCCodeCache(void);                     // Adds this run's CROM blocks to the code cache file
+  void    WarmUpPPCCode(void);                        // Translates the cached CROM blocks ahead of time
+  void    SaveBoardState(int board);                  // Saves the tile generator (0), Real3D (1) or sound board (2) into m_boardStates, on the job system
 
   // Runtime configuration
   const Util::Config::Node &m_config;
   bool m_multiThreaded;
   bool m_gpuMultiThreaded;
+  unsigned m_boardLatency;   // number of frames sound board (if sync'd) and drive board threads may lag main board
+  bool m_parallelState;      // boards saved and loaded at once on the job system
+  Util::Config::Binding<unsigned> m_ppcFrequency;   // MHz
 
   // Game and hardware information
   Game m_game;
@@ -236,14 +366,24 @@ private:
   UINT8   gunReg;
   int     adcChannel;
 
+  // Input register values built from Inputs by LatchInputs() once a frame
+  struct InputImage
+  {
+    UINT8 bank[2] = { 0xFF, 0xFF }; // offset 0x04, by input bank (less the EEPROM bit)
+    UINT8 gameInputs[2] = { 0xFF, 0xFF }; // offsets 0x08 and 0x0C (less the drive board's bits)
+    UINT8 adc[8] = {};              // ADC channels
+    UINT8 gun[9] = {};              // light gun registers
+  } m_inputImage;
+
   // MIDI port
   UINT8   midiCtrlPort; // controls MIDI (SCSP) IRQ behavior
 
   // Emulated core Model 3 memory regions
   UINT8   *memoryPool;  // single allocated region for all ROM and system RAM
   UINT8   *ram;         // 8 MB PowerPC RAM
+  const UINT8 *ppcCodePages;  // RAM pages holding translated PowerPC code (1 bit per 4 KB page)
   UINT8   *crom;        // 8+128 MB CROM (fixed CROM first, then 64MB of banked CROMs -- Daytona2 might need extra?)
-  UINT8   *vrom;        // 64 MB VROM (video ROM, visible only to Real3D)
+  UINT8   *vrom;        // 64 MB VROM (video ROM, visible only to Real3D), allocated apart from the pool
   UINT8   *soundROM;    // 512 KB sound ROM (68K program)
   UINT8   *sampleROM;   // 8 MB samples (68K)
   UINT8   *dsbROM;      // 128 KB DSB ROM (Z80 program)
@@ -263,7 +403,11 @@ private:
   unsigned  securityPtr;  // pointer to current offset in security data
 
   // PowerPC
+  PPC_CONTEXT       *m_ppc;     // made active on whichever thread runs the main board
   PPC_FETCH_REGION  PPCFetchRegions[3];
+  std::string       m_ppcCodeCacheFile; // empty unless the code cache is enabled
+  UINT64            m_ppcCodeCacheKey = 0;  // hash of fixed CROM and Supermodel version
+  std::vector<UINT32> m_ppcCodeCache;   // fixed CROM block entry points, translated on reset
 
   // Multiple threading
   bool        gpusReady;           // True if GPUs are ready to render
@@ -274,25 +418,41 @@ private:
   CThread     *ppcBrdThread;       // PPC main board thread
   CThread     *sndBrdThread;       // Sound board thread
   CThread     *drvBrdThread;       // Drive board thread
+  CThread     *netBrdThread;       // Net board thread
   bool        ppcBrdThreadRunning; // Flag to indicate PPC main board thread is currently processing
-  bool        ppcBrdThreadDone;    // Flag to indicate PPC main board thread has finished processing
   bool        sndBrdThreadRunning; // Flag to indicate sound board thread is currently processing
-  bool        sndBrdThreadDone;    // Flag to indicate sound board thread has finished processing
   bool        sndBrdWakeNotify;    // Flag to indicate that sound board thread has been woken by audio callback (when not sync'd with render thread)
   bool        drvBrdThreadRunning; // Flag to indicate drive board thread is currently processing
-  bool        drvBrdThreadDone;    // Flag to indicate drive board thread has finished processing
+  bool        netBrdThreadRunning; // Flag to indicate net board thread is currently processing
 
   // Thread synchronization objects
+  CFrameBarrier frameDone;         // PPC main board thread arrives here when it finishes a frame
+  CFrameBarrier sndFrameDone;      // Sound board thread (if sync'd) arrives here when it finishes a frame
+  CFrameBarrier drvFrameDone;      // Drive board thread arrives here when it finishes a frame
+  CFrameBarrier netFrameDone;      // Net board thread arrives here when it finishes a frame
+  CSnapshotCopier snapshotCopier;  // Copies dirty GPU memory to read-only snapshots in SyncGPUs (with worker threads if multi-threading GPU)
+  std::vector<UINT8> m_boardStates[3];  // tile generator, Real3D and sound board blocks of a save state being made, reused
   CSemaphore  *ppcBrdThreadSync;
   CSemaphore  *sndBrdThreadSync;
   CMutex      *sndBrdNotifyLock;
   CCondVar    *sndBrdNotifySync;
   CSemaphore  *drvBrdThreadSync;
+  CSemaphore  *netBrdThreadSync;
   CMutex      *notifyLock;
   CCondVar    *notifySync;
 
   // Frame timings
   FrameTimings timings;
+#ifdef SUPERMODEL_BUS_PROFILE
+  CBusProfile m_busProfile;     // accesses through the Read and Write handlers by region
+#endif
+  IRender3D   *render3D;        // attached renderer, for its texture cache counts
+  UINT64      texCacheHits;     // its counts as of the last frame
+  UINT64      texCacheMisses;
+  Util::AllocTracker::Counts allocCounts;  // allocation counts as of the last frame
+
+  // Main board event timeline (PowerPC clock)
+  CScheduler  m_scheduler;
 
   // Other devices
   CIRQ        IRQ;            // Model 3 IRQ controller
@@ -313,6 +473,9 @@ private:
   bool		m_runNetBoard;
 #endif
 
+  // Instruction traces of each CPU (empty unless enabled)
+  std::vector<std::unique_ptr<CExecTrace>> m_cpuTraces;
+
 };
 
 
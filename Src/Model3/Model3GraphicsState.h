@@ -23,7 +23,8 @@
  * Model3GraphicsState.h
  * 
  * Minimalistic implementation of IEmulator designed to load and view graphics
- * state.
+ * state: a save state, or a frame captured with CModel3::SaveFrameState(),
+ * which can be rendered over and over without the CPUs.
  */
 
 #ifndef INCLUDED_MODEL3GRAPHICSSTATE_H
@@ -71,11 +72,15 @@ public:
 
   void RenderFrame(bool displayFrame) override
   {
+    // As CModel3::RenderFrame()
     if (displayFrame) {
       BeginFrameVideo();
       m_tileGen.BeginFrame();
       m_real3D.BeginFrame();
+      m_tileGen.PreRenderFrame();
+      m_tileGen.RenderFrameBottom();
       m_real3D.RenderFrame();
+      m_tileGen.RenderFrameTop();
       m_real3D.EndFrame();
       m_tileGen.EndFrame();
       EndFrameVideo();
@@ -105,7 +110,7 @@ public:
     m_game = game;
     if (rom_set.get_rom("vrom").size <= 32*0x100000)
     {
-      rom_set.get_rom("vrom").CopyTo(&m_vrom.get()[0], 32*100000);
+      rom_set.get_rom("vrom").CopyTo(&m_vrom.get()[0], 32*0x100000);
       rom_set.get_rom("vrom").CopyTo(&m_vrom.get()[32*0x100000], 32*0x100000);
     }
     else
@@ -135,7 +140,7 @@ public:
     m_irq.Init();
     if (OKAY != m_tileGen.Init(&m_irq))
       return FAIL;
-    if (OKAY != m_real3D.Init(m_vrom.get(), this, &m_irq, 0x100))
+    if (OKAY != m_real3D.Init(m_vrom.get(), NULL, this, &m_irq, 0x100))
       return FAIL;
     return OKAY;
   }
@@ -47,22 +47,17 @@
  */
 UINT32 CPCIBus::ReadConfigSpace(unsigned device, unsigned reg, unsigned bits, unsigned offset)
 {
-	unsigned	i;
-	
 	// Alignment check
 #ifdef DEBUG
 	if (((bits==16)&&(offset&1)) || ((bits==32)&&(offset&3)))
 		ErrorLog("Misaligned PCI read request (device=%d,reg=%X,offset=%d)\n", device, reg, offset);
 #endif
 
-	// Search device vector for a matching device
-	for (i = 0; i < DeviceVector.size(); i++)
-	{
-		if (DeviceVector[i].device == device)
-			return DeviceVector[i].DeviceObject->ReadPCIConfigSpace(device, reg, bits, offset);
-	}
+	IPCIDevice *DeviceObject = FindDevice(device);
+	if (DeviceObject != NULL)
+		return DeviceObject->ReadPCIConfigSpace(device, reg, bits, offset);
 	
-	DebugLog("PCI read request for unknown device (device=%d,reg=%X)\n", device, reg);
+	DEBUG_LOG(Model3, "PCI read request for unknown device (device=%d,reg=%X)\n", device, reg);
 	return 0;
 }
 
@@ -73,21 +68,44 @@ UINT32 CPCIBus::ReadConfigSpace(unsigned device, unsigned reg, unsigned bits, un
  * device.
  */
 void CPCIBus::WriteConfigSpace(unsigned device, unsigned reg, unsigned bits, unsigned offset, UINT32 data)
+{
+	IPCIDevice *DeviceObject = FindDevice(device);
+	if (DeviceObject != NULL)
+	{
+		DeviceObject->WritePCIConfigSpace(device, reg, bits, offset, data);
+		return;
+	}
+	
+//	printf("PCI write request for unknown device (device=%d, reg=%X, data=%X)\n", device, reg, data);
+	DEBUG_LOG(Model3, "PCI write request for unknown device (device=%d, reg=%X, data=%X)\n", device, reg, data);
+}
+
+/*
+ * CPCIBus::FindDevice(device):
+ *
+ * Returns the object attached as a particular device or NULL if there is none.
+ * Games tend to access one device many times in a row, so the last device found
+ * is checked before searching the device vector.
+ */
+IPCIDevice *CPCIBus::FindDevice(unsigned device)
 {
 	unsigned	i;
 	
+	if ((lastDeviceObject != NULL) && (lastDevice == device))
+		return lastDeviceObject;
+	
 	// Search device vector for a matching device
 	for (i = 0; i < DeviceVector.size(); i++)
 	{
 		if (DeviceVector[i].device == device)
 		{
-			DeviceVector[i].DeviceObject->WritePCIConfigSpace(device, reg, bits, offset, data);
-			return;
+			lastDevice = device;
+			lastDeviceObject = DeviceVector[i].DeviceObject;
+			return lastDeviceObject;
 		}
 	}
 	
-//	printf("PCI write request for unknown device (device=%d, reg=%X, data=%X)\n", device, reg, data);
-	DebugLog("PCI write request for unknown device (device=%d, reg=%X, data=%X)\n", device, reg, data);
+	return NULL;
 }
 	
 /*
@@ -120,7 +138,7 @@ void CPCIBus::AttachDevice(unsigned device, IPCIDevice *DeviceObjectPtr)
 	D.DeviceObject = DeviceObjectPtr;
 	DeviceVector.push_back(D);
 	
-	DebugLog("Attached device %d to PCI bus\n", device);
+	DEBUG_LOG(Model3, "Attached device %d to PCI bus\n", device);
 }
 
 /*
@@ -131,6 +149,8 @@ void CPCIBus::AttachDevice(unsigned device, IPCIDevice *DeviceObjectPtr)
 void CPCIBus::Init(void)
 {
 	DeviceVector.clear();
+	lastDevice = 0;
+	lastDeviceObject = NULL;
 }
 
 /*
@@ -140,7 +160,9 @@ void CPCIBus::Init(void)
  */
 CPCIBus::CPCIBus(void)
 {	
-	DebugLog("Built PCI bus\n");
+	lastDevice = 0;
+	lastDeviceObject = NULL;
+	DEBUG_LOG(Model3, "Built PCI bus\n");
 }
 
 /*
@@ -150,5 +172,5 @@ CPCIBus::CPCIBus(void)
  */
 CPCIBus::~CPCIBus(void)
 {	
-	DebugLog("Destroyed PCI bus\n");
+	DEBUG_LOG(Model3, "Destroyed PCI bus\n");
 }
@@ -133,6 +133,21 @@ public:
 	 */
 	void WriteConfigSpace(unsigned device, unsigned reg, unsigned bits, unsigned offset, UINT32 data);
 	
+	/*
+	 * FindDevice(device):
+	 *
+	 * Looks up the object attached as a particular device, so that callers
+	 * which access the same device repeatedly need only do this once. The
+	 * last device found is remembered.
+	 *
+	 * Parameters:
+	 *		device	PCI device ID.
+	 *
+	 * Returns:
+	 *		Pointer to the device object or NULL if none is attached.
+	 */
+	IPCIDevice *FindDevice(unsigned device);
+	
 	/*
 	 * Reset(void):
 	 *
@@ -181,6 +196,10 @@ private:
 	
 	// An array of device objects
 	std::vector<struct DeviceObjectLink> DeviceVector;
+	
+	// Most recently found device
+	unsigned	lastDevice;
+	IPCIDevice	*lastDeviceObject;
 };
 
 
@@ -44,8 +44,16 @@ UINT8 CRTC72421::ReadRegister(unsigned reg)
 	time_t 		currentTime;
 	struct tm	*Time;
 
-	time(&currentTime);
-	Time = localtime(&currentTime);
+	if (m_fixedTime)
+	{
+		currentTime = m_fixedTime;
+		Time = gmtime(&currentTime);
+	}
+	else
+	{
+		time(&currentTime);
+		Time = localtime(&currentTime);
+	}
 
 	switch (reg&0xF)
 	{
@@ -91,6 +99,11 @@ void CRTC72421::WriteRegister(unsigned reg, UINT8 data)
 	// TO-DO: emulate me!
 }
 
+void CRTC72421::SetFixedTime(time_t fixedTime)
+{
+	m_fixedTime = fixedTime;
+}
+
 void CRTC72421::Reset(void)
 {
 	// nothing to do
@@ -107,11 +120,12 @@ void CRTC72421::Init(void)
 }
 
 CRTC72421::CRTC72421(void)
+	: m_fixedTime(0)
 {	
-	DebugLog("Built RTC-72421\n");
+	DEBUG_LOG(Model3, "Built RTC-72421\n");
 }
 
 CRTC72421::~CRTC72421(void)
 {	
-	DebugLog("Destroyed RTC-72421\n");
+	DEBUG_LOG(Model3, "Destroyed RTC-72421\n");
 }
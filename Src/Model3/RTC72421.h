@@ -28,6 +28,7 @@
 #ifndef INCLUDED_RTC72421_H
 #define INCLUDED_RTC72421_H
 
+#include <ctime>
 
 /*
  * CRTC72421:
@@ -60,6 +61,17 @@ public:
 	 *		data	Data to write.
 	 */
 	void WriteRegister(unsigned reg, UINT8 data);
+
+	/*
+	 * SetFixedTime(time_t fixedTime):
+	 *
+	 * Makes the clock always read the given time (in UTC) rather than the
+	 * host's local time, so that runs can be repeated exactly.
+	 *
+	 * Parameters:
+	 *		fixedTime	Time to read, or 0 to read the host's time again.
+	 */
+	void SetFixedTime(time_t fixedTime);
 	 
 	/*
 	 * Reset(void):
@@ -85,6 +97,9 @@ public:
 	 */
 	CRTC72421(void);
 	~CRTC72421(void);
+
+private:
+	time_t	m_fixedTime;
 };
 
 
@@ -44,14 +44,21 @@
 #include "Supermodel.h"
 #include "Model3/JTAG.h"
 #include "Util/BMPFile.h"
+#include "Util/ByteSwap.h"
+#include "Util/Hash.h"
+#include "Util/MappedMemory.h"
 #include <cstring>
 #include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REAL3D_SSE2
+#endif
 
 // Macros that divide memory regions into pages and mark them as dirty when they are written to
 #define PAGE_WIDTH 12
 #define PAGE_SIZE (1<<PAGE_WIDTH)
 #define DIRTY_SIZE(arraySize) (1+(arraySize-1)/(8*PAGE_SIZE))
-#define MARK_DIRTY(dirtyArray, addr) dirtyArray[addr>>(PAGE_WIDTH+3)] |= 1<<((addr>>PAGE_WIDTH)&7)
+#define MARK_DIRTY(dirtyMap, addr) (dirtyMap).Mark(addr, PAGE_WIDTH)
 
 // Offsets of memory regions within Real3D memory pool
 #define OFFSET_8C           0x0000000 // 4 MB, culling RAM low (at 0x8C000000)
@@ -79,11 +86,15 @@ static void UpdateRenderConfig(IRender3D *Render3D, uint64_t internalRenderConfi
  Save States
 ******************************************************************************/
 
-void CReal3D::SaveState(CBlockFile *SaveState)
+void CReal3D::WriteState(CBlockFile *SaveState, const uint32_t *cullLo, const uint32_t *cullHi, const uint32_t *poly, const uint16_t *texture)
 {
   SaveState->NewBlock("Real3D", __FILE__);
   
-  SaveState->Write(memoryPool, MEM_POOL_SIZE_RW); // Don't write out read-only snapshots or dirty page arrays
+  SaveState->Write(cullLo, 0x400000);
+  SaveState->Write(cullHi, 0x100000);
+  SaveState->Write(poly, 0x400000);
+  SaveState->Write(texture, 0x800000);
+  SaveState->Write(textureFIFO, 0x100000);
   SaveState->Write(&fifoIdx, sizeof(fifoIdx));
   SaveState->Write(m_vromTextureFIFO, sizeof(m_vromTextureFIFO));
   
@@ -108,6 +119,21 @@ void CReal3D::SaveState(CBlockFile *SaveState)
   SaveState->Write(&m_vromTextureFIFOIdx, sizeof(m_vromTextureFIFOIdx));
 }
 
+void CReal3D::SaveState(CBlockFile *SaveState)
+{
+  // Don't write out read-only snapshots or dirty page arrays (live regions may
+  // be in either half of the pool if double-buffered)
+  WriteState(SaveState, cullingRAMLo, cullingRAMHi, polyRAM, textureRAM);
+}
+
+void CReal3D::SaveFrameState(CBlockFile *SaveState)
+{
+  if (m_gpuMultiThreaded)
+    WriteState(SaveState, cullingRAMLoRO, cullingRAMHiRO, polyRAMRO, textureRAMRO);
+  else
+    WriteState(SaveState, cullingRAMLo, cullingRAMHi, polyRAM, textureRAM);
+}
+
 void CReal3D::LoadState(CBlockFile *SaveState)
 {
   if (OKAY != SaveState->FindBlock("Real3D"))
@@ -116,12 +142,39 @@ void CReal3D::LoadState(CBlockFile *SaveState)
     return;
   }
   
-  SaveState->Read(memoryPool, MEM_POOL_SIZE_RW);
+  SaveState->Read(cullingRAMLo, 0x400000);
+  SaveState->Read(cullingRAMHi, 0x100000);
+  SaveState->Read(polyRAM, 0x400000);
+
+  // Only the rows of texture RAM that differ from what the renderer already
+  // has are uploaded again. When states are loaded every frame (netplay,
+  // run-ahead) that is usually few of them. The renderer may lag the texture
+  // RAM when multi-threaded, so then all of it is uploaded.
+  m_loadedTextureRAM.resize(2048 * 2048);
+  SaveState->Read(m_loadedTextureRAM.data(), 0x800000);
+  unsigned firstRow = 2048, lastRow = 0;
+  for (unsigned row = 0; row < 2048; row++)
+  {
+    if (m_gpuMultiThreaded || memcmp(&textureRAM[row * 2048], &m_loadedTextureRAM[row * 2048], 2048 * sizeof(uint16_t)))
+    {
+      firstRow = std::min(firstRow, row);
+      lastRow = row;
+    }
+  }
+  if (firstRow <= lastRow)
+  {
+    memcpy(&textureRAM[firstRow * 2048], &m_loadedTextureRAM[firstRow * 2048], (lastRow - firstRow + 1) * 2048 * sizeof(uint16_t));
+    m_vromTextureUploads.clear();
+  }
+  SaveState->Read(textureFIFO, 0x100000);
 
   // If multi-threaded, update read-only snapshots too
   if (m_gpuMultiThreaded)
     UpdateSnapshots(true);
-  Render3D->UploadTextures(0, 0, 0, 2048, 2048);
+  if (firstRow <= lastRow)
+    Render3D->UploadTextures(0, 0, firstRow, 2048, lastRow - firstRow + 1);
+  if (m_lowMemory)
+    std::vector<uint16_t>().swap(m_loadedTextureRAM);
   SaveState->Read(&fifoIdx, sizeof(fifoIdx));
   SaveState->Read(&m_vromTextureFIFO, sizeof(m_vromTextureFIFO));
   
@@ -136,6 +189,7 @@ void CReal3D::LoadState(CBlockFile *SaveState)
   SaveState->Read(m_internalRenderConfig, sizeof(m_internalRenderConfig));
   UpdateRenderConfig(Render3D, m_internalRenderConfig);
   SaveState->Read(&commandPortWritten);
+  m_sceneWritten = true;
   SaveState->Read(&m_pingPong, sizeof(m_pingPong));
   for (int i = 0; i < 39; i++)
   {
@@ -173,12 +227,16 @@ void CReal3D::EndVBlank(void)
   error = false;  // clear error (just needs to be done once per frame)
 }
 
-uint32_t CReal3D::SyncSnapshots(void)
+uint32_t CReal3D::SyncSnapshots(CSnapshotCopier &copier)
 {
   // Update read-only copy of command port flag
   commandPortWrittenRO = commandPortWritten;
   commandPortWritten = false;
 
+  // Held until a frame is actually rendered, frames that aren't displayed don't clear it
+  m_sceneChanged |= commandPortWrittenRO || m_sceneWritten;
+  m_sceneWritten = false;
+
   if (!m_gpuMultiThreaded)
     return 0;
 
@@ -186,58 +244,100 @@ uint32_t CReal3D::SyncSnapshots(void)
   queuedUploadTexturesRO = queuedUploadTextures;
   queuedUploadTextures.clear();
 
-  // Update read-only snapshots
-  return UpdateSnapshots(false);
+  // If double-buffered, the buffers just written become the snapshots
+  if (m_gpuDoubleBuffered)
+  {
+    SwapBuffers();
+    return 0;
+  }
+
+  // Queue read-only snapshots for update
+  copier.Queue("cullLo",  (uint8_t*)cullingRAMLo, (uint8_t*)cullingRAMLoRO, 0x400000, cullingRAMLoDirty, PAGE_WIDTH);
+  copier.Queue("cullHi",  (uint8_t*)cullingRAMHi, (uint8_t*)cullingRAMHiRO, 0x100000, cullingRAMHiDirty, PAGE_WIDTH);
+  copier.Queue("poly",    (uint8_t*)polyRAM,      (uint8_t*)polyRAMRO,      0x400000, polyRAMDirty, PAGE_WIDTH);
+  copier.Queue("texture", (uint8_t*)textureRAM,   (uint8_t*)textureRAMRO,   0x800000, textureRAMDirty, PAGE_WIDTH);
+  return 0;
+}
+
+void CReal3D::RefreshWriteBuffers(CSnapshotCopier &copier)
+{
+  if (!m_writeBuffersStale)
+    return;
+  m_writeBuffersStale = false;
+
+  // Dirty pages were written to what are now the read-only snapshots
+  copier.Queue("cullLo",  (uint8_t*)cullingRAMLoRO, (uint8_t*)cullingRAMLo, 0x400000, cullingRAMLoDirty, PAGE_WIDTH);
+  copier.Queue("cullHi",  (uint8_t*)cullingRAMHiRO, (uint8_t*)cullingRAMHi, 0x100000, cullingRAMHiDirty, PAGE_WIDTH);
+  copier.Queue("poly",    (uint8_t*)polyRAMRO,      (uint8_t*)polyRAM,      0x400000, polyRAMDirty, PAGE_WIDTH);
+  copier.Queue("texture", (uint8_t*)textureRAMRO,   (uint8_t*)textureRAM,   0x800000, textureRAMDirty, PAGE_WIDTH);
+}
+
+uint64_t CReal3D::HashSnapshots(void) const
+{
+  bool ro = m_gpuMultiThreaded;
+  uint64_t hash[4];
+  hash[0] = Util::Hash64((const uint8_t *) (ro ? cullingRAMLoRO : cullingRAMLo), 0x400000);
+  hash[1] = Util::Hash64((const uint8_t *) (ro ? cullingRAMHiRO : cullingRAMHi), 0x100000);
+  hash[2] = Util::Hash64((const uint8_t *) (ro ? polyRAMRO : polyRAM), 0x400000);
+  hash[3] = Util::Hash64((const uint8_t *) (ro ? textureRAMRO : textureRAM), 0x800000);
+  return Util::Hash64((const uint8_t *) hash, sizeof(hash));
 }
 
-uint32_t CReal3D::UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, unsigned size, uint8_t *dirty)
+void CReal3D::SwapBuffers(void)
+{
+  // Live buffers must be complete before they become the snapshots again
+  if (m_writeBuffersStale)
+  {
+    CSnapshotCopier copier;
+    RefreshWriteBuffers(copier);
+    copier.Run();
+  }
+
+  std::swap(cullingRAMLo, cullingRAMLoRO);
+  std::swap(cullingRAMHi, cullingRAMHiRO);
+  std::swap(polyRAM, polyRAMRO);
+  std::swap(textureRAM, textureRAMRO);
+  m_writeBuffersStale = true;
+  if (Render3D != NULL)
+    Render3D->AttachMemory(cullingRAMLoRO, cullingRAMHiRO, polyRAMRO, vrom, textureRAMRO);
+}
+
+uint32_t CReal3D::UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, unsigned size, DirtyPageMap &dirty)
 {
-  unsigned dirtySize = DIRTY_SIZE(size);
   if (copyWhole)
   {
     // If updating whole region, then just copy all data in one go
     memcpy(dst, src, size);
-    memset(dirty, 0, dirtySize);
+    CSnapshotCopier::ClearDirty(dirty, size, PAGE_WIDTH);
     return size;
   }
   else
   {
-    // Otherwise, loop through dirty pages array to find out what needs to be updated and copy only those parts
-    uint32_t copied = 0;
-    uint8_t *pSrc = src;
-    uint8_t *pDst = dst;
-    for (unsigned i = 0; i < dirtySize; i++)
-    {
-      uint8_t d = dirty[i];
-      if (d)
-      {
-        for (unsigned j = 0; j < 8; j++)
-        {
-          if (d&1)
-          {
-            // If not at very end of region, then copy an extra 4 bytes to allow for a possible 32-bit overlap
-            uint32_t toCopy = (i < dirtySize - 1 || j < 7 ? PAGE_SIZE + 4 : PAGE_SIZE);
-            memcpy(pDst, pSrc, toCopy);
-            copied += toCopy;
-          }
-          d >>= 1;
-          pSrc += PAGE_SIZE;  
-          pDst += PAGE_SIZE;
-        }
-        dirty[i] = 0;
-      }
-      else
-      {
-        pSrc += 8 * PAGE_SIZE;  
-        pDst += 8 * PAGE_SIZE;
-      }
-    }
-    return copied;
+    // Otherwise, copy only the dirty pages
+    return CSnapshotCopier::CopyDirty(src, dst, size, dirty, PAGE_WIDTH);
   }
 }
 
 uint32_t CReal3D::UpdateSnapshots(bool copyWhole)
 {
+  // Copying all 17 MB (after loading a state) is split over the job system
+  if (copyWhole)
+  {
+    Util::JobSystem::Shared().ParallelFor(4, [this](size_t i)
+    {
+      if (i == 0)
+        UpdateSnapshot(true, (uint8_t*)textureRAM, (uint8_t*)textureRAMRO, 0x800000, textureRAMDirty);
+      else if (i == 1)
+        UpdateSnapshot(true, (uint8_t*)cullingRAMLo, (uint8_t*)cullingRAMLoRO, 0x400000, cullingRAMLoDirty);
+      else if (i == 2)
+        UpdateSnapshot(true, (uint8_t*)polyRAM, (uint8_t*)polyRAMRO, 0x400000, polyRAMDirty);
+      else
+        UpdateSnapshot(true, (uint8_t*)cullingRAMHi, (uint8_t*)cullingRAMHiRO, 0x100000, cullingRAMHiDirty);
+    });
+    m_writeBuffersStale = false;
+    return 0x400000 + 0x100000 + 0x400000 + 0x800000;
+  }
+
   // Update all memory region snapshots
   uint32_t cullLoCopied  = UpdateSnapshot(copyWhole, (uint8_t*)cullingRAMLo, (uint8_t*)cullingRAMLoRO, 0x400000, cullingRAMLoDirty);
   uint32_t cullHiCopied  = UpdateSnapshot(copyWhole, (uint8_t*)cullingRAMHi, (uint8_t*)cullingRAMHiRO, 0x100000, cullingRAMHiDirty);
@@ -260,13 +360,23 @@ void CReal3D::BeginFrame(void)
     queuedUploadTexturesRO.clear();
   }
 
+  // Nothing the renderer reads has been written since the last frame it drew
+  m_repeatFrame = !m_sceneChanged && Render3D->CanRepeatFrame();
+  if (m_repeatFrame)
+    return;
+
   Render3D->BeginFrame();
 }
 
 void CReal3D::RenderFrame(void)
 {
-  //if (commandPortWrittenRO)
+  if (m_repeatFrame)
+    Render3D->RepeatFrame();
+  else
+  {
     Render3D->RenderFrame();
+    m_sceneChanged = false;
+  }
 }
 
 void CReal3D::EndFrame(void)
@@ -335,14 +445,64 @@ static const unsigned decode8x1[8] =
   6
 };
 
+/*
+ * StoreTile16x8x8():
+ *
+ * Stores a whole 8x8 tile of 16-bit texels, as decode8x8 does one texel at a
+ * time. Each pair of rows comes from 16 consecutive words, with the pairs of
+ * words swapped: the first row takes words 0-1, 4-5, 8-9 and 12-13 of them,
+ * and the second row words 2-3, 6-7, 10-11 and 14-15.
+ */
+static inline void StoreTile16x8x8(uint16_t *dest, const uint16_t *src)
+{
+  for (int row = 0; row < 8; row += 2)
+  {
+#ifdef REAL3D_SSE2
+    __m128i a = _mm_loadu_si128((const __m128i *) &src[0]);
+    __m128i b = _mm_loadu_si128((const __m128i *) &src[8]);
+    a = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xB1), 0xB1), 0xD8);  // 1,0,5,4 | 3,2,7,6
+    b = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(b, 0xB1), 0xB1), 0xD8);
+    _mm_storeu_si128((__m128i *) &dest[0], _mm_unpacklo_epi64(a, b));
+    _mm_storeu_si128((__m128i *) &dest[2048], _mm_unpackhi_epi64(a, b));
+#else
+    for (int i = 0; i < 8; i++)
+    {
+      dest[i] = src[decode8x8[i]];
+      dest[2048 + i] = src[decode8x8[8 + i]];
+    }
+#endif
+    src += 16;
+    dest += 2 * 2048;
+  }
+}
+
 void CReal3D::StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigned width, unsigned height, const uint16_t *texData, bool sixteenBit, bool writeLSB, bool writeMSB, uint32_t &texDataOffset)
 {
   uint32_t tileX = (std::min)(8u, width);
   uint32_t tileY = (std::min)(8u, height);
 
   texDataOffset = 0;
+  MarkTextureWritten(xPos, yPos, width, height);
 
-  if (sixteenBit)  // 16-bit textures
+  if (sixteenBit && tileX == 8 && tileY == 8)  // 16-bit textures made of whole tiles, which is nearly all of them
+  {
+    for (uint32_t y = yPos; y < (yPos + height); y += 8)
+    {
+      if (m_gpuMultiThreaded)
+      {
+        // A line of texture RAM (2048 texels) is exactly one page
+        for (uint32_t yy = y; yy < y + 8; yy++)
+          MARK_DIRTY(textureRAMDirty, (yy * 2048 + xPos) * 2);
+      }
+      for (uint32_t x = xPos; x < (xPos + width); x += 8)
+      {
+        StoreTile16x8x8(&textureRAM[y * 2048 + x], texData);
+        texData += 64;
+        texDataOffset += 64;
+      }
+    }
+  }
+  else if (sixteenBit)  // 16-bit textures
   {
     // Outer 2 loops: NxN tiles
     for (uint32_t y = yPos; y < (yPos + height); y += tileY)
@@ -384,7 +544,7 @@ void CReal3D::StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigne
      */
 
     if (writeLSB && writeMSB)  // write to both?
-      DebugLog("Observed 8-bit texture with byte_select=3!");
+      DEBUG_LOG(Real3D, "Observed 8-bit texture with byte_select=3!");
 
     // Outer 2 loops: NxN tiles
     const uint8_t byteSelect = (uint8_t)writeLSB | ((uint8_t)writeMSB << 1);
@@ -447,6 +607,59 @@ void CReal3D::StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigne
   else
     Render3D->UploadTextures(level, xPos, yPos, width, height);
 }
+
+void CReal3D::MarkTextureWritten(unsigned xPos, unsigned yPos, unsigned width, unsigned height)
+{
+  if (width == 0 || height == 0 || xPos >= 2048 || yPos >= 2048)
+    return;
+  unsigned x1 = (std::min)(2048u, xPos + width) - 1;
+  unsigned y1 = (std::min)(2048u, yPos + height) - 1;
+  uint64_t stamp = ++m_textureWriteCount;
+  for (unsigned by = yPos / 8; by <= y1 / 8; by++)
+  {
+    for (unsigned bx = xPos / 8; bx <= x1 / 8; bx++)
+      m_textureWriteStamps[by * 256 + bx] = stamp;
+  }
+  if (m_vromUploadRects != NULL)
+    m_vromUploadRects->push_back({ xPos, yPos, x1 - xPos + 1, y1 - yPos + 1 });
+}
+
+void CReal3D::UploadVROMTexture(uint32_t addr, uint32_t header)
+{
+  const uint64_t key = (uint64_t(addr) << 32) | header;
+  auto it = m_vromTextureUploads.find(key);
+  if (it != m_vromTextureUploads.end())
+  {
+    bool intact = true;
+    for (const VROMTextureRect &rect : it->second.rects)
+    {
+      for (unsigned by = rect.y / 8; intact && by <= (rect.y + rect.height - 1) / 8; by++)
+      {
+        for (unsigned bx = rect.x / 8; bx <= (rect.x + rect.width - 1) / 8; bx++)
+        {
+          if (m_textureWriteStamps[by * 256 + bx] > it->second.stamp)
+          {
+            intact = false;
+            break;
+          }
+        }
+      }
+    }
+    if (intact)
+      return;
+  }
+
+  // Games stream far fewer distinct textures than this, start over if exceeded
+  if (it == m_vromTextureUploads.end() && m_vromTextureUploads.size() >= 4096)
+    m_vromTextureUploads.clear();
+
+  VROMTextureUpload &upload = m_vromTextureUploads[key];
+  upload.rects.clear();
+  m_vromUploadRects = &upload.rects;
+  UploadTexture(header, (const uint16_t *) &vrom[addr]);
+  m_vromUploadRects = NULL;
+  upload.stamp = m_textureWriteCount;
+}
 
 /*
 Texture header:
@@ -468,6 +681,8 @@ xxxxxxxx -------- -------- -------- Texture type:
 // Texture data will be in little endian format
 void CReal3D::UploadTexture(uint32_t header, const uint16_t *texData)
 {
+  m_sceneWritten = true;
+
   // Position: texture RAM is arranged as 2 2048x1024 texel sheets
   uint32_t x              = 32 * (header & 0x3F);
   uint32_t y              = 32 * ((header >> 7) & 0x1F);
@@ -507,7 +722,7 @@ void CReal3D::UploadTexture(uint32_t header, const uint16_t *texData)
   case 0x80:  // MAME thinks these might be a gamma table (vf3 uploads this as the first texture)
     break;
   default:  // unknown
-    DebugLog("Unknown texture format %02X\n", type);
+    DEBUG_LOG(Real3D, "Unknown texture format %02X\n", type);
     break;
   }
 }
@@ -525,10 +740,93 @@ void CReal3D::UploadTexture(uint32_t header, const uint16_t *texData)
   IRQ:  IRQ pending.
 ******************************************************************************/
 
+/*
+ * DMACopyFromRAM(void):
+ *
+ * Performs the current DMA transfer in bulk if CopyFromRAM() can.
+ *
+ * Returns:
+ *    True if the transfer was performed, false if it must go through the bus.
+ */
+bool CReal3D::DMACopyFromRAM(void)
+{
+  if (dmaLength > 0x800000/4 || !CopyFromRAM(dmaDest, dmaSrc, dmaLength * 4, (dmaConfig&0x80) != 0))
+    return false;
+
+  dmaSrc += dmaLength * 4;
+  dmaDest += dmaLength * 4;
+  dmaLength = 0;
+  return true;
+}
+
+// CModel3::Write32() flips each word as it stores it, so a byte-reversed copy
+// ends up as a straight copy of RAM and a normal one as a swapped copy
+bool CReal3D::CopyFromRAM(uint32_t destAddr, uint32_t srcAddr, uint32_t size, bool reverseBytes)
+{
+  if (mainRAM == NULL || (srcAddr & 3) || (destAddr & 3) || (size & 3) || size > 0x800000 || srcAddr > 0x800000 - size)
+    return false;
+
+  uint32_t  offset = destAddr & 0xFFFFFF;
+  uint8_t   *dest;
+  DirtyPageMap *dirty = NULL;
+  switch (destAddr >> 24)
+  {
+  case 0x8C:  // low culling RAM
+    if (offset + size > 0x400000)
+      return false;
+    dest = (uint8_t *) cullingRAMLo;
+    dirty = &cullingRAMLoDirty;
+    break;
+  case 0x8E:  // high culling RAM
+    if (offset + size > 0x100000)
+      return false;
+    dest = (uint8_t *) cullingRAMHi;
+    dirty = &cullingRAMHiDirty;
+    break;
+  case 0x98:  // polygon RAM
+    if (offset + size > 0x400000)
+      return false;
+    dest = (uint8_t *) polyRAM;
+    dirty = &polyRAMDirty;
+    break;
+  case 0x94:  // texture FIFO (destination address is ignored)
+    if (fifoIdx + size/4 > 0x100000/4)
+      return false;
+    dest = (uint8_t *) &textureFIFO[fifoIdx];
+    offset = 0;
+    fifoIdx += size/4;
+    break;
+  default:
+    return false;
+  }
+
+  m_sceneWritten = true;
+  if (reverseBytes)
+    memcpy(dest + offset, mainRAM + srcAddr, size);
+  else
+    Util::CopyFlipEndian32(dest + offset, mainRAM + srcAddr, size);
+
+  if (m_gpuMultiThreaded && dirty != NULL && size != 0)
+  {
+    for (uint32_t addr = offset & ~(PAGE_SIZE - 1); addr < offset + size; addr += PAGE_SIZE)
+      MARK_DIRTY(*dirty, addr);
+  }
+  return true;
+}
+
 void CReal3D::DMACopy(void)
 {
-  DebugLog("Real3D DMA copy (PC=%08X, LR=%08X): %08X -> %08X, %X %s\n", ppc_get_pc(), ppc_get_lr(), dmaSrc, dmaDest, dmaLength*4, (dmaConfig&0x80)?"(byte reversed)":"");
+  DEBUG_LOG(Real3D, "Real3D DMA copy (PC=%08X, LR=%08X): %08X -> %08X, %X %s\n", ppc_get_pc(), ppc_get_lr(), dmaSrc, dmaDest, dmaLength*4, (dmaConfig&0x80)?"(byte reversed)":"");
   //printf("Real3D DMA copy (PC=%08X, LR=%08X): %08X -> %08X, %X %s\n", ppc_get_pc(), ppc_get_lr(), dmaSrc, dmaDest, dmaLength*4, (dmaConfig&0x80)?"(byte reversed)":""); 
+  if (DMACopyFromRAM())
+    return;
+  if (!(dmaConfig&0x80) && dmaLength <= 0x800000/4 && Bus->CopyBlock(dmaDest, dmaSrc, dmaLength * 4))  // other devices on the bus, eg tile generator
+  {
+    dmaSrc += dmaLength * 4;
+    dmaDest += dmaLength * 4;
+    dmaLength = 0;
+    return;
+  }
   if ((dmaConfig&0x80)) // reverse bytes
   {
     while (dmaLength != 0)
@@ -564,7 +862,7 @@ uint8_t CReal3D::ReadDMARegister8(unsigned reg)
     break;
   }
   
-  DebugLog("Real3D: ReadDMARegister8: reg=%X\n", reg);
+  DEBUG_LOG(Real3D, "Real3D: ReadDMARegister8: reg=%X\n", reg);
   return 0;
 }
 
@@ -583,7 +881,7 @@ void CReal3D::WriteDMARegister8(unsigned reg, uint8_t data)
     dmaConfig = data;
     break;
   default:
-    DebugLog("Real3D: WriteDMARegister8: reg=%X, data=%02X\n", reg, data);
+    DEBUG_LOG(Real3D, "Real3D: WriteDMARegister8: reg=%X, data=%02X\n", reg, data);
     break;
   }
   //DebugLog("Real3D: WriteDMARegister8: reg=%X, data=%02X\n", reg, data);
@@ -599,7 +897,7 @@ uint32_t CReal3D::ReadDMARegister32(unsigned reg)
     break;
   }
   
-  DebugLog("Real3D: ReadDMARegister32: reg=%X\n", reg);
+  DEBUG_LOG(Real3D, "Real3D: ReadDMARegister32: reg=%X\n", reg);
   return 0;
 }
 
@@ -623,7 +921,7 @@ void CReal3D::WriteDMARegister32(unsigned reg, uint32_t data)
     if ((data&0x20000000)) // DMA ID command
     {
       dmaData = pciID;
-      DebugLog("Real3D: DMA ID command issued (ATTENTION: make sure we're returning the correct value), PC=%08X, LR=%08X\n", ppc_get_pc(), ppc_get_lr());
+      DEBUG_LOG(Real3D, "Real3D: DMA ID command issued (ATTENTION: make sure we're returning the correct value), PC=%08X, LR=%08X\n", ppc_get_pc(), ppc_get_lr());
     }
     else if ((data&0x80000000))
     {
@@ -634,7 +932,7 @@ void CReal3D::WriteDMARegister32(unsigned reg, uint32_t data)
     dmaData = 0xFFFFFFFF;
     break;
   default:
-    DebugLog("Real3D: WriteDMARegister32: reg=%X, data=%08X\n", reg, data);
+    DEBUG_LOG(Real3D, "Real3D: WriteDMARegister32: reg=%X, data=%08X\n", reg, data);
     break;
   }
   //DebugLog("Real3D: WriteDMARegister32: reg=%X, data=%08X\n", reg, data);
@@ -647,7 +945,7 @@ void CReal3D::WriteDMARegister32(unsigned reg, uint32_t data)
 void CReal3D::Flush(void)
 {
   commandPortWritten = true;  
-  DebugLog("Real3D 88000000 written @ PC=%08X\n", ppc_get_pc());
+  DEBUG_LOG(Real3D, "Real3D 88000000 written @ PC=%08X\n", ppc_get_pc());
 
   // Upload textures (if any)
   if (fifoIdx > 0)
@@ -661,12 +959,12 @@ void CReal3D::Flush(void)
       // Spikeout seems to be uploading 0 length textures
       if (0 == size)
       {
-        DebugLog("Real3D: 0-length texture upload @ PC=%08X (%08X %08X %08X)\n", ppc_get_pc(), textureFIFO[i+0], textureFIFO[i+1], textureFIFO[i+2]);
+        DEBUG_LOG(Real3D, "Real3D: 0-length texture upload @ PC=%08X (%08X %08X %08X)\n", ppc_get_pc(), textureFIFO[i+0], textureFIFO[i+1], textureFIFO[i+2]);
         break;
       }
 
       UploadTexture(header,(uint16_t *)&textureFIFO[i+2]);
-      DebugLog("Real3D: Texture upload completed: %X bytes (%X)\n", size*4, textureFIFO[i+0]);
+      DEBUG_LOG(Real3D, "Real3D: Texture upload completed: %X bytes (%X)\n", size*4, textureFIFO[i+0]);
 
       i += size;
     }
@@ -696,7 +994,7 @@ void CReal3D::WriteTexturePort(unsigned reg, uint32_t data)
     uint32_t num_words = (2+vrom[addr+0]/2) / 4;
     if (!num_words)
     {
-      DebugLog("Real3D: 0-length VROM texture upload @ PC=%08X (%08X)\n", ppc_get_pc(), data);
+      DEBUG_LOG(Real3D, "Real3D: 0-length VROM texture upload @ PC=%08X (%08X)\n", ppc_get_pc(), data);
       return;
     }
     for (uint32_t i = 0; i < num_words; i++)
@@ -708,7 +1006,7 @@ void CReal3D::WriteTexturePort(unsigned reg, uint32_t data)
     {
       uint32_t addr = m_vromTextureFIFO[0];
       uint32_t header = m_vromTextureFIFO[1];
-      UploadTexture(header, (const uint16_t *) &vrom[addr & 0xFFFFFF]);
+      UploadVROMTexture(addr & 0xFFFFFF, header);
       m_vromTextureFIFOIdx = 0;
     }
     else
@@ -718,6 +1016,7 @@ void CReal3D::WriteTexturePort(unsigned reg, uint32_t data)
 
 void CReal3D::WriteLowCullingRAM(uint32_t addr, uint32_t data)
 {
+  m_sceneWritten = true;
   if (m_gpuMultiThreaded)
     MARK_DIRTY(cullingRAMLoDirty, addr);
   cullingRAMLo[addr/4] = data;
@@ -725,6 +1024,7 @@ void CReal3D::WriteLowCullingRAM(uint32_t addr, uint32_t data)
 
 void CReal3D::WriteHighCullingRAM(uint32_t addr, uint32_t data)
 {
+  m_sceneWritten = true;
   if (m_gpuMultiThreaded)
     MARK_DIRTY(cullingRAMHiDirty, addr);
   cullingRAMHi[addr/4] = data;
@@ -732,6 +1032,7 @@ void CReal3D::WriteHighCullingRAM(uint32_t addr, uint32_t data)
 
 void CReal3D::WritePolygonRAM(uint32_t addr, uint32_t data)
 {
+  m_sceneWritten = true;
   if (m_gpuMultiThreaded)
     MARK_DIRTY(polyRAMDirty, addr);
   polyRAM[addr/4] = data;
@@ -745,12 +1046,13 @@ void CReal3D::WriteJTAGRegister(uint64_t instruction, uint64_t data)
   else if (instruction == CJTAG::Instruction::SetReal3DRenderConfig1)
     m_internalRenderConfig[1] = data;
   UpdateRenderConfig(Render3D, m_internalRenderConfig);
+  m_sceneWritten = true;
 }
 
 // Registers correspond to the Stat_Pckt in the Real3d sdk
 uint32_t CReal3D::ReadRegister(unsigned reg)
 {
-  DebugLog("Real3D: Read reg %X\n", reg);
+  DEBUG_LOG(Real3D, "Real3D: Read reg %X\n", reg);
   if (reg == 0)
   {
 	  uint32_t ping_pong;
@@ -789,7 +1091,7 @@ uint32_t CReal3D::ReadPCIConfigSpace(unsigned device, unsigned reg, unsigned bit
   
   if ((bits==8))
   {
-    DebugLog("Real3D: %d-bit PCI read request for reg=%02X\n", bits, reg);
+    DEBUG_LOG(Real3D, "Real3D: %d-bit PCI read request for reg=%02X\n", bits, reg);
     return 0;
   }
   
@@ -811,10 +1113,10 @@ uint32_t CReal3D::ReadPCIConfigSpace(unsigned device, unsigned reg, unsigned bit
     default:
       break;
     }
-    DebugLog("Real3D: PCI ID read. Returning %X (%d-bits). PC=%08X, LR=%08X\n", d, bits, ppc_get_pc(), ppc_get_lr());
+    DEBUG_LOG(Real3D, "Real3D: PCI ID read. Returning %X (%d-bits). PC=%08X, LR=%08X\n", d, bits, ppc_get_pc(), ppc_get_lr());
     return d;
   default:
-    DebugLog("Real3D: PCI read request for reg=%02X (%d-bit)\n", reg, bits);
+    DEBUG_LOG(Real3D, "Real3D: PCI read request for reg=%02X (%d-bit)\n", reg, bits);
     break;
   }
 
@@ -823,7 +1125,7 @@ uint32_t CReal3D::ReadPCIConfigSpace(unsigned device, unsigned reg, unsigned bit
   
 void CReal3D::WritePCIConfigSpace(unsigned device, unsigned reg, unsigned bits, unsigned offset, uint32_t data)
 {
-  DebugLog("Real3D: PCI %d-bit write request for reg=%02X, data=%08X\n", bits, reg, data);
+  DEBUG_LOG(Real3D, "Real3D: PCI %d-bit write request for reg=%02X, data=%08X\n", bits, reg, data);
 }
   
 void CReal3D::Reset(void)
@@ -833,21 +1135,30 @@ void CReal3D::Reset(void)
   m_pingPong = 0;
   commandPortWritten = false;
   commandPortWrittenRO = false;
+  m_sceneWritten = false;
+  m_sceneChanged = true;
+  m_repeatFrame = false;
 
   queuedUploadTextures.clear();
   queuedUploadTexturesRO.clear();
+  m_vromTextureUploads.clear();
 
   fifoIdx = 0;
   m_vromTextureFIFOIdx = 0;
+  m_writeBuffersStale = false;
   dmaStatus = 0;
   dmaUnknownReg = 0;
   
   unsigned memSize = (m_gpuMultiThreaded ? MEMORY_POOL_SIZE : MEM_POOL_SIZE_RW);
   memset(memoryPool, 0, memSize);
+  cullingRAMLoDirty.summary = 0;
+  cullingRAMHiDirty.summary = 0;
+  polyRAMDirty.summary = 0;
+  textureRAMDirty.summary = 0;
   memset(m_vromTextureFIFO, 0, sizeof(m_vromTextureFIFO));
   memset(m_internalRenderConfig, 0, sizeof(m_internalRenderConfig));
 
-  DebugLog("Real3D reset\n");
+  DEBUG_LOG(Real3D, "Real3D reset\n");
 }
 
 
@@ -866,8 +1177,9 @@ void CReal3D::AttachRenderer(IRender3D *Render3DPtr)
     Render3D->AttachMemory(cullingRAMLo, cullingRAMHi, polyRAM, vrom, textureRAM);
 
   Render3D->SetStepping(step);
+  m_sceneChanged = true;
 
-  DebugLog("Real3D attached a Render3D object\n");
+  DEBUG_LOG(Real3D, "Real3D attached a Render3D object\n");
 }
 
 uint32_t CReal3D::GetASICIDCode(ASIC asic) const
@@ -882,7 +1194,7 @@ void CReal3D::SetStepping(int stepping, uint32_t pciIDValue)
   step = stepping;
   if ((step!=0x10) && (step!=0x15) && (step!=0x20) && (step!=0x21))
   {
-    DebugLog("Real3D: Unrecognized stepping: %d.%d\n", (step>>4)&0xF, step&0xF);
+    DEBUG_LOG(Real3D, "Real3D: Unrecognized stepping: %d.%d\n", (step>>4)&0xF, step&0xF);
     step = 0x10;
   }
 
@@ -929,21 +1241,22 @@ void CReal3D::SetStepping(int stepping, uint32_t pciIDValue)
     };
   }
 
-  DebugLog("Real3D set to Step %d.%d\n", (step>>4)&0xF, step&0xF);
+  DEBUG_LOG(Real3D, "Real3D set to Step %d.%d\n", (step>>4)&0xF, step&0xF);
 }
 
-bool CReal3D::Init(const uint8_t *vromPtr, IBus *BusObjectPtr, CIRQ *IRQObjectPtr, unsigned dmaIRQBit)
+bool CReal3D::Init(const uint8_t *vromPtr, const uint8_t *ramPtr, IBus *BusObjectPtr, CIRQ *IRQObjectPtr, unsigned dmaIRQBit)
 {
   uint32_t memSize = (m_config["GPUMultiThreaded"].ValueAs<bool>() ? MEMORY_POOL_SIZE : MEM_POOL_SIZE_RW);
   float  memSizeMB = (float)memSize/(float)0x100000;
 
   // IRQ and bus objects
   Bus = BusObjectPtr; 
+  mainRAM = ramPtr;
   IRQ = IRQObjectPtr;
   dmaIRQ = dmaIRQBit;
     
-  // Allocate all Real3D RAM regions
-  memoryPool = new(std::nothrow) uint8_t[memSize];
+  // Allocate all Real3D RAM regions (the renderer walks them at random)
+  memoryPool = Util::MappedMemory::AllocateLarge(memSize);
   if (NULL == memoryPool)
     return ErrorLog("Insufficient memory for Real3D object (needs %1.1f MB).", memSizeMB);
   
@@ -961,25 +1274,30 @@ bool CReal3D::Init(const uint8_t *vromPtr, IBus *BusObjectPtr, CIRQ *IRQObjectPt
     cullingRAMHiRO = (uint32_t *) &memoryPool[OFFSET_8E_RO];
     polyRAMRO = (uint32_t *) &memoryPool[OFFSET_98_RO];
     textureRAMRO = (uint16_t *) &memoryPool[OFFSET_TEXRAM_RO];
-    cullingRAMLoDirty = (uint8_t *) &memoryPool[OFFSET_8C_DIRTY];
-    cullingRAMHiDirty = (uint8_t *) &memoryPool[OFFSET_8E_DIRTY];
-    polyRAMDirty = (uint8_t *) &memoryPool[OFFSET_98_DIRTY];
-    textureRAMDirty = (uint8_t *) &memoryPool[OFFSET_TEXRAM_DIRTY];
+    cullingRAMLoDirty = { &memoryPool[OFFSET_8C_DIRTY], 0 };
+    cullingRAMHiDirty = { &memoryPool[OFFSET_8E_DIRTY], 0 };
+    polyRAMDirty = { &memoryPool[OFFSET_98_DIRTY], 0 };
+    textureRAMDirty = { &memoryPool[OFFSET_TEXRAM_DIRTY], 0 };
   }
   
   // VROM pointer passed to us
   vrom = (uint32_t *) vromPtr;
   
-  DebugLog("Initialized Real3D (allocated %1.1f MB)\n", memSizeMB);
+  DEBUG_LOG(Real3D, "Initialized Real3D (allocated %1.1f MB)\n", memSizeMB);
   return OKAY;
 }
 
 CReal3D::CReal3D(const Util::Config::Node &config)
   : m_config(config),
-    m_gpuMultiThreaded(config["GPUMultiThreaded"].ValueAs<bool>())
+    m_gpuMultiThreaded(config["GPUMultiThreaded"].ValueAs<bool>()),
+    m_gpuDoubleBuffered(m_gpuMultiThreaded && config["GPUDoubleBuffered"].ValueAsDefault<bool>(false)),
+    m_lowMemory(config["LowMemory"].ValueAsDefault<bool>(false))
 { 
   Render3D = NULL;
+  Bus = NULL;
+  mainRAM = NULL;
   memoryPool = NULL;
+  m_writeBuffersStale = false;
   cullingRAMLo = NULL;
   cullingRAMHi = NULL;
   polyRAM = NULL;
@@ -991,9 +1309,12 @@ CReal3D::CReal3D(const Util::Config::Node &config)
   m_vromTextureFIFO[0] = 0;
   m_vromTextureFIFO[1] = 0;
   m_vromTextureFIFOIdx = 0;
+  m_textureWriteStamps.assign(256 * 256, 0);
+  m_textureWriteCount = 0;
+  m_vromUploadRects = NULL;
   m_internalRenderConfig[0] = 0;
   m_internalRenderConfig[1] = 0;
-  DebugLog("Built Real3D\n");
+  DEBUG_LOG(Real3D, "Built Real3D\n");
 }
 
 /*
@@ -1046,16 +1367,13 @@ CReal3D::~CReal3D(void)
 #endif
 
   Render3D = NULL;
-  if (memoryPool != NULL)
-  {
-    delete [] memoryPool;
-    memoryPool = NULL;
-  }
+  Util::MappedMemory::Free(memoryPool, m_gpuMultiThreaded ? MEMORY_POOL_SIZE : MEM_POOL_SIZE_RW);
+  memoryPool = NULL;
   cullingRAMLo = NULL;
   cullingRAMHi = NULL;
   polyRAM = NULL;
   textureRAM = NULL;
   textureFIFO = NULL;
   vrom = NULL;
-  DebugLog("Destroyed Real3D\n");
+  DEBUG_LOG(Real3D, "Destroyed Real3D\n");
 }
@@ -31,6 +31,7 @@
 
 #include <cstdint>
 #include <map>
+#include <vector>
 
 /* 
  * QueuedUploadTextures:
@@ -100,6 +101,19 @@ public:
    */
   void SaveState(CBlockFile *SaveState);
 
+  /*
+   * SaveFrameState(SaveState):
+   *
+   * Saves the device state the current frame is rendered from: the
+   * read-only snapshots if multi-threaded. The block is the same as that of
+   * SaveState(), so it can be loaded with LoadState() to render the frame
+   * again without the rest of the system.
+   *
+   * Parameters:
+   *    SaveState   Block file to save state information to.
+   */
+  void SaveFrameState(CBlockFile *SaveState);
+
   /*
    * LoadState(SaveState):
    *
@@ -125,15 +139,45 @@ public:
   void EndVBlank(void);
 
   /*
-   * SyncSnapshots(void):
+   * SyncSnapshots(copier):
    *
    * Syncs the read-only memory snapshots with the real ones so that rendering
    * of the current frame can begin in the render thread.  Must be called at the
    * end of each frame when both the render thread and the PPC thread have finished
    * their work.  If multi-threaded rendering is not enabled, then this method does
    * nothing.
+   *
+   * Parameters:
+   *    copier  Snapshot copier on which to queue the dirty memory regions.  The
+   *            caller must Run() it before rendering begins.
+   *
+   * Returns:
+   *    Number of bytes copied directly (not including queued regions).
    */
-  uint32_t SyncSnapshots(void);
+  uint32_t SyncSnapshots(CSnapshotCopier &copier);
+
+  /*
+   * RefreshWriteBuffers(copier):
+   *
+   * When double-buffered (GPUDoubleBuffered), SyncSnapshots() swaps the live
+   * and read-only buffers instead of copying between them, which leaves the
+   * new live buffers behind by the pages written during the previous frame.
+   * This queues those pages on the copier.  The caller must Run() it before
+   * the PPC next accesses Real3D memory.  Does nothing if not double-buffered.
+   *
+   * Parameters:
+   *    copier  Snapshot copier on which to queue the stale pages.
+   */
+  void RefreshWriteBuffers(CSnapshotCopier &copier);
+
+  /*
+   * HashSnapshots(void):
+   *
+   * Returns a hash of the culling, polygon and texture RAM that the frame
+   * was rendered from (the read-only snapshots if multi-threaded), to tell
+   * whether two runs drew the same scenes.
+   */
+  uint64_t HashSnapshots(void) const;
 
   /*
    * BeginFrame(void):
@@ -149,7 +193,10 @@ public:
    *
    * Traverses the scene database and renders a frame.  Must be called after
    * BeginFrame() but before EndFrame() and must only access read-only snapshots
-   * and variables since it may be running in a separate thread.
+   * and variables since it may be running in a separate thread.  If nothing
+   * was written to 3D memory, the texture FIFO, the command port or the render
+   * config since the last frame rendered, and the renderer kept that frame,
+   * it is drawn again without traversing anything.
    */
   void RenderFrame(void);
 
@@ -270,6 +317,29 @@ public:
    *    data  Data to write.
    */
   void WritePolygonRAM(uint32_t addr, uint32_t data);
+
+  /*
+   * CopyFromRAM(destAddr, srcAddr, size, reverseBytes):
+   *
+   * Copies a block of PowerPC RAM to one of the Real3D memory regions or the
+   * texture FIFO in one go, marking the dirty pages as it does. The result is
+   * the same as writing each word through CModel3::Write32() as read with
+   * CModel3::Read32(), byte reversed first if requested.
+   *
+   * Parameters:
+   *    destAddr      Destination address on the PowerPC bus (8C, 8E, 94 or
+   *                  98xxxxxx).
+   *    srcAddr       Source address in PowerPC RAM.
+   *    size          Number of bytes.
+   *    reverseBytes  Whether each word is byte reversed, as by the Real3D
+   *                  DMA device when so configured.
+   *
+   * Returns:
+   *    True if the block was copied, false if the addresses are not word
+   *    aligned, are not in RAM and a Real3D region, or the block runs off the
+   *    end of either, in which case it must go through the bus.
+   */
+  bool CopyFromRAM(uint32_t destAddr, uint32_t srcAddr, uint32_t size, bool reverseBytes);
   
   /*
    * WriteJTAGRegister(instruction, data):
@@ -387,7 +457,7 @@ public:
 
   
   /*
-   * Init(vromPtr, BusObjectPtr, IRQObjectPtr, dmaIRQBit):
+   * Init(vromPtr, ramPtr, BusObjectPtr, IRQObjectPtr, dmaIRQBit):
    *
    * One-time initialization of the context. Must be called prior to all
    * other members. Connects the Real3D device to its video ROM and allocates
@@ -396,6 +466,9 @@ public:
    * Parameters:
    *    vromPtr       A pointer to video ROM (with each 32-bit word in
    *                  its native little endian format).
+   *    ramPtr        A pointer to the 8MB of PowerPC RAM at 00000000 (with
+   *                  each 32-bit word in its native little endian format),
+   *                  so that DMA from it can bypass the bus. May be NULL.
    *    BusObjectPtr  Pointer to the bus that the 53C810 has control
    *                  over. Used to read/write memory.
    *    IRQObjectPtr  Pointer to the IRQ controller. Used to trigger SCSI
@@ -407,7 +480,7 @@ public:
    *    OKAY if successful otherwise FAIL (not enough memory). Prints own
    *    errors.
    */
-  bool Init(const uint8_t *vromPtr, IBus *BusObjectPtr, CIRQ *IRQObjectPtr, unsigned dmaIRQBit);
+  bool Init(const uint8_t *vromPtr, const uint8_t *ramPtr, IBus *BusObjectPtr, CIRQ *IRQObjectPtr, unsigned dmaIRQBit);
    
   /*
    * CReal3D(config):
@@ -425,15 +498,23 @@ public:
 private:
   // Private member functions
   void      DMACopy(void);
+  bool      DMACopyFromRAM(void);
   void      StoreTexture(unsigned level, unsigned xPos, unsigned yPos, unsigned width, unsigned height, const uint16_t *texData, bool sixteenBit, bool writeLSB, bool writeMSB, uint32_t &texDataOffset);
 
   void      UploadTexture(uint32_t header, const uint16_t *texData);
+  void      MarkTextureWritten(unsigned xPos, unsigned yPos, unsigned width, unsigned height);
+  void      UploadVROMTexture(uint32_t addr, uint32_t header);
   uint32_t  UpdateSnapshots(bool copyWhole);
-  uint32_t  UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, unsigned size, uint8_t *dirty);
+  void      SwapBuffers(void);
+  uint32_t  UpdateSnapshot(bool copyWhole, uint8_t *src, uint8_t *dst, unsigned size, DirtyPageMap &dirty);
+  void      WriteState(CBlockFile *SaveState, const uint32_t *cullLo, const uint32_t *cullHi, const uint32_t *poly, const uint16_t *texture);
 
   // Config 
   const Util::Config::Node &m_config;
   const bool                m_gpuMultiThreaded;
+  const bool                m_gpuDoubleBuffered;
+  const bool                m_lowMemory;          // free the texture RAM read from save states once it's been used
+  bool                      m_writeBuffersStale;  // live buffers were swapped and not yet refreshed
 
   // Renderer attached to the Real3D
   IRender3D *Render3D;
@@ -452,6 +533,7 @@ private:
   uint32_t  *cullingRAMHi;      // 1MB of culling RAM at 8E000000
   uint32_t  *polyRAM;           // 4MB of polygon RAM at 98000000
   uint16_t  *textureRAM;        // 8MB of internal texture RAM
+  std::vector<uint16_t> m_loadedTextureRAM; // texture RAM read from a save state, to compare with the current
   uint32_t  *textureFIFO;       // 1MB texture FIFO at 0x94000000
   uint32_t  fifoIdx;            // index into texture FIFO
   uint32_t  m_vromTextureFIFO[2];
@@ -464,17 +546,36 @@ private:
   uint16_t  *textureRAMRO;      // 8MB of internal texture RAM    [read-only snapshot]
   
   // Arrays to keep track of dirty pages in memory regions
-  uint8_t   *cullingRAMLoDirty;
-  uint8_t   *cullingRAMHiDirty;
-  uint8_t   *polyRAMDirty;
-  uint8_t   *textureRAMDirty;
+  DirtyPageMap cullingRAMLoDirty;
+  DirtyPageMap cullingRAMHiDirty;
+  DirtyPageMap polyRAMDirty;
+  DirtyPageMap textureRAMDirty;
 
   // Queued texture uploads
   std::vector<QueuedUploadTextures> queuedUploadTextures;
   std::vector<QueuedUploadTextures> queuedUploadTexturesRO;  // Read-only copy of queue
+
+  // VROM texture uploads whose texels are still intact in texture RAM. VROM
+  // never changes, so uploading one of these again would write what is
+  // already there and is skipped, which also keeps the renderer's decoded
+  // copy. An upload is intact while no block it wrote has been written since.
+  struct VROMTextureRect
+  {
+    unsigned x, y, width, height;
+  };
+  struct VROMTextureUpload
+  {
+    uint64_t stamp;                       // value of m_textureWriteCount once uploaded
+    std::vector<VROMTextureRect> rects;   // every level it wrote
+  };
+  std::map<uint64_t, VROMTextureUpload> m_vromTextureUploads;  // keyed by VROM address and header
+  std::vector<uint64_t> m_textureWriteStamps; // per 8x8 texel block, when texture RAM was last written there
+  uint64_t m_textureWriteCount;
+  std::vector<VROMTextureRect> *m_vromUploadRects;  // rects of the VROM upload in progress, or NULL
   
   // Big endian bus object for DMA memory access
   IBus  *Bus;
+  const uint8_t *mainRAM;       // PowerPC RAM, for DMA fast path
   
   // IRQ handling
   CIRQ    *IRQ;   // IRQ controller
@@ -492,6 +593,12 @@ private:
   // Command port
   bool  commandPortWritten;
   bool  commandPortWrittenRO; // Read-only copy of flag
+
+  // When nothing the renderer reads was written between two frames, the
+  // renderer draws again the 3D it kept from the last one
+  bool  m_sceneWritten = false; // 3D memory, textures or render config written since the last sync
+  bool  m_sceneChanged = true;  // anything written since the last frame was rendered
+  bool  m_repeatFrame = false;  // this frame is a repeat of the last one
   
   // Status and command registers
   uint32_t m_pingPong;
@@ -0,0 +1,99 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2017 Bart Trzynadlowski, Nik Henson, Ian Curtis
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free 
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+ 
+/*
+ * Scheduler.cpp
+ * 
+ * Timeline of board and device events, run against the PowerPC clock. This
+ * replaces hard-coded sequences of ppc_execute() calls: each event ends a
+ * PowerPC time slice at exactly the right cycle, so there are no slice
+ * boundaries other than the ones that actually do something.
+ */
+
+#include "Supermodel.h"
+#include "Model3/Scheduler.h"
+#include <algorithm>
+
+bool CScheduler::Later(const Event &a, const Event &b)
+{
+  return a.time > b.time || (a.time == b.time && a.sequence > b.sequence);
+}
+
+UINT64 CScheduler::Now(void) const
+{
+  return m_dispatching ? m_dispatchTime : ppc_total_cycles();
+}
+
+void CScheduler::Schedule(UINT64 time, Callback callback)
+{
+  m_events.push_back({ time, m_sequence++, std::move(callback) });
+  std::push_heap(m_events.begin(), m_events.end(), Later);
+}
+
+void CScheduler::ScheduleIn(UINT64 cycles, Callback callback)
+{
+  Schedule(Now() + cycles, std::move(callback));
+}
+
+// Dispatches all events up to and including the given time (callbacks may post more)
+void CScheduler::DispatchUntil(UINT64 time)
+{
+  while (!m_events.empty() && m_events.front().time <= time)
+  {
+    std::pop_heap(m_events.begin(), m_events.end(), Later);
+    Event event = std::move(m_events.back());
+    m_events.pop_back();
+    if (event.callback)
+    {
+      m_dispatching = true;
+      m_dispatchTime = std::max(event.time, ppc_total_cycles());  // late events run now
+      event.callback();
+      m_dispatching = false;
+    }
+  }
+}
+
+void CScheduler::Run(UINT64 endTime)
+{
+  for (UINT64 now = ppc_total_cycles(); ; now = ppc_total_cycles())
+  {
+    DispatchUntil(now);
+    if (now >= endTime)
+      break;
+
+    UINT64 until = endTime;
+    if (!m_events.empty())
+      until = std::min(until, m_events.front().time);
+
+    int cycles = int(until - now);
+    if (ppc_execute(cycles) < cycles)
+    {
+      // PowerPC halted: time no longer advances, but devices still need their events
+      DispatchUntil(endTime);
+      break;
+    }
+  }
+}
+
+void CScheduler::Clear(void)
+{
+  m_events.clear();
+}
@@ -0,0 +1,102 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2017 Bart Trzynadlowski, Nik Henson, Ian Curtis
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free 
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+ 
+/*
+ * Scheduler.h
+ * 
+ * Header file defining the CScheduler class: a timeline of events on the
+ * PowerPC clock.
+ */
+
+#ifndef INCLUDED_SCHEDULER_H
+#define INCLUDED_SCHEDULER_H
+
+#include "Types.h"
+#include <functional>
+#include <vector>
+
+/*
+ * CScheduler:
+ *
+ * Events are posted at an absolute PowerPC cycle count (the same time base as
+ * ppc_total_cycles()) and Run() executes the PowerPC in slices that end
+ * exactly at each event before dispatching it. Events with the same time are
+ * dispatched in the order they were posted. A callback may be empty, in which
+ * case the event only marks a point the PowerPC must not run past in one
+ * slice (e.g. a state change that devices compute lazily from the cycle count).
+ */
+class CScheduler
+{
+public:
+  typedef std::function<void(void)> Callback;
+
+  /*
+   * Now(void):
+   *
+   * Returns:
+   *    Current time. While dispatching, this is the time of the event.
+   */
+  UINT64 Now(void) const;
+
+  /*
+   * Schedule(time, callback):
+   * ScheduleIn(cycles, callback):
+   *
+   * Posts an event at an absolute time or relative to Now(). Events in the
+   * past are dispatched as soon as possible.
+   */
+  void Schedule(UINT64 time, Callback callback);
+  void ScheduleIn(UINT64 cycles, Callback callback);
+
+  /*
+   * Run(endTime):
+   *
+   * Runs the PowerPC until the given time, dispatching events along the way.
+   * Events posted for later times remain queued. If the PowerPC halts, the
+   * remaining events up to endTime are still dispatched in order.
+   */
+  void Run(UINT64 endTime);
+
+  /*
+   * Clear(void):
+   *
+   * Discards all pending events.
+   */
+  void Clear(void);
+
+private:
+  struct Event
+  {
+    UINT64    time;
+    UINT64    sequence;
+    Callback  callback;
+  };
+
+  static bool Later(const Event &a, const Event &b);
+  void DispatchUntil(UINT64 time);
+
+  std::vector<Event> m_events;  // min-heap on (time, sequence)
+  UINT64 m_sequence = 0;
+  bool m_dispatching = false;
+  UINT64 m_dispatchTime = 0;
+};
+
+#endif  // INCLUDED_SCHEDULER_H
@@ -0,0 +1,236 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2017 Bart Trzynadlowski, Nik Henson, Ian Curtis
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * SnapshotCopier.cpp
+ *
+ * Copies dirty pages of the Real3D and tile generator memory regions to the
+ * read-only snapshots used by the render thread. This is on the critical path
+ * between the end of one frame and the start of the next, so only the words of
+ * the dirty bitmaps flagged in their summaries are looked at, runs of dirty
+ * pages are copied with a single memcpy and large updates are spread across
+ * worker threads.
+ */
+
+#include "Supermodel.h"
+#include "Model3/SnapshotCopier.h"
+#include <algorithm>
+#include <cstring>
+
+#define CHUNK_WIDTH     20    // log2 of bytes per unit of work handed to a thread (1 MB)
+#define PARALLEL_BYTES  0x100000  // minimum dirty bytes before copying in parallel
+
+static inline unsigned CountTrailingZeros(uint64_t w)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(w);
+#else
+  unsigned n = 0;
+  while ((w & 1) == 0)
+  {
+    w >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static inline unsigned CountBits(uint64_t w)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll(w);
+#else
+  unsigned n = 0;
+  for (; w != 0; w &= w - 1)
+    n++;
+  return n;
+#endif
+}
+
+// Returns number of bytes of the page bitmap in word index (the last word may be partial)
+static inline unsigned WordBytes(unsigned numPages, unsigned index)
+{
+  unsigned left = numPages / 8 - 8 * index;
+  return left < 8 ? left : 8;
+}
+
+// Returns bitmap word covering pages 64*index to 64*index+63 (pages beyond the end read as clean)
+static inline uint64_t DirtyWord(const DirtyPageMap &dirty, unsigned numPages, unsigned index)
+{
+  if (index >= 64 || !((dirty.summary >> index) & 1))
+    return 0;
+  const uint8_t *bytes = &dirty.pages[8 * index];
+  unsigned n = WordBytes(numPages, index);
+  uint64_t w = 0;
+  for (unsigned i = 0; i < n; i++)
+    w |= uint64_t(bytes[i]) << (8 * i);
+  return w;
+}
+
+// Returns index of first summary word at or after index with any dirty pages (64 if none)
+static inline unsigned NextDirtyWord(const DirtyPageMap &dirty, unsigned index)
+{
+  uint64_t s = index < 64 ? dirty.summary >> index : 0;
+  return s == 0 ? 64 : index + CountTrailingZeros(s);
+}
+
+static inline bool IsDirty(const DirtyPageMap &dirty, unsigned page)
+{
+  return (dirty.pages[page / 8] >> (page & 7)) & 1;
+}
+
+// Copies the dirty pages within [firstPage, endPage) of a region, merging runs
+uint32_t CSnapshotCopier::CopyPages(const Region &region, unsigned firstPage, unsigned endPage)
+{
+  uint32_t copied = 0;
+  unsigned page = firstPage;
+  while (page < endPage)
+  {
+    // Find start of next run, skipping clean words using the summary
+    uint64_t w = DirtyWord(*region.dirty, region.numPages, page / 64) >> (page & 63);
+    if (w == 0)
+    {
+      page = 64 * NextDirtyWord(*region.dirty, page / 64 + 1);
+      continue;
+    }
+    page += CountTrailingZeros(w);
+    if (page >= endPage)
+      break;
+    unsigned start = page;
+
+    // Find first clean page after it
+    for (;;)
+    {
+      w = ~DirtyWord(*region.dirty, region.numPages, page / 64) >> (page & 63);
+      if (w != 0)
+      {
+        page += CountTrailingZeros(w);
+        break;
+      }
+      page = (page | 63) + 1;
+    }
+    if (page > endPage)
+      page = endPage;
+
+    // If not at very end of region, then copy an extra 4 bytes to allow for a
+    // possible 32-bit overlap (unless the next page is dirty, in which case
+    // it is copied in full by whoever owns it)
+    uint32_t offset = start << region.pageWidth;
+    uint32_t toCopy = (page - start) << region.pageWidth;
+    if (page < region.numPages && !IsDirty(*region.dirty, page))
+      toCopy += 4;
+    memcpy(region.dst + offset, region.src + offset, toCopy);
+    copied += toCopy;
+  }
+  return copied;
+}
+
+// Clears only the bitmap words flagged in the summary, then the summary itself
+void CSnapshotCopier::ClearRegion(const Region &region)
+{
+  DirtyPageMap &dirty = *region.dirty;
+  for (uint64_t s = dirty.summary; s != 0; s &= s - 1)
+  {
+    unsigned index = CountTrailingZeros(s);
+    memset(&dirty.pages[8 * index], 0, WordBytes(region.numPages, index));
+  }
+  dirty.summary = 0;
+}
+
+void CSnapshotCopier::ClearDirty(DirtyPageMap &dirty, unsigned size, unsigned pageWidth)
+{
+  Region region = { NULL, NULL, NULL, &dirty, size >> pageWidth, pageWidth };
+  ClearRegion(region);
+}
+
+uint32_t CSnapshotCopier::CopyDirty(const uint8_t *src, uint8_t *dst, unsigned size, DirtyPageMap &dirty, unsigned pageWidth)
+{
+  Region region = { NULL, src, dst, &dirty, size >> pageWidth, pageWidth };
+  uint32_t copied = CopyPages(region, 0, region.numPages);
+  ClearRegion(region);
+  return copied;
+}
+
+void CSnapshotCopier::Queue(const char *name, const uint8_t *src, uint8_t *dst, unsigned size, DirtyPageMap &dirty, unsigned pageWidth)
+{
+  m_regions.push_back({ name, src, dst, &dirty, size >> pageWidth, pageWidth });
+}
+
+void CSnapshotCopier::CopyChunk(Chunk &chunk)
+{
+  chunk.copied = CopyPages(*chunk.region, chunk.firstPage, chunk.endPage);
+}
+
+uint32_t CSnapshotCopier::Run(void)
+{
+  if (m_regions.empty())
+    return 0;
+
+  // Split regions into chunks, skipping clean ones, and count dirty bytes
+  uint32_t dirtyBytes = 0;
+  m_chunks.clear();
+  m_stats.clear();
+  for (const Region &region: m_regions)
+  {
+    unsigned chunkPages = 1u << (CHUNK_WIDTH - region.pageWidth);
+    unsigned regionCount = 0;
+    for (unsigned first = 0; first < region.numPages; first += chunkPages)
+    {
+      unsigned end = std::min(first + chunkPages, region.numPages);
+      unsigned count = 0;
+      for (unsigned page = first; page < end; page += 64)
+        count += CountBits(DirtyWord(*region.dirty, region.numPages, page / 64));
+      if (count != 0)
+        m_chunks.push_back({ &region, first, end, 0 });
+      regionCount += count;
+    }
+    dirtyBytes += regionCount << region.pageWidth;
+    m_stats.push_back({ region.name, regionCount, region.numPages });
+  }
+
+  // Copy on this thread alone unless there is enough work to be worth waking other threads
+  if (m_jobs == NULL || dirtyBytes < PARALLEL_BYTES)
+  {
+    for (Chunk &chunk: m_chunks)
+      CopyChunk(chunk);
+  }
+  else
+    m_jobs->ParallelFor(m_chunks.size(), [this](size_t i) { CopyChunk(m_chunks[i]); });
+
+  // Clear bitmaps only now, since chunks look at their neighbour's first page
+  uint32_t copied = 0;
+  for (const Chunk &chunk: m_chunks)
+    copied += chunk.copied;
+  for (const Region &region: m_regions)
+    ClearRegion(region);
+  m_regions.clear();
+  return copied;
+}
+
+const std::vector<CSnapshotCopier::RegionStats> &CSnapshotCopier::GetStats(void) const
+{
+  return m_stats;
+}
+
+void CSnapshotCopier::SetJobSystem(Util::JobSystem *jobs)
+{
+  m_jobs = jobs;
+}
@@ -0,0 +1,174 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2017 Bart Trzynadlowski, Nik Henson, Ian Curtis
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * SnapshotCopier.h
+ *
+ * Header file defining the CSnapshotCopier class: copies the dirty pages of
+ * GPU memory regions to their read-only snapshots.
+ */
+
+#ifndef INCLUDED_SNAPSHOTCOPIER_H
+#define INCLUDED_SNAPSHOTCOPIER_H
+
+#include "Util/JobSystem.h"
+#include <cstdint>
+#include <vector>
+
+/*
+ * DirtyPageMap:
+ *
+ * Records which pages of a memory region have been written to. Bit j of
+ * byte i of the page bitmap covers page 8*i+j, and bit k of the summary is
+ * set if any of pages 64*k to 64*k+63 is dirty, so that clean stretches can
+ * be skipped with a single test. A region may have at most 4096 pages.
+ */
+struct DirtyPageMap
+{
+  uint8_t   *pages;
+  uint64_t  summary;
+
+  inline void Mark(uint32_t addr, unsigned pageWidth)
+  {
+    uint32_t page = addr >> pageWidth;
+    pages[page / 8] |= 1 << (page & 7);
+    summary |= uint64_t(1) << (page / 64);
+  }
+};
+
+/*
+ * CSnapshotCopier:
+ *
+ * The Real3D and tile generator keep a dirty page map for each memory region
+ * they share with the render thread. At the end of each frame, regions are
+ * queued here and Run() copies them in a single pass. Only the parts of the
+ * page bitmaps flagged in the summary are scanned, adjacent dirty pages are
+ * merged into one memcpy and only what was set is cleared afterwards. When a
+ * job system has been attached and enough data is dirty, the regions are
+ * split into 1 MB chunks that are copied in parallel.
+ */
+class CSnapshotCopier
+{
+public:
+  // Number of dirty pages found in a region by Run()
+  struct RegionStats
+  {
+    const char  *name;
+    unsigned    dirtyPages;
+    unsigned    numPages;
+  };
+
+  /*
+   * CopyDirty(src, dst, size, dirty, pageWidth):
+   *
+   * Copies the dirty pages of a single region on the calling thread and
+   * clears its dirty bitmap.
+   *
+   * Parameters:
+   *    src     Live memory region.
+   *    dst     Read-only snapshot.
+   *    size    Size of region in bytes (a multiple of 8 pages).
+   *    dirty   Dirty page map.
+   *    pageWidth Log2 of page size in bytes.
+   *
+   * Returns:
+   *    Number of bytes copied.
+   */
+  static uint32_t CopyDirty(const uint8_t *src, uint8_t *dst, unsigned size, DirtyPageMap &dirty, unsigned pageWidth);
+
+  /*
+   * ClearDirty(dirty, size, pageWidth):
+   *
+   * Clears the dirty page map of a region. Parameters are as for
+   * CopyDirty().
+   */
+  static void ClearDirty(DirtyPageMap &dirty, unsigned size, unsigned pageWidth);
+
+  /*
+   * Queue(name, src, dst, size, dirty, pageWidth):
+   *
+   * Adds a region to be copied by the next call to Run(). The name is used
+   * only to label statistics and must remain valid. Other parameters are as
+   * for CopyDirty().
+   */
+  void Queue(const char *name, const uint8_t *src, uint8_t *dst, unsigned size, DirtyPageMap &dirty, unsigned pageWidth);
+
+  /*
+   * Run(void):
+   *
+   * Copies the dirty pages of all queued regions, clears their bitmaps and
+   * empties the queue. Must not run concurrently with anything that writes to
+   * the regions.
+   *
+   * Returns:
+   *    Number of bytes copied.
+   */
+  uint32_t Run(void);
+
+  /*
+   * GetStats(void):
+   *
+   * Returns:
+   *    Dirty page counts for each region copied by the most recent call to
+   *    Run() that had anything queued.
+   */
+  const std::vector<RegionStats> &GetStats(void) const;
+
+  /*
+   * SetJobSystem(jobs):
+   *
+   * Sets the job system used to copy large updates in parallel.
+   *
+   * Parameters:
+   *    jobs    Job system, or NULL to copy on the calling thread only.
+   */
+  void SetJobSystem(Util::JobSystem *jobs);
+
+private:
+  struct Region
+  {
+    const char    *name;
+    const uint8_t *src;
+    uint8_t       *dst;
+    DirtyPageMap  *dirty;
+    unsigned      numPages;
+    unsigned      pageWidth;
+  };
+
+  struct Chunk
+  {
+    const Region  *region;
+    unsigned      firstPage;
+    unsigned      endPage;
+    uint32_t      copied;
+  };
+
+  static uint32_t CopyPages(const Region &region, unsigned firstPage, unsigned endPage);
+  static void CopyChunk(Chunk &chunk);
+  static void ClearRegion(const Region &region);
+
+  std::vector<Region>   m_regions;
+  std::vector<Chunk>    m_chunks;
+  std::vector<RegionStats> m_stats;
+  Util::JobSystem       *m_jobs = NULL;
+};
+
+#endif  // INCLUDED_SNAPSHOTCOPIER_H
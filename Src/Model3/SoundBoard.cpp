@@ -55,6 +55,8 @@
  */
 
 #include "Supermodel.h"
+#include "Util/Hash.h"
+#include "Util/MappedMemory.h"
 
 // DEBUG
 //#define SUPERMODEL_LOG_AUDIO	// define this to log all audio to sound.bin
@@ -73,6 +75,10 @@ void CSoundBoard::UpdateROMBanks(void)
 		sampleBank = &sampleROM[0x800000];
 	else
 		sampleBank = &sampleROM[0x000000];
+
+	// Repoint the 68K's direct mapping of the bank
+	M68KSetContext(&M68K);
+	M68KMapROM(0x800000, 0xFFFFFF, sampleBank, 0x7FFFFF);
 }
 
 UINT8 CSoundBoard::Read8(UINT32 a)
@@ -287,18 +293,14 @@ void CSoundBoard::Write32(unsigned int a,unsigned int d)
  SCSP 68K Callbacks
  
  The SCSP emulator drives the 68K via callbacks. These have to live outside of
- the CSoundBoard object for now, unfortunately.
+ the CSoundBoard object for now, unfortunately. They run with the board's 68K
+ context active, which holds the status of its IRQ pins (IPL2-0).
 ******************************************************************************/
 
-// Status of IRQ pins (IPL2-0) on 68K
-// TODO: can we get rid of this global variable altogether?
-static int	irqLine = 0;
-
 // Interrupt acknowledge callback (TODO: don't need this, default behavior in M68K.cpp should be fine)
 int IRQAck(int irqLevel)
 {
 	M68KSetIRQ(0);
-	irqLine = 0;
 	return M68K_IRQ_AUTOVECTOR;
 }
 
@@ -309,6 +311,7 @@ void SCSP68KIRQCallback(int irqLevel)
 	 * IRQ arbitration logic: only allow higher priority IRQs to be asserted or
 	 * 0 to clear pending IRQ.
 	 */
+	int irqLine = M68KGetIRQ();
 	if ((irqLevel>irqLine) || (0==irqLevel))
 	{
 		irqLine = irqLevel;	
@@ -330,6 +333,7 @@ int SCSP68KRunCallback(int numCycles)
 
 void CSoundBoard::WriteMIDIPort(UINT8 data)
 {
+	SCSP_SetContext(m_scsp);
 	SCSP_MidiIn(data);
 	if (NULL != DSB)	// DSB receives all commands as well
 		DSB->SendCommand(data);
@@ -337,25 +341,37 @@ void CSoundBoard::WriteMIDIPort(UINT8 data)
 
 bool CSoundBoard::RunFrame(void)
 {
-	// Run sound board first to generate SCSP audio
-	if (m_config["EmulateSound"].ValueAs<bool>())
+	// Let the DSB run its CPU on its own thread (if it has one) while the SCSPs are rendered
+	if (NULL != DSB)
+		DSB->StartFrame();
+
+	// Run sound board first to generate SCSP audio. In timing only mode, the
+	// 68K still runs and answers the main board, but there is no audio.
+	bool timingOnly = m_soundTimingOnly;
+	if (m_emulateSound)
 	{
 		M68KSetContext(&M68K);
-		SCSP_Update();
-		M68KGetContext(&M68K);
+		SCSP_SetContext(m_scsp);
+		if (timingOnly)
+			SCSP_UpdateTiming();
+		else
+			SCSP_Update();
 	}
-	else
+	if (!m_emulateSound || timingOnly)
 	{
 		memset(audioL, 0, 44100/60*sizeof(INT16));
 		memset(audioR, 0, 44100/60*sizeof(INT16));
 	}
 	
-	// Run DSB and mix with existing audio
+	// Run DSB and mix with existing audio (its CPU reads back the MPEG stream
+	// position, so the stream is still decoded in timing only mode)
 	if (NULL != DSB)
 		DSB->RunFrame(audioL, audioR);
 
-	// Output the audio buffers
-	bool bufferFull = OutputAudio(44100/60, audioL, audioR, m_config["FlipStereo"].ValueAs<bool>());
+	// Output the audio buffers. With none, each frame is one frame of sound.
+	if (timingOnly)
+		return true;
+	bool bufferFull = OutputAudio(44100/60, audioL, audioR, m_flipStereo);
 
 #ifdef SUPERMODEL_LOG_AUDIO
 	// Output to binary file
@@ -372,6 +388,14 @@ bool CSoundBoard::RunFrame(void)
 	return bufferFull;
 }
 
+UINT64 CSoundBoard::HashAudio(void) const
+{
+	UINT64 hash[2];
+	hash[0] = Util::Hash64((const UINT8 *) audioL, 44100/60*sizeof(INT16));
+	hash[1] = Util::Hash64((const UINT8 *) audioR, 44100/60*sizeof(INT16));
+	return Util::Hash64((const UINT8 *) hash, sizeof(hash));
+}
+
 void CSoundBoard::Reset(void)
 {
 	// Even if SCSP emulation is disabled, we must reset to establish a valid 68K state
@@ -381,13 +405,11 @@ void CSoundBoard::Reset(void)
 	M68KSetContext(&M68K);
 	M68KReset();
 	//printf("SBrd PC=%06X\n", M68KGetPC());
-	M68KGetContext(&M68K);
 	if (NULL != DSB)
 		DSB->Reset();
-	DebugLog("Sound Board Reset\n");
+	DEBUG_LOG(Sound, "Sound Board Reset\n");
 	//printf("PC=%06X\n", M68KGetPC());
 	//M68KSetContext(&M68K);
-	//M68KGetContext(&M68K);
 	//printf("PC=%06X\n", M68KGetPC());
 }
 
@@ -401,6 +423,7 @@ void CSoundBoard::SaveState(CBlockFile *SaveState)
 	// All other devices...
 	M68KSetContext(&M68K);
 	M68KSaveState(SaveState, "Sound Board 68K");
+	SCSP_SetContext(m_scsp);
 	SCSP_SaveState(SaveState);
 	if (NULL != DSB)
 		DSB->SaveState(SaveState);
@@ -420,9 +443,9 @@ void CSoundBoard::LoadState(CBlockFile *SaveState)
 	UpdateROMBanks();
 	
 	// All other devices
-	M68KSetContext(&M68K);	// so we don't lose callback pointers when copying context back
+	M68KSetContext(&M68K);
 	M68KLoadState(SaveState, "Sound Board 68K");
-	M68KGetContext(&M68K);
+	SCSP_SetContext(m_scsp);
 	SCSP_LoadState(SaveState);
 	if (NULL != DSB)
 		DSB->LoadState(SaveState);
@@ -436,7 +459,7 @@ void CSoundBoard::LoadState(CBlockFile *SaveState)
 void CSoundBoard::AttachDSB(CDSB *DSBPtr)
 {
 	DSB = DSBPtr;
-	DebugLog("Sound Board connected to DSB\n");
+	DEBUG_LOG(Sound, "Sound Board connected to DSB\n");
 }
 
 // Offsets of memory regions within sound board's pool
@@ -454,13 +477,11 @@ bool CSoundBoard::Init(const UINT8 *soundROMPtr, const UINT8 *sampleROMPtr)
 	soundROM = soundROMPtr;
 	sampleROM = sampleROMPtr;
 	ctrlReg = 0;
-	UpdateROMBanks();
 
 	// Allocate all memory for RAM
-	memoryPool = new(std::nothrow) UINT8[MEMORY_POOL_SIZE];
+	memoryPool = Util::MappedMemory::AllocateLarge(MEMORY_POOL_SIZE);	// comes zeroed
 	if (NULL == memoryPool)
 		return ErrorLog("Insufficient memory for sound board (needs %1.1f MB).", memSizeMB);
-	memset(memoryPool, 0, MEMORY_POOL_SIZE);
 	
 	// Set up memory pointers
 	ram1 = &memoryPool[OFFSET_RAM1];
@@ -473,9 +494,16 @@ bool CSoundBoard::Init(const UINT8 *soundROMPtr, const UINT8 *sampleROMPtr)
 	M68KInit();
 	M68KAttachBus(this);
 	M68KSetIRQCallback(IRQAck);
-	M68KGetContext(&M68K);
+	M68KMapRAM(0x000000, 0x0FFFFF, ram1, 0x0FFFFF);
+	M68KMapRAM(0x200000, 0x2FFFFF, ram2, 0x0FFFFF);
+	M68KMapROM(0x600000, 0x6FFFFF, soundROM, 0x07FFFF);
+	UpdateROMBanks();	// sample ROM bank
+	std::string engine = m_config["SoundBoardM68KEngine"].ValueAsDefault<std::string>(m_config["M68KEngine"].ValueAs<std::string>());
+	if (OKAY != M68KSetEngine(engine.c_str()))
+		ErrorLog("Unknown 68K engine '%s' for sound board; using 'musashi'.", engine.c_str());
 		
 	// Initialize SCSPs
+	SCSP_SetContext(m_scsp);
 	SCSP_SetBuffers(audioL, audioR, 44100/60);
 	SCSP_SetCB(SCSP68KRunCallback, SCSP68KIRQCallback);
 	if (OKAY != SCSP_Init(m_config, 2))
@@ -504,7 +532,10 @@ CDSB *CSoundBoard::GetDSB(void)
 }
 
 CSoundBoard::CSoundBoard(const Util::Config::Node &config)
-  : m_config(config)
+  : m_config(config),
+    m_emulateSound(config, "EmulateSound"),
+    m_soundTimingOnly(config, "SoundTimingOnly"),
+    m_flipStereo(config, "FlipStereo")
 {
 	DSB = NULL;
 	memoryPool = NULL;
@@ -514,8 +545,9 @@ CSoundBoard::CSoundBoard(const Util::Config::Node &config)
 	audioR = NULL;
 	soundROM = NULL;
 	sampleROM = NULL;
+	m_scsp = SCSP_CreateContext();
 	
-	DebugLog("Built Sound Board\n");
+	DEBUG_LOG(Sound, "Built Sound Board\n");
 }
 
 static void Reverse16(UINT8 *buf, unsigned size)
@@ -538,15 +570,16 @@ CSoundBoard::~CSoundBoard(void)
 	fclose(soundFP);
 #endif
 
+	SCSP_SetContext(m_scsp);
 	SCSP_Deinit();
+	SCSP_SetContext(NULL);
+	SCSP_DestroyContext(m_scsp);
+	m_scsp = NULL;
 	
 	DSB = NULL;
 	
-	if (memoryPool != NULL)
-	{
-		delete [] memoryPool;
-		memoryPool = NULL;
-	}
+	Util::MappedMemory::Free(memoryPool, MEMORY_POOL_SIZE);
+	memoryPool = NULL;
 	ram1 = NULL;
 	ram2 = NULL;
 	audioL = NULL;
@@ -554,5 +587,5 @@ CSoundBoard::~CSoundBoard(void)
 	soundROM = NULL;
 	sampleROM = NULL;
 	
-	DebugLog("Destroyed Sound Board\n");
+	DEBUG_LOG(Sound, "Destroyed Sound Board\n");
 }
@@ -111,6 +111,14 @@ public:
 	 * Runs the sound board for one frame, updating sound in the process.
 	 */
 	bool RunFrame(void);
+
+	/*
+	 * HashAudio(void):
+	 *
+	 * Returns a hash of the audio output by the most recent frame, to tell
+	 * whether two runs produced the same sound.
+	 */
+	UINT64 HashAudio(void) const;
 	
 	/*
 	 * Reset(void):
@@ -185,12 +193,18 @@ private:
 	
 	// Config
 	const Util::Config::Node &m_config;
+	Util::Config::Binding<bool> m_emulateSound;
+	Util::Config::Binding<bool> m_soundTimingOnly;
+	Util::Config::Binding<bool> m_flipStereo;
 
 	// Digital Sound Board
 	CDSB		*DSB;
 	
 	// 68K context
 	M68KCtx		M68K;
+
+	// SCSP context (made active alongside the 68K)
+	SCSP_CONTEXT	*m_scsp;
 	
 	// Sound board memory
 	const UINT8	*soundROM;		// 68K program ROM (passed in from parent object)
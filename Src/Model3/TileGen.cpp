@@ -36,9 +36,10 @@
  * color offset registers associated with them. The renderer uses these 
  * "computed" palettes.
  *
- * The computed palettes are updated whenever the real palette is modified, a
- * single color entry at a time. If the color register is modified, the entire
- * palette has to be recomputed accordingly.
+ * Writes to the real palette only flag the colors written. The computed
+ * palettes are updated from them when the snapshots are synced, once however
+ * many times a color was written during the frame. If the color register is
+ * modified, the entire palette has to be recomputed accordingly.
  *
  * The read-only copy of the palette, which is generated for the renderer, only
  * stores the two computed palettes.
@@ -51,13 +52,15 @@
  */
 
 #include <cstring>
+#include <algorithm>
 #include "Supermodel.h"
+#include "Util/ByteSwap.h"
 
 // Macros that divide memory regions into pages and mark them as dirty when they are written to
 #define PAGE_WIDTH 10
 #define PAGE_SIZE (1<<PAGE_WIDTH)
 #define DIRTY_SIZE(arraySize) (1+(arraySize-1)/(8*PAGE_SIZE))
-#define MARK_DIRTY(dirtyArray, addr) dirtyArray[addr>>(PAGE_WIDTH+3)] |= 1<<((addr>>PAGE_WIDTH)&7)
+#define MARK_DIRTY(dirtyMap, addr) (dirtyMap).Mark(addr, PAGE_WIDTH)
 
 // Offsets of memory regions within TileGen memory pool
 #define OFFSET_VRAM         0x000000	// VRAM and palette data
@@ -89,6 +92,13 @@ void CTileGen::SaveState(CBlockFile *SaveState)
 	SaveState->Write(regs, sizeof(regs));
 }
 
+void CTileGen::SaveFrameState(CBlockFile *SaveState)
+{
+	SaveState->NewBlock("Tile Generator", __FILE__);
+	SaveState->Write(m_gpuMultiThreaded ? vramRO : vram, 0x120000);
+	SaveState->Write(m_gpuMultiThreaded ? regsRO : regs, sizeof(regs));
+}
+
 void CTileGen::LoadState(CBlockFile *SaveState)
 {
 	if (OKAY != SaveState->FindBlock("Tile Generator"))
@@ -97,18 +107,14 @@ void CTileGen::LoadState(CBlockFile *SaveState)
 		return;
 	}
 	
-	// Load memory one word at a time
-	for (int i = 0; i < 0x120000; i += 4)
-	{
-		UINT32 data;
-	
-		SaveState->Read(&data, sizeof(data));
-		WriteRAM32(i, data);
-	}	
+	SaveState->Read(vram, 0x120000);
 	SaveState->Read(regs, sizeof(regs));
 	
-	// Because regs were read after palette, must recompute
-	RecomputePalettes();
+	// Palettes are computed from the whole of VRAM and everything must be redrawn
+	memset(palPending, 0, sizeof(palPending));
+	palPendingAny = false;
+	RecomputePalettes(3);
+	allChanged = true;
 	
 	// If multi-threaded, update read-only snapshots too
 	if (m_gpuMultiThreaded)
@@ -141,84 +147,86 @@ void CTileGen::EndVBlank(void)
 	//
 }
 
-void CTileGen::RecomputePalettes(void)
+UINT32 CTileGen::SyncSnapshots(CSnapshotCopier &copier)
 {
-	// Writing the colors forces palettes to be computed
-	if (m_gpuMultiThreaded)
+	// Good time to recompute the palettes
+	if (recomputePalettes)
 	{
-		for (unsigned colorAddr = 0; colorAddr < 32768*4; colorAddr += 4 )
-		{
-			MARK_DIRTY(palDirty[0], colorAddr);
-			MARK_DIRTY(palDirty[1], colorAddr);
-			WritePalette(colorAddr/4, *(UINT32 *) &vram[0x100000+colorAddr]);
-		}
+		RecomputePalettes(recomputePalettes);
+		recomputePalettes = 0;
 	}
-	else
+	if (palPendingAny)
+		ConvertPendingColors();
+
+	// Pages written this frame are what the next frame drawn must update
+	MergeChangedPages(vramChanged, sizeof(vramChangedPages[0]));
+	MergeChangedPages(palChanged, sizeof(palChangedPages[0]));
+	
+	if (!m_gpuMultiThreaded)
+		return 0;
+	
+	memcpy(regsRO, regs, sizeof(regs)); // Always copy whole of regs buffer
+
+	// If double-buffered, the buffers just written become the snapshots
+	if (m_gpuDoubleBuffered)
 	{
-		for (unsigned colorAddr = 0; colorAddr < 32768*4; colorAddr += 4 )
-			WritePalette(colorAddr/4, *(UINT32 *) &vram[0x100000+colorAddr]);
+		SwapBuffers();
+		return sizeof(regs);
 	}
+
+	// Queue read-only snapshots for update
+	copier.Queue("palA", (UINT8*)pal[0], (UINT8*)palRO[0], 0x020000, palDirty[0], PAGE_WIDTH);
+	copier.Queue("palB", (UINT8*)pal[1], (UINT8*)palRO[1], 0x020000, palDirty[1], PAGE_WIDTH);
+	copier.Queue("vram", (UINT8*)vram, (UINT8*)vramRO, 0x120000, vramDirty, PAGE_WIDTH);
+	return sizeof(regs);
 }
 
-UINT32 CTileGen::SyncSnapshots(void)
+void CTileGen::RefreshWriteBuffers(CSnapshotCopier &copier)
 {
-	// Good time to recompute the palettes
-	if (recomputePalettes)
+	if (!m_writeBuffersStale)
+		return;
+	m_writeBuffersStale = false;
+
+	// Dirty pages were written to what are now the read-only snapshots
+	copier.Queue("palA", (UINT8*)palRO[0], (UINT8*)pal[0], 0x020000, palDirty[0], PAGE_WIDTH);
+	copier.Queue("palB", (UINT8*)palRO[1], (UINT8*)pal[1], 0x020000, palDirty[1], PAGE_WIDTH);
+	copier.Queue("vram", (UINT8*)vramRO, (UINT8*)vram, 0x120000, vramDirty, PAGE_WIDTH);
+}
+
+void CTileGen::SwapBuffers(void)
+{
+	// Live buffers must be complete before they become the snapshots again
+	if (m_writeBuffersStale)
 	{
-		RecomputePalettes();
-		recomputePalettes = false;
+		CSnapshotCopier copier;
+		RefreshWriteBuffers(copier);
+		copier.Run();
+	}
+
+	std::swap(vram, vramRO);
+	std::swap(pal[0], palRO[0]);
+	std::swap(pal[1], palRO[1]);
+	m_writeBuffersStale = true;
+	if (Render2D != NULL)
+	{
+		Render2D->AttachVRAM(vramRO);
+		Render2D->AttachPalette((const UINT32 **)palRO);
 	}
-	
-	if (!m_gpuMultiThreaded)
-		return 0;
-	
-	// Update read-only snapshots
-	return UpdateSnapshots(false);
 }
 
-UINT32 CTileGen::UpdateSnapshot(bool copyWhole, UINT8 *src, UINT8 *dst, unsigned size, UINT8 *dirty)
+UINT32 CTileGen::UpdateSnapshot(bool copyWhole, UINT8 *src, UINT8 *dst, unsigned size, DirtyPageMap &dirty)
 {
-	unsigned dirtySize = DIRTY_SIZE(size);
 	if (copyWhole)
 	{
 		// If updating whole region, then just copy all data in one go
 		memcpy(dst, src, size);
-		memset(dirty, 0, dirtySize);
+		CSnapshotCopier::ClearDirty(dirty, size, PAGE_WIDTH);
 		return size;
 	}
 	else
 	{
-		// Otherwise, loop through dirty pages array to find out what needs to be updated and copy only those parts
-		UINT32 copied = 0;
-		UINT8 *pSrc = src;
-		UINT8 *pDst = dst;
-		for (unsigned i = 0; i < dirtySize; i++)
-		{
-			UINT8 d = dirty[i];
-			if (d)
-			{
-				for (unsigned j = 0; j < 8; j++)
-				{
-					if (d&1)
-					{
-						// If not at very end of region, then copy an extra 4 bytes to allow for a possible 32-bit overlap
-						UINT32 toCopy = (i < dirtySize - 1 || j < 7 ? PAGE_SIZE + 4 : PAGE_SIZE);
-						memcpy(pDst, pSrc, toCopy);
-						copied += toCopy;
-					}
-					d >>= 1;
-					pSrc += PAGE_SIZE;	
-					pDst += PAGE_SIZE;
-				}
-				dirty[i] = 0;
-			}
-			else
-			{
-				pSrc += 8 * PAGE_SIZE;	
-				pDst += 8 * PAGE_SIZE;
-			}
-		}
-		return copied;
+		// Otherwise, copy only the dirty pages
+		return CSnapshotCopier::CopyDirty(src, dst, size, dirty, PAGE_WIDTH);
 	}
 }
 
@@ -228,17 +236,31 @@ UINT32 CTileGen::UpdateSnapshots(bool copyWhole)
 	UINT32 palACopied  = UpdateSnapshot(copyWhole, (UINT8*)pal[0],  (UINT8*)palRO[0],  0x020000, palDirty[0]);
 	UINT32 palBCopied  = UpdateSnapshot(copyWhole, (UINT8*)pal[1],  (UINT8*)palRO[1],  0x020000, palDirty[1]);
 	UINT32 vramCopied = UpdateSnapshot(copyWhole, (UINT8*)vram, (UINT8*)vramRO, 0x120000, vramDirty);
+	if (copyWhole)
+		m_writeBuffersStale = false;
 	memcpy(regsRO, regs, sizeof(regs)); // Always copy whole of regs buffer
 	//printf("TileGen copied - palA:%4uK, palB:%4uK, vram:%4uK, regs:%uK\n", palACopied / 1024, palBCopied / 1024, vramCopied / 1024, sizeof(regs) / 1024);
 	return palACopied + palBCopied + vramCopied + sizeof(regs);
 }
 
+void CTileGen::MergeChangedPages(DirtyPageMap changed[2], unsigned bytes)
+{
+	if (changed[0].summary == 0)
+		return;
+	for (unsigned i = 0; i < bytes; i++)
+		changed[1].pages[i] |= changed[0].pages[i];
+	changed[1].summary |= changed[0].summary;
+	memset(changed[0].pages, 0, bytes);
+	changed[0].summary = 0;
+}
+
 void CTileGen::BeginFrame(void)
 {
-	// NOTE: Render2D->WriteVRAM(addr, data) is no longer being called for RAM addresses that are written
-	// to and instead this class relies upon the fact that Render2D currently marks everything as dirty
-	// with every frame.  If this were to change in the future then code to handle marking the correct
-	// parts of the renderer as dirty would need to be added here.
+	// Render2D redraws only what the pages changed since it last drew affect, or everything after a reset
+	if (allChanged)
+		Render2D->SetChangedPages(NULL, NULL);
+	else
+		Render2D->SetChangedPages(vramChanged[1].pages, palChanged[1].pages);
 	
 	Render2D->BeginFrame();
 }
@@ -261,6 +283,13 @@ void CTileGen::RenderFrameTop(void)
 void CTileGen::EndFrame(void)
 {
 	Render2D->EndFrame();
+
+	// Drawn now, so the frame maps start again
+	memset(vramChangedPages[1], 0, sizeof(vramChangedPages[1]));
+	memset(palChangedPages[1], 0, sizeof(palChangedPages[1]));
+	vramChanged[1].summary = 0;
+	palChanged[1].summary = 0;
+	allChanged = false;
 }
 
 /******************************************************************************
@@ -276,24 +305,47 @@ void CTileGen::WriteRAM32(unsigned addr, UINT32 data)
 {
 	if (m_gpuMultiThreaded)
 		MARK_DIRTY(vramDirty, addr);
+	MARK_DIRTY(vramChanged[0], addr);
 	*(UINT32 *) &vram[addr] = data;
 		
-	// Update palette if required
+	// Palette entries are converted during sync
 	if (addr >= 0x100000)
-    {
-		addr -= 0x100000;
-		unsigned color = addr/4;	// color index
-		
-		// Same address in both palettes must be marked dirty
+	{
+		unsigned color = (addr - 0x100000) / 4;
+		palPending[color / 32] |= 1 << (color % 32);
+		palPendingAny = true;
+	}
+}
+
+bool CTileGen::WriteRAMBlock(unsigned addr, const UINT8 *src, unsigned size, bool reverseBytes)
+{
+	if ((addr & 3) || (size & 3) || addr > 0x120000 || size > 0x120000 - addr)
+		return false;
+	if (size == 0)
+		return true;
+
+	if (reverseBytes)
+		memcpy(&vram[addr], src, size);
+	else
+		Util::CopyFlipEndian32(&vram[addr], src, size);
+
+	for (unsigned page = addr & ~(PAGE_SIZE - 1); page < addr + size; page += PAGE_SIZE)
+	{
 		if (m_gpuMultiThreaded)
-		{
-			MARK_DIRTY(palDirty[0], addr);
-			MARK_DIRTY(palDirty[1], addr);
-		}
-			
-		// Both palettes will be modified simultaneously
-        WritePalette(color, data);
-    }
+			MARK_DIRTY(vramDirty, page);
+		MARK_DIRTY(vramChanged[0], page);
+	}
+
+	// Flag the palette entries in range
+	if (addr + size > 0x100000)
+	{
+		unsigned first = (std::max(addr, 0x100000u) - 0x100000) / 4;
+		unsigned last = (addr + size - 0x100000) / 4;
+		for (unsigned color = first; color < last; color++)
+			palPending[color / 32] |= 1 << (color % 32);
+		palPendingAny = true;
+	}
+	return true;
 }
 
 //TODO: 8- and 16-bit handlers have not been thoroughly tested
@@ -396,6 +448,77 @@ void CTileGen::WritePalette(unsigned color, UINT32 data)
 
 	pal[0][color] = AddColorOffset(r, g, b, a, regs[0x40/4]);	// A/A'
 	pal[1][color] = AddColorOffset(r, g, b, a, regs[0x44/4]);	// B/B'
+	MARK_DIRTY(palChanged[0], color*4);
+}
+
+// Each color is three 5-bit components, so the offset only needs adding to the
+// 32 values of each and the colors can be looked up from those
+static void BuildColorLookup(UINT32 offsetReg, UINT32 lookup[3][32])
+{
+	for (unsigned i = 0; i < 32; i++)
+	{
+		UINT8 c = (i * 255) / 31;
+		UINT32 rgb = AddColorOffset(c, c, c, 0, offsetReg);
+		lookup[0][i] = rgb & 0x0000FF;
+		lookup[1][i] = rgb & 0x00FF00;
+		lookup[2][i] = rgb & 0xFF0000;
+	}
+}
+
+static inline UINT32 LookupColor(UINT32 data, const UINT32 lookup[3][32])
+{
+	if ((data&0x8000))
+		return lookup[0][0] | lookup[1][0] | lookup[2][0];	// transparent: black with the offset added
+	return 0xFF000000 | lookup[0][data&0x1F] | lookup[1][(data>>5)&0x1F] | lookup[2][(data>>10)&0x1F];
+}
+
+inline void CTileGen::UpdateColor(unsigned p, unsigned color, UINT32 value)
+{
+	// Only colors that came out differently need copying to the snapshot or redrawing
+	if (value == pal[p][color])
+		return;
+	pal[p][color] = value;
+	if (m_gpuMultiThreaded)
+		MARK_DIRTY(palDirty[p], color*4);
+	MARK_DIRTY(palChanged[0], color*4);
+}
+
+void CTileGen::RecomputePalettes(unsigned which)
+{
+	const UINT32 *colors = (const UINT32 *) &vram[0x100000];
+	for (int p = 0; p < 2; p++)
+	{
+		if (!(which & (1 << p)))
+			continue;
+		
+		UINT32 lookup[3][32];
+		BuildColorLookup(regs[(0x40 + p*4)/4], lookup);
+		for (unsigned color = 0; color < 32768; color++)
+			UpdateColor(p, color, LookupColor(colors[color], lookup));
+	}
+}
+
+void CTileGen::ConvertPendingColors(void)
+{
+	const UINT32 *colors = (const UINT32 *) &vram[0x100000];
+	UINT32 lookup[2][3][32];
+	BuildColorLookup(regs[0x40/4], lookup[0]);
+	BuildColorLookup(regs[0x44/4], lookup[1]);
+	for (unsigned i = 0; i < 32768/32; i++)
+	{
+		UINT32 bits = palPending[i];
+		if (bits == 0)
+			continue;
+		palPending[i] = 0;
+		for (unsigned color = i * 32; bits != 0; color++, bits >>= 1)
+		{
+			if (!(bits & 1))
+				continue;
+			UpdateColor(0, color, LookupColor(colors[color], lookup[0]));
+			UpdateColor(1, color, LookupColor(colors[color], lookup[1]));
+		}
+	}
+	palPendingAny = false;
 }
 
 UINT32 CTileGen::ReadRegister(unsigned reg)
@@ -421,11 +544,11 @@ void CTileGen::WriteRegister(unsigned reg, UINT32 data)
 		break;
 	case 0x40:	// layer A/A' color offset
 	case 0x44:	// layer B/B' color offset
-		// We only have a mechanism to recompute both palettes simultaneously.
-		// These regs are often written together in the same frame. To avoid
-		// needlessly recomputing both palettes twice, we defer the operation.
+		// These regs are often written together, and every frame during fades.
+		// To avoid needlessly recomputing a palette twice, we defer the
+		// operation, and only the palette whose offset changed is recomputed.
 		if (regs[reg/4] != data)	// only if changed
-			recomputePalettes = true;
+			recomputePalettes |= 1 << ((reg - 0x40) / 4);
 		break;
 	case 0x10:	// IRQ acknowledge
 		IRQ->Deassert(data&0xFF);
@@ -433,7 +556,7 @@ void CTileGen::WriteRegister(unsigned reg, UINT32 data)
 		//IRQ->Deassert(data & 0x0F);
 		break;
 	default:
-		DebugLog("Tile Generator reg %02X = %08X\n", reg, data);
+		DEBUG_LOG(Graphics, "Tile Generator reg %02X = %08X\n", reg, data);
 		//printf("%02X = %08X\n", reg, data);
 		break;
 	}
@@ -446,13 +569,20 @@ void CTileGen::Reset(void)
 {
 	unsigned memSize = (m_gpuMultiThreaded ? MEMORY_POOL_SIZE : MEM_POOL_SIZE_RW);
 	memset(memoryPool, 0, memSize);
+	vramDirty.summary = 0;
+	palDirty[0].summary = 0;
+	palDirty[1].summary = 0;
 	memset(regs, 0, sizeof(regs));
 	memset(regsRO, 0, sizeof(regsRO));
 	
 	InitPalette();
-	recomputePalettes = false;
+	memset(palPending, 0, sizeof(palPending));
+	palPendingAny = false;
+	recomputePalettes = 0;
+	m_writeBuffersStale = false;
+	allChanged = true;
 
-	DebugLog("Tile Generator reset\n");
+	DEBUG_LOG(Graphics, "Tile Generator reset\n");
 }
 
 
@@ -478,7 +608,7 @@ void CTileGen::AttachRenderer(CRender2D *Render2DPtr)
 		Render2D->AttachRegisters(regs);
 	}
 
-	DebugLog("Tile Generator attached a Render2D object\n");
+	DEBUG_LOG(Graphics, "Tile Generator attached a Render2D object\n");
 }
 
 
@@ -503,25 +633,39 @@ bool CTileGen::Init(CIRQ *IRQObjectPtr)
 		vramRO = (UINT8 *) &memoryPool[OFFSET_VRAM_RO];
 		palRO[0] = (UINT32 *) &memoryPool[OFFSET_PAL_RO_A];
 		palRO[1] = (UINT32 *) &memoryPool[OFFSET_PAL_RO_B];
-		vramDirty = (UINT8 *) &memoryPool[OFFSET_VRAM_DIRTY];
-		palDirty[0] = (UINT8 *) &memoryPool[OFFSET_PAL_A_DIRTY];
-		palDirty[1] = (UINT8 *) &memoryPool[OFFSET_PAL_B_DIRTY];
+		vramDirty = { &memoryPool[OFFSET_VRAM_DIRTY], 0 };
+		palDirty[0] = { &memoryPool[OFFSET_PAL_A_DIRTY], 0 };
+		palDirty[1] = { &memoryPool[OFFSET_PAL_B_DIRTY], 0 };
 	}
 
 	// Hook up the IRQ controller
 	IRQ = IRQObjectPtr;
 	
-	DebugLog("Initialized Tile Generator (allocated %1.1f MB and connected to IRQ controller)\n", memSizeMB);
+	DEBUG_LOG(Graphics, "Initialized Tile Generator (allocated %1.1f MB and connected to IRQ controller)\n", memSizeMB);
 	return OKAY;
 }
 
 CTileGen::CTileGen(const Util::Config::Node &config)
   : m_config(config),
-    m_gpuMultiThreaded(config["GPUMultiThreaded"].ValueAs<bool>())
+    m_gpuMultiThreaded(config["GPUMultiThreaded"].ValueAs<bool>()),
+    m_gpuDoubleBuffered(m_gpuMultiThreaded && config["GPUDoubleBuffered"].ValueAsDefault<bool>(false))
 {
 	IRQ = NULL;
+	Render2D = NULL;
 	memoryPool = NULL;
-	DebugLog("Built Tile Generator\n");
+	m_writeBuffersStale = false;
+	memset(vramChangedPages, 0, sizeof(vramChangedPages));
+	memset(palChangedPages, 0, sizeof(palChangedPages));
+	for (int i = 0; i < 2; i++)
+	{
+		vramChanged[i] = { vramChangedPages[i], 0 };
+		palChanged[i] = { palChangedPages[i], 0 };
+	}
+	allChanged = true;
+	memset(palPending, 0, sizeof(palPending));
+	palPendingAny = false;
+	recomputePalettes = 0;
+	DEBUG_LOG(Graphics, "Built Tile Generator\n");
 }
 
 CTileGen::~CTileGen(void)
@@ -546,5 +690,5 @@ CTileGen::~CTileGen(void)
 		delete [] memoryPool;
 		memoryPool = NULL;
 	}
-	DebugLog("Destroyed Tile Generator\n");
+	DEBUG_LOG(Graphics, "Destroyed Tile Generator\n");
 }
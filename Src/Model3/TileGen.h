@@ -48,6 +48,17 @@ public:
 	 */
 	void SaveState(CBlockFile *SaveState);
 
+	/*
+	 * SaveFrameState(SaveState):
+	 *
+	 * Saves the state the current frame is rendered from (the read-only
+	 * snapshots if multi-threaded), in the same block as SaveState().
+	 *
+	 * Parameters:
+	 *		SaveState	Block file to save state information to.
+	 */
+	void SaveFrameState(CBlockFile *SaveState);
+
 	/*
 	 * LoadState(SaveState):
 	 *
@@ -73,15 +84,36 @@ public:
 	void EndVBlank(void);
 
 	/*
-	 * SyncSnapshots(void):
+	 * SyncSnapshots(copier):
 	 *
 	 * Syncs the read-only memory snapshots with the real ones so that rendering
 	 * of the current frame can begin in the render thread.  Must be called at the
 	 * end of each frame when both the render thread and the PPC thread have finished
 	 * their work.  If multi-threaded rendering is not enabled, then this method does
 	 * nothing.
+	 *
+	 * Parameters:
+	 *		copier	Snapshot copier on which to queue the dirty memory regions.  The
+	 *				caller must Run() it before rendering begins.
+	 *
+	 * Returns:
+	 *		Number of bytes copied directly (not including queued regions).
+	 */
+	UINT32 SyncSnapshots(CSnapshotCopier &copier);
+
+	/*
+	 * RefreshWriteBuffers(copier):
+	 *
+	 * When double-buffered (GPUDoubleBuffered), SyncSnapshots() swaps the live
+	 * and read-only buffers instead of copying between them, which leaves the
+	 * new live buffers behind by the pages written during the previous frame.
+	 * This queues those pages on the copier.  The caller must Run() it before
+	 * the PPC next accesses VRAM.  Does nothing if not double-buffered.
+	 *
+	 * Parameters:
+	 *		copier	Snapshot copier on which to queue the stale pages.
 	 */
-	UINT32 SyncSnapshots(void);
+	void RefreshWriteBuffers(CSnapshotCopier &copier);
 
 	/*
 	 * BeginFrame(void):
@@ -176,6 +208,25 @@ public:
 	void WriteRAM16(unsigned addr, uint16_t data);
 	void WriteRAM32(unsigned addr, uint32_t data);
 	
+	/*
+	 * WriteRAMBlock(addr, src, size, reverseBytes):
+	 *
+	 * Writes a block of words to RAM in one go, for bus to bus copies and DMA.
+	 * The result is the same as WriteRAM32() of each word byte reversed (as
+	 * the PowerPC's stores are), or of each word as is if reverseBytes is set.
+	 *
+	 * Parameters:
+	 *		addr			Word aligned address in tile generator RAM.
+	 *		src				Source data.
+	 *		size			Number of bytes, a multiple of 4.
+	 *		reverseBytes	True to copy the bytes as they are.
+	 *
+	 * Returns:
+	 *		True if the block was written, false if it lies outside of RAM or
+	 *		is misaligned, in which case nothing is written.
+	 */
+	bool WriteRAMBlock(unsigned addr, const UINT8 *src, unsigned size, bool reverseBytes);
+	
 	/*
 	 * ReadRegister(reg):
 	 *
@@ -252,14 +303,20 @@ public:
 	
 private:
 	// Private member functions
-	void		RecomputePalettes(void);
+	void		RecomputePalettes(unsigned which);	// bit 0: A/A', bit 1: B/B'
 	void		InitPalette(void);
 	void		WritePalette(unsigned color, UINT32 data);
+	void		UpdateColor(unsigned p, unsigned color, UINT32 value);
+	void		ConvertPendingColors(void);
 	UINT32		UpdateSnapshots(bool copyWhole);
-	UINT32		UpdateSnapshot(bool copyWhole, UINT8 *src, UINT8 *dst, unsigned size, UINT8 *dirty);
+	void		SwapBuffers(void);
+	UINT32		UpdateSnapshot(bool copyWhole, UINT8 *src, UINT8 *dst, unsigned size, DirtyPageMap &dirty);
+	void		MergeChangedPages(DirtyPageMap changed[2], unsigned bytes);
 
   const Util::Config::Node &m_config;
   const bool m_gpuMultiThreaded;
+  const bool m_gpuDoubleBuffered;
+  bool m_writeBuffersStale;  // live buffers were swapped and not yet refreshed
 
 	CIRQ		*IRQ;		// IRQ controller the tile generator is attached to
 	CRender2D	*Render2D;	// 2D renderer the tile generator is attached to
@@ -272,15 +329,29 @@ private:
 	UINT8	*memoryPool;		// all memory allocated here
 	UINT8   *vram;          	// 1.125MB of VRAM
 	UINT32	*pal[2];			// 2 x 0x20000 byte (32K colors) palette
-	bool	recomputePalettes;	// whether to recompute palettes A/A' and B/B' during sync
+	unsigned	recomputePalettes;	// palettes to recompute during sync (bit 0: A/A', bit 1: B/B')
+	UINT32	palPending[32768/32];	// colors written since the last sync, a bit for each
+	bool	palPendingAny;
 
 	// Read-only snapshots
 	UINT8   *vramRO;        // 1.125MB of VRAM                       [read-only snapshot]	
 	UINT32  *palRO[2];      // 2 x 0x20000 byte (32K colors) palette [read-only snapshot]
 	
 	// Arrays to keep track of dirty pages in memory regions
-	UINT8   *vramDirty;
-	UINT8   *palDirty[2];	// one for each palette
+	DirtyPageMap vramDirty;
+	DirtyPageMap palDirty[2];	// one for each palette
+
+	/*
+	 * Pages of VRAM and of the computed palettes changed since the renderer
+	 * last drew a frame, so it need only redraw the lines they affect. Writes
+	 * mark the pending maps [0], which are merged into the frame maps [1] at
+	 * each sync and cleared once a frame has been drawn from them.
+	 */
+	DirtyPageMap vramChanged[2];
+	DirtyPageMap palChanged[2];
+	UINT8	vramChangedPages[2][0x120000 >> (10 + 3)];	// a bit for each 1 KB page
+	UINT8	palChangedPages[2][0x20000 >> (10 + 3)];	// both palettes change together
+	bool	allChanged;		// after a reset, everything must be redrawn
 
 	// Registers
 	UINT32	regs[64];
@@ -96,8 +96,10 @@
 
 #include "Supermodel.h"
 #include "NetBoard.h"
+#include "NetDelta.h"
 #include "Util/Format.h"
 #include "Util/ByteSwap.h"
+#include "Util/Trace.h"
 #include <algorithm>
 
 // few macros to make debugging a bit less painful
@@ -105,7 +107,7 @@
 
 #if defined(NET_DEBUG)
 	#include <stdio.h>
-	#define DPRINTF DebugLog
+	#define DPRINTF(...) DEBUG_LOG(Net, __VA_ARGS__)
 #else
 	#define DPRINTF(a, ...)
 #endif
@@ -168,7 +170,7 @@ UINT8 CNetBoard::Read8(UINT32 a)
 		//DebugLog("Netboard R8\tRAM[%x]=%x\n", a,RAM[a]);
 		if (a > 0x0ffff)
 		{
-			DebugLog("OUT OF RANGE RAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE RAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		return RAM[a ^ 1];
@@ -177,18 +179,18 @@ UINT8 CNetBoard::Read8(UINT32 a)
 		//DebugLog("Netboard R8\tctrlrw[%x]=%x\n", a&0xff, ctrlrw[a&0xff]);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ctrlrw[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ctrlrw[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		switch (a & 0xff)
 		{
 		case 0x0:
-			DebugLog("Netboard R8\tctrlrw[%x]=%x\tcommbank = %x\n", a & 0xff, ctrlrw[a & 0xff], commbank);
+			DEBUG_LOG(Net, "Netboard R8\tctrlrw[%x]=%x\tcommbank = %x\n", a & 0xff, ctrlrw[a & 0xff], commbank);
 			return ctrlrw[a&0xff];//commbank;
 			break;
 
 		default:
-			DebugLog("unknown 400(%x)\n", a & 0xff);
+			DEBUG_LOG(Net, "unknown 400(%x)\n", a & 0xff);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown R8 CTRLRW", NULL);
 			return ctrlrw[a&0xff];
 			break;
@@ -200,7 +202,7 @@ UINT8 CNetBoard::Read8(UINT32 a)
 		//if(((a&0xffff) > 0 && (a&0xffff) < 0xff) || ((a&0xffff) > 0xefff && (a&0xffff) < 0xffff)) DebugLog("Netboard R8\tCommRAM[%x]=%x\n", a & 0xffff, CommRAM[a & 0xffff]);
 		if ((a & 0x3ffff) > 0xffff)
 		{
-			DebugLog("OUT OF RANGE CommRAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE CommRAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		return CommRAM[(a & 0xffff) ^ 1];
@@ -209,46 +211,46 @@ UINT8 CNetBoard::Read8(UINT32 a)
 		//DebugLog("Netboard R8\tioreg[%x]=%x\t\t", a&0xff, ioreg[a&0xff]);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ioreg[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ioreg[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 
 		switch (a & 0xff)
 		{
 		case 0x11: // ioreg[c0011]
-			DebugLog("Netboard R8\tioreg[%x]=%x\t\treceive result status\n", a & 0xff, ioreg[a & 0xff]);
+			DEBUG_LOG(Net, "Netboard R8\tioreg[%x]=%x\t\treceive result status\n", a & 0xff, ioreg[a & 0xff]);
 			//return 0x5; /////////////////////////////////// pure hack for spikofe - must have the pure hack spikeout enable too ///////////////////////////////////////////////////////
 			if (Gameinfo.name.compare("spikeofe") == 0) return 0x5;
 			return ioreg[(a&0xff) ^ 1];
 			break;
 
 		case 0x19: // ioreg[c0019]
-			DebugLog("Netboard R8\tioreg[%x]=%x\t\ttransmit result status\n", a & 0xff, ioreg[a & 0xff]);
+			DEBUG_LOG(Net, "Netboard R8\tioreg[%x]=%x\t\ttransmit result status\n", a & 0xff, ioreg[a & 0xff]);
 			return ioreg[(a&0xff) ^ 1];
 			break;
 
 		case 0x81: // ioreg[c0081]
-			DebugLog("Netboard R8\tioreg[%x]=%x\t\n", a & 0xff, ioreg[a & 0xff]);
+			DEBUG_LOG(Net, "Netboard R8\tioreg[%x]=%x\t\n", a & 0xff, ioreg[a & 0xff]);
 			return ioreg[(a&0xff) ^ 1];
 			break;
 
 		case 0x83: // ioreg[c0083]
-			DebugLog("Netboard R8\tioreg[%x]=%x\t\tirq status\n", a & 0xff, ioreg[a & 0xff]);
+			DEBUG_LOG(Net, "Netboard R8\tioreg[%x]=%x\t\tirq status\n", a & 0xff, ioreg[a & 0xff]);
 			return ioreg[(a&0xff) ^ 1];
 			break;
 
 		case 0x89: // ioreg[c0089]
-			DebugLog("Netboard R8\tioreg[%x]=%x\t\n", a & 0xff, ioreg[a & 0xff]);
+			DEBUG_LOG(Net, "Netboard R8\tioreg[%x]=%x\t\n", a & 0xff, ioreg[a & 0xff]);
 			return ioreg[(a&0xff) ^ 1];
 			break;
 
 		case 0x8a: // ioreg[c008a]
-			DebugLog("Netboard R8\tioreg[%x]=%x\t\n", a & 0xff, ioreg[a & 0xff]);
+			DEBUG_LOG(Net, "Netboard R8\tioreg[%x]=%x\t\n", a & 0xff, ioreg[a & 0xff]);
 			return ioreg[(a&0xff) ^ 1];
 			break;
 
 		default:
-			DebugLog("unknown c00(%x)\n", a & 0xff);
+			DEBUG_LOG(Net, "unknown c00(%x)\n", a & 0xff);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown R8 IOREG", NULL);
 			return ioreg[(a&0xff) ^ 1];
 			break;
@@ -257,7 +259,7 @@ UINT8 CNetBoard::Read8(UINT32 a)
 
 
 	default:
-		DebugLog("NetBoard 68K: Unknown R8 (%02X) addr=%x\n", (a >> 16) & 0xF,a&0x0fffff);
+		DEBUG_LOG(Net, "NetBoard 68K: Unknown R8 (%02X) addr=%x\n", (a >> 16) & 0xF,a&0x0fffff);
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown R8", NULL);
 		break;
 	}
@@ -274,7 +276,7 @@ UINT16 CNetBoard::Read16(UINT32 a)
 		//DebugLog("Netboard Read16 (0x0) \tRAM[%x]=%x\n",a, *(UINT16 *)&RAM[a]);
 		if (a > 0x0ffff)
 		{
-			DebugLog("OUT OF RANGE RAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE RAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		result = *(UINT16 *)&RAM[a];
@@ -284,7 +286,7 @@ UINT16 CNetBoard::Read16(UINT32 a)
 		//DebugLog("Netboard R16\tctrlrw[%x] = %x\t", a&0xff, *(UINT16 *)&ctrlrw[a&0xff]);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ctrlrw[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ctrlrw[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 
@@ -298,7 +300,7 @@ UINT16 CNetBoard::Read16(UINT32 a)
 
 		default:
 			result = *(UINT16 *)&ctrlrw[a & 0xff];
-			DebugLog("unknown 400(%x)\n", a & 0xff);
+			DEBUG_LOG(Net, "unknown 400(%x)\n", a & 0xff);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown R16 CTRLRW", NULL);
 			return result;
 			break;
@@ -309,7 +311,7 @@ UINT16 CNetBoard::Read16(UINT32 a)
 		//if (((a & 0xffff) > 0 && (a & 0xffff) < 0xff) || ((a & 0xffff) > 0xefff && (a & 0xffff) < 0xffff)) DebugLog("Netboard R16\tCommRAM[%x] = %x\n", a & 0xffff, *(UINT16 *)&CommRAM[a & 0xffff]);
 		if ((a & 0x3ffff) > 0xffff)
 		{
-			DebugLog("OUT OF RANGE CommRAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE CommRAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		result = *(UINT16 *)&CommRAM[a & 0xffff];
@@ -319,7 +321,7 @@ UINT16 CNetBoard::Read16(UINT32 a)
 		//DebugLog("Netboard Read16 (0xc) \tioreg[%x] = %x\t", a&0xff, *(UINT16 *)&ioreg[a&0xff]);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ioreg[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ioreg[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 
@@ -327,23 +329,23 @@ UINT16 CNetBoard::Read16(UINT32 a)
 		{
 		case 0x88: // ioreg[c0088]
 			result = *(UINT16 *)&ioreg[a & 0xff];
-			DebugLog("Netboard R16\tioreg[%x] = %x\n", a & 0xff, *(UINT16 *)&ioreg[a & 0xff]);
+			DEBUG_LOG(Net, "Netboard R16\tioreg[%x] = %x\n", a & 0xff, *(UINT16 *)&ioreg[a & 0xff]);
 			return result;
 
 		case 0x8a: // ioreg[c008a]
 			result = *(UINT16 *)&ioreg[a & 0xff];
-			DebugLog("Netboard R16\tioreg[%x] = %x\n", a & 0xff, *(UINT16 *)&ioreg[a & 0xff]);
+			DEBUG_LOG(Net, "Netboard R16\tioreg[%x] = %x\n", a & 0xff, *(UINT16 *)&ioreg[a & 0xff]);
 			return result;
 
 		default:
 			result = *(UINT16 *)&ioreg[a & 0xff];
-			DebugLog("unknown c00(%x)\n", a & 0xff);
+			DEBUG_LOG(Net, "unknown c00(%x)\n", a & 0xff);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown R16 IOREG", NULL);
 			return result;
 		}
 
 	default:
-		DebugLog("NetBoard 68K: Unknown R16 %02X addr=%x\n", (a >> 16) & 0xF,a&0x0fffff);
+		DEBUG_LOG(Net, "NetBoard 68K: Unknown R16 %02X addr=%x\n", (a >> 16) & 0xF,a&0x0fffff);
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown R16", NULL);
 		break;
 	}
@@ -362,7 +364,7 @@ UINT32 CNetBoard::Read32(UINT32 a)
 		lo = *(UINT16 *)&RAM[a + 2];
 		if (a > 0x0ffff)
 		{
-			DebugLog("OUT OF RANGE RAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE RAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		//DebugLog("Netboard R32\tRAM[%x]=%x\n", a,(hi << 16) | lo);
@@ -374,10 +376,10 @@ UINT32 CNetBoard::Read32(UINT32 a)
 		lo = *(UINT16 *)&ctrlrw[a + 2];
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ctrlrw[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ctrlrw[%x]\n", a);
 			MessageBox(NULL, "Out of Range", NULL, MB_OK);
 		}
-		DebugLog("Netboard R32\tctrlrw[%x]=%x\n", a, (hi << 16) | lo);
+		DEBUG_LOG(Net, "Netboard R32\tctrlrw[%x]=%x\n", a, (hi << 16) | lo);
 		result = (hi << 16) | lo;
 		return result;*/
 
@@ -386,7 +388,7 @@ UINT32 CNetBoard::Read32(UINT32 a)
 		lo = *(UINT16 *)&CommRAM[(a & 0xffff) + 2];
 		if ((a & 0x3ffff) > 0xffff)
 		{
-			DebugLog("OUT OF RANGE CommRAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE CommRAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		//if (((a & 0xffff) > 0 && (a & 0xffff) < 0xff) || ((a & 0xffff) > 0xefff && (a & 0xffff) < 0xffff)) DebugLog("Netboard R32\tCommRAM[%x] = %x\n", a & 0xffff, (hi << 16) | lo);
@@ -398,15 +400,15 @@ UINT32 CNetBoard::Read32(UINT32 a)
 		lo = *(UINT16 *)&ioreg[a + 2];
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ioreg[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ioreg[%x]\n", a);
 			MessageBox(NULL, "Out of Range", NULL, MB_OK);
 		}
-		DebugLog("Netboard R32\tioreg[%x]=%x\n", a, (hi << 16) | lo);
+		DEBUG_LOG(Net, "Netboard R32\tioreg[%x]=%x\n", a, (hi << 16) | lo);
 		result = (hi << 16) | lo;
 		return result;*/
 
 	default:
-		DebugLog("NetBoard 68K: Unknown R32 (%02X) a=%x\n", (a >> 16) & 0xF, a & 0xffff);
+		DEBUG_LOG(Net, "NetBoard 68K: Unknown R32 (%02X) a=%x\n", (a >> 16) & 0xF, a & 0xffff);
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown R32", NULL);
 		break;
 	}
@@ -422,7 +424,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		//DebugLog("Netboard Write8 (0x0) \tRAM[%x] <- %x\n", a, d);
 		if (a > 0x0ffff)
 		{
-			DebugLog("OUT OF RANGE RAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE RAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		RAM[a ^ 1] = d;
@@ -432,7 +434,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		//DebugLog("Netboard W8\tctrlrw[%x] <- %x\t", a&0xff, d);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ctrlrw[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ctrlrw[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 
@@ -440,7 +442,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		{
 		case 0x40:
 			ctrlrw[a & 0xff] = d;
-			DebugLog("Netboard W8\tctrlrw[%x] <- %x\tIRQ 5 ack\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tctrlrw[%x] <- %x\tIRQ 5 ack\n", a & 0xff, d);
 			NetIRQAck(5);
 			//NetIRQAck(0);
 			M68KSetIRQ(4); // dirtdvls needs ????????????????????????????????????????????????????????????????????????????????????????????????????
@@ -450,7 +452,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		case 0xa0:
 			ctrlrw[a & 0xff] = d;
 			ioreg[0] = ioreg[0] | 0x01; // Do I force this myself or is it automatic, need investigation, bad init way actually ?
-			DebugLog("Netboard W8\tctrlrw[%x] <- %x\tIRQ 2 ack\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tctrlrw[%x] <- %x\tIRQ 2 ack\n", a & 0xff, d);
 			NetIRQAck(2);
 			//NetIRQAck(0);
 			//M68KRun(10000);
@@ -462,7 +464,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 			break;
 
 		default:
-			DebugLog("unknown 400(%x)\n", a & 0xff);
+			DEBUG_LOG(Net, "unknown 400(%x)\n", a & 0xff);
 			ctrlrw[a & 0xff] = d;
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown W8 CTRLRW", NULL);
 			break;
@@ -475,7 +477,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		//if (((a & 0xffff) > 0 && (a & 0xffff) < 0xff) || ((a & 0xffff) > 0xefff && (a & 0xffff) < 0xffff)) DebugLog("Netboard W8\tCommRAM[%x] <- %x\n", a & 0xffff, d);
 		if ((a & 0x3ffff) > 0xffff)
 		{
-			DebugLog("OUT OF RANGE CommRAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE CommRAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		CommRAM[(a & 0xffff) ^ 1] = d;
@@ -485,7 +487,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		//DebugLog("Netboard Write8 (0xc) \tioreg[%x] <- %x\t", a&0xff, d);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ioreg[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ioreg[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 
@@ -494,40 +496,40 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		case 0x01: // ioreg[c0001]
 			ioreg[(a & 0xff) ^ 1] = d;
 			#ifdef NET_DEBUG
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			#endif
 			break;
 
 		case 0x03: // ioreg[c0003]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x05: // ioreg[c0005]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		/*case 0x15: // 0x00 0x01 0x80 // ioreg[c0015]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\t\t", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\t\t", a & 0xff, d);
 
 			if ((d & 0xFF) != 0x80)
 			{
 				if ((d & 0xFF) == 0x01)
 				{
-					DebugLog("Irq 6 ack\n");
+					DEBUG_LOG(Net, "Irq 6 ack\n");
 					NetIRQAck(6);
 					//NetIRQAck(0);
 				}
 				else
 				{
-					DebugLog("\n");
+					DEBUG_LOG(Net, "\n");
 				}
 			}
 			else
 			{
-				DebugLog("data receive enable ???\n");
+				DEBUG_LOG(Net, "data receive enable ???\n");
 				//M68KSetIRQ(6); // irq6 ici reset dirt a la fin de la synchro
 				//M68KRun(10000);
 			}
@@ -536,11 +538,11 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		case 0x17: // 0x00 0x8c // ioreg[c0017]
 			ioreg[(a & 0xff) ^ 1] = d;
 			//M68KSetIRQ(6); // si irq6 ici, reset master a la fin de la synchro
-			DebugLog("Netboard W8\tioreg[%x] <- %x\t\t", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\t\t", a & 0xff, d);
 			if ((d & 0xFF) == 0x8C)
 			{
-				DebugLog("receive enable off=%x size=%x\n", recv_offset, recv_size);
-				DebugLog("receiving : ");
+				DEBUG_LOG(Net, "receive enable off=%x size=%x\n", recv_offset, recv_size);
+				DEBUG_LOG(Net, "receiving : ");
 
 				recv_size = recv_size & 0x7fff;
 
@@ -551,24 +553,24 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 				{
 					for (int i = 0; i < 100; i++)
 					{
-						DebugLog("%x ", CommRAM[recv_offset + i]);
+						DEBUG_LOG(Net, "%x ", CommRAM[recv_offset + i]);
 					}
 				}
 				else
 				{
 					for (int i = 0; i < recv_size; i++)
 					{
-						DebugLog("%x ", CommRAM[recv_offset + i]);
+						DEBUG_LOG(Net, "%x ", CommRAM[recv_offset + i]);
 					}
 				}
-				DebugLog("\n");
+				DEBUG_LOG(Net, "\n");
 
 				M68KSetIRQ(6); // no carrier error if removed
 				//M68KRun(10000); // obligatoire, warning 500 cycles not enough // pas obligatoire si 3*call dans le netrunframe ???
 			}
 			else
 			{
-				DebugLog("??? receive disable\n");
+				DEBUG_LOG(Net, "??? receive disable\n");
 				//M68KSetIRQ(6);
 
 			}
@@ -582,68 +584,68 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 
 		case 0x15: // 0x00 0x01 0x80 // ioreg[c0015]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\t\t", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\t\t", a & 0xff, d);
 
 			switch (d & 0xff)
 			{
 			case 0x80:
-				DebugLog("receive enable off=%x size=%x\n", recv_offset, recv_size);
+				DEBUG_LOG(Net, "receive enable off=%x size=%x\n", recv_offset, recv_size);
 				{
 					auto &recv_data = netr->Receive();
 					memcpy(CommRAM + recv_offset, recv_data.data(), recv_data.size());
 				}
 
 				#ifdef NET_DEBUG
-				DebugLog("receiving : ");
+				DEBUG_LOG(Net, "receiving : ");
 				if (recv_size > 50) // too long to print so...
 				{
 					for (int i = 0; i < 100; i++)
 					{
-						DebugLog("%x ", CommRAM[recv_offset + i]);
+						DEBUG_LOG(Net, "%x ", CommRAM[recv_offset + i]);
 					}
 				}
 				else
 				{
 					for (int i = 0; i < recv_size; i++)
 					{
-						DebugLog("%x ", CommRAM[recv_offset + i]);
+						DEBUG_LOG(Net, "%x ", CommRAM[recv_offset + i]);
 					}
 				}
-				DebugLog("\n");
+				DEBUG_LOG(Net, "\n");
 				#endif
 				break;
 
 			case 0x00:
-				DebugLog("??? receive disable\n");
+				DEBUG_LOG(Net, "??? receive disable\n");
 				break;
 
 			case 0x01:
-				DebugLog("Irq 6 ack\n");
+				DEBUG_LOG(Net, "Irq 6 ack\n");
 				NetIRQAck(6);
 				break;
 
 			default:
-				DebugLog("15 : other value %x\n", d & 0xff);
+				DEBUG_LOG(Net, "15 : other value %x\n", d & 0xff);
 				break;
 			}
 			break;
 
 		case 0x17: // 0x00 0x8c // ioreg[c0017]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\t\t", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\t\t", a & 0xff, d);
 
 			switch (d & 0xff)
 			{
 			case 0x8c:
-				DebugLog("data receive enable\n");
+				DEBUG_LOG(Net, "data receive enable\n");
 				M68KSetIRQ(6);
 				M68KRun(6000); // 6000 enough
 				break;
 			case 0x00:
-				DebugLog("??? data receive disable\n");
+				DEBUG_LOG(Net, "??? data receive disable\n");
 				break;
 			default:
-				DebugLog("17 : other value %x\n",d & 0xff);
+				DEBUG_LOG(Net, "17 : other value %x\n",d & 0xff);
 				break;
 
 			}
@@ -652,7 +654,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 
 		case 0x19: // ioreg[c0019]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\t\ttransmit result status\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\t\ttransmit result status\n", a & 0xff, d);
 			break;
 
 			// 1b 1d = send part
@@ -660,47 +662,47 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 
 		case 0x1b: // 0x80 // ioreg[c001b]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\t\t\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\t\t\n", a & 0xff, d);
 
 			switch (d & 0xff)
 			{
 			case 0x80:
 				nets->Send((const char*)CommRAM + send_offset, send_size);
-				DebugLog("send enable off=%x size=%x\n", send_offset, send_size);
+				DEBUG_LOG(Net, "send enable off=%x size=%x\n", send_offset, send_size);
 				
 				#ifdef NET_DEBUG
-				DebugLog("transmitting : ");
+				DEBUG_LOG(Net, "transmitting : ");
 				if (send_size > 50) //too big for print, so...
 				{
 					for (int i = 0; i < 100; i++)
 					{
-						DebugLog("%x ", CommRAM[send_offset + i]);
+						DEBUG_LOG(Net, "%x ", CommRAM[send_offset + i]);
 					}
 				}
 				else
 				{
 					for (int i = 0; i < send_size; i++)
 					{
-						DebugLog("%x ", CommRAM[send_offset + i]);
+						DEBUG_LOG(Net, "%x ", CommRAM[send_offset + i]);
 					}
 				}
-				DebugLog("\n");
+				DEBUG_LOG(Net, "\n");
 				#endif
 				break;
 
 			case 0x00:
-				DebugLog("??? transmit disable\n");
+				DEBUG_LOG(Net, "??? transmit disable\n");
 				break;
 
 			default:
-				DebugLog("1b : other value %x\n", d & 0xff);
+				DEBUG_LOG(Net, "1b : other value %x\n", d & 0xff);
 				break;
 			}
 			break;
 
 		case 0x1d: // 0x8c // ioreg[c001d]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 
 			switch (d & 0xff)
 			{
@@ -713,7 +715,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 				break;
 
 			default:
-				DebugLog("1d : other value %x\n", d & 0xff);
+				DEBUG_LOG(Net, "1d : other value %x\n", d & 0xff);
 				break;
 			}
 			break;
@@ -721,12 +723,12 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 
 		case 0x29: // ioreg[c0029]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x2f: // 0x00 or 0x00->0x40->0x00 or 0x82// ioreg[c002f]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 
 			/*if ((d & 0xff) == 0x00)
 			{
@@ -736,11 +738,11 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 
 			if ((d & 0xff) == 0x40)
 			{
-				DebugLog("********************************* trigger something ????\n");
+				DEBUG_LOG(Net, "********************************* trigger something ????\n");
 			}
 			if ((d & 0xff) == 0x82)
 			{
-				DebugLog("********************************* trigger something number 2 ????\n");
+				DEBUG_LOG(Net, "********************************* trigger something number 2 ????\n");
 			}
 
 			break;
@@ -750,108 +752,108 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 			recv_offset = (recv_offset >> 8) | (d << 8 );
 
 			//DebugLog("recv off = %x\n",recv_offset);
-			DebugLog("recv off = %x\n", d);
+			DEBUG_LOG(Net, "recv off = %x\n", d);
 			break;
 
 		case 0x43: // ioreg[c0043]
 			ioreg[(a & 0xff) ^ 1] = d;
 			recv_size = (recv_size >> 8) | (d << 8);
-			DebugLog("recv size = %x\n", d);
+			DEBUG_LOG(Net, "recv size = %x\n", d);
 			break;
 
 		case 0x45: // ioreg[c0045]
 			ioreg[(a & 0xff) ^ 1] = d;
 			send_offset = (send_offset >> 8) | (d << 8);
 			//DebugLog("send off = %x\n", send_offset);
-			DebugLog("send off = %x\n", d);
+			DEBUG_LOG(Net, "send off = %x\n", d);
 			break;
 
 		case 0x47: // ioreg[c0047]
 			ioreg[(a & 0xff) ^ 1] = d;
 			send_size = (send_size >> 8) | (d << 8);
 			//DebugLog("send size = %x\n", send_size);
-			DebugLog("send size = %x\n", d);
+			DEBUG_LOG(Net, "send size = %x\n", d);
 			break;
 
 		case 0x51: //0x04 0x18 // ioreg[c0051]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x55: // ioreg[c0055]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x57: // 0x04->0x09 // ioreg[c0057]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x59: // ioreg[c0059]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x5b: // ioreg[c005b]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x5d: // ioreg[c005d]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x5f: // ioreg[c005f]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x81: // ioreg[c0081]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x83: // 0x35 once and after 0x00 always // ioreg[c0083] // just apres le ioreg[83]=0 on a ppc R32 ioreg[114] et R32 ioreg[110] et apres ack irq5
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x85: // ioreg[c0085]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x87: // ioreg[c0087]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x88: // ioreg[c0088]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x89: // ioreg[c0089] // dayto2pe loops with values 00 01 02 during type 2 trame
 			ioreg[(a & 0xff) ^ 1] = d;
 			//CommRAM[4] = d; /////////////////////////////////// pure hack for spikeout /////////////////////////////////////////////////////////////////////////////////////////////
 			if (Gameinfo.name.compare("spikeout") == 0 || Gameinfo.name.compare("spikeofe") == 0) CommRAM[4] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x8a: // ioreg[c008a]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		case 0x8b: // ioreg[c008b]
 			ioreg[(a & 0xff) ^ 1] = d;
-			DebugLog("Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W8\tioreg[%x] <- %x\n", a & 0xff, d);
 			break;
 
 		default:
-			DebugLog("unknown c00(%x)\n", a & 0xff);
+			DEBUG_LOG(Net, "unknown c00(%x)\n", a & 0xff);
 			ioreg[(a & 0xff) ^ 1] = d;
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown W8 IOREG", NULL);
 			break;
@@ -862,7 +864,7 @@ void CNetBoard::Write8(UINT32 a, UINT8 d)
 		break;
 
 	default:
-		DebugLog("NetBoard 68K: Unknown W8 (%x) %06X<-%02X\n", (a >> 16) & 0xF, a, d);
+		DEBUG_LOG(Net, "NetBoard 68K: Unknown W8 (%x) %06X<-%02X\n", (a >> 16) & 0xF, a, d);
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown W8", NULL);
 		break;
 	}
@@ -876,7 +878,7 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 		//DebugLog("Netboard Write16 (0x0) \tRAM[%x] <- %x\n", a, d);
 		if (a > 0x0ffff)
 		{
-			DebugLog("OUT OF RANGE RAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE RAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		*(UINT16 *)&RAM[a] = d;
@@ -886,7 +888,7 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 		//DebugLog("Netboard W16\tctrlrw[%x] <- %x\t", a&0xff, d);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ctrlrw[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ctrlrw[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 
@@ -895,7 +897,7 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 		case 0x00:
 			*(UINT16 *)&ctrlrw[a & 0xff] = d;
 			commbank = d;
-			DebugLog("Netboard W16\tctrlrw[%x] <- %x\t\tCommBank <- %x\n", a & 0xff, d,commbank & 1);
+			DEBUG_LOG(Net, "Netboard W16\tctrlrw[%x] <- %x\t\tCommBank <- %x\n", a & 0xff, d,commbank & 1);
 
 			// sans swap ca avance, avec ca bloque pour scud
 			//CommRAM = Buffer + ((commbank & 1) ? 0x10000 : 0); //swap
@@ -914,7 +916,7 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 			break;
 		case 0x40:
 			*(UINT16 *)&ctrlrw[a & 0xff] = d;
-			DebugLog("Netboard W16\tctrlrw[%x] <- %x\t\tIRQ 5 ack\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W16\tctrlrw[%x] <- %x\t\tIRQ 5 ack\n", a & 0xff, d);
 
 			NetIRQAck(5);
 			M68KSetIRQ(4);  // ???????????????????????????????????????????????????????????????????????????????????????????????????????????????????
@@ -923,7 +925,7 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 		case 0xa0:
 			*(UINT16 *)&ctrlrw[a & 0xff] = d;
 			*(UINT8 *)&ioreg[0] = *(UINT8 *)&ioreg[0] | 0x01; // Do I force this myself or is it automatic, need investigation, bad init way actually ?
-			DebugLog("Netboard W16\tctrlrw[%x] <-%x\t\tIRQ 2 ack\n", a & 0xff, d);
+			DEBUG_LOG(Net, "Netboard W16\tctrlrw[%x] <-%x\t\tIRQ 2 ack\n", a & 0xff, d);
 
 			NetIRQAck(2);
 			//NetIRQAck(0);
@@ -934,15 +936,15 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 			break;
 		case 0xc0:
 			*(UINT16 *)&ctrlrw[a & 0xff] = d;
-			DebugLog("Netboard W16\tctrlrw[%x] <-%x\tNode ID <- %x\n", a & 0xff, d, d);
+			DEBUG_LOG(Net, "Netboard W16\tctrlrw[%x] <-%x\tNode ID <- %x\n", a & 0xff, d, d);
 			break;
 		case 0xe0:
 			*(UINT16 *)&ctrlrw[a & 0xff] = d;
-			DebugLog("Netboard W16\tctrlrw[%x] <-%x\t\treceive complete <- %x\n", a & 0xff, d, d);
+			DEBUG_LOG(Net, "Netboard W16\tctrlrw[%x] <-%x\t\treceive complete <- %x\n", a & 0xff, d, d);
 			break;
 		default:
 			*(UINT16 *)&ctrlrw[a & 0xff] = d;
-			DebugLog("unknown 400(%x)\n", a & 0xff);
+			DEBUG_LOG(Net, "unknown 400(%x)\n", a & 0xff);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown W16 CTRLRW", NULL);
 			break;
 
@@ -953,7 +955,7 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 		//if (((a & 0xffff) > 0 && (a & 0xffff) < 0xff) || ((a & 0xffff) > 0xefff && (a & 0xffff) < 0xffff)) DebugLog("Netboard W16\tCommRAM[%x] <- %x\n", a & 0xffff, d);
 		if ((a & 0x3ffff) > 0xffff)
 		{
-			DebugLog("OUT OF RANGE CommRAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE CommRAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		*(UINT16 *)&CommRAM[a & 0xffff] = d;
@@ -963,7 +965,7 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 		//DebugLog("Netboard W16\tioreg[%x] <- %x\t", a&0xff, d);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ioreg[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ioreg[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 
@@ -974,29 +976,29 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 			if (d == 0)
 			{
 				*(UINT16 *)&ioreg[a & 0xff] = d;
-				DebugLog("Netboard W16\tioreg[%x] <- %x\t\t", a & 0xff, d);
+				DEBUG_LOG(Net, "Netboard W16\tioreg[%x] <- %x\t\t", a & 0xff, d);
 			}
 
 			if (d == 1)
 			{
 				*(UINT16 *)&ioreg[a & 0xff] = d;
-				DebugLog("Netboard W16\tioreg[%x] <- %x\t\t", a & 0xff, d);
+				DEBUG_LOG(Net, "Netboard W16\tioreg[%x] <- %x\t\t", a & 0xff, d);
 			}
 
 			if (d == 2)
 			{
 				*(UINT16 *)&ioreg[a & 0xff] = d;
-				DebugLog("Netboard W16\tioreg[%x] <- %x\t\t", a & 0xff, d);
+				DEBUG_LOG(Net, "Netboard W16\tioreg[%x] <- %x\t\t", a & 0xff, d);
 			}
 
 			if (d > 2)
 			{
-				DebugLog("d=%x\n", d);
+				DEBUG_LOG(Net, "d=%x\n", d);
 				*(UINT16 *)&ioreg[a & 0xff] = d;
 				//MessageBox(NULL, "d > 1", NULL, MB_OK);
 			}
 
-			DebugLog("d = %x \n",d);
+			DEBUG_LOG(Net, "d = %x \n",d);
 
 			M68KSetIRQ(4); // network error if removed
 			M68KRun(1000); // 1000 is enough
@@ -1005,12 +1007,12 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 
 		case 0x8a: // ioreg[c008a]
 			*(UINT16 *)&ioreg[a & 0xff] = d;
-			DebugLog("Netboard W16\tioreg[%x] <- %x\t", a & 0xff, d);
-			DebugLog("d = %x\n",d);
+			DEBUG_LOG(Net, "Netboard W16\tioreg[%x] <- %x\t", a & 0xff, d);
+			DEBUG_LOG(Net, "d = %x\n",d);
 			break;
 
 		default:
-			DebugLog("unknown c00(%x)\n", a & 0xff);
+			DEBUG_LOG(Net, "unknown c00(%x)\n", a & 0xff);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown W16 IOREG", NULL);
 			break;
 
@@ -1020,7 +1022,7 @@ void CNetBoard::Write16(UINT32 a, UINT16 d)
 		break;
 
 	default:
-		DebugLog("NetBoard 68K: Unknown W16 (%x) %06X<-%04X\n", (a >> 16) & 0xF,a, d);
+		DEBUG_LOG(Net, "NetBoard 68K: Unknown W16 (%x) %06X<-%04X\n", (a >> 16) & 0xF,a, d);
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown W16", NULL);
 		break;
 	}
@@ -1034,7 +1036,7 @@ void CNetBoard::Write32(UINT32 a, UINT32 d)
 		//DebugLog("Netboard Write32 (0x0) \tRAM[%x] <- %x\n", a, d);
 		if (a > 0x0ffff)
 		{
-			DebugLog("OUT OF RANGE RAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE RAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 		*(UINT16 *)&RAM[a] = (d >> 16);
@@ -1042,10 +1044,10 @@ void CNetBoard::Write32(UINT32 a, UINT32 d)
 		break;
 
 	/*case 0x4: // not used
-		DebugLog("Netboard W32\tctrlrw[%x] <- %x\n", a, d);
+		DEBUG_LOG(Net, "Netboard W32\tctrlrw[%x] <- %x\n", a, d);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ctrlrw[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ctrlrw[%x]\n", a);
 			MessageBox(NULL, "Out of Range", NULL, MB_OK);
 		}
 		*(UINT16 *)&ctrlrw[a] = (d >> 16);
@@ -1056,7 +1058,7 @@ void CNetBoard::Write32(UINT32 a, UINT32 d)
 		//if (((a & 0xffff) > 0 && (a & 0xffff) < 0xff) || ((a & 0xffff) > 0xefff && (a & 0xffff) < 0xffff)) DebugLog("Netboard W32\tCommRAM[%x] <- %x\n", a & 0xffff, d);
 		if ((a & 0x3ffff) > 0xffff)
 		{
-			DebugLog("OUT OF RANGE CommRAM[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE CommRAM[%x]\n", a);
 			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Out of Range", NULL);
 		}
 
@@ -1065,10 +1067,10 @@ void CNetBoard::Write32(UINT32 a, UINT32 d)
 		break;
 
 	/*case 0xc: // not used
-		DebugLog("Netboard W32\tioreg[%x] <- %x\n", a, d);
+		DEBUG_LOG(Net, "Netboard W32\tioreg[%x] <- %x\n", a, d);
 		if ((a & 0xfff) > 0xff)
 		{
-			DebugLog("OUT OF RANGE ioreg[%x]\n", a);
+			DEBUG_LOG(Net, "OUT OF RANGE ioreg[%x]\n", a);
 			MessageBox(NULL, "Out of Range", NULL, MB_OK);
 		}
 		*(UINT16 *)&ioreg[a] = (d >> 16);
@@ -1079,7 +1081,7 @@ void CNetBoard::Write32(UINT32 a, UINT32 d)
 		break;*/
 
 	default:
-		DebugLog("NetBoard 68K: Unknown W32 (%x) %08X<-%08X\n", (a >> 16) & 0xF,a, d);
+		DEBUG_LOG(Net, "NetBoard 68K: Unknown W32 (%x) %08X<-%08X\n", (a >> 16) & 0xF,a, d);
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Info", "Unknown W32", NULL);
 		break;
 	}
@@ -1088,6 +1090,10 @@ void CNetBoard::Write32(UINT32 a, UINT32 d)
 
 
 #define MEMORY_POOL_SIZE	0x40000 // contiguous, not sure
+
+// 68K cycles run per frame and between IRQ5s
+#define NET_CYCLES_PER_FRAME	(4 * 4000000 / 60)
+#define IRQ5_PERIOD				(4000000 / 60)
 #define OFFSET_COMMRAM		0x0 // size 256kb 0x80000-0xbffff
 
 bool CNetBoard::Init(UINT8 * netRAMPtr, UINT8 *netBufferPtr)
@@ -1104,7 +1110,7 @@ bool CNetBoard::Init(UINT8 * netRAMPtr, UINT8 *netBufferPtr)
 
 	if (NULL == memoryPool)
 	{
-		DebugLog("error mem\n");
+		DEBUG_LOG(Net, "error mem\n");
 		return ErrorLog("Insufficient memory for net board");
 	}
 	memset(memoryPool, 0, MEMORY_POOL_SIZE);
@@ -1122,7 +1128,7 @@ bool CNetBoard::Init(UINT8 * netRAMPtr, UINT8 *netBufferPtr)
 	/*bank = new UINT8[0x10000];
 	if(NULL == bank)
 	{
-		DebugLog("error mem bank\n");
+		DEBUG_LOG(Net, "error mem bank\n");
 		return ErrorLog("Insufficient memory for net board");
 	}
 	memset(bank, 0, 0x10000);*/
@@ -1131,7 +1137,7 @@ bool CNetBoard::Init(UINT8 * netRAMPtr, UINT8 *netBufferPtr)
 	ct = new UINT8[0x100];
 	if (NULL == ct)
 	{
-		DebugLog("error mem ct\n");
+		DEBUG_LOG(Net, "error mem ct\n");
 		return ErrorLog("Insufficient memory for net board ct");
 	}
 	memset(ct, 0, 0x100);
@@ -1143,7 +1149,7 @@ bool CNetBoard::Init(UINT8 * netRAMPtr, UINT8 *netBufferPtr)
 
 	ctrlrw = ct;
 
-	DebugLog("Init netboard\n");
+	DEBUG_LOG(Net, "Init netboard\n");
 
 
 	// Initialize 68K core
@@ -1151,8 +1157,11 @@ bool CNetBoard::Init(UINT8 * netRAMPtr, UINT8 *netBufferPtr)
 	M68KInit();
 	M68KAttachBus(this);
 	M68KSetIRQCallback(NetIRQAck);
+	M68KMapRAM(0x000000, 0x00FFFF, RAM, 0x00FFFF);
+	std::string engine = m_config["NetBoardM68KEngine"].ValueAsDefault<std::string>(m_config["M68KEngine"].ValueAs<std::string>());
+	if (OKAY != M68KSetEngine(engine.c_str()))
+		ErrorLog("Unknown 68K engine '%s' for net board; using 'musashi'.", engine.c_str());
 	//M68KSetIRQCallback(NULL);
-	M68KGetContext(&M68K);
 	//Net_SetCB(NET68KRunCallback, NET68KIRQCallback);
 
 
@@ -1161,13 +1170,12 @@ bool CNetBoard::Init(UINT8 * netRAMPtr, UINT8 *netBufferPtr)
 	port_out = m_config["PortOut"].ValueAs<unsigned>();
 	addr_out = m_config["AddressOut"].ValueAs<std::string>();
 
-	nets = std::make_unique<TCPSend>(addr_out, port_out);
-	netr = std::make_unique<TCPReceive>(port_in);
+	CreateNetTransport(m_config, nets, netr);
 
 	if (m_config["Network"].ValueAs<bool>() && m_attached) {
-		while (!nets->Connect()) {
-			printf("Connecting to %s:%i ..\n", addr_out.c_str(), port_out);
-		}
+		printf("Connecting to %s:%i ..\n", addr_out.c_str(), port_out);
+		NetConnector connector;
+		connector.Run("the next machine", [this] { return nets->Connect(); });
 		printf("Successfully connected.\n");
 	}
 
@@ -1188,6 +1196,7 @@ CNetBoard::CNetBoard(const Util::Config::Node &config) : m_config(config)
 	ctrlrw		= NULL;
 
 	test_irq	= 0;
+	irq5Countdown = 0;
 
 	int5		= false;
 }
@@ -1223,47 +1232,32 @@ void CNetBoard::LoadState(CBlockFile * SaveState)
 
 void CNetBoard::RunFrame(void)
 {
+	TRACE_ZONE("CNetBoard::RunFrame");
+
 	if (!IsRunning())
 		return;
 
+	CountNetLinkFrame();
 	M68KSetContext(&M68K);
 
-	/*if (int5 == false)
+	// IRQ5 is raised by a timer every IRQ5_PERIOD cycles, which carries over from one frame to the next. It was found
+	// that it must come 3-4 times a frame, with the 68K running 4 times faster than its nominal 4 MHz, to avoid network
+	// errors in some games, so that is what is done.
+	int cycles = NET_CYCLES_PER_FRAME;
+	while (cycles > 0)
 	{
-		int5 = true;
-		interrupt5 = std::thread([this] { inter5(); });
-	}*/
-
-
-	M68KSetIRQ(5); // apparently, must be called every xx milli secondes or every frames or 3-4 in a frame
-	/*if (test_irq == 0 || test_irq<2)
-	{
-		test_irq ++;
+		if (irq5Countdown <= 0)
+		{
+			M68KSetIRQ(5);
+			irq5Countdown += IRQ5_PERIOD;
+		}
+		int slice = std::min(cycles, irq5Countdown);
+		int done = M68KRun(slice);
+		if (done <= 0)
+			done = slice;
+		cycles -= done;
+		irq5Countdown -= done;
 	}
-	else
-	{
-		test_irq = 0;
-		M68KSetIRQ(5);
-		//M68KRun(10000);
-	}*/
-
-	M68KRun((4000000 / 60)); // original
-	//M68KRun((4000000 / 60)*3); // 12Mhz
-
-	//DebugLog("NetBoard PC=%06X\n", M68KGetPC());
-
-	//M68KSetIRQ(6);
-	//M68KRun(10000);
-
-	// 3 times more avoid network error canceled on certain games (certainly due to irq5 that would be calling 3-4 times in a frame)
-	M68KSetIRQ(5);
-	M68KRun((4000000 / 60));
-	M68KSetIRQ(5);
-	M68KRun((4000000 / 60));
-	M68KSetIRQ(5);
-	M68KRun((4000000 / 60));
-
-	M68KGetContext(&M68K);
 }
 
 void CNetBoard::Reset(void)
@@ -1271,6 +1265,7 @@ void CNetBoard::Reset(void)
 	/*********************************************************************************************/
 
 	commbank = 0;
+	irq5Countdown = 0;
 	recv_offset=0;
 	recv_size=0;
 	send_offset=0;
@@ -1287,10 +1282,9 @@ void CNetBoard::Reset(void)
 
 
 	M68KSetContext(&M68K);
-	DebugLog("RESET NetBoard PC=%06X\n", M68KGetPC());
+	DEBUG_LOG(Net, "RESET NetBoard PC=%06X\n", M68KGetPC());
 	M68KReset();
 
-	M68KGetContext(&M68K);
 
 }
 
@@ -28,9 +28,8 @@
 #include "OSD/Thread.h"
 #include <memory>
 #include "INetBoard.h"
-#include "TCPSend.h"
+#include "NetTransport.h"
 #include "TCPSendAsync.h"
-#include "TCPReceive.h"
 
 //#define NET_BUF_SIZE 32800 // 16384 not enough
 
@@ -89,14 +88,15 @@ private:
 	UINT16		send_offset;
 	UINT16		send_size;
 	UINT8		slot;
+	int			irq5Countdown;	// 68K cycles until IRQ5 is next raised
 
 	// netsock
 	UINT16 port_in = 0;
 	UINT16 port_out = 0;
 	std::string addr_out = "";
 
-	std::unique_ptr<TCPSend> nets;
-	std::unique_ptr<TCPReceive> netr;
+	std::unique_ptr<INetSend> nets;
+	std::unique_ptr<INetReceive> netr;
 
 	//game info
 	Game Gameinfo;
@@ -0,0 +1,79 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "NetBuffers.h"
+#include <atomic>
+
+static std::atomic<UINT64> s_buffered(0);
+static std::atomic<UINT64> s_allocations(0);
+
+NetBufferPool::NetBufferPool(int blockSize, int count) :
+	m_blockSize(blockSize),
+	m_count(count),
+	m_storage(new char[size_t(blockSize) * count])
+{
+	m_free.reserve(count);
+
+	for (int i = count - 1; i >= 0; i--) {
+		m_free.push_back(m_storage.get() + size_t(blockSize) * i);
+	}
+}
+
+char* NetBufferPool::Acquire(int size)
+{
+	if (size <= m_blockSize) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_free.empty()) {
+			char* block = m_free.back();
+			m_free.pop_back();
+			CountNetBuffer(false);
+			return block;
+		}
+	}
+
+	CountNetBuffer(true);
+	return new char[size];
+}
+
+void NetBufferPool::Release(char* block)
+{
+	if (block >= m_storage.get() && block < m_storage.get() + size_t(m_blockSize) * m_count) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_free.push_back(block);		// never exceeds the capacity reserved
+	}
+	else {
+		delete[] block;
+	}
+}
+
+NetBufferStats GetNetBufferStats()
+{
+	return { s_buffered.load(), s_allocations.load() };
+}
+
+void CountNetBuffer(bool allocated)
+{
+	s_buffered++;
+	if (allocated) {
+		s_allocations++;
+	}
+}
@@ -0,0 +1,63 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _NETBUFFERS_H_
+#define _NETBUFFERS_H_
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include "Types.h"
+
+// Most a net board sends or receives at once: the whole of CommRAM
+static const int NET_MAX_MESSAGE = 0x10000;
+
+// Fixed-size blocks allocated once, for messages that can't just be sent from CommRAM. A block larger than the pool's, or
+// any block once the pool runs dry, comes from the heap and is counted as an allocation.
+class NetBufferPool
+{
+public:
+	NetBufferPool(int blockSize, int count);
+
+	char* Acquire(int size);
+	void Release(char* block);
+
+private:
+	std::mutex m_mutex;
+	int m_blockSize;
+	int m_count;
+	std::unique_ptr<char[]> m_storage;
+	std::vector<char*> m_free;
+};
+
+// Buffers the network layer has used since start up, and how many of those had to be allocated. Once the link is running
+// allocations should stay where they are.
+struct NetBufferStats
+{
+	UINT64 buffered;		// messages sent or received through a buffer
+	UINT64 allocations;		// heap allocations made for them
+};
+
+NetBufferStats GetNetBufferStats();
+void CountNetBuffer(bool allocated);
+
+#endif
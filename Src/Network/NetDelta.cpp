@@ -0,0 +1,259 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "NetDelta.h"
+#include "NetBuffers.h"
+#include "OSD/Logger.h"
+#include <atomic>
+#include <cstring>
+
+/*
+ * Each message starts with a header:
+ *
+ *	distance	UINT8	0 if the message follows whole, else how many messages back the one it is a delta against is
+ *	sequence	UINT16	of this message, so that a receiver can tell it is out of step with a restarted sender
+ *
+ * A delta is then runs of changed bytes, XORed with the message it is against, each given as a count of unchanged
+ * bytes before it and a count of bytes in it, both 7 bits to the byte. Unchanged bytes at the end are left out.
+ */
+
+static const int HEADER_SIZE = 3;
+
+static std::atomic<UINT64> s_frames(0);
+static std::atomic<UINT64> s_messages(0);
+static std::atomic<UINT64> s_keyframes(0);
+static std::atomic<UINT64> s_rawBytes(0);
+static std::atomic<UINT64> s_sentBytes(0);
+
+static void PutHeader(std::vector<char>* packet, int distance, UINT32 sequence)
+{
+	packet->clear();
+	packet->push_back(char(distance));
+	packet->push_back(char(sequence & 0xff));
+	packet->push_back(char((sequence >> 8) & 0xff));
+}
+
+static void PutCount(std::vector<char>* packet, size_t count)
+{
+	while (count >= 0x80) {
+		packet->push_back(char((count & 0x7f) | 0x80));
+		count >>= 7;
+	}
+	packet->push_back(char(count));
+}
+
+static bool GetCount(const std::vector<char>& packet, size_t* pos, size_t* count)
+{
+	*count = 0;
+	for (int shift = 0; shift < 32; shift += 7) {
+		if (*pos >= packet.size()) {
+			return false;
+		}
+		UINT8 byte = UINT8(packet[(*pos)++]);
+		*count |= size_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Appends the delta of data against base, giving up with false once the packet grows past limit. Gaps of up to two
+// unchanged bytes are kept in a run, as starting a new run costs at least as much.
+static bool PutDelta(std::vector<char>* packet, const char* data, const char* base, size_t length, size_t limit)
+{
+	size_t pos = 0;
+	while (pos < length) {
+		size_t start = pos;
+		while (pos < length && data[pos] == base[pos]) {
+			pos++;
+		}
+		if (pos == length) {
+			break;
+		}
+		size_t end = pos;
+		while (end < length) {
+			size_t gap = end;
+			while (gap < length && data[gap] == base[gap] && gap - end < 3) {
+				gap++;
+			}
+			if (gap == length || gap - end >= 3) {
+				break;
+			}
+			end = gap + 1;
+		}
+		PutCount(packet, pos - start);
+		PutCount(packet, end - pos);
+		if (packet->size() + (end - pos) > limit) {
+			return false;
+		}
+		for (; pos < end; pos++) {
+			packet->push_back(char(data[pos] ^ base[pos]));
+		}
+	}
+	return true;
+}
+
+DeltaSend::DeltaSend(std::unique_ptr<INetSend> send, int keyframeInterval) :
+	m_send(std::move(send)),
+	m_keyframeInterval(keyframeInterval),
+	m_sequence(0)
+{
+	m_packet.reserve(NET_MAX_MESSAGE + HEADER_SIZE);
+	m_scratch.reserve(NET_MAX_MESSAGE + HEADER_SIZE);
+}
+
+bool DeltaSend::Send(const void* data, int length)
+{
+	// an empty message breaks the link, and goes as it is
+	if (length <= 0) {
+		return m_send->Send(data, 0);
+	}
+
+	const char* bytes = (const char*)data;
+	m_sequence++;
+
+	// the smallest delta against a recent message of the same size, unless that would be too many deltas in a row
+	int best = 0;
+	for (int distance = 1; distance < HISTORY && UINT32(distance) < m_sequence; distance++) {
+		const Sent& base = m_history[(m_sequence - distance) % HISTORY];
+		if (base.data.size() != size_t(length) || base.depth + 1 >= m_keyframeInterval) {
+			continue;
+		}
+		size_t limit = best ? m_packet.size() - 1 : size_t(HEADER_SIZE + length - 1);
+		PutHeader(&m_scratch, distance, m_sequence);
+		if (PutDelta(&m_scratch, bytes, base.data.data(), size_t(length), limit) && m_scratch.size() <= limit) {
+			std::swap(m_packet, m_scratch);
+			best = distance;
+		}
+	}
+
+	Sent& sent = m_history[m_sequence % HISTORY];
+	sent.depth = best ? m_history[(m_sequence - best) % HISTORY].depth + 1 : 0;
+	CountNetBuffer(size_t(length) > sent.data.capacity());
+	sent.data.assign(bytes, bytes + length);
+
+	if (!best) {
+		PutHeader(&m_packet, 0, m_sequence);
+		m_packet.insert(m_packet.end(), bytes, bytes + length);
+		s_keyframes++;
+	}
+	s_messages++;
+	s_rawBytes += UINT64(length);
+	s_sentBytes += UINT64(m_packet.size());
+
+	return m_send->Send(m_packet.data(), int(m_packet.size()));
+}
+
+bool DeltaSend::Connect()
+{
+	return m_send->Connect();
+}
+
+bool DeltaSend::Connected()
+{
+	return m_send->Connected();
+}
+
+DeltaReceive::DeltaReceive(std::unique_ptr<INetReceive> receive) :
+	m_receive(std::move(receive)),
+	m_sequence(0)
+{
+}
+
+bool DeltaReceive::CheckDataAvailable(int timeoutMS)
+{
+	return m_receive->CheckDataAvailable(timeoutMS);
+}
+
+std::vector<char>& DeltaReceive::Receive()
+{
+	auto& packet = m_receive->Receive();
+	if (packet.empty()) {
+		return packet;		// link broken
+	}
+	if (packet.size() < size_t(HEADER_SIZE)) {
+		ErrorLog("Net board received a message too short for delta coding. Is NetDelta set on every machine?");
+		m_empty.clear();
+		return m_empty;
+	}
+
+	int distance = UINT8(packet[0]);
+	UINT32 sequence = UINT8(packet[1]) | (UINT32(UINT8(packet[2])) << 8);
+
+	// a whole message can always be taken, and puts us in step with the sender
+	if (distance == 0) {
+		m_sequence = sequence;
+		auto& message = m_history[m_sequence % HISTORY];
+		CountNetBuffer(packet.size() - HEADER_SIZE > message.capacity());
+		message.assign(packet.begin() + HEADER_SIZE, packet.end());
+		return message;
+	}
+
+	if (distance >= HISTORY || sequence != ((m_sequence + 1) & 0xffff)) {
+		ErrorLog("Net board received a delta out of step with the messages before it.");
+		m_empty.clear();
+		return m_empty;
+	}
+	m_sequence = sequence;
+	auto& message = m_history[m_sequence % HISTORY];
+	const auto& base = m_history[(m_sequence - distance) % HISTORY];
+	CountNetBuffer(base.size() > message.capacity());
+	message.assign(base.begin(), base.end());
+
+	size_t pos = HEADER_SIZE;
+	size_t at = 0;
+	while (pos < packet.size()) {
+		size_t skip, count;
+		if (!GetCount(packet, &pos, &skip) || !GetCount(packet, &pos, &count) ||
+			skip > message.size() - at || count > message.size() - at - skip || count > packet.size() - pos) {
+			ErrorLog("Net board received a corrupt delta message.");
+			m_empty.clear();
+			return m_empty;
+		}
+		at += skip;
+		for (size_t i = 0; i < count; i++) {
+			message[at++] ^= packet[pos++];
+		}
+	}
+	return message;
+}
+
+bool DeltaReceive::Connected()
+{
+	return m_receive->Connected();
+}
+
+bool DeltaReceive::WaitConnected(int timeoutMS)
+{
+	return m_receive->WaitConnected(timeoutMS);
+}
+
+NetLinkStats GetNetLinkStats()
+{
+	return { s_frames.load(), s_messages.load(), s_keyframes.load(), s_rawBytes.load(), s_sentBytes.load() };
+}
+
+void CountNetLinkFrame()
+{
+	s_frames++;
+}
@@ -0,0 +1,93 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _NETDELTA_H_
+#define _NETDELTA_H_
+
+#include <memory>
+#include <vector>
+#include "NetTransport.h"
+
+// Wraps a reliable transport so that each message goes as the XOR against one of the last messages sent, with the
+// runs of zeros left out. Net boards send the same CommRAM segments round the ring frame after frame with few bytes
+// changed, so the message the same segment was in last frame is usually found among the last few and only the changes
+// go over the link. Messages sent as a delta against a delta are limited to keyframeInterval in a row, after which the
+// whole message is sent again. Both ends must use it, and the transport must not lose or reorder messages.
+class DeltaSend : public INetSend
+{
+public:
+	DeltaSend(std::unique_ptr<INetSend> send, int keyframeInterval);
+
+	bool Send(const void* data, int length) override;
+	bool Connect() override;
+	bool Connected() override;
+
+private:
+	struct Sent
+	{
+		std::vector<char> data;
+		int depth = 0;			// deltas since the last keyframe this one is built on
+	};
+
+	static const int HISTORY = 16;
+
+	std::unique_ptr<INetSend> m_send;
+	int m_keyframeInterval;
+	UINT32 m_sequence;
+	Sent m_history[HISTORY];		// last messages sent, by sequence number modulo HISTORY
+	std::vector<char> m_packet;
+	std::vector<char> m_scratch;
+};
+
+class DeltaReceive : public INetReceive
+{
+public:
+	DeltaReceive(std::unique_ptr<INetReceive> receive);
+
+	bool CheckDataAvailable(int timeoutMS = 0) override;
+	std::vector<char>& Receive() override;
+	bool Connected() override;
+	bool WaitConnected(int timeoutMS) override;
+
+private:
+	static const int HISTORY = 16;
+
+	std::unique_ptr<INetReceive> m_receive;
+	UINT32 m_sequence;
+	std::vector<char> m_history[HISTORY];	// last messages received, decoded
+	std::vector<char> m_empty;
+};
+
+// What went over the outgoing link since start up, for working out the bytes it takes a frame
+struct NetLinkStats
+{
+	UINT64 frames;			// net board frames run with the link up
+	UINT64 messages;		// messages sent
+	UINT64 keyframes;		// of which sent whole
+	UINT64 rawBytes;		// their size before delta coding
+	UINT64 sentBytes;		// and after
+};
+
+NetLinkStats GetNetLinkStats();
+void CountNetLinkFrame();
+
+#endif
@@ -0,0 +1,234 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "NetMesh.h"
+#include "NetTransport.h"
+#include "OSD/Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+static const UINT32 MESH_PACKET_MAGIC	= 0x4D334E4D;	// "MN3M"
+static const int	RESEND_MS			= 5;			// resend our segment if peers are this late, in case it was lost
+
+NetMesh::NetMesh(int port, const std::string& peers) :
+	m_socket(nullptr),
+	m_socketSet(nullptr),
+	m_packet(nullptr),
+	m_receivePacket(nullptr),
+	m_frame(0),
+	m_machineIndex(0),
+	m_resends(0)
+{
+	SDLNet_Init();
+
+	m_socketSet = SDLNet_AllocSocketSet(1);
+	m_packet = SDLNet_AllocPacket(UDP_MAX_PACKET);
+	m_packet->len = 0;
+	m_receivePacket = SDLNet_AllocPacket(UDP_MAX_PACKET);
+
+	for (int i = 0; i < MAX_MACHINES; i++) {
+		m_segments[i].reserve(UDP_MAX_PACKET);
+		m_segmentFrames[i] = 0;
+	}
+
+	std::stringstream list(peers);
+	std::string peer;
+
+	while (std::getline(list, peer, ',')) {
+		peer.erase(0, peer.find_first_not_of(" \t"));
+		peer.erase(peer.find_last_not_of(" \t") + 1);
+		if (peer.empty()) {
+			continue;
+		}
+
+		auto colon = peer.rfind(':');
+		std::string host = peer.substr(0, colon);
+		int peerPort = colon == std::string::npos ? port : atoi(peer.c_str() + colon + 1);
+
+		IPaddress ip;
+		if (SDLNet_ResolveHost(&ip, host.c_str(), peerPort) == 0) {
+			m_peers.push_back(ip);
+		}
+		else {
+			ErrorLog("Unable to resolve net board peer '%s'.", peer.c_str());
+		}
+	}
+
+	m_socket = SDLNet_UDP_Open(port);
+	if (m_socket) {
+		SDLNet_UDP_AddSocket(m_socketSet, m_socket);
+	}
+	else {
+		ErrorLog("Unable to open port %i for the net board mesh.", port);
+	}
+}
+
+NetMesh::~NetMesh()
+{
+	if (m_resends) {
+		DEBUG_LOG(Net, "Net board mesh resent %llu segments\n", (unsigned long long)m_resends);
+	}
+
+	if (m_socket) {
+		SDLNet_UDP_Close(m_socket);
+		m_socket = nullptr;
+	}
+
+	if (m_socketSet) {
+		SDLNet_FreeSocketSet(m_socketSet);
+		m_socketSet = nullptr;
+	}
+
+	SDLNet_FreePacket(m_packet);
+	SDLNet_FreePacket(m_receivePacket);
+
+	SDLNet_Quit();
+}
+
+bool NetMesh::IsOpen() const
+{
+	return m_socket != nullptr;
+}
+
+int NetMesh::NumPeers() const
+{
+	return int(m_peers.size());
+}
+
+void NetMesh::Send(int machineIndex, const void* data, int length)
+{
+	if (!m_socket) {
+		return;
+	}
+
+	length = std::min(length, UDP_MAX_PACKET - int(sizeof(Header)));
+
+	m_frame++;
+	m_machineIndex = machineIndex;
+
+	Header header = { MESH_PACKET_MAGIC, m_frame, UINT16(machineIndex), UINT16(length) };
+	memcpy(m_packet->data, &header, sizeof(header));
+	if (length) {
+		memcpy(m_packet->data + sizeof(header), data, length);
+	}
+	m_packet->len = int(sizeof(header)) + length;
+
+	Resend();
+}
+
+void NetMesh::Resend()
+{
+	for (const auto& peer : m_peers) {
+		m_packet->address = peer;
+		SDLNet_UDP_Send(m_socket, -1, m_packet);
+	}
+}
+
+bool NetMesh::ReadPacket()
+{
+	if (SDLNet_UDP_Recv(m_socket, m_receivePacket) <= 0) {
+		return true;
+	}
+
+	const UDPpacket& packet = *m_receivePacket;
+
+	Header header;
+	if (packet.len < int(sizeof(header))) {
+		return true;
+	}
+	memcpy(&header, packet.data, sizeof(header));
+	if (header.magic != MESH_PACKET_MAGIC || header.machineIndex >= MAX_MACHINES || int(header.machineIndex) == m_machineIndex ||
+		packet.len - int(sizeof(header)) < int(header.length)) {
+		return true;
+	}
+
+	// a peer that has started again numbers its frames from 1
+	UINT32& lastFrame = m_segmentFrames[header.machineIndex];
+	if (header.frame <= lastFrame && lastFrame - header.frame < 0x10000) {
+		return true;
+	}
+
+	if (header.length == 0) {
+		return false;
+	}
+
+	lastFrame = header.frame;
+	auto* data = (const char*)packet.data + sizeof(header);
+	m_segments[header.machineIndex].assign(data, data + header.length);
+
+	return true;
+}
+
+bool NetMesh::Gather(int numMachines, int timeoutMS)
+{
+	if (!m_socket || numMachines > MAX_MACHINES) {
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	auto lastSent = start;
+
+	for (;;) {
+
+		// every other machine has sent this frame's segment, or a newer one
+		bool complete = true;
+		for (int i = 0; i < numMachines; i++) {
+			if (i != m_machineIndex && m_segmentFrames[i] < m_frame) {
+				complete = false;
+				break;
+			}
+		}
+
+		if (complete) {
+			return true;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - start >= std::chrono::milliseconds(timeoutMS)) {
+			return false;
+		}
+
+		if (now - lastSent >= std::chrono::milliseconds(RESEND_MS)) {
+			Resend();
+			lastSent = now;
+			m_resends++;
+		}
+
+		if (SDLNet_CheckSockets(m_socketSet, RESEND_MS) > 0) {
+			while (SDLNet_SocketReady(m_socket)) {
+				if (!ReadPacket()) {
+					return false;
+				}
+				if (SDLNet_CheckSockets(m_socketSet, 0) <= 0) {
+					break;
+				}
+			}
+		}
+	}
+}
+
+const std::vector<char>& NetMesh::Segment(int machineIndex) const
+{
+	return m_segments[machineIndex];
+}
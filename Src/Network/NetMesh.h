@@ -0,0 +1,75 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _NETMESH_H_
+#define _NETMESH_H_
+
+#include <string>
+#include <vector>
+#include "Types.h"
+#include "SDLIncludes.h"
+
+// Exchanges each machine's own CommRAM segment directly with every other machine once a frame, over UDP, in place of
+// passing all the segments around the ring one hop at a time. Segments are tagged with the sender's position in the ring
+// and a frame number; a segment newer than the one wanted will do, as it means the sender has moved on.
+class NetMesh
+{
+public:
+	NetMesh(int port, const std::string& peers);	// peers is "address:port" for each other machine, comma separated
+	~NetMesh();
+
+	bool IsOpen() const;
+	int NumPeers() const;
+
+	void Send(int machineIndex, const void* data, int length);		// starts a new frame; an empty segment breaks the link
+	bool Gather(int numMachines, int timeoutMS);					// false if the link broke or timed out
+	const std::vector<char>& Segment(int machineIndex) const;		// as last gathered
+
+private:
+
+	static const int MAX_MACHINES = 16;
+
+	struct Header
+	{
+		UINT32	magic;
+		UINT32	frame;
+		UINT16	machineIndex;
+		UINT16	length;
+	};
+
+	void Resend();
+	bool ReadPacket();		// false if a peer broke the link
+
+	UDPsocket m_socket;
+	SDLNet_SocketSet m_socketSet;
+	UDPpacket* m_packet;			// our segment, as sent to each peer
+	UDPpacket* m_receivePacket;
+	std::vector<IPaddress> m_peers;
+
+	UINT32 m_frame;
+	int m_machineIndex;
+	std::vector<char> m_segments[MAX_MACHINES];
+	UINT32 m_segmentFrames[MAX_MACHINES];	// frame each segment came from, 0 if none yet
+	UINT64 m_resends;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "NetPacing.h"
+#include "Util/RollingStats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+
+static const double WAIT_TARGET	= 250.0;	// microseconds to wait on the link each frame, as slack against jitter
+static const double GAIN		= 2.0;		// ppm of period per microsecond off target
+static const double INTEGRAL	= 0.05;		// ppm added each frame per microsecond off target, to take up a clock's drift
+static const double LIMIT		= 5000.0;	// ppm either way
+
+static std::atomic<bool> s_follower(false);
+static std::atomic<INT32> s_correction(0);		// ppm
+
+// Only the net board thread paces, but the stats are read from elsewhere
+static std::mutex s_mutex;
+static Util::RollingStats s_waits(600);
+static UINT64 s_frames = 0;
+static double s_smoothed = 0;
+static double s_integral = 0;
+static INT32 s_maxCorrection = 0;
+
+void SetNetPacingFollower(bool follower)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_follower = follower;
+	s_smoothed = 0;
+	s_integral = 0;
+	s_correction = 0;
+}
+
+void PaceNetFrame(UINT32 waitMicros)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_frames++;
+	s_waits.Add(waitMicros);
+	if (!s_follower)
+		return;
+
+	// a single long wait is as likely a hiccup elsewhere as the clocks drifting apart, so it is smoothed over a few frames
+	double error = std::min(double(waitMicros), 8 * WAIT_TARGET) - WAIT_TARGET;
+	s_smoothed += (error - s_smoothed) / 8;
+	s_integral = std::max(-LIMIT, std::min(LIMIT, s_integral + INTEGRAL * s_smoothed));
+	INT32 correction = INT32(std::max(-LIMIT, std::min(LIMIT, s_integral + GAIN * s_smoothed)));
+	s_correction = correction;
+	if (std::abs(correction) > std::abs(s_maxCorrection))
+		s_maxCorrection = correction;
+}
+
+double GetNetPacingPeriodScale()
+{
+	return 1.0 + s_correction.load() * 1e-6;
+}
+
+NetPacingStats GetNetPacingStats()
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	NetPacingStats stats;
+	stats.frames = s_frames;
+	stats.averageWait = s_waits.Average();
+	stats.waitPercentile99 = s_waits.Percentile(99);
+	stats.correction = s_correction;
+	stats.maxCorrection = s_maxCorrection;
+	return stats;
+}
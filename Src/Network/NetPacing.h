@@ -0,0 +1,54 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _NETPACING_H_
+#define _NETPACING_H_
+
+#include "Types.h"
+
+// Keeps a linked machine's frames in step with the master's. Machines in the ring each wait on the one before for its
+// segments, so a machine whose clock runs fast spends longer waiting every frame, and one whose clock runs slow finds
+// them there already and holds up the rest. Every machine but the master measures how long it waited on the link each
+// frame and stretches or shrinks its frame period, by a fraction of a percent at most, to keep that wait near a small
+// target. Then all of them run at the master's rate with a little slack, and none of them drifts out of phase until it
+// stalls for a whole frame.
+struct NetPacingStats
+{
+	UINT64 frames;				// frames paced by the link
+	double averageWait;			// microseconds waited on the link per frame, over the recent frames
+	UINT32 waitPercentile99;	// and at worst for 99% of them
+	INT32 correction;			// current change to the frame period, in parts per million
+	INT32 maxCorrection;		// and the largest either way
+};
+
+// Set by the net board once it knows its place in the ring. The master keeps to its own clock.
+void SetNetPacingFollower(bool follower);
+
+// Called by the net board at the end of each linked frame with the time it spent waiting on the link
+void PaceNetFrame(UINT32 waitMicros);
+
+// Frame period scale for the frame pacer; 1.0 unless following
+double GetNetPacingPeriodScale();
+
+NetPacingStats GetNetPacingStats();
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "NetTransport.h"
+#include "NetDelta.h"
+#include "SharedMemoryLink.h"
+#include "TCPSend.h"
+#include "TCPReceive.h"
+#include "UDPSend.h"
+#include "UDPReceive.h"
+#include "OSD/Logger.h"
+#include <algorithm>
+#include <chrono>
+
+void CreateNetTransport(const Util::Config::Node& config, std::unique_ptr<INetSend>& send, std::unique_ptr<INetReceive>& receive)
+{
+	int port_in = config["PortIn"].ValueAs<unsigned>();
+	int port_out = config["PortOut"].ValueAs<unsigned>();
+	std::string addr_out = config["AddressOut"].ValueAs<std::string>();
+	std::string transport = config["NetTransport"].ValueAsDefault<std::string>("tcp");
+
+	if (transport == "udp") {
+		send = std::make_unique<UDPSend>(addr_out, port_out, config["NetRedundancy"].ValueAsDefault<int>(3));
+		receive = std::make_unique<UDPReceive>(port_in);
+	}
+	else if (transport == "shm") {
+		send = std::make_unique<SharedMemorySend>(port_out);
+		receive = std::make_unique<SharedMemoryReceive>(port_in);
+	}
+	else {
+		if (transport != "tcp") {
+			ErrorLog("Unknown net transport '%s'; using 'tcp'.", transport.c_str());
+		}
+		send = std::make_unique<TCPSend>(addr_out, port_out);
+		receive = std::make_unique<TCPReceive>(port_in);
+	}
+
+	if (config["NetDelta"].ValueAsDefault<bool>(false)) {
+		if (transport == "udp") {
+			// deltas are against earlier messages, which UDP can lose
+			ErrorLog("NetDelta needs a link that never loses messages and is ignored with the 'udp' transport.");
+		}
+		else {
+			send = std::make_unique<DeltaSend>(std::move(send), config["NetKeyframeInterval"].ValueAsDefault<int>(60));
+			receive = std::make_unique<DeltaReceive>(std::move(receive));
+		}
+	}
+}
+
+NetConnector::NetConnector() :
+	m_cancelled(false)
+{
+}
+
+bool NetConnector::Run(const char* what, const std::function<bool()>& attempt)
+{
+	using namespace std::chrono_literals;
+
+	auto start = std::chrono::steady_clock::now();
+	auto backoff = 10ms;
+	unsigned retries = 0;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (!m_cancelled) {
+
+		lock.unlock();
+		bool connected = attempt();
+		lock.lock();
+
+		if (connected) {
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			InfoLog("Net board connected to %s after %.0f ms and %u retries.", what, elapsed.count(), retries);
+			return true;
+		}
+
+		// wait before trying again, unless cancelled in the meantime
+		m_cv.wait_for(lock, backoff, [this] { return m_cancelled; });
+		backoff = std::min(backoff * 2, std::chrono::milliseconds(1000));
+		retries++;
+	}
+
+	return false;
+}
+
+void NetConnector::Cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_cancelled = true;
+	}
+	m_cv.notify_all();
+}
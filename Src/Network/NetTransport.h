@@ -0,0 +1,95 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _NETTRANSPORT_H_
+#define _NETTRANSPORT_H_
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Types.h"
+#include "Util/NewConfig.h"
+
+// Sends messages to the next machine in the link
+class INetSend
+{
+public:
+	virtual ~INetSend() {}
+
+	virtual bool Send(const void* data, int length) = 0;
+	virtual bool Connect() = 0;
+	virtual bool Connected() = 0;
+};
+
+// Receives messages from the previous machine in the link, in the order they were sent
+class INetReceive
+{
+public:
+	virtual ~INetReceive() {}
+
+	virtual bool CheckDataAvailable(int timeoutMS = 0) = 0;		// timeoutMS -1 = wait forever until data arrives, 0 = no waiting, 1+ wait time in milliseconds
+	virtual std::vector<char>& Receive() = 0;					// valid until the next call
+	virtual bool Connected() = 0;
+	virtual bool WaitConnected(int timeoutMS) = 0;				// as CheckDataAvailable, but waits for the previous machine to connect
+};
+
+// Repeats a connection attempt, waiting twice as long after each failure up to a second, until it succeeds or Cancel() is
+// called. Logs how long it took and how many retries were needed.
+class NetConnector
+{
+public:
+	NetConnector();
+
+	bool Run(const char* what, const std::function<bool()>& attempt);	// false if cancelled
+	void Cancel();
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_cancelled;
+};
+
+// Creates the sender and receiver for the link given by the NetTransport ("tcp", "udp" or "shm"), AddressOut, PortOut and
+// PortIn settings. "shm" links machines on the same PC through shared memory, with the ports naming the rings. NetDelta
+// sends each message as a delta against an earlier one (see NetDelta.h).
+void CreateNetTransport(const Util::Config::Node& config, std::unique_ptr<INetSend>& send, std::unique_ptr<INetReceive>& receive);
+
+// UDP packets hold a header and then one or more messages, each with a header of its own, oldest first
+struct UDPPacketHeader
+{
+	UINT32	magic;
+	UINT32	count;			// messages in packet
+};
+
+struct UDPMessageHeader
+{
+	UINT32	sequence;		// numbered consecutively from 1 by each sender
+	UINT32	length;
+};
+
+static const UINT32	UDP_PACKET_MAGIC	= 0x4D334E55;	// "UN3M"
+static const int	UDP_MAX_PACKET		= 65507;		// largest IPv4 UDP payload
+
+#endif
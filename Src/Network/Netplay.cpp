@@ -0,0 +1,459 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "Netplay.h"
+#include "UDPSend.h"
+#include "UDPReceive.h"
+#include "BlockFile.h"
+#include "Game.h"
+#include "Model3/IEmulator.h"
+#include "Inputs/Inputs.h"
+#include "Inputs/Input.h"
+#include "OSD/Audio.h"
+#include "OSD/Video.h"
+#include "OSD/Logger.h"
+#include "Util/Hash.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+// Every message is a header followed by inputs for count consecutive frames. The first message, before any frames
+// are run, has none and carries a hash of the starting state instead.
+struct NetplayHeader
+{
+	UINT32	magic;
+	UINT16	player;
+	UINT16	numValues;			// per frame
+	INT32	firstFrame;
+	INT32	count;
+	INT32	checkFrame;			// frame the hash is of, or -1
+	INT32	ack;				// sender has the receiver's inputs up to this frame
+	UINT64	checkHash;
+};
+
+static const UINT32	NETPLAY_MAGIC		= 0x4D33504E;	// "NP3M"
+static const int	CONNECT_TIMEOUT_MS	= 30000;
+static const int	STALL_TIMEOUT_MS	= 10000;
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+CNetplay::CNetplay(const Util::Config::Node &config, IEmulator *model3, CInputs *inputs, const Game &game) :
+	m_config(config),
+	m_model3(model3),
+	m_inputs(inputs),
+	m_game(game),
+	m_frame(0),
+	m_confirmed(-1),
+	m_peerConfirmed(-1),
+	m_rollbackTo(-1)
+{
+	m_player = config["NetplayPlayer"].ValueAsDefault<int>(1) == 2 ? 2 : 1;
+	m_delay = std::min(std::max(config["NetplayDelay"].ValueAsDefault<int>(2), 0), 8);
+	m_window = std::min(std::max(config["NetplayRollback"].ValueAsDefault<int>(8), 0), 20);
+
+	for (int i = 0; i < HISTORY; i++) {
+		m_local[i].frame = m_remote[i].frame = m_used[i].frame = -1;
+	}
+
+	for (auto &check : m_localChecks) {
+		check.frame = -1;
+	}
+	m_remoteCheck.frame = -1;
+
+	// one snapshot for each frame that can be rolled back, and one for the frame being run
+	m_snapshots.resize(m_window + 2);
+	m_snapshotFrames.assign(m_window + 2, -1);
+
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+CNetplay::~CNetplay(void)
+{
+}
+
+const NetplayStats &CNetplay::GetStats(void) const
+{
+	return m_stats;
+}
+
+void CNetplay::BuildInputLists(void)
+{
+	for (unsigned i = 0; i < m_inputs->Count(); i++) {
+		CInput *input = (*m_inputs)[i];
+		if (input->IsUIInput() || !(input->gameFlags & m_game.inputs)) {
+			continue;
+		}
+		bool player2 = !strncmp(input->label, "P2 ", 3);
+		m_playerInputs[player2 ? 1 : 0].push_back(input);
+	}
+
+	if (m_player == 1) {
+		m_localSources = m_playerInputs[0];
+		return;
+	}
+
+	// player 2 plays with their player 1 controls
+	for (CInput *input : m_playerInputs[1]) {
+		std::string label = std::string("P1 ") + (input->label + 3);
+		CInput *source = input;
+		for (CInput *candidate : m_playerInputs[0]) {
+			if (label == candidate->label) {
+				source = candidate;
+				break;
+			}
+		}
+		m_localSources.push_back(source);
+	}
+}
+
+void CNetplay::ReadLocalInputs(std::vector<UINT16> *values)
+{
+	values->resize(m_localSources.size());
+	for (size_t i = 0; i < m_localSources.size(); i++) {
+		(*values)[i] = m_localSources[i]->value;
+	}
+}
+
+bool CNetplay::Init(void)
+{
+	BuildInputLists();
+
+	std::string address = m_config["NetplayAddress"].ValueAsDefault<std::string>("127.0.0.1");
+	int portIn = m_config["NetplayPortIn"].ValueAsDefault<int>(1980);
+	int portOut = m_config["NetplayPortOut"].ValueAsDefault<int>(1981);
+
+	m_send = std::make_unique<UDPSend>(address, portOut, 3);
+	m_receive = std::make_unique<UDPReceive>(portIn);
+
+	if (!m_receive->Connected() || !m_send->Connect())
+	{
+		ErrorLog("Unable to open netplay ports (sending to %s:%i, receiving on %i).", address.c_str(), portOut, portIn);
+		return FAIL;
+	}
+
+	// both games must start the same, which the first message says
+	SaveSnapshot(0);
+	UINT64 hash = HashSnapshot(0);
+
+	NetplayHeader hello = { NETPLAY_MAGIC, UINT16(m_player), UINT16(m_localSources.size()), -1, 0, 0, -1, hash };
+	m_send->Send(&hello, sizeof(hello));		// repeated by UDPSend until something else is sent
+
+	printf("Waiting for player %d at %s:%i ..\n", 3 - m_player, address.c_str(), portOut);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (;;)
+	{
+		if (SecondsSince(start) * 1000 > CONNECT_TIMEOUT_MS)
+		{
+			ErrorLog("Player %d did not answer.", 3 - m_player);
+			return FAIL;
+		}
+
+		if (!m_receive->CheckDataAvailable(100))
+			continue;
+
+		auto &data = m_receive->Receive();
+		NetplayHeader peer;
+		if (data.size() < sizeof(peer))
+			continue;
+		memcpy(&peer, data.data(), sizeof(peer));
+		if (peer.magic != NETPLAY_MAGIC)
+			continue;
+
+		if (peer.player == m_player || peer.numValues != m_playerInputs[2 - m_player].size())
+		{
+			ErrorLog("The other player must be player %d, running the same game and version of Supermodel.", 3 - m_player);
+			return FAIL;
+		}
+
+		// if the other player has already started, its hello has been replaced by inputs, and the starting states are
+		// compared by the check of frame 0 that comes with them instead
+		if (!HandleMessage(data))
+			return FAIL;
+		break;
+	}
+
+	printf("Netplay started as player %d, with %d frames of input delay and up to %d of rollback.\n", m_player, m_delay, m_window);
+	return OKAY;
+}
+
+bool CNetplay::HandleMessage(const std::vector<char> &data)
+{
+	NetplayHeader header;
+	if (data.size() < sizeof(header))
+		return OKAY;
+	memcpy(&header, data.data(), sizeof(header));
+
+	size_t numValues = m_playerInputs[2 - m_player].size();
+	if (header.magic != NETPLAY_MAGIC || header.numValues != numValues || header.count < 0 ||
+		data.size() < sizeof(header) + size_t(header.count) * numValues * sizeof(UINT16))
+		return OKAY;
+
+	if (header.firstFrame == -1)
+	{
+		// only compared before starting, while the snapshot of frame 0 is still there
+		if (m_frame == 0 && header.checkHash != HashSnapshot(0))
+		{
+			ErrorLog("The two games do not start the same. Make sure both players have the same ROM set and NVRAM.");
+			return FAIL;
+		}
+		return OKAY;
+	}
+
+	if (header.checkFrame >= 0)
+		m_remoteCheck = { header.checkFrame, header.checkHash };
+	m_peerConfirmed = std::max(m_peerConfirmed, int(header.ack));
+
+	const char *values = data.data() + sizeof(header);
+
+	for (int i = 0; i < header.count; i++, values += numValues * sizeof(UINT16))
+	{
+		// inputs arrive in order, each message repeating recent frames, so only the next frame unknown is taken
+		int frame = header.firstFrame + i;
+		if (frame != m_confirmed + 1)
+			continue;
+
+		FrameInputs &remote = m_remote[frame % HISTORY];
+		remote.frame = frame;
+		remote.values.resize(numValues);
+		memcpy(remote.values.data(), values, numValues * sizeof(UINT16));
+		m_lastRemote = remote.values;
+		m_confirmed = frame;
+
+		// if this frame has been run already, with a different guess, it and those after it must be run again
+		const FrameInputs &used = m_used[frame % HISTORY];
+		if (frame < m_frame && used.frame == frame && used.values != remote.values && (m_rollbackTo < 0 || frame < m_rollbackTo))
+			m_rollbackTo = frame;
+	}
+
+	return OKAY;
+}
+
+bool CNetplay::ReceiveInputs(void)
+{
+	while (m_receive->CheckDataAvailable(0))
+	{
+		if (!HandleMessage(m_receive->Receive()))
+			return FAIL;
+	}
+	return OKAY;
+}
+
+bool CNetplay::WaitForInputs(int frame)
+{
+	// can't get further ahead of the other player than can be rolled back
+	if (m_confirmed >= frame - m_window - 1)
+		return OKAY;
+
+	m_stats.stalls++;
+	auto start = std::chrono::steady_clock::now();
+
+	while (m_confirmed < frame - m_window - 1)
+	{
+		if (SecondsSince(start) * 1000 > STALL_TIMEOUT_MS)
+		{
+			ErrorLog("Player %d has stopped responding.", 3 - m_player);
+			return FAIL;
+		}
+
+		if (m_receive->CheckDataAvailable(5) && !ReceiveInputs())
+			return FAIL;
+	}
+
+	return OKAY;
+}
+
+void CNetplay::SendInputs(void)
+{
+	// the latest local frame and all those before it the other player doesn't have yet
+	int last = m_frame + m_delay;
+	int first = std::max(std::max(0, last - HISTORY + 1), m_peerConfirmed + 1);
+	size_t numValues = m_localSources.size();
+
+	NetplayHeader header = { NETPLAY_MAGIC, UINT16(m_player), UINT16(numValues), first, last - first + 1, -1, m_confirmed, 0 };
+
+	// the latest check whose frame no longer depends on inputs still to come
+	for (const Check &check : m_localChecks)
+	{
+		if (check.frame >= 0 && check.frame - 1 <= m_confirmed && check.frame > header.checkFrame)
+		{
+			header.checkFrame = check.frame;
+			header.checkHash = check.hash;
+		}
+	}
+
+	m_message.resize(sizeof(header) + size_t(header.count) * numValues * sizeof(UINT16));
+	memcpy(m_message.data(), &header, sizeof(header));
+
+	char *values = m_message.data() + sizeof(header);
+	for (int frame = first; frame <= last; frame++, values += numValues * sizeof(UINT16))
+		memcpy(values, m_local[frame % HISTORY].values.data(), numValues * sizeof(UINT16));
+
+	m_send->Send(m_message.data(), int(m_message.size()));
+}
+
+bool CNetplay::CompareChecks(void)
+{
+	// wait until ours for the same frame is final too
+	if (m_remoteCheck.frame < 0 || m_remoteCheck.frame - 1 > m_confirmed || m_remoteCheck.frame >= m_frame)
+		return OKAY;
+
+	for (const Check &check : m_localChecks)
+	{
+		if (check.frame == m_remoteCheck.frame && check.hash != m_remoteCheck.hash)
+		{
+			ErrorLog("Netplay games no longer match, from frame %d.", check.frame);
+			return FAIL;
+		}
+	}
+
+	m_remoteCheck.frame = -1;
+	return OKAY;
+}
+
+void CNetplay::ApplyInputs(int frame)
+{
+	int local = m_player - 1;
+
+	const FrameInputs &remote = m_remote[frame % HISTORY];
+	FrameInputs &used = m_used[frame % HISTORY];
+	used.frame = frame;
+	used.values = remote.frame == frame ? remote.values : m_lastRemote;
+	if (used.values.size() != m_playerInputs[1 - local].size())
+		used.values.assign(m_playerInputs[1 - local].size(), 0);
+
+	const FrameInputs &prevUsed = m_used[(frame + HISTORY - 1) % HISTORY];
+	const FrameInputs &prevLocal = m_local[(frame + HISTORY - 1) % HISTORY];
+
+	for (int p = 0; p < 2; p++)
+	{
+		const std::vector<UINT16> &values = p == local ? m_local[frame % HISTORY].values : used.values;
+		const FrameInputs &prev = p == local ? prevLocal : prevUsed;
+		bool hasPrev = prev.frame == frame - 1;
+
+		for (size_t i = 0; i < m_playerInputs[p].size(); i++)
+		{
+			CInput *input = m_playerInputs[p][i];
+			input->prevValue = hasPrev ? prev.values[i] : values[i];
+			input->value = values[i];
+		}
+	}
+}
+
+void CNetplay::SaveSnapshot(int frame)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	int slot = frame % int(m_snapshots.size());
+	m_state.Create(&m_snapshots[slot], "Supermodel Save State", "Netplay snapshot");
+	m_model3->SaveState(&m_state);
+	m_state.Close();
+	m_snapshotFrames[slot] = frame;
+
+	double seconds = SecondsSince(start);
+	m_stats.saveSeconds += seconds;
+	m_stats.maxSaveSeconds = std::max(m_stats.maxSaveSeconds, seconds);
+
+	// recomputed whenever the frame is run again, so final once the inputs before it are all known
+	if (frame % CHECK_INTERVAL == 0)
+		m_localChecks[(frame / CHECK_INTERVAL) % NUM_CHECKS] = { frame, HashSnapshot(frame) };
+}
+
+void CNetplay::LoadSnapshot(int frame)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	int slot = frame % int(m_snapshots.size());
+	m_state.Load(m_snapshots[slot].data(), m_snapshots[slot].size());
+	m_model3->LoadState(&m_state);
+	m_state.Close();
+
+	double seconds = SecondsSince(start);
+	m_stats.loadSeconds += seconds;
+	m_stats.maxLoadSeconds = std::max(m_stats.maxLoadSeconds, seconds);
+}
+
+UINT64 CNetplay::HashSnapshot(int frame) const
+{
+	const std::vector<uint8_t> &snapshot = m_snapshots[frame % int(m_snapshots.size())];
+	return Util::Hash64(snapshot.data(), snapshot.size());
+}
+
+bool CNetplay::RunFrame(bool displayFrame)
+{
+	// the inputs just polled are for a few frames on; until then, as at the start
+	std::vector<UINT16> &local = m_local[(m_frame + m_delay) % HISTORY].values;
+	ReadLocalInputs(&local);
+	m_local[(m_frame + m_delay) % HISTORY].frame = m_frame + m_delay;
+	if (m_frame == 0)
+	{
+		for (int frame = 0; frame < m_delay; frame++)
+			m_local[frame] = m_local[m_delay], m_local[frame].frame = frame;
+		if (m_lastRemote.empty())
+			m_lastRemote.assign(m_playerInputs[2 - m_player].size(), 0);
+	}
+
+	if (!ReceiveInputs() || !WaitForInputs(m_frame))
+		return FAIL;
+
+	// run again, unseen and unheard, the frames run with wrong guesses
+	if (m_rollbackTo >= 0)
+	{
+		int depth = m_frame - m_rollbackTo;
+		m_stats.rollbacks++;
+		m_stats.framesRerun += depth;
+		m_stats.maxRollback = std::max(m_stats.maxRollback, unsigned(depth));
+
+		SetAudioDiscard(true);
+		SetVideoDiscard(true);
+		LoadSnapshot(m_rollbackTo);
+		for (int frame = m_rollbackTo; frame < m_frame; frame++)
+		{
+			if (frame > m_rollbackTo)
+				SaveSnapshot(frame);
+			ApplyInputs(frame);
+			m_model3->RunFrame(false);
+		}
+		SetAudioDiscard(false);
+		SetVideoDiscard(false);
+
+		m_rollbackTo = -1;
+	}
+
+	if (!CompareChecks())
+		return FAIL;
+
+	SendInputs();
+
+	SaveSnapshot(m_frame);
+	ApplyInputs(m_frame);
+	m_model3->RunFrame(displayFrame);
+
+	m_frame++;
+	m_stats.frames++;
+	return OKAY;
+}
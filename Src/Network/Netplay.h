@@ -0,0 +1,174 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef INCLUDED_NETPLAY_H
+#define INCLUDED_NETPLAY_H
+
+#include <memory>
+#include <vector>
+#include "Types.h"
+#include "BlockFile.h"
+#include "NetTransport.h"
+#include "Util/NewConfig.h"
+
+class IEmulator;
+class CInputs;
+class CInput;
+struct Game;
+
+/*
+ * NetplayStats:
+ *
+ * How a netplay session has gone: frames run, how often and how far it rolled
+ * back, how long it waited for the other player, and how long snapshots took.
+ */
+struct NetplayStats
+{
+	UINT64	frames;
+	UINT64	rollbacks;
+	UINT64	framesRerun;
+	unsigned maxRollback;
+	UINT64	stalls;				// frames held up waiting for the other player's inputs
+	double	saveSeconds;		// total time taken by snapshots
+	double	loadSeconds;		// total time taken by restoring them
+	double	maxSaveSeconds;
+	double	maxLoadSeconds;
+};
+
+/*
+ * CNetplay:
+ *
+ * Two player online play for games that aren't linked, by exchanging inputs
+ * and rolling back. Each player's own inputs are delayed by a few frames and
+ * sent to the other, whose inputs are predicted (as the last received) when
+ * they haven't arrived. When they do and the prediction was wrong, the state
+ * snapshotted before the first wrong frame is restored and the frames since
+ * are run again, unrendered and unheard, with the right inputs.
+ *
+ * Each player uses their player 1 controls. Player 2's are sent as player 2's,
+ * and inputs common to both (service, test, etc.) belong to player 1. Both
+ * machines must start from the same state, i.e. the same ROM set and NVRAM,
+ * which is checked at the start and then every second.
+ *
+ * Snapshots are block files in memory, written with IEmulator::SaveState(),
+ * in buffers that are allocated only once. The emulation must be repeatable,
+ * so it must not be run multi-threaded.
+ */
+class CNetplay
+{
+public:
+	CNetplay(const Util::Config::Node &config, IEmulator *model3, CInputs *inputs, const Game &game);
+	~CNetplay(void);
+
+	/*
+	 * Init(void):
+	 *
+	 * Waits for the other player and checks the two games match. Must be
+	 * called after the emulator has been reset and before the first frame.
+	 *
+	 * Returns:
+	 *    OKAY to start playing, otherwise FAIL. Prints errors.
+	 */
+	bool Init(void);
+
+	/*
+	 * RunFrame(displayFrame):
+	 *
+	 * Runs the next frame with both players' inputs, in place of calling
+	 * IEmulator::RunFrame(). Inputs must have been polled since the last
+	 * call. First rolls back and runs earlier frames again if need be.
+	 *
+	 * Returns:
+	 *    OKAY, or FAIL if the session is over (a player left or the games no
+	 *    longer match). Prints errors.
+	 */
+	bool RunFrame(bool displayFrame);
+
+	const NetplayStats &GetStats(void) const;
+
+private:
+	static const int HISTORY = 64;			// frames of inputs kept; more than delay and rollback window together
+	static const int CHECK_INTERVAL = 60;	// frames between desync checks
+	static const int NUM_CHECKS = 3;
+
+	struct FrameInputs
+	{
+		int		frame;					// -1 if not yet known
+		std::vector<UINT16> values;
+	};
+
+	struct Check
+	{
+		int		frame;					// -1 if none
+		UINT64	hash;
+	};
+
+	void	BuildInputLists(void);
+	void	ReadLocalInputs(std::vector<UINT16> *values);
+	void	ApplyInputs(int frame);
+	void	SendInputs(void);
+	bool	HandleMessage(const std::vector<char> &data);
+	bool	ReceiveInputs(void);
+	bool	WaitForInputs(int frame);
+	bool	CompareChecks(void);
+	void	SaveSnapshot(int frame);
+	void	LoadSnapshot(int frame);
+	UINT64	HashSnapshot(int frame) const;
+
+	const Util::Config::Node &m_config;
+	IEmulator	*m_model3;
+	CInputs		*m_inputs;
+	const Game	&m_game;
+
+	std::unique_ptr<INetSend>		m_send;
+	std::unique_ptr<INetReceive>	m_receive;
+
+	int		m_player;				// 1 or 2
+	int		m_delay;				// frames local inputs are delayed by
+	int		m_window;				// most frames that can be rolled back
+
+	// Inputs in the order they are exchanged. Player 1's are the player 1 and common inputs of the game; player 2's
+	// are its player 2 inputs, read from the matching player 1 ones on player 2's machine.
+	std::vector<CInput *>	m_playerInputs[2];
+	std::vector<CInput *>	m_localSources;		// what the local player's values are read from
+
+	FrameInputs	m_local[HISTORY];
+	FrameInputs	m_remote[HISTORY];			// as received
+	FrameInputs	m_used[HISTORY];			// remote inputs each frame was last run with
+	std::vector<UINT16> m_lastRemote;		// prediction for frames not yet received
+	std::vector<char> m_message;			// being sent
+	int		m_frame;						// next frame to run
+	int		m_confirmed;					// remote inputs are known up to and including this frame
+	int		m_peerConfirmed;				// and the other player knows ours up to this one
+	int		m_rollbackTo;					// earliest frame run with a wrong prediction, or -1
+
+	std::vector<std::vector<uint8_t>>	m_snapshots;	// state at the start of a frame, by frame % size
+	std::vector<int>					m_snapshotFrames;
+	CBlockFile							m_state;		// reused, for its block index
+
+	Check	m_localChecks[NUM_CHECKS];			// by frame / CHECK_INTERVAL % NUM_CHECKS
+	Check	m_remoteCheck;
+
+	NetplayStats	m_stats;
+};
+
+#endif	// INCLUDED_NETPLAY_H
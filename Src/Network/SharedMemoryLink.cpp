@@ -0,0 +1,263 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "SharedMemoryLink.h"
+#include "OSD/Logger.h"
+#include "Util/MappedMemory.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+static const UINT32 RING_BYTES	= 1 << 20;		// sixteen of the largest messages
+static const UINT32 RING_MAGIC	= 0x4D334C4B;	// "KL3M"
+
+struct SharedLinkRing
+{
+	std::atomic<UINT32>	magic;		// set once a receiver has emptied the ring
+	std::atomic<UINT32>	session;	// bumped each time a receiver opens the ring, 0 once it has closed it
+	std::atomic<UINT32>	sender;		// session a sender is attached to, 0 if none
+	alignas(64) std::atomic<UINT32>	write;		// total bytes written, only by the sender
+	alignas(64) std::atomic<UINT32>	read;		// total bytes read, only by the receiver
+	alignas(64) char	data[RING_BYTES];
+};
+
+static_assert(std::atomic<UINT32>::is_always_lock_free, "the ring's atomics must be lock-free to work across processes");
+
+static std::string RingName(int port)
+{
+	return "supermodel-link-" + std::to_string(port);
+}
+
+// Waits for ready() to be true, as for INetReceive::CheckDataAvailable(). Spins at first, since the next message is
+// usually moments away, then yields, then sleeps in short steps.
+template <typename Ready>
+static bool WaitFor(Ready ready, int timeoutMS)
+{
+	using namespace std::chrono;
+
+	if (ready()) {
+		return true;
+	}
+	if (timeoutMS == 0) {
+		return false;
+	}
+
+	auto start = steady_clock::now();
+
+	while (!ready()) {
+
+		auto elapsed = steady_clock::now() - start;
+		if (timeoutMS > 0 && elapsed >= milliseconds(timeoutMS)) {
+			return false;
+		}
+
+		if (elapsed >= milliseconds(2)) {
+			std::this_thread::sleep_for(microseconds(100));
+		}
+		else if (elapsed >= microseconds(200)) {
+			std::this_thread::yield();
+		}
+	}
+
+	return true;
+}
+
+static void CopyIn(SharedLinkRing* ring, UINT32 pos, const void* src, UINT32 length)
+{
+	UINT32 offset = pos & (RING_BYTES - 1);
+	UINT32 first = std::min(length, RING_BYTES - offset);
+	memcpy(ring->data + offset, src, first);
+	memcpy(ring->data, (const char*)src + first, length - first);
+}
+
+static void CopyOut(void* dest, const SharedLinkRing* ring, UINT32 pos, UINT32 length)
+{
+	UINT32 offset = pos & (RING_BYTES - 1);
+	UINT32 first = std::min(length, RING_BYTES - offset);
+	memcpy(dest, ring->data + offset, first);
+	memcpy((char*)dest + first, ring->data, length - first);
+}
+
+SharedMemorySend::SharedMemorySend(int port) :
+	m_name(RingName(port)),
+	m_ring(nullptr),
+	m_session(0)
+{
+}
+
+SharedMemorySend::~SharedMemorySend()
+{
+	Detach();
+}
+
+void SharedMemorySend::Detach()
+{
+	if (m_ring) {
+		UINT32 session = m_session;
+		m_ring->sender.compare_exchange_strong(session, 0);
+		Util::MappedMemory::UnmapShared((uint8_t*)m_ring, sizeof(SharedLinkRing));
+		m_ring = nullptr;
+	}
+}
+
+bool SharedMemorySend::Connect()
+{
+	Detach();
+
+	m_ring = (SharedLinkRing*)Util::MappedMemory::MapShared(m_name, sizeof(SharedLinkRing));
+	if (!m_ring) {
+		return false;
+	}
+
+	// the next machine's receiver may not have opened the ring yet
+	m_session = m_ring->session.load(std::memory_order_acquire);
+	if (m_ring->magic.load(std::memory_order_acquire) != RING_MAGIC || m_session == 0) {
+		Detach();
+		return false;
+	}
+
+	m_ring->sender.store(m_session, std::memory_order_release);
+	return true;
+}
+
+bool SharedMemorySend::Connected()
+{
+	return m_ring && m_ring->session.load(std::memory_order_acquire) == m_session;
+}
+
+bool SharedMemorySend::Send(const void* data, int length)
+{
+	if (!Connected()) {
+		return false;
+	}
+
+	UINT32 size = UINT32(length);
+	UINT32 need = UINT32(sizeof(size)) + size;
+	if (length < 0 || need > RING_BYTES) {
+		return false;
+	}
+
+	// wait for the receiver to make room, giving up if it has stopped reading
+	UINT32 write = m_ring->write.load(std::memory_order_relaxed);
+	bool room = WaitFor([&] { return RING_BYTES - (write - m_ring->read.load(std::memory_order_acquire)) >= need || !Connected(); }, 1000);
+	if (!room || !Connected()) {
+		ErrorLog("Net board lost the shared memory link to the next machine.");
+		Detach();
+		return false;
+	}
+
+	CopyIn(m_ring, write, &size, sizeof(size));
+	CopyIn(m_ring, write + sizeof(size), data, size);
+	m_ring->write.store(write + need, std::memory_order_release);
+
+	return true;
+}
+
+SharedMemoryReceive::SharedMemoryReceive(int port) :
+	m_name(RingName(port)),
+	m_ring(nullptr)
+{
+	m_recBuffer.reserve(NET_MAX_MESSAGE);
+
+	m_ring = (SharedLinkRing*)Util::MappedMemory::MapShared(m_name, sizeof(SharedLinkRing));
+	if (!m_ring) {
+		ErrorLog("Unable to map shared memory for the net board link '%s'.", m_name.c_str());
+		return;
+	}
+
+	// empty the ring, which may be left from an earlier run, with any sender still attached to it shut out
+	UINT32 session = m_ring->session.exchange(0);
+	m_ring->write.store(0, std::memory_order_relaxed);
+	m_ring->read.store(0, std::memory_order_relaxed);
+	m_ring->sender.store(0, std::memory_order_relaxed);
+	m_ring->session.store(std::max(session + 1, 1u), std::memory_order_release);
+	m_ring->magic.store(RING_MAGIC, std::memory_order_release);
+}
+
+SharedMemoryReceive::~SharedMemoryReceive()
+{
+	if (m_ring) {
+		m_ring->session.store(0, std::memory_order_release);
+		Util::MappedMemory::UnmapShared((uint8_t*)m_ring, sizeof(SharedLinkRing));
+		Util::MappedMemory::UnlinkShared(m_name);
+		m_ring = nullptr;
+	}
+}
+
+bool SharedMemoryReceive::CheckDataAvailable(int timeoutMS)
+{
+	if (!m_ring) {
+		return false;
+	}
+
+	return WaitFor([this] { return m_ring->write.load(std::memory_order_acquire) != m_ring->read.load(std::memory_order_relaxed); }, timeoutMS);
+}
+
+std::vector<char>& SharedMemoryReceive::Receive()
+{
+	m_recBuffer.clear();
+
+	if (!m_ring) {
+		return m_recBuffer;
+	}
+
+	// wait for a message, unless the sender has gone with nothing left to read
+	UINT32 read = m_ring->read.load(std::memory_order_relaxed);
+	auto available = [&] { return m_ring->write.load(std::memory_order_acquire) != read; };
+	WaitFor([&] { return available() || !Connected(); }, -1);
+	if (!available()) {
+		return m_recBuffer;
+	}
+
+	UINT32 size;
+	CopyOut(&size, m_ring, read, sizeof(size));
+
+	// reserve our space, which only allocates for a message larger than any before
+	CountNetBuffer(size_t(size) > m_recBuffer.capacity());
+	m_recBuffer.resize(size);
+	CopyOut(m_recBuffer.data(), m_ring, read + sizeof(size), size);
+
+	m_ring->read.store(read + UINT32(sizeof(size)) + size, std::memory_order_release);
+
+	return m_recBuffer;
+}
+
+bool SharedMemoryReceive::Connected()
+{
+	if (!m_ring) {
+		return false;
+	}
+
+	UINT32 sender = m_ring->sender.load(std::memory_order_acquire);
+	return sender != 0 && sender == m_ring->session.load(std::memory_order_relaxed);
+}
+
+bool SharedMemoryReceive::WaitConnected(int timeoutMS)
+{
+	if (!m_ring) {
+		return false;
+	}
+
+	return WaitFor([this] { return Connected(); }, timeoutMS);
+}
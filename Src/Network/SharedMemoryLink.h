@@ -0,0 +1,72 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _SHAREDMEMORYLINK_H_
+#define _SHAREDMEMORYLINK_H_
+
+#include <string>
+#include <vector>
+#include "NetBuffers.h"
+#include "NetTransport.h"
+
+struct SharedLinkRing;
+
+// Links machines running on the same PC through a ring in memory shared between their processes, named after the port
+// it stands in for. Messages are copied in and out without any system calls, and waiting for one spins briefly before
+// yielding and then sleeping, as the next is usually moments away. The receiver creates the ring and empties it; a
+// sender attaches to whichever receiver has it, and counts as disconnected once that one goes away.
+class SharedMemorySend : public INetSend
+{
+public:
+	SharedMemorySend(int port);
+	~SharedMemorySend();
+
+	bool Send(const void* data, int length) override;
+	bool Connect() override;
+	bool Connected() override;
+
+private:
+	void Detach();
+
+	std::string		m_name;
+	SharedLinkRing*	m_ring;
+	UINT32			m_session;		// receiver's session attached to
+};
+
+class SharedMemoryReceive : public INetReceive
+{
+public:
+	SharedMemoryReceive(int port);
+	~SharedMemoryReceive();
+
+	bool CheckDataAvailable(int timeoutMS = 0) override;		// timeoutMS -1 = wait forever until data arrives, 0 = no waiting, 1+ wait time in milliseconds
+	std::vector<char>& Receive() override;
+	bool Connected() override;
+	bool WaitConnected(int timeoutMS) override;
+
+private:
+	std::string			m_name;
+	SharedLinkRing*		m_ring;
+	std::vector<char>	m_recBuffer;
+};
+
+#endif
@@ -20,10 +20,13 @@
  ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include "Supermodel.h"
 #include "SimNetBoard.h"
+#include "NetDelta.h"
+#include "NetPacing.h"
 
  // these make 16-bit read/writes much neater
 #define RAM16 *(uint16_t*)&RAM
@@ -45,6 +48,7 @@ CSimNetBoard::CSimNetBoard(const Util::Config::Node& config) : m_config(config)
 CSimNetBoard::~CSimNetBoard(void)
 {
 	m_running = false;
+	m_connector.Cancel();
 
 	if (m_connectThread.joinable())
 		m_connectThread.join();
@@ -86,8 +90,15 @@ bool CSimNetBoard::Init(uint8_t* netRAMPtr, uint8_t* netBufferPtr)
 	port_out = m_config["PortOut"].ValueAs<unsigned>();
 	addr_out = m_config["AddressOut"].ValueAs<std::string>();
 
-	nets = std::make_unique<TCPSend>(addr_out, port_out);
-	netr = std::make_unique<TCPReceive>(port_in);
+	CreateNetTransport(m_config, nets, netr);
+
+	std::string relay = m_config["NetRelay"].ValueAsDefault<std::string>("ring");
+	if (relay == "mesh" && IsGame("spikeofe"))
+		ErrorLog("Net relay 'mesh' is not supported by this game; using 'ring'.");	// relies on the whole ring being sent each frame
+	else if (relay == "mesh")
+		m_mesh = std::make_unique<NetMesh>(m_config["PortMesh"].ValueAsDefault<unsigned>(1972), m_config["NetPeers"].ValueAsDefault<std::string>(""));
+	else if (relay != "ring")
+		ErrorLog("Unknown net relay '%s'; using 'ring'.", relay.c_str());
 
 	return 0;
 }
@@ -258,7 +269,8 @@ void CSimNetBoard::RunFrame(void)
 			CommRAM16[0xc] = FLIPENDIAN16(0x100);
 			CommRAM16[0xe] = FLIPENDIAN16(RAM16[0x402] - m_segmentSize + 0x200);
 
-			m_state = State::ready;
+			m_machineIndex = machineIndex;
+			m_state = StartMesh() ? State::ready : State::error;
 		}
 		else
 		{
@@ -449,18 +461,28 @@ void CSimNetBoard::RunFrame(void)
 			CommRAM16[0xc] = FLIPENDIAN16(0x100);
 			CommRAM16[0xe] = FLIPENDIAN16(RAM16[0x206] + 0x80);
 
-			m_state = State::ready;
+			m_machineIndex = machineIndex.total;
+			m_state = StartMesh() ? State::ready : State::error;
+			SetNetPacingFollower(m_config["NetPacing"].ValueAsDefault<bool>(false) && m_machineIndex != 0);
 		}
 		break;
 
 	case State::ready:
+	{
 		m_counter++;
+		CountNetLinkFrame();
 		CommRAM16[0x6] = FLIPENDIAN16(m_counter);
+
+		// time spent waiting on the link paces this machine against the others
+		auto start = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::duration waited(0);
 		
 		if (IsGame("spikeofe"))	// temporary hack for spikeout final edition (avoids comm error)
 		{
 			nets->Send(CommRAM + 0x100, m_segmentSize * m_numMachines);
+			start = std::chrono::steady_clock::now();
 			auto& recv_data = netr->Receive();
+			waited += std::chrono::steady_clock::now() - start;
 			if (recv_data.size() == 0)
 			{
 				// link broken - send an "empty" packet to alert other machines
@@ -471,6 +493,19 @@ void CSimNetBoard::RunFrame(void)
 			}
 			memcpy(CommRAM + 0x100 + m_segmentSize, recv_data.data(), recv_data.size());
 		}
+		else if (m_mesh)
+		{
+			bool exchanged = ExchangeMesh();
+			waited += std::chrono::steady_clock::now() - start;
+			if (!exchanged)
+			{
+				// link broken - send an "empty" segment to alert other machines
+				m_mesh->Send(m_machineIndex, nullptr, 0);
+				m_state = State::error;
+				if (m_gameType == GameType::one)
+					ioreg16[0x8a] = 0x40;			// send "link broken" message to mainboard
+			}
+		}
 		else
 		{
 			// we only send what we need to; helps cut down on bandwidth
@@ -478,7 +513,9 @@ void CSimNetBoard::RunFrame(void)
 			for (int i = 0; i < m_numMachines; i++)
 			{
 				nets->Send(CommRAM + 0x100 + i * m_segmentSize, m_segmentSize);
+				start = std::chrono::steady_clock::now();
 				auto& recv_data = netr->Receive();
+				waited += std::chrono::steady_clock::now() - start;
 				if (recv_data.size() == 0)
 				{
 					// link broken - send an "empty" packet to alert other machines
@@ -491,8 +528,11 @@ void CSimNetBoard::RunFrame(void)
 				memcpy(CommRAM + 0x100 + (i + 1) * m_segmentSize, recv_data.data(), recv_data.size());
 			}
 		}
-		
+
+		if (m_state == State::ready)
+			PaceNetFrame(UINT32(std::chrono::duration_cast<std::chrono::microseconds>(waited).count()));
 		break;
+	}
 
 	case State::error:
 		// do nothing
@@ -503,7 +543,11 @@ void CSimNetBoard::RunFrame(void)
 void CSimNetBoard::Reset(void)
 {
 	// if netboard was active, send an "empty" packet so the other machines don't get stuck waiting for data
-	if (m_state == State::ready)
+	if (m_state == State::ready && m_mesh)
+	{
+		m_mesh->Send(m_machineIndex, nullptr, 0);
+	}
+	else if (m_state == State::ready)
 	{
 		nets->Send(nullptr, 0);
 		netr->Receive();
@@ -513,6 +557,43 @@ void CSimNetBoard::Reset(void)
 	m_state = State::start;
 }
 
+bool CSimNetBoard::StartMesh(void)
+{
+	if (!m_mesh)
+		return true;
+
+	if (!m_mesh->IsOpen() || m_mesh->NumPeers() != m_numMachines - 1)
+	{
+		ErrorLog("net board mesh has %i peers for %i other linked machines. Make sure NetPeers lists every other machine!", m_mesh->NumPeers(), m_numMachines - 1);
+		return false;
+	}
+
+	return true;
+}
+
+bool CSimNetBoard::ExchangeMesh(void)
+{
+	// rather than relay segments around the ring, one hop per round trip, every machine sends its own segment to all
+	// the others at once and then places theirs where the ring would have: the segment from k machines back goes k
+	// segments along
+	m_mesh->Send(m_machineIndex, CommRAM + 0x100, m_segmentSize);
+
+	if (!m_mesh->Gather(m_numMachines, 5000))
+		return false;
+
+	for (int i = 1; i < m_numMachines; i++)
+	{
+		int from = (m_machineIndex + m_numMachines - i) % m_numMachines;
+		const auto& segment = m_mesh->Segment(from);
+		memcpy(CommRAM + 0x100 + i * m_segmentSize, segment.data(), std::min<size_t>(segment.size(), m_segmentSize));
+	}
+
+	// and last of all our own, as it would have come back around the ring
+	memcpy(CommRAM + 0x100 + m_numMachines * m_segmentSize, CommRAM + 0x100, m_segmentSize);
+
+	return true;
+}
+
 bool CSimNetBoard::IsAttached(void)
 {
 	return m_attached;
@@ -530,26 +611,20 @@ void CSimNetBoard::GetGame(Game gameInfo)
 
 void CSimNetBoard::ConnectProc(void)
 {
-	using namespace std::chrono_literals;
-
 	if (m_connected)
 		return;
 
 	printf("Connecting to %s:%i ..\n", addr_out.c_str(), port_out);
 
-	// wait until TCPSend has connected to the next machine
-	while (!nets->Connect())
-	{
-		if (!m_running)
-			return;
-	}
+	// wait until TCPSend has connected to the next machine, backing off between attempts
+	if (!m_connector.Run("the next machine", [this] { return nets->Connect(); }))
+		return;
 
 	// wait until TCPReceive has accepted a connection from the previous machine
-	while (!netr->Connected())
+	while (!netr->WaitConnected(100))
 	{
 		if (!m_running)
 			return;
-		std::this_thread::sleep_for(1ms);
 	}
 
 	printf("Successfully connected.\n");
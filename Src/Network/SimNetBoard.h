@@ -24,8 +24,8 @@
 #define INCLUDED_SIMNETBOARD_H
 
 #include <cstdint>
-#include "TCPSend.h"
-#include "TCPReceive.h"
+#include "NetTransport.h"
+#include "NetMesh.h"
 #include "INetBoard.h"
 
 enum class State
@@ -77,15 +77,18 @@ private:
 	std::thread m_connectThread;
 	std::atomic_bool m_running = false;
 	std::atomic_bool m_connected = false;
+	NetConnector m_connector;
 
-	std::unique_ptr<TCPSend> nets = nullptr;
-	std::unique_ptr<TCPReceive> netr = nullptr;
+	std::unique_ptr<INetSend> nets = nullptr;
+	std::unique_ptr<INetReceive> netr = nullptr;
+	std::unique_ptr<NetMesh> m_mesh = nullptr;		// NetRelay = mesh
 
 	Game m_gameInfo;
 	GameType m_gameType = GameType::unknown;
 	State m_state = State::start;
 
 	uint8_t m_numMachines = 0;
+	uint8_t m_machineIndex = 0;		// position in the ring, counting relays
 	uint16_t m_counter = 0;
 
 	uint16_t m_segmentSize = 0;
@@ -94,6 +97,8 @@ private:
 
 	inline bool IsGame(const char* gameName);
 	void ConnectProc(void);
+	bool StartMesh(void);
+	bool ExchangeMesh(void);
 };
 
 #endif
\ No newline at end of file
@@ -28,7 +28,7 @@ using namespace std::chrono_literals;
 
 #if defined(_DEBUG)
 #include <stdio.h>
-#define DPRINTF DebugLog
+#define DPRINTF(...) DEBUG_LOG(Net, __VA_ARGS__)
 #else
 #define DPRINTF(a, ...)
 #endif
@@ -36,11 +36,15 @@ using namespace std::chrono_literals;
 TCPReceive::TCPReceive(int port) :
 	m_listenSocket(nullptr),
 	m_receiveSocket(nullptr),
-	m_socketSet(nullptr)
+	m_socketSet(nullptr),
+	m_listenSet(nullptr),
+	m_running(false)
 {
 	SDLNet_Init();
 
+	m_recBuffer.reserve(NET_MAX_MESSAGE);
 	m_socketSet = SDLNet_AllocSocketSet(1);
+	m_listenSet = SDLNet_AllocSocketSet(1);
 
 	IPaddress ip;
 	int result = SDLNet_ResolveHost(&ip, nullptr, port);
@@ -48,6 +52,7 @@ TCPReceive::TCPReceive(int port) :
 	if (result == 0) {
 		m_listenSocket = SDLNet_TCP_Open(&ip);
 		if (m_listenSocket) {
+			SDLNet_TCP_AddSocket(m_listenSet, m_listenSocket);
 			m_running = true;
 			m_listenThread = std::thread(&TCPReceive::ListenFunc, this);
 		}
@@ -56,7 +61,11 @@ TCPReceive::TCPReceive(int port) :
 
 TCPReceive::~TCPReceive()
 {
-	m_running = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
 
 	if (m_listenThread.joinable()) {
 		m_listenThread.join();
@@ -77,6 +86,11 @@ TCPReceive::~TCPReceive()
 		m_socketSet = nullptr;
 	}
 
+	if (m_listenSet) {
+		SDLNet_FreeSocketSet(m_listenSet);
+		m_listenSet = nullptr;
+	}
+
 	SDLNet_Quit();
 }
 
@@ -103,11 +117,12 @@ std::vector<char>& TCPReceive::Receive()
 	result = SDLNet_TCP_Recv(m_receiveSocket, &size, sizeof(int));
 	DPRINTF("Received %i bytes\n", result);
 	if (result <= 0) {
-		SDLNet_TCP_Close(m_receiveSocket);
-		m_receiveSocket = nullptr;
+		CloseReceiveSocket();
+		size = 0;
 	}
 
-	// reserve our space
+	// reserve our space, which only allocates for a message larger than any before
+	CountNetBuffer(size_t(size) > m_recBuffer.capacity());
 	m_recBuffer.resize(size);
 
 	while (size) {
@@ -115,8 +130,7 @@ std::vector<char>& TCPReceive::Receive()
 		result = SDLNet_TCP_Recv(m_receiveSocket, m_recBuffer.data() + (m_recBuffer.size() - size), size);
 		DPRINTF("Received %i bytes\n", result);
 		if (result <= 0) {
-			SDLNet_TCP_Close(m_receiveSocket);
-			m_receiveSocket = nullptr;
+			CloseReceiveSocket();
 			break;
 		}
 
@@ -128,32 +142,70 @@ std::vector<char>& TCPReceive::Receive()
 
 void TCPReceive::ListenFunc()
 {
+	auto start = std::chrono::steady_clock::now();
+
 	while (m_running) {
 
-		std::this_thread::sleep_for(16ms);
-		if (m_receiveSocket) continue;
+		// nothing to do while connected, other than wait for the connection to close
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this] { return !m_running || !m_receiveSocket; });
+			if (!m_running) {
+				break;
+			}
+		}
+
+		// wait in select() for a connection, waking now and then to see if we're shutting down
+		if (SDLNet_CheckSockets(m_listenSet, 100) <= 0) {
+			continue;
+		}
 
 		auto socket = SDLNet_TCP_Accept(m_listenSocket);
 
 		if (socket) {
 
-			// remove old socket if required from socket set
-			if (m_receiveSocket) {
-				SDLNet_DelSocket(m_socketSet, (SDLNet_GenericSocket)m_receiveSocket.load());
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_receiveSocket = socket;
+				SDLNet_AddSocket(m_socketSet, (SDLNet_GenericSocket)socket);
 			}
+			m_cv.notify_all();
 
-			m_receiveSocket = socket;
-
-			SDLNet_AddSocket(m_socketSet, (SDLNet_GenericSocket)socket);
-
-			// add socket to socket set
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			InfoLog("Net board accepted a connection from the previous machine after %.0f ms.", elapsed.count());
 			DPRINTF("Accepted connection.\n");
 		}
 
 	}
 }
 
+void TCPReceive::CloseReceiveSocket()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		SDLNet_DelSocket(m_socketSet, (SDLNet_GenericSocket)m_receiveSocket.load());
+		SDLNet_TCP_Close(m_receiveSocket);
+		m_receiveSocket = nullptr;
+	}
+	m_cv.notify_all();		// listen for the next connection
+}
+
 bool TCPReceive::Connected()
 {
 	return (m_receiveSocket != 0);
+}
+
+bool TCPReceive::WaitConnected(int timeoutMS)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto ready = [this] { return !m_running || m_receiveSocket; };
+
+	if (timeoutMS < 0) {
+		m_cv.wait(lock, ready);
+	}
+	else {
+		m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMS), ready);
+	}
+
+	return Connected();
 }
\ No newline at end of file
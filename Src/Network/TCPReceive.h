@@ -25,28 +25,37 @@
 
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
+#include "NetBuffers.h"
+#include "NetTransport.h"
 #include "SDLIncludes.h"
 
-class TCPReceive
+class TCPReceive : public INetReceive
 {
 public:
 	TCPReceive(int port);
 	~TCPReceive();
 
-	bool CheckDataAvailable(int timeoutMS = 0);		// timeoutMS -1 = wait forever until data arrives, 0 = no waiting, 1+ wait time in milliseconds
-	std::vector<char>& Receive();
-	bool Connected();
+	bool CheckDataAvailable(int timeoutMS = 0) override;		// timeoutMS -1 = wait forever until data arrives, 0 = no waiting, 1+ wait time in milliseconds
+	std::vector<char>& Receive() override;
+	bool Connected() override;
+	bool WaitConnected(int timeoutMS) override;
 
 private:
 
 	void ListenFunc();
+	void CloseReceiveSocket();
 
 	TCPsocket m_listenSocket;
 	std::atomic<TCPsocket> m_receiveSocket;
 	SDLNet_SocketSet m_socketSet;
+	SDLNet_SocketSet m_listenSet;		// just the listen socket, ready when a connection is waiting
 	std::thread m_listenThread;
 	std::atomic_bool m_running;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;		// signalled when a connection is accepted or closed
 	std::vector<char> m_recBuffer;
 };
 
@@ -22,10 +22,11 @@
 
 #include "TCPSend.h"
 #include "OSD/Logger.h"
+#include <cstring>
 
 #if defined(_DEBUG)
 #include <stdio.h>
-#define DPRINTF DebugLog
+#define DPRINTF(...) DEBUG_LOG(Net, __VA_ARGS__)
 #else
 #define DPRINTF(a, ...)
 #endif
@@ -38,6 +39,8 @@ TCPSend::TCPSend(std::string& ip, int port) :
 	m_socket(nullptr)
 {
 	SDLNet_Init();
+
+	m_sendBuffer.reserve(NET_MAX_MESSAGE + sizeof(int));
 }
 
 TCPSend::~TCPSend()
@@ -60,16 +63,20 @@ bool TCPSend::Send(const void * data, int length)
 
 	DPRINTF("Sending %i bytes\n", length);
 
-	int sent = 0;
-
-	sent = SDLNet_TCP_Send(m_socket, &length, sizeof(int));		// pack the length at the start of transmission.
+	// SDL_net can't gather the length and the data into one send, so they are put together in a buffer reserved up
+	// front, which is one copy but saves sending the length in a segment of its own
+	int sendSize = int(sizeof(int)) + length;
+	CountNetBuffer(size_t(sendSize) > m_sendBuffer.capacity());
 
-	if (!length)
-		return true;		// 0 sized packet will blow our connex
+	m_sendBuffer.resize(sendSize);
+	memcpy(m_sendBuffer.data(), &length, sizeof(int));		// pack the length at the start of transmission.
+	if (length) {
+		memcpy(m_sendBuffer.data() + sizeof(int), data, length);
+	}
 
-	sent = SDLNet_TCP_Send(m_socket, data, length);
+	int sent = SDLNet_TCP_Send(m_socket, m_sendBuffer.data(), sendSize);
 
-	if (sent < length) {
+	if (sent < sendSize) {
 		SDLNet_TCP_Close(m_socket);
 		m_socket = nullptr;
 	}
@@ -24,22 +24,26 @@
 #define _TCPSEND_H_
 
 #include <string>
+#include <vector>
+#include "NetBuffers.h"
+#include "NetTransport.h"
 #include "SDLIncludes.h"
 
-class TCPSend
+class TCPSend : public INetSend
 {
 public:
 	TCPSend(std::string& ip, int port);
 	~TCPSend();
 
-	bool Send(const void* data, int length);
-	bool Connect();
-	bool Connected();
+	bool Send(const void* data, int length) override;
+	bool Connect() override;
+	bool Connected() override;
 private:
 
 	std::string	m_ip;
 	int			m_port;
 	TCPsocket	m_socket;		// sdl socket
+	std::vector<char> m_sendBuffer;	// length and message, sent together
 
 };
 
@@ -26,7 +26,7 @@
 
 #if defined(_DEBUG)
 #include <stdio.h>
-#define DPRINTF DebugLog
+#define DPRINTF(...) DEBUG_LOG(Net, __VA_ARGS__)
 #else
 #define DPRINTF(a, ...)
 #endif
@@ -37,7 +37,10 @@ TCPSendAsync::TCPSendAsync(std::string& ip, int port) :
 	m_ip(ip),
 	m_port(port),
 	m_socket(nullptr),
-	m_hasData(false)
+	m_running(true),
+	m_pool(NET_MAX_MESSAGE + 4, QUEUE_SIZE),
+	m_head(0),
+	m_count(0)
 {
 	SDLNet_Init();
 
@@ -53,15 +56,19 @@ TCPSendAsync::~TCPSendAsync()
 
 	{
 		std::unique_lock<std::mutex> lock(m_mutex);
-		m_dataBuffers.clear();
-		m_hasData = true;		// must set data ready in case of spurious wake up 
-		m_cv.notify_one();		// tell locked thread it can wake up
+		m_running = false;
+		m_cv.notify_all();		// tell locked thread it can wake up
 	}
 
 	if (m_sendThread.joinable()) {
 		m_sendThread.join();
 	}
 
+	for (; m_count; m_count--) {
+		m_pool.Release(m_queue[m_head]);
+		m_head = (m_head + 1) % QUEUE_SIZE;
+	}
+
 	SDLNet_Quit();	// unload lib (winsock dll for windows)
 }
 
@@ -79,18 +86,25 @@ bool TCPSendAsync::Send(const void * data, int length)
 		return true;		// 0 sized packet will blow our connex
 	}
 
-	auto dataBuffer = std::unique_ptr<char[]>(new char[length+4]);
+	// the data must be copied as the caller is free to change it once we return, but into a block that is reused
+	char* dataBuffer = m_pool.Acquire(length + 4);
 
-	*((int32_t*)dataBuffer.get()) = length;				// set start of buffer to length
-	memcpy(dataBuffer.get() + 4, data, length);		// copy the rest of the data
+	*((int32_t*)dataBuffer) = length;				// set start of buffer to length
+	memcpy(dataBuffer + 4, data, length);		// copy the rest of the data
 
-	// lock our array and signal to other thread data is ready
+	// queue the block and signal to other thread data is ready, waiting if it has fallen far behind
 	{
 		std::unique_lock<std::mutex> lock(m_mutex);
-		m_dataBuffers.emplace_back(std::move(dataBuffer));
-		
-		m_hasData = true;	// must set data ready in case of spurious wake up 
-		m_cv.notify_one();	// tell locked thread it can wake up
+		m_cv.wait(lock, [this] { return m_count < QUEUE_SIZE || !m_running; });
+
+		if (!m_running) {
+			m_pool.Release(dataBuffer);
+			return false;
+		}
+
+		m_queue[(m_head + m_count) % QUEUE_SIZE] = dataBuffer;
+		m_count++;
+		m_cv.notify_all();	// tell locked thread it can wake up
 	}
 
 	return true;
@@ -105,49 +119,42 @@ void TCPSendAsync::SendThread()
 {
 	while (true) {
 
-		std::unique_ptr<char[]> sendData;
+		char* sendData;
 
 		{
 			std::unique_lock<std::mutex> lock(m_mutex);
-			m_cv.wait(lock, [this] { return m_hasData.load(); });
+			m_cv.wait(lock, [this] { return m_count > 0 || !m_running; });
 
-			if (m_dataBuffers.empty()) {
-				return;					// if we have woken up with no data assume we need to exit the thread
+			if (!m_running) {
+				return;
 			}
 
-			auto front = m_dataBuffers.begin();
-			sendData = std::move(*front);
-			m_dataBuffers.erase(front);
-			m_hasData = false;		// potentially we could still have data in pipe, we'll set this at the bottom
+			// the block stays at the head of the queue, and so out of Send()'s way, until it has gone
+			sendData = m_queue[m_head];
 
 			// unlock mutex now so we don't block whilst sending
 		}
 
-		if (sendData == nullptr) {
-			break;		// shouldn't be able to get here
+		// get send size (which is packed at the start of the data
+		auto sendSize = *((int32_t*)sendData) + 4;		// send size doesn't include 'header'
+
+		int sent = SDLNet_TCP_Send(m_socket, sendData, sendSize);		// pack the length at the start of transmission.
+
+		// we have finished with this buffer so hand it back to the pool
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_head = (m_head + 1) % QUEUE_SIZE;
+			m_count--;
+			m_cv.notify_all();
 		}
 
-		// get send size (which is packed at the start of the data
-		auto sendSize = *((int32_t*)sendData.get()) + 4;		// send size doesn't include 'header'
+		m_pool.Release(sendData);
 
-		int sent = SDLNet_TCP_Send(m_socket, sendData.get(), sendSize);		// pack the length at the start of transmission.
 		if (sent < sendSize) {
 			SDLNet_TCP_Close(m_socket);
 			m_socket = nullptr;
 			break;
 		}
-
-		// we have finished with this buffer so release the data
-		sendData = nullptr;
-
-		//check if we still have data in the pipe, if so set ready state again
-		{
-			std::unique_lock<std::mutex> lock(m_mutex);
-			if (m_dataBuffers.size()) {
-				m_hasData = true;
-				m_cv.notify_one();
-			}
-		}
 	}
 }
 
@@ -30,6 +30,7 @@
 #include <atomic>
 #include <memory>
 #include <thread>
+#include "NetBuffers.h"
 #include "SDLIncludes.h"
 
 class TCPSendAsync
@@ -43,18 +44,22 @@ public:
 	bool Connected();
 private:
 
+	static const int QUEUE_SIZE = 8;			// messages waiting to be sent, before Send() waits for room
+
 	void SendThread();
 
 	std::string				m_ip;
 	int						m_port;
 	TCPsocket				m_socket;		// sdl socket
-	std::atomic<bool>		m_hasData;
+	bool					m_running;
 	std::condition_variable m_cv;
-	std::vector<char>		m_buffer;
 	std::mutex				m_mutex;
 	std::thread				m_sendThread;
 
-	std::vector<std::unique_ptr<char[]>> m_dataBuffers;	// each pointer is to an array of data. First word is the size of the data
+	NetBufferPool			m_pool;
+	char*					m_queue[QUEUE_SIZE];	// each is a block from the pool. First word is the size of the data
+	int						m_head;
+	int						m_count;
 
 };
 
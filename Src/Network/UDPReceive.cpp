@@ -0,0 +1,201 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "UDPReceive.h"
+#include "OSD/Logger.h"
+#include <cstring>
+
+#if defined(_DEBUG)
+#include <stdio.h>
+#define DPRINTF(...) DEBUG_LOG(Net, __VA_ARGS__)
+#else
+#define DPRINTF(a, ...)
+#endif
+
+static const UINT32 RESYNC_DISTANCE = 0x10000;	// sequence numbers this far behind mean the sender has restarted
+
+UDPReceive::UDPReceive(int port) :
+	m_socket(nullptr),
+	m_socketSet(nullptr),
+	m_packet(nullptr),
+	m_head(0),
+	m_count(0),
+	m_synced(false),
+	m_nextSequence(0),
+	m_lost(0)
+{
+	SDLNet_Init();
+
+	m_socketSet = SDLNet_AllocSocketSet(1);
+	m_packet = SDLNet_AllocPacket(UDP_MAX_PACKET);
+
+	for (auto& message : m_ring) {
+		message.reserve(UDP_MAX_PACKET);
+	}
+	m_current.reserve(UDP_MAX_PACKET);
+
+	m_socket = SDLNet_UDP_Open(port);
+	if (m_socket) {
+		SDLNet_UDP_AddSocket(m_socketSet, m_socket);
+	}
+}
+
+UDPReceive::~UDPReceive()
+{
+	if (m_lost) {
+		DEBUG_LOG(Net, "UDP link lost %llu messages\n", (unsigned long long)m_lost);
+	}
+
+	if (m_socket) {
+		SDLNet_UDP_Close(m_socket);
+		m_socket = nullptr;
+	}
+
+	if (m_socketSet) {
+		SDLNet_FreeSocketSet(m_socketSet);
+		m_socketSet = nullptr;
+	}
+
+	SDLNet_FreePacket(m_packet);
+
+	SDLNet_Quit();
+}
+
+void UDPReceive::ReadPacket()
+{
+	if (SDLNet_UDP_Recv(m_socket, m_packet) <= 0) {
+		return;
+	}
+
+	const UINT8* data = m_packet->data;
+	int size = m_packet->len;
+
+	UDPPacketHeader header;
+	if (size < int(sizeof(header))) {
+		return;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != UDP_PACKET_MAGIC) {
+		return;
+	}
+
+	int pos = int(sizeof(header));
+
+	for (UINT32 i = 0; i < header.count; i++) {
+
+		UDPMessageHeader messageHeader;
+		if (size - pos < int(sizeof(messageHeader))) {
+			return;
+		}
+		memcpy(&messageHeader, data + pos, sizeof(messageHeader));
+		pos += int(sizeof(messageHeader));
+		if (UINT32(size - pos) < messageHeader.length) {
+			return;
+		}
+
+		// a sender starting again begins numbering from 1
+		if (m_synced && m_nextSequence - messageHeader.sequence > RESYNC_DISTANCE && messageHeader.sequence < m_nextSequence) {
+			m_synced = false;
+		}
+
+		if (!m_synced || messageHeader.sequence >= m_nextSequence) {
+
+			if (m_synced && messageHeader.sequence > m_nextSequence) {
+				m_lost += messageHeader.sequence - m_nextSequence;
+				DPRINTF("Lost %u messages\n", messageHeader.sequence - m_nextSequence);
+			}
+
+			// drop the oldest message if full
+			if (m_count == RING_SIZE) {
+				m_head = (m_head + 1) % RING_SIZE;
+				m_count--;
+				m_lost++;
+			}
+
+			auto& message = m_ring[(m_head + m_count) % RING_SIZE];
+			CountNetBuffer(messageHeader.length > message.capacity());
+			message.assign((const char*)data + pos, (const char*)data + pos + messageHeader.length);
+			m_count++;
+
+			m_synced = true;
+			m_nextSequence = messageHeader.sequence + 1;
+		}
+
+		pos += int(messageHeader.length);
+	}
+}
+
+void UDPReceive::ReadPackets(int timeoutMS)
+{
+	if (SDLNet_CheckSockets(m_socketSet, timeoutMS < 0 ? ~0u : Uint32(timeoutMS)) <= 0) {
+		return;
+	}
+
+	// take everything that has arrived
+	do {
+		ReadPacket();
+	} while (SDLNet_CheckSockets(m_socketSet, 0) > 0);
+}
+
+bool UDPReceive::CheckDataAvailable(int timeoutMS)
+{
+	if (!m_socket) {
+		return false;
+	}
+
+	if (m_count == 0) {
+		ReadPackets(timeoutMS);
+	}
+
+	return m_count > 0;
+}
+
+std::vector<char>& UDPReceive::Receive()
+{
+	if (!m_socket) {
+		DPRINTF("Can't receive because no socket.\n");
+		m_current.clear();
+		return m_current;
+	}
+
+	while (m_count == 0) {
+		ReadPackets(-1);
+	}
+
+	// swap the message out of the ring so that it stays valid until the next call
+	m_current.swap(m_ring[m_head]);
+	m_head = (m_head + 1) % RING_SIZE;
+	m_count--;
+
+	return m_current;
+}
+
+bool UDPReceive::Connected()
+{
+	// nothing to wait for other than the socket being open
+	return m_socket != 0;
+}
+
+bool UDPReceive::WaitConnected(int timeoutMS)
+{
+	return Connected();
+}
@@ -0,0 +1,64 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _UDPRECEIVE_H_
+#define _UDPRECEIVE_H_
+
+#include <vector>
+#include "NetBuffers.h"
+#include "NetTransport.h"
+#include "SDLIncludes.h"
+
+// Receives the packets of a UDPSend, passing on each message once and in order. Messages lost along with every packet
+// holding them are skipped. Received messages wait in a ring allocated up front, the oldest being dropped if it fills.
+class UDPReceive : public INetReceive
+{
+public:
+	UDPReceive(int port);
+	~UDPReceive();
+
+	bool CheckDataAvailable(int timeoutMS = 0) override;		// timeoutMS -1 = wait forever until data arrives, 0 = no waiting, 1+ wait time in milliseconds
+	std::vector<char>& Receive() override;
+	bool Connected() override;
+	bool WaitConnected(int timeoutMS) override;
+
+private:
+
+	static const int RING_SIZE = 16;
+
+	void ReadPackets(int timeoutMS);
+	void ReadPacket();
+
+	UDPsocket m_socket;
+	SDLNet_SocketSet m_socketSet;
+	UDPpacket* m_packet;
+
+	std::vector<char> m_ring[RING_SIZE];
+	int m_head;				// oldest message
+	int m_count;
+	std::vector<char> m_current;	// last returned by Receive
+	bool m_synced;			// a message has been received, so m_nextSequence is known
+	UINT32 m_nextSequence;
+	UINT64 m_lost;			// messages never received
+};
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "UDPSend.h"
+#include "OSD/Logger.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std::chrono_literals;
+
+#if defined(_DEBUG)
+#include <stdio.h>
+#define DPRINTF(...) DEBUG_LOG(Net, __VA_ARGS__)
+#else
+#define DPRINTF(a, ...)
+#endif
+
+static const auto RESEND_INTERVAL = 16ms;	// about a frame
+
+UDPSend::UDPSend(std::string& ip, int port, int redundancy) :
+	m_ip(ip),
+	m_port(port),
+	m_redundancy(std::min(std::max(redundancy, 1), MAX_REDUNDANCY)),
+	m_socket(nullptr),
+	m_packet(nullptr),
+	m_sequence(0),
+	m_running(false)
+{
+	SDLNet_Init();
+
+	m_packet = SDLNet_AllocPacket(UDP_MAX_PACKET);
+	m_packet->len = 0;
+
+	for (auto& message : m_history) {
+		message.reserve(UDP_MAX_PACKET);
+	}
+}
+
+UDPSend::~UDPSend()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_cv.notify_all();
+
+	if (m_resendThread.joinable()) {
+		m_resendThread.join();
+	}
+
+	if (m_socket) {
+		SDLNet_UDP_Close(m_socket);
+		m_socket = nullptr;
+	}
+
+	SDLNet_FreePacket(m_packet);
+
+	SDLNet_Quit();	// unload lib (winsock dll for windows)
+}
+
+bool UDPSend::Send(const void * data, int length)
+{
+	// If we failed bail out
+	if (!Connected()) {
+		DPRINTF("Not connected\n");
+		return false;
+	}
+
+	int maxLength = UDP_MAX_PACKET - int(sizeof(UDPPacketHeader) + sizeof(UDPMessageHeader));
+	if (length > maxLength) {
+		ErrorLog("Net board message of %i bytes is too large to send over UDP (at most %i).", length, maxLength);
+		return false;
+	}
+
+	DPRINTF("Sending %i bytes\n", length);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_sequence++;
+	auto& message = m_history[m_sequence % m_redundancy];
+	CountNetBuffer(size_t(length) > message.capacity());
+	message.assign((const char*)data, (const char*)data + length);
+
+	// include as many earlier messages as fit, newest first, then lay them out oldest first
+	int count = 1;
+	int size = int(sizeof(UDPPacketHeader) + sizeof(UDPMessageHeader)) + length;
+	while (count < m_redundancy && count < int(m_sequence)) {
+		int next = int(sizeof(UDPMessageHeader) + m_history[(m_sequence - count) % m_redundancy].size());
+		if (size + next > UDP_MAX_PACKET) {
+			break;
+		}
+		size += next;
+		count++;
+	}
+
+	UDPPacketHeader header = { UDP_PACKET_MAGIC, UINT32(count) };
+	memcpy(m_packet->data, &header, sizeof(header));
+	int pos = int(sizeof(header));
+
+	for (UINT32 seq = m_sequence - count + 1; seq <= m_sequence; seq++) {
+		const auto& m = m_history[seq % m_redundancy];
+		UDPMessageHeader messageHeader = { seq, UINT32(m.size()) };
+		memcpy(m_packet->data + pos, &messageHeader, sizeof(messageHeader));
+		pos += int(sizeof(messageHeader));
+		memcpy(m_packet->data + pos, m.data(), m.size());
+		pos += int(m.size());
+	}
+
+	m_packet->len = pos;
+	SDLNet_UDP_Send(m_socket, -1, m_packet);
+	m_lastSent = std::chrono::steady_clock::now();
+
+	return true;
+}
+
+bool UDPSend::Connected()
+{
+	return m_socket != 0;
+}
+
+bool UDPSend::Connect()
+{
+	// there is no connection as such, only the address to send to
+	if (Connected()) {
+		return true;
+	}
+
+	IPaddress ip;
+	int result = SDLNet_ResolveHost(&ip, m_ip.c_str(), m_port);
+
+	if (result == 0) {
+		m_socket = SDLNet_UDP_Open(0);
+		if (m_socket) {
+			m_packet->address = ip;
+			m_running = true;
+			m_resendThread = std::thread(&UDPSend::ResendFunc, this);
+		}
+	}
+
+	return Connected();
+}
+
+void UDPSend::ResendFunc()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_running) {
+
+		m_cv.wait_for(lock, RESEND_INTERVAL, [this] { return !m_running; });
+
+		if (m_running && m_packet->len && std::chrono::steady_clock::now() - m_lastSent >= RESEND_INTERVAL) {
+			SDLNet_UDP_Send(m_socket, -1, m_packet);
+			m_lastSent = std::chrono::steady_clock::now();
+		}
+	}
+}
@@ -0,0 +1,69 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011-2020 Bart Trzynadlowski, Nik Henson, Ian Curtis,
+ **                     Harry Tuttle, and Spindizzi
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef _UDPSEND_H_
+#define _UDPSEND_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "NetBuffers.h"
+#include "NetTransport.h"
+#include "SDLIncludes.h"
+
+// Sends each message in a UDP packet along with the ones before it, up to a total of redundancy, so that the receiver
+// can make up for lost packets. The last packet is sent again whenever nothing new is sent for a while, so a link in
+// which every machine waits on the one before it never stalls for good on a lost packet.
+class UDPSend : public INetSend
+{
+public:
+	UDPSend(std::string& ip, int port, int redundancy);
+	~UDPSend();
+
+	bool Send(const void* data, int length) override;
+	bool Connect() override;
+	bool Connected() override;
+private:
+
+	static const int MAX_REDUNDANCY = 8;
+
+	void ResendFunc();
+
+	std::string	m_ip;
+	int			m_port;
+	int			m_redundancy;
+	UDPsocket	m_socket;		// sdl socket
+	UDPpacket*	m_packet;
+	UINT32		m_sequence;		// of last message sent
+	std::vector<char> m_history[MAX_REDUNDANCY];	// last messages sent, by sequence number modulo redundancy
+
+	std::thread	m_resendThread;
+	std::mutex	m_mutex;
+	std::condition_variable m_cv;
+	bool		m_running;
+	std::chrono::steady_clock::time_point m_lastSent;
+};
+
+#endif
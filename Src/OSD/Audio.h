@@ -35,11 +35,70 @@ extern void SetAudioCallback(AudioCallbackFPtr callback, void *data);
 extern void SetAudioEnabled(bool enabled);
 
 /*
- * OpenAudio()
+ * SetAudioDiscard(bool discard)
  *
- * Initializes the audio system.
+ * While set, chunks passed to OutputAudio() are thrown away, for frames that
+ * are run a second time and have been heard already.
  */
-extern bool OpenAudio();
+extern void SetAudioDiscard(bool discard);
+
+/*
+ * SetAudioTap(AudioTapFPtr tap, void *data)
+ *
+ * Passes every chunk given to OutputAudio() that is not discarded to a
+ * function as well, for recording: interleaved left and right 16-bit samples
+ * at 44.1 kHz, mixed but not resampled. Called on the thread that outputs the
+ * audio. NULL stops.
+ */
+typedef void (*AudioTapFPtr)(void *data, const INT16 *samples, unsigned numSamples);
+
+extern void SetAudioTap(AudioTapFPtr tap, void *data);
+
+/*
+ * SetAudioRateControl(bool enabled)
+ *
+ * Enables dynamic rate control, which resamples each chunk by a fraction of a
+ * percent to hold the amount buffered steady when audio is produced slightly
+ * faster or slower than it is played.
+ */
+extern void SetAudioRateControl(bool enabled);
+
+/*
+ * AudioStats
+ *
+ * Current state of the audio buffer: how much is buffered, the latency it is
+ * aiming for (which grows after under-runs and shrinks while there are none),
+ * the output latency measured each time the device asks for audio (what is
+ * buffered plus the device's own period), and the number of under-runs and
+ * over-runs since the audio system was opened.
+ */
+struct AudioStats
+{
+	unsigned bufferedMillis;
+	unsigned latencyMillis;
+	unsigned outputMillis;
+	unsigned periodSamples;
+	unsigned underRuns;
+	unsigned overRuns;
+};
+
+/*
+ * GetAudioStats(AudioStats *stats)
+ *
+ * Fills in the current audio buffer statistics. May be called from any thread.
+ */
+extern void GetAudioStats(AudioStats *stats);
+
+/*
+ * OpenAudio(const char *driver, unsigned periodSamples)
+ *
+ * Initializes the audio system. The driver names the host audio API to play
+ * through (eg "pipewire", "alsa", "wasapi", "coreaudio"), or is empty for the
+ * platform's default, and the period is the number of samples the device is
+ * asked to play at a time. Smaller periods lower the output latency but wake
+ * the audio thread more often.
+ */
+extern bool OpenAudio(const char *driver, unsigned periodSamples);
 
 /*
  * OutputAudio(unsigned numSamples, *INT16 leftBuffer, *INT16 rightBuffer)
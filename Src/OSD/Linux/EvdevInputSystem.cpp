@@ -0,0 +1,579 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * EvdevInputSystem.cpp
+ *
+ * Implementation of the Linux evdev input system.
+ */
+
+#include "EvdevInputSystem.h"
+#include "Supermodel.h"
+#include "OSD/Thread.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+static_assert(ABS_CNT == 0x40 && KEY_CNT == 0x300, "kernel input code spaces have changed size");
+
+// Older kernel headers have no names for the halves of the event timestamp
+#ifndef input_event_sec
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+static const int LongBits = 8 * sizeof(long);
+
+static bool TestBit(const unsigned long *bits, int bit)
+{
+  return (bits[bit / LongBits] >> (bit % LongBits)) & 1;
+}
+
+static UINT64 MonotonicNanos()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return UINT64(now.tv_sec) * 1000000000 + UINT64(now.tv_nsec);
+}
+
+CEvdevInputSystem::CEvdevInputSystem(const Util::Config::Node &config)
+  : CSDLInputSystem("evdev", config, false),
+    m_config(config),
+    m_probe(config["InputLatencyProbe"].ValueAsDefault<bool>(false)),
+    m_probeLatency(10000)
+{
+}
+
+CEvdevInputSystem::~CEvdevInputSystem()
+{
+  StopForceFeedback();
+  if (m_thread.joinable())
+  {
+    UINT64 one = 1;
+    if (write(m_wakeFd, &one, sizeof(one)) != sizeof(one))
+      ErrorLog("Unable to stop the evdev input thread.");
+    m_thread.join();
+  }
+  if (m_wakeFd >= 0)
+    close(m_wakeFd);
+  for (auto &device: m_devices)
+    close(device->fd);    // also removes the device's force feedback effects
+  if (m_numChanges)
+    InfoLog("Input (evdev): %llu changes, waiting %.2f ms on average (%.2f ms at most) to be polled.", (unsigned long long) m_numChanges, m_totalLatency / double(m_numChanges), m_maxLatency);
+}
+
+/*
+ * Opens the device if it is a joystick, wheel, pedals or the like: anything
+ * with joystick or gamepad buttons, or with absolute axes, that isn't a touch
+ * pad, tablet, motion sensor or mouse. Axes and buttons are numbered the way
+ * SDL numbers them, so that mappings carry over.
+ */
+bool CEvdevInputSystem::OpenDevice(const std::string &path)
+{
+  int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  bool writable = fd >= 0;
+  if (fd < 0)
+    fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  unsigned long evBits[EV_CNT / LongBits + 1] = {};
+  unsigned long absBits[ABS_CNT / LongBits + 1] = {};
+  unsigned long keyBits[KEY_CNT / LongBits + 1] = {};
+  unsigned long relBits[REL_CNT / LongBits + 1] = {};
+  unsigned long ffBits[FF_CNT / LongBits + 1] = {};
+  unsigned long propBits[INPUT_PROP_CNT / LongBits + 1] = {};
+  if (ioctl(fd, EVIOCGBIT(0, sizeof(evBits)), evBits) < 0)
+  {
+    close(fd);
+    return false;
+  }
+  ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits);
+  ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits);
+  ioctl(fd, EVIOCGBIT(EV_REL, sizeof(relBits)), relBits);
+  ioctl(fd, EVIOCGBIT(EV_FF, sizeof(ffBits)), ffBits);
+  ioctl(fd, EVIOCGPROP(sizeof(propBits)), propBits);
+
+  bool joyButtons = false;
+  for (int code = BTN_JOYSTICK; code < BTN_DIGI && !joyButtons; code++)
+    joyButtons = TestBit(keyBits, code);
+  for (int code = BTN_TRIGGER_HAPPY; code <= BTN_TRIGGER_HAPPY40 && !joyButtons; code++)
+    joyButtons = TestBit(keyBits, code);
+  bool axes = false;
+  for (int code = ABS_X; code <= ABS_BRAKE && !axes; code++)
+    axes = TestBit(absBits, code);
+  bool pointer = TestBit(keyBits, BTN_TOUCH) || TestBit(keyBits, BTN_TOOL_FINGER) || TestBit(keyBits, BTN_TOOL_PEN) || TestBit(keyBits, BTN_STYLUS) ||
+                 TestBit(propBits, INPUT_PROP_ACCELEROMETER) || (TestBit(relBits, REL_X) && !joyButtons);
+  if (pointer || !(joyButtons || axes))
+  {
+    close(fd);
+    return false;
+  }
+
+  std::unique_ptr<Device> device(new Device);
+  device->fd = fd;
+  device->path = path;
+  JoyDetails &details = device->details;
+  memset(&details, 0, sizeof(details));
+  if (ioctl(fd, EVIOCGNAME(sizeof(details.name)), details.name) < 0)
+    strcpy(details.name, "Unknown");
+  details.name[MAX_NAME_LENGTH] = '\0';
+
+  // Axes are the absolute axes in code order, less hats. Hats come in pairs.
+  for (int axisNum = 0; axisNum < NUM_JOY_AXES; axisNum++)
+  {
+    device->axisCodes[axisNum] = -1;
+    device->axisMin[axisNum] = 0;
+    device->axisMax[axisNum] = 0;
+  }
+  for (int code = 0; code < ABS_MISC; code++)
+  {
+    if (!TestBit(absBits, code))
+      continue;
+    if (code >= ABS_HAT0X && code <= ABS_HAT3Y)
+    {
+      if ((code - ABS_HAT0X) % 2 == 0)
+        details.numPOVs++;
+      continue;
+    }
+    input_absinfo info;
+    if (details.numAxes < NUM_JOY_AXES && ioctl(fd, EVIOCGABS(code), &info) >= 0)
+    {
+      device->axisCodes[details.numAxes] = code;
+      device->axisMin[details.numAxes] = info.minimum;
+      device->axisMax[details.numAxes] = info.maximum;
+      details.numAxes++;
+    }
+  }
+  for (int code = BTN_JOYSTICK; code < KEY_MAX; code++)
+  {
+    if (TestBit(keyBits, code))
+      device->buttonCodes.push_back(code);
+  }
+  for (int code = 0; code < BTN_JOYSTICK; code++)
+  {
+    if (TestBit(keyBits, code))
+      device->buttonCodes.push_back(code);
+  }
+  details.numButtons = int(device->buttonCodes.size());
+
+  // Force feedback. Wheels and joysticks have constant force on every axis;
+  // pads only rumble, which is given to the stick axes.
+  if (writable && TestBit(evBits, EV_FF))
+  {
+    device->ffConstant = TestBit(ffBits, FF_CONSTANT);
+    device->ffSpring = TestBit(ffBits, FF_SPRING);
+    device->ffFriction = TestBit(ffBits, FF_FRICTION);
+    device->ffSine = TestBit(ffBits, FF_PERIODIC) && TestBit(ffBits, FF_SINE);
+    device->ffRumble = TestBit(ffBits, FF_RUMBLE);
+  }
+  details.hasFFeedback = device->ffConstant || device->ffSpring || device->ffFriction || device->ffSine || device->ffRumble;
+  for (int axisNum = 0; axisNum < NUM_JOY_AXES; axisNum++)
+  {
+    details.hasAxis[axisNum] = axisNum < details.numAxes;
+    if (device->ffConstant)
+      details.axisHasFF[axisNum] = details.hasAxis[axisNum];
+    else
+      details.axisHasFF[axisNum] = details.hasFFeedback && (axisNum == AXIS_X || axisNum == AXIS_Y);
+    strcpy(details.axisName[axisNum], CInputSystem::GetDefaultAxisName(axisNum));
+  }
+  if (details.hasFFeedback)
+  {
+    input_event gain = {};
+    gain.type = EV_FF;
+    gain.code = FF_GAIN;
+    gain.value = 0xFFFF;
+    input_event autocenter = gain;
+    autocenter.code = FF_AUTOCENTER;
+    autocenter.value = 0;
+    if (write(fd, &gain, sizeof(gain)) != sizeof(gain) || (TestBit(ffBits, FF_AUTOCENTER) && write(fd, &autocenter, sizeof(autocenter)) != sizeof(autocenter)))
+      ErrorLog("Unable to set up force feedback for %s (%s): %s", details.name, path.c_str(), strerror(errno));
+  }
+  for (int &id: device->effectIds)
+    id = -1;
+
+  // Timestamp events on the same clock as Poll() reads
+  int clock = CLOCK_MONOTONIC;
+  ioctl(fd, EVIOCSCLOCKID, &clock);
+
+  for (auto &value: device->abs)
+    value.store(0, std::memory_order_relaxed);
+  for (auto &word: device->keys)
+    word.store(0, std::memory_order_relaxed);
+  device->pendingSince.store(0, std::memory_order_relaxed);
+  ReadState(device.get());
+  for (int i = 0; i < NumAbsCodes; i++)
+    device->absSnapshot[i] = device->abs[i].load(std::memory_order_relaxed);
+  for (int i = 0; i < NumKeyWords; i++)
+    device->keySnapshot[i] = device->keys[i].load(std::memory_order_relaxed);
+
+  InfoLog("Input (evdev): %s is %s, with %d axes, %d hats and %d buttons%s.", path.c_str(), details.name, details.numAxes, details.numPOVs, details.numButtons,
+    details.hasFFeedback ? " and force feedback" : "");
+  m_devices.push_back(std::move(device));
+  return true;
+}
+
+// Reads the whole state of the device, at start up and after events are lost
+void CEvdevInputSystem::ReadState(Device *device)
+{
+  for (int code = 0; code < NumAbsCodes; code++)
+  {
+    input_absinfo info;
+    if (ioctl(device->fd, EVIOCGABS(code), &info) >= 0)
+      device->abs[code].store(info.value, std::memory_order_relaxed);
+  }
+  UINT64 keys[NumKeyWords] = {};
+  if (ioctl(device->fd, EVIOCGKEY(sizeof(keys)), keys) >= 0)
+  {
+    for (int i = 0; i < NumKeyWords; i++)
+      device->keys[i].store(keys[i], std::memory_order_relaxed);
+  }
+}
+
+/*
+ * Reader thread. Waits for events from all the devices at once and applies
+ * each as it comes. A report (SYN_REPORT) ends a set of changes, and stamps
+ * the device with when it was made if it has no changes waiting already.
+ */
+void CEvdevInputSystem::ReadDevices()
+{
+  pthread_setname_np(pthread_self(), "evdev input");
+  if (!CThread::SetPriority(CThread::PRIORITY_REALTIME) && !CThread::SetPriority(CThread::PRIORITY_HIGH))
+    DebugLog("Unable to raise the priority of the evdev input thread: %s", CThread::GetLastError());
+
+  std::vector<pollfd> fds;
+  for (auto &device: m_devices)
+    fds.push_back({ device->fd, POLLIN, 0 });
+  fds.push_back({ m_wakeFd, POLLIN, 0 });
+
+  input_event events[64];
+  while (true)
+  {
+    if (poll(fds.data(), fds.size(), -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      ErrorLog("Evdev input thread stopped: %s", strerror(errno));
+      return;
+    }
+    if (fds.back().revents)
+      return;
+
+    for (size_t i = 0; i < m_devices.size(); i++)
+    {
+      Device *device = m_devices[i].get();
+      if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+      {
+        // Unplugged: its state stays as it was last
+        ErrorLog("Input (evdev): %s (%s) has gone.", device->details.name, device->path.c_str());
+        fds[i].fd = -1;
+        continue;
+      }
+      if (!(fds[i].revents & POLLIN))
+        continue;
+
+      ssize_t bytes;
+      while ((bytes = read(device->fd, events, sizeof(events))) > 0)
+      {
+        for (size_t j = 0; j < size_t(bytes) / sizeof(input_event); j++)
+        {
+          const input_event &event = events[j];
+          if (event.type == EV_SYN && event.code == SYN_DROPPED)
+            device->dropped = true;
+          else if (event.type == EV_SYN && event.code == SYN_REPORT)
+          {
+            if (device->dropped)
+            {
+              ReadState(device);
+              device->dropped = false;
+            }
+            UINT64 since = 0;
+            UINT64 time = UINT64(event.input_event_sec) * 1000000000 + UINT64(event.input_event_usec) * 1000;
+            device->pendingSince.compare_exchange_strong(since, time, std::memory_order_release, std::memory_order_relaxed);
+          }
+          else if (device->dropped)
+            continue;
+          else if (event.type == EV_ABS && event.code < NumAbsCodes)
+            device->abs[event.code].store(event.value, std::memory_order_relaxed);
+          else if (event.type == EV_KEY && event.code < NumKeyCodes)
+          {
+            UINT64 bit = UINT64(1) << (event.code % 64);
+            if (event.value)
+              device->keys[event.code / 64].fetch_or(bit, std::memory_order_relaxed);
+            else
+              device->keys[event.code / 64].fetch_and(~bit, std::memory_order_relaxed);
+          }
+        }
+      }
+    }
+  }
+}
+
+bool CEvdevInputSystem::InitializeSystem()
+{
+  if (!CSDLInputSystem::InitializeSystem())
+    return false;
+
+  // Event devices in number order, as SDL finds them
+  std::vector<std::string> paths;
+  if (DIR *dir = opendir("/dev/input"))
+  {
+    while (dirent *entry = readdir(dir))
+    {
+      if (strncmp(entry->d_name, "event", 5) == 0)
+        paths.push_back(entry->d_name);
+    }
+    closedir(dir);
+  }
+  std::sort(paths.begin(), paths.end(), [](const std::string &a, const std::string &b)
+  {
+    return atoi(a.c_str() + 5) < atoi(b.c_str() + 5);
+  });
+  for (auto &name: paths)
+    OpenDevice("/dev/input/" + name);
+  if (m_devices.empty())
+  {
+    InfoLog("Input (evdev): no joysticks found, or none readable (is the user in the 'input' group?).");
+    return true;
+  }
+
+  m_wakeFd = eventfd(0, EFD_CLOEXEC);
+  if (m_wakeFd < 0)
+  {
+    ErrorLog("Unable to create evdev input thread: %s", strerror(errno));
+    return false;
+  }
+  m_thread = std::thread(&CEvdevInputSystem::ReadDevices, this);
+  m_probeReport = std::chrono::steady_clock::now();
+  return true;
+}
+
+int CEvdevInputSystem::GetNumJoysticks()
+{
+  return int(m_devices.size());
+}
+
+const JoyDetails *CEvdevInputSystem::GetJoyDetails(int joyNum)
+{
+  return &m_devices[joyNum]->details;
+}
+
+int CEvdevInputSystem::GetJoyAxisValue(int joyNum, int axisNum)
+{
+  // Scale to the range SDL gives, -32768 to 32767
+  const Device *device = m_devices[joyNum].get();
+  if (axisNum < 0 || axisNum >= NUM_JOY_AXES || device->axisCodes[axisNum] < 0)
+    return 0;
+  INT64 range = INT64(device->axisMax[axisNum]) - device->axisMin[axisNum];
+  if (range <= 0)
+    return 0;
+  INT64 value = INT64(device->absSnapshot[device->axisCodes[axisNum]]) - device->axisMin[axisNum];
+  value = std::max<INT64>(0, std::min(value, range));
+  return int(value * 65535 / range) - 32768;
+}
+
+bool CEvdevInputSystem::IsJoyPOVInDir(int joyNum, int povNum, int povDir)
+{
+  const Device *device = m_devices[joyNum].get();
+  if (povNum < 0 || povNum >= device->details.numPOVs)
+    return false;
+  int x = device->absSnapshot[ABS_HAT0X + 2 * povNum];
+  int y = device->absSnapshot[ABS_HAT0Y + 2 * povNum];
+  switch (povDir)
+  {
+    case POV_UP:    return y < 0;
+    case POV_DOWN:  return y > 0;
+    case POV_LEFT:  return x < 0;
+    case POV_RIGHT: return x > 0;
+    default:        return false;
+  }
+}
+
+bool CEvdevInputSystem::IsJoyButPressed(int joyNum, int butNum)
+{
+  const Device *device = m_devices[joyNum].get();
+  if (butNum < 0 || butNum >= int(device->buttonCodes.size()))
+    return false;
+  int code = device->buttonCodes[butNum];
+  return (device->keySnapshot[code / 64] >> (code % 64)) & 1;
+}
+
+bool CEvdevInputSystem::PlayEffect(Device *device, Effect slot, void *ffEffect)
+{
+  ff_effect *effect = reinterpret_cast<ff_effect *>(ffEffect);
+  effect->id = device->effectIds[slot];
+  if (ioctl(device->fd, EVIOCSFF, effect) < 0)
+    return false;
+  device->effectIds[slot] = effect->id;
+  input_event play = {};
+  play.type = EV_FF;
+  play.code = effect->id;
+  play.value = 1;
+  return write(device->fd, &play, sizeof(play)) == sizeof(play);
+}
+
+void CEvdevInputSystem::StopEffect(Device *device, Effect slot)
+{
+  if (device->effectIds[slot] < 0)
+    return;
+  input_event stop = {};
+  stop.type = EV_FF;
+  stop.code = device->effectIds[slot];
+  stop.value = 0;
+  if (write(device->fd, &stop, sizeof(stop)) != sizeof(stop))
+    DebugLog("Unable to stop force feedback effect on %s: %s", device->path.c_str(), strerror(errno));
+}
+
+/*
+ * The same effects, with the same strengths and settings, as the SDL input
+ * system, which on Linux drives these devices through the same interface.
+ */
+bool CEvdevInputSystem::ProcessForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCmd ffCmd)
+{
+  Device *device = m_devices[joyNum].get();
+  ff_effect effect;
+  memset(&effect, 0, sizeof(effect));
+  effect.direction = 0x4000;    // along the X axis
+  switch (ffCmd.id)
+  {
+    case FFStop:
+      for (int slot = 0; slot < NumEffects; slot++)
+        StopEffect(device, Effect(slot));
+      return true;
+
+    case FFConstantForce:
+    {
+      unsigned max = m_config["SDLConstForceMax"].ValueAs<unsigned>();
+      if (max == 0)
+        return false;
+      float force = ffCmd.force * (max / 100.0f);
+      if (device->ffConstant)
+      {
+        effect.type = FF_CONSTANT;
+        effect.u.constant.level = INT16(-force * INT16_MAX);
+        return PlayEffect(device, EffectConstant, &effect);
+      }
+      // Pads rumble for strong enough forces
+      float threshold = m_config["SDLConstForceThreshold"].ValueAs<unsigned>() / 100.0f;
+      if (!device->ffRumble || fabsf(force) <= threshold)
+      {
+        StopEffect(device, EffectConstant);
+        return device->ffRumble;
+      }
+      effect.type = FF_RUMBLE;
+      effect.replay.length = 200;
+      effect.u.rumble.strong_magnitude = UINT16(std::min(fabsf(force), 1.0f) * 0xFFFF);
+      return PlayEffect(device, EffectConstant, &effect);
+    }
+
+    case FFSelfCenter:
+    case FFFriction:
+    {
+      bool spring = ffCmd.id == FFSelfCenter;
+      unsigned max = m_config[spring ? "SDLSelfCenterMax" : "SDLFrictionMax"].ValueAs<unsigned>();
+      if (max == 0 || !(spring ? device->ffSpring : device->ffFriction))
+        return false;
+      effect.type = spring ? FF_SPRING : FF_FRICTION;
+      INT16 coeff = INT16(ffCmd.force * (max / 100.0f) * INT16_MAX);
+      effect.u.condition[0].right_saturation = 0xFFFF;
+      effect.u.condition[0].left_saturation = 0xFFFF;
+      effect.u.condition[0].right_coeff = coeff;
+      effect.u.condition[0].left_coeff = coeff;
+      return PlayEffect(device, spring ? EffectSpring : EffectFriction, &effect);
+    }
+
+    case FFVibrate:
+    {
+      unsigned max = m_config["SDLVibrateMax"].ValueAs<unsigned>();
+      if (max == 0)
+        return false;
+      float strength = ffCmd.force * (max / 100.0f);
+      if (device->ffSine)
+      {
+        effect.type = FF_PERIODIC;
+        effect.u.periodic.waveform = FF_SINE;
+        effect.u.periodic.period = 50;
+        effect.u.periodic.magnitude = INT16(strength * INT16_MAX);
+      }
+      else if (device->ffRumble)
+      {
+        if (strength == 0.0f)
+        {
+          StopEffect(device, EffectVibration);
+          return true;
+        }
+        effect.type = FF_RUMBLE;
+        effect.u.rumble.strong_magnitude = UINT16(std::min(strength, 1.0f) * 0xFFFF);
+      }
+      else
+        return false;
+      return PlayEffect(device, EffectVibration, &effect);
+    }
+  }
+  return false;
+}
+
+bool CEvdevInputSystem::Poll()
+{
+  if (!CSDLInputSystem::Poll())
+    return false;
+
+  // Take the devices' latest state, noting how long the changes in it waited
+  UINT64 now = MonotonicNanos();
+  for (auto &device: m_devices)
+  {
+    UINT64 since = device->pendingSince.exchange(0, std::memory_order_acquire);
+    for (int i = 0; i < NumAbsCodes; i++)
+      device->absSnapshot[i] = device->abs[i].load(std::memory_order_relaxed);
+    for (int i = 0; i < NumKeyWords; i++)
+      device->keySnapshot[i] = device->keys[i].load(std::memory_order_relaxed);
+    if (since != 0)
+    {
+      UINT64 latency = now > since ? now - since : 0;
+      m_numChanges++;
+      m_totalLatency += latency * 1e-6;
+      m_maxLatency = std::max(m_maxLatency, latency * 1e-6);
+      if (m_probe)
+        m_probeLatency.Add(UINT32(std::min<UINT64>(latency / 1000, UINT32(-1))));
+    }
+  }
+
+  if (m_probe && std::chrono::steady_clock::now() - m_probeReport >= std::chrono::seconds(1))
+  {
+    m_probeReport = std::chrono::steady_clock::now();
+    if (m_probeLatency.Count())
+      printf("Input latency: %u changes, %.2f ms on average, %.2f ms at worst for 99%%, %.2f ms at most\n", unsigned(m_probeLatency.Count()),
+        m_probeLatency.Average() / 1e3, m_probeLatency.Percentile(99) / 1e3, m_probeLatency.Max() / 1e3);
+    m_probeLatency.Clear();
+  }
+  return true;
+}
@@ -0,0 +1,152 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * EvdevInputSystem.h
+ *
+ * Header file for the Linux evdev input system.
+ */
+
+#ifndef INCLUDED_EVDEVINPUTSYSTEM_H
+#define INCLUDED_EVDEVINPUTSYSTEM_H
+
+#include "SDLInputSystem.h"
+#include "Util/RollingStats.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Input system that reads joysticks, wheels and pedals straight from their
+ * evdev devices (/dev/input/event*) on a high priority thread of its own,
+ * rather than from SDL's event queue once a frame.  The thread keeps the
+ * latest state of every device in atomics as events arrive, without locks,
+ * and each poll takes a snapshot of that, so an input read by a frame is
+ * as new as it can be.  Keyboard, mouse and window events are still handled
+ * by SDL.
+ *
+ * The time from each change reaching the kernel to its being polled is
+ * measured from the event timestamps, and logged on exit.  In latency probe
+ * mode it is also printed each second.
+ *
+ * The devices must be readable by the user, usually by being in the 'input'
+ * group, and writable for force feedback.
+ */
+class CEvdevInputSystem : public CSDLInputSystem
+{
+private:
+  // Sizes of the kernel's absolute axis and key code spaces (ABS_CNT, KEY_CNT)
+  static const int NumAbsCodes = 0x40;
+  static const int NumKeyCodes = 0x300;
+  static const int NumKeyWords = NumKeyCodes / 64;
+
+  // Force feedback effects, each uploaded once and then updated
+  enum Effect
+  {
+    EffectConstant,
+    EffectSpring,
+    EffectFriction,
+    EffectVibration,
+    NumEffects
+  };
+
+  struct Device
+  {
+    int fd = -1;
+    std::string path;
+    JoyDetails details;
+    int axisCodes[NUM_JOY_AXES];      // ABS_ code read for each axis, or -1
+    int axisMin[NUM_JOY_AXES];
+    int axisMax[NUM_JOY_AXES];
+    std::vector<int> buttonCodes;     // KEY_ or BTN_ code read for each button
+    bool ffConstant = false;          // force feedback effects supported
+    bool ffSpring = false;
+    bool ffFriction = false;
+    bool ffSine = false;
+    bool ffRumble = false;
+    int effectIds[NumEffects];        // -1 until uploaded
+
+    // Latest state, written by the reader thread. pendingSince is when the
+    // earliest change not yet polled was made, in nanoseconds on the
+    // monotonic clock, or 0 if there is none.
+    std::atomic<INT32> abs[NumAbsCodes];
+    std::atomic<UINT64> keys[NumKeyWords];
+    std::atomic<UINT64> pendingSince;
+    bool dropped = false;             // events were lost, state must be read afresh (reader thread only)
+
+    // Snapshot taken by Poll()
+    INT32 absSnapshot[NumAbsCodes];
+    UINT64 keySnapshot[NumKeyWords];
+  };
+
+  const Util::Config::Node &m_config;
+  std::vector<std::unique_ptr<Device>> m_devices;
+
+  // Reader thread, woken through an eventfd to exit
+  std::thread m_thread;
+  int m_wakeFd = -1;
+
+  // Polling latency of changes: totals for the log and, when probing, recent
+  // samples printed each second
+  bool m_probe;
+  UINT64 m_numChanges = 0;
+  double m_totalLatency = 0;          // ms
+  double m_maxLatency = 0;
+  Util::RollingStats m_probeLatency;  // us
+  std::chrono::steady_clock::time_point m_probeReport;
+
+  bool OpenDevice(const std::string &path);
+  void ReadState(Device *device);
+  void ReadDevices();
+  bool PlayEffect(Device *device, Effect slot, void *ffEffect);
+  void StopEffect(Device *device, Effect slot);
+
+protected:
+  bool InitializeSystem();
+
+  int GetJoyAxisValue(int joyNum, int axisNum);
+
+  bool IsJoyPOVInDir(int joyNum, int povNum, int povDir);
+
+  bool IsJoyButPressed(int joyNum, int butNum);
+
+  bool ProcessForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCmd ffCmd);
+
+public:
+  /*
+   * Constructs an evdev input system.
+   */
+  CEvdevInputSystem(const Util::Config::Node &config);
+
+  ~CEvdevInputSystem();
+
+  int GetNumJoysticks();
+
+  const JoyDetails *GetJoyDetails(int joyNum);
+
+  bool Poll();
+};
+
+#endif  // INCLUDED_EVDEVINPUTSYSTEM_H
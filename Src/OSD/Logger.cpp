@@ -21,6 +21,7 @@
  **/
 
 #include "OSD/Logger.h"
+#include <chrono>
 #include <set>
 #ifdef _WIN32
 #include <windows.h>
@@ -32,6 +33,8 @@
 // Logger object is used to redirect log messages appropriately
 static std::shared_ptr<CLogger> s_Logger;
 
+uint32_t g_debugLogChannels = 0;
+
 
 std::shared_ptr<CLogger> GetLogger()
 {
@@ -96,6 +99,45 @@ static std::pair<bool, CLogger::LogLevel> GetLogLevel(const Util::Config::Node &
   return std::pair<bool, CLogger::LogLevel>(FAIL, CLogger::LogLevel::Info);
 }
 
+static std::pair<bool, uint32_t> GetLogChannels(const Util::Config::Node &config)
+{
+  const std::map<std::string, LogChannel> logChannelByString
+  {
+    { "ppc", LogChannel::PPC },
+    { "model3", LogChannel::Model3 },
+    { "real3d", LogChannel::Real3D },
+    { "graphics", LogChannel::Graphics },
+    { "sound", LogChannel::Sound },
+    { "dsb", LogChannel::DSB },
+    { "drive", LogChannel::Drive },
+    { "net", LogChannel::Net },
+    { "input", LogChannel::Input },
+  };
+
+  uint32_t channels = 0;
+  std::string logChannels = config["LogChannels"].ValueAsDefault<std::string>("all");
+  for (auto name: Util::Format(logChannels).Split(','))
+  {
+    std::string canonicalizedName = Util::TrimWhiteSpace(Util::ToLower(name));
+    auto it = logChannelByString.find(canonicalizedName);
+    if (canonicalizedName == "all")
+    {
+      channels |= (1u << int(LogChannel::NumChannels)) - 1;
+    }
+    else if (it != logChannelByString.end())
+    {
+      channels |= 1u << int(it->second);
+    }
+    else if (!canonicalizedName.empty())
+    {
+      ErrorLog("Invalid log channel: %s", canonicalizedName.c_str());
+      return std::pair<bool, uint32_t>(FAIL, 0);
+    }
+  }
+
+  return std::pair<bool, uint32_t>(OKAY, channels);
+}
+
 std::shared_ptr<CLogger> CreateLogger(const Util::Config::Node &config)
 {
   std::vector<std::shared_ptr<CLogger>> loggers;
@@ -108,9 +150,20 @@ std::shared_ptr<CLogger> CreateLogger(const Util::Config::Node &config)
   }
   CLogger::LogLevel logLevel = logLevelResult.second;
 
+  // Debug log channels
+  auto logChannelsResult = GetLogChannels(config);
+  if (logChannelsResult.first != OKAY)
+  {
+    return std::shared_ptr<CLogger>();
+  }
+  g_debugLogChannels = logLevel <= CLogger::LogLevel::Debug ? logChannelsResult.second : 0;
+
   // Console message logger always required
   loggers.push_back(std::make_shared<CConsoleErrorLogger>());
 
+  // Outputs that may be written from a thread of their own
+  std::vector<std::shared_ptr<CLogger>> outputLoggers;
+
   // Parse other log outputs
   std::string logOutputs = config["LogOutput"].ValueAsDefault<std::string>("");
   std::vector<std::string> outputs = Util::Format(logOutputs).Split(',');
@@ -148,13 +201,22 @@ std::shared_ptr<CLogger> CreateLogger(const Util::Config::Node &config)
 
   if (!logFilenames.empty() || !systemFiles.empty())
   {
-    loggers.push_back(std::make_shared<CFileLogger>(logLevel, logFilenames, systemFiles));
+    outputLoggers.push_back(std::make_shared<CFileLogger>(logLevel, logFilenames, systemFiles));
   }
 
   // System logger
   if (destinations.count("syslog") > 0)
   {
-    loggers.push_back(std::make_shared<CSystemLogger>(logLevel));
+    outputLoggers.push_back(std::make_shared<CSystemLogger>(logLevel));
+  }
+
+  if (!outputLoggers.empty() && config["LogAsync"].ValueAsDefault<bool>(true))
+  {
+    loggers.push_back(std::make_shared<CAsyncLogger>(logLevel, std::make_shared<CMultiLogger>(outputLoggers)));
+  }
+  else
+  {
+    loggers.insert(loggers.end(), outputLoggers.begin(), outputLoggers.end());
   }
 
   return std::make_shared<CMultiLogger>(loggers);
@@ -324,6 +386,320 @@ CFileLogger::CFileLogger(CLogger::LogLevel level, std::vector<std::string> filen
   ReopenFiles(std::ios::out);
 }
 
+/*
+ * CAsyncLogger
+ *
+ * A queue is a ring buffer of records, each a header followed by the
+ * message, 16-byte aligned. A record that would not fit before the end of the
+ * buffer is preceded by one that pads it out. Only the thread that owns the
+ * queue moves its head and only the writer moves its tail.
+ */
+
+static const size_t QUEUE_SIZE = 0x10000;
+static const size_t NUM_RATE_LIMITS = 64;
+static const unsigned MAX_MESSAGES_PER_SECOND = 100;
+static const int PADDING_RECORD = -1;
+
+namespace
+{
+  struct Record
+  {
+    uint32_t size;      // including header
+    int32_t level;      // or PADDING_RECORD
+    uint64_t sequence;
+  };
+
+  struct RateLimit
+  {
+    const char *fmt = nullptr;
+    CLogger::LogLevel level = CLogger::LogLevel::Info;
+    std::chrono::steady_clock::time_point windowStart;
+    unsigned count = 0;
+    unsigned suppressed = 0;
+  };
+}
+
+struct CAsyncLogger::Queue
+{
+  alignas(64) std::atomic<uint64_t> head;     // moved by owning thread
+  alignas(64) std::atomic<uint64_t> tail;     // moved by writer
+  std::atomic<unsigned> dropped;
+  std::atomic<bool> abandoned;                // owning thread has exited
+  RateLimit rateLimits[NUM_RATE_LIMITS];      // owning thread only
+  alignas(16) uint8_t buffer[QUEUE_SIZE];
+
+  Queue()
+    : head(0),
+      tail(0),
+      dropped(0),
+      abandoned(false)
+  {
+  }
+};
+
+// Gives up its queue when the thread exits, which the writer drops once empty
+struct CAsyncLogger::ThreadQueue
+{
+  uint64_t loggerId = 0;
+  std::shared_ptr<Queue> queue;
+
+  ~ThreadQueue()
+  {
+    if (queue)
+      queue->abandoned = true;
+  }
+};
+
+thread_local CAsyncLogger::ThreadQueue CAsyncLogger::s_threadQueue;
+
+static std::atomic<uint64_t> s_nextAsyncLoggerId(1);
+
+void CAsyncLogger::DebugLog(const char *fmt, va_list vl)
+{
+  Log(LogLevel::Debug, fmt, vl);
+}
+
+void CAsyncLogger::InfoLog(const char *fmt, va_list vl)
+{
+  Log(LogLevel::Info, fmt, vl);
+}
+
+void CAsyncLogger::ErrorLog(const char *fmt, va_list vl)
+{
+  Log(LogLevel::Error, fmt, vl);
+}
+
+CAsyncLogger::Queue *CAsyncLogger::GetQueue()
+{
+  ThreadQueue &threadQueue = s_threadQueue;
+  if (threadQueue.loggerId != m_id)
+  {
+    if (threadQueue.queue)
+      threadQueue.queue->abandoned = true;
+    threadQueue.queue = std::make_shared<Queue>();
+    threadQueue.loggerId = m_id;
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_queues.push_back(threadQueue.queue);
+  }
+  return threadQueue.queue.get();
+}
+
+void CAsyncLogger::Log(LogLevel level, const char *fmt, va_list vl)
+{
+  if (m_logLevel > level)
+  {
+    return;
+  }
+
+  Queue *queue = GetQueue();
+
+  // Count messages made with this format string in the last second, noting
+  // how many were suppressed when its next second starts (or another format
+  // string takes its place)
+  auto now = std::chrono::steady_clock::now();
+  static_assert(NUM_RATE_LIMITS == 64, "hash below takes the top 6 bits");
+  RateLimit &limit = queue->rateLimits[(uint64_t(uintptr_t(fmt)) * 0x9E3779B97F4A7C15ull) >> 58];
+  if (limit.fmt != fmt || now - limit.windowStart >= std::chrono::seconds(1))
+  {
+    if (limit.suppressed)
+    {
+      char note[4096];
+      snprintf(note, sizeof(note), "Suppressed %u more messages like: %s", limit.suppressed, limit.fmt);
+      Push(queue, limit.level, note);
+    }
+    limit.fmt = fmt;
+    limit.level = level;
+    limit.windowStart = now;
+    limit.count = 0;
+    limit.suppressed = 0;
+  }
+  if (++limit.count > MAX_MESSAGES_PER_SECOND)
+  {
+    limit.suppressed++;
+    return;
+  }
+
+  char string[4096];
+  vsnprintf(string, sizeof(string), fmt, vl);
+  if (!Push(queue, level, string) || level != LogLevel::Error)
+  {
+    return;
+  }
+
+  // Errors are written before returning, in case the program is about to end
+  uint64_t end = queue->head.load(std::memory_order_relaxed);
+  std::unique_lock<std::mutex> lock(m_mtx);
+  m_errorsWaiting++;
+  m_wake.notify_one();
+  m_written.wait(lock, [&] { return m_exit || queue->tail.load(std::memory_order_acquire) >= end; });
+  m_errorsWaiting--;
+}
+
+// Returns false if the message was dropped
+bool CAsyncLogger::Push(Queue *queue, LogLevel level, const char *str)
+{
+  size_t length = strlen(str) + 1;
+  uint32_t size = uint32_t((sizeof(Record) + length + 15) & ~size_t(15));
+  uint64_t sequence = m_nextSequence.fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t head = queue->head.load(std::memory_order_relaxed);
+  size_t offset = size_t(head % QUEUE_SIZE);
+  size_t padding = offset + size > QUEUE_SIZE ? QUEUE_SIZE - offset : 0;
+  while (QUEUE_SIZE - (head - queue->tail.load(std::memory_order_acquire)) < padding + size)
+  {
+    if (level == LogLevel::Debug)
+    {
+      queue->dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    m_wake.notify_one();
+    std::this_thread::yield();
+  }
+
+  if (padding)
+  {
+    Record record = { uint32_t(padding), PADDING_RECORD, 0 };
+    memcpy(queue->buffer + offset, &record, sizeof(record));
+    head += padding;
+    offset = 0;
+  }
+  Record record = { size, int32_t(level), sequence };
+  memcpy(queue->buffer + offset, &record, sizeof(record));
+  memcpy(queue->buffer + offset + sizeof(record), str, length);
+  queue->head.store(head + size, std::memory_order_release);
+
+  // The writer looks every so often anyway, but shouldn't let the queue fill
+  if (m_writerSleeping.load(std::memory_order_relaxed) && head + size - queue->tail.load(std::memory_order_relaxed) > QUEUE_SIZE / 2)
+  {
+    m_wake.notify_one();
+  }
+  return true;
+}
+
+// Writes the earliest message at the front of any queue. Returns false if all
+// are empty.
+bool CAsyncLogger::WriteNext(const std::vector<std::shared_ptr<Queue>> &queues)
+{
+  Queue *next = nullptr;
+  const Record *nextRecord = nullptr;
+  for (auto &queue: queues)
+  {
+    uint64_t tail = queue->tail.load(std::memory_order_relaxed);
+    uint64_t head = queue->head.load(std::memory_order_acquire);
+    if (tail == head)
+    {
+      continue;
+    }
+    const Record *record = (const Record *) (queue->buffer + tail % QUEUE_SIZE);
+    if (record->level == PADDING_RECORD)
+    {
+      queue->tail.store(tail + record->size, std::memory_order_release);
+      if (tail + record->size == head)
+      {
+        continue;
+      }
+      record = (const Record *) queue->buffer;
+    }
+    if (!nextRecord || record->sequence < nextRecord->sequence)
+    {
+      next = queue.get();
+      nextRecord = record;
+    }
+  }
+  if (!next)
+  {
+    return false;
+  }
+
+  const char *str = (const char *) (nextRecord + 1);
+  switch (nextRecord->level)
+  {
+  case LogLevel::Debug:
+    m_logger->DebugLog("%s", str);
+    break;
+  case LogLevel::Info:
+    m_logger->InfoLog("%s", str);
+    break;
+  default:
+    m_logger->ErrorLog("%s", str);
+    break;
+  }
+  next->tail.store(next->tail.load(std::memory_order_relaxed) + nextRecord->size, std::memory_order_release);
+  return true;
+}
+
+void CAsyncLogger::WriterThread()
+{
+  std::vector<std::shared_ptr<Queue>> queues;
+  std::unique_lock<std::mutex> lock(m_mtx);
+  for (;;)
+  {
+    bool exiting = m_exit;
+    queues = m_queues;
+    lock.unlock();
+
+    bool wrote = false;
+    while (WriteNext(queues))
+    {
+      wrote = true;
+    }
+    for (auto &queue: queues)
+    {
+      unsigned dropped = queue->dropped.exchange(0);
+      if (dropped)
+      {
+        m_logger->DebugLog("Dropped %u debug messages because the log could not keep up.\n", dropped);
+      }
+    }
+
+    lock.lock();
+    for (auto it = m_queues.begin(); it != m_queues.end(); )
+    {
+      Queue *queue = it->get();
+      if (queue->abandoned && queue->tail.load() == queue->head.load())
+        it = m_queues.erase(it);
+      else
+        ++it;
+    }
+    if (m_errorsWaiting)
+    {
+      m_written.notify_all();
+    }
+    if (exiting && !wrote)
+    {
+      break;
+    }
+    if (!wrote)
+    {
+      m_writerSleeping = true;
+      m_wake.wait_for(lock, std::chrono::milliseconds(10));
+      m_writerSleeping = false;
+    }
+  }
+  queues.clear();
+}
+
+CAsyncLogger::CAsyncLogger(CLogger::LogLevel level, std::shared_ptr<CLogger> logger)
+  : m_logLevel(level),
+    m_logger(logger),
+    m_id(s_nextAsyncLoggerId++),
+    m_nextSequence(0),
+    m_writerSleeping(false)
+{
+  m_thread = std::thread(&CAsyncLogger::WriterThread, this);
+}
+
+CAsyncLogger::~CAsyncLogger()
+{
+  // Everything queued is written first
+  {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_exit = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+}
+
 /*
  * CSystemLogger
  */
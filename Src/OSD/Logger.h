@@ -33,12 +33,15 @@
 #include "Types.h"
 #include "Version.h"
 #include "Util/NewConfig.h"
+#include <atomic>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
 #include <fstream>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 
@@ -193,6 +196,52 @@ private:
   void WriteToFiles(const char *str);
 };
 
+/*
+ * CAsyncLogger:
+ *
+ * Passes messages on to another logger from a thread of its own, so that
+ * logging costs the caller little more than formatting the message. Each
+ * thread queues its messages in a ring buffer of its own, without locking,
+ * and they are written in the order they were made. Messages made with the
+ * same format string more than a hundred times a second are suppressed, with
+ * a note of how many were. Debug messages are dropped if the queue is full;
+ * others wait for room, and errors wait until they have been written.
+ */
+class CAsyncLogger: public CLogger
+{
+public:
+  void DebugLog(const char *fmt, va_list vl);
+  void InfoLog(const char *fmt, va_list vl);
+  void ErrorLog(const char *fmt, va_list vl);
+  CAsyncLogger(LogLevel level, std::shared_ptr<CLogger> logger);
+  ~CAsyncLogger();
+
+private:
+  struct Queue;
+  struct ThreadQueue;
+
+  Queue *GetQueue();
+  void Log(LogLevel level, const char *fmt, va_list vl);
+  bool Push(Queue *queue, LogLevel level, const char *str);
+  bool WriteNext(const std::vector<std::shared_ptr<Queue>> &queues);
+  void WriterThread();
+
+  static thread_local ThreadQueue s_threadQueue;
+
+  LogLevel m_logLevel;
+  std::shared_ptr<CLogger> m_logger;
+  const uint64_t m_id;                        // tells the thread's queue which logger it belongs to
+  std::atomic<uint64_t> m_nextSequence;
+  std::mutex m_mtx;                           // guards all below
+  std::condition_variable m_wake;
+  std::condition_variable m_written;
+  std::vector<std::shared_ptr<Queue>> m_queues;
+  std::atomic<bool> m_writerSleeping;
+  unsigned m_errorsWaiting = 0;
+  bool m_exit = false;
+  std::thread m_thread;
+};
+
 /*
  * CSystemLogger:
  *
@@ -211,6 +260,50 @@ private:
 };
 
 
+/******************************************************************************
+ Log Channels
+
+ Debug messages from the busier subsystems belong to a channel, each of which
+ can be enabled on its own. Whether a channel is enabled is checked before the
+ message's arguments are even evaluated, so disabled channels cost next to
+ nothing, and building with NO_DEBUG_LOG defined removes them altogether.
+******************************************************************************/
+
+enum class LogChannel: int
+{
+  PPC = 0,    // PowerPC core
+  Model3,     // main board, its memory map and devices
+  Real3D,     // Real3D GPU
+  Graphics,   // renderers and tile generator
+  Sound,      // sound board, 68K and SCSP
+  DSB,        // Digital Sound Board
+  Drive,      // drive boards
+  Net,        // net board and netplay
+  Input,      // input systems
+  NumChannels
+};
+
+// Bit mask of enabled channels (set by CreateLogger())
+extern uint32_t g_debugLogChannels;
+
+inline bool IsDebugLogEnabled(LogChannel channel)
+{
+  return (g_debugLogChannels & (1u << int(channel))) != 0;
+}
+
+/*
+ * DEBUG_LOG(channel, fmt, ...):
+ *
+ * Prints debugging information (see DebugLog()) if the channel, named without
+ * the LogChannel:: prefix, is enabled. Usable as a single statement.
+ */
+#ifdef NO_DEBUG_LOG
+#define DEBUG_LOG(channel, ...) do { if (false) DebugLog(__VA_ARGS__); } while (0)
+#else
+#define DEBUG_LOG(channel, ...) do { if (IsDebugLogEnabled(LogChannel::channel)) DebugLog(__VA_ARGS__); } while (0)
+#endif
+
+
 /******************************************************************************
  Log Functions
 
@@ -283,6 +376,9 @@ extern std::shared_ptr<CLogger> GetLogger(void);
 /*
  * CreateLogger(config):
  *
+ * Also enables the debug log channels named by the configuration, if the log
+ * level lets debug messages through.
+ *
  * Returns:
  *    A logger object that satisfies the requirements specified in the passed
  *    configuration or an empty pointer if an unrecoverable error occurred.
@@ -61,10 +61,14 @@ EOutputs COutputs::GetOutputByName(const char *name)
 	return OutputUnknown;
 }
 
-COutputs::COutputs()
+static_assert(NUM_OUTPUTS <= 32, "outputs must fit in the changed mask");
+
+COutputs::COutputs() : m_changed(0)
 {
+	for (unsigned i = 0; i < NUM_OUTPUTS; i++)
+		m_values[i].store(0, std::memory_order_relaxed);
 	memset(m_first, true, sizeof(m_first));
-	memset(m_values, 0, sizeof(m_values));
+	memset(m_sent, 0, sizeof(m_sent));
 }
 
 COutputs::~COutputs()
@@ -87,7 +91,7 @@ UINT8 COutputs::GetValue(EOutputs output) const
 	int idx = (unsigned)output;
 	if (idx < 0 || idx >= NUM_OUTPUTS)
 		return 0;
-	return m_values[idx];
+	return m_values[idx].load(std::memory_order_relaxed);
 }
 
 void COutputs::SetValue(EOutputs output, UINT8 value)
@@ -95,10 +99,35 @@ void COutputs::SetValue(EOutputs output, UINT8 value)
 	int idx = (unsigned)output;
 	if (idx < 0 || idx >= NUM_OUTPUTS)
 		return;
-	bool firstSet = m_first[idx];
-	UINT8 prevValue = m_values[idx];
-	m_first[idx] = false;
-	m_values[idx] = value;
-	if (firstSet || value != prevValue)
-		SendOutput(output, prevValue, value);
+	m_values[idx].store(value, std::memory_order_relaxed);
+	uint32_t bit = 1u << idx;
+	if (!(m_changed.load(std::memory_order_relaxed) & bit))
+		m_changed.fetch_or(bit, std::memory_order_release);
+}
+
+void COutputs::Flush()
+{
+	uint32_t changed = m_changed.exchange(0, std::memory_order_acquire);
+	if (!changed)
+		return;
+	bool sent = false;
+	for (unsigned idx = 0; idx < NUM_OUTPUTS; idx++)
+	{
+		if (!(changed & (1u << idx)))
+			continue;
+		UINT8 value = m_values[idx].load(std::memory_order_relaxed);
+		if (!m_first[idx] && value == m_sent[idx])
+			continue;
+		SendOutput((EOutputs)idx, m_sent[idx], value);
+		m_first[idx] = false;
+		m_sent[idx] = value;
+		sent = true;
+	}
+	if (sent)
+		EndSend();
+}
+
+void COutputs::EndSend()
+{
+	//
 }
@@ -29,6 +29,8 @@
 #define INCLUDED_OUTPUTS_H
 
 #include "Game.h"
+#include <atomic>
+#include <cstdint>
 
 /*
  * EOutputs enumeration of all available outputs.
@@ -119,10 +121,19 @@ public:
 	/*
 	 * SetValue(output, value):
 	 *
-	 * Sets the current value of the given output.
+	 * Sets the current value of the given output.  Only marks the output as changed; changes are sent by Flush().  May be
+	 * called from any thread.
 	 */
 	void SetValue(EOutputs output, UINT8 value);
 
+	/*
+	 * Flush():
+	 *
+	 * Sends the outputs whose values differ from those last sent (or that have never been sent), once per frame, from the
+	 * main thread.  An output that changes and changes back between calls is not sent at all.
+	 */
+	void Flush();
+
 protected:
 	/*
 	 * COutputs():
@@ -139,12 +150,22 @@ protected:
 	 */
 	virtual void SendOutput(EOutputs output, UINT8 prevValue, UINT8 value) = 0;
 
+	/*
+	 * EndSend():
+	 *
+	 * Called by Flush() after the SendOutput() calls for all the outputs that changed, so that a subclass that batches them
+	 * can send them together.  Does nothing by default.
+	 */
+	virtual void EndSend();
+
 private:
 	static const char* s_outputNames[]; // Static array of output names
 
-	Game m_game;                  // Currently running game
-	bool m_first[NUM_OUTPUTS];    // For each output, true if an initial value has been set
-	UINT8 m_values[NUM_OUTPUTS];  // Current value of each output
+	Game m_game;                          // Currently running game
+	std::atomic<UINT8> m_values[NUM_OUTPUTS];  // Current value of each output
+	std::atomic<uint32_t> m_changed;      // Bit for each output set since the last flush
+	bool m_first[NUM_OUTPUTS];            // For each output, true if no value has been sent yet
+	UINT8 m_sent[NUM_OUTPUTS];            // Value of each output last sent
 };
 
 #endif	// INCLUDED_OUTPUTS_H
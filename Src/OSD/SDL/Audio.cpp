@@ -25,57 +25,109 @@
  * SDL audio playback. Implements the OSD audio interface.
  *
  * Buffer sizes and read/write positions must be sample-aligned. A sample is 
- * defined to encompass both channels so for, e.g., 16-bit audio as used here,
- * a sample is 4 bytes. Static assertions are employed to ensure that the
+ * defined to encompass both channels so for, e.g., 32-bit float audio as used
+ * here, a sample is 8 bytes. Static assertions are employed to ensure that the
  * initial set up of the buffer is correct.
+ *
+ * The 16-bit chunks from the sound boards are converted to float once, as
+ * the channels are interleaved (and swapped), and stay float through rate
+ * control to the device, with a single clip at the end. SDL is asked for
+ * float output, which it passes through untouched on most back ends.
+ *
+ * The host audio API is whichever of SDL's drivers is chosen (PipeWire, ALSA,
+ * WASAPI, CoreAudio, etc.), and the device period can be as short as 64
+ * samples. Each period is filled by the callback straight from the ring
+ * buffer without locking.
  */
 
 #include "Supermodel.h"
 #include "SDLIncludes.h"
+#include "Util/Trace.h"
+#include "Util/AllocTracker.h"
 
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
 
 // Model3 audio output is 44.1KHz 2-channel sound and frame rate is 60fps
 #define SAMPLE_RATE 44100
 #define NUM_CHANNELS 2
 #define SUPERMODEL_FPS 60
 
-#define BYTES_PER_SAMPLE (NUM_CHANNELS * sizeof(INT16))
+#define BYTES_PER_SAMPLE (NUM_CHANNELS * sizeof(float))
 #define SAMPLES_PER_FRAME (SAMPLE_RATE / SUPERMODEL_FPS)
 #define BYTES_PER_FRAME (SAMPLES_PER_FRAME * BYTES_PER_SAMPLE)
 
 #define MAX_LATENCY 100
 
 static bool enabled = true;         // True if sound output is enabled
-static constexpr unsigned latency = 20;       // Audio latency to use (ie size of audio buffer) as percentage of max buffer size
-static constexpr bool underRunLoop = true;    // True if should loop back to beginning of buffer on under-run, otherwise sound is just skipped
+static bool discard = false;        // True if chunks are to be thrown away rather than buffered
+static constexpr unsigned latency = 20;       // Initial audio latency to use as percentage of one second
+
+static constexpr unsigned minPeriodSamples = 64;    // Range of device periods (in samples) that may be asked for
+static constexpr unsigned maxPeriodSamples = 4096;
+static SDL_AudioDeviceID audioDevice = 0;   // Open output device
+static unsigned periodSamples = 512;        // Size (in samples) of callback play buffer, as obtained from the device
+
+// Latency is raised by a frame on every under-run and lowered by a frame after this many callbacks without one (~10s)
+static unsigned latencyDecayCallbacks = 10 * SAMPLE_RATE / 512;
+static constexpr UINT32 minLatencyBytes = 3 * BYTES_PER_FRAME;
+static constexpr UINT32 maxLatencyBytes = SAMPLE_RATE * BYTES_PER_SAMPLE;
+
+// The ring buffer is a power of two in size, large enough for the maximum latency, so that the read and write
+// positions can be free-running byte counters that are masked to index it
+static constexpr UINT32 audioBufferSize = 1 << 19;  // Size (in bytes) of audio buffer
+static_assert(audioBufferSize >= maxLatencyBytes + 2 * BYTES_PER_FRAME, "audio buffer too small for maximum latency");
+static_assert(audioBufferSize % BYTES_PER_SAMPLE == 0, "must be an integer multiple of the sample size");
+static INT8	*audioBuffer = NULL;    // Audio buffer
 
-static constexpr unsigned playSamples = 512;  // Size (in samples) of callback play buffer
+// The buffer has a single producer (OutputAudio) and a single consumer (PlayCallback). Each side owns its position
+// and only reads the other's, so no lock is needed. Positions are always sample-aligned.
+static std::atomic<UINT32> writePos(0);         // Total bytes written into buffer
+static std::atomic<UINT32> playPos(0);          // Total bytes played from buffer via callback
+static std::atomic<UINT32> latencyBytes(0);     // Current target amount of buffered audio (in bytes)
 
-static UINT32 audioBufferSize = 0;  // Size (in bytes) of audio buffer
-static INT8	*audioBuffer = NULL;    // Audio buffer
+static bool priming = false;        // True after an under-run until enough data has been buffered to resume (callback only)
+static unsigned callbacksSinceUnderRun = 0;     // Callbacks played without an under-run (callback only)
 
-static UINT32 writePos = 0;         // Current position at which writing into buffer
-static UINT32 playPos = 0;          // Current position at which playing data in buffer via callback
+static std::atomic<UINT32> outputBytes(0);      // Smoothed output latency seen by the callback (in bytes)
+static std::atomic<unsigned> underRuns(0);      // Number of buffer under-runs that have occured
+static std::atomic<unsigned> overRuns(0);       // Number of buffer over-runs that have occured
 
-static bool writeWrapped = false;   // True if write position has wrapped around at end of buffer but play position has not done so yet
+// Dynamic rate control stretches or squeezes each chunk by up to this fraction to keep the buffer near its set point,
+// so that emulation can run slightly faster or slower than 60fps (eg locked to the display refresh) without glitches
+static constexpr double maxRateDelta = 0.005;
+static constexpr unsigned maxResampledSamples = SAMPLES_PER_FRAME + SAMPLES_PER_FRAME / 64 + 4;
 
-static unsigned underRuns = 0;      // Number of buffer under-runs that have occured
-static unsigned overRuns = 0;       // Number of buffer over-runs that have occured
+static bool rateControl = true;     // True if dynamic rate control is enabled
+static double resamplePos = 1;      // Position of next output sample in history + current chunk (in samples)
+static float resampleHistory[3 * NUM_CHANNELS];   // Last 3 samples of previous chunk
 
 static AudioCallbackFPtr callback = NULL; // Pointer to audio callback that is called when audio buffer is less than half empty
 static void *callbackData = NULL;         // Pointer to data to be passed to audio callback when it is called
 
+static std::mutex tapMutex;               // Guards tap, which is set from the main thread
+static AudioTapFPtr tap = NULL;           // Pointer to function that is passed each chunk output, for recording
+static void *tapData = NULL;
+
 void SetAudioCallback(AudioCallbackFPtr newCallback, void *newData)
 {
 	// Lock audio whilst changing callback pointers
-	SDL_LockAudio();
+	SDL_LockAudioDevice(audioDevice);
 
 	callback = newCallback;
 	callbackData = newData;
 
-	SDL_UnlockAudio();
+	SDL_UnlockAudioDevice(audioDevice);
+}
+
+void SetAudioTap(AudioTapFPtr newTap, void *newData)
+{
+	std::lock_guard<std::mutex> lock(tapMutex);
+	tap = newTap;
+	tapData = newData;
 }
 
 void SetAudioEnabled(bool newEnabled)
@@ -83,111 +135,97 @@ void SetAudioEnabled(bool newEnabled)
 	enabled = newEnabled;
 }
 
-static void PlayCallback(void *data, Uint8 *stream, int len)
+void SetAudioDiscard(bool newDiscard)
 {
-	//printf("PlayCallback(%d) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u]\n",
-	//	len, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize);
-
-	// Get current write position and adjust it if write has wrapped but play position has not
-	UINT32 adjWritePos = writePos;
-	if (writeWrapped)
-		adjWritePos += audioBufferSize;
-
-	// Check if play position overlaps write position (ie buffer under-run)
-	if (playPos + len > adjWritePos)
-	{
-		underRuns++;
-
-		//printf("Audio buffer under-run #%u in PlayCallback(%d) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u]\n",
-		//	underRuns, len, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize);
+	discard = newDiscard;
+}
 
-		// See what action to take on under-run
-		if (underRunLoop)
-		{
-			// If loop, then move play position back to beginning of data in buffer
-			playPos = adjWritePos + BYTES_PER_FRAME;
-
-			// Check if play position has moved past end of buffer
-			if (playPos >= audioBufferSize)
-				// If so, wrap it around to beginning again (but keep write wrapped flag as before)
-				playPos -= audioBufferSize;
-			else
-				// Otherwise, set write wrapped flag as will now appear as if write has wrapped but play position has not
-				writeWrapped = true;
-		}
-		else
-		{
-			// Otherwise, just copy silence to audio output stream and exit
-			memset(stream, 0, len);
-			return;
-		}
-	}
+void SetAudioRateControl(bool newRateControl)
+{
+	rateControl = newRateControl;
+}
 
-	INT8* src1;
-	INT8* src2;
-	UINT32 len1;
-	UINT32 len2;
+void GetAudioStats(AudioStats *stats)
+{
+	UINT32 filled = writePos.load(std::memory_order_relaxed) - playPos.load(std::memory_order_relaxed);
+	if (filled > audioBufferSize)	// positions read mid-update
+		filled = 0;
+
+	stats->bufferedMillis = unsigned(UINT64(filled) * 1000 / (SAMPLE_RATE * BYTES_PER_SAMPLE));
+	stats->latencyMillis = unsigned(UINT64(latencyBytes.load(std::memory_order_relaxed)) * 1000 / (SAMPLE_RATE * BYTES_PER_SAMPLE));
+	stats->outputMillis = unsigned(UINT64(outputBytes.load(std::memory_order_relaxed)) * 1000 / (SAMPLE_RATE * BYTES_PER_SAMPLE));
+	stats->periodSamples = periodSamples;
+	stats->underRuns = underRuns.load(std::memory_order_relaxed);
+	stats->overRuns = overRuns.load(std::memory_order_relaxed);
+}
 
-	// Check if play region extends past end of buffer
-	if (playPos + len > audioBufferSize)
+static void PlayCallback(void *data, Uint8 *stream, int len)
+{
+	TRACE_THREAD_NAME("Audio");
+	TRACE_ZONE("PlayCallback");
+	ALLOC_SCOPE(Audio);
+
+	UINT32 read = playPos.load(std::memory_order_relaxed);
+	UINT32 filled = writePos.load(std::memory_order_acquire) - read;
+	UINT32 target = latencyBytes.load(std::memory_order_relaxed);
+
+	// The newest sample buffered will be heard after everything before it and the period being handed over now,
+	// which the device plays out in full before asking again. Smoothed over roughly the last 16 callbacks.
+	UINT32 output = outputBytes.load(std::memory_order_relaxed);
+	UINT32 measured = (priming ? 0 : filled) + len;
+	outputBytes.store(output + INT32(measured - output) / 16, std::memory_order_relaxed);
+
+	// Check if play region overlaps write position (ie buffer under-run)
+	if (!priming && filled < UINT32(len))
 	{
-		// If so, split play region into two
-		src1 = audioBuffer + playPos;
-		src2 = audioBuffer;
-		len1 = audioBufferSize - playPos;
-		len2 = len - len1;
+		underRuns.fetch_add(1, std::memory_order_relaxed);
+
+		// Play silence until the buffer has refilled, and keep more buffered from now on
+		priming = true;
+		callbacksSinceUnderRun = 0;
+		target = std::min<UINT32>(target + BYTES_PER_FRAME, maxLatencyBytes);
+		latencyBytes.store(target, std::memory_order_relaxed);
 	}
-	else
+	else if (!priming && ++callbacksSinceUnderRun >= latencyDecayCallbacks)
 	{
-		// Otherwise, just copy whole region
-		src1 = audioBuffer + playPos;
-		src2 = 0;
-		len1 = len;
-		len2 = 0;
+		// No under-runs for a while, so try a shorter latency
+		callbacksSinceUnderRun = 0;
+		target = std::max<UINT32>(target - BYTES_PER_FRAME, minLatencyBytes);
+		latencyBytes.store(target, std::memory_order_relaxed);
 	}
 
-	// Check if audio is enabled
-	if (enabled)
-	{
-		// If so, copy play region into audio output stream
-		memcpy(stream, src1, len1);
-
-		// Also, if not looping on under-runs then blank region out
-		if (!underRunLoop)
-			memset(src1, 0, len1);
-
-		if (len2)
-		{
-			// If region was split into two, copy second half into audio output stream as well
-			memcpy(stream + len1, src2, len2);
+	// Resume once half the target latency is available
+	if (priming && filled >= std::max(target / 2, UINT32(len)))
+		priming = false;
 
-			// Also, if not looping on under-runs then blank region out
-			if (!underRunLoop)
-				memset(src2, 0, len2);
-		}
+	if (enabled && !priming)
+	{
+		// Copy play region into audio output stream, splitting it in two if it extends past end of buffer
+		UINT32 offset = read & (audioBufferSize - 1);
+		UINT32 len1 = std::min(UINT32(len), audioBufferSize - offset);
+		memcpy(stream, audioBuffer + offset, len1);
+		if (len1 < UINT32(len))
+			memcpy(stream + len1, audioBuffer, len - len1);
 	}
 	else
 		// Otherwise, just copy silence to audio output stream
 		memset(stream, 0, len);
 
-	// Move play position forward for next time
-	playPos += len;
-
-	bool bufferFull = adjWritePos + 2 * BYTES_PER_FRAME > playPos + audioBufferSize;
-
-	// Check if play position has moved past end of buffer
-	if (playPos >= audioBufferSize)
+	// Move play position forward, unless waiting for the buffer to refill
+	if (!priming)
 	{
-		// If so, wrap it around to beginning again and reset write wrapped flag
-		playPos -= audioBufferSize;
-		writeWrapped = false;
+		playPos.store(read + len, std::memory_order_release);
+		filled -= len;
 	}
 
+	bool bufferFull = filled + 2 * BYTES_PER_FRAME > target;
+
 	// If buffer is not full then call audio callback
 	if (callback && !bufferFull)
 		callback(callbackData);
 }
 
+// Interleaves 16-bit channels as they are, for the tap
 static void MixChannels(unsigned numSamples, INT16 *leftBuffer, INT16 *rightBuffer, void *dest, bool flipStereo)
 {
 	INT16 *p = (INT16*)dest;
@@ -215,6 +253,64 @@ static void MixChannels(unsigned numSamples, INT16 *leftBuffer, INT16 *rightBuff
 #endif	// NUM_CHANNELS
 }
 
+// Interleaves 16-bit channels into float samples in one pass, which compilers vectorise
+static void MixChannelsFloat(unsigned numSamples, const INT16 *leftBuffer, const INT16 *rightBuffer, float *dest, bool flipStereo)
+{
+	constexpr float scale = 1.0f / 32768.0f;
+
+#if (NUM_CHANNELS == 1)
+	for (unsigned i = 0; i < numSamples; i++)
+		dest[i] = (float(leftBuffer[i]) + float(rightBuffer[i])) * scale;
+#else
+	const INT16 *first = flipStereo ? rightBuffer : leftBuffer;
+	const INT16 *second = flipStereo ? leftBuffer : rightBuffer;
+	for (unsigned i = 0; i < numSamples; i++)
+	{
+		dest[2 * i + 0] = float(first[i]) * scale;
+		dest[2 * i + 1] = float(second[i]) * scale;
+	}
+#endif	// NUM_CHANNELS
+}
+
+// The only clip between the sound boards and the device
+static void ClipChunk(float *samples, unsigned numSamples)
+{
+	for (unsigned i = 0; i < numSamples * NUM_CHANNELS; i++)
+		samples[i] = std::max(-1.0f, std::min(1.0f, samples[i]));
+}
+
+// Resamples a chunk of mixed samples, stepping through the input by step samples per output sample, with cubic
+// (Catmull-Rom) interpolation across the end of the previous chunk. Returns the number of samples output.
+static unsigned ResampleChunk(const float *src, unsigned numSamples, float *dest, double step)
+{
+	float in[(3 + SAMPLES_PER_FRAME) * NUM_CHANNELS];
+	memcpy(in, resampleHistory, sizeof(resampleHistory));
+	memcpy(in + 3 * NUM_CHANNELS, src, numSamples * BYTES_PER_SAMPLE);
+
+	// Each output sample needs one input sample before and two after its position
+	unsigned lastSample = numSamples + 2;
+	unsigned n = 0;
+	double pos = resamplePos;
+	while (n < maxResampledSamples && unsigned(pos) + 2 <= lastSample)
+	{
+		unsigned i = unsigned(pos);
+		float t = float(pos - i);
+		const float *p = in + (i - 1) * NUM_CHANNELS;
+		for (unsigned c = 0; c < NUM_CHANNELS; c++)
+		{
+			float p0 = p[c], p1 = p[c + NUM_CHANNELS], p2 = p[c + 2 * NUM_CHANNELS], p3 = p[c + 3 * NUM_CHANNELS];
+			dest[n * NUM_CHANNELS + c] = p1 + 0.5f * t * (p2 - p0 + t * (2 * p0 - 5 * p1 + 4 * p2 - p3 + t * (3 * (p1 - p2) + p3 - p0)));
+		}
+		n++;
+		pos += step;
+	}
+
+	// Carry position and last 3 samples over to next chunk
+	resamplePos = pos - numSamples;
+	memcpy(resampleHistory, in + numSamples * NUM_CHANNELS, sizeof(resampleHistory));
+	return n;
+}
+
 /*
 static void LogAudioInfo(SDL_AudioSpec *fmt)
 {
@@ -226,32 +322,49 @@ static void LogAudioInfo(SDL_AudioSpec *fmt)
 }
 */
 
-bool OpenAudio()
+bool OpenAudio(const char *driver, unsigned requestedPeriod)
 {
 	// Initialize SDL audio sub-system
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
 		return ErrorLog("Unable to initialize SDL audio sub-system: %s\n", SDL_GetError());
 
+	// Switch to the requested driver, if any
+	if (driver != NULL && driver[0] != '\0')
+	{
+		SDL_AudioQuit();
+		if (SDL_AudioInit(driver) != 0)
+		{
+			std::string available;
+			for (int i = 0; i < SDL_GetNumAudioDrivers(); i++)
+				available += std::string(i ? ", " : "") + SDL_GetAudioDriver(i);
+			return ErrorLog("Unable to use audio driver '%s': %s (available: %s)\n", driver, SDL_GetError(), available.c_str());
+		}
+	}
+
+	// Device period must be a power of two
+	unsigned period = minPeriodSamples;
+	while (period < requestedPeriod && period < maxPeriodSamples)
+		period *= 2;
+
 	// Set up audio specification
-	SDL_AudioSpec fmt;
+	SDL_AudioSpec fmt, obtained;
 	memset(&fmt, 0, sizeof(SDL_AudioSpec));
 	fmt.freq = SAMPLE_RATE;
 	fmt.channels = NUM_CHANNELS;
-	fmt.format = AUDIO_S16SYS;
-	fmt.samples = playSamples;
+	fmt.format = AUDIO_F32SYS;
+	fmt.samples = Uint16(period);
 	fmt.callback = PlayCallback;
 
-	// Force SDL to use the format we requested; it will convert if necessary
-	if (SDL_OpenAudio(&fmt, nullptr) < 0)
+	// Force SDL to use the format we requested; it will convert if necessary. Only the period may differ, as some
+	// devices have a minimum or fixed size.
+	audioDevice = SDL_OpenAudioDevice(NULL, 0, &fmt, &obtained, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+	if (audioDevice == 0)
 		return ErrorLog("Unable to open 44.1KHz 2-channel audio with SDL: %s\n", SDL_GetError());
+	periodSamples = obtained.samples;
+	latencyDecayCallbacks = 10 * SAMPLE_RATE / periodSamples;
+	InfoLog("Audio output: %s driver, %u-sample period (%1.1f ms).", SDL_GetCurrentAudioDriver(), periodSamples, 1000.0 * periodSamples / SAMPLE_RATE);
 
 	// Create audio buffer
-	constexpr uint32_t bufferSize = SAMPLE_RATE * BYTES_PER_SAMPLE * latency / MAX_LATENCY;
-	static_assert(bufferSize % BYTES_PER_SAMPLE == 0, "must be an integer multiple of the sample size"); 
-	audioBufferSize = bufferSize;
-	
-	int minBufferSize = 3 * BYTES_PER_FRAME;
-	audioBufferSize = std::max<int>(minBufferSize, audioBufferSize);
 	audioBuffer = new(std::nothrow) INT8[audioBufferSize];
 	if (audioBuffer == NULL)
 	{
@@ -260,169 +373,89 @@ bool OpenAudio()
 	}
 	memset(audioBuffer, 0, sizeof(INT8) * audioBufferSize);
 
-	// Set initial play position to be beginning of buffer and initial write position to be half-way into buffer
+	// Set initial latency, and start with half of it buffered as silence
+	constexpr UINT32 initialLatency = SAMPLE_RATE * BYTES_PER_SAMPLE * latency / MAX_LATENCY;
+	static_assert(initialLatency % BYTES_PER_SAMPLE == 0, "must be an integer multiple of the sample size");
+	static_assert(initialLatency >= minLatencyBytes && initialLatency <= maxLatencyBytes, "initial latency out of range");
+	latencyBytes = initialLatency;
 	playPos = 0;
-	constexpr uint32_t endOfBuffer = bufferSize - BYTES_PER_FRAME;
-	constexpr uint32_t midpointAfterFirstFrameUnaligned = BYTES_PER_FRAME + (bufferSize - BYTES_PER_FRAME) / 2;
-	constexpr uint32_t extraPaddingNeeded = (BYTES_PER_SAMPLE - midpointAfterFirstFrameUnaligned % BYTES_PER_SAMPLE) % BYTES_PER_SAMPLE;
-	constexpr uint32_t midpointAfterFirstFrame = midpointAfterFirstFrameUnaligned + extraPaddingNeeded;
-	static_assert(endOfBuffer % BYTES_PER_SAMPLE == 0, "make sure we are aligned to a sample boundary otherwise underrun/overrun adjustment will end up shifting playback by one channel causing stereo to flip");
-	static_assert(midpointAfterFirstFrame % BYTES_PER_SAMPLE == 0,"error");
-	writePos = std::min<int>(endOfBuffer, midpointAfterFirstFrame);
-	writeWrapped = false;
+	writePos = initialLatency / 2 / BYTES_PER_SAMPLE * BYTES_PER_SAMPLE;
+	priming = false;
+	callbacksSinceUnderRun = 0;
+	resamplePos = 1;
+	memset(resampleHistory, 0, sizeof(resampleHistory));
 
 	// Reset counters
+	outputBytes = writePos.load() + periodSamples * BYTES_PER_SAMPLE;
 	underRuns = 0;
 	overRuns = 0;
 
 	// Start audio playing
-	SDL_PauseAudio(0);
+	SDL_PauseAudioDevice(audioDevice, 0);
 	return OKAY;
 }
 
 bool OutputAudio(unsigned numSamples, INT16 *leftBuffer, INT16 *rightBuffer, bool flipStereo)
 {
-	//printf("OutputAudio(%u) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u]\n",
-	//	numSamples, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize);
-
-	UINT32 bytesRemaining;
-	UINT32 bytesToCopy;
-	INT16 *src;
-
 	// Number of samples should never be more than max number of samples per frame
 	if (numSamples > SAMPLES_PER_FRAME)
 		numSamples = SAMPLES_PER_FRAME;
 
-	// Mix together left and right channels into single chunk of data
-	INT16 mixBuffer[NUM_CHANNELS * SAMPLES_PER_FRAME];
-	MixChannels(numSamples, leftBuffer, rightBuffer, mixBuffer, flipStereo);
-
-	// Lock SDL audio callback so that it doesn't interfere with following code
-	SDL_LockAudio();
-
-	// Calculate number of bytes for current sound chunk
-	UINT32 numBytes = numSamples * BYTES_PER_SAMPLE;
+	if (discard)
+		return false;
 
-	// Get end of current play region (writing must occur past this point)
-	UINT32 playEndPos = playPos + BYTES_PER_FRAME;
+	UINT32 write = writePos.load(std::memory_order_relaxed);
+	UINT32 filled = write - playPos.load(std::memory_order_acquire);
+	UINT32 target = latencyBytes.load(std::memory_order_relaxed);
 
-	// Undo any wrap-around of the write position that may have occured to create following ordering: playPos < playEndPos < writePos
-	if (playEndPos > writePos && writeWrapped)
-		writePos += audioBufferSize;
+	bool bufferFull = filled + 2 * BYTES_PER_FRAME > target;
 
-	// Check if play region has caught up with write position and now overlaps it (ie buffer under-run)
-	if (playEndPos > writePos)
 	{
-		underRuns++;
-
-		//printf("Audio buffer under-run #%u in OutputAudio(%u) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u, numBytes = %u]\n",
-		//	underRuns, numSamples, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize, numBytes);
-
-		// See what action to take on under-run
-		if (underRunLoop)
+		std::lock_guard<std::mutex> lock(tapMutex);
+		if (tap != NULL)
 		{
-			// If loop, then move play position back to beginning of data in buffer
-			playPos = writePos + numBytes + BYTES_PER_FRAME;
-
-			// Check if play position has moved past end of buffer
-			if (playPos >= audioBufferSize)
-				// If so, wrap it around to beginning again (but keep write wrapped flag as before)
-				playPos -= audioBufferSize;
-			else
-			{
-				// Otherwise, set write wrapped flag as will now appear as if write has wrapped but play position has not
-				writeWrapped = true;
-				writePos += audioBufferSize;
-			}
+			INT16 tapBuffer[NUM_CHANNELS * SAMPLES_PER_FRAME];
+			MixChannels(numSamples, leftBuffer, rightBuffer, tapBuffer, flipStereo);
+			tap(tapData, tapBuffer, numSamples);
 		}
-		else
-		{
-			// Otherwise, bump write position forward in chunks until it is past end of play region
-			do
-			{
-				writePos += numBytes;
-			}
-			while (playEndPos > writePos);
-		}
-	}
-
-	// Check if write position has caught up with play region and now overlaps it (ie buffer over-run)
-	bool overRun = writePos + numBytes > playPos + audioBufferSize;
-
-	bool bufferFull = writePos + 2 * BYTES_PER_FRAME > playPos + audioBufferSize;
-
-	// Move write position back to within buffer
-	if (writePos >= audioBufferSize)
-		writePos -= audioBufferSize;
-
-	// Handle buffer over-run
-	if (overRun)
-	{
-		overRuns++;
-
-		//printf("Audio buffer over-run #%u in OutputAudio(%u) [writePos = %u, writeWrapped = %s, playPos = %u, audioBufferSize = %u, numBytes = %u]\n",
-		//	overRuns, numSamples, writePos, (writeWrapped ? "true" : "false"), playPos, audioBufferSize, numBytes);
-
-		bufferFull = true;
-
-		// Discard current chunk of data
-		goto Finish;
 	}
 
-	src = mixBuffer;
-	INT8 *dst1;
-	INT8 *dst2;
-	UINT32 len1;
-	UINT32 len2;
-
-	// Check if write region extends past end of buffer
-	if (writePos + numBytes > audioBufferSize)
-	{
-		// If so, split write region into two
-		dst1 = audioBuffer + writePos;
-		dst2 = audioBuffer;
-		len1 = audioBufferSize - writePos;
-		len2 = numBytes - len1;
-	}
-	else
+	// Mix together left and right channels into single chunk of data
+	float mixBuffer[NUM_CHANNELS * SAMPLES_PER_FRAME];
+	MixChannelsFloat(numSamples, leftBuffer, rightBuffer, mixBuffer, flipStereo);
+
+	// With rate control, resample chunk to move the buffer towards a set point just under where it is considered full.
+	// Output is stretched (and so the buffer fills) in proportion to how far below the set point it is, and vice versa.
+	float resampleBuffer[NUM_CHANNELS * maxResampledSamples];
+	float *chunk = mixBuffer;
+	if (rateControl)
 	{
-		// Otherwise, just copy whole region
-		dst1 = audioBuffer + writePos;
-		dst2 = 0;
-		len1 = numBytes;
-		len2 = 0;
+		double setPoint = std::max<double>(target / 2, double(target) - 3 * BYTES_PER_FRAME);
+		double delta = std::max(-maxRateDelta, std::min(maxRateDelta, maxRateDelta * (setPoint - filled) / setPoint));
+		numSamples = ResampleChunk(mixBuffer, numSamples, resampleBuffer, 1 / (1 + delta));
+		chunk = resampleBuffer;
+		ClipChunk(chunk, numSamples);
 	}
 
-	// Copy chunk to write position in buffer
-	bytesRemaining = numBytes;
-	bytesToCopy = (bytesRemaining > len1 ? len1 : bytesRemaining);
-	memcpy(dst1, src, bytesToCopy);
-
-	// Adjust for number of bytes copied
-	bytesRemaining -= bytesToCopy;
-	src = (INT16*)((UINT8*)src + bytesToCopy);
+	// Calculate number of bytes for current sound chunk
+	UINT32 numBytes = numSamples * BYTES_PER_SAMPLE;
 
-	if (bytesRemaining)
+	// Check if chunk would take buffer past target latency (ie buffer over-run) and if so, discard it
+	if (filled + numBytes > target)
 	{
-		// If write region was split into two, copy second half of chunk into buffer as well
-		bytesToCopy = (bytesRemaining > len2 ? len2 : bytesRemaining);
-		memcpy(dst2, src, bytesToCopy);
+		overRuns.fetch_add(1, std::memory_order_relaxed);
+		return true;
 	}
 
-	// Move write position forward for next time
-	writePos += numBytes;
-
-	// Check if write position has moved past end of buffer
-	if (writePos >= audioBufferSize)
-	{
-		// If so, wrap it around to beginning again and set write wrapped flag
-		writePos -= audioBufferSize;
-		writeWrapped = true;
-	}
+	// Copy chunk to write position in buffer, splitting it in two if it extends past end of buffer
+	UINT32 offset = write & (audioBufferSize - 1);
+	UINT32 len1 = std::min(numBytes, audioBufferSize - offset);
+	memcpy(audioBuffer + offset, chunk, len1);
+	if (len1 < numBytes)
+		memcpy(audioBuffer, (INT8*)chunk + len1, numBytes - len1);
 
-Finish:
-	// Unlock SDL audio callback
-	SDL_UnlockAudio();
+	// Publish chunk to callback
+	writePos.store(write + numBytes, std::memory_order_release);
 
 	// Return whether buffer is half full
 	return bufferFull;
@@ -431,7 +464,11 @@ Finish:
 void CloseAudio()
 {
 	// Close SDL audio output
-	SDL_CloseAudio();
+	if (audioDevice != 0)
+	{
+		SDL_CloseAudioDevice(audioDevice);
+		audioDevice = 0;
+	}
 
 	// Delete audio buffer
 	if (audioBuffer != NULL)
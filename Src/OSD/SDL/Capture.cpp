@@ -0,0 +1,686 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * Capture.cpp
+ *
+ * Screenshots and video recording. See Capture.h.
+ */
+
+#include "Capture.h"
+
+#include <GL/glew.h>
+#include <zlib.h>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+
+#include "Supermodel.h"
+#include "Util/BMPFile.h"
+
+#ifdef _WIN32
+#define popen   _popen
+#define pclose  _pclose
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define SAMPLE_RATE 44100
+#define FRAME_RATE  60
+
+static bool EndsWith(const std::string &str, const char *suffix)
+{
+  size_t len = strlen(suffix);
+  if (str.length() < len)
+    return false;
+  for (size_t i = 0; i < len; i++)
+  {
+    if (tolower(str[str.length() - len + i]) != tolower(suffix[i]))
+      return false;
+  }
+  return true;
+}
+
+static void PutBE32(UINT8 *p, UINT32 value)
+{
+  p[0] = UINT8(value >> 24);
+  p[1] = UINT8(value >> 16);
+  p[2] = UINT8(value >> 8);
+  p[3] = UINT8(value);
+}
+
+static void PutLE16(UINT8 *p, UINT16 value)
+{
+  p[0] = UINT8(value);
+  p[1] = UINT8(value >> 8);
+}
+
+static void PutLE32(UINT8 *p, UINT32 value)
+{
+  p[0] = UINT8(value);
+  p[1] = UINT8(value >> 8);
+  p[2] = UINT8(value >> 16);
+  p[3] = UINT8(value >> 24);
+}
+
+static bool WritePNGChunk(FILE *fp, const char *type, const UINT8 *data, UINT32 size)
+{
+  UINT8 header[8];
+  PutBE32(header, size);
+  memcpy(header + 4, type, 4);
+  UINT8 crc[4];
+  uLong value = crc32(0L, Z_NULL, 0);
+  value = crc32(value, header + 4, 4);
+  if (size > 0)
+    value = crc32(value, data, size);
+  PutBE32(crc, UINT32(value));
+  return fwrite(header, sizeof(header), 1, fp) == 1
+    && (size == 0 || fwrite(data, size, 1, fp) == 1)
+    && fwrite(crc, sizeof(crc), 1, fp) == 1;
+}
+
+#ifndef _WIN32
+// Starts a shell command with pipes to its standard input and its file
+// descriptor 3, so that ffmpeg can read video and audio from separate pipes
+static bool StartPipedCommand(const std::string &command, FILE **input, FILE **extra, int *pid)
+{
+  int inputPipe[2], extraPipe[2];
+  if (pipe(inputPipe) != 0)
+    return FAIL;
+  if (pipe(extraPipe) != 0)
+  {
+    close(inputPipe[0]);
+    close(inputPipe[1]);
+    return FAIL;
+  }
+  pid_t child = fork();
+  if (child == 0)
+  {
+    // A copy above them all, in case a pipe is already on descriptor 3
+    int extraRead = dup(extraPipe[0]);
+    dup2(inputPipe[0], 0);
+    dup2(extraRead, 3);
+    int fds[] = { inputPipe[0], inputPipe[1], extraPipe[0], extraPipe[1], extraRead };
+    for (int fd: fds)
+    {
+      if (fd > 3)
+        close(fd);
+    }
+    execl("/bin/sh", "sh", "-c", command.c_str(), (char *) NULL);
+    _exit(127);
+  }
+  close(inputPipe[0]);
+  close(extraPipe[0]);
+  if (child < 0)
+  {
+    close(inputPipe[1]);
+    close(extraPipe[1]);
+    return FAIL;
+  }
+  *input = fdopen(inputPipe[1], "w");
+  *extra = fdopen(extraPipe[1], "w");
+  *pid = int(child);
+  return OKAY;
+}
+#endif
+
+// Writes RGBA pixels, bottom row first as OpenGL reads them, as an RGB PNG file
+static bool WritePNG(const std::string &file, const UINT8 *pixels, unsigned width, unsigned height)
+{
+  // Each row is stored top first and preceded by its filter type (none)
+  size_t rowBytes = 1 + size_t(width) * 3;
+  std::vector<UINT8> raw(rowBytes * height);
+  for (unsigned y = 0; y < height; y++)
+  {
+    const UINT8 *src = &pixels[size_t(height - 1 - y) * width * 4];
+    UINT8 *dest = &raw[y * rowBytes];
+    *dest++ = 0;
+    for (unsigned x = 0; x < width; x++, src += 4)
+    {
+      *dest++ = src[0];
+      *dest++ = src[1];
+      *dest++ = src[2];
+    }
+  }
+  uLongf compressedSize = compressBound(uLong(raw.size()));
+  std::vector<UINT8> compressed(compressedSize);
+  if (compress2(compressed.data(), &compressedSize, raw.data(), uLong(raw.size()), Z_BEST_SPEED) != Z_OK)
+    return FAIL;
+
+  FILE *fp = fopen(file.c_str(), "wb");
+  if (fp == NULL)
+    return FAIL;
+  static const UINT8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  UINT8 ihdr[13];
+  PutBE32(ihdr + 0, width);
+  PutBE32(ihdr + 4, height);
+  ihdr[8] = 8;    // bits per component
+  ihdr[9] = 2;    // RGB
+  ihdr[10] = 0;   // deflate
+  ihdr[11] = 0;   // adaptive filtering
+  ihdr[12] = 0;   // not interlaced
+  bool ok = fwrite(signature, sizeof(signature), 1, fp) == 1
+    && WritePNGChunk(fp, "IHDR", ihdr, sizeof(ihdr))
+    && WritePNGChunk(fp, "IDAT", compressed.data(), UINT32(compressedSize))
+    && WritePNGChunk(fp, "IEND", NULL, 0);
+  ok = fclose(fp) == 0 && ok;
+  return ok ? OKAY : FAIL;
+}
+
+// Converts RGBA pixels, bottom row first, to 4:2:0 YCbCr planes (BT.601, full range as in C420jpeg)
+static void ConvertToYUV420(UINT8 *yuv, const UINT8 *pixels, unsigned srcWidth, unsigned width, unsigned height)
+{
+  UINT8 *yPlane = yuv;
+  UINT8 *uPlane = yPlane + width * height;
+  UINT8 *vPlane = uPlane + (width / 2) * (height / 2);
+  for (unsigned y = 0; y < height; y += 2)
+  {
+    const UINT8 *row0 = &pixels[size_t(height - 1 - y) * srcWidth * 4];
+    const UINT8 *row1 = &pixels[size_t(height - 2 - y) * srcWidth * 4];
+    for (unsigned x = 0; x < width; x += 2)
+    {
+      int r = 0, g = 0, b = 0;
+      const UINT8 *quad[4] = { &row0[x * 4], &row0[x * 4 + 4], &row1[x * 4], &row1[x * 4 + 4] };
+      UINT8 *yOut[4] = { &yPlane[y * width + x], &yPlane[y * width + x + 1], &yPlane[(y + 1) * width + x], &yPlane[(y + 1) * width + x + 1] };
+      for (int i = 0; i < 4; i++)
+      {
+        const UINT8 *p = quad[i];
+        *yOut[i] = UINT8((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+        r += p[0];
+        g += p[1];
+        b += p[2];
+      }
+      r = (r + 2) / 4;
+      g = (g + 2) / 4;
+      b = (b + 2) / 4;
+      uPlane[(y / 2) * (width / 2) + x / 2] = UINT8(std::min(255, std::max(0, ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128)));
+      vPlane[(y / 2) * (width / 2) + x / 2] = UINT8(std::min(255, std::max(0, ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128)));
+    }
+  }
+}
+
+
+/******************************************************************************
+ Render Thread
+******************************************************************************/
+
+void CCapture::Screenshot(const std::string &file)
+{
+  m_screenshot = file;
+}
+
+bool CCapture::StartRecording(const std::string &file)
+{
+  StopRecording();
+  Flush();  // worker is idle from here on, so the recorder can be set up directly
+  OpenRecording(file);
+  if (m_recorder.audio == NULL)
+  {
+    CloseRecording();
+    return ErrorLog("Unable to record video to '%s'.", file.c_str());
+  }
+  m_recording = true;
+  m_droppedFrames = 0;
+  SetAudioTap(AudioTap, this);
+  printf("Recording video to '%s'.\n", file.c_str());
+  return OKAY;
+}
+
+void CCapture::StopRecording(void)
+{
+  if (!m_recording)
+    return;
+  SetAudioTap(NULL, NULL);
+  m_recording = false;
+  Flush();
+  UINT64 frames = m_recorder.frames;
+  UINT64 dropped = m_droppedFrames + m_recorder.skipped;
+  std::string file = m_recorder.file;
+  const char *done = m_recorder.stream ? "Streamed" : "Recorded";
+  CloseRecording();
+  printf("%s %llu frames to '%s'.\n", done, (unsigned long long) frames, file.c_str());
+  InfoLog("%s %llu frames to '%s' (%llu dropped).", done, (unsigned long long) frames, file.c_str(), (unsigned long long) dropped);
+}
+
+bool CCapture::Recording(void) const
+{
+  return m_recording;
+}
+
+bool CCapture::StartStreaming(const std::string &url, const std::string &encoder, unsigned kbps)
+{
+  StopRecording();
+  Flush();
+  m_recorder = Recorder();
+  m_recorder.file = url;
+  m_recorder.pipe = true;
+  m_recorder.stream = true;
+  m_recorder.encoder = encoder;
+  m_recorder.kbps = kbps;
+#ifndef _WIN32
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  m_recording = true;
+  m_droppedFrames = 0;
+  SetAudioTap(AudioTap, this);
+  printf("Streaming video to '%s'.\n", url.c_str());
+  return OKAY;
+}
+
+void CCapture::CaptureFrame(unsigned width, unsigned height)
+{
+  Slot &slot = m_slots[m_nextSlot];
+  bool wanted = m_recording || !m_screenshot.empty();
+  if (!wanted && !slot.pending)
+  {
+    // Nothing wanted, but finish off any frames still in flight in order
+    bool anyPending = false;
+    for (unsigned i = 0; i < NUM_SLOTS; i++)
+      anyPending = anyPending || m_slots[i].pending;
+    if (!anyPending)
+      return;
+  }
+
+  // Oldest frame has long been read back by now
+  if (slot.pending)
+    FinishSlot(slot);
+  m_nextSlot = (m_nextSlot + 1) % NUM_SLOTS;
+  if (!wanted)
+    return;
+
+  slot.width = width;
+  slot.height = height;
+  slot.video = m_recording;
+  slot.screenshot.swap(m_screenshot);
+  m_screenshot.clear();
+  if (!m_usePBOs)
+  {
+    // Read back synchronously; only the encoding is done in the background
+    slot.pending = true;
+    FinishSlot(slot);
+    return;
+  }
+
+  GLint size = GLint(width * height * 4);
+  GLint allocated = 0;
+  if (slot.pbo == 0)
+    glGenBuffers(1, &slot.pbo);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  glGetBufferParameteriv(GL_PIXEL_PACK_BUFFER, GL_BUFFER_SIZE, &allocated);
+  if (allocated != size)
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.pending = true;
+}
+
+void CCapture::FinishSlot(Slot &slot)
+{
+  slot.pending = false;
+  std::vector<UINT8> pixels(size_t(slot.width) * slot.height * 4);
+  if (m_usePBOs)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const void *mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (mapped != NULL)
+      memcpy(pixels.data(), mapped, pixels.size());
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (mapped == NULL)
+      return;
+  }
+  else
+    glReadPixels(0, 0, slot.width, slot.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+  if (!slot.screenshot.empty())
+  {
+    Job job;
+    job.type = JobScreenshot;
+    job.file.swap(slot.screenshot);
+    job.width = slot.width;
+    job.height = slot.height;
+    job.data = slot.video ? pixels : std::move(pixels);
+    Queue(std::move(job));
+  }
+  if (slot.video)
+  {
+    // Drop frames rather than wait for the worker
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_queuedFrames >= MAX_QUEUED_FRAMES)
+      {
+        m_droppedFrames++;
+        return;
+      }
+    }
+    Job job;
+    job.type = JobVideoFrame;
+    job.width = slot.width;
+    job.height = slot.height;
+    job.data = std::move(pixels);
+    Queue(std::move(job));
+  }
+}
+
+void CCapture::Flush(void)
+{
+  for (unsigned i = 0; i < NUM_SLOTS; i++)
+  {
+    Slot &slot = m_slots[(m_nextSlot + i) % NUM_SLOTS];
+    if (slot.pending)
+      FinishSlot(slot);
+  }
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+}
+
+void CCapture::Queue(Job &&job)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (job.type == JobVideoFrame)
+    m_queuedFrames++;
+  m_jobs.push_back(std::move(job));
+  m_wake.notify_one();
+}
+
+// Called on the thread that outputs audio
+void CCapture::AudioTap(void *data, const INT16 *samples, unsigned numSamples)
+{
+  CCapture *capture = (CCapture *) data;
+  Job job;
+  job.type = JobAudio;
+  job.data.resize(numSamples * 2 * sizeof(INT16));
+  for (unsigned i = 0; i < numSamples * 2; i++)
+    PutLE16(&job.data[i * 2], UINT16(samples[i]));
+  capture->Queue(std::move(job));
+}
+
+
+/******************************************************************************
+ Worker Thread
+******************************************************************************/
+
+void CCapture::WorkerThread(void)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true)
+  {
+    m_wake.wait(lock, [this] { return m_quit || !m_jobs.empty(); });
+    if (m_jobs.empty())
+      return;
+    Job job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    m_busy = true;
+    lock.unlock();
+    DoJob(job);
+    lock.lock();
+    m_busy = false;
+    if (job.type == JobVideoFrame)
+      m_queuedFrames--;
+    if (m_jobs.empty())
+      m_idle.notify_all();
+  }
+}
+
+void CCapture::DoJob(Job &job)
+{
+  switch (job.type)
+  {
+  case JobScreenshot:
+  {
+    bool ok;
+    if (EndsWith(job.file, ".bmp"))
+      ok = Util::WriteSurfaceToBMP<Util::RGBA8>(job.file, job.data.data(), job.width, job.height, true) == OKAY;
+    else
+      ok = WritePNG(job.file, job.data.data(), job.width, job.height) == OKAY;
+    if (!ok)
+      ErrorLog("Unable to write screenshot to '%s'.", job.file.c_str());
+    break;
+  }
+  case JobVideoFrame:
+    WriteVideoFrame(job);
+    break;
+  case JobAudio:
+    if (m_recorder.audio != NULL && fwrite(job.data.data(), job.data.size(), 1, m_recorder.audio) == 1)
+      m_recorder.audioBytes += UINT32(job.data.size());
+    else if (m_recorder.audioPipe != NULL)
+      fwrite(job.data.data(), job.data.size(), 1, m_recorder.audioPipe);
+    break;
+  }
+}
+
+void CCapture::OpenRecording(const std::string &file)
+{
+  m_recorder = Recorder();
+  m_recorder.file = file;
+  m_recorder.pipe = !EndsWith(file, ".y4m");
+
+  // Check the video file can be written; ffmpeg is started with the first frame, once its size is known
+  if (!m_recorder.pipe)
+  {
+    m_recorder.video = fopen(file.c_str(), "wb");
+    if (m_recorder.video == NULL)
+      return;
+  }
+#ifndef _WIN32
+  else
+    signal(SIGPIPE, SIG_IGN); // ffmpeg failing must not take the emulator with it
+#endif
+
+  // Sizes are filled in on closing
+  m_recorder.audio = fopen((file + ".wav").c_str(), "wb");
+  if (m_recorder.audio == NULL)
+    return;
+  UINT8 header[44];
+  memcpy(header + 0, "RIFF", 4);
+  PutLE32(header + 4, 36);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  PutLE32(header + 16, 16);
+  PutLE16(header + 20, 1);                    // PCM
+  PutLE16(header + 22, 2);                    // stereo
+  PutLE32(header + 24, SAMPLE_RATE);
+  PutLE32(header + 28, SAMPLE_RATE * 2 * 2);  // bytes per second
+  PutLE16(header + 32, 2 * 2);                // bytes per sample
+  PutLE16(header + 34, 16);                   // bits
+  memcpy(header + 36, "data", 4);
+  PutLE32(header + 40, 0);
+  fwrite(header, sizeof(header), 1, m_recorder.audio);
+}
+
+void CCapture::CloseRecording(void)
+{
+#ifndef _WIN32
+  if (m_recorder.pid >= 0)
+  {
+    // ffmpeg sees the end of both inputs and finishes the stream
+    if (m_recorder.video != NULL)
+      fclose(m_recorder.video);
+    if (m_recorder.audioPipe != NULL)
+      fclose(m_recorder.audioPipe);
+    m_recorder.video = NULL;
+    waitpid(pid_t(m_recorder.pid), NULL, 0);
+  }
+#endif
+  if (m_recorder.video != NULL)
+  {
+    if (m_recorder.pipe)
+      pclose(m_recorder.video);
+    else
+      fclose(m_recorder.video);
+  }
+  if (m_recorder.audio != NULL)
+  {
+    UINT8 size[4];
+    PutLE32(size, 36 + m_recorder.audioBytes);
+    fseek(m_recorder.audio, 4, SEEK_SET);
+    fwrite(size, sizeof(size), 1, m_recorder.audio);
+    PutLE32(size, m_recorder.audioBytes);
+    fseek(m_recorder.audio, 40, SEEK_SET);
+    fwrite(size, sizeof(size), 1, m_recorder.audio);
+    fclose(m_recorder.audio);
+  }
+  m_recorder = Recorder();
+}
+
+void CCapture::WriteVideoFrame(const Job &job)
+{
+  Recorder &rec = m_recorder;
+  if (rec.width == 0)
+  {
+    // 4:2:0 needs an even size
+    rec.width = rec.pipe ? job.width : job.width & ~1;
+    rec.height = rec.pipe ? job.height : job.height & ~1;
+    if (rec.stream)
+      OpenStreamEncoder();
+    else if (rec.pipe)
+    {
+      std::string command = Util::Format() << "ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgba -video_size " << rec.width << "x" << rec.height
+        << " -framerate " << FRAME_RATE << " -i - -vf vflip -pix_fmt yuv420p \"" << rec.file << "\"";
+#ifdef _WIN32
+      rec.video = popen(command.c_str(), "wb");
+#else
+      rec.video = popen(command.c_str(), "w");
+#endif
+      if (rec.video == NULL)
+        ErrorLog("Unable to start ffmpeg to record '%s'.", rec.file.c_str());
+    }
+    else if (rec.video != NULL)
+      fprintf(rec.video, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", rec.width, rec.height, FRAME_RATE);
+  }
+
+  // Frames of another size (after switching to full screen, say) cannot be added
+  if (rec.video == NULL || (job.width & ~(rec.pipe ? 0u : 1u)) != rec.width || (job.height & ~(rec.pipe ? 0u : 1u)) != rec.height)
+  {
+    rec.skipped++;
+    return;
+  }
+
+  if (rec.pipe)
+  {
+    if (fwrite(job.data.data(), job.data.size(), 1, rec.video) != 1)
+    {
+      rec.skipped++;
+      return;
+    }
+  }
+  else
+  {
+    rec.yuv.resize(rec.width * rec.height + 2 * (rec.width / 2) * (rec.height / 2));
+    ConvertToYUV420(rec.yuv.data(), job.data.data() + size_t(job.height - rec.height) * job.width * 4, job.width, rec.width, rec.height);
+    fputs("FRAME\n", rec.video);
+    fwrite(rec.yuv.data(), rec.yuv.size(), 1, rec.video);
+  }
+  rec.frames++;
+}
+
+// Low latency settings, and any device and upload filter needed, of the
+// encoders a stream is likely to use. Others are used as they come.
+static const struct
+{
+  const char *name;
+  const char *device;   // before the inputs
+  const char *filters;  // after flipping the frame
+  const char *options;
+} s_streamEncoders[] =
+{
+  { "libx264",            "",                                       "",                     "-preset ultrafast -tune zerolatency" },
+  { "h264_nvenc",         "",                                       "",                     "-preset p1 -tune ull -zerolatency 1 -delay 0" },
+  { "hevc_nvenc",         "",                                       "",                     "-preset p1 -tune ull -zerolatency 1 -delay 0" },
+  { "h264_vaapi",         "-vaapi_device /dev/dri/renderD128 ",     ",format=nv12,hwupload", "" },
+  { "hevc_vaapi",         "-vaapi_device /dev/dri/renderD128 ",     ",format=nv12,hwupload", "" },
+  { "h264_qsv",           "",                                       "",                     "-preset veryfast -async_depth 1" },
+  { "h264_videotoolbox",  "",                                       "",                     "-realtime 1" },
+  { "hevc_videotoolbox",  "",                                       "",                     "-realtime 1" }
+};
+
+void CCapture::OpenStreamEncoder(void)
+{
+  Recorder &rec = m_recorder;
+  const char *device = "", *filters = "", *options = "";
+  for (auto &encoder: s_streamEncoders)
+  {
+    if (rec.encoder == encoder.name)
+    {
+      device = encoder.device;
+      filters = encoder.filters;
+      options = encoder.options;
+    }
+  }
+
+  // No B-frames and a key frame a second, so that viewers can join quickly,
+  // and packets sent as soon as they are muxed
+  Util::Format command;
+  command << "ffmpeg -loglevel error " << device << "-f rawvideo -pix_fmt rgba -video_size " << rec.width << "x" << rec.height
+    << " -framerate " << FRAME_RATE << " -i - ";
+#ifndef _WIN32
+  command << "-f s16le -ar " << SAMPLE_RATE << " -ac 2 -i pipe:3 ";
+#endif
+  command << "-vf vflip" << filters << " -c:v " << rec.encoder << ' ' << options << " -b:v " << rec.kbps << "k -g " << FRAME_RATE << " -bf 0 ";
+#ifndef _WIN32
+  command << "-c:a aac -b:a 128k ";
+#else
+  command << "-an ";
+#endif
+  command << "-flush_packets 1 -muxdelay 0 -f " << (rec.file.compare(0, 6, "rtp://") == 0 ? "rtp_mpegts" : "mpegts") << " \"" << rec.file << "\"";
+
+#ifndef _WIN32
+  if (OKAY != StartPipedCommand(command, &rec.video, &rec.audioPipe, &rec.pid))
+#else
+  rec.video = popen(command.str().c_str(), "wb");
+  if (rec.video == NULL)
+#endif
+    ErrorLog("Unable to start ffmpeg to stream to '%s'.", rec.file.c_str());
+}
+
+
+/******************************************************************************
+ Construction and Destruction
+******************************************************************************/
+
+CCapture::CCapture(void)
+  : m_nextSlot(0),
+    m_usePBOs(GLEW_ARB_pixel_buffer_object || GLEW_VERSION_2_1),
+    m_recording(false),
+    m_droppedFrames(0),
+    m_queuedFrames(0),
+    m_busy(false),
+    m_quit(false)
+{
+  m_worker = std::thread(&CCapture::WorkerThread, this);
+}
+
+CCapture::~CCapture(void)
+{
+  StopRecording();
+  Flush();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+    m_wake.notify_one();
+  }
+  m_worker.join();
+  for (unsigned i = 0; i < NUM_SLOTS; i++)
+  {
+    if (m_slots[i].pbo != 0)
+      glDeleteBuffers(1, &m_slots[i].pbo);
+  }
+}
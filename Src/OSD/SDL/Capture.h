@@ -0,0 +1,205 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * Capture.h
+ *
+ * Header file for CCapture, which saves screenshots and records video and
+ * audio without holding up the frame.
+ */
+
+#ifndef INCLUDED_CAPTURE_H
+#define INCLUDED_CAPTURE_H
+
+#include "Types.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Frames are read back from the back buffer into a ring of pixel buffer
+ * objects and only mapped a few frames later, once the GPU has long finished
+ * with them, so that the render thread never waits for a transfer.  Files are
+ * encoded and written by a worker thread.  Screenshots are PNG files (BMP if
+ * the name ends in .bmp).  Video is written as YUV4MPEG2 (4:2:0) if the file
+ * name ends in .y4m and is otherwise piped as raw frames to ffmpeg, which
+ * picks the format from the name.  Audio output is recorded alongside, to a
+ * WAV file named after the video.  Frames that arrive while the worker is too
+ * far behind are dropped rather than stalling the game.
+ *
+ * A stream is a recording whose frames and audio are piped to ffmpeg, which
+ * encodes them with the encoder asked for (a hardware one, for preference) set
+ * for low latency and sends them as MPEG-TS to an SRT, UDP or RTP address.
+ *
+ * All members except the audio tap must be called from the thread that owns
+ * the OpenGL context.
+ */
+class CCapture
+{
+public:
+  /*
+   * Screenshot(file):
+   *
+   * Saves the next frame drawn.
+   *
+   * Parameters:
+   *    file    File name.
+   */
+  void Screenshot(const std::string &file);
+
+  /*
+   * StartRecording(file):
+   * StopRecording(void):
+   * Recording(void):
+   *
+   * Records every frame drawn, and the audio output, from now until
+   * StopRecording(), which waits for everything to be written.  StartRecording
+   * returns FAIL if the files could not be opened.
+   *
+   * Parameters:
+   *    file    Video file name.  Audio goes to the same name with .wav added.
+   */
+  bool StartRecording(const std::string &file);
+  void StopRecording(void);
+  bool Recording(void) const;
+
+  /*
+   * StartStreaming(url, encoder, kbps):
+   *
+   * Streams every frame drawn, and the audio output, until StopRecording(),
+   * in place of any recording.  ffmpeg is started with the first frame, once
+   * its size is known.
+   *
+   * Parameters:
+   *    url       Where to send the stream (srt://, udp:// or rtp://).
+   *    encoder   ffmpeg video encoder (h264_nvenc, h264_vaapi, etc.)
+   *    kbps      Video bit rate in kbit/s.
+   */
+  bool StartStreaming(const std::string &url, const std::string &encoder, unsigned kbps);
+
+  /*
+   * CaptureFrame(width, height):
+   *
+   * Called with the finished frame in the back buffer, before it is shown.
+   * Does nothing unless a screenshot is wanted or video is being recorded.
+   *
+   * Parameters:
+   *    width   Width of the frame buffer.
+   *    height  Height of the frame buffer.
+   */
+  void CaptureFrame(unsigned width, unsigned height);
+
+  /*
+   * Flush(void):
+   *
+   * Reads back every frame still in flight and waits for all files to be
+   * written.
+   */
+  void Flush(void);
+
+  CCapture(void);
+  ~CCapture(void);
+
+private:
+  static const unsigned NUM_SLOTS = 3;          // frames in flight on the GPU
+  static const unsigned MAX_QUEUED_FRAMES = 8;  // frames waiting for the worker before new ones are dropped
+
+  enum JobType
+  {
+    JobScreenshot,
+    JobVideoFrame,
+    JobAudio
+  };
+
+  struct Job
+  {
+    JobType               type;
+    std::string           file;
+    unsigned              width = 0;
+    unsigned              height = 0;
+    std::vector<UINT8>    data;
+  };
+
+  // A frame being read back
+  struct Slot
+  {
+    unsigned      pbo = 0;
+    unsigned      width = 0;
+    unsigned      height = 0;
+    bool          pending = false;
+    bool          video = false;
+    std::string   screenshot;
+  };
+
+  // Recording state, owned by the worker
+  struct Recorder
+  {
+    std::string   file;
+    FILE          *video = NULL;
+    bool          pipe = false;
+    bool          stream = false;
+    std::string   encoder;
+    unsigned      kbps = 0;
+    FILE          *audioPipe = NULL;  // stream audio, to ffmpeg's descriptor 3
+    int           pid = -1;           // of ffmpeg, when it has a second pipe
+    FILE          *audio = NULL;
+    UINT32        audioBytes = 0;
+    unsigned      width = 0;
+    unsigned      height = 0;
+    UINT64        frames = 0;
+    UINT64        skipped = 0;
+    std::vector<UINT8> yuv;
+  };
+
+  Slot              m_slots[NUM_SLOTS];
+  unsigned          m_nextSlot;
+  bool              m_usePBOs;
+  bool              m_recording;
+  std::string       m_screenshot;
+  UINT64            m_droppedFrames;
+
+  std::mutex        m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  std::deque<Job>   m_jobs;
+  unsigned          m_queuedFrames;
+  bool              m_busy;
+  bool              m_quit;
+  std::thread       m_worker;
+  Recorder          m_recorder;
+
+  void    Queue(Job &&job);
+  void    FinishSlot(Slot &slot);
+  void    WorkerThread(void);
+  void    DoJob(Job &job);
+  void    OpenRecording(const std::string &file);
+  void    CloseRecording(void);
+  void    OpenStreamEncoder(void);
+  void    WriteVideoFrame(const Job &job);
+  static void AudioTap(void *data, const INT16 *samples, unsigned numSamples);
+};
+
+#endif  // INCLUDED_CAPTURE_H
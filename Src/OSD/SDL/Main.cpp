@@ -45,6 +45,11 @@
  * - SUPERMODEL_WIN32: Define this if compiling on Windows.
  * - SUPERMODEL_OSX: Define this if compiling on Mac OS X.
  * - SUPERMODEL_DEBUGGER: Enable the debugger.
+ * - SUPERMODEL_TRACE: Compile in trace zones (-trace).
+ * - SUPERMODEL_BUS_PROFILE: Count main board bus accesses by region, printed
+ *   at exit.
+ * - SUPERMODEL_ALLOC_TRACKING: Count heap allocations by subsystem, shown with
+ *   the frame timings, and print the most frequent call sites at exit.
  * - DEBUG: Debug mode (use with caution, produces large logs of game behavior)
  */
 
@@ -53,6 +58,7 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdarg>
+#include <csignal>
 #include <memory>
 #include <vector>
 #include <algorithm>
@@ -62,16 +68,47 @@
 #include "Util/Format.h"
 #include "Util/NewConfig.h"
 #include "Util/ConfigBuilders.h"
+#include "Util/RollingStats.h"
+#include "Util/RewindBuffer.h"
+#include "Util/FramePacer.h"
+#include "Util/FrameSkipper.h"
+#include "Util/Hash.h"
+#include "Util/FrameHashLog.h"
+#include "Util/Trace.h"
+#include "Util/MemoryUsage.h"
+#include "Util/AllocTracker.h"
+#include "Util/CPUFeatures.h"
+#include "Util/ByteSwap.h"
+#include "Util/TaskGraph.h"
+#include "Graphics/TileLine.h"
+#include "Graphics/New3D/SIMDMath.h"
+#include "Sound/SCSPMix.h"
+#include "Inputs/InputRecording.h"
 #include "GameLoader.h"
 #include "SDLInputSystem.h"
 #ifdef SUPERMODEL_WIN32
 #include "DirectInputSystem.h"
 #include "WinOutputs.h"
 #endif
+#ifdef __linux__
+#include "EvdevInputSystem.h"
+#endif
+#ifdef NET_BOARD
+#include "NetOutputs.h"
+#endif
 #include "SDLIncludes.h"
 
 #include <iostream>
 #include "Util/BMPFile.h"
+#include "Capture.h"
+#include "Telemetry.h"
+#include "Present.h"
+#ifdef NET_BOARD
+#include "Network/NetBuffers.h"
+#include "Network/NetDelta.h"
+#include "Network/NetPacing.h"
+#include "Network/Netplay.h"
+#endif
 
 
 /******************************************************************************
@@ -163,6 +200,87 @@ static bool SetGLGeometry(unsigned *xOffsetPtr, unsigned *yOffsetPtr, unsigned *
   return OKAY;
 }
 
+/*
+ * UseOffscreenDriver():
+ *
+ * Whether a headless run should get its OpenGL context from SDL's offscreen
+ * video driver, which makes one with EGL straight on a GPU (or Mesa's software
+ * renderer), with no window system at all. It does when asked to, and for
+ * headless runs on Linux and the like when there is no X11 or Wayland display
+ * to make a hidden window on.
+ */
+static bool UseOffscreenDriver()
+{
+  if (s_runtime_config["Offscreen"].ValueAs<bool>())
+    return true;
+  if (!s_runtime_config["Headless"].ValueAs<bool>())
+    return false;
+#if defined(_WIN32) || defined(__APPLE__)
+  return false;
+#else
+  return getenv("DISPLAY") == nullptr && getenv("WAYLAND_DISPLAY") == nullptr;
+#endif
+}
+
+/*
+ * How finished frames are presented (the PresentMode setting), and the timing
+ * of the swaps in EndFrameVideo().
+ */
+static PresentMode s_presentMode = PresentMode::VSync;
+static CPresentClock s_presentClock(60.0);
+
+static const struct
+{
+  const char *name;
+  PresentMode mode;
+} s_presentModes[] =
+{
+  { "vsync",      PresentMode::VSync      },
+  { "vrr",        PresentMode::VRR        },
+  { "lowlatency", PresentMode::LowLatency }
+};
+
+static bool ParsePresentMode(const std::string &name, PresentMode *mode)
+{
+  for (auto &entry: s_presentModes)
+  {
+    if (Util::ToLower(name) == entry.name)
+    {
+      *mode = entry.mode;
+      return OKAY;
+    }
+  }
+  return FAIL;
+}
+
+static const char *PresentModeName(PresentMode mode)
+{
+  for (auto &entry: s_presentModes)
+  {
+    if (entry.mode == mode)
+      return entry.name;
+  }
+  return "";
+}
+
+/*
+ * SetSwapInterval(throttled):
+ *
+ * Sets how many vertical blanks a swap waits for in the presentation mode, or
+ * makes swaps immediate while running unthrottled (fast start, fast forward).
+ * VRR swaps at once so that a frame is shown as soon as it is ready; the
+ * display refreshes when it arrives rather than tearing.
+ */
+static void SetSwapInterval(bool throttled)
+{
+  int interval = 0;
+  if (throttled && s_presentMode == PresentMode::LowLatency)
+    interval = 1;
+  else if (throttled && s_presentMode == PresentMode::VSync)
+    interval = s_runtime_config["VSync"].ValueAsDefault<bool>(false) ? 1 : 0;
+  SDL_GL_SetSwapInterval(interval);
+}
+
 /*
  * CreateGLScreen():
  *
@@ -187,8 +305,23 @@ static bool CreateGLScreen(const std::string &caption, bool focusWindow, unsigne
     return ErrorLog("Internal error: CreateGLScreen() called more than once");
   }
 
-  // Initialize video subsystem
-  if (SDL_Init(SDL_INIT_VIDEO) != 0)
+  // Initialize video subsystem. Offscreen contexts are made on the EGL device
+  // asked for, so that instances can be spread over GPUs or share one, each
+  // with a context of its own. SDL reads both as hints, from the environment.
+  bool offscreen = UseOffscreenDriver();
+  if (offscreen)
+  {
+    SDL_setenv("SDL_VIDEODRIVER", "offscreen", 1);
+    SDL_setenv("SDL_HINT_EGL_DEVICE", std::to_string(s_runtime_config["OffscreenDevice"].ValueAs<unsigned>()).c_str(), 1);
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    {
+      // SDL older than 2.0.16, or no EGL; a hidden window may still do
+      ErrorLog("Unable to render offscreen (%s), trying a hidden window instead.", SDL_GetError());
+      SDL_setenv("SDL_VIDEODRIVER", "", 1);
+      offscreen = false;
+    }
+  }
+  if (!offscreen && SDL_Init(SDL_INIT_VIDEO) != 0)
     return ErrorLog("Unable to initialize SDL video subsystem: %s\n", SDL_GetError());
 
   // Important GL attributes
@@ -199,15 +332,18 @@ static bool CreateGLScreen(const std::string &caption, bool focusWindow, unsigne
   SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE,8);
   SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER,1);
 
-  // Set video mode
-  s_window = SDL_CreateWindow(caption.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, *xResPtr, *yResPtr, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | (fullScreen ? SDL_WINDOW_FULLSCREEN : 0));
+  // Set video mode. Headless runs still need a GL context, so they get a
+  // window that is never shown.
+  bool headless = s_runtime_config["Headless"].ValueAs<bool>() || s_runtime_config["Offscreen"].ValueAs<bool>();
+  Uint32 windowFlags = headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN | (fullScreen ? SDL_WINDOW_FULLSCREEN : 0);
+  s_window = SDL_CreateWindow(caption.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, *xResPtr, *yResPtr, SDL_WINDOW_OPENGL | windowFlags);
   if (nullptr == s_window)
   {
     ErrorLog("Unable to create an OpenGL display: %s\n", SDL_GetError());
     return FAIL;
   }
 
-  if (focusWindow)
+  if (focusWindow && !headless)
   {
     SDL_RaiseWindow(s_window);
   }
@@ -221,14 +357,15 @@ static bool CreateGLScreen(const std::string &caption, bool focusWindow, unsigne
   }
 
   // Set vsync
-  SDL_GL_SetSwapInterval(s_runtime_config["VSync"].ValueAsDefault<bool>(false) ? 1 : 0);
+  SetSwapInterval(true);
 
   // Set the context as the current window context
   SDL_GL_MakeCurrent(s_window, context);
 
-  // Initialize GLEW, allowing us to use features beyond OpenGL 1.2
+  // Initialize GLEW, allowing us to use features beyond OpenGL 1.2. Without an
+  // X11 display it cannot load the GLX extensions, which are not needed.
   err = glewInit();
-  if (GLEW_OK != err)
+  if (GLEW_OK != err && !(offscreen && GLEW_ERROR_NO_GLX_DISPLAY == err))
   {
     ErrorLog("OpenGL initialization failed: %s\n", glewGetErrorString(err));
     return FAIL;
@@ -332,6 +469,42 @@ static void PrintGLInfo(bool createScreen, bool infoLog, bool printExtensions)
   else      printf("\n");
 }
 
+/*
+ * PrintCPUFeatures():
+ *
+ * Prints the instruction set extensions found and the version of each SIMD
+ * kernel chosen for them.
+ */
+static void PrintCPUFeatures(bool infoLog)
+{
+  std::string detected = Util::CPUFeatures::Names(Util::CPUFeatures::Detected());
+  std::string baseline = Util::CPUFeatures::Names(Util::CPUFeatures::Baseline());
+  const struct
+  {
+    const char *kernel;
+    const char *implementation;
+  } kernels[] =
+  {
+    { "SCSP slot mixing      ", SCSPMix_GetImplementation() },
+    { "2D tile lines         ", TileLine::GetImplementation() },
+    { "New3D matrices/culling", New3D::SIMDMath::GetImplementation() },
+    { "Byte swapping         ", Util::GetByteSwapImplementation() }
+  };
+  if (infoLog)  InfoLog("CPU features:");
+  else             puts("CPU features:\n");
+  if (infoLog)  InfoLog("  Detected              : %s", detected.c_str());
+  else           printf("  Detected              : %s\n", detected.c_str());
+  if (infoLog)  InfoLog("  Built for             : %s", baseline.c_str());
+  else           printf("  Built for             : %s\n", baseline.c_str());
+  for (const auto &k : kernels)
+  {
+    if (infoLog)  InfoLog("  %s: %s", k.kernel, k.implementation);
+    else           printf("  %s: %s\n", k.kernel, k.implementation);
+  }
+  if (infoLog)  InfoLog("");
+  else      printf("\n");
+}
+
 #ifdef DEBUG
 static void PrintBAT(unsigned regu, unsigned regl)
 {
@@ -414,26 +587,55 @@ static void DumpPPCRegisters(IBus *bus)
 }
 #endif
 
+#ifdef DEBUG
 static void SaveFrameBuffer(const std::string& file)
 {
     std::shared_ptr<uint8_t> pixels(new uint8_t[totalXRes * totalYRes * 4], std::default_delete<uint8_t[]>());
     glReadPixels(0, 0, totalXRes, totalYRes, GL_RGBA, GL_UNSIGNED_BYTE, pixels.get());
     Util::WriteSurfaceToBMP<Util::RGBA8>(file, pixels.get(), totalXRes, totalYRes, true);
 }
+#endif
 
-void Screenshot()
+// Reads frames back for screenshots and video without stalling the render thread
+static std::unique_ptr<CCapture> s_capture;
+
+static std::string TimestampedFileName(const char *prefix, const char *extension)
 {
-    // Make a screenshot
     char file[128];
-    std::string info = "Screenshot created: ";
     time_t now = std::time(nullptr);
     tm* ltm = std::localtime(&now);
+    sprintf(file, "%s %.4d-%.2d-%.2d (%.2d-%.2d-%.2d).%s", prefix, 1900 + ltm->tm_year, 1 + ltm->tm_mon, ltm->tm_mday, ltm->tm_hour, ltm->tm_min, ltm->tm_sec, extension);
+    return file;
+}
 
-    sprintf(file, "Screenshot %.4d-%.2d-%.2d (%.2d-%.2d-%.2d).bmp", 1900 + ltm->tm_year, 1 + ltm->tm_mon, ltm->tm_mday, ltm->tm_hour, ltm->tm_min, ltm->tm_sec);
-
+void Screenshot()
+{
+    // Make a screenshot of the next frame; it is written in the background
+    std::string file = TimestampedFileName("Screenshot", "png");
+    std::string info = "Screenshot created: ";
     info += file;
     puts(info.c_str());
-    SaveFrameBuffer(file);
+    if (s_capture)
+      s_capture->Screenshot(file);
+}
+
+static void ToggleVideoRecording()
+{
+    if (!s_capture)
+      return;
+    if (s_capture->Recording())
+      s_capture->StopRecording();
+    else
+      s_capture->StartRecording(TimestampedFileName("Video", "y4m"));
+}
+
+// Streams the output if set to, in place of any recording
+static bool StartStreaming()
+{
+  std::string url = s_runtime_config["StreamURL"].ValueAs<std::string>();
+  if (!s_capture || url.empty())
+    return OKAY;
+  return s_capture->StartStreaming(url, s_runtime_config["StreamEncoder"].ValueAs<std::string>(), s_runtime_config["StreamBitrate"].ValueAs<unsigned>());
 }
 
 /******************************************************************************
@@ -561,20 +763,21 @@ static void TestPolygonHeaderBits(IEmulator *Emu)
  Different subsystems output their own blocks.
 ******************************************************************************/
 
-static const int STATE_FILE_VERSION = 3;  // save state file version
+static const int STATE_FILE_VERSION = 5;  // save state file version
 static const int NVRAM_FILE_VERSION = 0;  // NVRAM file version
 static unsigned s_saveSlot = 0;           // save state slot #
+static CBlockFileWriter s_stateWriter;    // writes save states in the background
+static std::vector<uint8_t> s_stateImage; // save state being written, reused
 
 static void SaveState(IEmulator *Model3)
 {
   CBlockFile  SaveState;
+  bool        background = s_runtime_config["BackgroundSaveState"].ValueAs<bool>();
+  bool        compress = s_runtime_config["CompressSaveState"].ValueAs<bool>();
 
+  // Captured in memory, then written out (and compressed) separately
   std::string file_path = Util::Format() << "Saves/" << Model3->GetGame().name << ".st" << s_saveSlot;
-  if (OKAY != SaveState.Create(file_path, "Supermodel Save State", "Supermodel Version " SUPERMODEL_VERSION))
-  {
-    ErrorLog("Unable to save state to '%s'.", file_path.c_str());
-    return;
-  }
+  SaveState.Create(&s_stateImage, "Supermodel Save State", "Supermodel Version " SUPERMODEL_VERSION);
 
   // Write file format version and ROM set ID to header block
   int32_t fileVersion = STATE_FILE_VERSION;
@@ -584,6 +787,26 @@ static void SaveState(IEmulator *Model3)
   // Save state
   Model3->SaveState(&SaveState);
   SaveState.Close();
+  if (background)
+  {
+    // Emulation can carry on while it is written
+    s_stateWriter.Write(file_path, &s_stateImage, compress, [file_path](bool result)
+    {
+      if (OKAY != result)
+        ErrorLog("Unable to save state to '%s'.", file_path.c_str());
+      else
+      {
+        printf("Saved state to '%s'.\n", file_path.c_str());
+        DebugLog("Saved state to '%s'.\n", file_path.c_str());
+      }
+    });
+    return;
+  }
+  if (OKAY != CBlockFileWriter::WriteFile(file_path, s_stateImage, compress))
+  {
+    ErrorLog("Unable to save state to '%s'.", file_path.c_str());
+    return;
+  }
   printf("Saved state to '%s'.\n", file_path.c_str());
   DebugLog("Saved state to '%s'.\n", file_path.c_str());
 }
@@ -596,6 +819,9 @@ static void LoadState(IEmulator *Model3, std::string file_path = std::string())
   if (file_path.empty())
     file_path = Util::Format() << "Saves/" << Model3->GetGame().name << ".st" << s_saveSlot;
 
+  // It may still be being written
+  s_stateWriter.Wait();
+
   // Open and check to make sure format is correct
   if (OKAY != SaveState.Load(file_path))
   {
@@ -624,16 +850,95 @@ static void LoadState(IEmulator *Model3, std::string file_path = std::string())
   DebugLog("Loaded state from '%s'.\n", file_path.c_str());
 }
 
-static void SaveNVRAM(IEmulator *Model3)
+// Saves the Real3D and tile generator state the last frame was rendered from,
+// for the renderer benchmarks (Src/Bench) to render over and over
+static void CaptureGPUFrame(CModel3 *Model3)
 {
-  CBlockFile  NVRAM;
+  CBlockFile  GfxState;
+  std::string file_path = TimestampedFileName("GPU Frame", "gfx");
 
-  std::string file_path = Util::Format() << "NVRAM/" << Model3->GetGame().name << ".nv";
-  if (OKAY != NVRAM.Create(file_path, "Supermodel NVRAM State", "Supermodel Version " SUPERMODEL_VERSION))
+  if (OKAY != GfxState.Create(file_path, "Supermodel Graphics State", "Supermodel Version " SUPERMODEL_VERSION))
   {
-    ErrorLog("Unable to save NVRAM to '%s'. Make sure directory exists!", file_path.c_str());
+    ErrorLog("Unable to capture GPU frame to '%s'.", file_path.c_str());
     return;
   }
+  int32_t fileVersion = STATE_FILE_VERSION;
+  GfxState.Write(&fileVersion, sizeof(fileVersion));
+  GfxState.Write(Model3->GetGame().name);
+  Model3->SaveFrameState(&GfxState);
+  GfxState.Close();
+  printf("Captured GPU frame to '%s'.\n", file_path.c_str());
+  DebugLog("Captured GPU frame to '%s'.\n", file_path.c_str());
+}
+
+// Rewind snapshots and the state fast start ends in are save states that never
+// leave memory
+static void SaveMemoryState(IEmulator *Model3, std::vector<uint8_t> *image, const char *comment)
+{
+  CBlockFile  SaveState;
+
+  Model3->PauseThreads();
+  SaveState.Create(image, "Supermodel Save State", comment);
+  Model3->SaveState(&SaveState);
+  SaveState.Close();
+  Model3->ResumeThreads();
+}
+
+static void SaveRewindState(IEmulator *Model3, Util::RewindBuffer *rewind, std::vector<uint8_t> *image)
+{
+  SaveMemoryState(Model3, image, "Rewind");
+  rewind->Push(image);
+}
+
+static void LoadMemoryState(IEmulator *Model3, const std::vector<uint8_t> &image)
+{
+  CBlockFile  SaveState;
+
+  SaveState.Load(image.data(), image.size());
+  Model3->LoadState(&SaveState);
+  SaveState.Close();
+}
+
+/*
+ * Runs a frame, then the frames after it unseen and unheard with the same
+ * inputs, showing only the last, so that the game responds to inputs that
+ * many frames sooner than it would. The machine is then put back as it was
+ * after the first frame, so that it runs exactly as it would have without.
+ */
+static void RunAheadFrame(IEmulator *Model3, unsigned frames, bool displayFrame, std::vector<uint8_t> *image)
+{
+  CBlockFile  SaveState;
+
+  SetVideoDiscard(true);
+  Model3->RunFrame(false);
+  SetVideoDiscard(false);
+  SaveState.Create(image, "Supermodel Save State", "Run-ahead");
+  Model3->SaveState(&SaveState);
+  SaveState.Close();
+
+  SetAudioDiscard(true);
+  SetVideoDiscard(true);
+  for (unsigned i = 1; i < frames; i++)
+    Model3->RunFrame(false);
+  SetVideoDiscard(!displayFrame);
+  Model3->RunFrame(displayFrame);
+  SetVideoDiscard(false);
+  SetAudioDiscard(false);
+
+  SaveState.Load(image->data(), image->size());
+  Model3->LoadState(&SaveState);
+  SaveState.Close();
+}
+
+static CBlockFileWriter s_nvramWriter;     // writes NVRAM checkpoints in the background
+static std::vector<uint8_t> s_nvramImage; // NVRAM checkpoint being written, reused
+static UINT64 s_nvramHash = 0;            // of the NVRAM last checkpointed
+
+static void SaveNVRAMImage(IEmulator *Model3, std::vector<uint8_t> *image)
+{
+  CBlockFile  NVRAM;
+
+  NVRAM.Create(image, "Supermodel NVRAM State", "Supermodel Version " SUPERMODEL_VERSION);
 
   // Write file format version and ROM set ID to header block
   int32_t fileVersion = NVRAM_FILE_VERSION;
@@ -643,6 +948,44 @@ static void SaveNVRAM(IEmulator *Model3)
   // Save NVRAM
   Model3->SaveNVRAM(&NVRAM);
   NVRAM.Close();
+}
+
+/*
+ * Saves NVRAM in the background if it has changed since it was last saved,
+ * so that high scores and bookkeeping survive the machine losing power. Only
+ * the copy is made during the frame.
+ */
+static void CheckpointNVRAM(IEmulator *Model3)
+{
+  SaveNVRAMImage(Model3, &s_nvramImage);
+  UINT64 hash = Util::Hash64(s_nvramImage.data(), s_nvramImage.size());
+  if (hash == s_nvramHash)
+    return;
+  s_nvramHash = hash;
+  std::string file_path = Util::Format() << "NVRAM/" << Model3->GetGame().name << ".nv";
+  s_nvramWriter.Write(file_path, &s_nvramImage, s_runtime_config["CompressNVRAM"].ValueAs<bool>(), [file_path](bool result)
+  {
+    if (OKAY != result)
+      ErrorLog("Unable to save NVRAM to '%s'. Make sure directory exists!", file_path.c_str());
+    else
+      DebugLog("Checkpointed NVRAM to '%s'.\n", file_path.c_str());
+  });
+}
+
+static void SaveNVRAM(IEmulator *Model3)
+{
+  std::vector<uint8_t> image;
+
+  std::string file_path = Util::Format() << "NVRAM/" << Model3->GetGame().name << ".nv";
+  SaveNVRAMImage(Model3, &image);
+
+  // After any checkpoint still being written
+  s_nvramWriter.Wait();
+  if (OKAY != CBlockFileWriter::WriteFile(file_path, image, s_runtime_config["CompressNVRAM"].ValueAs<bool>()))
+  {
+    ErrorLog("Unable to save NVRAM to '%s'. Make sure directory exists!", file_path.c_str());
+    return;
+  }
   DebugLog("Saved NVRAM to '%s'.\n", file_path.c_str());
 }
 
@@ -801,69 +1144,616 @@ static void UpdateCrosshairs(uint32_t currentInputs, CInputs *Inputs, unsigned c
 static CInputs *videoInputs = NULL;
 static uint32_t currentInputs = 0;
 
+static bool s_videoDiscard = false;
+
+void SetVideoDiscard(bool discard)
+{
+  s_videoDiscard = discard;
+}
+
 bool BeginFrameVideo()
 {
-  return true;
+  return !s_videoDiscard;
 }
 
 void EndFrameVideo()
 {
+  if (s_videoDiscard)
+    return;
+
   // Show crosshairs for light gun games
   if (videoInputs)
     UpdateCrosshairs(currentInputs, videoInputs, s_runtime_config["Crosshairs"].ValueAs<unsigned>());
 
-  // Swap the buffers
+  // Capture the finished frame for screenshots and video
+  if (s_capture)
+    s_capture->CaptureFrame(totalXRes, totalYRes);
+
+  // Swap the buffers. Low latency waits for the swap to be done, which leaves
+  // the driver no frames to queue and times it to the vertical blank.
+  CPresentClock::Clock::time_point swapStart = CPresentClock::Clock::now();
   SDL_GL_SwapWindow(s_window);
+  if (s_presentMode == PresentMode::LowLatency)
+    glFinish();
+  s_presentClock.Presented(swapStart);
+}
+
+/*
+ * LatchToRefresh(pacer, frameCosts):
+ *
+ * In low latency mode, while the display shows each frame for one refresh,
+ * the refresh rather than the frame pacer sets the rate. The last swap was
+ * waited for, so it ended on a vertical blank, and the next frame is started
+ * only as long before the following blank as the recent frames took, plus a
+ * margin, so the inputs it reads are that much newer when it is shown. The
+ * driver's own timing of the blank is used where it offers one. Returns false
+ * if the frame pacer is to be waited on as usual.
+ */
+static bool LatchToRefresh(Util::FramePacer &pacer, const Util::RollingStats &frameCosts)
+{
+  const UINT32 marginMicros = 2000;
+  const Util::RollingStats &intervals = s_presentClock.Intervals();
+  if (s_presentMode != PresentMode::LowLatency || !s_presentClock.Timed() || intervals.Count() < 60)
+    return false;
+
+  // The shortest recent interval is a refresh, which must be near enough a
+  // frame. Faster displays show frames for several refreshes, unevenly.
+  UINT32 refresh = intervals.Min();
+  if (refresh < 1000000 / 63 || refresh > 1000000 / 57)
+    return false;
+
+  UINT32 budget = frameCosts.Max() + marginMicros;
+  if (budget >= refresh)
+    return true;    // no time to spare, the swap alone keeps the rate
+  if (!s_presentClock.DelayBeforeSwap(budget))
+    pacer.WaitUntil(s_presentClock.LastPresent() + std::chrono::microseconds(refresh - budget));
+  return true;
 }
 
-static void SuperSleep(UINT32 time)
+/******************************************************************************
+ Frame Timings
+
+ Keeps rolling statistics of the per-stage timings reported by CModel3 for the
+ window title overlay and optionally logs every frame's timings to a file.
+ GPU pass timings are included whenever CGPUTimer is enabled.
+******************************************************************************/
+
+static const struct
+{
+  const char *name;
+  UINT32 FrameTimings::*micros;
+} s_timingStages[] =
+{
+  { "ppc",    &FrameTimings::ppcMicros    },
+  { "render", &FrameTimings::renderMicros },
+  { "sync",   &FrameTimings::syncMicros   },
+  { "snd",    &FrameTimings::sndMicros    },
+  { "drv",    &FrameTimings::drvMicros    },
+#ifdef NET_BOARD
+  { "net",    &FrameTimings::netMicros    },
+#endif
+  { "wait",   &FrameTimings::waitMicros   },
+  { "frame",  &FrameTimings::frameMicros  }
+};
+
+class CFrameTimingMonitor
+{
+public:
+  void Add(const FrameTimings &timings)
+  {
+    for (size_t i = 0; i < m_stats.size(); i++)
+      m_stats[i].Add(timings.*s_timingStages[i].micros);
+    for (size_t i = 0; i < m_gpuStats.size(); i++)
+      m_gpuStats[i].Add(timings.gpuMicros[i]);
+    for (size_t i = 0; i < m_allocStats.size(); i++)
+      m_allocStats[i].Add(timings.allocations[i]);
+    if (m_log != NULL)
+      WriteLog(timings);
+    m_frame++;
+  }
+
+  // Average and 99th percentile of each stage in ms (and minimum frame time),
+  // then audio buffered/target latency in ms, and heap allocations per frame
+  // if they are tracked
+  std::string Summary() const
+  {
+    Util::Format summary;
+    for (size_t i = 0; i < m_stats.size(); i++)
+    {
+      const Util::RollingStats &stats = m_stats[i];
+      summary << (i ? " " : "") << s_timingStages[i].name << ' ';
+      if (s_timingStages[i].micros == &FrameTimings::frameMicros)
+        summary << Ms(stats.Min()) << '/';
+      summary << Ms(stats.Average()) << '/' << Ms(stats.Percentile(99));
+    }
+    if (m_showGPU)
+    {
+      summary << " - gpu";
+      for (size_t i = 0; i < m_gpuStats.size(); i++)
+        summary << ' ' << CGPUTimer::PassName(int(i)) << ' ' << Ms(m_gpuStats[i].Average()) << '/' << Ms(m_gpuStats[i].Percentile(99));
+    }
+    AudioStats audio;
+    GetAudioStats(&audio);
+    summary << " ms - audio " << audio.bufferedMillis << '/' << audio.latencyMillis << " ms, output " << audio.outputMillis << " ms";
+    if (audio.underRuns)
+      summary << ' ' << audio.underRuns << " under-runs";
+    const Util::RollingStats &intervals = s_presentClock.Intervals();
+    if (intervals.Count())
+      summary << " - present " << Ms(intervals.Average()) << '/' << Ms(intervals.Percentile(99)) << " jitter " << Ms(s_presentClock.Jitter().Average()) << '/' << Ms(s_presentClock.Jitter().Percentile(99)) << " ms";
+    if (!m_allocStats.empty())
+    {
+      // Only subsystems that allocate, since the aim is for none to
+      summary << " - allocs";
+      bool any = false;
+      for (size_t i = 0; i < m_allocStats.size(); i++)
+      {
+        if (m_allocStats[i].Average() > 0)
+        {
+          summary << ' ' << Util::AllocTracker::SubsystemName(int(i)) << ' ' << Decimal(m_allocStats[i].Average());
+          any = true;
+        }
+      }
+      summary << (any ? "/frame" : " none");
+    }
+    return summary;
+  }
+
+  bool Logging() const
+  {
+    return m_log != NULL;
+  }
+
+  void ShowGPU(bool show)
+  {
+    m_showGPU = show;
+  }
+
+  bool OpenLog(const std::string &path)
+  {
+    m_log = fopen(path.c_str(), "w");
+    if (m_log == NULL)
+      return FAIL;
+    m_json = path.size() >= 5 && Util::ToLower(path.substr(path.size() - 5)) == ".json";
+    if (!m_json)
+    {
+      fprintf(m_log, "frame");
+      for (auto &stage: s_timingStages)
+        fprintf(m_log, ",%s_us", stage.name);
+      for (int i = 0; i < CGPUTimer::NumPasses; i++)
+        fprintf(m_log, ",gpu_%s_us", CGPUTimer::PassName(i));
+      fprintf(m_log, ",sync_bytes,ppc_idle_cycles,dsb_idle_cycles,drv_idle_cycles,tex_cache_hits,tex_cache_misses");
+      for (size_t i = 0; i < m_allocStats.size(); i++)
+        fprintf(m_log, ",alloc_%s", Util::AllocTracker::SubsystemName(int(i)));
+      fprintf(m_log, "\n");
+    }
+    return OKAY;
+  }
+
+  CFrameTimingMonitor(size_t window = 600)  // last 10 seconds
+    : m_stats(sizeof(s_timingStages) / sizeof(s_timingStages[0]), Util::RollingStats(window)),
+      m_gpuStats(CGPUTimer::NumPasses, Util::RollingStats(window)),
+      m_allocStats(Util::AllocTracker::Enabled() ? Util::AllocTracker::NumSubsystems : 0, Util::RollingStats(window))
+  {
+  }
+
+  ~CFrameTimingMonitor()
+  {
+    if (m_log != NULL)
+      fclose(m_log);
+  }
+
+private:
+  static std::string Ms(double micros)
+  {
+    char str[16];
+    snprintf(str, sizeof(str), "%1.1f", micros / 1000.0);
+    return str;
+  }
+
+  static std::string Decimal(double value)
+  {
+    char str[16];
+    snprintf(str, sizeof(str), "%1.1f", value);
+    return str;
+  }
+
+  // One CSV row, or one JSON object per line
+  void WriteLog(const FrameTimings &timings)
+  {
+    fprintf(m_log, m_json ? "{\"frame\":%llu" : "%llu", (unsigned long long) m_frame);
+    for (auto &stage: s_timingStages)
+    {
+      if (m_json)
+        fprintf(m_log, ",\"%s_us\":%u", stage.name, timings.*stage.micros);
+      else
+        fprintf(m_log, ",%u", timings.*stage.micros);
+    }
+    for (int i = 0; i < CGPUTimer::NumPasses; i++)
+    {
+      if (m_json)
+        fprintf(m_log, ",\"gpu_%s_us\":%u", CGPUTimer::PassName(i), timings.gpuMicros[i]);
+      else
+        fprintf(m_log, ",%u", timings.gpuMicros[i]);
+    }
+    if (m_json)
+      fprintf(m_log, ",\"sync_bytes\":%u,\"ppc_idle_cycles\":%u,\"dsb_idle_cycles\":%u,\"drv_idle_cycles\":%u,\"tex_cache_hits\":%u,\"tex_cache_misses\":%u", timings.syncSize, timings.ppcIdleCycles, timings.dsbIdleCycles, timings.drvIdleCycles, timings.texCacheHits, timings.texCacheMisses);
+    else
+      fprintf(m_log, ",%u,%u,%u,%u,%u,%u", timings.syncSize, timings.ppcIdleCycles, timings.dsbIdleCycles, timings.drvIdleCycles, timings.texCacheHits, timings.texCacheMisses);
+    for (size_t i = 0; i < m_allocStats.size(); i++)
+    {
+      if (m_json)
+        fprintf(m_log, ",\"alloc_%s\":%u", Util::AllocTracker::SubsystemName(int(i)), timings.allocations[i]);
+      else
+        fprintf(m_log, ",%u", timings.allocations[i]);
+    }
+    fprintf(m_log, m_json ? "}\n" : "\n");
+  }
+
+  std::vector<Util::RollingStats> m_stats;
+  std::vector<Util::RollingStats> m_gpuStats;
+  std::vector<Util::RollingStats> m_allocStats;  // per subsystem, if allocations are tracked
+  bool m_showGPU = false;
+  FILE *m_log = NULL;
+  bool m_json = false;
+  UINT64 m_frame = 0;
+};
+
+
+/******************************************************************************
+ Hitch Detection
+
+ Keeps the last few seconds of per-frame timings and, when a frame comes round
+ later than a threshold, writes them to a timestamped file so intermittent
+ stalls can be looked into after the fact.
+******************************************************************************/
+
+class CHitchDetector
+{
+public:
+  // Records a frame that has just been run. Snapshot bytes are the size of the
+  // rewind state saved this frame, if any.
+  void Add(const FrameTimings &timings, UINT32 ppcPC, UINT32 snapshotBytes, bool skipped)
+  {
+    auto now = std::chrono::steady_clock::now();
+    Frame &frame = m_frames[m_next];
+    m_next = (m_next + 1) % m_frames.size();
+    m_count = std::min(m_count + 1, m_frames.size());
+    frame.number = m_frame++;
+    frame.intervalMicros = m_running ? UINT32(std::chrono::duration_cast<std::chrono::microseconds>(now - m_last).count()) : 0;
+    frame.timings = timings;
+    frame.ppcPC = ppcPC;
+    frame.snapshotBytes = snapshotBytes;
+    frame.skipped = skipped;
+    m_last = now;
+    m_running = true;
+
+    // Reports are kept apart so that a run of slow frames writes one. Writing
+    // one does not count against the next frame.
+    if (frame.intervalMicros >= m_thresholdMicros && now >= m_quietUntil)
+    {
+      Report(frame);
+      m_last = std::chrono::steady_clock::now();
+      m_quietUntil = m_last + std::chrono::seconds(10);
+    }
+  }
+
+  // Forgets when the last frame ended, so that the gap left by pausing, fast
+  // forwarding or running unthrottled is not taken for a hitch
+  void Restart()
+  {
+    m_running = false;
+  }
+
+  CHitchDetector(const std::string &game, unsigned thresholdMillis, size_t window = 300)  // last 5 seconds
+    : m_game(game),
+      m_thresholdMicros(thresholdMillis * 1000),
+      m_frames(window)
+  {
+  }
+
+private:
+  struct Frame
+  {
+    UINT64 number;
+    UINT32 intervalMicros;  // since the previous frame ended, 0 for the first after a restart
+    FrameTimings timings;
+    UINT32 ppcPC;           // where the PowerPC was at the end of the frame
+    UINT32 snapshotBytes;
+    bool skipped;
+  };
+
+  void Report(const Frame &hitch) const
+  {
+    std::string file = TimestampedFileName("Hitch", "json");
+    FILE *fp = fopen(file.c_str(), "w");
+    if (fp == NULL)
+    {
+      ErrorLog("Unable to write hitch report to '%s'.", file.c_str());
+      return;
+    }
+
+    AudioStats audio;
+    GetAudioStats(&audio);
+    fprintf(fp, "{\"game\":\"%s\",\"frame\":%llu,\"interval_us\":%u,\"threshold_us\":%u,\"resident_bytes\":%llu,\n",
+      m_game.c_str(), (unsigned long long) hitch.number, hitch.intervalMicros, m_thresholdMicros, (unsigned long long) Util::MemoryUsage::Resident());
+    fprintf(fp, "\"audio\":{\"buffered_ms\":%u,\"output_ms\":%u,\"under_runs\":%u,\"over_runs\":%u},\n",
+      audio.bufferedMillis, audio.outputMillis, audio.underRuns, audio.overRuns);
+#ifdef NET_BOARD
+    NetPacingStats pacing = GetNetPacingStats();
+    fprintf(fp, "\"link\":{\"wait_average_us\":%.0f,\"wait_99th_us\":%u},\n", pacing.averageWait, pacing.waitPercentile99);
+#endif
+    fputs("\"frames\":[\n", fp);
+    size_t first = (m_next + m_frames.size() - m_count) % m_frames.size();
+    for (size_t i = 0; i < m_count; i++)
+    {
+      const Frame &frame = m_frames[(first + i) % m_frames.size()];
+      const FrameTimings &timings = frame.timings;
+      fprintf(fp, "%s{\"frame\":%llu,\"interval_us\":%u", i ? ",\n" : "", (unsigned long long) frame.number, frame.intervalMicros);
+      for (auto &stage: s_timingStages)
+        fprintf(fp, ",\"%s_us\":%u", stage.name, timings.*stage.micros);
+      for (int j = 0; j < CGPUTimer::NumPasses; j++)
+        fprintf(fp, ",\"gpu_%s_us\":%u", CGPUTimer::PassName(j), timings.gpuMicros[j]);
+      for (int j = 0; Util::AllocTracker::Enabled() && j < Util::AllocTracker::NumSubsystems; j++)
+        fprintf(fp, ",\"alloc_%s\":%u", Util::AllocTracker::SubsystemName(j), timings.allocations[j]);
+      fprintf(fp, ",\"wait_parked\":%s,\"skipped\":%s,\"ppc_pc\":\"%08X\",\"sync_bytes\":%u,\"snapshot_bytes\":%u,\"tex_cache_hits\":%u,\"tex_cache_misses\":%u}",
+        timings.waitParked ? "true" : "false", frame.skipped ? "true" : "false", frame.ppcPC, timings.syncSize, frame.snapshotBytes, timings.texCacheHits, timings.texCacheMisses);
+    }
+    fputs("\n]}\n", fp);
+    fclose(fp);
+
+    printf("Frame %llu took %1.1f ms, timings of the last %u frames written to %s\n", (unsigned long long) hitch.number, hitch.intervalMicros / 1000.0, unsigned(m_count), file.c_str());
+    InfoLog("Frame %llu took %1.1f ms, timings of the last %u frames written to '%s'.", (unsigned long long) hitch.number, hitch.intervalMicros / 1000.0, unsigned(m_count), file.c_str());
+  }
+
+  std::string m_game;
+  UINT32 m_thresholdMicros;
+  std::vector<Frame> m_frames;
+  size_t m_next = 0;
+  size_t m_count = 0;
+  UINT64 m_frame = 0;
+  bool m_running = false;
+  std::chrono::steady_clock::time_point m_last;
+  std::chrono::steady_clock::time_point m_quietUntil;
+};
+
+// Reports how fast a benchmark ran, and a hash of the state it ended in that
+// matches between runs that emulated exactly the same thing
+static void PrintBenchmark(IEmulator *Model3, unsigned frames, std::chrono::steady_clock::duration elapsed, const CFrameTimingMonitor *timings)
+{
+  CBlockFile  SaveState;
+  std::vector<uint8_t> image;
+
+  SaveState.Create(&image, "Supermodel Save State", "Benchmark");
+  Model3->SaveState(&SaveState);
+  SaveState.Close();
+  unsigned long long hash = Util::Hash64(image.data(), image.size());
+
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  double fps = seconds > 0 ? frames / seconds : 0.0;
+  printf("Benchmark: %u frames in %1.2f s (%1.1f FPS)\n", frames, seconds, fps);
+  InfoLog("Benchmark: %u frames in %1.2f s (%1.1f FPS).", frames, seconds, fps);
+  if (timings != NULL)
+  {
+    std::string summary = timings->Summary();
+    printf("Benchmark timings (average/99th percentile): %s\n", summary.c_str());
+    InfoLog("Benchmark timings (average/99th percentile): %s.", summary.c_str());
+  }
+  printf("Benchmark state hash: %016llx\n", hash);
+  InfoLog("Benchmark state hash: %016llx.", hash);
+}
+
+#ifdef SUPERMODEL_ALLOC_TRACKING
+/******************************************************************************
+ Allocation Tracking
+
+ Allocations still made every frame once a game has warmed up are the ones to
+ get rid of, so call sites are only sampled from then on and the counts
+ printed at exit are those made since.
+******************************************************************************/
+
+static const unsigned ALLOC_WARM_UP_FRAMES = 600;  // 10 seconds
+
+static void PrintAllocations(unsigned frames, const Util::AllocTracker::Counts &warmedUp)
+{
+  if (frames == 0)
+  {
+    printf("Heap allocations: the game did not run past warm-up\n");
+    return;
+  }
+
+  Util::AllocTracker::Counts counts;
+  Util::AllocTracker::Read(&counts);
+  std::string summary;
+  for (int i = 0; i < Util::AllocTracker::NumSubsystems; i++)
+  {
+    char str[64];
+    snprintf(str, sizeof(str), " %s %1.1f", Util::AllocTracker::SubsystemName(i), double(counts.allocations[i] - warmedUp.allocations[i]) / frames);
+    summary += str;
+  }
+  printf("Heap allocations per frame over the %u frames after warm-up:%s\n", frames, summary.c_str());
+  InfoLog("Heap allocations per frame over the %u frames after warm-up:%s.", frames, summary.c_str());
+
+  std::string sites = Util::AllocTracker::SampleReport(20);
+  if (!sites.empty())
+    printf("Most frequent call sites (samples of 1 in %u allocations, subsystem, stack):\n%s", Util::AllocTracker::SAMPLE_INTERVAL, sites.c_str());
+}
+#endif // SUPERMODEL_ALLOC_TRACKING
+
+
+/******************************************************************************
+ Main Program Loop
+******************************************************************************/
+
+static const char s_ppcProfileFilePath[] = { "ppc_profile.txt" };
+static const char s_cpuTraceFilePath[] = { "cpu_trace.bin" };
+
+// Model whose CPU traces are written if the emulator crashes
+static CModel3 *s_crashTraceModel = NULL;
+
+static void DumpCPUTraceOnCrash(int sig)
+{
+  // Best effort: the traces are only read, and the default action follows
+  signal(sig, SIG_DFL);
+  CModel3 *M = s_crashTraceModel;
+  s_crashTraceModel = NULL;
+  if (M)
+    M->DumpCPUTrace(s_cpuTraceFilePath);
+  raise(sig);
+}
+
+static void SetCrashTraceModel(CModel3 *M)
+{
+  s_crashTraceModel = M;
+  void (*handler)(int) = M ? DumpCPUTraceOnCrash : SIG_DFL;
+  signal(SIGSEGV, handler);
+  signal(SIGILL, handler);
+  signal(SIGFPE, handler);
+  signal(SIGABRT, handler);
+}
+
+// Growth of the resident memory since it was last sampled
+static size_t ResidentGrowth(size_t *resident)
+{
+  size_t before = *resident;
+  *resident = Util::MemoryUsage::Resident();
+  return *resident > before ? *resident - before : 0;
+}
+
+// Physical memory taken while starting up by the emulated boards (including
+// the game's ROMs) and by the renderers, and at most by the process. When the
+// two were set up together, only their sum is known.
+static void LogMemoryUsage(size_t boards, size_t renderers, bool together)
+{
+  const double MB = 1024.0 * 1024.0;
+  const char *profile = s_runtime_config["LowMemory"].ValueAs<bool>() ? " (low memory profile)" : "";
+  if (together)
+    InfoLog("Memory: boards and renderers %1.1f MB, peak resident %1.1f MB%s.", (boards + renderers) / MB, Util::MemoryUsage::PeakResident() / MB, profile);
+  else
+    InfoLog("Memory: boards %1.1f MB, renderers %1.1f MB, peak resident %1.1f MB%s.", boards / MB, renderers / MB, Util::MemoryUsage::PeakResident() / MB, profile);
+}
+
+/*
+ * Start-up work run on threads of its own while the main thread, which must
+ * keep the window and GL context, sets up everything else: decompressing the
+ * ROMs, initializing the boards and loading the game into them, and opening
+ * the audio device. Supermodel() waits for each just before it needs it. The
+ * graph is timed from the program's start, for the time to the first frame.
+ */
+struct StartupTasks
 {
-  UINT32 start = SDL_GetTicks();
-  UINT32 tics  = start;
-
-  while (start + time > tics) {
-    tics = SDL_GetTicks();
+  Util::TaskGraph graph;
+  Util::TaskGraph::Task roms = 0;
+  Util::TaskGraph::Task boards = 0;
+  Util::TaskGraph::Task game = 0;
+  Util::TaskGraph::Task audio = 0;
+
+  StartupTasks(std::chrono::steady_clock::time_point origin)
+    : graph(origin)
+  {
   }
-}
+};
 
-/******************************************************************************
- Main Program Loop
-******************************************************************************/
+// Settings the main loop reads every frame, taken from the runtime config
+// whenever it changes
+struct FrameSettings
+{
+  bool throttle;
+  bool showFrameRate;
+  bool showTimings;
+
+  FrameSettings(const Util::Config::Node &config)
+    : throttle(config["Throttle"].ValueAs<bool>()),
+      showFrameRate(config["ShowFrameRate"].ValueAs<bool>()),
+      showTimings(config["ShowTimings"].ValueAs<bool>())
+  {
+  }
+};
 
 #ifdef SUPERMODEL_DEBUGGER
-int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *Inputs, COutputs *Outputs, std::shared_ptr<Debugger::CDebugger> Debugger)
+int Supermodel(const Game &game, StartupTasks *startup, IEmulator *Model3, CInputs *Inputs, COutputs *Outputs, std::shared_ptr<Debugger::CDebugger> Debugger)
 {
   std::shared_ptr<CLogger> oldLogger;
 #else
-int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *Inputs, COutputs *Outputs)
+int Supermodel(const Game &game, StartupTasks *startup, IEmulator *Model3, CInputs *Inputs, COutputs *Outputs)
 {
 #endif // SUPERMODEL_DEBUGGER
   std::string initialState = s_runtime_config["InitStateFile"].ValueAs<std::string>();
   unsigned    fastStartTicks = s_runtime_config["FastStart"].ValueAs<unsigned>();
+  unsigned    fastStartFrames = s_runtime_config["FastStartFrames"].ValueAs<unsigned>();
+  UINT32      fastStartPC = s_runtime_config["FastStartPC"].ValueAs<UINT32>();
+  unsigned    fastStartRun = 0;
+  std::vector<uint8_t> bootImage;
   unsigned    prevFPSTicks;
   unsigned    fpsFramesElapsed;
   bool        gameHasLightguns = false;
   bool        quit = false;
   bool        paused = false;
   bool        dumpTimings = false;
-  bool        fastStart = (fastStartTicks > 0);
+  bool        fastStart = (fastStartTicks > 0 || fastStartFrames > 0 || fastStartPC != 0);
+  CModel3     *timedModel3 = dynamic_cast<CModel3 *>(Model3);
+  CFrameTimingMonitor timingMonitor;
+  unsigned    benchmarkFrames = s_runtime_config["Benchmark"].ValueAs<unsigned>();
+  unsigned    benchmarkRun = 0;
+  CFrameTimingMonitor benchmarkMonitor(std::max(benchmarkFrames, 1u));
+  std::chrono::steady_clock::time_point benchmarkStart;
+  CInputRecording inputRecording;
+  Util::FrameHashLog frameHashLog;
+  std::unique_ptr<Util::RewindBuffer> rewind;
+  std::vector<uint8_t> rewindImage;
+  unsigned    rewindInterval = std::max(s_runtime_config["RewindInterval"].ValueAs<unsigned>(), 1u);
+  unsigned    rewindFrames = 0;
+  bool        rewinding = false;
+  unsigned    nvramCheckpointInterval = s_runtime_config["NVRAMCheckpoint"].ValueAs<unsigned>() * 60;
+  unsigned    nvramCheckpointFrames = nvramCheckpointInterval;
+  std::unique_ptr<CTelemetry> telemetry;
+  std::string telemetryMemory = s_runtime_config["TelemetryMemory"].ValueAs<std::string>();
+  std::string telemetryAddress = s_runtime_config["TelemetryAddress"].ValueAs<std::string>();
+  std::unique_ptr<CHitchDetector> hitchDetector;
+  bool        dynamicScale = s_runtime_config["New3DEngine"].ValueAs<bool>() && s_runtime_config["New3DDynamicScale"].ValueAs<int>() > 0;  // needs the GPU timings every frame
+#ifdef SUPERMODEL_ALLOC_TRACKING
+  unsigned    allocFrames = 0;
+  Util::AllocTracker::Counts allocWarmedUp = {};  // counts once warmed up
+#endif
+  unsigned    runAhead = std::min(s_runtime_config["RunAhead"].ValueAs<unsigned>(), 4u);
+  std::vector<uint8_t> runAheadImage;
+  unsigned    fastForwardInterval = std::max(s_runtime_config["FastForwardInterval"].ValueAs<unsigned>(), 1u);
+  bool        fastForwardTimingOnly = s_runtime_config["FastForwardTimingOnlySound"].ValueAs<bool>();
+  bool        soundTimingOnly = s_runtime_config["SoundTimingOnly"].ValueAs<bool>();
+  bool        fastForward = false;
+  unsigned    fastForwardRun = 0;
+  Util::FramePacer framePacer(60.0);
+  Util::RollingStats frameCosts(60);  // of frames' running, less their swaps
+#ifdef NET_BOARD
+  bool        netPacing = s_runtime_config["NetPacing"].ValueAs<bool>();
+#endif
+  unsigned    maxFrameSkip = std::min(s_runtime_config["AutoFrameSkip"].ValueAs<unsigned>(), 9u);
+  Util::FrameSkipper frameSkipper(1000000 / 60, maxFrameSkip);
+  Util::Config::Snapshot<FrameSettings> frameSettings(s_runtime_config);
+  bool        drawFrame = true;
+  unsigned    framesSkipped = 0;
+  size_t      resident = Util::MemoryUsage::Resident();
+  size_t      boardsResident = 0;
+  size_t      renderersResident = 0;
+  bool        lowMemory = s_runtime_config["LowMemory"].ValueAs<bool>();  // boards before renderers, so the two don't add to the peak together
+  bool        firstFrame = true;
+#ifdef NET_BOARD
+  std::unique_ptr<CNetplay> netplay;
+#endif
 
   if (fastStart)
-    SDL_GL_SetSwapInterval(0);
-
-  // Initialize and load ROMs
-  if (OKAY != Model3->Init())
-    return 1;
-  if (Model3->LoadGame(game, *rom_set))
-    return 1;
-  *rom_set = ROMSet();  // free up this memory we won't need anymore
+    SetSwapInterval(false);
 
-  // Load NVRAM
-  LoadNVRAM(Model3);
+  // With the low memory profile, the boards are set up before the renderers
+  if (lowMemory)
+  {
+    if (!startup->graph.Wait(startup->game))
+      return 1;
+    boardsResident = ResidentGrowth(&resident);
+  }
 
   // Set the video mode
   char baseTitleStr[128];
-  char titleStr[128];
+  char titleStr[384];
   totalXRes = xRes = s_runtime_config["XResolution"].ValueAs<unsigned>();
   totalYRes = yRes = s_runtime_config["YResolution"].ValueAs<unsigned>();
   sprintf(baseTitleStr, "Supermodel - %s", game.title.c_str());
@@ -877,10 +1767,37 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
 
   // Info log GL information
   PrintGLInfo(false, true, false);
+  PrintCPUFeatures(true);
 
-  // Initialize audio system
-  if (OKAY != OpenAudio())
-    return 1;
+  // Initialize the renderers (compiling their shaders) while the boards are being set up
+  ResidentGrowth(&resident);
+  CShaderCache::Shared().SetEnabled(s_runtime_config["ShaderCache"].ValueAs<bool>());
+  CRender2D *Render2D = new CRender2D(s_runtime_config);
+  IRender3D *Render3D = s_runtime_config["New3DEngine"].ValueAs<bool>() ? ((IRender3D *) new New3D::CNew3D(s_runtime_config, game.name)) : ((IRender3D *) new Legacy3D::CLegacy3D(s_runtime_config));
+  if (!startup->graph.Run("renderers", [&]() { return OKAY == Render2D->Init(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes) && OKAY == Render3D->Init(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes); }))
+    goto QuitError;
+  renderersResident = ResidentGrowth(&resident);
+
+  // Wait for the game to be loaded
+  if (!startup->graph.Wait(startup->game))
+    goto QuitError;
+  if (!lowMemory)
+    boardsResident = ResidentGrowth(&resident);
+  if (s_runtime_config["CPUTrace"].ValueAs<unsigned>() > 0)
+    SetCrashTraceModel(dynamic_cast<CModel3 *>(Model3));
+
+  // Load NVRAM, noting what it holds so that it is only checkpointed once changed
+  LoadNVRAM(Model3);
+  if (nvramCheckpointInterval > 0)
+  {
+    SaveNVRAMImage(Model3, &s_nvramImage);
+    s_nvramHash = Util::Hash64(s_nvramImage.data(), s_nvramImage.size());
+  }
+
+  // Wait for the audio device to be opened
+  if (!startup->graph.Wait(startup->audio))
+    goto QuitError;
+  SetAudioRateControl(s_runtime_config["AudioRateControl"].ValueAs<bool>());
 
   // Hide mouse if fullscreen, enable crosshairs for gun games
   Inputs->GetInputSystem()->SetMouseVisibility(!s_runtime_config["FullScreen"].ValueAs<bool>());
@@ -899,22 +1816,105 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   if (Outputs != NULL)
     Model3->AttachOutputs(Outputs);
 
-  // Initialize the renderers
-  CRender2D *Render2D = new CRender2D(s_runtime_config);
-  IRender3D *Render3D = s_runtime_config["New3DEngine"].ValueAs<bool>() ? ((IRender3D *) new New3D::CNew3D(s_runtime_config, Model3->GetGame().name)) : ((IRender3D *) new Legacy3D::CLegacy3D(s_runtime_config));
-  if (OKAY != Render2D->Init(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes))
-    goto QuitError;
-  if (OKAY != Render3D->Init(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes))
-    goto QuitError;
+  // Attach the renderers
   Model3->AttachRenderers(Render2D,Render3D);
+  s_capture.reset(new CCapture());
+  if (!s_runtime_config["RecordVideo"].ValueAs<std::string>().empty())
+  {
+    if (OKAY != s_capture->StartRecording(s_runtime_config["RecordVideo"].ValueAs<std::string>()))
+      goto QuitError;
+  }
+  if (OKAY != StartStreaming())
+    goto QuitError;
 
-  // Reset emulator
+  // Reset emulator (which is when the boards first touch most of their memory)
+  ResidentGrowth(&resident);
   Model3->Reset();
+  boardsResident += ResidentGrowth(&resident);
+  LogMemoryUsage(boardsResident, renderersResident, !lowMemory);
 
   // Load initial save state if requested
   if (initialState.length() > 0)
     LoadState(Model3, initialState);
 
+#ifdef NET_BOARD
+  // Connect to the other player, who must be starting from the same state
+  if (s_runtime_config["Netplay"].ValueAs<bool>())
+  {
+    netplay.reset(new CNetplay(s_runtime_config, Model3, Inputs, game));
+    if (OKAY != netplay->Init())
+      goto QuitError;
+    runAhead = 0; // netplay keeps its own snapshots
+    fastForwardInterval = 0;  // both players must run in step
+  }
+#endif
+  if (runAhead > 0)
+    InfoLog("Running %u frame%s ahead.", runAhead, runAhead > 1 ? "s" : "");
+
+  // Boot unseen and unheard, until the game reaches the given address if one is set
+  if (fastStart)
+  {
+    SetAudioDiscard(true);
+    if (fastStartPC != 0 && timedModel3 != NULL)
+      timedModel3->WatchPPCAddress(true, fastStartPC);
+  }
+
+  // Record the game's inputs, or play back a recording of them
+  if (!s_runtime_config["ReplayInputs"].ValueAs<std::string>().empty())
+  {
+    if (OKAY != inputRecording.Replay(s_runtime_config["ReplayInputs"].ValueAs<std::string>(), Inputs, game))
+      goto QuitError;
+  }
+  else if (!s_runtime_config["RecordInputs"].ValueAs<std::string>().empty())
+  {
+    if (OKAY != inputRecording.Record(s_runtime_config["RecordInputs"].ValueAs<std::string>(), Inputs, game))
+      goto QuitError;
+  }
+
+  // Hash each frame's results, to compare a later run against, or compare them against such a log
+  if (!s_runtime_config["VerifyFrameHashes"].ValueAs<std::string>().empty() && timedModel3 != NULL)
+  {
+    std::string file = s_runtime_config["VerifyFrameHashes"].ValueAs<std::string>();
+    std::string error;
+    if (!frameHashLog.Compare(file, game.name, { "ram", "real3d", "audio" }, &error))
+    {
+      ErrorLog("%s", error.c_str());
+      goto QuitError;
+    }
+  }
+  else if (!s_runtime_config["FrameHashLog"].ValueAs<std::string>().empty() && timedModel3 != NULL)
+  {
+    std::string file = s_runtime_config["FrameHashLog"].ValueAs<std::string>();
+    if (!frameHashLog.Write(file, game.name, { "ram", "real3d", "audio" }))
+    {
+      ErrorLog("Unable to create %s.", file.c_str());
+      goto QuitError;
+    }
+  }
+
+#ifdef SUPERMODEL_TRACE
+  // Record trace zones of the whole run
+  if (!s_runtime_config["TraceFile"].ValueAs<std::string>().empty())
+  {
+    std::string file = s_runtime_config["TraceFile"].ValueAs<std::string>();
+    if (!Util::Trace::Start(file))
+    {
+      ErrorLog("Unable to create %s.", file.c_str());
+      goto QuitError;
+    }
+    TRACE_THREAD_NAME("Main");
+  }
+#endif // SUPERMODEL_TRACE
+
+  // Keep a history to rewind through, except in netplay, where the two games must run the same frames
+  if (s_runtime_config["Rewind"].ValueAs<bool>())
+  {
+#ifdef NET_BOARD
+    if (!netplay)
+#endif
+      rewind.reset(new Util::RewindBuffer(size_t(s_runtime_config["RewindMemory"].ValueAs<unsigned>()) << 20));
+  }
+
 #ifdef SUPERMODEL_DEBUGGER
   // If debugger was supplied, set it as logger and attach it to system
   oldLogger = GetLogger();
@@ -925,6 +1925,26 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   }
 #endif // SUPERMODEL_DEBUGGER
 
+  // Open frame timing log
+  if (timedModel3 != NULL && !s_runtime_config["TimingsFile"].ValueAs<std::string>().empty())
+  {
+    std::string timingsFile = s_runtime_config["TimingsFile"].ValueAs<std::string>();
+    if (OKAY != timingMonitor.OpenLog(timingsFile))
+      ErrorLog("Unable to write frame timings to '%s'.", timingsFile.c_str());
+  }
+
+  // Publish performance figures for watching from elsewhere
+  if (timedModel3 != NULL && (!telemetryMemory.empty() || !telemetryAddress.empty()))
+  {
+    telemetry.reset(new CTelemetry());
+    if (OKAY != telemetry->Start(game.name, telemetryMemory, telemetryAddress))
+      telemetry.reset();
+  }
+
+  // Write out the last few seconds of timings whenever a frame is late
+  if (timedModel3 != NULL && s_runtime_config["HitchThreshold"].ValueAs<unsigned>() > 0)
+    hitchDetector.reset(new CHitchDetector(game.name, s_runtime_config["HitchThreshold"].ValueAs<unsigned>()));
+
   // Emulate!
   fpsFramesElapsed = 0;
   prevFPSTicks = SDL_GetTicks();
@@ -940,13 +1960,173 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
 #endif
   while (!quit)
   {
-    auto startTime = SDL_GetTicks();
-
-    // Render if paused, otherwise run a frame
-    if (paused)
+    bool ranFrame = false;
+    UINT32 runMicros = 0;
+    UINT32 snapshotBytes = 0;
+    std::shared_ptr<const FrameSettings> settings = frameSettings.Get();
+
+    // Time GPU passes only while the timings are shown or logged, or the 3D resolution follows them
+    bool timeGPU = timedModel3 != NULL && (timingMonitor.Logging() || settings->showTimings);
+    CGPUTimer::Shared().SetEnabled(timeGPU || dynamicScale);
+    timingMonitor.ShowGPU(timeGPU && GLEW_ARB_timer_query);
+
+    // Step back through the rewind history while held, render if paused, otherwise run a frame
+    if (rewind && !paused && Inputs->uiRewind->value)
+    {
+      if (!rewinding)
+      {
+        Model3->PauseThreads();
+        SetAudioEnabled(false);
+        rewinding = true;
+      }
+      if (rewind->Pop(&rewindImage))
+        LoadMemoryState(Model3, rewindImage);
+      Model3->RenderFrame(!fastStart);
+    }
+    else if (paused)
       Model3->RenderFrame(!fastStart);
     else
-      Model3->RunFrame(!fastStart);
+    {
+      if (rewinding)
+      {
+        Model3->ResumeThreads();
+        SetAudioEnabled(true);
+        rewinding = false;
+        rewindFrames = 0;
+      }
+      // Fast forward runs unthrottled while held, unheard, showing one frame
+      // in every FastForwardInterval
+      if (!fastStart && fastForwardInterval > 0 && Inputs->uiFastForward->value != fastForward)
+      {
+        fastForward = !fastForward;
+        fastForwardRun = 0;
+        SetAudioDiscard(fastForward);
+        SetSwapInterval(!fastForward);
+        if (fastForwardTimingOnly)
+          s_runtime_config.Get("SoundTimingOnly").SetValue(fastForward || soundTimingOnly);
+        if (!fastForward && !settings->showFrameRate && !settings->showTimings)
+          SDL_SetWindowTitle(s_window, baseTitleStr);
+        prevFPSTicks = SDL_GetTicks();
+        fpsFramesElapsed = 0;
+      }
+      if (fastForward)
+        drawFrame = (fastForwardRun++ % fastForwardInterval) == 0;
+      // Frames skipped to keep up are neither rendered nor shown
+      bool displayFrame = !fastStart && drawFrame;
+      if (inputRecording.Recording() || inputRecording.Replaying())
+      {
+        // A regression run ends with the inputs it replays
+        if (!inputRecording.Frame() && (frameHashLog.Writing() || frameHashLog.Comparing()))
+          quit = true;
+      }
+      auto runStart = std::chrono::steady_clock::now();
+      if (benchmarkFrames > 0 && benchmarkRun == 0)
+        benchmarkStart = runStart;
+      SetVideoDiscard(!drawFrame);
+#ifdef NET_BOARD
+      if (netplay)
+      {
+        if (OKAY != netplay->RunFrame(displayFrame))
+          quit = true;
+      }
+      else
+#endif
+      if (runAhead > 0 && !fastStart && !fastForward)
+        RunAheadFrame(Model3, runAhead, displayFrame, &runAheadImage);
+      else
+        Model3->RunFrame(displayFrame);
+      SetVideoDiscard(false);
+      if (timedModel3 != NULL)
+        timingMonitor.Add(timedModel3->GetTimings());
+#ifdef SUPERMODEL_ALLOC_TRACKING
+      if (++allocFrames == ALLOC_WARM_UP_FRAMES)
+      {
+        Util::AllocTracker::Read(&allocWarmedUp);
+        Util::AllocTracker::StartSampling();
+      }
+#endif
+      if (telemetry)
+        telemetry->AddFrame(timedModel3->GetTimings(), !drawFrame);
+      if (frameHashLog.Writing() || frameHashLog.Comparing())
+      {
+        FrameHashes hashes = timedModel3->GetFrameHashes();
+        uint64_t values[3] = { hashes.ram, hashes.real3D, hashes.audio };
+        if (!frameHashLog.Frame(values))
+        {
+          printf("Frame %llu differs from the reference (%s)\n", (unsigned long long) frameHashLog.DivergedFrame(), frameHashLog.DivergedNames().c_str());
+          ErrorLog("Frame %llu differs from the reference (%s).", (unsigned long long) frameHashLog.DivergedFrame(), frameHashLog.DivergedNames().c_str());
+          quit = true;
+        }
+      }
+      runMicros = UINT32(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - runStart).count());
+      frameCosts.Add(runMicros - std::min(runMicros, s_presentClock.LastSwapMicros()));
+      ranFrame = true;
+      if (firstFrame)
+      {
+        // Time from the program's start to the first frame, and where start-up spent it
+        double elapsed = startup->graph.Elapsed();
+        InfoLog("Startup: first frame after %1.0f ms (%s).", elapsed, startup->graph.Summary().c_str());
+        if (benchmarkFrames > 0)
+          printf("Startup: first frame after %1.0f ms\n", elapsed);
+        firstFrame = false;
+      }
+      if (fastStart)
+        ++fastStartRun;
+      if (benchmarkFrames > 0)
+      {
+        if (timedModel3 != NULL)
+          benchmarkMonitor.Add(timedModel3->GetTimings());
+        if (++benchmarkRun == benchmarkFrames)
+          quit = true;
+      }
+      if (rewind && rewindFrames-- == 0)
+      {
+        SaveRewindState(Model3, rewind.get(), &rewindImage);
+        snapshotBytes = UINT32(rewindImage.size());
+        rewindFrames = rewindInterval - 1;
+      }
+      if (nvramCheckpointInterval > 0 && --nvramCheckpointFrames == 0)
+      {
+        CheckpointNVRAM(Model3);
+        nvramCheckpointFrames = nvramCheckpointInterval;
+      }
+    }
+    if (hitchDetector)
+    {
+      if (ranFrame && !fastStart && !fastForward && settings->throttle)
+        hitchDetector->Add(timedModel3->GetTimings(), ppc_get_pc(), snapshotBytes, !drawFrame);
+      else
+        hitchDetector->Restart();
+    }
+
+    // 60 fps, we could roll with 57.5? that would be a jerk fest on 60hz screens though.
+    // Waiting here rather than at the end of the loop means inputs are polled
+    // as late as possible, right before the frame that reads them.
+    bool latched = false;
+    if (paused || (!fastStart && !fastForward && settings->throttle))
+    {
+#ifdef NET_BOARD
+      // Linked machines stretch or shrink their frames to keep in step
+      if (netPacing)
+        framePacer.SetPeriodScale(GetNetPacingPeriodScale());
+#endif
+      latched = !paused && LatchToRefresh(framePacer, frameCosts);
+      if (!latched)
+        framePacer.Wait();
+    }
+    else
+      s_presentClock.Restart();
+
+    // Decide whether the next frame is drawn, from what this one cost and how
+    // late it ended
+    if (ranFrame && maxFrameSkip > 0 && !fastStart && !fastForward && settings->throttle)
+    {
+      UINT32 renderMicros = timedModel3 != NULL ? timedModel3->GetTimings().renderMicros : 0;
+      framesSkipped += !drawFrame;
+      drawFrame = frameSkipper.Update(runMicros, renderMicros, drawFrame, latched ? 0 : framePacer.LateMicros());
+    }
+    else
+      drawFrame = true;
 
     // Poll the inputs
     if (!Inputs->Poll(&game, xOffset, yOffset, xRes, yRes))
@@ -980,6 +2160,13 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       // Quit emulator
       quit = true;
     }
+#ifdef NET_BOARD
+    else if (netplay && (Inputs->uiReset->Pressed() || Inputs->uiPause->Pressed() || Inputs->uiLoadState->Pressed() || Inputs->uiClearNVRAM->Pressed()))
+    {
+      // Both machines must run exactly the same frames
+      puts("Not available during netplay.");
+    }
+#endif
     else if (Inputs->uiReset->Pressed())
     {
       if (!paused)
@@ -988,8 +2175,11 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
         SetAudioEnabled(false);
       }
 
-      // Reset emulator
-      Model3->Reset();
+      // Reset emulator, or go straight back to where fast start ended
+      if (bootImage.empty())
+        Model3->Reset();
+      else
+        LoadMemoryState(Model3, bootImage);
 
 #ifdef SUPERMODEL_DEBUGGER
       // If debugger was supplied, reset it too
@@ -1033,11 +2223,9 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       // Toggle emulator fullscreen
       s_runtime_config.Get("FullScreen").SetValue(!s_runtime_config["FullScreen"].ValueAs<bool>());
 
-      // Delete renderers and recreate them afterwards since GL context will most likely be lost when switching from/to fullscreen
-      delete Render2D;
-      delete Render3D;
-      Render2D = NULL;
-      Render3D = NULL;
+      // The GL context survives the switch, so the renderers only resize, keeping their caches.
+      // A recording cannot change size, so it ends here. A stream starts again at the new size.
+      s_capture.reset();
 
       // Resize screen
       totalXRes = xRes = s_runtime_config["XResolution"].ValueAs<unsigned>();
@@ -1047,14 +2235,12 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       if (OKAY != ResizeGLScreen(&xOffset,&yOffset,&xRes,&yRes,&totalXRes,&totalYRes,!stretch,fullscreen))
         goto QuitError;
 
-      // Recreate renderers and attach to the emulator
-      Render2D = new CRender2D(s_runtime_config);
-      Render3D = s_runtime_config["New3DEngine"].ValueAs<bool>() ? ((IRender3D *) new New3D::CNew3D(s_runtime_config, Model3->GetGame().name)) : ((IRender3D *) new Legacy3D::CLegacy3D(s_runtime_config));
-      if (OKAY != Render2D->Init(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes))
-        goto QuitError;
-      if (OKAY != Render3D->Init(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes))
+      // Fit the renderers to the new display area
+      Render2D->Resize(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes);
+      if (OKAY != Render3D->Resize(xOffset, yOffset, xRes, yRes, totalXRes, totalYRes))
         goto QuitError;
-      Model3->AttachRenderers(Render2D,Render3D);
+      s_capture.reset(new CCapture());
+      StartStreaming();
 
       Inputs->GetInputSystem()->SetMouseVisibility(!s_runtime_config["FullScreen"].ValueAs<bool>());
     }
@@ -1188,6 +2374,13 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       Model3->ClearNVRAM();
       puts("NVRAM cleared.");
     }
+    else if (Inputs->uiToggleTimings->Pressed())
+    {
+      // Toggle frame timing overlay in title bar
+      s_runtime_config.Get("ShowTimings").SetValue(!s_runtime_config["ShowTimings"].ValueAs<bool>());
+      if (!s_runtime_config["ShowTimings"].ValueAs<bool>() && !s_runtime_config["ShowFrameRate"].ValueAs<bool>())
+        SDL_SetWindowTitle(s_window, baseTitleStr);
+    }
     else if (Inputs->uiToggleFrLimit->Pressed())
     {
       // Toggle frame limiting
@@ -1199,6 +2392,54 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
       // Make a screenshot
       Screenshot();
     }
+    else if (Inputs->uiRecordVideo->Pressed())
+    {
+      // Start or stop recording video
+      ToggleVideoRecording();
+    }
+    else if (Inputs->uiCaptureGPUFrame->Pressed())
+    {
+      // Save what the last frame was rendered from
+      CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+      if (M)
+      {
+        if (!paused)
+          Model3->PauseThreads();
+        CaptureGPUFrame(M);
+        if (!paused)
+          Model3->ResumeThreads();
+      }
+    }
+    else if (Inputs->uiDumpPPCProfile->Pressed())
+    {
+      // Write PowerPC hot spots sampled so far
+      CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+      if (!s_runtime_config["ProfilePPC"].ValueAs<bool>())
+        puts("PowerPC profiling is disabled (use -profile-ppc).");
+      else if (M)
+      {
+        if (!paused)
+          Model3->PauseThreads();
+        M->DumpPPCProfile(s_ppcProfileFilePath);
+        if (!paused)
+          Model3->ResumeThreads();
+      }
+    }
+    else if (Inputs->uiDumpCPUTrace->Pressed())
+    {
+      // Write the instructions each CPU executed most recently
+      CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+      if (s_runtime_config["CPUTrace"].ValueAs<unsigned>() == 0)
+        puts("CPU tracing is disabled (use -cpu-trace).");
+      else if (M)
+      {
+        if (!paused)
+          Model3->PauseThreads();
+        M->DumpCPUTrace(s_cpuTraceFilePath);
+        if (!paused)
+          Model3->ResumeThreads();
+      }
+    }
 #ifdef SUPERMODEL_DEBUGGER
       else if (Debugger != NULL && Inputs->uiEnterDebugger->Pressed())
       {
@@ -1208,38 +2449,52 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
     }
 #endif // SUPERMODEL_DEBUGGER
 
+    // Send the outputs that changed this frame, together
+    if (Outputs != NULL)
+      Outputs->Flush();
 
-    // Frame rate and limiting
+    // Frame rate, timing overlay and limiting (as the UI may just have changed them)
+    settings = frameSettings.Get();
     unsigned currentFPSTicks = SDL_GetTicks();
-    if (s_runtime_config["ShowFrameRate"].ValueAs<bool>())
+    bool showFrameRate = settings->showFrameRate;
+    bool showTimings = settings->showTimings && timedModel3 != NULL;
+    if (showFrameRate || showTimings || fastForward)
     {
       ++fpsFramesElapsed;
       if((currentFPSTicks-prevFPSTicks) >= 1000)  // update FPS every 1 second (each tick is 1 ms)
       {
-        sprintf(titleStr, "%s - %1.1f FPS%s%s", baseTitleStr, (float)fpsFramesElapsed/((float)(currentFPSTicks-prevFPSTicks)/1000.0f), paused ? " (Paused)" : "", fastStart ? " (Fast start)" : "");
+        float fps = (float)fpsFramesElapsed/((float)(currentFPSTicks-prevFPSTicks)/1000.0f);
+        std::string timingStr = showTimings ? " - " + timingMonitor.Summary() : "";
+        std::string skippedStr = maxFrameSkip > 0 ? " (" + std::to_string(framesSkipped) + " skipped)" : "";
+        char fastForwardStr[32] = "";
+        if (fastForward)
+          snprintf(fastForwardStr, sizeof(fastForwardStr), " (Fast forward %1.1fx)", fps / 60.0f);
+        if (showFrameRate)
+          snprintf(titleStr, sizeof(titleStr), "%s - %1.1f FPS%s%s%s%s%s", baseTitleStr, fps, skippedStr.c_str(), timingStr.c_str(), paused ? " (Paused)" : "", fastStart ? " (Fast start)" : "", fastForwardStr);
+        else
+          snprintf(titleStr, sizeof(titleStr), "%s%s%s%s%s", baseTitleStr, timingStr.c_str(), paused ? " (Paused)" : "", fastStart ? " (Fast start)" : "", fastForwardStr);
         SDL_SetWindowTitle(s_window, titleStr);
         prevFPSTicks = currentFPSTicks;     // reset tick count
         fpsFramesElapsed = 0;         // reset frame count
+        framesSkipped = 0;
       }
     }
 
-    if (fastStart) {
-      if (currentFPSTicks > fastStartTicks) {
-        // Set vsync
-        SDL_GL_SetSwapInterval(s_runtime_config["VSync"].ValueAsDefault<bool>(false) ? 1 : 0);
-        fastStart = false;
-      }
-    }
-
-    if (paused || (!fastStart && s_runtime_config["Throttle"].ValueAs<bool>()))
-    {
-        UINT32 endTime    = SDL_GetTicks();
-        UINT32 diff     = endTime - startTime;
-        UINT32 frameTime  = (UINT32)(1000 / 60.f);    // 60 fps, we could roll with 57.5? that would be a jerk fest on 60hz screens though
-
-        if (diff < frameTime) {
-            SuperSleep(frameTime - diff);
-        }
+    // Fast start ends at whichever of its time, frame count and address comes first
+    if (fastStart && ((fastStartTicks > 0 && currentFPSTicks > fastStartTicks) ||
+                      (fastStartFrames > 0 && fastStartRun >= fastStartFrames) ||
+                      (fastStartPC != 0 && timedModel3 != NULL && timedModel3->PPCAddressReached()))) {
+      // Set vsync
+      SetSwapInterval(true);
+      SetAudioDiscard(false);
+      if (fastStartPC != 0 && timedModel3 != NULL)
+        timedModel3->WatchPPCAddress(false, 0);
+      fastStart = false;
+      InfoLog("Fast start ended after %u frames.", fastStartRun);
+
+      // Keep this state for resets
+      if (s_runtime_config["FastStartCheckpoint"].ValueAs<bool>())
+        SaveMemoryState(Model3, &bootImage, "Fast start");
     }
 
     if (dumpTimings && !paused)
@@ -1253,6 +2508,76 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   // Make sure all threads are paused before shutting down
   Model3->PauseThreads();
 
+  if (benchmarkFrames > 0)
+    PrintBenchmark(Model3, benchmarkRun, std::chrono::steady_clock::now() - benchmarkStart, timedModel3 != NULL ? &benchmarkMonitor : NULL);
+
+  if (frameHashLog.Comparing() && !frameHashLog.Diverged())
+  {
+    unsigned long long frames = frameHashLog.Frames();
+    const char *ended = frameHashLog.LogEnded() ? ", after which the reference ended" : "";
+    printf("All %llu frames matched the reference%s\n", frames, ended);
+    InfoLog("All %llu frames matched the reference%s.", frames, ended);
+  }
+
+  // Finish writing any save states
+  s_stateWriter.Wait();
+
+  if (rewind)
+  {
+    Util::RewindBuffer::Stats stats = rewind->GetStats();
+    if (stats.snapshots > 1)
+      InfoLog("Rewind: %llu snapshots of %.1f MB on average, stored in %.1f%% of that, %.2f ms each; %.1f MB used for %u.",
+        (unsigned long long) stats.snapshots, stats.imageBytes / (1048576.0 * stats.snapshots), 100.0 * stats.deltaBytes / stats.imageBytes,
+        stats.deltaSeconds * 1e3 / (stats.snapshots - 1), rewind->MemoryUsed() / 1048576.0, unsigned(rewind->Count()));
+  }
+
+  if (framePacer.GetStats().frames)
+  {
+    Util::FramePacer::Stats stats = framePacer.GetStats();
+    InfoLog("Frame pacing: %llu frames, %llu late (%llu by over a frame); recent frames ended %.1f us past due on average, %u us at worst for 99%%.",
+      (unsigned long long) stats.frames, (unsigned long long) stats.late, (unsigned long long) stats.restarts,
+      framePacer.Error().Average(), framePacer.Error().Percentile(99));
+  }
+  if (s_presentClock.Intervals().Count())
+  {
+    const Util::RollingStats &intervals = s_presentClock.Intervals();
+    InfoLog("Presentation (%s): recent frames were shown %.2f ms apart on average, %.2f ms at worst for 99%%, straying %.2f ms from 60 Hz on average, %.2f ms at worst for 99%%.",
+      PresentModeName(s_presentMode), intervals.Average() / 1e3, intervals.Percentile(99) / 1e3,
+      s_presentClock.Jitter().Average() / 1e3, s_presentClock.Jitter().Percentile(99) / 1e3);
+  }
+  if (maxFrameSkip > 0)
+    InfoLog("Frame skipping: %llu frames skipped.", (unsigned long long) frameSkipper.Skipped());
+
+  // Write final PowerPC profile
+  if (s_runtime_config["ProfilePPC"].ValueAs<bool>())
+  {
+    CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+    if (M)
+      M->DumpPPCProfile(s_ppcProfileFilePath);
+  }
+
+#ifdef SUPERMODEL_BUS_PROFILE
+  // Print which memory mapped regions the PowerPC accessed most
+  {
+    CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+    if (M)
+      M->DumpBusProfile();
+  }
+#endif // SUPERMODEL_BUS_PROFILE
+
+#ifdef SUPERMODEL_ALLOC_TRACKING
+  PrintAllocations(allocFrames > ALLOC_WARM_UP_FRAMES ? allocFrames - ALLOC_WARM_UP_FRAMES : 0, allocWarmedUp);
+#endif
+
+  // Write final CPU traces
+  if (s_runtime_config["CPUTrace"].ValueAs<unsigned>() > 0)
+  {
+    SetCrashTraceModel(NULL);
+    CModel3 *M = dynamic_cast<CModel3 *>(Model3);
+    if (M)
+      M->DumpCPUTrace(s_cpuTraceFilePath);
+  }
+
 #ifdef SUPERMODEL_DEBUGGER
   // If debugger was supplied, detach it from system and restore old logger
   if (Debugger != NULL)
@@ -1262,22 +2587,53 @@ int Supermodel(const Game &game, ROMSet *rom_set, IEmulator *Model3, CInputs *In
   }
 #endif // SUPERMODEL_DEBUGGER
 
+#ifdef NET_BOARD
+  if (netplay)
+  {
+    NetplayStats stats = netplay->GetStats();
+    InfoLog("Netplay: %llu frames, %llu rollbacks re-running %llu frames (at most %u), %llu frames stalled; snapshots %.3f ms save, %.3f ms load average, %.3f/%.3f ms max.",
+      (unsigned long long) stats.frames, (unsigned long long) stats.rollbacks, (unsigned long long) stats.framesRerun, stats.maxRollback, (unsigned long long) stats.stalls,
+      stats.frames ? stats.saveSeconds * 1e3 / (stats.frames + stats.framesRerun) : 0.0, stats.rollbacks ? stats.loadSeconds * 1e3 / stats.rollbacks : 0.0,
+      stats.maxSaveSeconds * 1e3, stats.maxLoadSeconds * 1e3);
+  }
+#endif
+
+  // Finish writing screenshots and video
+  s_capture.reset();
+
   // Save NVRAM
   SaveNVRAM(Model3);
 
   // Close audio
   CloseAudio();
 
+#ifdef SUPERMODEL_TRACE
+  // Write trace, now that the threads recording it have stopped
+  if (Util::Trace::Recording())
+  {
+    uint64_t dropped = Util::Trace::Stop();
+    if (dropped)
+      InfoLog("Trace: %llu zones dropped once threads had recorded too many.", (unsigned long long) dropped);
+  }
+#endif // SUPERMODEL_TRACE
+
   // Shut down renderers
   delete Render2D;
   delete Render3D;
+  CShaderCache::Shared().Save();
 
-  return 0;
+  return frameHashLog.Diverged() ? 1 : 0;
 
   // Quit with an error
 QuitError:
+  SetCrashTraceModel(NULL);
+#ifdef SUPERMODEL_TRACE
+  Util::Trace::Stop();
+#endif
+  s_capture.reset();
   delete Render2D;
   delete Render3D;
+  CShaderCache::Shared().Save();
   return 1;
 }
 
@@ -1362,6 +2718,21 @@ static void PrintGameList(const std::string &xml_file, const std::map<std::strin
   }
 }
 
+// Print the game found in each ROM set
+static void PrintIdentifiedGames(const std::vector<std::string> &rom_files, const std::vector<Game> &games)
+{
+  for (size_t i = 0; i < rom_files.size(); i++)
+  {
+    const Game &game = games[i];
+    if (game.name.empty())
+      printf("%s: -\n", rom_files[i].c_str());
+    else if (!game.version.empty())
+      printf("%s: %s, %s (%s)\n", rom_files[i].c_str(), game.name.c_str(), game.title.c_str(), game.version.c_str());
+    else
+      printf("%s: %s, %s\n", rom_files[i].c_str(), game.name.c_str(), game.title.c_str());
+  }
+}
+
 static void LogConfig(const Util::Config::Node &config)
 {
   InfoLog("Runtime configuration:");
@@ -1379,12 +2750,53 @@ static Util::Config::Node DefaultConfig()
 {
   Util::Config::Node config("Global");
   config.Set("GameXMLFile", s_gameXMLFilePath);
+  config.Set("ROMCacheDirectory", "");
   config.Set("InitStateFile", "");
+  config.Set("Benchmark", "0");
+  config.Set("Headless", false);
+  config.Set("Offscreen", false);
+  config.Set("OffscreenDevice", "0");
+  config.Set("RecordInputs", "");
+  config.Set("ReplayInputs", "");
+  config.Set("RecordVideo", "");
+  config.Set("StreamURL", "");
+  config.Set("StreamEncoder", "libx264");
+  config.Set("StreamBitrate", "8000");
+  config.Set("FrameHashLog", "");
+  config.Set("VerifyFrameHashes", "");
+#ifdef SUPERMODEL_TRACE
+  config.Set("TraceFile", "");
+#endif
+  config.Set("BackgroundSaveState", true);
+  config.Set("ParallelSaveState", true);
+  config.Set("CompressSaveState", true);
+  config.Set("CompressNVRAM", false);
+  config.Set("NVRAMCheckpoint", "0");
+  config.Set("Rewind", false);
+  config.Set("RewindInterval", "4");
+  config.Set("RewindMemory", "512");
   config.Set("FastStart", "0");
+  config.Set("FastStartFrames", "0");
+  config.Set("FastStartPC", "0");
+  config.Set("FastStartCheckpoint", false);
+  config.Set("RunAhead", "0");
+  config.Set("FastForwardInterval", "4");
+  config.Set("FastForwardTimingOnlySound", false);
   // CModel3
   config.Set("MultiThreaded", true);
   config.Set("GPUMultiThreaded", true);
+  config.Set("GPUDoubleBuffered", false);
+  config.Set("BoardLatencyFrames", "0");
+  config.Set("MapVROM", true);
+  config.Set("ShareROMs", false);
+  config.Set("LowMemory", false);
   config.Set("PowerPCFrequency", "50");
+  config.Set("PowerPCEngine", "interpreter");
+  config.Set("PowerPCCodeCache", false);
+  config.Set("PowerPCFPU", "accurate");
+  config.Set("ProfilePPC", false);
+  config.Set("CPUTrace", "0");
+  config.Set("M68KEngine", "fast");
   // 2D and 3D graphics engines
   config.Set("MultiTexture", false);
   config.Set("VertexShader", "");
@@ -1395,29 +2807,66 @@ static Util::Config::Node DefaultConfig()
   config.Set("FragmentShader2D", "");
   // CSoundBoard
   config.Set("EmulateSound", true);
+  config.Set("SoundTimingOnly", false);
   config.Set("Balance", "0");
+  config.Set("SoundBlockSamples", int(1));
+  config.Set("MultiThreadedSCSP", true);
   // CDSB
   config.Set("EmulateDSB", true);
   config.Set("SoundVolume", "100");
   config.Set("MusicVolume", "100");
+  config.Set("DSBSincResampler", false);
+  config.Set("MultiThreadedDSB", true);
+  config.Set("MpegCacheMB", int(0));
   // Other sound options
   config.Set("LegacySoundDSP", false); // New config option for games that do not play correctly with MAME's SCSP sound core.
   // CDriveBoard
   config.Set("ForceFeedback", false);
+  config.Set("ForceFeedbackRate", "60");
   // Platform-specific/UI
   config.Set("New3DEngine", true);
   config.Set("QuadRendering", false);
+  config.Set("New3DModelCache", false);
+  config.Set("New3DTextureSheet", false);
+  config.Set("New3DParallelCulling", true);
+  config.Set("New3DPackedVertices", false);
+  config.Set("New3DAsyncLos", false);
+  config.Set("New3DShaderPermutations", false);
+  config.Set("New3DBoxClipping", false);
+  config.Set("New3DInstancing", false);
+  config.Set("New3DFrontToBack", false);
+  config.Set("New3DMultisample", int(0));
+  config.Set("New3DOverlapBuild", false);
+  config.Set("New3DRepeatFrames", true);
+  config.Set("New3DDynamicScale", int(0));
+  config.Set("New3DMinScale", int(50));
+  config.Set("New3DMaxScale", int(100));
+  config.Set("New3DTextureCacheMB", int(64));
+  config.Set("New3DCompressTextures", false);
   config.Set("XResolution", "496");
   config.Set("YResolution", "384");
   config.Set("FullScreen", false);
   config.Set("WideScreen", false);
   config.Set("Stretch", false);
   config.Set("WideBackground", false);
+  config.Set("GPUTilemaps", false);
+  config.Set("Filter2D", "bilinear");
+  config.Set("ShaderCache", true);
   config.Set("VSync", true);
+  config.Set("PresentMode", "vsync");
   config.Set("Throttle", true);
+  config.Set("AutoFrameSkip", "0");
   config.Set("ShowFrameRate", false);
+  config.Set("ShowTimings", false);
+  config.Set("TimingsFile", "");
+  config.Set("TelemetryMemory", "");
+  config.Set("TelemetryAddress", "");
+  config.Set("HitchThreshold", "0");
   config.Set("Crosshairs", int(0));
   config.Set("FlipStereo", false);
+  config.Set("AudioRateControl", true);
+  config.Set("AudioDriver", "");
+  config.Set("AudioPeriod", int(128));
 #ifdef SUPERMODEL_WIN32
   config.Set("InputSystem", "dinput");
   // DirectInput ForceFeedback
@@ -1441,9 +2890,26 @@ static Util::Config::Node DefaultConfig()
   // NetBoard
   config.Set("Network", false);
   config.Set("SimulateNet", true);
+  config.Set("NetTransport", "tcp");
+  config.Set("NetRedundancy", "3");
+  config.Set("NetDelta", false);
+  config.Set("NetKeyframeInterval", "60");
+  config.Set("NetPacing", false);
+  config.Set("NetRelay", "ring");
+  config.Set("PortMesh", "1972");
+  config.Set("NetPeers", "");
+  // Netplay
+  config.Set("Netplay", false);
+  config.Set("NetplayPlayer", "1");
+  config.Set("NetplayAddress", "127.0.0.1");
+  config.Set("NetplayPortIn", "1980");
+  config.Set("NetplayPortOut", "1981");
+  config.Set("NetplayDelay", "2");
+  config.Set("NetplayRollback", "8");
 #endif
 #else
   config.Set("InputSystem", "sdl");
+  config.Set("InputLatencyProbe", false);
   // SDL ForceFeedback
   config.Set("SDLConstForceMax", "100");
   config.Set("SDLSelfCenterMax", "100");
@@ -1452,6 +2918,7 @@ static Util::Config::Node DefaultConfig()
   config.Set("SDLConstForceThreshold", "30");
 #endif
   config.Set("Outputs", "none");
+  config.Set("OutputsPort", "8000");
   return config;
 }
 
@@ -1471,17 +2938,68 @@ static void Help(void)
   puts("General Options:");
   puts("  -?, -h, -help, --help   Print this help text");
   puts("  -print-games            List supported games and quit");
+  puts("  -identify-roms          List the game in each ROM set given and quit");
   printf("  -game-xml-file=<file>   ROM set definition file [Default: %s]\n", s_gameXMLFilePath);
+  puts("  -rom-cache=<dir>        Cache loaded ROMs in this directory [Default: off]");
+  puts("  -share-roms             Map program and sound ROMs from an image in the ROM");
+  puts("                          cache shared by all processes running the game");
   puts("  -log-output=<outputs>   Log output destination(s) [Default: Supermodel.log]");
   puts("  -log-level=<level>      Logging threshold [Default: info]");
+  puts("  -log-channels=<names>   Subsystems to log debug messages from: ppc, model3,");
+  puts("                          real3d, graphics, sound, dsb, drive, net, input");
+  puts("                          [Default: all]");
+  puts("  -log-sync               Write log messages as they are made rather than from");
+  puts("                          a separate thread");
   puts("");
   puts("Core Options:");
   printf("  -ppc-frequency=<freq>   PowerPC frequency in MHz [Default: %d]\n", defaultConfig["PowerPCFrequency"].ValueAs<unsigned>());
+  puts("  -ppc-engine=<engine>    PowerPC execution engine: interpreter [Default],");
+  puts("                          threaded or jit");
+  puts("  -ppc-code-cache         Remember the CROM code the threaded or jit engine");
+  puts("                          translated and translate it all on reset");
+  puts("  -ppc-fpu=<mode>         PowerPC FPSCR flags: accurate [Default], fast or");
+  puts("                          validate (reports reads fast mode would change)");
+  puts("  -m68k-engine=<engine>   68K engine of the sound, Digital Sound and net");
+  puts("                          boards: fast [Default] or musashi (reference)");
+  puts("  -profile-ppc            Sample emulated PowerPC code and write hot spots to");
+  printf("                          %s on exit (Alt+H writes it at any time)\n", s_ppcProfileFilePath);
+  puts("  -cpu-trace=<millions>   Keep this many million recent instructions per CPU");
+  printf("                          and write them to %s on exit or crash\n", s_cpuTraceFilePath);
+  puts("                          (Alt+K writes them at any time)");
   puts("  -no-threads             Disable multi-threading entirely");
   puts("  -gpu-multi-threaded     Run graphics rendering in separate thread [Default]");
   puts("  -no-gpu-thread          Run graphics rendering in main thread");
+  puts("  -gpu-double-buffer      Swap GPU memory buffers each frame instead of copying");
+  puts("                          them (requires GPU thread)");
+  puts("  -low-memory             Use as little memory as possible, at some cost in");
+  puts("                          speed (disables the GPU thread)");
+  puts("  -board-latency=<frames> Let drive and sound board threads run up to 0-4");
+  puts("                          frames behind main board [Default: 0]");
   puts("  -load-state=<file>      Load save state after starting");
   puts("  -fast-start=<ticks>     Start un-throttled for specified ticks");
+  puts("  -fast-start-frames=<n>  Start un-throttled, unseen and unheard for n frames");
+  puts("  -fast-start-pc=<addr>   Start un-throttled until the PowerPC executes addr");
+  puts("  -fast-start-checkpoint  Make resets restore the state fast start ended in");
+  puts("  -run-ahead=<frames>     Run 0-4 frames ahead to cut input lag [Default: 0]");
+  puts("  -record-inputs=<file>   Record the game's inputs to a file");
+  puts("  -replay-inputs=<file>   Play back inputs recorded with -record-inputs");
+  puts("  -record-video=<file>    Record video (.y4m, or anything ffmpeg can write)");
+  puts("  -stream=<url>           Stream video and audio with ffmpeg as MPEG-TS to an");
+  puts("                          srt://, udp:// or rtp:// address");
+  puts("  -stream-encoder=<name>  ffmpeg encoder: h264_nvenc, h264_vaapi, h264_qsv,");
+  puts("                          h264_videotoolbox, etc. [Default: libx264]");
+  puts("  -stream-bitrate=<kbps>  Video bit rate of stream [Default: 8000]");
+  puts("                          and audio (<file>.wav) from the start");
+  puts("  -benchmark=<frames>     Run the given number of frames flat out, then print");
+  puts("                          timings and a hash of the final state and quit");
+  puts("  -hash-frames=<file>     Write hashes of RAM, 3D memory and sound output each");
+  puts("                          frame to a file");
+  puts("  -verify-frames=<file>   Compare each frame against hashes written with");
+  puts("                          -hash-frames and report the first that differs");
+  puts("  -headless               Run without showing a window");
+  puts("  -offscreen              Run headless with an EGL context and no window");
+  puts("                          system (the default when there is no display)");
+  puts("  -offscreen-device=<n>   EGL device (GPU) to render offscreen on [Default: 0]");
   puts("");
   puts("Video Options:");
   puts("  -res=<x>,<y>            Resolution [Default: 496,384]");
@@ -1490,15 +3008,69 @@ static void Help(void)
   puts("  -wide-screen            Expand 3D field of view to screen width");
   puts("  -wide-bg                When wide-screen mode is enabled, also expand the 2D");
   puts("                          background layer to screen width");
+  puts("  -gpu-tilemaps           Draw the 2D layers with a shader (OpenGL 3.0)");
+  puts("  -filter-2d=<mode>       Scaling of the 2D layers: bilinear [Default], nearest");
+  puts("                          or sharp (nearest, smoothed only at pixel edges)");
+  puts("  -no-shader-cache        Compile shaders every run instead of keeping their");
+  puts("                          binaries in NVRAM/Shaders.bin");
   puts("  -stretch                Fit viewport to resolution, ignoring aspect ratio");
   puts("  -no-throttle            Disable 60 Hz frame rate lock");
+  puts("  -frame-skip=<frames>    Skip drawing up to 0-9 frames in a row when they");
+  puts("                          would not be ready in time [Default: 0]");
   puts("  -vsync                  Lock to vertical refresh rate [Default]");
   puts("  -no-vsync               Do not lock to vertical refresh rate");
+  puts("  -present-mode=<mode>    How frames are shown: vsync [Default], vrr (as soon");
+  puts("                          as ready, for variable refresh displays) or");
+  puts("                          lowlatency (no queued frames, late input)");
   puts("  -show-fps               Display frame rate in window title bar");
+  puts("  -show-timings           Display average and 99th percentile time of each");
+  puts("                          stage of the frame in title bar (Alt+Y toggles)");
+  puts("  -timings-file=<file>    Write timings of every frame to CSV file (or JSON");
+  puts("                          lines if name ends in .json)");
+  puts("  -telemetry-shm=<name>   Publish performance figures each second in shared");
+  puts("                          memory block supermodel-telemetry-<name>");
+  puts("  -telemetry=<host:port>  Send performance figures each second as JSON over UDP");
+  puts("  -hitch-threshold=<ms>   Write the last 5 seconds of frame timings to a file");
+  puts("                          when a frame takes longer than this [Default: 0=off]");
   puts("  -crosshairs=<n>         Crosshairs configuration for gun games:");
   puts("                          0=none [Default], 1=P1 only, 2=P2 only, 3=P1 & P2");
   puts("  -new3d                  New 3D engine by Ian Curtis [Default]");
   puts("  -quad-rendering         Enable proper quad rendering");
+  puts("  -model-cache            Remember VROM models drawn and build them all at");
+  puts("                          start-up next time (new engine)");
+  puts("  -texture-sheet          Sample from whole decoded texture sheets instead of");
+  puts("                          individual textures (new engine)");
+  puts("  -no-parallel-culling    Walk culling tree on the render thread only (new");
+  puts("                          engine)");
+  puts("  -packed-vertices        Store vertices in a compact format on the GPU (new");
+  puts("                          engine)");
+  puts("  -async-los              Read line of sight back without stalling, one frame");
+  puts("                          late (new engine)");
+  puts("  -shader-permutations    Compile a specialised shader for each polygon type");
+  puts("                          and cache them (new engine)");
+  puts("  -box-clipping           Depth range of partly visible models from their");
+  puts("                          bounding boxes, not polygons (new engine)");
+  puts("  -instancing             Draw repeated models with one instanced draw (new");
+  puts("                          engine)");
+  puts("  -front-to-back          Draw opaque models nearest first, to save fill rate");
+  puts("                          (new engine)");
+  puts("  -msaa=<n>               Multisample anti-aliasing with n samples per pixel");
+  puts("                          (new engine)");
+  puts("  -overlap-build          Build the 3D scene while the 2D layers are drawn");
+  puts("                          (new engine)");
+  puts("  -no-repeat-frames       Render the 3D scene every frame, even when the game");
+  puts("                          hasn't changed it (new engine)");
+  puts("  -dynamic-scale=<ms>     Lower the 3D resolution while its GPU time is over");
+  puts("                          ms milliseconds a frame [Default: 0, off] (new");
+  puts("                          engine)");
+  puts("  -min-scale=<pct>        Lowest 3D resolution for -dynamic-scale, in percent");
+  puts("                          of the window [Default: 50]");
+  puts("  -max-scale=<pct>        Highest 3D resolution for -dynamic-scale [Default:");
+  puts("                          100]");
+  puts("  -texture-cache=<mb>     GPU memory to keep replaced textures in, for reuse if");
+  puts("                          the same data comes back [Default: 64] (new engine)");
+  puts("  -compress-textures      Store textures that stay in texture RAM as S3TC,");
+  puts("                          kept in NVRAM between runs (new engine)");
   puts("  -legacy3d               Legacy 3D engine (faster but less accurate)");
   puts("  -multi-texture          Use 8 texture maps for decoding (legacy engine)");
   puts("  -no-multi-texture       Decode to single texture (legacy engine) [Default]");
@@ -1509,15 +3081,36 @@ static void Help(void)
   puts("  -vert-shader-2d=<file>  Load tile map vertex shader");
   puts("  -frag-shader-2d=<file>  Load tile map fragment shader");
   puts("  -print-gl-info          Print OpenGL driver information and quit");
+  puts("  -print-cpu-features     Print CPU features and the SIMD code chosen, and quit");
   puts("");
   puts("Audio Options:");
   puts("  -sound-volume=<vol>     Volume of SCSP-generated sound in %, applies only");
   puts("                          when Digital Sound Board is present [Default: 100]");
   puts("  -music-volume=<vol>     Digital Sound Board volume in % [Default: 100]");
   puts("  -balance=<bal>          Relative front/rear balance in % [Default: 0]");
+  puts("  -sound-block=<n>        Run the sound 68K every n samples rather than every");
+  puts("                          sample, up to 64 [Default: 1]");
+  puts("  -scsp-thread            Render the slave SCSP on its own thread in blocks");
+  puts("                          of 8 or more samples [Default]");
+  puts("  -no-scsp-thread         Render both SCSPs on the sound board thread");
   puts("  -flip-stereo            Swap left and right audio channels");
+  puts("  -audio-rate-control     Resample audio slightly to match the emulation rate");
+  puts("                          to the host's [Default]");
+  puts("  -no-audio-rate-control  Output audio as produced, dropping it on over-runs");
+  puts("  -audio-driver=<name>    Host audio API, eg pipewire, alsa, pulseaudio,");
+  puts("                          wasapi, directsound, coreaudio [Default: SDL's]");
+  puts("  -audio-period=<n>       Samples played per device period, 64 to 4096");
+  printf("                          [Default: %u]\n", defaultConfig["AudioPeriod"].ValueAs<unsigned>());
   puts("  -no-sound               Disable sound board emulation (sound effects)");
+  puts("  -sound-timing-only      Run the sound board without producing any audio");
   puts("  -no-dsb                 Disable Digital Sound Board (MPEG music)");
+  puts("  -dsb-sinc               Resample MPEG music with a windowed sinc filter");
+  puts("  -no-dsb-sinc            Resample MPEG music linearly [Default]");
+  puts("  -dsb-thread             Run the Digital Sound Board 68K on its own thread");
+  puts("                          while the SCSPs are rendered [Default]");
+  puts("  -no-dsb-thread          Run the Digital Sound Board on the sound board thread");
+  puts("  -mpeg-cache=<mb>        Keep up to this many MB of decoded MPEG music so that");
+  puts("                          it is not decoded again [Default: 0, off]");
   puts("  -new-scsp               New SCSP engine based on MAME [Default]");
   puts("  -legacy-scsp            Legacy SCSP engine by ElSemi");
   puts("");
@@ -1531,10 +3124,21 @@ static void Help(void)
 #endif
   puts("Input Options:");
   puts("  -force-feedback         Enable force feedback (DirectInput, XInput)");
+  puts("  -ff-rate=<hz>           Times per second force feedback commands are sent");
+  puts("                          to controllers, 0 for as made [Default: 60]");
   puts("  -config-inputs          Configure keyboards, mice, and game controllers");
-#ifdef SUPERMODEL_WIN32
+#if defined(SUPERMODEL_WIN32) || defined(__linux__)
   printf("  -input-system=<s>       Input system [Default: %s]\n", defaultConfig["InputSystem"].ValueAs<std::string>().c_str());
+#endif
+#ifdef __linux__
+  puts("  -input-latency-probe    Print how long joystick changes wait to be read each");
+  puts("                          second (evdev)");
+#endif
+#if defined(SUPERMODEL_WIN32) || defined(NET_BOARD)
   printf("  -outputs=<s>            Outputs [Default: %s]\n", defaultConfig["Outputs"].ValueAs<std::string>().c_str());
+#endif
+#ifdef NET_BOARD
+  printf("  -outputs-port=<n>       TCP port 'net' outputs are served on [Default: %u]\n", defaultConfig["OutputsPort"].ValueAs<unsigned>());
 #endif
   puts("  -print-inputs           Prints current input configuration");
   puts("");
@@ -1544,6 +3148,12 @@ static void Help(void)
   puts("  -enter-debugger         Enter debugger at start of emulation");
   puts("");
 #endif // SUPERMODEL_DEBUGGER
+#ifdef SUPERMODEL_TRACE
+  puts("Trace Options:");
+  puts("  -trace=<file>           Write when each board, renderer and audio zone ran");
+  puts("                          to a Chrome trace (chrome://tracing, Perfetto)");
+  puts("");
+#endif // SUPERMODEL_TRACE
 }
 
 struct ParsedCommandLine
@@ -1553,7 +3163,9 @@ struct ParsedCommandLine
   bool error = false;
   bool print_help = false;
   bool print_games = false;
+  bool identify_roms = false;
   bool print_gl_info = false;
+  bool print_cpu_features = false;
   bool config_inputs = false;
   bool print_inputs = false;
   bool disable_debugger = false;
@@ -1568,6 +3180,8 @@ struct ParsedCommandLine
     // therefore, defaults are needed early
     config.Set("LogOutput", "Supermodel.log");
     config.Set("LogLevel", "info");
+    config.Set("LogChannels", "all");
+    config.Set("LogAsync", true);
   }
 };
 
@@ -1577,30 +3191,80 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
   const std::map<std::string, std::string> valued_options
   { // -option=value
     { "-game-xml-file",         "GameXMLFile"             },
+    { "-rom-cache",             "ROMCacheDirectory"       },
     { "-load-state",            "InitStateFile"           },
+    { "-run-ahead",             "RunAhead"                },
+    { "-record-inputs",         "RecordInputs"            },
+    { "-record-video",          "RecordVideo"             },
+    { "-stream",                "StreamURL"               },
+    { "-stream-encoder",        "StreamEncoder"           },
+    { "-stream-bitrate",        "StreamBitrate"           },
+    { "-offscreen-device",      "OffscreenDevice"         },
+    { "-present-mode",          "PresentMode"             },
+    { "-replay-inputs",         "ReplayInputs"            },
+    { "-benchmark",             "Benchmark"               },
+    { "-hash-frames",           "FrameHashLog"            },
+    { "-verify-frames",         "VerifyFrameHashes"       },
+#ifdef SUPERMODEL_TRACE
+    { "-trace",                 "TraceFile"               },
+#endif
     { "-ppc-frequency",         "PowerPCFrequency"        },
+    { "-ppc-engine",            "PowerPCEngine"           },
+    { "-ppc-fpu",               "PowerPCFPU"              },
+    { "-m68k-engine",           "M68KEngine"              },
+    { "-cpu-trace",             "CPUTrace"                },
+    { "-board-latency",         "BoardLatencyFrames"      },
     { "-crosshairs",            "Crosshairs"              },
+    { "-filter-2d",             "Filter2D"                },
+    { "-frame-skip",            "AutoFrameSkip"           },
     { "-vert-shader",           "VertexShader"            },
     { "-frag-shader",           "FragmentShader"          },
     { "-vert-shader-fog",       "VertexShaderFog"         },
     { "-frag-shader-fog",       "FragmentShaderFog"       },
     { "-vert-shader-2d",        "VertexShader2D"          },
     { "-frag-shader-2d",        "FragmentShader2D"        },
+    { "-msaa",                  "New3DMultisample"        },
+    { "-texture-cache",         "New3DTextureCacheMB"     },
+    { "-dynamic-scale",         "New3DDynamicScale"       },
+    { "-min-scale",             "New3DMinScale"           },
+    { "-max-scale",             "New3DMaxScale"           },
     { "-sound-volume",          "SoundVolume"             },
     { "-music-volume",          "MusicVolume"             },
     { "-balance",               "Balance"                 },
+    { "-sound-block",           "SoundBlockSamples"       },
+    { "-mpeg-cache",            "MpegCacheMB"             },
+    { "-audio-driver",          "AudioDriver"             },
+    { "-audio-period",          "AudioPeriod"             },
     { "-input-system",          "InputSystem"             },
+    { "-ff-rate",               "ForceFeedbackRate"       },
     { "-outputs",               "Outputs"                 },
+    { "-outputs-port",          "OutputsPort"             },
     { "-log-output",            "LogOutput"               },
     { "-log-level",             "LogLevel"                },
-    { "-fast-start",            "FastStart"               }
+    { "-log-channels",          "LogChannels"             },
+    { "-fast-start",            "FastStart"               },
+    { "-fast-start-frames",     "FastStartFrames"         },
+    { "-fast-start-pc",         "FastStartPC"             },
+    { "-timings-file",          "TimingsFile"             },
+    { "-telemetry-shm",         "TelemetryMemory"         },
+    { "-telemetry",             "TelemetryAddress"        },
+    { "-hitch-threshold",       "HitchThreshold"          }
   };
   const std::map<std::string, std::pair<std::string, bool>> bool_options
   { // -option
     { "-threads",             { "MultiThreaded",    true } },
+    { "-log-sync",            { "LogAsync",         false } },
+    { "-headless",            { "Headless",         true } },
+    { "-offscreen",           { "Offscreen",        true } },
+    { "-fast-start-checkpoint", { "FastStartCheckpoint", true } },
     { "-no-threads",          { "MultiThreaded",    false } },
+    { "-profile-ppc",         { "ProfilePPC",       true } },
+    { "-ppc-code-cache",      { "PowerPCCodeCache", true } },
+    { "-share-roms",          { "ShareROMs",        true } },
     { "-gpu-multi-threaded",  { "GPUMultiThreaded", true } },
     { "-no-gpu-thread",       { "GPUMultiThreaded", false } },
+    { "-gpu-double-buffer",   { "GPUDoubleBuffered", true } },
+    { "-low-memory",          { "LowMemory",        true } },
     { "-window",              { "FullScreen",       false } },
     { "-fullscreen",          { "FullScreen",       true } },
     { "-no-wide-screen",      { "WideScreen",       false } },
@@ -1609,6 +3273,9 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
     { "-no-stretch",          { "Stretch",          false } },
     { "-wide-bg",             { "WideBackground",   true } },
     { "-no-wide-bg",          { "WideBackground",   false } },
+    { "-gpu-tilemaps",        { "GPUTilemaps",      true } },
+    { "-shader-cache",        { "ShaderCache",      true } },
+    { "-no-shader-cache",     { "ShaderCache",      false } },
     { "-no-multi-texture",    { "MultiTexture",     false } },
     { "-multi-texture",       { "MultiTexture",     true } },
     { "-throttle",            { "Throttle",         true } },
@@ -1616,16 +3283,39 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
     { "-vsync",               { "VSync",            true } },
     { "-no-vsync",            { "VSync",            false } },
     { "-show-fps",            { "ShowFrameRate",    true } },
+    { "-show-timings",        { "ShowTimings",      true } },
     { "-no-fps",              { "ShowFrameRate",    false } },
     { "-new3d",               { "New3DEngine",      true } },
     { "-quad-rendering",      { "QuadRendering",    true } },
+    { "-model-cache",         { "New3DModelCache",  true } },
+    { "-texture-sheet",       { "New3DTextureSheet", true } },
+    { "-compress-textures",   { "New3DCompressTextures", true } },
+    { "-no-parallel-culling", { "New3DParallelCulling", false } },
+    { "-packed-vertices",     { "New3DPackedVertices", true } },
+    { "-async-los",           { "New3DAsyncLos",    true } },
+    { "-shader-permutations", { "New3DShaderPermutations", true } },
+    { "-box-clipping",        { "New3DBoxClipping", true } },
+    { "-instancing",          { "New3DInstancing",  true } },
+    { "-front-to-back",       { "New3DFrontToBack", true } },
+    { "-overlap-build",       { "New3DOverlapBuild", true } },
+    { "-repeat-frames",       { "New3DRepeatFrames", true } },
+    { "-no-repeat-frames",    { "New3DRepeatFrames", false } },
     { "-legacy3d",            { "New3DEngine",      false } },
     { "-no-flip-stereo",      { "FlipStereo",       false } },
     { "-flip-stereo",         { "FlipStereo",       true } },
+    { "-audio-rate-control",  { "AudioRateControl", true } },
+    { "-no-audio-rate-control", { "AudioRateControl", false } },
     { "-sound",               { "EmulateSound",     true } },
     { "-no-sound",            { "EmulateSound",     false } },
+    { "-sound-timing-only",   { "SoundTimingOnly",  true } },
     { "-dsb",                 { "EmulateDSB",       true } },
     { "-no-dsb",              { "EmulateDSB",       false } },
+    { "-dsb-sinc",            { "DSBSincResampler", true } },
+    { "-no-dsb-sinc",         { "DSBSincResampler", false } },
+    { "-dsb-thread",          { "MultiThreadedDSB", true } },
+    { "-no-dsb-thread",       { "MultiThreadedDSB", false } },
+    { "-scsp-thread",         { "MultiThreadedSCSP", true } },
+    { "-no-scsp-thread",      { "MultiThreadedSCSP", false } },
     { "-legacy-scsp",         { "LegacySoundDSP",   true } },
     { "-new-scsp",            { "LegacySoundDSP",   false } },
 #ifdef NET_BOARD
@@ -1636,6 +3326,7 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
 #endif
     { "-no-force-feedback",   { "ForceFeedback",    false } },
     { "-force-feedback",      { "ForceFeedback",    true } },
+    { "-input-latency-probe", { "InputLatencyProbe", true } },
 
   };
   for (int i = 1; i < argc; i++)
@@ -1685,6 +3376,8 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
         cmd_line.print_help = true;
       else if (arg == "-print-games")
         cmd_line.print_games = true;
+      else if (arg == "-identify-roms")
+        cmd_line.identify_roms = true;
       else if (arg == "-res" || arg.find("-res=") == 0)
       {
         std::vector<std::string> parts = Util::Format(arg).Split('=');
@@ -1712,6 +3405,8 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
       }
       else if (arg == "-print-gl-info")
         cmd_line.print_gl_info = true;
+      else if (arg == "-print-cpu-features")
+        cmd_line.print_cpu_features = true;
       else if (arg == "-config-inputs")
         cmd_line.config_inputs = true;
       else if (arg == "-print-inputs")
@@ -1755,6 +3450,7 @@ static ParsedCommandLine ParseCommandLine(int argc, char **argv)
 
 int main(int argc, char **argv)
 {
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
   Title();
   if (argc <= 1)
   {
@@ -1791,6 +3487,11 @@ int main(int argc, char **argv)
     Help();
     return 0;
   }
+  if (cmd_line.print_cpu_features)
+  {
+    PrintCPUFeatures(false);
+    return 0;
+  }
   if (cmd_line.print_gl_info)
   {
     // We must exit after this because CreateGLScreen() is used
@@ -1808,9 +3509,11 @@ int main(int argc, char **argv)
     return 0;
   }
 
-  // Load game and resolve run-time config
+  // Pick the game and resolve run-time config (its ROMs are loaded later, alongside the rest of start-up)
   Game game;
   ROMSet rom_set;
+  std::unique_ptr<GameLoader> loader;
+  GameLoader::Choice choice;
   Util::Config::Node fileConfig("Global");
   {
     Util::Config::Node fileConfigWithDefaults("Global");
@@ -1822,22 +3525,75 @@ int main(int argc, char **argv)
     if (rom_specified || print_games)
     {
       std::string xml_file = config3["GameXMLFile"].ValueAs<std::string>();
-      GameLoader loader(xml_file);
+      loader.reset(new GameLoader(xml_file, config3["ROMCacheDirectory"].ValueAs<std::string>()));
       if (print_games)
       {
-        PrintGameList(xml_file, loader.GetGames());
+        PrintGameList(xml_file, loader->GetGames());
+        return 0;
+      }
+      if (cmd_line.identify_roms)
+      {
+        PrintIdentifiedGames(cmd_line.rom_files, loader->Identify(cmd_line.rom_files));
         return 0;
       }
-      if (loader.Load(&game, &rom_set, *cmd_line.rom_files.begin()))
+      if (loader->Choose(&choice, *cmd_line.rom_files.begin()))
         return 1;
+      game = choice.game;
       Util::Config::MergeINISections(&config4, config3, fileConfig[game.name]);   // apply game-specific config
     }
     else
       config4 = config3;
     Util::Config::MergeINISections(&s_runtime_config, config4, cmd_line.config);  // apply command line overrides once more
   }
+  // Benchmarks run flat out, and the same way every time
+  if (s_runtime_config["Benchmark"].ValueAs<unsigned>() > 0)
+  {
+    s_runtime_config.Get("Throttle").SetValue(false);
+    s_runtime_config.Get("VSync").SetValue(false);
+    s_runtime_config.Get("AutoFrameSkip").SetValue(0);
+    s_runtime_config.Get("RunAhead").SetValue(0);
+    s_runtime_config.Get("Rewind").SetValue(false);
+    s_runtime_config.Get("FastStart").SetValue(0);
+    s_runtime_config.Get("FastStartFrames").SetValue(0);
+    s_runtime_config.Get("FastStartPC").SetValue(0);
+  }
+  // Frames hashed for regression tests must come out the same every run: the
+  // board threads must not drift, and frames must not be re-run or undone
+  if (!s_runtime_config["FrameHashLog"].ValueAs<std::string>().empty() || !s_runtime_config["VerifyFrameHashes"].ValueAs<std::string>().empty())
+  {
+    s_runtime_config.Get("MultiThreaded").SetValue(false);
+    s_runtime_config.Get("GPUMultiThreaded").SetValue(false);
+    s_runtime_config.Get("RunAhead").SetValue(0);
+    s_runtime_config.Get("Rewind").SetValue(false);
+  }
+  // Run-ahead loads a save state every frame, which the board threads would
+  // have to be stopped for
+  if (s_runtime_config["RunAhead"].ValueAs<unsigned>() > 0)
+  {
+    s_runtime_config.Get("MultiThreaded").SetValue(false);
+    s_runtime_config.Get("GPUMultiThreaded").SetValue(false);
+  }
+  // The GPU thread needs a second copy of the Real3D memory
+  if (s_runtime_config["LowMemory"].ValueAs<bool>())
+  {
+    s_runtime_config.Get("GPUMultiThreaded").SetValue(false);
+    s_runtime_config.Get("GPUDoubleBuffered").SetValue(false);
+  }
+#ifdef NET_BOARD
+  // Netplay re-runs frames, which must come out the same every time
+  if (s_runtime_config["Netplay"].ValueAs<bool>())
+  {
+    s_runtime_config.Get("MultiThreaded").SetValue(false);
+    s_runtime_config.Get("GPUMultiThreaded").SetValue(false);
+  }
+#endif
   LogConfig(s_runtime_config);
 
+  // Decompress the ROMs while the window and inputs are being set up
+  StartupTasks startup(startTime);
+  if (rom_specified)
+    startup.roms = startup.graph.Start("roms", [&]() { return !loader->Load(&rom_set, choice); });
+
   // Initialize SDL (individual subsystems get initialized later)
   if (SDL_Init(0) != 0)
   {
@@ -1856,10 +3612,17 @@ int main(int argc, char **argv)
 #endif // SUPERMODEL_DEBUGGER
   std::string selectedInputSystem = s_runtime_config["InputSystem"].ValueAs<std::string>();
 
+  if (OKAY != ParsePresentMode(s_runtime_config["PresentMode"].ValueAs<std::string>(), &s_presentMode))
+  {
+    ErrorLog("Unknown presentation mode: %s\n", s_runtime_config["PresentMode"].ValueAs<std::string>().c_str());
+    exitCode = 1;
+    goto Exit;
+  }
+
   // Create a window
   xRes = 496;
   yRes = 384;
-  if (OKAY != CreateGLScreen("Supermodel", false, &xOffset, &yOffset, &xRes, &yRes, &totalXRes, &totalYRes, false, false))
+  if (!startup.graph.Run("window", []() { return OKAY == CreateGLScreen("Supermodel", false, &xOffset, &yOffset, &xRes, &yRes, &totalXRes, &totalYRes, false, false); }))
   {
     exitCode = 1;
     goto Exit;
@@ -1883,6 +3646,10 @@ int main(int argc, char **argv)
   else if (selectedInputSystem == "rawinput")
     InputSystem = new CDirectInputSystem(s_runtime_config, s_window, true, false);
 #endif // SUPERMODEL_WIN32
+#ifdef __linux__
+  else if (selectedInputSystem == "evdev")
+    InputSystem = new CEvdevInputSystem(s_runtime_config);
+#endif
   else
   {
     ErrorLog("Unknown input system: %s\n", selectedInputSystem.c_str());
@@ -1890,9 +3657,11 @@ int main(int argc, char **argv)
     goto Exit;
   }
 
+  InputSystem->SetForceFeedbackRate(s_runtime_config["ForceFeedbackRate"].ValueAsDefault<unsigned>(60));
+
   // Create inputs from input system (configuring them if required)
   Inputs = new CInputs(InputSystem);
-  if (!Inputs->Initialize())
+  if (!startup.graph.Run("inputs", [&]() { return Inputs->Initialize(); }))
   {
     ErrorLog("Unable to initalize inputs.\n");
     exitCode = 1;
@@ -1917,14 +3686,32 @@ int main(int argc, char **argv)
   if (!rom_specified)
     goto Exit;
 
+  // Now that the input settings are final and the main thread has initialized
+  // its SDL subsystems, set up the boards and open the audio device alongside
+  // the outputs and renderers
+  startup.boards = startup.graph.Start("boards", [&]() { return OKAY == Model3->Init(); });
+  startup.game = startup.graph.Start("game", [&]()
+  {
+    if (Model3->LoadGame(game, rom_set))
+      return false;
+    rom_set = ROMSet();  // free up this memory we won't need anymore
+    return true;
+  }, { startup.roms, startup.boards });
+  startup.audio = startup.graph.Start("audio", []() { return OKAY == OpenAudio(s_runtime_config["AudioDriver"].ValueAs<std::string>().c_str(), s_runtime_config["AudioPeriod"].ValueAs<unsigned>()); });
+
   // Create outputs
-#ifdef SUPERMODEL_WIN32
   {
     std::string outputs = s_runtime_config["Outputs"].ValueAs<std::string>();
     if (outputs == "none")
       Outputs = NULL;
+#ifdef SUPERMODEL_WIN32
     else if (outputs == "win")
       Outputs = new CWinOutputs();
+#endif
+#ifdef NET_BOARD
+    else if (outputs == "net")
+      Outputs = new CNetOutputs(s_runtime_config["OutputsPort"].ValueAsDefault<unsigned>(8000));
+#endif
     else
     {
       ErrorLog("Unknown outputs: %s\n", outputs.c_str());
@@ -1932,7 +3719,6 @@ int main(int argc, char **argv)
       goto Exit;
     }
   }
-#endif // SUPERMODEL_WIN32
 
   // Initialize outputs
   if (Outputs != NULL && !Outputs->Initialize())
@@ -1952,14 +3738,40 @@ int main(int argc, char **argv)
       Debugger->ForceBreak(true);
   }
   // Fire up Supermodel with debugger
-  exitCode = Supermodel(game, &rom_set, Model3, Inputs, Outputs, Debugger);
+  exitCode = Supermodel(game, &startup, Model3, Inputs, Outputs, Debugger);
 #else
   // Fire up Supermodel
-  exitCode = Supermodel(game, &rom_set, Model3, Inputs, Outputs);
+  exitCode = Supermodel(game, &startup, Model3, Inputs, Outputs);
 #endif // SUPERMODEL_DEBUGGER
+  startup.graph.WaitAll();  // in case Supermodel() failed before it needed them
   delete Model3;
 
+  {
+    ForceFeedbackStats ffStats = InputSystem->GetForceFeedbackStats();
+    if (ffStats.sent)
+      InfoLog("Force feedback: %llu commands sent, %llu replaced before being sent; latency %.2f ms average, %.2f ms max; slowest device call %.2f ms.",
+        (unsigned long long) ffStats.sent, (unsigned long long) ffStats.replaced, ffStats.totalLatency * 1e3 / ffStats.sent,
+        ffStats.maxLatency * 1e3, ffStats.maxCallTime * 1e3);
+  }
+#ifdef NET_BOARD
+  {
+    NetBufferStats netStats = GetNetBufferStats();
+    if (netStats.buffered)
+      InfoLog("Net board: %llu messages buffered, %llu heap allocations.", (unsigned long long) netStats.buffered, (unsigned long long) netStats.allocations);
+    NetLinkStats linkStats = GetNetLinkStats();
+    if (linkStats.messages && linkStats.frames)
+      InfoLog("Net board link: %.0f bytes sent per frame as deltas, of %.0f whole; %llu of %llu messages sent as keyframes.",
+        (double) linkStats.sentBytes / linkStats.frames, (double) linkStats.rawBytes / linkStats.frames,
+        (unsigned long long) linkStats.keyframes, (unsigned long long) linkStats.messages);
+    NetPacingStats pacingStats = GetNetPacingStats();
+    if (pacingStats.frames)
+      InfoLog("Net board pacing: recent frames waited %.0f us on the link on average, %u us at worst for 99%%; frame period %+d ppm, %+d ppm at most.",
+        pacingStats.averageWait, pacingStats.waitPercentile99, pacingStats.correction, pacingStats.maxCorrection);
+  }
+#endif
+
 Exit:
+  startup.graph.WaitAll();
   if (Inputs != NULL)
     delete Inputs;
   if (InputSystem != NULL)
@@ -0,0 +1,204 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * NetOutputs.cpp
+ *
+ * Implementation of COutputs that serves the outputs over TCP.
+ */
+
+#include "OSD/SDL/NetOutputs.h"
+#include "OSD/Logger.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace std::chrono_literals;
+
+static const auto SERVER_INTERVAL = 10ms;	// longest a new client waits to be accepted
+
+CNetOutputs::CNetOutputs(unsigned port) :
+	m_port(port),
+	m_server(nullptr),
+	m_clientSet(nullptr),
+	m_running(false)
+{
+	SDLNet_Init();
+}
+
+CNetOutputs::~CNetOutputs()
+{
+	if (m_thread.joinable())
+	{
+		// Tell the clients emulation has stopped, once everything before has been sent
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending += "mame_stop = 1\r";
+			m_running = false;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+	}
+
+	for (TCPsocket client : m_clients)
+		SDLNet_TCP_Close(client);
+	if (m_clientSet)
+		SDLNet_FreeSocketSet(m_clientSet);
+	if (m_server)
+		SDLNet_TCP_Close(m_server);
+
+	SDLNet_Quit();
+}
+
+bool CNetOutputs::Initialize()
+{
+	IPaddress ip;
+	if (SDLNet_ResolveHost(&ip, nullptr, Uint16(m_port)) != 0 || (m_server = SDLNet_TCP_Open(&ip)) == nullptr)
+	{
+		ErrorLog("Unable to listen for network outputs clients on port %u.", m_port);
+		return false;
+	}
+	m_clientSet = SDLNet_AllocSocketSet(MAX_CLIENTS);
+
+	m_running = true;
+	m_thread = std::thread(&CNetOutputs::ServerThread, this);
+	InfoLog("Serving outputs on port %u.", m_port);
+	return true;
+}
+
+void CNetOutputs::Attached()
+{
+	std::string message = "mame_start = " + GetGame().name + "\r";
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_startMessage = message;
+		m_pending += message;
+	}
+	m_cv.notify_all();
+}
+
+void CNetOutputs::SendOutput(EOutputs output, UINT8 prevValue, UINT8 value)
+{
+	char line[64];
+	sprintf(line, "%s = %u\r", GetOutputName(output), value);
+	m_batch += line;
+}
+
+void CNetOutputs::EndSend()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending += m_batch;
+	}
+	m_batch.clear();
+	m_cv.notify_all();
+}
+
+void CNetOutputs::ServerThread()
+{
+	std::string message;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_cv.wait_for(lock, SERVER_INTERVAL, [this] { return !m_running || !m_pending.empty(); });
+		bool running = m_running;
+		message.swap(m_pending);
+		m_pending.clear();
+		lock.unlock();
+
+		if (!message.empty())
+			SendToClients(message);
+		if (!running)
+			return;
+		DropClosedClients();
+		AcceptClients();
+
+		lock.lock();
+	}
+}
+
+void CNetOutputs::AcceptClients()
+{
+	TCPsocket client;
+	while ((client = SDLNet_TCP_Accept(m_server)) != nullptr)
+	{
+		if (m_clients.size() >= size_t(MAX_CLIENTS))
+		{
+			ErrorLog("Too many network outputs clients (at most %d).", MAX_CLIENTS);
+			SDLNet_TCP_Close(client);
+			continue;
+		}
+
+		// The game (if started yet) and every output that has been set
+		std::string message;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			message = m_startMessage;
+		}
+		if (!message.empty())
+		{
+			for (unsigned i = 0; i < NUM_OUTPUTS; i++)
+			{
+				char line[64];
+				sprintf(line, "%s = %u\r", GetOutputName((EOutputs)i), GetValue((EOutputs)i));
+				message += line;
+			}
+		}
+		if (!message.empty() && SDLNet_TCP_Send(client, message.data(), int(message.length())) < int(message.length()))
+		{
+			SDLNet_TCP_Close(client);
+			continue;
+		}
+
+		SDLNet_TCP_AddSocket(m_clientSet, client);
+		m_clients.push_back(client);
+		DebugLog("Network outputs client connected (%u connected).", unsigned(m_clients.size()));
+	}
+}
+
+void CNetOutputs::SendToClients(const std::string &message)
+{
+	for (size_t i = m_clients.size(); i-- > 0; )
+	{
+		if (SDLNet_TCP_Send(m_clients[i], message.data(), int(message.length())) < int(message.length()))
+			DropClient(i);
+	}
+}
+
+void CNetOutputs::DropClosedClients()
+{
+	if (m_clients.empty() || SDLNet_CheckSockets(m_clientSet, 0) <= 0)
+		return;
+	for (size_t i = m_clients.size(); i-- > 0; )
+	{
+		char buffer[256];
+		if (SDLNet_SocketReady(m_clients[i]) && SDLNet_TCP_Recv(m_clients[i], buffer, sizeof(buffer)) <= 0)
+			DropClient(i);
+	}
+}
+
+void CNetOutputs::DropClient(size_t index)
+{
+	SDLNet_TCP_DelSocket(m_clientSet, m_clients[index]);
+	SDLNet_TCP_Close(m_clients[index]);
+	m_clients.erase(m_clients.begin() + index);
+	DebugLog("Network outputs client disconnected (%u connected).", unsigned(m_clients.size()));
+}
@@ -0,0 +1,137 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * NetOutputs.h
+ *
+ * Implementation of COutputs that serves the outputs over TCP, in the same
+ * text protocol as MAME's network outputs ("name = value" lines ending in a
+ * carriage return), so that it works on any platform with the lamp and force
+ * feedback programs that support MAME.
+ */
+
+#ifndef INCLUDED_NETOUTPUTS_H
+#define INCLUDED_NETOUTPUTS_H
+
+#include "Types.h"
+#include "OSD/Outputs.h"
+#include "SDLIncludes.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CNetOutputs : public COutputs
+{
+public:
+	/*
+	 * CNetOutputs(port):
+	 * ~CNetOutputs():
+	 *
+	 * Constructor and destructor.  Clients connect to the given TCP port.
+	 */
+	CNetOutputs(unsigned port);
+
+	virtual ~CNetOutputs();
+
+	/*
+	 * Initialize():
+	 *
+	 * Starts listening for clients.
+	 */
+	bool Initialize();
+
+	/*
+	 * Attached():
+	 *
+	 * Tells all clients which game has started.
+	 */
+	void Attached();
+
+protected:
+	/*
+	 * SendOutput():
+	 *
+	 * Adds the output to the batch sent by EndSend().
+	 */
+	void SendOutput(EOutputs output, UINT8 prevValue, UINT8 value);
+
+	/*
+	 * EndSend():
+	 *
+	 * Hands the batch of outputs to the server thread, which sends it to every
+	 * client at once.
+	 */
+	void EndSend();
+
+private:
+	static const int MAX_CLIENTS = 16;
+
+	/*
+	 * ServerThread():
+	 *
+	 * Accepts clients, sends them each batch and drops them when they
+	 * disconnect, so that a slow client never holds up emulation.
+	 */
+	void ServerThread();
+
+	/*
+	 * AcceptClients():
+	 *
+	 * Accepts any clients waiting to connect and sends them the running game and
+	 * the current value of every output.
+	 */
+	void AcceptClients();
+
+	/*
+	 * SendToClients(message):
+	 *
+	 * Sends the message to every client, dropping those it cannot be sent to.
+	 */
+	void SendToClients(const std::string &message);
+
+	/*
+	 * DropClosedClients():
+	 *
+	 * Reads and ignores anything clients send, dropping those that have
+	 * disconnected.
+	 */
+	void DropClosedClients();
+
+	void DropClient(size_t index);
+
+	unsigned m_port;
+	TCPsocket m_server;
+	SDLNet_SocketSet m_clientSet;
+	std::vector<TCPsocket> m_clients;  // only used by the server thread
+	std::string m_batch;               // outputs added since the last EndSend(), main thread only
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::string m_pending;             // batches not yet sent by the server thread
+	std::string m_startMessage;        // sent to clients when they connect
+	bool m_running;
+};
+
+#endif	// INCLUDED_NETOUTPUTS_H
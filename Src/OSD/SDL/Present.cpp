@@ -0,0 +1,106 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * Present.cpp
+ *
+ * Presentation modes and the timing of swaps.
+ */
+
+// X11's Xmd.h, which glxew.h brings in, has its own INT8 to INT64 types, so
+// this file keeps clear of Supermodel.h and Types.h
+#include "OSD/SDL/Present.h"
+
+#include <GL/glew.h>
+#ifdef _WIN32
+#include <GL/wglew.h>
+#elif defined(__linux__)
+#include <GL/glxew.h>
+#endif
+
+void CPresentClock::Presented(Clock::time_point swapStart)
+{
+  Clock::time_point now = Clock::now();
+  m_swapMicros = uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(now - swapStart).count());
+  if (m_timed)
+  {
+    uint32_t interval = uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(now - m_lastPresent).count());
+    m_intervals.Add(interval);
+    m_jitter.Add(interval > m_periodMicros ? interval - m_periodMicros : m_periodMicros - interval);
+  }
+  m_lastPresent = now;
+  m_timed = true;
+}
+
+void CPresentClock::Restart()
+{
+  m_timed = false;
+}
+
+bool CPresentClock::Timed() const
+{
+  return m_timed;
+}
+
+CPresentClock::Clock::time_point CPresentClock::LastPresent() const
+{
+  return m_lastPresent;
+}
+
+uint32_t CPresentClock::LastSwapMicros() const
+{
+  return m_swapMicros;
+}
+
+const Util::RollingStats &CPresentClock::Intervals() const
+{
+  return m_intervals;
+}
+
+const Util::RollingStats &CPresentClock::Jitter() const
+{
+  return m_jitter;
+}
+
+bool CPresentClock::DelayBeforeSwap(uint32_t micros)
+{
+  GLfloat seconds = GLfloat(micros * 1e-6);
+#ifdef _WIN32
+  HDC dc = wglGetCurrentDC();
+  if (WGLEW_NV_delay_before_swap && dc != NULL)
+    return wglDelayBeforeSwapNV(dc, seconds) != FALSE;
+#elif defined(__linux__)
+  // Offscreen (EGL) contexts have no GLX display
+  Display *display = GLXEW_NV_delay_before_swap ? glXGetCurrentDisplay() : NULL;
+  if (display != NULL)
+    return glXDelayBeforeSwapNV(display, glXGetCurrentDrawable(), seconds) != False;
+#else
+  (void) seconds;
+#endif
+  return false;
+}
+
+CPresentClock::CPresentClock(double framesPerSecond, size_t window)
+  : m_periodMicros(uint32_t(1e6 / framesPerSecond + 0.5)),
+    m_intervals(window),
+    m_jitter(window)
+{
+}
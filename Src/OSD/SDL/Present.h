@@ -0,0 +1,114 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * Present.h
+ *
+ * Header file for the presentation modes and CPresentClock, which times the
+ * frames as they reach the display.
+ */
+
+#ifndef INCLUDED_PRESENT_H
+#define INCLUDED_PRESENT_H
+
+#include "Util/RollingStats.h"
+
+#include <chrono>
+#include <cstdint>
+
+/*
+ * PresentMode:
+ *
+ * How finished frames are swapped onto the display.
+ *
+ *    VSync       On the vertical blank if VSync is set, otherwise at once.
+ *                The driver may queue frames ahead of the display.
+ *    VRR         At once, as soon as each frame is ready, so that the frame
+ *                pacer alone sets the rate.  For variable refresh rate
+ *                displays, which refresh when the frame arrives.
+ *    LowLatency  On the vertical blank, waiting for each swap to be done so
+ *                that no frames queue.  The next frame then starts as late
+ *                before the following blank as its cost allows, reading the
+ *                inputs later.
+ */
+enum class PresentMode
+{
+  VSync,
+  VRR,
+  LowLatency
+};
+
+/*
+ * CPresentClock:
+ *
+ * Times each swap and the interval since the one before.  With the swap
+ * waited for, as in LowLatency, a swap ends on the vertical blank.  Jitter is
+ * how far each interval strays from the frame period; on a fixed display not
+ * at the frame rate it shows the judder of frames held for a different number
+ * of refreshes.
+ */
+class CPresentClock
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Records a swap that began at the given time and has just returned
+  void Presented(Clock::time_point swapStart);
+
+  // Forgets the last swap, so that the gap of a pause or fast forward isn't
+  // counted as an interval
+  void Restart();
+
+  // Whether LastPresent() is of a swap since the last Restart()
+  bool Timed() const;
+
+  Clock::time_point LastPresent() const;
+
+  // How long the last swap took, in microseconds
+  uint32_t LastSwapMicros() const;
+
+  // Recent present-to-present intervals, and how far each was from the frame
+  // period, in microseconds
+  const Util::RollingStats &Intervals() const;
+  const Util::RollingStats &Jitter() const;
+
+  /*
+   * DelayBeforeSwap(micros):
+   *
+   * Waits until the given time before the display's next vertical blank, as
+   * told by the driver through GLX/WGL_NV_delay_before_swap.  Must be called
+   * from the thread with the OpenGL context, after glewInit().  Returns false
+   * without waiting where the extension isn't supported.
+   */
+  bool DelayBeforeSwap(uint32_t micros);
+
+  CPresentClock(double framesPerSecond, size_t window = 600);
+
+private:
+  uint32_t           m_periodMicros;
+  Clock::time_point  m_lastPresent;
+  bool               m_timed = false;
+  uint32_t           m_swapMicros = 0;
+  Util::RollingStats m_intervals;
+  Util::RollingStats m_jitter;
+};
+
+#endif  // INCLUDED_PRESENT_H
@@ -32,6 +32,7 @@
 #include "Supermodel.h"
 #include "SDLInputSystem.h"
 
+#include <algorithm>
 #include <vector>
 using namespace std;
 
@@ -167,7 +168,14 @@ SDLKeyMapStruct CSDLInputSystem::s_keyMap[] =
 };
 
 CSDLInputSystem::CSDLInputSystem(const Util::Config::Node& config)
-  : CInputSystem("SDL"),
+  : CSDLInputSystem("SDL", config, true)
+{
+  //
+}
+
+CSDLInputSystem::CSDLInputSystem(const char *systemName, const Util::Config::Node& config, bool openJoysticks)
+  : CInputSystem(systemName),
+    m_openJoysticks(openJoysticks),
     m_keyState(nullptr),
     m_mouseX(0),
     m_mouseY(0),
@@ -180,7 +188,10 @@ CSDLInputSystem::CSDLInputSystem(const Util::Config::Node& config)
 
 CSDLInputSystem::~CSDLInputSystem()
 {
+  StopForceFeedback();
   CloseJoysticks();
+  if (m_numEvents)
+    InfoLog("Input: %llu events, waiting %.1f ms on average (%u ms at most) to be polled.", (unsigned long long) m_numEvents, double(m_totalEventDelay) / double(m_numEvents), m_maxEventDelay);
 }
 
 void CSDLInputSystem::OpenJoysticks()
@@ -238,7 +249,7 @@ void CSDLInputSystem::OpenJoysticks()
 #if (defined _WIN32 && defined HAPTIC_MOD)
         if (numHapticAxes > 2)
         {
-          DebugLog("Joystick : %s return more than 2 ffb axes, need sdl2 addon SDL_HapticSetAxes() to bypass\n", SDL_HapticName(joyNum));
+          DEBUG_LOG(Input, "Joystick : %s return more than 2 ffb axes, need sdl2 addon SDL_HapticSetAxes() to bypass\n", SDL_HapticName(joyNum));
           if (strcmp(joyDetails.name, "Saitek Cyborg Evo Force") == 0) // remove if any other particular case
             SDL_HapticSetAxes(hapticDatas.SDLhaptic, 2);   // /!\ function manually added to SDL2 project
         }
@@ -253,7 +264,7 @@ void CSDLInputSystem::OpenJoysticks()
 #ifndef _WIN32
         if (!HasBasicForce(hapticDatas.SDLhaptic)) numHapticAxes = 0;
 #endif
-        DebugLog("joy num %d haptic num axe %d name : %s\n", joyNum, numHapticAxes, SDL_HapticName(joyNum));
+        DEBUG_LOG(Input, "joy num %d haptic num axe %d name : %s\n", joyNum, numHapticAxes, SDL_HapticName(joyNum));
       }
     }
 
@@ -358,12 +369,33 @@ void CSDLInputSystem::OpenJoysticks()
       }
     }
 
+    // Initial state, after which it is updated from events
+    JoyState joyState;
+    joyState.id = SDL_JoystickInstanceID(joystick);
+    for (int axisNum = 0; axisNum < SDL_JoystickNumAxes(joystick); axisNum++)
+      joyState.axes.push_back(SDL_JoystickGetAxis(joystick, axisNum));
+    for (int butNum = 0; butNum < SDL_JoystickNumButtons(joystick); butNum++)
+      joyState.buttons.push_back(SDL_JoystickGetButton(joystick, butNum));
+    for (int povNum = 0; povNum < SDL_JoystickNumHats(joystick); povNum++)
+      joyState.hats.push_back(SDL_JoystickGetHat(joystick, povNum));
+
     m_joysticks.push_back(joystick);
     m_joyDetails.push_back(joyDetails);
+    m_joyStates.push_back(joyState);
     m_SDLHapticDatas.push_back(hapticDatas);
   }
 }
 
+CSDLInputSystem::JoyState *CSDLInputSystem::FindJoyState(SDL_JoystickID id)
+{
+  for (JoyState &joyState: m_joyStates)
+  {
+    if (joyState.id == id)
+      return &joyState;
+  }
+  return nullptr;
+}
+
 void CSDLInputSystem::CloseJoysticks()
 {
   // Close all previously opened joysticks
@@ -389,6 +421,7 @@ void CSDLInputSystem::CloseJoysticks()
 
   m_joysticks.clear();
   m_joyDetails.clear();
+  m_joyStates.clear();
   m_SDLHapticDatas.clear();
 }
 
@@ -404,7 +437,12 @@ bool CSDLInputSystem::InitializeSystem()
   SDL_JoystickEventState(SDL_ENABLE);
 
   // Open attached joysticks
-  OpenJoysticks();
+  if (m_openJoysticks)
+    OpenJoysticks();
+
+  // Initial key and mouse state, after which they are updated from events
+  m_keyState = SDL_GetKeyboardState(nullptr);
+  m_mouseButtons = SDL_GetMouseState(&m_mouseX, &m_mouseY);
   return true;
 }
 
@@ -466,16 +504,16 @@ bool CSDLInputSystem::IsMouseButPressed(int mseNum, int butNum)
 
 int CSDLInputSystem::GetJoyAxisValue(int joyNum, int axisNum)
 {
-  // Get raw joystick axis value for given joystick from SDL (values range from -32768 to 32767)
-  SDL_Joystick *joystick = m_joysticks[joyNum];
-  return SDL_JoystickGetAxis(joystick, axisNum);
+  // Get raw joystick axis value for given joystick (values range from -32768 to 32767)
+  const std::vector<Sint16> &axes = m_joyStates[joyNum].axes;
+  return axisNum < (int)axes.size() ? axes[axisNum] : 0;
 }
 
 bool CSDLInputSystem::IsJoyPOVInDir(int joyNum, int povNum, int povDir)
 {
-  // Get current joystick POV-hat value for given joystick and POV number from SDL and check if pointing in required direction
-  SDL_Joystick *joystick = m_joysticks[joyNum];
-  int hatVal = SDL_JoystickGetHat(joystick, povNum);
+  // Get current joystick POV-hat value for given joystick and POV number and check if pointing in required direction
+  const std::vector<Uint8> &hats = m_joyStates[joyNum].hats;
+  int hatVal = povNum < (int)hats.size() ? hats[povNum] : SDL_HAT_CENTERED;
   switch (povDir)
   {
     case POV_UP:    return !!(hatVal & SDL_HAT_UP);
@@ -489,9 +527,9 @@ bool CSDLInputSystem::IsJoyPOVInDir(int joyNum, int povNum, int povDir)
 
 bool CSDLInputSystem::IsJoyButPressed(int joyNum, int butNum)
 {
-  // Get current joystick button state for given joystick and button number from SDL
-  SDL_Joystick *joystick = m_joysticks[joyNum];
-  return !!SDL_JoystickGetButton(joystick, butNum);
+  // Get current joystick button state for given joystick and button number
+  const std::vector<Uint8> &buttons = m_joyStates[joyNum].buttons;
+  return butNum < (int)buttons.size() && !!buttons[butNum];
 }
 
 bool CSDLInputSystem::ProcessForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCmd ffCmd)
@@ -580,39 +618,66 @@ bool CSDLInputSystem::Poll()
   // Reset mouse wheel direction
   m_mouseWheelDir = 0;
 
-  // Poll for event from SDL
+  // Poll for events from SDL and update the joystick and mouse state from
+  // them, so that reading inputs costs no more calls into SDL (key state is
+  // kept by SDL itself)
+  Uint32 now = SDL_GetTicks();
   SDL_Event e;
   while (SDL_PollEvent(&e))
   {
+    JoyState *joyState = nullptr;
     switch (e.type)
 		{
 	  default:
-	    break;
+	    continue;
 		case SDL_QUIT:
 			return false;
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+			break;
+		case SDL_MOUSEMOTION:
+			m_mouseX = e.motion.x;
+			m_mouseY = e.motion.y;
+			break;
+		case SDL_MOUSEBUTTONDOWN:
+			m_mouseButtons |= SDL_BUTTON(e.button.button);
+			break;
+		case SDL_MOUSEBUTTONUP:
+			m_mouseButtons &= ~SDL_BUTTON(e.button.button);
+			break;
 		case SDL_MOUSEWHEEL:
-			if (e.button.y > 0)
+			if (e.wheel.y > 0)
 			{
 				m_mouseZ += 5;
 				m_mouseWheelDir = 1;
 			}
-			else if (e.button.y < 0)
+			else if (e.wheel.y < 0)
 			{
 				m_mouseZ -= 5;
 				m_mouseWheelDir = -1;
 			}
 			break;
+		case SDL_JOYAXISMOTION:
+			if ((joyState = FindJoyState(e.jaxis.which)) && e.jaxis.axis < joyState->axes.size())
+				joyState->axes[e.jaxis.axis] = e.jaxis.value;
+			break;
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+			if ((joyState = FindJoyState(e.jbutton.which)) && e.jbutton.button < joyState->buttons.size())
+				joyState->buttons[e.jbutton.button] = e.jbutton.state == SDL_PRESSED;
+			break;
+		case SDL_JOYHATMOTION:
+			if ((joyState = FindJoyState(e.jhat.which)) && e.jhat.hat < joyState->hats.size())
+				joyState->hats[e.jhat.hat] = e.jhat.value;
+			break;
 		}
-  }
-
-  // Get key state from SDL
-  m_keyState = SDL_GetKeyboardState(nullptr);
 
-  // Get mouse state from SDL (except mouse wheel which was handled earlier)
-  m_mouseButtons = SDL_GetMouseState(&m_mouseX, &m_mouseY);
-
-  // Update joystick state (not required as called implicitly by SDL_PollEvent above)
-  //SDL_JoystickUpdate();
+    // Input event: note how long it waited
+    Uint32 delay = SDL_TICKS_PASSED(now, e.common.timestamp) ? now - e.common.timestamp : 0;
+    m_numEvents++;
+    m_totalEventDelay += delay;
+    m_maxEventDelay = std::max(m_maxEventDelay, delay);
+  }
   return true;
 }
 
@@ -54,21 +54,43 @@ private:
 	// Lookup table to map key names to SDLKeys
 	static SDLKeyMapStruct s_keyMap[];
 
+	// Whether joysticks are read through SDL (or left to a subclass)
+	bool m_openJoysticks;
+
 	// Vector to keep track of attached joysticks
 	std::vector<SDL_Joystick*> m_joysticks;
 
 	// Vector of joystick details
 	std::vector<JoyDetails> m_joyDetails;
 
-	// Current key state obtained from SDL
+	// Current joystick state, one per attached joystick, kept up to date from
+	// SDL events as they are polled
+	struct JoyState
+	{
+		SDL_JoystickID id;
+		std::vector<Sint16> axes;
+		std::vector<Uint8> buttons;
+		std::vector<Uint8> hats;
+	};
+	std::vector<JoyState> m_joyStates;
+
+	// Current key state obtained from SDL (which SDL itself keeps up to date
+	// from events)
 	const Uint8 *m_keyState;
 
-	// Current mouse state obtained from SDL
+	// Current mouse state, kept up to date from SDL events
 	int m_mouseX;
 	int m_mouseY;
 	int m_mouseZ;
 	short m_mouseWheelDir;
-	Uint8 m_mouseButtons;
+	Uint32 m_mouseButtons;
+
+	// How long input events waited to be polled, from their timestamps
+	UINT64 m_numEvents = 0;
+	UINT64 m_totalEventDelay = 0;	// ms
+	Uint32 m_maxEventDelay = 0;
+
+	JoyState *FindJoyState(SDL_JoystickID id);
 
 	// SDL2 ffb
 	SDL_HapticEffect eff;
@@ -97,6 +119,12 @@ private:
 	void CloseJoysticks();
 
 protected:
+	/*
+	 * Constructs an SDL input system with the given name for a subclass that
+	 * reads joysticks itself if openJoysticks is false.
+	 */
+	CSDLInputSystem(const char *systemName, const Util::Config::Node& config, bool openJoysticks);
+
 	/*
 	 * Initializes the SDL input system.
 	 */
@@ -0,0 +1,262 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * Telemetry.cpp
+ *
+ * Publishes performance figures once a second.
+ */
+
+#include "OSD/SDL/Telemetry.h"
+#include "OSD/Audio.h"
+#include "OSD/Logger.h"
+#include "Supermodel.h"
+#include "Util/MappedMemory.h"
+#include "Util/MemoryUsage.h"
+#ifdef NET_BOARD
+#include "Network/NetPacing.h"
+#include "SDLIncludes.h"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace std::chrono_literals;
+
+// In the order of TelemetryFigures
+static UINT32 FrameTimings::*const s_stages[TelemetryFigures::NumStages] =
+{
+  &FrameTimings::ppcMicros,
+  &FrameTimings::syncMicros,
+  &FrameTimings::renderMicros,
+  &FrameTimings::sndMicros,
+  &FrameTimings::drvMicros,
+#ifdef NET_BOARD
+  &FrameTimings::netMicros,
+#else
+  nullptr,
+#endif
+  &FrameTimings::waitMicros,
+  &FrameTimings::frameMicros
+};
+
+static const char *s_stageNames[TelemetryFigures::NumStages] = { "ppc", "sync", "render", "snd", "drv", "net", "wait", "frame" };
+
+bool CTelemetry::Start(const std::string &game, const std::string &sharedName, const std::string &address)
+{
+  m_game = game;
+
+  if (!sharedName.empty())
+  {
+    m_sharedName = "supermodel-telemetry-" + sharedName;
+    m_block = (TelemetryBlock *) Util::MappedMemory::MapShared(m_sharedName, sizeof(TelemetryBlock));
+    if (m_block == nullptr)
+      ErrorLog("Unable to create telemetry shared memory block '%s'.", m_sharedName.c_str());
+    else
+    {
+      m_block->magic = TelemetryBlock::Magic;
+      m_block->version = TelemetryBlock::Version;
+      m_block->sequence = 0;
+      memset(m_block->game, 0, sizeof(m_block->game));
+      strncpy(m_block->game, game.c_str(), sizeof(m_block->game) - 1);
+    }
+  }
+
+  if (!address.empty())
+  {
+#ifdef NET_BOARD
+    size_t colon = address.find_last_of(':');
+    IPaddress ip;
+    UDPsocket socket = nullptr;
+    if (colon == std::string::npos || SDLNet_Init() != 0 ||
+        SDLNet_ResolveHost(&ip, address.substr(0, colon).c_str(), Uint16(atoi(address.substr(colon + 1).c_str()))) != 0 ||
+        (socket = SDLNet_UDP_Open(0)) == nullptr)
+      ErrorLog("Unable to send telemetry to '%s'.", address.c_str());
+    else
+    {
+      UDPpacket *packet = SDLNet_AllocPacket(2048);
+      packet->address = ip;
+      m_socket = socket;
+      m_packet = packet;
+    }
+#else
+    ErrorLog("Telemetry can only be sent to '%s' by a build with net board support.", address.c_str());
+#endif
+  }
+
+  if (m_block == nullptr && m_socket == nullptr)
+    return FAIL;
+  m_running = true;
+  m_thread = std::thread(&CTelemetry::ThreadProc, this);
+  InfoLog("Publishing telemetry%s%s%s%s.", m_block ? " in shared memory block " : "", m_block ? m_sharedName.c_str() : "",
+    m_socket ? " to " : "", m_socket ? address.c_str() : "");
+  return OKAY;
+}
+
+void CTelemetry::AddFrame(const FrameTimings &timings, bool skipped)
+{
+  auto now = std::chrono::steady_clock::now();
+  if (!m_started)
+  {
+    m_secondStart = now;
+    m_started = true;
+  }
+
+  m_totals.frames++;
+  m_totals.framesInSecond++;
+  m_totals.skipped += skipped;
+  for (int i = 0; i < TelemetryFigures::NumStages; i++)
+  {
+    UINT32 micros = s_stages[i] ? timings.*s_stages[i] : 0;
+    m_totals.stageSum[i] += micros;
+    m_totals.stageMax[i] = std::max(m_totals.stageMax[i], micros);
+  }
+
+  if (now - m_secondStart < 1s)
+    return;
+
+  // Hand the second over under the sequence lock, which the telemetry thread
+  // reads again if it changes while being copied
+  m_totals.seconds = std::chrono::duration<double>(now - m_secondStart).count();
+  m_sequence.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_handover = m_totals;
+  m_sequence.fetch_add(1, std::memory_order_release);
+
+  UINT64 frames = m_totals.frames;
+  m_totals = Totals();
+  m_totals.frames = frames;
+  m_secondStart = now;
+}
+
+void CTelemetry::ThreadProc()
+{
+  UINT32 lastSequence = 0;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_cv.wait_for(lock, 1s, [this] { return !m_running; }))
+  {
+    Totals totals;
+    UINT32 sequence;
+    do
+    {
+      while ((sequence = m_sequence.load(std::memory_order_acquire)) & 1)
+        std::this_thread::yield();
+      totals = m_handover;
+      std::atomic_thread_fence(std::memory_order_acquire);
+    } while (m_sequence.load(std::memory_order_relaxed) != sequence);
+
+    // Nothing new means no frames ran in the last second (paused, loading)
+    if (sequence == lastSequence)
+    {
+      UINT64 frames = totals.frames;
+      totals = Totals();
+      totals.frames = frames;
+    }
+    lastSequence = sequence;
+    Publish(totals);
+  }
+}
+
+void CTelemetry::Publish(const Totals &totals)
+{
+  TelemetryFigures figures = {};
+  figures.frames = totals.frames;
+  figures.fps = totals.seconds > 0 ? float(totals.framesInSecond / totals.seconds) : 0.0f;
+  for (int i = 0; i < TelemetryFigures::NumStages; i++)
+  {
+    figures.stageAverage[i] = totals.framesInSecond ? UINT32(totals.stageSum[i] / totals.framesInSecond) : 0;
+    figures.stageMax[i] = totals.stageMax[i];
+  }
+  figures.framesSkipped = totals.skipped;
+  AudioStats audio;
+  GetAudioStats(&audio);
+  figures.audioBufferedMillis = audio.bufferedMillis;
+  figures.audioOutputMillis = audio.outputMillis;
+  figures.audioUnderRuns = audio.underRuns;
+  figures.audioOverRuns = audio.overRuns;
+#ifdef NET_BOARD
+  NetPacingStats link = GetNetPacingStats();
+  figures.linkWaitAverage = link.frames ? UINT32(link.averageWait) : 0;
+  figures.linkWaitPercentile99 = link.frames ? link.waitPercentile99 : 0;
+#endif
+  figures.residentBytes = Util::MemoryUsage::Resident();
+
+  if (m_block != nullptr)
+  {
+    m_block->sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_block->figures = figures;
+    m_block->sequence.fetch_add(1, std::memory_order_release);
+  }
+
+#ifdef NET_BOARD
+  if (m_socket != nullptr)
+  {
+    char json[2048];
+    int length = snprintf(json, sizeof(json), "{\"game\":\"%s\",\"frames\":%llu,\"fps\":%.1f", m_game.c_str(), (unsigned long long) figures.frames, figures.fps);
+    for (int i = 0; i < TelemetryFigures::NumStages; i++)
+      length += snprintf(json + length, sizeof(json) - length, ",\"%s_us\":[%u,%u]", s_stageNames[i], figures.stageAverage[i], figures.stageMax[i]);
+    length += snprintf(json + length, sizeof(json) - length,
+      ",\"skipped\":%u,\"audio_buffered_ms\":%u,\"audio_output_ms\":%u,\"audio_under_runs\":%u,\"audio_over_runs\":%u"
+      ",\"link_wait_us\":[%u,%u],\"resident_bytes\":%llu}",
+      figures.framesSkipped, figures.audioBufferedMillis, figures.audioOutputMillis, figures.audioUnderRuns, figures.audioOverRuns,
+      figures.linkWaitAverage, figures.linkWaitPercentile99, (unsigned long long) figures.residentBytes);
+    UDPpacket *packet = (UDPpacket *) m_packet;
+    memcpy(packet->data, json, size_t(length));
+    packet->len = length;
+    SDLNet_UDP_Send((UDPsocket) m_socket, -1, packet);
+  }
+#endif
+}
+
+CTelemetry::CTelemetry()
+  : m_totals(),
+    m_sequence(0),
+    m_handover()
+{
+}
+
+CTelemetry::~CTelemetry()
+{
+  if (m_thread.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_running = false;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+  }
+  if (m_block != nullptr)
+  {
+    Util::MappedMemory::UnmapShared((UINT8 *) m_block, sizeof(TelemetryBlock));
+    Util::MappedMemory::UnlinkShared(m_sharedName);
+  }
+#ifdef NET_BOARD
+  if (m_socket != nullptr)
+  {
+    SDLNet_FreePacket((UDPpacket *) m_packet);
+    SDLNet_UDP_Close((UDPsocket) m_socket);
+    SDLNet_Quit();
+  }
+#endif
+}
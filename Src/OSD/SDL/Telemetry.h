@@ -0,0 +1,156 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * Telemetry.h
+ *
+ * Header file for CTelemetry, which publishes performance figures once a
+ * second for cabinets to be watched from elsewhere.
+ */
+
+#ifndef INCLUDED_TELEMETRY_H
+#define INCLUDED_TELEMETRY_H
+
+#include "Types.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct FrameTimings;
+
+/*
+ * TelemetryFigures:
+ *
+ * What is published each second.  Stage times are the average and the worst
+ * over the frames of the second, in microseconds, in the order ppc, sync,
+ * render, snd, drv, net, wait, frame.  Link waits are 0 without a net board.
+ */
+struct TelemetryFigures
+{
+  static const int NumStages = 8;
+
+  UINT64 frames;                    // run since start up
+  float  fps;                       // over the last second
+  UINT32 stageAverage[NumStages];
+  UINT32 stageMax[NumStages];
+  UINT32 framesSkipped;             // of the last second's
+  UINT32 audioBufferedMillis;
+  UINT32 audioOutputMillis;
+  UINT32 audioUnderRuns;            // since start up
+  UINT32 audioOverRuns;
+  UINT32 linkWaitAverage;           // microseconds a frame spent waiting on the net board link, recently
+  UINT32 linkWaitPercentile99;
+  UINT64 residentBytes;             // memory in use
+};
+
+/*
+ * TelemetryBlock:
+ *
+ * Layout of the shared memory block ("supermodel-telemetry-<name>", under
+ * /dev/shm on Linux).  A reader copies the figures out when the sequence
+ * number is even and the same before and after, and tries again otherwise.
+ */
+struct TelemetryBlock
+{
+  static const UINT32 Magic = 0x4C544D53;  // "SMTL"
+  static const UINT32 Version = 1;
+
+  UINT32 magic;
+  UINT32 version;
+  std::atomic<UINT32> sequence;     // odd while the figures are being written
+  char   game[32];
+  TelemetryFigures figures;
+};
+
+/*
+ * CTelemetry:
+ *
+ * The frame loop adds each frame's timings, which costs a few additions, and
+ * once a second hands the totals over to a thread of its own through a
+ * sequence lock, which never blocks.  That thread gathers the rest of the
+ * figures and publishes them into a shared memory block and as a JSON
+ * datagram to a UDP address, whichever are given.
+ */
+class CTelemetry
+{
+public:
+  /*
+   * Start(game, sharedName, address):
+   *
+   * Begins publishing.  Returns FAIL if neither destination could be opened.
+   *
+   * Parameters:
+   *    game        Game name, to tell cabinets' figures apart.
+   *    sharedName  Name of the shared memory block, or empty for none.
+   *    address     "host:port" to send datagrams to, or empty for none.
+   *                Needs the net board build (SDL_net).
+   */
+  bool Start(const std::string &game, const std::string &sharedName, const std::string &address);
+
+  /*
+   * AddFrame(timings, skipped):
+   *
+   * Counts a frame run.  Called by the frame loop only.
+   */
+  void AddFrame(const FrameTimings &timings, bool skipped);
+
+  CTelemetry();
+  ~CTelemetry();
+
+private:
+  struct Totals
+  {
+    UINT64 frames;
+    UINT64 stageSum[TelemetryFigures::NumStages];
+    UINT32 stageMax[TelemetryFigures::NumStages];
+    UINT32 skipped;
+    UINT32 framesInSecond;
+    double seconds;
+  };
+
+  void ThreadProc();
+  void Publish(const Totals &totals);
+
+  // Frame loop side
+  Totals m_totals;
+  std::chrono::steady_clock::time_point m_secondStart;
+  bool m_started = false;
+
+  // Handed over once a second
+  std::atomic<UINT32> m_sequence;
+  Totals m_handover;
+
+  std::string m_game;
+  TelemetryBlock *m_block = nullptr;
+  std::string m_sharedName;
+  void *m_socket = nullptr;         // SDL_net UDP socket and packet
+  void *m_packet = nullptr;
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_running = false;
+};
+
+#endif  // INCLUDED_TELEMETRY_H
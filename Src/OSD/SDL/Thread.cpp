@@ -181,3 +181,100 @@ bool CMutex::Unlock()
 {
 	return SDL_mutexV((SDL_mutex*)m_impl) == 0;
 }
+
+// SDL has no way to set thread affinity, so it is done natively. Included last,
+// as windows.h would otherwise rename CThread methods (CreateSemaphore, etc.).
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+bool CThread::SetAffinity(const std::vector<unsigned> &cpus)
+{
+	if (cpus.empty())
+	{
+		SDL_SetError("No CPUs given for thread affinity");
+		return false;
+	}
+#if defined(_WIN32)
+	DWORD_PTR mask = 0;
+	for (unsigned cpu: cpus)
+	{
+		if (cpu >= 8 * sizeof(mask))
+		{
+			SDL_SetError("CPU %u out of range for thread affinity", cpu);
+			return false;
+		}
+		mask |= DWORD_PTR(1) << cpu;
+	}
+	if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+	{
+		SDL_SetError("SetThreadAffinityMask failed (error %lu)", (unsigned long) ::GetLastError());
+		return false;
+	}
+	return true;
+#elif defined(__APPLE__)
+	thread_affinity_policy_data_t policy = { integer_t(cpus[0] + 1) };	// tag 0 means no affinity
+	mach_port_t thread = mach_thread_self();
+	kern_return_t result = thread_policy_set(thread, THREAD_AFFINITY_POLICY, (thread_policy_t) &policy, THREAD_AFFINITY_POLICY_COUNT);
+	mach_port_deallocate(mach_task_self(), thread);
+	if (result != KERN_SUCCESS)
+	{
+		SDL_SetError("thread_policy_set failed (error %d)", result);
+		return false;
+	}
+	return true;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (unsigned cpu: cpus)
+	{
+		if (cpu >= CPU_SETSIZE)
+		{
+			SDL_SetError("CPU %u out of range for thread affinity", cpu);
+			return false;
+		}
+		CPU_SET(cpu, &set);
+	}
+	int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (result != 0)
+	{
+		SDL_SetError("pthread_setaffinity_np failed: %s", strerror(result));
+		return false;
+	}
+	return true;
+#else
+	SDL_SetError("Thread affinity is not supported on this platform");
+	return false;
+#endif
+}
+
+bool CThread::SetPriority(Priority priority)
+{
+	SDL_ThreadPriority sdlPriority = SDL_THREAD_PRIORITY_NORMAL;
+	switch (priority)
+	{
+	case PRIORITY_NORMAL:
+		sdlPriority = SDL_THREAD_PRIORITY_NORMAL;
+		break;
+	case PRIORITY_HIGH:
+		sdlPriority = SDL_THREAD_PRIORITY_HIGH;
+		break;
+	case PRIORITY_REALTIME:
+#if SDL_VERSION_ATLEAST(2, 0, 9)
+		sdlPriority = SDL_THREAD_PRIORITY_TIME_CRITICAL;
+#else
+		sdlPriority = SDL_THREAD_PRIORITY_HIGH;
+#endif
+		break;
+	}
+	return SDL_SetThreadPriority(sdlPriority) == 0;
+}
@@ -29,6 +29,10 @@
 #define INCLUDED_THREADS_H
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 class CSemaphore;
 class CMutex;
@@ -50,6 +54,18 @@ private:
 	CThread(const std::string &name, void *impl);
 
 public:
+	/*
+	 * Priority
+	 *
+	 * Scheduling priorities that can be requested with SetPriority.
+	 */
+	enum Priority
+	{
+		PRIORITY_NORMAL,
+		PRIORITY_HIGH,
+		PRIORITY_REALTIME
+	};
+
 	/*
 	 * Sleep
 	 *
@@ -99,6 +115,22 @@ public:
 	 */
 	static const char *GetLastError();
 
+	/*
+	 * SetAffinity
+	 *
+	 * Restricts the calling thread to the given logical CPUs (numbered from zero).  On macOS, threads cannot be pinned
+	 * and the first CPU is instead used as an affinity tag, which keeps threads with the same tag on a shared cache and
+	 * threads with different tags apart.  Returns false if not supported or the CPUs are invalid.
+	 */
+	static bool SetAffinity(const std::vector<unsigned> &cpus);
+
+	/*
+	 * SetPriority
+	 *
+	 * Sets the scheduling priority of the calling thread.  Raising the priority may need elevated privileges.
+	 */
+	static bool SetPriority(Priority priority);
+
 	/*
 	 * Thread destructor.
 	 */
@@ -237,4 +269,119 @@ public:
 	bool Unlock();
 };
 
+/*
+ * CFrameBarrier
+ *
+ * Lightweight barrier used to hand a frame back from worker threads to a
+ * single waiting thread.  The waiter arms the barrier with the number of
+ * workers before releasing them and each worker arrives once when it is done.
+ * Arriving is a single atomic decrement; the waiter spins briefly on the count
+ * and only then parks.  Work may also be added while earlier work is still
+ * outstanding, and the waiter may choose to leave some of it pending, which
+ * lets a worker run a bounded number of frames behind.  Implemented entirely
+ * in this header so that it is available to every OSD backend.
+ */
+class CFrameBarrier
+{
+private:
+	static const unsigned SPIN_COUNT = 4096;
+
+	std::atomic<unsigned> m_pending;
+	std::atomic<unsigned> m_allowed;
+#ifndef __cpp_lib_atomic_wait
+	std::atomic<bool> m_parked;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+#endif
+
+public:
+	CFrameBarrier()
+	  : m_pending(0)
+	  , m_allowed(0)
+#ifndef __cpp_lib_atomic_wait
+	  , m_parked(false)
+#endif
+	{
+	}
+
+	/*
+	 * Arm
+	 *
+	 * Sets the number of arrivals to wait for.  Must be called before the workers are released.
+	 */
+	void Arm(unsigned count)
+	{
+		m_pending.store(count, std::memory_order_release);
+	}
+
+	/*
+	 * Add
+	 *
+	 * Adds to the number of arrivals outstanding.  Unlike Arm, arrivals still owed from earlier work are kept.
+	 */
+	void Add(unsigned count)
+	{
+		m_pending.fetch_add(count, std::memory_order_release);
+	}
+
+	/*
+	 * Pending
+	 *
+	 * Number of arrivals still outstanding, for a waiter that would rather not wait behind a worker.
+	 */
+	unsigned Pending() const
+	{
+		return m_pending.load(std::memory_order_acquire);
+	}
+
+	/*
+	 * Arrive
+	 *
+	 * Signals that the calling worker has finished.  Wakes the waiter if it has parked and no more arrivals are
+	 * outstanding than it allowed for.
+	 */
+	void Arrive()
+	{
+		if (m_pending.fetch_sub(1) - 1 > m_allowed.load())
+			return;
+#ifdef __cpp_lib_atomic_wait
+		m_pending.notify_one();
+#else
+		if (m_parked.load())
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_cond.notify_one();
+		}
+#endif
+	}
+
+	/*
+	 * Wait
+	 *
+	 * Waits until no more than the given number of arrivals are outstanding (by default, until all workers have
+	 * arrived).  Returns true if the calling thread had to park, false if spinning was enough.
+	 */
+	bool Wait(unsigned allowed = 0)
+	{
+		m_allowed.store(allowed);
+		for (unsigned i = 0; i < SPIN_COUNT; i++)
+		{
+			if (m_pending.load(std::memory_order_acquire) <= allowed)
+				return false;
+		}
+#ifdef __cpp_lib_atomic_wait
+		unsigned pending;
+		while ((pending = m_pending.load()) > allowed)
+			m_pending.wait(pending);
+#else
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_parked.store(true);
+		while (m_pending.load() > allowed)
+			m_cond.wait(lock);
+		m_parked.store(false, std::memory_order_relaxed);
+#endif
+		return true;
+	}
+};
+
 #endif	// INCLUDED_THREADS_H
@@ -44,4 +44,12 @@ extern bool BeginFrameVideo();
  */
 extern void EndFrameVideo();
 
+/*
+ * SetVideoDiscard(discard)
+ *
+ * While set, frames are neither rendered nor shown, as when frames are run
+ * again unseen for netplay or run-ahead.
+ */
+extern void SetVideoDiscard(bool discard);
+
 #endif	// INCLUDED_VIDEO_H
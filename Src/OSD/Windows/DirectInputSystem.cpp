@@ -27,6 +27,7 @@
  */
 
 #include "DirectInputSystem.h"
+#include "OSD/Thread.h"
 #include "Util/Format.h"
 #include "Supermodel.h"
 
@@ -35,6 +36,7 @@
 
 #include <wbemidl.h>
 #include <oleauto.h>
+#include <dbt.h>
 
 #include <SDL.h>
 #include <SDL_syswm.h>
@@ -47,6 +49,9 @@
 static std::array<const char *, 3> s_xinput_dlls = { TEXT("xinput1_4.dll"), TEXT("xinput1_3.dll"), TEXT("xinput9_1_0.dll") };
 static std::array<const char *, 3> s_xinput_dlls_a = { "xinput1_4.dll", "xinput1_3.dll", "xinput9_1_0.dll" };
 
+// Interval at which the joystick polling thread reads the joysticks, well within a frame and no slower than most USB devices report
+static const DWORD s_joyPollInterval = 1;	// ms
+
 // TODO - need to double check these all correct and see if can fill in any missing codes (although most just don't exist)
 DIKeyMapStruct CDirectInputSystem::s_keyMap[] = 
 {
@@ -434,7 +439,8 @@ CDirectInputSystem::CDirectInputSystem(const Util::Config::Node &config, SDL_Win
 	m_useRawInput(useRawInput), m_useXInput(useXInput), m_enableFFeedback(true),
 	m_initializedCOM(false), m_activated(false), m_window(window), m_hwnd(NULL), m_screenW(0), m_screenH(0), 
 	m_getRIDevListPtr(NULL), m_getRIDevInfoPtr(NULL), m_regRIDevsPtr(NULL), m_getRIDataPtr(NULL),
-	m_xiGetCapabilitiesPtr(NULL), m_xiGetStatePtr(NULL), m_xiSetStatePtr(NULL), m_di8(NULL), m_di8Keyboard(NULL), m_di8Mouse(NULL)
+	m_xiGetCapabilitiesPtr(NULL), m_xiGetStatePtr(NULL), m_xiSetStatePtr(NULL), m_di8(NULL), m_di8Keyboard(NULL), m_di8Mouse(NULL),
+	m_joyStopEvent(NULL), m_joyLatest(1), m_joyBack(2), m_joyFront(0), m_xiProbe(false)
 {
 	// Reset initial states
 	memset(&m_combRawMseState, 0, sizeof(m_combRawMseState));
@@ -444,6 +450,8 @@ CDirectInputSystem::CDirectInputSystem(const Util::Config::Node &config, SDL_Win
 
 CDirectInputSystem::~CDirectInputSystem()
 {
+	StopForceFeedback();
+	StopJoystickThread();
 	CloseKeyboardsAndMice();
 	CloseJoysticks();
 
@@ -658,7 +666,7 @@ void CDirectInputSystem::OpenKeyboardsAndMice()
 					}
 				}
 
-				DebugLog("RawInput - found %d keyboards and %d mice", m_rawKeyboards.size(), m_rawMice.size());
+				DEBUG_LOG(Input, "RawInput - found %d keyboards and %d mice", m_rawKeyboards.size(), m_rawMice.size());
 
 				// Check some devices were actually found
 				m_useRawInput = m_rawKeyboards.size() > 0 && m_rawMice.size() > 0;
@@ -1287,10 +1295,18 @@ void CDirectInputSystem::OpenJoysticks()
 		m_joyDetails.push_back(joyDetails);
 		m_diJoyStates.push_back(joyState);
 	}
+
+	// Set up polling thread's state tables and assume all XInput controllers are connected to begin with
+	for (int i = 0; i < 3; i++)
+		m_joyTables[i] = m_diJoyStates;
+	m_xiConnected.assign(m_diJoyInfos.size(), true);
+	m_diPolled.assign(m_diJoyInfos.size(), false);
 }
 
 void CDirectInputSystem::ActivateJoysticks()
 {
+	std::lock_guard<std::mutex> lock(m_joyMutex);
+
 	// Set DirectInput cooperative level of joysticks
 	unsigned joyNum = 0;
 	for (std::vector<DIJoyInfo>::iterator it = m_diJoyInfos.begin(); it != m_diJoyInfos.end(); it++)
@@ -1309,23 +1325,52 @@ void CDirectInputSystem::ActivateJoysticks()
 	}
 }
 
-void CDirectInputSystem::PollJoysticks()
+void CDirectInputSystem::PollJoysticks(std::vector<DIJOYSTATE2> &joyStates)
 {
-	// Get current joystick states from XInput and DirectInput
+	// If devices have changed, probe all XInput controllers again
+	if (m_xiProbe.exchange(false))
+		m_xiConnected.assign(m_diJoyInfos.size(), true);
+
+	// Poll all DirectInput joysticks first, so that their states can then be fetched together, re-acquiring any that have been lost
+	HRESULT hr;
 	int i = 0;
-	for (std::vector<DIJoyInfo>::iterator it = m_diJoyInfos.begin(); it != m_diJoyInfos.end(); it++)
+	for (std::vector<DIJoyInfo>::iterator it = m_diJoyInfos.begin(); it != m_diJoyInfos.end(); it++, i++)
+	{
+		m_diPolled[i] = false;
+		if (it->isXInput)
+			continue;
+		LPDIRECTINPUTDEVICE8 joystick = m_di8Joysticks[it->dInputNum];
+		if (FAILED(hr = joystick->Poll()))
+		{
+			hr = joystick->Acquire();
+			while (hr == DIERR_INPUTLOST)
+				hr = joystick->Acquire();
+
+			if (hr == DIERR_OTHERAPPHASPRIO || hr == DIERR_INVALIDPARAM || hr == DIERR_NOTINITIALIZED)
+				continue;
+		}
+		m_diPolled[i] = true;
+	}
+
+	// Get current joystick states from XInput and DirectInput
+	i = 0;
+	for (std::vector<DIJoyInfo>::iterator it = m_diJoyInfos.begin(); it != m_diJoyInfos.end(); it++, i++)
 	{
-		LPDIJOYSTATE2 pJoyState = &m_diJoyStates[i++];
+		LPDIJOYSTATE2 pJoyState = &joyStates[i];
 
-		HRESULT hr;
 		if (it->isXInput)
 		{
-			// Use XInput to query joystick
+			// Use XInput to query joystick, unless it has been found unplugged
 			XINPUT_STATE xState;
 			memset(&xState, 0, sizeof(xState));
-			if (FAILED(hr = m_xiGetStatePtr(it->xInputNum, &xState)))
+			if (!m_xiConnected[i] || m_xiGetStatePtr(it->xInputNum, &xState) != ERROR_SUCCESS)
 			{
+				if (m_xiConnected[i])
+					DebugLog("XInput controller %d unplugged\n", it->xInputNum + 1);
+				m_xiConnected[i] = false;
 				memset(pJoyState, 0, sizeof(DIJOYSTATE2));
+				for (int povNum = 0; povNum < 4; povNum++)
+					pJoyState->rgdwPOV[povNum] = -1;
 				continue;
 			}
 
@@ -1368,27 +1413,107 @@ void CDirectInputSystem::PollJoysticks()
 			pJoyState->rgbButtons[8] = !!(buttons & XINPUT_GAMEPAD_LEFT_THUMB);
 			pJoyState->rgbButtons[9] = !!(buttons & XINPUT_GAMEPAD_RIGHT_THUMB);
 		}
-		else
+		else if (m_diPolled[i])
 		{
-			// Use DirectInput to query joystick
-			LPDIRECTINPUTDEVICE8 joystick = m_di8Joysticks[it->dInputNum];
-			if (FAILED(hr = joystick->Poll()))
-			{
-				hr = joystick->Acquire();
-				while (hr == DIERR_INPUTLOST)
-					hr = joystick->Acquire();
-
-				if (hr == DIERR_OTHERAPPHASPRIO || hr == DIERR_INVALIDPARAM || hr == DIERR_NOTINITIALIZED)
-				{
-					memset(pJoyState, 0, sizeof(DIJOYSTATE2));
-					continue;
-				}
-			}
-		
 			// Update joystick's DirectInput state
-			joystick->GetDeviceState(sizeof(DIJOYSTATE2), pJoyState);
+			m_di8Joysticks[it->dInputNum]->GetDeviceState(sizeof(DIJOYSTATE2), pJoyState);
+		}
+		else
+			memset(pJoyState, 0, sizeof(DIJOYSTATE2));
+	}
+}
+
+void CDirectInputSystem::StartJoystickThread()
+{
+	if (m_diJoyInfos.empty() || m_joyThread.joinable())
+		return;
+	m_joyStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (m_joyStopEvent == NULL)
+	{
+		ErrorLog("Unable to create joystick polling thread (error %d) - joysticks will be unavailable.\n", GetLastError());
+		return;
+	}
+	m_joyThread = std::thread(&CDirectInputSystem::RunJoystickThread, this);
+}
+
+void CDirectInputSystem::StopJoystickThread()
+{
+	if (m_joyThread.joinable())
+	{
+		SetEvent(m_joyStopEvent);
+		m_joyThread.join();
+	}
+	if (m_joyStopEvent != NULL)
+	{
+		CloseHandle(m_joyStopEvent);
+		m_joyStopEvent = NULL;
+	}
+}
+
+/*
+ * Joystick polling thread.  Reads all the joysticks every interval into the back state table and publishes it to Poll().  A
+ * message-only window registered for device notifications tells it when devices arrive, which is the only time unplugged
+ * XInput controllers are probed again.
+ */
+void CDirectInputSystem::RunJoystickThread()
+{
+	if (!CThread::SetPriority(CThread::PRIORITY_HIGH))
+		DebugLog("Unable to raise the priority of the joystick polling thread: %s\n", CThread::GetLastError());
+
+	WNDCLASSA wndClass;
+	memset(&wndClass, 0, sizeof(wndClass));
+	wndClass.lpfnWndProc = JoystickThreadWndProc;
+	wndClass.hInstance = GetModuleHandle(NULL);
+	wndClass.lpszClassName = "SupermodelJoystickThread";
+	RegisterClassA(&wndClass);
+	HWND hwnd = CreateWindowA(wndClass.lpszClassName, NULL, 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, wndClass.hInstance, NULL);
+	HDEVNOTIFY devNotify = NULL;
+	if (hwnd != NULL)
+	{
+		SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)this);
+		DEV_BROADCAST_DEVICEINTERFACE_A filter;
+		memset(&filter, 0, sizeof(filter));
+		filter.dbcc_size = sizeof(filter);
+		filter.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+		devNotify = RegisterDeviceNotificationA(hwnd, &filter, DEVICE_NOTIFY_WINDOW_HANDLE | DEVICE_NOTIFY_ALL_INTERFACE_CLASSES);
+	}
+	if (devNotify == NULL)
+		ErrorLog("Unable to register for device notifications (error %d) - unplugged XInput controllers will not be found again.\n", GetLastError());
+
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_joyMutex);
+			PollJoysticks(m_joyTables[m_joyBack]);
 		}
+		m_joyBack = m_joyLatest.exchange(m_joyBack | JoyTableFresh, std::memory_order_acq_rel) & ~JoyTableFresh;
+
+		// Wait for next poll, handling any device notifications in the meantime
+		if (MsgWaitForMultipleObjects(1, &m_joyStopEvent, FALSE, s_joyPollInterval, QS_ALLINPUT) == WAIT_OBJECT_0)
+			break;
+		MSG msg;
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+			DispatchMessage(&msg);
 	}
+
+	if (devNotify != NULL)
+		UnregisterDeviceNotification(devNotify);
+	if (hwnd != NULL)
+		DestroyWindow(hwnd);
+	UnregisterClassA(wndClass.lpszClassName, wndClass.hInstance);
+}
+
+LRESULT CALLBACK CDirectInputSystem::JoystickThreadWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+	// A device has arrived, so XInput controllers must be probed again (removals are found by XInput itself)
+	if (msg == WM_DEVICECHANGE && (wParam == DBT_DEVICEARRIVAL || wParam == DBT_DEVNODES_CHANGED))
+	{
+		CDirectInputSystem *self = (CDirectInputSystem*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+		if (self != NULL)
+			self->m_xiProbe = true;
+		return TRUE;
+	}
+	return DefWindowProc(hwnd, msg, wParam, lParam);
 }
 
 void CDirectInputSystem::CloseJoysticks()
@@ -1771,6 +1896,7 @@ bool CDirectInputSystem::IsJoyButPressed(int joyNum, int butNum)
 
 bool CDirectInputSystem::ProcessForceFeedbackCmd(int joyNum, int axisNum, ForceFeedbackCmd ffCmd)
 {
+	std::lock_guard<std::mutex> lock(m_joyMutex);
 	DIJoyInfo *pInfo = &m_diJoyInfos[joyNum];
 
 	HRESULT hr;
@@ -2066,9 +2192,10 @@ bool CDirectInputSystem::Poll()
 		// Removed - see below
 		//SDL_EventState(SDL_SYSWMEVENT, SDL_ENABLE);
 
-		// Activate the devices now that a Window handle is available
+		// Activate the devices now that a Window handle is available and start polling joysticks
 		ActivateKeyboardsAndMice();
 		ActivateJoysticks();
+		StartJoystickThread();
 
 		m_activated = true;
 	}
@@ -2121,9 +2248,15 @@ bool CDirectInputSystem::Poll()
 			return false;	
 	}
 
-	// Poll keyboards, mice and joysticks
+	// Poll keyboards and mice
 	PollKeyboardsAndMice();
-	PollJoysticks();
+
+	// Take the latest joystick states from the polling thread, if it has published any since the last poll
+	if (m_joyLatest.load(std::memory_order_relaxed) & JoyTableFresh)
+	{
+		m_joyFront = m_joyLatest.exchange(m_joyFront, std::memory_order_acq_rel) & ~JoyTableFresh;
+		m_diJoyStates = m_joyTables[m_joyFront];
+	}
 
 	return true;
 }
@@ -41,6 +41,9 @@
 #include <xinput.h>
 #include <functional>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #define NUM_DI_KEYS (sizeof(s_keyMap) / sizeof(DIKeyMapStruct))
@@ -166,6 +169,28 @@ private:
 	std::vector<DIJoyInfo> m_diJoyInfos;
 	std::vector<DIJOYSTATE2> m_diJoyStates;
 
+	// Joystick polling thread, woken by its stop event to exit.  It holds the mutex while it polls, so that the devices can be
+	// re-activated safely from the main thread.
+	std::thread m_joyThread;
+	HANDLE m_joyStopEvent;
+	std::mutex m_joyMutex;
+
+	// Joystick state table published by the polling thread, triple buffered without locks: the thread fills the back table, then
+	// swaps it for the latest one, and Poll() swaps its front table for the latest one if that has been refilled since
+	static const unsigned JoyTableFresh = 4;
+	std::vector<DIJOYSTATE2> m_joyTables[3];
+	std::atomic<unsigned> m_joyLatest;	// index of latest table, plus JoyTableFresh if Poll() has not taken it yet
+	unsigned m_joyBack;					// polling thread only
+	unsigned m_joyFront;				// Poll() only
+
+	// XInput controllers found unplugged are only probed again when the polling thread is told that devices have changed, as
+	// XInputGetState can block for milliseconds on an empty slot
+	std::atomic<bool> m_xiProbe;
+	std::vector<bool> m_xiConnected;	// polling thread only
+
+	// DirectInput joysticks polled successfully this time round (polling thread only)
+	std::vector<bool> m_diPolled;
+
 	bool GetRegString(HKEY regKey, const char *regPath, std::string &str);
 
 	bool GetRegDeviceName(const char *rawDevName, char *name);
@@ -186,7 +211,15 @@ private:
 
 	void ActivateJoysticks();
 
-	void PollJoysticks();
+	void PollJoysticks(std::vector<DIJOYSTATE2> &joyStates);
+
+	void StartJoystickThread();
+
+	void StopJoystickThread();
+
+	void RunJoystickThread();
+
+	static LRESULT CALLBACK JoystickThreadWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 	void CloseJoysticks();
 
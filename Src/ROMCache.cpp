@@ -0,0 +1,309 @@
+#include "ROMCache.h"
+#include "OSD/Logger.h"
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>  // CreateFileMapping(), MapViewOfFile()
+#else
+#include <sys/mman.h> // mmap()
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+ * The file begins with a header, in host byte order:
+ *
+ *    magic         "SMROMC01"
+ *    num_sources   uint32
+ *      path        string (uint32 length followed by characters)
+ *      size        uint64
+ *      mtime       int64
+ *    game_name     string
+ *    num_regions   uint32
+ *      name        string
+ *      offset      uint64
+ *      size        uint64
+ *
+ * Region data follows, each region starting on a page (4 KB) boundary.
+ */
+
+static const char MAGIC[8] = { 'S', 'M', 'R', 'O', 'M', 'C', '0', '1' };
+static const uint64_t REGION_ALIGNMENT = 0x1000;
+
+namespace
+{
+  struct Source
+  {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+  };
+
+  // Read-only view of a whole file, unmapped when the last ROM using it goes
+  class MappedFile
+  {
+  public:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+    static std::shared_ptr<MappedFile> Open(const std::string &file_path)
+    {
+      std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+      HANDLE handle = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (handle == INVALID_HANDLE_VALUE)
+        return nullptr;
+      LARGE_INTEGER size;
+      if (GetFileSizeEx(handle, &size) && size.QuadPart > 0)
+      {
+        file->m_mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (file->m_mapping)
+        {
+          file->data = (const uint8_t *) MapViewOfFile(file->m_mapping, FILE_MAP_READ, 0, 0, 0);
+          file->size = size_t(size.QuadPart);
+        }
+      }
+      CloseHandle(handle);
+#else
+      int fd = open(file_path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return nullptr;
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size > 0)
+      {
+        void *p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+          file->data = (const uint8_t *) p;
+          file->size = size_t(st.st_size);
+        }
+      }
+      close(fd);  // the mapping stays valid
+#endif
+      return file->data ? file : nullptr;
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+      if (data)
+        UnmapViewOfFile(data);
+      if (m_mapping)
+        CloseHandle(m_mapping);
+#else
+      if (data)
+        munmap((void *) data, size);
+#endif
+    }
+
+  private:
+#ifdef _WIN32
+    HANDLE m_mapping = NULL;
+#endif
+  };
+
+  // Bounds-checked reads from the header
+  struct Reader
+  {
+    const uint8_t *pos;
+    const uint8_t *end;
+    bool error = false;
+
+    template <typename T>
+    T Get()
+    {
+      T value = T();
+      if (size_t(end - pos) < sizeof(T))
+        error = true;
+      else
+      {
+        memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+      }
+      return value;
+    }
+
+    std::string GetString()
+    {
+      uint32_t length = Get<uint32_t>();
+      if (error || size_t(end - pos) < length)
+      {
+        error = true;
+        return std::string();
+      }
+      std::string s((const char *) pos, length);
+      pos += length;
+      return s;
+    }
+  };
+
+  template <typename T>
+  void Put(std::vector<uint8_t> *header, T value)
+  {
+    const uint8_t *p = (const uint8_t *) &value;
+    header->insert(header->end(), p, p + sizeof(T));
+  }
+
+  void PutString(std::vector<uint8_t> *header, const std::string &s)
+  {
+    Put<uint32_t>(header, uint32_t(s.length()));
+    header->insert(header->end(), s.begin(), s.end());
+  }
+}
+
+static bool StatSource(Source *source)
+{
+  struct stat st;
+  if (stat(source->path.c_str(), &st) != 0)
+    return true;
+  source->size = uint64_t(st.st_size);
+  source->mtime = int64_t(st.st_mtime);
+  return false;
+}
+
+bool ROMCache::Load(std::string *game_name, ROMSet *rom_set, const std::string &cache_file, const std::vector<std::string> &required_sources)
+{
+  std::shared_ptr<MappedFile> file = MappedFile::Open(cache_file);
+  if (!file)
+    return true;
+
+  Reader header = { file->data, file->data + file->size };
+  if (file->size < sizeof(MAGIC) || memcmp(file->data, MAGIC, sizeof(MAGIC)))
+  {
+    ErrorLog("'%s' is not a ROM cache file.", cache_file.c_str());
+    return true;
+  }
+  header.pos += sizeof(MAGIC);
+
+  // Every file it was made from must be unchanged, and it must have been made
+  // from those the caller is loading now
+  std::vector<std::string> missing(required_sources);
+  uint32_t num_sources = header.Get<uint32_t>();
+  for (uint32_t i = 0; i < num_sources && !header.error; i++)
+  {
+    Source cached;
+    cached.path = header.GetString();
+    cached.size = header.Get<uint64_t>();
+    cached.mtime = header.Get<int64_t>();
+    Source current;
+    current.path = cached.path;
+    if (header.error)
+      break;
+    if (StatSource(&current) || current.size != cached.size || current.mtime != cached.mtime)
+    {
+      InfoLog("ROM cache '%s' is out of date ('%s' has changed).", cache_file.c_str(), cached.path.c_str());
+      return true;
+    }
+    for (auto it = missing.begin(); it != missing.end(); ++it)
+    {
+      if (*it == cached.path)
+      {
+        missing.erase(it);
+        break;
+      }
+    }
+  }
+  if (!header.error && !missing.empty())
+  {
+    InfoLog("ROM cache '%s' was made from other files than '%s'.", cache_file.c_str(), missing.front().c_str());
+    return true;
+  }
+
+  std::string name = header.GetString();
+  std::map<std::string, ROM> rom_by_region;
+  uint32_t num_regions = header.Get<uint32_t>();
+  for (uint32_t i = 0; i < num_regions && !header.error; i++)
+  {
+    std::string region_name = header.GetString();
+    uint64_t offset = header.Get<uint64_t>();
+    uint64_t size = header.Get<uint64_t>();
+    if (header.error || offset > file->size || size > file->size - offset)
+    {
+      header.error = true;
+      break;
+    }
+
+    // Each region shares ownership of the mapping
+    ROM &rom = rom_by_region[region_name];
+    rom.data = std::shared_ptr<uint8_t>(file, (uint8_t *) file->data + offset);
+    rom.size = size_t(size);
+    rom.file = cache_file;
+    rom.file_offset = offset;
+  }
+  if (header.error)
+  {
+    InfoLog("ROM cache '%s' is corrupt.", cache_file.c_str());
+    return true;
+  }
+
+  *game_name = name;
+  rom_set->rom_by_region = std::move(rom_by_region);
+  return false;
+}
+
+bool ROMCache::Save(const std::string &cache_file, const std::vector<std::string> &sources, const std::string &game_name, const ROMSet &rom_set)
+{
+  std::vector<uint8_t> header(MAGIC, MAGIC + sizeof(MAGIC));
+  Put<uint32_t>(&header, uint32_t(sources.size()));
+  for (auto &path: sources)
+  {
+    Source source;
+    source.path = path;
+    if (StatSource(&source))
+    {
+      ErrorLog("Unable to cache ROMs because '%s' could not be found.", path.c_str());
+      return true;
+    }
+    PutString(&header, source.path);
+    Put<uint64_t>(&header, source.size);
+    Put<int64_t>(&header, source.mtime);
+  }
+  PutString(&header, game_name);
+
+  // Lay the regions out a page apart, after the header
+  size_t regions_size = 0;
+  for (auto &v: rom_set.rom_by_region)
+    regions_size += sizeof(uint32_t) + v.first.length() + 2 * sizeof(uint64_t);
+  uint64_t offset = (header.size() + sizeof(uint32_t) + regions_size + REGION_ALIGNMENT - 1) & ~(REGION_ALIGNMENT - 1);
+  Put<uint32_t>(&header, uint32_t(rom_set.rom_by_region.size()));
+  for (auto &v: rom_set.rom_by_region)
+  {
+    PutString(&header, v.first);
+    Put<uint64_t>(&header, offset);
+    Put<uint64_t>(&header, v.second.size);
+    offset = (offset + v.second.size + REGION_ALIGNMENT - 1) & ~(REGION_ALIGNMENT - 1);
+  }
+
+  // Written under another name first, so a cache is never seen half written
+  std::string temp_file = cache_file + ".tmp";
+  FILE *fp = fopen(temp_file.c_str(), "wb");
+  if (!fp)
+  {
+    ErrorLog("Unable to write ROM cache '%s'. Does its directory exist?", cache_file.c_str());
+    return true;
+  }
+  static const uint8_t padding[REGION_ALIGNMENT] = {};
+  bool error = fwrite(header.data(), header.size(), 1, fp) != 1;
+  uint64_t written = header.size();
+  for (auto &v: rom_set.rom_by_region)
+  {
+    size_t pad = size_t((REGION_ALIGNMENT - written % REGION_ALIGNMENT) % REGION_ALIGNMENT);
+    error |= pad && fwrite(padding, pad, 1, fp) != 1;
+    error |= v.second.size && fwrite(v.second.data.get(), v.second.size, 1, fp) != 1;
+    written += pad + v.second.size;
+  }
+  error |= fclose(fp) != 0;
+
+  remove(cache_file.c_str());
+  if (error || rename(temp_file.c_str(), cache_file.c_str()) != 0)
+  {
+    remove(temp_file.c_str());
+    ErrorLog("Unable to write ROM cache '%s'.", cache_file.c_str());
+    return true;
+  }
+  InfoLog("Cached ROMs of '%s' in '%s'.", game_name.c_str(), cache_file.c_str());
+  return false;
+}
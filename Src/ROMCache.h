@@ -0,0 +1,28 @@
+#ifndef INCLUDED_ROMCACHE_H
+#define INCLUDED_ROMCACHE_H
+
+#include "ROMSet.h"
+#include <string>
+#include <vector>
+
+/*
+ * Keeps the ROM regions of a game in a file of their own, exactly as assembled
+ * from the zip archives (interleaved and byte swapped, but unpatched), along
+ * with the size and modification time of every file they came from. Loading
+ * maps the file into memory rather than reading it, so regions are only paged
+ * in as they are copied. A cache is only used while none of the files it was
+ * made from have changed.
+ */
+namespace ROMCache
+{
+  // Loads the game name and regions from the cache file, which must have been
+  // made from (at least) the given source files. Returns true if there is no
+  // usable cache, in which case the ROM set is untouched.
+  bool Load(std::string *game_name, ROMSet *rom_set, const std::string &cache_file, const std::vector<std::string> &required_sources);
+
+  // Writes the cache file for a ROM set loaded from the given source files.
+  // Returns true on failure.
+  bool Save(const std::string &cache_file, const std::vector<std::string> &sources, const std::string &game_name, const ROMSet &rom_set);
+}
+
+#endif  // INCLUDED_ROMCACHE_H
@@ -26,6 +26,8 @@ struct ROM
   std::shared_ptr<uint8_t> data;
   std::vector<BigEndianPatch> patches;
   size_t size = 0;
+  std::string file;         // if read-only data mapped from this file (the ROM cache)
+  uint64_t file_offset = 0; // at this offset
   
   void CopyTo(uint8_t *dest, size_t dest_size, bool apply_patches = true) const;
 };
@@ -0,0 +1,465 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * DSBMix.cpp
+ *
+ * Up-sampling of the DSB's MPEG output and mixing with the SCSP output, 8
+ * samples at a time with SSE2 or NEON. As pFrac + nFrac is always 1.0, the
+ * vector code keeps the position in the input as one 24.8 number, index and
+ * nFrac, and makes 8 positions at once by adding multiples of delta. Linear
+ * interpolation is a multiply-add of adjacent sample pairs by their
+ * fractions, the windowed sinc filter a 16-tap dot product per output. The
+ * volumes are applied with exact 16 by 16 bit (or, on
+ * NEON, 32 by 32 bit) multiplies and the 32-bit sums saturated to 16 bits, as
+ * MixAndClip() did, so every implementation gives the same output.
+ */
+
+#include "DSBMix.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DSBMIX_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define DSBMIX_NEON
+#include <arm_neon.h>
+#endif
+
+
+/******************************************************************************
+ Scalar
+******************************************************************************/
+
+// Steps to the next output sample (less than one input sample, as delta does not exceed 1.0)
+static inline void Step(int &inIdx, int &pFrac, int &nFrac, int delta)
+{
+	pFrac -= delta;
+	nFrac += delta;
+
+	// Time to move to next samples?
+	if (pFrac <= 0)	// when pFrac becomes 0, advance samples, reset pFrac to 1
+	{
+		pFrac += (1<<8);
+		nFrac -= (1<<8);
+		inIdx++;
+	}
+}
+
+// Mixes 16-bit samples (sign extended in a and b)
+static inline int16_t MixAndClip(int32_t a, int32_t b)
+{
+	a += b;
+	if (a > 32767)
+		a = 32767;
+	else if (a < -32768)
+		a = -32768;
+	return (int16_t) a;
+}
+
+// Applies the volume settings to a music and an SCSP sample and mixes them
+static inline int16_t MixSample(int16_t sound, int32_t music, int32_t musicVolume, int32_t soundVolume)
+{
+	return MixAndClip((sound * soundVolume) >> 8, (int32_t) (((int64_t) music * musicVolume) >> 16));
+}
+
+static inline int32_t LinearSample(const int16_t *in, int idx, int pFrac, int nFrac)
+{
+	// nFrac, pFrac will never exceed 1.0 (0x100) (only true if delta does not exceed 1)
+	return ((int)in[idx]*pFrac + (int)in[idx+1]*nFrac) >> 8;
+}
+
+// Kaiser windowed sinc, cutting off at 0.45 of the input rate, one set of taps
+// for each 8-bit fraction, each set summing to 1.0 (1.14 fixed point)
+static const int16_t *SincTaps()
+{
+	static int16_t taps[256][DSBMIX_SINC_TAPS];
+	static bool init = [] {
+		const double pi = 3.14159265358979323846;
+		const double cutoff = 0.45;
+		const double beta = 7.0;
+		const double halfWidth = DSBMIX_SINC_TAPS / 2;
+
+		auto besselI0 = [](double x) {
+			double sum = 1, term = 1;
+			for (int k = 1; k < 32; k++)
+			{
+				term *= (x / (2 * k)) * (x / (2 * k));
+				sum += term;
+			}
+			return sum;
+		};
+
+		for (int f = 0; f < 256; f++)
+		{
+			double h[DSBMIX_SINC_TAPS], total = 0;
+			for (int t = 0; t < DSBMIX_SINC_TAPS; t++)
+			{
+				// Tap t is input sample t - DSBMIX_SINC_HISTORY from the current one; the output is 7 samples before current + f
+				double x = t - (halfWidth - 1) - f / 256.0;
+				double r = x / halfWidth;
+				double window = r * r < 1 ? besselI0(beta * std::sqrt(1 - r * r)) / besselI0(beta) : 0;
+				h[t] = (x == 0 ? 2 * cutoff : std::sin(2 * pi * cutoff * x) / (pi * x)) * window;
+				total += h[t];
+			}
+
+			// Round to 1.14 fixed point, putting the rounding error on the largest tap so the taps always sum to 1.0
+			int sum = 0, largest = 0;
+			for (int t = 0; t < DSBMIX_SINC_TAPS; t++)
+			{
+				taps[f][t] = (int16_t) std::lround(h[t] / total * (1 << 14));
+				sum += taps[f][t];
+				if (std::abs(taps[f][t]) > std::abs(taps[f][largest]))
+					largest = t;
+			}
+			taps[f][largest] += (int16_t) ((1 << 14) - sum);
+		}
+		return true;
+	}();
+	(void) init;
+	return &taps[0][0];
+}
+
+// Filtered sample at 7 samples before idx + the fraction whose taps are given, clipped to 16 bits
+static inline int32_t SincSample(const int16_t *in, int idx, const int16_t *taps)
+{
+	int32_t sum = 0;
+	for (int t = 0; t < DSBMIX_SINC_TAPS; t++)
+		sum += in[idx + t] * taps[t];
+	sum >>= 14;
+	return sum > 32767 ? 32767 : (sum < -32768 ? -32768 : sum);
+}
+
+
+/******************************************************************************
+ SSE2 and NEON
+******************************************************************************/
+
+// The vector code multiplies the sound volume and the halves of the music volume as 16-bit numbers
+static inline bool VolumesInRange(int32_t musicVolume, int32_t soundVolume)
+{
+	return musicVolume >= 0 && soundVolume >= 0 && soundVolume <= 0x7FFF;
+}
+
+#if defined(DSBMIX_SSE2)
+
+struct Volumes
+{
+	__m128i	musicHi, musicLo, sound;
+
+	Volumes(int32_t musicVolume, int32_t soundVolume)
+	  : musicHi(_mm_set1_epi16((int16_t) (musicVolume >> 16))),
+	    musicLo(_mm_set1_epi16((int16_t) (musicVolume & 0xFFFF))),
+	    sound(_mm_set1_epi16((int16_t) soundVolume))
+	{
+	}
+};
+
+// Mixes 8 music samples into 8 SCSP samples
+static inline __m128i Mix8(__m128i sound, __m128i music, const Volumes &vol)
+{
+	// music * musicVolume >> 16 = music * hi + (music * lo >> 16), an unsigned high multiply corrected for negative samples
+	__m128i frac = _mm_sub_epi16(_mm_mulhi_epu16(music, vol.musicLo), _mm_and_si128(vol.musicLo, _mm_srai_epi16(music, 15)));
+	__m128i fracSign = _mm_srai_epi16(frac, 15);
+	__m128i wholeLo = _mm_mullo_epi16(music, vol.musicHi);
+	__m128i wholeHi = _mm_mulhi_epi16(music, vol.musicHi);
+	__m128i music0 = _mm_add_epi32(_mm_unpacklo_epi16(wholeLo, wholeHi), _mm_unpacklo_epi16(frac, fracSign));
+	__m128i music1 = _mm_add_epi32(_mm_unpackhi_epi16(wholeLo, wholeHi), _mm_unpackhi_epi16(frac, fracSign));
+
+	// sound * soundVolume >> 8
+	__m128i soundLo = _mm_mullo_epi16(sound, vol.sound);
+	__m128i soundHi = _mm_mulhi_epi16(sound, vol.sound);
+	__m128i sound0 = _mm_srai_epi32(_mm_unpacklo_epi16(soundLo, soundHi), 8);
+	__m128i sound1 = _mm_srai_epi32(_mm_unpackhi_epi16(soundLo, soundHi), 8);
+
+	return _mm_packs_epi32(_mm_add_epi32(sound0, music0), _mm_add_epi32(sound1, music1));
+}
+
+// Input indices of the next 8 output samples and their nFrac
+static inline void Positions8(int pos, int delta, __m128i &idx0, __m128i &idx1, __m128i &n0, __m128i &n1)
+{
+	__m128i pos0 = _mm_add_epi32(_mm_set1_epi32(pos), _mm_setr_epi32(0, delta, delta * 2, delta * 3));
+	__m128i pos1 = _mm_add_epi32(pos0, _mm_set1_epi32(delta * 4));
+	__m128i mask = _mm_set1_epi32(0xFF);
+	idx0 = _mm_srai_epi32(pos0, 8);
+	idx1 = _mm_srai_epi32(pos1, 8);
+	n0 = _mm_and_si128(pos0, mask);
+	n1 = _mm_and_si128(pos1, mask);
+}
+
+static inline __m128i LoadPair(const int16_t *in)
+{
+	int32_t pair;
+	memcpy(&pair, in, sizeof(pair));
+	return _mm_cvtsi32_si128(pair);
+}
+
+// Input sample pairs at positions idx[0..3], and their linear interpolation by the weights
+static inline __m128i Linear4(const int16_t *in, const int *idx, __m128i weights)
+{
+	__m128i pairs01 = _mm_unpacklo_epi32(LoadPair(&in[idx[0]]), LoadPair(&in[idx[1]]));
+	__m128i pairs23 = _mm_unpacklo_epi32(LoadPair(&in[idx[2]]), LoadPair(&in[idx[3]]));
+	return _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi64(pairs01, pairs23), weights), 8);
+}
+
+static int LinearVector(int16_t *outL, int16_t *outR, const int16_t *inL, const int16_t *inR, int count, int delta, int &pos, int32_t musicVolume, int32_t soundVolume)
+{
+	Volumes vol(musicVolume, soundVolume);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8, pos += delta * 8)
+	{
+		__m128i idx0, idx1, n0, n1;
+		Positions8(pos, delta, idx0, idx1, n0, n1);
+		int idx[8];
+		_mm_storeu_si128((__m128i *) &idx[0], idx0);
+		_mm_storeu_si128((__m128i *) &idx[4], idx1);
+
+		// Weights are pairs of pFrac and nFrac
+		__m128i n = _mm_packs_epi32(n0, n1);
+		__m128i p = _mm_sub_epi16(_mm_set1_epi16(1 << 8), n);
+		__m128i w0 = _mm_unpacklo_epi16(p, n);
+		__m128i w1 = _mm_unpackhi_epi16(p, n);
+		__m128i left = _mm_packs_epi32(Linear4(inL, &idx[0], w0), Linear4(inL, &idx[4], w1));
+		__m128i right = _mm_packs_epi32(Linear4(inR, &idx[0], w0), Linear4(inR, &idx[4], w1));
+		_mm_storeu_si128((__m128i *) &outL[i], Mix8(_mm_loadu_si128((const __m128i *) &outL[i]), left, vol));
+		_mm_storeu_si128((__m128i *) &outR[i], Mix8(_mm_loadu_si128((const __m128i *) &outR[i]), right, vol));
+	}
+
+	return i;
+}
+
+static int SincVector(int16_t *outL, int16_t *outR, const int16_t *inL, const int16_t *inR, int count, int delta, int &pos, int32_t musicVolume, int32_t soundVolume)
+{
+	const int16_t *taps = SincTaps();
+	Volumes vol(musicVolume, soundVolume);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8, pos += delta * 8)
+	{
+		__m128i idx0, idx1, n0, n1;
+		Positions8(pos, delta, idx0, idx1, n0, n1);
+		int idx[8], nFrac[8];
+		_mm_storeu_si128((__m128i *) &idx[0], idx0);
+		_mm_storeu_si128((__m128i *) &idx[4], idx1);
+		_mm_storeu_si128((__m128i *) &nFrac[0], n0);
+		_mm_storeu_si128((__m128i *) &nFrac[4], n1);
+
+		int32_t	sums[2][8];
+		for (int k = 0; k < 8; k++)
+		{
+			const int16_t *l = &inL[idx[k]];
+			const int16_t *r = &inR[idx[k]];
+			const int16_t *c = &taps[nFrac[k] * DSBMIX_SINC_TAPS];
+			__m128i c0 = _mm_loadu_si128((const __m128i *) &c[0]);
+			__m128i c1 = _mm_loadu_si128((const __m128i *) &c[8]);
+			__m128i sumL = _mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *) &l[0]), c0), _mm_madd_epi16(_mm_loadu_si128((const __m128i *) &l[8]), c1));
+			__m128i sumR = _mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *) &r[0]), c0), _mm_madd_epi16(_mm_loadu_si128((const __m128i *) &r[8]), c1));
+
+			// L0+L2 R0+R2 L1+L3 R1+R3, then add the two halves
+			__m128i sum = _mm_add_epi32(_mm_unpacklo_epi32(sumL, sumR), _mm_unpackhi_epi32(sumL, sumR));
+			sum = _mm_add_epi32(sum, _mm_unpackhi_epi64(sum, sum));
+			sums[0][k] = _mm_cvtsi128_si32(sum);
+			sums[1][k] = _mm_cvtsi128_si32(_mm_srli_si128(sum, 4));
+		}
+
+		__m128i left = _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i *) &sums[0][0]), 14), _mm_srai_epi32(_mm_loadu_si128((const __m128i *) &sums[0][4]), 14));
+		__m128i right = _mm_packs_epi32(_mm_srai_epi32(_mm_loadu_si128((const __m128i *) &sums[1][0]), 14), _mm_srai_epi32(_mm_loadu_si128((const __m128i *) &sums[1][4]), 14));
+		_mm_storeu_si128((__m128i *) &outL[i], Mix8(_mm_loadu_si128((const __m128i *) &outL[i]), left, vol));
+		_mm_storeu_si128((__m128i *) &outR[i], Mix8(_mm_loadu_si128((const __m128i *) &outR[i]), right, vol));
+	}
+
+	return i;
+}
+
+#elif defined(DSBMIX_NEON)
+
+// Mixes 8 music samples into 8 SCSP samples
+static inline int16x8_t Mix8(int16x8_t sound, int16x8_t music, int32_t musicVolume, int16_t soundVolume)
+{
+	int32x4_t music0 = vmovl_s16(vget_low_s16(music));
+	int32x4_t music1 = vmovl_s16(vget_high_s16(music));
+	music0 = vcombine_s32(vshrn_n_s64(vmull_n_s32(vget_low_s32(music0), musicVolume), 16), vshrn_n_s64(vmull_n_s32(vget_high_s32(music0), musicVolume), 16));
+	music1 = vcombine_s32(vshrn_n_s64(vmull_n_s32(vget_low_s32(music1), musicVolume), 16), vshrn_n_s64(vmull_n_s32(vget_high_s32(music1), musicVolume), 16));
+	int32x4_t sound0 = vshrq_n_s32(vmull_n_s16(vget_low_s16(sound), soundVolume), 8);
+	int32x4_t sound1 = vshrq_n_s32(vmull_n_s16(vget_high_s16(sound), soundVolume), 8);
+	return vcombine_s16(vqmovn_s32(vaddq_s32(sound0, music0)), vqmovn_s32(vaddq_s32(sound1, music1)));
+}
+
+// Input indices of the next 8 output samples and their nFrac
+static inline void Positions8(int pos, int delta, int32x4_t &idx0, int32x4_t &idx1, int32x4_t &n0, int32x4_t &n1)
+{
+	const int32_t steps[4] = { 0, delta, delta * 2, delta * 3 };
+	int32x4_t pos0 = vaddq_s32(vdupq_n_s32(pos), vld1q_s32(steps));
+	int32x4_t pos1 = vaddq_s32(pos0, vdupq_n_s32(delta * 4));
+	int32x4_t mask = vdupq_n_s32(0xFF);
+	idx0 = vshrq_n_s32(pos0, 8);
+	idx1 = vshrq_n_s32(pos1, 8);
+	n0 = vandq_s32(pos0, mask);
+	n1 = vandq_s32(pos1, mask);
+}
+
+// Input sample pairs at positions idx[0..3], and their linear interpolation by the weights
+static inline int32x4_t Linear4(const int16_t *in, const int *idx, int16x8_t weights)
+{
+	int32_t pairs[4];
+	for (int k = 0; k < 4; k++)
+		memcpy(&pairs[k], &in[idx[k]], sizeof(pairs[k]));
+	int16x8_t samples = vreinterpretq_s16_s32(vld1q_s32(pairs));
+	int32x4_t prod01 = vmull_s16(vget_low_s16(samples), vget_low_s16(weights));
+	int32x4_t prod23 = vmull_s16(vget_high_s16(samples), vget_high_s16(weights));
+	int32x4_t sum = vcombine_s32(vpadd_s32(vget_low_s32(prod01), vget_high_s32(prod01)), vpadd_s32(vget_low_s32(prod23), vget_high_s32(prod23)));
+	return vshrq_n_s32(sum, 8);
+}
+
+static int LinearVector(int16_t *outL, int16_t *outR, const int16_t *inL, const int16_t *inR, int count, int delta, int &pos, int32_t musicVolume, int32_t soundVolume)
+{
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8, pos += delta * 8)
+	{
+		int32x4_t idx0, idx1, n0, n1;
+		Positions8(pos, delta, idx0, idx1, n0, n1);
+		int idx[8];
+		vst1q_s32(&idx[0], idx0);
+		vst1q_s32(&idx[4], idx1);
+
+		// Weights are pairs of pFrac and nFrac
+		int16x8_t n = vcombine_s16(vmovn_s32(n0), vmovn_s32(n1));
+		int16x8x2_t pairs = vzipq_s16(vsubq_s16(vdupq_n_s16(1 << 8), n), n);
+		int16x8_t w0 = pairs.val[0];
+		int16x8_t w1 = pairs.val[1];
+		int16x8_t left = vcombine_s16(vmovn_s32(Linear4(inL, &idx[0], w0)), vmovn_s32(Linear4(inL, &idx[4], w1)));
+		int16x8_t right = vcombine_s16(vmovn_s32(Linear4(inR, &idx[0], w0)), vmovn_s32(Linear4(inR, &idx[4], w1)));
+		vst1q_s16(&outL[i], Mix8(vld1q_s16(&outL[i]), left, musicVolume, (int16_t) soundVolume));
+		vst1q_s16(&outR[i], Mix8(vld1q_s16(&outR[i]), right, musicVolume, (int16_t) soundVolume));
+	}
+
+	return i;
+}
+
+static int SincVector(int16_t *outL, int16_t *outR, const int16_t *inL, const int16_t *inR, int count, int delta, int &pos, int32_t musicVolume, int32_t soundVolume)
+{
+	const int16_t *taps = SincTaps();
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8, pos += delta * 8)
+	{
+		int32x4_t idx0, idx1, n0, n1;
+		Positions8(pos, delta, idx0, idx1, n0, n1);
+		int idx[8], nFrac[8];
+		vst1q_s32(&idx[0], idx0);
+		vst1q_s32(&idx[4], idx1);
+		vst1q_s32(&nFrac[0], n0);
+		vst1q_s32(&nFrac[4], n1);
+
+		int32_t	sums[2][8];
+		for (int k = 0; k < 8; k++)
+		{
+			const int16_t *c = &taps[nFrac[k] * DSBMIX_SINC_TAPS];
+			int16x8_t c0 = vld1q_s16(&c[0]);
+			int16x8_t c1 = vld1q_s16(&c[8]);
+			for (int ch = 0; ch < 2; ch++)
+			{
+				const int16_t *in = ch ? &inR[idx[k]] : &inL[idx[k]];
+				int16x8_t in0 = vld1q_s16(&in[0]);
+				int16x8_t in1 = vld1q_s16(&in[8]);
+				int32x4_t sum = vmull_s16(vget_low_s16(in0), vget_low_s16(c0));
+				sum = vmlal_s16(sum, vget_high_s16(in0), vget_high_s16(c0));
+				sum = vmlal_s16(sum, vget_low_s16(in1), vget_low_s16(c1));
+				sum = vmlal_s16(sum, vget_high_s16(in1), vget_high_s16(c1));
+				int32x2_t half = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+				sums[ch][k] = vget_lane_s32(vpadd_s32(half, half), 0);
+			}
+		}
+
+		// Saturating narrow clips the filtered samples to 16 bits
+		int16x8_t left = vcombine_s16(vqshrn_n_s32(vld1q_s32(&sums[0][0]), 14), vqshrn_n_s32(vld1q_s32(&sums[0][4]), 14));
+		int16x8_t right = vcombine_s16(vqshrn_n_s32(vld1q_s32(&sums[1][0]), 14), vqshrn_n_s32(vld1q_s32(&sums[1][4]), 14));
+		vst1q_s16(&outL[i], Mix8(vld1q_s16(&outL[i]), left, musicVolume, (int16_t) soundVolume));
+		vst1q_s16(&outR[i], Mix8(vld1q_s16(&outR[i]), right, musicVolume, (int16_t) soundVolume));
+	}
+
+	return i;
+}
+
+#endif
+
+
+/******************************************************************************
+ Interface
+******************************************************************************/
+
+int DSBMix_Linear(int16_t *outL, int16_t *outR, const int16_t *inL, const int16_t *inR, int count, int delta, int &pFrac, int &nFrac, int32_t musicVolume, int32_t soundVolume)
+{
+	int inIdx = 0;
+	int i = 0;
+
+#if defined(DSBMIX_SSE2) || defined(DSBMIX_NEON)
+	if (VolumesInRange(musicVolume, soundVolume))
+	{
+		int pos = nFrac;
+		i = LinearVector(outL, outR, inL, inR, count, delta, pos, musicVolume, soundVolume);
+		inIdx = pos >> 8;
+		nFrac = pos & 0xFF;
+		pFrac = (1 << 8) - nFrac;
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		outL[i] = MixSample(outL[i], LinearSample(inL, inIdx, pFrac, nFrac), musicVolume, soundVolume);
+		outR[i] = MixSample(outR[i], LinearSample(inR, inIdx, pFrac, nFrac), musicVolume, soundVolume);
+		Step(inIdx, pFrac, nFrac, delta);
+	}
+
+	return inIdx;
+}
+
+int DSBMix_Sinc(int16_t *outL, int16_t *outR, const int16_t *inL, const int16_t *inR, int count, int delta, int &pFrac, int &nFrac, int32_t musicVolume, int32_t soundVolume)
+{
+	const int16_t *taps = SincTaps();
+	int inIdx = 0;
+	int i = 0;
+
+#if defined(DSBMIX_SSE2) || defined(DSBMIX_NEON)
+	if (VolumesInRange(musicVolume, soundVolume))
+	{
+		int pos = nFrac;
+		i = SincVector(outL, outR, inL, inR, count, delta, pos, musicVolume, soundVolume);
+		inIdx = pos >> 8;
+		nFrac = pos & 0xFF;
+		pFrac = (1 << 8) - nFrac;
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		const int16_t *c = &taps[nFrac * DSBMIX_SINC_TAPS];
+		outL[i] = MixSample(outL[i], SincSample(inL, inIdx, c), musicVolume, soundVolume);
+		outR[i] = MixSample(outR[i], SincSample(inR, inIdx, c), musicVolume, soundVolume);
+		Step(inIdx, pFrac, nFrac, delta);
+	}
+
+	return inIdx;
+}
@@ -0,0 +1,68 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * DSBMix.h
+ *
+ * Header file for resampling the DSB's MPEG output and mixing it with the SCSP
+ * output, with SSE2 or NEON where available. Used only by CDSBResampler; do
+ * not use externally.
+ */
+
+#ifndef INCLUDED_DSBMIX_H
+#define INCLUDED_DSBMIX_H
+
+#include <cstdint>
+
+
+/*
+ * DSBMIX_SINC_TAPS, DSBMIX_SINC_HISTORY:
+ *
+ * Length of the windowed sinc filter, and the number of input samples before
+ * the current one that it reads. The caller keeps these from the previous
+ * frame and places them in front of the input passed to DSBMix_Sinc().
+ */
+static const int DSBMIX_SINC_TAPS = 16;
+static const int DSBMIX_SINC_HISTORY = DSBMIX_SINC_TAPS - 2;
+
+/*
+ * DSBMix_Linear(outL, outR, inL, inR, count, delta, pFrac, nFrac, musicVolume, soundVolume):
+ * DSBMix_Sinc(outL, outR, inL, inR, count, delta, pFrac, nFrac, musicVolume, soundVolume):
+ *
+ * Up-sample count output samples of music from the input, delta (24.8 fixed
+ * point, fin/fout) input samples apart, and mix them into the SCSP output in
+ * outL and outR. pFrac and nFrac are the interpolation state carried between
+ * frames (see DSB.cpp). The music is scaled by musicVolume (16.16 fixed point)
+ * and the SCSP output by soundVolume (24.8 fixed point), and their sums
+ * saturated to 16 bits. Return the index of the first input sample not yet
+ * finished with.
+ *
+ * Linear interpolation is exactly what the DSB always did. The sinc filter
+ * instead uses 16 input samples per output, from DSBMIX_SINC_HISTORY samples
+ * before the current one to 1 after, and so lags linear interpolation by 7
+ * input samples; inL and inR must point at the history in front of the input.
+ * Every implementation of each gives the same output.
+ */
+int DSBMix_Linear(int16_t *outL, int16_t *outR, const int16_t *inL, const int16_t *inR, int count, int delta, int &pFrac, int &nFrac, int32_t musicVolume, int32_t soundVolume);
+int DSBMix_Sinc(int16_t *outL, int16_t *outR, const int16_t *inL, const int16_t *inR, int count, int delta, int &pFrac, int &nFrac, int32_t musicVolume, int32_t soundVolume);
+
+
+#endif	// INCLUDED_DSBMIX_H
@@ -1,26 +1,461 @@
 #define MINIMP3_IMPLEMENTATION
 #include "Pkgs/minimp3.h"
 #include "MpegAudio.h"
+#include "Util/Hash.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Frames are decoded by a worker thread ahead of DecodeAudio(), which only
+// copies samples out. Each decoded frame carries the decoder state and stream
+// position that follow it, so any command that changes the stream (new memory,
+// new loop points, a seek or a stop) just drops the frames decoded ahead and
+// restarts the worker from where playback is. The samples produced are
+// exactly those of decoding synchronously.
+//
+// With the frame cache enabled, every frame decoded is kept too, keyed on its
+// address in ROM, the end of the stream and a hash of the decoder state it was
+// decoded from, which together decide what it decodes to. Frames found there
+// are copied instead of decoded and the state hash moves on to the one stored
+// with them, so music that has been heard once (a loop coming round, a track
+// played again) is not decoded again. The real decoder state falls behind
+// while frames come from the cache, to be rebuilt if a frame is missing by
+// decoding the last few frames from scratch (the state only depends on the
+// frame before and the bit reservoir). When a frame is first cached, the
+// fewest frames that rebuild the state after it are found and checked against
+// the hash, and it is only taken from the cache when playback arrived through
+// those same frames, so that the samples stay exactly those of decoding.
+
+static const int LOOKAHEAD_FRAMES = 4;	// ~4600 samples, several video frames at 32 KHz
+static const int HISTORY_FRAMES = 4;	// frames kept to rebuild the decoder state from
+
+// the last frames decoded, oldest first
+struct History
+{
+	const uint8_t*		addr[HISTORY_FRAMES];
+	const uint8_t*		end[HISTORY_FRAMES];
+	int					count;
+
+	void Push(const uint8_t* frameAddr, const uint8_t* streamEnd)
+	{
+		if (count == HISTORY_FRAMES) {
+			memmove(addr, addr + 1, sizeof(addr) - sizeof(addr[0]));
+			memmove(end, end + 1, sizeof(end) - sizeof(end[0]));
+			count--;
+		}
+		addr[count]	= frameAddr;
+		end[count]	= streamEnd;
+		count++;
+	}
+};
+
+struct CacheKey
+{
+	const uint8_t*		addr;
+	const uint8_t*		end;
+	uint64_t			state;
+
+	bool operator==(const CacheKey& other) const
+	{
+		return addr == other.addr && end == other.end && state == other.state;
+	}
+};
+
+struct CacheKeyHash
+{
+	size_t operator()(const CacheKey& key) const
+	{
+		return size_t(key.state ^ (uint64_t(uintptr_t(key.addr)) * 0x9E3779B97F4A7C15ULL) ^ uintptr_t(key.end));
+	}
+};
+
+struct CachedFrame
+{
+	mp3dec_frame_info_t			info;
+	int							numSamples;
+	uint64_t					state;		// hash of the decoder state after this frame
+	int							rebuild;	// frames, ending with this one, that rebuild that state (0 if none do)
+	const uint8_t*				priorAddr[HISTORY_FRAMES - 1];	// the frames before this one among them
+	const uint8_t*				priorEnd[HISTORY_FRAMES - 1];
+	std::unique_ptr<short[]>	pcm;
+};
+
+struct Frame
+{
+	mp3dec_t			mp3d;		// decoder state after this frame, if up to date
+	uint64_t			state;		// hash of it, kept while the frame cache is enabled
+	int					rebuild;	// frames of history to decode to bring mp3d up to date (0 if it is)
+	History				history;
+	mp3dec_frame_info_t	info;
+	int					numSamples;
+	int					pos;		// stream position after this frame (0 if looped)
+	bool				end;		// reached end of stream without looping
+	short				pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+};
 
 struct Decoder
 {
 	mp3dec_t			mp3d;
+	uint64_t			state;
+	int					rebuild;
+	History				history;
 	mp3dec_frame_info_t	info;
 	const uint8_t*		buffer;
 	int					size, pos;
 	bool				loop;
 	bool				stopped;
+	bool				end;
 	int					numSamples;
 	int					pcmPos;
 	short				pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
 };
 
-static Decoder dec = { 0 };
+struct Worker
+{
+	std::thread				thread;
+	std::mutex				mutex;
+	std::condition_variable	cv;
+	bool					exit;
+	bool					busy;		// decoding a frame, so still reading the stream
+
+	// Where to (re)start decoding from, set under the lock along with a new generation
+	unsigned				generation;
+	bool					active;
+	mp3dec_t				mp3d;
+	uint64_t				state;
+	int						rebuild;
+	History					history;
+	mp3dec_frame_info_t		info;
+	const uint8_t*			buffer;
+	int						size, pos;
+	bool					loop;
+
+	// Frames decoded ahead, queue[head] being the next to play
+	Frame					queue[LOOKAHEAD_FRAMES];
+	int						head, count;
+
+	// Frame cache, only touched by the worker. The limit is set under the lock,
+	// along with a request to empty it, as the keys are only good for one ROM.
+	std::unordered_map<CacheKey, CachedFrame, CacheKeyHash>	cache;
+	size_t					cacheBytes;
+	size_t					cacheLimit;
+	bool					clearCache;
+
+	~Worker()
+	{
+		if (thread.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				exit = true;
+			}
+			cv.notify_all();
+			thread.join();
+		}
+	}
+};
+
+struct MpegDec::Context
+{
+	Decoder				dec;
+	Worker				worker;
+};
+
+// the context active on this thread, and the old global names for its parts
+static thread_local MpegDec::Context *s_ctx = nullptr;
+#define dec		(s_ctx->dec)
+#define worker	(s_ctx->worker)
+
+// hash of everything in the decoder state that the next frame decoded depends on
+static uint64_t StateHash(const mp3dec_t& mp3d)
+{
+	// a decoder that isn't mid-stream starts the next frame from scratch, whatever else it holds
+	if (mp3d.header[0] != 0xff) {
+		return 0;
+	}
+
+	// the synthesis filter leaves half of each group of four in the first 15 groups of the newest column it keeps
+	// unwritten, holding whatever was in the scratch buffer, and never reads them, so they are left out
+	mp3dec_t copy;
+	memcpy(&copy, &mp3d, offsetof(mp3dec_t, reserv_buf));
+	for (int i = 0; i < 15; i++) {
+		copy.qmf_state[14 * 64 + 4 * i + 2] = 0;
+		copy.qmf_state[14 * 64 + 4 * i + 3] = 0;
+	}
+
+	uint64_t head = Util::Hash64((const uint8_t*)&copy, offsetof(mp3dec_t, reserv_buf));
+	uint64_t reserv = Util::Hash64(mp3d.reserv_buf, mp3d.reserv);
+	return (head ^ (reserv * 0x100000001B3ULL)) | 1;
+}
+
+// decode the last frames of the history from scratch, which gives the state after them
+static void Rebuild(mp3dec_t& mp3d, const History& history, int frames)
+{
+	short				pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+	mp3dec_frame_info_t	info;
+
+	mp3dec_init(&mp3d);
+	for (int i = history.count - frames; i < history.count; i++) {
+		mp3dec_decode_frame(&mp3d, history.addr[i], (int)(history.end[i] - history.addr[i]), pcm, &info);
+	}
+}
+
+// whether playback came through the frames that rebuild the state after a cached one
+static bool CanRebuild(const CachedFrame& cached, const History& history)
+{
+	int prior = cached.rebuild - 1;
+	if (prior < 0 || history.count < prior) {
+		return false;
+	}
+
+	for (int i = 0; i < prior; i++) {
+		int h = history.count - prior + i;
+		if (history.addr[h] != cached.priorAddr[i] || history.end[h] != cached.priorEnd[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// keep a frame just decoded, along with the fewest frames from the history (which ends with it) that rebuild the
+// state after it
+static void CacheFrame(const CacheKey& key, const Frame& f, const mp3dec_frame_info_t& info, uint64_t state, const History& history, size_t limit)
+{
+	size_t bytes = sizeof(CachedFrame) + sizeof(CacheKey) + f.numSamples * info.channels * sizeof(short);
+	if (worker.cacheBytes + bytes > limit) {
+		return;
+	}
+
+	CachedFrame& entry	= worker.cache[key];
+	entry.info			= info;
+	entry.numSamples	= f.numSamples;
+	entry.state			= state;
+	entry.rebuild		= 0;
+	entry.pcm.reset(new short[f.numSamples * info.channels]);
+	memcpy(entry.pcm.get(), f.pcm, f.numSamples * info.channels * sizeof(short));
+	worker.cacheBytes += bytes;
+
+	mp3dec_t mp3d;
+	for (int n = 1; n <= history.count && state != 0; n++) {
+		Rebuild(mp3d, history, n);
+		if (StateHash(mp3d) == state) {
+			entry.rebuild = n;
+			for (int i = 0; i < n - 1; i++) {
+				entry.priorAddr[i]	= history.addr[history.count - n + i];
+				entry.priorEnd[i]	= history.end[history.count - n + i];
+			}
+			break;
+		}
+	}
+}
+
+static void RunWorker(MpegDec::Context *ctx)
+{
+	s_ctx = ctx;
+
+	unsigned			generation = worker.generation - 1;
+	bool				end = true;
+	mp3dec_t			mp3d;
+	uint64_t			state = 0;
+	int					rebuild = 0;
+	History				history = {};
+	mp3dec_frame_info_t	info;
+	const uint8_t*		buffer = nullptr;
+	int					size = 0, pos = 0;
+	bool				loop = false;
+	size_t				limit = 0;
+
+	std::unique_lock<std::mutex> lock(worker.mutex);
+
+	for (;;) {
+
+		worker.cv.wait(lock, [&] { return worker.exit || generation != worker.generation || (!end && worker.count < LOOKAHEAD_FRAMES); });
+
+		if (worker.exit) {
+			return;
+		}
+
+		if (worker.clearCache) {
+			worker.cache.clear();
+			worker.cacheBytes	= 0;
+			worker.clearCache	= false;
+		}
+
+		if (generation != worker.generation) {
+			generation	= worker.generation;
+			end			= !worker.active;
+			mp3d		= worker.mp3d;
+			rebuild		= worker.rebuild;
+			history		= worker.history;
+			info		= worker.info;
+			buffer		= worker.buffer;
+			size		= worker.size;
+			pos			= worker.pos;
+			loop		= worker.loop;
+			limit		= worker.cacheLimit;
+
+			// the hash isn't kept up to date while the cache is off
+			state		= !rebuild && limit ? StateHash(mp3d) : worker.state;
+			continue;
+		}
+
+		// the slot after the last queued frame isn't read until it is counted, so decode into it unlocked
+		Frame& f = worker.queue[(worker.head + worker.count) % LOOKAHEAD_FRAMES];
+		worker.busy = true;
+		lock.unlock();
+
+		CacheKey key = { buffer + pos, buffer + size, state };
+		auto cached = limit ? worker.cache.find(key) : worker.cache.end();
+
+		// frames after which the decoder can't be brought up to date again are decoded every time
+		if (cached != worker.cache.end() && (cached->second.state == 0 || CanRebuild(cached->second, history))) {
+			info			= cached->second.info;
+			f.numSamples	= cached->second.numSamples;
+			memcpy(f.pcm, cached->second.pcm.get(), f.numSamples * info.channels * sizeof(short));
+
+			// a decoder that has lost the stream starts afresh, so it needs no rebuilding
+			state	= cached->second.state;
+			rebuild	= cached->second.rebuild;
+			if (state == 0) {
+				mp3dec_init(&mp3d);
+			}
+			history.Push(key.addr, key.end);
+		}
+		else {
+			if (rebuild) {
+				Rebuild(mp3d, history, rebuild);
+				rebuild = 0;
+			}
+
+			f.numSamples = mp3dec_decode_frame(&mp3d, key.addr, size - pos, f.pcm, &info);
+			history.Push(key.addr, key.end);
+
+			if (limit) {
+				state = StateHash(mp3d);
+				if (cached == worker.cache.end()) {
+					CacheFrame(key, f, info, state, history, limit);
+				}
+			}
+		}
+
+		pos += info.frame_bytes;
+
+		// check end of buffer handling
+		end = pos >= size - HDR_SIZE;
+		if (end && loop) {
+			pos = 0;
+			end = false;
+		}
+
+		if (!rebuild) {
+			f.mp3d = mp3d;
+		}
+		f.state		= state;
+		f.rebuild	= rebuild;
+		f.history	= history;
+		f.info		= info;
+		f.pos		= pos;
+		f.end		= end;
+
+		lock.lock();
+		worker.busy = false;
+
+		if (generation == worker.generation) {
+			worker.count++;
+		}
+
+		worker.cv.notify_all();
+	}
+}
+
+// drop frames decoded ahead and restart the worker from the current playback position. Waits for
+// any frame being decoded, so that once stopped the old stream is no longer read.
+static void Restart()
+{
+	{
+		std::unique_lock<std::mutex> lock(worker.mutex);
+		worker.cv.wait(lock, [] { return !worker.busy; });
+
+		worker.generation++;
+		worker.count	= 0;
+		worker.active	= !dec.stopped && dec.buffer;
+		worker.mp3d		= dec.mp3d;
+		worker.state	= dec.state;
+		worker.rebuild	= dec.rebuild;
+		worker.history	= dec.history;
+		worker.info		= dec.info;
+		worker.buffer	= dec.buffer;
+		worker.size		= dec.size;
+		worker.pos		= dec.pos;
+		worker.loop		= dec.loop;
+
+		if (!worker.thread.joinable()) {
+			worker.thread = std::thread(RunWorker, s_ctx);
+		}
+	}
+
+	worker.cv.notify_all();
+	dec.end = false;
+}
+
+// take the next decoded frame, waiting for the worker if it hasn't got that far
+static void NextFrame()
+{
+	{
+		std::unique_lock<std::mutex> lock(worker.mutex);
+		worker.cv.wait(lock, [] { return worker.count > 0; });
+
+		const Frame& f = worker.queue[worker.head];
+
+		if (!f.rebuild) {
+			dec.mp3d	= f.mp3d;
+		}
+		dec.state		= f.state;
+		dec.rebuild		= f.rebuild;
+		dec.history		= f.history;
+		dec.info		= f.info;
+		dec.numSamples	= f.numSamples;
+		dec.pos			= f.pos;
+		dec.end			= f.end;
+		memcpy(dec.pcm, f.pcm, f.numSamples * f.info.channels * sizeof(short));
+
+		worker.head = (worker.head + 1) % LOOKAHEAD_FRAMES;
+		worker.count--;
+	}
+
+	worker.cv.notify_all();
+}
+
+MpegDec::Context *MpegDec::CreateContext()
+{
+	return new Context();	// value-initialized, so zeroed as the globals it replaces were
+}
+
+void MpegDec::DestroyContext(Context *ctx)
+{
+	if (s_ctx == ctx) {
+		s_ctx = nullptr;
+	}
+
+	delete ctx;
+}
+
+void MpegDec::SetContext(Context *ctx)
+{
+	s_ctx = ctx;
+}
 
 void MpegDec::SetMemory(const uint8_t *data, int length, bool loop)
 {
 	mp3dec_init(&dec.mp3d);
 
+	dec.state		= 0;
+	dec.rebuild		= 0;
+	dec.history		= {};
 	dec.buffer		= data;
 	dec.size		= length;
 	dec.pos			= 0;
@@ -28,6 +463,8 @@ void MpegDec::SetMemory(const uint8_t *data, int length, bool loop)
 	dec.pcmPos		= 0;
 	dec.loop		= loop;
 	dec.stopped		= false;
+
+	Restart();
 }
 
 void MpegDec::UpdateMemory(const uint8_t* data, int length, bool loop)
@@ -44,6 +481,8 @@ void MpegDec::UpdateMemory(const uint8_t* data, int length, bool loop)
 	dec.size	= length;
 	dec.pos		= dec.pos - diff;		// update position relative to our new start location
 	dec.loop	= loop;
+
+	Restart();
 }
 
 int MpegDec::GetPosition()
@@ -54,6 +493,8 @@ int MpegDec::GetPosition()
 void MpegDec::SetPosition(int pos)
 {
 	dec.pos = pos;
+
+	Restart();
 }
 
 static void FlushBuffer(int16_t*& left, int16_t*& right, int& numStereoSamples)
@@ -80,14 +521,22 @@ static void EndWithSilence(int16_t*& left, int16_t*& right, int& numStereoSample
 	}
 }
 
-static bool EndOfBuffer()
+void MpegDec::Stop()
 {
-	return dec.pos >= dec.size - HDR_SIZE;
+	dec.stopped = true;
+
+	Restart();
 }
 
-void MpegDec::Stop()
+void MpegDec::SetCacheSize(size_t bytes)
 {
-	dec.stopped = true;
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.cacheLimit	= bytes;
+		worker.clearCache	= true;
+	}
+
+	worker.cv.notify_all();
 }
 
 bool MpegDec::IsLoaded()
@@ -107,26 +556,25 @@ void MpegDec::DecodeAudio(int16_t* left, int16_t* right, int numStereoSamples)
 
 	while (numStereoSamples) {
 
-		dec.numSamples = mp3dec_decode_frame(
-			&dec.mp3d,
-			dec.buffer + dec.pos,
-			dec.size - dec.pos,
-			dec.pcm,
-			&dec.info);
+		// once past the end there is nothing more to decode until the stream is changed
+		// (decoding the few bytes left would find no frame and reset the decoder)
+		if (dec.end) {
+			memset(&dec.mp3d, 0, sizeof(dec.mp3d));
+			dec.state = 0;
+			dec.rebuild = 0;
+			dec.numSamples = 0;
+		}
+		else {
+			NextFrame();
+		}
 
-		dec.pos += dec.info.frame_bytes;
 		dec.pcmPos = 0;	// reset pos
 
 		FlushBuffer(left, right, numStereoSamples);
 
 		// check end of buffer handling
-		if (EndOfBuffer()) {
-			if (dec.loop) {
-				dec.pos = 0;
-			}
-			else {
-				EndWithSilence(left, right, numStereoSamples);
-			}
+		if (dec.end) {
+			EndWithSilence(left, right, numStereoSamples);
 		}
 
 	}
@@ -1,10 +1,20 @@
 #ifndef _MPEG_AUDIO_H_
 #define _MPEG_AUDIO_H_
 
+#include <cstddef>
 #include <cstdint>
 
 namespace MpegDec
 {
+	// State of a DSB's MPEG decoder, along with the thread decoding ahead for it. Each DSB creates its own and makes
+	// it active with SetContext() on every thread before calling the functions below there, all of which act on the
+	// context active on the calling thread.
+	struct Context;
+
+	Context	*CreateContext();
+	void	DestroyContext(Context *ctx);	// waits for its thread, so that it no longer reads the stream
+	void	SetContext(Context *ctx);
+
 	void	SetMemory(const uint8_t *data, int length, bool loop);
 	void	UpdateMemory(const uint8_t *data, int length, bool loop);
 	int		GetPosition();
@@ -12,6 +22,7 @@ namespace MpegDec
 	void	DecodeAudio(int16_t* left, int16_t* right, int numStereoSamples);
 	void	Stop();
 	bool	IsLoaded();
+	void	SetCacheSize(size_t bytes);	// keeps decoded frames up to this many bytes (0 to not); empties the cache
 }
 
 #endif
@@ -38,6 +38,10 @@
  * out, or there may be a UART with a large FIFO buffer. This can be simulated
  * by increasing the MIDI buffer (MIDI_STACK_SIZE).
  *
+ * The MIDI FIFOs are written and read by different threads when the sound
+ * board runs on its own, so they are lock-free single producer, single
+ * consumer rings. Bytes that arrive when one is full are dropped and counted.
+ *
  * To-Do List
  * ----------
  * - Wrap up into an object. Remove any unused #ifdef pathways.
@@ -69,11 +73,15 @@ Anyways credit to R. Belmont and ElSemi for the code, and for being awesome emul
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include "Sound/SCSPDSP.h"
+#include "Sound/SCSPMix.h"
+#include "Util/SPSCRing.h"
+#include "Util/Trace.h"
 
-static const Util::Config::Node *s_config = 0;
-static bool s_multiThreaded = false;
-bool legacySound; // For LegacySound (SCSP DSP) config option. 
 
 #define USEDSP
 //#define RB_VOLUME
@@ -81,15 +89,7 @@ bool legacySound; // For LegacySound (SCSP DSP) config option.
 #define MAX_SCSP	2
 
 
-// These globals control the operation of the SCSP, they are no longer extern and are set through SCSP_SetBuffers(). --Bart
-float SoundClock; // Originally titled SysFPS; seems to be for the sound CPU.
 const float Freq = 76;
-signed short *bufferl;		
-signed short *bufferr;
-int length;
-int cnts;
-
-signed int *buffertmpl,*buffertmpr;	// these are allocated inside this file
 
 unsigned int srate=44100;
 
@@ -118,27 +118,8 @@ unsigned int srate=44100;
 #define DWORD UINT32
 #endif
 
-static CMutex *MIDILock;	// for safe access to the MIDI FIFOs
-static int (*Run68kCB)(int cycles);
-static void (*Int68kCB)(int irq);
-static void (*RetIntCB)();
-static DWORD IrqTimA;
-static DWORD IrqTimBC;
-static DWORD IrqMidi;
-
-unsigned short MCIEB;
-unsigned short MCIPD;
-
 #define MIDI_STACK_SIZE			128
-#define MIDI_STACK_SIZE_MASK	(MIDI_STACK_SIZE-1)
-
-static BYTE MidiOutStack[16];
-static BYTE MidiOutW=0,MidiOutR=0;
-static BYTE MidiStack[MIDI_STACK_SIZE];
-static BYTE MidiOutFill;
-static BYTE MidiInFill;
-static BYTE MidiW=0,MidiR=0;
-static BYTE HasSlaveSCSP=0;
+#define MIDI_OUT_STACK_SIZE		16
 
 static DWORD FNS_Table[0x400];
 static INT32 EG_TABLE[0x400];
@@ -153,9 +134,6 @@ static int RPANTABLE[0x10000];
 #endif
 
 
-static int TimPris[3];
-static int TimCnt[3];
-
 #define SHIFT	12
 #define FIX(v)	((UINT32) ((float) (1<<SHIFT)*(v)))
 
@@ -269,6 +247,7 @@ struct _SLOT
 	_LFO ALFO;		//Amplitude LFO
 	int slot;
 	signed short Prev;	//Previous sample (for interpolation)
+	BYTE dirty;		//derived state to recompute before the next sample (SLOT_DIRTY_*)
 };
 
 #define MEM4B(scsp)		((scsp->data[0]>>0x0)&0x0200)
@@ -295,8 +274,6 @@ struct _SLOT
 #define SCITMA	6
 #define SCITMB	7
 
-bool HasMVOL;
-
 struct _SCSP
 {
 	union
@@ -320,9 +297,114 @@ struct _SCSP
 #endif
 
 	int ARTABLE[64], DRTABLE[64];
-} SCSPs[MAX_SCSP],*SCSP=SCSPs;
 
-static signed short *RBUFDST;	//this points to where the sample will be stored in the RingBuf
+	UINT32 DirtySlots;	//one bit per slot with dirty derived state
+	UINT32 ActiveSlots;	//one bit per slot that may be playing (see SCSP_ResolveSlots)
+};
+
+/*
+ * SCSP_CONTEXT:
+ *
+ * Everything that belongs to one sound board's pair of SCSPs. The tables above
+ * are the same for all of them and are built once. The functions act on the
+ * context made active on the calling thread with SCSP_SetContext(), and the
+ * old global names below refer to it.
+ */
+struct SCSP_CONTEXT
+{
+	const Util::Config::Node *config = 0;
+	Util::Config::Binding<float> balance;
+	bool multiThreaded = false;
+	int blockSamples = 1;	// most samples generated between runs of the 68K
+	bool slaveThread = false;	// render the slave SCSP on a worker thread in blocks of samples
+	bool legacySound = false; // For LegacySound (SCSP DSP) config option.
+
+	// These control the operation of the SCSP and are set through SCSP_SetBuffers(). --Bart
+	float SoundClock = 0; // Originally titled SysFPS; seems to be for the sound CPU.
+	signed short *bufferl = NULL;
+	signed short *bufferr = NULL;
+	int length = 0;
+	int cnts = 0;
+
+	signed int *buffertmpl = NULL, *buffertmpr = NULL;	// these are allocated inside this file
+
+	int (*Run68kCB)(int cycles) = NULL;
+	void (*Int68kCB)(int irq) = NULL;
+	void (*RetIntCB)() = NULL;
+	DWORD IrqTimA = 0;
+	DWORD IrqTimBC = 0;
+	DWORD IrqMidi = 0;
+
+	unsigned short MCIEB = 0;
+	unsigned short MCIPD = 0;
+
+	Util::SPSCRing<BYTE, MIDI_STACK_SIZE> MidiInFIFO;		// main board to 68K
+	Util::SPSCRing<BYTE, MIDI_OUT_STACK_SIZE> MidiOutFIFO;	// 68K to main board
+	BYTE HasSlaveSCSP = 0;
+
+	int TimPris[3] = {};
+	int TimCnt[3] = {};
+
+	bool HasMVOL = false;
+
+	_SCSP SCSPs[MAX_SCSP] = {};
+	_SCSP *SCSP = SCSPs;
+
+	signed short *RBUFDST = NULL;	//this points to where the sample will be stored in the RingBuf
+
+	int lastdiff = 0;	// 68K cycles run past the end of the last block
+
+	// Slave SCSP thread (see below)
+	CThread *slaveWorker = NULL;
+	CFrameBarrier slaveStart;			// the worker sleeps here between blocks
+	std::atomic<unsigned> slaveBlocks{0};	// blocks started
+	std::atomic<int> slaveDone{0};		// samples of the block rendered so far
+	int slaveLength = 0;
+	float slaveBalance = 0;
+	bool slaveExit = false;
+	signed int slaveL[64] = {}, slaveR[64] = {};
+};
+
+static thread_local SCSP_CONTEXT *scsp_ctx = NULL;
+
+#define s_config		(scsp_ctx->config)
+#define s_balance		(scsp_ctx->balance)
+#define s_multiThreaded	(scsp_ctx->multiThreaded)
+#define s_blockSamples	(scsp_ctx->blockSamples)
+#define s_slaveThread	(scsp_ctx->slaveThread)
+#define legacySound		(scsp_ctx->legacySound)
+#define SoundClock		(scsp_ctx->SoundClock)
+#define bufferl			(scsp_ctx->bufferl)
+#define bufferr			(scsp_ctx->bufferr)
+#define cnts			(scsp_ctx->cnts)
+#define buffertmpl		(scsp_ctx->buffertmpl)
+#define buffertmpr		(scsp_ctx->buffertmpr)
+#define Run68kCB		(scsp_ctx->Run68kCB)
+#define Int68kCB		(scsp_ctx->Int68kCB)
+#define RetIntCB		(scsp_ctx->RetIntCB)
+#define IrqTimA			(scsp_ctx->IrqTimA)
+#define IrqTimBC		(scsp_ctx->IrqTimBC)
+#define IrqMidi			(scsp_ctx->IrqMidi)
+#define MCIEB			(scsp_ctx->MCIEB)
+#define MCIPD			(scsp_ctx->MCIPD)
+#define MidiInFIFO		(scsp_ctx->MidiInFIFO)
+#define MidiOutFIFO		(scsp_ctx->MidiOutFIFO)
+#define HasSlaveSCSP	(scsp_ctx->HasSlaveSCSP)
+#define TimPris			(scsp_ctx->TimPris)
+#define TimCnt			(scsp_ctx->TimCnt)
+#define HasMVOL			(scsp_ctx->HasMVOL)
+#define SCSPs			(scsp_ctx->SCSPs)
+#define SCSP			(scsp_ctx->SCSP)
+#define RBUFDST			(scsp_ctx->RBUFDST)
+#define s_slaveWorker	(scsp_ctx->slaveWorker)
+#define s_slaveStart	(scsp_ctx->slaveStart)
+#define s_slaveBlocks	(scsp_ctx->slaveBlocks)
+#define s_slaveDone		(scsp_ctx->slaveDone)
+#define s_slaveLength	(scsp_ctx->slaveLength)
+#define s_slaveBalance	(scsp_ctx->slaveBalance)
+#define s_slaveExit		(scsp_ctx->slaveExit)
+#define s_slaveL		(scsp_ctx->slaveL)
+#define s_slaveR		(scsp_ctx->slaveR)
 
 
 unsigned char DecodeSCI(unsigned char irq)
@@ -345,20 +427,8 @@ void CheckPendingIRQ()
 	DWORD pend=SCSPs->data[0x20/2];
 	DWORD en=SCSPs->data[0x1e/2];
 	
-	/*
-	 * MIDI FIFO critical section
-	 *
-	 * NOTE: I don't think a mutex is really needed here, so I've disabled
-	 * this critical section.
-	 */
-	//if (g_Config.multiThreaded)
-	//	MIDILock->Lock();
-
-	if(MidiW!=MidiR)
+	if(!MidiInFIFO.Empty())
 	{
-		//if (g_Config.multiThreaded)
-		//	MIDILock->Unlock();
-		
 		//SCSP.data[0x20/2]|=0x8;	//Hold midi line while there are commands pending
 
 		//Int68kCB(IrqMidi);
@@ -369,9 +439,6 @@ void CheckPendingIRQ()
 		pend |= 8;
 	}
 	
-	//if (g_Config.multiThreaded)
-	//	MIDILock->Unlock();
-	
 	if(!pend)
 		return;
 	if(pend&0x40)
@@ -568,6 +635,7 @@ void SCSP_StartSlot(_SLOT *slot)
 	slot->EG.volume = 0x17F << EG_SHIFT;
 	slot->Prev = 0;
 	Compute_LFO(slot);
+	slot->dirty = 0;
 	/*{
 		char aux[12];
 		static n=0;
@@ -596,39 +664,9 @@ void SCSP_StopSlot(_SLOT *slot,int keyoff)
 
 #define log2(n) (log((float) n)/log((float) 2))
 
-bool SCSP_Init(const Util::Config::Node &config, int n)
+// Builds the tables shared by all SCSPs
+static void SCSP_BuildTables(void)
 {
-	s_config = &config;
-	s_multiThreaded = config["MultiThreaded"].ValueAs<bool>();
-	legacySound = config["LegacySoundDSP"].ValueAs<bool>();
-	SoundClock = Freq;
-
-	if(n==2)
-	{
-		SCSP=SCSPs+1;
-		memset(SCSP,0,sizeof(_SCSP));
-		SCSP->Master=0;
-		HasSlaveSCSP=1;
-#ifdef USEDSP
-		SCSPDSP_Init(&SCSP->DSP);
-#endif
-
-	}
-	SCSP=SCSPs+0;
-	memset(SCSP,0,sizeof(_SCSP));
-#ifdef USEDSP
-	SCSPDSP_Init(&SCSP->DSP);
-#endif
-	SCSP->Master=1;
-	SCSP->SCSPRAM_LENGTH = 512 * 1024;
-	SCSP->DSP.SCSPRAM = (UINT16 *)SCSP->SCSPRAM;
-	SCSP->DSP.SCSPRAM_LENGTH = (512 * 1024) / 2;
-	MidiR=MidiW=0;
-	MidiOutR=MidiOutW=0;
-	MidiOutFill=0;
-	MidiInFill=0;
-	
-
 	for(int i=0;i<0x400;++i)
 	{
 		float fcent=(double) 1200.0*log2((double)(((double) 1024.0+(double)i)/(double)1024.0));
@@ -744,7 +782,51 @@ bool SCSP_Init(const Util::Config::Node &config, int n)
 		scale=(double) (1<<EG_SHIFT);
 		DRTABLE[i]=(int) (step*scale);
 	}
+
+	LFO_Init();
+}
+
+bool SCSP_Init(const Util::Config::Node &config, int n)
+{
+	static std::once_flag tablesBuilt;
+	std::call_once(tablesBuilt, SCSP_BuildTables);
+
+	s_config = &config;
+	s_balance.Bind(config, "Balance");
+	s_multiThreaded = config["MultiThreaded"].ValueAs<bool>();
+	legacySound = config["LegacySoundDSP"].ValueAs<bool>();
+	s_blockSamples = config["SoundBlockSamples"].ValueAs<int>();
+	if (s_blockSamples < 1)
+		s_blockSamples = 1;
+	else if (s_blockSamples > 64)
+		s_blockSamples = 64;
+	s_slaveThread = config["MultiThreadedSCSP"].ValueAs<bool>() && std::thread::hardware_concurrency() > 1;
+	SoundClock = Freq;
+
+	if(n==2)
+	{
+		SCSP=SCSPs+1;
+		memset(SCSP,0,sizeof(_SCSP));
+		SCSP->Master=0;
+		HasSlaveSCSP=1;
+#ifdef USEDSP
+		SCSPDSP_Init(&SCSP->DSP);
+#endif
+
+	}
+	SCSP=SCSPs+0;
+	memset(SCSP,0,sizeof(_SCSP));
+#ifdef USEDSP
+	SCSPDSP_Init(&SCSP->DSP);
+#endif
+	SCSP->Master=1;
+	SCSP->SCSPRAM_LENGTH = 512 * 1024;
+	SCSP->DSP.SCSPRAM = (UINT16 *)SCSP->SCSPRAM;
+	SCSP->DSP.SCSPRAM_LENGTH = (512 * 1024) / 2;
+	MidiInFIFO.Clear();
+	MidiOutFIFO.Clear();
 	
+
 	for(int i=0;i<32;++i)
 		SCSPs[0].Slots[i].slot=i;
 
@@ -753,7 +835,6 @@ bool SCSP_Init(const Util::Config::Node &config, int n)
 	SCSP->MIXBuf=(signed short *) malloc(0x300*32*sizeof(signed short));
 #endif
 
-	LFO_Init();
 	buffertmpl = NULL;
 	buffertmpr = NULL;
 	buffertmpl=(signed int*) malloc(44100*sizeof(signed int));
@@ -772,15 +853,6 @@ bool SCSP_Init(const Util::Config::Node &config, int n)
 	TimCnt[1] = 0xffff;
 	TimCnt[2] = 0xffff;
 	
-	// MIDI FIFO mutex
-	MIDILock = CThread::CreateMutex();
-	if (NULL == MIDILock)
-	{
-		free(buffertmpl);
-		free(buffertmpr);
-		return ErrorLog("Unable to create MIDI mutex!");
-	}
-	
 	return OKAY;
 }
 
@@ -792,10 +864,86 @@ void SCSP_SetRAM(int n,unsigned char *r)
 #endif
 }
 
+/*
+ * Pitch step, release rate, and LFOs are derived from the slot registers but
+ * only needed to generate samples, and the 68K runs between blocks of them.
+ * Writes just mark what is out of date, looked up by register, and it is all
+ * brought up to date once before the next block however many writes there
+ * were. Key on still takes effect immediately, and a slot being started
+ * derives everything afresh.
+ */
+#define SLOT_DIRTY_STEP	0x01
+#define SLOT_DIRTY_RR	0x02
+#define SLOT_DIRTY_LFO	0x04
+
+static const BYTE SlotRegDirty[0x20] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, SLOT_DIRTY_RR, SLOT_DIRTY_RR, 0, 0, 0, 0,
+	SLOT_DIRTY_STEP, SLOT_DIRTY_STEP, SLOT_DIRTY_LFO, SLOT_DIRTY_LFO, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static inline int SCSP_LowestSlot(UINT32 slots)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz(slots);
+#else
+	int s = 0;
+	while (!(slots & (1u << s)))
+		++s;
+	return s;
+#endif
+}
+
+/*
+ * Also gathers the slots that are playing. Only key on, by the 68K, starts a
+ * slot, so none can start before the next block. Those that stop during it
+ * are left in and skipped as before, so the mixers need only look at these.
+ */
+static void SCSP_ResolveSlots(_SCSP *chip)
+{
+	UINT32 dirtySlots = chip->DirtySlots;
+	chip->DirtySlots = 0;
+	for (; dirtySlots; dirtySlots &= dirtySlots - 1)
+	{
+		_SLOT *slot = chip->Slots + SCSP_LowestSlot(dirtySlots);
+		if (slot->dirty & SLOT_DIRTY_STEP)
+			slot->step = SCSP_Step(slot);
+		if (slot->dirty & SLOT_DIRTY_RR)
+		{
+			slot->EG.RR = Get_DR(0, RR(slot));
+			slot->EG.DL = 0x1f - DL(slot);
+		}
+		if (slot->dirty & SLOT_DIRTY_LFO)
+			Compute_LFO(slot);
+		slot->dirty = 0;
+	}
+
+	chip->ActiveSlots = 0;
+	for (int s = 0; s < 32; ++s)
+	{
+		if (chip->Slots[s].active)
+			chip->ActiveSlots |= 1u << s;
+	}
+}
+
+static void SCSP_ResolveAllSlots()
+{
+	SCSP_ResolveSlots(&SCSPs[0]);
+	if (HasSlaveSCSP)
+		SCSP_ResolveSlots(&SCSPs[1]);
+}
+
 void SCSP_UpdateSlotReg(int s,int r)
 {
 	struct _SLOT *slot = SCSP->Slots + s;
 	int sl;
+	BYTE dirty = SlotRegDirty[r & 0x1f];
+	if (dirty)
+	{
+		slot->dirty |= dirty;
+		SCSP->DirtySlots |= 1u << s;
+		return;
+	}
 	switch (r & 0x3f)
 	{
 	case 0:
@@ -819,19 +967,6 @@ void SCSP_UpdateSlotReg(int s,int r)
 			slot->data[0] &= ~0x1000;
 		}
 		break;
-	case 0x10:
-	case 0x11:
-		slot->step = SCSP_Step(slot);
-		break;
-	case 0xA:
-	case 0xB:
-		slot->EG.RR = Get_DR(0, RR(slot));
-		slot->EG.DL = 0x1f - DL(slot);
-		break;
-	case 0x12:
-	case 0x13:
-		Compute_LFO(slot);
-		break;
 	}
 }
 
@@ -961,26 +1096,13 @@ void SCSP_UpdateRegR(int reg)
 		unsigned short v = SCSP->data[0x4 / 2];
 		v &= 0xff00;
 
-		/*
-		 * MIDI FIFO critical section!
-		 */
-		if (s_multiThreaded)
-			MIDILock->Lock();
-
-		v |= MidiStack[MidiR];
+		// Reading an empty FIFO gives the stale byte in the next slot
+		BYTE midi = MidiInFIFO.Peek();
+		MidiInFIFO.Pop(&midi);
+		v |= midi;
 		//printf("read MIDI\n");
-		if (MidiR != MidiW)
-		{
-			++MidiR;
-			MidiR &= MIDI_STACK_SIZE_MASK;
-			//Int68kCB(IrqMidi);
-		}
 
-		MidiInFill--;
 		SCSP->data[0x4 / 2] = v;
-
-		if (s_multiThreaded)
-			MIDILock->Unlock();
 	}
 	break;
 	case 8:
@@ -1051,7 +1173,10 @@ void SCSP_w8(unsigned int addr,unsigned char val)
 			else if (addr < 0x7C0)
 				((unsigned char *)SCSP->DSP.MADRS)[(addr - 0x780) ^ 1] = val;
 			else if (addr >= 0x800 && addr < 0xC00)
+			{
 				((unsigned char *)SCSP->DSP.MPRO)[(addr - 0x800) ^ 1] = val;
+				SCSP->DSP.ProgramDirty = true;
+			}
 			else
 				int a = 1;
 			if (addr == 0xBF0)
@@ -1071,7 +1196,10 @@ void SCSP_w8(unsigned int addr,unsigned char val)
 			else if (addr < 0x800)
 				((unsigned char *)SCSP->DSP.MADRS)[(addr - 0x7c0) ^ 1] = val;
 			else if (addr < 0xC00)
+			{
 				((unsigned char *)SCSP->DSP.MPRO)[(addr - 0x800) ^ 1] = val;
+				SCSP->DSP.ProgramDirty = true;
+			}
 			else
 				int a = 1;
 			if (addr == 0xBF0)
@@ -1118,7 +1246,10 @@ void SCSP_w16(unsigned int addr,unsigned short val)
 			else if (addr < 0x800)
 				*(unsigned short *) &(SCSP->DSP.MADRS[(addr - 0x780) / 2]) = val;
 			else if (addr < 0xC00)
+			{
 				*(unsigned short *) &(SCSP->DSP.MPRO[(addr - 0x800) / 2]) = val;
+				SCSP->DSP.ProgramDirty = true;
+			}
 			else
 				int a = 1;
 			if (addr == 0xBF0)
@@ -1138,6 +1269,7 @@ void SCSP_w16(unsigned int addr,unsigned short val)
 			else if (addr < 0xC00)
 			{
 				*((UINT16 *)(SCSP->DSP.MPRO + (addr - 0x800) / 2)) = val;
+				SCSP->DSP.ProgramDirty = true;
 			}
 			else
 				int a = 1;
@@ -1186,7 +1318,10 @@ void SCSP_w32(unsigned int addr,unsigned int val)
 			else if (addr < 0x800) // MADRS is mirrored twice
 				*(unsigned int *) &(SCSP->DSP.MADRS[(addr-0x7c0)/2]) = val;
 			else if(addr<0xC00)
+			{
 				*(unsigned int *) &(SCSP->DSP.MPRO[(addr-0x800)/2])=val;
+				SCSP->DSP.ProgramDirty = true;
+			}
 			else
 				int a=1;
 			if(addr==0xBF0)
@@ -1335,9 +1470,17 @@ void SCSP_TimersAddTicks(int ticks)
 }
 
 
-signed int inline SCSP_UpdateSlot(_SLOT *slot)
+/*
+ * SCSP_StepSlot(slot, s1, s2, fpart, alfo, eg):
+ *
+ * Advances an active slot by one sample: fetches the two samples to
+ * interpolate between and the fraction, moves the address on (handling the
+ * loop), and steps the LFOs and envelope, giving their levels. Returns false
+ * if the slot doesn't play this sample (SSCTL set). The sample itself is made
+ * from these by SCSPMix_SlotSample().
+ */
+static inline bool SCSP_StepSlot(_SLOT *slot, INT32 *s1, INT32 *s2, INT32 *fpart, INT32 *alfo, INT32 *eg)
 {
-	signed int sample;
 	int step = slot->step;
 	DWORD addr1, addr2, addr_select;
 	DWORD *addr[2] = { &addr1, &addr2 };
@@ -1345,7 +1488,7 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 
 
 	if (SSCTL(slot) != 0)
-		return 0;
+		return false;
 
 	if (PLFOS(slot) != 0)
 	{
@@ -1385,23 +1528,17 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 		{
 			signed char *p1 = (signed char *) &(slot->base[addr1 ^ 1]);
 			signed char *p2 = (signed char *) &(slot->base[addr2 ^ 1]);
-			int s;
-			signed int fpart = slot->cur_addr&((1 << SHIFT) - 1);
 			//sample=(p[0])<<8;
-			s = (int)(p1[0] << 8)*((1 << SHIFT) - fpart) + (int)(p2[0] << 8)*fpart;
-			sample = (s >> SHIFT);
+			*s1 = (int)(p1[0] << 8);
+			*s2 = (int)(p2[0] << 8);
 		}
 		else	//16 bit signed (endianness?)
 		{
 			signed short *p1 = (signed short *) &(slot->base[addr1]);
 			signed short *p2 = (signed short *) &(slot->base[addr2]);
-			int s;
-			signed int fpart = slot->cur_addr&((1 << SHIFT) - 1);
 			//sample=(p[0]);
-			s = (int)(p1[0])*((1 << (SHIFT)) - fpart) + (int)(p2[0])*fpart;
-			
-			
-			sample = (s >> (SHIFT));
+			*s1 = (int)(p1[0]);
+			*s2 = (int)(p2[0]);
 
 			//sample=((p[0]>>8)&0xFF)|(p[0]<<8);
 			//s=(int) p[0]*((1<<SHIFT)-fpart)+(int) p[1]*fpart;
@@ -1413,13 +1550,9 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 			sample^=0x8000;
 			*/
 		}
+		*fpart = slot->cur_addr&((1 << SHIFT) - 1);
 	//}
 
-	if (SBCTL(slot) & 0x1)
-		sample ^= 0x7FFF;
-	if (SBCTL(slot) & 0x2)
-		sample = (INT16)(sample ^ 0x8000);
-
 	if (slot->Back)
 		slot->cur_addr -= step;
 	else
@@ -1487,20 +1620,31 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 
 	if (!SDIR(slot))
 	{
-		if (ALFOS(slot) != 0) 
-		{
-			sample = sample * ALFO_Step(&(slot->ALFO));
-			sample >>= (SHIFT);
-		}
-
-
+		*alfo = ALFOS(slot) != 0 ? ALFO_Step(&(slot->ALFO)) : (1 << SHIFT);
 
 		if (slot->EG.state == ATTACK)
-			sample = (sample * EG_Update(slot)) >> SHIFT;
+			*eg = EG_Update(slot);
 		else
-			sample = (sample * EG_TABLE[EG_Update(slot) >> (SHIFT - 10)]) >> SHIFT;
+			*eg = EG_TABLE[EG_Update(slot) >> (SHIFT - 10)];
+	}
+	else
+	{
+		*alfo = 1 << SHIFT;
+		*eg = 1 << SHIFT;
 	}
 
+	return true;
+}
+
+signed int inline SCSP_UpdateSlot(_SLOT *slot)
+{
+	INT32 s1, s2, fpart, alfo, eg;
+
+	if (!SCSP_StepSlot(slot, &s1, &s2, &fpart, &alfo, &eg))
+		return 0;
+
+	signed int sample = SCSPMix_SlotSample(s1, s2, fpart, SBCTL(slot), alfo, eg);
+
 	if (!STWINH(slot))
 	{
 		if (!SDIR(slot))
@@ -1514,6 +1658,230 @@ signed int inline SCSP_UpdateSlot(_SLOT *slot)
 	return sample;
 }
 
+/*
+ * SCSP_CanMixSlotsBatched(chip):
+ *
+ * Whether this sample's slots of an SCSP can be stepped first and mixed
+ * together by SCSP_MixSlotsBatched(), rather than one at a time. Not if a slot
+ * uses FM, which reads the ring buffer values of the slots before it, nor if
+ * the slave SCSP's slots are playing when there isn't one (their ring buffer
+ * values go to the master's). Only slots keyed on or registers written by the
+ * 68K change this, so it holds until the 68K next runs.
+ */
+static bool SCSP_CanMixSlotsBatched(const _SCSP *chip)
+{
+#if FM_DELAY
+	return false;
+#else
+	for (UINT32 slots = chip->ActiveSlots; slots; slots &= slots - 1)
+	{
+		const _SLOT *slot = chip->Slots + SCSP_LowestSlot(slots);
+		if (slot->active && ((slot->data[0x7] & 0xEFFF) || (chip != SCSPs && !HasSlaveSCSP)))	// MDL, MDXSL or MDYSL
+			return false;
+	}
+	return true;
+#endif
+}
+
+/*
+ * SCSP_MixSlotsBatched(chip, balance, smpl, smpr):
+ *
+ * Generates a sample for all of an SCSP's slots, as SCSP_UpdateSlot() does
+ * for each in turn in SCSP_DoMasterSamples(), but mixing the active ones
+ * together with SCSPMix_Slots().
+ */
+static void SCSP_MixSlotsBatched(_SCSP *chip, float balance, signed int *smpl, signed int *smpr)
+{
+	SCSPSlotBatch batch;
+	int slotNum[32];
+	int count = 0;
+
+	for (UINT32 slots = chip->ActiveSlots; slots; slots &= slots - 1)
+	{
+		int sl = SCSP_LowestSlot(slots);
+		_SLOT *slot = chip->Slots + sl;
+		if (!slot->active || !SCSP_StepSlot(slot, &batch.s1[count], &batch.s2[count], &batch.fpart[count], &batch.alfo[count], &batch.eg[count]))
+			continue;
+
+		batch.sbctl[count] = SBCTL(slot);
+		batch.ringLevel[count] = (STWINH(slot) || SDIR(slot)) ? 0 : LPANTABLE[(TL(slot) << 0x0) | (0x7 << 0xd)];
+		batch.dspLevel[count] = LPANTABLE[(TL(slot) << 0x0) | (IMXL(slot) << 0xd)];
+		UINT16 Enc = ((TL(slot)) << 0x0) | ((DIPAN(slot)) << 0x8) | ((DISDL(slot)) << 0xd);
+		batch.leftLevel[count] = LPANTABLE[Enc];
+		batch.rightLevel[count] = RPANTABLE[Enc];
+		slotNum[count++] = sl;
+	}
+
+	SCSPMix_Slots(&batch, count, balance, smpl, smpr);
+
+	for (int i = 0; i < count; ++i)
+	{
+		_SLOT *slot = chip->Slots + slotNum[i];
+		if (!STWINH(slot) && !SDIR(slot))
+			chip->RINGBUF[(chip->BUFPTR + slotNum[i]) & 63] = batch.ring[i];
+		SCSPDSP_SetSample(&chip->DSP, batch.dsp[i], ISEL(slot), IMXL(slot));
+	}
+
+	chip->BUFPTR = (chip->BUFPTR + 32) & 63;
+}
+
+/*
+ * SCSP_NextBlockLength(remaining):
+ *
+ * How many samples to generate before running the 68K again, at most
+ * s_blockSamples and the number remaining. The 68K then runs for all of them
+ * at once, seeing the timers and interrupts as they are at the end of the
+ * block, so a block must not run past a sample at which a timer expires
+ * (unless it expires on the first one, which is when the 68K would see the
+ * interrupt anyway). While an interrupt is pending, it is one sample at a time,
+ * as before.
+ */
+static int SCSP_NextBlockLength(int remaining)
+{
+	static const int timerReg[3] = { 0x18 / 2, 0x1a / 2, 0x1c / 2 };
+	int n = (s_blockSamples < remaining) ? s_blockSamples : remaining;
+
+	if (n <= 1)
+		return 1;
+	if ((SCSPs->data[0x20 / 2] & SCSPs->data[0x1e / 2] & 0x1c8) || !MidiInFIFO.Empty())
+		return 1;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		if (TimCnt[i] > 0xff00)	// stopped
+			continue;
+		int step = 1 << (8 - ((SCSPs->data[timerReg[i]] >> 8) & 0x7));
+		int ticks = (0xff00 - TimCnt[i]) / step + 1;	// until it expires, as SCSP_TimersAddTicks() counts
+		if (ticks > 1 && ticks - 1 < n)
+			n = ticks - 1;
+	}
+
+	return n;
+}
+
+/*
+ * SCSP_MixEffects(chip, balance, smpl, smpr):
+ *
+ * Adds the outputs of an SCSP's DSP (EFREG) to the sample at the levels and
+ * pans of its first 16 slots.
+ */
+static void SCSP_MixEffects(const _SCSP *chip, float balance, signed int *smpl, signed int *smpr)
+{
+	// For legacy option, 14 is the most reasonable value I can set at the moment for the EFSDL slot. - Paul
+	int levelShift = legacySound ? 0xe : 0xd;
+
+	for (int i = 0; i < 16; ++i)
+	{
+		const _SLOT *slot = chip->Slots + i;
+		if (EFSDL(slot))
+		{
+			UINT16 Enc = ((EFPAN(slot)) << 0x8) | ((EFSDL(slot)) << levelShift);
+			*smpl += (int)(balance*(float)(((chip->DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
+			*smpr += (int)(balance*(float)(((chip->DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
+		}
+	}
+}
+
+/*
+ * Slave SCSP Thread
+ *
+ * Between runs of the 68K, the two SCSPs only meet in the final mix, unless a
+ * slave slot uses FM (which reads the master's ring buffer). For blocks of at
+ * least SLAVE_THREAD_MIN_BLOCK samples, the slave's slots and DSP are rendered
+ * on a worker thread while the master's are rendered by SCSP_DoMasterSamples(),
+ * which waits for each of the slave's samples before mixing it. The worker
+ * counts them out in s_slaveDone and, having finished a block, keeps looking
+ * for the next one for a while (they follow each other closely within a
+ * frame) before sleeping. The output is the same as rendering both in turn.
+ */
+
+static const int SLAVE_THREAD_MIN_BLOCK = 8;
+static const int SLAVE_THREAD_SPIN_US = 250;	// how long the worker looks for the next block before sleeping
+
+static int SCSP_SlaveThread(void *ctx)
+{
+	scsp_ctx = (SCSP_CONTEXT *) ctx;
+	unsigned blocks = 0;
+
+	while (true)
+	{
+		auto start = std::chrono::steady_clock::now();
+		while (s_slaveBlocks.load(std::memory_order_acquire) == blocks && std::chrono::steady_clock::now() - start < std::chrono::microseconds(SLAVE_THREAD_SPIN_US))
+			std::this_thread::yield();
+		s_slaveStart.Wait();
+		blocks++;
+		if (s_slaveExit)
+			return 0;
+		s_slaveStart.Arm(1);
+
+		// once the last sample is counted the next block may be set up, so take its length and balance now
+		int length = s_slaveLength;
+		float balance = s_slaveBalance;
+
+		for (int i = 0; i < length; ++i)
+		{
+			signed int smpl = 0, smpr = 0;
+			SCSP_MixSlotsBatched(&SCSPs[1], balance, &smpl, &smpr);
+			SCSPDSP_Step(&SCSPs[1].DSP);
+			SCSP_MixEffects(&SCSPs[1], balance, &smpl, &smpr);
+			s_slaveL[i] = smpl;
+			s_slaveR[i] = smpr;
+			s_slaveDone.store(i + 1, std::memory_order_release);
+		}
+	}
+}
+
+/*
+ * SCSP_StartSlaveBlock(length, balance):
+ *
+ * Starts the worker rendering the next length samples of the slave SCSP, if
+ * it is worth it and the slave doesn't depend on the master. Returns false if
+ * the slave is to be rendered with the master instead.
+ */
+static bool SCSP_StartSlaveBlock(int length, float balance)
+{
+	if (!s_slaveThread || !HasSlaveSCSP || length < SLAVE_THREAD_MIN_BLOCK || !SCSP_CanMixSlotsBatched(&SCSPs[1]))
+		return false;
+
+	if (NULL == s_slaveWorker)
+	{
+		s_slaveStart.Arm(1);
+		s_slaveWorker = CThread::CreateThread("SCSP slave", SCSP_SlaveThread, scsp_ctx);
+		if (NULL == s_slaveWorker)
+		{
+			ErrorLog("Unable to create slave SCSP thread: %s", CThread::GetLastError());
+			s_slaveThread = false;
+			return false;
+		}
+	}
+
+	s_slaveLength = length;
+	s_slaveBalance = balance;
+	s_slaveDone.store(0, std::memory_order_relaxed);
+	s_slaveBlocks.fetch_add(1, std::memory_order_release);
+	s_slaveStart.Arrive();
+	return true;
+}
+
+// Waits for the worker to render a sample of the current block
+static void SCSP_WaitSlaveSample(int i)
+{
+	while (s_slaveDone.load(std::memory_order_acquire) <= i)
+		std::this_thread::yield();
+}
+
+static void SCSP_StopSlaveThread()
+{
+	if (NULL == s_slaveWorker)
+		return;
+	s_slaveExit = true;
+	s_slaveStart.Arrive();
+	s_slaveWorker->Wait();
+	delete s_slaveWorker;
+	s_slaveWorker = NULL;
+	s_slaveExit = false;
+}
+
 
 void SCSP_CpuRunScanline()
 {
@@ -1523,7 +1891,6 @@ void SCSP_CpuRunScanline()
 void SCSP_DoMasterSamples(int nsamples)
 {
 	int slice = 12000000 / (SoundClock*nsamples);	// 68K cycles/sample
-	static int lastdiff = 0;
 
 	/*
 	 * Compute relative master/slave SCSP balance (note: master is often used
@@ -1531,7 +1898,7 @@ void SCSP_DoMasterSamples(int nsamples)
 	 * When one SCSP is fully attenuated, the other's samples will be multiplied
 	 * by 2.
 	 */
-	float balance = (float)s_config->Get("Balance").ValueAs<float>();
+	float balance = s_balance;
 	if (balance < -100.0f)
 		balance = -100.0f;
 	else if (balance > 100.0f)
@@ -1541,7 +1908,10 @@ void SCSP_DoMasterSamples(int nsamples)
 	float slaveBalance = 1.0f - balance;
 	signed short *bufl, *bufr;
 
-	INT32 sl, s, i;
+	INT32 sl, s;
+	SCSP_ResolveAllSlots();
+	int blockLength = SCSP_NextBlockLength(nsamples), blockDone = 0;
+	bool slaveThreaded = SCSP_StartSlaveBlock(blockLength, slaveBalance);
 
 	bufl = bufferl;
 	bufr = bufferr;
@@ -1553,7 +1923,15 @@ void SCSP_DoMasterSamples(int nsamples)
 	{
 		signed int smpl = 0, smpr = 0;
 
-		for (sl = 0; sl < 32; ++sl)
+		bool batched = SCSP_CanMixSlotsBatched(&SCSPs[0]) && (slaveThreaded || SCSP_CanMixSlotsBatched(&SCSPs[1]));
+		if (batched)
+		{
+			SCSP_MixSlotsBatched(&SCSPs[0], masterBalance, &smpl, &smpr);
+			if (!slaveThreaded)
+				SCSP_MixSlotsBatched(&SCSPs[1], slaveBalance, &smpl, &smpr);
+		}
+
+		for (sl = 0; !batched && sl < 32; ++sl)
 		{
 #if FM_DELAY
 			RBUFDST = SCSPs[0].DELAYBUF + SCSPs[0].DELAYPTR;
@@ -1597,6 +1975,7 @@ void SCSP_DoMasterSamples(int nsamples)
 #else
 				RBUFDST = SCSPs[1].RINGBUF + SCSPs[1].BUFPTR;
 #endif
+			if (!slaveThreaded)
 			{
 				if (SCSPs[1].Slots[sl].active)
 				{
@@ -1632,51 +2011,20 @@ void SCSP_DoMasterSamples(int nsamples)
 	}
 
 		SCSPDSP_Step(&SCSPs[0].DSP);
-		if (HasSlaveSCSP)
+		if (HasSlaveSCSP && !slaveThreaded)
 			SCSPDSP_Step(&SCSPs[1].DSP);
 
 		//		smpl=0;
 		//		smpr=0;
-		for (i = 0; i < 16; ++i)
+		SCSP_MixEffects(&SCSPs[0], masterBalance, &smpl, &smpr);
+		if (HasSlaveSCSP && !slaveThreaded)
+			SCSP_MixEffects(&SCSPs[1], slaveBalance, &smpl, &smpr);
+
+		if (slaveThreaded)
 		{
-			_SLOT *slot = SCSPs[0].Slots + i;
-			if (legacySound == true) {
-				if (EFSDL(slot))
-				{
-					// For legacy option, 14 is the most reasonable value I can set at the moment for the EFSDL slot. - Paul
-					UINT16 Enc = ((EFPAN(slot)) << 0x8) | ((EFSDL(slot)) << 0xe);
-					smpl += (int)(masterBalance*(float)(((SCSPs[0].DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
-					smpr += (int)(masterBalance*(float)(((SCSPs[0].DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
-				}
-				if (HasSlaveSCSP)
-				{
-					_SLOT *slot = SCSPs[1].Slots + i;
-					if (EFSDL(slot))
-					{
-						UINT16 Enc = ((EFPAN(slot)) << 0x8) | ((EFSDL(slot)) << 0xe);
-						smpl += (int)(slaveBalance*(float)(((SCSPs[1].DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
-						smpr += (int)(slaveBalance*(float)(((SCSPs[1].DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
-					}
-				}
-			}
-			else {
-				if (EFSDL(slot))
-				{
-					UINT16 Enc = ((EFPAN(slot)) << 0x8) | ((EFSDL(slot)) << 0xd);
-					smpl += (int)(masterBalance*(float)(((SCSPs[0].DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
-					smpr += (int)(masterBalance*(float)(((SCSPs[0].DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
-				}
-				if (HasSlaveSCSP)
-				{
-					_SLOT *slot = SCSPs[1].Slots + i;
-					if (EFSDL(slot))
-					{
-						UINT16 Enc = ((EFPAN(slot)) << 0x8) | ((EFSDL(slot)) << 0xd);
-						smpl += (int)(slaveBalance*(float)(((SCSPs[1].DSP.EFREG[i] * LPANTABLE[Enc]) >> SHIFT)));
-						smpr += (int)(slaveBalance*(float)(((SCSPs[1].DSP.EFREG[i] * RPANTABLE[Enc]) >> SHIFT)));
-					}
-				}
-			}
+			SCSP_WaitSlaveSample(blockDone);
+			smpl += s_slaveL[blockDone];
+			smpr += s_slaveR[blockDone];
 		}
 
 		if (DAC18B(SCSP))
@@ -1694,14 +2042,56 @@ void SCSP_DoMasterSamples(int nsamples)
 
 
 		SCSP_TimersAddTicks(1);
-		CheckPendingIRQ();
-		lastdiff = Run68kCB(slice - lastdiff);
+		if (++blockDone >= blockLength)
+		{
+			CheckPendingIRQ();
+			scsp_ctx->lastdiff = Run68kCB(blockDone * slice - scsp_ctx->lastdiff);
+			SCSP_ResolveAllSlots();
+			blockDone = 0;
+			blockLength = SCSP_NextBlockLength(nsamples - s - 1);
+			slaveThreaded = s + 1 < nsamples && SCSP_StartSlaveBlock(blockLength, slaveBalance);
+		}
 		}
 	}
 
 void SCSP_Update()
 {
-	SCSP_DoMasterSamples(length);
+	TRACE_ZONE("SCSP_Update");
+	SCSP_DoMasterSamples(scsp_ctx->length);
+}
+
+/*
+ * SCSP_DoTimingSamples(nsamples):
+ *
+ * Runs the 68K in the same blocks, and the timers and interrupts at the same
+ * samples, as SCSP_DoMasterSamples(), but renders nothing: the slots do not
+ * advance, and the DSP does not run. Enough for the sound program to answer
+ * the main board as it would, when the audio is not wanted.
+ */
+static void SCSP_DoTimingSamples(int nsamples)
+{
+	int slice = 12000000 / (SoundClock*nsamples);	// 68K cycles/sample
+
+	SCSP_ResolveAllSlots();
+	int blockLength = SCSP_NextBlockLength(nsamples), blockDone = 0;
+	for (int s = 0; s < nsamples; ++s)
+	{
+		SCSP_TimersAddTicks(1);
+		if (++blockDone >= blockLength)
+		{
+			CheckPendingIRQ();
+			scsp_ctx->lastdiff = Run68kCB(blockDone * slice - scsp_ctx->lastdiff);
+			SCSP_ResolveAllSlots();
+			blockDone = 0;
+			blockLength = SCSP_NextBlockLength(nsamples - s - 1);
+		}
+	}
+}
+
+void SCSP_UpdateTiming()
+{
+	TRACE_ZONE("SCSP_UpdateTiming");
+	SCSP_DoTimingSamples(scsp_ctx->length);
 }
 
 void SCSP_SetCB(int (*Run68k)(int cycles),void (*Int68k)(int irq))
@@ -1712,100 +2102,43 @@ void SCSP_SetCB(int (*Run68k)(int cycles),void (*Int68k)(int irq))
 
 void SCSP_MidiIn(BYTE val)
 {
-	/*
-	 * MIDI FIFO critical section
-	 */
-	if (s_multiThreaded)
-		MIDILock->Lock();
-		
 	//DebugLog("Midi Buffer push %02X",val);
-	MidiStack[MidiW++]=val;
-	MidiW&=MIDI_STACK_SIZE_MASK;
-	MidiInFill++;
+	MidiInFIFO.Push(val);	// dropped and counted if full
 	//Int68kCB(IrqMidi);
 //	SCSP.data[0x20/2]|=0x8;
-
-	if (s_multiThreaded)
-		MIDILock->Unlock();
 }
 
 void SCSP_MidiOutW(BYTE val)
 {
-	/*
-	 * MIDI FIFO critical section
-	 */
-	if (s_multiThreaded)
-		MIDILock->Lock();
-
 	//printf("68K: MIDI out\n");
 	//DebugLog("Midi Out Buffer push %02X",val);
-	MidiStack[MidiOutW++]=val;
-	MidiOutW&=31;
-	++MidiOutFill;
-
-	if (s_multiThreaded)
-		MIDILock->Unlock();
+	MidiOutFIFO.Push(val);
 }
 
 
 unsigned char SCSP_MidiOutR()
 {
-	unsigned char val;
+	unsigned char val = 0xff;
 
-	if(MidiOutR==MidiOutW)	// I don't think this needs to be a critical section...
-		return 0xff;
-		
-	/*
-	 * MIDI FIFO critical section
-	 */
-	if (s_multiThreaded)
-		MIDILock->Lock();
-
-	val=MidiStack[MidiOutR++];
+	MidiOutFIFO.Pop(&val);
 	//DebugLog("Midi Out Buffer pop %02X",val);
-	MidiOutR&=31;
-	--MidiOutFill;
-	
-	if (s_multiThreaded)
-		MIDILock->Unlock();
-		
 	return val;
 }
 
 unsigned char SCSP_MidiOutFill()
 {
-	unsigned char v;
-	
-	/*
-	 * MIDI FIFO critical section
-	 */
-	if (s_multiThreaded)
-		MIDILock->Lock();
-
-	v = MidiOutFill;
-	
-	if (s_multiThreaded)
-		MIDILock->Unlock();
-	
-	return v;
+	return (unsigned char) MidiOutFIFO.Count();
 }
 
 unsigned char SCSP_MidiInFill()
 {
-	unsigned char v;
-	
-	/*
-	 * MIDI FIFO critical section
-	 */
-	if (s_multiThreaded)
-		MIDILock->Lock();
+	return (unsigned char) MidiInFIFO.Count();
+}
 
-	v = MidiInFill;
-	
-	if (s_multiThreaded)
-		MIDILock->Unlock();
-	
-	return v;
+void SCSP_MidiOverflows(unsigned *inDropped, unsigned *outDropped)
+{
+	*inDropped = MidiInFIFO.Overflows();
+	*outDropped = MidiOutFIFO.Overflows();
 }
 
 void SCSP_RTECheck()
@@ -1910,6 +2243,7 @@ unsigned int SCSP_Slave_r32(unsigned int addr)
 
 void SCSP_SaveState(CBlockFile *StateFile)
 {
+	SCSP_ResolveAllSlots();
 	StateFile->NewBlock("SCSP x 2", __FILE__);
 	
 	/*
@@ -1929,14 +2263,18 @@ void SCSP_SaveState(CBlockFile *StateFile)
 	StateFile->Write(&IrqTimA, sizeof(IrqTimA));
 	StateFile->Write(&IrqTimBC, sizeof(IrqTimBC));
 	StateFile->Write(&IrqMidi, sizeof(IrqMidi));
-	StateFile->Write(MidiOutStack, sizeof(MidiOutStack));
-	StateFile->Write(&MidiOutW, sizeof(MidiOutW));
-	StateFile->Write(&MidiOutR, sizeof(MidiOutR));
-	StateFile->Write(MidiStack, sizeof(MidiStack));
-	StateFile->Write(&MidiOutFill, sizeof(MidiOutFill));
-	StateFile->Write(&MidiInFill, sizeof(MidiInFill));
-	StateFile->Write(&MidiW, sizeof(MidiW));
-	StateFile->Write(&MidiR, sizeof(MidiR));
+	// MIDI FIFOs, laid out as the separate arrays and byte indices they used to be
+	BYTE midiOutW = BYTE(MidiOutFIFO.WriteIndex()), midiOutR = BYTE(MidiOutFIFO.ReadIndex());
+	BYTE midiOutFill = BYTE(MidiOutFIFO.Count()), midiInFill = BYTE(MidiInFIFO.Count());
+	BYTE midiW = BYTE(MidiInFIFO.WriteIndex()), midiR = BYTE(MidiInFIFO.ReadIndex());
+	StateFile->Write(MidiOutFIFO.Data(), MIDI_OUT_STACK_SIZE);
+	StateFile->Write(&midiOutW, sizeof(midiOutW));
+	StateFile->Write(&midiOutR, sizeof(midiOutR));
+	StateFile->Write(MidiInFIFO.Data(), MIDI_STACK_SIZE);
+	StateFile->Write(&midiOutFill, sizeof(midiOutFill));
+	StateFile->Write(&midiInFill, sizeof(midiInFill));
+	StateFile->Write(&midiW, sizeof(midiW));
+	StateFile->Write(&midiR, sizeof(midiR));
 	StateFile->Write(TimPris, sizeof(TimPris));
 	StateFile->Write(TimCnt, sizeof(TimCnt));
 	
@@ -2021,14 +2359,17 @@ void SCSP_LoadState(CBlockFile *StateFile)
 	StateFile->Read(&IrqTimA, sizeof(IrqTimA));
 	StateFile->Read(&IrqTimBC, sizeof(IrqTimBC));
 	StateFile->Read(&IrqMidi, sizeof(IrqMidi));
-	StateFile->Read(MidiOutStack, sizeof(MidiOutStack));
-	StateFile->Read(&MidiOutW, sizeof(MidiOutW));
-	StateFile->Read(&MidiOutR, sizeof(MidiOutR));
-	StateFile->Read(MidiStack, sizeof(MidiStack));
-	StateFile->Read(&MidiOutFill, sizeof(MidiOutFill));
-	StateFile->Read(&MidiInFill, sizeof(MidiInFill));
-	StateFile->Read(&MidiW, sizeof(MidiW));
-	StateFile->Read(&MidiR, sizeof(MidiR));
+	BYTE midiOutStack[MIDI_OUT_STACK_SIZE], midiOutW, midiOutR, midiStack[MIDI_STACK_SIZE], midiOutFill, midiInFill, midiW, midiR;
+	StateFile->Read(midiOutStack, sizeof(midiOutStack));
+	StateFile->Read(&midiOutW, sizeof(midiOutW));
+	StateFile->Read(&midiOutR, sizeof(midiOutR));
+	StateFile->Read(midiStack, sizeof(midiStack));
+	StateFile->Read(&midiOutFill, sizeof(midiOutFill));	// follow from the indices
+	StateFile->Read(&midiInFill, sizeof(midiInFill));
+	StateFile->Read(&midiW, sizeof(midiW));
+	StateFile->Read(&midiR, sizeof(midiR));
+	MidiOutFIFO.Restore(midiOutStack, midiOutR, midiOutW);
+	MidiInFIFO.Restore(midiStack, midiR, midiW);
 	StateFile->Read(TimPris, sizeof(TimPris));
 	StateFile->Read(TimCnt, sizeof(TimCnt));
 	
@@ -2083,7 +2424,10 @@ void SCSP_LoadState(CBlockFile *StateFile)
 
 			// Recompute LFOs
 			Compute_LFO(&(SCSPs[i].Slots[j]));
+			SCSPs[i].Slots[j].dirty = 0;
 		}
+		SCSPs[i].DirtySlots = 0;
+		SCSP_ResolveSlots(&SCSPs[i]);
 		
 		// DSP
 		StateFile->Read(&(SCSPs[i].DSP.RBP), sizeof(SCSPs[i].DSP.RBP));
@@ -2099,6 +2443,7 @@ void SCSP_LoadState(CBlockFile *StateFile)
 		StateFile->Read(SCSPs[i].DSP.EFREG, sizeof(SCSPs[i].DSP.EFREG));
 		StateFile->Read(&(SCSPs[i].DSP.Stopped), sizeof(SCSPs[i].DSP.Stopped));
 		StateFile->Read(&(SCSPs[i].DSP.LastStep), sizeof(SCSPs[i].DSP.LastStep));
+		SCSPs[i].DSP.ProgramDirty = true;
 	}
 }
 
@@ -2107,19 +2452,38 @@ void SCSP_SetBuffers(INT16 *leftBufferPtr, INT16 *rightBufferPtr, int bufferLeng
 	SoundClock = 76;
 	bufferl = leftBufferPtr;
 	bufferr = rightBufferPtr;
-	length = bufferLength;
+	scsp_ctx->length = bufferLength;
 	cnts = 0;		// what is this for? seems unimportant but need to find out
 }
 
 void SCSP_Deinit(void)
 {
+	SCSP_StopSlaveThread();
 #ifdef USEDSP
 	free(SCSP->MIXBuf);
 #endif
 	free(buffertmpl);
 	free(buffertmpr);
-	delete MIDILock;
 	buffertmpl = NULL;
 	buffertmpr = NULL;
-	MIDILock = NULL;
+
+	unsigned inDropped, outDropped;
+	SCSP_MidiOverflows(&inDropped, &outDropped);
+	if (inDropped || outDropped)
+		InfoLog("SCSP MIDI FIFOs overflowed: %u bytes in and %u bytes out were dropped.", inDropped, outDropped);
+}
+
+SCSP_CONTEXT *SCSP_CreateContext(void)
+{
+	return new SCSP_CONTEXT();
+}
+
+void SCSP_DestroyContext(SCSP_CONTEXT *ctx)
+{
+	delete ctx;
+}
+
+void SCSP_SetContext(SCSP_CONTEXT *ctx)
+{
+	scsp_ctx = ctx;
 }
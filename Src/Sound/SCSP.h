@@ -28,6 +28,18 @@
 #ifndef INCLUDED_SCSP_H
 #define INCLUDED_SCSP_H
 
+/*
+ * SCSP_CONTEXT:
+ *
+ * State of a sound board's SCSPs. Each board creates its own and makes it
+ * active with SCSP_SetContext() on every thread before calling the functions
+ * below there, all of which act on the context active on the calling thread.
+ */
+struct SCSP_CONTEXT;
+
+SCSP_CONTEXT *SCSP_CreateContext(void);
+void SCSP_DestroyContext(SCSP_CONTEXT *ctx);	// call SCSP_Deinit() on it first
+void SCSP_SetContext(SCSP_CONTEXT *ctx);
 
 void SCSP_w8(UINT32 addr,UINT8 val);
 void SCSP_w16(UINT32 addr,UINT16 val);
@@ -38,19 +50,20 @@ UINT32 SCSP_r32(UINT32 addr);
 
 void SCSP_SetCB(int (*Run68k)(int cycles),void (*Int68k)(int irq));
 void SCSP_Update();
+void SCSP_UpdateTiming();	// runs the 68K, timers and interrupts for a frame without producing audio
 void SCSP_MidiIn(UINT8);
 void SCSP_MidiOutW(UINT8);
 UINT8 SCSP_MidiOutFill();
 UINT8 SCSP_MidiInFill();
+void SCSP_MidiOverflows(unsigned *inDropped, unsigned *outDropped);	// bytes dropped because a FIFO was full
 void SCSP_CpuRunScanline();
 UINT8 SCSP_MidiOutR();
 
 /*
  * SCSP_Init(n):
  *
- * Initializes the SCSPs, allocates internal memory, and creates a mutex for 
- * MIDI FIFO access. Call SCSP_SetCB() and SCSP_SetBuffers() before calling
- * this.
+ * Initializes the SCSPs and allocates internal memory. Call SCSP_SetCB() and
+ * SCSP_SetBuffers() before calling this.
  *
  * Parameters:
  *		n	Number of SCSPs to create. Always use 2! 
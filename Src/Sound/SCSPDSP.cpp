@@ -208,62 +208,150 @@ void SCSPDSP_Init(_SCSPDSP *DSP)
 	DSP->RBL = (8 * 1024); // Initial RBL is 0
 	DSP->Stopped = 1;
 }
-//#ifndef DYNDSP
-void SCSPDSP_Step(_SCSPDSP *DSP)
+
+/*
+ * SCSPDSP_Decode(DSP):
+ *
+ * Decodes the steps of MPRO up to LastStep into Ops, leaving out those that
+ * have no effect. A step's only effect can be on ACC, which is read by the
+ * next step through BSEL or the shifter, so the steps are gone through last
+ * to first, keeping those with side effects and those whose ACC is read.
+ */
+static void SCSPDSP_Decode(_SCSPDSP *DSP)
 {
-	INT32 ACC = 0;    //26 bit
-	INT32 SHIFTED = 0;    //24 bit
-	INT32 X = 0;  //24 bit
-	INT32 Y = 0;  //13 bit
-	INT32 B = 0;  //26 bit
-	INT32 INPUTS = 0; //24 bit
-	INT32 MEMVAL = 0;
-	INT32 FRC_REG = 0;    //13 bit
-	INT32 Y_REG = 0;      //24 bit
-	UINT32 ADDR = 0;
-	UINT32 ADRS_REG = 0;  //13 bit
+	bool keep[128];
+	bool ACCRead = false;	//by the step after
 	int step;
 
-	if (DSP->Stopped)
-		return;
-
-	memset(DSP->EFREG, 0, 2 * 16);
-	for (step = 0; step </*128*/DSP->LastStep; ++step)
+	for (step = DSP->LastStep - 1; step >= 0; --step)
 	{
 		UINT16 *IPtr = DSP->MPRO + step * 4;
 
-		//		if(IPtr[0]==0 && IPtr[1]==0 && IPtr[2]==0 && IPtr[3]==0)
-		//			break;
-
-		UINT32 TRA = (IPtr[0] >> 8) & 0x7F;
 		UINT32 TWT = (IPtr[0] >> 7) & 0x01;
-		UINT32 TWA = (IPtr[0] >> 0) & 0x7F;
-
-		UINT32 XSEL = (IPtr[1] >> 15) & 0x01;
-		UINT32 YSEL = (IPtr[1] >> 13) & 0x03;
 		UINT32 IRA = (IPtr[1] >> 6) & 0x3F;
 		UINT32 IWT = (IPtr[1] >> 5) & 0x01;
-		UINT32 IWA = (IPtr[1] >> 0) & 0x1F;
-
-		UINT32 TABLE = (IPtr[2] >> 15) & 0x01;
 		UINT32 MWT = (IPtr[2] >> 14) & 0x01;
 		UINT32 MRD = (IPtr[2] >> 13) & 0x01;
 		UINT32 EWT = (IPtr[2] >> 12) & 0x01;
-		UINT32 EWA = (IPtr[2] >> 8) & 0x0F;
 		UINT32 ADRL = (IPtr[2] >> 7) & 0x01;
 		UINT32 FRCL = (IPtr[2] >> 6) & 0x01;
 		UINT32 SHIFT = (IPtr[2] >> 4) & 0x03;
 		UINT32 YRL = (IPtr[2] >> 3) & 0x01;
-		UINT32 NEGB = (IPtr[2] >> 2) & 0x01;
 		UINT32 ZERO = (IPtr[2] >> 1) & 0x01;
 		UINT32 BSEL = (IPtr[2] >> 0) & 0x01;
 
-		UINT32 NOFL = (IPtr[3] >> 15) & 0x01;	//????
-		UINT32 COEF = (IPtr[3] >> 9) & 0x3f;
+		bool memory = (MRD || MWT) && (step & 1);
+		bool shiftedUsed = TWT || FRCL || (MWT && (step & 1)) || (ADRL && SHIFT == 3) || EWT;
+
+		//IRA past the inputs stops the program
+		keep[step] = TWT || IWT || EWT || ADRL || FRCL || YRL || memory || IRA > 0x31 || ACCRead;
+		ACCRead = keep[step] && (shiftedUsed || (ACCRead && !ZERO && BSEL));
+	}
 
-		UINT32 MASA = (IPtr[3] >> 2) & 0x1f;	//???
-		UINT32 ADREB = (IPtr[3] >> 1) & 0x01;
-		UINT32 NXADR = (IPtr[3] >> 0) & 0x01;
+	DSP->NumOps = 0;
+	for (step = 0; step < DSP->LastStep; ++step)
+	{
+		if (!keep[step])
+			continue;
+
+		UINT16 *IPtr = DSP->MPRO + step * 4;
+		_SCSPDSPOp *op = DSP->Ops + DSP->NumOps++;
+
+		op->STEP = step;
+		op->TRA = (IPtr[0] >> 8) & 0x7F;
+		op->TWT = (IPtr[0] >> 7) & 0x01;
+		op->TWA = (IPtr[0] >> 0) & 0x7F;
+
+		op->XSEL = (IPtr[1] >> 15) & 0x01;
+		op->YSEL = (IPtr[1] >> 13) & 0x03;
+		op->IRA = (IPtr[1] >> 6) & 0x3F;
+		op->IWT = (IPtr[1] >> 5) & 0x01;
+		op->IWA = (IPtr[1] >> 0) & 0x1F;
+
+		op->TABLE = (IPtr[2] >> 15) & 0x01;
+		op->MWT = (IPtr[2] >> 14) & 0x01;
+		op->MRD = (IPtr[2] >> 13) & 0x01;
+		op->EWT = (IPtr[2] >> 12) & 0x01;
+		op->EWA = (IPtr[2] >> 8) & 0x0F;
+		op->ADRL = (IPtr[2] >> 7) & 0x01;
+		op->FRCL = (IPtr[2] >> 6) & 0x01;
+		op->SHIFT = (IPtr[2] >> 4) & 0x03;
+		op->YRL = (IPtr[2] >> 3) & 0x01;
+		op->NEGB = (IPtr[2] >> 2) & 0x01;
+		op->ZERO = (IPtr[2] >> 1) & 0x01;
+		op->BSEL = (IPtr[2] >> 0) & 0x01;
+
+		op->NOFL = (IPtr[3] >> 15) & 0x01;
+		op->COEF = (IPtr[3] >> 9) & 0x3f;
+		op->MASA = (IPtr[3] >> 2) & 0x1f;
+		op->ADREB = (IPtr[3] >> 1) & 0x01;
+		op->NXADR = (IPtr[3] >> 0) & 0x01;
+	}
+
+	DSP->ProgramDirty = false;
+}
+
+//#ifndef DYNDSP
+void SCSPDSP_Step(_SCSPDSP *DSP)
+{
+	INT32 ACC = 0;    //26 bit
+	INT32 SHIFTED = 0;    //24 bit
+	INT32 X = 0;  //24 bit
+	INT32 Y = 0;  //13 bit
+	INT32 B = 0;  //26 bit
+	INT32 INPUTS = 0; //24 bit
+	INT32 MEMVAL = 0;
+	INT32 FRC_REG = 0;    //13 bit
+	INT32 Y_REG = 0;      //24 bit
+	UINT32 ADDR = 0;
+	UINT32 ADRS_REG = 0;  //13 bit
+	int i;
+
+	if (DSP->Stopped)
+		return;
+
+	if (DSP->ProgramDirty)
+		SCSPDSP_Decode(DSP);
+
+	//ring buffer addressing, fixed for the whole program
+	UINT32 RBMASK = DSP->RBL - 1;
+	UINT32 RBBASE = DSP->RBP << 12;
+
+	memset(DSP->EFREG, 0, 2 * 16);
+	for (i = 0; i < DSP->NumOps; ++i)
+	{
+		const _SCSPDSPOp *op = DSP->Ops + i;
+		int step = op->STEP;
+
+		UINT32 TRA = op->TRA;
+		UINT32 TWT = op->TWT;
+		UINT32 TWA = op->TWA;
+
+		UINT32 XSEL = op->XSEL;
+		UINT32 YSEL = op->YSEL;
+		UINT32 IRA = op->IRA;
+		UINT32 IWT = op->IWT;
+		UINT32 IWA = op->IWA;
+
+		UINT32 TABLE = op->TABLE;
+		UINT32 MWT = op->MWT;
+		UINT32 MRD = op->MRD;
+		UINT32 EWT = op->EWT;
+		UINT32 EWA = op->EWA;
+		UINT32 ADRL = op->ADRL;
+		UINT32 FRCL = op->FRCL;
+		UINT32 SHIFT = op->SHIFT;
+		UINT32 YRL = op->YRL;
+		UINT32 NEGB = op->NEGB;
+		UINT32 ZERO = op->ZERO;
+		UINT32 BSEL = op->BSEL;
+
+		UINT32 NOFL = op->NOFL;	//????
+		UINT32 COEF = op->COEF;
+
+		UINT32 MASA = op->MASA;	//???
+		UINT32 ADREB = op->ADREB;
+		UINT32 NXADR = op->NXADR;
 
 		INT64 v;
 
@@ -410,13 +498,13 @@ void SCSPDSP_Step(_SCSPDSP *DSP)
 			if (NXADR)
 				ADDR++;
 			if (!TABLE)
-				ADDR &= DSP->RBL - 1;
+				ADDR &= RBMASK;
 			else
 				ADDR &= 0xFFFF;
 			//ADDR<<=1;
 			//ADDR+=DSP->RBP<<13;
 			//MEMVAL=DSP->SCSPRAM[ADDR>>1];
-			ADDR += DSP->RBP << 12;
+			ADDR += RBBASE;
 			if (ADDR > 0x7ffff) ADDR = 0;
 			if (MRD && (step & 1)) //memory only allowed on odd? DoA inserts NOPs on even
 			{
@@ -470,6 +558,7 @@ void SCSPDSP_Start(_SCSPDSP *DSP)
 			break;
 	}
 	DSP->LastStep = i + 1;
+	DSP->ProgramDirty = true;
 
 /*
 	int test=0;
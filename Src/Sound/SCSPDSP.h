@@ -33,6 +33,16 @@
 #define DYNOPT	1		//set to 1 to enable optimization of recompiler
 
 
+//a step of the microprogram, decoded
+struct _SCSPDSPOp
+{
+	UINT8 STEP;	//index in MPRO, memory is only accessed on odd steps
+	UINT8 TRA, TWT, TWA;
+	UINT8 XSEL, YSEL, IRA, IWT, IWA;
+	UINT8 TABLE, MWT, MRD, EWT, EWA, ADRL, FRCL, SHIFT, YRL, NEGB, ZERO, BSEL;
+	UINT8 NOFL, COEF, MASA, ADREB, NXADR;
+};
+
 //the DSP Context
 struct _SCSPDSP
 {
@@ -60,6 +70,11 @@ struct _SCSPDSP
 	
 	bool Stopped;
 	int LastStep;
+
+//decoded program, without the steps that have no effect
+	_SCSPDSPOp Ops[128];
+	int NumOps;
+	bool ProgramDirty;	//MPRO has changed since it was decoded
 #ifdef DYNDSP
 	INT32 ACC;	//26 bit
 	INT32 SHIFTED;	//24 bit
@@ -35,8 +35,7 @@ struct _LFO
 {
 	unsigned short phase;
 	UINT32 phase_step;
-	int *table;
-	int *scale;
+	int *table;	// waveform through the depth scale, ready to use
 };
 
 #define LFIX(v)	((unsigned int) ((float) (1<<LFO_SHIFT)*(v)))
@@ -56,6 +55,10 @@ static float PSCALE[8] = { 0.0,7.0,13.5,27.0,55.0,112.0,230.0,494 };
 static int PSCALES[8][256];
 static int ASCALES[8][256];
 
+// Every waveform at every depth, so a step is a single lookup
+static int PLFO_WAVES[4][8][256];
+static int ALFO_WAVES[4][8][256];
+
 void LFO_Init(void)
 {
 	int i, s;
@@ -123,30 +126,38 @@ void LFO_Init(void)
 			ASCALES[s][i] = DB(((limit*(float)i) / 256.0));
 		}
 	}
+
+	const int *pwaves[4] = { PLFO_SAW, PLFO_SQR, PLFO_TRI, PLFO_NOI };
+	const int *awaves[4] = { ALFO_SAW, ALFO_SQR, ALFO_TRI, ALFO_NOI };
+	for (int w = 0; w < 4; ++w)
+	{
+		for (s = 0; s < 8; ++s)
+		{
+			for (i = 0; i < 256; ++i)
+			{
+				PLFO_WAVES[w][s][i] = PSCALES[s][pwaves[w][i] + 128] << (SHIFT - LFO_SHIFT);
+				ALFO_WAVES[w][s][i] = ASCALES[s][awaves[w][i]] << (SHIFT - LFO_SHIFT);
+			}
+		}
+	}
 }
 
 signed int INLINE PLFO_Step(struct _LFO *LFO)
 {
-	int p;
 	LFO->phase += LFO->phase_step;
 #if LFO_SHIFT!=8    
 	LFO->phase &= (1 << (LFO_SHIFT + 8)) - 1;
 #endif    
-	p = LFO->table[LFO->phase >> LFO_SHIFT];
-	p = LFO->scale[p + 128];
-	return p << (SHIFT - LFO_SHIFT);
+	return LFO->table[LFO->phase >> LFO_SHIFT];
 }
 
 signed int INLINE ALFO_Step(struct _LFO *LFO)
 {
-	int p;
 	LFO->phase += LFO->phase_step;
 #if LFO_SHIFT!=8    
 	LFO->phase &= (1 << (LFO_SHIFT + 8)) - 1;
 #endif    
-	p = LFO->table[LFO->phase >> LFO_SHIFT];
-	p = LFO->scale[p];
-	return p << (SHIFT - LFO_SHIFT);
+	return LFO->table[LFO->phase >> LFO_SHIFT];
 }
 
 void LFO_ComputeStep(struct _LFO *LFO, UINT32 LFOF, UINT32 LFOWS, UINT32 LFOS, int ALFO)
@@ -154,25 +165,7 @@ void LFO_ComputeStep(struct _LFO *LFO, UINT32 LFOF, UINT32 LFOWS, UINT32 LFOS, i
 	float step = (float)LFOFreq[LFOF] * 256.0 / (float)44100.0;
 	LFO->phase_step = (unsigned int)((float)(1 << LFO_SHIFT)*step);
 	if (ALFO)
-	{
-		switch (LFOWS)
-		{
-		case 0: LFO->table = ALFO_SAW; break;
-		case 1: LFO->table = ALFO_SQR; break;
-		case 2: LFO->table = ALFO_TRI; break;
-		case 3: LFO->table = ALFO_NOI; break;
-		}
-		LFO->scale = ASCALES[LFOS];
-	}
+		LFO->table = ALFO_WAVES[LFOWS & 3][LFOS & 7];
 	else
-	{
-		switch (LFOWS)
-		{
-		case 0: LFO->table = PLFO_SAW; break;
-		case 1: LFO->table = PLFO_SQR; break;
-		case 2: LFO->table = PLFO_TRI; break;
-		case 3: LFO->table = PLFO_NOI; break;
-		}
-		LFO->scale = PSCALES[LFOS];
-	}
+		LFO->table = PLFO_WAVES[LFOWS & 3][LFOS & 7];
 }
\ No newline at end of file
@@ -0,0 +1,281 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * SCSPMix.cpp
+ *
+ * Mixing of SCSP slot samples, 8 (AVX2) or 4 (SSE4.1, NEON) slots at a time.
+ * The integer steps are the same multiplies and arithmetic shifts as the
+ * scalar code, and the balance is applied in single precision and truncated
+ * as C does, so every implementation gives exactly the same output.
+ */
+
+#include "SCSPMix.h"
+#include "Util/CPUFeatures.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCSPMIX_X86
+#elif defined(__ARM_NEON)
+#define SCSPMIX_NEON
+#endif
+
+#if defined(SCSPMIX_X86)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define SSE41_TARGET
+#define AVX2_TARGET
+#else
+#define SSE41_TARGET __attribute__((target("sse4.1")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#elif defined(SCSPMIX_NEON)
+#include <arm_neon.h>
+#endif
+
+
+/******************************************************************************
+ Scalar
+******************************************************************************/
+
+// Mixes slots [first,count), as SCSP_DoMasterSamples() did one slot at a time
+static void MixSlotsScalar(SCSPSlotBatch *b, int first, int count, float balance, int32_t *left, int32_t *right)
+{
+	for (int i = first; i < count; i++)
+	{
+		int32_t sample = SCSPMix_SlotSample(b->s1[i], b->s2[i], b->fpart[i], b->sbctl[i], b->alfo[i], b->eg[i]);
+		b->ring[i] = (sample * b->ringLevel[i]) >> 13;
+		sample = (int)(balance * (float)sample);
+		b->dsp[i] = (sample * b->dspLevel[i]) >> 10;
+		*left += (sample * b->leftLevel[i]) >> 12;
+		*right += (sample * b->rightLevel[i]) >> 12;
+	}
+}
+
+static void MixSlotsScalar(SCSPSlotBatch *b, int count, float balance, int32_t *left, int32_t *right)
+{
+	MixSlotsScalar(b, 0, count, balance, left, right);
+}
+
+
+/******************************************************************************
+ AVX2 and SSE4.1
+******************************************************************************/
+
+#if defined(SCSPMIX_X86)
+
+AVX2_TARGET static void MixSlotsAVX2(SCSPSlotBatch *b, int count, float balance, int32_t *left, int32_t *right)
+{
+	const __m256i one = _mm256_set1_epi32(1 << 12);
+	const __m256i bit0 = _mm256_set1_epi32(1);
+	const __m256i bit1 = _mm256_set1_epi32(2);
+	const __m256i reverse = _mm256_set1_epi32(0x7FFF);
+	const __m256i sign = _mm256_set1_epi32(0x8000);
+	const __m256 bal = _mm256_set1_ps(balance);
+	__m256i sumLeft = _mm256_setzero_si256();
+	__m256i sumRight = _mm256_setzero_si256();
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+#define LOAD(a) _mm256_loadu_si256((const __m256i *) &b->a[i])
+		__m256i fpart = LOAD(fpart);
+		__m256i x = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(LOAD(s1), _mm256_sub_epi32(one, fpart)), _mm256_mullo_epi32(LOAD(s2), fpart)), 12);
+
+		__m256i sbctl = LOAD(sbctl);
+		__m256i reverseData = _mm256_cmpeq_epi32(_mm256_and_si256(sbctl, bit0), bit0);
+		__m256i reverseSign = _mm256_cmpeq_epi32(_mm256_and_si256(sbctl, bit1), bit1);
+		x = _mm256_xor_si256(x, _mm256_and_si256(reverseData, reverse));
+		__m256i flipped = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_xor_si256(x, sign), 16), 16);	// (INT16) (x ^ 0x8000)
+		x = _mm256_blendv_epi8(x, flipped, reverseSign);
+
+		x = _mm256_srai_epi32(_mm256_mullo_epi32(x, LOAD(alfo)), 12);
+		x = _mm256_srai_epi32(_mm256_mullo_epi32(x, LOAD(eg)), 12);
+		_mm256_storeu_si256((__m256i *) &b->ring[i], _mm256_srai_epi32(_mm256_mullo_epi32(x, LOAD(ringLevel)), 13));
+
+		x = _mm256_cvttps_epi32(_mm256_mul_ps(bal, _mm256_cvtepi32_ps(x)));
+		_mm256_storeu_si256((__m256i *) &b->dsp[i], _mm256_srai_epi32(_mm256_mullo_epi32(x, LOAD(dspLevel)), 10));
+		sumLeft = _mm256_add_epi32(sumLeft, _mm256_srai_epi32(_mm256_mullo_epi32(x, LOAD(leftLevel)), 12));
+		sumRight = _mm256_add_epi32(sumRight, _mm256_srai_epi32(_mm256_mullo_epi32(x, LOAD(rightLevel)), 12));
+#undef LOAD
+	}
+
+	alignas(32) int32_t sums[2][8];
+	_mm256_store_si256((__m256i *) sums[0], sumLeft);
+	_mm256_store_si256((__m256i *) sums[1], sumRight);
+	_mm256_zeroupper();	// the scalar tail is SSE code
+	for (int j = 0; j < 8; j++)
+	{
+		*left += sums[0][j];
+		*right += sums[1][j];
+	}
+
+	MixSlotsScalar(b, i, count, balance, left, right);
+}
+
+SSE41_TARGET static void MixSlotsSSE41(SCSPSlotBatch *b, int count, float balance, int32_t *left, int32_t *right)
+{
+	const __m128i one = _mm_set1_epi32(1 << 12);
+	const __m128i bit0 = _mm_set1_epi32(1);
+	const __m128i bit1 = _mm_set1_epi32(2);
+	const __m128i reverse = _mm_set1_epi32(0x7FFF);
+	const __m128i sign = _mm_set1_epi32(0x8000);
+	const __m128 bal = _mm_set1_ps(balance);
+	__m128i sumLeft = _mm_setzero_si128();
+	__m128i sumRight = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+#define LOAD(a) _mm_loadu_si128((const __m128i *) &b->a[i])
+		__m128i fpart = LOAD(fpart);
+		__m128i x = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(LOAD(s1), _mm_sub_epi32(one, fpart)), _mm_mullo_epi32(LOAD(s2), fpart)), 12);
+
+		__m128i sbctl = LOAD(sbctl);
+		__m128i reverseData = _mm_cmpeq_epi32(_mm_and_si128(sbctl, bit0), bit0);
+		__m128i reverseSign = _mm_cmpeq_epi32(_mm_and_si128(sbctl, bit1), bit1);
+		x = _mm_xor_si128(x, _mm_and_si128(reverseData, reverse));
+		__m128i flipped = _mm_srai_epi32(_mm_slli_epi32(_mm_xor_si128(x, sign), 16), 16);
+		x = _mm_blendv_epi8(x, flipped, reverseSign);
+
+		x = _mm_srai_epi32(_mm_mullo_epi32(x, LOAD(alfo)), 12);
+		x = _mm_srai_epi32(_mm_mullo_epi32(x, LOAD(eg)), 12);
+		_mm_storeu_si128((__m128i *) &b->ring[i], _mm_srai_epi32(_mm_mullo_epi32(x, LOAD(ringLevel)), 13));
+
+		x = _mm_cvttps_epi32(_mm_mul_ps(bal, _mm_cvtepi32_ps(x)));
+		_mm_storeu_si128((__m128i *) &b->dsp[i], _mm_srai_epi32(_mm_mullo_epi32(x, LOAD(dspLevel)), 10));
+		sumLeft = _mm_add_epi32(sumLeft, _mm_srai_epi32(_mm_mullo_epi32(x, LOAD(leftLevel)), 12));
+		sumRight = _mm_add_epi32(sumRight, _mm_srai_epi32(_mm_mullo_epi32(x, LOAD(rightLevel)), 12));
+#undef LOAD
+	}
+
+	alignas(16) int32_t sums[2][4];
+	_mm_store_si128((__m128i *) sums[0], sumLeft);
+	_mm_store_si128((__m128i *) sums[1], sumRight);
+	for (int j = 0; j < 4; j++)
+	{
+		*left += sums[0][j];
+		*right += sums[1][j];
+	}
+
+	MixSlotsScalar(b, i, count, balance, left, right);
+}
+
+#endif	// SCSPMIX_X86
+
+
+/******************************************************************************
+ NEON
+******************************************************************************/
+
+#if defined(SCSPMIX_NEON)
+
+static void MixSlotsNEON(SCSPSlotBatch *b, int count, float balance, int32_t *left, int32_t *right)
+{
+	const int32x4_t one = vdupq_n_s32(1 << 12);
+	const int32x4_t bit0 = vdupq_n_s32(1);
+	const int32x4_t bit1 = vdupq_n_s32(2);
+	const int32x4_t reverse = vdupq_n_s32(0x7FFF);
+	const int32x4_t sign = vdupq_n_s32(0x8000);
+	int32x4_t sumLeft = vdupq_n_s32(0);
+	int32x4_t sumRight = vdupq_n_s32(0);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+#define LOAD(a) vld1q_s32(&b->a[i])
+		int32x4_t fpart = LOAD(fpart);
+		int32x4_t x = vshrq_n_s32(vaddq_s32(vmulq_s32(LOAD(s1), vsubq_s32(one, fpart)), vmulq_s32(LOAD(s2), fpart)), 12);
+
+		int32x4_t sbctl = LOAD(sbctl);
+		uint32x4_t reverseSign = vtstq_s32(sbctl, bit1);
+		x = veorq_s32(x, vandq_s32(vreinterpretq_s32_u32(vtstq_s32(sbctl, bit0)), reverse));
+		int32x4_t flipped = vshrq_n_s32(vshlq_n_s32(veorq_s32(x, sign), 16), 16);
+		x = vbslq_s32(reverseSign, flipped, x);
+
+		x = vshrq_n_s32(vmulq_s32(x, LOAD(alfo)), 12);
+		x = vshrq_n_s32(vmulq_s32(x, LOAD(eg)), 12);
+		vst1q_s32(&b->ring[i], vshrq_n_s32(vmulq_s32(x, LOAD(ringLevel)), 13));
+
+		x = vcvtq_s32_f32(vmulq_n_f32(vcvtq_f32_s32(x), balance));	// rounds toward zero, like the C cast
+		vst1q_s32(&b->dsp[i], vshrq_n_s32(vmulq_s32(x, LOAD(dspLevel)), 10));
+		sumLeft = vaddq_s32(sumLeft, vshrq_n_s32(vmulq_s32(x, LOAD(leftLevel)), 12));
+		sumRight = vaddq_s32(sumRight, vshrq_n_s32(vmulq_s32(x, LOAD(rightLevel)), 12));
+#undef LOAD
+	}
+
+	int32_t sums[2][4];
+	vst1q_s32(sums[0], sumLeft);
+	vst1q_s32(sums[1], sumRight);
+	for (int j = 0; j < 4; j++)
+	{
+		*left += sums[0][j];
+		*right += sums[1][j];
+	}
+
+	MixSlotsScalar(b, i, count, balance, left, right);
+}
+
+#endif	// SCSPMIX_NEON
+
+
+/******************************************************************************
+ Dispatch
+******************************************************************************/
+
+struct Implementation
+{
+	const char *name;
+	uint32_t features;	// needed by the CPU
+	void (*mixSlots)(SCSPSlotBatch *b, int count, float balance, int32_t *left, int32_t *right);
+};
+
+static const Implementation s_implementations[] =	// best first
+{
+#if defined(SCSPMIX_X86)
+	{ "avx2",	Util::CPUFeatures::AVX2,	MixSlotsAVX2 },
+	{ "sse4.1",	Util::CPUFeatures::SSE41,	MixSlotsSSE41 },
+#endif
+#if defined(SCSPMIX_NEON)
+	{ "neon",	Util::CPUFeatures::NEON,	MixSlotsNEON },
+#endif
+	{ "scalar",	0,							MixSlotsScalar }
+};
+
+static const Implementation *s_current = Util::CPUFeatures::FindBest(s_implementations);
+
+void SCSPMix_Slots(SCSPSlotBatch *batch, int count, float balance, int32_t *left, int32_t *right)
+{
+	s_current->mixSlots(batch, count, balance, left, right);
+}
+
+const char *SCSPMix_GetImplementation(void)
+{
+	return s_current->name;
+}
+
+bool SCSPMix_SetImplementation(const char *name)
+{
+	const Implementation *impl = Util::CPUFeatures::Find(s_implementations, name);
+	if (impl == nullptr)
+		return false;
+	s_current = impl;
+	return true;
+}
@@ -0,0 +1,96 @@
+/**
+ ** Supermodel
+ ** A Sega Model 3 Arcade Emulator.
+ ** Copyright 2011 Bart Trzynadlowski, Nik Henson
+ **
+ ** This file is part of Supermodel.
+ **
+ ** Supermodel is free software: you can redistribute it and/or modify it under
+ ** the terms of the GNU General Public License as published by the Free
+ ** Software Foundation, either version 3 of the License, or (at your option)
+ ** any later version.
+ **
+ ** Supermodel is distributed in the hope that it will be useful, but WITHOUT
+ ** ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ ** FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ ** more details.
+ **
+ ** You should have received a copy of the GNU General Public License along
+ ** with Supermodel.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/*
+ * SCSPMix.h
+ *
+ * Header file for mixing the samples of SCSP slots, with vectorised versions
+ * chosen at run time. Used only by SCSP.cpp; do not use externally.
+ */
+
+#ifndef INCLUDED_SCSPMIX_H
+#define INCLUDED_SCSPMIX_H
+
+#include <cstdint>
+
+
+/*
+ * SCSPMix_SlotSample(s1, s2, fpart, sbctl, alfo, eg):
+ *
+ * Makes a slot's sample: interpolates between the two samples by the 12-bit
+ * fraction fpart, applies the SBCTL bits, and scales the result by the
+ * amplitude LFO and envelope levels (1 << 12 leaves it unchanged).
+ */
+inline int32_t SCSPMix_SlotSample(int32_t s1, int32_t s2, int32_t fpart, int32_t sbctl, int32_t alfo, int32_t eg)
+{
+	int32_t sample = (s1 * ((1 << 12) - fpart) + s2 * fpart) >> 12;
+	if (sbctl & 0x1)
+		sample ^= 0x7FFF;
+	if (sbctl & 0x2)
+		sample = (int16_t)(sample ^ 0x8000);
+	sample = (sample * alfo) >> 12;
+	return (sample * eg) >> 12;
+}
+
+/*
+ * SCSPSlotBatch:
+ *
+ * The slots of an SCSP playing this sample, in structure-of-arrays form so
+ * several are mixed at once. Each slot's sample comes from
+ * SCSPMix_SlotSample(). Its ring buffer value is the sample scaled by
+ * ringLevel; its DSP input and left and right outputs are the sample times the
+ * balance, scaled by dspLevel, leftLevel and rightLevel. Levels are pan table
+ * entries, 0 for outputs a slot doesn't have.
+ */
+struct SCSPSlotBatch
+{
+	// Inputs
+	int32_t	s1[32], s2[32], fpart[32], sbctl[32];
+	int32_t	alfo[32], eg[32];
+	int32_t	ringLevel[32], dspLevel[32], leftLevel[32], rightLevel[32];
+
+	// Outputs
+	int32_t	ring[32];	// (sample * ringLevel) >> 13
+	int32_t	dsp[32];	// (sample * balance * dspLevel) >> 10
+};
+
+/*
+ * SCSPMix_Slots(batch, count, balance, left, right):
+ *
+ * Mixes the first count slots of the batch, filling in their ring buffer
+ * values and DSP inputs and adding their outputs to left and right. The result
+ * is bit-exact with doing each slot in turn on the CPU.
+ */
+void SCSPMix_Slots(SCSPSlotBatch *batch, int count, float balance, int32_t *left, int32_t *right);
+
+/*
+ * SCSPMix_GetImplementation():
+ * SCSPMix_SetImplementation(name):
+ *
+ * Name of the implementation in use ("avx2", "sse4.1", "neon" or "scalar"),
+ * and selection of another (for testing), which fails if the CPU lacks it.
+ * The best supported one is chosen at start up.
+ */
+const char *SCSPMix_GetImplementation(void);
+bool SCSPMix_SetImplementation(const char *name);
+
+
+#endif	// INCLUDED_SCSPMIX_H
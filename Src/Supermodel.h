@@ -119,6 +119,8 @@
 #include "Graphics/Legacy3D/TextureRefs.h"
 #include "Graphics/Legacy3D/Legacy3D.h"
 #include "Graphics/Shader.h"
+#include "Graphics/GPUTimer.h"
+#include "Graphics/ShaderCache.h"
 #ifdef SUPERMODEL_DEBUGGER
 #include "Debugger/SupermodelDebugger.h"
 #include "Debugger/CPU/PPCDebug.h"
@@ -126,6 +128,7 @@
 #include "Debugger/CPU/Z80Debug.h"
 #endif // SUPERMODEL_DEBUGGER
 #include "CPU/Bus.h"
+#include "CPU/ExecTrace.h"
 #include "CPU/PowerPC/PPCDisasm.h"
 #include "CPU/PowerPC/ppc.h"
 #include "CPU/68K/68K.h"
@@ -142,6 +145,7 @@
 #include "Model3/MPC10x.h"
 #include "Model3/RTC72421.h"
 #include "Model3/93C46.h"
+#include "Model3/SnapshotCopier.h"
 #include "Model3/TileGen.h"
 #include "Model3/Real3D.h"
 #include "Sound/SCSP.h"
@@ -0,0 +1,405 @@
+#include "Util/AllocTracker.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <malloc.h>
+#endif
+
+#ifdef _MSC_VER
+#define ALLOC_CALLER() _ReturnAddress()
+#else
+#define ALLOC_CALLER() __builtin_return_address(0)
+#endif
+
+namespace Util
+{
+  namespace AllocTracker
+  {
+    static const int MAX_THREADS = 128;       // threads past this share the last counters
+    static const int SAMPLE_FRAMES = 8;       // kept of each call stack
+    static const size_t MAX_SAMPLES = 4096;   // distinct call stacks, a power of 2
+
+    struct alignas(64) ThreadCounts
+    {
+      std::atomic<uint64_t> allocations[NumSubsystems];
+      std::atomic<uint64_t> bytes[NumSubsystems];
+    };
+
+    struct Sample
+    {
+      uint64_t  hash;       // 0 if unused
+      void      *frames[SAMPLE_FRAMES];
+      int       numFrames;
+      int       subsystem;
+      uint64_t  count;
+    };
+
+    // Everything here is zero before any constructor runs, since allocations
+    // made by static constructors are counted too
+    static ThreadCounts s_threads[MAX_THREADS];
+    static std::atomic<int> s_numThreads;
+    static std::atomic<bool> s_sampling;
+    static std::atomic_flag s_sampleLock = ATOMIC_FLAG_INIT;
+    static Sample s_samples[MAX_SAMPLES];
+    static thread_local int t_subsystem = Other;
+
+    static void LockSamples()
+    {
+      while (s_sampleLock.test_and_set(std::memory_order_acquire))
+        ;
+    }
+
+    static void UnlockSamples()
+    {
+      s_sampleLock.clear(std::memory_order_release);
+    }
+
+#ifdef SUPERMODEL_ALLOC_TRACKING
+    static thread_local int t_slot = -1;
+    static thread_local unsigned t_countdown = SAMPLE_INTERVAL;
+    static thread_local bool t_busy = false;  // in the tracker, whose own allocations (walking the stack) aren't counted
+
+    static void AddSample(void *caller)
+    {
+      void *frames[SAMPLE_FRAMES + 4];
+      int first = 0;
+      int numFrames = 1;
+#if defined(__GLIBC__)
+      // Starting from the caller of the allocation function, the tracker's own frames depending on what was inlined
+      numFrames = backtrace(frames, SAMPLE_FRAMES + 4);
+      for (int i = 0; i < numFrames; i++)
+      {
+        if (frames[i] == caller)
+        {
+          first = i;
+          break;
+        }
+      }
+      numFrames = std::min(numFrames - first, SAMPLE_FRAMES);
+#else
+      frames[0] = caller;
+#endif
+
+      uint64_t hash = 0xCBF29CE484222325ULL ^ uint64_t(t_subsystem);
+      for (int i = 0; i < numFrames; i++)
+        hash = (hash ^ uint64_t(uintptr_t(frames[first + i]))) * 0x100000001B3ULL;
+      hash |= 1;
+
+      LockSamples();
+      for (size_t i = 0; i < MAX_SAMPLES; i++)
+      {
+        Sample &sample = s_samples[(hash + i) & (MAX_SAMPLES - 1)];
+        if (sample.hash == hash)
+        {
+          sample.count++;
+          break;
+        }
+        if (sample.hash == 0)
+        {
+          sample.hash = hash;
+          memcpy(sample.frames, frames + first, numFrames * sizeof(void *));
+          sample.numFrames = numFrames;
+          sample.subsystem = t_subsystem;
+          sample.count = 1;
+          break;
+        }
+      }
+      UnlockSamples();  // samples of new call stacks are dropped once the table is full
+    }
+
+    static void Record(size_t size, void *caller)
+    {
+      if (t_busy)
+        return;
+      t_busy = true;
+      if (t_slot < 0)
+        t_slot = std::min(s_numThreads.fetch_add(1, std::memory_order_relaxed), MAX_THREADS - 1);
+      ThreadCounts &counts = s_threads[t_slot];
+      counts.allocations[t_subsystem].fetch_add(1, std::memory_order_relaxed);
+      counts.bytes[t_subsystem].fetch_add(size, std::memory_order_relaxed);
+      if (s_sampling.load(std::memory_order_relaxed) && --t_countdown == 0)
+      {
+        t_countdown = SAMPLE_INTERVAL;
+        AddSample(caller);
+      }
+      t_busy = false;
+    }
+#endif  // SUPERMODEL_ALLOC_TRACKING
+
+    bool Enabled()
+    {
+#ifdef SUPERMODEL_ALLOC_TRACKING
+      return true;
+#else
+      return false;
+#endif
+    }
+
+    const char *SubsystemName(int subsystem)
+    {
+      static const char *s_names[NumSubsystems] = { "other", "main", "sync", "render", "snd", "drv", "net", "audio", "jobs" };
+      return subsystem >= 0 && subsystem < NumSubsystems ? s_names[subsystem] : "?";
+    }
+
+    void Read(Counts *counts)
+    {
+      memset(counts, 0, sizeof(*counts));
+      int numThreads = std::min(s_numThreads.load(std::memory_order_relaxed), MAX_THREADS);
+      for (int i = 0; i < numThreads; i++)
+      {
+        for (int j = 0; j < NumSubsystems; j++)
+        {
+          counts->allocations[j] += s_threads[i].allocations[j].load(std::memory_order_relaxed);
+          counts->bytes[j] += s_threads[i].bytes[j].load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    void SetThreadSubsystem(Subsystem subsystem)
+    {
+      t_subsystem = subsystem;
+    }
+
+    void StartSampling()
+    {
+      LockSamples();
+      memset(s_samples, 0, sizeof(s_samples));
+      UnlockSamples();
+      s_sampling = Enabled();
+    }
+
+    std::string SampleReport(size_t top)
+    {
+      // Room is made first, since allocating while holding the lock could need it again
+      std::vector<Sample> samples;
+      samples.reserve(MAX_SAMPLES);
+      LockSamples();
+      for (const Sample &sample: s_samples)
+      {
+        if (sample.hash != 0)
+          samples.push_back(sample);
+      }
+      UnlockSamples();
+
+      std::sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b) { return a.count > b.count; });
+      samples.resize(std::min(samples.size(), top));
+
+      std::string report;
+      char line[64];
+      for (const Sample &sample: samples)
+      {
+        snprintf(line, sizeof(line), "%8llu %-6s", (unsigned long long) sample.count, SubsystemName(sample.subsystem));
+        report += line;
+#if defined(__GLIBC__)
+        char **names = backtrace_symbols(const_cast<void **>(sample.frames), sample.numFrames);
+#endif
+        for (int i = 0; i < sample.numFrames; i++)
+        {
+          report += i ? " <- " : " ";
+#if defined(__GLIBC__)
+          if (names)
+          {
+            report += names[i];
+            continue;
+          }
+#endif
+          snprintf(line, sizeof(line), "%p", sample.frames[i]);
+          report += line;
+        }
+#if defined(__GLIBC__)
+        free(names);
+#endif
+        report += '\n';
+      }
+      return report;
+    }
+
+    Scope::Scope(Subsystem subsystem)
+      : m_previous(t_subsystem)
+    {
+      t_subsystem = subsystem;
+    }
+
+    Scope::~Scope()
+    {
+      t_subsystem = m_previous;
+    }
+  } // AllocTracker
+} // Util
+
+
+/******************************************************************************
+ Allocation Hooks
+******************************************************************************/
+
+#ifdef SUPERMODEL_ALLOC_TRACKING
+
+using Util::AllocTracker::Record;
+
+#if defined(__GLIBC__)
+
+// glibc's own entry points, so that malloc can be replaced while still being
+// the allocator underneath
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+  void *ptr = __libc_malloc(size);
+  if (ptr)
+    Record(size, ALLOC_CALLER());
+  return ptr;
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  void *ptr = __libc_calloc(count, size);
+  if (ptr)
+    Record(count * size, ALLOC_CALLER());
+  return ptr;
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  void *newPtr = __libc_realloc(ptr, size);
+  if (newPtr && size)
+    Record(size, ALLOC_CALLER());
+  return newPtr;
+}
+
+static void *RawAlloc(size_t size)
+{
+  return __libc_malloc(size);
+}
+
+static void *RawAlignedAlloc(size_t size, size_t alignment)
+{
+  return __libc_memalign(alignment, size);
+}
+
+static void RawAlignedFree(void *ptr)
+{
+  free(ptr);
+}
+
+#else
+
+static void *RawAlloc(size_t size)
+{
+  return malloc(size);
+}
+
+static void *RawAlignedAlloc(size_t size, size_t alignment)
+{
+#ifdef _MSC_VER
+  return _aligned_malloc(size, alignment);
+#else
+  void *ptr = nullptr;
+  return posix_memalign(&ptr, std::max(alignment, sizeof(void *)), size) == 0 ? ptr : nullptr;
+#endif
+}
+
+static void RawAlignedFree(void *ptr)
+{
+#ifdef _MSC_VER
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+#endif  // __GLIBC__
+
+static void *TrackedNew(size_t size, void *caller)
+{
+  void *ptr = RawAlloc(size ? size : 1);
+  if (ptr)
+    Record(size, caller);
+  return ptr;
+}
+
+static void *TrackedAlignedNew(size_t size, std::align_val_t alignment, void *caller)
+{
+  void *ptr = RawAlignedAlloc(size ? size : 1, size_t(alignment));
+  if (ptr)
+    Record(size, caller);
+  return ptr;
+}
+
+void *operator new(size_t size)
+{
+  void *ptr = TrackedNew(size, ALLOC_CALLER());
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size)
+{
+  void *ptr = TrackedNew(size, ALLOC_CALLER());
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  return TrackedNew(size, ALLOC_CALLER());
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return TrackedNew(size, ALLOC_CALLER());
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+  void *ptr = TrackedAlignedNew(size, alignment, ALLOC_CALLER());
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+  void *ptr = TrackedAlignedNew(size, alignment, ALLOC_CALLER());
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+  return TrackedAlignedNew(size, alignment, ALLOC_CALLER());
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+  return TrackedAlignedNew(size, alignment, ALLOC_CALLER());
+}
+
+void operator delete(void *ptr) noexcept                                              { free(ptr); }
+void operator delete[](void *ptr) noexcept                                            { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept                                      { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept                                    { free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept                      { free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept                    { free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept                            { RawAlignedFree(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept                          { RawAlignedFree(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept                    { RawAlignedFree(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept                  { RawAlignedFree(ptr); }
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept    { RawAlignedFree(ptr); }
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept  { RawAlignedFree(ptr); }
+
+#endif  // SUPERMODEL_ALLOC_TRACKING
@@ -0,0 +1,92 @@
+#ifndef INCLUDED_UTIL_ALLOCTRACKER_H
+#define INCLUDED_UTIL_ALLOCTRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Util
+{
+  /*
+   * Counts the heap allocations made by each thread, by the subsystem it is
+   * working for at the time, so that allocations made every frame once a game
+   * has warmed up can be found and removed.
+   *
+   * The global operator new (and, with glibc, malloc, calloc and realloc) are
+   * replaced to do the counting, which is only compiled in when
+   * SUPERMODEL_ALLOC_TRACKING is defined (ENABLE_ALLOC_TRACKING=1 in
+   * Makefiles/Options.inc). Otherwise every count stays 0.
+   *
+   * Once sampling is started, the call stack of every SAMPLE_INTERVAL-th
+   * allocation a thread makes is kept, so the most frequent call sites can be
+   * listed. Where the stack can't be walked (anything but glibc), only the
+   * caller of operator new is kept. Addresses are only named if the
+   * executable exports its symbols (-rdynamic); otherwise they are offsets to
+   * give to addr2line.
+   */
+  namespace AllocTracker
+  {
+    enum Subsystem
+    {
+      Other,        // not in a scope, the main loop and UI among others
+      MainBoard,
+      Sync,
+      Render,
+      SoundBoard,
+      DriveBoard,
+      NetBoard,
+      Audio,        // audio output callback
+      Jobs,         // job system workers, outside the scope of a caller
+      NumSubsystems
+    };
+
+    struct Counts
+    {
+      uint64_t allocations[NumSubsystems];
+      uint64_t bytes[NumSubsystems];
+    };
+
+    static const unsigned SAMPLE_INTERVAL = 16;
+
+    // True if allocations are being counted in this build
+    bool Enabled();
+
+    const char *SubsystemName(int subsystem);
+
+    // Totals over all threads since the program started
+    void Read(Counts *counts);
+
+    // Subsystem of the calling thread's allocations outside of any Scope
+    void SetThreadSubsystem(Subsystem subsystem);
+
+    // Starts keeping call stacks (usually once the game has warmed up),
+    // clearing any kept before
+    void StartSampling();
+
+    // The top most sampled call sites, one per line, each with its sample
+    // count, subsystem and frames
+    std::string SampleReport(size_t top);
+
+    // Attributes the calling thread's allocations to a subsystem while it
+    // is alive
+    class Scope
+    {
+    public:
+      Scope(Subsystem subsystem);
+      ~Scope();
+
+    private:
+      int m_previous;
+    };
+  } // AllocTracker
+} // Util
+
+#ifdef SUPERMODEL_ALLOC_TRACKING
+#define ALLOC_SCOPE_CONCAT2(a, b)  a##b
+#define ALLOC_SCOPE_CONCAT(a, b)   ALLOC_SCOPE_CONCAT2(a, b)
+#define ALLOC_SCOPE(subsystem)     Util::AllocTracker::Scope ALLOC_SCOPE_CONCAT(allocScope, __LINE__)(Util::AllocTracker::subsystem)
+#else
+#define ALLOC_SCOPE(subsystem)
+#endif
+
+#endif  // INCLUDED_UTIL_ALLOCTRACKER_H
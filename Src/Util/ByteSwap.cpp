@@ -1,4 +1,18 @@
 #include "Util/ByteSwap.h"
+#include "Util/CPUFeatures.h"
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BYTESWAP_X86
+#include <tmmintrin.h>
+#if defined(_MSC_VER)
+#define SSSE3_TARGET
+#else
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+#elif defined(__ARM_NEON)
+#define BYTESWAP_NEON
+#include <arm_neon.h>
+#endif
 
 namespace Util
 {
@@ -24,4 +38,96 @@ namespace Util
       buffer[i+3] = tmp1;
     }
   }
+
+  // Swaps the words left over after the vectors
+  static void CopyFlipEndian32Tail(uint8_t *dest, const uint8_t *src, size_t i, size_t size)
+  {
+    for (; i + 4 <= size; i += 4)
+    {
+      uint32_t w;
+      memcpy(&w, &src[i], 4);
+      w = (w >> 24) | ((w >> 8) & 0xFF00) | ((w << 8) & 0xFF0000) | (w << 24);
+      memcpy(&dest[i], &w, 4);
+    }
+  }
+
+  static void CopyFlipEndian32Scalar(uint8_t *dest, const uint8_t *src, size_t size)
+  {
+    CopyFlipEndian32Tail(dest, src, 0, size);
+  }
+
+#if defined(BYTESWAP_X86)
+  SSSE3_TARGET static void CopyFlipEndian32SSSE3(uint8_t *dest, const uint8_t *src, size_t size)
+  {
+    const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) &src[i]);
+      _mm_storeu_si128((__m128i *) &dest[i], _mm_shuffle_epi8(v, mask));
+    }
+    CopyFlipEndian32Tail(dest, src, i, size);
+  }
+
+  static void CopyFlipEndian32SSE2(uint8_t *dest, const uint8_t *src, size_t size)
+  {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+      // Swap bytes within each 16-bit half, then swap the halves
+      __m128i v = _mm_loadu_si128((const __m128i *) &src[i]);
+      v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+      v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+      _mm_storeu_si128((__m128i *) &dest[i], v);
+    }
+    CopyFlipEndian32Tail(dest, src, i, size);
+  }
+#elif defined(BYTESWAP_NEON)
+  static void CopyFlipEndian32NEON(uint8_t *dest, const uint8_t *src, size_t size)
+  {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+      vst1q_u8(&dest[i], vrev32q_u8(vld1q_u8(&src[i])));
+    CopyFlipEndian32Tail(dest, src, i, size);
+  }
+#endif
+
+  struct ByteSwapImplementation
+  {
+    const char *name;
+    uint32_t features;  // needed by the CPU
+    void (*copyFlipEndian32)(uint8_t *dest, const uint8_t *src, size_t size);
+  };
+
+  static const ByteSwapImplementation s_implementations[] = // best first
+  {
+#if defined(BYTESWAP_X86)
+    { "ssse3",  CPUFeatures::SSSE3, CopyFlipEndian32SSSE3 },
+    { "sse2",   CPUFeatures::SSE2,  CopyFlipEndian32SSE2 },
+#elif defined(BYTESWAP_NEON)
+    { "neon",   CPUFeatures::NEON,  CopyFlipEndian32NEON },
+#endif
+    { "scalar", 0,                  CopyFlipEndian32Scalar }
+  };
+
+  static const ByteSwapImplementation *s_current = CPUFeatures::FindBest(s_implementations);
+
+  void CopyFlipEndian32(uint8_t *dest, const uint8_t *src, size_t size)
+  {
+    s_current->copyFlipEndian32(dest, src, size);
+  }
+
+  const char *GetByteSwapImplementation()
+  {
+    return s_current->name;
+  }
+
+  bool SetByteSwapImplementation(const char *name)
+  {
+    const ByteSwapImplementation *impl = CPUFeatures::Find(s_implementations, name);
+    if (impl == nullptr)
+      return false;
+    s_current = impl;
+    return true;
+  }
 } // Util
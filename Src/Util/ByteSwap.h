@@ -8,6 +8,15 @@ namespace Util
 {
   void FlipEndian16(uint8_t *buffer, size_t size);
   void FlipEndian32(uint8_t *buffer, size_t size);
+
+  // Copies size bytes (a multiple of 4), reversing the byte order of each
+  // 32-bit word. Buffers must not overlap.
+  void CopyFlipEndian32(uint8_t *dest, const uint8_t *src, size_t size);
+
+  // Version of CopyFlipEndian32() in use: "ssse3", "sse2", "neon" or
+  // "scalar", the best the CPU supports unless another is set
+  const char *GetByteSwapImplementation();
+  bool SetByteSwapImplementation(const char *name);
 } // Util
 
 #endif  // INCLUDED_BYTESWAP_H
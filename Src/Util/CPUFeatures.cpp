@@ -0,0 +1,167 @@
+#include "Util/CPUFeatures.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPUFEATURES_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(__arm__) || defined(_M_ARM64)
+#define CPUFEATURES_ARM
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#endif
+
+namespace Util
+{
+  namespace CPUFeatures
+  {
+    static const struct
+    {
+      Feature feature;
+      const char *name;
+    } s_names[] =
+    {
+      { SSE2,   "sse2"   },
+      { SSSE3,  "ssse3"  },
+      { SSE41,  "sse4.1" },
+      { SSE42,  "sse4.2" },
+      { AVX,    "avx"    },
+      { AVX2,   "avx2"   },
+      { FMA,    "fma"    },
+      { BMI2,   "bmi2"   },
+      { NEON,   "neon"   },
+      { CRC32,  "crc32"  }
+    };
+
+    uint32_t Baseline()
+    {
+      uint32_t features = 0;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+      features |= SSE2;
+#endif
+#if defined(__SSSE3__)
+      features |= SSSE3;
+#endif
+#if defined(__SSE4_1__)
+      features |= SSE41;
+#endif
+#if defined(__SSE4_2__)
+      features |= SSE42;
+#endif
+#if defined(__AVX__)
+      features |= AVX;
+#endif
+#if defined(__AVX2__)
+      features |= AVX2;
+#endif
+#if defined(__FMA__)
+      features |= FMA;
+#endif
+#if defined(__BMI2__)
+      features |= BMI2;
+#endif
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+      features |= NEON;
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+      features |= CRC32;
+#endif
+      return features;
+    }
+
+    static uint32_t Detect()
+    {
+      uint32_t features = Baseline();
+#if defined(CPUFEATURES_X86)
+#if defined(_MSC_VER)
+      int info[4];
+      __cpuid(info, 0);
+      int maxLeaf = info[0];
+      __cpuid(info, 1);
+      bool ymmSaved = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6; // OSXSAVE, and the OS saves xmm and ymm
+      if (info[3] & (1 << 26))
+        features |= SSE2;
+      if (info[2] & (1 << 9))
+        features |= SSSE3;
+      if (info[2] & (1 << 19))
+        features |= SSE41;
+      if (info[2] & (1 << 20))
+        features |= SSE42;
+      if (ymmSaved && (info[2] & (1 << 28)))
+        features |= AVX;
+      if (ymmSaved && (info[2] & (1 << 12)))
+        features |= FMA;
+      if (maxLeaf >= 7)
+      {
+        __cpuidex(info, 7, 0);
+        if (ymmSaved && (info[1] & (1 << 5)))
+          features |= AVX2;
+        if (info[1] & (1 << 8))
+          features |= BMI2;
+      }
+#else
+      __builtin_cpu_init(); // we may be called from a static initializer, before libgcc's
+      if (__builtin_cpu_supports("sse2"))
+        features |= SSE2;
+      if (__builtin_cpu_supports("ssse3"))
+        features |= SSSE3;
+      if (__builtin_cpu_supports("sse4.1"))
+        features |= SSE41;
+      if (__builtin_cpu_supports("sse4.2"))
+        features |= SSE42;
+      if (__builtin_cpu_supports("avx"))
+        features |= AVX;
+      if (__builtin_cpu_supports("avx2"))
+        features |= AVX2;
+      if (__builtin_cpu_supports("fma"))
+        features |= FMA;
+      if (__builtin_cpu_supports("bmi2"))
+        features |= BMI2;
+#endif
+#elif defined(CPUFEATURES_ARM)
+#if defined(__aarch64__) && defined(__linux__)
+      unsigned long hwcap = getauxval(AT_HWCAP);
+      if (hwcap & HWCAP_ASIMD)
+        features |= NEON;
+      if (hwcap & HWCAP_CRC32)
+        features |= CRC32;
+#elif defined(__arm__) && defined(__linux__)
+      unsigned long hwcap = getauxval(AT_HWCAP);
+      if (hwcap & HWCAP_NEON)
+        features |= NEON;
+#elif defined(__APPLE__) && defined(__aarch64__)
+      features |= NEON | CRC32; // every Apple ARM64 has both
+#endif
+#endif
+      return features;
+    }
+
+    uint32_t Detected()
+    {
+      static const uint32_t s_features = Detect();
+      return s_features;
+    }
+
+    bool Have(uint32_t features)
+    {
+      return (Detected() & features) == features;
+    }
+
+    std::string Names(uint32_t features)
+    {
+      std::string names;
+      for (const auto &entry : s_names)
+      {
+        if (features & entry.feature)
+        {
+          if (!names.empty())
+            names += ' ';
+          names += entry.name;
+        }
+      }
+      return names.empty() ? "none" : names;
+    }
+  } // CPUFeatures
+} // Util
@@ -0,0 +1,89 @@
+#ifndef INCLUDED_UTIL_CPUFEATURES_H
+#define INCLUDED_UTIL_CPUFEATURES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace Util
+{
+  /*
+   * Instruction set extensions of the CPU we are running on. The makefiles
+   * build for a single baseline (SSE2 on x86, NEON on ARM64), so kernels that
+   * can use more are compiled in several versions, with target attributes,
+   * and one is picked at startup. Each kernel keeps a table of its versions,
+   * best first, ending with one that needs nothing:
+   *
+   *   struct Implementation
+   *   {
+   *     const char *name;
+   *     uint32_t features;  // all must be present
+   *     void (*mix)(...);
+   *   };
+   *
+   *   static const Implementation s_implementations[] =
+   *   {
+   *     { "avx2",   CPUFeatures::AVX2, MixAVX2 },
+   *     { "scalar", 0,                 MixScalar }
+   *   };
+   *
+   *   static const Implementation *s_current = CPUFeatures::FindBest(s_implementations);
+   *
+   * Detection happens on first use, so this is safe in static initializers.
+   */
+  namespace CPUFeatures
+  {
+    enum Feature : uint32_t
+    {
+      SSE2  = 1 << 0,
+      SSSE3 = 1 << 1,
+      SSE41 = 1 << 2,
+      SSE42 = 1 << 3,
+      AVX   = 1 << 4,   // only if the OS saves the ymm registers
+      AVX2  = 1 << 5,
+      FMA   = 1 << 6,
+      BMI2  = 1 << 7,
+      NEON  = 1 << 8,
+      CRC32 = 1 << 9    // ARMv8 CRC32 instructions
+    };
+
+    // Features of this CPU, including those the compiler already assumes
+    uint32_t Detected();
+
+    // Features the compiler was allowed to use everywhere
+    uint32_t Baseline();
+
+    // True if all the given features are present
+    bool Have(uint32_t features);
+
+    // Space separated names of the given features, e.g. "sse2 ssse3 sse4.1"
+    std::string Names(uint32_t features);
+
+    // Best implementation in the table the CPU supports (the last always is)
+    template <class Implementation, size_t N>
+    const Implementation *FindBest(const Implementation (&implementations)[N])
+    {
+      for (const auto &impl : implementations)
+      {
+        if (Have(impl.features))
+          return &impl;
+      }
+      return &implementations[N - 1];
+    }
+
+    // Named implementation, or nullptr if there isn't one or the CPU lacks its features
+    template <class Implementation, size_t N>
+    const Implementation *Find(const Implementation (&implementations)[N], const char *name)
+    {
+      for (const auto &impl : implementations)
+      {
+        if (!strcmp(impl.name, name))
+          return Have(impl.features) ? &impl : nullptr;
+      }
+      return nullptr;
+    }
+  } // CPUFeatures
+} // Util
+
+#endif  // INCLUDED_UTIL_CPUFEATURES_H
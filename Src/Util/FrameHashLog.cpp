@@ -0,0 +1,179 @@
+#include "Util/FrameHashLog.h"
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+namespace Util
+{
+  static const char *s_magic = "SMHASH1";
+
+  static std::string JoinNames(const std::vector<std::string> &names)
+  {
+    std::string line;
+    for (auto &name: names)
+      line += (line.empty() ? "" : " ") + name;
+    return line;
+  }
+
+  // Reads a line without its terminator (LF or CRLF). False at the end.
+  static bool ReadLine(FILE *file, std::string *line)
+  {
+    line->clear();
+    int c;
+    while ((c = fgetc(file)) != EOF && c != '\n')
+      line->push_back(char(c));
+    if (!line->empty() && line->back() == '\r')
+      line->pop_back();
+    return c != EOF || !line->empty();
+  }
+
+  bool FrameHashLog::Write(const std::string &file, const std::string &game, const std::vector<std::string> &names)
+  {
+    Close();
+    m_file = fopen(file.c_str(), "w");
+    if (!m_file)
+      return false;
+    m_writing = true;
+    m_names = names;
+    fprintf(m_file, "%s %s\n%s\n", s_magic, game.c_str(), JoinNames(names).c_str());
+    return true;
+  }
+
+  bool FrameHashLog::Compare(const std::string &file, const std::string &game, const std::vector<std::string> &names, std::string *error)
+  {
+    Close();
+    m_file = fopen(file.c_str(), "r");
+    if (!m_file)
+    {
+      *error = "Unable to open " + file + ".";
+      return false;
+    }
+    std::string header, nameLine;
+    if (!ReadLine(m_file, &header) || !ReadLine(m_file, &nameLine) || header.compare(0, strlen(s_magic) + 1, std::string(s_magic) + " ") != 0)
+    {
+      *error = file + " is not a frame hash log.";
+      Close();
+      return false;
+    }
+    if (header.substr(strlen(s_magic) + 1) != game)
+    {
+      *error = file + " was written for " + header.substr(strlen(s_magic) + 1) + ", not " + game + ".";
+      Close();
+      return false;
+    }
+    if (nameLine != JoinNames(names))
+    {
+      *error = file + " holds different hashes (" + nameLine + ").";
+      Close();
+      return false;
+    }
+    m_writing = false;
+    m_names = names;
+    return true;
+  }
+
+  bool FrameHashLog::Frame(const uint64_t *hashes)
+  {
+    if (!m_file)
+      return true;
+    uint64_t frame = m_frames++;
+
+    if (m_writing)
+    {
+      fprintf(m_file, "%" PRIu64, frame);
+      for (size_t i = 0; i < m_names.size(); i++)
+        fprintf(m_file, " %016" PRIx64, hashes[i]);
+      fputc('\n', m_file);
+      return true;
+    }
+
+    if (m_diverged || m_logEnded)
+      return true;
+    std::string line;
+    if (!ReadLine(m_file, &line))
+    {
+      m_logEnded = true;
+      return true;
+    }
+    const char *p = line.c_str();
+    char *end;
+    uint64_t logFrame = strtoull(p, &end, 10);
+    uint64_t mask = logFrame != frame ? ~uint64_t(0) : 0;
+    for (size_t i = 0; i < m_names.size() && !mask; i++)
+    {
+      p = end;
+      uint64_t hash = strtoull(p, &end, 16);
+      if (end == p || hash != hashes[i])
+        mask |= uint64_t(1) << i;
+    }
+    if (mask)
+    {
+      m_diverged = true;
+      m_divergedFrame = frame;
+      m_divergedMask = mask;
+      return false;
+    }
+    return true;
+  }
+
+  bool FrameHashLog::Writing() const
+  {
+    return m_file && m_writing;
+  }
+
+  bool FrameHashLog::Comparing() const
+  {
+    return m_file && !m_writing;
+  }
+
+  uint64_t FrameHashLog::Frames() const
+  {
+    return m_frames;
+  }
+
+  bool FrameHashLog::LogEnded() const
+  {
+    return m_logEnded;
+  }
+
+  bool FrameHashLog::Diverged() const
+  {
+    return m_diverged;
+  }
+
+  uint64_t FrameHashLog::DivergedFrame() const
+  {
+    return m_divergedFrame;
+  }
+
+  std::string FrameHashLog::DivergedNames() const
+  {
+    std::string names;
+    for (size_t i = 0; i < m_names.size(); i++)
+    {
+      if (m_divergedMask & (uint64_t(1) << i))
+        names += (names.empty() ? "" : ", ") + m_names[i];
+    }
+    return names;
+  }
+
+  void FrameHashLog::Close()
+  {
+    if (m_file)
+      fclose(m_file);
+    m_file = nullptr;
+    m_frames = 0;
+    m_logEnded = false;
+    m_diverged = false;
+    m_divergedMask = 0;
+  }
+
+  FrameHashLog::FrameHashLog()
+  {
+  }
+
+  FrameHashLog::~FrameHashLog()
+  {
+    Close();
+  }
+} // Util
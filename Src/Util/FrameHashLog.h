@@ -0,0 +1,70 @@
+#ifndef INCLUDED_UTIL_FRAMEHASHLOG_H
+#define INCLUDED_UTIL_FRAMEHASHLOG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace Util
+{
+  /*
+   * Writes hashes of the state each frame leaves behind to a log, or compares
+   * them against a log written earlier, to find the first frame at which two
+   * runs of the same game with the same inputs stopped emulating the same
+   * thing.
+   *
+   * The log is text: a line with the magic "SMHASH1" and the game name, a
+   * line with the names of the hashes, then a line per frame with its number
+   * and the hashes in hexadecimal.
+   */
+  class FrameHashLog
+  {
+  public:
+    // Starts writing the named hashes to a file. Returns false if it could
+    // not be created.
+    bool Write(const std::string &file, const std::string &game, const std::vector<std::string> &names);
+
+    // Starts comparing against a file written for the same game with the
+    // same hashes. Returns false, with the reason, if it could not be read or
+    // was written for something else.
+    bool Compare(const std::string &file, const std::string &game, const std::vector<std::string> &names, std::string *error);
+
+    // Writes or compares the hashes of the next frame, one for each name.
+    // Returns false at the first frame that differs from the log; later
+    // frames are not compared, nor are any past the end of the log.
+    bool Frame(const uint64_t *hashes);
+
+    bool Writing() const;
+    bool Comparing() const;
+
+    // Frames written or compared so far
+    uint64_t Frames() const;
+
+    // Whether the log ended before the run did
+    bool LogEnded() const;
+
+    // Whether a frame differed, which one and the names of the hashes that
+    // did, separated by commas
+    bool Diverged() const;
+    uint64_t DivergedFrame() const;
+    std::string DivergedNames() const;
+
+    FrameHashLog();
+    ~FrameHashLog();
+
+  private:
+    FILE                      *m_file = nullptr;
+    bool                      m_writing = false;
+    std::vector<std::string>  m_names;
+    uint64_t                  m_frames = 0;
+    bool                      m_logEnded = false;
+    bool                      m_diverged = false;
+    uint64_t                  m_divergedFrame = 0;
+    uint64_t                  m_divergedMask = 0;
+
+    void Close();
+  };
+} // Util
+
+#endif  // INCLUDED_UTIL_FRAMEHASHLOG_H
@@ -0,0 +1,128 @@
+#include "Util/FramePacer.h"
+#include <thread>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>  // CreateWaitableTimerEx()
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+namespace Util
+{
+  void FramePacer::Wait()
+  {
+    Clock::time_point now = Clock::now();
+    if (!m_started)
+    {
+      m_start = now;
+      m_frame = 0;
+      m_started = true;
+    }
+
+    m_stats.frames++;
+    m_frame++;
+    Clock::time_point due = m_start + m_frame * m_period;
+    m_lateMicros = 0;
+    if (now >= due)
+    {
+      m_lateMicros = uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(now - due).count());
+      m_stats.late++;
+      m_error.Add(0);
+      if (now - due > m_period)
+      {
+        m_stats.restarts++;
+        m_start = now;
+        m_frame = 0;
+      }
+      return;
+    }
+
+    if (due - now > m_spin)
+      Sleep(due - now - m_spin);
+    while ((now = Clock::now()) < due)
+      ;
+    m_error.Add(uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(now - due).count()));
+  }
+
+  void FramePacer::WaitUntil(Clock::time_point when)
+  {
+    Clock::time_point now = Clock::now();
+    if (when - now > m_spin)
+      Sleep(when - now - m_spin);
+    while (Clock::now() < when)
+      ;
+  }
+
+  void FramePacer::Reset()
+  {
+    m_started = false;
+  }
+
+  void FramePacer::SetPeriodScale(double scale)
+  {
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(m_nominalPeriod * scale);
+    if (period == m_period)
+      return;
+    // Later frames are counted from the last one due, at the new period
+    if (m_started)
+    {
+      m_start += m_frame * m_period;
+      m_frame = 0;
+    }
+    m_period = period;
+  }
+
+  uint32_t FramePacer::LateMicros() const
+  {
+    return m_lateMicros;
+  }
+
+  FramePacer::Stats FramePacer::GetStats() const
+  {
+    return m_stats;
+  }
+
+  const RollingStats &FramePacer::Error() const
+  {
+    return m_error;
+  }
+
+  // Plain Sleep() on Windows only wakes on the system tick (often 15.6 ms), so
+  // a high resolution timer is used where there is one
+  void FramePacer::Sleep(Clock::duration duration)
+  {
+#ifdef _WIN32
+    if (m_timer)
+    {
+      LARGE_INTEGER due;
+      due.QuadPart = -(LONGLONG) (std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 100);  // relative, in 100 ns units
+      if (SetWaitableTimer((HANDLE) m_timer, &due, 0, NULL, NULL, FALSE))
+      {
+        WaitForSingleObject((HANDLE) m_timer, INFINITE);
+        return;
+      }
+    }
+#endif
+    std::this_thread::sleep_for(duration);
+  }
+
+  FramePacer::FramePacer(double frames_per_second, unsigned spin_microseconds)
+    : m_nominalPeriod(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frames_per_second))),
+      m_period(m_nominalPeriod),
+      m_spin(std::chrono::microseconds(spin_microseconds)),
+      m_error(600)
+  {
+#ifdef _WIN32
+    m_timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+  }
+
+  FramePacer::~FramePacer()
+  {
+#ifdef _WIN32
+    if (m_timer)
+      CloseHandle((HANDLE) m_timer);
+#endif
+  }
+} // Util
@@ -0,0 +1,74 @@
+#ifndef INCLUDED_UTIL_FRAMEPACER_H
+#define INCLUDED_UTIL_FRAMEPACER_H
+
+#include "Util/RollingStats.h"
+#include <chrono>
+#include <cstdint>
+
+namespace Util
+{
+  /*
+   * Holds frames to a fixed rate without keeping a core busy. Each wait sleeps
+   * in the OS until shortly before the frame is due, then spins on the clock
+   * for the last fraction of a millisecond, which OS sleeps can't be trusted
+   * to hit. Frames are due a whole number of periods after pacing began, so
+   * that the error of one wait doesn't carry into the next. If a frame is late
+   * by more than a period (a pause, a slow frame), pacing begins again from
+   * then rather than rushing the frames that follow to catch up.
+   */
+  class FramePacer
+  {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stats
+    {
+      uint64_t  frames;         // waited for
+      uint64_t  late;           // due before Wait() was even called
+      uint64_t  restarts;       // so late that pacing began again
+    };
+
+    // Waits until the next frame is due
+    void Wait();
+
+    // Waits until the given time, as closely as Wait() keeps to frames. This
+    // doesn't count as a frame.
+    void WaitUntil(Clock::time_point when);
+
+    // Begins pacing again from now, as after a pause
+    void Reset();
+
+    // Stretches (above 1) or shrinks the period from the next frame on, as
+    // when keeping in step with other machines. Frames already due stay put.
+    void SetPeriodScale(double scale);
+
+    Stats GetStats() const;
+
+    // How far past the deadline each of the most recent waits ended, in
+    // microseconds (0 if the frame was late already)
+    const RollingStats &Error() const;
+
+    // How late the frame was when Wait() was last called, in microseconds (0
+    // if it was on time)
+    uint32_t LateMicros() const;
+
+    FramePacer(double frames_per_second, unsigned spin_microseconds = 500);
+    ~FramePacer();
+
+  private:
+    void Sleep(Clock::duration duration);
+
+    Clock::duration   m_nominalPeriod;
+    Clock::duration   m_period;
+    Clock::duration   m_spin;
+    Clock::time_point m_start;
+    uint64_t          m_frame = 0;    // frames due since m_start
+    bool              m_started = false;
+    uint32_t          m_lateMicros = 0;
+    Stats             m_stats = {};
+    RollingStats      m_error;
+    void              *m_timer = nullptr;   // Windows waitable timer
+  };
+} // Util
+
+#endif  // INCLUDED_UTIL_FRAMEPACER_H
@@ -0,0 +1,50 @@
+#include "Util/FrameSkipper.h"
+#include <algorithm>
+
+namespace Util
+{
+  // Weight of the newest frame in the averages: a few frames' memory, so that
+  // a scene change is followed quickly and a single odd frame is not
+  static const double WEIGHT = 0.25;
+
+  bool FrameSkipper::Update(uint32_t frame_micros, uint32_t render_micros, bool drawn, uint32_t late_micros)
+  {
+    render_micros = std::min(render_micros, frame_micros);
+    m_emulation += WEIGHT * (double(frame_micros - render_micros) - m_emulation);
+    if (drawn)
+      m_render += WEIGHT * (double(render_micros) - m_render);
+
+    double cost = m_emulation + m_render;
+    if (!m_skipping)
+      m_skipping = late_micros > m_budget / 2;
+    else if (late_micros == 0 && cost < 0.9 * m_budget)
+      m_skipping = false;
+
+    double late_if_drawn = double(late_micros) + cost - m_budget;
+    if (m_skipping && late_if_drawn > m_budget / 2 && m_run < m_maxSkip)
+    {
+      m_run++;
+      m_skipped++;
+      return false;
+    }
+    m_run = 0;
+    return true;
+  }
+
+  void FrameSkipper::Reset()
+  {
+    m_run = 0;
+    m_skipping = false;
+  }
+
+  uint64_t FrameSkipper::Skipped() const
+  {
+    return m_skipped;
+  }
+
+  FrameSkipper::FrameSkipper(uint32_t budget_micros, unsigned max_skip)
+    : m_budget(budget_micros),
+      m_maxSkip(max_skip)
+  {
+  }
+} // Util
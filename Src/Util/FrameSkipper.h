@@ -0,0 +1,43 @@
+#ifndef INCLUDED_UTIL_FRAMESKIPPER_H
+#define INCLUDED_UTIL_FRAMESKIPPER_H
+
+#include <cstdint>
+
+namespace Util
+{
+  /*
+   * Decides, frame by frame, whether to draw the next frame or skip drawing it
+   * to keep up. Skipping begins once the frame pacer is over half a frame
+   * late, and ends once it is on time again and frames, as predicted from the
+   * emulation and rendering costs of recent ones, fit in 90% of the budget, so
+   * that a borderline load doesn't flicker in and out of it. While skipping, a
+   * frame is drawn whenever the predicted cost, on top of how late the pacer
+   * already is, leaves it no more than half a frame late, which later frames
+   * make up since its deadlines are absolute. No more than the given number of
+   * frames are ever skipped in a row.
+   */
+  class FrameSkipper
+  {
+  public:
+    // Takes the time the frame just run took, how much of that was rendering,
+    // whether it was drawn and how late it ended. Returns whether to draw the
+    // next frame.
+    bool Update(uint32_t frame_micros, uint32_t render_micros, bool drawn, uint32_t late_micros);
+
+    void Reset();
+    uint64_t Skipped() const;
+
+    FrameSkipper(uint32_t budget_micros, unsigned max_skip);
+
+  private:
+    double    m_budget;
+    unsigned  m_maxSkip;
+    double    m_emulation = 0;    // recent average time to run a frame, less rendering
+    double    m_render = 0;       // recent average time to render a frame that is drawn
+    unsigned  m_run = 0;          // frames skipped in a row
+    bool      m_skipping = false;
+    uint64_t  m_skipped = 0;
+  };
+} // Util
+
+#endif  // INCLUDED_UTIL_FRAMESKIPPER_H
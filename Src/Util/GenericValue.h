@@ -3,10 +3,10 @@
  * -----
  * - ParseInteger() should be optimized. It is frequently used throughout the
  *   code base at run-time.
- * - Possible optimization: cache last ValueAs<T> conversion. Return this when
- *   available and when value is Set(), mark dirty. This may require memory
- *   allocation or, alternatively, we could do this only for data types of size
- *   <= 8.
+ *
+ * Values read often should not be converted each time: Util::Config::Binding
+ * and Util::Config::Snapshot (NewConfig.h) cache conversions until the config
+ * changes.
  */
 
 #ifndef INCLUDED_UTIL_GENERICVALUE_H
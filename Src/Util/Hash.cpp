@@ -0,0 +1,25 @@
+#include "Util/Hash.h"
+#include <cstring>
+
+namespace Util
+{
+  uint64_t Hash64(const uint8_t *data, size_t size)
+  {
+    const uint64_t prime = 0x100000001B3ULL;
+    uint64_t h[4] = { 0xCBF29CE484222325ULL, 1, 2, 3 };
+
+    size_t words = size / 8;
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4)
+    {
+      uint64_t w[4];
+      memcpy(w, data + i * 8, sizeof(w));
+      for (int lane = 0; lane < 4; lane++)
+        h[lane] = (h[lane] ^ w[lane]) * prime;
+    }
+    for (size_t b = i * 8; b < size; b++)
+      h[0] = (h[0] ^ data[b]) * prime;
+
+    return ((h[0] * prime ^ h[1]) * prime ^ h[2]) * prime ^ h[3];
+  }
+} // Util
@@ -0,0 +1,14 @@
+#ifndef INCLUDED_UTIL_HASH_H
+#define INCLUDED_UTIL_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Util
+{
+  // 64-bit FNV-1a over 64-bit words, in four lanes so that the multiplies
+  // overlap. Not cryptographic; used to tell whether two save states match.
+  uint64_t Hash64(const uint8_t *data, size_t size);
+} // Util
+
+#endif  // INCLUDED_UTIL_HASH_H
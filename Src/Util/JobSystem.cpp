@@ -0,0 +1,159 @@
+#include "Util/JobSystem.h"
+#ifdef SUPERMODEL_ALLOC_TRACKING
+#include "Util/AllocTracker.h"
+#endif
+#include <algorithm>
+
+namespace Util
+{
+  static const unsigned SPIN_COUNT = 64;  // yields before an idle thread sleeps
+
+  // Identifies worker threads, so they can push to and pop from their own queue
+  static thread_local JobSystem *t_owner = nullptr;
+  static thread_local unsigned t_index = 0;
+
+  JobSystem &JobSystem::Shared()
+  {
+    static JobSystem s_jobs(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return s_jobs;
+  }
+
+  JobSystem::JobSystem(unsigned numWorkers)
+  {
+    for (unsigned i = 0; i < numWorkers; i++)
+      m_queues.emplace_back(new Queue());
+    for (unsigned i = 0; i < numWorkers; i++)
+      m_threads.emplace_back(&JobSystem::WorkerThread, this, i);
+  }
+
+  JobSystem::~JobSystem()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto &thread: m_threads)
+      thread.join();
+  }
+
+  void JobSystem::Submit(Group &group, Job job)
+  {
+    if (m_queues.empty())
+    {
+      job();
+      return;
+    }
+
+    group.m_pending.fetch_add(1);
+    unsigned q = t_owner == this ? t_index : m_nextQueue.fetch_add(1, std::memory_order_relaxed) % unsigned(m_queues.size());
+    {
+      std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+      m_queues[q]->tasks.push_back({ std::move(job), &group });
+    }
+    m_queued.fetch_add(1);
+    if (m_sleepers.load() != 0)
+      WakeSleepers(false);
+  }
+
+  void JobSystem::Wait(Group &group)
+  {
+    unsigned first = t_owner == this ? t_index : 0;
+    while (!group.Done())
+    {
+      Task task;
+      if (TryTake(first, task))
+      {
+        Run(task);
+        continue;
+      }
+      for (unsigned i = 0; i < SPIN_COUNT && !group.Done() && m_queued.load() == 0; i++)
+        std::this_thread::yield();
+      if (!group.Done() && m_queued.load() == 0)
+        Sleep(&group);
+    }
+  }
+
+  // Takes a task, starting with queue 'first': LIFO from a worker's own queue
+  // (it is the most likely to still be in cache), FIFO when stealing
+  bool JobSystem::TryTake(unsigned first, Task &task)
+  {
+    if (m_queued.load() == 0)
+      return false;
+    unsigned n = unsigned(m_queues.size());
+    for (unsigned k = 0; k < n; k++)
+    {
+      Queue &queue = *m_queues[(first + k) % n];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty())
+        continue;
+      if (k == 0 && t_owner == this)
+      {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      else
+      {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+      m_queued.fetch_sub(1);
+      return true;
+    }
+    return false;
+  }
+
+  void JobSystem::Run(Task &task)
+  {
+    {
+      // Destroy the job before signalling, as the group's waiter may then return
+      Job job = std::move(task.job);
+      job();
+    }
+    if (task.group->m_pending.fetch_sub(1) == 1 && m_sleepers.load() != 0)
+      WakeSleepers(true);
+  }
+
+  // Blocks until there is queued work, the group (if any) is done or the
+  // scheduler is stopping. Returns true if stopping.
+  bool JobSystem::Sleep(const Group *group)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_sleepers.fetch_add(1);
+    while (m_queued.load() == 0 && !m_stop && !(group && group->Done()))
+      m_wake.wait(lock);
+    m_sleepers.fetch_sub(1);
+    return m_stop;
+  }
+
+  void JobSystem::WakeSleepers(bool all)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (all)
+      m_wake.notify_all();
+    else
+      m_wake.notify_one();
+  }
+
+  void JobSystem::WorkerThread(unsigned index)
+  {
+    t_owner = this;
+    t_index = index;
+#ifdef SUPERMODEL_ALLOC_TRACKING
+    AllocTracker::SetThreadSubsystem(AllocTracker::Jobs);
+#endif
+    for (;;)
+    {
+      Task task;
+      if (TryTake(index, task))
+      {
+        Run(task);
+        continue;
+      }
+      for (unsigned i = 0; i < SPIN_COUNT && m_queued.load() == 0; i++)
+        std::this_thread::yield();
+      if (m_queued.load() == 0 && Sleep(nullptr) && m_queued.load() == 0)
+        return;
+    }
+  }
+} // Util
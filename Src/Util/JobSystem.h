@@ -0,0 +1,106 @@
+#ifndef INCLUDED_UTIL_JOBSYSTEM_H
+#define INCLUDED_UTIL_JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Util
+{
+  /*
+   * Work-stealing scheduler for short, fine-grained jobs (copying a chunk of
+   * memory, decoding a texture, etc.) that subsystems want spread over all
+   * host cores. Each worker thread has its own queue. Jobs submitted from a
+   * worker go onto its queue; jobs from any other thread are dealt round-robin.
+   * Idle workers steal from the front of other queues. A thread waiting for
+   * a group of jobs runs queued jobs itself until the group is done, so
+   * nested submission cannot deadlock.
+   *
+   * Jobs must not block on anything other than other jobs.
+   */
+  class JobSystem
+  {
+  public:
+    typedef std::function<void()> Job;
+
+    // Counts outstanding jobs. Must outlive the jobs submitted to it.
+    class Group
+    {
+      friend class JobSystem;
+      std::atomic<size_t> m_pending{ 0 };
+    public:
+      bool Done() const
+      {
+        return m_pending.load() == 0;
+      }
+    };
+
+    // Instance shared by the whole emulator, with one worker per host core
+    // beyond the first (the thread that waits on a group works too). With no
+    // workers, Submit() runs jobs immediately.
+    static JobSystem &Shared();
+
+    unsigned NumWorkers() const
+    {
+      return unsigned(m_queues.size());
+    }
+
+    void Submit(Group &group, Job job);
+
+    // Runs queued jobs on the calling thread until all jobs in the group have
+    // finished
+    void Wait(Group &group);
+
+    // Calls fn(i) for i in [0, count), in parallel, and waits for all calls
+    template <typename F>
+    void ParallelFor(size_t count, const F &fn)
+    {
+      if (count == 0)
+        return;
+      Group group;
+      for (size_t i = 1; i < count; i++)
+        Submit(group, [&fn, i]() { fn(i); });
+      fn(0);
+      Wait(group);
+    }
+
+    JobSystem(unsigned numWorkers);
+    ~JobSystem();
+
+  private:
+    struct Task
+    {
+      Job   job;
+      Group *group;
+    };
+
+    struct Queue
+    {
+      std::mutex        mutex;
+      std::deque<Task>  tasks;
+    };
+
+    bool TryTake(unsigned first, Task &task);
+    void Run(Task &task);
+    bool Sleep(const Group *group);
+    void WakeSleepers(bool all);
+    void WorkerThread(unsigned index);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread>  m_threads;
+    std::atomic<size_t>       m_queued{ 0 };      // tasks waiting in all queues
+    std::atomic<unsigned>     m_sleepers{ 0 };    // threads blocked on m_wake
+    std::atomic<unsigned>     m_nextQueue{ 0 };   // round-robin for external submissions
+    std::mutex                m_mutex;
+    std::condition_variable   m_wake;
+    bool                      m_stop = false;
+  };
+} // Util
+
+#endif  // INCLUDED_UTIL_JOBSYSTEM_H
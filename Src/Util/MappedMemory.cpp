@@ -0,0 +1,149 @@
+#include "Util/MappedMemory.h"
+#include <cstdint>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>  // VirtualAlloc()
+#else
+#include <sys/mman.h> // mmap()
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Util
+{
+  namespace MappedMemory
+  {
+    size_t PageSize()
+    {
+#ifdef _WIN32
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      return size_t(info.dwPageSize);
+#else
+      return size_t(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    uint8_t *Allocate(size_t size)
+    {
+#ifdef _WIN32
+      return (uint8_t *) VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+      void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      return p == MAP_FAILED ? nullptr : (uint8_t *) p;
+#endif
+    }
+
+    uint8_t *AllocateLarge(size_t size)
+    {
+      const size_t huge_page_size = 2 * 1024 * 1024;
+#ifdef _WIN32
+      // Needs the "lock pages in memory" privilege, which few users have
+      size_t large_page_size = GetLargePageMinimum();
+      if (large_page_size != 0 && size % large_page_size == 0)
+      {
+        void *p = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p)
+          return (uint8_t *) p;
+      }
+      (void) huge_page_size;
+      return Allocate(size);
+#else
+      // Over-allocate so that an aligned block can be cut out of the middle
+      size_t page_size = PageSize();
+      size = (size + page_size - 1) / page_size * page_size;
+      uint8_t *p = Allocate(size + huge_page_size);
+      if (!p)
+        return Allocate(size);
+      uint8_t *block = (uint8_t *) ((uintptr_t(p) + huge_page_size - 1) & ~uintptr_t(huge_page_size - 1));
+      if (block > p)
+        munmap(p, size_t(block - p));
+      munmap(block + size, size_t(p + huge_page_size - block));
+#ifdef MADV_HUGEPAGE
+      madvise(block, size, MADV_HUGEPAGE);
+#endif
+      return block;
+#endif
+    }
+
+    void Free(uint8_t *block, size_t size)
+    {
+      if (!block)
+        return;
+#ifdef _WIN32
+      VirtualFree(block, 0, MEM_RELEASE);
+#else
+      munmap(block, size);
+#endif
+    }
+
+    bool MapFile(uint8_t *dest, size_t size, const std::string &file_path, uint64_t offset)
+    {
+#ifdef _WIN32
+      // A view can't be placed over part of an allocation here
+      return true;
+#else
+      size_t page_size = PageSize();
+      if (uintptr_t(dest) % page_size || size % page_size || offset % page_size || !size)
+        return true;
+      int fd = open(file_path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return true;
+      // MAP_FIXED swaps the pages atomically, so the block is never left with
+      // a hole in it
+      void *p = mmap(dest, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, off_t(offset));
+      close(fd);
+      return p == MAP_FAILED;
+#endif
+    }
+
+    uint8_t *MapShared(const std::string &name, size_t size)
+    {
+#ifdef _WIN32
+      // The mapping object lives on as long as a view of it does
+      std::string object_name = "Local\\" + name;
+      HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, DWORD(uint64_t(size) >> 32), DWORD(size), object_name.c_str());
+      if (mapping == NULL)
+        return nullptr;
+      void *p = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+      CloseHandle(mapping);
+      return (uint8_t *) p;
+#else
+      std::string object_name = "/" + name;
+      int fd = shm_open(object_name.c_str(), O_RDWR | O_CREAT, 0600);
+      if (fd < 0)
+        return nullptr;
+      // Grows a new object, zero-filled, and leaves one already that size alone
+      if (ftruncate(fd, off_t(size)) != 0)
+      {
+        close(fd);
+        return nullptr;
+      }
+      void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      return p == MAP_FAILED ? nullptr : (uint8_t *) p;
+#endif
+    }
+
+    void UnmapShared(uint8_t *block, size_t size)
+    {
+      if (!block)
+        return;
+#ifdef _WIN32
+      (void) size;
+      UnmapViewOfFile(block);
+#else
+      munmap(block, size);
+#endif
+    }
+
+    void UnlinkShared(const std::string &name)
+    {
+#ifdef _WIN32
+      (void) name;
+#else
+      shm_unlink(("/" + name).c_str());
+#endif
+    }
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef INCLUDED_UTIL_MAPPEDMEMORY_H
+#define INCLUDED_UTIL_MAPPEDMEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Util
+{
+  /*
+   * Large blocks of memory taken straight from the OS, so that pages never
+   * written to read as zero without using any physical memory, and so that
+   * parts of them can be swapped for read-only views of a file, paged in only
+   * as they are read.
+   */
+  namespace MappedMemory
+  {
+    size_t PageSize();
+
+    // Returns nullptr if out of memory
+    uint8_t *Allocate(size_t size);
+    void Free(uint8_t *block, size_t size);
+
+    // As Allocate() but aligned to 2 MB and backed by huge pages where the OS
+    // will give them, so that a board's memories spread over few TLB entries.
+    // Falls back to ordinary pages. Freed with Free().
+    uint8_t *AllocateLarge(size_t size);
+
+    // Replaces the given pages of an allocated block with a read-only view of
+    // the file at the given offset. The destination, size and offset must all
+    // be multiples of the page size. Returns true if it couldn't be done (or
+    // isn't supported on this platform), leaving the block untouched.
+    bool MapFile(uint8_t *dest, size_t size, const std::string &file_path, uint64_t offset);
+
+    // Maps a named block of memory shared between processes on this machine,
+    // creating it zero-filled if no process has yet. Returns nullptr if it
+    // can't be mapped. Unmapped with UnmapShared().
+    uint8_t *MapShared(const std::string &name, size_t size);
+    void UnmapShared(uint8_t *block, size_t size);
+
+    // Removes the name, so that the next MapShared() of it gets a new block.
+    // Processes that have the old one mapped keep it until they unmap it.
+    // Blocks go away by themselves on Windows once nothing has them mapped.
+    void UnlinkShared(const std::string &name);
+  }
+}
+
+#endif  // INCLUDED_UTIL_MAPPEDMEMORY_H
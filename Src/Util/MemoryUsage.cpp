@@ -0,0 +1,63 @@
+#include "Util/MemoryUsage.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>    // GetProcessMemoryInfo()
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#else
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace Util
+{
+  namespace MemoryUsage
+  {
+    size_t Resident()
+    {
+#ifdef _WIN32
+      PROCESS_MEMORY_COUNTERS counters;
+      if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+      return size_t(counters.WorkingSetSize);
+#elif defined(__APPLE__)
+      mach_task_basic_info info;
+      mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+      if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) != KERN_SUCCESS)
+        return 0;
+      return size_t(info.resident_size);
+#else
+      // Second field of statm is the resident page count
+      FILE *file = fopen("/proc/self/statm", "r");
+      if (!file)
+        return 0;
+      unsigned long size = 0, resident = 0;
+      int fields = fscanf(file, "%lu %lu", &size, &resident);
+      fclose(file);
+      return fields == 2 ? size_t(resident) * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+    }
+
+    size_t PeakResident()
+    {
+#ifdef _WIN32
+      PROCESS_MEMORY_COUNTERS counters;
+      if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+      return size_t(counters.PeakWorkingSetSize);
+#else
+      struct rusage usage;
+      if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+      return size_t(usage.ru_maxrss);         // bytes
+#else
+      return size_t(usage.ru_maxrss) * 1024;  // kilobytes
+#endif
+#endif
+    }
+  }
+}
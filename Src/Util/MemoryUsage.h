@@ -0,0 +1,22 @@
+#ifndef INCLUDED_UTIL_MEMORYUSAGE_H
+#define INCLUDED_UTIL_MEMORYUSAGE_H
+
+#include <cstddef>
+
+namespace Util
+{
+  /*
+   * Physical memory used by the process, as the OS counts it. Memory that was
+   * allocated but never touched isn't included.
+   */
+  namespace MemoryUsage
+  {
+    // Bytes resident now, or 0 if it can't be found out on this platform
+    size_t Resident();
+
+    // Most bytes resident at any time so far, or 0 if unknown
+    size_t PeakResident();
+  }
+}
+
+#endif  // INCLUDED_UTIL_MEMORYUSAGE_H
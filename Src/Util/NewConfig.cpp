@@ -152,6 +152,8 @@ namespace Util
 {
   namespace Config
   {
+    std::atomic<unsigned> Node::s_generation(0);
+
     void Node::CheckEmptyOrMissing() const
     {
       if (m_missing)
@@ -255,6 +257,7 @@ namespace Util
     // children) as a child 
     void Node::AddChild(Node &parent, ptr_t &node)
     {
+      Modified();
       if (!parent.m_last_child)
       {
         parent.m_first_child = node;
@@ -285,6 +288,7 @@ namespace Util
 
     void Node::Swap(Node &rhs)
     {
+      Modified();
       m_next_sibling.swap(rhs.m_next_sibling);
       m_first_child.swap(rhs.m_first_child);
       m_last_child.swap(rhs.m_last_child);
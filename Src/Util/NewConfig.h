@@ -6,6 +6,8 @@
 #include <memory>
 #include <iterator>
 #include <exception>
+#include <atomic>
+#include <mutex>
 
 namespace Util
 {
@@ -24,9 +26,16 @@ namespace Util
       std::map<std::string, ptr_t> m_children;
       mutable std::map<std::string, Node> m_missing_nodes;  // missing nodes from failed queries (must also be empty)
       bool m_missing = false;
+      static std::atomic<unsigned> s_generation;  // bumped whenever any tree is modified (see Binding)
+
+      static inline void Modified()
+      {
+        s_generation.fetch_add(1, std::memory_order_relaxed);
+      }
 
       void Destroy()
       {
+        Modified();
         m_value.reset();
         m_next_sibling.reset();
         m_first_child.reset();
@@ -171,6 +180,7 @@ namespace Util
       inline void SetValue(const std::shared_ptr<GenericValue> &value)
       {
         m_value = value;
+        Modified();
       }
 
       template <typename T>
@@ -205,6 +215,7 @@ namespace Util
             m_value->Set(value);
           else
             m_value = std::make_shared<ValueInstance<T>>(value);
+          Modified();
         }
         else
           throw std::range_error(Util::Format() << "Node \"" << m_key << "\" does not exist");
@@ -302,6 +313,12 @@ namespace Util
       Node *TryGet(const std::string &path);
       const Node *TryGet(const std::string &path) const;
 
+      // Changes each time any config tree is modified
+      static inline unsigned Generation()
+      {
+        return s_generation.load(std::memory_order_relaxed);
+      }
+
       void Serialize(std::ostream *os, size_t indent_level = 0) const;
       std::string ToString(size_t indent_level = 0) const;
       Node &operator=(const Node &rhs);
@@ -312,6 +329,94 @@ namespace Util
       Node(Node &&that);
       ~Node();
     };
+
+    // A value read often, e.g. every frame. It is looked up and converted as
+    // with ValueAs<T>() when bound and then only again after a config tree
+    // has been modified, so reading it is usually just a comparison.
+    template <typename T>
+    class Binding
+    {
+    private:
+      const Node *m_config = nullptr;
+      std::string m_path;
+      mutable T m_value = T();
+      mutable unsigned m_generation = 0;
+
+      void Refresh() const
+      {
+        m_generation = Node::Generation();
+        m_value = (*m_config)[m_path].ValueAs<T>();
+      }
+
+    public:
+      // Looks up path under config, which must outlive the binding. Throws as
+      // ValueAs() does if the value is empty.
+      void Bind(const Node &config, const std::string &path)
+      {
+        m_config = &config;
+        m_path = path;
+        Refresh();
+      }
+
+      const T &Value() const
+      {
+        if (m_generation != Node::Generation())
+          Refresh();
+        return m_value;
+      }
+
+      inline operator T() const
+      {
+        return Value();
+      }
+
+      Binding()
+      {}
+
+      Binding(const Node &config, const std::string &path)
+      {
+        Bind(config, path);
+      }
+    };
+
+    // A set of values read together, e.g. every frame, gathered into a plain
+    // struct that is constructed from the config tree. It is rebuilt only
+    // after a config tree has been modified and the new one then replaces the
+    // old atomically, so any thread may read it and each reader sees values
+    // that are consistent with one another for as long as it holds them.
+    template <typename Settings>
+    class Snapshot
+    {
+    private:
+      const Node *m_config = nullptr;
+      mutable std::shared_ptr<const Settings> m_settings;
+      mutable std::atomic<unsigned> m_generation;
+      mutable std::mutex m_mtx;
+      
+    public:
+      std::shared_ptr<const Settings> Get() const
+      {
+        if (m_generation.load(std::memory_order_acquire) != Node::Generation())
+        {
+          std::lock_guard<std::mutex> lock(m_mtx);
+          unsigned generation = Node::Generation(); // taken before building, so later changes are not missed
+          if (m_generation.load(std::memory_order_relaxed) != generation)
+          {
+            std::atomic_store(&m_settings, std::shared_ptr<const Settings>(std::make_shared<Settings>(*m_config)));
+            m_generation.store(generation, std::memory_order_release);
+          }
+        }
+        return std::atomic_load(&m_settings);
+      }
+
+      // Config must outlive the snapshot. Throws as Settings' constructor does.
+      Snapshot(const Node &config)
+        : m_config(&config),
+          m_settings(std::make_shared<Settings>(config)),
+          m_generation(Node::Generation())
+      {
+      }
+    };
   } // Config
 } // Util
 
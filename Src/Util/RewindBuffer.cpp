@@ -0,0 +1,267 @@
+#include "Util/RewindBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace Util
+{
+  /*
+   * A delta is a series of runs, each a count of unchanged words followed by a
+   * count of changed ones and their XOR, the counts being 7 bits per byte. A
+   * run of changed words only ends at two unchanged ones, so that isolated
+   * matches don't cost more than they save. Beyond the end of the smaller
+   * snapshot, it is taken to be zero.
+   */
+  static inline uint64_t LoadWord(const std::vector<uint8_t> &image, size_t word)
+  {
+    uint64_t value = 0;
+    size_t pos = word * 8;
+    if (pos + 8 <= image.size())
+      memcpy(&value, image.data() + pos, 8);
+    else if (pos < image.size())
+      memcpy(&value, image.data() + pos, image.size() - pos);
+    return value;
+  }
+
+  static inline uint8_t *PutCount(uint8_t *out, size_t count)
+  {
+    while (count >= 0x80)
+    {
+      *out++ = uint8_t(count | 0x80);
+      count >>= 7;
+    }
+    *out++ = uint8_t(count);
+    return out;
+  }
+
+  static inline const uint8_t *GetCount(const uint8_t *in, size_t *count)
+  {
+    size_t value = 0;
+    for (int shift = 0; ; shift += 7)
+    {
+      uint8_t byte = *in++;
+      value |= size_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        break;
+    }
+    *count = value;
+    return in;
+  }
+
+  // Grows the delta as needed, by half again, so it is rarely reallocated once
+  // it has reached the size these snapshots need
+  static void MakeDelta(const std::vector<uint8_t> &older, const std::vector<uint8_t> &newer, std::vector<uint8_t> *delta)
+  {
+    size_t numWords = (std::max(older.size(), newer.size()) + 7) / 8;
+    size_t commonWords = std::min(older.size(), newer.size()) / 8;
+    delta->resize(std::max(delta->capacity(), size_t(4096)));
+    size_t pos = 0;
+
+    size_t i = 0;
+    while (i < numWords)
+    {
+      // Most of it is unchanged, so skip that a block at a time first
+      size_t unchanged = i;
+      while (i + 32 <= commonWords && !memcmp(older.data() + i * 8, newer.data() + i * 8, 32 * 8))
+        i += 32;
+      while (i < numWords && LoadWord(older, i) == LoadWord(newer, i))
+        i++;
+      if (i == numWords)
+        break;
+      unchanged = i - unchanged;
+
+      size_t start = i;
+      while (i < numWords)
+      {
+        if (LoadWord(older, i) == LoadWord(newer, i) && (i + 1 == numWords || LoadWord(older, i + 1) == LoadWord(newer, i + 1)))
+          break;
+        i++;
+      }
+
+      size_t needed = pos + 20 + (i - start) * 8;
+      if (needed > delta->size())
+        delta->resize(std::max(needed, delta->size() + delta->size() / 2));
+      uint8_t *out = delta->data() + pos;
+      out = PutCount(out, unchanged);
+      out = PutCount(out, i - start);
+      for (size_t j = start; j < i; j++)
+      {
+        uint64_t value = LoadWord(older, j) ^ LoadWord(newer, j);
+        memcpy(out, &value, 8);
+        out += 8;
+      }
+      pos = out - delta->data();
+    }
+
+    delta->resize(pos);
+  }
+
+  static void ApplyDelta(std::vector<uint8_t> *image, const std::vector<uint8_t> &delta, size_t olderSize)
+  {
+    size_t numWords = (std::max(olderSize, image->size()) + 7) / 8;
+    image->resize(numWords * 8);  // zero beyond the end of the newer snapshot
+
+    const uint8_t *in = delta.data();
+    const uint8_t *end = in + delta.size();
+    uint8_t *word = image->data();
+    while (in < end)
+    {
+      size_t unchanged, changed;
+      in = GetCount(in, &unchanged);
+      in = GetCount(in, &changed);
+      word += unchanged * 8;
+      for (size_t j = 0; j < changed; j++)
+      {
+        uint64_t value, x;
+        memcpy(&value, word, 8);
+        memcpy(&x, in, 8);
+        value ^= x;
+        memcpy(word, &value, 8);
+        word += 8;
+        in += 8;
+      }
+    }
+
+    image->resize(olderSize);
+  }
+
+  void RewindBuffer::Push(std::vector<uint8_t> *image)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    WaitIdle(lock);
+
+    m_stats.snapshots++;
+    m_stats.imageBytes += image->size();
+
+    if (!m_haveLatest)
+    {
+      m_latest.swap(*image);
+      image->swap(m_next);
+      m_haveLatest = true;
+      Trim();
+      return;
+    }
+
+    // The delta of the current latest snapshot against this one is made in
+    // the background, after which this one is the latest
+    m_next.swap(*image);
+    m_pending = true;
+    if (!m_thread.joinable())
+      m_thread = std::thread(&RewindBuffer::WorkerThread, this);
+    lock.unlock();
+    m_cv.notify_all();
+  }
+
+  bool RewindBuffer::Pop(std::vector<uint8_t> *image)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    WaitIdle(lock);
+
+    if (!m_haveLatest)
+      return false;
+    image->assign(m_latest.begin(), m_latest.end());
+
+    // The one before becomes the latest
+    if (m_deltas.empty())
+      m_haveLatest = false;
+    else
+    {
+      Delta &delta = m_deltas.back();
+      ApplyDelta(&m_latest, delta.data, delta.size);
+      m_deltaBytes -= delta.data.size();
+      m_deltas.pop_back();
+    }
+    return true;
+  }
+
+  void RewindBuffer::Clear()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    WaitIdle(lock);
+    m_deltas.clear();
+    m_deltaBytes = 0;
+    m_haveLatest = false;
+  }
+
+  size_t RewindBuffer::Count()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_deltas.size() + size_t(m_haveLatest) + size_t(m_pending);
+  }
+
+  size_t RewindBuffer::MemoryUsed()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_latest.capacity() + m_next.capacity() + m_scratch.capacity() + m_deltaBytes;
+  }
+
+  RewindBuffer::Stats RewindBuffer::GetStats()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+  }
+
+  void RewindBuffer::WaitIdle(std::unique_lock<std::mutex> &lock)
+  {
+    m_cv.wait(lock, [this] { return !m_pending; });
+  }
+
+  // Drops the oldest snapshots until within budget, always keeping the latest
+  void RewindBuffer::Trim()
+  {
+    while (!m_deltas.empty() && m_latest.capacity() + m_next.capacity() + m_scratch.capacity() + m_deltaBytes > m_maxBytes)
+    {
+      m_deltaBytes -= m_deltas.front().data.size();
+      m_deltas.pop_front();
+    }
+  }
+
+  void RewindBuffer::WorkerThread()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+      m_cv.wait(lock, [this] { return m_exit || m_pending; });
+      if (m_exit)
+        return;
+
+      lock.unlock();
+
+      // Nothing else touches the snapshots while one is pending. The delta is
+      // made in a buffer big enough for any and then copied, so it takes no
+      // more memory than it needs.
+      auto start = std::chrono::steady_clock::now();
+      Delta delta;
+      delta.size = m_latest.size();
+      MakeDelta(m_latest, m_next, &m_scratch);
+      delta.data.assign(m_scratch.begin(), m_scratch.end());
+      m_latest.swap(m_next);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+      lock.lock();
+      m_stats.deltaBytes += delta.data.size();
+      m_stats.deltaSeconds += elapsed.count();
+      m_deltaBytes += delta.data.size();
+      m_deltas.push_back(std::move(delta));
+      Trim();
+      m_pending = false;
+      m_cv.notify_all();
+    }
+  }
+
+  RewindBuffer::RewindBuffer(size_t maxBytes)
+    : m_maxBytes(maxBytes)
+  {
+  }
+
+  RewindBuffer::~RewindBuffer()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_exit = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+} // Util
@@ -0,0 +1,78 @@
+#ifndef INCLUDED_UTIL_REWINDBUFFER_H
+#define INCLUDED_UTIL_REWINDBUFFER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Util
+{
+  /*
+   * Keeps a history of snapshots (save state images) to step back through,
+   * within a memory budget. Only the most recent snapshot is kept whole. Each
+   * older one is stored as the XOR of it with the one after it, encoded as runs
+   * of unchanged 64-bit words and of changed ones, so memory that two
+   * snapshots have in common costs next to nothing. Deltas are made on a
+   * thread of its own while emulation carries on. The oldest snapshots are
+   * dropped to stay within the budget.
+   */
+  class RewindBuffer
+  {
+  public:
+    struct Stats
+    {
+      uint64_t  snapshots;      // pushed
+      uint64_t  imageBytes;     // their total size
+      uint64_t  deltaBytes;     // total size of the deltas made of them
+      double    deltaSeconds;   // total time taken making deltas
+    };
+
+    // Adds a snapshot, taking the image by swapping it with a buffer that can
+    // be reused for the next
+    void Push(std::vector<uint8_t> *image);
+
+    // Removes the most recent snapshot and copies it to the image. Returns
+    // false if there are none left.
+    bool Pop(std::vector<uint8_t> *image);
+
+    void Clear();
+    size_t Count();
+    size_t MemoryUsed();
+    Stats GetStats();
+
+    RewindBuffer(size_t maxBytes);
+    ~RewindBuffer();
+
+  private:
+    struct Delta
+    {
+      std::vector<uint8_t> data;
+      size_t size;              // of the older snapshot
+    };
+
+    void WorkerThread();
+    void WaitIdle(std::unique_lock<std::mutex> &lock);
+    void Trim();
+
+    size_t                    m_maxBytes;
+    std::vector<uint8_t>      m_latest;       // most recent snapshot, whole
+    bool                      m_haveLatest = false;
+    std::vector<uint8_t>      m_next;         // pushed, waiting to be diffed against m_latest
+    bool                      m_pending = false;
+    std::deque<Delta>         m_deltas;       // oldest first
+    std::vector<uint8_t>      m_scratch;      // delta being made
+    size_t                    m_deltaBytes = 0;
+    Stats                     m_stats = {};
+
+    std::thread               m_thread;
+    std::mutex                m_mutex;
+    std::condition_variable   m_cv;
+    bool                      m_exit = false;
+  };
+} // Util
+
+#endif  // INCLUDED_UTIL_REWINDBUFFER_H
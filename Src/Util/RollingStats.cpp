@@ -0,0 +1,63 @@
+#include "Util/RollingStats.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Util
+{
+  void RollingStats::Add(uint32_t value)
+  {
+    if (m_samples.size() < m_window)
+      m_samples.push_back(value);
+    else
+    {
+      m_sum -= m_samples[m_next];
+      m_samples[m_next] = value;
+    }
+    m_sum += value;
+    m_next = (m_next + 1) % m_window;
+  }
+
+  void RollingStats::Clear()
+  {
+    m_samples.clear();
+    m_next = 0;
+    m_sum = 0;
+  }
+
+  size_t RollingStats::Count() const
+  {
+    return m_samples.size();
+  }
+
+  uint32_t RollingStats::Min() const
+  {
+    return m_samples.empty() ? 0 : *std::min_element(m_samples.begin(), m_samples.end());
+  }
+
+  uint32_t RollingStats::Max() const
+  {
+    return m_samples.empty() ? 0 : *std::max_element(m_samples.begin(), m_samples.end());
+  }
+
+  double RollingStats::Average() const
+  {
+    return m_samples.empty() ? 0.0 : double(m_sum) / m_samples.size();
+  }
+
+  uint32_t RollingStats::Percentile(double percent) const
+  {
+    if (m_samples.empty())
+      return 0;
+    size_t rank = size_t(std::ceil(percent / 100.0 * m_samples.size()));
+    size_t index = rank == 0 ? 0 : std::min(rank - 1, m_samples.size() - 1);
+    m_scratch = m_samples;
+    std::nth_element(m_scratch.begin(), m_scratch.begin() + index, m_scratch.end());
+    return m_scratch[index];
+  }
+
+  RollingStats::RollingStats(size_t window)
+    : m_window(window > 0 ? window : 1)
+  {
+    m_samples.reserve(m_window);
+  }
+} // Util
@@ -0,0 +1,41 @@
+#ifndef INCLUDED_UTIL_ROLLINGSTATS_H
+#define INCLUDED_UTIL_ROLLINGSTATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Util
+{
+  /*
+   * Keeps the most recent samples of a measurement (frame times, etc.) in a
+   * ring buffer and reports their minimum, average and percentiles. Adding a
+   * sample is constant time; percentiles are found on demand with a partial
+   * sort, so should be asked for occasionally rather than per sample.
+   */
+  class RollingStats
+  {
+  public:
+    void Add(uint32_t value);
+    void Clear();
+    size_t Count() const;
+    uint32_t Min() const;
+    uint32_t Max() const;
+    double Average() const;
+
+    // Smallest sample that is at least as large as the given percentage of all samples
+    uint32_t Percentile(double percent) const;
+
+    // Window is the number of most recent samples considered
+    RollingStats(size_t window);
+
+  private:
+    std::vector<uint32_t> m_samples;
+    size_t m_window;
+    size_t m_next = 0;
+    uint64_t m_sum = 0;
+    mutable std::vector<uint32_t> m_scratch;
+  };
+} // Util
+
+#endif  // INCLUDED_UTIL_ROLLINGSTATS_H
@@ -0,0 +1,124 @@
+#ifndef INCLUDED_UTIL_SPSCRING_H
+#define INCLUDED_UTIL_SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Util
+{
+  /*
+   * Fixed size FIFO between one producer thread and one consumer thread,
+   * without locks. Each side owns one index and only reads the other's, so
+   * an acquire/release pair per value is all the synchronization needed.
+   *
+   * Size must be a power of two. One slot is always left empty so that full
+   * and empty differ, meaning Size-1 values fit, and the indices alone (as
+   * kept in save states) describe the contents. A value pushed when full is
+   * dropped and counted rather than overwriting the oldest.
+   */
+  template <typename T, size_t Size>
+  class SPSCRing
+  {
+    static_assert((Size & (Size - 1)) == 0, "SPSCRing size must be a power of two");
+
+  public:
+    static const uint32_t Mask = uint32_t(Size - 1);
+
+    // Producer only. Returns false, and counts an overflow, if full.
+    bool Push(T value)
+    {
+      uint32_t write = m_write.load(std::memory_order_relaxed);
+      uint32_t next = (write + 1) & Mask;
+      if (next == m_read.load(std::memory_order_acquire))
+      {
+        m_overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      m_data[write] = value;
+      m_write.store(next, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer only. The oldest value, or if empty, whatever was last in the slot the next one will fill.
+    T Peek() const
+    {
+      uint32_t read = m_read.load(std::memory_order_relaxed);
+      (void) m_write.load(std::memory_order_acquire);   // so that a value just pushed is seen
+      return m_data[read];
+    }
+
+    // Consumer only. Returns false if empty.
+    bool Pop(T *value)
+    {
+      uint32_t read = m_read.load(std::memory_order_relaxed);
+      if (read == m_write.load(std::memory_order_acquire))
+        return false;
+      *value = m_data[read];
+      m_read.store((read + 1) & Mask, std::memory_order_release);
+      return true;
+    }
+
+    // Exact when called by either side; the other can only have made it closer to what it wants
+    bool Empty() const
+    {
+      return m_read.load(std::memory_order_acquire) == m_write.load(std::memory_order_acquire);
+    }
+
+    size_t Count() const
+    {
+      return (m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire)) & Mask;
+    }
+
+    // Values dropped by Push() because the ring was full
+    uint32_t Overflows() const
+    {
+      return m_overflows.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * Raw contents, indices and restoring them, for save states. Neither
+     * thread may be using the ring meanwhile.
+     */
+    const T *Data() const
+    {
+      return m_data;
+    }
+
+    uint32_t ReadIndex() const
+    {
+      return m_read.load(std::memory_order_relaxed);
+    }
+
+    uint32_t WriteIndex() const
+    {
+      return m_write.load(std::memory_order_relaxed);
+    }
+
+    void Restore(const T *data, uint32_t readIndex, uint32_t writeIndex)
+    {
+      for (size_t i = 0; i < Size; i++)
+        m_data[i] = data[i];
+      m_read.store(readIndex & Mask, std::memory_order_relaxed);
+      m_write.store(writeIndex & Mask, std::memory_order_relaxed);
+    }
+
+    // Neither thread may be using the ring
+    void Clear()
+    {
+      for (auto &v: m_data)
+        v = T();
+      m_read.store(0, std::memory_order_relaxed);
+      m_write.store(0, std::memory_order_relaxed);
+      m_overflows.store(0, std::memory_order_relaxed);
+    }
+
+  private:
+    T m_data[Size] = {};
+    std::atomic<uint32_t> m_read{0};    // next slot to pop, written by the consumer
+    std::atomic<uint32_t> m_write{0};   // next slot to push, written by the producer
+    std::atomic<uint32_t> m_overflows{0};
+  };
+} // Util
+
+#endif  // INCLUDED_UTIL_SPSCRING_H
@@ -0,0 +1,114 @@
+#include "Util/TaskGraph.h"
+#include "Util/Format.h"
+
+namespace Util
+{
+  TaskGraph::Task TaskGraph::Start(const char *name, Function fn, std::initializer_list<Task> deps)
+  {
+    Task task;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      task = m_entries.size();
+      m_entries.emplace_back();
+      m_entries.back().name = name;
+    }
+    std::vector<Task> depList(deps);
+    m_threads.emplace_back([this, task, fn, depList]() { Execute(task, fn, depList); });
+    return task;
+  }
+
+  bool TaskGraph::Run(const char *name, Function fn, std::initializer_list<Task> deps)
+  {
+    Task task;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      task = m_entries.size();
+      m_entries.emplace_back();
+      m_entries.back().name = name;
+    }
+    return Execute(task, fn, std::vector<Task>(deps));
+  }
+
+  bool TaskGraph::Execute(Task task, const Function &fn, const std::vector<Task> &deps)
+  {
+    bool ready = true;
+    for (Task dep: deps)
+      ready &= Wait(dep);
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_entries[task].start = Elapsed();
+      m_entries[task].state = ready ? Running : Skipped;
+    }
+    if (!ready)
+    {
+      m_done.notify_all();
+      return false;
+    }
+
+    bool ok = fn();
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_entries[task].finish = Elapsed();
+      m_entries[task].state = ok ? Succeeded : Failed;
+    }
+    m_done.notify_all();
+    return ok;
+  }
+
+  bool TaskGraph::Wait(Task task)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]() { return m_entries[task].state != Pending && m_entries[task].state != Running; });
+    return m_entries[task].state == Succeeded;
+  }
+
+  void TaskGraph::WaitAll()
+  {
+    for (auto &thread: m_threads)
+    {
+      if (thread.joinable())
+        thread.join();
+    }
+  }
+
+  double TaskGraph::Elapsed() const
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_origin).count();
+  }
+
+  std::string TaskGraph::Summary() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> parts;
+    for (auto &entry: m_entries)
+    {
+      switch (entry.state)
+      {
+      case Succeeded:
+        parts.push_back(Util::Format() << entry.name << ' ' << unsigned(entry.start + 0.5) << '-' << unsigned(entry.finish + 0.5) << " ms");
+        break;
+      case Failed:
+        parts.push_back(entry.name + " failed");
+        break;
+      case Skipped:
+        parts.push_back(entry.name + " skipped");
+        break;
+      default:
+        break;
+      }
+    }
+    return Util::Format(", ").Join(parts);
+  }
+
+  TaskGraph::TaskGraph(std::chrono::steady_clock::time_point origin)
+    : m_origin(origin)
+  {
+  }
+
+  TaskGraph::~TaskGraph()
+  {
+    WaitAll();
+  }
+} // Util
@@ -0,0 +1,87 @@
+#ifndef INCLUDED_UTIL_TASKGRAPH_H
+#define INCLUDED_UTIL_TASKGRAPH_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Util
+{
+  /*
+   * Runs a few long tasks, such as those making up start-up, each as soon as
+   * the tasks it depends on have finished. Tasks added with Start() get a
+   * thread of their own, and unlike JobSystem jobs they may block on files or
+   * devices. Run() runs a task on the calling thread instead, for work that
+   * must stay there (window and GL calls). A task whose dependencies did not
+   * all succeed is not run, and counts as failed. Tasks must all be added from
+   * the same thread.
+   *
+   * Every task's start and finish are timed from the graph's origin, so that
+   * where start-up spends its time, and how much of it overlaps, can be
+   * reported.
+   */
+  class TaskGraph
+  {
+  public:
+    typedef size_t Task;
+    typedef std::function<bool()> Function;  // returns true on success
+
+    // Runs fn on a new thread once all of deps have succeeded
+    Task Start(const char *name, Function fn, std::initializer_list<Task> deps = {});
+
+    // Runs fn on the calling thread once all of deps have succeeded, and
+    // returns whether it did
+    bool Run(const char *name, Function fn, std::initializer_list<Task> deps = {});
+
+    // Waits for a task to finish (or be skipped), and returns whether it
+    // succeeded
+    bool Wait(Task task);
+
+    // Waits for all tasks started so far
+    void WaitAll();
+
+    // Milliseconds since the origin
+    double Elapsed() const;
+
+    // Each task that has finished, in the order added, as "name start-end ms",
+    // or "name failed"/"name skipped"
+    std::string Summary() const;
+
+    TaskGraph(std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now());
+    ~TaskGraph();
+
+  private:
+    enum State
+    {
+      Pending,
+      Running,
+      Succeeded,
+      Failed,
+      Skipped
+    };
+
+    struct Entry
+    {
+      std::string name;
+      State state = Pending;
+      double start = 0;   // ms since origin
+      double finish = 0;
+    };
+
+    bool Execute(Task task, const Function &fn, const std::vector<Task> &deps);
+
+    std::chrono::steady_clock::time_point m_origin;
+    std::deque<Entry> m_entries;  // deque, so entries stay put as more are added
+    std::vector<std::thread> m_threads;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_done;
+  };
+} // Util
+
+#endif  // INCLUDED_UTIL_TASKGRAPH_H
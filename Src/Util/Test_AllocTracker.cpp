@@ -0,0 +1,131 @@
+// Build with -DSUPERMODEL_ALLOC_TRACKING, without which nothing is counted
+#include "Util/AllocTracker.h"
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+namespace AllocTracker = Util::AllocTracker;
+
+// Keeps the compiler from leaving out allocations whose results aren't used
+static void *volatile s_sink;
+
+static AllocTracker::Counts Since(const AllocTracker::Counts &before)
+{
+  AllocTracker::Counts now;
+  AllocTracker::Read(&now);
+  for (int i = 0; i < AllocTracker::NumSubsystems; i++)
+  {
+    now.allocations[i] -= before.allocations[i];
+    now.bytes[i] -= before.bytes[i];
+  }
+  return now;
+}
+
+// Allocations go to the innermost scope, and back to the outer one after it
+static bool TestScopes()
+{
+  AllocTracker::Counts before;
+  AllocTracker::Read(&before);
+  {
+    ALLOC_SCOPE(Render);
+    for (int i = 0; i < 3; i++)
+    {
+      int *p = new int[25];
+      s_sink = p;
+      delete[] p;
+    }
+    {
+      ALLOC_SCOPE(Sync);
+      std::unique_ptr<double> p(new double(1.0));
+      s_sink = p.get();
+    }
+  }
+  AllocTracker::Counts counts = Since(before);
+  return counts.allocations[AllocTracker::Render] == 3 && counts.bytes[AllocTracker::Render] == 3 * 25 * sizeof(int) &&
+    counts.allocations[AllocTracker::Sync] == 1 && counts.bytes[AllocTracker::Sync] == sizeof(double);
+}
+
+// Other threads are counted under their own subsystem
+static bool TestThreads()
+{
+  AllocTracker::Counts before;
+  AllocTracker::Read(&before);
+  std::thread other([]()
+  {
+    AllocTracker::SetThreadSubsystem(AllocTracker::Jobs);
+    for (int i = 0; i < 10; i++)
+    {
+      char *p = new char[100];
+      s_sink = p;
+      delete[] p;
+    }
+  });
+  other.join();
+  AllocTracker::Counts counts = Since(before);
+  return counts.allocations[AllocTracker::Jobs] == 10 && counts.bytes[AllocTracker::Jobs] == 1000;
+}
+
+// malloc is counted as well where it can be replaced
+static bool TestMalloc()
+{
+#if defined(__GLIBC__)
+  AllocTracker::Counts before;
+  AllocTracker::Read(&before);
+  {
+    ALLOC_SCOPE(Audio);
+    void *p = malloc(64);
+    s_sink = p;
+    free(p);
+  }
+  AllocTracker::Counts counts = Since(before);
+  return counts.allocations[AllocTracker::Audio] == 1 && counts.bytes[AllocTracker::Audio] == 64;
+#else
+  return true;
+#endif
+}
+
+// A call site allocating every time turns up in the samples
+static bool TestSampling()
+{
+  AllocTracker::StartSampling();
+  {
+    ALLOC_SCOPE(NetBoard);
+    for (unsigned i = 0; i < 100 * AllocTracker::SAMPLE_INTERVAL; i++)
+    {
+      int *p = new int;
+      s_sink = p;
+      delete p;
+    }
+  }
+  std::string report = AllocTracker::SampleReport(1);
+  return report.find("net") != std::string::npos && report.find("100") != std::string::npos && report.find('\n') == report.size() - 1;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "Enabled", AllocTracker::Enabled() });
+  test_results.push_back({ "Scopes", TestScopes() });
+  test_results.push_back({ "Threads", TestThreads() });
+  test_results.push_back({ "Malloc", TestMalloc() });
+  test_results.push_back({ "Sampling", TestSampling() });
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
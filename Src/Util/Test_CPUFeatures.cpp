@@ -0,0 +1,97 @@
+#include "Util/CPUFeatures.h"
+#include "Util/ByteSwap.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+namespace CPUFeatures = Util::CPUFeatures;
+
+struct Implementation
+{
+  const char *name;
+  uint32_t features;
+};
+
+static const uint32_t MISSING = 1u << 31;  // no CPU has this
+
+static const Implementation s_implementations[] =
+{
+  { "missing",  MISSING },
+  { "baseline", CPUFeatures::Baseline() },
+  { "plain",    0 }
+};
+
+// What the compiler assumes is always there, and detection is stable
+static bool TestBaseline()
+{
+  return CPUFeatures::Have(CPUFeatures::Baseline()) && CPUFeatures::Have(0) && !CPUFeatures::Have(MISSING) &&
+         CPUFeatures::Detected() == CPUFeatures::Detected();
+}
+
+static bool TestNames()
+{
+  return CPUFeatures::Names(CPUFeatures::SSE2 | CPUFeatures::SSE41 | CPUFeatures::AVX2) == "sse2 sse4.1 avx2" &&
+         CPUFeatures::Names(0) == "none";
+}
+
+// The best supported entry is chosen, and unsupported or unknown ones can't be set
+static bool TestFind()
+{
+  return CPUFeatures::FindBest(s_implementations) == &s_implementations[1] &&
+         CPUFeatures::Find(s_implementations, "plain") == &s_implementations[2] &&
+         CPUFeatures::Find(s_implementations, "missing") == nullptr &&
+         CPUFeatures::Find(s_implementations, "unknown") == nullptr;
+}
+
+// Every byte swap the CPU runs gives the same result, including the words after the last vector
+static bool TestByteSwap()
+{
+  std::vector<uint8_t> src(4 * 37), expected(src.size()), dest(src.size());
+  for (size_t i = 0; i < src.size(); i++)
+  {
+    src[i] = uint8_t(i * 7 + 3);
+    expected[i ^ 3] = src[i];
+  }
+  std::string initial = Util::GetByteSwapImplementation();
+  int tested = 0;
+  for (const char *name : { "ssse3", "sse2", "neon", "scalar" })
+  {
+    if (!Util::SetByteSwapImplementation(name))
+      continue;
+    std::fill(dest.begin(), dest.end(), 0);
+    Util::CopyFlipEndian32(dest.data(), src.data(), src.size());
+    if (dest != expected)
+      return false;
+    ++tested;
+  }
+  Util::SetByteSwapImplementation(initial.c_str());
+  return tested > 0;
+}
+
+int main()
+{
+  std::cout << "CPU features: " << CPUFeatures::Names(CPUFeatures::Detected()) << std::endl;
+
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "Baseline", TestBaseline() });
+  test_results.push_back({ "Names", TestNames() });
+  test_results.push_back({ "Find", TestFind() });
+  test_results.push_back({ "ByteSwap", TestByteSwap() });
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
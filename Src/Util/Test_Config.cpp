@@ -202,6 +202,46 @@ int main()
     test_results.push_back({ "Duplicate leaf nodes", config.ToString() == expected_config });
   }
 
+  // Bindings should follow changes to the value and to the whole tree
+  {
+    Util::Config::Node config("global");
+    config.Set<std::string>("Balance", "25");
+    Util::Config::Binding<float> balance(config, "Balance");
+    test_results.push_back({ "Binding 1", balance == 25.0f });
+    config.Set<std::string>("Balance", "-50");
+    test_results.push_back({ "Binding 2", balance == -50.0f });
+    config.Set("Balance", 10.5f);
+    test_results.push_back({ "Binding 3", balance == 10.5f });
+    Util::Config::Node other("global");
+    other.Set<std::string>("Balance", "100");
+    config = other;
+    test_results.push_back({ "Binding 4", balance == 100.0f });
+  }
+
+  // Snapshots should be rebuilt on change, leaving old ones intact
+  {
+    struct Settings
+    {
+      bool throttle;
+      unsigned frequency;
+      Settings(const Util::Config::Node &config)
+        : throttle(config["Throttle"].ValueAs<bool>()),
+          frequency(config["Frequency"].ValueAs<unsigned>())
+      {}
+    };
+    Util::Config::Node config("global");
+    config.Set<std::string>("Throttle", "true");
+    config.Set<std::string>("Frequency", "0x32");
+    Util::Config::Snapshot<Settings> snapshot(config);
+    auto before = snapshot.Get();
+    test_results.push_back({ "Snapshot 1", before->throttle && before->frequency == 50 });
+    test_results.push_back({ "Snapshot 2", snapshot.Get() == before });
+    config.Set<std::string>("Throttle", "false");
+    auto after = snapshot.Get();
+    test_results.push_back({ "Snapshot 3", !after->throttle && after->frequency == 50 });
+    test_results.push_back({ "Snapshot 4", before->throttle });
+  }
+
   PrintTestResults(test_results);
   return 0;
 }
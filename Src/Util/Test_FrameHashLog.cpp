@@ -0,0 +1,119 @@
+#include "Util/FrameHashLog.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+static const char *FILE_NAME = "Test_FrameHashLog.txt";
+static const std::vector<std::string> NAMES = { "ram", "real3d", "audio" };
+
+static void Hashes(uint64_t frame, uint64_t hashes[3])
+{
+  for (int i = 0; i < 3; i++)
+    hashes[i] = (frame + 1) * 0x9E3779B97F4A7C15ULL + uint64_t(i);
+}
+
+static void WriteLog(uint64_t frames)
+{
+  Util::FrameHashLog log;
+  log.Write(FILE_NAME, "scud", NAMES);
+  for (uint64_t frame = 0; frame < frames; frame++)
+  {
+    uint64_t hashes[3];
+    Hashes(frame, hashes);
+    log.Frame(hashes);
+  }
+}
+
+// A run that matches the log never diverges
+static bool TestMatch()
+{
+  WriteLog(100);
+  Util::FrameHashLog log;
+  std::string error;
+  if (!log.Compare(FILE_NAME, "scud", NAMES, &error))
+    return false;
+  for (uint64_t frame = 0; frame < 100; frame++)
+  {
+    uint64_t hashes[3];
+    Hashes(frame, hashes);
+    if (!log.Frame(hashes))
+      return false;
+  }
+  return !log.Diverged() && !log.LogEnded() && log.Frames() == 100;
+}
+
+// The first frame that differs is reported, with the hashes that differed,
+// and later ones are not
+static bool TestDiverge()
+{
+  WriteLog(100);
+  Util::FrameHashLog log;
+  std::string error;
+  log.Compare(FILE_NAME, "scud", NAMES, &error);
+  int failures = 0;
+  for (uint64_t frame = 0; frame < 100; frame++)
+  {
+    uint64_t hashes[3];
+    Hashes(frame, hashes);
+    if (frame >= 42)
+      hashes[1] ^= 1;
+    if (frame >= 50)
+      hashes[2] ^= 1;
+    failures += !log.Frame(hashes);
+  }
+  return failures == 1 && log.Diverged() && log.DivergedFrame() == 42 && log.DivergedNames() == "real3d";
+}
+
+// Frames past the end of the log are not compared
+static bool TestLogEnded()
+{
+  WriteLog(10);
+  Util::FrameHashLog log;
+  std::string error;
+  log.Compare(FILE_NAME, "scud", NAMES, &error);
+  for (uint64_t frame = 0; frame < 20; frame++)
+  {
+    uint64_t hashes[3];
+    Hashes(frame, hashes);
+    if (!log.Frame(hashes))
+      return false;
+  }
+  return log.LogEnded() && !log.Diverged();
+}
+
+// Logs of another game or other hashes are refused
+static bool TestMismatch()
+{
+  WriteLog(1);
+  Util::FrameHashLog log;
+  std::string error;
+  bool otherGame = log.Compare(FILE_NAME, "lemans24", NAMES, &error);
+  bool otherNames = log.Compare(FILE_NAME, "scud", { "ram", "audio" }, &error);
+  return !otherGame && !otherNames && !error.empty();
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "Match", TestMatch() });
+  test_results.push_back({ "Diverge", TestDiverge() });
+  test_results.push_back({ "Log ended", TestLogEnded() });
+  test_results.push_back({ "Mismatch", TestMismatch() });
+  remove(FILE_NAME);
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include "Util/FramePacer.h"
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point since)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Frames keep to the rate over many waits, without the error adding up
+static bool TestRate()
+{
+  Util::FramePacer pacer(200.0);
+  auto start = std::chrono::steady_clock::now();
+  pacer.Wait();
+  for (int i = 0; i < 100; i++)
+    pacer.Wait();
+  double elapsed = Seconds(start);
+  return elapsed >= 0.5 && elapsed < 0.6 && pacer.Error().Average() < 2000;
+}
+
+// Work done between waits is taken out of the wait
+static bool TestWorkAbsorbed()
+{
+  Util::FramePacer pacer(100.0);
+  auto start = std::chrono::steady_clock::now();
+  pacer.Wait();
+  for (int i = 0; i < 20; i++)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(4));
+    pacer.Wait();
+  }
+  double elapsed = Seconds(start);
+  return elapsed >= 0.2 && elapsed < 0.25 && pacer.GetStats().late == 0;
+}
+
+// A frame late by over a period begins pacing again rather than being caught
+// up on by rushing the next ones
+static bool TestRestart()
+{
+  Util::FramePacer pacer(100.0);
+  pacer.Wait();
+  pacer.Wait();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  pacer.Wait();
+  auto start = std::chrono::steady_clock::now();
+  pacer.Wait();
+  double elapsed = Seconds(start);
+  return pacer.GetStats().restarts == 1 && elapsed >= 0.009;
+}
+
+// Scaling the period changes the rate from the next frame on
+static bool TestPeriodScale()
+{
+  Util::FramePacer pacer(200.0);
+  pacer.Wait();
+  for (int i = 0; i < 10; i++)
+    pacer.Wait();
+  pacer.SetPeriodScale(2.0);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 20; i++)
+    pacer.Wait();
+  double elapsed = Seconds(start);
+  return elapsed >= 0.195 && elapsed < 0.23 && pacer.GetStats().late == 0;
+}
+
+// Waiting sleeps most of the time rather than spinning
+static bool TestSleeps()
+{
+  Util::FramePacer pacer(60.0);
+  auto start = std::chrono::steady_clock::now();
+  std::clock_t cpu_start = std::clock();
+  pacer.Wait();
+  for (int i = 0; i < 30; i++)
+    pacer.Wait();
+  double cpu = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+  return cpu < 0.25 * Seconds(start);
+}
+
+// Waiting until a time is as close as waiting for a frame, and isn't one
+static bool TestWaitUntil()
+{
+  Util::FramePacer pacer(60.0);
+  auto start = std::chrono::steady_clock::now();
+  pacer.WaitUntil(start + std::chrono::milliseconds(20));
+  double elapsed = Seconds(start);
+  pacer.WaitUntil(start);
+  return elapsed >= 0.02 && elapsed < 0.022 && Seconds(start) < 0.022 && pacer.GetStats().frames == 0;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "Rate", TestRate() });
+  test_results.push_back({ "Work absorbed", TestWorkAbsorbed() });
+  test_results.push_back({ "Restart", TestRestart() });
+  test_results.push_back({ "Period scale", TestPeriodScale() });
+  test_results.push_back({ "Sleeps", TestSleeps() });
+  test_results.push_back({ "Wait until", TestWaitUntil() });
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include "Util/FrameSkipper.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+static const uint32_t BUDGET = 16667;
+
+/*
+ * Runs frames of fixed emulation and rendering cost against a frame pacer
+ * with absolute deadlines, as the main loop does, and returns the fraction
+ * drawn. Also returns the most frames skipped in a row and whether the pacer
+ * fell so far behind that it would have given up catching up.
+ */
+static double Simulate(uint32_t emulation, uint32_t render, unsigned max_skip, unsigned *longest_skip, bool *fell_behind)
+{
+  Util::FrameSkipper skipper(BUDGET, max_skip);
+  uint64_t now = 0, due = 0;
+  bool draw = true;
+  unsigned drawn = 0, run = 0;
+  *longest_skip = 0;
+  *fell_behind = false;
+  for (int frame = 0; frame < 600; frame++)
+  {
+    uint32_t frame_micros = emulation + (draw ? render : 0);
+    now += frame_micros;
+    due += BUDGET;
+    uint32_t late = 0;
+    if (now > due)
+    {
+      late = uint32_t(now - due);
+      if (late > BUDGET)
+      {
+        *fell_behind = true;
+        due = now;
+      }
+    }
+    else
+      now = due;
+    drawn += draw;
+    run = draw ? 0 : run + 1;
+    *longest_skip = std::max(*longest_skip, run);
+    draw = skipper.Update(frame_micros, draw ? render : 0, draw, late);
+  }
+  return drawn / 600.0;
+}
+
+// Frames that fit are all drawn
+static bool TestNoSkip()
+{
+  unsigned longest;
+  bool fell_behind;
+  return Simulate(8000, 6000, 3, &longest, &fell_behind) == 1.0 && !fell_behind;
+}
+
+// Rendering that doesn't quite fit is skipped just often enough to keep up
+static bool TestSomeSkipped()
+{
+  unsigned longest;
+  bool fell_behind;
+  double drawn = Simulate(8000, 12000, 3, &longest, &fell_behind);
+  return drawn > 0.5 && drawn < 1.0 && longest == 1 && !fell_behind;
+}
+
+// However slow rendering is, no more than the most allowed are skipped in a row
+static bool TestMaxSkip()
+{
+  unsigned longest;
+  bool fell_behind;
+  double drawn = Simulate(10000, 60000, 2, &longest, &fell_behind);
+  return longest == 2 && drawn > 0.3 && drawn < 0.34;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "No skip", TestNoSkip() });
+  test_results.push_back({ "Some skipped", TestSomeSkipped() });
+  test_results.push_back({ "Max skip", TestMaxSkip() });
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include "Util/JobSystem.h"
+#include <iostream>
+#include <string>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+// Every index is visited exactly once
+static bool TestParallelFor(Util::JobSystem &jobs, size_t count)
+{
+  std::vector<std::atomic<int>> visits(count);
+  for (auto &v: visits)
+    v = 0;
+  jobs.ParallelFor(count, [&](size_t i) { visits[i]++; });
+  for (auto &v: visits)
+  {
+    if (v != 1)
+      return false;
+  }
+  return true;
+}
+
+// Jobs that submit and wait on jobs of their own
+static bool TestNested(Util::JobSystem &jobs)
+{
+  std::atomic<int> total(0);
+  Util::JobSystem::Group outer;
+  for (int i = 0; i < 16; i++)
+  {
+    jobs.Submit(outer, [&]()
+    {
+      Util::JobSystem::Group inner;
+      for (int j = 0; j < 16; j++)
+        jobs.Submit(inner, [&]() { total++; });
+      jobs.Wait(inner);
+    });
+  }
+  jobs.Wait(outer);
+  return total == 16 * 16;
+}
+
+// Several threads outside the scheduler submitting and waiting at once
+static bool TestConcurrentClients(Util::JobSystem &jobs)
+{
+  std::atomic<int> total(0);
+  std::vector<std::thread> clients;
+  for (int c = 0; c < 4; c++)
+  {
+    clients.emplace_back([&]()
+    {
+      for (int round = 0; round < 100; round++)
+        jobs.ParallelFor(10, [&](size_t) { total++; });
+    });
+  }
+  for (auto &client: clients)
+    client.join();
+  return total == 4 * 100 * 10;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+
+  for (unsigned workers: { 0u, 1u, 3u })
+  {
+    Util::JobSystem jobs(workers);
+    std::string suffix = " (" + std::to_string(workers) + " workers)";
+    test_results.push_back({ "ParallelFor empty" + suffix, TestParallelFor(jobs, 0) });
+    test_results.push_back({ "ParallelFor" + suffix, TestParallelFor(jobs, 10000) });
+    test_results.push_back({ "Nested groups" + suffix, TestNested(jobs) });
+    test_results.push_back({ "Concurrent clients" + suffix, TestConcurrentClients(jobs) });
+  }
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
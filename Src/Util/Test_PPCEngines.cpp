@@ -0,0 +1,126 @@
+#include "Supermodel.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+// The cores log through these; nothing here needs the output
+void DebugLog(const char *fmt, ...) {}
+void InfoLog(const char *fmt, ...) {}
+bool ErrorLog(const char *fmt, ...) { return FAIL; }
+uint32_t g_debugLogChannels = 0;
+
+static UINT32 D(int opcd, int rt, int ra, int d)  { return (opcd << 26) | (rt << 21) | (ra << 16) | (d & 0xFFFF); }
+static UINT32 X(int xo, int rs, int ra, int rb)   { return (31u << 26) | (rs << 21) | (ra << 16) | (rb << 11) | (xo << 1); }
+
+static UINT8 s_ram[0x10000];  // stored as byte-reversed words, like CModel3
+static UINT8 s_rom[0x1000];   // reset vector at 0xFFF00100
+
+class CTestBus: public IBus
+{
+};
+
+// Runs a program out of RAM at 0x100 (ending in a branch to itself) under an
+// engine and gets the GPRs it leaves. False if the host lacks the engine.
+static bool Run(PPC_ENGINE engine, const std::vector<UINT32> &program, UINT32 gpr[32])
+{
+  memset(s_ram, 0, sizeof(s_ram));
+  memset(s_rom, 0, sizeof(s_rom));
+  *(UINT32 *) &s_rom[0x100] = 0x48000102;  // ba 0x100
+  for (size_t i = 0; i < program.size(); i++)
+    *(UINT32 *) &s_ram[0x100 + 4 * i] = program[i];
+  *(UINT32 *) &s_ram[0x100 + 4 * program.size()] = 0x48000000;  // b .
+
+  static CTestBus bus;
+  static PPC_FETCH_REGION fetch[3];
+  PPC_CONFIG config;
+  config.pvr = PPC_MODEL_603R;
+  config.bus_frequency = BUS_FREQUENCY_66MHZ;
+  config.bus_frequency_multiplier = 0x25;
+  PPC_CONTEXT *ctx = ppc_create_context();
+  ppc_set_context(ctx);
+  ppc_attach_bus(&bus);
+  ppc_init(&config);
+  fetch[0] = { 0x00000000, 0x0000FFFF, (UINT32 *) s_ram };
+  fetch[1] = { 0xFFF00000, 0xFFF00FFF, (UINT32 *) s_rom };
+  fetch[2] = { 0, 0, NULL };
+  ppc_set_fetch(fetch);
+  if (!ppc_set_engine(engine))
+  {
+    ppc_destroy_context(ctx);
+    return false;
+  }
+  ppc_reset();
+  ppc_execute(10000);
+  for (unsigned i = 0; i < 32; i++)
+    gpr[i] = ppc_get_gpr(i);
+  ppc_destroy_context(ctx);
+  return true;
+}
+
+// Every engine leaves the same registers as the interpreter
+static bool TestEngines(const std::vector<UINT32> &program)
+{
+  static const PPC_ENGINE engines[] = { PPC_ENGINE_THREADED, PPC_ENGINE_JIT };
+  UINT32 expected[32];
+  Run(PPC_ENGINE_INTERPRETER, program, expected);
+  for (PPC_ENGINE engine: engines)
+  {
+    UINT32 gpr[32];
+    if (Run(engine, program, gpr) && memcmp(gpr, expected, sizeof(gpr)))
+      return false;
+  }
+  return true;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+
+  // The JIT emits these natively; mr (or rA,rS,rS) and its and form copy rS
+  // but xor rA,rS,rS clears rA
+  std::vector<UINT32> logical =
+  {
+    D(15, 1, 0, 0xDEAD),  // lis r1,0xdead
+    X(316, 1, 1, 1),      // xor r1,r1,r1
+    D(15, 2, 0, 0x1234),  // lis r2,0x1234
+    D(24, 2, 2, 0x5678),  // ori r2,r2,0x5678
+    X(444, 2, 3, 2),      // mr r3,r2
+    X(28, 2, 4, 2),       // and r4,r2,r2
+    X(316, 2, 5, 2),      // xor r5,r2,r2
+    D(14, 6, 0, -2),      // li r6,-2
+    X(28, 2, 7, 6),       // and r7,r2,r6
+    X(316, 2, 8, 6),      // xor r8,r2,r6
+    X(444, 2, 9, 6)       // or r9,r2,r6
+  };
+  test_results.push_back({ "Logical", TestEngines(logical) });
+
+  std::vector<UINT32> arithmetic =
+  {
+    D(14, 1, 0, 1000),    // li r1,1000
+    D(14, 2, 0, -7),      // li r2,-7
+    X(266, 3, 1, 2),      // add r3,r1,r2
+    X(40, 4, 1, 2),       // subf r4,r1,r2
+    D(14, 5, 1, -1000),   // addi r5,r1,-1000
+    D(15, 6, 2, 1),       // addis r6,r2,1
+    D(26, 2, 7, 0xFFFF),  // xori r7,r2,0xffff
+    D(27, 2, 8, 0x8000)   // xoris r8,r2,0x8000
+  };
+  test_results.push_back({ "Arithmetic", TestEngines(arithmetic) });
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "Util/RewindBuffer.h"
+#include <iostream>
+#include <string>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+static unsigned s_seed = 1;
+
+static uint8_t Random()
+{
+  s_seed = s_seed * 1664525 + 1013904223;
+  return uint8_t(s_seed >> 24);
+}
+
+// Snapshots that change a little each time, now and then changing size
+static std::vector<std::vector<uint8_t>> MakeSnapshots(size_t count, size_t size)
+{
+  std::vector<std::vector<uint8_t>> snapshots;
+  std::vector<uint8_t> image(size);
+  for (auto &b: image)
+    b = Random();
+  for (size_t i = 0; i < count; i++)
+  {
+    for (int j = 0; j < 20; j++)
+      image[(size_t(Random()) << 8 | Random()) % image.size()] = Random();
+    if (i % 5 == 2)
+      image.resize(image.size() + Random() % 13);
+    if (i % 7 == 4)
+      image.resize(image.size() - Random() % 11);
+    snapshots.push_back(image);
+  }
+  return snapshots;
+}
+
+// Snapshots come back newest first, exactly as pushed
+static bool TestRoundTrip(size_t count)
+{
+  auto snapshots = MakeSnapshots(count, 100000);
+  Util::RewindBuffer rewind(size_t(64) << 20);
+  std::vector<uint8_t> image;
+  for (auto &snapshot: snapshots)
+  {
+    image = snapshot;
+    rewind.Push(&image);
+  }
+  if (rewind.Count() != count)
+    return false;
+  for (size_t i = count; i-- > 0; )
+  {
+    if (!rewind.Pop(&image) || image != snapshots[i])
+      return false;
+  }
+  return !rewind.Pop(&image) && rewind.Count() == 0;
+}
+
+// Pushing again after stepping back carries on from there
+static bool TestPushAfterPop()
+{
+  auto snapshots = MakeSnapshots(10, 50000);
+  Util::RewindBuffer rewind(size_t(64) << 20);
+  std::vector<uint8_t> image;
+  for (size_t i = 0; i < 6; i++)
+  {
+    image = snapshots[i];
+    rewind.Push(&image);
+  }
+  for (int i = 0; i < 3; i++)
+    rewind.Pop(&image);
+  for (size_t i = 6; i < 10; i++)
+  {
+    image = snapshots[i];
+    rewind.Push(&image);
+  }
+  for (size_t i: { 9, 8, 7, 6, 2, 1, 0 })
+  {
+    if (!rewind.Pop(&image) || image != snapshots[i])
+      return false;
+  }
+  return rewind.Count() == 0;
+}
+
+// The oldest are dropped to stay within the budget, and the rest still come back right
+static bool TestBudget()
+{
+  auto snapshots = MakeSnapshots(200, 100000);
+  Util::RewindBuffer rewind(220000);
+  std::vector<uint8_t> image;
+  for (auto &snapshot: snapshots)
+  {
+    image = snapshot;
+    rewind.Push(&image);
+  }
+  size_t count = rewind.Count();
+  if (count >= snapshots.size() || count < 2 || rewind.MemoryUsed() > 220000)
+    return false;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!rewind.Pop(&image) || image != snapshots[snapshots.size() - 1 - i])
+      return false;
+  }
+  return true;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "One snapshot", TestRoundTrip(1) });
+  test_results.push_back({ "Round trip", TestRoundTrip(50) });
+  test_results.push_back({ "Push after pop", TestPushAfterPop() });
+  test_results.push_back({ "Memory budget", TestBudget() });
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include "Util/SPSCRing.h"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+// Values come out in order, and Size-1 of them fit
+static bool TestFIFO()
+{
+  Util::SPSCRing<uint8_t, 8> ring;
+  for (int i = 0; i < 7; i++)
+  {
+    if (!ring.Push(uint8_t(i)))
+      return false;
+  }
+  if (ring.Count() != 7 || ring.Push(7) || ring.Overflows() != 1)
+    return false;
+  uint8_t value;
+  for (int i = 0; i < 7; i++)
+  {
+    if (ring.Peek() != i || !ring.Pop(&value) || value != i)
+      return false;
+  }
+  return ring.Empty() && !ring.Pop(&value);
+}
+
+// Restoring the raw contents and indices gives back the same queue, wrapped around or not
+static bool TestRestore()
+{
+  Util::SPSCRing<uint8_t, 8> ring;
+  uint8_t value;
+  for (int i = 0; i < 6; i++)
+    ring.Push(uint8_t(i));
+  for (int i = 0; i < 5; i++)
+    ring.Pop(&value);
+  for (int i = 6; i < 11; i++)
+    ring.Push(uint8_t(i));
+  Util::SPSCRing<uint8_t, 8> copy;
+  copy.Restore(ring.Data(), ring.ReadIndex(), ring.WriteIndex());
+  if (copy.Count() != 6)
+    return false;
+  for (int i = 5; i < 11; i++)
+  {
+    if (!copy.Pop(&value) || value != i)
+      return false;
+  }
+  return copy.Empty();
+}
+
+// Nothing is lost, duplicated or reordered between two threads
+static bool TestThreads()
+{
+  Util::SPSCRing<uint32_t, 128> ring;
+  const uint32_t count = 1000000;
+  std::thread producer([&]()
+  {
+    for (uint32_t i = 0; i < count; )
+    {
+      if (ring.Push(i))
+        i++;
+    }
+  });
+  bool inOrder = true;
+  for (uint32_t expected = 0; expected < count; )
+  {
+    uint32_t value;
+    if (ring.Pop(&value))
+      inOrder = inOrder && value == expected++;
+  }
+  producer.join();
+  return inOrder && ring.Empty();
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "FIFO", TestFIFO() });
+  test_results.push_back({ "Restore", TestRestore() });
+  test_results.push_back({ "Threads", TestThreads() });
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,87 @@
+#include "Util/TaskGraph.h"
+#include <atomic>
+#include <iostream>
+#include <string>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+// A task only starts once everything it depends on has finished
+static bool TestOrder()
+{
+  Util::TaskGraph graph;
+  std::atomic<int> step(0);
+  auto a = graph.Start("a", [&]() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); return step++ == 0; });
+  auto b = graph.Start("b", [&]() { return step++ == 1; }, { a });
+  bool c = graph.Run("c", [&]() { return step++ == 2; }, { a, b });
+  return c && graph.Wait(a) && graph.Wait(b) && step == 3;
+}
+
+// Independent tasks run at the same time
+static bool TestConcurrent()
+{
+  Util::TaskGraph graph;
+  std::atomic<int> running(0);
+  std::atomic<int> most(0);
+  auto fn = [&]()
+  {
+    int now = ++running;
+    int seen = most;
+    while (now > seen && !most.compare_exchange_weak(seen, now))
+      ;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    running--;
+    return true;
+  };
+  auto a = graph.Start("a", fn);
+  auto b = graph.Start("b", fn);
+  bool c = graph.Run("c", fn);
+  return c && graph.Wait(a) && graph.Wait(b) && most == 3;
+}
+
+// Failure skips everything that depends on it, but nothing else
+static bool TestFailure()
+{
+  Util::TaskGraph graph;
+  std::atomic<bool> ranDependent(false);
+  auto a = graph.Start("a", []() { return false; });
+  auto b = graph.Start("b", [&]() { ranDependent = true; return true; }, { a });
+  auto c = graph.Start("c", []() { return true; });
+  bool d = graph.Run("d", [&]() { ranDependent = true; return true; }, { b, c });
+  graph.WaitAll();
+  return !graph.Wait(a) && !graph.Wait(b) && graph.Wait(c) && !d && !ranDependent;
+}
+
+// Summary lists each task by how it ended
+static bool TestSummary()
+{
+  Util::TaskGraph graph;
+  auto a = graph.Start("a", []() { return false; });
+  graph.Start("b", []() { return true; }, { a });
+  graph.Run("c", []() { return true; });
+  graph.WaitAll();
+  std::string summary = graph.Summary();
+  return summary.find("a failed, b skipped, c ") == 0 && summary.rfind(" ms") == summary.length() - 3;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "Order", TestOrder() });
+  test_results.push_back({ "Concurrent", TestConcurrent() });
+  test_results.push_back({ "Failure", TestFailure() });
+  test_results.push_back({ "Summary", TestSummary() });
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
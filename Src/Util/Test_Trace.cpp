@@ -0,0 +1,108 @@
+#include "Util/Trace.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void PrintTestResults(std::vector<std::pair<std::string, bool>> results)
+{
+  std::cout << "TEST RESULTS" << std::endl;
+  std::cout << "------------" << std::endl;
+  for (auto v: results)
+    std::cout << v.first << ": " << (v.second ? "passed" : "FAILED") << std::endl;
+}
+
+static const char *FILE_NAME = "Test_Trace.json";
+
+static std::string ReadTrace()
+{
+  std::string text;
+  FILE *file = fopen(FILE_NAME, "r");
+  if (!file)
+    return text;
+  int c;
+  while ((c = fgetc(file)) != EOF)
+    text.push_back(char(c));
+  fclose(file);
+  return text;
+}
+
+static size_t Count(const std::string &text, const std::string &what)
+{
+  size_t count = 0;
+  for (size_t pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1))
+    count++;
+  return count;
+}
+
+// Zones from each thread are written under that thread's name
+static bool TestThreads()
+{
+  if (!Util::Trace::Start(FILE_NAME))
+    return false;
+  Util::Trace::SetThreadName("Test Main");
+  {
+    Util::Trace::Scope zone("MainZone");
+  }
+  std::thread other([]()
+  {
+    Util::Trace::SetThreadName("Test Other");
+    for (int i = 0; i < 3; i++)
+      Util::Trace::Scope zone("OtherZone");
+  });
+  other.join();
+  if (Util::Trace::Stop() != 0)
+    return false;
+  std::string text = ReadTrace();
+  return Count(text, "\"MainZone\"") == 1 && Count(text, "\"OtherZone\"") == 3 &&
+    Count(text, "\"Test Main\"") == 1 && Count(text, "\"Test Other\"") == 1 &&
+    text.compare(0, 15, "{\"traceEvents\":") == 0 && text.find("]}") != std::string::npos;
+}
+
+// Nothing is recorded outside of Start() and Stop(), and each trace holds
+// only its own zones
+static bool TestNotRecording()
+{
+  {
+    Util::Trace::Scope zone("Before");
+  }
+  Util::Trace::Start(FILE_NAME);
+  {
+    Util::Trace::Scope zone("During");
+  }
+  Util::Trace::Stop();
+  {
+    Util::Trace::Scope zone("After");
+  }
+  std::string text = ReadTrace();
+  return Count(text, "\"During\"") == 1 && Count(text, "\"Before\"") == 0 && Count(text, "\"After\"") == 0 &&
+    Count(text, "\"MainZone\"") == 0 && !Util::Trace::Recording();
+}
+
+// Names are escaped
+static bool TestEscape()
+{
+  Util::Trace::Start(FILE_NAME);
+  Util::Trace::Zone("Say \"hi\"", 1000, 2500);
+  Util::Trace::Stop();
+  std::string text = ReadTrace();
+  return text.find("\"Say \\\"hi\\\"\"") != std::string::npos && text.find("\"ts\":1.000,\"dur\":1.500") != std::string::npos;
+}
+
+int main()
+{
+  std::vector<std::pair<std::string, bool>> test_results;
+  test_results.push_back({ "Threads", TestThreads() });
+  test_results.push_back({ "Not recording", TestNotRecording() });
+  test_results.push_back({ "Escape", TestEscape() });
+  remove(FILE_NAME);
+
+  PrintTestResults(test_results);
+  for (auto v: test_results)
+  {
+    if (!v.second)
+      return 1;
+  }
+  return 0;
+}
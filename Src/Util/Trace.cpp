@@ -0,0 +1,147 @@
+#include "Util/Trace.h"
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Util
+{
+  namespace Trace
+  {
+    // Zones kept per thread, about 100 MB worth, after which they are dropped
+    static const size_t MAX_ZONES = 1 << 22;
+
+    struct ZoneRecord
+    {
+      const char  *name;
+      uint64_t    start;
+      uint64_t    end;
+    };
+
+    struct ThreadRecord
+    {
+      unsigned                id;
+      std::string             name;
+      std::vector<ZoneRecord> zones;
+      uint64_t                dropped = 0;
+    };
+
+    // Thread records are never freed, so that a thread's pointer to its own
+    // stays valid across traces
+    static std::mutex s_mutex;
+    static std::vector<std::unique_ptr<ThreadRecord>> s_threads;
+    static std::atomic<bool> s_recording(false);
+    static FILE *s_file = nullptr;
+    static std::chrono::steady_clock::time_point s_epoch;
+    static thread_local ThreadRecord *t_thread = nullptr;
+
+    static ThreadRecord *ThisThread()
+    {
+      if (!t_thread)
+      {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_threads.emplace_back(new ThreadRecord());
+        t_thread = s_threads.back().get();
+        t_thread->id = unsigned(s_threads.size());
+        t_thread->name = "Thread " + std::to_string(t_thread->id);
+      }
+      return t_thread;
+    }
+
+    static void WriteString(FILE *file, const char *str)
+    {
+      fputc('"', file);
+      for (; *str; str++)
+      {
+        if (*str == '"' || *str == '\\')
+          fputc('\\', file);
+        if (unsigned(*str) >= 0x20)
+          fputc(*str, file);
+      }
+      fputc('"', file);
+    }
+
+    bool Start(const std::string &file)
+    {
+      Stop();
+      std::lock_guard<std::mutex> lock(s_mutex);
+      s_file = fopen(file.c_str(), "w");
+      if (!s_file)
+        return false;
+      for (auto &thread: s_threads)
+      {
+        thread->zones.clear();
+        thread->dropped = 0;
+      }
+      s_epoch = std::chrono::steady_clock::now();
+      s_recording = true;
+      return true;
+    }
+
+    uint64_t Stop()
+    {
+      std::lock_guard<std::mutex> lock(s_mutex);
+      if (!s_file)
+        return 0;
+      s_recording = false;
+      uint64_t dropped = 0;
+
+      fputs("{\"traceEvents\":[\n", s_file);
+      bool first = true;
+      for (auto &thread: s_threads)
+      {
+        fprintf(s_file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread->id);
+        WriteString(s_file, thread->name.c_str());
+        fputs("}}", s_file);
+        first = false;
+        for (auto &zone: thread->zones)
+        {
+          fputs(",\n{\"name\":", s_file);
+          WriteString(s_file, zone.name);
+          fprintf(s_file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64 ".%03u}",
+            thread->id, zone.start / 1000, unsigned(zone.start % 1000), (zone.end - zone.start) / 1000, unsigned((zone.end - zone.start) % 1000));
+        }
+        dropped += thread->dropped;
+        thread->zones.clear();
+        thread->zones.shrink_to_fit();
+      }
+      fputs("\n]}\n", s_file);
+      fclose(s_file);
+      s_file = nullptr;
+      return dropped;
+    }
+
+    bool Recording()
+    {
+      return s_recording.load(std::memory_order_relaxed);
+    }
+
+    void SetThreadName(const std::string &name)
+    {
+      ThreadRecord *thread = ThisThread();
+      if (thread->name == name)
+        return;
+      std::lock_guard<std::mutex> lock(s_mutex);
+      thread->name = name;
+    }
+
+    uint64_t Now()
+    {
+      return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count());
+    }
+
+    void Zone(const char *name, uint64_t start, uint64_t end)
+    {
+      if (!Recording())
+        return;
+      ThreadRecord *thread = ThisThread();
+      if (thread->zones.size() < MAX_ZONES)
+        thread->zones.push_back({ name, start, end });
+      else
+        thread->dropped++;
+    }
+  } // Trace
+} // Util
@@ -0,0 +1,77 @@
+#ifndef INCLUDED_UTIL_TRACE_H
+#define INCLUDED_UTIL_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+namespace Util
+{
+  /*
+   * Records when zones of code ran on each thread and writes them out as a
+   * Chrome trace (JSON, viewable in chrome://tracing or Perfetto), to see on
+   * a timeline how the board threads, renderer and audio overlap and where
+   * they stall.
+   *
+   * Zones are marked with TRACE_ZONE(), which is only compiled in when
+   * SUPERMODEL_TRACE is defined (ENABLE_TRACE=1 in Makefiles/Options.inc).
+   * They record nothing until Start() is called.
+   */
+  namespace Trace
+  {
+    // Starts recording, to be written to a file by Stop(). Returns false if
+    // the file could not be created.
+    bool Start(const std::string &file);
+
+    // Stops recording and writes the file. Threads that recorded zones must
+    // be idle (e.g., paused) by then. Returns the number of zones dropped
+    // because a thread recorded too many.
+    uint64_t Stop();
+
+    bool Recording();
+
+    // Names the calling thread in the trace
+    void SetThreadName(const std::string &name);
+
+    // Nanoseconds since Start()
+    uint64_t Now();
+
+    // Records a zone that ran on the calling thread. Name must be a string
+    // that outlives the trace (a literal).
+    void Zone(const char *name, uint64_t start, uint64_t end);
+
+    // Records the zone it is alive for
+    class Scope
+    {
+    public:
+      Scope(const char *name)
+        : m_name(name),
+          m_recording(Recording()),
+          m_start(m_recording ? Now() : 0)
+      {
+      }
+
+      ~Scope()
+      {
+        if (m_recording)
+          Zone(m_name, m_start, Now());
+      }
+
+    private:
+      const char  *m_name;
+      bool        m_recording;
+      uint64_t    m_start;
+    };
+  } // Trace
+} // Util
+
+#ifdef SUPERMODEL_TRACE
+#define TRACE_ZONE_CONCAT2(a, b)  a##b
+#define TRACE_ZONE_CONCAT(a, b)   TRACE_ZONE_CONCAT2(a, b)
+#define TRACE_ZONE(name)          Util::Trace::Scope TRACE_ZONE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_THREAD_NAME(name)   Util::Trace::SetThreadName(name)
+#else
+#define TRACE_ZONE(name)
+#define TRACE_THREAD_NAME(name)
+#endif
+
+#endif  // INCLUDED_UTIL_TRACE_H